@@ -130,6 +130,21 @@ int gemm(char transa, char transb, int m, int n, int k, double alpha,
          const double * A, int lda, const double * b, int ldb,
          double beta, double * C, int ldc);
 
+/** Generalized matrix multiply for row major (C and boost::multi_array)
+    matrices: C = alpha op(A) op(B) + beta C, where C is m x n and op(A) and
+    op(B) are m x k and k x n.  The strides are those of the rows.  A row
+    major matrix is a column major one transposed, so this simply calculates
+    C' = op(B)' op(A)' with the column major gemm().
+*/
+template<typename Float>
+int gemm_row_major(char transa, char transb, int m, int n, int k,
+                   Float alpha, const Float * A, int lda,
+                   const Float * B, int ldb,
+                   Float beta, Float * C, int ldc)
+{
+    return gemm(transb, transa, n, m, k, alpha, B, ldb, A, lda, beta, C, ldc);
+}
+
 } // namespace LAPack
 } // namespace ML
 
@@ -173,6 +173,23 @@ std::string print_size(const boost::multi_array<Float, 2> & array)
     return format("%dx%d", (int)array.shape()[0], (int)array.shape()[1]);
 }
 
+// Return the elements of A (row major) as the type F.  This points into A
+// itself if it's already of that type, or into a copy made in storage if not.
+template<typename F, typename Float>
+const F * data_as(const boost::multi_array<Float, 2> & A,
+                  std::vector<F> & storage)
+{
+    storage.assign(A.data(), A.data() + A.num_elements());
+    return storage.empty() ? 0 : &storage[0];
+}
+
+template<typename F>
+const F * data_as(const boost::multi_array<F, 2> & A,
+                  std::vector<F> & storage)
+{
+    return A.data();
+}
+
 
 /*****************************************************************************/
 /* MATRIX VECTOR                                                             */
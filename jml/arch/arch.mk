@@ -1,5 +1,7 @@
 LIBARCH_SOURCES := \
         simd_vector.cc \
+	simd_vector_avx2.cc \
+	simd_vector_avx512.cc \
         demangle.cc \
 	tick_counter.cc \
 	cpuid.cc \
@@ -13,6 +15,7 @@ LIBARCH_SOURCES := \
 	environment_static.cc \
 	cpu_info.cc \
 	vm.cc \
+	huge_page_pool.cc \
 	info.cc \
 	rtti_utils.cc \
 	rt.cc
@@ -25,6 +28,8 @@ endif
 
 $(eval $(call library,arch,$(LIBARCH_SOURCES),$(LIBARCH_LINK)))
 $(eval $(call set_single_compile_option,simd_vector.cc,-funsafe-loop-optimizations -Wunsafe-loop-optimizations))
+$(eval $(call set_single_compile_option,simd_vector_avx2.cc,-mavx2 -mfma -ffp-contract=off))
+$(eval $(call set_single_compile_option,simd_vector_avx512.cc,-mavx512f -ffp-contract=off))
 
 $(eval $(call library,exception_hook,exception_hook.cc,arch dl))
 
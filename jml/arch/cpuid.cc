@@ -30,6 +30,7 @@ enum {
     CPUID_MONITOR_MWAIT = 5,
     CPUID_THERMAL_POWER = 6,
     CPUID_DCA_ACCESS = 7,
+    CPUID_STRUCTURED_FEATURES = 7,
     CPUID_EXT_LEVEL =      0x80000000,
     CPUID_EXT_FEATURES =   0x80000001,
     CPUID_EXT_BRAND1 =     0x80000002,
@@ -83,6 +84,13 @@ cpuid(uint32_t request, uint32_t ecx = 0)
     return result;
 }
 
+uint64_t xgetbv(uint32_t index)
+{
+    uint32_t eax, edx;
+    asm volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (index));
+    return eax | ((uint64_t)edx << 32);
+}
+
 } // file scope
 
 uint32_t cpuid_flags()
@@ -112,8 +120,6 @@ std::string model_id()
 {
     uint32_t cpuid_extlevel = cpuid(CPUID_EXT_LEVEL).eax;
 
-    cerr << "cpuid_extlevel = " << setw(16) << cpuid_extlevel << endl;
-
     if (cpuid_extlevel < 0x80000000 || cpuid_extlevel > 0x8000ffff)
         return "";  // no model if no extended CPUID
 
@@ -139,6 +145,8 @@ std::string model_id()
 CPU_Info::CPU_Info()
 {
     cpuid_level = cpuid_extlevel = standard1 = standard2 = extended = amd = 0;
+    structured = 0;
+    xcr0 = 0;
 
     cpuid_level = cpuid(CPUID_LEVEL).eax;
     cpuid_extlevel = cpuid(CPUID_EXT_LEVEL).eax;
@@ -162,6 +170,12 @@ CPU_Info::CPU_Info()
         amd = r.ecx;
     }
 
+    if (cpuid_level >= CPUID_STRUCTURED_FEATURES)
+        structured = cpuid(CPUID_STRUCTURED_FEATURES, 0).ebx;
+
+    if (osxsave)
+        xcr0 = xgetbv(0);
+
 #if 0
     if (fpu) cerr << "fpu ";
 
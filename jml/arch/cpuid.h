@@ -79,12 +79,19 @@ struct CPU_Info {
             uint32_t tm2:1;       // 8
             uint32_t pni:1;
             uint32_t cid:1;
-            uint32_t res5:2;      // 11, 12
+            uint32_t res5:1;      // 11
+            uint32_t fma:1;       // 12
             uint32_t cx16:1;      // 13
             uint32_t xtpr:1;      // 14
             uint32_t res6:3;      // 15, 16, 17
             uint32_t dca:1;       // 18
-            uint32_t res7:14;
+            uint32_t sse41:1;     // 19
+            uint32_t sse42:1;     // 20
+            uint32_t res7:5;      // 21-25
+            uint32_t xsave:1;     // 26
+            uint32_t osxsave:1;   // 27
+            uint32_t avx:1;       // 28
+            uint32_t res8:3;      // 29, 30, 31
         };
         uint32_t standard2;
     };
@@ -141,6 +148,29 @@ struct CPU_Info {
         uint32_t amd;
     };
 
+    // Structured extended flags (leaf 7, ebx)
+    union {
+        struct {
+            uint32_t res1_7:3;    // 0, 1, 2
+            uint32_t bmi1:1;      // 3
+            uint32_t res2_7:1;    // 4
+            uint32_t avx2:1;      // 5
+            uint32_t res3_7:2;    // 6, 7
+            uint32_t bmi2:1;      // 8
+            uint32_t res4_7:7;    // 9-15
+            uint32_t avx512f:1;   // 16
+            uint32_t avx512dq:1;  // 17
+            uint32_t res5_7:12;   // 18-29
+            uint32_t avx512bw:1;  // 30
+            uint32_t avx512vl:1;  // 31
+        };
+        uint32_t structured;
+    };
+
+    /** Register state that the OS saves on a context switch (XCR0); the
+        AVX registers can only be used if it does.  Zero without osxsave. */
+    uint64_t xcr0;
+
     std::string print_flags();
 };
 
@@ -0,0 +1,313 @@
+/* huge_page_pool.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Pool allocator backed by huge pages.
+*/
+
+#include "huge_page_pool.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/atomic_ops.h"
+#include "jml/arch/vm.h"
+
+#include <sys/mman.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <new>
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* HUGE PAGES                                                                */
+/*****************************************************************************/
+
+namespace {
+
+/* Bytes mapped for each Huge_Page_Kind */
+size_t mapped_bytes[HUGE_PAGES_NONE + 1];
+
+size_t round_up(size_t size, size_t page)
+{
+    return (size + page - 1) & ~(page - 1);
+}
+
+void * try_map(size_t size, int flags)
+{
+    void * result = mmap(0, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return result == MAP_FAILED ? 0 : result;
+}
+
+/* Normal pages aligned on a huge page so that all of them can be made into
+   transparent huge pages. */
+void * try_map_transparent(size_t size)
+{
+    char * mem = (char *)try_map(size + huge_page_size, 0);
+    if (!mem)
+        return 0;
+
+    char * aligned = (char *)round_up((size_t)mem, huge_page_size);
+    if (aligned != mem)
+        munmap(mem, aligned - mem);
+    size_t after = (mem + size + huge_page_size) - (aligned + size);
+    if (after)
+        munmap(aligned + size, after);
+
+    madvise(aligned, size, MADV_HUGEPAGE);
+    return aligned;
+}
+
+} // file scope
+
+Huge_Page_Kind
+max_huge_page_kind()
+{
+    static Huge_Page_Kind result = [] ()
+        {
+            const char * env = getenv("JML_HUGE_PAGES");
+            if (!env || !strcmp(env, "2m"))
+                return HUGE_PAGES_2MB;
+            if (!strcmp(env, "1g"))
+                return HUGE_PAGES_1GB;
+            if (!strcmp(env, "thp"))
+                return HUGE_PAGES_TRANSPARENT;
+            if (!strcmp(env, "none"))
+                return HUGE_PAGES_NONE;
+            cerr << "unknown JML_HUGE_PAGES value " << env
+                 << "; using 2MB pages" << endl;
+            return HUGE_PAGES_2MB;
+        } ();
+
+    return result;
+}
+
+void *
+map_huge_pages(size_t & size, Huge_Page_Kind & kind)
+{
+    Huge_Page_Kind max_kind = max_huge_page_kind();
+    void * result = 0;
+
+    if (max_kind <= HUGE_PAGES_1GB && size >= giant_page_size) {
+        size_t rounded = round_up(size, giant_page_size);
+        if ((result = try_map(rounded, MAP_HUGETLB | MAP_HUGE_1GB))) {
+            size = rounded;
+            kind = HUGE_PAGES_1GB;
+        }
+    }
+
+    if (!result && max_kind <= HUGE_PAGES_2MB) {
+        size_t rounded = round_up(size, huge_page_size);
+        if ((result = try_map(rounded, MAP_HUGETLB | MAP_HUGE_2MB))) {
+            size = rounded;
+            kind = HUGE_PAGES_2MB;
+        }
+    }
+
+    if (!result && max_kind <= HUGE_PAGES_TRANSPARENT) {
+        size_t rounded = round_up(size, huge_page_size);
+        if ((result = try_map_transparent(rounded))) {
+            size = rounded;
+            kind = HUGE_PAGES_TRANSPARENT;
+        }
+    }
+
+    if (!result) {
+        size_t rounded = round_up(size, page_size);
+        if (!(result = try_map(rounded, 0)))
+            throw Exception(errno, "map_huge_pages: mmap");
+        size = rounded;
+        kind = HUGE_PAGES_NONE;
+    }
+
+    atomic_add(mapped_bytes[kind], size);
+    return result;
+}
+
+void
+unmap_huge_pages(void * mem, size_t size, Huge_Page_Kind kind)
+{
+    if (munmap(mem, size) == -1)
+        throw Exception(errno, "unmap_huge_pages: munmap");
+    atomic_add(mapped_bytes[kind], -size);
+}
+
+
+/*****************************************************************************/
+/* HUGE_PAGE_POOL                                                            */
+/*****************************************************************************/
+
+namespace {
+
+/* Every pool in existence, for the stats */
+std::mutex pools_lock;
+std::vector<const Huge_Page_Pool *> all_pools;
+
+/* The process-wide pools by block size */
+std::mutex shared_pools_lock;
+std::map<size_t, Huge_Page_Pool *> shared_pools;
+
+/* The arrays mapped by huge_page_allocate(), with their rounded size */
+std::mutex arrays_lock;
+std::map<void *, std::pair<size_t, Huge_Page_Kind> > arrays;
+size_t array_bytes_in_use = 0;
+
+} // file scope
+
+Huge_Page_Pool::
+Huge_Page_Pool(size_t object_size, size_t slab_size)
+    : object_size_(round_up(std::max(object_size, sizeof(Free_Block)), 16)),
+      slab_size(std::max<size_t>(slab_size, object_size_)),
+      free_list(0), current(0), current_end(0), in_use(0)
+{
+    std::lock_guard<std::mutex> guard(pools_lock);
+    all_pools.push_back(this);
+}
+
+Huge_Page_Pool::
+~Huge_Page_Pool()
+{
+    {
+        std::lock_guard<std::mutex> guard(pools_lock);
+        all_pools.erase(std::find(all_pools.begin(), all_pools.end(), this));
+    }
+
+    for (auto & slab: slabs)
+        unmap_huge_pages(slab.mem, slab.size, slab.kind);
+}
+
+void *
+Huge_Page_Pool::
+allocate_slow()
+{
+    // Called with the lock held
+    if (current + object_size_ > current_end) {
+        Slab slab;
+        slab.size = slab_size;
+        try {
+            slab.mem = map_huge_pages(slab.size, slab.kind);
+        } catch (...) {
+            --in_use;
+            throw;
+        }
+        slabs.push_back(slab);
+        current = (char *)slab.mem;
+        current_end = current + slab.size;
+    }
+
+    void * result = current;
+    current += object_size_;
+    return result;
+}
+
+size_t
+Huge_Page_Pool::
+bytes_mapped() const
+{
+    std::lock_guard<Spinlock> guard(lock);
+    size_t result = 0;
+    for (auto & slab: slabs)
+        result += slab.size;
+    return result;
+}
+
+Huge_Page_Pool &
+huge_page_pool(size_t object_size)
+{
+    object_size = round_up(object_size, 16);
+
+    std::lock_guard<std::mutex> guard(shared_pools_lock);
+    Huge_Page_Pool * & result = shared_pools[object_size];
+    if (!result)
+        result = new Huge_Page_Pool(object_size);
+    return *result;
+}
+
+void *
+huge_page_allocate(size_t bytes)
+{
+    if (bytes < huge_page_size)
+        return ::operator new(bytes);
+
+    Huge_Page_Kind kind;
+    void * result = map_huge_pages(bytes, kind);
+
+    std::lock_guard<std::mutex> guard(arrays_lock);
+    arrays[result] = make_pair(bytes, kind);
+    array_bytes_in_use += bytes;
+    return result;
+}
+
+void
+huge_page_deallocate(void * mem, size_t bytes)
+{
+    if (bytes < huge_page_size) {
+        ::operator delete(mem);
+        return;
+    }
+
+    std::pair<size_t, Huge_Page_Kind> mapping;
+    {
+        std::lock_guard<std::mutex> guard(arrays_lock);
+        auto it = arrays.find(mem);
+        if (it == arrays.end())
+            throw Exception("huge_page_deallocate: unknown array");
+        mapping = it->second;
+        array_bytes_in_use -= mapping.first;
+        arrays.erase(it);
+    }
+
+    unmap_huge_pages(mem, mapping.first, mapping.second);
+}
+
+Huge_Page_Stats
+huge_page_stats()
+{
+    Huge_Page_Stats result;
+    result.bytes_1gb = mapped_bytes[HUGE_PAGES_1GB];
+    result.bytes_2mb = mapped_bytes[HUGE_PAGES_2MB];
+    result.bytes_transparent = mapped_bytes[HUGE_PAGES_TRANSPARENT];
+    result.bytes_normal = mapped_bytes[HUGE_PAGES_NONE];
+
+    {
+        std::lock_guard<std::mutex> guard(pools_lock);
+        for (auto pool: all_pools)
+            result.bytes_in_use += pool->num_in_use() * pool->object_size();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(arrays_lock);
+        result.bytes_in_use += array_bytes_in_use;
+    }
+
+    return result;
+}
+
+} // namespace ML
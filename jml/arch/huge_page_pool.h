@@ -0,0 +1,239 @@
+/* huge_page_pool.h                                                -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Pool allocator backed by huge pages, for large tables that live for a
+   long time and whose lookups would otherwise be dominated by TLB misses.
+*/
+
+#ifndef __jml__arch__huge_page_pool_h__
+#define __jml__arch__huge_page_pool_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "jml/arch/spinlock.h"
+#include "jml/compiler/compiler.h"
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* HUGE PAGES                                                                */
+/*****************************************************************************/
+
+enum {
+    huge_page_shift = 21,
+    huge_page_size  = 1 << huge_page_shift,     ///< 2MB
+    giant_page_size = 1 << 30                   ///< 1GB
+};
+
+/** How the memory of a mapping is backed, from the best to the worst. */
+enum Huge_Page_Kind {
+    HUGE_PAGES_1GB,             ///< explicit 1GB pages (hugetlbfs)
+    HUGE_PAGES_2MB,             ///< explicit 2MB pages (hugetlbfs)
+    HUGE_PAGES_TRANSPARENT,     ///< normal pages, madvised for THP
+    HUGE_PAGES_NONE             ///< normal pages
+};
+
+/** Best kind of pages that map_huge_pages() may use.  It's given by the
+    JML_HUGE_PAGES environment variable: "1g" allows 1GB pages for the
+    mappings of at least 1GB, "2m" (the default) stops at 2MB pages, "thp"
+    only uses transparent huge pages and "none" uses normal pages.
+*/
+Huge_Page_Kind max_huge_page_kind();
+
+/** Map at least size bytes of anonymous memory, trying explicit huge pages
+    first and falling back down to normal pages as each kind fails (usually
+    because no huge pages are reserved).  size is rounded up to the page
+    size of the kind used, which is returned in kind.  Throws if no memory
+    at all can be mapped.
+*/
+void * map_huge_pages(size_t & size, Huge_Page_Kind & kind);
+
+/** Unmap memory returned by map_huge_pages(). */
+void unmap_huge_pages(void * mem, size_t size, Huge_Page_Kind kind);
+
+/** Memory mapped by map_huge_pages() and handed out by the pools. */
+struct Huge_Page_Stats {
+    Huge_Page_Stats()
+        : bytes_1gb(0), bytes_2mb(0), bytes_transparent(0), bytes_normal(0),
+          bytes_in_use(0)
+    {
+    }
+
+    size_t bytes_1gb;           ///< mapped with 1GB pages
+    size_t bytes_2mb;           ///< mapped with 2MB pages
+    size_t bytes_transparent;   ///< mapped for transparent huge pages
+    size_t bytes_normal;        ///< mapped with normal pages
+    size_t bytes_in_use;        ///< handed out and not yet freed
+
+    size_t bytes_mapped() const
+    {
+        return bytes_1gb + bytes_2mb + bytes_transparent + bytes_normal;
+    }
+};
+
+/** Totals over all of the mappings of the process.  Thread-safe. */
+Huge_Page_Stats huge_page_stats();
+
+
+/*****************************************************************************/
+/* HUGE_PAGE_POOL                                                            */
+/*****************************************************************************/
+
+/** Slab allocator of fixed size blocks carved out of huge page mappings.
+
+    Freed blocks are kept on a free list for the next allocations and the
+    slabs are only unmapped when the pool is destroyed, which suits tables
+    that grow to a working size and then stay there.  The size of the
+    blocks is rounded up to a multiple of 16 bytes, which they are aligned
+    on.
+
+    Thread-safe; the lock is only held to pop or push a block, so it is
+    only contended by threads that allocate very heavily from one pool.
+*/
+
+struct Huge_Page_Pool {
+
+    /** A pool of blocks of object_size bytes, mapped slab_size bytes at a
+        time. */
+    Huge_Page_Pool(size_t object_size, size_t slab_size = huge_page_size);
+
+    ~Huge_Page_Pool();
+
+    void * allocate()
+    {
+        std::lock_guard<Spinlock> guard(lock);
+        ++in_use;
+        if (JML_LIKELY(free_list != 0)) {
+            Free_Block * block = free_list;
+            free_list = block->next;
+            return block;
+        }
+        return allocate_slow();
+    }
+
+    void deallocate(void * mem)
+    {
+        std::lock_guard<Spinlock> guard(lock);
+        Free_Block * block = reinterpret_cast<Free_Block *>(mem);
+        block->next = free_list;
+        free_list = block;
+        --in_use;
+    }
+
+    size_t object_size() const { return object_size_; }
+
+    /** Number of blocks handed out and not yet freed. */
+    size_t num_in_use() const { return in_use; }
+
+    /** Bytes of memory mapped by the pool. */
+    size_t bytes_mapped() const;
+
+private:
+    struct Free_Block {
+        Free_Block * next;
+    };
+
+    void * allocate_slow();
+
+    size_t object_size_;
+    size_t slab_size;
+
+    mutable Spinlock lock;
+    Free_Block * free_list;
+    char * current;             ///< Next block never handed out
+    char * current_end;         ///< End of the last slab
+    size_t in_use;
+
+    struct Slab {
+        void * mem;
+        size_t size;
+        Huge_Page_Kind kind;
+    };
+    std::vector<Slab> slabs;
+
+    Huge_Page_Pool(const Huge_Page_Pool &) = delete;
+    void operator = (const Huge_Page_Pool &) = delete;
+};
+
+/** The process-wide pool for blocks of the given size (rounded up to 16
+    bytes), which is created on first use and never destroyed. */
+Huge_Page_Pool & huge_page_pool(size_t object_size);
+
+/** Allocate an array of bytes bytes.  The arrays of at least a huge page
+    get a mapping of their own and the smaller ones come from operator new,
+    since there is little to gain from mapping them separately or from
+    keeping a pool for each of their sizes.
+*/
+void * huge_page_allocate(size_t bytes);
+
+/** Free memory from huge_page_allocate(), given the same bytes. */
+void huge_page_deallocate(void * mem, size_t bytes);
+
+
+/*****************************************************************************/
+/* HUGE_PAGE_ALLOCATOR                                                       */
+/*****************************************************************************/
+
+/** Standard allocator over the process-wide huge page pools, to be given
+    to the node-based containers (std::map, std::unordered_map...).  Single
+    objects come from the pool for their size and the arrays (such as the
+    buckets of a hash table) from huge_page_allocate().
+*/
+
+template<typename T>
+struct Huge_Page_Allocator {
+    typedef T value_type;
+
+    Huge_Page_Allocator()
+    {
+    }
+
+    template<typename U>
+    Huge_Page_Allocator(const Huge_Page_Allocator<U> &)
+    {
+    }
+
+    T * allocate(size_t n)
+    {
+        // Here rather than in the class so that T can be incomplete there
+        static_assert(alignof(T) <= 16, "pool blocks are only aligned on 16");
+
+        if (JML_LIKELY(n == 1))
+            return reinterpret_cast<T *>(pool().allocate());
+        return reinterpret_cast<T *>(huge_page_allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T * mem, size_t n)
+    {
+        if (JML_LIKELY(n == 1))
+            pool().deallocate(mem);
+        else huge_page_deallocate(mem, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator == (const Huge_Page_Allocator<U> &) const
+    {
+        return true;
+    }
+
+    template<typename U>
+    bool operator != (const Huge_Page_Allocator<U> &) const
+    {
+        return false;
+    }
+
+private:
+    static Huge_Page_Pool & pool()
+    {
+        static Huge_Page_Pool & result = huge_page_pool(sizeof(T));
+        return result;
+    }
+};
+
+} // namespace ML
+
+#endif /* __jml__arch__huge_page_pool_h__ */
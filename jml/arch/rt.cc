@@ -6,6 +6,11 @@
 */
 
 #include "rt.h"
+#include "jml/arch/exception.h"
+#include <fstream>
+#include <sched.h>
+
+using namespace std;
 
 namespace ML {
 
@@ -25,5 +30,79 @@ bool makeThreadRealTime(unsigned long long handle,
     return true;
 }
 
+bool setThreadAffinity(unsigned long long handle,
+                       const std::vector<int> & cpus)
+{
+    if (cpus.empty())
+        return true;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu: cpus)
+        CPU_SET(cpu, &set);
+
+    int res = pthread_setaffinity_np(handle, sizeof(set), &set);
+    return res == 0;
+}
+
+bool setCurrentThreadAffinity(const std::vector<int> & cpus)
+{
+    return setThreadAffinity(pthread_self(), cpus);
+}
+
+std::vector<int> parseCpuList(const std::string & spec)
+{
+    if (spec.compare(0, 5, "node:") == 0) {
+        string filename = "/sys/devices/system/node/node"
+            + spec.substr(5) + "/cpulist";
+        ifstream stream(filename.c_str());
+        string cpulist;
+        if (!stream || !getline(stream, cpulist))
+            throw Exception("couldn't read CPUs of NUMA node from "
+                            + filename);
+        return parseCpuList(cpulist);
+    }
+
+    std::vector<int> result;
+
+    const char * p = spec.c_str();
+    const char * end = p + spec.length();
+
+    auto expectNumber = [&] ()
+        {
+            if (p == end || *p < '0' || *p > '9')
+                throw Exception("invalid CPU list '%s'", spec.c_str());
+            int n = 0;
+            for (;  p != end && *p >= '0' && *p <= '9';  ++p) {
+                n = n * 10 + (*p - '0');
+                if (n >= CPU_SETSIZE)
+                    throw Exception("CPU number too large in '%s'",
+                                    spec.c_str());
+            }
+            return n;
+        };
+
+    while (p != end && *p != '\n') {
+        int first = expectNumber();
+        int last = first;
+        if (p != end && *p == '-') {
+            ++p;
+            last = expectNumber();
+            if (last < first)
+                throw Exception("invalid CPU range in '%s'", spec.c_str());
+        }
+
+        for (int cpu = first;  cpu <= last;  ++cpu)
+            result.push_back(cpu);
+
+        if (p != end && *p == ',')
+            ++p;
+        else if (p != end && *p != '\n')
+            throw Exception("invalid CPU list '%s'", spec.c_str());
+    }
+
+    return result;
+}
+
 } // namespace ML
 
@@ -9,6 +9,8 @@
 #define __jml__arch__rt_h__
 
 #include <boost/thread.hpp>
+#include <string>
+#include <vector>
 
 namespace ML {
 
@@ -30,6 +32,33 @@ inline bool makeThreadRealTime(boost::thread & thread, int priority)
     return makeThreadRealTime(thread.native_handle(), priority);
 }
 
+
+bool setThreadAffinity(unsigned long long handle,
+                       const std::vector<int> & cpus);
+
+/** Restrict the given thread to run only on the given CPUs.  An empty list
+    leaves the thread free to run anywhere.
+
+    Returns whether or not the call succeeded.
+*/
+
+inline bool setThreadAffinity(boost::thread & thread,
+                              const std::vector<int> & cpus)
+{
+    return setThreadAffinity(thread.native_handle(), cpus);
+}
+
+/** Restrict the calling thread to run only on the given CPUs. */
+bool setCurrentThreadAffinity(const std::vector<int> & cpus);
+
+/** Parse a CPU specification into the list of CPU numbers it names.  The
+    specification is either a list in the kernel's cpulist format, such as
+    "0-3,8,10-11", or "node:N" for all of the CPUs of NUMA node N (as read
+    from /sys/devices/system/node).  An empty specification gives an empty
+    list.  Throws on an invalid specification.
+*/
+std::vector<int> parseCpuList(const std::string & spec);
+
 } // namespace ML
 
 #endif /* __jml__arch__rt_h__ */
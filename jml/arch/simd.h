@@ -39,6 +39,24 @@ JML_ALWAYS_INLINE bool has_sse3() { return cpu_info().sse3; }
 
 JML_ALWAYS_INLINE bool has_pni() { return cpu_info().pni; }
 
+/* The AVX registers need support from the OS as well as the CPU: bits 1
+   and 2 of XCR0 are the SSE and AVX state, and bits 5 to 7 the AVX-512
+   state. */
+
+JML_ALWAYS_INLINE bool has_avx()
+{
+    return cpu_info().avx && (cpu_info().xcr0 & 0x6) == 0x6;
+}
+
+JML_ALWAYS_INLINE bool has_avx2() { return has_avx() && cpu_info().avx2; }
+
+JML_ALWAYS_INLINE bool has_fma() { return has_avx() && cpu_info().fma; }
+
+JML_ALWAYS_INLINE bool has_avx512f()
+{
+    return cpu_info().avx512f && (cpu_info().xcr0 & 0xe6) == 0xe6;
+}
+
 
 #endif // __i686__
 
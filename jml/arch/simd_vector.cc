@@ -28,12 +28,107 @@
 #include "sse2.h"
 #include "sse2_exp.h"
 #include "sse2_log.h"
+#include "simd_vector_avx.h"
+#include "jml/utils/environment.h"
 
 using namespace std;
 
 
 namespace ML {
 namespace SIMD {
+
+
+/*****************************************************************************/
+/* RUNTIME DISPATCH                                                          */
+/*****************************************************************************/
+
+/* The kernels that have AVX2 or AVX-512 versions start by calling the one
+   for the instruction set in use.  current_isa is zero, which is generic,
+   until it's initialized, so functions called during static
+   initialization are still safe. */
+
+namespace {
+
+Env_Option<std::string> vector_isa_option("JML_SIMD_VECTOR_ISA", "");
+
+Vector_Isa current_isa = ISA_GENERIC;
+
+bool supported(Vector_Isa isa)
+{
+    switch (isa) {
+    case ISA_GENERIC: return true;
+#ifdef JML_INTEL_ISA
+    case ISA_AVX2: return has_avx2() && has_fma();
+    case ISA_AVX512: return has_avx512f();
+#endif
+    default: return false;
+    }
+}
+
+Vector_Isa parse_isa(const std::string & name)
+{
+    for (int i = ISA_GENERIC;  i <= ISA_AVX512;  ++i)
+        if (name == vector_isa_name((Vector_Isa)i))
+            return (Vector_Isa)i;
+    throw Exception("unknown vector instruction set '%s'", name.c_str());
+}
+
+struct Init_Vector_Isa {
+    Init_Vector_Isa()
+    {
+        try {
+            // The environment can override the choice, for testing and
+            // benchmarking
+            std::string name = vector_isa_option.get();
+            if (name.empty()) current_isa = best_vector_isa();
+            else set_vector_isa(parse_isa(name));
+        } catch (const std::exception & exc) {
+            cerr << "SIMD vector kernels are using generic code: "
+                 << exc.what() << endl;
+        }
+    }
+} init_vector_isa;
+
+} // file scope
+
+#define JML_SIMD_DISPATCH(fn, args) \
+    switch (current_isa) { \
+    case ISA_AVX512: return Avx512::fn args; \
+    case ISA_AVX2: return Avx2::fn args; \
+    default: break; \
+    }
+
+const char * vector_isa_name(Vector_Isa isa)
+{
+    switch (isa) {
+    case ISA_GENERIC: return "generic";
+    case ISA_AVX2: return "avx2";
+    case ISA_AVX512: return "avx512";
+    default: return "unknown";
+    }
+}
+
+Vector_Isa best_vector_isa()
+{
+    if (supported(ISA_AVX512)) return ISA_AVX512;
+    if (supported(ISA_AVX2)) return ISA_AVX2;
+    return ISA_GENERIC;
+}
+
+Vector_Isa vector_isa()
+{
+    return current_isa;
+}
+
+void set_vector_isa(Vector_Isa isa)
+{
+    if (!supported(isa))
+        throw Exception("set_vector_isa(): this machine doesn't support the "
+                        "%s instruction set", vector_isa_name(isa));
+    current_isa = isa;
+}
+
+
 namespace Generic {
 
 template<typename X>
@@ -45,6 +140,8 @@ int ptr_align(const X * p)
 
 void vec_scale(const float * x, float k, float * r, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_scale, (x, k, r, n));
+
     v4sf kkkk = vec_splat(k);
     unsigned i = 0;
 
@@ -77,6 +174,8 @@ void vec_scale(const float * x, float k, float * r, size_t n)
 
 void vec_add(const float * x, const float * y, float * r, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_add, (x, y, r, n));
+
     unsigned i = 0;
 
     if (false) ;
@@ -115,6 +214,8 @@ void vec_add(const float * x, const float * y, float * r, size_t n)
 
 void vec_prod(const float * x, const float * y, float * r, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_prod, (x, y, r, n));
+
     unsigned i = 0;
 
     if (false) ;
@@ -205,6 +306,8 @@ void vec_prod(const double * x, const double * y, float * r, size_t n)
 
 void vec_add(const float * x, float k, const float * y, float * r, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_add, (x, k, y, r, n));
+
     v4sf kkkk = vec_splat(k);
     unsigned i = 0;
 
@@ -297,6 +400,8 @@ void vec_add(const float * x, float k, const float * y, float * r, size_t n)
 void vec_add(const float * x, const float * k, const float * y, float * r,
              size_t n)
 {
+    JML_SIMD_DISPATCH(vec_add, (x, k, y, r, n));
+
     unsigned i = 0;
 
     if (true) {
@@ -347,6 +452,8 @@ void vec_add(const float * x, float k, const double * y, float * r, size_t n)
 
 float vec_dotprod(const float * x, const float * y, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_dotprod, (x, y, n));
+
     double res = 0.0;
     for (unsigned i = 0;  i < n;  ++i) res += x[i] * y[i];
     return res;
@@ -354,6 +461,8 @@ float vec_dotprod(const float * x, const float * y, size_t n)
 
 void vec_scale(const double * x, double k, double * r, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_scale, (x, k, r, n));
+
     v2df kk = vec_splat(k);
     unsigned i = 0;
 
@@ -387,6 +496,8 @@ void vec_scale(const double * x, double k, double * r, size_t n)
 void vec_add(const double * x, double k, const double * y, double * r,
              size_t n)
 {
+    JML_SIMD_DISPATCH(vec_add, (x, k, y, r, n));
+
     v2df kk = vec_splat(k);
     unsigned i = 0;
 
@@ -433,6 +544,8 @@ void vec_add(const double * x, double k, const double * y, double * r,
 void vec_add(const double * x, const double * k, const double * y,
              double * r, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_add, (x, k, y, r, n));
+
     unsigned i = 0;
     if (true) {
         for (; i + 8 <= n;  i += 8) {
@@ -480,6 +593,8 @@ void vec_add(const double * x, const double * k, const double * y,
 
 double vec_dotprod(const double * x, const double * y, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_dotprod, (x, y, n));
+
     unsigned i = 0;
     double result = 0.0;
 
@@ -528,6 +643,8 @@ double vec_dotprod(const double * x, const double * y, size_t n)
 
 void vec_minus(const float * x, const float * y, float * r, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_minus, (x, y, r, n));
+
     for (unsigned i = 0;  i < n;  ++i) r[i] = x[i] - y[i];
 }
 
@@ -650,6 +767,8 @@ double vec_accum_prod3(const float * x, const float * y, const double * z,
 
 void vec_minus(const double * x, const double * y, double * r, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_minus, (x, y, r, n));
+
     for (unsigned i = 0;  i < n;  ++i) r[i] = x[i] - y[i];
 }
 
@@ -754,6 +873,8 @@ double vec_accum_prod3(const double * x, const double * y, const float * z,
 
 double vec_sum(const double * x, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_sum, (x, n));
+
     double res = 0.0;
     for (unsigned i = 0;  i < n;  ++i)
         res += x[i];
@@ -762,6 +883,8 @@ double vec_sum(const double * x, size_t n)
 
 double vec_dotprod_dp(const float * x, const float * y, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_dotprod_dp, (x, y, n));
+
     double res = 0.0;
     unsigned i = 0;
 
@@ -831,6 +954,8 @@ double vec_dotprod_dp(const float * x, const float * y, size_t n)
 
 double vec_dotprod_dp(const double * x, const float * y, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_dotprod_dp, (x, y, n));
+
     double res = 0.0;
 
     unsigned i = 0;
@@ -890,6 +1015,8 @@ double vec_dotprod_dp(const double * x, const float * y, size_t n)
 
 double vec_sum_dp(const float * x, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_sum_dp, (x, n));
+
     double res = 0.0;
     for (unsigned i = 0;  i < n;  ++i)
         res += x[i];
@@ -898,6 +1025,8 @@ double vec_sum_dp(const float * x, size_t n)
 
 void vec_add(const double * x, const double * y, double * r, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_add, (x, y, r, n));
+
     unsigned i = 0;
     if (true) {
         for (; i + 8 <= n;  i += 8) {
@@ -935,6 +1064,8 @@ void vec_add(const double * x, const double * y, double * r, size_t n)
 
 void vec_add(const double * x, double k, const float * y, double * r, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_add, (x, k, y, r, n));
+
     unsigned i = 0;
 
     v2df kk = vec_splat(k);
@@ -1000,6 +1131,8 @@ void vec_add(const double * x, const float * y, double * r, size_t n)
 
 void vec_prod(const double * x, const double * y, double * r, size_t n)
 {
+    JML_SIMD_DISPATCH(vec_prod, (x, y, r, n));
+
     unsigned i = 0;
     if (true) {
         for (; i + 8 <= n;  i += 8) {
@@ -1562,6 +1695,66 @@ void vec_exp(const double * x, double k, double * r, size_t n)
     for (; i < n;  ++i) r[i] = exp((double)(k * x[i]));
 }
 
+void vec_expf(const float * x, float * r, size_t n)
+{
+    JML_SIMD_DISPATCH(vec_expf, (x, r, n));
+
+    unsigned i = 0;
+    for (; i + 4 <= n;  i += 4) {
+        v4sf xxxx0 = __builtin_ia32_loadups(x + i + 0);
+        __builtin_ia32_storeups(r + i + 0, sse2_expf(xxxx0));
+    }
+
+    for (; i < n;  ++i) r[i] = expf(x[i]);
+}
+
+void vec_logf(const float * x, float * r, size_t n)
+{
+    JML_SIMD_DISPATCH(vec_logf, (x, r, n));
+
+    unsigned i = 0;
+    for (; i + 4 <= n;  i += 4) {
+        v4sf xxxx0 = __builtin_ia32_loadups(x + i + 0);
+        __builtin_ia32_storeups(r + i + 0, sse2_logf(xxxx0));
+    }
+
+    for (; i < n;  ++i) r[i] = logf(x[i]);
+}
+
+void vec_sigmoid(const float * x, float * r, size_t n)
+{
+    JML_SIMD_DISPATCH(vec_sigmoid, (x, r, n));
+
+    // 1 / (1 + exp(-x)), or exp(x) / (1 + exp(x)) for negative x so that
+    // the exp doesn't overflow
+    v4sf one = vec_splat(1.0f), zero = vec_splat(0.0f);
+    v4sf abs_mask = (v4sf)vec_splat(0x7fffffff);
+
+    unsigned i = 0;
+    for (; i + 4 <= n;  i += 4) {
+        v4sf xxxx0 = __builtin_ia32_loadups(x + i + 0);
+        v4sf eeee0 = sse2_expf(zero - __builtin_ia32_andps(xxxx0, abs_mask));
+        v4sf dddd0 = one + eeee0;
+        v4sf neg0  = (v4sf)__builtin_ia32_cmpltps(xxxx0, zero);
+        v4sf rrrr0 = __builtin_ia32_orps
+            (__builtin_ia32_andps(neg0, eeee0 / dddd0),
+             __builtin_ia32_andnps(neg0, one / dddd0));
+        __builtin_ia32_storeups(r + i + 0, rrrr0);
+    }
+
+    for (; i < n;  ++i) {
+        float e = expf(-fabsf(x[i]));
+        r[i] = (x[i] < 0.0f ? e : 1.0f) / (1.0f + e);
+    }
+}
+
+void vec_tanh(const float * x, float * r, size_t n)
+{
+    JML_SIMD_DISPATCH(vec_tanh, (x, r, n));
+
+    for (unsigned i = 0;  i < n;  ++i) r[i] = tanhf(x[i]);
+}
+
 float vec_twonorm_sqr(const float * x, size_t n)
 {
     unsigned i = 0;
@@ -155,6 +155,25 @@ void vec_exp(const float * x, double k, double * r, size_t n);
 void vec_exp(const double * x, double * r, size_t n);
 void vec_exp(const double * x, double k, double * r, size_t n);
 
+// Single precision approximations, for when throughput matters more than
+// the last bit.  These are vectorized on all machines, and 8 or 16 wide
+// with AVX2 or AVX-512.  Maximum errors over every float input, measured
+// against the double precision libm functions in units in the last place
+// of the float result, are:
+//
+//   vec_expf     x in [-87.5, 88.37]     1.1 ulp
+//   vec_logf     x > 0                   1 ulp
+//   vec_sigmoid  1 / (1 + exp(-x))       2.5 ulp
+//   vec_tanh     all x                   2.5 ulp
+//
+// Outside of the range given for vec_expf, and for zero, negative,
+// denormal, infinite or NaN inputs to vec_logf, the result is the same
+// as the C library gives.
+void vec_expf(const float * x, float * r, size_t n);
+void vec_logf(const float * x, float * r, size_t n);
+void vec_sigmoid(const float * x, float * r, size_t n);
+void vec_tanh(const float * x, float * r, size_t n);
+
 // Maximum
 void vec_max(const float * x, const float * y, float * r, size_t n);
 void vec_max(const float * x, float y, float * r, size_t n);
@@ -200,6 +219,34 @@ namespace SSE3 {
 
 using namespace Generic;
 
+
+/** Instruction sets that the vector kernels can use.  Those with versions
+    for the newer ones select them at runtime; the rest always use the
+    generic (SSE2) code.
+*/
+enum Vector_Isa {
+    ISA_GENERIC,
+    ISA_AVX2,     ///< AVX2 and FMA
+    ISA_AVX512    ///< AVX-512 foundation
+};
+
+const char * vector_isa_name(Vector_Isa isa);
+
+/** Best instruction set that both the CPU and the OS support.  This is
+    the one used unless the JML_SIMD_VECTOR_ISA environment variable names
+    another one ("generic", "avx2" or "avx512").
+*/
+Vector_Isa best_vector_isa();
+
+/** The instruction set currently in use. */
+Vector_Isa vector_isa();
+
+/** Change the instruction set, for testing and benchmarking.  Throws if
+    it isn't supported.  Not thread safe with respect to the kernels
+    themselves.
+*/
+void set_vector_isa(Vector_Isa isa);
+
 } // namespace SIMD
 } // namespace ML
 
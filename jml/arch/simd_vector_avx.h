@@ -0,0 +1,95 @@
+/* simd_vector_avx.h                                               -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   AVX2 and AVX-512 versions of the SIMD vector kernels.  These are only
+   called through the dispatch in simd_vector.cc, once it has checked that
+   the CPU supports them.
+*/
+
+#ifndef __arch__simd_vector_avx_h__
+#define __arch__simd_vector_avx_h__
+
+#include <stddef.h>
+
+namespace ML {
+namespace SIMD {
+
+/* Elementwise kernels give exactly the same results as the generic ones;
+   they don't use fused multiply-adds, which round differently.  The
+   reductions do, and add in a different order, so they only agree to
+   within rounding. */
+
+namespace Avx2 {
+
+void vec_scale(const float * x, float k, float * r, size_t n);
+void vec_add(const float * x, const float * y, float * r, size_t n);
+void vec_add(const float * x, float k, const float * y, float * r, size_t n);
+void vec_add(const float * x, const float * k, const float * y, float * r,
+             size_t n);
+void vec_prod(const float * x, const float * y, float * r, size_t n);
+void vec_minus(const float * x, const float * y, float * r, size_t n);
+float vec_dotprod(const float * x, const float * y, size_t n);
+double vec_dotprod_dp(const float * x, const float * y, size_t n);
+double vec_sum_dp(const float * x, size_t n);
+
+void vec_scale(const double * x, double k, double * r, size_t n);
+void vec_add(const double * x, const double * y, double * r, size_t n);
+void vec_add(const double * x, double k, const double * y, double * r,
+             size_t n);
+void vec_add(const double * x, const double * k, const double * y,
+             double * r, size_t n);
+void vec_prod(const double * x, const double * y, double * r, size_t n);
+void vec_minus(const double * x, const double * y, double * r, size_t n);
+double vec_dotprod(const double * x, const double * y, size_t n);
+double vec_sum(const double * x, size_t n);
+
+double vec_dotprod_dp(const double * x, const float * y, size_t n);
+void vec_add(const double * x, double k, const float * y, double * r,
+             size_t n);
+
+void vec_expf(const float * x, float * r, size_t n);
+void vec_logf(const float * x, float * r, size_t n);
+void vec_sigmoid(const float * x, float * r, size_t n);
+void vec_tanh(const float * x, float * r, size_t n);
+
+} // namespace Avx2
+
+namespace Avx512 {
+
+void vec_scale(const float * x, float k, float * r, size_t n);
+void vec_add(const float * x, const float * y, float * r, size_t n);
+void vec_add(const float * x, float k, const float * y, float * r, size_t n);
+void vec_add(const float * x, const float * k, const float * y, float * r,
+             size_t n);
+void vec_prod(const float * x, const float * y, float * r, size_t n);
+void vec_minus(const float * x, const float * y, float * r, size_t n);
+float vec_dotprod(const float * x, const float * y, size_t n);
+double vec_dotprod_dp(const float * x, const float * y, size_t n);
+double vec_sum_dp(const float * x, size_t n);
+
+void vec_scale(const double * x, double k, double * r, size_t n);
+void vec_add(const double * x, const double * y, double * r, size_t n);
+void vec_add(const double * x, double k, const double * y, double * r,
+             size_t n);
+void vec_add(const double * x, const double * k, const double * y,
+             double * r, size_t n);
+void vec_prod(const double * x, const double * y, double * r, size_t n);
+void vec_minus(const double * x, const double * y, double * r, size_t n);
+double vec_dotprod(const double * x, const double * y, size_t n);
+double vec_sum(const double * x, size_t n);
+
+double vec_dotprod_dp(const double * x, const float * y, size_t n);
+void vec_add(const double * x, double k, const float * y, double * r,
+             size_t n);
+
+void vec_expf(const float * x, float * r, size_t n);
+void vec_logf(const float * x, float * r, size_t n);
+void vec_sigmoid(const float * x, float * r, size_t n);
+void vec_tanh(const float * x, float * r, size_t n);
+
+} // namespace Avx512
+
+} // namespace SIMD
+} // namespace ML
+
+#endif /* __arch__simd_vector_avx_h__ */
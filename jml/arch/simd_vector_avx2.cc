@@ -0,0 +1,94 @@
+/* simd_vector_avx2.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   AVX2 versions of the SIMD vector kernels.
+
+   This file is compiled with -mavx2 -mfma.  It mustn't include headers with
+   inline functions that other files use too, as the linker could keep
+   the copy from here for everyone.
+*/
+
+#include "simd_vector_avx.h"
+#include "simd_vector_avx_impl.h"
+#include <immintrin.h>
+
+
+namespace ML {
+namespace SIMD {
+namespace Avx2 {
+
+namespace {
+
+struct Ops {
+    typedef __m256 Floats;
+    typedef __m256d Doubles;
+    typedef int Ints __attribute__((__vector_size__(32)));
+    typedef __m256 Mask;
+    enum { NF = 8, ND = 4 };
+
+    static Floats load(const float * p) { return _mm256_loadu_ps(p); }
+    static Doubles load(const double * p) { return _mm256_loadu_pd(p); }
+    static void store(float * p, Floats v) { _mm256_storeu_ps(p, v); }
+    static void store(double * p, Doubles v) { _mm256_storeu_pd(p, v); }
+    static Floats splat(float v) { return _mm256_set1_ps(v); }
+    static Doubles splat(double v) { return _mm256_set1_pd(v); }
+    static Ints splat(int v) { return (Ints)_mm256_set1_epi32(v); }
+
+    static Doubles load_cvt(const float * p)
+    {
+        return _mm256_cvtps_pd(_mm_loadu_ps(p));
+    }
+
+    static Floats fmadd(Floats a, Floats b, Floats c)
+    {
+        return _mm256_fmadd_ps(a, b, c);
+    }
+
+    static Doubles fmadd(Doubles a, Doubles b, Doubles c)
+    {
+        return _mm256_fmadd_pd(a, b, c);
+    }
+
+    static double hsum(Doubles v)
+    {
+        __m128d r = _mm_add_pd(_mm256_castpd256_pd128(v),
+                               _mm256_extractf128_pd(v, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(r, _mm_unpackhi_pd(r, r)));
+    }
+
+    static Ints as_ints(Floats v) { return (Ints)_mm256_castps_si256(v); }
+    static Floats as_floats(Ints v) { return _mm256_castsi256_ps((__m256i)v); }
+    static Ints to_ints(Floats v) { return (Ints)_mm256_cvtps_epi32(v); }
+    static Floats to_floats(Ints v) { return _mm256_cvtepi32_ps((__m256i)v); }
+
+    static Floats round(Floats v)
+    {
+        return _mm256_round_ps(v, _MM_FROUND_TO_NEAREST_INT
+                                  | _MM_FROUND_NO_EXC);
+    }
+
+    static Floats min(Floats a, Floats b) { return _mm256_min_ps(a, b); }
+    static Floats max(Floats a, Floats b) { return _mm256_max_ps(a, b); }
+
+    static Mask lt(Floats a, Floats b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+
+    static Floats select(Mask m, Floats t, Floats f)
+    {
+        return _mm256_blendv_ps(f, t, m);
+    }
+
+    static int outside(Floats x, float lo, float hi)
+    {
+        Floats in = _mm256_and_ps(_mm256_cmp_ps(x, splat(lo), _CMP_GE_OQ),
+                                  _mm256_cmp_ps(x, splat(hi), _CMP_LE_OQ));
+        return ~_mm256_movemask_ps(in) & 0xff;
+    }
+};
+
+} // file scope
+
+JML_SIMD_VECTOR_AVX_KERNELS(Ops)
+
+} // namespace Avx2
+} // namespace SIMD
+} // namespace ML
@@ -0,0 +1,95 @@
+/* simd_vector_avx512.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   AVX-512 versions of the SIMD vector kernels.
+
+   This file is compiled with -mavx512f.  It mustn't include headers with
+   inline functions that other files use too, as the linker could keep
+   the copy from here for everyone.
+*/
+
+#include "simd_vector_avx.h"
+#include "simd_vector_avx_impl.h"
+#include <immintrin.h>
+
+
+namespace ML {
+namespace SIMD {
+namespace Avx512 {
+
+namespace {
+
+struct Ops {
+    typedef __m512 Floats;
+    typedef __m512d Doubles;
+    typedef int Ints __attribute__((__vector_size__(64)));
+    typedef __mmask16 Mask;
+    enum { NF = 16, ND = 8 };
+
+    static Floats load(const float * p) { return _mm512_loadu_ps(p); }
+    static Doubles load(const double * p) { return _mm512_loadu_pd(p); }
+    static void store(float * p, Floats v) { _mm512_storeu_ps(p, v); }
+    static void store(double * p, Doubles v) { _mm512_storeu_pd(p, v); }
+    static Floats splat(float v) { return _mm512_set1_ps(v); }
+    static Doubles splat(double v) { return _mm512_set1_pd(v); }
+    static Ints splat(int v) { return (Ints)_mm512_set1_epi32(v); }
+
+    static Doubles load_cvt(const float * p)
+    {
+        return _mm512_cvtps_pd(_mm256_loadu_ps(p));
+    }
+
+    static Floats fmadd(Floats a, Floats b, Floats c)
+    {
+        return _mm512_fmadd_ps(a, b, c);
+    }
+
+    static Doubles fmadd(Doubles a, Doubles b, Doubles c)
+    {
+        return _mm512_fmadd_pd(a, b, c);
+    }
+
+    static double hsum(Doubles v)
+    {
+        return _mm512_reduce_add_pd(v);
+    }
+
+    static Ints as_ints(Floats v) { return (Ints)_mm512_castps_si512(v); }
+    static Floats as_floats(Ints v) { return _mm512_castsi512_ps((__m512i)v); }
+    static Ints to_ints(Floats v) { return (Ints)_mm512_cvtps_epi32(v); }
+    static Floats to_floats(Ints v) { return _mm512_cvtepi32_ps((__m512i)v); }
+
+    static Floats round(Floats v)
+    {
+        return _mm512_roundscale_ps(v, _MM_FROUND_TO_NEAREST_INT
+                                       | _MM_FROUND_NO_EXC);
+    }
+
+    static Floats min(Floats a, Floats b) { return _mm512_min_ps(a, b); }
+    static Floats max(Floats a, Floats b) { return _mm512_max_ps(a, b); }
+
+    static Mask lt(Floats a, Floats b)
+    {
+        return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ);
+    }
+
+    static Floats select(Mask m, Floats t, Floats f)
+    {
+        return _mm512_mask_blend_ps(m, f, t);
+    }
+
+    static int outside(Floats x, float lo, float hi)
+    {
+        Mask in = _mm512_cmp_ps_mask(x, splat(lo), _CMP_GE_OQ)
+                & _mm512_cmp_ps_mask(x, splat(hi), _CMP_LE_OQ);
+        return ~in & 0xffff;
+    }
+};
+
+} // file scope
+
+JML_SIMD_VECTOR_AVX_KERNELS(Ops)
+
+} // namespace Avx512
+} // namespace SIMD
+} // namespace ML
@@ -0,0 +1,502 @@
+/* simd_vector_avx_impl.h                                          -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Kernels shared between the AVX2 and AVX-512 versions of the SIMD vector
+   functions.  They are templated over an Ops class that gives the vector
+   types and the operations that can't be written with the GCC vector
+   operators:
+
+   - Floats and Doubles, the vector types, and NF and ND, their widths;
+   - load(), store() and splat() for both float and double;
+   - load_cvt(), which loads ND floats and converts them to doubles;
+   - fmadd(a, b, c), which is a * b + c with a single rounding;
+   - hsum(), the sum of the elements of a Doubles.
+
+   The single precision functions (exp, log and those built on them) also
+   need:
+
+   - Ints, an int vector as wide as Floats, with splat(int);
+   - as_ints() and as_floats() to reinterpret the bits, and to_ints() and
+     to_floats() to convert integral values;
+   - round() to the nearest integer, min() and max(), where a NaN in the
+     second argument is returned as is;
+   - Mask, with lt(a, b) and select(mask, if_true, if_false);
+   - outside(x, lo, hi), a bitmask of the elements not within [lo, hi],
+     which includes NaNs.
+
+   Only for inclusion by simd_vector_avx2.cc and simd_vector_avx512.cc,
+   which need to be compiled with -ffp-contract=off so that the compiler
+   doesn't fuse the multiplies and adds of the elementwise kernels.
+*/
+
+#ifndef __arch__simd_vector_avx_impl_h__
+#define __arch__simd_vector_avx_impl_h__
+
+#include <stddef.h>
+
+namespace ML {
+namespace SIMD {
+namespace {
+
+/* Elementwise */
+
+template<class Ops>
+void scale(const float * x, float k, float * r, size_t n)
+{
+    typename Ops::Floats kk = Ops::splat(k);
+    size_t i = 0;
+    for (; i + Ops::NF <= n;  i += Ops::NF)
+        Ops::store(r + i, Ops::load(x + i) * kk);
+    for (; i < n;  ++i) r[i] = k * x[i];
+}
+
+template<class Ops>
+void scale(const double * x, double k, double * r, size_t n)
+{
+    typename Ops::Doubles kk = Ops::splat(k);
+    size_t i = 0;
+    for (; i + Ops::ND <= n;  i += Ops::ND)
+        Ops::store(r + i, Ops::load(x + i) * kk);
+    for (; i < n;  ++i) r[i] = k * x[i];
+}
+
+template<class Ops, typename F>
+void add(const F * x, const F * y, F * r, size_t n, size_t width)
+{
+    size_t i = 0;
+    for (; i + width <= n;  i += width)
+        Ops::store(r + i, Ops::load(x + i) + Ops::load(y + i));
+    for (; i < n;  ++i) r[i] = x[i] + y[i];
+}
+
+template<class Ops, typename F>
+void add_k(const F * x, F k, const F * y, F * r, size_t n, size_t width)
+{
+    auto kk = Ops::splat(k);
+    size_t i = 0;
+    for (; i + width <= n;  i += width)
+        Ops::store(r + i, Ops::load(x + i) + kk * Ops::load(y + i));
+    for (; i < n;  ++i) r[i] = x[i] + k * y[i];
+}
+
+template<class Ops, typename F>
+void add_kv(const F * x, const F * k, const F * y, F * r, size_t n,
+            size_t width)
+{
+    size_t i = 0;
+    for (; i + width <= n;  i += width)
+        Ops::store(r + i, Ops::load(x + i)
+                          + Ops::load(k + i) * Ops::load(y + i));
+    for (; i < n;  ++i) r[i] = x[i] + k[i] * y[i];
+}
+
+template<class Ops, typename F>
+void prod(const F * x, const F * y, F * r, size_t n, size_t width)
+{
+    size_t i = 0;
+    for (; i + width <= n;  i += width)
+        Ops::store(r + i, Ops::load(x + i) * Ops::load(y + i));
+    for (; i < n;  ++i) r[i] = x[i] * y[i];
+}
+
+template<class Ops, typename F>
+void minus(const F * x, const F * y, F * r, size_t n, size_t width)
+{
+    size_t i = 0;
+    for (; i + width <= n;  i += width)
+        Ops::store(r + i, Ops::load(x + i) - Ops::load(y + i));
+    for (; i < n;  ++i) r[i] = x[i] - y[i];
+}
+
+template<class Ops>
+void add_k_mixed(const double * x, double k, const float * y, double * r,
+                 size_t n)
+{
+    typename Ops::Doubles kk = Ops::splat(k);
+    size_t i = 0;
+    for (; i + Ops::ND <= n;  i += Ops::ND)
+        Ops::store(r + i, Ops::load(x + i) + kk * Ops::load_cvt(y + i));
+    for (; i < n;  ++i) r[i] = x[i] + k * y[i];
+}
+
+
+/* Reductions.  These accumulate in double precision into four separate
+   vectors, so that the adds aren't all waiting on each other.  Products
+   of two floats are exact in double precision, so the float versions are
+   slightly more accurate than the generic ones. */
+
+template<class Ops, class Load, class Step>
+double reduce(size_t n, Load load, Step step)
+{
+    typedef typename Ops::Doubles D;
+    const size_t w = Ops::ND;
+
+    D r0 = Ops::splat(0.0), r1 = r0, r2 = r0, r3 = r0;
+    size_t i = 0;
+    for (; i + 4 * w <= n;  i += 4 * w) {
+        r0 = step(i + 0 * w, r0);
+        r1 = step(i + 1 * w, r1);
+        r2 = step(i + 2 * w, r2);
+        r3 = step(i + 3 * w, r3);
+    }
+    for (; i + w <= n;  i += w)
+        r0 = step(i, r0);
+
+    double result = Ops::hsum((r0 + r1) + (r2 + r3));
+    for (; i < n;  ++i) result += load(i);
+    return result;
+}
+
+template<class Ops>
+double dotprod_dp(const float * x, const float * y, size_t n)
+{
+    typedef typename Ops::Doubles D;
+    return reduce<Ops>
+        (n,
+         [&] (size_t i) { return (double)x[i] * y[i]; },
+         [&] (size_t i, D r)
+         {
+             return Ops::fmadd(Ops::load_cvt(x + i), Ops::load_cvt(y + i), r);
+         });
+}
+
+template<class Ops>
+double dotprod_dp(const double * x, const float * y, size_t n)
+{
+    typedef typename Ops::Doubles D;
+    return reduce<Ops>
+        (n,
+         [&] (size_t i) { return x[i] * y[i]; },
+         [&] (size_t i, D r)
+         {
+             return Ops::fmadd(Ops::load(x + i), Ops::load_cvt(y + i), r);
+         });
+}
+
+template<class Ops>
+double dotprod(const double * x, const double * y, size_t n)
+{
+    typedef typename Ops::Doubles D;
+    return reduce<Ops>
+        (n,
+         [&] (size_t i) { return x[i] * y[i]; },
+         [&] (size_t i, D r)
+         {
+             return Ops::fmadd(Ops::load(x + i), Ops::load(y + i), r);
+         });
+}
+
+template<class Ops>
+double sum_dp(const float * x, size_t n)
+{
+    typedef typename Ops::Doubles D;
+    return reduce<Ops>
+        (n,
+         [&] (size_t i) { return (double)x[i]; },
+         [&] (size_t i, D r) { return r + Ops::load_cvt(x + i); });
+}
+
+template<class Ops>
+double sum(const double * x, size_t n)
+{
+    typedef typename Ops::Doubles D;
+    return reduce<Ops>
+        (n,
+         [&] (size_t i) { return x[i]; },
+         [&] (size_t i, D r) { return r + Ops::load(x + i); });
+}
+
+
+/* Single precision exp, log, sigmoid and tanh.  These are the cephes
+   polynomials that sse2_exp.h and sse2_log.h use, evaluated with FMA.  The
+   measured errors, against double precision, are given in
+   simd_vector.h and checked by simd_vector_test.
+
+   Elements outside of the range where the polynomials work (which
+   includes NaNs) are done again with the libm function, one by one; the
+   other elements never need it. */
+
+template<class Ops>
+typename Ops::Floats
+fix_up(typename Ops::Floats x, typename Ops::Floats r, int bits,
+       float (*fn) (float))
+{
+    float xs[Ops::NF], rs[Ops::NF];
+    Ops::store(xs, x);
+    Ops::store(rs, r);
+    for (unsigned i = 0;  i < Ops::NF;  ++i)
+        if (bits & (1 << i))
+            rs[i] = fn(xs[i]);
+    return Ops::load(rs);
+}
+
+inline float scalar_expf(float x) { return __builtin_expf(x); }
+inline float scalar_logf(float x) { return __builtin_logf(x); }
+
+template<class Ops>
+typename Ops::Floats expf(typename Ops::Floats x)
+{
+    typedef typename Ops::Floats F;
+    typedef typename Ops::Ints I;
+
+    // exp(x) = exp(g + n log(2)) = exp(g) 2^n, with g in [-log(2)/2,
+    // log(2)/2].  log(2) is split into two parts, the first of which has
+    // few enough bits to make n * C1 exact.
+    F fn = Ops::round(x * Ops::splat(1.44269504088896341f));
+    F g = Ops::fmadd(fn, Ops::splat(-0.693359375f), x);
+    g = Ops::fmadd(fn, Ops::splat(2.12194440e-4f), g);
+
+    F y = Ops::splat(1.9875691500E-4f);
+    y = Ops::fmadd(y, g, Ops::splat(1.3981999507E-3f));
+    y = Ops::fmadd(y, g, Ops::splat(8.3334519073E-3f));
+    y = Ops::fmadd(y, g, Ops::splat(4.1665795894E-2f));
+    y = Ops::fmadd(y, g, Ops::splat(1.6666665459E-1f));
+    y = Ops::fmadd(y, g, Ops::splat(5.0000001201E-1f));
+    y = Ops::fmadd(y, g * g, g) + Ops::splat(1.0f);
+
+    // Build 2^n directly in the exponent bits
+    I n = Ops::to_ints(fn);
+    F result = y * Ops::as_floats((n + Ops::splat(0x7f)) << 23);
+
+    // Beyond this, 2^n isn't a normal float
+    int bits = Ops::outside(x, -87.5f, 88.3762626647949f);
+    if (__builtin_expect(bits != 0, 0))
+        return fix_up<Ops>(x, result, bits, scalar_expf);
+    return result;
+}
+
+template<class Ops>
+typename Ops::Floats logf(typename Ops::Floats x)
+{
+    typedef typename Ops::Floats F;
+    typedef typename Ops::Ints I;
+
+    // x = m 2^e, with m in [sqrt(1/2), sqrt(2)]
+    I bits = Ops::as_ints(x);
+    F e = Ops::to_floats((bits >> 23) - Ops::splat(0x7e));
+    F m = Ops::as_floats((bits & Ops::splat(0x007fffff))
+                         | Ops::splat(0x3f000000));
+
+    typename Ops::Mask small = Ops::lt(m, Ops::splat(0.707106781186547524f));
+    e = e - Ops::select(small, Ops::splat(1.0f), Ops::splat(0.0f));
+    m = m + Ops::select(small, m, Ops::splat(0.0f)) - Ops::splat(1.0f);
+
+    // log(1 + m) = m - m^2 / 2 + m^3 P(m)
+    F z = m * m;
+    F y = Ops::splat(7.0376836292E-2f);
+    y = Ops::fmadd(y, m, Ops::splat(-1.1514610310E-1f));
+    y = Ops::fmadd(y, m, Ops::splat(1.1676998740E-1f));
+    y = Ops::fmadd(y, m, Ops::splat(-1.2420140846E-1f));
+    y = Ops::fmadd(y, m, Ops::splat(1.4249322787E-1f));
+    y = Ops::fmadd(y, m, Ops::splat(-1.6668057665E-1f));
+    y = Ops::fmadd(y, m, Ops::splat(2.0000714765E-1f));
+    y = Ops::fmadd(y, m, Ops::splat(-2.4999993993E-1f));
+    y = Ops::fmadd(y, m, Ops::splat(3.3333331174E-1f));
+    y = y * m * z;
+
+    y = Ops::fmadd(e, Ops::splat(-2.12194440e-4f), y);
+    y = Ops::fmadd(z, Ops::splat(-0.5f), y);
+    F result = Ops::fmadd(e, Ops::splat(0.693359375f), m + y);
+
+    // Zero, negative, denormal, infinite and NaN inputs
+    int outside = Ops::outside(x, 1.17549435e-38f, 3.40282347e+38f);
+    if (__builtin_expect(outside != 0, 0))
+        return fix_up<Ops>(x, result, outside, scalar_logf);
+    return result;
+}
+
+template<class Ops>
+typename Ops::Floats sigmoid(typename Ops::Floats x)
+{
+    typedef typename Ops::Floats F;
+    typedef typename Ops::Ints I;
+
+    // 1 / (1 + exp(-x)), or exp(x) / (1 + exp(x)) for negative x so that
+    // the exp doesn't overflow
+    F ax = Ops::as_floats(Ops::as_ints(x) & Ops::splat(0x7fffffff));
+    F e = expf<Ops>(Ops::splat(0.0f) - ax);
+    F d = Ops::splat(1.0f) + e;
+    return Ops::select(Ops::lt(x, Ops::splat(0.0f)),
+                       e / d, Ops::splat(1.0f) / d);
+}
+
+template<class Ops>
+typename Ops::Floats tanh(typename Ops::Floats x)
+{
+    typedef typename Ops::Floats F;
+    typedef typename Ops::Ints I;
+
+    I sign_bit = Ops::splat((int)0x80000000);
+    I sign = Ops::as_ints(x) & sign_bit;
+
+    // Beyond 10, tanh(x) rounds to 1.  A NaN in x stays a NaN.
+    F ax = Ops::min(Ops::splat(10.0f), Ops::as_floats(Ops::as_ints(x)
+                                                     & ~sign_bit));
+
+    // Small arguments: tanh(x) = x + x^3 P(x^2)
+    F z = ax * ax;
+    F p = Ops::splat(-5.70498872745E-3f);
+    p = Ops::fmadd(p, z, Ops::splat(2.06390887954E-2f));
+    p = Ops::fmadd(p, z, Ops::splat(-5.37397155531E-2f));
+    p = Ops::fmadd(p, z, Ops::splat(1.33314422036E-1f));
+    p = Ops::fmadd(p, z, Ops::splat(-3.33332819422E-1f));
+    F small = Ops::fmadd(p * z, ax, ax);
+
+    // Large ones: tanh(x) = 1 - 2 / (exp(2x) + 1)
+    F one = Ops::splat(1.0f);
+    F large = one - Ops::splat(2.0f) / (expf<Ops>(ax + ax) + one);
+
+    F result = Ops::select(Ops::lt(ax, Ops::splat(0.625f)), small, large);
+    return Ops::as_floats(Ops::as_ints(result) | sign);
+}
+
+/* Applies fn to each element.  The last partial vector is padded, so
+   that every element goes through the same code. */
+
+template<class Ops, class Fn>
+void map(const float * x, float * r, size_t n, Fn fn)
+{
+    size_t i = 0;
+    for (; i + Ops::NF <= n;  i += Ops::NF)
+        Ops::store(r + i, fn(Ops::load(x + i)));
+
+    if (i == n) return;
+
+    float in[Ops::NF], out[Ops::NF];
+    for (unsigned j = 0;  j < Ops::NF;  ++j)
+        in[j] = i + j < n ? x[i + j] : 1.0f;
+    Ops::store(out, fn(Ops::load(in)));
+    for (unsigned j = 0;  i + j < n;  ++j)
+        r[i + j] = out[j];
+}
+
+} // file scope
+} // namespace SIMD
+} // namespace ML
+
+
+/* Defines the kernels declared in simd_vector_avx.h in the current
+   namespace, using the given Ops. */
+
+#define JML_SIMD_VECTOR_AVX_KERNELS(Ops)                                     \
+                                                                            \
+void vec_scale(const float * x, float k, float * r, size_t n)               \
+{                                                                           \
+    scale<Ops>(x, k, r, n);                                                 \
+}                                                                           \
+                                                                            \
+void vec_add(const float * x, const float * y, float * r, size_t n)         \
+{                                                                           \
+    add<Ops>(x, y, r, n, Ops::NF);                                          \
+}                                                                           \
+                                                                            \
+void vec_add(const float * x, float k, const float * y, float * r, size_t n) \
+{                                                                           \
+    add_k<Ops>(x, k, y, r, n, Ops::NF);                                     \
+}                                                                           \
+                                                                            \
+void vec_add(const float * x, const float * k, const float * y, float * r,  \
+             size_t n)                                                      \
+{                                                                           \
+    add_kv<Ops>(x, k, y, r, n, Ops::NF);                                    \
+}                                                                           \
+                                                                            \
+void vec_prod(const float * x, const float * y, float * r, size_t n)        \
+{                                                                           \
+    prod<Ops>(x, y, r, n, Ops::NF);                                         \
+}                                                                           \
+                                                                            \
+void vec_minus(const float * x, const float * y, float * r, size_t n)       \
+{                                                                           \
+    minus<Ops>(x, y, r, n, Ops::NF);                                        \
+}                                                                           \
+                                                                            \
+float vec_dotprod(const float * x, const float * y, size_t n)               \
+{                                                                           \
+    return dotprod_dp<Ops>(x, y, n);                                        \
+}                                                                           \
+                                                                            \
+double vec_dotprod_dp(const float * x, const float * y, size_t n)           \
+{                                                                           \
+    return dotprod_dp<Ops>(x, y, n);                                        \
+}                                                                           \
+                                                                            \
+double vec_sum_dp(const float * x, size_t n)                                \
+{                                                                           \
+    return sum_dp<Ops>(x, n);                                               \
+}                                                                           \
+                                                                            \
+void vec_scale(const double * x, double k, double * r, size_t n)            \
+{                                                                           \
+    scale<Ops>(x, k, r, n);                                                 \
+}                                                                           \
+                                                                            \
+void vec_add(const double * x, const double * y, double * r, size_t n)      \
+{                                                                           \
+    add<Ops>(x, y, r, n, Ops::ND);                                          \
+}                                                                           \
+                                                                            \
+void vec_add(const double * x, double k, const double * y, double * r,      \
+             size_t n)                                                      \
+{                                                                           \
+    add_k<Ops>(x, k, y, r, n, Ops::ND);                                     \
+}                                                                           \
+                                                                            \
+void vec_add(const double * x, const double * k, const double * y,          \
+             double * r, size_t n)                                          \
+{                                                                           \
+    add_kv<Ops>(x, k, y, r, n, Ops::ND);                                    \
+}                                                                           \
+                                                                            \
+void vec_prod(const double * x, const double * y, double * r, size_t n)     \
+{                                                                           \
+    prod<Ops>(x, y, r, n, Ops::ND);                                         \
+}                                                                           \
+                                                                            \
+void vec_minus(const double * x, const double * y, double * r, size_t n)    \
+{                                                                           \
+    minus<Ops>(x, y, r, n, Ops::ND);                                        \
+}                                                                           \
+                                                                            \
+double vec_dotprod(const double * x, const double * y, size_t n)            \
+{                                                                           \
+    return dotprod<Ops>(x, y, n);                                           \
+}                                                                           \
+                                                                            \
+double vec_sum(const double * x, size_t n)                                  \
+{                                                                           \
+    return sum<Ops>(x, n);                                                  \
+}                                                                           \
+                                                                            \
+double vec_dotprod_dp(const double * x, const float * y, size_t n)          \
+{                                                                           \
+    return dotprod_dp<Ops>(x, y, n);                                        \
+}                                                                           \
+                                                                            \
+void vec_add(const double * x, double k, const float * y, double * r,       \
+             size_t n)                                                      \
+{                                                                           \
+    add_k_mixed<Ops>(x, k, y, r, n);                                        \
+}                                                                           \
+                                                                            \
+void vec_expf(const float * x, float * r, size_t n)                         \
+{                                                                           \
+    map<Ops>(x, r, n, expf<Ops>);                                           \
+}                                                                           \
+                                                                            \
+void vec_logf(const float * x, float * r, size_t n)                         \
+{                                                                           \
+    map<Ops>(x, r, n, logf<Ops>);                                           \
+}                                                                           \
+                                                                            \
+void vec_sigmoid(const float * x, float * r, size_t n)                      \
+{                                                                           \
+    map<Ops>(x, r, n, sigmoid<Ops>);                                        \
+}                                                                           \
+                                                                            \
+void vec_tanh(const float * x, float * r, size_t n)                         \
+{                                                                           \
+    map<Ops>(x, r, n, tanh<Ops>);                                           \
+}
+
+#endif /* __arch__simd_vector_avx_impl_h__ */
@@ -12,6 +12,7 @@
 #include "sse2_poly.h"
 #include "sse2_math.h"
 #include "sse2_misc.h"
+#include <cfloat>
 
 namespace ML {
 namespace SIMD {
@@ -126,7 +127,8 @@ inline v4sf sse2_logf(v4sf x)
     int mask = 0;
 
     // For out of range results, we have to use the other values
-    if (JML_UNLIKELY(mask = out_of_range_mask_oo(x, 0.0f, INFINITY))) {
+    // Denormals aren't handled by sse2_logf_unsafe either
+    if (JML_UNLIKELY(mask = out_of_range_mask_oo(x, FLT_MIN, INFINITY))) {
         //using namespace std;
         //cerr << "mask = " << mask << " x = " << x << endl;
 
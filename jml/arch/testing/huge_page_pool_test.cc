@@ -0,0 +1,130 @@
+/* huge_page_pool_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test of the huge page pool allocator.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "jml/arch/huge_page_pool.h"
+
+#include <boost/test/unit_test.hpp>
+#include <map>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
+using namespace std;
+using namespace ML;
+
+
+BOOST_AUTO_TEST_CASE( test_map_huge_pages )
+{
+    Huge_Page_Stats before = huge_page_stats();
+
+    size_t size = 1000;
+    Huge_Page_Kind kind;
+    char * mem = (char *)map_huge_pages(size, kind);
+    cerr << "mapped " << size << " bytes of kind " << kind << endl;
+
+    BOOST_CHECK_GE(size, 1000);
+    BOOST_CHECK_GE(kind, max_huge_page_kind());
+    if (kind != HUGE_PAGES_NONE)
+        BOOST_CHECK_EQUAL((size_t)mem % huge_page_size, 0);
+    mem[0] = 1;
+    mem[size - 1] = 1;
+
+    Huge_Page_Stats during = huge_page_stats();
+    BOOST_CHECK_EQUAL(during.bytes_mapped(), before.bytes_mapped() + size);
+
+    unmap_huge_pages(mem, size, kind);
+    BOOST_CHECK_EQUAL(huge_page_stats().bytes_mapped(), before.bytes_mapped());
+}
+
+BOOST_AUTO_TEST_CASE( test_pool )
+{
+    Huge_Page_Pool pool(24, 65536);
+    BOOST_CHECK_EQUAL(pool.object_size(), 32);
+    BOOST_CHECK_EQUAL(pool.bytes_mapped(), 0);
+
+    // More than one slab's worth
+    set<void *> blocks;
+    for (unsigned i = 0;  i < 10000;  ++i) {
+        void * block = pool.allocate();
+        BOOST_CHECK_EQUAL((size_t)block % 16, 0);
+        BOOST_CHECK(blocks.insert(block).second);
+    }
+    BOOST_CHECK_EQUAL(pool.num_in_use(), 10000);
+    BOOST_CHECK_GE(pool.bytes_mapped(), 10000 * 32);
+    BOOST_CHECK_GE(huge_page_stats().bytes_in_use, 10000 * 32);
+
+    // Freed blocks are reused rather than mapping more
+    size_t mapped = pool.bytes_mapped();
+    for (void * block: blocks)
+        pool.deallocate(block);
+    BOOST_CHECK_EQUAL(pool.num_in_use(), 0);
+
+    for (unsigned i = 0;  i < 10000;  ++i)
+        BOOST_CHECK(blocks.count(pool.allocate()));
+    BOOST_CHECK_EQUAL(pool.bytes_mapped(), mapped);
+}
+
+BOOST_AUTO_TEST_CASE( test_allocator_in_containers )
+{
+    typedef Huge_Page_Allocator<pair<const int, string> > Allocator;
+
+    {
+        map<int, string, less<int>, Allocator> ordered;
+        unordered_map<int, string, hash<int>, equal_to<int>, Allocator>
+            hashed;
+
+        // Enough entries for the buckets to be mapped by themselves
+        for (int i = 0;  i < 500000;  ++i) {
+            ordered[i] = to_string(i);
+            hashed[i] = to_string(i);
+        }
+
+        for (int i = 0;  i < 500000;  i += 997) {
+            BOOST_CHECK_EQUAL(ordered[i], to_string(i));
+            BOOST_CHECK_EQUAL(hashed[i], to_string(i));
+        }
+
+        BOOST_CHECK_GE(huge_page_stats().bytes_in_use,
+                       500000 * 2 * sizeof(pair<const int, string>));
+    }
+
+    Huge_Page_Stats stats = huge_page_stats();
+    cerr << "after destruction: " << stats.bytes_mapped() << " bytes mapped "
+         << "(1GB " << stats.bytes_1gb << " 2MB " << stats.bytes_2mb
+         << " THP " << stats.bytes_transparent << " normal "
+         << stats.bytes_normal << "), " << stats.bytes_in_use << " in use"
+         << endl;
+    BOOST_CHECK_EQUAL(stats.bytes_in_use, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_threads )
+{
+    Huge_Page_Pool pool(64);
+
+    auto run = [&] ()
+        {
+            vector<void *> blocks;
+            for (unsigned i = 0;  i < 100;  ++i) {
+                for (unsigned j = 0;  j < 1000;  ++j)
+                    blocks.push_back(pool.allocate());
+                for (void * block: blocks)
+                    pool.deallocate(block);
+                blocks.clear();
+            }
+        };
+
+    vector<thread> threads;
+    for (unsigned i = 0;  i < 4;  ++i)
+        threads.emplace_back(run);
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(pool.num_in_use(), 0);
+    BOOST_CHECK_LE(pool.bytes_mapped(), 4 * 1000 * 64 + huge_page_size);
+}
@@ -0,0 +1,59 @@
+/* rt_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test of the CPU list parsing and thread affinity functions.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <sched.h>
+#include <boost/test/unit_test.hpp>
+
+#include "jml/arch/exception.h"
+#include "jml/arch/rt.h"
+
+using namespace std;
+using namespace ML;
+
+BOOST_AUTO_TEST_CASE( test_parse_cpu_list )
+{
+    BOOST_CHECK(parseCpuList("").empty());
+
+    vector<int> expected = { 0, 1, 2, 3, 8, 10, 11 };
+    vector<int> cpus = parseCpuList("0-3,8,10-11");
+    BOOST_CHECK_EQUAL_COLLECTIONS(cpus.begin(), cpus.end(),
+                                  expected.begin(), expected.end());
+
+    // As read from sysfs, with a trailing newline
+    cpus = parseCpuList("4-5\n");
+    BOOST_CHECK_EQUAL(cpus.size(), 2);
+    BOOST_CHECK_EQUAL(cpus[0], 4);
+    BOOST_CHECK_EQUAL(cpus[1], 5);
+
+    BOOST_CHECK_THROW(parseCpuList("a"), ML::Exception);
+    BOOST_CHECK_THROW(parseCpuList("3-1"), ML::Exception);
+    BOOST_CHECK_THROW(parseCpuList("1,,2"), ML::Exception);
+    BOOST_CHECK_THROW(parseCpuList("1;2"), ML::Exception);
+    BOOST_CHECK_THROW(parseCpuList("node:nonexistent"), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_current_thread_affinity )
+{
+    cpu_set_t before;
+    BOOST_REQUIRE_EQUAL(sched_getaffinity(0, sizeof(before), &before), 0);
+
+    int firstCpu = 0;
+    while (!CPU_ISSET(firstCpu, &before))
+        ++firstCpu;
+
+    BOOST_CHECK(setCurrentThreadAffinity({}));
+    BOOST_CHECK(setCurrentThreadAffinity({ firstCpu }));
+
+    cpu_set_t after;
+    BOOST_REQUIRE_EQUAL(sched_getaffinity(0, sizeof(after), &after), 0);
+    BOOST_CHECK_EQUAL(CPU_COUNT(&after), 1);
+    BOOST_CHECK(CPU_ISSET(firstCpu, &after));
+
+    BOOST_REQUIRE_EQUAL(sched_setaffinity(0, sizeof(before), &before), 0);
+}
@@ -0,0 +1,149 @@
+/* simd_vector_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Times the SIMD vector kernels with each of the instruction sets that the
+   machine supports, over a range of vector sizes.
+
+   Usage: simd_vector_bench [max size] [kernel]
+*/
+
+#include "jml/arch/simd_vector.h"
+#include "jml/arch/format.h"
+#include "jml/arch/timers.h"
+#include <functional>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdlib.h>
+
+
+using namespace std;
+using namespace ML;
+
+
+namespace {
+
+vector<float> xf, yf, kf, rf;
+vector<double> xd, yd, kd, rd;
+
+/* Stops the compiler from throwing away the results of reductions. */
+volatile double sink;
+
+struct Kernel {
+    string name;
+    std::function<void (size_t)> run;
+};
+
+vector<Kernel> kernels()
+{
+    vector<Kernel> result = {
+        { "vec_scale f",
+          [] (size_t n) { SIMD::vec_scale(&xf[0], 1.1f, &rf[0], n); } },
+        { "vec_add f",
+          [] (size_t n) { SIMD::vec_add(&xf[0], &yf[0], &rf[0], n); } },
+        { "vec_add f k",
+          [] (size_t n) { SIMD::vec_add(&xf[0], 1.1f, &yf[0], &rf[0], n); } },
+        { "vec_add f k[]",
+          [] (size_t n)
+          { SIMD::vec_add(&xf[0], &kf[0], &yf[0], &rf[0], n); } },
+        { "vec_prod f",
+          [] (size_t n) { SIMD::vec_prod(&xf[0], &yf[0], &rf[0], n); } },
+        { "vec_dotprod f",
+          [] (size_t n) { sink = SIMD::vec_dotprod(&xf[0], &yf[0], n); } },
+        { "vec_dotprod_dp f",
+          [] (size_t n) { sink = SIMD::vec_dotprod_dp(&xf[0], &yf[0], n); } },
+        { "vec_sum_dp f",
+          [] (size_t n) { sink = SIMD::vec_sum_dp(&xf[0], n); } },
+        { "vec_scale d",
+          [] (size_t n) { SIMD::vec_scale(&xd[0], 1.1, &rd[0], n); } },
+        { "vec_add d",
+          [] (size_t n) { SIMD::vec_add(&xd[0], &yd[0], &rd[0], n); } },
+        { "vec_add d k",
+          [] (size_t n) { SIMD::vec_add(&xd[0], 1.1, &yd[0], &rd[0], n); } },
+        { "vec_add d k f",
+          [] (size_t n) { SIMD::vec_add(&xd[0], 1.1, &yf[0], &rd[0], n); } },
+        { "vec_dotprod d",
+          [] (size_t n) { sink = SIMD::vec_dotprod(&xd[0], &yd[0], n); } },
+        { "vec_dotprod_dp d f",
+          [] (size_t n) { sink = SIMD::vec_dotprod_dp(&xd[0], &yf[0], n); } },
+        { "vec_sum d",
+          [] (size_t n) { sink = SIMD::vec_sum(&xd[0], n); } },
+        { "vec_expf",
+          [] (size_t n) { SIMD::vec_expf(&xf[0], &rf[0], n); } },
+        { "vec_logf",
+          [] (size_t n) { SIMD::vec_logf(&xf[0], &rf[0], n); } },
+        { "vec_sigmoid",
+          [] (size_t n) { SIMD::vec_sigmoid(&xf[0], &rf[0], n); } },
+        { "vec_tanh",
+          [] (size_t n) { SIMD::vec_tanh(&xf[0], &rf[0], n); } },
+    };
+    return result;
+}
+
+/* Nanoseconds per element, over enough calls to make the timer
+   meaningful. */
+double time_kernel(const Kernel & kernel, size_t n)
+{
+    size_t calls = max<size_t>(1, (1 << 24) / n);
+
+    kernel.run(n);  // warm the cache
+
+    Timer timer;
+    for (size_t i = 0;  i < calls;  ++i)
+        kernel.run(n);
+    return timer.elapsed_wall() * 1e9 / (calls * n);
+}
+
+} // file scope
+
+int main(int argc, char ** argv)
+{
+    size_t max_size = argc > 1 ? atol(argv[1]) : 1 << 20;
+    string only = argc > 2 ? argv[2] : "";
+
+    xf.resize(max_size);  yf.resize(max_size);  kf.resize(max_size);
+    rf.resize(max_size);
+    xd.resize(max_size);  yd.resize(max_size);  kd.resize(max_size);
+    rd.resize(max_size);
+
+    for (size_t i = 0;  i < max_size;  ++i) {
+        xf[i] = xd[i] = rand() / (double)RAND_MAX;
+        yf[i] = yd[i] = rand() / (double)RAND_MAX;
+        kf[i] = kd[i] = rand() / (double)RAND_MAX;
+    }
+
+    vector<SIMD::Vector_Isa> isas;
+    for (int i = SIMD::ISA_GENERIC;  i <= SIMD::best_vector_isa();  ++i)
+        isas.push_back((SIMD::Vector_Isa)i);
+
+    SIMD::Vector_Isa initial = SIMD::vector_isa();
+
+    cout << format("%-20s %9s", "kernel", "size");
+    for (auto isa: isas)
+        cout << format(" %10s %7s", SIMD::vector_isa_name(isa), "speedup");
+    cout << endl;
+    cout << format("%-20s %9s", "", "");
+    for (unsigned i = 0;  i < isas.size();  ++i)
+        cout << format(" %10s %7s", "ns/elem", "");
+    cout << endl;
+
+    for (const Kernel & kernel: kernels()) {
+        if (!only.empty() && kernel.name.find(only) == string::npos)
+            continue;
+
+        for (size_t n = 16;  n <= max_size;  n *= 16) {
+            cout << format("%-20s %9zd", kernel.name.c_str(), n);
+
+            double generic = 0.0;
+            for (auto isa: isas) {
+                SIMD::set_vector_isa(isa);
+                double ns = time_kernel(kernel, n);
+                if (isa == SIMD::ISA_GENERIC) generic = ns;
+                cout << format(" %10.3f %7.2f", ns, generic / ns);
+            }
+            cout << endl;
+        }
+    }
+
+    SIMD::set_vector_isa(initial);
+}
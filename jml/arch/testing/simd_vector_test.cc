@@ -10,6 +10,7 @@
 
 #include "jml/arch/simd_vector.h"
 #include "jml/arch/demangle.h"
+#include "jml/arch/exception.h"
 
 #include <boost/test/unit_test.hpp>
 #include <boost/test/floating_point_comparison.hpp>
@@ -820,3 +821,222 @@ BOOST_AUTO_TEST_CASE( vec_min_max_el_test )
     }
 }
 
+
+
+/* Runs every kernel with an AVX version using the given instruction set.
+   The inputs start one element in, so that they aren't aligned. */
+
+struct Isa_Results {
+    vector<vector<float> > floats;
+    vector<vector<double> > doubles;
+    vector<double> reductions;
+    vector<double> float_reductions;
+};
+
+Isa_Results run_kernels(SIMD::Vector_Isa isa, int nvals)
+{
+    SIMD::set_vector_isa(isa);
+
+    vector<float> xf(nvals + 1), yf(nvals + 1), kf(nvals + 1);
+    vector<double> xd(nvals + 1), yd(nvals + 1), kd(nvals + 1);
+
+    srand(nvals);
+    for (unsigned i = 0;  i <= nvals;  ++i) {
+        xf[i] = xd[i] = 0.5 + rand() / (double)RAND_MAX;
+        yf[i] = 0.5 + rand() / (double)RAND_MAX;
+        yd[i] = 0.5 + rand() / (double)RAND_MAX;
+        kf[i] = kd[i] = 0.5 + rand() / (double)RAND_MAX;
+    }
+
+    const float * x = &xf[1], * y = &yf[1], * k = &kf[1];
+    const double * xx = &xd[1], * yy = &yd[1], * kk = &kd[1];
+
+    Isa_Results result;
+    vector<float> rf(nvals + 1);
+    vector<double> rd(nvals + 1);
+
+    auto addf = [&] () { result.floats.push_back(rf); };
+    auto addd = [&] () { result.doubles.push_back(rd); };
+
+    SIMD::vec_scale(x, 1.1f, &rf[1], nvals);          addf();
+    SIMD::vec_add(x, y, &rf[1], nvals);               addf();
+    SIMD::vec_add(x, 1.1f, y, &rf[1], nvals);         addf();
+    SIMD::vec_add(x, k, y, &rf[1], nvals);            addf();
+    SIMD::vec_prod(x, y, &rf[1], nvals);              addf();
+    SIMD::vec_minus(x, y, &rf[1], nvals);             addf();
+
+    SIMD::vec_scale(xx, 1.1, &rd[1], nvals);          addd();
+    SIMD::vec_add(xx, yy, &rd[1], nvals);             addd();
+    SIMD::vec_add(xx, 1.1, yy, &rd[1], nvals);        addd();
+    SIMD::vec_add(xx, kk, yy, &rd[1], nvals);         addd();
+    SIMD::vec_prod(xx, yy, &rd[1], nvals);            addd();
+    SIMD::vec_minus(xx, yy, &rd[1], nvals);           addd();
+    SIMD::vec_add(xx, 1.1, y, &rd[1], nvals);         addd();
+
+    result.float_reductions.push_back(SIMD::vec_dotprod(x, y, nvals));
+    result.float_reductions.push_back(SIMD::vec_dotprod_dp(x, y, nvals));
+    result.float_reductions.push_back(SIMD::vec_sum_dp(x, nvals));
+    result.float_reductions.push_back(SIMD::vec_dotprod_dp(xx, y, nvals));
+
+    result.reductions.push_back(SIMD::vec_dotprod(xx, yy, nvals));
+    result.reductions.push_back(SIMD::vec_sum(xx, nvals));
+
+    return result;
+}
+
+void check_close(const vector<double> & expected, const vector<double> & got,
+                 double eps)
+{
+    BOOST_REQUIRE_EQUAL(expected.size(), got.size());
+    for (unsigned i = 0;  i < expected.size();  ++i) {
+        double diff = fabs(expected[i] - got[i]);
+        double scale = max(fabs(expected[i]), 1.0);
+        if (diff / scale >= eps)
+            cerr << "reduction " << i << ": " << expected[i] << " != "
+                 << got[i] << endl;
+        BOOST_CHECK(diff / scale < eps);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( vector_isa_test )
+{
+    SIMD::Vector_Isa initial = SIMD::vector_isa();
+    SIMD::Vector_Isa best = SIMD::best_vector_isa();
+    cerr << "best vector instruction set is " << SIMD::vector_isa_name(best)
+         << endl;
+
+    BOOST_CHECK_NO_THROW(SIMD::set_vector_isa(SIMD::ISA_GENERIC));
+    BOOST_CHECK_NO_THROW(SIMD::set_vector_isa(best));
+    BOOST_CHECK_EQUAL(SIMD::vector_isa(), best);
+
+    for (int i = SIMD::ISA_AVX2;  i <= SIMD::ISA_AVX512;  ++i) {
+        SIMD::Vector_Isa isa = (SIMD::Vector_Isa)i;
+        if (i > best) {
+            BOOST_CHECK_THROW(SIMD::set_vector_isa(isa), Exception);
+            continue;
+        }
+
+        cerr << "comparing " << SIMD::vector_isa_name(isa) << " with generic"
+             << endl;
+
+        for (int nvals: { 0, 1, 3, 4, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64,
+                          65, 127, 1000, 1023 }) {
+            Isa_Results expected = run_kernels(SIMD::ISA_GENERIC, nvals);
+            Isa_Results got = run_kernels(isa, nvals);
+
+            // Elementwise kernels are exactly the same
+            BOOST_CHECK(expected.floats == got.floats);
+            BOOST_CHECK(expected.doubles == got.doubles);
+
+            check_close(expected.float_reductions, got.float_reductions,
+                        get_eps(0.0f));
+            check_close(expected.reductions, got.reductions,
+                        get_eps(0.0));
+        }
+    }
+
+    SIMD::set_vector_isa(initial);
+}
+
+
+/* Largest error of the single precision function over the inputs, in
+   units in the last place of the correctly rounded result. */
+
+double max_ulp_error(void (*fn) (const float *, float *, size_t),
+                     double (*reference) (double),
+                     const vector<float> & inputs)
+{
+    vector<float> outputs(inputs.size());
+    fn(&inputs[0], &outputs[0], inputs.size());
+
+    double result = 0.0;
+    for (unsigned i = 0;  i < inputs.size();  ++i) {
+        double expected = reference(inputs[i]);
+        if (std::isnan(expected)) {
+            BOOST_CHECK(std::isnan(outputs[i]));
+            continue;
+        }
+        float rounded = expected;
+        if (std::isinf(rounded)) {
+            BOOST_CHECK_EQUAL(outputs[i], rounded);
+            continue;
+        }
+        double ulp = nextafterf(fabs(rounded), INFINITY) - fabs(rounded);
+        double error = fabs(outputs[i] - expected) / ulp;
+        if (error > result) {
+            result = error;
+            if (error > 4)
+                cerr << "  input " << inputs[i] << " expected " << expected
+                     << " got " << outputs[i] << endl;
+        }
+    }
+    return result;
+}
+
+double sigmoid_reference(double x) { return 1.0 / (1.0 + exp(-x)); }
+double exp_reference(double x) { return exp(x); }
+double log_reference(double x) { return log(x); }
+double tanh_reference(double x) { return tanh(x); }
+
+BOOST_AUTO_TEST_CASE( vec_transcendental_test )
+{
+    vector<float> exp_inputs, log_inputs, sigmoid_inputs, tanh_inputs;
+
+    for (float x = -87.5;  x <= 88.37;  x += 0.0013)
+        exp_inputs.push_back(x);
+    for (float x: { 0.0f, -0.5f, 89.0f, -87.6f, -100.0f, -104.0f,
+                    INFINITY, -INFINITY, NAN })
+        exp_inputs.push_back(x);
+
+    // Positive floats from the bit patterns, including denormals
+    for (uint32_t bits = 1;  bits < 0x7f800000;  bits += 4093) {
+        float x;
+        memcpy(&x, &bits, sizeof(x));
+        log_inputs.push_back(x);
+    }
+    for (float x: { 0.0f, -1.0f, INFINITY, NAN, 1.0f })
+        log_inputs.push_back(x);
+
+    for (float x = -100;  x <= 100;  x += 0.0021)
+        sigmoid_inputs.push_back(x);
+    sigmoid_inputs.push_back(NAN);
+
+    for (float x = -20;  x <= 20;  x += 0.00037)
+        tanh_inputs.push_back(x);
+    for (float x = 1e-30;  x < 1;  x *= 1.1) {
+        tanh_inputs.push_back(x);
+        tanh_inputs.push_back(-x);
+    }
+    for (float x: { 0.0f, -0.0f, 0.625f, -0.625f, 1e6f, INFINITY,
+                    -INFINITY, NAN })
+        tanh_inputs.push_back(x);
+
+    SIMD::Vector_Isa initial = SIMD::vector_isa();
+
+    for (int i = SIMD::ISA_GENERIC;  i <= SIMD::best_vector_isa();  ++i) {
+        SIMD::set_vector_isa((SIMD::Vector_Isa)i);
+
+        double exp_error
+            = max_ulp_error(SIMD::vec_expf, exp_reference, exp_inputs);
+        double log_error
+            = max_ulp_error(SIMD::vec_logf, log_reference, log_inputs);
+        double sigmoid_error
+            = max_ulp_error(SIMD::vec_sigmoid, sigmoid_reference,
+                            sigmoid_inputs);
+        double tanh_error
+            = max_ulp_error(SIMD::vec_tanh, tanh_reference, tanh_inputs);
+
+        cerr << SIMD::vector_isa_name((SIMD::Vector_Isa)i)
+             << ": max error exp " << exp_error << " log " << log_error
+             << " sigmoid " << sigmoid_error << " tanh " << tanh_error
+             << " ulp" << endl;
+
+        // Bounds documented in simd_vector.h
+        BOOST_CHECK_LE(exp_error, 1.1);
+        BOOST_CHECK_LE(log_error, 1.0);
+        BOOST_CHECK_LE(sigmoid_error, 2.5);
+        BOOST_CHECK_LE(tanh_error, 2.5);
+    }
+
+    SIMD::set_vector_isa(initial);
+}
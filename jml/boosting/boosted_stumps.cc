@@ -78,13 +78,14 @@ Function_Profiler __profiler(var);
 /*****************************************************************************/
 
 Boosted_Stumps::Boosted_Stumps()
+    : optimized_(false)
 {
 }
 
 Boosted_Stumps::
 Boosted_Stumps(const std::shared_ptr<const Feature_Space> & feature_space,
                const Feature & predicted)
-    : Classifier_Impl(feature_space, predicted)
+    : Classifier_Impl(feature_space, predicted), optimized_(false)
 {
     output = RAW;
 }
@@ -92,6 +93,7 @@ Boosted_Stumps(const std::shared_ptr<const Feature_Space> & feature_space,
 Boosted_Stumps::
 Boosted_Stumps(DB::Store_Reader & reader,
                const std::shared_ptr<const Feature_Space> & feature_space)
+    : optimized_(false)
 {
     this->reconstitute(reader, feature_space);
 }
@@ -100,7 +102,8 @@ Boosted_Stumps::
 Boosted_Stumps(const std::shared_ptr<const Feature_Space> & feature_space,
                const Feature & predicted,
                size_t label_count)
-    : Classifier_Impl(feature_space, predicted, label_count)
+    : Classifier_Impl(feature_space, predicted, label_count),
+      optimized_(false)
 {
 }
 
@@ -251,6 +254,209 @@ predict(int label, const Feature_Set & features,
     return result;
 }
 
+bool
+Boosted_Stumps::
+optimization_supported() const
+{
+    return true;
+}
+
+bool
+Boosted_Stumps::
+predict_is_optimized() const
+{
+    return optimized_;
+}
+
+bool
+Boosted_Stumps::
+optimize_impl(Optimization_Info & info)
+{
+    size_t nl = label_count();
+
+    opt_splits.clear();
+    opt_actions.clear();
+
+    for (stumps_type::const_iterator it = stumps.begin(), end = stumps.end();
+         it != end;  ++it) {
+        const Stump & stump = it->second;
+        const Action & action = stump.action;
+
+        if (action.pred_false.size() != nl
+            || action.pred_true.size() != nl
+            || action.pred_missing.size() != nl)
+            throw Exception("Boosted_Stumps::optimize(): stump action "
+                            "doesn't have label_count() entries");
+
+        int index = info.get_optimized_index(stump.split.feature());
+        opt_splits.push_back(Flat_Split(stump.split, index));
+
+        // In the order of the results of Split::apply()
+        opt_actions.insert(opt_actions.end(),
+                           action.pred_false.begin(), action.pred_false.end());
+        opt_actions.insert(opt_actions.end(),
+                           action.pred_true.begin(), action.pred_true.end());
+        opt_actions.insert(opt_actions.end(),
+                           action.pred_missing.begin(),
+                           action.pred_missing.end());
+    }
+
+    return optimized_ = true;
+}
+
+void
+Boosted_Stumps::
+predict_batch_raw(const float * features,
+                  size_t nrows,
+                  size_t stride,
+                  int label,
+                  float * result) const
+{
+    size_t nl = label_count();
+    size_t nout = (label == -1 ? nl : 1);
+    size_t nstumps = opt_splits.size();
+
+    // Rows are done in blocks so that the outputs of the block stay in the
+    // cache while we go through all of the stumps.
+    enum { BLOCK = 256 };
+
+    for (size_t first = 0;  first < nrows;  first += BLOCK) {
+        size_t last = std::min<size_t>(nrows, first + BLOCK);
+
+        for (size_t i = first;  i < last;  ++i) {
+            float * out = result + i * nout;
+            for (unsigned l = 0;  l < nout;  ++l)
+                out[l] = bias.size() ? bias[label == -1 ? l : label] : 0.0f;
+        }
+
+        for (size_t s = 0;  s < nstumps;  ++s) {
+            const Flat_Split & split = opt_splits[s];
+            const float * action = &opt_actions[s * 3 * nl];
+
+            if (label != -1) {
+                const float * act = action + label;
+                for (size_t i = first;  i < last;  ++i)
+                    result[i] += act[split.apply(features + i * stride) * nl];
+                continue;
+            }
+
+            for (size_t i = first;  i < last;  ++i) {
+                const float * dist
+                    = action + split.apply(features + i * stride) * nl;
+                float * out = result + i * nl;
+                for (unsigned l = 0;  l < nl;  ++l)
+                    out[l] += dist[l];
+            }
+        }
+    }
+}
+
+namespace {
+
+/** Applies the output transform of predict() to one row. */
+void transform_output(float * result, size_t nl, Boosted_Stumps::Output output)
+{
+    if (output == Boosted_Stumps::LOGIT
+        || output == Boosted_Stumps::LOGIT_NORM) {
+        double total = 0.0;
+        for (unsigned i = 0;  i < nl;  ++i) {
+            /* Avoid an overflow from the exp. */
+            if (result[i] > fp_traits<float>::max_exp_arg * 0.9)
+                result[i] = fp_traits<float>::max_exp_arg * 0.9;
+            double e = exp(result[i]);
+            double x = e / (e + (1.0 / e));
+            total += x;
+            result[i] = x;
+        }
+        if (output == Boosted_Stumps::LOGIT_NORM) {
+            if ((float)total == 0.0F)
+                std::fill(result, result + nl, 1.0f / nl);
+            else
+                for (unsigned i = 0;  i < nl;  ++i)
+                    result[i] /= total;
+        }
+    }
+
+    for (unsigned i = 0;  i < nl;  ++i)
+        if (!finite(result[i]))
+            throw Exception("Boosted_Stumps::predict(): non-finite result");
+}
+
+} // file scope
+
+Label_Dist
+Boosted_Stumps::
+optimized_predict_impl(const float * features,
+                       const Optimization_Info & info,
+                       PredictionContext * context) const
+{
+    Label_Dist result(label_count());
+    optimized_predict_batch_impl(features, 1, info, &result[0], context);
+    return result;
+}
+
+float
+Boosted_Stumps::
+optimized_predict_impl(int label,
+                       const float * features,
+                       const Optimization_Info & info,
+                       PredictionContext * context) const
+{
+    float result;
+    optimized_predict_batch_impl(label, features, 1, info, &result, context);
+    return result;
+}
+
+void
+Boosted_Stumps::
+optimized_predict_batch_impl(const float * features,
+                             size_t nrows,
+                             const Optimization_Info & info,
+                             float * result,
+                             PredictionContext * context) const
+{
+    PROFILE_FUNCTION(t_predict);
+    size_t nl = label_count();
+    predict_batch_raw(features, nrows, info.features_out(), -1, result);
+    for (size_t i = 0;  i < nrows;  ++i)
+        transform_output(result + i * nl, nl, output);
+}
+
+void
+Boosted_Stumps::
+optimized_predict_batch_impl(int label,
+                             const float * features,
+                             size_t nrows,
+                             const Optimization_Info & info,
+                             float * result,
+                             PredictionContext * context) const
+{
+    PROFILE_FUNCTION(t_predict);
+    if (label < 0 || label >= label_count())
+        throw Exception(format("Boosted_Stumps::predict_batch(): "
+                               "Attempt to predict label %d with label_count "
+                               " %zd", label, label_count()));
+
+    if (output == LOGIT_NORM) {
+        /* Need to predict all, so we know how to normalize. */
+        size_t nl = label_count();
+        vector<float> all(nrows * nl);
+        optimized_predict_batch_impl(features, nrows, info, &all[0], context);
+        for (size_t i = 0;  i < nrows;  ++i)
+            result[i] = all[i * nl + label];
+        return;
+    }
+
+    predict_batch_raw(features, nrows, info.features_out(), label, result);
+
+    if (output == LOGIT) {
+        for (size_t i = 0;  i < nrows;  ++i) {
+            double e = exp(result[i]);
+            result[i] = e / (e + 1.0 / e);
+        }
+    }
+}
+
 Boosted_Stumps::iterator Boosted_Stumps::
 insert(const Stump & stump, float weight)
 {
@@ -120,6 +120,9 @@ public:
         bias.swap(other.bias);
         sum_missing.swap(other.sum_missing);
         std::swap(predicted_, other.predicted_);
+        opt_splits.swap(other.opt_splits);
+        opt_actions.swap(other.opt_actions);
+        std::swap(optimized_, other.optimized_);
     }
 
     using Classifier_Impl::predict;
@@ -163,6 +166,55 @@ public:
     void predict_core(const Feature_Set & features, const Results & results)
         const;
 
+    /** Is optimization supported by the classifier? */
+    virtual bool optimization_supported() const;
+
+    /** Is predict optimized?  True once optimize() was called. */
+    virtual bool predict_is_optimized() const;
+
+    /** Flattens the stumps into opt_splits and opt_actions. */
+    virtual bool optimize_impl(Optimization_Info & info);
+
+    virtual Label_Dist
+    optimized_predict_impl(const float * features,
+                           const Optimization_Info & info,
+                           PredictionContext * context = 0) const;
+
+    virtual float
+    optimized_predict_impl(int label,
+                           const float * features,
+                           const Optimization_Info & info,
+                           PredictionContext * context = 0) const;
+
+    /** Batch predict.  Goes through the stumps in the outer loop and the
+        rows in the inner one, so that each stump is only looked up once
+        per block of rows.
+    */
+    virtual void
+    optimized_predict_batch_impl(const float * features,
+                                 size_t nrows,
+                                 const Optimization_Info & info,
+                                 float * output,
+                                 PredictionContext * context = 0) const;
+
+    virtual void
+    optimized_predict_batch_impl(int label,
+                                 const float * features,
+                                 size_t nrows,
+                                 const Optimization_Info & info,
+                                 float * output,
+                                 PredictionContext * context = 0) const;
+
+    /** The stumps, flattened by optimize() for the optimized predict into
+        contiguous arrays.  opt_actions holds, for each stump, label_count()
+        outputs for each result of Split::apply() (false, true and missing).
+        They aren't kept up to date when the stumps change: optimize() has
+        to be called again.  They are never serialized.
+    */
+    std::vector<Flat_Split> opt_splits;
+    std::vector<float> opt_actions;
+    bool optimized_;
+
     /** Calculate the accuracy.  This can be done much quicker with the
         boosted stumps as it only needs to look at the index for the features
         that it has learned a stump for, and these are nicely indexed
@@ -256,6 +308,16 @@ public:
     merge(const Classifier_Impl & other, float weight = 1.0) const;
     
 private:
+    /** Does the work of the batch predict over rows of stride floats,
+        writing label_count() outputs per row when label is -1, otherwise
+        one for the given label.  Takes no notice of the output transform.
+    */
+    void predict_batch_raw(const float * features,
+                           size_t nrows,
+                           size_t stride,
+                           int label,
+                           float * result) const;
+
     /** For reconstituting old classifiers only */
     Boosted_Stumps(const std::shared_ptr<const Feature_Space>
                        & feature_space,
@@ -25,6 +25,7 @@ LIBBOOSTING_SOURCES := \
         training_data.cc \
         training_index.cc \
         training_index_entry.cc \
+        compressed_index.cc \
         weighted_training.cc \
         transformed_classifier.cc \
         stump_training.cc \
@@ -53,7 +54,9 @@ LIBBOOSTING_SOURCES := \
 	feature.cc \
 	bit_compressed_index.cc \
 	label.cc \
-	buckets.cc
+	buckets.cc \
+	compiled_classifier.cc \
+	cross_validation.cc
 
 LIBBOOSTING_LINK :=	utils db algebra arch judy ACE boost_regex boost_thread worker_task
 
@@ -543,6 +543,60 @@ predict(int label,
     return optimized_predict_impl(label, fv, info, context);
 }
 
+void
+Classifier_Impl::
+predict_batch(const float * features,
+              size_t nrows,
+              size_t stride,
+              const Optimization_Info & info,
+              float * output,
+              PredictionContext * context) const
+{
+    if (!info)
+        throw Exception("predict_batch(): needs the Optimization_Info "
+                        "returned by optimize()");
+
+    if (nrows == 0) return;
+
+    size_t nin = info.features_in(), nout = info.features_out();
+    if (stride == 0) stride = nin;
+
+    vector<float> fv(nrows * nout);
+    for (size_t i = 0;  i < nrows;  ++i)
+        info.apply(features + i * stride, &fv[i * nout]);
+
+    optimized_predict_batch_impl(&fv[0], nrows, info, output, context);
+}
+
+void
+Classifier_Impl::
+predict_batch(int label,
+              const float * features,
+              size_t nrows,
+              size_t stride,
+              const Optimization_Info & info,
+              float * output,
+              PredictionContext * context) const
+{
+    if (!info)
+        throw Exception("predict_batch(): needs the Optimization_Info "
+                        "returned by optimize()");
+    if (label < 0 || label >= label_count())
+        throw Exception(format("predict_batch(): label %d out of range for "
+                               "label_count %zd", label, label_count()));
+
+    if (nrows == 0) return;
+
+    size_t nin = info.features_in(), nout = info.features_out();
+    if (stride == 0) stride = nin;
+
+    vector<float> fv(nrows * nout);
+    for (size_t i = 0;  i < nrows;  ++i)
+        info.apply(features + i * stride, &fv[i * nout]);
+
+    optimized_predict_batch_impl(label, &fv[0], nrows, info, output, context);
+}
+
 bool
 Classifier_Impl::
 optimize_impl(Optimization_Info & info)
@@ -597,6 +651,39 @@ optimized_predict_impl(int label,
     return predict(label, fset, context);
 }
 
+void
+Classifier_Impl::
+optimized_predict_batch_impl(const float * features,
+                             size_t nrows,
+                             const Optimization_Info & info,
+                             float * output,
+                             PredictionContext * context) const
+{
+    size_t nf = info.features_out(), nl = label_count();
+
+    for (size_t i = 0;  i < nrows;  ++i) {
+        Label_Dist result
+            = optimized_predict_impl(features + i * nf, info, context);
+        std::copy(result.begin(), result.end(), output + i * nl);
+    }
+}
+
+void
+Classifier_Impl::
+optimized_predict_batch_impl(int label,
+                             const float * features,
+                             size_t nrows,
+                             const Optimization_Info & info,
+                             float * output,
+                             PredictionContext * context) const
+{
+    size_t nf = info.features_out();
+
+    for (size_t i = 0;  i < nrows;  ++i)
+        output[i] = optimized_predict_impl(label, features + i * nf, info,
+                                           context);
+}
+
 namespace {
 
 struct Accuracy_Job_Info {
@@ -360,6 +360,33 @@ public:
                           const Optimization_Info & info,
                           PredictionContext * context = 0) const;
 
+    /** Batch prediction over a dense, row-major matrix of nrows rows.  Each
+        row holds the features that info was created for, in the same order
+        as for the optimized predict above, and starts stride floats after
+        the previous one (0 means that the rows are packed).  The first
+        version writes label_count() floats per row into output, the second
+        one float per row for the given label.
+
+        The rows are put into the classifier's feature order all at once and
+        then handed to optimized_predict_batch_impl(), which classifiers can
+        override to look up their features and parameters once per batch
+        rather than once per row.  An exception is thrown if info isn't
+        initialized.
+    */
+    virtual void predict_batch(const float * features,
+                               size_t nrows,
+                               size_t stride,
+                               const Optimization_Info & info,
+                               float * output,
+                               PredictionContext * context = 0) const;
+    virtual void predict_batch(int label,
+                               const float * features,
+                               size_t nrows,
+                               size_t stride,
+                               const Optimization_Info & info,
+                               float * output,
+                               PredictionContext * context = 0) const;
+
     //protected:
 
     /** Function to override to perform the optimization.  Default will
@@ -391,6 +418,26 @@ public:
                            const float * features,
                            const Optimization_Info & info,
                            PredictionContext * context = 0) const;
+
+    /** Batch version of the optimized predict.  The features are nrows
+        packed rows of info.features_out() values each, as they would be
+        passed to optimized_predict_impl().  The default implementation
+        calls optimized_predict_impl() for each row.
+    */
+    virtual void
+    optimized_predict_batch_impl(const float * features,
+                                 size_t nrows,
+                                 const Optimization_Info & info,
+                                 float * output,
+                                 PredictionContext * context = 0) const;
+
+    virtual void
+    optimized_predict_batch_impl(int label,
+                                 const float * features,
+                                 size_t nrows,
+                                 const Optimization_Info & info,
+                                 float * output,
+                                 PredictionContext * context = 0) const;
     
 public:
     /** Run the classifier over the entire dataset, calling the predict
@@ -714,6 +761,24 @@ public:
         return impl->predict(features, context);
     }
 
+    /** Predict the score for all classes of many dense rows at once.  See
+        Classifier_Impl::predict_batch(). */
+    void predict_batch(const float * features, size_t nrows, size_t stride,
+                       const Optimization_Info & info, float * output,
+                       PredictionContext * context = 0) const
+    {
+        impl->predict_batch(features, nrows, stride, info, output, context);
+    }
+
+    /** Predict the score for a single class of many dense rows at once. */
+    void predict_batch(int label, const float * features, size_t nrows,
+                       size_t stride, const Optimization_Info & info,
+                       float * output, PredictionContext * context = 0) const
+    {
+        impl->predict_batch(label, features, nrows, stride, info, output,
+                            context);
+    }
+
     /** Calculate the prediction accuracy over a training set. */
     std::pair<float, float>
     accuracy(const Training_Data & data,
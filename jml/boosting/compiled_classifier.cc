@@ -0,0 +1,384 @@
+/* compiled_classifier.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Generation of native code for classifiers.
+*/
+
+#include "compiled_classifier.h"
+#include "decision_tree.h"
+#include "boosted_stumps.h"
+#include "glz_classifier.h"
+#include "feature_space.h"
+#include "jml/arch/format.h"
+#include "jml/utils/floating_point.h"
+#include <map>
+#include <mutex>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* COMPILED_CLASSIFIER                                                       */
+/*****************************************************************************/
+
+namespace {
+
+std::mutex & registryLock()
+{
+    static std::mutex result;
+    return result;
+}
+
+/* Function static, as generated classifiers linked into the executable
+   register themselves during static initialization. */
+std::map<std::string, Compiled_Classifier> & registry()
+{
+    static std::map<std::string, Compiled_Classifier> result;
+    return result;
+}
+
+} // file scope
+
+void
+Compiled_Classifier::
+add(const Compiled_Classifier & classifier)
+{
+    std::lock_guard<std::mutex> guard(registryLock());
+    registry()[classifier.name] = classifier;
+}
+
+bool
+Compiled_Classifier::
+has(const std::string & name)
+{
+    std::lock_guard<std::mutex> guard(registryLock());
+    return registry().count(name);
+}
+
+Compiled_Classifier
+Compiled_Classifier::
+get(const std::string & name)
+{
+    std::lock_guard<std::mutex> guard(registryLock());
+    auto it = registry().find(name);
+    if (it == registry().end())
+        throw Exception("no compiled classifier named '%s' was loaded",
+                        name.c_str());
+    return it->second;
+}
+
+
+/*****************************************************************************/
+/* CODE GENERATION                                                           */
+/*****************************************************************************/
+
+namespace {
+
+/** Literal that gives back exactly the same float. */
+std::string literal(float val)
+{
+    if (std::isnan(val)) return "NAN";
+    if (std::isinf(val)) return val > 0 ? "INFINITY" : "-INFINITY";
+    std::string result = format("%.9g", val);
+    if (result.find_first_of(".e") == std::string::npos)
+        result += ".0";
+    return result + "f";
+}
+
+std::string quote(const std::string & str)
+{
+    std::string result = "\"";
+    for (char c: str) {
+        if (c == '"' || c == '\\') result += '\\';
+        result += c;
+    }
+    return result + "\"";
+}
+
+struct Generator {
+    Generator(const Classifier_Impl & classifier,
+              const std::vector<Feature> & features)
+        : classifier(classifier), nl(classifier.label_count())
+    {
+        for (unsigned i = 0;  i < features.size();  ++i)
+            indexes[features[i]] = i;
+    }
+
+    const Classifier_Impl & classifier;
+    int nl;
+    std::map<Feature, int> indexes;
+    std::string code;
+
+    void line(int indent, const std::string & str)
+    {
+        code.append(4 * indent, ' ');
+        code += str;
+        code += '\n';
+    }
+
+    /** Expression for the input value of the feature. */
+    std::string input(const Feature & feature) const
+    {
+        auto it = indexes.find(feature);
+        if (it == indexes.end())
+            throw Exception("Compiled_Classifier::generate_source(): "
+                            "classifier needs feature %s which is not in "
+                            "the list",
+                            classifier.feature_space()->print(feature)
+                                .c_str());
+        return format("features[%d]", it->second);
+    }
+
+    /** Condition which is true when the split is, for a value which isn't
+        missing. */
+    static std::string
+    condition(const std::string & val, const Split & split)
+    {
+        switch (split.op()) {
+        case Split::LESS:
+            return val + " < " + literal(split.split_val());
+        case Split::EQUAL:
+            return val + " == " + literal(split.split_val());
+        case Split::NOT_MISSING:
+            return "true";
+        default:
+            throw Exception("Compiled_Classifier: invalid split op");
+        }
+    }
+
+    static std::string expect(const std::string & cond, bool likely)
+    {
+        return format("__builtin_expect(%s, %d)", cond.c_str(), likely);
+    }
+
+    void tree(const Tree::Ptr & ptr, int indent)
+    {
+        if (!ptr) {
+            for (unsigned l = 0;  l < nl;  ++l)
+                line(indent, format("output[%d] = 0.0f;", l));
+            return;
+        }
+
+        if (!ptr.node()) {
+            const distribution<float> & pred = ptr.leaf()->pred;
+            for (unsigned l = 0;  l < nl;  ++l)
+                line(indent, format("output[%d] = %s;", l,
+                                    literal(pred.at(l)).c_str()));
+            return;
+        }
+
+        const Tree::Node & node = *ptr.node();
+        std::string val = input(node.split.feature());
+
+        // Hint the branches with the number of training examples that
+        // went down each of them.
+        float missing = node.child_missing.examples();
+        float present = node.child_true.examples()
+            + node.child_false.examples();
+
+        line(indent, "if (" + expect("std::isnan(" + val + ")",
+                                     missing > present) + ") {");
+        tree(node.child_missing, indent + 1);
+
+        if (node.split.op() == Split::NOT_MISSING) {
+            line(indent, "}");
+            line(indent, "else {");
+            tree(node.child_true, indent + 1);
+        }
+        else {
+            bool likely = node.child_true.examples()
+                >= node.child_false.examples();
+            line(indent, "}");
+            line(indent, "else if ("
+                 + expect(condition(val, node.split), likely) + ") {");
+            tree(node.child_true, indent + 1);
+            line(indent, "}");
+            line(indent, "else {");
+            tree(node.child_false, indent + 1);
+        }
+        line(indent, "}");
+    }
+
+    void decision_tree(const Decision_Tree & dtree)
+    {
+        tree(dtree.tree.root, 1);
+    }
+
+    void boosted_stumps(const Boosted_Stumps & stumps)
+    {
+        for (unsigned l = 0;  l < nl;  ++l)
+            line(1, format("output[%d] = %s;", l,
+                           literal(stumps.bias.size()
+                                   ? stumps.bias[l] : 0.0f).c_str()));
+
+        // Straight line; each stump is a select that the compiler can
+        // turn into conditional moves.
+        line(1, "float x;");
+        for (auto it = stumps.begin();  it != stumps.end();  ++it) {
+            const Stump & stump = *it;
+            const Action & action = stump.action;
+
+            line(0, "");
+            line(1, "x = " + input(stump.split.feature()) + ";");
+            for (unsigned l = 0;  l < nl;  ++l)
+                line(1, format("output[%d] += std::isnan(x) ? %s "
+                               ": (%s ? %s : %s);",
+                               l,
+                               literal(action.pred_missing.at(l)).c_str(),
+                               condition("x", stump.split).c_str(),
+                               literal(action.pred_true.at(l)).c_str(),
+                               literal(action.pred_false.at(l)).c_str()));
+        }
+
+        if (stumps.output == Boosted_Stumps::RAW) return;
+
+        // Same transform as Boosted_Stumps::predict()
+        line(0, "");
+        line(1, "double total = 0.0;");
+        line(1, format("for (unsigned i = 0;  i < %d;  ++i) {", nl));
+        line(2, format("if (output[i] > %s) output[i] = %s;",
+                       literal(fp_traits<float>::max_exp_arg * 0.9).c_str(),
+                       literal(fp_traits<float>::max_exp_arg * 0.9).c_str()));
+        line(2, "double e = std::exp(output[i]);");
+        line(2, "double v = e / (e + (1.0 / e));");
+        line(2, "total += v;");
+        line(2, "output[i] = v;");
+        line(1, "}");
+
+        if (stumps.output == Boosted_Stumps::LOGIT_NORM) {
+            line(1, format("for (unsigned i = 0;  i < %d;  ++i)", nl));
+            line(2, format("output[i] = ((float)total == 0.0f ? 1.0f / %d "
+                           ": output[i] / total);", nl));
+        }
+    }
+
+    void glz(const GLZ_Classifier & glz)
+    {
+        size_t nv = glz.features.size();
+
+        line(1, "double accum;");
+        for (unsigned l = 0;  l < nl;  ++l) {
+            const distribution<float> & w = glz.weights.at(l);
+
+            line(0, "");
+            line(1, "accum = 0.0;");
+            for (unsigned j = 0;  j < nv;  ++j) {
+                const GLZ_Classifier::Feature_Spec & spec = glz.features[j];
+                std::string val = input(spec.feature);
+                std::string decoded;
+
+                switch (spec.type) {
+                case GLZ_Classifier::Feature_Spec::VALUE:
+                case GLZ_Classifier::Feature_Spec::VALUE_IF_PRESENT:
+                    decoded = "(std::isnan(" + val + ") ? 0.0f : " + val + ")";
+                    break;
+                case GLZ_Classifier::Feature_Spec::PRESENCE:
+                    decoded = "(std::isnan(" + val + ") ? 0.0f : 1.0f)";
+                    break;
+                default:
+                    throw Exception("Compiled_Classifier: invalid GLZ "
+                                    "feature spec type");
+                }
+
+                line(1, "accum += " + decoded + " * "
+                     + literal(w.at(j)) + ";");
+            }
+
+            if (glz.add_bias)
+                line(1, "accum += " + literal(w.at(nv)) + ";");
+
+            link_inverse(glz.link, format("output[%d]", l));
+        }
+    }
+
+    /** Same as apply_link_inverse() on accum. */
+    void link_inverse(Link_Function link, const std::string & result)
+    {
+        switch (link) {
+        case LOGIT:
+            line(1, "accum = std::exp(accum);");
+            line(1, result + " = std::isfinite(accum) "
+                 "? accum / (1.0 + accum) : 0.99999;");
+            break;
+        case PROBIT:
+            line(1, result + " = (1.0 + std::erf(accum * "
+                 + format("%.17g", 1.0 / std::sqrt(2.0)) + ")) * 0.5;");
+            break;
+        case COMP_LOG_LOG:
+            line(1, result + " = 1.0 - std::exp(-std::exp(accum));");
+            break;
+        case LINEAR:
+            line(1, result + " = accum;");
+            break;
+        case LOG:
+            line(1, result + " = std::exp(accum);");
+            break;
+        default:
+            throw Exception("Compiled_Classifier: unknown link function");
+        }
+    }
+};
+
+} // file scope
+
+std::string
+Compiled_Classifier::
+generate_source(const Classifier_Impl & classifier,
+                const std::vector<Feature> & features,
+                const std::string & name)
+{
+    bool valid = !name.empty() && !isdigit(name[0]);
+    for (char c: name)
+        if (!isalnum(c) && c != '_') valid = false;
+    if (!valid)
+        throw Exception("Compiled_Classifier::generate_source(): '%s' isn't "
+                        "a valid C identifier", name.c_str());
+
+    Generator gen(classifier, features);
+
+    if (auto dtree = dynamic_cast<const Decision_Tree *>(&classifier))
+        gen.decision_tree(*dtree);
+    else if (auto stumps = dynamic_cast<const Boosted_Stumps *>(&classifier))
+        gen.boosted_stumps(*stumps);
+    else if (auto glz = dynamic_cast<const GLZ_Classifier *>(&classifier))
+        gen.glz(*glz);
+    else throw Exception("Compiled_Classifier::generate_source(): can't "
+                         "compile a classifier of type %s",
+                         classifier.class_id().c_str());
+
+    std::string result;
+    result += "/* " + name + ".cc\n"
+        "   Generated by Compiled_Classifier::generate_source() from a "
+        + classifier.class_id() + " classifier.\n"
+        "   Do not edit.\n"
+        "*/\n\n"
+        "#include \"jml/boosting/compiled_classifier.h\"\n"
+        "#include <cmath>\n\n\n";
+
+    result += "extern \"C\" void " + name
+        + "(const float * features, float * output)\n{\n";
+    result += gen.code;
+    result += "}\n\n";
+
+    result += "namespace {\n\n";
+    result += "const char * const feature_names[] = {\n";
+    for (unsigned i = 0;  i < features.size();  ++i)
+        result += "    "
+            + quote(classifier.feature_space()->print(features[i]))
+            + ",\n";
+    result += "    0\n};\n\n";
+
+    result += format("ML::Compiled_Classifier::Register\n"
+                     "registerClassifier(\"%s\", %s, %d, "
+                     "feature_names, %zd);\n\n",
+                     name.c_str(), name.c_str(), gen.nl, features.size());
+    result += "} // file scope\n";
+
+    return result;
+}
+
+} // namespace ML
@@ -0,0 +1,104 @@
+/* compiled_classifier.h                                           -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Classifiers compiled to native code.
+*/
+
+#ifndef __boosting__compiled_classifier_h__
+#define __boosting__compiled_classifier_h__
+
+
+#include <string>
+#include <vector>
+
+
+namespace ML {
+
+
+class Classifier_Impl;
+struct Feature;
+
+
+/*****************************************************************************/
+/* COMPILED_CLASSIFIER                                                       */
+/*****************************************************************************/
+
+/** A trained classifier turned into C++ source by generate_source(), with
+    its features, thresholds and structure hard coded so that predicting is
+    straight line code with no lookups.  This is for fixed models where the
+    scoring latency matters more than being able to load a new model.
+
+    The generated source only includes this header.  Once compiled into a
+    shared library, it registers itself under its name when the library is
+    loaded (for example with the library preloading of the services), and
+    can then be found with get().
+*/
+
+struct Compiled_Classifier {
+
+    /** Predict from a dense vector of the features, in the order of
+        features, into label_count outputs. */
+    typedef void (*Predict) (const float * features, float * output);
+
+    Compiled_Classifier()
+        : predict(0), label_count(0)
+    {
+    }
+
+    Compiled_Classifier(const std::string & name,
+                        Predict predict,
+                        int label_count,
+                        const char * const * feature_names,
+                        int feature_count)
+        : name(name), predict(predict), label_count(label_count),
+          features(feature_names, feature_names + feature_count)
+    {
+    }
+
+    std::string name;
+    Predict predict;
+    int label_count;
+    std::vector<std::string> features;   ///< Names of the inputs, in order
+
+    /** Make the classifier available under its name.  Replaces any with
+        the same name. */
+    static void add(const Compiled_Classifier & classifier);
+
+    /** Has a compiled classifier of the given name been loaded? */
+    static bool has(const std::string & name);
+
+    /** Return the compiled classifier of the given name, or throw if
+        there is none. */
+    static Compiled_Classifier get(const std::string & name);
+
+    /** Used by the generated code to register itself when loaded. */
+    struct Register {
+        Register(const std::string & name, Predict predict, int label_count,
+                 const char * const * feature_names, int feature_count)
+        {
+            add(Compiled_Classifier(name, predict, label_count,
+                                    feature_names, feature_count));
+        }
+    };
+
+    /** Generate the C++ source of a compiled version of the classifier,
+        which takes its features in the given order and registers itself
+        under the given name; the name must be a valid C identifier, as
+        it is also the name of the extern "C" predict function.  Decision
+        trees, boosted stumps and GLZ classifiers are supported; an
+        exception is thrown for anything else.
+
+        The generated code doesn't check that the features are finite,
+        unlike the predict() of some classifiers.
+    */
+    static std::string
+    generate_source(const Classifier_Impl & classifier,
+                    const std::vector<Feature> & features,
+                    const std::string & name);
+};
+
+
+} // namespace ML
+
+
+#endif /* __boosting__compiled_classifier_h__ */
@@ -0,0 +1,225 @@
+/* compressed_index.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Compressed example numbers and values for a training index entry.
+*/
+
+#include "compressed_index.h"
+#include "jml/arch/bitops.h"
+#include "jml/arch/bit_range_ops.h"
+#include "jml/arch/exception.h"
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace ML {
+
+namespace {
+
+inline void write_varint(std::vector<unsigned char> & bytes, uint64_t val)
+{
+    while (val >= 0x80) {
+        bytes.push_back((val & 0x7f) | 0x80);
+        val >>= 7;
+    }
+    bytes.push_back(val);
+}
+
+inline uint64_t read_varint(const unsigned char * & p)
+{
+    uint64_t result = 0;
+    int shift = 0;
+    for (;;) {
+        unsigned char c = *p++;
+        result |= uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80)) return result;
+        shift += 7;
+    }
+}
+
+inline uint64_t zigzag(int64_t val)
+{
+    return (val << 1) ^ (val >> 63);
+}
+
+inline int64_t unzigzag(uint64_t val)
+{
+    return (val >> 1) ^ -(int64_t)(val & 1);
+}
+
+/** Orders -0.0 before 0.0 so that the dictionary keeps them both, and so
+    that decoding gives back exactly the same bits. */
+struct Bit_Less {
+    bool operator () (float v1, float v2) const
+    {
+        return v1 < v2
+            || (v1 == v2 && std::signbit(v1) && !std::signbit(v2));
+    }
+};
+
+struct Bit_Equal {
+    bool operator () (float v1, float v2) const
+    {
+        return v1 == v2 && std::signbit(v1) == std::signbit(v2);
+    }
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COMPRESSED_INDEX                                                          */
+/*****************************************************************************/
+
+Compressed_Index::
+Compressed_Index()
+    : size_(0), implicit_examples_(true), code_bits(-1)
+{
+}
+
+void
+Compressed_Index::
+clear()
+{
+    size_ = 0;
+    implicit_examples_ = true;
+    example_bytes.clear();
+    block_offsets.clear();
+    block_bases.clear();
+    dictionary_.clear();
+    code_bits = -1;
+    codes.clear();
+    values.clear();
+}
+
+void
+Compressed_Index::
+init(const unsigned * examples, const float * values, size_t size)
+{
+    clear();
+    size_ = size;
+
+    if (size == 0) return;
+
+    /* Example numbers */
+    implicit_examples_ = true;
+    if (examples) {
+        for (unsigned i = 0;  i < size && implicit_examples_;  ++i)
+            implicit_examples_ = (examples[i] == i);
+    }
+
+    if (!implicit_examples_) {
+        example_bytes.reserve(size + size / 8);
+        unsigned last = 0;
+        for (unsigned i = 0;  i < size;  ++i) {
+            if (i % BLOCK_SIZE == 0) {
+                block_offsets.push_back(example_bytes.size());
+                block_bases.push_back(last);
+            }
+            write_varint(example_bytes, zigzag((int64_t)examples[i] - last));
+            last = examples[i];
+        }
+        /* Varints are never read past their end, so no slack is needed */
+        std::vector<unsigned char>(example_bytes).swap(example_bytes);
+    }
+
+    /* Values */
+    dictionary_.assign(values, values + size);
+    std::sort(dictionary_.begin(), dictionary_.end(), Bit_Less());
+    dictionary_.erase(std::unique(dictionary_.begin(), dictionary_.end(),
+                                  Bit_Equal()),
+                      dictionary_.end());
+
+    if (dictionary_.size() <= MAX_DICTIONARY) {
+        std::vector<float>(dictionary_).swap(dictionary_);
+        code_bits = dictionary_.size() <= 1 ? 0
+            : highest_bit(dictionary_.size() - 1) + 1;
+
+        /* Each block is a whole number of words; the extra two words are
+           written to and read from past the end. */
+        size_t words = num_blocks() * BLOCK_SIZE * code_bits / 64 + 2;
+        codes.resize(words);
+
+        Bit_Writer<uint64_t> writer(&codes[0]);
+        for (unsigned i = 0;  i < size;  ++i) {
+            uint64_t code
+                = std::lower_bound(dictionary_.begin(), dictionary_.end(),
+                                   values[i], Bit_Less())
+                - dictionary_.begin();
+            writer.write(code, code_bits);
+        }
+    }
+    else {
+        std::vector<float>().swap(dictionary_);
+        this->values.assign(values, values + size);
+    }
+}
+
+size_t
+Compressed_Index::
+decode_block(size_t block, unsigned * examples, float * values,
+             uint16_t * codes) const
+{
+    if (block >= num_blocks())
+        throw Exception("Compressed_Index::decode_block(): "
+                        "block out of range");
+
+    size_t start = block * BLOCK_SIZE;
+    size_t n = std::min<size_t>(BLOCK_SIZE, size_ - start);
+
+    if (examples && !implicit_examples_) {
+        const unsigned char * p = &example_bytes[block_offsets[block]];
+        unsigned last = block_bases[block];
+        for (unsigned i = 0;  i < n;  ++i) {
+            last += unzigzag(read_varint(p));
+            examples[i] = last;
+        }
+    }
+
+    if (code_bits == 0) {
+        if (codes) std::fill(codes, codes + n, 0);
+        if (values) std::fill(values, values + n, dictionary_[0]);
+    }
+    else if (code_bits > 0 && (values || codes)) {
+        Bit_Extractor<uint64_t> extractor
+            (&this->codes[block * BLOCK_SIZE * code_bits / 64]);
+        const float * dict = &dictionary_[0];
+
+        for (unsigned i = 0;  i < n;  ++i) {
+            unsigned code = extractor.extractFast<uint64_t>(code_bits);
+            if (codes) codes[i] = code;
+            if (values) values[i] = dict[code];
+        }
+    }
+    else if (code_bits < 0 && values)
+        std::copy(&this->values[start], &this->values[start] + n, values);
+
+    return n;
+}
+
+void
+Compressed_Index::
+decode(unsigned * examples, float * values) const
+{
+    for (size_t b = 0;  b < num_blocks();  ++b)
+        decode_block(b,
+                     examples ? examples + b * BLOCK_SIZE : 0,
+                     values ? values + b * BLOCK_SIZE : 0);
+}
+
+size_t
+Compressed_Index::
+memusage() const
+{
+    return example_bytes.capacity()
+        + block_offsets.capacity() * sizeof(uint32_t)
+        + block_bases.capacity() * sizeof(unsigned)
+        + dictionary_.capacity() * sizeof(float)
+        + codes.capacity() * sizeof(uint64_t)
+        + values.capacity() * sizeof(float);
+}
+
+} // namespace ML
@@ -0,0 +1,106 @@
+/* compressed_index.h                                              -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Compressed example numbers and values for a training index entry.
+*/
+
+#ifndef __boosting__compressed_index_h__
+#define __boosting__compressed_index_h__
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* COMPRESSED_INDEX                                                          */
+/*****************************************************************************/
+
+/** The example numbers and values of one feature of a Dataset_Index, in one
+    sort order, compressed so that the index of a very large dataset fits in
+    memory.
+
+    - Example numbers are stored as varint encoded (zig-zag) differences
+      from the previous example number, which takes one byte for most
+      features.  They're not stored at all when they just count up from
+      zero.
+    - Values are replaced by their number in a dictionary of the distinct
+      values, bit packed, when there are at most MAX_DICTIONARY of them.
+      This is lossless, and for boolean, categorical and most integer
+      features gives between one and sixteen bits per value.  Other features
+      keep their floats.
+
+    The entries are split into blocks of BLOCK_SIZE, which are decoded one
+    at a time so that anything calculated from a block (labels, buckets...)
+    can be done while it's still in cache.
+*/
+
+struct Compressed_Index {
+    Compressed_Index();
+
+    enum {
+        BLOCK_SIZE = 1024,
+        MAX_DICTIONARY = 65536
+    };
+
+    /** Compress the given arrays of size entries.  If examples is null then
+        the example numbers count up from zero. */
+    void init(const unsigned * examples, const float * values, size_t size);
+
+    void clear();
+
+    size_t size() const { return size_; }
+
+    size_t num_blocks() const
+    {
+        return (size_ + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+
+    /** Do the example numbers just count up from zero? */
+    bool implicit_examples() const { return implicit_examples_; }
+
+    /** Are the values stored as numbers in dictionary()? */
+    bool has_dictionary() const { return code_bits >= 0; }
+
+    /** The sorted distinct values, if has_dictionary(). */
+    const std::vector<float> & dictionary() const { return dictionary_; }
+
+    /** Decode the given block, returning the number of entries in it.  Any
+        of the output arrays (which need room for BLOCK_SIZE entries) can be
+        null if it's not needed.  The example numbers are not written if
+        implicit_examples() is true, and the dictionary numbers are only
+        written if has_dictionary() is true. */
+    size_t decode_block(size_t block, unsigned * examples, float * values,
+                        uint16_t * codes = 0) const;
+
+    /** Decode the whole thing into the given arrays, which need room for
+        size() entries each. */
+    void decode(unsigned * examples, float * values) const;
+
+    /** Memory used, in bytes. */
+    size_t memusage() const;
+
+private:
+    size_t size_;
+    bool implicit_examples_;
+
+    /** Varint encoded example differences, and the offset in it and the
+        example before each block. */
+    std::vector<unsigned char> example_bytes;
+    std::vector<uint32_t> block_offsets;
+    std::vector<unsigned> block_bases;
+
+    /** Dictionary numbers, bit packed; -1 bits means no dictionary. */
+    std::vector<float> dictionary_;
+    int code_bits;
+    std::vector<uint64_t> codes;
+
+    /** Values when there is no dictionary. */
+    std::vector<float> values;
+};
+
+} // namespace ML
+
+#endif /* __boosting__compressed_index_h__ */
@@ -0,0 +1,217 @@
+/* cross_validation.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Cross validation of classifier generators over a grid of parameters.
+*/
+
+#include "cross_validation.h"
+#include "classifier_generator.h"
+#include "jml/utils/worker_task.h"
+#include "jml/utils/guard.h"
+#include "jml/utils/string_functions.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+#include <boost/random/mersenne_twister.hpp>
+#include <mutex>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* CROSS_VALIDATION                                                          */
+/*****************************************************************************/
+
+Cross_Validation::
+Cross_Validation()
+    : num_folds(5), seed(1), verbosity(0)
+{
+}
+
+void
+Cross_Validation::
+add_parameter(const std::string & key,
+              const std::vector<std::string> & values)
+{
+    if (values.empty())
+        throw Exception("Cross_Validation: no values for parameter " + key);
+    parameters.push_back(make_pair(key, values));
+}
+
+void
+Cross_Validation::
+add_parameter(const std::string & spec)
+{
+    size_t equal = spec.find('=');
+    if (equal == string::npos || equal == 0)
+        throw Exception("Cross_Validation: parameter search '" + spec
+                        + "' isn't of the form KEY=VALUE1,VALUE2,...");
+    add_parameter(string(spec, 0, equal), split(string(spec, equal + 1), ','));
+}
+
+size_t
+Cross_Validation::
+num_configs() const
+{
+    size_t result = 1;
+    for (auto & param: parameters)
+        result *= param.second.size();
+    return result;
+}
+
+std::string
+Cross_Validation::
+describe(size_t config) const
+{
+    string result;
+    for (auto & param: parameters) {
+        if (!result.empty()) result += " ";
+        result += param.first + "="
+            + param.second[config % param.second.size()];
+        config /= param.second.size();
+    }
+    return result;
+}
+
+Configuration
+Cross_Validation::
+configuration(const Configuration & base, size_t config) const
+{
+    // Copies of a Configuration share their entries, so they are copied
+    // one at a time.
+    const Configuration root(base, "", Configuration::PREFIX_REPLACE);
+
+    Configuration result;
+    for (auto & key: root.allKeys())
+        result[key] = root[key];
+
+    for (auto & param: parameters) {
+        result[param.first] = param.second[config % param.second.size()];
+        config /= param.second.size();
+    }
+
+    return result;
+}
+
+std::vector<Cross_Validation::Result>
+Cross_Validation::
+run(Thread_Context & context,
+    const Training_Data & data,
+    const Feature & predicted,
+    const std::vector<Feature> & features,
+    const std::string & trainer_name,
+    const Configuration & config,
+    const distribution<float> & example_weights,
+    const On_Result & on_result) const
+{
+    size_t nx = data.example_count();
+
+    if (num_folds < 2)
+        throw Exception("Cross_Validation: need at least 2 folds, not %d",
+                        num_folds);
+    if (nx < (size_t)num_folds)
+        throw Exception("Cross_Validation: %zd examples for %d folds",
+                        nx, num_folds);
+    if (!example_weights.empty() && example_weights.size() != nx)
+        throw Exception("Cross_Validation: %zd weights for %zd examples",
+                        example_weights.size(), nx);
+
+    /* Put the examples in folds of the same size, at random. */
+    vector<int> folds(nx);
+    for (unsigned i = 0;  i < nx;  ++i)
+        folds[i] = i % num_folds;
+
+    boost::mt19937 rng(seed);
+    for (size_t i = nx - 1;  i > 0;  --i)
+        std::swap(folds[i], folds[rng() % (i + 1)]);
+
+    /* Create the generators here; configuring them reads the Configuration,
+       which isn't thread safe. */
+    size_t nconfigs = num_configs();
+    vector<std::shared_ptr<Classifier_Generator> > generators;
+    for (unsigned i = 0;  i < nconfigs;  ++i) {
+        std::shared_ptr<Classifier_Generator> generator
+            = get_trainer(trainer_name, configuration(config, i));
+        generator->init(data.feature_space(), predicted);
+        generators.push_back(generator);
+    }
+
+    /* Index the data once, so that the jobs don't all wait for it. */
+    data.index();
+
+    size_t njobs = nconfigs * num_folds;
+    vector<Result> results(njobs);
+    vector<Thread_Context> contexts(njobs);
+    for (unsigned i = 0;  i < njobs;  ++i)
+        contexts[i] = context.child();
+
+    std::mutex results_lock;
+
+    auto run_job = [&] (size_t job)
+        {
+            Result result;
+            result.config = job / num_folds;
+            result.fold = job % num_folds;
+
+            Timer timer;
+
+            distribution<float> training_weights(nx), validation_weights(nx);
+            for (unsigned i = 0;  i < nx;  ++i) {
+                float w = example_weights.empty() ? 1.0 : example_weights[i];
+                if (folds[i] == result.fold)
+                    validation_weights[i] = w;
+                else training_weights[i] = w;
+            }
+
+            std::shared_ptr<Classifier_Impl> classifier
+                = generators[result.config]
+                ->generate(contexts[job], data, data,
+                           training_weights, validation_weights, features);
+
+            result.training_accuracy
+                = classifier->accuracy(data, training_weights).first;
+
+            pair<float, float> validation
+                = classifier->accuracy(data, validation_weights);
+            result.validation_accuracy = validation.first;
+            result.validation_margin = validation.second;
+
+            result.seconds = timer.elapsed_wall();
+
+            std::unique_lock<std::mutex> guard(results_lock);
+            results[job] = result;
+            if (on_result)
+                on_result(result);
+        };
+
+    Worker_Task & worker = context.worker();
+
+    int group;
+    {
+        group = worker.get_group(NO_JOB,
+                                 format("Cross_Validation::run(): under %d",
+                                        context.group()),
+                                 context.group());
+        Call_Guard guard(std::bind(&Worker_Task::unlock_group,
+                                   std::ref(worker),
+                                   group));
+        for (unsigned i = 0;  i < njobs;  ++i)
+            worker.add(std::bind<void>(run_job, i),
+                       format("Cross_Validation::run() config %zd fold %d "
+                              "under %d",
+                              i / num_folds, i % num_folds, group),
+                       group);
+    }
+
+    worker.run_until_finished(group);
+
+    if (verbosity > 0)
+        cerr << "cross validation: " << njobs << " jobs finished" << endl;
+
+    return results;
+}
+
+} // namespace ML
@@ -0,0 +1,115 @@
+/* cross_validation.h                                              -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Cross validation of classifier generators over a grid of parameters.
+*/
+
+#ifndef __boosting__cross_validation_h__
+#define __boosting__cross_validation_h__
+
+#include "config.h"
+#include "training_data.h"
+#include "jml/utils/configuration.h"
+#include "jml/stats/distribution.h"
+#include "thread_context.h"
+#include <functional>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* CROSS_VALIDATION                                                          */
+/*****************************************************************************/
+
+/** Trains a generator once per fold and per combination of the values of
+    the parameters that are searched over, and measures each classifier on
+    the fold that was held out.
+
+    All of the jobs run concurrently in the worker task and share the same
+    Training_Data and index: a fold is held out by giving its examples a
+    weight of zero for training, and a fold is evaluated by giving the
+    other examples a weight of zero.  The data must therefore not be
+    changed while run() is running.  Examples are put in folds at random,
+    so groups of examples aren't kept together.
+
+    The generators are created and configured on the calling thread before
+    any training starts, since a Configuration can't be read from several
+    threads at once.
+*/
+
+struct Cross_Validation {
+
+    Cross_Validation();
+
+    /** Search over the given values of the configuration key, which is the
+        same as it would be given on the command line. */
+    void add_parameter(const std::string & key,
+                       const std::vector<std::string> & values);
+
+    /** Parse a parameter search as KEY=VALUE1,VALUE2,... */
+    void add_parameter(const std::string & spec);
+
+    /** Number of combinations of the values of the parameters (1 if there
+        are none). */
+    size_t num_configs() const;
+
+    /** The key=value pairs of the given combination. */
+    std::string describe(size_t config) const;
+
+    /** A copy of base with the values of the given combination set. */
+    Configuration configuration(const Configuration & base,
+                                size_t config) const;
+
+    /** How one generator did on one fold. */
+    struct Result {
+        Result()
+            : config(0), fold(0), training_accuracy(0.0),
+              validation_accuracy(0.0), validation_margin(0.0),
+              seconds(0.0)
+        {
+        }
+
+        size_t config;               ///< Combination of parameter values
+        int fold;                    ///< Fold that was held out
+        float training_accuracy;     ///< Accuracy (or RMSE) on the others
+        float validation_accuracy;   ///< Accuracy (or RMSE) on the fold
+        float validation_margin;     ///< Average margin on the fold
+        double seconds;              ///< Wall time to train and evaluate
+    };
+
+    /** Called as each job finishes, in the order that they finish.  The
+        calls are serialized. */
+    typedef std::function<void (const Result & result)> On_Result;
+
+    /** Train and evaluate the generator given by trainer_name in config
+        for each fold and combination of parameter values.  The weights
+        are those of the examples in data (empty for uniform), and are
+        multiplied by the fold masks.  Returns the results ordered by
+        combination and then fold.
+    */
+    std::vector<Result>
+    run(Thread_Context & context,
+        const Training_Data & data,
+        const Feature & predicted,
+        const std::vector<Feature> & features,
+        const std::string & trainer_name,
+        const Configuration & config,
+        const distribution<float> & example_weights,
+        const On_Result & on_result = On_Result()) const;
+
+    /** Number of folds. */
+    int num_folds;
+
+    /** Seed used to put the examples in folds. */
+    uint32_t seed;
+
+    int verbosity;
+
+    /** The keys searched over and their values. */
+    std::vector<std::pair<std::string, std::vector<std::string> > > parameters;
+};
+
+} // namespace ML
+
+#endif /* __boosting__cross_validation_h__ */
@@ -30,14 +30,14 @@ namespace ML {
 /*****************************************************************************/
 
 Decision_Tree::Decision_Tree()
-    : encoding(OE_PROB), optimized_(false)
+    : encoding(OE_PROB), optimized_(false), flat_root(FLAT_NONE)
 {
 }
 
 Decision_Tree::
 Decision_Tree(DB::Store_Reader & store,
               const std::shared_ptr<const Feature_Space> & fs)
-    : optimized_(false)
+    : optimized_(false), flat_root(FLAT_NONE)
 {
     throw Exception("Decision_Tree constructor(reconst): not implemented");
 }
@@ -47,7 +47,8 @@ Decision_Tree(std::shared_ptr<const Feature_Space> feature_space,
               const Feature & predicted)
     : Classifier_Impl(feature_space, predicted),
       encoding(OE_PROB),
-      optimized_(false)
+      optimized_(false),
+      flat_root(FLAT_NONE)
 {
 }
     
@@ -64,6 +65,9 @@ swap(Decision_Tree & other)
     std::swap(tree, other.tree);
     std::swap(encoding, other.encoding);
     std::swap(optimized_, other.optimized_);
+    flat_nodes.swap(other.flat_nodes);
+    flat_leaves.swap(other.flat_leaves);
+    std::swap(flat_root, other.flat_root);
 }
 
 namespace {
@@ -82,21 +86,6 @@ struct StandardGetFeatures {
     }
 };
 
-struct OptimizedGetFeatures {
-    OptimizedGetFeatures(const float * features)
-        : features(features)
-    {
-    }
-
-    const float * features;
-
-    JML_ALWAYS_INLINE Split::Weights operator () (const Split & split) const
-    {
-        return split.apply(features);
-    }
-                      
-};
-
 struct AccumResults {
     explicit AccumResults(double * accum, int nl, double weight)
         : accum(accum), nl(nl), weight(weight)
@@ -206,25 +195,50 @@ bool
 Decision_Tree::
 optimize_impl(Optimization_Info & info)
 {
-    optimize_recursive(info, tree.root);
-    optimized_ = true;
-    return true;
-}
+    size_t nl = label_count();
 
-void
-Decision_Tree::
-optimize_recursive(Optimization_Info & info,
-                   const Tree::Ptr & ptr)
-{
-    if (!ptr) return;
-    if (!ptr.node()) return;
+    flat_nodes.clear();
+    flat_leaves.clear();
+
+    // Nodes get their index when they are queued, which makes the order
+    // breadth first.
+    vector<const Tree::Node *> queue;
 
-    Tree::Node & node = *ptr.node();
+    auto flatten = [&] (const Tree::Ptr & ptr) -> int
+        {
+            if (!ptr) return FLAT_NONE;
+
+            if (!ptr.node()) {
+                const distribution<float> & pred = ptr.leaf()->pred;
+                if (pred.size() < nl)
+                    throw Exception("Decision_Tree::optimize(): leaf "
+                                    "doesn't have label_count() entries");
+                int leaf = flat_leaves.size() / nl;
+                flat_leaves.insert(flat_leaves.end(),
+                                   pred.begin(), pred.begin() + nl);
+                return FLAT_LEAF - leaf;
+            }
+
+            queue.push_back(ptr.node());
+            return queue.size() - 1;
+        };
+
+    flat_root = flatten(tree.root);
+
+    for (unsigned i = 0;  i < queue.size();  ++i) {
+        const Tree::Node & node = *queue[i];
+
+        Flat_Node flat;
+        flat.split = Flat_Split(node.split,
+                                info.get_optimized_index(node.split.feature()));
+        flat.child[false] = flatten(node.child_false);
+        flat.child[true] = flatten(node.child_true);
+        flat.child[MISSING] = flatten(node.child_missing);
+        flat_nodes.push_back(flat);
+    }
 
-    node.split.optimize(info);
-    optimize_recursive(info, node.child_true);
-    optimize_recursive(info, node.child_false);
-    optimize_recursive(info, node.child_missing);
+    optimized_ = true;
+    return true;
 }
 
 Label_Dist
@@ -233,14 +247,10 @@ optimized_predict_impl(const float * features,
                        const Optimization_Info & info,
                        PredictionContext * context) const
 {
-    OptimizedGetFeatures get_features(features);
-
     int nl = label_count();
-    double accum[nl];
-    DistResults results(accum, nl);
-
-    predict_recursive_impl(get_features, results, tree.root);
-    return results;
+    const float * leaf = flat_predict(features);
+    if (!leaf) return Label_Dist(nl, 0.0);
+    return Label_Dist(leaf, leaf + nl);
 }
 
 void
@@ -251,10 +261,12 @@ optimized_predict_impl(const float * features,
                        double weight,
                        PredictionContext * context) const
 {
-    OptimizedGetFeatures get_features(features);
-    AccumResults results(accum, label_count(), weight);
+    const float * leaf = flat_predict(features);
+    if (!leaf) return;
 
-    predict_recursive_impl(get_features, results, tree.root);
+    int nl = label_count();
+    for (unsigned i = 0;  i < nl;  ++i)
+        accum[i] += leaf[i] * weight;
 }
 
 float
@@ -264,11 +276,43 @@ optimized_predict_impl(int label,
                        const Optimization_Info & info,
                        PredictionContext * context) const
 {
-    OptimizedGetFeatures get_features(features);
-    LabelResults results(label);
+    const float * leaf = flat_predict(features);
+    return leaf ? leaf[label] : 0.0;
+}
 
-    predict_recursive_impl(get_features, results, tree.root);
-    return results;
+void
+Decision_Tree::
+optimized_predict_batch_impl(const float * features,
+                             size_t nrows,
+                             const Optimization_Info & info,
+                             float * output,
+                             PredictionContext * context) const
+{
+    size_t nf = info.features_out();
+    int nl = label_count();
+
+    for (size_t i = 0;  i < nrows;  ++i) {
+        const float * leaf = flat_predict(features + i * nf);
+        if (leaf) std::copy(leaf, leaf + nl, output + i * nl);
+        else std::fill(output + i * nl, output + (i + 1) * nl, 0.0f);
+    }
+}
+
+void
+Decision_Tree::
+optimized_predict_batch_impl(int label,
+                             const float * features,
+                             size_t nrows,
+                             const Optimization_Info & info,
+                             float * output,
+                             PredictionContext * context) const
+{
+    size_t nf = info.features_out();
+
+    for (size_t i = 0;  i < nrows;  ++i) {
+        const float * leaf = flat_predict(features + i * nf);
+        output[i] = leaf ? leaf[label] : 0.0f;
+    }
 }
 
 template<class GetFeatures, class Results>
@@ -56,6 +56,40 @@ public:
     Output_Encoding encoding;  ///< How the outputs are represented
     bool optimized_;           ///< Is predict() optimized?
 
+    /** The tree, flattened by optimize() into contiguous arrays for the
+        optimized predict, so that it doesn't need to chase the pointers of
+        the tree.  The nodes are in breadth first order, so that the top
+        levels share cache lines.  The children are indexed by the result
+        of the split (false, true, missing) and encoded as for flat_root.
+        Never serialized; optimize() has to be called again if the tree
+        changes.
+    */
+    struct Flat_Node {
+        Flat_Split split;
+        int child[3];
+    };
+
+    /** Child that doesn't exist; otherwise a child is the index of a node
+        if it is positive or FLAT_LEAF - n for the nth leaf. */
+    enum { FLAT_NONE = -1, FLAT_LEAF = -2 };
+
+    std::vector<Flat_Node> flat_nodes;
+    std::vector<float> flat_leaves;   ///< label_count() per leaf
+    int flat_root;
+
+    /** Prediction of the leaf that the features lead to in the flattened
+        tree, or 0 if they lead nowhere. */
+    const float * flat_predict(const float * features) const
+    {
+        int i = flat_root;
+        while (i >= 0) {
+            const Flat_Node & node = flat_nodes[i];
+            i = node.child[node.split.apply(features)];
+        }
+        if (i == FLAT_NONE) return 0;
+        return &flat_leaves[(FLAT_LEAF - i) * label_count()];
+    }
+
     using Classifier_Impl::predict;
 
     virtual float predict(int label, const Feature_Set & features,
@@ -80,9 +114,6 @@ public:
     virtual bool
     optimize_impl(Optimization_Info & info);
 
-    void optimize_recursive(Optimization_Info & info,
-                            const Tree::Ptr & ptr);
-
     /** Optimized predict for a dense feature vector.
         This is the worker function that all classifiers that implement the
         optimized predict should override.  The default implementation will
@@ -105,6 +136,23 @@ public:
                            const Optimization_Info & info,
                            PredictionContext * context = 0) const;
 
+    /** Batch predict.  Walks the tree for each row straight into the
+        output, without building a Label_Dist per row. */
+    virtual void
+    optimized_predict_batch_impl(const float * features,
+                                 size_t nrows,
+                                 const Optimization_Info & info,
+                                 float * output,
+                                 PredictionContext * context = 0) const;
+
+    virtual void
+    optimized_predict_batch_impl(int label,
+                                 const float * features,
+                                 size_t nrows,
+                                 const Optimization_Info & info,
+                                 float * output,
+                                 PredictionContext * context = 0) const;
+
     template<class GetFeatures, class Results>
     void predict_recursive_impl(const GetFeatures & get_features,
                                 Results & results,
@@ -17,7 +17,9 @@
 #include "jml/utils/vector_utils.h"
 #include "jml/utils/filter_streams.h"
 #include "jml/utils/smart_ptr_utils.h"
+#include "jml/db/persistent.h"
 #include <boost/tuple/tuple.hpp>
+#include <sstream>
 #include "stdint.h"
 
 using namespace std;
@@ -721,11 +723,13 @@ freeze()
 /*****************************************************************************/
 
 Dense_Training_Data::Dense_Training_Data()
+    : mapped_data(0), mapped_row_count(0)
 {
 }
 
 Dense_Training_Data::
 Dense_Training_Data(const std::string & filename)
+    : mapped_data(0), mapped_row_count(0)
 {
     init(filename);
 }
@@ -733,6 +737,7 @@ Dense_Training_Data(const std::string & filename)
 Dense_Training_Data::
 Dense_Training_Data(const std::string & filename,
                     std::shared_ptr<Dense_Feature_Space> feature_space)
+    : mapped_data(0), mapped_row_count(0)
 {
     init(filename, feature_space);
 }
@@ -815,6 +820,35 @@ get_sizes(const std::string & filename,
     return get_sizes(context, row_start_ofs);
 }
 
+/** Header at the start of a binary dataset file.  It's followed by the
+    serialized feature space, row offsets and row comments, and then (at a
+    page aligned offset) the rows of floats. */
+struct Binary_Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t row_count;
+    uint64_t var_count;
+    uint64_t metadata_offset;
+    uint64_t metadata_length;
+    uint64_t data_offset;
+    uint64_t reserved;
+};
+
+static const char BINARY_MAGIC[8] = { 'J', 'M', 'L', 'D', 'E', 'N', 'S', 'E' };
+static const uint32_t BINARY_VERSION = 1;
+static const uint32_t BINARY_BYTE_ORDER = 0x01020304;
+
+std::string serialize_to_string(const Dense_Feature_Space & fs)
+{
+    std::ostringstream stream;
+    {
+        DB::Store_Writer store(stream);
+        fs.serialize(store);
+    }
+    return stream.str();
+}
+
 } // file scope
 
 void Dense_Training_Data::
@@ -833,10 +867,17 @@ add_data()
     for (unsigned j = 0;  j < nv;  ++j)
         (*feature_vec)[j] = Feature(j);
     
+    /* The rows are either in the mapped file or in the dataset. */
+    const float * rows = dataset.data();
+    if (mapped_data) {
+        rows = mapped_data;
+        nx = mapped_row_count;
+    }
+
     /* Add data */
     for (unsigned x = 0;  x < nx;  ++x) {
         std::shared_ptr<Dense_Feature_Set> features
-            (new Dense_Feature_Set(feature_vec, &dataset[x][0]));
+            (new Dense_Feature_Set(feature_vec, rows + (size_t)x * nv));
         //cerr << "got row " << feature_space()->print(*features) << endl;
         add_example(features);
     }
@@ -896,8 +937,17 @@ init(const std::vector<std::string> & filenames,
      std::shared_ptr<Dense_Feature_Space> feature_space)
 {
     vector<Data_Source> data_sources;
-    for (unsigned i = 0;  i < filenames.size();  ++i)
+    for (unsigned i = 0;  i < filenames.size();  ++i) {
+        if (is_binary(filenames[i])) {
+            if (filenames.size() != 1)
+                throw Exception("Dense_Training_Data::init(): binary dataset "
+                                "'" + filenames[i] + "' can't be loaded "
+                                "together with other files");
+            init_binary(filenames[i], feature_space);
+            return;
+        }
         data_sources.push_back(Data_Source(filenames[i]));
+    }
     init(data_sources, feature_space);
 }
 
@@ -918,6 +968,10 @@ init(const std::vector<Data_Source> & data_sources,
 {
     Training_Data::init(feature_space);
 
+    mapped_file.close();
+    mapped_data = 0;
+    mapped_row_count = 0;
+
     /* Get all of the counts from all of the files. */
     size_t row_count = 0, var_count = 0;
     string header;
@@ -1174,6 +1228,177 @@ init(const std::vector<Data_Source> & data_sources,
     //}
 }
 
+void
+Dense_Training_Data::
+init_binary(const std::string & filename,
+            std::shared_ptr<Dense_Feature_Space> feature_space)
+{
+    File_Read_Buffer file(filename);
+
+    Binary_Header header;
+    if (file.size() < sizeof(header))
+        throw Exception("Dense_Training_Data::init_binary(): file '"
+                        + filename + "' is too short to be a binary dataset");
+    memcpy(&header, file.start(), sizeof(header));
+
+    if (memcmp(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0)
+        throw Exception("Dense_Training_Data::init_binary(): file '"
+                        + filename + "' is not an uncompressed binary dataset");
+    if (header.version != BINARY_VERSION)
+        throw Exception(format("Dense_Training_Data::init_binary(): binary "
+                               "dataset '%s' has version %d; only %d is "
+                               "supported", filename.c_str(),
+                               (int)header.version, (int)BINARY_VERSION));
+    if (header.byte_order != BINARY_BYTE_ORDER)
+        throw Exception("Dense_Training_Data::init_binary(): binary dataset '"
+                        + filename + "' was written on a machine with a "
+                        "different byte order");
+
+    uint64_t data_length = header.row_count * header.var_count * sizeof(float);
+    if (header.metadata_offset > file.size()
+        || header.metadata_length > file.size() - header.metadata_offset
+        || header.data_offset % sizeof(float) != 0
+        || header.data_offset > file.size()
+        || (header.var_count != 0
+            && header.row_count > (file.size() - header.data_offset)
+                                  / sizeof(float) / header.var_count))
+        throw Exception(format("Dense_Training_Data::init_binary(): binary "
+                               "dataset '%s' is truncated or corrupt "
+                               "(%zd bytes, expected %zd)", filename.c_str(),
+                               file.size(),
+                               (size_t)(header.data_offset + data_length)));
+
+    DB::Store_Reader store(file.start() + header.metadata_offset,
+                           header.metadata_length);
+
+    Dense_Feature_Space saved_fs;
+    saved_fs.reconstitute(store);
+
+    if (saved_fs.variable_count() != header.var_count)
+        throw Exception("Dense_Training_Data::init_binary(): binary dataset '"
+                        + filename + "' has a feature space with the wrong "
+                        "number of variables");
+
+    if (feature_space->variable_count() == 0)
+        *feature_space = saved_fs;
+    else if (serialize_to_string(*feature_space)
+             != serialize_to_string(saved_fs))
+        throw Exception("Dense_Training_Data::init_binary(): feature space of "
+                        "binary dataset '" + filename + "' doesn't match the "
+                        "one it is being loaded into");
+
+    vector<size_t> offsets;
+    vector<string> comments;
+    store >> offsets >> comments;
+
+    compact_size_t marker(store);
+    if (marker != 12345 || offsets.size() != header.row_count
+        || comments.size() != header.row_count)
+        throw Exception("Dense_Training_Data::init_binary(): binary dataset '"
+                        + filename + "' has invalid metadata");
+
+    Training_Data::init(feature_space);
+
+    dataset.resize(boost::extents[0][header.var_count]);
+    row_offsets.swap(offsets);
+    row_comments.swap(comments);
+
+    mapped_file = file;
+    mapped_data = (const float *)(file.start() + header.data_offset);
+    mapped_row_count = header.row_count;
+
+    add_data();
+}
+
+void
+Dense_Training_Data::
+save_binary(const std::string & filename) const
+{
+    std::shared_ptr<const Dense_Feature_Space> fs
+        = std::dynamic_pointer_cast<const Dense_Feature_Space>
+            (feature_space());
+    if (!fs)
+        throw Exception("Dense_Training_Data::save_binary(): no dense "
+                        "feature space");
+
+    size_t nv = variable_count();
+    size_t nx = mapped_data ? mapped_row_count : dataset.shape()[0];
+    const float * rows = mapped_data ? mapped_data : dataset.data();
+
+    std::ostringstream metadata;
+    {
+        DB::Store_Writer store(metadata);
+        fs->serialize(store);
+        store << row_offsets << row_comments << compact_size_t(12345);
+    }
+    string metadata_str = metadata.str();
+
+    Binary_Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    header.version = BINARY_VERSION;
+    header.byte_order = BINARY_BYTE_ORDER;
+    header.row_count = nx;
+    header.var_count = nv;
+    header.metadata_offset = sizeof(header);
+    header.metadata_length = metadata_str.size();
+
+    /* Page align the rows so that they can be mapped in place */
+    header.data_offset = (header.metadata_offset + header.metadata_length
+                          + 4095) & ~(uint64_t)4095;
+
+    filter_ostream stream(filename);
+    stream.write((const char *)&header, sizeof(header));
+    stream.write(metadata_str.c_str(), metadata_str.size());
+    string padding(header.data_offset - header.metadata_offset
+                   - header.metadata_length, '\0');
+    stream.write(padding.c_str(), padding.size());
+    stream.write((const char *)rows, nx * nv * sizeof(float));
+
+    if (!stream)
+        throw Exception("Dense_Training_Data::save_binary(): error writing "
+                        "'" + filename + "'");
+}
+
+bool
+Dense_Training_Data::
+is_binary(const std::string & filename)
+{
+    filter_istream stream(filename);
+
+    char magic[sizeof(BINARY_MAGIC)];
+    stream.read(magic, sizeof(magic));
+
+    return stream && memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0;
+}
+
+void
+Dense_Training_Data::
+copy_mapped_data()
+{
+    size_t nv = variable_count();
+    dataset.resize(boost::extents[mapped_row_count][nv]);
+    std::copy(mapped_data, mapped_data + mapped_row_count * nv,
+              dataset.data());
+
+    /* Point our examples at the copy.  They may be shared with other
+       training data (which will keep on reading the mapping), so we make
+       new ones rather than modifying them. */
+    const float * end = mapped_data + mapped_row_count * nv;
+    for (unsigned x = 0;  x < data_.size();  ++x) {
+        const Dense_Feature_Set * fs
+            = dynamic_cast<const Dense_Feature_Set *>(data_[x].get());
+        if (!fs || fs->values < mapped_data || fs->values >= end)
+            continue;
+        data_[x].reset(new Dense_Feature_Set
+                       (fs->features,
+                        dataset.data() + (fs->values - mapped_data)));
+    }
+
+    mapped_data = 0;
+    mapped_row_count = 0;
+}
+
 Dense_Training_Data * Dense_Training_Data::make_copy() const
 {
     return new Dense_Training_Data(*this);
@@ -1215,6 +1440,9 @@ modify_feature(int example_number,
     if (feature.type() < 0 || feature.type() >= example_count())
         throw Exception("can't add feature to dense dataset");
 
+    if (mapped_data)
+        copy_mapped_data();
+
     float & val = dataset[example_number][feature.type()];
     float result = val;
     val = new_value;
@@ -15,6 +15,7 @@
 #include "feature_space.h"
 #include "feature_info.h"
 #include "training_data.h"
+#include "jml/utils/file_functions.h"
 #include <boost/multi_array.hpp>
 #include <map>
 
@@ -316,6 +317,29 @@ public:
               const char * data_end,
               std::shared_ptr<Dense_Feature_Space> feature_space);
 
+    /** Initialise from a binary dataset written by save_binary().  The file
+        is memory mapped and the examples point straight into the mapping,
+        so nothing is parsed or copied and the pages are shared between
+        processes that load the same file.  The other init() methods call
+        this one when given a single binary file.
+
+        If the feature space is empty, the one saved with the data is
+        loaded into it; otherwise it must be identical to the saved one
+        (hence the categorical features must be numbered the same way).
+        The file must be a local, uncompressed file.
+    */
+    void init_binary(const std::string & filename,
+                     std::shared_ptr<Dense_Feature_Space> feature_space);
+
+    /** Save the dataset, its feature space, row comments and row offsets
+        in the binary format read by init_binary().  The floats are stored
+        in native byte order, row by row.
+    */
+    void save_binary(const std::string & filename) const;
+
+    /** Does the given file contain a binary dataset? */
+    static bool is_binary(const std::string & filename);
+
 private:
     struct Data_Source;
 
@@ -354,10 +378,22 @@ protected:
     /** The offset from the start of the file for the start of the line for
         each of the examples in the file. */
     std::vector<size_t> row_offsets;
-    
+
+    /** For a binary dataset, the mapped file and where in it the rows are.
+        The rows are copied into dataset the first time that one of them is
+        modified; the mapping is kept so that feature sets shared with other
+        training data objects stay valid. */
+    File_Read_Buffer mapped_file;
+    const float * mapped_data;
+    size_t mapped_row_count;
+
     /** Add the data from the dataset to the Training_Data structures so they
         can be indexed.  Usually called after all files have been read. */
     void add_data();
+
+    /** Copy the mapped rows into dataset so that they can be modified, and
+        point the examples at the copy. */
+    void copy_mapped_data();
 };
 
 
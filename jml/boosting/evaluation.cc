@@ -8,6 +8,8 @@
 
 #include "evaluation.h"
 #include "training_data.h"
+#include "training_index.h"
+#include "jml/stats/auc.h"
 
 
 using namespace std;
@@ -157,5 +159,104 @@ accuracy(const boost::multi_array<float, 2> & output,
     return result;
 }
 
-} // namespace ML
+namespace {
+
+/** Calculate the AUC, where score(x) gives the output of example x for the
+    positive label. */
+template<typename Score>
+double
+calc_auc(const Score & score,
+         const Training_Data & data,
+         const Feature & label,
+         int label_value,
+         int approx_buckets,
+         const distribution<float> & example_weights)
+{
+    size_t nx = data.example_count();
+
+    if (!example_weights.empty() && example_weights.size() != nx)
+        throw Exception("auc(): dataset and weight vector sizes don't match");
+
+    if (nx == 0)
+        throw Exception("auc(): no examples");
+
+    const vector<Label> & labels = data.index().labels(label);
+
+    auto weight = [&] (size_t x) -> float
+        {
+            return example_weights.empty() ? 1.0 : example_weights[x];
+        };
+
+    if (approx_buckets == 0) {
+        vector<AUC_Entry> entries;
+        entries.reserve(nx);
+        for (unsigned x = 0;  x < nx;  ++x)
+            entries.push_back(AUC_Entry(score(x), labels[x] == label_value,
+                                        weight(x)));
+        return 1.0 - do_calc_auc_parallel(entries);
+    }
+
+    float min_score = INFINITY, max_score = -INFINITY;
+    for (unsigned x = 0;  x < nx;  ++x) {
+        float s = score(x);
+        if (!isfinite(s)) continue;
+        min_score = std::min(min_score, s);
+        max_score = std::max(max_score, s);
+    }
+
+    if (!(max_score > min_score)) {
+        min_score = 0.0;
+        max_score = 1.0;
+    }
 
+    AUC_Histogram histogram(min_score, max_score, approx_buckets);
+    for (unsigned x = 0;  x < nx;  ++x)
+        histogram.add(score(x), labels[x] == label_value, weight(x));
+
+    return 1.0 - histogram.calc_auc();
+}
+
+} // file scope
+
+double
+auc(const std::vector<distribution<float> > & output,
+    const Training_Data & data,
+    const Feature & label,
+    int label_value,
+    int approx_buckets,
+    const distribution<float> & example_weights)
+{
+    if (output.size() != data.example_count())
+        throw Exception("auc: output and data sizes don't match");
+
+    auto score = [&] (size_t x) -> float
+        {
+            if (label_value >= output[x].size())
+                throw Exception("auc(): label has no output");
+            return output[x][label_value];
+        };
+
+    return calc_auc(score, data, label, label_value, approx_buckets,
+                    example_weights);
+}
+
+double
+auc(const boost::multi_array<float, 2> & output,
+    const Training_Data & data,
+    const Feature & label,
+    int label_value,
+    int approx_buckets,
+    const distribution<float> & example_weights)
+{
+    if (output.shape()[0] != data.example_count())
+        throw Exception("auc: data set and output size don't match");
+    if (label_value >= output.shape()[1])
+        throw Exception("auc(): label has no output");
+
+    auto score = [&] (size_t x) -> float { return output[x][label_value]; };
+
+    return calc_auc(score, data, label, label_value, approx_buckets,
+                    example_weights);
+}
+
+} // namespace ML
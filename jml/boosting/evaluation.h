@@ -157,6 +157,48 @@ float accuracy(const boost::multi_array<float, 2> & output,
                const distribution<float> & example_weights
                    = UNIFORM_WEIGHTS);
 
+/** Calculate the area under the ROC curve of one label of a classification
+    problem, using a set of already cached predictions.
+
+    \param output             the output of the classifier for each of the
+                              examples in \p data.
+    \param data               the training data used to calculate the AUC
+                              over.
+    \param label_value        the label that counts as positive.  Its
+                              output is the score that examples are
+                              ranked by.
+    \param approx_buckets     if zero, the exact AUC is calculated by
+                              sorting the examples in parallel (see
+                              do_calc_auc_parallel).  Otherwise an
+                              AUC_Histogram with this number of buckets
+                              over the range of the outputs is used, which
+                              is approximate but needs no sort.
+    \param example_weights    a weighting of the examples.  The exact AUC
+                              only uses it to ignore examples with a zero
+                              weight.
+    \returns                  a number between 0 and 1; 1 is a perfect
+                              ranking and 0.5 a random one.
+
+    \pre                      data.size() == output.size()
+*/
+double auc(const std::vector<distribution<float> > & output,
+           const Training_Data & data,
+           const Feature & label,
+           int label_value = 1,
+           int approx_buckets = 0,
+           const distribution<float> & example_weights = UNIFORM_WEIGHTS);
+
+/** Same as the previous, for a matrix of outputs.
+
+    \pre                      data.size() == output.shape()[0]
+*/
+double auc(const boost::multi_array<float, 2> & output,
+           const Training_Data & data,
+           const Feature & label,
+           int label_value = 1,
+           int approx_buckets = 0,
+           const distribution<float> & example_weights = UNIFORM_WEIGHTS);
+
 } // namespace ML
 
 
@@ -17,6 +17,7 @@
 #include <limits>
 #include "jml/utils/vector_utils.h"
 #include "jml/compiler/compiler.h"
+#include "jml/arch/simd_vector.h"
 
 using namespace std;
 using namespace ML::DB;
@@ -223,6 +224,31 @@ optimized_predict_impl(int label,
     return do_predict_impl(label, features_c, &feature_indexes[0]);
 }
 
+void
+GLZ_Classifier::
+optimized_predict_batch_impl(const float * features_c,
+                             size_t nrows,
+                             const Optimization_Info & info,
+                             float * output,
+                             PredictionContext * context) const
+{
+    do_predict_batch_impl(features_c, nrows, info.features_out(),
+                          &feature_indexes[0], -1, output);
+}
+
+void
+GLZ_Classifier::
+optimized_predict_batch_impl(int label,
+                             const float * features_c,
+                             size_t nrows,
+                             const Optimization_Info & info,
+                             float * output,
+                             PredictionContext * context) const
+{
+    do_predict_batch_impl(features_c, nrows, info.features_out(),
+                          &feature_indexes[0], label, output);
+}
+
 float
 GLZ_Classifier::
 decode_value(float feat_val, const Feature_Spec & spec) const
@@ -276,6 +302,40 @@ do_accum(const float * features_c,
     return apply_link_inverse(accum, link);
 }
 
+void
+GLZ_Classifier::
+do_predict_batch_impl(const float * features_c,
+                      size_t nrows,
+                      size_t stride,
+                      const int * indexes,
+                      int label,
+                      float * output) const
+{
+    size_t nv = features.size();
+    int first = (label == -1 ? 0 : label);
+    int last = (label == -1 ? label_count() : label + 1);
+
+    // Decoded row, contiguous so that the dot product can use SIMD
+    float decoded[nv + 1];
+
+    for (size_t i = 0;  i < nrows;  ++i) {
+        const float * row = features_c + i * stride;
+
+        for (unsigned j = 0;  j < nv;  ++j) {
+            int idx = (indexes ? indexes[j] : j);
+            decoded[j] = decode_value(row[idx], features[j]);
+        }
+
+        for (int l = first;  l < last;  ++l) {
+            const distribution<float> & w = weights[l];
+            double accum = (nv ? SIMD::vec_dotprod_dp(decoded, &w[0], nv)
+                            : 0.0);
+            if (add_bias) accum += w[nv];
+            *output++ = apply_link_inverse(accum, link);
+        }
+    }
+}
+
 Label_Dist
 GLZ_Classifier::
 do_predict_impl(const float * features_c,
@@ -145,6 +145,23 @@ public:
                            const Optimization_Info & info,
                            PredictionContext * context = 0) const;
 
+    /** Batch predict.  Decodes each row once for all of the labels, and
+        then does a SIMD dot product with the weights of each label. */
+    virtual void
+    optimized_predict_batch_impl(const float * features,
+                                 size_t nrows,
+                                 const Optimization_Info & info,
+                                 float * output,
+                                 PredictionContext * context = 0) const;
+
+    virtual void
+    optimized_predict_batch_impl(int label,
+                                 const float * features,
+                                 size_t nrows,
+                                 const Optimization_Info & info,
+                                 float * output,
+                                 PredictionContext * context = 0) const;
+
 #ifndef JML_TESTING_GLZ_CLASSIFIER
 protected:
 #endif
@@ -166,6 +183,17 @@ protected:
                     const float * features,
                     const int * indexes) const;
 
+    // Batch version: rows of stride floats, each dereferenced through
+    // indexes.  Writes all of the labels if label is -1, otherwise only
+    // the given one.
+    void
+    do_predict_batch_impl(const float * features,
+                          size_t nrows,
+                          size_t stride,
+                          const int * indexes,
+                          int label,
+                          float * output) const;
+
     // Internal function used to do the actual work
     double
     do_accum(const float * features_c,
@@ -218,6 +218,47 @@ std::string print(Split::Op op);
 std::ostream & operator << (std::ostream & stream, Split::Op op);
 
 
+/*****************************************************************************/
+/* FLAT_SPLIT                                                                */
+/*****************************************************************************/
+
+/** Compact form of a split for the flattened models that are built by
+    optimize() and only used for prediction.  It holds the index of the
+    feature in the dense feature vector instead of the feature itself, and
+    fits in 12 bytes.
+*/
+
+struct Flat_Split {
+    Flat_Split()
+        : index(0), split_val(0.0f), op_mask(0)
+    {
+    }
+
+    Flat_Split(const Split & split, int index)
+        : index(index), split_val(split.split_val()),
+          op_mask(1 << split.op())
+    {
+    }
+
+    int index;          ///< Index of the feature in the dense vector
+    float split_val;    ///< Value to test against
+    uint32_t op_mask;   ///< 1 << Split::Op
+
+    /** Same as Split::apply(): returns true, false or MISSING. */
+    JML_ALWAYS_INLINE int apply(const float * features) const
+    {
+        float feature_val = features[index];
+        if (isnanf(feature_val)) return MISSING;
+
+        bool equal = feature_val == split_val;
+        bool less = feature_val < split_val;
+        int all = (less | (equal << 1) | 4);
+
+        return (all & op_mask) != 0;
+    }
+};
+
+
 } // namespace ML
 
 
@@ -12,6 +12,7 @@
 #include <boost/utility.hpp>
 #include <boost/scoped_array.hpp>
 #include <boost/shared_array.hpp>
+#include <map>
 #include "stump_training_cuda.h"
 #include "fixed_point_accum.h"
 #include "arch/cuda/device_data.h"
@@ -78,6 +79,7 @@ stumpBinsymKernel(const uint16_t * buckets,
                   uint32_t size,
                   const float * weights,
                   const float * ex_weights,
+                  uint32_t example_offset, // example num of i == 0
                   TwoBuckets * buckets_global,
                   TwoBuckets * w_label_global_,
                   int num_buckets,
@@ -139,31 +141,34 @@ stumpBinsymKernel(const uint16_t * buckets,
             int example = start_at + i * num_threads;
 
             if (example >= size) break;
+
+            // The weights are for all examples, not just this block
+            int weight_index = example + example_offset;
             
             float4 weight, ex_weight;
             
             if (use_texture) {
-                ex_weight.x = tex1Dfetch(ex_weights_tex, example);
-                ex_weight.y = tex1Dfetch(ex_weights_tex, example + 1);
-                ex_weight.z = tex1Dfetch(ex_weights_tex, example + 2);
-                ex_weight.w = tex1Dfetch(ex_weights_tex, example + 3);
+                ex_weight.x = tex1Dfetch(ex_weights_tex, weight_index);
+                ex_weight.y = tex1Dfetch(ex_weights_tex, weight_index + 1);
+                ex_weight.z = tex1Dfetch(ex_weights_tex, weight_index + 2);
+                ex_weight.w = tex1Dfetch(ex_weights_tex, weight_index + 3);
 
-                //ex_weight = tex1Dfetch(ex_weights_tex4, example);
+                //ex_weight = tex1Dfetch(ex_weights_tex4, weight_index);
 
-                weight.x = tex1Dfetch(weights_tex, example);
-                weight.y = tex1Dfetch(weights_tex, example + 1);
-                weight.z = tex1Dfetch(weights_tex, example + 2);
-                weight.w = tex1Dfetch(weights_tex, example + 3);
+                weight.x = tex1Dfetch(weights_tex, weight_index);
+                weight.y = tex1Dfetch(weights_tex, weight_index + 1);
+                weight.z = tex1Dfetch(weights_tex, weight_index + 2);
+                weight.w = tex1Dfetch(weights_tex, weight_index + 3);
 
-                //weight = tex1Dfetch(weights_tex4, example);
+                //weight = tex1Dfetch(weights_tex4, weight_index);
             }
             else if (use_texture  && false /* doesn't work; most get zero */) {
-                ex_weight = tex1Dfetch(ex_weights_tex4, example);
-                weight = tex1Dfetch(weights_tex4, example);
+                ex_weight = tex1Dfetch(ex_weights_tex4, weight_index);
+                weight = tex1Dfetch(weights_tex4, weight_index);
             }
             else {
-                ex_weight = *(const float4 *)(&ex_weights[example]);
-                weight = *(const float4 *)(&weights[example]);
+                ex_weight = *(const float4 *)(&ex_weights[weight_index]);
+                weight = *(const float4 *)(&weights[weight_index]);
             }
 
             weight.x *= ex_weight.x;
@@ -350,31 +355,34 @@ stumpBinsymKernelPacked(const uint64_t * index_data,
             int example = start_at + i * num_threads;
 
             if (example >= size) break;
+
+            // The weights are for all examples, not just this block
+            int weight_index = example + example_offset;
             
             float4 weight, ex_weight;
             
             if (use_texture) {
-                ex_weight.x = tex1Dfetch(ex_weights_tex, example);
-                ex_weight.y = tex1Dfetch(ex_weights_tex, example + 1);
-                ex_weight.z = tex1Dfetch(ex_weights_tex, example + 2);
-                ex_weight.w = tex1Dfetch(ex_weights_tex, example + 3);
+                ex_weight.x = tex1Dfetch(ex_weights_tex, weight_index);
+                ex_weight.y = tex1Dfetch(ex_weights_tex, weight_index + 1);
+                ex_weight.z = tex1Dfetch(ex_weights_tex, weight_index + 2);
+                ex_weight.w = tex1Dfetch(ex_weights_tex, weight_index + 3);
 
-                //ex_weight = tex1Dfetch(ex_weights_tex4, example);
+                //ex_weight = tex1Dfetch(ex_weights_tex4, weight_index);
 
-                weight.x = tex1Dfetch(weights_tex, example);
-                weight.y = tex1Dfetch(weights_tex, example + 1);
-                weight.z = tex1Dfetch(weights_tex, example + 2);
-                weight.w = tex1Dfetch(weights_tex, example + 3);
+                weight.x = tex1Dfetch(weights_tex, weight_index);
+                weight.y = tex1Dfetch(weights_tex, weight_index + 1);
+                weight.z = tex1Dfetch(weights_tex, weight_index + 2);
+                weight.w = tex1Dfetch(weights_tex, weight_index + 3);
 
-                //weight = tex1Dfetch(weights_tex4, example);
+                //weight = tex1Dfetch(weights_tex4, weight_index);
             }
             else if (use_texture  && false /* doesn't work; most get zero */) {
-                ex_weight = tex1Dfetch(ex_weights_tex4, example);
-                weight = tex1Dfetch(weights_tex4, example);
+                ex_weight = tex1Dfetch(ex_weights_tex4, weight_index);
+                weight = tex1Dfetch(weights_tex4, weight_index);
             }
             else {
-                ex_weight = *(const float4 *)(&ex_weights[example]);
-                weight = *(const float4 *)(&weights[example]);
+                ex_weight = *(const float4 *)(&ex_weights[weight_index]);
+                weight = *(const float4 *)(&weights[weight_index]);
             }
 
             weight.x *= ex_weight.x;
@@ -577,6 +585,12 @@ void executeHostCompressed(TwoBuckets * accum,
                            int divisor_bits,
                            size_t size);
 
+static void check_cuda(cudaError_t err)
+{
+    if (err != cudaSuccess)
+        throw Exception(cudaGetErrorString(err));
+}
+
 struct Test_Buckets_Binsym::Context {
     const Plan * plan;
     
@@ -585,11 +599,13 @@ struct Test_Buckets_Binsym::Context {
     DeviceData<TwoBuckets>  d_accum;
     DeviceData<TwoBuckets>  d_w_label;
     bool on_device;
+    int device;
 
     void synchronize()
     {
         if (on_device) {
-            
+            check_cuda(cudaSetDevice(device));
+
             cudaError_t err = cudaThreadSynchronize();
             
             if (err != cudaSuccess)
@@ -600,15 +616,60 @@ struct Test_Buckets_Binsym::Context {
             d_w_label.sync(w_label);
         }
 
-#if 1
+#if 0
         cerr << "final results: " << endl;
         for (unsigned i = 0;  i < 2 /*num_buckets*/;  ++i)
             cerr << "bucket " << i << ": 0: " << accum[i][0]
                  << "  1: " << accum[i][1] << endl;
-#endif
         cerr << "w_label: 0: " << w_label[0][0] << " 1: " << w_label[0][1]
              << endl;
+#endif
+    }
+};
+
+/** Device memory for one block of an index that is being streamed to the
+    device, with the stream that copies it and runs the kernel on it.  As
+    everything on a stream is done in order, the buffer can be reused for
+    the next block on the same stream without waiting.
+*/
+struct Block_Buffer {
+    Block_Buffer()
+        : stream(0)
+    {
+    }
+
+    ~Block_Buffer()
+    {
+        if (stream) cudaStreamDestroy(stream);
+    }
+
+    void init(uint32_t block_size, bool examples, bool divisors)
+    {
+        check_cuda(cudaStreamCreate(&stream));
+        d_buckets.init(block_size);
+        d_labels.init(block_size);
+        if (examples) d_examples.init(block_size);
+        if (divisors) d_divisors.init(block_size);
+    }
+
+    template<typename D>
+    static void copy(DeviceData<D> & to, const D * from, uint32_t n,
+                     cudaStream_t stream)
+    {
+        if (!from) return;
+        check_cuda(cudaMemcpyAsync(to.getDevice(), from, n * sizeof(D),
+                                   cudaMemcpyHostToDevice, stream));
     }
+
+    cudaStream_t stream;
+    DeviceData<uint16_t> d_buckets;
+    DeviceData<uint32_t> d_examples;
+    DeviceData<int32_t>  d_labels;
+    DeviceData<float>    d_divisors;
+
+private:
+    Block_Buffer(const Block_Buffer &);
+    void operator = (const Block_Buffer &);
 };
 
 struct Test_Buckets_Binsym::Plan {
@@ -622,11 +683,14 @@ struct Test_Buckets_Binsym::Plan {
          const float * ex_weights,
          int num_buckets,
          bool on_device,
-         bool compressed)
+         bool compressed,
+         int device,
+         uint32_t block_size)
         : buckets(buckets), examples(examples), labels(labels),
           divisors(divisors), size(size), weights(weights),
           ex_weights(ex_weights), num_buckets(num_buckets),
-          on_device(on_device), compressed(compressed)
+          on_device(on_device), compressed(compressed), device(device),
+          block_size(block_size), pinned(false)
           
     {
         if (!buckets)
@@ -637,6 +701,8 @@ struct Test_Buckets_Binsym::Plan {
         
         if (!on_device) return;  // nothing to set up if running on host
 
+        check_cuda(cudaSetDevice(device));
+
         // How many concurrent threads are launched at the same time to work
         // together?  If this number is too high, then we will have contention
         // on the shared memory (the probability that we update multiple buckets
@@ -650,9 +716,6 @@ struct Test_Buckets_Binsym::Plan {
         // How many of these thread blocks?
         grid = dim3( rudiv(size, threads.x * num_todo));
         
-        cerr << "num_todo = " << num_todo << endl;
-        cerr << "grid: x = " << grid.x << endl;
-        
         // If there aren't enough buckets, then create some more and merge
         // them together at the end.
         // This helps to avoid bank conflicts.
@@ -664,10 +727,6 @@ struct Test_Buckets_Binsym::Plan {
             buckets_to_allocate = num_buckets * bucket_expansion;
         }
         
-        cerr << "num_buckets = " << num_buckets << " bucket_expansion = "
-             << bucket_expansion << " buckets_to_allocate = "
-             << buckets_to_allocate << endl;
-
         // How much shared memory?
         //
         // We need:
@@ -679,12 +738,23 @@ struct Test_Buckets_Binsym::Plan {
         // parallelism.
         shared_mem_size = sizeof(TwoBuckets) * (buckets_to_allocate + 1);
         
-        cerr << "shared_mem_size = " << shared_mem_size << endl;
-        
+        choose_block_size();
+
         if (compressed) {
             d_compressed_index.init(compressed_index.data.get(),
                                     compressed_index.num_words);
         }
+        else if (streamed()) {
+            // Async copies need page locked memory on the host
+            pin(buckets);
+            pin(examples);
+            pin(labels);
+            pin(divisors);
+            pinned = true;
+
+            for (unsigned i = 0;  i < 2;  ++i)
+                buffers[i].init(block_size, examples, divisors);
+        }
         else {
             d_buckets.init(buckets, size);
             d_examples.init(examples, size);
@@ -695,26 +765,95 @@ struct Test_Buckets_Binsym::Plan {
         d_weights.init(weights, size);
         d_ex_weights.init(ex_weights, size);
 
-        // set texture parameters
-        cudaError_t err;
-            
-        err = cudaBindTexture(0, weights_tex, d_weights /*, d_weights.num_bytes()*/);
-        if (err != cudaSuccess)
-            throw Exception(cudaGetErrorString(err));
-                
-        err = cudaBindTexture(0, ex_weights_tex, d_ex_weights /* , d_ex_weights.num_bytes()*/);
-        if (err != cudaSuccess)
-            throw Exception(cudaGetErrorString(err));
+        use_texture = true;
+    }
 
-        err = cudaBindTexture(0, weights_tex4, d_weights /*, d_weights.num_bytes()*/);
-        if (err != cudaSuccess)
-            throw Exception(cudaGetErrorString(err));
-                
-        err = cudaBindTexture(0, ex_weights_tex4, d_ex_weights /*, d_ex_weights.num_bytes()*/);
-        if (err != cudaSuccess)
-            throw Exception(cudaGetErrorString(err));
+    ~Plan()
+    {
+        if (!pinned) return;
+        unpin(buckets);
+        unpin(examples);
+        unpin(labels);
+        unpin(divisors);
+    }
 
-        use_texture = true;
+    /** Work out how many entries of the index go to the device at once.
+        The weights need to fit whole, and then two blocks of the index
+        need to fit in what is left (one being copied while the kernel
+        runs on the other).
+    */
+    void choose_block_size()
+    {
+        // Whole blocks of threads, and four entries at once per thread
+        uint32_t granularity = threads.x * num_todo;
+
+        size_t entry_bytes = sizeof(uint16_t) + sizeof(int32_t)
+            + (examples ? sizeof(uint32_t) : 0)
+            + (divisors ? sizeof(float) : 0);
+
+        if (block_size == 0) {
+            size_t free_bytes, total_bytes;
+            check_cuda(cudaMemGetInfo(&free_bytes, &total_bytes));
+
+            // Leave some space for the accumulators and anyone else
+            size_t usable = free_bytes / 10 * 9;
+            size_t weight_bytes = 2 * sizeof(float) * (size_t)size;
+
+            size_t index_bytes
+                = (compressed ? compressed_index.num_words * sizeof(uint64_t)
+                   : entry_bytes * size);
+
+            if (weight_bytes + index_bytes <= usable)
+                return;  // all fits; no need to stream
+
+            if (compressed)
+                throw Exception("compressed index of %zd bytes doesn't fit "
+                                "on device %d; an uncompressed index can be "
+                                "streamed", index_bytes, device);
+
+            if (weight_bytes >= usable)
+                throw Exception("weights of %zd bytes don't fit on "
+                                "device %d", weight_bytes, device);
+
+            block_size = std::min<size_t>((usable - weight_bytes)
+                                          / (2 * entry_bytes),
+                                          size);
+        }
+        else if (compressed)
+            throw Exception("compressed index can't be streamed");
+
+        block_size = block_size / granularity * granularity;
+        if (block_size == 0)
+            block_size = granularity;
+    }
+
+    bool streamed() const
+    {
+        return block_size != 0 && block_size < size;
+    }
+
+    template<typename D>
+    void pin(const D * data)
+    {
+        if (!data) return;
+        check_cuda(cudaHostRegister((void *)data, sizeof(D) * (size_t)size,
+                                    cudaHostRegisterPortable));
+    }
+
+    template<typename D>
+    void unpin(const D * data)
+    {
+        if (data) cudaHostUnregister((void *)data);
+    }
+
+    /** Point the textures at our weights.  They are global to the device,
+        so this is done before each launch. */
+    void bind_textures() const
+    {
+        check_cuda(cudaBindTexture(0, weights_tex, d_weights));
+        check_cuda(cudaBindTexture(0, ex_weights_tex, d_ex_weights));
+        check_cuda(cudaBindTexture(0, weights_tex4, d_weights));
+        check_cuda(cudaBindTexture(0, ex_weights_tex4, d_ex_weights));
     }
 
     const uint16_t * buckets;
@@ -727,6 +866,9 @@ struct Test_Buckets_Binsym::Plan {
     int num_buckets;
     bool on_device;
     bool compressed;
+    int device;
+    uint32_t block_size;
+    bool pinned;
 
     dim3 threads;
     int num_todo;
@@ -746,17 +888,21 @@ struct Test_Buckets_Binsym::Plan {
     Bit_Compressed_Index compressed_index;
     DeviceData<uint64_t> d_compressed_index;
 
+    // Double buffering of the blocks when streaming
+    mutable Block_Buffer buffers[2];
+
     bool use_texture;
 
-    boost::shared_ptr<Context>
+    std::shared_ptr<Context>
     executeHost(TwoBuckets * accum,
                 TwoBuckets & w_label) const
     {
-        boost::shared_ptr<Context> result(new Context());
+        std::shared_ptr<Context> result(new Context());
         //result->plan = this;
 
         // Get the data structures
         result->on_device = false;
+        result->device = -1;
         result->accum = accum;
         result->w_label = &w_label;
 
@@ -779,20 +925,64 @@ struct Test_Buckets_Binsym::Plan {
         return result;
     }
 
-    boost::shared_ptr<Context>
+    /** Copy each block in turn and run the kernel on it, alternating
+        between the two buffers so that a copy overlaps the kernel before
+        it.  All of the kernels add into the same accumulators. */
+    void executeStreamed(Context & context) const
+    {
+        for (uint32_t start = 0, n = 0;  start < size;  start += n) {
+            n = std::min(block_size, size - start);
+
+            Block_Buffer & buffer = buffers[(start / block_size) % 2];
+
+            Block_Buffer::copy(buffer.d_buckets, buckets + start, n,
+                               buffer.stream);
+            Block_Buffer::copy(buffer.d_labels, labels + start, n,
+                               buffer.stream);
+            if (examples)
+                Block_Buffer::copy(buffer.d_examples, examples + start, n,
+                                   buffer.stream);
+            if (divisors)
+                Block_Buffer::copy(buffer.d_divisors, divisors + start, n,
+                                   buffer.stream);
+
+            dim3 block_grid(rudiv(n, threads.x * num_todo));
+
+            // Example numbers are explicit if there is an examples array
+            uint32_t example_offset = (examples ? 0 : start);
+
+            stumpBinsymKernel<<< block_grid, threads, shared_mem_size,
+                                 buffer.stream >>>
+                ( buffer.d_buckets, buffer.d_examples, buffer.d_labels,
+                  buffer.d_divisors,
+                  n, d_weights, d_ex_weights, example_offset,
+                  context.d_accum, context.d_w_label,
+                  num_buckets, bucket_expansion, num_todo,
+                  use_texture);
+
+            check_cuda(cudaGetLastError());
+        }
+    }
+
+    std::shared_ptr<Context>
     executeDevice(TwoBuckets * accum,
                   TwoBuckets & w_label) const
     {
-        boost::shared_ptr<Context> result(new Context());
+        check_cuda(cudaSetDevice(device));
+
+        std::shared_ptr<Context> result(new Context());
         //result->plan = this;
 
         // Get the data structures
         result->d_accum.init(accum, num_buckets);
         result->d_w_label.init(&w_label, 1);
         result->on_device = true;
+        result->device = device;
         result->accum = accum;
         result->w_label = &w_label;
 
+        if (use_texture) bind_textures();
+
         // execute the kernel
         if (compressed)
             stumpBinsymKernelPacked<<< grid, threads, shared_mem_size >>>
@@ -805,10 +995,12 @@ struct Test_Buckets_Binsym::Plan {
                   result->d_accum, result->d_w_label,
                   num_buckets, bucket_expansion, num_todo,
                   use_texture);
+        else if (streamed())
+            executeStreamed(*result);
         else
             stumpBinsymKernel<<< grid, threads, shared_mem_size >>>
                 ( d_buckets, d_examples, d_labels, d_divisors,
-                  size, d_weights, d_ex_weights,
+                  size, d_weights, d_ex_weights, 0 /* example offset */,
                   result->d_accum, result->d_w_label,
                   num_buckets, bucket_expansion, num_todo,
                   use_texture);
@@ -821,7 +1013,7 @@ struct Test_Buckets_Binsym::Plan {
         return result;
     }
 
-    boost::shared_ptr<Context>
+    std::shared_ptr<Context>
     execute(TwoBuckets * accum,
             TwoBuckets & w_label) const
     {
@@ -836,7 +1028,7 @@ struct Test_Buckets_Binsym::Plan {
     }
 };
 
-boost::shared_ptr<Test_Buckets_Binsym::Plan>
+std::shared_ptr<Test_Buckets_Binsym::Plan>
 Test_Buckets_Binsym::
 plan(const uint16_t * buckets,
      const uint32_t * examples, // or 0 if example num == i
@@ -847,14 +1039,17 @@ plan(const uint16_t * buckets,
      const float * ex_weights,
      int num_buckets,
      bool on_device,
-     bool compressed) const
+     bool compressed,
+     int device,
+     uint32_t block_size) const
 {
-    return boost::shared_ptr<Test_Buckets_Binsym::Plan>
+    return std::shared_ptr<Test_Buckets_Binsym::Plan>
         (new Plan(buckets, examples, labels, divisors, size, weights,
-                  ex_weights, num_buckets, on_device, compressed));
+                  ex_weights, num_buckets, on_device, compressed,
+                  device, block_size));
 }
 
-boost::shared_ptr<Test_Buckets_Binsym::Context>
+std::shared_ptr<Test_Buckets_Binsym::Context>
 Test_Buckets_Binsym::
 execute(const Plan & plan,
         TwoBuckets * accum,
@@ -870,6 +1065,50 @@ synchronize(Context & context) const
     context.synchronize();
 }
 
+int
+Test_Buckets_Binsym::
+num_devices()
+{
+    int result = 0;
+    cudaError_t err = cudaGetDeviceCount(&result);
+    if (err == cudaErrorNoDevice) return 0;
+    check_cuda(err);
+    return result;
+}
+
+void
+Test_Buckets_Binsym::
+execute(const std::vector<const Plan *> & plans,
+        const std::vector<TwoBuckets *> & accum,
+        TwoBuckets * w_label) const
+{
+    if (plans.size() != accum.size())
+        throw Exception("Test_Buckets_Binsym::execute(): %zd plans but %zd "
+                        "accumulators", plans.size(), accum.size());
+
+    // The textures for each device can only point to one set of weights
+    std::map<int, const Plan *> device_weights;
+    for (unsigned i = 0;  i < plans.size();  ++i) {
+        const Plan & plan = *plans[i];
+        if (!plan.on_device) continue;
+        const Plan * & first = device_weights[plan.device];
+        if (!first) first = &plan;
+        else if (first->weights != plan.weights
+                 || first->ex_weights != plan.ex_weights)
+            throw Exception("Test_Buckets_Binsym::execute(): plans on "
+                            "device %d have different weights", plan.device);
+    }
+
+    // Launching is asynchronous, so all of the devices are busy at once.
+    // The host plans run here in turn.
+    std::vector<std::shared_ptr<Context> > contexts;
+    for (unsigned i = 0;  i < plans.size();  ++i)
+        contexts.push_back(plans[i]->execute(accum[i], w_label[i]));
+
+    for (unsigned i = 0;  i < contexts.size();  ++i)
+        contexts[i]->synchronize();
+}
+
 
 } // namespace CUDA
 } // namespace ML
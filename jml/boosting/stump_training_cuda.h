@@ -10,7 +10,8 @@
 #ifndef __jml__stump_training_cuda_h__
 #define __jml__stump_training_cuda_h__
 
-#include <boost/shared_ptr.hpp>
+#include <memory>
+#include <vector>
 #include "fixed_point_accum.h"
 
 namespace ML {
@@ -29,6 +30,16 @@ struct Test_Buckets_Binsym {
     struct Plan;     // Implementation is private
     struct Context;  // implementation is private
 
+    /** Plan to accumulate the buckets of one feature.
+
+        The plan runs on the given CUDA device.  If the index is too big to
+        be kept on the device, it is streamed there in blocks of block_size
+        entries, with the transfer of one block overlapping the kernel for
+        the one before.  A block_size of 0 means choose it from the free
+        memory on the device (and keep the whole index there if it fits).
+        Only the uncompressed layout can be streamed; the weights are
+        always kept whole on the device.
+    */
     std::shared_ptr<Plan>
     plan(const uint16_t * buckets,
          const uint32_t * examples, // or 0 if example num == i
@@ -39,7 +50,9 @@ struct Test_Buckets_Binsym {
          const float * ex_weights,
          int num_buckets,
          bool on_device,
-         bool compressed) const;
+         bool compressed,
+         int device = 0,
+         uint32_t block_size = 0) const;
 
     std::shared_ptr<Context>
     execute(const Plan & plan,
@@ -48,6 +61,24 @@ struct Test_Buckets_Binsym {
 
     /** Wait for the given context to be finished. */
     void synchronize(Context & context) const;
+
+    /** Number of CUDA devices that plans can be made on. */
+    static int num_devices();
+
+    /** Execute a plan per feature and wait for all of them to finish.  The
+        features are normally sharded over the devices by planning feature
+        i on device i % num_devices(); the plans on different devices run
+        at the same time.  plans[i] accumulates into accum[i] and
+        w_label[i].
+
+        The plans that are on the same device must have the same weights
+        and ex_weights, as these are read through textures that are global
+        to the device.  The buckets are accumulated in fixed point, so the
+        results don't depend on how the work was split up.
+    */
+    void execute(const std::vector<const Plan *> & plans,
+                 const std::vector<TwoBuckets *> & accum,
+                 TwoBuckets * w_label) const;
 };
 
 } // namespace CUDA
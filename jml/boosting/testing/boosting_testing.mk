@@ -3,11 +3,17 @@ $(eval $(call test,split_test,boosting,boost))
 $(eval $(call test,decision_tree_multithreaded_test,boosting utils arch worker_task,boost))
 $(eval $(call test,decision_tree_unlimited_depth_test,boosting utils arch worker_task,boost))
 $(eval $(call test,glz_classifier_test,boosting utils arch worker_task,boost))
+$(eval $(call test,classifier_batch_test,boosting utils arch worker_task,boost))
+$(eval $(call test,compiled_classifier_test,boosting utils arch worker_task,boost))
 $(eval $(call test,probabilizer_test,boosting utils arch,boost))
 $(eval $(call test,feature_info_test,boosting utils arch,boost))
+$(eval $(call test,dense_training_data_binary_test,boosting utils arch,boost))
+$(eval $(call test,compressed_index_test,boosting utils arch,boost))
 $(eval $(call test,weighted_training_test,boosting,boost manual))
+$(eval $(call test,cross_validation_test,boosting utils arch worker_task,boost))
 
 $(eval $(call program,dataset_nan_test,boosting utils arch boosting_tools))
+$(eval $(call program,stump_training_parallel_bench,boosting utils arch worker_task))
 
 ifeq ($(CUDA_ENABLED),1)
 $(eval $(call test,split_cuda_test,boosting_cuda,boost))
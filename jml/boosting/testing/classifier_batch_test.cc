@@ -0,0 +1,149 @@
+/* classifier_batch_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test that the batch predict gives the same answers as the normal one.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <limits>
+#include <iostream>
+
+#include "jml/boosting/glz_classifier_generator.h"
+#include "jml/boosting/decision_tree_generator.h"
+#include "jml/boosting/boosted_stumps_generator.h"
+#include "jml/boosting/training_data.h"
+#include "jml/boosting/dense_features.h"
+#include "jml/boosting/feature_info.h"
+#include "jml/utils/smart_ptr_utils.h"
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+int nfv = 1000;
+
+/* Rows are LABEL feature1 feature2 feature3, so that the features start one
+   float after the beginning of the row and the stride isn't the number of
+   features. */
+enum { STRIDE = 4 };
+
+struct Fixture {
+    Fixture()
+    {
+        fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+        fs.add_feature("feature1", REAL);
+        fs.add_feature("feature2", REAL);
+        fs.add_feature("feature3", REAL);
+
+        fsp = make_unowned_sp(fs);
+        data.reset(new Training_Data(fsp));
+
+        float NaN = std::numeric_limits<float>::quiet_NaN();
+
+        for (unsigned i = 0;  i < nfv;  ++i) {
+            distribution<float> row;
+            row.push_back(i % 3 == 0);
+            row.push_back(i % 3);
+            row.push_back(i % 5 == 0 ? NaN : i % 5);
+            row.push_back((i * 7) % 11 / 11.0);
+
+            rows.insert(rows.end(), row.begin(), row.end());
+            data->add_example(fs.encode(row));
+        }
+
+        features = fs.features();
+        features.erase(features.begin());
+    }
+
+    void check(Classifier_Generator & generator)
+    {
+        Configuration config;
+        config.parse_string("verbosity=0\nmax_iter=50\n", "inbuilt");
+        generator.configure(config);
+        generator.init(fsp, fs.features()[0]);
+
+        distribution<float> training_weights(nfv, 1);
+        Thread_Context context;
+
+        std::shared_ptr<Classifier_Impl> classifier
+            = generator.generate(context, *data, training_weights, features);
+
+        Optimization_Info info = classifier->optimize(features);
+        BOOST_REQUIRE(info);
+        BOOST_CHECK(classifier->predict_is_optimized());
+
+        int nl = classifier->label_count();
+        vector<float> output(nfv * nl);
+        classifier->predict_batch(&rows[1], nfv, STRIDE, info, &output[0]);
+
+        vector<float> output1(nfv);
+        classifier->predict_batch(1, &rows[1], nfv, STRIDE, info,
+                                  &output1[0]);
+
+        for (unsigned i = 0;  i < nfv;  ++i) {
+            distribution<float> row(&rows[i * STRIDE],
+                                    &rows[i * STRIDE] + STRIDE);
+            Label_Dist expected = classifier->predict(*fs.encode(row));
+
+            for (unsigned l = 0;  l < nl;  ++l)
+                BOOST_CHECK_CLOSE(output[i * nl + l] + 1.0f,
+                                  expected[l] + 1.0f, 0.001);
+            BOOST_CHECK_CLOSE(output1[i] + 1.0f, expected[1] + 1.0f, 0.001);
+        }
+    }
+
+    Dense_Feature_Space fs;
+    std::shared_ptr<Dense_Feature_Space> fsp;
+    std::shared_ptr<Training_Data> data;
+    vector<Feature> features;
+    vector<float> rows;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_glz_batch )
+{
+    Fixture fixture;
+    GLZ_Classifier_Generator generator;
+    fixture.check(generator);
+}
+
+BOOST_AUTO_TEST_CASE( test_decision_tree_batch )
+{
+    Fixture fixture;
+    Decision_Tree_Generator generator;
+    fixture.check(generator);
+}
+
+BOOST_AUTO_TEST_CASE( test_boosted_stumps_batch )
+{
+    Fixture fixture;
+    Boosted_Stumps_Generator generator;
+    fixture.check(generator);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_needs_optimization_info )
+{
+    Fixture fixture;
+    Decision_Tree_Generator generator;
+    Configuration config;
+    generator.configure(config);
+    generator.init(fixture.fsp, fixture.fs.features()[0]);
+
+    distribution<float> training_weights(nfv, 1);
+    Thread_Context context;
+    std::shared_ptr<Classifier_Impl> classifier
+        = generator.generate(context, *fixture.data, training_weights,
+                             fixture.features);
+
+    float output[2];
+    BOOST_CHECK_THROW(classifier->predict_batch(&fixture.rows[1], 1, STRIDE,
+                                                Optimization_Info(), output),
+                      Exception);
+}
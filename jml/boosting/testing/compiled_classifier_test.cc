@@ -0,0 +1,133 @@
+/* compiled_classifier_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test of the generation of native code for classifiers.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <iostream>
+
+#include "jml/boosting/compiled_classifier.h"
+#include "jml/boosting/decision_tree.h"
+#include "jml/boosting/boosted_stumps.h"
+#include "jml/boosting/stump.h"
+#include "jml/boosting/dense_features.h"
+#include "jml/boosting/feature_info.h"
+#include "jml/utils/smart_ptr_utils.h"
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+void predictZero(const float * features, float * output)
+{
+    output[0] = 0.0;
+}
+
+Label_Dist dist(float v0, float v1)
+{
+    Label_Dist result;
+    result.push_back(v0);
+    result.push_back(v1);
+    return result;
+}
+
+struct Fixture {
+    Fixture()
+    {
+        fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+        fs.add_feature("feature1", REAL);
+        fs.add_feature("feature2", REAL);
+
+        fsp = make_unowned_sp(fs);
+        label = fs.features()[0];
+        features.assign(fs.features().begin() + 1, fs.features().end());
+    }
+
+    Dense_Feature_Space fs;
+    std::shared_ptr<Dense_Feature_Space> fsp;
+    Feature label;
+    vector<Feature> features;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_registry )
+{
+    BOOST_CHECK(!Compiled_Classifier::has("test_registry"));
+    BOOST_CHECK_THROW(Compiled_Classifier::get("test_registry"), Exception);
+
+    const char * const names[] = { "feature1", "feature2", 0 };
+    Compiled_Classifier::Register reg("test_registry", predictZero, 1,
+                                      names, 2);
+
+    BOOST_REQUIRE(Compiled_Classifier::has("test_registry"));
+    Compiled_Classifier classifier = Compiled_Classifier::get("test_registry");
+    BOOST_CHECK_EQUAL(classifier.name, "test_registry");
+    BOOST_CHECK_EQUAL(classifier.label_count, 1);
+    BOOST_CHECK(classifier.predict == predictZero);
+    BOOST_REQUIRE_EQUAL(classifier.features.size(), 2);
+    BOOST_CHECK_EQUAL(classifier.features[1], "feature2");
+}
+
+BOOST_AUTO_TEST_CASE( test_generate_decision_tree )
+{
+    Fixture fixture;
+
+    Decision_Tree dtree(fixture.fsp, fixture.label);
+    Tree & tree = dtree.tree;
+    Tree::Node * root = tree.new_node();
+    root->split = Split(fixture.features[1], 1.0, Split::LESS);
+    root->examples = 10;
+    root->child_true = tree.new_leaf(dist(0.25, 0.75), 8);
+    root->child_false = tree.new_leaf(dist(1.0, 0.0), 1);
+    root->child_missing = tree.new_leaf(dist(0.5, 0.5), 1);
+    tree.root = root;
+
+    string source = Compiled_Classifier::generate_source
+        (dtree, fixture.features, "test_tree");
+
+    cerr << source << endl;
+
+    BOOST_CHECK(source.find("extern \"C\" void test_tree(") != string::npos);
+    BOOST_CHECK(source.find("features[1] < 1.0f") != string::npos);
+    BOOST_CHECK(source.find("output[1] = 0.75f;") != string::npos);
+    BOOST_CHECK(source.find("\"feature2\"") != string::npos);
+
+    // Feature that the classifier needs isn't in the list
+    vector<Feature> missing(1, fixture.features[0]);
+    BOOST_CHECK_THROW(Compiled_Classifier::generate_source
+                      (dtree, missing, "test_tree"),
+                      Exception);
+
+    // Not an identifier
+    BOOST_CHECK_THROW(Compiled_Classifier::generate_source
+                      (dtree, fixture.features, "test tree"),
+                      Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_generate_boosted_stumps )
+{
+    Fixture fixture;
+
+    Boosted_Stumps stumps(fixture.fsp, fixture.label);
+    stumps.insert(Stump(fixture.label, fixture.features[0], 2.0,
+                        dist(0.5, -0.5), dist(-0.25, 0.25), dist(0.0, 0.0),
+                        Stump::NORMAL, fixture.fsp));
+    stumps.bias = dist(0.125, -0.125);
+
+    string source = Compiled_Classifier::generate_source
+        (stumps, fixture.features, "test_stumps");
+
+    cerr << source << endl;
+
+    BOOST_CHECK(source.find("output[0] = 0.125f;") != string::npos);
+    BOOST_CHECK(source.find("x = features[0];") != string::npos);
+    BOOST_CHECK(source.find("x < 2.0f ? 0.5f : -0.25f") != string::npos);
+}
@@ -0,0 +1,183 @@
+/* compressed_index_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test of the compressed index entries.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <iostream>
+#include <cmath>
+
+#include "jml/boosting/compressed_index.h"
+#include "jml/boosting/dense_features.h"
+#include "jml/boosting/training_index.h"
+#include "jml/arch/exception_handler.h"
+#include "jml/utils/string_functions.h"
+
+using namespace ML;
+using namespace std;
+
+namespace {
+
+void check_round_trip(const vector<unsigned> & examples,
+                      const vector<float> & values)
+{
+    Compressed_Index index;
+    index.init(examples.empty() ? 0 : &examples[0], &values[0],
+               values.size());
+
+    BOOST_REQUIRE_EQUAL(index.size(), values.size());
+
+    vector<unsigned> examples2(values.size());
+    vector<float> values2(values.size());
+    index.decode(&examples2[0], &values2[0]);
+
+    if (index.implicit_examples()) {
+        for (unsigned i = 0;  i < examples.size();  ++i)
+            BOOST_REQUIRE_EQUAL(examples[i], i);
+    }
+    else BOOST_CHECK(examples == examples2);
+
+    for (unsigned i = 0;  i < values.size();  ++i) {
+        BOOST_REQUIRE_EQUAL(values[i], values2[i]);
+        BOOST_REQUIRE_EQUAL(std::signbit(values[i]), std::signbit(values2[i]));
+    }
+
+    /* Block by block, with the dictionary numbers */
+    uint16_t codes[Compressed_Index::BLOCK_SIZE];
+    float block_values[Compressed_Index::BLOCK_SIZE];
+    size_t total = 0;
+    for (unsigned b = 0;  b < index.num_blocks();  ++b) {
+        size_t n = index.decode_block(b, 0, block_values,
+                                      index.has_dictionary() ? codes : 0);
+        for (unsigned i = 0;  i < n;  ++i) {
+            BOOST_REQUIRE_EQUAL(block_values[i], values[total + i]);
+            if (index.has_dictionary())
+                BOOST_REQUIRE_EQUAL(index.dictionary()[codes[i]],
+                                    values[total + i]);
+        }
+        total += n;
+    }
+    BOOST_CHECK_EQUAL(total, values.size());
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_implicit_examples )
+{
+    vector<unsigned> examples;
+    vector<float> values;
+    for (unsigned i = 0;  i < 3000;  ++i) {
+        examples.push_back(i);
+        values.push_back(i % 2);
+    }
+
+    check_round_trip(examples, values);
+    check_round_trip(vector<unsigned>(), values);
+
+    Compressed_Index index;
+    index.init(&examples[0], &values[0], values.size());
+    BOOST_CHECK(index.implicit_examples());
+    BOOST_CHECK(index.has_dictionary());
+    BOOST_CHECK_EQUAL(index.dictionary().size(), 2);
+
+    // One bit per value and no examples
+    BOOST_CHECK_LT(index.memusage(), values.size() / 4);
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_examples )
+{
+    vector<unsigned> examples;
+    vector<float> values;
+    unsigned example = 0;
+    for (unsigned i = 0;  i < 5000;  ++i) {
+        /* Some examples have the feature twice, and some gaps are large */
+        if (i % 7 != 0) example += 1 + (i % 13 == 0 ? 100000 : i % 5);
+        examples.push_back(example);
+        values.push_back(i % 100);
+    }
+
+    check_round_trip(examples, values);
+
+    /* Out of order, as when sorted by value */
+    std::reverse(examples.begin(), examples.end());
+    check_round_trip(examples, values);
+}
+
+BOOST_AUTO_TEST_CASE( test_no_dictionary )
+{
+    vector<float> values;
+    for (unsigned i = 0;  i < Compressed_Index::MAX_DICTIONARY + 10;  ++i)
+        values.push_back(i * 0.5 - 1000.0);
+
+    check_round_trip(vector<unsigned>(), values);
+
+    Compressed_Index index;
+    index.init(0, &values[0], values.size());
+    BOOST_CHECK(!index.has_dictionary());
+}
+
+BOOST_AUTO_TEST_CASE( test_single_value_and_signed_zero )
+{
+    check_round_trip(vector<unsigned>(), vector<float>(1500, 3.0));
+
+    vector<float> values = { 0.0, -0.0, 1.0, -0.0, 0.0 };
+    check_round_trip(vector<unsigned>(), values);
+
+    Compressed_Index index;
+    index.init(0, &values[0], values.size());
+    BOOST_CHECK_EQUAL(index.dictionary().size(), 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_compressed_dataset_index )
+{
+    string text = "LABEL:k=BOOLEAN x y\n";
+    for (unsigned i = 0;  i < 3000;  ++i) {
+        float y = (i % 11 == 0 ? NAN : (float)(i % 4));
+        text += format("%d %f %f\n", i % 3 == 0, (i * 7919) % 1000 * 0.25, y);
+    }
+
+    std::shared_ptr<Dense_Feature_Space> fs(new Dense_Feature_Space());
+    Dense_Training_Data data;
+    data.init(text.c_str(), text.c_str() + text.size(), fs);
+
+    Feature label(0), x(1), y(2);
+
+    Dataset_Index uncompressed, compressed(true);
+    uncompressed.init(data);
+    compressed.init(data);
+    BOOST_CHECK(compressed.compressed());
+
+    for (Feature feature: { x, y }) {
+        const Dataset_Index::Freqs & freqs1 = uncompressed.freqs(feature);
+        const Dataset_Index::Freqs & freqs2 = compressed.freqs(feature);
+        BOOST_REQUIRE_EQUAL(freqs1.size(), freqs2.size());
+        BOOST_CHECK(std::equal(freqs1.begin(), freqs1.end(), freqs2.begin()));
+
+        for (Sort_By sort_by: { BY_EXAMPLE, BY_VALUE }) {
+            Joint_Index j1 = uncompressed.joint(label, feature, sort_by,
+                                                IC_VALUE | IC_LABEL, 10);
+            Joint_Index j2 = compressed.joint(label, feature, sort_by,
+                                              IC_VALUE | IC_LABEL, 10);
+
+            BOOST_REQUIRE_EQUAL(j1.size(), j2.size());
+            BOOST_CHECK(j1.bucket_vals() == j2.bucket_vals());
+            for (unsigned i = 0;  i < j1.size();  ++i) {
+                BOOST_REQUIRE_EQUAL(j1[i].value(), j2[i].value());
+                BOOST_REQUIRE_EQUAL(j1[i].example(), j2[i].example());
+                BOOST_REQUIRE_EQUAL(j1[i].label().label(),
+                                    j2[i].label().label());
+                BOOST_REQUIRE_EQUAL(j1[i].example_counts(),
+                                    j2[i].example_counts());
+                if (sort_by == BY_EXAMPLE)
+                    BOOST_REQUIRE_EQUAL(j1[i].bucket(), j2[i].bucket());
+            }
+        }
+    }
+
+    BOOST_CHECK(uncompressed.values(x) == compressed.values(x));
+}
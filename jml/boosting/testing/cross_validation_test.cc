@@ -0,0 +1,110 @@
+/* cross_validation_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test of the cross validation harness.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <iostream>
+
+#include "jml/boosting/cross_validation.h"
+#include "jml/boosting/training_data.h"
+#include "jml/boosting/dense_features.h"
+#include "jml/boosting/feature_info.h"
+#include "jml/utils/smart_ptr_utils.h"
+#include "jml/arch/format.h"
+
+using namespace ML;
+using namespace std;
+
+
+BOOST_AUTO_TEST_CASE( test_parameter_grid )
+{
+    Cross_Validation cv;
+    BOOST_CHECK_EQUAL(cv.num_configs(), 1);
+
+    cv.add_parameter("dt.max_depth=1,2,3");
+    cv.add_parameter("dt.trace", { "0", "1" });
+    BOOST_CHECK_EQUAL(cv.num_configs(), 6);
+    BOOST_CHECK_EQUAL(cv.describe(0), "dt.max_depth=1 dt.trace=0");
+    BOOST_CHECK_EQUAL(cv.describe(5), "dt.max_depth=3 dt.trace=1");
+
+    BOOST_CHECK_THROW(cv.add_parameter("dt.max_depth"), Exception);
+    BOOST_CHECK_THROW(cv.add_parameter("=1,2"), Exception);
+
+    Configuration base;
+    base["dt.type"] = "decision_tree";
+    base["dt.max_depth"] = "10";
+
+    const Configuration config = cv.configuration(base, 4);
+    BOOST_CHECK_EQUAL(config["dt.type"], "decision_tree");
+    BOOST_CHECK_EQUAL(config["dt.max_depth"], "2");
+    BOOST_CHECK_EQUAL(config["dt.trace"], "1");
+
+    // The base configuration isn't changed
+    const Configuration & cbase = base;
+    BOOST_CHECK_EQUAL(cbase["dt.max_depth"], "10");
+    BOOST_CHECK(!cbase.count("dt.trace"));
+}
+
+BOOST_AUTO_TEST_CASE( test_cross_validation )
+{
+    /* A dataset where the label is a threshold on X, and Y is noise. */
+    string dataset = "LABEL X Y\n";
+    srandom(1);
+    for (unsigned i = 0;  i < 200;  ++i) {
+        int x = random() % 100, y = random() % 100;
+        dataset += format("%d %d %d\n", x >= 50, x, y);
+    }
+
+    Dense_Feature_Space fs;
+
+    Dense_Training_Data data;
+    data.init(dataset.c_str(), dataset.c_str() + dataset.size(),
+              make_unowned_sp(fs));
+    guess_all_info(data, fs, true);
+
+    Feature predicted = fs.features()[0];
+    vector<Feature> features = data.all_features();
+    features.erase(std::find(features.begin(), features.end(), predicted));
+
+    Configuration config;
+    config["dt.type"] = "decision_tree";
+
+    Cross_Validation cv;
+    cv.num_folds = 4;
+    cv.add_parameter("dt.max_depth=1,3");
+
+    size_t num_called = 0;
+    auto on_result = [&] (const Cross_Validation::Result & result)
+        {
+            cerr << "config " << result.config << " fold " << result.fold
+                 << " validation " << result.validation_accuracy << endl;
+            ++num_called;
+        };
+
+    Thread_Context context;
+    vector<Cross_Validation::Result> results
+        = cv.run(context, data, predicted, features, "dt", config,
+                 distribution<float>(), on_result);
+
+    BOOST_CHECK_EQUAL(num_called, 8);
+    BOOST_REQUIRE_EQUAL(results.size(), 8);
+
+    for (unsigned i = 0;  i < results.size();  ++i) {
+        BOOST_CHECK_EQUAL(results[i].config, i / 4);
+        BOOST_CHECK_EQUAL(results[i].fold, i % 4);
+        // A single split on X is enough
+        BOOST_CHECK_EQUAL(results[i].training_accuracy, 1.0);
+        BOOST_CHECK_GT(results[i].validation_accuracy, 0.9);
+    }
+
+    cv.num_folds = 1;
+    BOOST_CHECK_THROW(cv.run(context, data, predicted, features, "dt", config,
+                             distribution<float>()),
+                      Exception);
+}
@@ -0,0 +1,174 @@
+/* dense_training_data_binary_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test of the memory mapped binary format for Dense_Training_Data.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <unistd.h>
+
+#include "jml/boosting/dense_features.h"
+#include "jml/boosting/training_index.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/arch/exception_handler.h"
+
+using namespace ML;
+using namespace std;
+
+namespace {
+
+const char * text_dataset =
+    "LABEL:k=BOOLEAN colour x y\n"
+    "1 red 1.5 2\n"
+    "# comment on its own line\n"
+    "0 green -1 3 # first comment\n"
+    "1 red 0.25 nan\n"
+    "0 blue 8 4 # second comment\n";
+
+struct FileCleanup {
+    FileCleanup(const string & filename)
+        : filename(filename)
+    {
+    }
+
+    ~FileCleanup()
+    {
+        unlink(filename.c_str());
+    }
+
+    string filename;
+};
+
+void check_same(const Dense_Training_Data & data1,
+                const Dense_Training_Data & data2)
+{
+    BOOST_REQUIRE_EQUAL(data1.example_count(), data2.example_count());
+    BOOST_REQUIRE_EQUAL(data1.variable_count(), data2.variable_count());
+    BOOST_CHECK_EQUAL(data1.feature_space()->print(),
+                      data2.feature_space()->print());
+
+    for (unsigned x = 0;  x < data1.example_count();  ++x) {
+        for (unsigned v = 0;  v < data1.variable_count();  ++v) {
+            float v1 = data1[x][Feature(v)], v2 = data2[x][Feature(v)];
+            if (isnan(v1)) BOOST_CHECK(isnan(v2));
+            else BOOST_CHECK_EQUAL(v1, v2);
+        }
+        BOOST_CHECK_EQUAL(data1.row_comment(x), data2.row_comment(x));
+        BOOST_CHECK_EQUAL(data1.row_offset(x), data2.row_offset(x));
+    }
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_binary_round_trip )
+{
+    string text_file = "build/x86_64/tmp/dense_binary_test.txt";
+    string binary_file = "build/x86_64/tmp/dense_binary_test.bin";
+    FileCleanup cleanup1(text_file), cleanup2(binary_file);
+
+    {
+        ofstream stream(text_file.c_str());
+        stream << text_dataset;
+    }
+
+    Dense_Training_Data text_data(text_file);
+    BOOST_CHECK_EQUAL(text_data.example_count(), 4);
+    BOOST_CHECK(!Dense_Training_Data::is_binary(text_file));
+
+    text_data.save_binary(binary_file);
+    BOOST_CHECK(Dense_Training_Data::is_binary(binary_file));
+
+    // Loaded through the normal constructor, which detects the format
+    Dense_Training_Data binary_data(binary_file);
+    check_same(text_data, binary_data);
+
+    // The categorical feature keeps its categories
+    Feature colour;
+    binary_data.feature_space()->parse("colour", colour);
+    BOOST_CHECK_EQUAL(binary_data.feature_space()->print(colour,
+                                                         binary_data[3][colour]),
+                      "blue");
+
+    // The index works on the mapped data
+    vector<float> xs = binary_data.index().values(Feature(2));
+    BOOST_CHECK_EQUAL(xs.size(), 4);
+
+    // Loading into a feature space that's the same works
+    std::shared_ptr<Dense_Feature_Space> fs(new Dense_Feature_Space());
+    Dense_Training_Data text_data2(text_file, fs);
+    Dense_Training_Data binary_data2(binary_file, fs);
+    check_same(text_data2, binary_data2);
+
+    // Modifying a value copies the data, and doesn't touch the file
+    float old_value = binary_data.modify_feature(1, Feature(2), 42.0);
+    BOOST_CHECK_EQUAL(old_value, -1.0);
+    BOOST_CHECK_EQUAL(binary_data[1][Feature(2)], 42.0);
+    BOOST_CHECK_EQUAL(binary_data[0][Feature(2)], 1.5);
+
+    Dense_Training_Data binary_data3(binary_file);
+    check_same(text_data, binary_data3);
+
+    // Save from mapped data
+    binary_data3.save_binary(binary_file + "2");
+    FileCleanup cleanup3(binary_file + "2");
+    Dense_Training_Data binary_data4(binary_file + "2");
+    check_same(text_data, binary_data4);
+}
+
+BOOST_AUTO_TEST_CASE( test_binary_errors )
+{
+    string text_file = "build/x86_64/tmp/dense_binary_test2.txt";
+    string binary_file = "build/x86_64/tmp/dense_binary_test2.bin";
+    FileCleanup cleanup1(text_file), cleanup2(binary_file);
+
+    {
+        ofstream stream(text_file.c_str());
+        stream << text_dataset;
+    }
+
+    Dense_Training_Data text_data(text_file);
+    text_data.save_binary(binary_file);
+
+    // A feature space that's different
+    {
+        std::shared_ptr<Dense_Feature_Space> fs(new Dense_Feature_Space());
+        Dense_Training_Data other(text_file, fs);
+        fs->make_feature("extra", REAL);
+
+        JML_TRACE_EXCEPTIONS(false);
+        BOOST_CHECK_THROW(Dense_Training_Data data(binary_file, fs),
+                          ML::Exception);
+    }
+
+    // Can't be loaded with others
+    {
+        vector<string> files = { text_file, binary_file };
+        std::shared_ptr<Dense_Feature_Space> fs(new Dense_Feature_Space());
+        Dense_Training_Data data;
+
+        JML_TRACE_EXCEPTIONS(false);
+        BOOST_CHECK_THROW(data.init(files, fs), ML::Exception);
+    }
+
+    // Truncated
+    {
+        size_t size = 0;
+        {
+            filter_istream stream(binary_file);
+            stream.seekg(0, ios::end);
+            size = stream.tellg();
+        }
+
+        BOOST_REQUIRE_EQUAL(truncate(binary_file.c_str(), size - 4), 0);
+
+        JML_TRACE_EXCEPTIONS(false);
+        BOOST_CHECK_THROW(Dense_Training_Data data(binary_file),
+                          ML::Exception);
+    }
+}
@@ -252,3 +252,74 @@ BOOST_AUTO_TEST_CASE( test_split_cuda2 )
     
     cerr << "cpu compressed took " << t.elapsed() << "s" << endl;
 }
+
+// Streaming the index in blocks and sharding over devices must give exactly
+// the same buckets as keeping it whole on one device
+BOOST_AUTO_TEST_CASE( test_split_cuda_streamed )
+{
+    CUDA::Test_Buckets_Binsym tester;
+    int num_devices = tester.num_devices();
+    if (num_devices == 0) {
+        cerr << "no CUDA devices; not testing" << endl;
+        return;
+    }
+
+    size_t array_size = 1000003;
+    size_t num_buckets = 100;
+    int num_features = 4;
+
+    boost::scoped_array<uint16_t> buckets   (new uint16_t[array_size]);
+    boost::scoped_array<int>      labels    (new int[array_size]);
+    boost::scoped_array<float>    ex_weights(new float[array_size]);
+    boost::scoped_array<float>    weights   (new float[array_size]);
+
+    for (unsigned i = 0;  i < array_size;  ++i) {
+        buckets[i]    = rand() % num_buckets;
+        labels[i]     = rand() % 2;
+        ex_weights[i] = rand() % 4 == 0 ? 0.0 : 1.0;
+        weights[i]    = 1.0 / array_size;
+    }
+
+    // Whole on device 0
+    std::shared_ptr<CUDA::Test_Buckets_Binsym::Plan> whole
+        = tester.plan(buckets.get(), 0, labels.get(), 0, array_size,
+                      weights.get(), ex_weights.get(), num_buckets,
+                      true /* on device */, false /* compressed */);
+
+    vector<TwoBuckets> expected(num_buckets);
+    TwoBuckets expected_w_label;
+    std::shared_ptr<CUDA::Test_Buckets_Binsym::Context> context
+        = tester.execute(*whole, &expected[0], expected_w_label);
+    tester.synchronize(*context);
+
+    // Each feature sharded to a device, streamed in small blocks
+    vector<std::shared_ptr<CUDA::Test_Buckets_Binsym::Plan> > plans;
+    vector<const CUDA::Test_Buckets_Binsym::Plan *> plan_ptrs;
+    vector<vector<TwoBuckets> > accum(num_features,
+                                      vector<TwoBuckets>(num_buckets));
+    vector<TwoBuckets *> accum_ptrs;
+    vector<TwoBuckets> w_label(num_features);
+
+    for (unsigned i = 0;  i < num_features;  ++i) {
+        plans.push_back(tester.plan(buckets.get(), 0, labels.get(), 0,
+                                    array_size, weights.get(),
+                                    ex_weights.get(), num_buckets,
+                                    true /* on device */,
+                                    false /* compressed */,
+                                    i % num_devices /* device */,
+                                    10000 /* block size */));
+        plan_ptrs.push_back(plans.back().get());
+        accum_ptrs.push_back(&accum[i][0]);
+    }
+
+    tester.execute(plan_ptrs, accum_ptrs, &w_label[0]);
+
+    for (unsigned i = 0;  i < num_features;  ++i) {
+        for (unsigned j = 0;  j < num_buckets;  ++j) {
+            BOOST_CHECK_EQUAL(float(accum[i][j][0]), float(expected[j][0]));
+            BOOST_CHECK_EQUAL(float(accum[i][j][1]), float(expected[j][1]));
+        }
+        BOOST_CHECK_EQUAL(float(w_label[i][0]), float(expected_w_label[0]));
+        BOOST_CHECK_EQUAL(float(w_label[i][1]), float(expected_w_label[1]));
+    }
+}
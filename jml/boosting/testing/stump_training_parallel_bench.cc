@@ -0,0 +1,106 @@
+/* stump_training_parallel_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Times the parallel stump trainer, which runs one job per feature on the
+   Worker_Task, over a range of thread counts.
+
+   Usage: stump_training_parallel_bench [examples] [features] [max threads]
+*/
+
+#include "jml/boosting/stump_training.h"
+#include "jml/boosting/stump_training_core.h"
+#include "jml/boosting/stump_training_parallel.h"
+#include "jml/boosting/stump_accum.h"
+#include "jml/boosting/training_data.h"
+#include "jml/boosting/dense_features.h"
+#include "jml/boosting/feature_info.h"
+#include "jml/utils/smart_ptr_utils.h"
+#include "jml/arch/format.h"
+#include "jml/arch/timers.h"
+#include <boost/multi_array.hpp>
+#include <iostream>
+#include <stdlib.h>
+
+
+using namespace std;
+using namespace ML;
+
+
+int main(int argc, char ** argv)
+{
+    int nx = argc > 1 ? atoi(argv[1]) : 20000;
+    int nf = argc > 2 ? atoi(argv[2]) : 500;
+    int maxThreads = argc > 3 ? atoi(argv[3]) : 64;
+
+    Dense_Feature_Space fs;
+    fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+    for (unsigned i = 0;  i < nf;  ++i)
+        fs.add_feature(format("feature%d", i), REAL);
+    std::shared_ptr<Dense_Feature_Space> fsp = make_unowned_sp(fs);
+
+    vector<Feature> features = fs.features();
+    Feature predicted = features[0];
+    features.erase(features.begin());
+
+    /* The label depends on the first few features, with some noise. */
+    srand(1);
+    Training_Data data(fsp);
+    for (unsigned x = 0;  x < nx;  ++x) {
+        distribution<float> row(nf + 1);
+        for (unsigned i = 1;  i <= nf;  ++i)
+            row[i] = (rand() % 100) / 100.0;
+        row[0] = row[1] + row[2] + (rand() % 100) / 200.0 > 1.25;
+        data.add_example(fs.encode(row));
+    }
+    data.preindex(predicted, features);
+
+    boost::multi_array<float, 2> weights(boost::extents[nx][2]);
+    for (unsigned x = 0;  x < nx;  ++x)
+        weights[x][0] = weights[x][1] = 0.5 / nx;
+    distribution<float> example_weights(nx, 1.0);
+
+    typedef W_normal W;
+    typedef Z_normal Z;
+    typedef Stump_Accum<W, Z, C_any, No_Trace, Locked> Accum;
+    typedef Stump_Trainer_Parallel<W, Z, No_Trace> Trainer;
+
+    cout << nx << " examples, " << nf << " features" << endl;
+    cout << "threads   seconds   speedup   best" << endl;
+
+    /* Train once over all the features; returns the best feature. */
+    auto train = [&] (Worker_Task & worker)
+        {
+            Accum accum(fs, true /* fair */, 1, C_any(Stump::NORMAL));
+            Trainer trainer(worker);
+
+            Trainer::Test_All_Job<Accum, LW_Array<const float>,
+                                  distribution<float> >
+                job(features, data, predicted, weights, example_weights,
+                    accum, trainer, boost::function<void ()>());
+            worker.run_until_finished(job.group);
+
+            vector<Stump> best = accum.results(data, predicted);
+            return best.empty() ? string("none")
+                : fs.print(best[0].split.feature());
+        };
+
+    double single = 0.0;
+
+    for (int nthreads = 1;  nthreads <= maxThreads;  nthreads *= 2) {
+        /* The calling thread also runs jobs. */
+        Worker_Task worker(nthreads - 1);
+
+        // Warm up the caches and the threads
+        train(worker);
+
+        Timer timer;
+        string best = train(worker);
+        double elapsed = timer.elapsed_wall();
+
+        if (nthreads == 1) single = elapsed;
+
+        cout << format("%7d %9.3f %9.2f   %s", nthreads, elapsed,
+                       single / elapsed, best.c_str())
+             << endl;
+    }
+}
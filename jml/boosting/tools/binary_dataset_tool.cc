@@ -0,0 +1,106 @@
+/* binary_dataset_tool.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Converts text datasets into the binary format that Dense_Training_Data
+   memory maps, so that they don't need to be parsed each time a classifier
+   is trained on them.
+*/
+
+#include "jml/boosting/dense_features.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/timers.h"
+
+#include <iostream>
+
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/positional_options.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+using namespace std;
+
+using namespace ML;
+
+int main(int argc, char ** argv)
+try
+{
+    ios::sync_with_stdio(false);
+
+    string output_suffix = ".bin";
+    int verbosity = 1;
+
+    vector<string> dataset_files;
+
+    namespace opt = boost::program_options;
+
+    opt::options_description options("Options");
+    {
+        using namespace boost::program_options;
+
+        options.add_options()
+            ( "suffix,s", value<string>(&output_suffix),
+              "write the binary version of FILE to FILE + SUFFIX" )
+            ( "verbosity,v", value(&verbosity),
+              "set verbosity to LEVEL [0-3]" )
+            ( "dataset", value<vector<string> >(&dataset_files),
+              "datasets to convert" );
+
+        positional_options_description p;
+        p.add("dataset", -1);
+
+        options_description all_opt;
+        all_opt.add(options);
+
+        all_opt.add_options()
+            ("help,h", "print this message");
+
+        variables_map vm;
+        store(command_line_parser(argc, argv)
+              .options(all_opt)
+              .positional(p)
+              .run(),
+              vm);
+        notify(vm);
+
+        if (vm.count("help")) {
+            cerr << "usage: " << argv[0] << " [options] dataset..." << endl
+                 << endl
+                 << "The datasets share a feature space, so that categorical"
+                 << " features are numbered" << endl
+                 << "the same way in all of them and they can be loaded "
+                 << "together." << endl << endl
+                 << all_opt << endl;
+            return 1;
+        }
+    }
+
+    if (dataset_files.empty())
+        throw Exception("error: need to specify at least one data set");
+
+    /* All of the datasets need to be read before any are written, as later
+       ones can add categories to the feature space. */
+    std::shared_ptr<Dense_Feature_Space> fs(new Dense_Feature_Space());
+    vector<std::shared_ptr<Dense_Training_Data> > data;
+
+    for (unsigned i = 0;  i < dataset_files.size();  ++i) {
+        Timer timer;
+        data.push_back(std::make_shared<Dense_Training_Data>
+                       (dataset_files[i], fs));
+        if (verbosity > 0)
+            cerr << "read '" << dataset_files[i] << "': "
+                 << data.back()->example_count() << " rows; "
+                 << timer.elapsed() << endl;
+    }
+
+    for (unsigned i = 0;  i < dataset_files.size();  ++i) {
+        string output = dataset_files[i] + output_suffix;
+        data[i]->save_binary(output);
+        if (verbosity > 0)
+            cerr << "wrote '" << output << "'" << endl;
+    }
+}
+catch (const std::exception & exc) {
+    cerr << "error: " << exc.what() << endl;
+    exit(1);
+}
@@ -207,11 +207,18 @@ void calc_stats(const Classifier_Impl & current,
     by_group = by_group && group_feature != MISSING_FEATURE && nl == 2;
     
     if (!by_group) {
+        /* Outputs kept for the AUC of a binary problem */
+        boost::multi_array<float, 2>
+            outputs(boost::extents[nl == 2 ? nx : 0][nl]);
+
         //boost::progress_timer timer;
         for (unsigned x = 0;  x < nx;  ++x) {
             distribution<float> input = current.predict(data[x], opt_info);
             
             distribution<float> result = prob.apply(input);
+
+            if (nl == 2)
+                std::copy(result.begin(), result.end(), &outputs[x][0]);
             //distribution<float> result = input;
             
             int highest, highest_2;
@@ -298,6 +305,10 @@ void calc_stats(const Classifier_Impl & current,
         cerr << "non-prob accuracy              = "
              << format("%8.3f%% %8.3f%%",
                        acc * 100.0, rmse * 100.0) << endl;
+
+        if (nl == 2)
+            cerr << format("auc        = %8.5f",
+                           auc(outputs, data, predicted, 1)) << endl;
     }
     else {
         /* Evaluate a group at a time */
@@ -11,3 +11,6 @@ $(eval $(call program,classifier_training_tool,boosting boosting_tools utils arc
 
 $(eval $(call program,training_data_tool,boosting boosting_tools utils arch ACE boost_program_options boost_regex worker_task,,tools))
 
+$(eval $(call program,classifier_codegen_tool,boosting utils arch boost_program_options,,tools))
+
+$(eval $(call program,binary_dataset_tool,boosting utils arch boost_program_options,,tools))
@@ -0,0 +1,100 @@
+/* classifier_codegen_tool.cc                                      -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tool to turn a trained classifier into C++ source with everything hard
+   coded.  The output is meant to be compiled into a shared library, eg
+
+       g++ -O3 -fPIC -shared -I$(SRC) model.cc -o libmodel.so
+
+   which registers the classifier as a Compiled_Classifier when loaded.
+*/
+
+#include "jml/boosting/classifier.h"
+#include "jml/boosting/compiled_classifier.h"
+#include "jml/boosting/feature_space.h"
+#include "jml/utils/filter_streams.h"
+
+#include <iostream>
+
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+
+using namespace std;
+
+using namespace ML;
+
+
+int main(int argc, char ** argv)
+try
+{
+    ios::sync_with_stdio(false);
+
+    string classifier_in;
+    string source_out;
+    string name;
+
+    namespace opt = boost::program_options;
+
+    opt::options_description classifier_options("Classifier options");
+    {
+        using namespace boost::program_options;
+
+        classifier_options.add_options()
+            ( "classifier-in,i", value<string>(&classifier_in),
+              "load classifier from FILE" )
+            ( "source-out,o", value<string>(&source_out),
+              "write the generated source to FILE (default stdout)" )
+            ( "name,n", value<string>(&name),
+              "register the compiled classifier as NAME" );
+
+        options_description all_opt;
+        all_opt.add(classifier_options);
+
+        all_opt.add_options()
+            ("help,h", "print this message");
+
+        variables_map vm;
+        store(command_line_parser(argc, argv)
+              .options(all_opt)
+              .run(),
+              vm);
+        notify(vm);
+
+        if (vm.count("help")) {
+            cerr << all_opt << endl;
+            return 1;
+        }
+    }
+
+    if (classifier_in == "")
+        throw Exception("Need to specify a classifier to compile.");
+    if (name == "")
+        throw Exception("Need to specify a name for the compiled classifier.");
+
+    Classifier classifier;
+    classifier.load(classifier_in);
+
+    /* The inputs are in the order of all_features(); the generated source
+       lists their names. */
+    vector<Feature> features = classifier.all_features();
+
+    string source = Compiled_Classifier::generate_source
+        (*classifier.impl, features, name);
+
+    if (source_out == "" || source_out == "-")
+        cout << source;
+    else {
+        filter_ostream stream(source_out);
+        stream << source;
+    }
+
+    cerr << "compiled " << classifier.impl->class_id() << " classifier as "
+         << name << " with " << features.size() << " features" << endl;
+}
+catch (const std::exception & exc) {
+    cerr << "error: " << exc.what() << endl;
+    exit(1);
+}
@@ -30,6 +30,7 @@
 #include "jml/boosting/weighted_training.h"
 #include "jml/boosting/training_index.h"
 #include "jml/boosting/transform_list.h"
+#include "jml/boosting/cross_validation.h"
 #include "jml/utils/vector_utils.h"
 #include <boost/progress.hpp>
 #include <boost/timer.hpp>
@@ -91,6 +92,9 @@ try
     string trainer_type;
     string testing_filter;
     bool help_config        = false;
+    bool compress_index     = false;
+    int cross_validate_folds = 0;
+    vector<string> search_params;
 
     vector<string> dataset_files;
     namespace opt = boost::program_options;
@@ -123,6 +127,8 @@ try
               "remove aliased training rows from the training data" )
             ( "num-buckets,1", value(&num_buckets),
               "number of buckets to discretize into (0=off) [INT]" )
+            ( "compress-index", value<bool>(&compress_index)->zero_tokens(),
+              "keep the training index compressed to save memory" )
             ( "group-feature,g", value(&group_feature_name),
               "use FEATURE to group examples in dataset [FEATURE]" )
             ( "type-override,Y", value<vector<string> >(&type_overrides),
@@ -136,7 +142,13 @@ try
             ( "repeat-trials,r", value<int>(&repeat_trials),
               "repeat experiment N times [INT]" )
             ( "predict-feature,L", value<string>(&predicted_name),
-              "train classifier to predict feature [FEATURE NAME]");
+              "train classifier to predict feature [FEATURE NAME]")
+            ( "cross-validate-folds", value<int>(&cross_validate_folds),
+              "cross validate over N folds of the training data instead of "
+              "training a classifier [INT]" )
+            ( "search", value<vector<string> >(&search_params),
+              "cross validate each of the values of the configuration key "
+              "[KEY=VALUE1,VALUE2,...]" );
 
         weight_options.add_options()
             ( "equalize-beta,E", value<float>(&equalize_beta),
@@ -318,6 +330,10 @@ try
     float training_split = 100.0 - validation_split - testing_split;
     datasets.split(training_split, validation_split, testing_split,
                    randomize_order, group_feature, testing_filter);
+
+    datasets.training->set_compress_index(compress_index);
+    if (datasets.validation)
+        datasets.validation->set_compress_index(compress_index);
     
     if (remove_aliased)
         remove_aliased_examples(*datasets.training, predicted, verbosity,
@@ -356,6 +372,60 @@ try
     if (verbosity > 4)
         print_weight_spec(trained_weight_spec, feature_space);
     
+    if (cross_validate_folds > 0 || !search_params.empty()) {
+        Cross_Validation cv;
+        if (cross_validate_folds > 0)
+            cv.num_folds = cross_validate_folds;
+        cv.verbosity = verbosity;
+        for (unsigned i = 0;  i < search_params.size();  ++i)
+            cv.add_parameter(search_params[i]);
+
+        distribution<float> ex_weights
+            = apply_weight_spec(*datasets.training, trained_weight_spec);
+
+        Thread_Context context;
+
+        auto on_result = [&] (const Cross_Validation::Result & result)
+            {
+                cerr << format("config %3zd fold %2d: train %6.4f "
+                               "validate %6.4f margin %6.4f %6.2fs  ",
+                               result.config, result.fold,
+                               result.training_accuracy,
+                               result.validation_accuracy,
+                               result.validation_margin, result.seconds)
+                     << cv.describe(result.config) << endl;
+            };
+
+        vector<Cross_Validation::Result> results
+            = cv.run(context, *datasets.training, predicted, features,
+                     trainer_name, config, ex_weights, on_result);
+
+        /* Summarize each configuration over its folds. */
+        int best = -1;
+        double best_mean = 0.0;
+        bool regression = feature_space->info(predicted).type() == REAL;
+        for (unsigned i = 0;  i < cv.num_configs();  ++i) {
+            vector<double> accuracies;
+            for (int j = 0;  j < cv.num_folds;  ++j)
+                accuracies.push_back
+                    (results[i * cv.num_folds + j].validation_accuracy);
+            double m = mean(accuracies.begin(), accuracies.end());
+            double sd = std_dev(accuracies.begin(), accuracies.end(), m);
+            cout << format("config %3d: validate %6.4f +/- %6.4f  ", i, m, sd)
+                 << cv.describe(i) << endl;
+
+            // Accuracy is better when higher, RMSE when lower
+            if (best == -1 || (regression ? m < best_mean : m > best_mean)) {
+                best = i;
+                best_mean = m;
+            }
+        }
+
+        cout << "best: config " << best << " " << cv.describe(best) << endl;
+
+        return 0;
+    }
+
     
     /* Now for the training. */
     vector<distribution<float> > accum_acc(datasets.testing.size());
@@ -453,8 +523,12 @@ try
             }
         }
 
-        if (i != repeat_trials - 1)
+        if (i != repeat_trials - 1) {
             datasets.reshuffle();
+            datasets.training->set_compress_index(compress_index);
+            if (datasets.validation)
+                datasets.validation->set_compress_index(compress_index);
+        }
     }
     
     if (repeat_trials > 1) {
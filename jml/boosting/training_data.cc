@@ -34,19 +34,21 @@ namespace ML {
 
 
 Training_Data::Training_Data()
+    : compress_index_(false)
 {
 }
 
 Training_Data::
 Training_Data(std::shared_ptr<const Feature_Space> feature_space)
-    : dirty_(false)
+    : dirty_(false), compress_index_(false)
 {
     init(feature_space);
 }
 
 Training_Data::Training_Data(const Training_Data & other)
     : data_(other.data_), index_(other.index_),
-      feature_space_(other.feature_space_), dirty_(other.dirty_)
+      feature_space_(other.feature_space_), dirty_(other.dirty_),
+      compress_index_(other.compress_index_)
 {
 }
 
@@ -74,6 +76,7 @@ void Training_Data::swap(Training_Data & other)
     std::swap(index_, other.index_);
     std::swap(feature_space_, other.feature_space_);
     std::swap(dirty_, other.dirty_);
+    std::swap(compress_index_, other.compress_index_);
 }
     
 std::vector<Feature>
@@ -301,7 +304,7 @@ preindex(const Feature & label, const std::vector<Feature> & features)
         throw Exception("preindex: already has index");
 
     //boost::timer timer;
-    index_.reset(new Dataset_Index());
+    index_.reset(new Dataset_Index(compress_index_));
     index_->init(*this, label, features);
     dirty_ = false;
     //cerr << "preindex(): " << timer.elapsed() << "s for "
@@ -466,7 +469,7 @@ const Dataset_Index & Training_Data::generate_index() const
     if (!dirty_ && index_) return *index_;
 
     //boost::timer timer;
-    index_.reset(new Dataset_Index());
+    index_.reset(new Dataset_Index(compress_index_));
     index_->init(*this);
     dirty_ = false;
     //cerr << "generate_index(): " << timer.elapsed() << "s for "
@@ -205,6 +205,14 @@ public:
     /** Pre-index the features in the dataset. */
     void preindex_features();
     
+    /** Keep the index compressed (see Dataset_Index), which lets it fit in
+        memory for very large datasets at the cost of decoding it each time
+        that it's used.  Takes effect the next time that the index is
+        generated. */
+    void set_compress_index(bool compress) { compress_index_ = compress; }
+
+    bool compress_index() const { return compress_index_; }
+
     /** Access the index for the given feature. */
     const Dataset_Index & index() const
     {
@@ -228,6 +236,9 @@ protected:
     */
     mutable bool dirty_;
 
+    /** Is the index generated in compressed form? */
+    bool compress_index_;
+
     /** Notify that the given feature needs to be reindexed */
     void notify_needs_reindex(const Feature & feature)
     {
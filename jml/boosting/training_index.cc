@@ -37,6 +37,12 @@ struct Dataset_Index::Itl {
     std::vector<Feature> all_features;
 };
 
+Dataset_Index::
+Dataset_Index(bool compressed)
+    : compressed_(compressed)
+{
+}
+
 void
 Dataset_Index::
 init(const Training_Data & data,
@@ -137,7 +143,8 @@ init(const Training_Data & data,
         //cerr << "finalizing feature " << itl->feature_space->print(feature)
         //     << endl;
 
-        it->finalize(data.example_count(), feature, itl->feature_space);
+        it->finalize(data.example_count(), feature, itl->feature_space,
+                     compressed_);
 
         //cerr << "  " << it->print_info() << endl;
         //cerr << "  examples = " << it->examples.size() << endl;
@@ -231,6 +238,9 @@ joint(const Feature & target, const Feature & independent,
         return Joint_Index(values, buckets, labels, examples, counts, divisors,
                            0, bucket_splits);
 
+    if (itl->index[independent].compressed)
+        return decode(itl->index[independent], target, sort_by, num_buckets);
+
     if (want_labels) {
         const vector<Label> & example_labels
             = itl->index[target].get_labels();
@@ -327,6 +337,11 @@ dist(const Feature & feature, Sort_By sort_by, unsigned content,
     if (itl->index[feature].seen == 0) // unknown feature...
         return Joint_Index(values, buckets, labels, examples, counts, divisors,
                            0, bucket_splits);
+
+    if (itl->index[feature].compressed)
+        return decode(itl->index[feature], MISSING_FEATURE, sort_by,
+                      num_buckets);
+
     if (want_buckets) {
         const Bucket_Info & bucket_info
             = itl->index[feature].buckets(num_buckets);
@@ -365,6 +380,38 @@ dist(const Feature & feature, Sort_By sort_by, unsigned content,
                        itl->index[feature].seen, bucket_splits);
 }
 
+Joint_Index
+Dataset_Index::
+decode(Index_Entry & entry, const Feature & target, Sort_By sort_by,
+       size_t num_buckets) const
+{
+    const vector<Label> * example_labels = 0;
+    if (target != MISSING_FEATURE)
+        example_labels = &itl->index[target].get_labels();
+
+    const Bucket_Info * bucket_info = 0;
+    if (num_buckets > 0)
+        bucket_info = &entry.buckets(num_buckets);
+
+    std::shared_ptr<const Index_Entry::Decoded> decoded
+        = entry.decode(sort_by, example_labels, bucket_info);
+
+    const Label * labels = 0;
+    if (!decoded->labels.empty()) labels = &decoded->labels[0];
+    else if (example_labels && !example_labels->empty())
+        labels = &(*example_labels)[0];  // same order as the examples
+
+    return Joint_Index(decoded->values.empty() ? 0 : &decoded->values[0],
+                       decoded->buckets.empty() ? 0 : &decoded->buckets[0],
+                       labels,
+                       decoded->examples.empty() ? 0 : &decoded->examples[0],
+                       decoded->counts.empty() ? 0 : &decoded->counts[0],
+                       decoded->divisors.empty() ? 0 : &decoded->divisors[0],
+                       entry.seen,
+                       bucket_info ? &bucket_info->splits : 0,
+                       decoded);
+}
+
 double Dataset_Index::density(const Feature & feat) const
 {
     return itl->index[feat].density();
@@ -57,6 +57,17 @@ enum Index_Contents {
 
 class Dataset_Index {
 public:
+    /** Create an index.  If compressed is true, then the examples and values
+        of each feature are kept compressed (see Compressed_Index) and the
+        arrays for joint() and dist() are decoded from them on each call
+        instead of being cached, which makes the index of a large dataset
+        several times smaller.
+    */
+    Dataset_Index(bool compressed = false);
+
+    /** Is the index kept compressed? */
+    bool compressed() const { return compressed_; }
+
     /** Initialise the index from a dataset.  This will create the bare
         minimum index as fast as possible, by scanning each of the feature
         sets one time.  The rest of the indexes (which are more expensive)
@@ -172,6 +183,10 @@ private:
     struct Itl;
     struct Index_Entry;
     std::shared_ptr<Itl> itl;
+    bool compressed_;
+
+    Joint_Index decode(Index_Entry & entry, const Feature & target,
+                       Sort_By sort_by, size_t num_buckets) const;
 };
 
 
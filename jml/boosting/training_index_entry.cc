@@ -36,7 +36,8 @@ Index_Entry()
       has_counts(false), has_counts_sorted(false),
       has_divisors(false), has_divisors_sorted(false),
       has_labels(false), has_labels_sorted(false),
-      has_freqs(false), has_category_freqs(false)
+      has_freqs(false), has_category_freqs(false),
+      compressed(false), has_compressed_by_value(false), materialized(false)
 {
 }
 
@@ -148,7 +149,8 @@ insert(float value, unsigned example, unsigned example_count, bool sparse,
 
 void Dataset_Index::Index_Entry::
 finalize(unsigned example_count, const Feature & feature,
-         std::shared_ptr<const Feature_Space> feature_space)
+         std::shared_ptr<const Feature_Space> feature_space,
+         bool compress)
 {
     check_used();
     //boost::timer t;
@@ -191,6 +193,15 @@ finalize(unsigned example_count, const Feature & feature,
             examples = vector<unsigned>(examples);
     }
 
+    if (compress) {
+        compressed_by_example.init(examples.empty() ? 0 : &examples[0],
+                                   values.empty() ? 0 : &values[0],
+                                   values.size());
+        vector<unsigned>().swap(examples);
+        vector<float>().swap(values);
+        compressed = true;
+    }
+
 #if 0
     if (found_twice == 0) return;
 
@@ -219,11 +230,212 @@ finalize(unsigned example_count, const Feature & feature,
     //     << " took " << t.elapsed() << "s" << endl;
 }
 
+void Dataset_Index::Index_Entry::
+materialize()
+{
+    if (!compressed || materialized) return;
+
+    size_t n = compressed_by_example.size();
+
+    /* The examples are only implicit if the feature is exactly_one; they may
+       count up from zero for other reasons. */
+    vector<unsigned> new_examples;
+    vector<float> new_values(n);
+    if (!exactly_one()) new_examples.resize(n);
+
+    if (n) compressed_by_example.decode(new_examples.empty()
+                                        ? 0 : &new_examples[0],
+                                        &new_values[0]);
+    if (!new_examples.empty() && compressed_by_example.implicit_examples())
+        std::iota(new_examples.begin(), new_examples.end(), 0);
+
+    Guard guard(lock);
+    if (materialized) return;
+    examples.swap(new_examples);
+    values.swap(new_values);
+    materialized = true;
+}
+
+const Compressed_Index &
+Dataset_Index::Index_Entry::
+get_compressed(Sort_By sort_by)
+{
+    check_used();
+    if (!compressed)
+        throw Exception("get_compressed(): index entry isn't compressed");
+
+    if (sort_by == BY_EXAMPLE) return compressed_by_example;
+    else if (sort_by == BY_VALUE) {
+        if (has_compressed_by_value) return compressed_by_value;
+
+        const Compressed_Index & index = compressed_by_example;
+        size_t n = index.size();
+
+        /* Same ordering as get_examples(BY_VALUE) */
+        vector<pair<float, unsigned> > pairs(n);
+        float values[Compressed_Index::BLOCK_SIZE];
+        unsigned examples[Compressed_Index::BLOCK_SIZE];
+
+        for (size_t b = 0;  b < index.num_blocks();  ++b) {
+            size_t start = b * Compressed_Index::BLOCK_SIZE;
+            size_t bn = index.decode_block(b, examples, values);
+            if (index.implicit_examples())
+                std::iota(examples, examples + bn, start);
+            for (unsigned i = 0;  i < bn;  ++i)
+                pairs[start + i] = make_pair(values[i], examples[i]);
+        }
+
+        sort_on_first_ascending(pairs);
+
+        Compressed_Index new_index;
+        if (n) {
+            vector<float> sorted_values(first_extractor(pairs.begin()),
+                                        first_extractor(pairs.end()));
+            vector<unsigned> sorted_examples(second_extractor(pairs.begin()),
+                                             second_extractor(pairs.end()));
+            vector<pair<float, unsigned> >().swap(pairs);
+            new_index.init(&sorted_examples[0], &sorted_values[0], n);
+        }
+
+        Guard guard(lock);
+        if (has_compressed_by_value) return compressed_by_value;
+        std::swap(compressed_by_value, new_index);
+        has_compressed_by_value = true;
+        return compressed_by_value;
+    }
+    else throw Exception("invalid sort_by");
+}
+
+namespace {
+
+/** Count how many times each example occurs in a run of the same example;
+    the same calculation as get_counts(BY_EXAMPLE). */
+void count_runs(const vector<unsigned> & examples, vector<unsigned> & counts)
+{
+    counts.resize(examples.size());
+
+    size_t run_start = 0;
+    for (size_t i = 1;  i <= examples.size();  ++i) {
+        if (i < examples.size() && examples[i] == examples[run_start])
+            continue;
+        std::fill(counts.begin() + run_start, counts.begin() + i,
+                  i - run_start);
+        run_start = i;
+    }
+}
+
+} // file scope
+
+std::shared_ptr<const Dataset_Index::Index_Entry::Decoded>
+Dataset_Index::Index_Entry::
+decode(Sort_By sort_by, const vector<Label> * labels,
+       const Bucket_Info * buckets)
+{
+    check_used();
+
+    if (labels && labels->size() != example_count)
+        throw Exception
+            (format("decode(): size(%zd) != example_count(%d)",
+                    labels->size(), example_count));
+
+    const Compressed_Index & index = get_compressed(sort_by);
+    size_t n = index.size();
+
+    std::shared_ptr<Decoded> result(new Decoded());
+
+    /* As for get_examples() and get_mapped_labels(), when they simply count
+       up then the examples aren't needed and the labels don't need to be
+       mapped. */
+    bool implicit = (sort_by == BY_EXAMPLE && exactly_one());
+
+    result->values.resize(n);
+    if (!implicit) result->examples.resize(n);
+    if (labels && !implicit) result->labels.resize(n);
+
+    /* With a dictionary, each possible value is put into a bucket only once
+       rather than once per example. */
+    const vector<float> * splits = (buckets ? &buckets->splits : 0);
+    vector<uint16_t> code_buckets;
+    if (splits) {
+        result->buckets.resize(n);
+        if (index.has_dictionary()) {
+            const vector<float> & dict = index.dictionary();
+            code_buckets.resize(dict.size());
+            for (unsigned i = 0;  i < dict.size();  ++i)
+                code_buckets[i]
+                    = std::upper_bound(splits->begin(), splits->end(), dict[i])
+                    - splits->begin();
+        }
+    }
+
+    uint16_t codes[Compressed_Index::BLOCK_SIZE];
+
+    /* Everything that depends upon a block is done while it's in cache */
+    for (size_t b = 0;  b < index.num_blocks();  ++b) {
+        size_t start = b * Compressed_Index::BLOCK_SIZE;
+        unsigned * examples = (implicit ? 0 : &result->examples[start]);
+        float * values = &result->values[start];
+        bool want_codes = !code_buckets.empty();
+
+        size_t bn = index.decode_block(b, examples, values,
+                                       want_codes ? codes : 0);
+
+        if (examples && index.implicit_examples())
+            std::iota(examples, examples + bn, start);
+
+        if (splits) {
+            uint16_t * bkts = &result->buckets[start];
+            if (want_codes)
+                for (unsigned i = 0;  i < bn;  ++i)
+                    bkts[i] = code_buckets[codes[i]];
+            else
+                for (unsigned i = 0;  i < bn;  ++i)
+                    bkts[i] = std::upper_bound(splits->begin(), splits->end(),
+                                               values[i])
+                        - splits->begin();
+        }
+
+        if (!result->labels.empty()) {
+            Label * lbls = &result->labels[start];
+            for (unsigned i = 0;  i < bn;  ++i)
+                lbls[i] = (*labels)[examples[i]];
+        }
+    }
+
+    /* Counts (and so divisors) are implicitly one unless the feature occurs
+       more than once in an example. */
+    if (!only_one()) {
+        if (sort_by == BY_EXAMPLE)
+            count_runs(result->examples, result->counts);
+        else {
+            vector<unsigned> ex_examples(compressed_by_example.size());
+            vector<unsigned> ex_counts;
+            compressed_by_example.decode(&ex_examples[0], 0);
+            count_runs(ex_examples, ex_counts);
+
+            hash_map<unsigned, unsigned> examp_counts;
+            for (unsigned i = 0;  i < ex_examples.size();  ++i)
+                examp_counts[ex_examples[i]] = ex_counts[i];
+
+            result->counts.resize(n);
+            for (unsigned i = 0;  i < n;  ++i)
+                result->counts[i] = examp_counts[result->examples[i]];
+        }
+
+        result->divisors.resize(n);
+        for (unsigned i = 0;  i < n;  ++i)
+            result->divisors[i] = 1.0 / result->counts[i];
+    }
+
+    return result;
+}
+
 const vector<float> &
 Dataset_Index::Index_Entry::
 get_values(Sort_By sort_by)
 {
     check_used();
+    if (compressed) materialize();
     if (sort_by == BY_EXAMPLE) return values;
     else if (sort_by == BY_VALUE) {
         if (has_values_sorted) return values_sorted;
@@ -245,6 +457,7 @@ Dataset_Index::Index_Entry::
 get_examples(Sort_By sort_by)
 {
     check_used();
+    if (compressed) materialize();
     if (sort_by == BY_EXAMPLE) return examples;
 
     else if (sort_by == BY_VALUE) {
@@ -291,6 +504,7 @@ Dataset_Index::Index_Entry::
 get_counts(Sort_By sort_by)
 {
     check_used();
+    if (compressed) materialize();
     if (only_one()) return counts;  // one per example; no problem
 
     bool debug = false;
@@ -421,6 +635,7 @@ Dataset_Index::Index_Entry::
 get_divisors(Sort_By sort_by)
 {
     check_used();
+    if (compressed) materialize();
     /* We calculate these directly from the counts. */
     if (sort_by == BY_EXAMPLE) {
         if (has_divisors) return divisors;
@@ -488,7 +703,53 @@ get_freqs()
     vector<pair<float, float> > freqs2;
     freqs2.reserve(seen);
 
-    if (only_one()) {
+    if (compressed && only_one() && compressed_by_example.has_dictionary()) {
+        /* Count each dictionary entry straight from the codes */
+        const Compressed_Index & index = compressed_by_example;
+        const vector<float> & dict = index.dictionary();
+        vector<unsigned> code_counts(dict.size());
+        uint16_t codes[Compressed_Index::BLOCK_SIZE];
+
+        for (size_t b = 0;  b < index.num_blocks();  ++b) {
+            size_t bn = index.decode_block(b, 0, 0, codes);
+            for (unsigned i = 0;  i < bn;  ++i)
+                code_counts[codes[i]] += 1;
+        }
+
+        for (unsigned i = 0;  i < dict.size();  ++i)
+            if (code_counts[i])
+                freqs2.push_back(make_pair(dict[i], code_counts[i]));
+    }
+    else if (compressed) {
+        /* Decode the values and counts sorted by value, without keeping
+           them, and accumulate as below. */
+        std::shared_ptr<const Decoded> decoded = decode(BY_VALUE, 0, 0);
+        const vector<unsigned> & counts = decoded->counts;
+        const vector<float> & vals = decoded->values;
+
+        float last = -INFINITY;
+        double count = 0.0;
+
+        for (unsigned i = 0;  i < vals.size();  ++i) {
+            double weight = (counts.empty() ? 1.0 : 1.0 / counts[i]);
+            if (isnan(vals[i]))
+                throw Exception("NaN in vals");
+
+            if (i == 0) {
+                count += weight;
+                last = vals[i];
+            }
+            else if (bit_equal(last, vals[i]))
+                count += weight;
+            else {
+                freqs2.push_back(make_pair(last, count));
+                count = weight;
+                last = vals[i];
+            }
+        }
+        freqs2.push_back(make_pair(last, count));
+    }
+    else if (only_one()) {
         /* Accumulate them; example_count is always one since only_one is
            true. */
         const vector<float> & vals = get_values(BY_VALUE);
@@ -622,7 +883,18 @@ get_labels()
     }
     
     Feature_Info info = feature_space->info(feature);
-        
+
+    /* A compressed entry is decoded just for this */
+    vector<float> decoded_values;
+    bool decode_values = compressed && !materialized;
+    if (decode_values) {
+        decoded_values.resize(compressed_by_example.size());
+        if (!decoded_values.empty())
+            compressed_by_example.decode(0, &decoded_values[0]);
+    }
+    const vector<float> & values
+        = (decode_values ? decoded_values : this->values);
+
     ExcAssert(values.size() == example_count);
 
     //cerr << "values = " << values << endl;
@@ -655,6 +927,7 @@ get_mapped_labels(const vector<Label> & labels, const Feature & target,
                   Sort_By sort_by)
 {
     check_used();
+    if (compressed) materialize();
     //cerr << "examples.size() = " << examples.size() << endl;
     //cerr << "labels.size() = " << labels.size() << endl;
     //cerr << "example_count = " << example_count << endl;
@@ -714,6 +987,10 @@ create_buckets(size_t num_buckets)
 
     result.buckets.clear();
 
+    /* The bucket numbers of a compressed entry are calculated by decode()
+       each time they're needed. */
+    if (compressed) return result;
+
     const vector<float> & values = get_values(BY_EXAMPLE);
 
     vector<int> bucket_count(result.splits.size() + 1);
@@ -13,6 +13,7 @@
 #include "config.h"
 #include "training_index.h"
 #include "feature_map.h"
+#include "compressed_index.h"
 #include "jml/arch/threads.h"
 #include "jml/math/xdiv.h"
 #include <boost/utility.hpp>
@@ -144,9 +145,37 @@ struct Dataset_Index::Index_Entry {
     /** Ditto, but sorted by example. */
     Feature_Map<Mapped_Labels_Entry> mapped_labels_sorted;
 
-    /** Buckets, one entry for each total number of buckets (cached). */
+    /** Buckets, one entry for each total number of buckets (cached).  When
+        compressed, only the splits are kept. */
     map<unsigned, Bucket_Info> bucket_info;
 
+    /** If true, the examples and values are kept only in compressed form
+        after finalize(), and joint indexes are decoded from them each time
+        that they are asked for rather than being cached. */
+    bool compressed;
+
+    /** The examples and values, sorted by example. */
+    Compressed_Index compressed_by_example;
+
+    /** Ditto, but sorted by value.  Created on demand. */
+    bool has_compressed_by_value;
+    Compressed_Index compressed_by_value;
+
+    /** True once the examples and values vectors have been decoded from
+        the compressed index, for the functions below that return them. */
+    bool materialized;
+
+    /** The arrays of a joint index that was decoded from the compressed
+        index. */
+    struct Decoded {
+        std::vector<float> values;
+        std::vector<uint16_t> buckets;
+        std::vector<Label> labels;
+        std::vector<unsigned> examples;
+        std::vector<unsigned> counts;
+        std::vector<float> divisors;
+    };
+
 
     /*************************************************************************/
     /* INITIALIZATION                                                        */
@@ -161,7 +190,32 @@ struct Dataset_Index::Index_Entry {
     /** Copy the data structures to allow unused space on the end of vectors
         to be reclaimed. */
     void finalize(unsigned example_count, const Feature & feature,
-                  std::shared_ptr<const Feature_Space> feature_space);
+                  std::shared_ptr<const Feature_Space> feature_space,
+                  bool compress = false);
+
+    /** Decode the examples and values vectors from the compressed index,
+        for the functions that return references to them.  This undoes the
+        compression for this one feature. */
+    void materialize();
+
+
+    /*************************************************************************/
+    /* COMPRESSED ACCESS                                                     */
+    /*************************************************************************/
+
+    /** Return the compressed index sorted as specified. */
+    const Compressed_Index & get_compressed(Sort_By sort_by);
+
+    /** Decode the arrays for a joint index from the compressed index, one
+        block at a time.  The labels (which are in example order) are
+        mapped onto the examples if non-null, and the bucket numbers are
+        calculated from the splits of buckets if it is non-null.  The
+        arrays that aren't needed (as for the same function of an
+        uncompressed entry) are left empty.
+    */
+    std::shared_ptr<const Decoded>
+    decode(Sort_By sort_by, const std::vector<Label> * labels,
+           const Bucket_Info * buckets);
 
 
     /*************************************************************************/
@@ -23,10 +23,11 @@ Joint_Index::
 Joint_Index(const float * values, const uint16_t * buckets,
             const Label * labels, const unsigned * examples,
             const unsigned * counts, const float * divisors,
-            unsigned size, const std::vector<float> * bucket_vals)
+            unsigned size, const std::vector<float> * bucket_vals,
+            std::shared_ptr<const void> storage)
     : values_(values), buckets_(buckets), labels_(labels), examples_(examples),
       counts_(counts), divisors_(divisors),
-      size_(size), bucket_vals_(bucket_vals)
+      size_(size), bucket_vals_(bucket_vals), storage_(storage)
 {
     //cerr << "values: " << (bool)values << " buckets: " << (bool)buckets
     //     << " labels: " << (bool)labels << " examples: " << (bool)examples
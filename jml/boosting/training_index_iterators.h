@@ -10,6 +10,7 @@
 
 #include "jml/compiler/compiler.h"
 #include <vector>
+#include <memory>
 #include <cmath>
 
 #include <string>
@@ -32,7 +33,9 @@ public:
     Joint_Index(const float * values, const uint16_t * buckets,
                 const Label * labels, const unsigned * examples,
                 const unsigned * counts, const float * divisors,
-                unsigned size, const std::vector<float> * bucket_vals);
+                unsigned size, const std::vector<float> * bucket_vals,
+                std::shared_ptr<const void> storage
+                    = std::shared_ptr<const void>());
 
     JML_ALWAYS_INLINE JML_COMPUTE_METHOD
     Index_Iterator begin() const;
@@ -119,6 +122,10 @@ private:
     /** Pointer to the array of bucket values, if we used them. */
     const std::vector<float> * bucket_vals_;
 
+    /** Keeps the arrays alive when they were decoded for this index alone,
+        rather than belonging to the Dataset_Index. */
+    std::shared_ptr<const void> storage_;
+
     friend class Index_Iterator;
 };
 
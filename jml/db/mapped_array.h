@@ -0,0 +1,139 @@
+/* mapped_array.h                                                  -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Read only array that can be reconstituted in place from a memory mapped
+   store.
+*/
+
+#ifndef __db__mapped_array_h__
+#define __db__mapped_array_h__
+
+#include "portable_iarchive.h"
+#include "portable_oarchive.h"
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+
+namespace ML {
+namespace DB {
+
+
+/*****************************************************************************/
+/* MAPPED_ARRAY                                                              */
+/*****************************************************************************/
+
+/** A read only array of a block serializable type (see
+    Is_Block_Serializable) that is saved and loaded in exactly the same form
+    as a std::vector of that type, so that either can be written and the
+    other read back.
+
+    When it's reconstituted from a store that reads from a memory mapped
+    file or a File_Read_Buffer (see Binary_Input::storage()), and the
+    elements happen to be aligned in it, the array points straight into the
+    mapping (which it keeps alive) instead of copying.  Loading then takes
+    constant time and the pages are shared between processes that load the
+    same file; otherwise the elements are copied as one block.
+*/
+
+template<typename T>
+struct Mapped_Array {
+    static_assert(Is_Block_Serializable<T>::value,
+                  "Mapped_Array needs a block serializable type");
+
+    typedef T value_type;
+    typedef const T * const_iterator;
+    typedef const T * iterator;
+
+    Mapped_Array()
+        : data_(0), size_(0)
+    {
+    }
+
+    Mapped_Array(const std::vector<T> & vec)
+        : owned(vec), data_(owned.data()), size_(owned.size())
+    {
+    }
+
+    Mapped_Array(const Mapped_Array & other)
+        : data_(other.data_), size_(other.size_), storage_(other.storage_)
+    {
+        if (!storage_) {
+            owned = other.owned;
+            data_ = owned.data();
+        }
+    }
+
+    Mapped_Array & operator = (const Mapped_Array & other)
+    {
+        Mapped_Array new_me(other);
+        swap(new_me);
+        return *this;
+    }
+
+    void swap(Mapped_Array & other)
+    {
+        owned.swap(other.owned);
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        storage_.swap(other.storage_);
+    }
+
+    const T * data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const T * begin() const { return data_; }
+    const T * end() const { return data_ + size_; }
+
+    const T & operator [] (size_t index) const { return data_[index]; }
+
+    /** Is the data used in place from the store's mapping? */
+    bool mapped() const { return !!storage_; }
+
+    std::vector<T> to_vector() const { return std::vector<T>(begin(), end()); }
+
+    void serialize(portable_bin_oarchive & store) const
+    {
+        compact_size_t sz(size_);
+        sz.serialize(store);
+        store.save_array(data_, size_);
+    }
+
+    void reconstitute(portable_bin_iarchive & store)
+    {
+        compact_size_t sz(store);
+        size_t bytes = sz * sizeof(T);
+
+        if (store.must_have(bytes) < bytes)
+            throw Exception("Mapped_Array: read past end of data");
+
+        Mapped_Array new_me;
+        new_me.size_ = sz;
+
+        std::shared_ptr<const void> storage = store.storage();
+        if (storage && (uintptr_t)store.pos() % alignof(T) == 0) {
+            new_me.data_ = reinterpret_cast<const T *>(store.pos());
+            new_me.storage_ = storage;
+            store.skip(bytes);
+        }
+        else {
+            new_me.owned.resize(sz);
+            store.load_array(new_me.owned.data(), sz);
+            new_me.data_ = new_me.owned.data();
+        }
+
+        swap(new_me);
+    }
+
+private:
+    std::vector<T> owned;                  ///< Elements when not mapped
+    const T * data_;
+    size_t size_;
+    std::shared_ptr<const void> storage_;  ///< Keeps the mapping alive
+};
+
+} // namespace DB
+} // namespace ML
+
+#endif /* __db__mapped_array_h__ */
@@ -45,6 +45,11 @@ struct Binary_Input::Source {
     }
 
     virtual size_t more(Binary_Input & input, size_t amount) = 0;
+
+    virtual std::shared_ptr<const void> storage() const
+    {
+        return std::shared_ptr<const void>();
+    }
 };
 
 struct Binary_Input::Buffer_Source
@@ -76,6 +81,11 @@ struct Binary_Input::Buffer_Source
         return input.avail();  // we can never get more after this
     }
 
+    virtual std::shared_ptr<const void> storage() const
+    {
+        return region;
+    }
+
     std::shared_ptr<File_Read_Buffer::Region> region;
 };
 
@@ -292,6 +302,14 @@ try_make_avail(size_t min_avail)
     return source->more(*this, min_avail);
 }
 
+std::shared_ptr<const void>
+Binary_Input::
+storage() const
+{
+    if (!source) return std::shared_ptr<const void>();
+    return source->storage();
+}
+
 
 /*****************************************************************************/
 /* PORTABLE_BIN_IARCHIVE                                                     */
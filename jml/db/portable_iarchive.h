@@ -106,6 +106,12 @@ public:
 
     size_t offset() const { return offset_; }
 
+    /** If the data being read is in memory that stays valid for as long as
+        the returned pointer is held (a memory mapped file or a
+        File_Read_Buffer), return it so that the data can be used in place.
+        Otherwise (streams, or memory owned by the caller) this is null. */
+    std::shared_ptr<const void> storage() const;
+
 private:
     size_t offset_;       ///< Offset of start from archive start
     const char * pos_;    ///< Position in memory region
@@ -253,12 +259,7 @@ public:
         compact_size_t sz(*this);
 
         std::vector<T, A> v;
-        v.reserve(sz);
-        for (unsigned i = 0;  i < sz;  ++i) {
-            T t;
-            *this >> t;
-            v.push_back(t);
-        }
+        load_elements(v, sz, Is_Block_Serializable<T>());
         vec.swap(v);
     }
 
@@ -337,10 +338,15 @@ public:
 
         arr.resize(sizes);
 
-        size_t ne = arr.num_elements();
-        T * el = arr.data();
-        for (unsigned i = 0;  i < ne;  ++i, ++el)
-            *this >> *el;
+        load_array(arr.data(), arr.num_elements());
+    }
+
+    /** Load n elements that were saved one after the other.  Arrays of
+        block serializable types are copied in one go. */
+    template<typename T>
+    void load_array(T * el, size_t n)
+    {
+        load_array(el, n, Is_Block_Serializable<T>());
     }
 
     void load_binary(void * address, size_t size)
@@ -366,6 +372,41 @@ public:
         obj.reconstitute(*this);
     }
 #endif
+
+private:
+    template<typename T>
+    void load_array(T * el, size_t n, std::true_type)
+    {
+        load_binary(el, n * sizeof(T));
+    }
+
+    template<typename T>
+    void load_array(T * el, size_t n, std::false_type)
+    {
+        for (size_t i = 0;  i < n;  ++i, ++el)
+            *this >> *el;
+    }
+
+    template<class T, class A>
+    void load_elements(std::vector<T, A> & v, size_t sz, std::true_type)
+    {
+        // Check first so that a corrupt size doesn't allocate a huge vector
+        if (must_have(sz * sizeof(T)) < sz * sizeof(T))
+            throw Exception("Binary_Input: read past end of data");
+        v.resize(sz);
+        load_array(v.data(), sz, std::true_type());
+    }
+
+    template<class T, class A>
+    void load_elements(std::vector<T, A> & v, size_t sz, std::false_type)
+    {
+        v.reserve(sz);
+        for (unsigned i = 0;  i < sz;  ++i) {
+            T t;
+            *this >> t;
+            v.push_back(t);
+        }
+    }
 };
 
 } // namespace DB
@@ -194,8 +194,7 @@ public:
     {
         compact_size_t size(vec.size());
         size.serialize(*this);
-        for (unsigned i = 0;  i < vec.size();  ++i)
-            *this << vec[i];
+        save_elements(vec, Is_Block_Serializable<T>());
     }
 
     template<class K, class V, class L, class A>
@@ -243,10 +242,15 @@ public:
             dim.serialize(*this);
         }
 
-        size_t ne = arr.num_elements();
-        const T * el = arr.data();
-        for (unsigned i = 0;  i < ne;  ++i, ++el)
-            *this << *el;
+        save_array(arr.data(), arr.num_elements());
+    }
+
+    /** Save n elements one after the other.  Arrays of block serializable
+        types are written in one go. */
+    template<typename T>
+    void save_array(const T * el, size_t n)
+    {
+        save_array(el, n, Is_Block_Serializable<T>());
     }
 
     template<typename T1, typename T2>
@@ -294,6 +298,33 @@ public:
     size_t offset() const { return offset_; }
 
 private:
+    template<typename T>
+    void save_array(const T * el, size_t n, std::true_type)
+    {
+        if (n) save_binary(el, n * sizeof(T));
+    }
+
+    template<typename T>
+    void save_array(const T * el, size_t n, std::false_type)
+    {
+        for (size_t i = 0;  i < n;  ++i, ++el)
+            *this << *el;
+    }
+
+    template<class T, class A>
+    void save_elements(const std::vector<T, A> & vec, std::true_type)
+    {
+        save_array(vec.data(), vec.size(), std::true_type());
+    }
+
+    // Also used for std::vector<bool>, which has no data()
+    template<class T, class A>
+    void save_elements(const std::vector<T, A> & vec, std::false_type)
+    {
+        for (unsigned i = 0;  i < vec.size();  ++i)
+            *this << vec[i];
+    }
+
     std::ostream * stream;
     std::shared_ptr<std::ostream> owned_stream;
     size_t offset_;
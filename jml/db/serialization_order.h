@@ -26,6 +26,7 @@
 #define __db__serialization_order_h__
 
 #include <stdint.h>
+#include <type_traits>
 #include "jml/compiler/compiler.h"
 
 namespace ML {
@@ -113,6 +114,23 @@ JML_ALWAYS_INLINE int64_t serialization_order(int64_t val)
     return val;
 }
 
+
+/** Types whose serialized form is exactly their in-memory representation, as
+    the serialization order is the native order.  Arrays of them can be saved
+    and loaded as one block, or used in place (see Mapped_Array).  The long
+    types (saved as compact sizes) and bool (saved as a byte) aren't. */
+template<typename T> struct Is_Block_Serializable : std::false_type {};
+
+template<> struct Is_Block_Serializable<char> : std::true_type {};
+template<> struct Is_Block_Serializable<signed char> : std::true_type {};
+template<> struct Is_Block_Serializable<unsigned char> : std::true_type {};
+template<> struct Is_Block_Serializable<signed short> : std::true_type {};
+template<> struct Is_Block_Serializable<unsigned short> : std::true_type {};
+template<> struct Is_Block_Serializable<signed int> : std::true_type {};
+template<> struct Is_Block_Serializable<unsigned int> : std::true_type {};
+template<> struct Is_Block_Serializable<float> : std::true_type {};
+template<> struct Is_Block_Serializable<double> : std::true_type {};
+
 } // namespace DB
 } // namespace ML
 
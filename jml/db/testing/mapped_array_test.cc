@@ -0,0 +1,176 @@
+/* mapped_array_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test of arrays reconstituted in place from a memory mapped store.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "jml/db/persistent.h"
+#include "jml/db/mapped_array.h"
+#include "jml/utils/file_functions.h"
+#include "jml/arch/exception_handler.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/multi_array.hpp>
+#include <sstream>
+#include <fstream>
+#include <unistd.h>
+
+
+using namespace ML;
+using namespace ML::DB;
+using namespace std;
+
+namespace {
+
+struct FileCleanup {
+    FileCleanup(const string & filename)
+        : filename(filename)
+    {
+    }
+
+    ~FileCleanup()
+    {
+        unlink(filename.c_str());
+    }
+
+    string filename;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_block_vectors_same_format )
+{
+    /* The block load and save write exactly what saving the elements one
+       at a time did. */
+    vector<float> floats = { 1.0, -2.5, 1e-30, 3.25 };
+    vector<int> ints = { 1, -2, 1 << 30 };
+    vector<bool> bools = { true, false, true };
+    vector<unsigned long> longs = { 1, 1000000, 3 };
+
+    ostringstream stream_out;
+    {
+        Store_Writer store(stream_out);
+        store << floats << ints << bools << longs;
+    }
+
+    ostringstream expected;
+    {
+        Store_Writer store(expected);
+        store << compact_size_t(floats.size());
+        for (float f: floats) store << f;
+        store << compact_size_t(ints.size());
+        for (int i: ints) store << i;
+        store << compact_size_t(bools.size());
+        for (bool b: bools) store << b;
+        store << compact_size_t(longs.size());
+        for (unsigned long l: longs) store << l;
+    }
+
+    BOOST_CHECK_EQUAL(stream_out.str(), expected.str());
+
+    istringstream stream_in(stream_out.str());
+    Store_Reader store(stream_in);
+    vector<float> floats2;
+    vector<int> ints2;
+    vector<bool> bools2;
+    vector<unsigned long> longs2;
+    store >> floats2 >> ints2 >> bools2 >> longs2;
+
+    BOOST_CHECK(floats == floats2);
+    BOOST_CHECK(ints == ints2);
+    BOOST_CHECK(bools == bools2);
+    BOOST_CHECK(longs == longs2);
+
+    BOOST_CHECK(!store.storage());
+}
+
+BOOST_AUTO_TEST_CASE( test_multi_array )
+{
+    boost::multi_array<double, 2> arr(boost::extents[3][5]);
+    for (unsigned i = 0;  i < 3;  ++i)
+        for (unsigned j = 0;  j < 5;  ++j)
+            arr[i][j] = i * 0.5 - j;
+
+    ostringstream stream_out;
+    {
+        Store_Writer store(stream_out);
+        store << arr;
+    }
+
+    istringstream stream_in(stream_out.str());
+    Store_Reader store(stream_in);
+    boost::multi_array<double, 2> arr2;
+    store >> arr2;
+
+    BOOST_CHECK(arr == arr2);
+}
+
+BOOST_AUTO_TEST_CASE( test_mapped_array )
+{
+    string filename = "build/x86_64/tmp/mapped_array_test.bin";
+    FileCleanup cleanup(filename);
+
+    vector<float> values;
+    for (unsigned i = 0;  i < 10000;  ++i)
+        values.push_back(i * 0.25);
+
+    {
+        ofstream stream(filename.c_str());
+        Store_Writer store(stream);
+        // The string and the size take four bytes, so the first array is
+        // aligned and the second (two bytes of size later) isn't
+        store << string("a") << Mapped_Array<float>(values) << values
+              << string("END");
+    }
+
+    Mapped_Array<float> mapped1, mapped2;
+    {
+        Store_Reader store(filename);
+        BOOST_CHECK(store.storage());
+
+        string s, end;
+        store >> s >> mapped1 >> mapped2 >> end;
+        BOOST_CHECK_EQUAL(s, "a");
+        BOOST_CHECK_EQUAL(end, "END");
+    }
+
+    // The unaligned one is copied
+    BOOST_CHECK(mapped1.mapped());
+    BOOST_CHECK(!mapped2.mapped());
+    for (const Mapped_Array<float> * m: { &mapped1, &mapped2 }) {
+        BOOST_REQUIRE_EQUAL(m->size(), values.size());
+        BOOST_CHECK(std::equal(m->begin(), m->end(), values.begin()));
+    }
+
+    // The mapping outlives the store, and copies share it
+    Mapped_Array<float> copy = mapped1;
+    mapped1 = Mapped_Array<float>();
+    BOOST_CHECK(copy.mapped());
+    BOOST_CHECK(copy.to_vector() == values);
+
+    // From a stream it's a copy
+    {
+        ifstream stream(filename.c_str());
+        Store_Reader store(stream);
+        string s;
+        Mapped_Array<float> unmapped;
+        store >> s >> unmapped;
+        BOOST_CHECK(!unmapped.mapped());
+        BOOST_CHECK(unmapped.to_vector() == values);
+    }
+
+    // Truncated
+    {
+        File_Read_Buffer buf(filename);
+        File_Read_Buffer truncated(buf.start(), 100);
+        Store_Reader store(truncated);
+        string s;
+        Mapped_Array<float> unmapped;
+        store >> s;
+
+        JML_TRACE_EXCEPTIONS(false);
+        BOOST_CHECK_THROW(store >> unmapped, ML::Exception);
+    }
+}
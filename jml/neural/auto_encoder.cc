@@ -275,6 +275,110 @@ rbprop(const double * inputs,
                           gradient, example_weight);
 }
 
+template<typename F>
+void
+Auto_Encoder::
+rfprop_batch(const F * inputs,
+             F * temp_space, size_t temp_space_size,
+             F * reconstruction,
+             size_t n) const
+{
+    size_t tspace = rfprop_temporary_space_required();
+
+    if (temp_space_size != n * tspace)
+        throw Exception("wrong temporary space size");
+
+    int ni = this->inputs();
+
+    for (unsigned x = 0;  x < n;  ++x)
+        rfprop(inputs + x * ni, temp_space + x * tspace, tspace,
+               reconstruction + x * ni);
+}
+
+void
+Auto_Encoder::
+rfprop_batch(const float * inputs,
+             float * temp_space, size_t temp_space_size,
+             float * reconstruction,
+             size_t n) const
+{
+    return rfprop_batch<float>(inputs, temp_space, temp_space_size,
+                               reconstruction, n);
+}
+
+void
+Auto_Encoder::
+rfprop_batch(const double * inputs,
+             double * temp_space, size_t temp_space_size,
+             double * reconstruction,
+             size_t n) const
+{
+    return rfprop_batch<double>(inputs, temp_space, temp_space_size,
+                                reconstruction, n);
+}
+
+template<typename F>
+void
+Auto_Encoder::
+rbprop_batch(const F * inputs,
+             const F * reconstruction,
+             const F * temp_space,
+             size_t temp_space_size,
+             const F * reconstruction_errors,
+             F * input_errors_out,
+             Parameters & gradient,
+             double example_weight,
+             size_t n) const
+{
+    size_t tspace = rfprop_temporary_space_required();
+
+    if (temp_space_size != n * tspace)
+        throw Exception("wrong temporary space size");
+
+    int ni = this->inputs();
+
+    for (unsigned x = 0;  x < n;  ++x)
+        rbprop(inputs + x * ni, reconstruction + x * ni,
+               temp_space + x * tspace, tspace,
+               reconstruction_errors + x * ni,
+               input_errors_out ? input_errors_out + x * ni : 0,
+               gradient, example_weight);
+}
+
+void
+Auto_Encoder::
+rbprop_batch(const float * inputs,
+             const float * reconstruction,
+             const float * temp_space,
+             size_t temp_space_size,
+             const float * reconstruction_errors,
+             float * input_errors_out,
+             Parameters & gradient,
+             double example_weight,
+             size_t n) const
+{
+    return rbprop_batch<float>(inputs, reconstruction, temp_space,
+                               temp_space_size, reconstruction_errors,
+                               input_errors_out, gradient, example_weight, n);
+}
+
+void
+Auto_Encoder::
+rbprop_batch(const double * inputs,
+             const double * reconstruction,
+             const double * temp_space,
+             size_t temp_space_size,
+             const double * reconstruction_errors,
+             double * input_errors_out,
+             Parameters & gradient,
+             double example_weight,
+             size_t n) const
+{
+    return rbprop_batch<double>(inputs, reconstruction, temp_space,
+                                temp_space_size, reconstruction_errors,
+                                input_errors_out, gradient, example_weight, n);
+}
+
 void
 Auto_Encoder::
 rbbprop(const float * inputs,
@@ -234,6 +234,69 @@ struct Auto_Encoder : public Layer {
                 Parameters & gradient,
                 double example_weight) const;
 
+    /** Batch versions of rfprop() and rbprop(), for n examples at once.
+        The inputs, reconstructions and errors are row major matrices with
+        one row per example, and the temporary space is
+        n * rfprop_temporary_space_required() with that of each example
+        following the last.  The gradient is accumulated over the batch.
+
+        The default implementations simply call rfprop() and rbprop() on
+        each example; layers that can do it with matrix-matrix products
+        override them.
+    */
+    virtual void
+    rfprop_batch(const float * inputs,
+                 float * temp_space, size_t temp_space_size,
+                 float * reconstruction,
+                 size_t n) const;
+
+    /** \copydoc rfprop_batch */
+    virtual void
+    rfprop_batch(const double * inputs,
+                 double * temp_space, size_t temp_space_size,
+                 double * reconstruction,
+                 size_t n) const;
+
+    template<typename F>
+    void
+    rfprop_batch(const F * inputs,
+                 F * temp_space, size_t temp_space_size,
+                 F * reconstruction,
+                 size_t n) const;
+
+    /** \copydoc rfprop_batch */
+    virtual void rbprop_batch(const float * inputs,
+                              const float * reconstruction,
+                              const float * temp_space,
+                              size_t temp_space_size,
+                              const float * reconstruction_errors,
+                              float * input_errors_out,
+                              Parameters & gradient,
+                              double example_weight,
+                              size_t n) const;
+
+    /** \copydoc rfprop_batch */
+    virtual void rbprop_batch(const double * inputs,
+                              const double * reconstruction,
+                              const double * temp_space,
+                              size_t temp_space_size,
+                              const double * reconstruction_errors,
+                              double * input_errors_out,
+                              Parameters & gradient,
+                              double example_weight,
+                              size_t n) const;
+
+    template<typename F>
+    void rbprop_batch(const F * inputs,
+                      const F * reconstruction,
+                      const F * temp_space,
+                      size_t temp_space_size,
+                      const F * reconstruction_errors,
+                      F * input_errors_out,
+                      Parameters & gradient,
+                      double example_weight,
+                      size_t n) const;
+
     virtual void rbbprop(const float * inputs,
                          const float * reconstruction,
                          const float * temp_space, size_t temp_space_size,
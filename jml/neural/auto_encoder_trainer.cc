@@ -16,6 +16,7 @@
 #include "jml/utils/configuration.h"
 #include "jml/arch/timers.h"
 #include <boost/bind.hpp>
+#include <numeric>
 #include "auto_encoder_stack.h"
 #include "jml/utils/check_not_nan.h"
 #include "jml/stats/distribution_ops.h"
@@ -54,6 +55,7 @@ defaults()
     weight_decay_l1 = 0.0;
     weight_decay_l2 = 0.0;
     dump_testing_output = 0;
+    batch_bprop = true;
 }
 
 void
@@ -74,6 +76,7 @@ configure(const std::string & name, const Configuration & config)
     config.get(weight_decay_l1, "weight_decay_l1");
     config.get(weight_decay_l2, "weight_decay_l2");
     config.get(dump_testing_output, "dump_testing_output");
+    config.get(batch_bprop, "batch_bprop");
 }
 
 template<typename Float>
@@ -149,6 +152,109 @@ train_example(const Auto_Encoder & encoder,
     return make_pair(exact_error.dotprod(exact_error), error.dotprod(error));
 }
 
+std::pair<double, double>
+Auto_Encoder_Trainer::
+train_batch(const Auto_Encoder & encoder,
+            const std::vector<distribution<float> > & data,
+            int first, int last,
+            Parameters & updates,
+            Thread_Context & context) const
+{
+    // What precision do we do the calculations in?
+    typedef double Float;
+
+    int n = last - first;
+    int ni = encoder.inputs();
+
+    if (n <= 0) return make_pair(0.0, 0.0);
+
+    // One row per example.  The noise is added in the same order as
+    // train_example() would.
+    vector<Float> inputs(n * ni), noisy_inputs(n * ni);
+    vector<int> noisy_rows;
+
+    for (unsigned x = 0;  x < n;  ++x) {
+        const distribution<float> & example = data[first + x];
+        if (example.size() != ni)
+            throw Exception("train_batch(): example was wrong size");
+
+        distribution<Float> example_inputs(example);
+        distribution<Float> noisy
+            = add_noise(example_inputs, context, false /* force_noise */);
+
+        std::copy(example_inputs.begin(), example_inputs.end(),
+                  &inputs[x * ni]);
+        std::copy(noisy.begin(), noisy.end(), &noisy_inputs[x * ni]);
+
+        if (!equivalent(noisy, example_inputs))
+            noisy_rows.push_back(x);
+    }
+
+    size_t temp_space_size = n * encoder.rfprop_temporary_space_required();
+    vector<Float> temp_space(temp_space_size);
+    vector<Float> reconstruction(n * ni);
+
+    // Forward propagate (calculate the reconstruction from the noisy
+    // input)
+
+    encoder.rfprop_batch(&noisy_inputs[0], &temp_space[0], temp_space_size,
+                         &reconstruction[0], n);
+
+    // Calculate the error (difference between the reconstruction and the
+    // input) and the error gradient
+
+    vector<Float> derror(n * ni);
+    vector<double> error_noisy(n);
+    for (unsigned x = 0;  x < n;  ++x) {
+        for (unsigned i = 0;  i < ni;  ++i) {
+            Float error = inputs[x * ni + i] - reconstruction[x * ni + i];
+            derror[x * ni + i] = -2.0 * error;
+            error_noisy[x] += error * error;
+        }
+    }
+
+    // Backpropagate the error gradient through the parameters
+
+    encoder.rbprop_batch(&noisy_inputs[0], &reconstruction[0],
+                         &temp_space[0], temp_space_size,
+                         &derror[0], 0 /* input_errors_out */, updates, 1.0,
+                         n);
+
+    // Calculate the exact error as well, which is only different for the
+    // examples that had noise added
+    vector<double> error_exact(error_noisy);
+
+    int nn = noisy_rows.size();
+    if (nn > 0) {
+        vector<Float> clean_inputs(nn * ni), clean_reconstruction(nn * ni);
+        for (unsigned r = 0;  r < nn;  ++r)
+            std::copy(&inputs[noisy_rows[r] * ni],
+                      &inputs[noisy_rows[r] * ni] + ni,
+                      &clean_inputs[r * ni]);
+
+        size_t clean_space_size
+            = nn * encoder.rfprop_temporary_space_required();
+        vector<Float> clean_space(clean_space_size);
+        encoder.rfprop_batch(&clean_inputs[0], &clean_space[0],
+                             clean_space_size, &clean_reconstruction[0], nn);
+
+        for (unsigned r = 0;  r < nn;  ++r) {
+            double total = 0.0;
+            for (unsigned i = 0;  i < ni;  ++i) {
+                Float error = clean_inputs[r * ni + i]
+                    - clean_reconstruction[r * ni + i];
+                total += error * error;
+            }
+            error_exact[noisy_rows[r]] = total;
+        }
+    }
+
+    return make_pair(std::accumulate(error_exact.begin(), error_exact.end(),
+                                     0.0),
+                     std::accumulate(error_noisy.begin(), error_noisy.end(),
+                                     0.0));
+}
+
 namespace {
 
 struct Train_Examples_Job {
@@ -198,7 +304,11 @@ struct Train_Examples_Job {
 
         Parameters_Copy<double> local_updates(layer, 0.0);
 
-        for (unsigned x = first;  x < last;  ++x) {
+        if (trainer.batch_bprop)
+            boost::tie(total_error_exact, total_error_noisy)
+                = trainer.train_batch(layer, data, first, last,
+                                      local_updates, thread_context);
+        else for (unsigned x = first;  x < last;  ++x) {
 
             double eex, eno;
             boost::tie(eex, eno)
@@ -238,7 +348,11 @@ train_iter(Auto_Encoder & encoder,
     int ni JML_UNUSED = encoder.inputs();
     int no JML_UNUSED = encoder.outputs();
 
-    int microbatch_size = minibatch_size / (num_threads() * 4);
+    // Batches go through the BLAS more efficiently the bigger they are, so
+    // they are only split up enough to keep each thread busy
+    int microbatch_size
+        = std::max(1, minibatch_size
+                          / (num_threads() * (batch_bprop ? 1 : 4)));
             
     Lock update_lock;
 
@@ -335,7 +449,11 @@ train_iter(Auto_Encoder & encoder,
     int ni JML_UNUSED = encoder.inputs();
     int no JML_UNUSED = encoder.outputs();
 
-    int microbatch_size = minibatch_size / (num_threads() * 4);
+    // Batches go through the BLAS more efficiently the bigger they are, so
+    // they are only split up enough to keep each thread busy
+    int microbatch_size
+        = std::max(1, minibatch_size
+                          / (num_threads() * (batch_bprop ? 1 : 4)));
             
     Lock update_lock;
 
@@ -49,6 +49,7 @@ struct Auto_Encoder_Trainer {
     float weight_decay_l1;
     float weight_decay_l2;
     int dump_testing_output;
+    bool batch_bprop;
 
     /** Add noise to the distribution, according to the noise parameters that
         have been set above. */
@@ -65,6 +66,19 @@ struct Auto_Encoder_Trainer {
                   Parameters & updates,
                   Thread_Context & context) const;
 
+    /** Train on the examples data[first] to data[last - 1] as one batch,
+        updating the parameters.  The forward and back propagation are done
+        with Auto_Encoder::rfprop_batch() and rbprop_batch(), which are
+        matrix-matrix products for layers that support it; otherwise this is
+        the same as calling train_example() on each.  Returns the sums of
+        the exact and noisy squared errors. */
+    std::pair<double, double>
+    train_batch(const Auto_Encoder & encoder,
+                const std::vector<distribution<float> > & data,
+                int first, int last,
+                Parameters & updates,
+                Thread_Context & context) const;
+
     /** Trains a single iteration on the given data with the selected
         parameters.  Returns a moving estimate of the RMSE on the
         training set. */
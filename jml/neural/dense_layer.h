@@ -204,6 +204,63 @@ struct Dense_Layer : public Layer {
                 Parameters * dgradient,
                 double example_weight) const;    
     
+
+
+    /*************************************************************************/
+    /* BATCH                                                                 */
+    /*************************************************************************/
+
+    /** Forward and back propagation of a batch of n examples at once.  The
+        inputs, outputs and errors are row major matrices with one row per
+        example, and the work is done as matrix-matrix products through the
+        BLAS rather than one example at a time.  The results are the same
+        as calling fprop() or bprop() on each example (bar the rounding of
+        the sums), with the gradient accumulated over the batch.  The sums
+        are done in the precision of the inputs.
+
+        The input_errors can be null if they're not needed.
+    */
+    void fprop_batch(const float * inputs, float * outputs, size_t n) const;
+    void fprop_batch(const double * inputs, double * outputs, size_t n) const;
+
+    template<typename F>
+    void fprop_batch(const F * inputs, F * outputs, size_t n) const;
+
+    void bprop_batch(const float * inputs,
+                     const float * outputs,
+                     const float * output_errors,
+                     float * input_errors,
+                     Parameters & gradient,
+                     double example_weight,
+                     size_t n) const;
+
+    void bprop_batch(const double * inputs,
+                     const double * outputs,
+                     const double * output_errors,
+                     double * input_errors,
+                     Parameters & gradient,
+                     double example_weight,
+                     size_t n) const;
+
+    template<typename F>
+    void bprop_batch(const F * inputs,
+                     const F * outputs,
+                     const F * output_errors,
+                     F * input_errors,
+                     Parameters & gradient,
+                     double example_weight,
+                     size_t n) const;
+
+    /** Copy the n x inputs() matrix of inputs into result, with each missing
+        value replaced by what it multiplies the weights by: zero for
+        MV_ZERO and MV_DENSE (whose missing activations are added in
+        separately), and the replacement value for MV_INPUT. */
+    void fill_missing(const float * inputs, float * result, size_t n) const;
+    void fill_missing(const double * inputs, double * result, size_t n) const;
+
+    template<typename F>
+    void fill_missing(const F * inputs, F * result, size_t n) const;
+    
     /** Add in our parameters to the params object. */
     virtual void add_parameters(Parameters & params);
 
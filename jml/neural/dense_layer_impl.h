@@ -12,6 +12,7 @@
 #include "jml/db/persistent.h"
 #include "jml/arch/demangle.h"
 #include "jml/algebra/matrix_ops.h"
+#include "jml/algebra/lapack.h"
 #include "jml/arch/simd_vector.h"
 #include "jml/utils/string_functions.h"
 #include "jml/boosting/registry.h"
@@ -662,6 +663,216 @@ bbprop(const double * inputs,
                           example_weight);
 }
 
+template<typename Float>
+template<typename F>
+void
+Dense_Layer<Float>::
+fill_missing(const F * inputs, F * result, size_t n) const
+{
+    int ni = this->inputs();
+
+    for (unsigned x = 0;  x < n;  ++x) {
+        const F * in = inputs + x * ni;
+        F * out = result + x * ni;
+
+        for (unsigned i = 0;  i < ni;  ++i) {
+            if (!isnan(in[i])) {
+                out[i] = in[i];
+                continue;
+            }
+
+            switch (missing_values) {
+            case MV_NONE:
+                throw Exception("missing value with MV_NONE");
+            case MV_ZERO:
+            case MV_DENSE:
+                out[i] = 0.0;  break;
+            case MV_INPUT:
+                out[i] = missing_replacements[i];  break;
+            default:
+                throw Exception("unknown missing values");
+            }
+        }
+    }
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+fill_missing(const float * inputs, float * result, size_t n) const
+{
+    fill_missing<float>(inputs, result, n);
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+fill_missing(const double * inputs, double * result, size_t n) const
+{
+    fill_missing<double>(inputs, result, n);
+}
+
+template<typename Float>
+template<typename F>
+void
+Dense_Layer<Float>::
+fprop_batch(const F * inputs, F * outputs, size_t n) const
+{
+    int ni = this->inputs(), no = this->outputs();
+
+    if (n == 0) return;
+
+    std::vector<F> filled(n * ni);
+    fill_missing(inputs, &filled[0], n);
+
+    std::vector<F> wstorage;
+    const F * w = data_as<F>(weights, wstorage);
+
+    // Activations are accumulated in the outputs, starting from the bias
+    for (unsigned x = 0;  x < n;  ++x)
+        std::copy(bias.begin(), bias.end(), outputs + x * no);
+
+    LAPack::gemm_row_major('N', 'N', n, no, ni,
+                           (F)1.0, &filled[0], ni, w, no,
+                           (F)1.0, outputs, no);
+
+    if (missing_values == MV_DENSE) {
+        for (unsigned x = 0;  x < n;  ++x) {
+            for (unsigned i = 0;  i < ni;  ++i) {
+                if (!isnan(inputs[x * ni + i])) continue;
+                const Float * ma = &missing_activations[i][0];
+                F * act = outputs + x * no;
+                for (unsigned o = 0;  o < no;  ++o)
+                    act[o] += ma[o];
+            }
+        }
+    }
+
+    // The transfer function may need the whole row (eg, softmax)
+    for (unsigned x = 0;  x < n;  ++x)
+        transfer_function->transfer(outputs + x * no, outputs + x * no, no);
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+fprop_batch(const float * inputs, float * outputs, size_t n) const
+{
+    fprop_batch<float>(inputs, outputs, n);
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+fprop_batch(const double * inputs, double * outputs, size_t n) const
+{
+    fprop_batch<double>(inputs, outputs, n);
+}
+
+template<typename Float>
+template<typename F>
+void
+Dense_Layer<Float>::
+bprop_batch(const F * inputs,
+            const F * outputs,
+            const F * output_errors,
+            F * input_errors,
+            Parameters & gradient,
+            double example_weight,
+            size_t n) const
+{
+    int ni = this->inputs(), no = this->outputs();
+
+    if (n == 0) return;
+
+    // Error with respect to the activations, one row per example
+    std::vector<F> dbias(n * no);
+    for (unsigned x = 0;  x < n;  ++x)
+        transfer_function->derivative(outputs + x * no, &dbias[x * no], no);
+    for (unsigned j = 0;  j < n * no;  ++j)
+        dbias[j] *= output_errors[j];
+
+    distribution<double> bias_updates(no);
+    for (unsigned x = 0;  x < n;  ++x)
+        SIMD::vec_add(&bias_updates[0], &dbias[x * no], &bias_updates[0], no);
+    gradient.vector(1, "bias").update(&bias_updates[0], example_weight);
+
+    std::vector<F> filled(n * ni);
+    fill_missing(inputs, &filled[0], n);
+
+    std::vector<F> wstorage;
+    const F * w = data_as<F>(weights, wstorage);
+
+    // Weight updates are inputs' * dbias, summed over the batch
+    std::vector<F> weight_updates(ni * no);
+    LAPack::gemm_row_major('T', 'N', ni, no, n,
+                           (F)1.0, &filled[0], ni, &dbias[0], no,
+                           (F)0.0, &weight_updates[0], no);
+
+    Matrix_Parameter & dweights = gradient.matrix(0, "weights");
+    for (unsigned i = 0;  i < ni;  ++i)
+        dweights.update_row(i, &weight_updates[i * no], (F)example_weight);
+
+    // Errors with respect to the (filled in) inputs are dbias * weights'
+    std::vector<F> ierrors;
+    if (input_errors || missing_values == MV_INPUT) {
+        ierrors.resize(n * ni);
+        LAPack::gemm_row_major('N', 'T', n, ni, no,
+                               (F)1.0, &dbias[0], no, w, no,
+                               (F)0.0, &ierrors[0], ni);
+    }
+
+    for (unsigned x = 0;  x < n;  ++x) {
+        for (unsigned i = 0;  i < ni;  ++i) {
+            bool was_missing = isnan(inputs[x * ni + i]);
+
+            if (input_errors)
+                input_errors[x * ni + i]
+                    = was_missing ? 0.0 : ierrors[x * ni + i];
+
+            if (!was_missing) continue;
+
+            if (missing_values == MV_DENSE)
+                gradient.matrix(3, "missing_activations")
+                    .update_row(i, &dbias[x * no], (F)example_weight);
+            else if (missing_values == MV_INPUT)
+                gradient.vector(2, "missing_replacements")
+                    .update_element(i, (F)(example_weight
+                                           * ierrors[x * ni + i]));
+        }
+    }
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+bprop_batch(const float * inputs,
+            const float * outputs,
+            const float * output_errors,
+            float * input_errors,
+            Parameters & gradient,
+            double example_weight,
+            size_t n) const
+{
+    bprop_batch<float>(inputs, outputs, output_errors, input_errors,
+                       gradient, example_weight, n);
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+bprop_batch(const double * inputs,
+            const double * outputs,
+            const double * output_errors,
+            double * input_errors,
+            Parameters & gradient,
+            double example_weight,
+            size_t n) const
+{
+    bprop_batch<double>(inputs, outputs, output_errors, input_errors,
+                        gradient, example_weight, n);
+}
+
 namespace {
 
 template<typename Float>
@@ -545,3 +545,71 @@ BOOST_AUTO_TEST_CASE( test_bbprop_tanh_double_none2 )
     bbprop_test<double>(layer, context);
 }
 
+
+template<typename F, typename Float>
+void batch_test(Missing_Values missing_values,
+                Transfer_Function_Type transfer_function,
+                size_t n, double tolerance)
+{
+    Thread_Context context;
+    context.seed(42);
+
+    int ni = 13, no = 9;
+    Dense_Layer<Float> layer("test", ni, no, transfer_function,
+                             missing_values, context);
+
+    vector<F> inputs(n * ni), output_errors(n * no);
+    for (unsigned i = 0;  i < inputs.size();  ++i) {
+        inputs[i] = context.random01() * 2.0 - 1.0;
+        if (missing_values != MV_NONE && i % 5 == 0)
+            inputs[i] = numeric_limits<F>::quiet_NaN();
+    }
+    for (unsigned i = 0;  i < output_errors.size();  ++i)
+        output_errors[i] = context.random01() * 2.0 - 1.0;
+
+    // One example at a time
+    vector<F> outputs1(n * no), input_errors1(n * ni);
+    Parameters_Copy<double> gradient1(layer, 0.0);
+    for (unsigned x = 0;  x < n;  ++x) {
+        layer.fprop(&inputs[x * ni], 0, 0, &outputs1[x * no]);
+        layer.bprop(&inputs[x * ni], &outputs1[x * no], 0, 0,
+                    &output_errors[x * no], &input_errors1[x * ni],
+                    gradient1, 0.5);
+    }
+
+    // As a batch
+    vector<F> outputs2(n * no), input_errors2(n * ni);
+    Parameters_Copy<double> gradient2(layer, 0.0);
+    layer.fprop_batch(&inputs[0], &outputs2[0], n);
+    layer.bprop_batch(&inputs[0], &outputs2[0], &output_errors[0],
+                      &input_errors2[0], gradient2, 0.5, n);
+
+    for (unsigned i = 0;  i < outputs1.size();  ++i)
+        BOOST_CHECK_SMALL(outputs1[i] - outputs2[i], (F)tolerance);
+    for (unsigned i = 0;  i < input_errors1.size();  ++i)
+        BOOST_CHECK_SMALL(input_errors1[i] - input_errors2[i], (F)tolerance);
+
+    BOOST_REQUIRE_EQUAL(gradient1.values.size(), gradient2.values.size());
+    for (unsigned i = 0;  i < gradient1.values.size();  ++i)
+        BOOST_CHECK_SMALL(gradient1.values[i] - gradient2.values[i],
+                          tolerance * n);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_size_one )
+{
+    for (Missing_Values mv: { MV_NONE, MV_ZERO, MV_INPUT, MV_DENSE }) {
+        batch_test<double, double>(mv, TF_TANH, 1, 1e-12);
+        batch_test<double, float>(mv, TF_TANH, 1, 1e-12);
+        batch_test<float, float>(mv, TF_TANH, 1, 1e-5);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_batch )
+{
+    for (Missing_Values mv: { MV_NONE, MV_ZERO, MV_INPUT, MV_DENSE }) {
+        batch_test<double, double>(mv, TF_TANH, 50, 1e-12);
+        batch_test<double, double>(mv, TF_LOGSIG, 50, 1e-12);
+        batch_test<double, float>(mv, TF_SOFTMAX, 50, 1e-12);
+        batch_test<float, double>(mv, TF_IDENTITY, 50, 1e-4);
+    }
+}
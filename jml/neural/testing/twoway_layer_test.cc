@@ -413,4 +413,81 @@ BOOST_AUTO_TEST_CASE( test_bbprop_tanh_double_none3 )
     // (long) calculation
     bbprop_test_reconstruct<double>(layer, context, 3.0);
 }
+template<typename F>
+void batch_test(Missing_Values missing_values,
+                Transfer_Function_Type transfer_function,
+                size_t n, double tolerance)
+{
+    Thread_Context context;
+    context.seed(42);
+
+    int ni = 13, no = 9;
+    Twoway_Layer layer("test", ni, no, transfer_function, missing_values,
+                       context);
+
+    vector<F> inputs(n * ni), reconstruction_errors(n * ni);
+    for (unsigned i = 0;  i < inputs.size();  ++i) {
+        inputs[i] = context.random01() * 2.0 - 1.0;
+        if (missing_values != MV_NONE && i % 5 == 0)
+            inputs[i] = numeric_limits<F>::quiet_NaN();
+    }
+    for (unsigned i = 0;  i < reconstruction_errors.size();  ++i)
+        reconstruction_errors[i] = context.random01() * 2.0 - 1.0;
+
+    size_t tspace = layer.rfprop_temporary_space_required();
+
+    // One example at a time
+    vector<F> temp1(n * tspace), reconstruction1(n * ni), input_errors1(n * ni);
+    Parameters_Copy<double> gradient1(layer, 0.0);
+    for (unsigned x = 0;  x < n;  ++x) {
+        layer.rfprop(&inputs[x * ni], &temp1[x * tspace], tspace,
+                     &reconstruction1[x * ni]);
+        layer.rbprop(&inputs[x * ni], &reconstruction1[x * ni],
+                     &temp1[x * tspace], tspace,
+                     &reconstruction_errors[x * ni], &input_errors1[x * ni],
+                     gradient1, 0.5);
+    }
+
+    // As a batch.  The weights are single precision, which rbprop() rounds
+    // some of its intermediate results to, so they are only the same to
+    // about that precision.
+    vector<F> temp2(n * tspace), reconstruction2(n * ni), input_errors2(n * ni);
+    Parameters_Copy<double> gradient2(layer, 0.0);
+    layer.rfprop_batch(&inputs[0], &temp2[0], temp2.size(),
+                       &reconstruction2[0], n);
+    layer.rbprop_batch(&inputs[0], &reconstruction2[0],
+                       &temp2[0], temp2.size(),
+                       &reconstruction_errors[0], &input_errors2[0],
+                       gradient2, 0.5, n);
+
+    for (unsigned i = 0;  i < temp1.size();  ++i)
+        BOOST_CHECK_SMALL(temp1[i] - temp2[i], (F)tolerance);
+    for (unsigned i = 0;  i < reconstruction1.size();  ++i)
+        BOOST_CHECK_SMALL(reconstruction1[i] - reconstruction2[i],
+                          (F)tolerance);
+    for (unsigned i = 0;  i < input_errors1.size();  ++i)
+        BOOST_CHECK_SMALL(input_errors1[i] - input_errors2[i], (F)tolerance);
+
+    BOOST_REQUIRE_EQUAL(gradient1.values.size(), gradient2.values.size());
+    for (unsigned i = 0;  i < gradient1.values.size();  ++i)
+        BOOST_CHECK_SMALL(gradient1.values[i] - gradient2.values[i],
+                          tolerance * n);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_size_one )
+{
+    for (Missing_Values mv: { MV_NONE, MV_ZERO, MV_INPUT, MV_DENSE }) {
+        batch_test<double>(mv, TF_TANH, 1, 1e-7);
+        batch_test<float>(mv, TF_TANH, 1, 1e-5);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_batch )
+{
+    for (Missing_Values mv: { MV_NONE, MV_ZERO, MV_INPUT, MV_DENSE }) {
+        batch_test<double>(mv, TF_TANH, 50, 1e-7);
+        batch_test<double>(mv, TF_IDENTITY, 50, 1e-7);
+    }
+}
+
 #endif
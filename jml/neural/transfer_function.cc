@@ -10,6 +10,7 @@
 #include "jml/db/persistent.h"
 #include "jml/boosting/registry.h"
 #include "jml/utils/smart_ptr_utils.h"
+#include "jml/arch/simd_vector.h"
 
 #include <boost/static_assert.hpp>
 
@@ -202,6 +203,48 @@ equal(const Transfer_Function & other) const
     return transfer_function == other_cast->transfer_function;
 }
 
+namespace {
+
+/* Single precision uses the vectorized functions, which are within a few
+   ulps; double precision keeps the full precision ones. */
+
+void transfer_logsig(const float * activation, float * outputs, int nvals)
+{
+    SIMD::vec_sigmoid(activation, outputs, nvals);
+}
+
+void transfer_logsig(const double * activation, double * outputs, int nvals)
+{
+    for (unsigned i = 0;  i < nvals;  ++i)
+        outputs[i] = 1.0 / (1.0 + exp(-activation[i]));
+}
+
+void transfer_tanh(const float * activation, float * outputs, int nvals)
+{
+    SIMD::vec_tanh(activation, outputs, nvals);
+}
+
+void transfer_tanh(const double * activation, double * outputs, int nvals)
+{
+    for (unsigned i = 0;  i < nvals;  ++i)
+        outputs[i] = tanh(activation[i]);
+}
+
+void transfer_tanhs(const float * activation, float * outputs, int nvals)
+{
+    SIMD::vec_scale(activation, 0.66666666666666666666f, outputs, nvals);
+    SIMD::vec_tanh(outputs, outputs, nvals);
+    SIMD::vec_scale(outputs, 1.7159f, outputs, nvals);
+}
+
+void transfer_tanhs(const double * activation, double * outputs, int nvals)
+{
+    for (unsigned i = 0;  i < nvals;  ++i)
+        outputs[i] = 1.7159 * tanh(0.66666666666666666666 * activation[i]);
+}
+
+} // file scope
+
 template<typename FloatIn>
 void
 Standard_Transfer_Function::
@@ -214,21 +257,15 @@ transfer(const FloatIn * activation, FloatIn * outputs, int nvals,
         return;
         
     case TF_LOGSIG:
-        for (unsigned i = 0;  i < nvals;  ++i) {
-            // See https://bugzilla.redhat.com/show_bug.cgi?id=521190
-            // for why we use double version of exp
-            outputs[i] = 1.0 / (1.0 + exp((double)-activation[i]));
-        }
+        transfer_logsig(activation, outputs, nvals);
         break;
         
     case TF_TANH:
-        for (unsigned i = 0;  i < nvals;  ++i)
-            outputs[i] = tanh(activation[i]);
+        transfer_tanh(activation, outputs, nvals);
         break;
         
     case TF_TANHS:
-        for (unsigned i = 0;  i < nvals;  ++i)
-            outputs[i] = 1.7159 * tanh(0.66666666666666666666 * activation[i]);
+        transfer_tanhs(activation, outputs, nvals);
         break;
         
     case TF_SOFTMAX: {
@@ -12,6 +12,7 @@
 #include "jml/utils/check_not_nan.h"
 #include "jml/boosting/registry.h"
 #include "jml/algebra/matrix_ops.h"
+#include "jml/algebra/lapack.h"
 #include "jml/stats/distribution_ops.h"
 
 using namespace std;
@@ -881,20 +882,23 @@ rbprop(const F * inputs,
         else throw Exception("unknown updates");
     }
 
-    distribution<F> cleared_value_updates(ni);
-    cleared_value_updates = isnan(noisy_input) * (W * b_updates);
-        
+    distribution<F> input_updates(W * b_updates);
+
     if (forward.missing_values == MV_INPUT) {
+        // Only the replacements that were used get an update
+        distribution<F> cleared_value_updates(ni);
+        for (unsigned i = 0;  i < ni;  ++i)
+            if (isnan(noisy_input[i]))
+                cleared_value_updates[i] = input_updates[i];
+
         gradient.vector(2, "missing_replacements")
             .update(cleared_value_updates, example_weight);
     }
 
 
-    if (input_errors_out) {
-        distribution<F> input_updates(W * b_updates);
+    if (input_errors_out)
         std::copy(input_updates.begin(), input_updates.end(),
                   input_errors_out);
-    }
 }
     
 void
@@ -929,6 +933,273 @@ rbprop(const double * inputs,
                           gradient, example_weight);
 }
 
+namespace {
+
+/** Sum of each column of the n x m row major matrix M, optionally
+    multiplied elementwise by the matrix M2 first. */
+template<typename F>
+distribution<double>
+column_sums(const F * M, size_t n, size_t m, const F * M2 = 0)
+{
+    distribution<double> result(m);
+    for (unsigned x = 0;  x < n;  ++x) {
+        const F * row = M + x * m;
+        if (M2) {
+            const F * row2 = M2 + x * m;
+            for (unsigned j = 0;  j < m;  ++j)
+                result[j] += row[j] * row2[j];
+        }
+        else for (unsigned j = 0;  j < m;  ++j)
+            result[j] += row[j];
+    }
+    return result;
+}
+
+} // file scope
+
+template<typename F>
+void
+Twoway_Layer::
+iapply_batch(const F * outputs, F * inputs, size_t n) const
+{
+    int no = this->outputs(), ni = this->inputs();
+
+    if (n == 0) return;
+
+    std::vector<F> scaled_outputs(outputs, outputs + n * no);
+    for (unsigned x = 0;  x < n;  ++x)
+        for (unsigned o = 0;  o < no;  ++o)
+            scaled_outputs[x * no + o] *= oscales[o];
+
+    std::vector<F> wstorage;
+    const F * W = data_as<F>(forward.weights, wstorage);
+
+    LAPack::gemm_row_major('N', 'T', n, ni, no,
+                           (F)1.0, &scaled_outputs[0], no, W, no,
+                           (F)0.0, inputs, ni);
+
+    for (unsigned x = 0;  x < n;  ++x) {
+        F * activations = inputs + x * ni;
+        for (unsigned i = 0;  i < ni;  ++i)
+            activations[i] = ibias[i] + iscales[i] * activations[i];
+        forward.transfer_function->transfer(activations, activations, ni);
+    }
+}
+
+template<typename F>
+void
+Twoway_Layer::
+rfprop_batch(const F * inputs,
+             F * temp_space, size_t temp_space_size,
+             F * reconstruction,
+             size_t n) const
+{
+    // Neither direction needs temporary space, so that of each example is
+    // just its hidden representation and together they make up the n x no
+    // matrix of them.
+    if (temp_space_size != n * rfprop_temporary_space_required()
+        || rfprop_temporary_space_required() != this->outputs())
+        throw Exception("wrong temporary space size");
+
+    F * outputs = temp_space;
+
+    forward.fprop_batch(inputs, outputs, n);
+    iapply_batch(outputs, reconstruction, n);
+}
+
+void
+Twoway_Layer::
+rfprop_batch(const float * inputs,
+             float * temp_space, size_t temp_space_size,
+             float * reconstruction,
+             size_t n) const
+{
+    return rfprop_batch<float>(inputs, temp_space, temp_space_size,
+                               reconstruction, n);
+}
+
+void
+Twoway_Layer::
+rfprop_batch(const double * inputs,
+             double * temp_space, size_t temp_space_size,
+             double * reconstruction,
+             size_t n) const
+{
+    return rfprop_batch<double>(inputs, temp_space, temp_space_size,
+                                reconstruction, n);
+}
+
+template<typename F>
+void
+Twoway_Layer::
+rbprop_batch(const F * inputs,
+             const F * reconstruction,
+             const F * temp_space,
+             size_t temp_space_size,
+             const F * reconstruction_errors,
+             F * input_errors_out,
+             Parameters & gradient,
+             double example_weight,
+             size_t n) const
+{
+    if (temp_space_size != n * rfprop_temporary_space_required()
+        || rfprop_temporary_space_required() != this->outputs())
+        throw Exception("wrong temporary space size");
+
+    if (n == 0) return;
+
+    int ni = this->inputs(), no = this->outputs();
+
+    // This is the same calculation as rbprop(), with each of the vectors
+    // there becoming a matrix with one row per example.  See there for
+    // the details.
+
+    const F * hidden_rep = temp_space;
+
+    std::vector<F> wstorage;
+    const F * W = data_as<F>(forward.weights, wstorage);
+
+    const distribution<Float> & d = iscales;
+    const distribution<Float> & e = oscales;
+
+    std::vector<F> c_updates(n * ni);
+    for (unsigned x = 0;  x < n;  ++x)
+        forward.transfer_function->derivative(reconstruction + x * ni,
+                                              &c_updates[x * ni], ni);
+    for (unsigned j = 0;  j < n * ni;  ++j)
+        c_updates[j] *= reconstruction_errors[j];
+
+    CHECK_NOT_NAN_RANGE(c_updates.begin(), c_updates.end());
+
+    gradient.vector(4, "ibias")
+        .update(&column_sums(&c_updates[0], n, ni)[0], example_weight);
+
+    std::vector<F> hidden_rep_e(hidden_rep, hidden_rep + n * no);
+    for (unsigned x = 0;  x < n;  ++x)
+        for (unsigned o = 0;  o < no;  ++o)
+            hidden_rep_e[x * no + o] *= e[o];
+
+    std::vector<F> W_hidden_rep_e(n * ni);
+    LAPack::gemm_row_major('N', 'T', n, ni, no,
+                           (F)1.0, &hidden_rep_e[0], no, W, no,
+                           (F)0.0, &W_hidden_rep_e[0], ni);
+
+    gradient.vector(5, "iscales")
+        .update(&column_sums(&W_hidden_rep_e[0], n, ni, &c_updates[0])[0],
+                example_weight);
+
+    std::vector<F> c_updates_d(c_updates);
+    for (unsigned x = 0;  x < n;  ++x)
+        for (unsigned i = 0;  i < ni;  ++i)
+            c_updates_d[x * ni + i] *= d[i];
+
+    std::vector<F> cupdates_d_W(n * no);
+    LAPack::gemm_row_major('N', 'N', n, no, ni,
+                           (F)1.0, &c_updates_d[0], ni, W, no,
+                           (F)0.0, &cupdates_d_W[0], no);
+
+    gradient.vector(6, "oscales")
+        .update(&column_sums(&cupdates_d_W[0], n, no, hidden_rep)[0],
+                example_weight);
+
+    // b_updates is also the factor_totals * hidden_deriv that multiplies
+    // the input in the weight updates
+    std::vector<F> b_updates(n * no);
+    for (unsigned x = 0;  x < n;  ++x)
+        forward.transfer_function->derivative(hidden_rep + x * no,
+                                              &b_updates[x * no], no);
+    for (unsigned x = 0;  x < n;  ++x)
+        for (unsigned o = 0;  o < no;  ++o)
+            b_updates[x * no + o] *= cupdates_d_W[x * no + o] * e[o];
+
+    CHECK_NOT_NAN_RANGE(b_updates.begin(), b_updates.end());
+
+    gradient.vector(1, "bias")
+        .update(&column_sums(&b_updates[0], n, no)[0], example_weight);
+
+    // W is used on the way in and the way out, so the weight updates are
+    // c_updates_d' * hidden_rep_e + inputs' * b_updates, with the missing
+    // inputs filled in with what multiplied the weights.
+    std::vector<F> filled(n * ni);
+    forward.fill_missing(inputs, &filled[0], n);
+
+    std::vector<F> W_updates(ni * no);
+    LAPack::gemm_row_major('T', 'N', ni, no, n,
+                           (F)1.0, &c_updates_d[0], ni, &hidden_rep_e[0], no,
+                           (F)0.0, &W_updates[0], no);
+    LAPack::gemm_row_major('T', 'N', ni, no, n,
+                           (F)1.0, &filled[0], ni, &b_updates[0], no,
+                           (F)1.0, &W_updates[0], no);
+
+    CHECK_NOT_NAN_RANGE(W_updates.begin(), W_updates.end());
+
+    Matrix_Parameter & dweights = gradient.matrix(0, "weights");
+    for (unsigned i = 0;  i < ni;  ++i)
+        dweights.update_row(i, &W_updates[i * no], (F)example_weight);
+
+    std::vector<F> input_updates;
+    if (input_errors_out || forward.missing_values == MV_INPUT) {
+        input_updates.resize(n * ni);
+        LAPack::gemm_row_major('N', 'T', n, ni, no,
+                               (F)1.0, &b_updates[0], no, W, no,
+                               (F)0.0, &input_updates[0], ni);
+    }
+
+    if (forward.missing_values == MV_DENSE
+        || forward.missing_values == MV_INPUT) {
+        for (unsigned x = 0;  x < n;  ++x) {
+            for (unsigned i = 0;  i < ni;  ++i) {
+                if (!isnan(inputs[x * ni + i])) continue;
+
+                if (forward.missing_values == MV_DENSE)
+                    gradient.matrix(3, "missing_activations")
+                        .update_row(i, &b_updates[x * no], (F)example_weight);
+                else gradient.vector(2, "missing_replacements")
+                         .update_element(i, (F)(example_weight
+                                                * input_updates[x * ni + i]));
+            }
+        }
+    }
+
+    if (input_errors_out)
+        std::copy(input_updates.begin(), input_updates.end(),
+                  input_errors_out);
+}
+
+void
+Twoway_Layer::
+rbprop_batch(const float * inputs,
+             const float * reconstruction,
+             const float * temp_space,
+             size_t temp_space_size,
+             const float * reconstruction_errors,
+             float * input_errors_out,
+             Parameters & gradient,
+             double example_weight,
+             size_t n) const
+{
+    return rbprop_batch<float>(inputs, reconstruction, temp_space,
+                               temp_space_size, reconstruction_errors,
+                               input_errors_out, gradient, example_weight, n);
+}
+
+void
+Twoway_Layer::
+rbprop_batch(const double * inputs,
+             const double * reconstruction,
+             const double * temp_space,
+             size_t temp_space_size,
+             const double * reconstruction_errors,
+             double * input_errors_out,
+             Parameters & gradient,
+             double example_weight,
+             size_t n) const
+{
+    return rbprop_batch<double>(inputs, reconstruction, temp_space,
+                                temp_space_size, reconstruction_errors,
+                                input_errors_out, gradient, example_weight, n);
+}
+
 std::string
 Twoway_Layer::
 print() const
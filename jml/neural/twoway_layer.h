@@ -304,6 +304,62 @@ struct Twoway_Layer : public Auto_Encoder {
                 Parameters & gradient,
                 double example_weight) const;
 
+    /** Batch versions of rfprop() and rbprop(), done as matrix-matrix
+        products through the BLAS.  See Auto_Encoder::rfprop_batch(). */
+    virtual void
+    rfprop_batch(const float * inputs,
+                 float * temp_space, size_t temp_space_size,
+                 float * reconstruction,
+                 size_t n) const;
+
+    virtual void
+    rfprop_batch(const double * inputs,
+                 double * temp_space, size_t temp_space_size,
+                 double * reconstruction,
+                 size_t n) const;
+
+    template<typename F>
+    void
+    rfprop_batch(const F * inputs,
+                 F * temp_space, size_t temp_space_size,
+                 F * reconstruction,
+                 size_t n) const;
+
+    virtual void rbprop_batch(const float * inputs,
+                              const float * reconstruction,
+                              const float * temp_space,
+                              size_t temp_space_size,
+                              const float * reconstruction_errors,
+                              float * input_errors_out,
+                              Parameters & gradient,
+                              double example_weight,
+                              size_t n) const;
+
+    virtual void rbprop_batch(const double * inputs,
+                              const double * reconstruction,
+                              const double * temp_space,
+                              size_t temp_space_size,
+                              const double * reconstruction_errors,
+                              double * input_errors_out,
+                              Parameters & gradient,
+                              double example_weight,
+                              size_t n) const;
+
+    template<typename F>
+    void rbprop_batch(const F * inputs,
+                      const F * reconstruction,
+                      const F * temp_space,
+                      size_t temp_space_size,
+                      const F * reconstruction_errors,
+                      F * input_errors_out,
+                      Parameters & gradient,
+                      double example_weight,
+                      size_t n) const;
+
+    /** iapply() for a n x outputs() matrix of outputs. */
+    template<typename F>
+    void iapply_batch(const F * outputs, F * inputs, size_t n) const;
+
     /** Dump as ASCII.  This will be big. */
     virtual std::string print() const;
     
@@ -6,7 +6,9 @@
 */
 
 #include "auc.h"
+#include "jml/utils/worker_task.h"
 #include <algorithm>
+#include <numeric>
 
 
 using namespace std;
@@ -14,20 +16,13 @@ using namespace std;
 
 namespace ML {
 
-double do_calc_auc(std::vector<AUC_Entry> & entries)
-{
-    // 1.  Total number of positive and negative
-    int num_neg = 0, num_pos = 0;
+namespace {
 
-    for (unsigned i = 0;  i < entries.size();  ++i) {
-        if (entries[i].weight == 0.0) continue;
-        if (entries[i].target == false) ++num_neg;
-        else ++num_pos;
-    }
-
-    // 2.  Sort
-    std::sort(entries.begin(), entries.end());
-    
+/** Calculate the AUC error of entries that are already sorted by model
+    value, with the given number of negative and positive examples. */
+double auc_of_sorted(const std::vector<AUC_Entry> & entries,
+                     int num_neg, int num_pos)
+{
     // 3.  Get (x,y) points and calculate the AUC
     int total_pos = 0, total_neg = 0;
 
@@ -79,4 +74,203 @@ double do_calc_auc(std::vector<AUC_Entry> & entries)
     return 1.0 - total_area;
 }
 
+void count_targets(const AUC_Entry * first, const AUC_Entry * last,
+                   int & num_neg, int & num_pos)
+{
+    for (; first != last;  ++first) {
+        if (first->weight == 0.0) continue;
+        if (first->target == false) ++num_neg;
+        else ++num_pos;
+    }
+}
+
+} // file scope
+
+double do_calc_auc(std::vector<AUC_Entry> & entries)
+{
+    // 1.  Total number of positive and negative
+    int num_neg = 0, num_pos = 0;
+    count_targets(entries.data(), entries.data() + entries.size(),
+                  num_neg, num_pos);
+
+    // 2.  Sort
+    std::sort(entries.begin(), entries.end());
+
+    return auc_of_sorted(entries, num_neg, num_pos);
+}
+
+double do_calc_auc_parallel(std::vector<AUC_Entry> & entries)
+{
+    size_t n = entries.size();
+    int nthreads = num_threads();
+
+    if (n < 100000 || nthreads < 2)
+        return do_calc_auc(entries);
+
+    /* 1.  Choose the splitters between the buckets from a regular sample
+           of the model values.  Equal values always go in the same bucket,
+           so that runs of ties are never split. */
+    int num_buckets = nthreads * 4;
+    int oversample = 32;
+    int sample_size = num_buckets * oversample;
+
+    vector<float> sample(sample_size);
+    for (unsigned i = 0;  i < sample_size;  ++i)
+        sample[i] = entries[i * (n / sample_size)].model;
+    std::sort(sample.begin(), sample.end());
+
+    vector<float> splitters(num_buckets - 1);
+    for (unsigned i = 0;  i < num_buckets - 1;  ++i)
+        splitters[i] = sample[(i + 1) * oversample];
+
+    auto bucketOf = [&] (float model) -> int
+        {
+            return std::upper_bound(splitters.begin(), splitters.end(), model)
+                - splitters.begin();
+        };
+
+    /* 2.  Count the bucket sizes for each chunk of the input, along with
+           the number of positives and negatives. */
+    int num_chunks = num_buckets;
+    vector<vector<size_t> > counts(num_chunks, vector<size_t>(num_buckets));
+    vector<int> chunk_neg(num_chunks), chunk_pos(num_chunks);
+
+    auto chunkStart = [&] (int chunk) { return chunk * n / num_chunks; };
+
+    auto doCount = [&] (int chunk)
+        {
+            const AUC_Entry * first = entries.data() + chunkStart(chunk);
+            const AUC_Entry * last = entries.data() + chunkStart(chunk + 1);
+            vector<size_t> & chunk_counts = counts[chunk];
+            for (const AUC_Entry * e = first;  e != last;  ++e)
+                ++chunk_counts[bucketOf(e->model)];
+            count_targets(first, last, chunk_neg[chunk], chunk_pos[chunk]);
+        };
+
+    run_in_parallel(0, num_chunks, doCount);
+
+    int num_neg = 0, num_pos = 0;
+    for (unsigned i = 0;  i < num_chunks;  ++i) {
+        num_neg += chunk_neg[i];
+        num_pos += chunk_pos[i];
+    }
+
+    /* 3.  Turn the counts into the offset of each chunk's part of each
+           bucket in the output. */
+    vector<size_t> bucket_start(num_buckets + 1);
+    size_t offset = 0;
+    for (unsigned b = 0;  b < num_buckets;  ++b) {
+        bucket_start[b] = offset;
+        for (unsigned c = 0;  c < num_chunks;  ++c) {
+            size_t count = counts[c][b];
+            counts[c][b] = offset;
+            offset += count;
+        }
+    }
+    bucket_start[num_buckets] = offset;
+
+    /* 4.  Scatter each chunk into the buckets */
+    vector<AUC_Entry> sorted(n);
+
+    auto doScatter = [&] (int chunk)
+        {
+            const AUC_Entry * first = entries.data() + chunkStart(chunk);
+            const AUC_Entry * last = entries.data() + chunkStart(chunk + 1);
+            vector<size_t> & pos = counts[chunk];
+            for (const AUC_Entry * e = first;  e != last;  ++e)
+                sorted[pos[bucketOf(e->model)]++] = *e;
+        };
+
+    run_in_parallel(0, num_chunks, doScatter);
+
+    /* 5.  Sort each bucket */
+    auto doSort = [&] (int bucket)
+        {
+            std::sort(sorted.begin() + bucket_start[bucket],
+                      sorted.begin() + bucket_start[bucket + 1]);
+        };
+
+    run_in_parallel(0, num_buckets, doSort);
+
+    entries.swap(sorted);
+
+    return auc_of_sorted(entries, num_neg, num_pos);
+}
+
+
+/*****************************************************************************/
+/* AUC_HISTOGRAM                                                             */
+/*****************************************************************************/
+
+AUC_Histogram::
+AUC_Histogram(float min_model, float max_model, int num_buckets)
+    : min_model(min_model), max_model(max_model),
+      pos(num_buckets), neg(num_buckets)
+{
+    if (num_buckets < 1)
+        throw Exception("AUC_Histogram: need at least one bucket");
+    if (!(max_model > min_model))
+        throw Exception("AUC_Histogram: empty range of model values");
+    scale = num_buckets / ((double)max_model - min_model);
+}
+
+void
+AUC_Histogram::
+add(const AUC_Histogram & other)
+{
+    if (other.min_model != min_model || other.max_model != max_model
+        || other.num_buckets() != num_buckets())
+        throw Exception("AUC_Histogram::add(): histograms don't match");
+
+    for (unsigned i = 0;  i < pos.size();  ++i) {
+        pos[i] += other.pos[i];
+        neg[i] += other.neg[i];
+    }
+}
+
+double
+AUC_Histogram::
+total_pos() const
+{
+    return std::accumulate(pos.begin(), pos.end(), 0.0);
+}
+
+double
+AUC_Histogram::
+total_neg() const
+{
+    return std::accumulate(neg.begin(), neg.end(), 0.0);
+}
+
+double
+AUC_Histogram::
+calc_auc() const
+{
+    double num_pos = total_pos(), num_neg = total_neg();
+
+    if (num_pos == 0.0 || num_neg == 0.0)
+        throw Exception("AUC_Histogram::calc_auc(): need both positive "
+                        "and negative examples");
+
+    /* Same trapezoids as do_calc_auc, with a point per bucket */
+    double cum_pos = 0.0, cum_neg = 0.0, prevx = 0.0, prevy = 0.0;
+    double total_area = 0.0;
+
+    for (unsigned i = 0;  i < pos.size();  ++i) {
+        if (pos[i] == 0.0 && neg[i] == 0.0) continue;
+        cum_pos += pos[i];
+        cum_neg += neg[i];
+
+        double x = cum_pos / num_pos;
+        double y = cum_neg / num_neg;
+
+        total_area += (x - prevx) * (y + prevy) * 0.5;
+
+        prevx = x;
+        prevy = y;
+    }
+
+    return 1.0 - total_area;
+}
+
 } // namespace ML
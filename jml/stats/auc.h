@@ -30,8 +30,70 @@ struct AUC_Entry {
     }
 };
 
+/** Calculate the AUC error (1.0 - the area under the ROC curve, so 0.0 for
+    a perfect ranking) of the given entries.  The entries are sorted in
+    place.  Entries with a zero weight are ignored; others count once each.
+*/
 double do_calc_auc(std::vector<AUC_Entry> & entries);
 
+/** Same as do_calc_auc, but uses a parallel sample sort over the worker
+    threads: the entries are split into buckets of model values using a
+    sample of them, scattered into the buckets and each bucket sorted in a
+    different thread.  Small sets of entries just use do_calc_auc.
+*/
+double do_calc_auc_parallel(std::vector<AUC_Entry> & entries);
+
+
+/*****************************************************************************/
+/* AUC_HISTOGRAM                                                             */
+/*****************************************************************************/
+
+/** Approximate AUC over a stream of entries, in constant memory.  The range
+    of model values is split into num_buckets equal buckets, and the
+    examples in each bucket are treated as a tie.  The error compared to
+    the exact AUC is bounded by the proportion of (positive, negative) pairs
+    that fall in the same bucket.  Model values outside the range go into
+    the first or last bucket.
+
+    Unlike do_calc_auc, the weights are counted: an example with a weight of
+    2 counts as if it were there twice.
+
+    Histograms with the same range and number of buckets can be merged, so
+    each thread can keep its own and add them together at the end.
+*/
+
+struct AUC_Histogram {
+    AUC_Histogram(float min_model = 0.0, float max_model = 1.0,
+                  int num_buckets = 4096);
+
+    void add(float model, bool target, float weight = 1.0)
+    {
+        double b = (model - min_model) * scale;
+        int bucket;
+        if (b >= num_buckets()) bucket = num_buckets() - 1;
+        else if (b > 0.0) bucket = b;
+        else bucket = 0;  // also NaN
+        (target ? pos : neg)[bucket] += weight;
+    }
+
+    /** Merge in another histogram over the same buckets. */
+    void add(const AUC_Histogram & other);
+
+    int num_buckets() const { return pos.size(); }
+
+    double total_pos() const;
+    double total_neg() const;
+
+    /** The AUC error, in the same form as do_calc_auc. */
+    double calc_auc() const;
+
+private:
+    float min_model, max_model;
+    double scale;               ///< Buckets per unit of model value
+    std::vector<double> pos;    ///< Weight of positive examples per bucket
+    std::vector<double> neg;    ///< Weight of negative examples per bucket
+};
+
 
 template<typename Float1, typename Float2, typename Float3>
 double
@@ -59,7 +121,7 @@ calc_auc(const std::vector<Float1> & outputs,
         entries.push_back(AUC_Entry(outputs[i], target));
     }
     
-    return do_calc_auc(entries);
+    return do_calc_auc_parallel(entries);
 }
 
 template<typename Float1, typename Float2, typename Float3, typename Float4>
@@ -91,7 +153,7 @@ calc_auc(const std::vector<Float1> & outputs,
         entries.push_back(AUC_Entry(outputs[i], target, weights[i]));
     }
     
-    return do_calc_auc(entries);
+    return do_calc_auc_parallel(entries);
 }
 
 } // namespace ML
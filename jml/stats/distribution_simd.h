@@ -87,6 +87,22 @@ dotprod(const distribution<double> & d2) const
     return SIMD::vec_dotprod_dp(&(*this)[0], &d2[0], size());
 }
 
+template<>
+JML_ALWAYS_INLINE double
+distribution<float>::
+two_norm() const
+{
+    return sqrt(SIMD::vec_twonorm_sqr_dp(&(*this)[0], this->size()));
+}
+
+template<>
+JML_ALWAYS_INLINE double
+distribution<double>::
+two_norm() const
+{
+    return sqrt(SIMD::vec_twonorm_sqr_dp(&(*this)[0], this->size()));
+}
+
 inline distribution<double>
 operator + (const distribution<double> & d1,
             const distribution<double> & d2)
@@ -4,7 +4,7 @@ LIBSTATS_SOURCES := \
 
 $(eval $(call add_sources,$(LIBSTATS_SOURCES)))
 
-LIBSTATS_LINK :=	utils
+LIBSTATS_LINK :=	utils worker_task
 
 $(eval $(call library,stats,$(LIBSTATS_SOURCES),$(LIBSTATS_LINK)))
 
@@ -15,6 +15,11 @@
 #include <iostream>
 
 #include "jml/stats/auc.h"
+#include "jml/stats/distribution_simd.h"
+#include "jml/arch/exception_handler.h"
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int.hpp>
+#include <boost/random/variate_generator.hpp>
 
 using namespace ML;
 using namespace std;
@@ -24,3 +29,121 @@ using boost::unit_test::test_suite;
 BOOST_AUTO_TEST_CASE( test1 )
 {
 }
+
+BOOST_AUTO_TEST_CASE( test_simple_auc )
+{
+    vector<float> outputs = { 0.1, 0.2, 0.3, 0.4 };
+
+    // Perfect ranking gives no error, and the reverse is all error
+    BOOST_CHECK_EQUAL(calc_auc(outputs, vector<int>({ 0, 0, 1, 1 }), 0, 1),
+                      0.0);
+    BOOST_CHECK_EQUAL(calc_auc(outputs, vector<int>({ 1, 1, 0, 0 }), 0, 1),
+                      1.0);
+
+    // 3 of the 4 pairs are in the right order
+    BOOST_CHECK_CLOSE(calc_auc(outputs, vector<int>({ 0, 1, 0, 1 }), 0, 1),
+                      0.25, 1e-5);
+
+    // A tie counts as half
+    vector<float> tied = { 0.1, 0.1 };
+    BOOST_CHECK_CLOSE(calc_auc(tied, vector<int>({ 0, 1 }), 0, 1),
+                      0.5, 1e-5);
+
+    JML_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(calc_auc(outputs, vector<int>({ 0, 1, 2, 1 }), 0, 1),
+                      ML::Exception);
+}
+
+namespace {
+
+vector<AUC_Entry> random_entries(int n, int num_values)
+{
+    boost::mt19937 rng(42);
+    boost::uniform_int<int> values(0, num_values - 1);
+    boost::variate_generator<boost::mt19937 &, boost::uniform_int<int> >
+        value(rng, values);
+
+    vector<AUC_Entry> result;
+    for (unsigned i = 0;  i < n;  ++i) {
+        int v = value();
+        // Higher values are a bit more likely to be positive
+        bool target = value() < (v + num_values) / 2;
+        result.push_back(AUC_Entry((v + 0.5) / num_values, target,
+                                   1 + i % 3));
+    }
+
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_parallel_auc )
+{
+    // Few distinct values, so there are lots of long runs of ties
+    for (int num_values: { 10, 1000, 1000000 }) {
+        vector<AUC_Entry> entries = random_entries(300000, num_values);
+        vector<AUC_Entry> entries2 = entries;
+
+        double serial = do_calc_auc(entries);
+        double parallel = do_calc_auc_parallel(entries2);
+
+        BOOST_CHECK_CLOSE(serial, parallel, 1e-8);
+        BOOST_CHECK_GT(serial, 0.0);
+        BOOST_CHECK_LT(serial, 0.5);
+
+        for (unsigned i = 1;  i < entries2.size();  ++i)
+            BOOST_REQUIRE(entries2[i - 1].model <= entries2[i].model);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_auc_histogram )
+{
+    // With every value in its own bucket, the histogram is exact
+    int num_values = 1000;
+    vector<AUC_Entry> entries = random_entries(100000, num_values);
+
+    AUC_Histogram histogram(0.0, 1.0, num_values);
+    AUC_Histogram half1(0.0, 1.0, num_values), half2(0.0, 1.0, num_values);
+    for (unsigned i = 0;  i < entries.size();  ++i) {
+        // The exact version doesn't count the weights
+        histogram.add(entries[i].model, entries[i].target);
+        (i % 2 ? half1 : half2).add(entries[i].model, entries[i].target);
+    }
+    half1.add(half2);
+
+    double exact = do_calc_auc(entries);
+    BOOST_CHECK_CLOSE(histogram.calc_auc(), exact, 1e-4);
+    BOOST_CHECK_CLOSE(half1.calc_auc(), histogram.calc_auc(), 1e-8);
+    BOOST_CHECK_EQUAL(histogram.total_pos() + histogram.total_neg(),
+                      entries.size());
+
+    // Fewer buckets are close
+    AUC_Histogram coarse(0.0, 1.0, 100);
+    for (auto & e: entries)
+        coarse.add(e.model, e.target);
+    BOOST_CHECK_CLOSE(coarse.calc_auc(), exact, 2.0);
+
+    // Out of range values are clamped
+    AUC_Histogram clamped(0.25, 0.75, 10);
+    clamped.add(-10.0, false);
+    clamped.add(10.0, true);
+    BOOST_CHECK_EQUAL(clamped.calc_auc(), 0.0);
+
+    JML_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(half1.add(coarse), ML::Exception);
+    BOOST_CHECK_THROW(AUC_Histogram(1.0, 1.0), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_simd_two_norm )
+{
+    distribution<float> f(1001);
+    distribution<double> d(1001);
+    double total = 0.0;
+    for (unsigned i = 0;  i < f.size();  ++i) {
+        f[i] = d[i] = i * 0.5 - 100.0;
+        total += d[i] * d[i];
+    }
+
+    BOOST_CHECK_CLOSE(f.two_norm(), sqrt(total), 1e-6);
+    BOOST_CHECK_CLOSE(d.two_norm(), sqrt(total), 1e-10);
+}
@@ -21,6 +21,9 @@
 #include "jml/utils/parse_context.h"
 #include "jml/utils/filter_streams.h"
 #include "jml/utils/environment.h"
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/variate_generator.hpp>
 
 using namespace ML;
 using namespace std;
@@ -280,3 +283,61 @@ BOOST_AUTO_TEST_CASE( test_distance_to_probability_big )
     boost::multi_array<float, 2> reduction JML_UNUSED
         = tsne(probabilities, 2);
 }
+
+BOOST_AUTO_TEST_CASE( test_tsne_vectors_barnes_hut )
+{
+    // Three well separated clusters in 10 dimensions
+    int nc = 3, per_cluster = 200, nd = 10;
+    int nx = nc * per_cluster;
+
+    boost::mt19937 rng;
+    boost::normal_distribution<float> norm;
+    boost::variate_generator<boost::mt19937,
+                             boost::normal_distribution<float> >
+        randn(rng, norm);
+
+    boost::multi_array<float, 2> data(boost::extents[nx][nd]);
+    for (unsigned i = 0;  i < nx;  ++i)
+        for (unsigned j = 0;  j < nd;  ++j)
+            data[i][j] = randn() + (i / per_cluster == j ? 10.0 : 0.0);
+
+    for (double theta: { 0.0, 0.5 }) {
+        TSNE_Params params;
+        params.max_iter = 300;
+        params.theta = theta;
+
+        boost::multi_array<float, 2> reduction
+            = tsne_vectors(data, 2, params);
+
+        BOOST_REQUIRE_EQUAL(reduction.shape()[0], nx);
+        BOOST_REQUIRE_EQUAL(reduction.shape()[1], 2);
+
+        // The clusters should stay together and apart from each other
+        double intra = 0.0, inter = 0.0;
+        int num_intra = 0, num_inter = 0;
+        for (unsigned i = 0;  i < nx;  ++i) {
+            for (unsigned j = 0;  j < i;  ++j) {
+                double dist = sqrt(sqr(reduction[i][0] - reduction[j][0])
+                                   + sqr(reduction[i][1] - reduction[j][1]));
+                BOOST_REQUIRE(isfinite(dist));
+                if (i / per_cluster == j / per_cluster) {
+                    intra += dist;
+                    ++num_intra;
+                }
+                else {
+                    inter += dist;
+                    ++num_inter;
+                }
+            }
+        }
+
+        cerr << "theta " << theta << ": intra " << intra / num_intra
+             << " inter " << inter / num_inter << endl;
+        BOOST_CHECK_LT(intra / num_intra * 2.0, inter / num_inter);
+    }
+
+    // The tree only does up to 3 dimensions
+    TSNE_Params params;
+    params.max_iter = 1;
+    BOOST_CHECK_THROW(tsne_vectors(data, 4, params), ML::Exception);
+}
@@ -26,6 +26,8 @@
 #include "jml/utils/guard.h"
 #include <boost/bind.hpp>
 #include "jml/utils/environment.h"
+#include <queue>
+#include <numeric>
 
 using namespace std;
 
@@ -1173,4 +1175,654 @@ tsne(const boost::multi_array<float, 2> & probs,
     return Y;
 }
 
+/*****************************************************************************/
+/* BARNES-HUT T-SNE                                                          */
+/*****************************************************************************/
+
+namespace {
+
+/** Call fn(i0, i1) over chunks of [0, n) in multiple threads. */
+template<typename Fn>
+void run_in_chunks(int n, int chunk_size, const Fn & fn)
+{
+    int num_chunks = (n + chunk_size - 1) / chunk_size;
+
+    auto doChunk = [&] (int chunk)
+        {
+            int i0 = chunk * chunk_size;
+            fn(i0, std::min(n, i0 + chunk_size));
+        };
+
+    run_in_parallel(0, num_chunks, doChunk);
+}
+
+inline double sqr_distance(const float * x, const float * y, int d)
+{
+    double total = 0.0;
+    for (unsigned k = 0;  k < d;  ++k) {
+        float diff = x[k] - y[k];
+        total += diff * diff;
+    }
+    return total;
+}
+
+
+/*****************************************************************************/
+/* VANTAGE_POINT_TREE                                                        */
+/*****************************************************************************/
+
+/** Tree over the input points used to find their nearest neighbours.  Each
+    node splits its points into those inside and those outside of the
+    median distance from one of them (the vantage point), which works in
+    high dimensional spaces where a kd-tree wouldn't.
+*/
+
+struct Vantage_Point_Tree {
+
+    Vantage_Point_Tree(const boost::multi_array<float, 2> & X)
+        : X(X), n(X.shape()[0]), d(X.shape()[1]), items(n), distances(n)
+    {
+        std::iota(items.begin(), items.end(), 0);
+        nodes.reserve(n);
+        boost::mt19937 rng;
+        build(0, n, rng);
+    }
+
+    const boost::multi_array<float, 2> & X;
+    int n, d;
+
+    struct Node {
+        int item;
+        float radius;   ///< Median distance from the item
+        int inside;     ///< Node with points closer than radius; -1 if none
+        int outside;    ///< Node with the other points; -1 if none
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> items;
+    std::vector<float> distances;  ///< Scratch space for build()
+
+    float distance(int i, int j) const
+    {
+        return sqrt(sqr_distance(&X[i][0], &X[j][0], d));
+    }
+
+    int build(int lower, int upper, boost::mt19937 & rng)
+    {
+        if (lower == upper) return -1;
+
+        std::swap(items[lower], items[lower + rng() % (upper - lower)]);
+
+        int result = nodes.size();
+        Node node = { items[lower], 0.0, -1, -1 };
+        nodes.push_back(node);
+
+        if (upper - lower == 1) return result;
+
+        int vantage = items[lower];
+        for (int i = lower + 1;  i < upper;  ++i)
+            distances[items[i]] = distance(vantage, items[i]);
+
+        int median = (lower + 1 + upper) / 2;
+        std::nth_element(items.begin() + lower + 1, items.begin() + median,
+                         items.begin() + upper,
+                         [&] (int i, int j)
+                         {
+                             return distances[i] < distances[j];
+                         });
+        nodes[result].radius = distances[items[median]];
+
+        int inside = build(lower + 1, median, rng);
+        int outside = build(median, upper, rng);
+        nodes[result].inside = inside;
+        nodes[result].outside = outside;
+
+        return result;
+    }
+
+    typedef std::priority_queue<std::pair<float, int> > Heap;
+
+    /** Return the k nearest neighbours of point i, not including i itself,
+        as (distance, point) pairs in order of increasing distance. */
+    std::vector<std::pair<float, int> >
+    nearest(int i, int k) const
+    {
+        Heap heap;
+        float tau = INFINITY;
+        search(0, i, k, heap, tau);
+
+        std::vector<std::pair<float, int> > result(heap.size());
+        for (int j = result.size() - 1;  j >= 0;  --j) {
+            result[j] = heap.top();
+            heap.pop();
+        }
+        return result;
+    }
+
+    void search(int node, int target, int k, Heap & heap, float & tau) const
+    {
+        if (node == -1) return;
+
+        const Node & nd = nodes[node];
+        float dist = distance(nd.item, target);
+
+        if (nd.item != target && dist < tau) {
+            if (heap.size() == k) heap.pop();
+            heap.push(std::make_pair(dist, nd.item));
+            if (heap.size() == k) tau = heap.top().first;
+        }
+
+        // Search the side the target is on first, as it shrinks tau most
+        if (dist < nd.radius) {
+            if (dist - tau <= nd.radius)
+                search(nd.inside, target, k, heap, tau);
+            if (dist + tau >= nd.radius)
+                search(nd.outside, target, k, heap, tau);
+        }
+        else {
+            if (dist + tau >= nd.radius)
+                search(nd.outside, target, k, heap, tau);
+            if (dist - tau <= nd.radius)
+                search(nd.inside, target, k, heap, tau);
+        }
+    }
+};
+
+
+/*****************************************************************************/
+/* SPARSE_PROBS                                                              */
+/*****************************************************************************/
+
+/** Symmetric matrix of joint probabilities, in compressed sparse row form
+    with the columns of each row in ascending order. */
+
+struct Sparse_Probs {
+    std::vector<int> offsets;   ///< Row i is [offsets[i], offsets[i + 1])
+    std::vector<int> columns;
+    std::vector<float> values;
+};
+
+/** Calculate the sparse input probabilities from nearest neighbours.  This
+    does the same as distances_to_probabilities() followed by the
+    symmetrization in tsne(), but with only k neighbours per point. */
+Sparse_Probs
+sparse_probabilities(const boost::multi_array<float, 2> & X,
+                     double perplexity, double tolerance)
+{
+    int n = X.shape()[0];
+    int k = std::min<int>(n - 1, 3 * perplexity);
+
+    Vantage_Point_Tree tree(X);
+
+    // Conditional probabilities p_j|i, with k per row
+    std::vector<int> columns(n * k);
+    std::vector<float> values(n * k);
+
+    auto doRows = [&] (int i0, int i1)
+        {
+            for (int i = i0;  i < i1;  ++i) {
+                std::vector<std::pair<float, int> > neighbours
+                    = tree.nearest(i, k);
+                if (neighbours.size() != k)
+                    throw Exception("wrong number of neighbours");
+
+                /* Scaling the distances by the largest doesn't change the
+                   probabilities, but stops the search starting out with all
+                   of them underflowing. */
+                distribution<float> D_row(k);
+                for (unsigned j = 0;  j < k;  ++j)
+                    D_row[j] = neighbours[j].first * neighbours[j].first;
+                if (D_row.back() > 0.0) D_row /= D_row.back();
+
+                distribution<float> P_row;
+                try {
+                    double beta;
+                    boost::tie(P_row, beta)
+                        = binary_search_perplexity(D_row, perplexity, -1,
+                                                   tolerance);
+                } catch (const std::exception & exc) {
+                    P_row = distribution<float>(k, 1.0 / k);
+                }
+
+                /* Columns in order, for the symmetrization */
+                std::vector<std::pair<int, float> > row(k);
+                for (unsigned j = 0;  j < k;  ++j)
+                    row[j] = std::make_pair(neighbours[j].second, P_row[j]);
+                std::sort(row.begin(), row.end());
+
+                for (unsigned j = 0;  j < k;  ++j) {
+                    columns[i * k + j] = row[j].first;
+                    values[i * k + j] = row[j].second;
+                }
+            }
+        };
+
+    run_in_chunks(n, 64, doRows);
+
+    /* Symmetrize, by merging each row with the same row of the transpose.
+       First we find the transpose, whose rows come out in order. */
+    std::vector<int> t_offsets(n + 1);
+    for (unsigned x = 0;  x < n * k;  ++x)
+        t_offsets[columns[x] + 1] += 1;
+    for (unsigned i = 0;  i < n;  ++i)
+        t_offsets[i + 1] += t_offsets[i];
+
+    std::vector<int> t_columns(n * k);
+    std::vector<float> t_values(n * k);
+    {
+        std::vector<int> t_pos(t_offsets.begin(), t_offsets.end() - 1);
+        for (unsigned i = 0;  i < n;  ++i) {
+            for (unsigned x = i * k;  x < (i + 1) * k;  ++x) {
+                int pos = t_pos[columns[x]]++;
+                t_columns[pos] = i;
+                t_values[pos] = values[x];
+            }
+        }
+    }
+
+    Sparse_Probs result;
+    result.offsets.resize(n + 1);
+    result.columns.reserve(2 * n * k);
+    result.values.reserve(2 * n * k);
+
+    double total = 0.0;
+
+    for (unsigned i = 0;  i < n;  ++i) {
+        int x = i * k, xe = (i + 1) * k;
+        int t = t_offsets[i], te = t_offsets[i + 1];
+
+        while (x < xe || t < te) {
+            int col;
+            float val;
+            if (t == te || (x < xe && columns[x] < t_columns[t])) {
+                col = columns[x];  val = values[x++];
+            }
+            else if (x == xe || t_columns[t] < columns[x]) {
+                col = t_columns[t];  val = t_values[t++];
+            }
+            else {
+                col = columns[x];  val = values[x++] + t_values[t++];
+            }
+
+            result.columns.push_back(col);
+            result.values.push_back(val);
+            total += val;
+        }
+
+        result.offsets[i + 1] = result.columns.size();
+    }
+
+    float factor = 1.0 / total;
+    for (unsigned x = 0;  x < result.values.size();  ++x)
+        result.values[x] *= factor;
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* BARNES_HUT_TREE                                                           */
+/*****************************************************************************/
+
+/** Tree over the output points that's used to approximate the repulsive
+    forces between them.  Each cell is split into 2^d equal sub-cells (a
+    quadtree in two dimensions) until each leaf contains only one point.
+*/
+
+struct Barnes_Hut_Tree {
+
+    enum {
+        MAX_DIMS = 3,
+        MAX_DEPTH = 32   ///< Points closer than this are merged together
+    };
+
+    struct Node {
+        float center[MAX_DIMS];  ///< Center of the cell
+        float half[MAX_DIMS];    ///< Half the width of the cell
+        float com[MAX_DIMS];     ///< Center of mass of its points
+        float size;              ///< Largest width of the cell
+        int count;               ///< Number of points in the cell
+        int point;               ///< Point in a leaf, or -1
+        int first_child;         ///< -1 for a leaf
+    };
+
+    Barnes_Hut_Tree(const boost::multi_array<float, 2> & Y)
+        : Y(Y), n(Y.shape()[0]), d(Y.shape()[1]), num_children(1 << d)
+    {
+        if (d < 1 || d > MAX_DIMS)
+            throw Exception("Barnes-Hut t-SNE needs 1 to 3 dimensions");
+
+        Node root = empty_node();
+        for (unsigned k = 0;  k < d;  ++k) {
+            float minv = INFINITY, maxv = -INFINITY;
+            for (unsigned i = 0;  i < n;  ++i) {
+                minv = std::min(minv, Y[i][k]);
+                maxv = std::max(maxv, Y[i][k]);
+            }
+            root.center[k] = 0.5f * (minv + maxv);
+            root.half[k] = 0.5f * (maxv - minv) + 1e-5f;
+            root.size = std::max(root.size, 2.0f * root.half[k]);
+        }
+
+        nodes.reserve(2 * n);
+        nodes.push_back(root);
+
+        for (unsigned i = 0;  i < n;  ++i)
+            insert(i);
+
+        for (unsigned i = 0;  i < nodes.size();  ++i) {
+            Node & node = nodes[i];
+            if (node.count == 0) continue;
+            for (unsigned k = 0;  k < d;  ++k)
+                node.com[k] /= node.count;
+        }
+    }
+
+    const boost::multi_array<float, 2> & Y;
+    int n, d, num_children;
+    std::vector<Node> nodes;
+
+    Node empty_node() const
+    {
+        Node result;
+        std::fill(result.center, result.center + MAX_DIMS, 0.0f);
+        std::fill(result.half, result.half + MAX_DIMS, 0.0f);
+        std::fill(result.com, result.com + MAX_DIMS, 0.0f);
+        result.size = 0.0f;
+        result.count = 0;
+        result.point = -1;
+        result.first_child = -1;
+        return result;
+    }
+
+    int child_for(const Node & node, const float * y) const
+    {
+        int result = 0;
+        for (unsigned k = 0;  k < d;  ++k)
+            if (y[k] > node.center[k]) result |= (1 << k);
+        return node.first_child + result;
+    }
+
+    /* Split a leaf into its children, moving its points into one of them */
+    void subdivide(int index)
+    {
+        int first_child = nodes.size();
+
+        for (unsigned c = 0;  c < num_children;  ++c) {
+            const Node & parent = nodes[index];
+            Node child = empty_node();
+            for (unsigned k = 0;  k < d;  ++k) {
+                child.half[k] = 0.5f * parent.half[k];
+                child.center[k] = parent.center[k]
+                    + ((c & (1 << k)) ? child.half[k] : -child.half[k]);
+                child.size = std::max(child.size, 2.0f * child.half[k]);
+            }
+            nodes.push_back(child);
+        }
+
+        Node & node = nodes[index];
+        node.first_child = first_child;
+
+        Node & child = nodes[child_for(node, &Y[node.point][0])];
+        child.count = node.count;
+        child.point = node.point;
+        std::copy(node.com, node.com + d, child.com);  // still a sum
+
+        node.point = -1;
+    }
+
+    void insert(int i)
+    {
+        const float * y = &Y[i][0];
+
+        for (int index = 0, depth = 0;  ;  ++depth) {
+            if (nodes[index].first_child == -1) {
+                Node & node = nodes[index];
+                bool same = (node.count > 0
+                             && sqr_distance(&Y[node.point][0], y, d) == 0.0);
+
+                if (node.count == 0 || same || depth == MAX_DEPTH) {
+                    if (node.count == 0) node.point = i;
+                    node.count += 1;
+                    for (unsigned k = 0;  k < d;  ++k)
+                        node.com[k] += y[k];
+                    return;
+                }
+
+                subdivide(index);
+            }
+
+            Node & node = nodes[index];
+            node.count += 1;
+            for (unsigned k = 0;  k < d;  ++k)
+                node.com[k] += y[k];
+
+            index = child_for(node, y);
+        }
+    }
+
+    /** Accumulate the repulsive force on the point at y (which is one of
+        the points in the tree) from all of the others, before being
+        normalized by Z, along with its contribution to Z.
+
+                                      2
+        force += sum_j (1 + ||y - y_j|| )^-2 (y - y_j)
+
+                                      2
+        sum_q += sum_j (1 + ||y - y_j|| )^-1
+    */
+    void repulsion(int index, const float * y, float theta_sqr,
+                   double & sum_q, double * force) const
+    {
+        const Node & node = nodes[index];
+        if (node.count == 0) return;
+
+        double diff[MAX_DIMS];
+        double D = 0.0;
+        for (unsigned k = 0;  k < d;  ++k) {
+            diff[k] = y[k] - node.com[k];
+            D += diff[k] * diff[k];
+        }
+
+        bool leaf = (node.first_child == -1);
+
+        if (leaf || node.size * node.size < theta_sqr * D) {
+            // A leaf at distance zero contains the point itself
+            int count = node.count - (leaf && D == 0.0);
+            double q = 1.0 / (1.0 + D);
+            sum_q += count * q;
+            double mult = count * q * q;
+            for (unsigned k = 0;  k < d;  ++k)
+                force[k] += mult * diff[k];
+            return;
+        }
+
+        for (unsigned c = 0;  c < num_children;  ++c)
+            repulsion(node.first_child + c, y, theta_sqr, sum_q, force);
+    }
+};
+
+/** Calculate the gradient for Barnes-Hut t-SNE, and the cost if asked.  dY
+    is the same as tsne_calc_gradient() with the stiffness for the exact
+    version:
+
+    dC/dy_i = 4 * sum_j ( p_ij q_ij Z (y_i - y_j) - q_ij^2 Z (y_i - y_j) )
+
+    where the first (attractive) part is over the non-zero entries of P and
+    the second (repulsive) part uses the tree.
+*/
+double tsne_calc_gradient_bh(boost::multi_array<float, 2> & dY,
+                             const boost::multi_array<float, 2> & Y,
+                             const Sparse_Probs & P,
+                             float theta,
+                             bool calc_cost)
+{
+    int n = Y.shape()[0];
+    int d = Y.shape()[1];
+
+    Barnes_Hut_Tree tree(Y);
+
+    boost::multi_array<float, 2> repulsive(boost::extents[n][d]);
+    std::vector<double> sum_q(n), row_costs(n), row_totals(n);
+
+    float theta_sqr = theta * theta;
+
+    auto doRows = [&] (int i0, int i1)
+        {
+            double attr[Barnes_Hut_Tree::MAX_DIMS];
+            double rep[Barnes_Hut_Tree::MAX_DIMS];
+
+            for (int i = i0;  i < i1;  ++i) {
+                const float * yi = &Y[i][0];
+
+                std::fill(attr, attr + d, 0.0);
+                double cost = 0.0, total = 0.0;
+
+                for (int x = P.offsets[i];  x < P.offsets[i + 1];  ++x) {
+                    const float * yj = &Y[P.columns[x]][0];
+                    float p = P.values[x];
+                    double q = 1.0 / (1.0 + sqr_distance(yi, yj, d));
+                    for (unsigned k = 0;  k < d;  ++k)
+                        attr[k] += p * q * (yi[k] - yj[k]);
+                    if (calc_cost) {
+                        cost += p * log(std::max<double>(p, 1e-12) / q);
+                        total += p;
+                    }
+                }
+
+                std::fill(rep, rep + d, 0.0);
+                double sq = 0.0;
+                tree.repulsion(0, yi, theta_sqr, sq, rep);
+
+                for (unsigned k = 0;  k < d;  ++k) {
+                    dY[i][k] = attr[k];
+                    repulsive[i][k] = rep[k];
+                }
+                sum_q[i] = sq;
+                row_costs[i] = cost;
+                row_totals[i] = total;
+            }
+        };
+
+    run_in_chunks(n, 64, doRows);
+
+    double Z = std::accumulate(sum_q.begin(), sum_q.end(), 0.0);
+    float Z_recip = 1.0 / Z;
+
+    for (unsigned i = 0;  i < n;  ++i)
+        for (unsigned k = 0;  k < d;  ++k)
+            dY[i][k] = 4.0f * (dY[i][k] - repulsive[i][k] * Z_recip);
+
+    if (!calc_cost) return 0.0;
+
+    // q_ij = q'_ij / Z, so log(p / q) = log(p / q') + log(Z)
+    double cost = std::accumulate(row_costs.begin(), row_costs.end(), 0.0);
+    double total = std::accumulate(row_totals.begin(), row_totals.end(), 0.0);
+    return cost + total * log(Z);
+}
+
+} // file scope
+
+boost::multi_array<float, 2>
+tsne_vectors(const boost::multi_array<float, 2> & coords,
+             int num_dims,
+             const TSNE_Params & params,
+             const TSNE_Callback & callback)
+{
+    if (params.theta <= 0.0) {
+        int n = coords.shape()[0];
+        boost::multi_array<float, 2> D(boost::extents[n][n]);
+        vectors_to_distances(coords, D);
+        boost::multi_array<float, 2> P
+            = distances_to_probabilities(D, params.tolerance,
+                                         params.perplexity);
+        return tsne(P, num_dims, params, callback);
+    }
+
+    int n = coords.shape()[0];
+    int d = num_dims;
+
+    if (n < 2)
+        throw Exception("tsne_vectors(): need at least two points");
+    if (d < 1 || d > Barnes_Hut_Tree::MAX_DIMS)
+        throw Exception("tsne_vectors(): Barnes-Hut t-SNE needs 1 to 3 "
+                        "dimensions; use theta = 0 for more");
+
+    boost::timer t;
+
+    Sparse_Probs P
+        = sparse_probabilities(coords, params.perplexity, params.tolerance);
+
+    cerr << "calculated " << P.values.size() << " input probabilities in "
+         << t.elapsed() << "s" << endl;
+
+    boost::mt19937 rng;
+    boost::normal_distribution<float> norm;
+
+    boost::variate_generator<boost::mt19937,
+                             boost::normal_distribution<float> >
+        randn(rng, norm);
+
+    boost::multi_array<float, 2> Y(boost::extents[n][d]);
+    for (unsigned i = 0;  i < n;  ++i)
+        for (unsigned j = 0;  j < d;  ++j)
+            Y[i][j] = 0.01 * randn();
+
+    // We boost P by 4 in early iterations to force the clusters to be
+    // spread apart, as for tsne()
+    for (unsigned x = 0;  x < P.values.size();  ++x)
+        P.values[x] = std::max(4.0f * P.values[x], 1e-12f);
+
+    Timer timer;
+
+    boost::multi_array<float, 2> dY(boost::extents[n][d]);
+    boost::multi_array<float, 2> iY(boost::extents[n][d]);
+    boost::multi_array<float, 2> gains(boost::extents[n][d]);
+    std::fill(gains.data(), gains.data() + gains.num_elements(), 1.0f);
+
+    if (callback
+        && !callback(-1, INFINITY, "init")) return Y;
+
+    for (int iter = 0;  iter < params.max_iter;  ++iter) {
+
+        bool calc_cost = (iter + 1) % 100 == 0 || iter == params.max_iter - 1;
+
+        double cost = tsne_calc_gradient_bh(dY, Y, P, params.theta,
+                                            calc_cost);
+
+        if (callback
+            && !callback(iter, INFINITY, "gradient")) return Y;
+
+        float momentum = (iter < 20
+                          ? params.initial_momentum
+                          : params.final_momentum);
+
+        tsne_update(Y, dY, iY, gains, iter == 0, momentum, params.eta,
+                    params.min_gain);
+
+        if (callback
+            && !callback(iter, INFINITY, "update")) return Y;
+
+        recenter_about_origin(Y);
+
+        if (callback
+            && !callback(iter, INFINITY, "recenter")) return Y;
+
+        if (calc_cost) {
+            cerr << format("iteration %4d cost %6.3f  ",
+                           iter + 1, cost)
+                 << timer.elapsed() << endl;
+            timer.restart();
+        }
+
+        // Stop lying about P values if we're finished
+        if (iter == 100) {
+            for (unsigned x = 0;  x < P.values.size();  ++x)
+                P.values[x] *= 0.25f;
+        }
+    }
+
+    return Y;
+}
+
 } // namespace ML
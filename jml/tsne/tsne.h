@@ -100,7 +100,10 @@ struct TSNE_Params {
           final_momentum(0.8),
           eta(500),
           min_gain(0.01),
-          min_prob(1e-12)
+          min_prob(1e-12),
+          perplexity(30.0),
+          tolerance(1e-5),
+          theta(0.5)
     {
     }
 
@@ -110,6 +113,11 @@ struct TSNE_Params {
     double eta;
     double min_gain;
     double min_prob;
+
+    /** The following are only used by tsne_vectors(). */
+    double perplexity;   ///< Perplexity of the input probabilities
+    double tolerance;    ///< Tolerance of the perplexity search
+    double theta;        ///< Barnes-Hut accuracy; 0 = exact
 };
 
 // Function that will be used as a callback to provide progress to a calling
@@ -129,6 +137,30 @@ tsne(const boost::multi_array<float, 2> & probs,
      const TSNE_Params & params = TSNE_Params(),
      const TSNE_Callback & callback = TSNE_Callback());
 
+/** Run t-SNE directly on a (n x d) matrix of coordinates, returning a
+    (n x num_dims) matrix.
+
+    If params.theta is zero, this is the same as calling
+    vectors_to_distances(), distances_to_probabilities() and tsne(), which
+    takes O(n^2) time and memory and so is only feasible up to a few
+    thousand points.
+
+    Otherwise the Barnes-Hut approximation is used (L.J.P. van der Maaten.
+    Accelerating t-SNE using Tree-Based Algorithms.  JMLR 15:3221-3245,
+    2014): the input probabilities are only calculated between each point
+    and its 3 * perplexity nearest neighbours, found with a vantage point
+    tree, and the repulsive forces between the output points are
+    approximated using a quadtree (octree in 3 dimensions) over them, with
+    cells whose size over distance is less than theta being treated as a
+    single point.  This takes O(n log n) time per iteration and O(n)
+    memory.  Only num_dims of 1 to 3 is supported in this case.
+*/
+boost::multi_array<float, 2>
+tsne_vectors(const boost::multi_array<float, 2> & coords,
+             int num_dims = 2,
+             const TSNE_Params & params = TSNE_Params(),
+             const TSNE_Callback & callback = TSNE_Callback());
+
 
 } // namespace ML
 
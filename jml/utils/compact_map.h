@@ -0,0 +1,203 @@
+/* compact_map.h                                                   -*- C++ -*-
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+   A map for a handful of entries, kept as a sorted compact_vector of pairs.
+   Up to Internal entries are stored inline without any allocation, and
+   lookups are a binary search over contiguous memory instead of a walk
+   through tree nodes.
+
+   Conforms to the commonly used parts of the interface of std::map.  Unlike
+   std::map, inserting or erasing invalidates iterators and references and
+   the keys are not const; they must not be modified through an iterator.
+*/
+
+#ifndef __utils__compact_map_h__
+#define __utils__compact_map_h__
+
+#include "jml/utils/compact_vector.h"
+#include "jml/db/persistent_fwd.h"
+#include <functional>
+#include <stdexcept>
+
+namespace ML {
+
+template<typename Key,
+         typename Value,
+         size_t Internal = 0,
+         class Compare = std::less<Key> >
+class compact_map {
+    typedef compact_vector<std::pair<Key, Value>, Internal> Entries;
+
+public:
+    typedef Key key_type;
+    typedef Value mapped_type;
+    typedef std::pair<Key, Value> value_type;
+    typedef typename Entries::iterator iterator;
+    typedef typename Entries::const_iterator const_iterator;
+    typedef typename Entries::size_type size_type;
+    typedef Compare key_compare;
+
+    compact_map()
+    {
+    }
+
+    template<class InputIterator>
+    compact_map(InputIterator first, InputIterator last)
+    {
+        insert(first, last);
+    }
+
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+
+    size_type size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    void clear() { entries.clear(); }
+
+    void swap(compact_map & other) { entries.swap(other.entries); }
+
+    iterator lower_bound(const Key & key)
+    {
+        return std::lower_bound(begin(), end(), key, KeyLess());
+    }
+
+    const_iterator lower_bound(const Key & key) const
+    {
+        return std::lower_bound(begin(), end(), key, KeyLess());
+    }
+
+    iterator find(const Key & key)
+    {
+        iterator it = lower_bound(key);
+        if (it != end() && !Compare()(key, it->first))
+            return it;
+        return end();
+    }
+
+    const_iterator find(const Key & key) const
+    {
+        const_iterator it = lower_bound(key);
+        if (it != end() && !Compare()(key, it->first))
+            return it;
+        return end();
+    }
+
+    size_type count(const Key & key) const
+    {
+        return find(key) != end();
+    }
+
+    Value & at(const Key & key)
+    {
+        iterator it = find(key);
+        if (it == end())
+            throw std::out_of_range("compact_map::at");
+        return it->second;
+    }
+
+    const Value & at(const Key & key) const
+    {
+        const_iterator it = find(key);
+        if (it == end())
+            throw std::out_of_range("compact_map::at");
+        return it->second;
+    }
+
+    Value & operator [] (const Key & key)
+    {
+        iterator it = lower_bound(key);
+        if (it == end() || Compare()(key, it->first))
+            it = entries.insert(it, value_type(key, Value()));
+        return it->second;
+    }
+
+    std::pair<iterator, bool> insert(const value_type & val)
+    {
+        iterator it = lower_bound(val.first);
+        if (it != end() && !Compare()(val.first, it->first))
+            return std::make_pair(it, false);
+        return std::make_pair(entries.insert(it, val), true);
+    }
+
+    template<class InputIterator>
+    void insert(InputIterator first, InputIterator last)
+    {
+        for (; first != last;  ++first)
+            insert(*first);
+    }
+
+    iterator erase(iterator pos)
+    {
+        return entries.erase(pos);
+    }
+
+    size_type erase(const Key & key)
+    {
+        iterator it = find(key);
+        if (it == end())
+            return 0;
+        entries.erase(it);
+        return 1;
+    }
+
+    bool operator == (const compact_map & other) const
+    {
+        return entries == other.entries;
+    }
+
+    bool operator != (const compact_map & other) const
+    {
+        return !(entries == other.entries);
+    }
+
+    bool operator < (const compact_map & other) const
+    {
+        return entries < other.entries;
+    }
+
+private:
+    struct KeyLess {
+        bool operator () (const value_type & val, const Key & key) const
+        {
+            return Compare()(val.first, key);
+        }
+    };
+
+    Entries entries;
+};
+
+/* Serialized in the same format as a std::map. */
+
+template<typename K, typename V, size_t I, class C>
+inline ML::DB::Store_Writer &
+operator << (ML::DB::Store_Writer & store, const compact_map<K, V, I, C> & m)
+{
+    DB::serialize_compact_size(store, m.size());
+    for (auto it = m.begin(), end = m.end();  it != end;  ++it)
+        store << it->first << it->second;
+    return store;
+}
+
+template<typename K, typename V, size_t I, class C>
+inline ML::DB::Store_Reader &
+operator >> (ML::DB::Store_Reader & store, compact_map<K, V, I, C> & m)
+{
+    unsigned long long sz = DB::reconstitute_compact_size(store);
+
+    compact_map<K, V, I, C> result;
+    for (unsigned i = 0;  i < sz;  ++i) {
+        K k;
+        V v;
+        store >> k >> v;
+        result.insert(std::make_pair(k, v));
+    }
+    m.swap(result);
+    return store;
+}
+
+} // namespace ML
+
+#endif /* __utils__compact_map_h__ */
@@ -7,7 +7,14 @@
 
 #include "csv.h"
 #include "parse_context.h"
+#include "filter_streams.h"
 #include "jml/arch/format.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/cpu_info.h"
+#include <deque>
+#include <future>
+#include <string.h>
+#include <stdint.h>
 
 using namespace std;
 
@@ -125,4 +132,267 @@ std::string csv_escape(const std::string & s)
     return result;
 }
 
+
+namespace {
+
+/** Finds the first of four characters in a buffer, eight bytes at a time,
+    which is what a SIMD comparison would do for the few characters that
+    end a CSV field, without needing anything but 64 bit integers.  The
+    characters don't need to be different.
+*/
+struct Csv_Scanner {
+    Csv_Scanner(char c1, char c2, char c3, char c4)
+        : c1(c1), c2(c2), c3(c3), c4(c4),
+          w1(ONES * (uint8_t)c1), w2(ONES * (uint8_t)c2),
+          w3(ONES * (uint8_t)c3), w4(ONES * (uint8_t)c4)
+    {
+    }
+
+    static const uint64_t ONES = 0x0101010101010101ULL;
+    static const uint64_t HIGHS = 0x8080808080808080ULL;
+
+    /** High bit set in the bytes which are zero.  There can be false
+        positives, but only in the bytes after a true one, and the first
+        one is all that's used. */
+    static uint64_t zero_bytes(uint64_t v)
+    {
+        return (v - ONES) & ~v & HIGHS;
+    }
+
+    const char * find(const char * p, const char * e) const
+    {
+        for (;  e - p >= 8;  p += 8) {
+            uint64_t w;
+            memcpy(&w, p, 8);
+            uint64_t found = zero_bytes(w ^ w1) | zero_bytes(w ^ w2)
+                | zero_bytes(w ^ w3) | zero_bytes(w ^ w4);
+            if (found)  // first byte in memory is the lowest (little endian)
+                return p + (__builtin_ctzll(found) >> 3);
+        }
+
+        for (;  p < e;  ++p) {
+            char c = *p;
+            if (c == c1 || c == c2 || c == c3 || c == c4)
+                return p;
+        }
+
+        return e;
+    }
+
+    char c1, c2, c3, c4;
+    uint64_t w1, w2, w3, w4;
+};
+
+/** Parse a field starting at p, leaving p at the separator or the line
+    ending that finishes it (after the separator, in which case another is
+    set).  Returns an error message, or null if there was none. */
+const char *
+parse_csv_field(const char * & p, const char * e, const Csv_Scanner & scanner,
+                char separator, std::string & field, bool & another)
+{
+    another = false;
+
+    if (p == e || *p != '\"') {
+        const char * f = scanner.find(p, e);
+        field.assign(p, f);
+        p = f;
+        if (p == e)
+            return 0;
+        if (*p == '\"')
+            return "non-quoted string with embedded quote";
+        if (*p == separator) {
+            another = true;
+            ++p;
+        }
+        return 0;
+    }
+
+    for (++p;;) {
+        const char * q = (const char *)memchr(p, '\"', e - p);
+        if (!q)
+            return "file finished inside quote";
+        field.append(p, q);
+        p = q + 1;
+
+        if (p != e && *p == '\"') {
+            field += '\"';
+            ++p;
+            continue;
+        }
+
+        if (p == e || *p == '\n' || *p == '\r')
+            return 0;
+        if (*p == separator) {
+            another = true;
+            ++p;
+            return 0;
+        }
+        return "invalid end of line";
+    }
+}
+
+/** Offset just after the last line ending in the data that isn't within
+    quotes, or 0 if there is none.  A '\n' that is followed by a '\r' isn't
+    used, since whether the '\r' is part of the line ending depends on what
+    came before. */
+size_t find_csv_record_boundary(const char * start, const char * end)
+{
+    static const Csv_Scanner scanner('\"', '\"', '\n', '\n');
+
+    const char * result = start;
+    bool quoted = false;
+
+    for (const char * p = start;  ;  ++p) {
+        p = scanner.find(p, end);
+        if (p == end)
+            break;
+        if (*p == '\"')
+            quoted = !quoted;
+        else if (!quoted && p + 1 != end && p[1] != '\r')
+            result = p + 1;
+    }
+
+    return result - start;
+}
+
+/** Rows parsed from a chunk, and the error which finished it, if any. */
+struct Csv_Chunk {
+    std::vector<std::vector<std::string> > rows;
+    std::string error;
+};
+
+Csv_Chunk parse_csv_chunk(const std::string & data, char separator)
+{
+    Csv_Chunk result;
+    result.error = parse_csv_rows(data.c_str(), data.c_str() + data.size(),
+                                  result.rows, separator);
+    return result;
+}
+
+} // file scope
+
+std::string
+parse_csv_rows(const char * start, const char * end,
+               std::vector<std::vector<std::string> > & rows,
+               char separator)
+{
+    Csv_Scanner scanner(separator, '\"', '\n', '\r');
+
+    const char * p = start;
+    while (p != end) {
+        while (p != end && (*p == ' ' || *p == '\t'))
+            ++p;
+
+        rows.emplace_back();
+        std::vector<std::string> & row = rows.back();
+
+        bool another = false;
+        for (;;) {
+            if (!another) {
+                if (p == end)
+                    break;
+                if (*p == '\n') {
+                    if (++p != end && *p == '\r')
+                        ++p;
+                    break;
+                }
+                if (*p == '\r') {
+                    if (++p != end && *p == '\n')
+                        ++p;
+                    break;
+                }
+            }
+
+            row.emplace_back();
+            const char * error
+                = parse_csv_field(p, end, scanner, separator, row.back(),
+                                  another);
+            if (error) {
+                rows.pop_back();
+                return error;
+            }
+        }
+    }
+
+    return "";
+}
+
+void for_each_csv_row(std::istream & stream,
+                      const Csv_Row_Handler & on_row,
+                      char separator,
+                      int num_threads,
+                      size_t chunk_size)
+{
+    if (num_threads == -1)
+        num_threads = num_cpus();
+    num_threads = std::max(num_threads, 1);
+    chunk_size = std::max<size_t>(chunk_size, 1);
+
+    std::deque<std::future<Csv_Chunk> > jobs;
+    std::string pending;   ///< Data read after the last record boundary
+    size_t row_num = 0;
+
+    auto deliver = [&] (Csv_Chunk chunk)
+        {
+            for (auto & row: chunk.rows)
+                on_row(row, row_num++);
+            if (!chunk.error.empty())
+                throw Exception("CSV row %zd: %s", row_num,
+                                chunk.error.c_str());
+        };
+
+    while (!jobs.empty() || stream) {
+        while (jobs.size() < (size_t)num_threads && stream) {
+            size_t done = pending.size();
+            pending.resize(done + chunk_size);
+            stream.read(&pending[done], chunk_size);
+            pending.resize(done + stream.gcount());
+
+            if (stream.bad())
+                throw Exception("error reading CSV stream");
+
+            size_t boundary = stream
+                ? find_csv_record_boundary(pending.c_str(),
+                                           pending.c_str() + pending.size())
+                : pending.size();
+            if (boundary == 0)
+                continue;  // a row longer than the chunk; read more of it
+
+            std::string data(pending, 0, boundary);
+            pending.erase(0, boundary);
+
+            if (num_threads == 1) {
+                deliver(parse_csv_chunk(data, separator));
+                continue;
+            }
+
+            jobs.emplace_back(std::async(std::launch::async, &parse_csv_chunk,
+                                         std::move(data), separator));
+        }
+
+        if (jobs.empty())
+            break;
+
+        Csv_Chunk chunk = jobs.front().get();
+        jobs.pop_front();
+        deliver(std::move(chunk));
+    }
+}
+
+void for_each_csv_row(const std::string & filename,
+                      const Csv_Row_Handler & on_row,
+                      char separator,
+                      int num_threads,
+                      size_t chunk_size)
+{
+    if (num_threads == -1)
+        num_threads = num_cpus();
+
+    std::map<std::string, std::string> options;
+    options["num-threads"] = format("%d", std::max(num_threads, 1));
+
+    filter_istream stream(filename, options);
+    for_each_csv_row(stream, on_row, separator, num_threads, chunk_size);
+}
+
 } // namespace ML
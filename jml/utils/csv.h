@@ -8,6 +8,8 @@
 #ifndef __utils__csv_h__
 #define __utils__csv_h__
 
+#include <functional>
+#include <iosfwd>
 #include <string>
 #include <vector>
 
@@ -30,6 +32,52 @@ expect_csv_row(Parse_Context & context, int length = -1, char separator = ',');
     needs to be escaped. */
 std::string csv_escape(const std::string & s);
 
+/** Parse all of the rows of CSV between start and end, appending them to
+    rows.  The rows are the same as those that expect_csv_row() would give
+    when called until the end of the data, except that a line ending with
+    a lone '\r' is accepted.
+
+    Errors are returned as a message rather than thrown, and the rows before
+    the one in error are kept.
+*/
+std::string parse_csv_rows(const char * start, const char * end,
+                           std::vector<std::vector<std::string> > & rows,
+                           char separator = ',');
+
+/** Called for each row, with its number in the file starting at 0.  The
+    row can be swapped out. */
+typedef std::function<void (std::vector<std::string> & row, size_t row_num)>
+    Csv_Row_Handler;
+
+/** Read all of the CSV rows in the stream and call on_row for each of them,
+    in order and on the calling thread.
+
+    The stream is read on the calling thread in chunks of about chunk_size
+    bytes, which are cut after the last line ending that isn't inside a
+    quoted field, and up to num_threads chunks are parsed at the same time
+    with parse_csv_rows().  If num_threads is -1, one thread per CPU is
+    used; if it is 1, everything is done on the calling thread.
+
+    An ML::Exception with the number of the row is thrown for the first
+    error, after the rows before it have been handled.
+*/
+void for_each_csv_row(std::istream & stream,
+                      const Csv_Row_Handler & on_row,
+                      char separator = ',',
+                      int num_threads = -1,
+                      size_t chunk_size = 4 * 1024 * 1024);
+
+/** Same, but reading the file (or any other URI) with a filter_istream,
+    which decompresses it if needed.  The num-threads option of the
+    filter_istream is set to num_threads too, so that lz4 files and gzip
+    files with several members are also decompressed in parallel.
+*/
+void for_each_csv_row(const std::string & filename,
+                      const Csv_Row_Handler & on_row,
+                      char separator = ',',
+                      int num_threads = -1,
+                      size_t chunk_size = 4 * 1024 * 1024);
+
 } // namespace ML
 
 
@@ -25,12 +25,13 @@
 
 
 #include "jml/utils/parse_context.h"
+#include "jml/utils/fast_int_parsing.h"
 #include <limits>
 #include <errno.h>
 
 namespace ML {
 
-double binary_exp10 [10] = {
+static const double binary_exp10 [10] = {
     10,
     100,
     1e4,
@@ -43,7 +44,7 @@ double binary_exp10 [10] = {
     INFINITY
 };
 
-double binary_exp10_neg [10] = {
+static const double binary_exp10_neg [10] = {
     0.1,
     0.01,
     1e-4,
@@ -56,7 +57,7 @@ double binary_exp10_neg [10] = {
     0.0
 };
 
-double
+inline double
 exp10_int(int val)
 {
     double result = 1.0;
@@ -84,22 +85,37 @@ exp10_int(int val)
     return result;
 }
 
+/** Powers of ten that are exactly representable as doubles. */
+static const double exact_exp10 [23] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/** Parse a real number.
+
+    The digits are accumulated (eight at a time when possible) into a 64
+    bit mantissa.  When the mantissa fits exactly in a double and the power
+    of ten is one of exact_exp10, a single multiplication or division gives
+    the correctly rounded result (Clinger's fast path), which is what
+    strtod would return.  That covers prices and most other numbers that
+    are written by people or printed with a fixed precision; anything
+    else (more than 19 digits, or huge or tiny exponents) is handed to
+    strtod.
+*/
 template<typename Float>
 inline bool match_float(Float & result, Parse_Context & c)
 {
     Parse_Context::Revert_Token tok(c);
 
-    unsigned long num = 0;
-    unsigned long den2 = 0;
-    int den2_digits = 0;
-    double sign = 1;
-    int digits = 0;
+    bool negative = false;
 
     if (c.match_literal('+')) ;
-    else if (c.match_literal('-')) sign = -1.0;
+    else if (c.match_literal('-')) negative = true;
 
     if (c.eof()) return false;
 
+    double sign = negative ? -1.0 : 1.0;
+
     if (*c == 'n' || *c == 'N') {
         ++c;
         if (!c.match_literal("an") && !c.match_literal("aN"))
@@ -117,77 +133,67 @@ inline bool match_float(Float & result, Parse_Context & c)
         return true;
     }
 
-    while (c) {
-        //std::cerr << "got character " << *c << " num = " << num
-        //          << " den = " << den << " den2 = " << den2
-        //          << " sign = " << sign
-        //          << " digits = " << digits << std::endl;
-
-        if (isdigit(*c)) {
-            int digit = *c - '0';
-            if (digits <= 17) {
-                num = 10*num + digit;
-                den2 *= 10;
-                ++den2_digits;
-            }
-            ++digits;
-        }
-        else if (*c == '.') {
-            if (den2 != 0) break;
-            else {
-                den2 = 1;
-                den2_digits = 0;
-            }
-        }
-        else if (digits && (*c == 'e' || *c == 'E')) {
-            Parse_Context::Revert_Token token(c);
-            ++c;
-            if (c.match_literal('+'));
-            int expi;
-            if (c.match_int(expi)) {
-                sign *= exp10(expi);
-                token.ignore();
-            }
-            break;
-        }
-        else break;
+    uint64_t mantissa = 0;
+    unsigned digits = match_digits(mantissa, c);
+    unsigned fraction_digits = 0;
+
+    if (c && *c == '.') {
         ++c;
+        fraction_digits = match_digits(mantissa, c);
+        digits += fraction_digits;
     }
 
     if (!digits) return false;
 
-    if (digits > 15) {
-        // we need to parse using strtod since rounding bites us otherwise
-        size_t ofs = c.get_offset();
+    long exponent = -(long)fraction_digits;
 
-        // Go back
-        tok.apply();
+    if (c && (*c == 'e' || *c == 'E')) {
+        Parse_Context::Revert_Token token(c);
+        ++c;
+        if (c.match_literal('+'));
+        int expi;
+        if (c.match_int(expi)) {
+            exponent += expi;
+            token.ignore();
+        }
+    }
+
+    // 19 digits can't wrap around in 64 bits
+    if (digits <= 19 && mantissa <= (1ULL << 53)
+        && (mantissa == 0 || (exponent >= -22 && exponent <= 22))) {
+        double value = mantissa;
+        if (mantissa == 0) ;
+        else if (exponent < 0)
+            value /= exact_exp10[-exponent];
+        else value *= exact_exp10[exponent];
+
+        tok.ignore();  // we are returning true; ignore the token
+        result = negative ? -value : value;
+        return true;
+    }
 
-        size_t ofs0 = c.get_offset();
-        size_t nchars = ofs - ofs0;
-        
-        char buf[nchars + 1];
+    // we need to parse using strtod since rounding bites us otherwise
+    size_t ofs = c.get_offset();
 
-        for (unsigned i = 0;  i < nchars;  ++i)
-            buf[i] = *c++;
-        buf[nchars] = 0;
+    // Go back
+    tok.apply();
 
-        char * endptr;
-        double parsed = strtod(buf, &endptr);
+    size_t ofs0 = c.get_offset();
+    size_t nchars = ofs - ofs0;
 
-        if (endptr != buf + nchars)
-            throw Exception("wrong endptr");
+    char buf[nchars + 1];
 
-        result = parsed;
-        return true;
-    }
+    for (unsigned i = 0;  i < nchars;  ++i)
+        buf[i] = *c++;
+    buf[nchars] = 0;
 
+    char * endptr;
+    double parsed = strtod(buf, &endptr);
 
-    tok.ignore();  // we are returning true; ignore the token
- 
-    if (den2 == 0) result = sign * num;
-    else result = sign * (double)num / den2;
+    if (endptr != buf + nchars)
+        throw Exception("wrong endptr");
 
+    result = parsed;
     return true;
 }
 
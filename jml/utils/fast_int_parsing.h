@@ -25,30 +25,71 @@
 
 #include "jml/utils/parse_context.h"
 #include <iostream>
+#include <stdint.h>
+#include <string.h>
 
 using namespace std;
 
 
 namespace ML {
 
-inline bool match_unsigned(unsigned long & val, Parse_Context & c)
+/** True if the eight characters at p are all digits.  Digits are 0x30 to
+    0x39, so each byte must have 3 as its top half both before and after
+    adding 6. */
+JML_ALWAYS_INLINE bool is_eight_digits(const char * p)
 {
-    Parse_Context::Revert_Token tok(c);
+    uint64_t val;
+    memcpy(&val, p, 8);
+    return ((val & 0xF0F0F0F0F0F0F0F0ULL)
+            | (((val + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+        == 0x3333333333333333ULL;
+}
 
-    val = 0;
+/** Value of the eight digits at p, which must be digits.  The digits are
+    combined in pairs, then in fours and then all together, with three
+    multiplications rather than eight (the first character is the lowest
+    byte on our little endian machines). */
+JML_ALWAYS_INLINE uint32_t parse_eight_digits(const char * p)
+{
+    uint64_t val;
+    memcpy(&val, p, 8);
+    val = ((val & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+    val = ((val & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+    return ((val & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+}
+
+/** Accumulate the digits at the current position into val, giving the
+    same result as val = val * 10 + digit for each of them (including the
+    wraparound), and return how many there were.  The digits are taken
+    eight at a time while they are in the current buffer of the context.
+*/
+template<typename UInt>
+JML_ALWAYS_INLINE unsigned match_digits(UInt & val, Parse_Context & c)
+{
     unsigned digits = 0;
-    
-    while (c) {
-        if (isdigit(*c)) {
-            int digit = *c - '0';
-            val = val * 10 + digit;
-            ++digits;
-        }
-        else break;
-        
+
+    while (c.buffer_left() >= 8 && is_eight_digits(c.buffer_ptr())) {
+        val = val * 100000000 + parse_eight_digits(c.buffer_ptr());
+        c.skip_in_buffer(8);
+        digits += 8;
+    }
+
+    while (c && isdigit(*c)) {
+        val = val * 10 + (*c - '0');
+        ++digits;
         ++c;
     }
-    
+
+    return digits;
+}
+
+inline bool match_unsigned(unsigned long & val, Parse_Context & c)
+{
+    Parse_Context::Revert_Token tok(c);
+
+    val = 0;
+    unsigned digits = match_digits(val, c);
+
     if (!digits) return false;
     
     tok.ignore();  // we are returning true; ignore the token
@@ -117,19 +158,8 @@ inline bool match_unsigned_long(unsigned long & val,
     Parse_Context::Revert_Token tok(c);
 
     val = 0;
-    int digits = 0;
-    
-    while (c) {
-        if (isdigit(*c)) {
-            int digit = *c - '0';
-            val = val * 10 + digit;
-            ++digits;
-        }
-        else break;
-        
-        ++c;
-    }
-    
+    int digits = match_digits(val, c);
+
     if (!digits) return false;
     
     tok.ignore();  // we are returning true; ignore the token
@@ -167,19 +197,13 @@ inline bool match_unsigned_long_long(unsigned long long & val,
     bool dot = false;
     int coeffs = 0;
     
-    while (c) {
-        if (isdigit(*c)) {
-            int digit = *c - '0';
-            val = val * 10 + digit;
-            ++digits;
-            if (dot) ++coeffs;
-        }
-        else if (*c == '.') { dot = true; }
-        else {
-            break;
-        }
-        
-        ++c;
+    for (;;) {
+        unsigned matched = match_digits(val, c);
+        digits += matched;
+        if (dot) coeffs += matched;
+
+        if (c && *c == '.') { dot = true;  ++c; }
+        else break;
     }
     
     if (!digits) return false;
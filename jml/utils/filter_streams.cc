@@ -33,7 +33,11 @@
 #include "jml/arch/exception.h"
 #include "jml/arch/format.h"
 #include "string_functions.h"
+#include "file_functions.h"
+#include "parallel_gzip.h"
 #include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <sstream>
 #include <thread>
 #include <unordered_map>
@@ -285,6 +289,92 @@ std::ios_base::openmode getMode(const std::map<std::string, std::string> & optio
     return result;
 }
 
+std::string getOption(const std::map<std::string, std::string> & options,
+                      const std::string & key,
+                      const std::string & defaultValue = "")
+{
+    auto it = options.find(key);
+    if (it == options.end())
+        return defaultValue;
+    return it->second;
+}
+
+/** Which decompressor reads the resource: gz, bz2, xz, lz4 or "" for
+    none. */
+std::string getDecompression(const std::string & resource,
+                             const std::string & compression)
+{
+    auto matches = [&] (const std::string & ext)
+        {
+            return compression == "" && (ends_with(resource, "." + ext)
+                                         || ends_with(resource, "." + ext + "~"));
+        };
+
+    if (compression == "gz" || compression == "gzip" || matches("gz"))
+        return "gz";
+    if (compression == "bz2" || compression == "bzip2" || matches("bz2"))
+        return "bz2";
+    if (compression == "xz" || compression == "lzma" || matches("xz"))
+        return "xz";
+    if (compression == "lz4" || matches("lz4"))
+        return "lz4";
+    return "";
+}
+
+int getNumThreads(const std::map<std::string, std::string> & options)
+{
+    return boost::lexical_cast<int>(getOption(options, "num-threads", "1"));
+}
+
+
+/*****************************************************************************/
+/* MAPPED STREAMBUF                                                          */
+/*****************************************************************************/
+
+/** Input streambuf over a memory mapped file.  The whole file is the get
+    area, so reading it never copies anything or makes a system call, and
+    seeking is free.
+*/
+
+struct mapped_streambuf : public std::streambuf {
+    mapped_streambuf(const std::string & filename)
+        : file(filename)
+    {
+        char * start = const_cast<char *>(file.start());
+        if (file.size())
+            madvise(start, file.size(), MADV_SEQUENTIAL);
+        setg(start, start, start + file.size());
+    }
+
+    File_Read_Buffer file;
+
+protected:
+    virtual std::streamsize showmanyc()
+    {
+        return egptr() - gptr();
+    }
+
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which)
+    {
+        if (!(which & std::ios_base::in))
+            return pos_type(off_type(-1));
+
+        char * base = dir == std::ios_base::beg ? eback()
+            : dir == std::ios_base::cur ? gptr() : egptr();
+        if (off < eback() - base || off > egptr() - base)
+            return pos_type(off_type(-1));
+
+        setg(eback(), base + off, egptr());
+        return pos_type(gptr() - eback());
+    }
+
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+    {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+
 } // file scope
 
 void
@@ -473,6 +563,15 @@ filter_istream(const std::string & file, std::ios_base::openmode mode,
     open(file, mode, compression);
 }
 
+filter_istream::
+filter_istream(const std::string & uri,
+               const std::map<std::string, std::string> & options)
+    : istream(std::cin.rdbuf()),
+      deferredFailure(false)
+{
+    open(uri, options);
+}
+
 filter_istream::
 filter_istream(filter_istream && other) noexcept
     : istream(other.rdbuf()),
@@ -513,21 +612,32 @@ filter_istream::
 open(const std::string & uri,
      std::ios_base::openmode mode,
      const std::string & compression)
+{
+    open(uri, createOptions(mode, compression, -1));
+}
+
+void
+filter_istream::
+open(const std::string & uri,
+     const std::map<std::string, std::string> & options)
 {
     exceptions(ios::badbit);
 
     string scheme, resource;
     std::tie(scheme, resource) = getScheme(uri);
 
+    std::ios_base::openmode mode = getMode(options);
+    if (!mode)
+        mode = std::ios_base::in;
+
     const auto & handler = getUriHandler(scheme);
     std::streambuf * buf;
     bool weOwnBuf;
     auto onException = [&]() { this->deferredFailure = true; };
-    std::tie(buf, weOwnBuf) = handler(scheme, resource, mode,
-                                      createOptions(mode, compression, -1),
+    std::tie(buf, weOwnBuf) = handler(scheme, resource, mode, options,
                                       onException);
 
-    openFromStreambuf(buf, weOwnBuf, resource, compression);
+    openFromStreambuf(buf, weOwnBuf, resource, options);
 }
 
 void
@@ -536,6 +646,18 @@ openFromStreambuf(std::streambuf * buf,
                   bool weOwnBuf,
                   const std::string & resource,
                   const std::string & compression)
+{
+    openFromStreambuf(buf, weOwnBuf, resource,
+                      createOptions(std::ios_base::openmode(0),
+                                    compression, -1));
+}
+
+void
+filter_istream::
+openFromStreambuf(std::streambuf * buf,
+                  bool weOwnBuf,
+                  const std::string & resource,
+                  const std::map<std::string, std::string> & options)
 {
     // TODO: exception safety for buf
 
@@ -544,32 +666,43 @@ openFromStreambuf(std::streambuf * buf,
     std::unique_ptr<std::streambuf> sink;
     if (weOwnBuf)
         sink.reset(buf);
-    
+
+    string decompression
+        = getDecompression(resource, getOption(options, "compression"));
+    int numThreads = getNumThreads(options);
+
+    mapped_streambuf * mapped = dynamic_cast<mapped_streambuf *>(buf);
+
+    if (mapped && decompression == "") {
+        // Read straight from the mapping
+        this->stream.reset(new std::istream(buf));
+        this->sink = std::move(sink);
+        rdbuf(buf);
+        return;
+    }
+
+    if (mapped && decompression == "gz" && numThreads > 1) {
+        // Needs the whole file to find the members; takes its own reference
+        // to the mapping
+        std::unique_ptr<std::streambuf> gzbuf
+            (new parallel_gzip_streambuf(mapped->file, numThreads));
+        this->stream.reset(new std::istream(gzbuf.get()));
+        this->sink = std::move(gzbuf);
+        rdbuf(this->sink.get());
+        return;
+    }
+
     unique_ptr<filtering_istream> new_stream
         (new filtering_istream());
 
-    bool gzip = (compression == "gz" || compression == "gzip"
-                 || (compression == ""
-                     && (ends_with(resource, ".gz")
-                         || ends_with(resource, ".gz~"))));
-    bool bzip2 = (compression == "bz2" || compression == "bzip2"
-                 || (compression == ""
-                     && (ends_with(resource, ".bz2")
-                         || ends_with(resource, ".bz2~"))));
-    bool lzma = (compression == "xz" || compression == "lzma"
-                 || (compression == ""
-                     && (ends_with(resource, ".xz")
-                         || ends_with(resource, ".xz~"))));
-
-    bool lz4 = (compression == "lz4"
-                 || (compression == ""
-                     && (ends_with(resource, ".lz4")
-                         || ends_with(resource, ".lz4~"))));
-
-    if (gzip) new_stream->push(gzip_decompressor());
-    if (bzip2) new_stream->push(bzip2_decompressor());
-    if (lzma) new_stream->push(lzma_decompressor());
-    if (lz4) new_stream->push(lz4_decompressor());
+    if (decompression == "gz") new_stream->push(gzip_decompressor());
+    if (decompression == "bz2") new_stream->push(bzip2_decompressor());
+    if (decompression == "xz") new_stream->push(lzma_decompressor());
+    if (decompression == "lz4") {
+        if (numThreads > 1)
+            new_stream->push(lz4_parallel_decompressor(numThreads));
+        else new_stream->push(lz4_decompressor());
+    }
 
     new_stream->push(*buf);
 
@@ -648,6 +781,25 @@ getUriHandler(const std::string & scheme)
 }
 
 struct RegisterFileHandler {
+    /** Regular files are mapped if there is nothing to decompress, or if
+        they are gzip files that will be decompressed in parallel. */
+    static bool shouldMap(const std::string & resource,
+                          const std::map<std::string, std::string> & options)
+    {
+        string mapped = getOption(options, "mapped");
+        if (mapped == "false" || mapped == "0")
+            return false;
+
+        struct stat stats;
+        if (stat(resource.c_str(), &stats) == -1 || !S_ISREG(stats.st_mode))
+            return false;
+
+        string decompression
+            = getDecompression(resource, getOption(options, "compression"));
+        return decompression == ""
+            || (decompression == "gz" && getNumThreads(options) > 1);
+    }
+
     static std::pair<std::streambuf *, bool>
     getFileHandler(const std::string & scheme,
                    std::string resource,
@@ -661,6 +813,15 @@ struct RegisterFileHandler {
         if (mode == ios::in) {
             if (resource == "-")
                 return make_pair(cin.rdbuf(), false);
+
+            if (shouldMap(resource, options)) {
+                try {
+                    return make_pair(new mapped_streambuf(resource), true);
+                } catch (const std::exception & exc) {
+                    // Fall back to reading it through a filebuf
+                }
+            }
+
             unique_ptr<std::filebuf> buf(new std::filebuf);
             buf->open(resource, ios_base::openmode(mode));
 
@@ -136,6 +136,9 @@ public:
                    std::ios_base::openmode mode = std::ios_base::in,
                    const std::string & compression = "");
 
+    filter_istream(const std::string & uri,
+                   const std::map<std::string, std::string> & options);
+
     filter_istream(filter_istream && other) noexcept;
 
     filter_istream & operator = (filter_istream && other);
@@ -146,11 +149,29 @@ public:
               std::ios_base::openmode mode = std::ios_base::in,
               const std::string & comparession = "");
 
+    /** Open with the given options.  As well as mode and compression (see
+        filter_ostream), these include:
+
+        mapped = "false" to read local files through a filebuf rather than
+                 memory mapping them.  By default, uncompressed local files
+                 are mapped and read without copying (so the file must
+                 not be truncated while it is being read).
+        num-threads = number of threads used to decompress lz4 streams and
+                 local gzip files with several members (default 1)
+    */
+    void open(const std::string & uri,
+              const std::map<std::string, std::string> & options);
+
     void openFromStreambuf(std::streambuf * buf,
                            bool weOwnBuf,
                            const std::string & resource = "",
                            const std::string & compression = "");
 
+    void openFromStreambuf(std::streambuf * buf,
+                           bool weOwnBuf,
+                           const std::string & resource,
+                           const std::map<std::string, std::string> & options);
+
     void close();
 
     /* read the entire stream into a std::string */
@@ -152,6 +152,13 @@ std::string expectJsonStringAsciiPermissive(Parse_Context & context, char sub)
 
     // Try multiple times to make it fit
     while (!context.match_literal('"')) {
+        // Plain characters are copied in bulk
+        size_t run = context.match_string_run(buffer + pos, bufferSize - pos);
+        if (run) {
+            pos += run;
+            continue;
+        }
+
         int c = *context++;
         if (c == '\\') {
             c = *context++;
@@ -212,6 +219,17 @@ std::string expectJsonString(Parse_Context & context)
     // Try multiple times to make it fit
     while (!context.match_literal('"')) {
 
+        // Plain characters are copied in bulk, leaving room for the longest
+        // encoded code point
+        if (pos + 6 < bufferSize) {
+            size_t run = context.match_string_run(buffer + pos,
+                                                  bufferSize - 6 - pos);
+            if (run) {
+                pos += run;
+                continue;
+            }
+        }
+
         int c = *context++;
         if (c == '\\') {
             c = *context++;
@@ -304,6 +322,13 @@ ssize_t expectJsonStringAscii(Parse_Context & context, char * buffer, size_t max
 
     // Try multiple times to make it fit
     while (!context.match_literal('"')) {
+        // Plain characters are copied in bulk
+        size_t run = context.match_string_run(buffer + pos, bufferSize - pos);
+        if (run) {
+            pos += run;
+            continue;
+        }
+
         int c = *context++;
         if (c == '\\') {
             c = *context++;
@@ -355,14 +380,12 @@ std::string expectJsonStringAscii(Parse_Context & context)
     // Try multiple times to make it fit
     while (!context.match_literal('"')) {
 
-#if 0 // attempt to do it a block at a time
-        char * bufferEnd = cbuffer + bufferSize;
-
-        int charsMatched
-            = context.match_text(buffer + pos, buffer + bufferSize,
-                                 "\"\\");
-        pos += charsMatched;
-#endif
+        // Plain characters are copied in bulk
+        size_t run = context.match_string_run(buffer + pos, bufferSize - pos);
+        if (run) {
+            pos += run;
+            continue;
+        }
 
         int c = *context++;
         if (c == '\\') {
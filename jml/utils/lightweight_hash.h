@@ -19,7 +19,9 @@
 #include "jml/arch/atomic_ops.h"
 #include <string>
 #include <cassert>
+#include <cstring>
 #include <functional>
+#include <emmintrin.h>
 
 namespace ML {
 
@@ -319,6 +321,199 @@ Allocator LogMemStorage<Bucket, Allocator>::
 allocator;
 
 
+/*****************************************************************************/
+/* HASH CONTROL GROUP                                                        */
+/*****************************************************************************/
+
+/** Sixteen control bytes of a GroupMemStorage, compared all at once with
+    SSE2.  An empty bucket has the top bit set; a full one holds a seven
+    bit tag taken from the hash of its key, so that most buckets holding
+    other keys can be skipped without comparing the keys themselves.
+*/
+
+struct Hash_Control_Group {
+    enum {
+        WIDTH = 16,
+        EMPTY = 0x80
+    };
+
+    explicit Hash_Control_Group(const uint8_t * ctrl)
+        : ctrl(_mm_loadu_si128((const __m128i *)ctrl))
+    {
+    }
+
+    /** Bitmask of the buckets whose tag is the given one. */
+    unsigned match(uint8_t tag) const
+    {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag)));
+    }
+
+    /** Bitmask of the empty buckets. */
+    unsigned matchEmpty() const
+    {
+        return _mm_movemask_epi8(ctrl);
+    }
+
+    /** Bitmask of the full buckets. */
+    unsigned matchFull() const
+    {
+        return ~matchEmpty() & 0xffff;
+    }
+
+    __m128i ctrl;
+};
+
+
+/*****************************************************************************/
+/* GROUP MEM STORAGE                                                         */
+/*****************************************************************************/
+
+/** Storage whose capacity is a power of two, like LogMemStorage, with one
+    control byte per bucket.  A Lightweight_Hash using it probes groups of
+    16 buckets at a time instead of one bucket at a time, and so can be
+    filled more before it needs to expand.  The capacity is at least one
+    group.
+*/
+
+template<typename Bucket, typename Allocator = std::allocator<Bucket> >
+struct GroupMemStorage {
+    GroupMemStorage()
+        : vals_(0), ctrl_(0), bits_(0)
+    {
+    }
+
+    GroupMemStorage(size_t capacity)
+        : vals_(0), ctrl_(0), bits_(0)
+    {
+        reserve(capacity);
+    }
+
+    GroupMemStorage(GroupMemStorage && other)
+        : vals_(other.vals_), ctrl_(other.ctrl_), bits_(other.bits_)
+    {
+        other.vals_ = 0;
+        other.ctrl_ = 0;
+        other.bits_ = 0;
+    }
+
+    GroupMemStorage & operator = (GroupMemStorage && other)
+    {
+        destroy();
+        swap(other);
+        return *this;
+    }
+
+    ~GroupMemStorage()
+    {
+        destroy();
+    }
+
+    Bucket * vals_;
+    uint8_t * ctrl_;
+    uint8_t bits_;
+
+    void swap(GroupMemStorage & other)
+    {
+        std::swap(vals_, other.vals_);
+        std::swap(ctrl_, other.ctrl_);
+        std::swap(bits_, other.bits_);
+    }
+
+    size_t capacity() const JML_PURE_FN
+    {
+        return size_t(bits_ != 0) * (1ULL << (bits_ - 1));
+    }
+
+    size_t groups() const JML_PURE_FN
+    {
+        return capacity() / Hash_Control_Group::WIDTH;
+    }
+
+    void reserve(size_t newCapacity)
+    {
+        if (vals_)
+            throw ML::Exception("can't double initialize storage");
+
+        if (newCapacity == 0) return;
+
+        newCapacity = std::max<size_t>(newCapacity, Hash_Control_Group::WIDTH);
+
+        bits_ = ML::highest_bit((newCapacity - 1), -1) + 2;
+        vals_ = allocator.allocate(capacity());
+        ctrl_ = new uint8_t[capacity()];
+        memset(ctrl_, Hash_Control_Group::EMPTY, capacity());
+
+        ExcAssertGreaterEqual(capacity(), newCapacity);
+    }
+
+    void destroy()
+    {
+        if (!vals_) return;
+        try {
+            allocator.deallocate(vals_, capacity());
+        } catch (...) {}
+        delete[] ctrl_;
+        vals_ = 0;
+        ctrl_ = 0;
+        bits_ = 0;
+    }
+
+    /** Scrambles the key's hash, so that the group (from its top bits) and
+        the tag (from the seven bits under those) are well distributed even
+        when the hash is the identity, as std::hash is for integers. */
+    static uint64_t mix(uint64_t hash) JML_CONST_FN
+    {
+        return hash * 0x9e3779b97f4a7c15ULL;
+    }
+
+    size_t group(uint64_t mixed) const JML_PURE_FN
+    {
+        int groupBits = bits_ - 5;
+        return groupBits == 0 ? 0 : mixed >> (64 - groupBits);
+    }
+
+    uint8_t tag(uint64_t mixed) const JML_PURE_FN
+    {
+        int groupBits = bits_ - 5;
+        return (mixed >> (57 - groupBits)) & 0x7f;
+    }
+
+    Hash_Control_Group controlGroup(size_t group) const
+    {
+        return Hash_Control_Group(ctrl_ + group * Hash_Control_Group::WIDTH);
+    }
+
+    bool isFull(size_t index) const JML_PURE_FN
+    {
+        return !(ctrl_[index] & Hash_Control_Group::EMPTY);
+    }
+
+    Bucket * operator + (size_t index)
+    {
+        return vals_ + index;
+    }
+    
+    Bucket & operator [] (size_t index)
+    {
+        return vals_[index];
+    }
+
+    const Bucket & operator [] (size_t index) const
+    {
+        return vals_[index];
+    }
+
+private:
+    void operator = (const GroupMemStorage & other);
+    GroupMemStorage(const GroupMemStorage & other);
+    static Allocator allocator;
+};
+
+template<typename Bucket, typename Allocator>
+Allocator GroupMemStorage<Bucket, Allocator>::
+allocator;
+
+
 /*****************************************************************************/
 /* LIGHTWEIGHT HASH BASE                                                     */
 /*****************************************************************************/
@@ -478,6 +673,24 @@ struct Lightweight_Hash_Base {
         return (size_ >= 3 * capacity() / 4);
     }
 
+    /** Number of full keys that a lookup of the given key compares against
+        before it finds it or gives up.  For benchmarking. */
+    size_t probe_length(const Key & key) const
+    {
+        size_t cap = capacity();
+        if (cap == 0) return 0;
+
+        size_t result = 0;
+        int i = Ops::hashKey(key, cap, storage_);
+        for (size_t n = 0;  n < cap && Ops::bucketIsFull(storage_[i]);  ++n) {
+            ++result;
+            if (Ops::bucketHasKey(storage_[i], key)) break;
+            ++i;
+            if (i == cap) i = 0;
+        }
+        return result;
+    }
+
 protected:
     Storage storage_;
     int size_;
@@ -644,6 +857,362 @@ uint64_t Lightweight_Hash_Base<Key, Bucket, Ops, Storage>::numHops = 0;
 #endif
 
 
+/*****************************************************************************/
+/* LIGHTWEIGHT HASH BASE (GROUP PROBING)                                     */
+/*****************************************************************************/
+
+/** Version of the base for GroupMemStorage.  Instead of probing bucket by
+    bucket until it finds the key or an empty bucket, it probes a group of
+    16 at a time: the control bytes of the group are compared with the
+    key's tag, and only the buckets with a matching tag have their keys
+    compared.  The probe stops at the first group with an empty bucket.
+
+    The buckets themselves are still initialized and emptied through the
+    Ops, so that bucketIsFull() agrees with the control bytes; iteration
+    is the same as for the other storages (in bucket order).
+*/
+
+template<class Key, class Bucket, class Ops, class Allocator>
+struct Lightweight_Hash_Base<Key, Bucket, Ops,
+                             GroupMemStorage<Bucket, Allocator> > {
+
+    typedef GroupMemStorage<Bucket, Allocator> Storage;
+    typedef Hash_Control_Group Group;
+
+    Lightweight_Hash_Base()
+        : size_(0)
+    {
+    }
+
+    template<class Iterator>
+    Lightweight_Hash_Base(Iterator first, Iterator last, size_t capacity = 0)
+        : storage_(capacity), size_(0)
+    {
+        if (capacity == 0)
+            storage_.reserve(std::distance(first, last) * 2);
+
+        size_t cp = this->capacity();
+        if (cp == 0) return;
+
+        for (unsigned i = 0;  i < cp;  ++i)
+            Ops::initEmptyBucket(storage_ + i);
+
+        for (; first != last;  ++first)
+            this->find_or_insert(*first);
+    }
+
+    Lightweight_Hash_Base(const Lightweight_Hash_Base & other,
+                          size_t capacity)
+        : storage_(capacity), size_(0)
+    {
+        size_t cp = this->capacity();
+
+        for (unsigned i = 0;  i < cp;  ++i)
+            Ops::initEmptyBucket(storage_ + i);
+
+        size_t ocp = other.capacity();
+        for (unsigned i = 0;  i < ocp;  ++i)
+            if (other.storage_.isFull(i))
+                must_insert(other.storage_[i]);
+    }
+
+    Lightweight_Hash_Base(const Lightweight_Hash_Base & other)
+        : storage_(other.capacity()), size_(other.size_)
+    {
+        if (capacity() == 0) return;
+
+        ExcAssertEqual(capacity(), other.capacity());
+
+        for (unsigned i = 0;  i < capacity();  ++i) {
+            if (other.storage_.isFull(i))
+                Ops::initBucket(storage_ + i, other.storage_[i]);
+            else Ops::initEmptyBucket(storage_ + i);
+        }
+
+        memcpy(storage_.ctrl_, other.storage_.ctrl_, capacity());
+    }
+
+    Lightweight_Hash_Base(Lightweight_Hash_Base && other)
+        : storage_(std::move(other.storage_)), size_(other.size_)
+    {
+        other.size_ = 0;
+    }
+
+    ~Lightweight_Hash_Base()
+    {
+        destroy();
+    }
+
+    Lightweight_Hash_Base & operator = (const Lightweight_Hash_Base & other)
+    {
+        Lightweight_Hash_Base new_me(other);
+        swap(new_me);
+        return *this;
+    }
+
+    Lightweight_Hash_Base & operator = (Lightweight_Hash_Base && other)
+    {
+        Lightweight_Hash_Base new_me(other);
+        swap(new_me);
+        return *this;
+    }
+
+    void swap(Lightweight_Hash_Base & other)
+    {
+        storage_.swap(other.storage_);
+        std::swap(size_, other.size_);
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return storage_.capacity(); }
+
+    void clear()
+    {
+        size_t cp = capacity();
+
+        // Empty buckets
+        for (unsigned i = 0;  i < cp;  ++i) {
+            if (storage_.isFull(i)) {
+                try {
+                    Ops::emptyBucket(storage_ + i);
+                } catch (...) {}
+            }
+        }
+
+        if (cp) memset(storage_.ctrl_, Group::EMPTY, cp);
+
+        size_ = 0;
+    }
+
+    bool count(const Key & key) const
+    {
+        int bucket = this->find_full_bucket(key);
+        return bucket != -1;
+    }
+
+    void destroy()
+    {
+        size_t cp = capacity();
+
+        // Run destructors
+        for (unsigned i = 0;  i < cp;  ++i) {
+            try {
+                Ops::destroyBucket(storage_ + i);
+            } catch (...) {}
+        }
+        
+        // Destroy the underlying memory
+        storage_.destroy();
+        size_ = 0;
+    }
+
+    void reserve(size_t new_capacity)
+    {
+        if (new_capacity <= capacity()) return;
+
+        if (new_capacity < capacity() * 2)
+            new_capacity = capacity() * 2;
+
+        Lightweight_Hash_Base new_me(*this, new_capacity);
+        swap(new_me);
+    }
+
+    void dump(std::ostream & stream) const
+    {
+        using namespace std;
+        stream << "Lightweight_Hash: size " << size_ << " capacity "
+               << capacity() << " groups " << storage_.groups() << endl;
+        for (unsigned i = 0;  i < capacity();  ++i) {
+            stream << "  bucket " << i << ": hash "
+                   << Ops::hashKey(storage_[i], capacity(), storage_)
+                   << " control " << (int)storage_.ctrl_[i]
+                   << " bucket " << storage_[i] << endl;
+        }
+    }
+
+    /** Groups tolerate a higher load than single buckets, since most of
+        the buckets in a group are skipped without comparing keys. */
+    bool needs_expansion() const
+    {
+        return (size_ >= 7 * capacity() / 8);
+    }
+
+    /** Number of full keys that a lookup of the given key compares against
+        before it finds it or gives up.  For benchmarking. */
+    size_t probe_length(const Key & key) const
+    {
+        size_t cap = capacity();
+        if (cap == 0) return 0;
+
+        uint64_t mixed = Storage::mix(Ops::hashKey(key, cap, storage_));
+        size_t group = storage_.group(mixed);
+        uint8_t tag = storage_.tag(mixed);
+        size_t ngroups = storage_.groups();
+
+        size_t result = 0;
+        for (size_t n = 0;  n < ngroups;  ++n) {
+            Group ctrl = storage_.controlGroup(group);
+            for (unsigned m = ctrl.match(tag);  m;  m &= m - 1) {
+                ++result;
+                int i = group * Group::WIDTH + ML::lowest_bit(m);
+                if (Ops::bucketHasKey(storage_[i], key)) return result;
+            }
+            if (ctrl.matchEmpty()) break;
+            if (++group == ngroups) group = 0;
+        }
+        return result;
+    }
+
+protected:
+    Storage storage_;
+    int size_;
+
+    std::pair<int, bool>
+    find_or_insert(const Bucket & toInsert)
+    {
+        Key key = Ops::getKey(toInsert);
+        int bucket = find_bucket(key);
+        if (bucket != -1 && storage_.isFull(bucket))
+            return std::make_pair(bucket, false);
+        return std::make_pair(insert_new(bucket, toInsert), true);
+    }
+
+    int must_insert(const Bucket & toInsert)
+    {
+        Key key = Ops::getKey(toInsert);
+        int bucket = find_bucket(key);
+        if (bucket != -1 && storage_.isFull(bucket))
+            throw ML::Exception("must_insert of value already there");
+        return insert_new(bucket, toInsert);
+    }
+
+    /** Returns the bucket holding the key, or else the empty bucket where
+        it should be inserted, or -1 if there is no room. */
+    int find_bucket(const Key & key) const
+    {
+        if (Ops::isGuardValue(key))
+            throw Exception("searching for or inserting guard value");
+
+        size_t cap = capacity();
+        if (cap == 0) return -1;
+
+        uint64_t mixed = Storage::mix(Ops::hashKey(key, cap, storage_));
+        size_t group = storage_.group(mixed);
+        uint8_t tag = storage_.tag(mixed);
+        size_t ngroups = storage_.groups();
+
+        for (size_t n = 0;  n < ngroups;  ++n) {
+            Group ctrl = storage_.controlGroup(group);
+
+            for (unsigned m = ctrl.match(tag);  m;  m &= m - 1) {
+                int i = group * Group::WIDTH + ML::lowest_bit(m);
+                if (JML_LIKELY(Ops::bucketHasKey(storage_[i], key)))
+                    return i;
+            }
+
+            // Since nothing is ever removed, a key can't be stored past
+            // the first group with an empty bucket
+            unsigned empty = ctrl.matchEmpty();
+            if (empty)
+                return group * Group::WIDTH + ML::lowest_bit(empty);
+
+            if (++group == ngroups) group = 0;
+        }
+
+        // No bucket found; will need to be expanded
+        if (size_ != cap) {
+            dump(std::cerr);
+            throw Exception("find_bucket: inconsistency");
+        }
+        return -1;
+    }
+
+    int find_full_bucket(const Key & key) const
+    {
+        int bucket = find_bucket(key);
+        if (bucket == -1 || !storage_.isFull(bucket)) return -1;
+        if (!Ops::bucketHasKey(storage_[bucket], key))
+            throw Exception("find_full_bucket didn't return correct key");
+        return bucket;
+    }
+
+    int insert_new(int bucket, const Bucket & toInsert) 
+    {
+        Key key = Ops::getKey(toInsert);
+        if (Ops::isGuardValue(key))
+            throw Exception("searching for or inserting guard value");
+        
+        if (needs_expansion()) {
+            // expand
+            reserve(std::max<size_t>(Group::WIDTH, capacity() * 2));
+            bucket = find_bucket(key);
+            if (bucket == -1 || storage_.isFull(bucket))
+                throw Exception("logic error: bucket appeared after reserve");
+        }
+
+        uint64_t mixed
+            = Storage::mix(Ops::hashKey(key, capacity(), storage_));
+
+        Ops::fillBucket(storage_ + bucket, toInsert);
+        storage_.ctrl_[bucket] = storage_.tag(mixed);
+        ++size_;
+
+        return bucket;
+    }
+
+    int advance_to_valid(int index) const
+    {
+        if (index < 0 || index >= capacity()) {
+            std::cerr << "index = " << index << std::endl;
+            throw Exception("advance_to_valid: already at end");
+        }
+
+        size_t cap = capacity();
+
+        // Scan a group at a time until we find a valid bucket
+        size_t group = index / Group::WIDTH;
+        unsigned full = storage_.controlGroup(group).matchFull()
+            & (0xffff << (index % Group::WIDTH));
+
+        while (!full) {
+            if (++group == storage_.groups()) return cap;
+            full = storage_.controlGroup(group).matchFull();
+        }
+
+        return group * Group::WIDTH + ML::lowest_bit(full);
+    }
+
+    int backup_to_valid(int index) const
+    {
+        if (index < 0 || index >= capacity())
+            throw Exception("backup_to_valid: already outside range");
+        
+        // Scan through until we find a valid bucket
+        while (index >= 0 && !storage_.isFull(index))
+            --index;
+        
+        if (index < 0)
+            throw Exception("backup_to_valid: none found");
+
+        return index;
+    }
+
+    const Bucket & dereference(int bucket) const
+    {
+        if (bucket < 0 || bucket > capacity())
+            throw Exception("dereferencing invalid iterator");
+        if (!storage_.isFull(bucket)) {
+            using namespace std;
+            cerr << "bucket = " << bucket << endl;
+            dump(cerr);
+            throw Exception("dereferencing invalid iterator bucket");
+        }
+        return this->storage_[bucket];
+    }
+};
+
+
 /*****************************************************************************/
 /* LIGHTWEIGHT HASH MAP                                                      */
 /*****************************************************************************/
@@ -720,6 +1289,13 @@ struct PairOps {
         uint64_t mask = (1ULL << ((storage.bits_ - 1))) - 1;
         return Hash()(key) & mask;
     }
+
+    // The base splits the whole hash into a group and a tag
+    static size_t hashKey(Key key, int capacity,
+                          const GroupMemStorage<Bucket> & storage)
+    {
+        return Hash()(key);
+    }
  };
 
 template<typename Key,
@@ -956,6 +1532,12 @@ struct ScalarOps {
         uint64_t mask = (1ULL << ((storage.bits_ - 1))) - 1;
         return Hash()(key) & mask;
     }
+
+    static size_t hashKey(Key key, int capacity,
+                          const GroupMemStorage<Bucket> & storage)
+    {
+        return Hash()(key);
+    }
 };
 
 template<typename Key, typename Hash>
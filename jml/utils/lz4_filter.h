@@ -17,8 +17,13 @@
 #include "jml/utils/exc_assert.h"
 
 #include <boost/iostreams/concepts.hpp>
+#include <boost/iostreams/read.hpp>
+#include <boost/iostreams/write.hpp>
 #include <ios>
 #include <vector>
+#include <deque>
+#include <future>
+#include <memory>
 #include <cstring>
 #include "jml/utils/guard.h"
 
@@ -119,22 +124,43 @@ struct JML_PACKED Header
     {
         Header head;
         lz4::read(src, &head, sizeof(head));
+        head.check();
+        return std::move(head);
+    }
+
+    /** Read the header of a frame that follows another one.  Returns a null
+        header if the source ends instead.
+    */
+    template<typename Source>
+    static Header readNext(Source& src)
+    {
+        Header head;
+        char* data = (char*) &head;
 
-        if (head.magic != MagicConst)
+        std::streamsize read;
+        while (!(read = boost::iostreams::read(src, data, 1)));
+        if (read < 0) return Header();
+
+        lz4::read(src, data + 1, sizeof(head) - 1);
+        head.check();
+        return std::move(head);
+    }
+
+    void check() const
+    {
+        if (magic != MagicConst)
             throw lz4_error("invalid magic number");
 
-        if (head.version() != 1)
+        if (version() != 1)
             throw lz4_error("unsupported lz4 version");
 
-        if (!head.blockIndependence())
+        if (!blockIndependence())
             throw lz4_error("unsupported option: block dependence");
 
-        checkBlockId(head.blockId());
+        checkBlockId(blockId());
 
-        if (head.checkBits != head.checksumOptions())
+        if (checkBits != checksumOptions())
             throw lz4_error("corrupted options");
-
-        return std::move(head);
     }
 
     template<typename Sink>
@@ -266,24 +292,27 @@ private:
 /* LZ4 DECOMPRESSOR                                                           */
 /******************************************************************************/
 
+/** Reads a sequence of frames, as written by successive compressors (or
+    by a compressor which is restarted) to the same file.
+*/
+
 struct lz4_decompressor : public boost::iostreams::multichar_input_filter
 {
-    lz4_decompressor() : done(false), toRead(0), pos(0) {}
+    lz4_decompressor() : done(false), frames(0), toRead(0), pos(0) {}
 
     template<typename Source>
     std::streamsize read(Source& src, char* s, std::streamsize n)
     {
         if (done) return -1;
-        if (!head) {
-            head = lz4::Header::read(src);
-            if (head.streamChecksum())
-                streamChecksumState = XXH32_init(lz4::ChecksumSeed);
-        }
 
         size_t written = 0;
         while (written < n) {
-            if (pos == toRead)
+            if (!head && !nextFrame(src))
+                done = true;
+            else if (pos == toRead) {
                 fillBuffer(src);
+                continue;
+            }
 
             if (done) break;
 
@@ -301,6 +330,20 @@ struct lz4_decompressor : public boost::iostreams::multichar_input_filter
 
 private:
 
+    template<typename Source>
+    bool nextFrame(Source& src)
+    {
+        // The first frame is mandatory; the end of the source is only
+        // expected between frames.
+        head = frames ? lz4::Header::readNext(src) : lz4::Header::read(src);
+        if (!head) return false;
+
+        ++frames;
+        if (head.streamChecksum())
+            streamChecksumState = XXH32_init(lz4::ChecksumSeed);
+        return true;
+    }
+
     template<typename Source>
     void fillBuffer(Source& src)
     {
@@ -317,7 +360,7 @@ private:
                 if (checksum != expected) throw lz4_error("invalid checksum");
             }
 
-            done = true;
+            head = lz4::Header();
             return;
         }
 
@@ -336,13 +379,15 @@ private:
         }
 
         pos = 0;
+        buffer.resize(head.blockSize());
 
         if (notCompressed) {
+            if (compressedSize > buffer.size())
+                throw lz4_error("malformed lz4 stream");
             std::memcpy(buffer.data(), compressed, compressedSize);
             toRead = compressedSize;
         }
         else {
-            buffer.resize(head.blockSize());
 
             auto decompressed = LZ4_decompress_safe(
                     compressed,     buffer.data(),
@@ -359,6 +404,7 @@ private:
 
     lz4::Header head;
     bool done;
+    size_t frames;
 
     std::vector<char> buffer;
     size_t toRead;
@@ -367,4 +413,235 @@ private:
     void* streamChecksumState;
 };
 
+
+
+/******************************************************************************/
+/* LZ4 PARALLEL DECOMPRESSOR                                                  */
+/******************************************************************************/
+
+/** Version of lz4_decompressor which decompresses on several threads.  The
+    blocks of a frame are independent (the header check requires it), so
+    only reading the source and checking the stream checksum need to be
+    done in order.  Blocks are handed to the threads in batches of at least
+    BatchSize bytes, so that streams with small blocks don't spend their
+    time starting threads; at most numThreads batches are in flight.
+
+    Boost iostreams copies filters around, so the state is shared.
+*/
+
+struct lz4_parallel_decompressor : public boost::iostreams::multichar_input_filter
+{
+    lz4_parallel_decompressor(int numThreads) :
+        state(std::make_shared<State>(numThreads))
+    {
+    }
+
+    template<typename Source>
+    std::streamsize read(Source& src, char* s, std::streamsize n)
+    {
+        return state->read(src, s, n);
+    }
+
+private:
+
+    static constexpr size_t BatchSize = 4 * 1024 * 1024;
+
+    struct Block
+    {
+        std::vector<char> compressed;
+        bool notCompressed;
+        bool checksum;
+        uint32_t expected;
+    };
+
+    struct Batch
+    {
+        std::future<std::vector<char> > data;
+        bool frameStart;
+        bool frameEnd;
+        bool streamChecksum;
+        uint32_t expectedStreamChecksum;
+    };
+
+    static std::vector<char>
+    decompress(const std::vector<Block> & blocks, size_t blockSize)
+    {
+        std::vector<char> result;
+        result.reserve(blocks.size() * blockSize);
+
+        for (const Block & block: blocks) {
+            const std::vector<char> & compressed = block.compressed;
+
+            if (block.checksum) {
+                uint32_t checksum = XXH32(compressed.data(), compressed.size(),
+                                          lz4::ChecksumSeed);
+                if (checksum != block.expected)
+                    throw lz4_error("invalid checksum");
+            }
+
+            size_t offset = result.size();
+
+            if (block.notCompressed) {
+                if (compressed.size() > blockSize)
+                    throw lz4_error("malformed lz4 stream");
+                result.insert(result.end(), compressed.begin(), compressed.end());
+                continue;
+            }
+
+            result.resize(offset + blockSize);
+            auto decompressed = LZ4_decompress_safe(
+                    compressed.data(), result.data() + offset,
+                    compressed.size(), blockSize);
+
+            if (decompressed < 0) throw lz4_error("malformed lz4 stream");
+            result.resize(offset + decompressed);
+        }
+
+        return result;
+    }
+
+    struct State
+    {
+        State(int numThreads) :
+            numThreads(std::max(numThreads, 1)),
+            frames(0), frameStart(false), sourceDone(false), pos(0)
+        {
+        }
+
+        template<typename Source>
+        std::streamsize read(Source& src, char* s, std::streamsize n)
+        {
+            size_t written = 0;
+            while (written < n) {
+                if (pos == current.size()) {
+                    if (!nextBatch(src)) break;
+                    continue;
+                }
+
+                size_t toCopy = std::min(n - written, current.size() - pos);
+                std::memcpy(s, current.data() + pos, toCopy);
+
+                s += toCopy;
+                pos += toCopy;
+                written += toCopy;
+            }
+
+            return n && !written ? -1 : written;
+        }
+
+        template<typename Source>
+        bool nextBatch(Source& src)
+        {
+            fill(src);
+            if (batches.empty()) return false;
+
+            Batch batch = std::move(batches.front());
+            batches.pop_front();
+
+            // Keep the threads busy while this one is being consumed
+            fill(src);
+
+            current = batch.data.get();
+            pos = 0;
+
+            if (batch.streamChecksum) {
+                if (batch.frameStart)
+                    streamChecksumState = XXH32_init(lz4::ChecksumSeed);
+
+                XXH32_update(streamChecksumState, current.data(), current.size());
+
+                if (batch.frameEnd) {
+                    uint32_t checksum = XXH32_digest(streamChecksumState);
+                    if (checksum != batch.expectedStreamChecksum)
+                        throw lz4_error("invalid checksum");
+                }
+            }
+
+            return true;
+        }
+
+        template<typename Source>
+        void fill(Source& src)
+        {
+            while (!sourceDone && batches.size() < numThreads)
+                readBatch(src);
+        }
+
+        /** Reads the next batch of blocks of the current frame from the
+            source, and starts a thread to decompress them. */
+        template<typename Source>
+        void readBatch(Source& src)
+        {
+            if (!head) {
+                // The first frame is mandatory; the end of the source is
+                // only expected between frames.
+                head = frames ? lz4::Header::readNext(src)
+                    : lz4::Header::read(src);
+                if (!head) {
+                    sourceDone = true;
+                    return;
+                }
+                ++frames;
+                frameStart = true;
+            }
+
+            Batch batch;
+            batch.frameStart = frameStart;
+            batch.frameEnd = false;
+            batch.streamChecksum = head.streamChecksum();
+            frameStart = false;
+
+            size_t blockSize = head.blockSize();
+            std::vector<Block> blocks;
+
+            for (size_t total = 0;  total < BatchSize;  total += blockSize) {
+                uint32_t compressedSize;
+                lz4::read(src, &compressedSize, sizeof(compressedSize));
+
+                // EOS marker.
+                if (compressedSize == 0) {
+                    if (head.streamChecksum())
+                        lz4::read(src, &batch.expectedStreamChecksum,
+                                  sizeof(batch.expectedStreamChecksum));
+                    batch.frameEnd = true;
+                    head = lz4::Header();
+                    break;
+                }
+
+                Block block;
+                block.notCompressed = compressedSize & lz4::NotCompressedMask;
+                compressedSize &= ~lz4::NotCompressedMask;
+
+                block.compressed.resize(compressedSize);
+                lz4::read(src, block.compressed.data(), compressedSize);
+
+                block.checksum = head.blockChecksum();
+                if (block.checksum)
+                    lz4::read(src, &block.expected, sizeof(block.expected));
+
+                blocks.emplace_back(std::move(block));
+            }
+
+            batch.data = std::async(std::launch::async, &decompress,
+                                    std::move(blocks), blockSize);
+            batches.emplace_back(std::move(batch));
+        }
+
+        size_t numThreads;
+
+        lz4::Header head;
+        size_t frames;
+        bool frameStart;
+        bool sourceDone;
+        std::deque<Batch> batches;
+
+        std::vector<char> current;
+        size_t pos;
+
+        void* streamChecksumState;
+    };
+
+    std::shared_ptr<State> state;
+};
+
 } // namespace ML
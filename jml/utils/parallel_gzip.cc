@@ -0,0 +1,206 @@
+/* parallel_gzip.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Decompression of gzip files with several members on several threads.
+*/
+
+#include "parallel_gzip.h"
+#include "jml/arch/exception.h"
+#include "jml/utils/guard.h"
+#include <zlib.h>
+#include <string.h>
+#include <limits.h>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* PARALLEL GZIP STREAMBUF                                                   */
+/*****************************************************************************/
+
+parallel_gzip_streambuf::
+parallel_gzip_streambuf(const File_Read_Buffer & file, int numThreads,
+                        size_t chunkSize)
+    : file(file), numThreads(std::max(numThreads, 1)),
+      chunkSize(chunkSize), pos(0), nextJob(0)
+{
+}
+
+parallel_gzip_streambuf::
+~parallel_gzip_streambuf()
+{
+    // The futures wait for their threads as they are destroyed
+    jobs.clear();
+}
+
+parallel_gzip_streambuf::Chunk
+parallel_gzip_streambuf::
+decompressMembers(const char * data, size_t size,
+                  size_t start, size_t stopAfter)
+{
+    Chunk result;
+    result.end = start;
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    // 16 tells zlib to expect a gzip header and trailer
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        result.error = "couldn't initialize zlib";
+        return result;
+    }
+
+    Call_Guard guard([&] () { inflateEnd(&stream); });
+
+    size_t used = 0;
+    result.data.resize(std::min<size_t>(4 * (stopAfter - start), 64 << 20)
+                       + 65536);
+
+    size_t pos = start;
+    do {
+        if (pos != start && findMemberHeader(data, size, pos) != pos) {
+            result.error = "trailing garbage after gzip member";
+            break;
+        }
+
+        inflateReset(&stream);
+        stream.next_in = (Bytef *)(data + pos);
+        stream.avail_in = std::min<size_t>(size - pos, UINT_MAX);
+
+        int res;
+        do {
+            if (stream.avail_in == 0) {
+                size_t inputDone = (const char *)stream.next_in - data;
+                stream.avail_in = std::min<size_t>(size - inputDone, UINT_MAX);
+            }
+
+            if (used == result.data.size())
+                result.data.resize(result.data.size() * 2);
+
+            stream.next_out = (Bytef *)(&result.data[0] + used);
+            stream.avail_out
+                = std::min<size_t>(result.data.size() - used, UINT_MAX);
+            unsigned avail_out = stream.avail_out;
+
+            res = inflate(&stream, Z_NO_FLUSH);
+            used += avail_out - stream.avail_out;
+
+            if (res == Z_BUF_ERROR && stream.avail_in == 0) {
+                result.error = "truncated gzip member";
+                break;
+            }
+        } while (res == Z_OK || res == Z_BUF_ERROR);
+
+        if (!result.error.empty())
+            break;
+
+        if (res != Z_STREAM_END) {
+            result.error = stream.msg ? stream.msg : "corrupt gzip member";
+            break;
+        }
+
+        pos = (const char *)stream.next_in - data;
+        result.end = pos;
+    } while (pos < stopAfter && pos < size);
+
+    result.data.resize(used);
+    return result;
+}
+
+size_t
+parallel_gzip_streambuf::
+findMemberHeader(const char * data, size_t size, size_t start)
+{
+    // Shortest possible member: 10 byte header, empty deflate stream and
+    // 8 byte trailer
+    enum { MIN_MEMBER = 20 };
+
+    const char * end = data + size;
+
+    for (const char * p = data + start;  p < end;  ++p) {
+        p = (const char *)memchr(p, 0x1f, end - p);
+        if (!p) break;
+        if (end - p < MIN_MEMBER) break;
+
+        // Magic, deflate method and no reserved flags
+        if ((uint8_t)p[1] == 0x8b && p[2] == 8 && ((uint8_t)p[3] & 0xe0) == 0)
+            return p - data;
+    }
+
+    return size;
+}
+
+void
+parallel_gzip_streambuf::
+startJobs()
+{
+    const char * data = file.start();
+    size_t size = file.size();
+
+    while (jobs.size() < numThreads && nextJob < size) {
+        size_t start = nextJob;
+        size_t stop = findMemberHeader(data, size,
+                                       std::min(size, start + chunkSize));
+
+        Job job;
+        job.start = start;
+        job.chunk = std::async(std::launch::async, &decompressMembers,
+                               data, size, start, stop);
+        jobs.emplace_back(std::move(job));
+
+        nextJob = stop;
+    }
+}
+
+parallel_gzip_streambuf::int_type
+parallel_gzip_streambuf::
+underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    const char * data = file.start();
+    size_t size = file.size();
+
+    while (pos < size) {
+        // A job that starts before here started in the middle of a member
+        // that has already been decompressed
+        while (!jobs.empty() && jobs.front().start < pos)
+            jobs.pop_front();
+
+        startJobs();
+
+        Chunk chunk;
+        if (!jobs.empty() && jobs.front().start == pos) {
+            chunk = jobs.front().chunk.get();
+            jobs.pop_front();
+            startJobs();
+        }
+        else {
+            size_t stopAfter = jobs.empty() ? size : jobs.front().start;
+            chunk = decompressMembers(data, size, pos, stopAfter);
+        }
+
+        if (!chunk.error.empty())
+            throw ML::Exception("decompressing %s: %s at offset %zd",
+                                file.filename().c_str(),
+                                chunk.error.c_str(), chunk.end);
+
+        pos = chunk.end;
+        current = std::move(chunk.data);
+
+        if (current.empty()) continue;
+
+        char * start = &current[0];
+        setg(start, start, start + current.size());
+        return traits_type::to_int_type(*start);
+    }
+
+    return traits_type::eof();
+}
+
+} // namespace ML
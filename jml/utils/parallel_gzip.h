@@ -0,0 +1,93 @@
+/* parallel_gzip.h                                                 -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Decompression of gzip files with several members on several threads.
+*/
+
+#ifndef __utils__parallel_gzip_h__
+#define __utils__parallel_gzip_h__
+
+#include "jml/utils/file_functions.h"
+#include <streambuf>
+#include <future>
+#include <deque>
+#include <string>
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* PARALLEL GZIP STREAMBUF                                                   */
+/*****************************************************************************/
+
+/** Input streambuf that decompresses a gzip file that is all in memory
+    (normally memory mapped) on several threads.
+
+    The members of a gzip file (as written by concatenating gzip files, or
+    by pigz or bgzip) are independent, but there is no index of where they
+    start.  The file is cut into chunks at places that look like member
+    headers, and each chunk is decompressed on its own thread, from its
+    start until the end of the first member that finishes at or after the
+    start of the next chunk.  The chunks are then joined up in order; a
+    chunk which didn't start where the previous one finished (because the
+    header was really part of the compressed data) is thrown away, and the
+    gap decompressed on the reading thread.
+
+    A file with only one member is decompressed on one thread.
+*/
+
+class parallel_gzip_streambuf : public std::streambuf {
+public:
+    parallel_gzip_streambuf(const File_Read_Buffer & file, int numThreads,
+                            size_t chunkSize = 4 * 1024 * 1024);
+
+    ~parallel_gzip_streambuf();
+
+    /** What a chunk decompressed to, and the offset in the file of the end
+        of its last member. */
+    struct Chunk {
+        Chunk()
+            : end(0)
+        {
+        }
+
+        std::string data;
+        size_t end;
+        std::string error;
+    };
+
+    /** Decompress members starting at offset start until one ends at or
+        past offset stopAfter.  Errors are returned rather than thrown, since
+        a chunk which fails may just be one that is thrown away. */
+    static Chunk decompressMembers(const char * data, size_t size,
+                                   size_t start, size_t stopAfter);
+
+    /** Offset of the first thing that looks like a gzip member header at or
+        after offset start, or size if there is none. */
+    static size_t findMemberHeader(const char * data, size_t size,
+                                   size_t start);
+
+protected:
+    virtual int_type underflow();
+
+private:
+    struct Job {
+        size_t start;
+        std::future<Chunk> chunk;
+    };
+
+    void startJobs();
+
+    File_Read_Buffer file;
+    size_t numThreads;
+    size_t chunkSize;
+
+    size_t pos;          ///< Offset in the file decompressed up to
+    size_t nextJob;      ///< Offset in the file of the next job to start
+    std::deque<Job> jobs;
+    std::string current; ///< Decompressed data being read
+};
+
+} // namespace ML
+
+#endif /* __utils__parallel_gzip_h__ */
@@ -17,6 +17,11 @@
 #include "jml/utils/file_functions.h"
 #include <cassert>
 #include <boost/scoped_array.hpp>
+#include <cstring>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
 
 
 using namespace std;
@@ -184,6 +189,60 @@ match_text(std::string & text, const char * delimiters)
     else return match_text(text, MatchAnyCharLots(delimiters, nd));
 }
 
+size_t
+Parse_Context::
+match_string_run(char * output, size_t maxLength)
+{
+    const char * start = cur_;
+    const char * end = cur_ + std::min<size_t>(ebuf_ - cur_, maxLength);
+    const char * p = start;
+
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i del = _mm_set1_epi8(0x7f);
+
+    while (end - p >= 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i *)p);
+
+        // Bytes above 0x7f are negative when compared as signed so the
+        // comparison with the space catches the control characters and the
+        // non-ASCII ones at once.
+        __m128i stop = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chars, quote),
+                             _mm_cmpeq_epi8(chars, backslash)),
+                _mm_or_si128(_mm_cmplt_epi8(chars, space),
+                             _mm_cmpeq_epi8(chars, del)));
+
+        int mask = _mm_movemask_epi8(stop);
+        if (mask) {
+            p += __builtin_ctz(mask);
+            end = p;
+            break;
+        }
+        p += 16;
+    }
+#endif
+
+    for (; p < end;  ++p) {
+        char c = *p;
+        if (c < ' ' || c > '~' || c == '"' || c == '\\') break;
+    }
+
+    // No newlines in the run so only the column moves.
+    size_t n = p - start;
+    memcpy(output, start, n);
+    cur_ = p;
+    ofs_ += n;
+    col_ += n;
+
+    if (n && cur_ == ebuf_)
+        next_buffer();
+
+    return n;
+}
+
 std::string
 Parse_Context::
 expect_text(char delimiter, bool allow_empty, const char * error)
@@ -145,7 +145,24 @@ struct Parse_Context {
         if (eof()) exception("unexpected EOF");
         return *cur_;
     }
-    
+
+    /** The characters from the current one to the end of the current
+        buffer, for code that looks at several of them at once.  The
+        pointer is only valid until the context is next moved. */
+    const char * buffer_ptr() const { return cur_; }
+    size_t buffer_left() const { return ebuf_ - cur_; }
+
+    /** Skip n characters of the current buffer, none of which may be a
+        newline. */
+    JML_ALWAYS_INLINE void skip_in_buffer(size_t n)
+    {
+        ofs_ += n;  col_ += n;
+
+        cur_ += n;
+        if (JML_UNLIKELY(cur_ == ebuf_))
+            next_buffer();
+    }
+
     /** Match a literal character.  Return true if matched or false if not.
         Never throws.
     */
@@ -267,6 +284,18 @@ struct Parse_Context {
 
     bool match_text(std::string & text, const char * delimiters);
 
+    /** Copy the run of printable ASCII characters (' ' to '~') at the current
+        position, up to but not including the first double quote or
+        backslash, into output and move past it.  The run also stops at the
+        end of the current buffer or after maxLength characters.  Returns the
+        number of characters copied, which may be zero.
+
+        This is the inner loop of string parsing: the bulk of a string is
+        scanned 16 characters at a time and the caller deals with whatever
+        stopped the run one character at a time.
+    */
+    size_t match_string_run(char * output, size_t maxLength);
+
     std::string expect_text(char delimiter,
                             bool allow_empty = true,
                             const char * error = "expected text");
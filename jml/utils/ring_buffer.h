@@ -11,7 +11,10 @@
 
 #include <vector>
 #include "jml/arch/futex.h"
+#include "jml/compiler/compiler.h"
 #include "jml/arch/spinlock.h"
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <thread>
 
@@ -396,6 +399,139 @@ struct RingBufferSRMW : public RingBufferBase<Request> {
     }
 };
 
+
+/*****************************************************************************/
+/* RING BUFFER MULTIPLE PRODUCERS SINGLE CONSUMER                            */
+/*****************************************************************************/
+
+/** Bounded lock-free ring buffer for any number of producers and a single
+    consumer.
+
+    Each cell carries a sequence number that tells whose turn it is:
+    producers claim a position with a compare and swap on writePosition and
+    publish the cell by bumping its sequence, so they never wait on each
+    other unless the ring is full.  The consumer owns readPosition.
+
+    The size is rounded up to a power of two.  Unlike the other ring
+    buffers there is no futex to block on; callers that need to sleep
+    pair it with a wakeup fd (see TypedMessageRingSink).
+*/
+template<typename Request>
+struct RingBufferMPSC {
+
+    RingBufferMPSC(size_t size)
+        : writePosition(0), readPosition(0)
+    {
+        size_t numCells = 2;
+        while (numCells < size)
+            numCells *= 2;
+
+        cells.reset(new Cell[numCells]);
+        mask = numCells - 1;
+        for (size_t i = 0;  i < numCells;  ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    RingBufferMPSC(const RingBufferMPSC & other) = delete;
+    RingBufferMPSC & operator = (const RingBufferMPSC & other) = delete;
+
+    bool tryPush(const Request & request)
+    {
+        Request copy(request);
+        return tryPush(std::move(copy));
+    }
+
+    /** Request is only moved from if the push succeeds. */
+    bool tryPush(Request && request)
+    {
+        uint64_t pos = writePosition.load(std::memory_order_relaxed);
+
+        for (;;) {
+            Cell & cell = cells[pos & mask];
+            uint64_t seq = cell.sequence.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)seq - (int64_t)pos;
+
+            if (diff == 0) {
+                if (writePosition.compare_exchange_weak
+                        (pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(request);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false;  // consumer hasn't freed that cell yet: full
+            else pos = writePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    /** Spins until there is room. */
+    void push(Request && request)
+    {
+        while (!tryPush(std::move(request)))
+            std::this_thread::yield();
+    }
+
+    void push(const Request & request)
+    {
+        Request copy(request);
+        push(std::move(copy));
+    }
+
+    /** Consumer only. */
+    bool tryPop(Request & result)
+    {
+        uint64_t pos = readPosition.load(std::memory_order_relaxed);
+        Cell & cell = cells[pos & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+            return false;
+
+        result = std::move(cell.value);
+        cell.value = Request();
+        cell.sequence.store(pos + mask + 1, std::memory_order_release);
+        readPosition.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /** Consumer only.  Calls onRequest on up to maxRequests requests in
+        order and returns how many there were.
+    */
+    template<typename Fn>
+    size_t popBatch(Fn && onRequest, size_t maxRequests)
+    {
+        size_t done = 0;
+        Request request;
+        while (done < maxRequests && tryPop(request)) {
+            onRequest(std::move(request));
+            request = Request();
+            ++done;
+        }
+        return done;
+    }
+
+    bool couldPop() const
+    {
+        uint64_t pos = readPosition.load(std::memory_order_relaxed);
+        return cells[pos & mask].sequence.load(std::memory_order_acquire)
+            == pos + 1;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        Request value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    uint64_t mask;
+
+    // Producers and consumer on separate cache lines
+    std::atomic<uint64_t> writePosition JML_ALIGNED(64);
+    std::atomic<uint64_t> readPosition JML_ALIGNED(64);
+};
+
 } // namespace ML
 
 #endif /* __jml_utils__ring_buffer_h__ */
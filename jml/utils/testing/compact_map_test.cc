@@ -0,0 +1,125 @@
+/* compact_map_test.cc
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+   Test for the compact_map class.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "jml/utils/compact_map.h"
+#include "jml/db/persistent.h"
+
+#include <boost/test/unit_test.hpp>
+#include <map>
+#include <memory>
+#include <iostream>
+
+
+using namespace std;
+using namespace ML;
+
+typedef compact_map<string, int, 3> TestMap;
+
+/* Compare against a std::map run through the same operations. */
+void checkSame(const TestMap & m, const map<string, int> & ref)
+{
+    BOOST_REQUIRE_EQUAL(m.size(), ref.size());
+    BOOST_CHECK_EQUAL(m.empty(), ref.empty());
+
+    auto it = m.begin();
+    for (auto & entry: ref) {
+        BOOST_CHECK_EQUAL(it->first, entry.first);
+        BOOST_CHECK_EQUAL(it->second, entry.second);
+        BOOST_CHECK(m.find(entry.first) == it);
+        BOOST_CHECK_EQUAL(m.count(entry.first), 1);
+        BOOST_CHECK_EQUAL(m.at(entry.first), entry.second);
+        ++it;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_compact_map_against_map )
+{
+    TestMap m;
+    map<string, int> ref;
+
+    srand(1);
+    for (unsigned i = 0;  i < 5000;  ++i) {
+        // Long enough keys not to fit in the small string buffer
+        string key = "a fairly long key number " + to_string(rand() % 12);
+        int value = rand();
+
+        switch (rand() % 4) {
+        case 0: {
+            auto res = m.insert(make_pair(key, value));
+            auto res2 = ref.insert(make_pair(key, value));
+            BOOST_CHECK_EQUAL(res.second, res2.second);
+            BOOST_CHECK_EQUAL(res.first->second, res2.first->second);
+            break;
+        }
+        case 1:
+            m[key] = value;
+            ref[key] = value;
+            break;
+        case 2:
+            BOOST_CHECK_EQUAL(m.erase(key), ref.erase(key));
+            break;
+        case 3: {
+            TestMap copy = m;
+            m.clear();
+            m = std::move(copy);
+            break;
+        }
+        }
+
+        checkSame(m, ref);
+        BOOST_CHECK_EQUAL(m.count("missing"), 0);
+        BOOST_CHECK(m.find("missing") == m.end());
+    }
+
+    BOOST_CHECK_THROW(m.at("missing"), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE( test_compact_map_shared_ptr_values )
+{
+    compact_map<string, std::shared_ptr<int>, 2> m;
+    auto p = std::make_shared<int>(3);
+
+    for (unsigned i = 0;  i < 10;  ++i)
+        m[to_string(i)] = p;
+    BOOST_CHECK_EQUAL(p.use_count(), 11);
+
+    for (unsigned i = 0;  i < 10;  i += 2)
+        m.erase(to_string(i));
+    BOOST_CHECK_EQUAL(p.use_count(), 6);
+
+    m.clear();
+    BOOST_CHECK_EQUAL(p.use_count(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_compact_map_serialization )
+{
+    map<string, int> ref = { { "xchg", 1 }, { "prov", 2 }, { "other", 3 } };
+    TestMap m(ref.begin(), ref.end());
+
+    // The format is the same as the one of std::map
+    ostringstream stream;
+    {
+        DB::Store_Writer store(stream);
+        store << m;
+    }
+
+    ostringstream refStream;
+    {
+        DB::Store_Writer store(refStream);
+        store << ref;
+    }
+
+    BOOST_CHECK_EQUAL(stream.str(), refStream.str());
+
+    istringstream istream(stream.str());
+    DB::Store_Reader store(istream);
+    TestMap m2;
+    store >> m2;
+    checkSame(m2, ref);
+}
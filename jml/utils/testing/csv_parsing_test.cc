@@ -12,6 +12,7 @@
 #include "jml/utils/csv.h"
 #include "jml/utils/vector_utils.h"
 #include "jml/utils/parse_context.h"
+#include "jml/arch/format.h"
 
 #include <sstream>
 #include <fstream>
@@ -42,3 +43,100 @@ BOOST_AUTO_TEST_CASE (test1)
     testCsvLine("\"\",", {"",""});
     testCsvLine("\"\",\"\"", {"",""});
 }
+
+namespace {
+
+vector<vector<string> > parseSequentially(const std::string & data)
+{
+    vector<vector<string> > result;
+    ML::Parse_Context context(data, data.c_str(), data.c_str() + data.size());
+    while (context)
+        result.push_back(expect_csv_row(context));
+    return result;
+}
+
+vector<vector<string> > readChunked(const std::string & data,
+                                    int numThreads, size_t chunkSize)
+{
+    vector<vector<string> > result;
+    istringstream stream(data);
+    for_each_csv_row(stream,
+                     [&] (vector<string> & row, size_t rowNum)
+                     {
+                         BOOST_CHECK_EQUAL(rowNum, result.size());
+                         result.emplace_back();
+                         result.back().swap(row);
+                     },
+                     ',', numThreads, chunkSize);
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE (test_chunked_reader_same_as_sequential)
+{
+    string data;
+    for (unsigned i = 0;  i < 2000;  ++i) {
+        switch (i % 7) {
+        case 0: data += format("%d,hello,%f\n", i, i * 0.5);  break;
+        case 1: data += format("\"quoted, with comma\",\"%d\"\n", i);  break;
+        case 2: data += "\"multi\nline \"\"field\"\"\",x\r\n";  break;
+        case 3: data += "\n";  break;
+        case 4: data += "  leading,blanks,,\n";  break;
+        case 5: data += format("a-very-long-field-to-span-scan-words-%d\n", i);
+            break;
+        case 6: data += "\"\",\"\"\n";  break;
+        }
+    }
+    data += "last,row,without,newline";
+
+    auto expected = parseSequentially(data);
+    BOOST_CHECK_EQUAL(expected.size(), 2001);
+
+    for (int numThreads: { 1, 4 }) {
+        for (size_t chunkSize: { 1, 7, 64, 4096, 1 << 20 }) {
+            BOOST_TEST_CHECKPOINT(format("%d threads, chunk %zd",
+                                         numThreads, chunkSize));
+            BOOST_CHECK(readChunked(data, numThreads, chunkSize) == expected);
+        }
+    }
+
+    vector<vector<string> > rows;
+    BOOST_CHECK_EQUAL(parse_csv_rows(data.c_str(), data.c_str() + data.size(),
+                                     rows), "");
+    BOOST_CHECK(rows == expected);
+}
+
+BOOST_AUTO_TEST_CASE (test_chunked_reader_errors)
+{
+    string data;
+    for (unsigned i = 0;  i < 1000;  ++i)
+        data += format("%d,ok\n", i);
+    data += "1000,bad\"quote\n1001,ok\n";
+
+    for (int numThreads: { 1, 4 }) {
+        size_t handled = 0;
+        istringstream stream(data);
+        try {
+            for_each_csv_row(stream,
+                             [&] (vector<string> & row, size_t rowNum)
+                             {
+                                 ++handled;
+                             },
+                             ',', numThreads, 100);
+            BOOST_CHECK(false);
+        } catch (const std::exception & exc) {
+            BOOST_CHECK_EQUAL(exc.what(),
+                              string("CSV row 1000: non-quoted string with "
+                                     "embedded quote"));
+        }
+        BOOST_CHECK_EQUAL(handled, 1000);
+    }
+
+    vector<vector<string> > rows;
+    string quoted = "a,\"unfinished\nb,c\n";
+    BOOST_CHECK_EQUAL(parse_csv_rows(quoted.c_str(),
+                                     quoted.c_str() + quoted.size(), rows),
+                      "file finished inside quote");
+    BOOST_CHECK_EQUAL(rows.size(), 0);
+}
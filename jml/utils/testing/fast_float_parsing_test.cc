@@ -0,0 +1,227 @@
+/* fast_float_parsing_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test that the fast float and integer parsing gives the same results as
+   strtod and strtoull, and how fast it is.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "jml/utils/parse_context.h"
+#include "jml/arch/format.h"
+#include "jml/arch/timers.h"
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace ML;
+using namespace std;
+
+namespace {
+
+uint64_t bits(double d)
+{
+    uint64_t result;
+    memcpy(&result, &d, 8);
+    return result;
+}
+
+void checkLikeStrtod(const std::string & s)
+{
+    BOOST_TEST_CHECKPOINT(s);
+
+    char * end = 0;
+    double expected = strtod(s.c_str(), &end);
+    BOOST_REQUIRE(end == s.c_str() + s.size());
+
+    Parse_Context context(s, s.c_str(), s.c_str() + s.size());
+    double parsed = context.expect_double();
+    BOOST_CHECK(context.eof());
+
+    if (bits(parsed) != bits(expected))
+        BOOST_CHECK_EQUAL(s, format("%.17g", parsed));
+}
+
+/** A random number with the given numbers of digits before and after the
+    point, and optionally an exponent. */
+std::string randomNumber(int intDigits, int fractionDigits, int exponent,
+                         bool withExponent)
+{
+    string result;
+    if (random() % 4 == 0)
+        result += '-';
+    for (int i = 0;  i < intDigits;  ++i)
+        result += '0' + random() % 10;
+    if (fractionDigits) {
+        result += '.';
+        for (int i = 0;  i < fractionDigits;  ++i)
+            result += '0' + random() % 10;
+    }
+    if (withExponent)
+        result += format("e%d", exponent);
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_float_parsing_like_strtod )
+{
+    for (string s: { "0", "-0", "0.0", "1", "1.5", "0.1", "0.3", ".5", "5.",
+                     "1e22", "1e23", "1e-22", "1e-23", "1.5e-3", "1E+5",
+                     "9007199254740992", "9007199254740993",
+                     "123456789012345678", "1234567890123456789",
+                     "12345678901234567890", "0.000000000000000000001",
+                     "3.14159265358979323846264338327950288",
+                     "2.2250738585072014e-308", "4.9e-324", "1.7976931348623157e308",
+                     "1e400", "1e-400", "0e400", "0.1e-5", "1234.5678e2",
+                     "0.1234", "1.23", "99.99", "0.000015" }) {
+        checkLikeStrtod(s);
+    }
+
+    srandom(1);
+    for (unsigned i = 0;  i < 100000;  ++i) {
+        int intDigits = random() % 21;
+        int fractionDigits = random() % 21;
+        if (intDigits + fractionDigits == 0)
+            intDigits = 1;
+        bool withExponent = random() % 3 == 0;
+        int exponent = random() % 61 - 30;
+        checkLikeStrtod(randomNumber(intDigits, fractionDigits, exponent,
+                                     withExponent));
+    }
+
+    // Things that aren't all parsed; the context is left after the number
+    for (string s: { "1.5.3", "1e", "1e+", "2.5x", "7-" }) {
+        BOOST_TEST_CHECKPOINT(s);
+        char * end = 0;
+        double expected = strtod(s.c_str(), &end);
+        Parse_Context context(s, s.c_str(), s.c_str() + s.size());
+        BOOST_CHECK_EQUAL(context.expect_double(), expected);
+        BOOST_CHECK_EQUAL(context.get_offset(), end - s.c_str());
+    }
+
+    for (string s: { "", "-", ".", "e5", "x" }) {
+        BOOST_TEST_CHECKPOINT(s);
+        Parse_Context context(s, s.c_str(), s.c_str() + s.size());
+        double d;
+        BOOST_CHECK(!context.match_double(d));
+        BOOST_CHECK_EQUAL(context.get_offset(), 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_int_parsing_like_strtoull )
+{
+    srandom(2);
+    for (unsigned i = 0;  i < 100000;  ++i) {
+        string s;
+        int digits = 1 + random() % 20;
+        for (int j = 0;  j < digits;  ++j)
+            s += '0' + random() % 10;
+        BOOST_TEST_CHECKPOINT(s);
+
+        errno = 0;
+        unsigned long long expected = strtoull(s.c_str(), 0, 10);
+        if (errno == ERANGE)
+            continue;
+
+        Parse_Context context(s, s.c_str(), s.c_str() + s.size());
+        BOOST_CHECK_EQUAL(context.expect_unsigned_long_long(), expected);
+        BOOST_CHECK(context.eof());
+    }
+
+    string s = "12345678x-987654321 ";
+    Parse_Context context("test", s.c_str(), s.c_str() + s.size());
+    BOOST_CHECK_EQUAL(context.expect_unsigned_long(), 12345678);
+    context.expect_literal('x');
+    BOOST_CHECK_EQUAL(context.expect_long(), -987654321);
+    BOOST_CHECK_EQUAL(context.get_col(), 20);
+}
+
+BOOST_AUTO_TEST_CASE( test_parsing_across_buffers )
+{
+    // Small chunks so that the numbers are split between buffers
+    string numbers;
+    vector<double> expected;
+    srandom(3);
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        string s = randomNumber(1 + random() % 12, random() % 10, 0, false);
+        numbers += s + " ";
+        expected.push_back(strtod(s.c_str(), 0));
+    }
+
+    for (size_t chunkSize: { 1, 3, 7, 8, 9, 64 }) {
+        BOOST_TEST_CHECKPOINT(chunkSize);
+        istringstream stream(numbers);
+        Parse_Context context("numbers", stream, 1, 1, chunkSize);
+        for (double d: expected) {
+            BOOST_CHECK_EQUAL(context.expect_double(), d);
+            context.expect_literal(' ');
+        }
+        BOOST_CHECK(context.eof());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_parsing_speed )
+{
+    vector<string> prices, longs, ints;
+    srandom(4);
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        prices.push_back(format("%d.%02d", (int)(random() % 100),
+                                (int)(random() % 100)));
+        longs.push_back(randomNumber(1 + random() % 8, 9 + random() % 8,
+                                     0, false));
+        ints.push_back(format("%lld", (long long)random() * random()));
+    }
+
+    auto profile = [] (const std::string & what, const vector<string> & strs,
+                       std::function<double (Parse_Context &)> parse)
+        {
+            string all;
+            for (auto & s: strs)
+                all += s + " ";
+
+            double total = 0;
+            size_t n = 0;
+            Timer timer;
+            for (unsigned i = 0;  i < 1000;  ++i) {
+                Parse_Context context(what, all.c_str(),
+                                      all.c_str() + all.size());
+                while (context) {
+                    total += parse(context);
+                    context.expect_literal(' ');
+                    ++n;
+                }
+            }
+            double elapsed = timer.elapsed_wall();
+            cerr << what << ": " << n / elapsed << " per second"
+                 << " (checksum " << total << ")" << endl;
+        };
+
+    auto strtodProfile = [] (const std::string & what,
+                             const vector<string> & strs)
+        {
+            double total = 0;
+            size_t n = 0;
+            Timer timer;
+            for (unsigned i = 0;  i < 1000;  ++i) {
+                for (auto & s: strs) {
+                    total += strtod(s.c_str(), 0);
+                    ++n;
+                }
+            }
+            double elapsed = timer.elapsed_wall();
+            cerr << what << ": " << n / elapsed << " per second"
+                 << " (checksum " << total << ")" << endl;
+        };
+
+    auto parseDouble = [] (Parse_Context & c) { return c.expect_double(); };
+
+    profile("prices", prices, parseDouble);
+    strtodProfile("prices with strtod", prices);
+    profile("long fractions", longs, parseDouble);
+    strtodProfile("long fractions with strtod", longs);
+    profile("integers", ints,
+            [] (Parse_Context & c) { return c.expect_unsigned_long_long(); });
+}
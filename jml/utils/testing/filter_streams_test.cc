@@ -12,11 +12,15 @@
 
 #include "jml/utils/file_functions.h"
 #include "jml/utils/filter_streams.h"
+#include "jml/utils/parallel_gzip.h"
+#include "jml/utils/lz4_filter.h"
 #include "jml/arch/exception.h"
 #include "jml/arch/exception_handler.h"
 
 #include <boost/filesystem.hpp>
 #include <boost/iostreams/stream_buffer.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/file.hpp>
 #include <boost/test/unit_test.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/barrier.hpp>
@@ -560,3 +564,160 @@ BOOST_AUTO_TEST_CASE(test_filter_stream_exceptions_destruction_istream)
 }
 
 #endif
+
+/* Incompressible data, with things that look like gzip headers in it.
+   These end up in the stored blocks of a gzip member. */
+string random_data(size_t size, int seed)
+{
+    string result(size, 0);
+    srandom(seed);
+    for (unsigned i = 0;  i < size;  ++i)
+        result[i] = random();
+    for (unsigned i = 1000;  i + 10 < size;  i += 40000)
+        result.replace(i, 4, "\x1f\x8b\x08\x00");
+    return result;
+}
+
+string read_all(const string & filename,
+                const std::map<string, string> & options)
+{
+    ML::filter_istream stream(filename, options);
+    return stream.readAll();
+}
+
+BOOST_AUTO_TEST_CASE( test_mapped_read )
+{
+    fs::create_directories("build/x86_64/tmp");
+    string filename = "build/x86_64/tmp/mapped.txt";
+    FileCleanup cleanup(filename);
+
+    string text;
+    for (unsigned i = 0;  i < 100000;  ++i)
+        text += "line " + to_string(i) + "\n";
+
+    {
+        ML::filter_ostream stream(filename);
+        stream << text;
+    }
+
+    BOOST_CHECK_EQUAL(read_all(filename, {}), text);
+    BOOST_CHECK_EQUAL(read_all(filename, { { "mapped", "false" } }), text);
+
+    {
+        ML::filter_istream stream(filename);
+        string line;
+        getline(stream, line);
+        BOOST_CHECK_EQUAL(line, "line 0");
+
+        stream.seekg(text.find("line 5000\n"));
+        getline(stream, line);
+        BOOST_CHECK_EQUAL(line, "line 5000");
+
+        stream.seekg(-11, ios::end);
+        getline(stream, line);
+        BOOST_CHECK_EQUAL(line, "line 99999");
+        BOOST_CHECK(stream);
+        getline(stream, line);
+        BOOST_CHECK(stream.eof());
+    }
+
+    {
+        ML::filter_ostream stream(filename);
+    }
+    BOOST_CHECK_EQUAL(read_all(filename, {}), "");
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_lz4 )
+{
+    fs::create_directories("build/x86_64/tmp");
+    string filename = "build/x86_64/tmp/parallel.lz4";
+    FileCleanup cleanup(filename);
+
+    // Two frames: one with 64k blocks, and one with 4M blocks, each
+    // with some compressible text and some incompressible data
+    string text;
+    for (unsigned i = 0;  i < 200000;  ++i)
+        text += "line " + to_string(i) + "\n";
+    string data1 = text + random_data(5000000, 1);
+    string data2 = random_data(9000000, 2) + text;
+
+    {
+        boost::iostreams::filtering_ostream stream;
+        stream.push(lz4_compressor(0, 4));
+        stream.push(boost::iostreams::file_sink(filename));
+        stream << data1;
+    }
+    {
+        ML::filter_ostream stream(filename, ios::out | ios::app);
+        stream << data2;
+    }
+
+    string expected = data1 + data2;
+
+    BOOST_CHECK(read_all(filename, {}) == expected);
+    for (string threads: { "2", "8" })
+        BOOST_CHECK(read_all(filename, { { "num-threads", threads } })
+                    == expected);
+
+    // Corrupt a block in the middle
+    {
+        int fd = open(filename.c_str(), O_RDWR);
+        BOOST_REQUIRE(fd != -1);
+        BOOST_REQUIRE_EQUAL(pwrite(fd, "garbage", 7, 1000000), 7);
+        close(fd);
+    }
+
+    JML_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(read_all(filename, { { "num-threads", "4" } }),
+                      std::exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_gzip )
+{
+    fs::create_directories("build/x86_64/tmp");
+    string filename = "build/x86_64/tmp/parallel.gz";
+    FileCleanup cleanup(filename);
+
+    string expected;
+    for (unsigned i = 0;  i < 12;  ++i) {
+        string member = random_data(i * 317000, i);
+        if (i % 3 == 0)
+            for (unsigned j = 0;  j < 100000;  ++j)
+                member += "line " + to_string(j) + "\n";
+
+        ML::filter_ostream stream(filename, ios::out | ios::app);
+        stream << member;
+        expected += member;
+    }
+
+    BOOST_CHECK(read_all(filename, {}) == expected);
+    for (string threads: { "2", "8" })
+        BOOST_CHECK(read_all(filename, { { "num-threads", threads } })
+                    == expected);
+    BOOST_CHECK(read_all(filename, { { "num-threads", "4" },
+                                     { "mapped", "false" } })
+                == expected);
+
+    // Small chunks, so that most of them start on a false header or in
+    // the middle of a member
+    File_Read_Buffer file(filename);
+    for (size_t chunkSize: { 1000, 100000, 1000000 }) {
+        parallel_gzip_streambuf buf(file, 4, chunkSize);
+        std::istream stream(&buf);
+        string result((std::istreambuf_iterator<char>(stream)),
+                      std::istreambuf_iterator<char>());
+        BOOST_CHECK(result == expected);
+    }
+
+    // Truncated file
+    {
+        JML_TRACE_EXCEPTIONS(false);
+        File_Read_Buffer truncated(file.start(), file.size() - 5);
+        parallel_gzip_streambuf buf(truncated, 4, 100000);
+        std::istream stream(&buf);
+        stream.exceptions(ios::badbit);
+        BOOST_CHECK_THROW(string((std::istreambuf_iterator<char>(stream)),
+                                 std::istreambuf_iterator<char>()),
+                          std::exception);
+    }
+}
@@ -14,6 +14,8 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/test/auto_unit_test.hpp>
 #include <math.h>
+#include <memory>
+#include <sstream>
 
 using namespace ML;
 
@@ -86,3 +88,68 @@ BOOST_AUTO_TEST_CASE( test1 )
     BOOST_CHECK_THROW(testHex4("002G", 2), std::exception);
     BOOST_CHECK_THROW(testHex4("002.", 2), std::exception);
 }
+
+BOOST_AUTO_TEST_CASE( test_string_runs )
+{
+    // Strings long enough to go through the bulk scanning with the special
+    // characters at every position in and around a block, both from memory
+    // and from a stream in chunks that are small and not a multiple of the
+    // block size.
+    for (unsigned len = 0;  len < 70;  ++len) {
+        for (unsigned special = 0;  special <= len;  ++special) {
+            std::string expected(len, 'a');
+            for (unsigned i = 0;  i < len;  ++i)
+                expected[i] = 'a' + i % 26;
+
+            std::string json = "\"" + expected.substr(0, special);
+            if (special < len) {
+                json += "\\n";
+                expected[special] = '\n';
+                json += expected.substr(special + 1);
+            }
+            json += "\" ,";
+
+            for (unsigned chunk: { 0, 3, 17 }) {
+                std::istringstream stream(json);
+                std::unique_ptr<Parse_Context> context;
+                if (chunk)
+                    context.reset(new Parse_Context("test", stream, 1, 1, chunk));
+                else context.reset(new Parse_Context("test", json.c_str(),
+                                                     json.c_str() + json.size()));
+
+                BOOST_CHECK_EQUAL(expectJsonStringAscii(*context), expected);
+                BOOST_CHECK_EQUAL(context->get_offset(), json.size() - 2);
+                BOOST_CHECK_EQUAL(context->get_col(), json.size() - 1);
+                context->expect_literal(" ,");
+                context->expect_eof();
+            }
+
+            {
+                Parse_Context context("test", json.c_str(),
+                                      json.c_str() + json.size());
+                BOOST_CHECK_EQUAL(expectJsonString(context), expected);
+            }
+
+            {
+                char buffer[32];
+                Parse_Context context("test", json.c_str(),
+                                      json.c_str() + json.size());
+                ssize_t res = expectJsonStringAscii(context, buffer, 32);
+                if (len < 32) {
+                    BOOST_CHECK_EQUAL(res, len);
+                    BOOST_CHECK_EQUAL(std::string(buffer), expected);
+                }
+                else BOOST_CHECK_EQUAL(res, -1);
+            }
+        }
+    }
+
+    // Non-ASCII characters stop the bulk copy and are handled as before.
+    std::string utf8 = "\"0123456789abcdef\xc3\xa9" "0123456789abcdef\"";
+    Parse_Context context("test", utf8.c_str(), utf8.c_str() + utf8.size());
+    BOOST_CHECK_EQUAL(expectJsonString(context), utf8.substr(1, utf8.size() - 2));
+
+    Parse_Context asciiContext("test", utf8.c_str(), utf8.c_str() + utf8.size());
+    JML_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(expectJsonStringAscii(asciiContext), std::exception);
+}
@@ -0,0 +1,134 @@
+/* lightweight_hash_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Compares the linear probing Lightweight_Hash with the group probing one
+   (GroupMemStorage) over a range of load factors: the time per lookup, and
+   the number of full key comparisons each lookup makes, for keys that are
+   there and keys that aren't.
+
+   Usage: lightweight_hash_bench [log2 capacity]
+*/
+
+#include "jml/utils/lightweight_hash.h"
+#include "jml/arch/format.h"
+#include "jml/arch/timers.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdlib.h>
+
+
+using namespace std;
+using namespace ML;
+
+
+namespace {
+
+typedef Lightweight_Hash<uint64_t, uint64_t> Linear_Hash;
+
+typedef Lightweight_Hash<uint64_t, uint64_t,
+                         std::pair<uint64_t, uint64_t>,
+                         std::pair<const uint64_t, uint64_t>,
+                         PairOps<uint64_t, uint64_t>,
+                         GroupMemStorage<std::pair<uint64_t, uint64_t> > >
+Group_Hash;
+
+/* Stops the compiler from throwing away the lookups. */
+volatile uint64_t sink;
+
+struct Result {
+    double ns;
+    double meanProbe;
+    size_t maxProbe;
+};
+
+template<class Hash>
+Result time_lookups(const Hash & hash, const vector<uint64_t> & keys)
+{
+    Result result;
+
+    uint64_t total = 0;
+    Timer timer;
+    for (auto key: keys) {
+        auto it = hash.find(key);
+        if (it != hash.end()) total += it->second;
+    }
+    result.ns = timer.elapsed_wall() * 1e9 / keys.size();
+    sink = total;
+
+    size_t probes = 0;
+    result.maxProbe = 0;
+    for (auto key: keys) {
+        size_t n = hash.probe_length(key);
+        probes += n;
+        result.maxProbe = std::max(result.maxProbe, n);
+    }
+    result.meanProbe = 1.0 * probes / keys.size();
+
+    return result;
+}
+
+template<class Hash>
+void run(const string & name, double load, size_t capacity,
+         const vector<uint64_t> & present, const vector<uint64_t> & absent)
+{
+    size_t n = load * capacity;
+
+    Hash hash;
+    hash.reserve(capacity);
+    for (unsigned i = 0;  i < n;  ++i)
+        hash[present[i]] = i;
+
+    cout << format("%-8s %5.3f", name.c_str(), load);
+
+    if (hash.capacity() != capacity) {
+        cout << "   (expands at this load)" << endl;
+        return;
+    }
+
+    vector<uint64_t> hits(present.begin(), present.begin() + n);
+    std::random_shuffle(hits.begin(), hits.end());
+    vector<uint64_t> misses(absent.begin(), absent.begin() + n);
+
+    Result hit = time_lookups(hash, hits);
+    Result miss = time_lookups(hash, misses);
+
+    cout << format(" %8.2f %6.2f %6zd %8.2f %6.2f %6zd",
+                   hit.ns, hit.meanProbe, hit.maxProbe,
+                   miss.ns, miss.meanProbe, miss.maxProbe)
+         << endl;
+}
+
+} // file scope
+
+int main(int argc, char ** argv)
+{
+    int bits = argc > 1 ? atoi(argv[1]) : 20;
+
+    size_t capacity = 1ULL << bits;
+
+    /* Keys that are looked up and found have the top bit clear; the ones
+       that aren't found have it set. */
+    vector<uint64_t> present(capacity), absent(capacity);
+    srandom(1);
+    for (unsigned i = 0;  i < capacity;  ++i) {
+        uint64_t r1 = (uint64_t)random() << 31 ^ random();
+        uint64_t r2 = (uint64_t)random() << 31 ^ random();
+        present[i] = (r1 & ~(1ULL << 63)) | 1;
+        absent[i] = r2 | (1ULL << 63);
+    }
+
+    cout << capacity << " buckets" << endl;
+    cout << format("%-8s %5s %22s %22s", "table", "load",
+                   "------- found --------", "------ not found -----")
+         << endl;
+    cout << format("%-8s %5s %8s %6s %6s %8s %6s %6s", "", "",
+                   "ns", "probes", "max", "ns", "probes", "max")
+         << endl;
+
+    for (double load: { 0.25, 0.5, 0.625, 0.75, 0.8125, 0.875 }) {
+        run<Linear_Hash>("linear", load, capacity, present, absent);
+        run<Group_Hash>("group", load, capacity, present, absent);
+    }
+}
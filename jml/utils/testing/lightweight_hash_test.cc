@@ -18,6 +18,7 @@
 #include "jml/arch/exception_handler.h"
 #include "jml/arch/demangle.h"
 #include <set>
+#include <map>
 #include "live_counting_obj.h"
 
 using namespace ML;
@@ -191,3 +192,153 @@ BOOST_AUTO_TEST_CASE(test_set)
     BOOST_CHECK_EQUAL_COLLECTIONS(objects.begin(), objects.end(),
                                   obj3.begin(), obj3.end());
 }
+
+BOOST_AUTO_TEST_CASE(test3_group)
+{
+    int nobj = 100;
+
+    vector<void *> objects;
+        
+    for (unsigned j = 0;  j < nobj;  ++j)
+        objects.push_back(malloc(50));
+    
+    Lightweight_Hash<void *, Entry,
+                     std::pair<void *, Entry>,
+                     std::pair<const void *, Entry>,
+                     PairOps<void *, Entry>,
+                     GroupMemStorage<std::pair<void *, Entry> > > h;
+
+    BOOST_CHECK_THROW(h[(void *)0].p1, ML::Exception);
+    
+    for (unsigned i = 0;  i < nobj;  ++i) {
+        h[objects[i]].val = true;
+    }
+
+    h.destroy();
+
+    for (unsigned i = 0;  i < nobj;  ++i) {
+        BOOST_CHECK(h.find(objects[i]) == h.end());
+        h[objects[i]].val = true;
+        BOOST_CHECK_EQUAL(h.size(), i + 1);
+    }
+
+    BOOST_CHECK_EQUAL(h.size(), nobj);
+
+    for (unsigned j = 0;  j < nobj;  ++j)
+        free(objects[j]);
+}
+
+/* The group probing version must behave exactly like the linear probing
+   one, apart from the order of iteration. */
+BOOST_AUTO_TEST_CASE(test_group_vs_linear)
+{
+    typedef Lightweight_Hash<int, int> Linear;
+    typedef Lightweight_Hash<int, int,
+                             std::pair<int, int>,
+                             std::pair<const int, int>,
+                             PairOps<int, int>,
+                             GroupMemStorage<std::pair<int, int> > > Group;
+
+    Linear linear;
+    Group group;
+    const Group & cgroup = group;
+
+    BOOST_CHECK_EQUAL(group.begin(), group.end());
+    BOOST_CHECK_EQUAL(cgroup.begin(), cgroup.end());
+
+    group.reserve(1);
+    BOOST_CHECK_EQUAL(group.capacity(), 16);
+    BOOST_CHECK_EQUAL(group.begin(), group.end());
+
+    srandom(1);
+    for (unsigned i = 0;  i < 20000;  ++i) {
+        // Small keys collide a lot; multiples of 1024 share all of their
+        // low bits
+        int key = (i % 3 == 0 ? (random() % 50000) * 1024
+                   : random() % 30000) + 1;
+        int value = random();
+
+        bool inserted = linear.insert(make_pair(key, value)).second;
+        BOOST_REQUIRE_EQUAL(group.insert(make_pair(key, value)).second,
+                            inserted);
+        BOOST_REQUIRE_EQUAL(group.size(), linear.size());
+        BOOST_REQUIRE(group.size() <= 7 * group.capacity() / 8);
+    }
+
+    for (int key = 0;  key < 40000;  ++key) {
+        if (key == 0) continue;
+        BOOST_REQUIRE_EQUAL(group.count(key), linear.count(key));
+        if (linear.count(key))
+            BOOST_REQUIRE_EQUAL(cgroup.find(key)->second,
+                                linear.find(key)->second);
+        else BOOST_REQUIRE(cgroup.find(key) == cgroup.end());
+    }
+
+    // Iteration visits everything exactly once, forwards and backwards
+    std::map<int, int> forwards, backwards, expected;
+    for (auto it = linear.begin();  it != linear.end();  ++it)
+        expected[it->first] = it->second;
+    for (auto it = cgroup.begin();  it != cgroup.end();  ++it)
+        BOOST_REQUIRE(forwards.insert(*it).second);
+    for (auto it = group.end();  it != group.begin();)
+        BOOST_REQUIRE(backwards.insert(*--it).second);
+
+    BOOST_CHECK(forwards == expected);
+    BOOST_CHECK(backwards == expected);
+
+    for (auto it = group.begin();  it != group.end();  ++it)
+        it->second = -it->first;
+
+    Group copy = group;
+    BOOST_CHECK_EQUAL(copy.size(), group.size());
+    for (auto it = expected.begin();  it != expected.end();  ++it)
+        BOOST_REQUIRE_EQUAL(copy[it->first], -it->first);
+
+    group.clear();
+    BOOST_CHECK(group.empty());
+    BOOST_CHECK_EQUAL(group.begin(), group.end());
+    BOOST_CHECK_EQUAL(group.count(expected.begin()->first), 0);
+    BOOST_CHECK_EQUAL(copy.size(), expected.size());
+
+    group[1] = 2;
+    BOOST_CHECK_EQUAL(group.size(), 1);
+    BOOST_CHECK_EQUAL(group.begin()->first, 1);
+    BOOST_CHECK_EQUAL(boost::next(group.begin()), group.end());
+}
+
+BOOST_AUTO_TEST_CASE(test_set_group)
+{
+    int nobj = 1000;
+
+    vector<int> objects;
+        
+    for (unsigned j = 0;  j < nobj;  ++j)
+        objects.push_back(random());
+
+    typedef Lightweight_Hash_Set<int, std::hash<int>, int,
+                                 ScalarOps<int, std::hash<int> >,
+                                 GroupMemStorage<int> > Set;
+    Set s;
+
+    for (unsigned i = 0;  i < nobj;  ++i) {
+        BOOST_CHECK_EQUAL(s.count(objects[i]), 0);
+        s.insert(objects[i]);
+        BOOST_CHECK_EQUAL(s.size(), i + 1);
+        BOOST_CHECK_EQUAL(s.count(objects[i]), 1);
+    }
+
+    BOOST_CHECK_THROW(s.insert(-1), ML::Exception);
+
+    Set s2 = s;
+
+    vector<int> obj2(s.begin(), s.end());
+    vector<int> obj3(s2.begin(), s2.end());
+    std::sort(objects.begin(), objects.end());
+    std::sort(obj2.begin(), obj2.end());
+    std::sort(obj3.begin(), obj3.end());
+    
+    BOOST_CHECK_EQUAL_COLLECTIONS(objects.begin(), objects.end(),
+                                  obj2.begin(), obj2.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(objects.begin(), objects.end(),
+                                  obj3.begin(), obj3.end());
+}
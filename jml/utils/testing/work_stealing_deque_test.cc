@@ -0,0 +1,100 @@
+/* work_stealing_deque_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test of the work stealing deque.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include "jml/utils/work_stealing_deque.h"
+
+using namespace ML;
+using namespace std;
+
+
+BOOST_AUTO_TEST_CASE( test_single_thread )
+{
+    Work_Stealing_Deque<int *> deque(4);
+    vector<int> values(100);
+
+    int * item;
+    BOOST_CHECK(!deque.pop(item));
+    BOOST_CHECK(!deque.steal(item));
+    BOOST_CHECK(deque.empty());
+
+    // More than the initial capacity, so that it grows
+    for (unsigned i = 0;  i < values.size();  ++i)
+        deque.push(&values[i]);
+    BOOST_CHECK_EQUAL(deque.size(), values.size());
+
+    // Owner is LIFO, thieves are FIFO
+    BOOST_REQUIRE(deque.pop(item));
+    BOOST_CHECK_EQUAL(item, &values[99]);
+    BOOST_REQUIRE(deque.steal(item));
+    BOOST_CHECK_EQUAL(item, &values[0]);
+
+    for (unsigned i = 98;  i > 0;  --i) {
+        BOOST_REQUIRE(deque.pop(item));
+        BOOST_CHECK_EQUAL(item, &values[i]);
+    }
+
+    BOOST_CHECK(!deque.pop(item));
+    BOOST_CHECK(deque.empty());
+}
+
+/* The owner pushes and pops while thieves steal; everything pushed must be
+   taken exactly once. */
+BOOST_AUTO_TEST_CASE( test_multithreaded )
+{
+    int nitems = 1000000;
+    int nthieves = 4;
+
+    Work_Stealing_Deque<int *> deque(16);
+    vector<int> values(nitems);
+    vector<std::atomic<int> > taken(nitems);
+    for (auto & t: taken) t = 0;
+
+    std::atomic<bool> finished(false);
+
+    auto take = [&] (int * item)
+        {
+            ++taken[item - &values[0]];
+        };
+
+    auto thief = [&] ()
+        {
+            int * item;
+            while (!finished || !deque.empty())
+                if (deque.steal(item))
+                    take(item);
+        };
+
+    vector<std::thread> threads;
+    for (unsigned i = 0;  i < nthieves;  ++i)
+        threads.emplace_back(thief);
+
+    int * item;
+    for (unsigned i = 0;  i < nitems;  ++i) {
+        deque.push(&values[i]);
+        if (i % 3 == 0 && deque.pop(item))
+            take(item);
+    }
+    while (deque.pop(item))
+        take(item);
+
+    finished = true;
+    for (auto & t: threads)
+        t.join();
+
+    int errors = 0;
+    for (unsigned i = 0;  i < nitems;  ++i)
+        if (taken[i] != 1) ++errors;
+    BOOST_CHECK_EQUAL(errors, 0);
+}
@@ -14,6 +14,7 @@
 #include <boost/bind.hpp>
 #include <vector>
 #include <stdint.h>
+#include <atomic>
 #include <iostream>
 
 #include "jml/utils/worker_task.h"
@@ -160,3 +161,63 @@ BOOST_AUTO_TEST_CASE( test_exception )
                           std::exception);
     }
 }
+
+/* Each job in the top group creates a subgroup from within the job, so that
+   the subgroup's jobs are queued on the worker thread's own deque and have
+   to be stolen by the others. */
+void test_nested_groups(int nthreads, int nouter, int ninner)
+{
+    Worker_Task worker(nthreads - 1);
+
+    std::atomic<int> jobsRun(0), groupsFinished(0);
+
+    auto innerJob = [&] () { ++jobsRun; };
+    auto groupFinished = [&] () { ++groupsFinished; };
+
+    auto outerJob = [&] (int parent)
+        {
+            int group = worker.get_group(groupFinished, "inner", parent);
+            Call_Guard guard(boost::bind(&Worker_Task::unlock_group,
+                                         boost::ref(worker),
+                                         group));
+            for (unsigned i = 0;  i < ninner;  ++i)
+                worker.add(innerJob, "inner job", group);
+        };
+
+    int group = worker.get_group(NO_JOB, "outer");
+    {
+        Call_Guard guard(boost::bind(&Worker_Task::unlock_group,
+                                     boost::ref(worker),
+                                     group));
+        for (unsigned i = 0;  i < nouter;  ++i)
+            worker.add(std::bind<void>(outerJob, group), "outer job", group);
+    }
+
+    worker.run_until_finished(group);
+
+    BOOST_CHECK_EQUAL(jobsRun, nouter * ninner);
+    BOOST_CHECK_EQUAL(groupsFinished, nouter);
+}
+
+BOOST_AUTO_TEST_CASE( test_nested )
+{
+    test_nested_groups(1, 100, 100);
+    test_nested_groups(2, 100, 100);
+    test_nested_groups(8, 100, 100);
+    test_nested_groups(32, 100, 100);
+}
+
+BOOST_AUTO_TEST_CASE( test_finish_all )
+{
+    Worker_Task worker(3);
+
+    std::atomic<int> jobsRun(0);
+    for (unsigned i = 0;  i < 1000;  ++i)
+        worker.add([&] () { ++jobsRun; }, "ungrouped job");
+
+    worker.finish_all();
+
+    BOOST_CHECK_EQUAL(jobsRun, 1000);
+    BOOST_CHECK_EQUAL(worker.finished(), 1000);
+    BOOST_CHECK_EQUAL(worker.queued(), 0);
+}
@@ -19,9 +19,10 @@ LIBUTILS_SOURCES := \
 	json_parsing.cc \
 	rng.cc \
 	hash.cc \
-	abort.cc
+	abort.cc \
+	parallel_gzip.cc
 
-LIBUTILS_LINK :=	ACE arch boost_iostreams lzma boost_thread cryptopp
+LIBUTILS_LINK :=	ACE arch boost_iostreams lzma boost_thread cryptopp z
 
 $(eval $(call library,utils,$(LIBUTILS_SOURCES),$(LIBUTILS_LINK)))
 
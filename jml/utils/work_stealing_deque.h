@@ -0,0 +1,169 @@
+/* work_stealing_deque.h                                           -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Chase-Lev work stealing deque.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* WORK_STEALING_DEQUE                                                       */
+/*****************************************************************************/
+
+/** Deque for the Chase-Lev work stealing algorithm ("Dynamic Circular
+    Work-Stealing Deque", SPAA 2005), with the memory orderings of Le et al
+    ("Correct and Efficient Work-Stealing for Weak Memory Models", PPoPP
+    2013).
+
+    A single thread, the owner, pushes and pops at the bottom, which is
+    LIFO; any number of other threads steal from the top, which is FIFO.
+    None of them ever block.  The owner's operations only synchronize with
+    the thieves when there is a single item left.
+
+    T needs to be something that can be stored in a std::atomic, normally
+    a pointer.  The buffer grows as needed; the buffers that were replaced
+    are kept until destruction, as a thief may still be reading from them.
+*/
+
+template<typename T>
+struct Work_Stealing_Deque {
+
+    Work_Stealing_Deque(size_t capacity = 256)
+        : top(0), bottom(0)
+    {
+        size_t size = 1;
+        while (size < capacity) size *= 2;
+        buffers.emplace_back(new Buffer(size));
+        buffer = buffers.back().get();
+    }
+
+    Work_Stealing_Deque(const Work_Stealing_Deque & other) = delete;
+    void operator = (const Work_Stealing_Deque & other) = delete;
+
+    /** Push onto the bottom.  Owner only. */
+    void push(T item)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Buffer * buf = buffer.load(std::memory_order_relaxed);
+        if (b - t > (int64_t)buf->mask)
+            buf = grow(buf, t, b);
+        buf->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    /** Pop the item last pushed.  Owner only.  Returns false if the deque
+        was empty.
+    */
+    bool pop(T & item)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Buffer * buf = buffer.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            // Was empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = buf->get(b);
+        if (t == b) {
+            // Last item; race the thieves for it
+            bool won = top.compare_exchange_strong(t, t + 1,
+                                                   std::memory_order_seq_cst,
+                                                   std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+
+        return true;
+    }
+
+    /** Steal the oldest item.  Any thread.  Returns false if the deque was
+        empty or another thread took the item first.
+    */
+    bool steal(T & item)
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) return false;
+
+        Buffer * buf = buffer.load(std::memory_order_acquire);
+        item = buf->get(t);
+        return top.compare_exchange_strong(t, t + 1,
+                                           std::memory_order_seq_cst,
+                                           std::memory_order_relaxed);
+    }
+
+    /** Number of items.  Only a snapshot when other threads are using the
+        deque. */
+    size_t size() const
+    {
+        int64_t b = bottom.load(std::memory_order_acquire);
+        int64_t t = top.load(std::memory_order_acquire);
+        return b > t ? b - t : 0;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+private:
+    struct Buffer {
+        Buffer(size_t size)
+            : mask(size - 1), items(new std::atomic<T>[size])
+        {
+        }
+
+        T get(int64_t index) const
+        {
+            return items[index & mask].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t index, T item)
+        {
+            items[index & mask].store(item, std::memory_order_relaxed);
+        }
+
+        size_t mask;
+        std::unique_ptr<std::atomic<T>[]> items;
+    };
+
+    Buffer * grow(Buffer * old, int64_t t, int64_t b)
+    {
+        buffers.emplace_back(new Buffer(2 * (old->mask + 1)));
+        Buffer * result = buffers.back().get();
+        for (int64_t i = t;  i < b;  ++i)
+            result->put(i, old->get(i));
+        buffer.store(result, std::memory_order_release);
+        return result;
+    }
+
+    // Separate cache lines, as the owner writes bottom and thieves top
+    std::atomic<int64_t> top;
+    char padding1[64 - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> bottom;
+    std::atomic<Buffer *> buffer;
+    char padding2[64 - sizeof(std::atomic<int64_t>) - sizeof(Buffer *)];
+
+    /** All buffers ever used; only the owner touches this. */
+    std::vector<std::unique_ptr<Buffer> > buffers;
+};
+
+
+} // namespace ML
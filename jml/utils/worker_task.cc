@@ -51,6 +51,15 @@ const Job NO_JOB;
 /* WORKER_TASK                                                               */
 /*****************************************************************************/
 
+namespace {
+
+/** The worker task whose worker thread this is, if any, and the index of
+    its queue. */
+__thread Worker_Task * current_task = 0;
+__thread int current_queue = -1;
+
+} // file scope
+
 Worker_Task &
 Worker_Task::
 instance(int thr)
@@ -61,9 +70,8 @@ instance(int thr)
 
 Worker_Task::
 Worker_Task(int threads)
-    : jobs_sem(0), finished_sem(1), state_change_sem(0), shutdown_sem(0),
-      next_group(0), next_job(0), num_queued(0),
-      num_running(0), force_finished(false)
+    : num_injected(0), external_finished(0), num_sleeping(0),
+      num_releasing(0), next_group(0), next_job(0), force_finished(false)
 {
     if (threads == -1)
         threads = num_cpus();
@@ -72,9 +80,13 @@ Worker_Task(int threads)
 
     //cerr << "creating worker task with " << threads << " threads" << endl;
 
+    /* Create the queues before any thread, as they steal from each other. */
+    for (unsigned i = 0;  i < threads;  ++i)
+        queues.emplace_back(new Worker_Queue());
+
     /* Create our threads */
     for (unsigned i = 0;  i < threads;  ++i)
-        workerThreads_.emplace_back(new std::thread(std::bind(&Worker_Task::runWorkerThread, this)));
+        workerThreads_.emplace_back(new std::thread(std::bind(&Worker_Task::runWorkerThread, this, i)));
 }
 
 Worker_Task::
@@ -83,18 +95,11 @@ Worker_Task::
     log("~Worker_Task: stopping worker task\n");
     force_finished = true;
 
-    // Wake up all tasks by providing jobs
-    for (unsigned i = 0;  i < threads_;  ++i)
-        jobs_sem.release();
-
-    /* TODO: finish all tasks */
-    if (jobs.size() || groups.size())
-        cerr << "at the end, there were " << jobs.size()
-             << " jobs outstanding and "
-             << groups.size() << " groups outstanding" << endl;
-
-    for (unsigned i = 0;  i < threads_;  ++i)
-        shutdown_sem.acquire();
+    // Wake up all threads that are waiting for jobs
+    {
+        Guard guard(sleep_lock);
+        sleep_cond.notify_all();
+    }
 
     // Join all worker threads
     for (auto & t: workerThreads_) {
@@ -103,6 +108,19 @@ Worker_Task::
         t->join();
     }
 
+    /* TODO: finish all tasks */
+    if (queued() || groups.size())
+        cerr << "at the end, there were " << queued()
+             << " jobs outstanding and "
+             << groups.size() << " groups outstanding" << endl;
+
+    Job_Info * info;
+    for (auto & q: queues)
+        while (q->jobs.pop(info))
+            delete info;
+    for (auto info: injected)
+        delete info;
+
     log("~Worker_Task: stopped worker task\n");
 }
 
@@ -122,21 +140,8 @@ get_group(const Job & group_finish, const std::string & info_str,
     groups[id].locked = locked;
     groups[id].info = info_str;
 
-    /* Add a job for the group.  This allows us to keep track of where the child
-       jobs get inserted. */
-    Job_Info info(group_finish, Job(),
-                  format("job for group %lld: ", id) + info_str, -1, id);
-    
-    Jobs::iterator where = jobs.end();
-
-    /* Insert it at the end of its parent's jobs if it has one. */
-    if (parent_group != -1) {
+    if (parent_group != -1)
         groups[parent_group].groups_outstanding += 1;
-        where = groups[parent_group].group_job;
-    }
-    
-    Jobs::iterator it = jobs.insert(where, info);
-    groups[id].group_job = it;
     
     notify_state_changed();
     
@@ -161,37 +166,31 @@ add(const Job & job, const Job & error, const std::string & job_info, Id group)
 {
     /* Wait to manupulate */
     Guard guard(lock);
-    Job_Info info(job, error, job_info, next_job++, group);
 
-    /* Find where to put it. */
+    Group_Info * group_info = 0;
 
     if (group != -1) {
-        if (!groups.count(group))
+        auto it = groups.find(group);
+        if (it == groups.end())
             throw Exception("Worker_Task::add(): group info has none");
 
-        Group_Info & group_info = groups[group];
-        if (group_info.exc) {
+        group_info = &it->second;
+        if (group_info->exc) {
             log("ignoring job addition to an error group\n");
             return -1;
         }
-        ++group_info.jobs_outstanding;
-        
-        /* Jobs::iterator it = */ jobs.insert(group_info.group_job, info);
+        ++group_info->jobs_outstanding;
     }
-    else jobs.push_back(info);
-    
-    ++num_queued;
-    
-    jobs_sem.release();  // release one to allow something to run the job
-    
-    /* If this is the first job running, then we are no longer finished so we
-       acquire the finished semaphore. */
-    if (num_queued + num_running == 1)
-        finished_sem.acquire();
+
+    Id id = next_job++;
+
+    /* Queued with the lock held so that whoever is woken up by the state
+       change can find it. */
+    push_job(new Job_Info(job, error, job_info, id, group, group_info));
 
     notify_state_changed();
     
-    return info.id;
+    return id;
 }
 
 Worker_Task::Id
@@ -203,11 +202,23 @@ add(const Job & job, const std::string & job_info, Id group)
 
 void Worker_Task::finish_all()
 {
-    /* Wait until we are finished */
-    finished_sem.acquire();
+    /* Lend this thread until everything that was added has been run. */
+    Semaphore state_semaphore(0);
+    add_state_semaphore(state_semaphore);
+
+    /* Make sure we remove this semaphore at the end. */
+    Call_Guard guard(boost::bind(&Worker_Task::remove_state_semaphore,
+                                 this, boost::ref(state_semaphore)));
 
-    /* Let something else finish */
-    finished_sem.release();
+    while (finished() < next_job) {
+        if (Job_Info * info = take_job()) {
+            run_job(info);
+            continue;
+        }
+
+        /* Wait for a state change. */
+        state_semaphore.acquire();
+    }
 }
 
 void Worker_Task::clear_all()
@@ -215,73 +226,192 @@ void Worker_Task::clear_all()
     throw Exception("Worker_Task::clear_all(): not implemented");
 }
 
-int Worker_Task::runWorkerThread()
+int Worker_Task::runWorkerThread(int index)
 {
     //cerr << "worker function" << endl;
     
     /* This is the worker function.  We grab work while there is any until it
        is time to exit. */
+
+    current_task = this;
+    current_queue = index;
     
     while (!force_finished) {
-        
+
         log("runWorkerThread: getting job\n");
-        Job_Info info = get_job();
-        log("runWorkerThread: got job: " + to_string(info.id) + "\n");
+        Job_Info * info = take_job();
+
+        if (!info) {
+            wait_for_job();
+            continue;
+        }
+
+        log("runWorkerThread: got job: " + to_string(info->id) + "\n");
+        run_job(info);
+    }
+
+    current_task = 0;
+    current_queue = -1;
+
+    return 0;
+}
+
+void Worker_Task::push_job(Job_Info * info)
+{
+    if (current_task == this)
+        queues[current_queue]->jobs.push(info);
+    else {
+        Guard guard(injected_lock);
+        injected.push_back(info);
+        ++num_injected;
+    }
+
+    wake_workers(1);
+}
+
+Worker_Task::Job_Info *
+Worker_Task::
+take_job()
+{
+    Worker_Queue * own = 0;
+    if (current_task == this)
+        own = queues[current_queue].get();
+
+    Job_Info * result;
+    if (own && own->jobs.pop(result))
+        return result;
+
+    if (num_injected && (result = take_injected(own)))
+        return result;
+
+    /* Steal, starting with the next thread along so that the thieves
+       spread out over the victims. */
+    int n = queues.size();
+    int first = own ? current_queue + 1 : 0;
+    for (int i = 0;  i < n;  ++i) {
+        Worker_Queue * victim = queues[(first + i) % n].get();
+        if (victim != own && victim->jobs.steal(result))
+            return result;
+    }
+
+    return 0;
+}
+
+Worker_Task::Job_Info *
+Worker_Task::
+take_injected(Worker_Queue * own)
+{
+    Guard guard(injected_lock);
+    if (injected.empty()) return 0;
+
+    Job_Info * result = injected.front();
+    injected.pop_front();
+
+    /* Take our share of what's left, so that the other threads steal it
+       from us rather than all contending for this lock. */
+    int moved = 0;
+    if (own) {
+        int share = injected.size() / (queues.size() + 1);
+        for (;  moved < share;  ++moved) {
+            own->jobs.push(injected.front());
+            injected.pop_front();
+        }
+    }
+
+    num_injected -= moved + 1;
+    guard.unlock();
+
+    if (moved) {
+        wake_workers(moved);
+
+        /* Threads lending themselves may have seen no jobs. */
+        Guard guard(lock);
+        notify_state_changed();
+    }
+
+    return result;
+}
+
+bool
+Worker_Task::
+has_queued_jobs() const
+{
+    if (num_injected) return true;
+    for (auto & q: queues)
+        if (!q->jobs.empty()) return true;
+    return false;
+}
+
+void
+Worker_Task::
+wake_workers(int n)
+{
+    /* Pairs with the fence in wait_for_job(): either we see the sleeper,
+       or it sees the queued job. */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!num_sleeping.load(std::memory_order_relaxed)) return;
 
-        if (force_finished) break;
+    Guard guard(sleep_lock);
+    if (n == 1) sleep_cond.notify_one();
+    else sleep_cond.notify_all();
+}
 
+void
+Worker_Task::
+wait_for_job()
+{
+    for (unsigned i = 0;  i < 100;  ++i) {
+        if (force_finished || has_queued_jobs()) return;
+        sched_yield();
+    }
+
+    Guard guard(sleep_lock);
+    ++num_sleeping;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (!force_finished && !has_queued_jobs())
+        sleep_cond.wait(guard);
+    --num_sleeping;
+}
+
+void
+Worker_Task::
+run_job(Job_Info * info)
+{
+    try {
+        if (!info->group_info || !info->group_info->failed) {
+            info->job();
+        }
+        else {
+            log("skipping job from invalid group\n");
+        }
+    }
+    catch (const std::exception & exc) {
+        log("run_job: job exception: " + string(exc.what()) + "\n");
         try {
-            log("runWorkerThread: running job\n");
-            //cerr << "thread " << ACE_OS::thr_self() << " is running job "
-            //     << info.id << " (" << info.info << ")" << endl;
-            if (!info.invalidGroup) {
-                info.job();
-            }
-            else {
-                log("skipping job from invalid group\n");
-            }
+            if (info->error) info->error();
         }
         catch (const std::exception & exc) {
-            log("runWorkerThread: job exception: " + string(exc.what())
-                + "\n");
-            // TODO: make this exception go to the calling process
-            //cerr << "thread " << ACE_OS::thr_self() << " running job "
-            //     << info.id << " (" << info.info << "): " << endl;
-            //cerr << "warning: job threw exception: "
-            //     << exc.what() << endl;
-            try {
-                if (info.error) info.error();
-            }
-            catch (const std::exception & exc) {
-                cerr << "warning: job error function throw exception: "
-                     << exc.what() << endl;
-            }
+            cerr << "warning: job error function throw exception: "
+                 << exc.what() << endl;
+        }
 
-            /* Indicate that the job's group had an error. */
-            if (info.group != -1) {
-                Guard guard(lock);
-                Group_Info & group_info = groups[info.group];
-                if (!group_info.exc) {
-                    /* When a job fails in a group, all remaining jobs from
-                       this group are marked for skipping and the queue is
-                       cleaned up gradually via get_job/finish_job. This
-                       marking is performed by both the worker and control
-                       threads. When it is known that all jobs have been fully
-                       executed or skipped, the group is then removed and the
-                       exception rethrown from the control thread. */
-                    group_info.exc = current_exception();
-                    mark_group_jobs_invalid_ul(group_info, info.group);
-                }
+        /* Indicate that the job's group had an error. */
+        if (info->group_info) {
+            Guard guard(lock);
+            Group_Info & group_info = *info->group_info;
+            if (!group_info.exc) {
+                /* When a job fails in a group, all remaining jobs from
+                   this group are skipped when they are taken.  When all
+                   jobs have been run or skipped, the group is then
+                   removed and the exception rethrown from the control
+                   thread. */
+                group_info.exc = current_exception();
+                group_info.failed = true;
             }
         }
-        //cerr << "thread " << ACE_OS::thr_self() << " is finished job "
-        //     << info.id << " (" << info.info << ")" << endl;
-        finish_job(info);
     }
 
-    shutdown_sem.release();
-    
-    return 0;
+    finish_job(info);
 }
 
 void Worker_Task::notify_state_changed()
@@ -319,38 +449,17 @@ void Worker_Task::run_until_released(Semaphore & sem, int group)
     /* Make sure we remove this semaphore at the end. */
     Call_Guard guard(boost::bind(&Worker_Task::remove_state_semaphore,
                                  this, boost::ref(state_semaphore)));
+
+    /* Any job could release the semaphore, so we need to hear about all of
+       them finishing. */
+    ++num_releasing;
+    Call_Guard releasing_guard([&] () { --num_releasing; });
     
     while (sem.tryacquire() == -1) {
 
         /* Run a job, if there is one old job to finish. */
-        
-        Job_Info info;
-        if (try_get_job(info, group)) {
-            // release lock here
-
-            try {
-                if (!info.invalidGroup) {
-                    info.job();
-                }
-                else {
-                    log("skipping job from invalid group\n");
-                }
-            }
-            catch (const std::exception & exc) {
-                // TODO: make this exception go to the calling process
-                cerr << "warning: job threw exception: "
-                     << exc.what() << endl;
-                try {
-                    if (info.error) info.error();
-                }
-                catch (const std::exception & exc) {
-                    cerr << "warning: job error function throw exception: "
-                         << exc.what() << endl;
-                }
-            }
-
-            finish_job(info);
-
+        if (Job_Info * info = take_job()) {
+            run_job(info);
             continue;
         }
 
@@ -361,88 +470,6 @@ void Worker_Task::run_until_released(Semaphore & sem, int group)
     sem.release();
 }
 
-void
-Worker_Task::
-cancel_group(Group_Info & group_info, int group)
-{
-    Guard guard(lock);
-    cancel_group_ul(group_info, group);
-}
-
-void
-Worker_Task::
-cancel_group_ul(Group_Info & group_info, int group)
-{
-    log("cancel_group_ul\n");
-    //cerr << "thread " << ACE_OS::thr_self() << " cancel_group() "
-    //     << group_info.info << endl;
-    
-    /* We clean up the group by scanning through its list of tasks, removing
-       those that haven't run yet, and calling all of the handlers. */
-    Jobs::iterator it = jobs.begin();
-        
-    /* Iterate through this group's jobs. */
-        
-    while (it != group_info.group_job) {
-        while (it != group_info.group_job
-               && (it->id == -1 || !in_group(*it, group))) ++it;
-            
-        if (it == group_info.group_job) break;
-            
-        /* Remove this job. */
-        //cerr << "removing job " << it->id << " (" << it->info
-        //     << ")" << endl;
-
-            
-        Jobs::iterator next = it;
-        ++next;
-        remove_job_ul(it);
-        it = next;
-    }
-    
-    log("finished clearning jobs for group " + to_string(group) + "\n");
-}
-
-void
-Worker_Task::
-mark_group_jobs_invalid_ul(Group_Info & group_info, int group)
-{
-    log("mark_group_jobs_invalid_ul\n");
-
-    if (group == -1) {
-        throw ML::Exception("cannot mark group -1 as invalid");
-    }
-
-    for (Jobs::iterator it = jobs.begin(); it != group_info.group_job; it++) {
-        if (it->group == group) {
-            it->invalidGroup = true;
-        }
-    }
-
-    log("mark_group_jobs_invalid_ul done\n");
-}
-
-void
-Worker_Task::
-wait_group_finished(Group_Info & group_info, int group)
-{
-    // cancel_group(group_info, group);
-    /* Wait until everything has stopped running in this group. */
-
-    Semaphore state_semaphore(0);
-    add_state_semaphore(state_semaphore);
-
-    /* Make sure we remove this semaphore at the end. */
-    Call_Guard guard(boost::bind(&Worker_Task::remove_state_semaphore,
-                                 this, boost::ref(state_semaphore)));
-    
-    while (group_info.jobs_running > 0)
-        state_semaphore.acquire();
-
-    /* Group should be finished. */
-    log("group finished\n");
-}
-
 void
 Worker_Task::
 run_until_finished(int group, bool unlock)
@@ -492,82 +519,40 @@ run_until_finished(int group, bool unlock)
         //     << group << " to finish" << endl;
 
         /* Is the group finished?  If so, we can get out of here. */
-        {
-            if (group_info.jobs_outstanding
-                + group_info.jobs_running
-                + group_info.groups_outstanding == 0) {
-                /* We're finished */
-
-                /* If the group had an error, clean up the group structures,
-                 * then rethrow the exception that occurred. */
-                if (group_info.exc) {
-                    //cerr << "thread " << ACE_OS::thr_self()
-                    //     << " had a group error" << endl;
-
-                    /* Save and replace the exception ptr, as we're about to
-                       remove the group. */
-                    exception_ptr exc = group_info.exc;
-                    group_info.exc = exception_ptr();
-
-                    /* Unlock the group to allow everything to finish. */
-                    unlock_guard.clear();
-                    unlock_group(group);
-
-                    /* Done; throw the exception. */
-                    if (exc)
-                        rethrow_exception(exc);
-                }
-                else
-                    return;
+        if (group_info.jobs_outstanding + group_info.groups_outstanding == 0) {
+            /* We're finished */
+
+            /* If the group had an error, clean up the group structures,
+               then rethrow the exception that occurred.  The exception was
+               set under the lock before the last job finished. */
+            Guard guard(lock);
+            if (group_info.exc) {
+                //cerr << "thread " << ACE_OS::thr_self()
+                //     << " had a group error" << endl;
+
+                /* Save and replace the exception ptr, as we're about to
+                   remove the group. */
+                exception_ptr exc = group_info.exc;
+                group_info.exc = exception_ptr();
+                guard.unlock();
+
+                /* Unlock the group to allow everything to finish. */
+                unlock_guard.clear();
+                unlock_group(group);
+
+                /* Done; throw the exception. */
+                if (exc)
+                    rethrow_exception(exc);
             }
+            else
+                return;
         }
 
         /* Run a job if we can */
-        Job_Info info;
         log("run_until_finished: try to get job\n");
-        if (try_get_job(info, group)) {
-            log("run_until_finished: got job: " + to_string(info.id) + "\n");
-            try {
-                //cerr << "thread " << ACE_OS::thr_self() << " is running job "
-                //     << info.id << " (" << info.info << ")" << endl;
-                log("run_until_finished: running job\n");
-                if (!info.invalidGroup) {
-                    info.job();
-                }
-                else {
-                    log("skipping job from invalid group\n");
-                }
-
-                //cerr << "thread " << ACE_OS::thr_self() << " finished job "
-                //     << info.id << " (" << info.info << ")" << endl;
-            }
-            catch (const std::exception & exc) {
-                log("run_until_finished: job exception\n");
-                // TODO: make this exception go to the calling process
-                //cerr << "thread " << ACE_OS::thr_self() << " running job "
-                //     << info.id << " (" << info.info << "):" << endl;
-                // cerr << "run_until_finished: warning: job threw exception: "
-                //      << exc.what() << endl;
-                try {
-                    if (info.error) info.error();
-                }
-                catch (const std::exception & exc) {
-                    cerr << "warning: job error function throw exception: "
-                         << exc.what() << endl;
-                }
-
-                /* Indicate that the job's group had an error. */
-                if (info.group != -1) {
-                    Guard guard(lock);
-                    Group_Info & group_info = groups[info.group];
-                    if (!group_info.exc) {
-                        group_info.exc = current_exception();
-                        mark_group_jobs_invalid_ul(group_info, info.group);
-                    }
-                }
-            }
-            finish_job(info);
-            
+        if (Job_Info * info = take_job()) {
+            log("run_until_finished: got job: " + to_string(info->id) + "\n");
+            run_job(info);
             continue;  // no state change needed
         }
         
@@ -581,263 +566,49 @@ Worker_Task::
 lend_thread(int group)
 {
     /* Run a job if we can */
-    Job_Info info;
-    if (try_get_job(info, group)) {
-        try {
-            //cerr << "thread " << ACE_OS::thr_self() << " is running job "
-            //     << info.id << " (" << info.info << ")" << endl;
-            if (!info.invalidGroup) {
-                info.job();
-            }
-            else {
-                log("skipping job from invalid group\n");
-            }
-        }
-        catch (const std::exception & exc) {
-            // TODO: make this exception go to the calling process
-            //cerr << "thread " << ACE_OS::thr_self() << " running job "
-            //     << info.id << " (" << info.info << "):" << endl;
-            cerr << "warning: job threw exception: "
-                 << exc.what() << endl;
-            try {
-                if (info.error) info.error();
-            }
-            catch (const std::exception & exc) {
-                cerr << "warning: job error function throw exception: "
-                     << exc.what() << endl;
-            }
-
-            /* Indicate that the job's group had an error. */
-            if (info.group != -1) {
-                Guard guard(lock);
-                Group_Info & group_info = groups[info.group];
-                if (!group_info.exc) {
-                    group_info.exc = current_exception();
-                    cancel_group_ul(group_info, info.group);
-                }
-            }
-        }
-        //cerr << "thread " << ACE_OS::thr_self() << " finished job "
-        //     << info.id << " (" << info.info << ")" << endl;
-        finish_job(info);
-    }
-}
-
-bool Worker_Task::in_group(const Job_Info & info, int group)
-{
-    if (group == -1) return true;
-    
-    /* Check all parents. */
-    if (info.group == group) return true;
-    else if (info.group == -1) return false;
-    else {
-        Group_Info * group_info = &groups[info.group];
-        
-        while (group_info) {
-            Id parent = group_info->parent_group;
-
-            if (parent == -1) group_info = 0;
-            else {
-                if (!groups.count(parent))
-                    throw Exception("Worker_Task::in_group(): invalid "
-                                    "group number");
-                group_info = &groups[parent];
-            }
-        }
-    }
-
-    return false;
-}
-
-Worker_Task::Job_Info
-Worker_Task::get_job(int group)
-{
-    /* Block until we can acquire a semaphore to have jobs. */
-    for (unsigned i = 0;  i < 100;  ++i) {
-        if (jobs_sem.tryacquire() == 0) {
-            return get_job_impl(group);
-        }
-        sched_yield();
-    }
-    jobs_sem.acquire();
-
-    return get_job_impl(group);
-}
-
-bool Worker_Task::try_get_job(Worker_Task::Job_Info & job, int group)
-{
-    if (jobs_sem.tryacquire() == -1) return false;
-    
-    job = get_job_impl(group);
-    return true;
-}
-
-Worker_Task::Job_Info Worker_Task::get_job_impl(int group)
-{
-    //cerr << "thread " << ACE_OS::thr_self()
-    //     << " is getting a job in group " << group
-    //     << endl;
-    if (force_finished) return Job_Info();
-
-    for (unsigned i = 0;  i < 100;  ++i) {
-        Guard guard(lock, std::try_to_lock);
-        if (guard)
-            return get_job_impl_ul(group);
-        sched_yield();
-    }
-
-    Guard guard(lock);
-
-    //static int numJobs = 0;
-    //cerr << "getting job " << ++numJobs << endl;
-
-    return get_job_impl_ul(group);
-}
-
-Worker_Task::Job_Info
-Worker_Task::
-get_job_impl_ul(int group)
-{
-    //cerr << "thread " << ACE_OS::thr_self()
-    //     << " is getting a job in group " << group
-    //     << endl;
-    if (force_finished) return Job_Info();
-
-    Jobs::iterator it;
-
-    if (group == -1) {
-        it = jobs.begin();
-
-        /* Try to find one whose id isn't -1 but which is in the group
-           anyway. */
-        while (it != jobs.end() && it->id == -1) ++it;
-        
-        if (it == jobs.end())
-            throw Exception("get_job(): internal error: "
-                            "semaphore acquired with zero jobs");
-    }
-    else {
-        map<Id, Group_Info>::const_iterator group_it
-            = groups.find(group);
-        if (group_it == groups.end()) {
-            //throw Exception("iterator not found in group");
-            cerr << "couldn't find group " << group << " in  list"
-                 << endl;
-            return get_job_impl_ul(-1);
-        }
-        else if (group_it->second.exc)
-            return get_job_impl_ul(-1);  // group has an error; we don't do it
-        else it = jobs.begin();
-        
-        /* Try to find one whose id isn't -1 but which is in the group
-           anyway. */
-        while (it != group_it->second.group_job
-               && (it->id == -1 || !in_group(*it, group)))
-            ++it;
-        
-        /* If we didn't find one in our group, we select any job at all
-           so that we make some progress. */
-        if (it == group_it->second.group_job || !in_group(*it, group))
-            return get_job_impl_ul(-1);
-    }
-    
-    Job_Info result = *it;
-    ++num_running;
-
-    if (result.group != -1) ++groups[result.group].jobs_running;
-    
-    --num_queued;
-    jobs.erase(it);
-
-    notify_state_changed();
-
-    return result;
+    if (Job_Info * info = take_job())
+        run_job(info);
 }
 
 void
 Worker_Task::
-finish_job(const Job_Info & info)
+finish_job(Job_Info * info)
 {
-    Guard guard(lock, std::defer_lock);
-
-    for (unsigned i = 0;  i < 100;  ++i) {
-        guard.try_lock();
-        if (guard) break;
+    if (current_task == this) {
+        // Only this thread writes it
+        std::atomic<long long> & finished = queues[current_queue]->finished;
+        finished.store(finished.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_relaxed);
     }
+    else ++external_finished;
 
-    if (!guard)
-        guard.lock();
-
-    --num_running;
-    
-    /* Finish off the group if we need to. */
-    Id group = info.group;
-    if (group != -1) {
-
-        if (!groups.count(group))
-            throw Exception("Worker_Task::finish_job(): invalid group number");
+    Id group = info->group;
+    Group_Info * group_info = info->group_info;
+    delete info;
 
-        Group_Info * group_info = &groups[group];
-
-        --group_info->jobs_outstanding;
-        --group_info->jobs_running;
-
-        if (group_info->jobs_outstanding < 0)
+    /* Finish off the group if we need to.  The group can go away as soon
+       as we've decremented, so we look it up again under the lock. */
+    if (group_info) {
+        int outstanding = --group_info->jobs_outstanding;
+        if (outstanding < 0)
             throw Exception("Worker_Task::finish_job(): "
                             "group has negative outstanding count");
 
-        if (group_info->jobs_running < 0)
-            throw Exception("Worker_Task::finish_job(): "
-                            "group has negative running count");
-        
-        check_finished_ul(group);
-    }
-    
-    if (num_queued + num_running == 0) finished_sem.release();
-
-    notify_state_changed();
-}
-
-void
-Worker_Task::
-remove_job_ul(const Jobs::iterator & it)
-{
-    --num_queued;
-    
-    if (jobs_sem.tryacquire() == -1) {
-        log(string("remove_job_ul error:\n")
-            + "errno = " + to_string(errno) + "\n"
-            + "error = " + strerror(errno) + "\n"
-            + "Worker_Task::remove_job_ul(): couldn't acquire the job "
-            + "semaphore\n"
-            + "force_finished = " + to_string(force_finished) + "\n");
-        dump();
-        abort();
+        if (outstanding == 0) {
+            Guard guard(lock);
+            if (groups.count(group))
+                check_finished_ul(group);
+            notify_state_changed();
+            return;
+        }
     }
 
-    /* Finish off the group if we need to. */
-    Id group = it->group;
-    if (group != -1) {
-
-        if (!groups.count(group))
-            throw Exception("Worker_Task::finish_job(): invalid group number");
-
-        Group_Info * group_info = &groups[group];
-
-        --group_info->jobs_outstanding;
-
-        if (group_info->jobs_outstanding < 0)
-            throw Exception("Worker_Task::finish_job(): "
-                            "group has negative outstanding count");
-        
-        check_finished_ul(group);
+    /* Jobs that aren't in a group, and any job when a thread is waiting
+       in run_until_released(), may be what something is waiting for. */
+    if (!group_info || num_releasing) {
+        Guard guard(lock);
+        notify_state_changed();
     }
-
-    jobs.erase(it);
-    
-    if (num_queued + num_running == 0) finished_sem.release();
-    
-    notify_state_changed();
 }
 
 bool Worker_Task::check_finished(Id group)
@@ -873,9 +644,6 @@ bool Worker_Task::check_finished_ul(Id group)
             cerr << "Worker_Task::check_finished(): " << exc.what() << endl;
         }
         
-        /* Get rid of the job for the group. */
-        jobs.erase(group_info->group_job);
-
         Id parent = group_info->parent_group;
 
         if (parent == -1) group_info = 0;
@@ -904,17 +672,23 @@ bool Worker_Task::check_finished_ul(Id group)
 
 int Worker_Task::queued() const
 {
-    return num_queued;
+    int result = num_injected;
+    for (auto & q: queues)
+        result += q->jobs.size();
+    return result;
 }
 
 int Worker_Task::running() const
 {
-    return num_running;
+    return next_job - finished() - queued();
 }
 
 int Worker_Task::finished() const
 {
-    return next_job - num_running - num_queued;
+    long long result = external_finished;
+    for (auto & q: queues)
+        result += q->finished;
+    return result;
 }
 
 void
@@ -937,13 +711,13 @@ dump(std::ostream & stream, int indent) const
     string i(indent, ' ');
     stream << i << "Group_Info @ " << this << endl;
     stream << i << "  info               = " << info << endl;
-    stream << i << "  jobs outstanding   = " << jobs_outstanding << endl;
-    stream << i << "  jobs running       = " << jobs_running << endl;
-    stream << i << "  groups outstanding = " << groups_outstanding << endl;
+    stream << i << "  jobs outstanding   = " << jobs_outstanding.load() << endl;
+    stream << i << "  groups outstanding = " << groups_outstanding.load()
+           << endl;
     stream << i << "  parent group       = " << parent_group << endl;
-    stream << i << "  group job          = " << &(*group_job) << endl;
     stream << i << "  locked             = " << locked << endl;
     stream << i << "  exc              = "   << (bool)exc << endl;
+    stream << i << "  failed             = " << failed.load() << endl;
     stream << i << "  finished set       = " << (bool)finished << endl;
 }
 
@@ -954,21 +728,20 @@ dump() const
     std::ostream & stream = cerr;
 
     stream << "Worker_Task @ " << this << endl;
-    stream << "  number of jobs   = " << jobs.size() << endl;
     stream << "  next group       = " << next_group << endl;
     stream << "  next job         = " << next_job << endl;
-    stream << "  num queued       = " << num_queued << endl;
-    stream << "  num running      = " << num_running << endl;
+    stream << "  num queued       = " << queued() << endl;
+    stream << "  num injected     = " << num_injected << endl;
+    stream << "  num finished     = " << finished() << endl;
+    stream << "  num sleeping     = " << num_sleeping << endl;
     stream << "  number of groups = " << groups.size() << endl;
     stream << "  state semaphores = " << state_semaphores.size() << endl;
     stream << "  force finishned  = " << force_finished << endl;
     stream << endl;
-    stream << "  jobs:" << endl;
-    int i = 0;
-    for (Jobs::const_iterator it = jobs.begin();  it != jobs.end();  ++it, ++i) {
-        stream << "   " << i << ":" << endl;
-        it->dump(cerr, 4);
-    }
+    stream << "  queues:" << endl;
+    for (unsigned i = 0;  i < queues.size();  ++i)
+        stream << "   " << i << ": " << queues[i]->jobs.size()
+               << " queued, " << queues[i]->finished << " finished" << endl;
     stream << "  groups:" << endl;
     for (map<Id, Group_Info>::const_iterator it = groups.begin();
          it != groups.end();  ++it) {
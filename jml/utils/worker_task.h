@@ -12,9 +12,13 @@
 #include "jml/arch/format.h"
 #include "jml/arch/spinlock.h"
 #include "jml/arch/semaphore.h"
+#include "jml/utils/work_stealing_deque.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <functional>
-#include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <thread>
@@ -46,12 +50,18 @@ int num_threads();
    The jobs can be arranged in groups, with a job that gets run once the
    group is finished, and the groups can be arranged in a hierarchy.
 
-   The jobs are scheduled such that with any group, jobs belonging to an
-   earlier subgroup are all scheduled before any belonging to a later
-   subgroup, regardless of the order in which they are scheduled.  (This
-   corresponds to a depth first search through the group tree).  The effect
-   is to guarantee that the average number of groups outstanding will be
-   as small as possible.
+   Each worker thread has its own deque of jobs (see work_stealing_deque.h).
+   Jobs added from a worker thread (ie, from within a job) go on the bottom
+   of that thread's deque, and it runs the most recent first, which
+   corresponds to a depth first search through the group tree and keeps
+   the number of groups outstanding small.  A thread that runs out of work
+   steals the oldest job from another thread's deque.  Jobs added from
+   other threads go on a shared queue, which the worker threads take from
+   in batches.
+
+   The lock is taken to add a job or a group and when a group may have
+   finished, but not to take a job or to finish one whose group still has
+   others outstanding.
 
    It works multithreaded, and deals with all locking and unlocking.
 */
@@ -144,10 +154,9 @@ public:
 
     /** This function lends the calling thread to the worker task until the
         given semaphore is released.  The semaphore will be checked on each
-        state change.  If the group argument is given, then this thread
-        will only schedule jobs from the given group (or its children), which
-        can be used to avoid the thread being used for other work in the
-        task.
+        state change.  Jobs are taken from any group; the group argument
+        is no longer used, as a job in the group may be queued behind
+        others on any thread's deque.
 
         If any of the jobs throw an exception, then another exception will
         be thrown from the given job.
@@ -162,78 +171,92 @@ public:
     */
     void run_until_finished(int group, bool unlock = false);
 
-    /** Lend the calling thread to the worker task for a single job in the
-        given group and then return.
+    /** Lend the calling thread to the worker task for a single job, if
+        there is one, and then return.  The group isn't used.
 
         An exception in a group job is handled by throwing an exception from
         this function.
     */
     void lend_thread(int group);
 
-    int runWorkerThread();
+    int runWorkerThread(int index);
 
 private:
     int threads_;
 
     std::vector<std::unique_ptr<std::thread> > workerThreads_;
     
-    struct Job_Info;
+    struct Group_Info;
 
-    typedef std::list<Job_Info> Jobs;
-    
     struct Job_Info {
-        Job_Info() : id(-1), group(-1) {}
+        Job_Info() : id(-1), group(-1), group_info(0) {}
         Job_Info(const Job & job, const Job & error,
-                 const std::string & info, Id id, Id group = -1)
+                 const std::string & info, Id id, Id group = -1,
+                 Group_Info * group_info = 0)
             : job(job), error(error), id(id), group(group),
-              invalidGroup(false), info(info) {}
+              group_info(group_info), info(info) {}
         Job job;
         Job error;
-        Id id;    // if -1, this is a group end marker
+        Id id;
         Id group;
-        bool invalidGroup; // true is group has error set
+        Group_Info * group_info;  ///< Can't go away while the job is queued
         std::string info;
         void dump(std::ostream & stream, int indent = 0) const;
     };
 
     struct Group_Info {
         Group_Info()
-            : jobs_outstanding(0), jobs_running(0),
-              groups_outstanding(0), parent_group(0),
-              locked(false)
+            : jobs_outstanding(0), groups_outstanding(0), parent_group(0),
+              locked(false), failed(false)
         {
         }
 
         Job finished;
-        int jobs_outstanding;      ///< Number of jobs waiting for
-        int jobs_running;          ///< Number of jobs that are running
-        int groups_outstanding;    ///< Number of groups waiting for
+        std::atomic<int> jobs_outstanding;   ///< Jobs queued or running
+        std::atomic<int> groups_outstanding; ///< Number of groups waiting for
         Id parent_group;           ///< Group to notify when finished
-        Jobs::iterator group_job;  ///< Job for the group; always last
         bool locked;
+        std::atomic<bool> failed;  ///< Set with exc; queued jobs are skipped
         std::exception_ptr exc;    ///< Exception to rethrow
         std::string info;
 
         void dump(std::ostream & stream, int indent = 0) const;
     };
 
-    /** Get a job. */
-    Job_Info get_job(int group = -1);
+    /** Jobs of one of the worker threads.  Only that thread pushes and
+        pops; the others steal. */
+    struct Worker_Queue {
+        Worker_Queue() : finished(0) {}
+        Work_Stealing_Deque<Job_Info *> jobs;
+        std::atomic<long long> finished;   ///< Jobs this thread has run
+    };
 
-    /** Tries to get a job, but doesn't fail if there isn't one. */
-    bool try_get_job(Job_Info & info, int group = -1);
+    /** Queue the job; on the calling thread's deque if it is one of ours,
+        or otherwise on the injected queue. */
+    void push_job(Job_Info * info);
 
-    /** Implementation of the get_job methods.  Requires that the jobs_sem
-        be acquired. */
-    Job_Info get_job_impl(int group);
-    
-    /** Unlocked implementation of the get_job methods.  Requires that the
-        jobs_sem be acquired and that the lock already be held. */
-    Job_Info get_job_impl_ul(int group);
-    
-    void finish_job(const Job_Info & info);
+    /** Find a job for the calling thread: from its own deque, then the
+        injected queue, then by stealing from the other threads.  Returns
+        null if there is none. */
+    Job_Info * take_job();
+
+    /** Take the oldest injected job.  If own is given, a share of the
+        others are moved onto it so that they can be stolen from there. */
+    Job_Info * take_injected(Worker_Queue * own);
+
+    /** Is there any job queued anywhere? */
+    bool has_queued_jobs() const;
+
+    /** Wake up to n of the worker threads sleeping in wait_for_job(). */
+    void wake_workers(int n);
+
+    /** Spin then sleep until there may be a job to take. */
+    void wait_for_job();
 
-    void remove_job_ul(const Jobs::iterator & it);
+    /** Run the job, handling errors, then finish and free it. */
+    void run_job(Job_Info * info);
+
+    void finish_job(Job_Info * info);
 
     void add_state_semaphore(Semaphore & sem);
 
@@ -244,35 +267,32 @@ private:
     // Check_finished, bit without the lock held
     bool check_finished_ul(Id group);
 
-    /** Is the given job in the group?  Searches up the parent hierarchy. */
-    bool in_group(const Job_Info & info, int group);
-
-    /** Removes all queued jobs in the group.  Running jobs are left alone. */
-    void cancel_group(Group_Info & group_info, int group);
+    typedef std::mutex Lock;
+    //typedef Spinlock Lock;
+    typedef std::unique_lock<Lock> Guard;
 
-    /** Removes all queued jobs in the group.  Running jobs are left alone. 
-        Lock must already be held. */
-    void cancel_group_ul(Group_Info & group_info, int group);
+    /** One per worker thread. */
+    std::vector<std::unique_ptr<Worker_Queue> > queues;
 
-    /** Marks invalid all the jobs belonging to a group, so that the worker threads can
-     * skip those jobs easily and in a lockless manner */
-    void mark_group_jobs_invalid_ul(Group_Info & group_info, int group);
+    /** Jobs added from threads other than ours. */
+    std::deque<Job_Info *> injected;
+    std::atomic<int> num_injected;
+    Lock injected_lock;
 
-    /** Waits for running jobs to finish. */
-    void wait_group_finished(Group_Info & group_info, int group);
+    /** Jobs run by threads other than ours. */
+    std::atomic<long long> external_finished;
 
-    typedef std::mutex Lock;
-    //typedef Spinlock Lock;
-    typedef std::unique_lock<Lock> Guard;
+    /** Where worker threads with nothing to do sleep. */
+    Lock sleep_lock;
+    std::condition_variable sleep_cond;
+    std::atomic<int> num_sleeping;
 
-    Semaphore jobs_sem, finished_sem, state_change_sem, shutdown_sem;
+    /** Number of threads in run_until_released(), which need to know
+        about each job finishing. */
+    std::atomic<int> num_releasing;
 
-    /** Jobs we are running. */
-    Jobs jobs;
-    Id next_group;
-    Id next_job;
-    int num_queued;
-    int num_running;
+    std::atomic<Id> next_group;
+    std::atomic<Id> next_job;
     Lock lock;
 
     /** Groups that are currently running. */
@@ -281,7 +301,7 @@ private:
     /** Semaphores that get released on each state change. */
     std::set<Semaphore *> state_semaphores;
 
-    volatile bool force_finished;
+    std::atomic<bool> force_finished;
 
     /* Dump everything to cerr; for debugging */
     void dump() const;
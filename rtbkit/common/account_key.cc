@@ -7,6 +7,10 @@
 
 #include "rtbkit/common/account_key.h"
 #include "jml/db/persistent.h"
+#include "jml/utils/exc_assert.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
 
 using namespace std;
 using namespace ML;
@@ -50,4 +54,91 @@ reconstitute(ML::DB::Store_Reader & store)
     store.load(static_cast<AccountKeyBase &>(*this));
 }
 
+
+/*****************************************************************************/
+/* ACCOUNT KEY REGISTRY                                                      */
+/*****************************************************************************/
+
+namespace {
+
+/* The keys are stored in chunks that never move, so that key() can index
+   them without taking the lock while intern() adds more. */
+enum {
+    ChunkBits = 12,
+    ChunkSize = 1 << ChunkBits,
+    MaxChunks = 1 << 12
+};
+
+struct Registry {
+    Registry()
+        : numHandles(0)
+    {
+        for (auto & chunk: chunks)
+            chunk = nullptr;
+        add(AccountKey());
+    }
+
+    std::mutex lock;
+    std::unordered_map<AccountKey, AccountHandle> handles;
+    std::atomic<AccountKey *> chunks[MaxChunks];
+    std::atomic<size_t> numHandles;
+
+    /** Must be called with the lock held. */
+    AccountHandle add(const AccountKey & key)
+    {
+        size_t handle = numHandles.load(std::memory_order_relaxed);
+        size_t chunk = handle >> ChunkBits;
+        if (chunk >= MaxChunks)
+            throw ML::Exception("too many account keys interned");
+
+        if (!chunks[chunk].load(std::memory_order_relaxed))
+            chunks[chunk].store(new AccountKey[ChunkSize],
+                                std::memory_order_release);
+
+        chunks[chunk].load(std::memory_order_relaxed)[handle % ChunkSize] = key;
+        handles[key] = handle;
+        numHandles.store(handle + 1, std::memory_order_release);
+        return handle;
+    }
+};
+
+Registry & registry()
+{
+    static Registry result;
+    return result;
+}
+
+} // file scope
+
+AccountHandle
+AccountKeyRegistry::
+intern(const AccountKey & key)
+{
+    Registry & reg = registry();
+    std::unique_lock<std::mutex> guard(reg.lock);
+
+    auto it = reg.handles.find(key);
+    if (it != reg.handles.end())
+        return it->second;
+    return reg.add(key);
+}
+
+const AccountKey &
+AccountKeyRegistry::
+key(AccountHandle handle)
+{
+    Registry & reg = registry();
+    ExcAssertLess(handle, reg.numHandles.load(std::memory_order_acquire));
+    AccountKey * chunk
+        = reg.chunks[handle >> ChunkBits].load(std::memory_order_acquire);
+    return chunk[handle % ChunkSize];
+}
+
+size_t
+AccountKeyRegistry::
+size()
+{
+    return registry().numHandles.load(std::memory_order_acquire);
+}
+
 } // namespace RTBKIT
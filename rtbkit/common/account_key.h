@@ -148,6 +148,43 @@ operator << (std::ostream & stream, const AccountKey & key)
     return stream << key.toString();
 }
 
+
+/*****************************************************************************/
+/* ACCOUNT HANDLE                                                            */
+/*****************************************************************************/
+
+/** Small integer that stands for an account key for the lifetime of the
+    process.  It is obtained once with AccountKeyRegistry::intern(), so that
+    code on the bidding path can look accounts up by index instead of
+    hashing or comparing the strings of the key.
+
+    Handle 0 is the empty key.
+*/
+typedef uint32_t AccountHandle;
+
+
+/*****************************************************************************/
+/* ACCOUNT KEY REGISTRY                                                      */
+/*****************************************************************************/
+
+/** Process wide table of the interned account keys.  Interning takes a
+    lock and is meant to be done when a configuration is loaded; getting
+    the key of a handle doesn't.
+*/
+struct AccountKeyRegistry {
+
+    /** Return the handle of the key, allocating one the first time the key
+        is seen.  Always the same for equal keys. */
+    static AccountHandle intern(const AccountKey & key);
+
+    /** Return the key of a handle returned by intern().  The reference
+        stays valid for the lifetime of the process. */
+    static const AccountKey & key(AccountHandle handle);
+
+    /** Number of handles given out so far, including the empty key's. */
+    static size_t size();
+};
+
 } // namespace RTBKIT
 
 namespace std {
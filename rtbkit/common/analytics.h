@@ -30,11 +30,22 @@ public:
         : Datacratic::ServiceBase(service_name, proxies) {}
     virtual ~Analytics() {}
 
+    /** Configure the plugin from the analytics configuration, which also
+        holds the name of the plugin.  Called before init().
+    */
+    virtual void configure(const Json::Value & config) {}
+
     virtual void init() {}
     virtual void bindTcp(const std::string & port_range = "logs") {}
     virtual void start() {}
     virtual void shutdown() {}
    
+    /** Whether messages on the given channel are published at all, so
+        that the callers can skip building the arguments of the ones that
+        aren't.
+    */
+    virtual bool isEnabled(const std::string & channel) const { return true; }
+
     // USED IN ROUTER 
     virtual void logMarkMessage(const Router & router,
                                 const double & last_check) {}
@@ -15,6 +15,95 @@
 using namespace std;
 using namespace Datacratic;
 
+/********************************************************************************/
+/* ANALYTICS CHANNELS                                                           */
+/********************************************************************************/
+
+AnalyticsChannels::
+AnalyticsChannels(double defaultRate)
+    : defaultRate_(defaultRate), defaultSeen(0), channels(gcLock)
+{
+}
+
+AnalyticsChannels::
+~AnalyticsChannels()
+{
+}
+
+bool
+AnalyticsChannels::
+sample(double rate, std::atomic<uint64_t> & seen)
+{
+    if (rate <= 0.0) return false;
+    if (rate >= 1.0) return true;
+
+    // Keep the messages where the running total of the rate goes past an
+    // integer, which spreads them evenly
+    uint64_t n = seen.fetch_add(1, std::memory_order_relaxed);
+    return uint64_t((n + 1) * rate) != uint64_t(n * rate);
+}
+
+bool
+AnalyticsChannels::
+accept(const string & channel) const
+{
+    auto current = channels();
+    auto it = current->find(channel);
+    if (it == current->end())
+        return sample(defaultRate_, defaultSeen);
+    return sample(it->second->rate, it->second->seen);
+}
+
+double
+AnalyticsChannels::
+rate(const string & channel) const
+{
+    auto current = channels();
+    auto it = current->find(channel);
+    if (it == current->end())
+        return defaultRate_;
+    return it->second->rate;
+}
+
+void
+AnalyticsChannels::
+setRate(const string & channel, double rate)
+{
+    std::lock_guard<std::mutex> guard(writeLock);
+
+    auto current = channels();
+    auto it = current->find(channel);
+    if (it != current->end()) {
+        it->second->rate = rate;
+        return;
+    }
+
+    // Only a new channel needs a new snapshot
+    std::unique_ptr<Channels> next(new Channels(*current));
+    (*next)[channel] = std::make_shared<Channel>(rate);
+    current.unlock();
+    channels.replace(next.release());
+}
+
+void
+AnalyticsChannels::
+setDefaultRate(double rate)
+{
+    defaultRate_ = rate;
+}
+
+void
+AnalyticsChannels::
+setRates(const Json::Value & rates)
+{
+    for (auto it = rates.begin(); it != rates.end(); ++it) {
+        double rate = (*it).isBool() ? ((*it).asBool() ? 1.0 : 0.0)
+                                     : (*it).asDouble();
+        setRate(it.memberName(), rate);
+    }
+}
+
+
 /********************************************************************************/
 /* ANALYTICS PUBLISHER                                                          */
 /********************************************************************************/
@@ -38,6 +127,16 @@ init(const string & baseUrl, const int numConnections)
     };
     addPeriodic("analytics::syncFilters", 10.0, syncFilters);
 
+    auto flushEvents = [&] (uint64_t wakeups) {
+        flush();
+    };
+    addPeriodic("analytics::flush", batchInterval, flushEvents);
+
+    flushRequests.onEvent = [&] (bool) {
+        flush();
+    };
+    addSource("analytics::flushRequests", flushRequests);
+
     initialized = true;
 }
 
@@ -57,7 +156,50 @@ shutdown()
 
 void
 AnalyticsPublisher::
-sendEvent(const string & channel, const string & event)
+setSampling(const string & channel, double rate)
+{
+    sampling.setRate(channel, rate);
+}
+
+void
+AnalyticsPublisher::
+addEvent(const string & channel, string && event)
+{
+    if (numPending >= maxPending) {
+        ++numDropped;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        pending[channel].emplace_back(std::move(event));
+    }
+
+    // Wake up the loop once per full batch rather than for each event
+    if (++numPending >= maxBatchSize && !flushRequested.exchange(true))
+        flushRequests.tryPush(true);
+}
+
+void
+AnalyticsPublisher::
+flush()
+{
+    flushRequested = false;
+
+    std::unordered_map<string, vector<string> > toSend;
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        toSend.swap(pending);
+        numPending = 0;
+    }
+
+    for (auto & batch: toSend)
+        sendEvents(batch.first, std::move(batch.second));
+}
+
+void
+AnalyticsPublisher::
+sendEvents(const string & channel, vector<string> && events)
 {
     auto onResponse = [] (const HttpRequest & rq,
             HttpClientError error,
@@ -70,11 +212,14 @@ sendEvent(const string & channel, const string & event)
                  << "error: " << error << endl;
         }
     };
-    string ressource("/v1/event");
+    string ressource("/v1/events");
     auto const & cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
     Json::Value payload(Json::objectValue);
     payload["channel"] = channel;
-    payload["event"] = event;
+    Json::Value & list = payload["events"];
+    list = Json::Value(Json::arrayValue);
+    for (auto & event: events)
+        list.append(std::move(event));
     client->post(ressource, cbs, payload);
 }
 
@@ -114,10 +259,7 @@ syncChannelFilters()
         if (status != 200) return;
         Json::Value filters = Json::parse(body);
         if (filters.isObject()) {
-            std::lock_guard<std::mutex> lock(mu);
-            for ( auto it = filters.begin(); it != filters.end(); ++it) {
-                channelFilter[it.memberName()] = (*it).asBool();
-            }
+            channels.setRates(filters);
         }
     };
     if (!live) return;
@@ -6,68 +6,234 @@
 */
 #pragma once
 
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <sstream>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
+#include "soa/gc/rcu_protected.h"
+#include "soa/jsoncpp/value.h"
 #include "soa/service/message_loop.h"
 #include "soa/service/http_client.h"
 #include "soa/service/service_utils.h"
+#include "soa/service/typed_message_channel.h"
 
 typedef std::unordered_map< std::string, bool > ChannelFilter;
 
+namespace Datacratic {
+
+/** Arguments of the analytics messages can be callables that return the
+    value to publish; they are only called once the message is known to be
+    published, so that the work of building it is skipped otherwise.  Call
+    as evaluateLazy(arg, 0).
+*/
+template<typename T>
+auto evaluateLazy(const T & arg, int) -> decltype(arg())
+{
+    return arg();
+}
+
+template<typename T>
+const T & evaluateLazy(const T & arg, long)
+{
+    return arg;
+}
+
+} // namespace Datacratic
+
+
+/********************************************************************************/
+/* ANALYTICS CHANNELS                                                           */
+/********************************************************************************/
+
+/** Sampling rate of each of the channels of analytics messages.  A rate of
+    0 disables the channel, 1 publishes all of its messages and anything in
+    between publishes that fraction of them, evenly spread.
+
+    The rates are kept in an RCU protected snapshot, so that checking a
+    message costs a lookup and, for the sampled channels, an atomic
+    increment, but never a lock.
+*/
+
+struct AnalyticsChannels {
+
+    AnalyticsChannels(double defaultRate = 0.0);
+
+    ~AnalyticsChannels();
+
+    /** Whether the next message on the channel is to be published.  Counts
+        the message towards the sampling of the channel.
+    */
+    bool accept(const std::string & channel) const;
+
+    /** Whether any message of the channel is published. */
+    bool enabled(const std::string & channel) const
+    {
+        return rate(channel) > 0.0;
+    }
+
+    double rate(const std::string & channel) const;
+
+    void setRate(const std::string & channel, double rate);
+
+    /** Rate of the channels that were never given one. */
+    double defaultRate() const
+    {
+        return defaultRate_;
+    }
+
+    void setDefaultRate(double rate);
+
+    /** Set the rates from an object with a boolean (enabled or not) or a
+        rate for each channel.
+    */
+    void setRates(const Json::Value & rates);
+
+private:
+    struct Channel {
+        Channel(double rate)
+            : rate(rate), seen(0)
+        {
+        }
+
+        std::atomic<double> rate;
+        mutable std::atomic<uint64_t> seen;
+    };
+
+    typedef std::unordered_map<std::string, std::shared_ptr<Channel> > Channels;
+
+    static bool sample(double rate, std::atomic<uint64_t> & seen);
+
+    std::atomic<double> defaultRate_;
+    mutable std::atomic<uint64_t> defaultSeen;
+
+    Datacratic::GcLock gcLock;
+    Datacratic::RcuProtected<Channels> channels;
+    std::mutex writeLock;
+};
+
+
 /********************************************************************************/
 /* ANALYTICS PUBLISHER                                                          */
 /********************************************************************************/
 
+/** Publishes messages to the analytics endpoint.
+
+    The channels are enabled (and sampled) by the endpoint, whose filters
+    are synced every 10 seconds; messages on the other channels are dropped
+    before any of their arguments are formatted.  The accepted messages are
+    batched by channel and sent every batchInterval seconds, or sooner once
+    maxBatchSize of them are waiting.
+*/
+
 struct AnalyticsPublisher : public Datacratic::MessageLoop {
 
-    AnalyticsPublisher() : initialized(false) {}
+    AnalyticsPublisher()
+        : initialized(false), batchInterval(0.1), maxBatchSize(1000),
+          maxPending(100000), live(false), channels(0.0), sampling(1.0),
+          numPending(0), numDropped(0), flushRequests(16),
+          flushRequested(false)
+    {
+    }
 
     void init(const std::string & baseUrl, const int numConnections);
     bool initialized;
 
+    /** Seconds between the sending of the batches.  Taken into account by
+        init().
+    */
+    double batchInterval;
+
+    /** Number of waiting messages that triggers the sending of a batch. */
+    size_t maxBatchSize;
+
+    /** Number of waiting messages past which new ones are dropped, for
+        when the endpoint can't keep up.
+    */
+    size_t maxPending;
+
     void start();
 
     void shutdown();
 
     void syncChannelFilters();
 
+    /** Sampling rate applied by the publisher on top of that of the
+        endpoint, for example to keep a busy channel in check.
+    */
+    void setSampling(const std::string & channel, double rate);
+
+    /** Whether messages on the channel are published at all, to avoid
+        building the ones that aren't.
+    */
+    bool isEnabled(const std::string & channel) const
+    {
+        return live && channels.enabled(channel) && sampling.enabled(channel);
+    }
+
+    /** Publish a message made of the arguments separated by spaces.  The
+        arguments that are callables are only called if the message is
+        published.
+    */
     template<typename... Args>
     void publish(const std::string & channel, const Args & ... args)
     {
         if (!live) return;
-
-        std::lock_guard<std::mutex> lock(mu);
-        auto it = channelFilter.find(channel);
-        if (it == channelFilter.end() || !it->second) return;
+        if (!channels.accept(channel) || !sampling.accept(channel)) return;
 
         std::stringstream ss;
         make_message(ss, args...);
-        sendEvent(channel, ss.str());
+        addEvent(channel, ss.str());
+    }
+
+    /** Send the waiting messages now. */
+    void flush();
+
+    /** Number of messages dropped because too many were waiting. */
+    uint64_t dropped() const
+    {
+        return numDropped;
     }
 
 private:
     std::mutex mu;
     std::shared_ptr<Datacratic::HttpClient> client;
-    bool live;
-    ChannelFilter channelFilter;
+    std::atomic<bool> live;
+
+    AnalyticsChannels channels;   ///< Rates asked for by the endpoint
+    AnalyticsChannels sampling;   ///< Rates asked for locally
+
+    std::unordered_map<std::string, std::vector<std::string> > pending;
+    std::atomic<size_t> numPending;
+    std::atomic<uint64_t> numDropped;
+    Datacratic::TypedMessageSink<bool> flushRequests;
+    std::atomic<bool> flushRequested;
+
+    void addEvent(const std::string & channel, std::string && event);
 
-    void sendEvent(const std::string & channel, const std::string & event);
+    void sendEvents(const std::string & channel,
+                    std::vector<std::string> && events);
 
     void checkHeartbeat();
 
+    static void make_message(std::stringstream & ss)
+    {
+    }
+
     template<typename Head>
-    void make_message(std::stringstream & ss, const Head & head)
+    static void make_message(std::stringstream & ss, const Head & head)
     {
-        ss << head;
+        ss << Datacratic::evaluateLazy(head, 0);
     }
 
     template<typename Head, typename... Tail>
-    void make_message(std::stringstream & ss, const Head & head, const Tail & ... tail)
+    static void make_message(std::stringstream & ss, const Head & head,
+                             const Tail & ... tail)
     {
-        ss << head << " ";
+        ss << Datacratic::evaluateLazy(head, 0) << " ";
         make_message(ss, tail...);
     }
 
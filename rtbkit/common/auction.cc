@@ -261,6 +261,15 @@ Auction::
 long long Auction::created = 0;
 long long Auction::destroyed = 0;
 
+const std::string &
+Auction::
+requestBinary() const
+{
+    std::call_once(requestBinaryOnce,
+                   [&] () { requestBinaryStr = request->toBinaryStr(); });
+    return requestBinaryStr;
+}
+
 double
 Auction::
 timeAvailable(Date now) const
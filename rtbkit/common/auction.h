@@ -16,6 +16,10 @@
 #include "rtbkit/common/win_cost_model.h"
 #include <boost/function.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include "soa/jsoncpp/json.h"
 #include "soa/types/date.h"
 #include "jml/arch/atomic_ops.h"
@@ -75,8 +79,33 @@ struct Auction : public std::enable_shared_from_this<Auction> {
     std::string requestSerialized; ///< Serialized bid request (canonical)
     std::string requestOriginal;
 
+    /** Binary version of the request for the agents that asked for it.  It's
+        only encoded the first time it's needed so auctions that don't reach
+        such an agent don't pay for it.
+    */
+    const std::string & requestBinary() const;
+
+    /** Encoding of the request that is shared between everything that sends
+        it for this auction, such as the bidder interfaces, under the given
+        key.  The first call for a key creates it; the later ones, from any
+        thread, wait for it and get the same object.
+    */
+    template<typename T>
+    std::shared_ptr<const T>
+    sharedEncoding(const std::string & key,
+                   const std::function<std::shared_ptr<const T> ()> & create)
+        const
+    {
+        std::lock_guard<std::mutex> guard(sharedEncodingsLock);
+        auto & encoding = sharedEncodings[key];
+        if (!encoding)
+            encoding = create();
+        return std::static_pointer_cast<const T>(encoding);
+    }
+
     ///< AugmentationList for each augmentors.
-    std::unordered_map<std::string, AugmentationList> augmentations;
+    typedef std::unordered_map<std::string, AugmentationList> Augmentations;
+    Augmentations augmentations;
     AgentAugmentations agentAugmentations; ///< per agent augmentations.
 
     /** How much time is still available for the auction (in seconds). */
@@ -299,6 +328,12 @@ struct Auction : public std::enable_shared_from_this<Auction> {
 private:
     Data * data;
 
+    mutable std::once_flag requestBinaryOnce;
+    mutable std::string requestBinaryStr;
+
+    mutable std::mutex sharedEncodingsLock;
+    mutable std::map<std::string, std::shared_ptr<const void> > sharedEncodings;
+
 public:
     /// Memory leak tracking
     static long long created;
@@ -6,9 +6,14 @@
 */
 
 #include <ostream>
+#include <sstream>
 #include <string>
+#include <limits>
+#include <unordered_map>
 
 #include "jml/utils/pair_utils.h"
+#include "jml/utils/lz4.h"
+#include "jml/db/compact_size_types.h"
 
 #include "auction_events.h"
 
@@ -71,6 +76,123 @@ SubmittedAuctionEventDescription() {
     addField("bidRequestStrFormat", &SubmittedAuctionEvent::bidRequestStrFormat, "");
 }
 
+namespace RTBKIT {
+
+std::string
+encodeSubmittedAuctions(
+        const std::vector< std::shared_ptr<SubmittedAuctionEvent> > & auctions,
+        bool compress)
+{
+    // The submissions of an auction, in the order the auctions first came
+    // in.  A submission with a different request than the first of its
+    // auction goes in a group of its own.
+    vector< vector<const SubmittedAuctionEvent *> > groups;
+    std::unordered_map<Id, size_t> groupOf;
+    for (auto & auction: auctions) {
+        auto it = groupOf.find(auction->auctionId);
+        if (it != groupOf.end()
+                && groups[it->second][0]->bidRequestStr == auction->bidRequestStr)
+            groups[it->second].push_back(auction.get());
+        else {
+            groupOf[auction->auctionId] = groups.size();
+            groups.push_back({ auction.get() });
+        }
+    }
+
+    std::ostringstream stream;
+    {
+        DB::Store_Writer store(stream);
+        store << DB::compact_size_t(groups.size());
+        for (auto & group: groups) {
+            const SubmittedAuctionEvent & first = *group[0];
+            store << first.auctionId << first.bidRequestStr
+                  << first.bidRequestStrFormat
+                  << DB::compact_size_t(group.size());
+            for (auto auction: group) {
+                store << auction->adSpotId << auction->lossTimeout
+                      << auction->augmentations << auction->bidResponse;
+            }
+        }
+    }
+    string data = stream.str();
+    size_t rawSize = data.size();
+
+    unsigned char compressed = 0;
+    if (compress && data.size() <= std::numeric_limits<int>::max()) {
+        string packed(LZ4_compressBound(data.size()), '\0');
+        int len = LZ4_compress(data.data(), &packed[0], data.size());
+        if (len > 0 && size_t(len) < data.size()) {
+            packed.resize(len);
+            data.swap(packed);
+            compressed = 1;
+        }
+    }
+
+    std::ostringstream result;
+    {
+        DB::Store_Writer store(result);
+        store << (unsigned char)0 << compressed
+              << DB::compact_size_t(rawSize) << data;
+    }
+    return result.str();
+}
+
+std::vector< std::shared_ptr<SubmittedAuctionEvent> >
+decodeSubmittedAuctions(const std::string & encoded)
+{
+    unsigned char version, compressed;
+    DB::compact_size_t size;
+    string data;
+    {
+        std::istringstream stream(encoded);
+        DB::Store_Reader store(stream);
+        store >> version;
+        if (version != 0)
+            throw ML::Exception("unknown submitted auctions version %d",
+                                (int)version);
+        store >> compressed >> size >> data;
+    }
+
+    if (compressed) {
+        if (size > (size_t)std::numeric_limits<int>::max())
+            throw ML::Exception("invalid submitted auctions size");
+
+        string unpacked(size, '\0');
+        int len = LZ4_decompress_safe(data.data(), &unpacked[0],
+                                      data.size(), size);
+        if (len < 0 || size_t(len) != size)
+            throw ML::Exception("corrupt submitted auctions");
+        data.swap(unpacked);
+    }
+
+    vector< std::shared_ptr<SubmittedAuctionEvent> > result;
+
+    std::istringstream stream(data);
+    DB::Store_Reader store(stream);
+    DB::compact_size_t numGroups(store);
+    for (size_t i = 0; i < numGroups; ++i) {
+        Id auctionId;
+        Datacratic::UnicodeString bidRequestStr;
+        string bidRequestStrFormat;
+        store >> auctionId >> bidRequestStr >> bidRequestStrFormat;
+
+        DB::compact_size_t numAuctions(store);
+        for (size_t j = 0; j < numAuctions; ++j) {
+            auto auction = std::make_shared<SubmittedAuctionEvent>();
+            auction->auctionId = auctionId;
+            auction->bidRequestStr = bidRequestStr;
+            auction->bidRequestStrFormat = bidRequestStrFormat;
+            store >> auction->adSpotId >> auction->lossTimeout
+                  >> auction->augmentations >> auction->bidResponse;
+            result.push_back(std::move(auction));
+        }
+    }
+
+    return result;
+}
+
+} // namespace RTBKIT
+
 /*****************************************************************************/
 /* POST AUCTION EVENT TYPE                                                   */
 /*****************************************************************************/
@@ -54,6 +54,23 @@ private:
 
 CREATE_STRUCTURE_DESCRIPTION(SubmittedAuctionEvent)
 
+/** Encodes several submitted auctions in one message from the router to the
+    post auction loop.  The submissions of the same auction are written
+    together with the bid request only once, instead of once per spot and
+    agent as separately serialized SubmittedAuctionEvents would.  The whole
+    batch can also be LZ4 compressed, which is worth it for links between
+    hosts but not on the same machine.
+*/
+std::string
+encodeSubmittedAuctions(
+        const std::vector< std::shared_ptr<SubmittedAuctionEvent> > & auctions,
+        bool compress = false);
+
+/** Decodes the submissions of a message from encodeSubmittedAuctions, in the
+    order that they were encoded within an auction. */
+std::vector< std::shared_ptr<SubmittedAuctionEvent> >
+decodeSubmittedAuctions(const std::string & encoded);
+
 /*****************************************************************************/
 /* POST AUCTION EVENT TYPE                                                   */
 /*****************************************************************************/
@@ -0,0 +1,289 @@
+/* auction_trace.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Sampled tracing of the stages of an auction.
+*/
+
+#include "rtbkit/common/auction_trace.h"
+#include "jml/arch/exception.h"
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string.h>
+
+
+using namespace std;
+
+
+namespace RTBKIT {
+
+const char * print(AuctionStage stage)
+{
+    switch (stage) {
+    case AS_PARSE:     return "parse";
+    case AS_FILTER:    return "filter";
+    case AS_AUGMENT:   return "augment";
+    case AS_BID:       return "bid";
+    case AS_RESPONSE:  return "response";
+    case AS_SUBMIT:    return "submit";
+    case AS_WIN:       return "win";
+    case AS_LOSS:      return "loss";
+    default:           return "unknown";
+    }
+}
+
+
+/*****************************************************************************/
+/* AUCTION TRACE BATCH                                                       */
+/*****************************************************************************/
+
+namespace {
+
+template<typename T>
+void append(std::string & result, const T & value)
+{
+    result.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template<typename T>
+T extract(const std::string & data, size_t & pos)
+{
+    if (data.size() - pos < sizeof(T))
+        throw ML::Exception("truncated auction trace batch");
+    T result;
+    memcpy(&result, data.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return result;
+}
+
+} // file scope
+
+std::string
+AuctionTraceBatch::
+serialize() const
+{
+    std::string result;
+    result.reserve(4 + service.size() + 48
+                   + events.size() * sizeof(AuctionTraceEvent));
+
+    append(result, uint32_t(service.size()));
+    result.append(service);
+    append(result, ticksPerSecond);
+    append(result, ticksAtDate);
+    append(result, date.secondsSinceEpoch());
+    append(result, numDropped);
+    append(result, uint64_t(events.size()));
+    result.append(reinterpret_cast<const char *>(events.data()),
+                  events.size() * sizeof(AuctionTraceEvent));
+
+    return result;
+}
+
+AuctionTraceBatch
+AuctionTraceBatch::
+reconstitute(const std::string & data)
+{
+    AuctionTraceBatch result;
+    size_t pos = 0;
+
+    uint32_t serviceLength = extract<uint32_t>(data, pos);
+    if (data.size() - pos < serviceLength)
+        throw ML::Exception("truncated auction trace batch");
+    result.service = data.substr(pos, serviceLength);
+    pos += serviceLength;
+
+    result.ticksPerSecond = extract<double>(data, pos);
+    result.ticksAtDate = extract<uint64_t>(data, pos);
+    result.date = Date::fromSecondsSinceEpoch(extract<double>(data, pos));
+    result.numDropped = extract<uint64_t>(data, pos);
+
+    uint64_t numEvents = extract<uint64_t>(data, pos);
+    if ((data.size() - pos) / sizeof(AuctionTraceEvent) < numEvents
+        || (data.size() - pos) % sizeof(AuctionTraceEvent) != 0)
+        throw ML::Exception("auction trace batch has the wrong size");
+
+    result.events.resize(numEvents);
+    memcpy(result.events.data(), data.data() + pos,
+           numEvents * sizeof(AuctionTraceEvent));
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* AUCTION TRACE                                                             */
+/*****************************************************************************/
+
+namespace {
+
+/** Ring of events with a single writer, the thread that owns it, and a
+    single reader, whoever drains it under the registry's lock.  The
+    positions only ever grow.
+*/
+struct Ring {
+    Ring(uint32_t thread)
+        : head(0), tail(0), dropped(0), thread(thread),
+          events(AuctionTrace::RingSize)
+    {
+    }
+
+    std::atomic<uint64_t> head;     ///< Next to write
+    std::atomic<uint64_t> tail;     ///< Next to read
+    std::atomic<uint64_t> dropped;
+    uint32_t thread;
+    std::vector<AuctionTraceEvent> events;
+};
+
+struct Registry {
+    Registry()
+        : nextThread(0)
+    {
+    }
+
+    std::mutex lock;
+    std::vector<std::shared_ptr<Ring> > rings;
+    uint32_t nextThread;
+
+    std::string service;
+    AuctionTrace::Sink sink;
+};
+
+/** Never destroyed, as threads may record while the process exits. */
+Registry & registry()
+{
+    static Registry * result = new Registry();
+    return *result;
+}
+
+/** The ring of the thread.  The registry keeps it alive after the thread
+    exits until it's drained.
+*/
+thread_local std::shared_ptr<Ring> threadRing;
+
+Ring * getThreadRing()
+{
+    if (JML_UNLIKELY(!threadRing)) {
+        Registry & reg = registry();
+        std::unique_lock<std::mutex> guard(reg.lock);
+        threadRing = std::make_shared<Ring>(reg.nextThread++);
+        reg.rings.push_back(threadRing);
+    }
+    return threadRing.get();
+}
+
+} // file scope
+
+std::atomic<uint32_t> AuctionTrace::samplingRate(0);
+
+void
+AuctionTrace::
+setSampling(uint32_t oneIn)
+{
+    samplingRate = oneIn;
+}
+
+void
+AuctionTrace::
+recordSampled(uint64_t traceId, AuctionStage stage, uint64_t ticks)
+{
+    Ring * ring = getThreadRing();
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= RingSize) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    AuctionTraceEvent & event = ring->events[head % RingSize];
+    event.traceId = traceId;
+    event.ticks = ticks;
+    event.stage = stage;
+    event.reserved = 0;
+    event.thread = ring->thread;
+
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void
+AuctionTrace::
+setSink(const std::string & service, Sink sink)
+{
+    Registry & reg = registry();
+    std::unique_lock<std::mutex> guard(reg.lock);
+    reg.service = service;
+    reg.sink = std::move(sink);
+}
+
+AuctionTrace::Sink
+AuctionTrace::
+fileSink(const std::string & filename)
+{
+    auto stream = std::make_shared<std::ofstream>(
+            filename, std::ios::out | std::ios::app | std::ios::binary);
+    if (!*stream)
+        throw ML::Exception("couldn't open auction trace file " + filename);
+
+    return [=] (const AuctionTraceBatch & batch)
+        {
+            std::string data = batch.serialize();
+            uint64_t length = data.size();
+            stream->write(reinterpret_cast<const char *>(&length),
+                          sizeof(length));
+            stream->write(data.data(), data.size());
+            stream->flush();
+        };
+}
+
+AuctionTraceBatch
+AuctionTrace::
+drain()
+{
+    Registry & reg = registry();
+    std::unique_lock<std::mutex> guard(reg.lock);
+
+    AuctionTraceBatch result;
+    result.service = reg.service;
+    result.ticksPerSecond = ML::ticks_per_second;
+    result.ticksAtDate = ML::ticks();
+    result.date = Date::now();
+    result.numDropped = 0;
+
+    for (auto it = reg.rings.begin();  it != reg.rings.end();) {
+        Ring & ring = **it;
+
+        uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        uint64_t head = ring.head.load(std::memory_order_acquire);
+        for (uint64_t i = tail;  i < head;  ++i)
+            result.events.push_back(ring.events[i % RingSize]);
+        ring.tail.store(head, std::memory_order_release);
+
+        result.numDropped += ring.dropped.exchange(0);
+
+        // Only the registry has it left once its thread has exited
+        if (it->use_count() == 1)
+            it = reg.rings.erase(it);
+        else ++it;
+    }
+
+    return result;
+}
+
+void
+AuctionTrace::
+flush()
+{
+    Sink sink;
+    {
+        Registry & reg = registry();
+        std::unique_lock<std::mutex> guard(reg.lock);
+        sink = reg.sink;
+    }
+    if (!sink) return;
+
+    AuctionTraceBatch batch = drain();
+    if (batch.events.empty() && !batch.numDropped) return;
+    sink(batch);
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,163 @@
+/* auction_trace.h                                                 -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Sampled tracing of the stages of an auction.
+*/
+
+#pragma once
+
+#include "soa/types/id.h"
+#include "soa/types/date.h"
+#include "jml/arch/tick_counter.h"
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+namespace RTBKIT {
+
+using namespace Datacratic;
+
+
+/*****************************************************************************/
+/* AUCTION TRACE                                                             */
+/*****************************************************************************/
+
+/** Stages that an auction goes through, in order. */
+enum AuctionStage : uint16_t {
+    AS_PARSE,       ///< Exchange connector started parsing the request
+    AS_FILTER,      ///< Router started filtering the agents
+    AS_AUGMENT,     ///< Sent to the augmentors
+    AS_BID,         ///< Sent to the agents
+    AS_RESPONSE,    ///< Response sent to the exchange
+    AS_SUBMIT,      ///< Submitted to the post auction loop
+    AS_WIN,         ///< Post auction loop matched a win
+    AS_LOSS         ///< Post auction loop matched a loss
+};
+
+const char * print(AuctionStage stage);
+
+/** A stage that a traced auction entered, as recorded.  The time spent in a
+    stage is up to the next event of the same trace.
+*/
+struct AuctionTraceEvent {
+    uint64_t traceId;   ///< Hash of the auction id
+    uint64_t ticks;     ///< ML::ticks() when the stage started
+    uint16_t stage;     ///< AuctionStage
+    uint16_t reserved;
+    uint32_t thread;    ///< Small number of the recording thread
+};
+
+static_assert(sizeof(AuctionTraceEvent) == 24,
+              "AuctionTraceEvent is written as is");
+
+/** Events drained in one go, with what's needed to turn their ticks into
+    dates.
+*/
+struct AuctionTraceBatch {
+    std::string service;
+    double ticksPerSecond;
+    uint64_t ticksAtDate;
+    Date date;
+    uint64_t numDropped;    ///< Events lost since the last batch
+    std::vector<AuctionTraceEvent> events;
+
+    Date toDate(uint64_t ticks) const
+    {
+        return date.plusSeconds((double(ticks) - double(ticksAtDate))
+                                / ticksPerSecond);
+    }
+
+    /** Binary form: a header followed by the events as they are in memory.
+        The header is the service name (a 32 bit length then the bytes),
+        then ticksPerSecond, ticksAtDate, the date in seconds since the
+        epoch, numDropped and the number of events as 64 bit values.
+    */
+    std::string serialize() const;
+    static AuctionTraceBatch reconstitute(const std::string & data);
+};
+
+/** Records the stages of a sample of the auctions into fixed size rings, one
+    per thread, so that it's cheap enough to leave on in production.
+
+    The auction id is the trace id, so the exchange connector, the router
+    and the post auction loop all sample the same auctions (which needs the
+    same sampling rate everywhere) and their events can be joined.  When
+    sampling is off, recording is a relaxed load and a branch.
+
+    Each ring has a single writer, its thread; flush() drains all of them
+    and passes the events to the sink.  A full ring drops the new events.
+*/
+
+struct AuctionTrace {
+
+    /** Trace one auction in oneIn; 0 turns tracing off, which is the
+        default.
+    */
+    static void setSampling(uint32_t oneIn);
+    static uint32_t sampling()
+    {
+        return samplingRate.load(std::memory_order_relaxed);
+    }
+
+    static bool sampled(const Id & auctionId)
+    {
+        uint32_t oneIn = sampling();
+        return oneIn && auctionId.hash() % oneIn == 0;
+    }
+
+    /** Record that the auction entered the stage now. */
+    static void record(const Id & auctionId, AuctionStage stage)
+    {
+        uint32_t oneIn = sampling();
+        if (JML_LIKELY(!oneIn)) return;
+        uint64_t traceId = auctionId.hash();
+        if (traceId % oneIn == 0)
+            recordSampled(traceId, stage, ML::ticks());
+    }
+
+    /** Record that the auction entered the stage at the given ML::ticks(). */
+    static void record(const Id & auctionId, AuctionStage stage,
+                       uint64_t ticks)
+    {
+        uint32_t oneIn = sampling();
+        if (JML_LIKELY(!oneIn)) return;
+        uint64_t traceId = auctionId.hash();
+        if (traceId % oneIn == 0)
+            recordSampled(traceId, stage, ticks);
+    }
+
+    typedef std::function<void (const AuctionTraceBatch &)> Sink;
+
+    /** Set where the flushed batches go, with the service name they are
+        stamped with.
+    */
+    static void setSink(const std::string & service, Sink sink);
+
+    /** Sink that appends each batch to the given file as its length (64
+        bits) followed by its serialized form.
+    */
+    static Sink fileSink(const std::string & filename);
+
+    /** Drain the events of every thread into a batch and give it to the
+        sink, if there are any.  Meant to be called periodically from a
+        single thread.
+    */
+    static void flush();
+
+    /** Drain the events of every thread. */
+    static AuctionTraceBatch drain();
+
+    /** Number of events that each thread's ring can hold. */
+    enum { RingSize = 1 << 14 };
+
+private:
+    static std::atomic<uint32_t> samplingRate;
+
+    static void recordSampled(uint64_t traceId, AuctionStage stage,
+                              uint64_t ticks);
+};
+
+} // namespace RTBKIT
@@ -8,9 +8,13 @@
 
 #include "rtbkit/common/augmentation.h"
 #include "jml/arch/format.h"
+#include "jml/db/persistent.h"
+#include "jml/db/compact_size_types.h"
 
 #include <iostream>
+#include <sstream>
 #include <algorithm>
+#include <unordered_map>
 
 using namespace std;
 
@@ -59,8 +63,12 @@ void
 Augmentation::
 mergeWith(const Augmentation& other)
 {
-    tags.insert(other.tags.begin(), other.tags.end());
-    mergeAugmentationData(data, other.data);
+    if (tags.empty()) tags = other.tags;
+    else tags.insert(other.tags.begin(), other.tags.end());
+
+    // Most augmentations only carry tags
+    if (!other.data.isNull())
+        mergeAugmentationData(data, other.data);
 }
 
 Json::Value
@@ -107,8 +115,15 @@ void
 AugmentationList::
 mergeWith(const AugmentationList& other)
 {
-    for (auto it = other.begin(), end = other.end(); it != end; ++it)
-        (*this)[it->first].mergeWith(it->second);
+    // Both are sorted by account so a single pass finds where each goes
+    auto pos = begin();
+    for (auto it = other.begin(), last = other.end(); it != last; ++it) {
+        while (pos != end() && pos->first < it->first) ++pos;
+
+        if (pos != end() && pos->first == it->first)
+            pos->second.mergeWith(it->second);
+        else pos = insert(pos, *it);
+    }
 }
 
 Augmentation
@@ -185,4 +200,122 @@ fromJson(const Json::Value& json)
     return list;
 }
 
+namespace {
+
+const std::string BinaryMagic("\0AUG", 4);
+const unsigned char BinaryVersion = 1;
+
+} // namespace anonymous
+
+std::string
+AugmentationList::
+toBinary() const
+{
+    using ML::DB::compact_size_t;
+
+    std::unordered_map<std::string, size_t> tagIndex;
+    std::vector<const std::string *> tagTable;
+    for (const auto& entry : *this) {
+        for (const auto& tag : entry.second.tags) {
+            if (tagIndex.insert(make_pair(tag, tagTable.size())).second)
+                tagTable.push_back(&tag);
+        }
+    }
+
+    std::ostringstream stream;
+    stream << BinaryMagic;
+    {
+        ML::DB::Store_Writer store(stream);
+        store << BinaryVersion;
+
+        store << compact_size_t(tagTable.size());
+        for (const std::string * tag : tagTable)
+            store << *tag;
+
+        store << compact_size_t(size());
+        for (const auto& entry : *this) {
+            entry.first.serialize(store);
+
+            const Augmentation& aug = entry.second;
+            store << compact_size_t(aug.tags.size());
+            for (const auto& tag : aug.tags)
+                store << compact_size_t(tagIndex[tag]);
+
+            bool hasData = !aug.data.isNull();
+            store << (unsigned char)hasData;
+            if (hasData) store << aug.data.toStringNoNewLine();
+        }
+    }
+
+    return stream.str();
+}
+
+AugmentationList
+AugmentationList::
+fromBinary(const std::string& str)
+{
+    using ML::DB::compact_size_t;
+
+    ExcCheck(isBinary(str), "not a binary augmentation list");
+
+    std::istringstream stream(str);
+    stream.seekg(BinaryMagic.size());
+    ML::DB::Store_Reader store(stream);
+
+    unsigned char version;
+    store >> version;
+    if (version != BinaryVersion)
+        throw ML::Exception("unknown binary augmentation list version %d",
+                            (int)version);
+
+    compact_size_t numTags(store);
+    std::vector<std::string> tagTable(numTags);
+    for (auto& tag : tagTable) store >> tag;
+
+    AugmentationList list;
+
+    compact_size_t numEntries(store);
+    for (size_t i = 0; i < numEntries; ++i) {
+        AccountKey account;
+        account.reconstitute(store);
+
+        Augmentation aug;
+
+        compact_size_t numAugTags(store);
+        for (size_t j = 0; j < numAugTags; ++j) {
+            compact_size_t index(store);
+            ExcCheckLess(index, tagTable.size(), "unknown augmentation tag");
+            aug.tags.insert(aug.tags.end(), tagTable[index]);
+        }
+
+        unsigned char hasData;
+        store >> hasData;
+        if (hasData) {
+            std::string data;
+            store >> data;
+            aug.data = Json::parse(data);
+        }
+
+        list.insert(list.end(), make_pair(std::move(account), std::move(aug)));
+    }
+
+    return list;
+}
+
+bool
+AugmentationList::
+isBinary(const std::string& str)
+{
+    return str.compare(0, BinaryMagic.size(), BinaryMagic) == 0;
+}
+
+AugmentationList
+AugmentationList::
+parse(const std::string& str)
+{
+    if (str.empty() || str == "null") return AugmentationList();
+    if (isBinary(str)) return fromBinary(str);
+    return fromJson(Json::parse(str));
+}
+
 } // namespace RTBKIT
@@ -84,6 +84,19 @@ struct AugmentationList : public AugmentationListBase
 
     Json::Value toJson() const;
     static AugmentationList fromJson(const Json::Value& json);
+
+    /** Compact encoding in which each distinct tag is written once and
+        referred to by its index, and the data is only written, as a JSON
+        string, when there is some.
+     */
+    std::string toBinary() const;
+    static AugmentationList fromBinary(const std::string& str);
+
+    /** Whether the string was produced by toBinary() rather than being JSON. */
+    static bool isBinary(const std::string& str);
+
+    /** Parse either encoding; an empty string or "null" is an empty list. */
+    static AugmentationList parse(const std::string& str);
 };
 
 
@@ -15,6 +15,7 @@
 #include "jml/db/persistent.h"
 #include "rtbkit/openrtb/openrtb_parsing.h"
 #include "soa/types/json_printing.h"
+#include "soa/types/binary_json.h"
 #include "soa/service/json_codec.h"
 
 
@@ -836,7 +837,7 @@ UserIds::
 serialize(ML::DB::Store_Writer & store) const
 {
     unsigned char version = 0;
-    store << version << (map<std::string, Id> &)(*this);
+    store << version << (const UserIdsBase &)(*this);
 }
 
 void
@@ -847,7 +848,7 @@ reconstitute(ML::DB::Store_Reader & store)
     store >> version;
     if (version != 0)
         throw ML::Exception("invalid UserIds version");
-    store >> (map<std::string, Id> &)*this;
+    store >> (UserIdsBase &)*this;
 }
 
 struct UserIdsDescription
@@ -974,10 +975,10 @@ toJsonStr() const
 {
     static const DefaultDescription<BidRequest> BidRequestDesc;
     
-    std::ostringstream stream;
-    StreamJsonPrintingContext context(stream);
+    std::string result;
+    StringJsonPrintingContext context(result);
     BidRequestDesc.printJson(this, context);
-    return stream.str();
+    return result;
 
     //return boost::trim_copy(toJson().toString());
 }
@@ -1104,6 +1105,8 @@ createFromJson(const Json::Value & json)
     return result;
 }
 
+const std::string BidRequest::BinaryFormat = "rtbkit-binary-v1";
+
 namespace {
 
 static const DefaultDescription<BidRequest> BidRequestDesc;
@@ -1130,12 +1133,43 @@ struct CanonicalParser {
     }
 };
 
+// Every binary request starts with the magic and a version byte which is
+// bumped whenever the encoding or the canonical description changes in a way
+// that older agents can't read.
+const char BinaryMagic[] = "RBR";
+enum { BinaryVersion = 1 };
+
+struct BinaryParser {
+
+    static BidRequest * parse(const std::string & str)
+    {
+        const size_t header = sizeof(BinaryMagic);
+
+        if (str.size() < header
+            || str.compare(0, header - 1, BinaryMagic) != 0)
+            throw ML::Exception("bid request is not in the binary format");
+
+        unsigned version = (unsigned char)str[header - 1];
+        if (version != BinaryVersion)
+            throw ML::Exception("unsupported binary bid request version %d",
+                                version);
+
+        BinaryJsonParsingContext context(str.data() + header,
+                                         str.data() + str.size());
+        auto_ptr<BidRequest> result(new BidRequest());
+        BidRequestDesc.parseJsonTyped(result.get(), context);
+
+        return result.release();
+    }
+};
+
 struct AtInit {
     AtInit()
     {
         PluginInterface<BidRequest>::registerPlugin("recoset", CanonicalParser::parse);
         PluginInterface<BidRequest>::registerPlugin("datacratic", CanonicalParser::parse);
         PluginInterface<BidRequest>::registerPlugin("rtbkit", CanonicalParser::parse);
+        PluginInterface<BidRequest>::registerPlugin(BidRequest::BinaryFormat, BinaryParser::parse);
     }
 } atInit;
 } // file scope
@@ -1174,6 +1208,17 @@ parse(const std::string & source, const Datacratic::UnicodeString & bidRequest)
     return BidRequest::parse(source, bidRequest.utf8String());
 }
 
+std::string
+BidRequest::
+toBinaryStr() const
+{
+    BinaryJsonPrintingContext context;
+    context.output.append(BinaryMagic, sizeof(BinaryMagic) - 1);
+    context.output.push_back(BinaryVersion);
+    BidRequestDesc.printJsonTyped(this, context);
+    return std::move(context.output);
+}
+
 SegmentResult
 BidRequest::
 segmentPresent(const std::string & source,
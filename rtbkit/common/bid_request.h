@@ -13,6 +13,7 @@
 #include "soa/types/string.h"
 #include "jml/arch/exception.h"
 #include "jml/utils/compact_vector.h"
+#include "jml/utils/compact_map.h"
 #include "jml/utils/less.h"
 #include <boost/function.hpp>
 #include "soa/types/id.h"
@@ -175,7 +176,13 @@ enum IdDomain {
 
 /** Information known about a user and passed in as part of the bid */
 
-struct UserIds : public std::map<std::string, Id> {
+/** The ids of the user by domain.  There are only a handful of them so they
+    are kept inline in a sorted vector.
+*/
+
+typedef ML::compact_map<std::string, Id, 3> UserIdsBase;
+
+struct UserIds : public UserIdsBase {
 
     void add(const Id & id, IdDomain domain);
     void add(const Id & id, const std::string & domain);
@@ -427,6 +434,17 @@ struct BidRequest {
 
     std::string serializeToString() const;
     static BidRequest createFromString(const std::string & str);
+
+    /** Source under which the binary version of the bid request is sent to
+        the agents; BidRequest::parse() understands it.
+    */
+    static const std::string BinaryFormat;
+
+    /** Return a compact binary version of the canonical bid request.  Unlike
+        serializeToString() it is lossless and it is versioned so that agents
+        can reject an encoding they don't understand.
+    */
+    std::string toBinaryStr() const;
 };
 
 IMPL_SERIALIZE_RECONSTITUTE(BidRequest);
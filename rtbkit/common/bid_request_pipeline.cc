@@ -30,4 +30,21 @@ BidRequestPipeline::create(
     return std::shared_ptr<BidRequestPipeline>(factory(std::move(serviceName), std::move(proxies), json));
 }
 
+BidRequestPipeline::PostStage
+BidRequestPipeline::prepareBidRequest(
+        const ExchangeConnector* exchange,
+        const Datacratic::HttpHeader& header,
+        const std::string& payload)
+{
+    if (preBidRequest(exchange, header, payload) == PipelineStatus::Stop) {
+        return [] (const std::shared_ptr<Auction>&) {
+            return PipelineStatus::Stop;
+        };
+    }
+
+    return [=] (const std::shared_ptr<Auction>& auction) {
+        return this->postBidRequest(exchange, auction);
+    };
+}
+
 } // namespace RTBKIT
@@ -52,6 +52,25 @@ public:
             const ExchangeConnector* exchange,
             const std::shared_ptr<Auction>& auction) = 0;
 
+    /** Second half of a stage that was prepared off the exchange thread: it
+        is called on the exchange thread with the auction once it exists.
+     */
+    typedef std::function<PipelineStatus (const std::shared_ptr<Auction>&)>
+        PostStage;
+
+    /** Runs the expensive part of the stage from the raw request, possibly
+        on another thread while the exchange thread parses the request, and
+        returns what remains to be done with the auction.  Stages that enrich
+        the auction override it to do their lookups here and return a
+        callback that only stores the results; the default calls
+        preBidRequest and then postBidRequest from the callback.
+     */
+    virtual PostStage
+    prepareBidRequest(
+            const ExchangeConnector* exchange,
+            const Datacratic::HttpHeader& header,
+            const std::string& payload);
+
 };
 
 } // namespace RTBKIT
@@ -194,7 +194,15 @@ Bid&
 Bids::
 bidForSpot(int spotIndex)
 {
-    for (Bid& bid : *this) {
+    const Bids & self = *this;
+    return const_cast<Bid &>(self.bidForSpot(spotIndex));
+}
+
+const Bid&
+Bids::
+bidForSpot(int spotIndex) const
+{
+    for (const Bid& bid : *this) {
         if (bid.spotIndex == spotIndex) return bid;
     }
 
@@ -272,7 +280,9 @@ fromJson(const std::string& raw)
             ExcCheck(foundField, "unknown bids field " + fieldName);
         };
 
-    ML::Parse_Context context(raw, raw.c_str(), raw.c_str() + raw.length());
+    // The first argument is only used in error messages; passing the raw
+    // string there would copy the whole response on every bid.
+    ML::Parse_Context context("bids", raw.c_str(), raw.c_str() + raw.length());
     expectJsonObject(context, onBidsEntry);
 
     return result;
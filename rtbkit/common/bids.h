@@ -111,6 +111,7 @@ struct Bids : public ML::compact_vector<Bid, 4>
 
     /** Return the bid object associated with the given spot index. */
     Bid& bidForSpot(int spotIndex);
+    const Bid& bidForSpot(int spotIndex) const;
 
     Json::Value toJson() const;
     std::string toJsonStr() const;
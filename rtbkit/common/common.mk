@@ -24,10 +24,12 @@ LIBRTB_SOURCES := \
 	post_auction_proxy.cc \
 	analytics_publisher.cc \
 	extension.cc \
-	bid_request_pipeline.cc
+	bid_request_pipeline.cc \
+	auction_trace.cc \
+	eligibility_summary.cc
 
 LIBRTB_LINK := \
-	ACE arch utils jsoncpp boost_thread endpoint boost_regex zmq opstats bid_request
+	ACE arch utils jsoncpp boost_thread endpoint boost_regex zmq opstats bid_request gc
 
 $(eval $(call library,rtb,$(LIBRTB_SOURCES),$(LIBRTB_LINK)))
 
@@ -63,6 +63,21 @@ Json::Value jsonEncode(CurrencyCode code)
     return Json::Value(toString(code));
 }
 
+/*****************************************************************************/
+/* CHECKED ARITHMETIC                                                        */
+/*****************************************************************************/
+
+namespace detail {
+
+void throwAmountOverflow(int64_t a, int64_t b, char op)
+{
+    throw ML::Exception("amount overflow: %lld %c %lld",
+                        (long long)a, op, (long long)b);
+}
+
+} // namespace detail
+
+
 /*****************************************************************************/
 /* AMOUNT                                                                    */
 /*****************************************************************************/
@@ -299,6 +314,40 @@ operator == (const CurrencyPool & other) const
     return checkContains(*this, other) && checkContains(other, *this);
 }
 
+CurrencyPool &
+CurrencyPool::
+merge(const CurrencyPool & other, int sign)
+{
+    ML::compact_vector<Amount, 1> result;
+    result.reserve(currencyAmounts.size() + other.currencyAmounts.size());
+
+    auto it1 = currencyAmounts.begin(), end1 = currencyAmounts.end();
+    auto it2 = other.currencyAmounts.begin(), end2 = other.currencyAmounts.end();
+
+    while (it1 != end1 || it2 != end2) {
+        if (it2 == end2
+            || (it1 != end1 && it1->currencyCode < it2->currencyCode)) {
+            result.push_back(*it1++);
+            continue;
+        }
+
+        // Zero amounts are never added, as with operator += (Amount).
+        Amount am = sign < 0 ? -*it2 : *it2;
+        ++it2;
+
+        if (it1 != end1 && it1->currencyCode == am.currencyCode) {
+            Amount sum = *it1++;
+            if (am) sum.value = detail::addChecked(sum.value, am.value);
+            result.push_back(sum);
+        }
+        else if (am)
+            result.push_back(am);
+    }
+
+    currencyAmounts.swap(result);
+    return *this;
+}
+
 Amount
 CurrencyPool::
 getAvailable(const CurrencyCode & currency) const
@@ -399,6 +448,22 @@ isSameOrPastVersion(const CurrencyPool & otherPool)
     return true;
 }
 
+/*****************************************************************************/
+/* CURRENCY ACCUMULATOR                                                      */
+/*****************************************************************************/
+
+CurrencyPool
+CurrencyAccumulator::
+pool() const
+{
+    CurrencyPool result;
+    for (int i = 0;  i < NumCurrencies;  ++i)
+        if (used & (1 << i))
+            result.currencyAmounts.push_back(Amount(code(i), values[i]));
+    return result;
+}
+
+
 /*****************************************************************************/
 /* LINE ITEMS                                                                */
 /*****************************************************************************/
@@ -426,6 +491,16 @@ toJson() const
     return result;
 }
 
+CurrencyPool
+LineItems::
+total() const
+{
+    CurrencyAccumulator result;
+    for (auto & e: entries)
+        result += e.second;
+    return result.pool();
+}
+
 bool
 LineItems::
 operator == (const LineItems & other) const
@@ -7,6 +7,7 @@
 #ifndef __types__currency_h__
 #define __types__currency_h__
 
+#include <algorithm>
 #include <cstddef>
 #include <ratio>
 #include <type_traits>
@@ -14,6 +15,8 @@
 #include <boost/preprocessor/cat.hpp>
 
 
+#include "jml/compiler/compiler.h"
+#include "jml/arch/exception.h"
 #include "jml/utils/exc_assert.h"
 #include "jml/utils/compact_vector.h"
 #include "jml/utils/unnamed_bool.h"
@@ -39,10 +42,49 @@ CurrencyCode jsonDecode(const Json::Value & j, CurrencyCode * = 0);
 Json::Value jsonEncode(CurrencyCode code);
 
 
+/*****************************************************************************/
+/* CHECKED ARITHMETIC                                                        */
+/*****************************************************************************/
+
+namespace detail {
+
+/** Throws the exception for an amount that doesn't fit in 64 bits. */
+void throwAmountOverflow(int64_t a, int64_t b, char op) JML_NORETURN;
+
+inline int64_t addChecked(int64_t a, int64_t b)
+{
+    int64_t result = (int64_t)((uint64_t)a + (uint64_t)b);
+    if (JML_UNLIKELY(((a ^ result) & (b ^ result)) < 0))
+        throwAmountOverflow(a, b, '+');
+    return result;
+}
+
+inline int64_t subChecked(int64_t a, int64_t b)
+{
+    int64_t result = (int64_t)((uint64_t)a - (uint64_t)b);
+    if (JML_UNLIKELY(((a ^ b) & (a ^ result)) < 0))
+        throwAmountOverflow(a, b, '-');
+    return result;
+}
+
+inline int64_t mulChecked(int64_t a, int64_t b)
+{
+    __int128 result = (__int128)a * b;
+    if (JML_UNLIKELY(result != (int64_t)result))
+        throwAmountOverflow(a, b, '*');
+    return (int64_t)result;
+}
+
+} // namespace detail
+
+
 /*****************************************************************************/
 /* AMOUNT                                                                    */
 /*****************************************************************************/
 
+/** Integer amount of a currency; the arithmetic throws rather than wrap
+    around on overflow.
+*/
 struct Amount {
     Amount(CurrencyCode currencyCode = CurrencyCode::CC_NONE, int64_t value = 0)
         : value(value), currencyCode(currencyCode)
@@ -79,7 +121,7 @@ struct Amount {
             *this = other;
         else {
             ExcAssertEqual(currencyCode, other.currencyCode);
-            value += other.value;
+            value = detail::addChecked(value, other.value);
         }
         return *this;
     }
@@ -103,7 +145,7 @@ struct Amount {
                 cerr << this->toString() << " - " << other.toString() << endl;
             }
             ExcAssertEqual(currencyCode, other.currencyCode);
-            value -= other.value;
+            value = detail::subChecked(value, other.value);
         }
         return *this;
     }
@@ -115,12 +157,24 @@ struct Amount {
         return result;
     }
 
+    /** Scale by a fraction; the result is truncated towards zero. */
     Amount operator * (double factor) const
     {
         double result = static_cast<double>(value) * factor;
+        if (JML_UNLIKELY(!(result > -9.2233720368547758e18
+                           && result < 9.2233720368547758e18)))
+            detail::throwAmountOverflow(value, factor, '*');
         return Amount(currencyCode, static_cast<int64_t>(result));
     }
 
+    /** Exact scaling by an integer, without going through a double. */
+    template<typename T,
+             typename = typename std::enable_if<std::is_integral<T>::value>::type>
+    Amount operator * (T factor) const
+    {
+        return Amount(currencyCode, detail::mulChecked(value, factor));
+    }
+
     bool currencyIsCompatible(const Amount & other) const
     {
         if (currencyCode == other.currencyCode) return true;
@@ -244,6 +298,58 @@ struct CurrencyTemplate : public Amount
         return Amount::operator==(rhs);
     }
 
+    /* Arithmetic between amounts of the same currency knows the currency
+       at compile time, so it skips the checks of the currency codes and
+       keeps the type.  Mixing with a plain Amount goes through Amount's.
+    */
+
+    using Amount::operator+;
+    using Amount::operator-;
+    using Amount::operator+=;
+    using Amount::operator-=;
+    using Amount::operator*;
+
+    template <typename R>
+    CurrencyTemplate& operator+=(const CurrencyTemplate<CURRENCY, R>& rhs)
+    {
+        value = detail::addChecked(value, rhs.value);
+        currencyCode = CURRENCY;
+        return *this;
+    }
+
+    template <typename R>
+    CurrencyTemplate& operator-=(const CurrencyTemplate<CURRENCY, R>& rhs)
+    {
+        value = detail::subChecked(value, rhs.value);
+        currencyCode = CURRENCY;
+        return *this;
+    }
+
+    template <typename R>
+    CurrencyTemplate operator+(const CurrencyTemplate<CURRENCY, R>& rhs) const
+    {
+        CurrencyTemplate result = *this;
+        result += rhs;
+        return result;
+    }
+
+    template <typename R>
+    CurrencyTemplate operator-(const CurrencyTemplate<CURRENCY, R>& rhs) const
+    {
+        CurrencyTemplate result = *this;
+        result -= rhs;
+        return result;
+    }
+
+    template <typename T,
+              typename = typename std::enable_if<std::is_integral<T>::value>::type>
+    CurrencyTemplate operator*(T factor) const
+    {
+        CurrencyTemplate result;
+        result.value = detail::mulChecked(value, factor);
+        return result;
+    }
+
     template <typename T>
     operator T() const;
 };
@@ -389,18 +495,16 @@ struct CurrencyPool {
     {
         if (!amount) return *this;
 
-        for (auto & am: currencyAmounts) {
-            if (am.currencyCode == amount.currencyCode) {
-                am += amount;
+        // The amounts are kept sorted by currency code.
+        auto it = currencyAmounts.begin(), end = currencyAmounts.end();
+        for (; it != end && it->currencyCode <= amount.currencyCode;  ++it) {
+            if (it->currencyCode == amount.currencyCode) {
+                it->value = detail::addChecked(it->value, amount.value);
                 return *this;
             }
         }
 
-        currencyAmounts.push_back(amount);
-        std::sort(currencyAmounts.begin(), currencyAmounts.end(),
-                  [] (Amount am1, Amount am2)
-                  { return am1.currencyCode < am2.currencyCode; });
-
+        currencyAmounts.insert(it, amount);
         return *this;
     }
 
@@ -425,16 +529,16 @@ struct CurrencyPool {
 
     CurrencyPool & operator += (const CurrencyPool & other)
     {
-        for (auto & am: other.currencyAmounts)
-            operator += (am);
-        return *this;
+        if (other.currencyAmounts.size() == 1)
+            return operator += (other.currencyAmounts[0]);
+        return merge(other, 1);
     }
 
     CurrencyPool & operator -= (const CurrencyPool & other)
     {
-        for (auto & am: other.currencyAmounts)
-            operator -= (am);
-        return *this;
+        if (other.currencyAmounts.size() == 1)
+            return operator -= (other.currencyAmounts[0]);
+        return merge(other, -1);
     }
 
     CurrencyPool operator *= (double factor)
@@ -543,6 +647,12 @@ struct CurrencyPool {
     static CurrencyPool fromJson(const Json::Value & json);
 
     bool isSameOrPastVersion(const CurrencyPool & otherPool) const;
+
+private:
+    /** Adds other times sign (1 or -1), in a single pass over the two
+        sorted lists of amounts.
+    */
+    CurrencyPool & merge(const CurrencyPool & other, int sign);
 };
 
 std::ostream & operator << (std::ostream & stream, CurrencyPool pool);
@@ -550,6 +660,124 @@ std::ostream & operator << (std::ostream & stream, CurrencyPool pool);
 IMPL_SERIALIZE_RECONSTITUTE(CurrencyPool);
 
 
+/*****************************************************************************/
+/* CURRENCY ACCUMULATOR                                                      */
+/*****************************************************************************/
+
+/** Sums amounts and pools into a fixed array of integers indexed by
+    currency, which saves looking up each currency and building the
+    intermediate pools when a lot of them are added together, as is done
+    to aggregate accounts:
+
+        CurrencyAccumulator total;
+        total += account.budgetIncreases;
+        total -= account.budgetDecreases;
+        ...
+        CurrencyPool budget = total.pool();
+*/
+struct CurrencyAccumulator {
+    enum { NumCurrencies = 4 };
+
+    CurrencyAccumulator()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        std::fill(values, values + NumCurrencies, 0);
+        used = 0;
+    }
+
+    /** Index of the currency in values, in the order of the codes, as in a
+        CurrencyPool; throws for CC_NONE.
+    */
+    static int index(CurrencyCode code)
+    {
+        switch (code) {
+        case CurrencyCode::CC_CLK: return 0;
+        case CurrencyCode::CC_EUR: return 1;
+        case CurrencyCode::CC_IMP: return 2;
+        case CurrencyCode::CC_USD: return 3;
+        default:
+            throw ML::Exception("no accumulator for currency %s",
+                                toString(code).c_str());
+        }
+    }
+
+    static CurrencyCode code(int index)
+    {
+        static const CurrencyCode codes[NumCurrencies] = {
+            CurrencyCode::CC_CLK, CurrencyCode::CC_EUR,
+            CurrencyCode::CC_IMP, CurrencyCode::CC_USD
+        };
+        return codes[index];
+    }
+
+    CurrencyAccumulator & operator += (const Amount & amount)
+    {
+        if (!amount) return *this;
+        int i = index(amount.currencyCode);
+        values[i] = detail::addChecked(values[i], amount.value);
+        used |= 1 << i;
+        return *this;
+    }
+
+    CurrencyAccumulator & operator -= (const Amount & amount)
+    {
+        if (!amount) return *this;
+        int i = index(amount.currencyCode);
+        values[i] = detail::subChecked(values[i], amount.value);
+        used |= 1 << i;
+        return *this;
+    }
+
+    CurrencyAccumulator & operator += (const CurrencyPool & pool)
+    {
+        for (auto & am: pool.currencyAmounts)
+            operator += (am);
+        return *this;
+    }
+
+    CurrencyAccumulator & operator -= (const CurrencyPool & pool)
+    {
+        for (auto & am: pool.currencyAmounts)
+            operator -= (am);
+        return *this;
+    }
+
+    CurrencyAccumulator & operator += (const CurrencyAccumulator & other)
+    {
+        for (int i = 0;  i < NumCurrencies;  ++i)
+            values[i] = detail::addChecked(values[i], other.values[i]);
+        used |= other.used;
+        return *this;
+    }
+
+    CurrencyAccumulator & operator -= (const CurrencyAccumulator & other)
+    {
+        for (int i = 0;  i < NumCurrencies;  ++i)
+            values[i] = detail::subChecked(values[i], other.values[i]);
+        used |= other.used;
+        return *this;
+    }
+
+    Amount get(CurrencyCode currency) const
+    {
+        return Amount(currency, values[index(currency)]);
+    }
+
+    /** The pool of the totals.  As with the arithmetic of CurrencyPool, a
+        currency that had a non-zero amount added is kept even if its total
+        is zero.
+    */
+    CurrencyPool pool() const;
+
+    int64_t values[NumCurrencies];
+    unsigned used;   ///< Bit per currency that was added to
+};
+
+
 /*****************************************************************************/
 /* LINE ITEMS                                                                */
 /*****************************************************************************/
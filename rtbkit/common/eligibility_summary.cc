@@ -0,0 +1,102 @@
+/* eligibility_summary.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Summary of the bid requests that the agents of an exchange can bid on.
+*/
+
+#include "rtbkit/common/eligibility_summary.h"
+
+#include <algorithm>
+
+
+using namespace std;
+
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* ELIGIBILITY SUMMARY                                                       */
+/*****************************************************************************/
+
+EligibilitySummary::
+EligibilitySummary()
+    : numAgents(0), anyFormat(false)
+{
+}
+
+uint32_t
+EligibilitySummary::
+formatKey(const Format & format)
+{
+    return uint32_t(uint16_t(format.width)) << 16 | uint16_t(format.height);
+}
+
+void
+EligibilitySummary::
+addAgent(const std::bitset<24 * 7> & agentHours,
+         const std::vector<Format> & agentFormats)
+{
+    ++numAgents;
+    hours |= agentHours;
+
+    for (const auto & format : agentFormats) {
+        if (format.width == 0 && format.height == 0) {
+            anyFormat = true;
+            continue;
+        }
+
+        uint32_t key = formatKey(format);
+        auto it = std::lower_bound(formats.begin(), formats.end(), key);
+        if (it == formats.end() || *it != key)
+            formats.insert(it, key);
+    }
+}
+
+bool
+EligibilitySummary::
+wants(const BidRequest & request) const
+{
+    if (!numAgents)
+        return false;
+
+    if (request.timestamp != Date() && !hours[request.timestamp.hourOfWeek()])
+        return false;
+
+    // Same as the CreativeFormatFilter: a spot without formats takes any
+    // creative.
+    for (const auto & imp : request.imp) {
+        if (anyFormat || imp.formats.empty())
+            return true;
+
+        for (const auto & format : imp.formats) {
+            if (std::binary_search(formats.begin(), formats.end(),
+                                   formatKey(format)))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+Json::Value
+EligibilitySummary::
+toJson() const
+{
+    Json::Value result;
+    result["agents"] = (Json::UInt)numAgents;
+    result["hours"] = (Json::UInt)hours.count();
+
+    if (anyFormat)
+        result["formats"] = "any";
+    else {
+        Json::Value & jsonFormats = result["formats"];
+        jsonFormats = Json::Value(Json::arrayValue);
+        for (uint32_t key : formats)
+            jsonFormats.append(Format(key >> 16, key & 0xffff).print());
+    }
+
+    return result;
+}
+
+} // namespace RTBKIT
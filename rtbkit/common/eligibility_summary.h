@@ -0,0 +1,60 @@
+/* eligibility_summary.h                                           -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Summary of the bid requests that the agents of an exchange can bid on.
+*/
+
+#pragma once
+
+#include "rtbkit/common/bid_request.h"
+#include <bitset>
+#include <vector>
+#include <stdint.h>
+
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* ELIGIBILITY SUMMARY                                                       */
+/*****************************************************************************/
+
+/** What the agents configured on an exchange can bid on, so that the
+    exchange connector can turn down the requests that none of them could
+    bid on before they are made into auctions and sent through the router.
+
+    The router builds one for each exchange whenever the configurations
+    change, from the hours of the week and the formats of the creatives of
+    the agents that are compatible with it.  Each of them is the union over
+    the agents: a request that the summary lets through may still find no
+    agent, but one that it rejects would have been filtered out for all of
+    them.  Immutable once published, so it's read without locks.
+*/
+
+struct EligibilitySummary {
+
+    EligibilitySummary();
+
+    /** Add an agent that bids in the given hours of the week with creatives
+        of the given formats; the 0x0 format fits any spot.
+    */
+    void addAgent(const std::bitset<24 * 7> & hours,
+                  const std::vector<Format> & formats);
+
+    /** Whether some agent could bid on the request. */
+    bool wants(const BidRequest & request) const;
+
+    size_t agents() const { return numAgents; }
+
+    Json::Value toJson() const;
+
+private:
+    static uint32_t formatKey(const Format & format);
+
+    size_t numAgents;
+    std::bitset<24 * 7> hours;
+    bool anyFormat;
+    std::vector<uint32_t> formats;      ///< Sorted keys of the formats
+};
+
+} // namespace RTBKIT
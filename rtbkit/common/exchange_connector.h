@@ -10,6 +10,7 @@
 #include "soa/service/service_base.h"
 #include "rtbkit/common/auction.h"
 #include "rtbkit/common/win_cost_model.h"
+#include "rtbkit/common/eligibility_summary.h"
 #include "jml/utils/unnamed_bool.h"
 #include "rtbkit/common/plugin_interface.h"
 
@@ -399,8 +400,25 @@ struct ExchangeConnector: public ServiceBase {
         return hasCurrencyConfigured_;
     }
 
+    /** Summary of the requests that the agents configured on this exchange
+        could bid on, published by the router whenever the configurations
+        change.  The connector turns down the requests that it rejects
+        before making auctions out of them; null (the default) lets
+        everything through.
+    */
+    std::shared_ptr<const EligibilitySummary> getEligibility() const
+    {
+        return std::atomic_load(&eligibility_);
+    }
+
+    void setEligibility(std::shared_ptr<const EligibilitySummary> summary)
+    {
+        std::atomic_store(&eligibility_, std::move(summary));
+    }
+
 private:
     bool hasCurrencyConfigured_;
+    std::shared_ptr<const EligibilitySummary> eligibility_;
     std::string currency_;
     RTBKIT::CurrencyCode currencyCode_;
 };
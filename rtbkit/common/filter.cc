@@ -11,7 +11,6 @@
 #include "jml/arch/spinlock.h"
 #include "jml/utils/exc_check.h"
 
-#include <unordered_map>
 #include <mutex>
 
 
@@ -26,35 +25,42 @@ namespace RTBKIT {
 /* FILTER STATE                                                               */
 /******************************************************************************/
 
-std::unordered_map<unsigned, BiddableSpots>
+void
 FilterState::
-biddableSpots()
+biddableSpots(BiddableConfigs& biddable)
 {
     // Used to remove creatives for configs that have been filtered out.
     narrowAllCreatives(CreativeMatrix(configs_));
 
-    std::unordered_map<unsigned, BiddableSpots> biddable;
-
-    for (size_t impId = 0; impId < creatives_.size(); ++impId) {
-        // \todo Would be nice if we could remove this temp map.
-        std::unordered_map<unsigned, SmallIntVector> biddableCreatives;
-
-        for (unsigned crId = 0; crId < creatives_[impId].size(); ++crId) {
-            const auto& configs = creatives_[impId][crId];
-
-            for (size_t config = configs.next();
-                 config < configs.size();
-                 config = configs.next(config + 1))
-            {
-                biddableCreatives[config].push_back(crId);
+    biddable.clear();
+    biddable.reserve(configs_.count());
+
+    // Going config by config lets us build each BiddableSpots in place
+    // without an intermediate map of creatives per impression. SmallIntVector
+    // and BiddableSpots keep their first few entries inline so the common case
+    // doesn't allocate anything beyond the list itself.
+    for (size_t config = configs_.next();
+         config < configs_.size();
+         config = configs_.next(config + 1))
+    {
+        biddable.emplace_back(config, BiddableSpots());
+        BiddableSpots& spots = biddable.back().second;
+
+        for (size_t impId = 0; impId < creatives_.size(); ++impId) {
+            const CreativeMatrix& matrix = creatives_[impId];
+
+            SmallIntVector biddableCreatives;
+            for (unsigned crId = 0; crId < matrix.size(); ++crId) {
+                if (matrix[crId].test(config))
+                    biddableCreatives.push_back(crId);
             }
+
+            if (!biddableCreatives.empty())
+                spots.emplace_back(impId, std::move(biddableCreatives));
         }
 
-        for (const auto& entry : biddableCreatives)
-            biddable[entry.first].emplace_back(impId, entry.second);
+        if (spots.empty()) biddable.pop_back();
     }
-
-    return biddable;
 }
 
 FilterState::FilterReasons&
@@ -16,6 +16,13 @@
 #include <memory>
 #include <functional>
 
+#if defined(__x86_64__)
+#  include <emmintrin.h>
+#  if defined(__AVX2__)
+#    include <immintrin.h>
+#  endif
+#endif
+
 
 namespace RTBKIT {
 
@@ -25,6 +32,95 @@ struct ExchangeConnector;
 struct AgentConfig;
 
 
+/******************************************************************************/
+/* BITFIELD KERNELS                                                           */
+/******************************************************************************/
+
+/** Word-wise kernels used by ConfigSet to manipulate its bitfield. They work
+    on raw pointers to skip the bounds checks and internal/external storage
+    branch of compact_vector::operator[] on every word.
+
+    The bitwise ops are processed 256 bits at a time when compiled with AVX2
+    and 128 bits at a time with SSE2 otherwise. Unaligned loads and stores are
+    used because the inline storage of compact_vector makes no alignment
+    guarantees.
+ */
+namespace details {
+
+typedef uint64_t BitfieldWord;
+
+#define RTBKIT_BITFIELD_KERNEL(_name_, _op_, _avx_, _sse_)              \
+    inline void _name_(                                                 \
+            BitfieldWord* dst,                                          \
+            const BitfieldWord* src,                                    \
+            size_t n)                                                   \
+    {                                                                   \
+        size_t i = 0;                                                   \
+        RTBKIT_BITFIELD_KERNEL_AVX(_avx_)                               \
+        RTBKIT_BITFIELD_KERNEL_SSE(_sse_)                               \
+        for (; i < n; ++i) dst[i] _op_ src[i];                          \
+    }
+
+#if defined(__AVX2__)
+#  define RTBKIT_BITFIELD_KERNEL_AVX(_avx_)                             \
+    for (; i + 4 <= n; i += 4) {                                        \
+        __m256i a = _mm256_loadu_si256((const __m256i*) (dst + i));     \
+        __m256i b = _mm256_loadu_si256((const __m256i*) (src + i));     \
+        _mm256_storeu_si256((__m256i*) (dst + i), _avx_(a, b));         \
+    }
+#else
+#  define RTBKIT_BITFIELD_KERNEL_AVX(_avx_)
+#endif
+
+#if defined(__x86_64__)
+#  define RTBKIT_BITFIELD_KERNEL_SSE(_sse_)                             \
+    for (; i + 2 <= n; i += 2) {                                        \
+        __m128i a = _mm_loadu_si128((const __m128i*) (dst + i));        \
+        __m128i b = _mm_loadu_si128((const __m128i*) (src + i));        \
+        _mm_storeu_si128((__m128i*) (dst + i), _sse_(a, b));            \
+    }
+#else
+#  define RTBKIT_BITFIELD_KERNEL_SSE(_sse_)
+#endif
+
+RTBKIT_BITFIELD_KERNEL(andWords, &=, _mm256_and_si256, _mm_and_si128)
+RTBKIT_BITFIELD_KERNEL(orWords,  |=, _mm256_or_si256,  _mm_or_si128)
+RTBKIT_BITFIELD_KERNEL(xorWords, ^=, _mm256_xor_si256, _mm_xor_si128)
+
+#undef RTBKIT_BITFIELD_KERNEL_SSE
+#undef RTBKIT_BITFIELD_KERNEL_AVX
+#undef RTBKIT_BITFIELD_KERNEL
+
+/** Uses independent accumulators so that the popcnt instructions can be
+    pipelined. A vectorized popcount isn't worth it for the handful of words
+    that a bitfield usually contains.
+ */
+inline size_t countWords(const BitfieldWord* words, size_t n)
+{
+    size_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        c0 += ML::num_bits_set(words[i + 0]);
+        c1 += ML::num_bits_set(words[i + 1]);
+        c2 += ML::num_bits_set(words[i + 2]);
+        c3 += ML::num_bits_set(words[i + 3]);
+    }
+    for (; i < n; ++i) c0 += ML::num_bits_set(words[i]);
+
+    return c0 + c1 + c2 + c3;
+}
+
+inline bool emptyWords(const BitfieldWord* words, size_t n)
+{
+    BitfieldWord acc = 0;
+    for (size_t i = 0; i < n; ++i) acc |= words[i];
+    return !acc;
+}
+
+} // namespace details
+
+
 /******************************************************************************/
 /* CONFIG SET                                                                 */
 /******************************************************************************/
@@ -40,11 +136,16 @@ struct AgentConfig;
 
     Note that this class is easier reflects more a bitfield then it does a
     set. In other words, it uses bitfield nomenclature to manipulate the set.
+
+    The first InlineWords words of the bitfield are stored inline which means
+    that sets of up to 512 configs never touch the heap. Larger sets fall back
+    to a heap allocated bitfield.
  */
 struct ConfigSet
 {
-    typedef uint64_t Word;
+    typedef details::BitfieldWord Word;
     static constexpr size_t Div = sizeof(Word) * 8;
+    static constexpr size_t InlineWords = 8;
 
     explicit ConfigSet(bool defaultValue = false) :
         defaultValue(defaultValue ? ~Word(0) : 0)
@@ -94,43 +195,35 @@ struct ConfigSet
 
     size_t count() const
     {
-        size_t total = 0;
-
-        for (size_t i = 0; i < bitfield.size(); ++i) {
-            if (!bitfield[i]) continue;
-            total += ML::num_bits_set(bitfield[i]);
-        }
-
-        return total;
+        if (bitfield.empty()) return 0;
+        return details::countWords(words(), bitfield.size());
     }
 
     size_t empty() const
     {
         if (bitfield.empty()) return !defaultValue;
-
-        for (size_t i = 0; i < bitfield.size(); ++i) {
-            if (bitfield[i]) return false;
-        }
-        return true;
+        return details::emptyWords(words(), bitfield.size());
     }
 
-#define RTBKIT_CONFIG_SET_OP(_op_)                                      \
+#define RTBKIT_CONFIG_SET_OP(_op_, _kernel_)                            \
     ConfigSet& operator _op_ (const ConfigSet& other)                   \
     {                                                                   \
         expand(other.size());                                           \
+        if (bitfield.empty()) return *this;                             \
                                                                         \
-        for (size_t i = 0; i < other.bitfield.size(); ++i)              \
-            bitfield[i] _op_ other.bitfield[i];                         \
+        Word* dst = words();                                            \
+        size_t n = other.bitfield.size();                               \
+        if (n) details::_kernel_(dst, other.words(), n);                \
                                                                         \
-        for (size_t i = other.bitfield.size(); i < bitfield.size(); ++i) \
-            bitfield[i] _op_ other.defaultValue;                        \
+        for (size_t i = n; i < bitfield.size(); ++i)                    \
+            dst[i] _op_ other.defaultValue;                             \
                                                                         \
         return *this;                                                   \
     }
 
-    RTBKIT_CONFIG_SET_OP(&=)
-    RTBKIT_CONFIG_SET_OP(|=)
-    RTBKIT_CONFIG_SET_OP(^=)
+    RTBKIT_CONFIG_SET_OP(&=, andWords)
+    RTBKIT_CONFIG_SET_OP(|=, orWords)
+    RTBKIT_CONFIG_SET_OP(^=, xorWords)
 
 #undef RTBKIT_CONFIG_SET_OP
 
@@ -155,8 +248,11 @@ struct ConfigSet
     ConfigSet& negate()
     {
         defaultValue = ~defaultValue;
+        if (bitfield.empty()) return *this;
+
+        Word* dst = words();
         for (size_t i = 0; i < bitfield.size(); ++i)
-            bitfield[i] = ~bitfield[i];
+            dst[i] = ~dst[i];
         return *this;
     }
 
@@ -179,9 +275,11 @@ struct ConfigSet
         size_t topIndex = start / Div;
         size_t subIndex = start % Div;
         Word mask = -1ULL & ~((1ULL << subIndex) - 1);
+        if (topIndex >= bitfield.size()) return size();
 
+        const Word* src = words();
         for (size_t i = topIndex; i < bitfield.size(); ++i) {
-            Word value = bitfield[i] & mask;
+            Word value = src[i] & mask;
             mask = -1ULL;
 
             if (!value) continue;
@@ -203,7 +301,12 @@ struct ConfigSet
     }
 
 private:
-    ML::compact_vector<Word, 8> bitfield;
+
+    // Only valid if the bitfield isn't empty.
+    Word* words() { return &bitfield[0]; }
+    const Word* words() const { return &bitfield[0]; }
+
+    ML::compact_vector<Word, InlineWords> bitfield;
     Word defaultValue;
 };
 
@@ -373,9 +476,12 @@ struct FilterState
     FilterState(
             const BidRequest& br,
             const ExchangeConnector* ex,
-            const CreativeMatrix& activeConfigs) :
+            const CreativeMatrix& activeConfigs,
+            const Auction::Augmentations* augmentations = nullptr) :
         request(br),
-        exchange(ex)
+        exchange(ex),
+        augmentations(augmentations),
+        recordReasons_(true)
     {
         if (activeConfigs.size())
             configs_ = activeConfigs[0];
@@ -385,6 +491,10 @@ struct FilterState
     const BidRequest& request;
     const ExchangeConnector * const exchange;
 
+    // Augmentations of the auction; only available to the filters of the
+    // PostAugmentation phase and null for the others.
+    const Auction::Augmentations * const augmentations;
+
     // Current set of active configuration.
     const ConfigSet& configs() const { return configs_; }
 
@@ -420,9 +530,21 @@ struct FilterState
     }
 
 
-    // Returns a map of configIndex to BiddableSpots object based on the
-    // creative matrix. This is the format ingested by the router.
-    std::unordered_map<unsigned, BiddableSpots> biddableSpots();
+    // List of (configIndex, BiddableSpots) pairs ordered by configIndex.
+    typedef std::vector< std::pair<unsigned, BiddableSpots> > BiddableConfigs;
+
+    // Fills the list with the BiddableSpots of every remaining config based
+    // on the creative matrix. This is the format ingested by the router. The
+    // list is cleared first so that its storage can be reused from one
+    // request to the next.
+    void biddableSpots(BiddableConfigs& biddable);
+
+    BiddableConfigs biddableSpots()
+    {
+        BiddableConfigs biddable;
+        biddableSpots(biddable);
+        return biddable;
+    }
 
     /*
      * This map is keyed by filtered reasons and contains a ConfigSet.
@@ -435,6 +557,12 @@ struct FilterState
 
     void resetFilterReasons();
 
+    // Whether the filters should fill in the filter reasons. Building them is
+    // costly so the FilterPool only asks for them on a sample of the requests
+    // and filters should skip that work when this is false.
+    bool recordReasons() const { return recordReasons_; }
+    void setRecordReasons(bool value) { recordReasons_ = value; }
+
 private:
     void updateConfigs()
     {
@@ -446,6 +574,7 @@ private:
     ConfigSet configs_;
     ML::compact_vector<CreativeMatrix, 8> creatives_;
     FilterReasons filterReasons_;
+    bool recordReasons_;
 };
 
 
@@ -476,6 +605,16 @@ struct FilterBase
     virtual unsigned priority() const { return 0; }
 
 
+    /** Filters of the PreAugmentation phase only look at the bid request and
+        their survivors are the agents for which the auction is augmented.
+        Those of the PostAugmentation phase are executed once the
+        augmentations are in, on the configs that made it through the first
+        phase.
+     */
+    enum Phase { PreAugmentation, PostAugmentation };
+    virtual Phase phase() const { return PreAugmentation; }
+
+
     /** Filters the given bid request such and a return the set of agent
         configuration that matches the given bid request. The filter should
         modified state to filter-out configs.
@@ -11,6 +11,7 @@
 #include "soa/types/value_description.h"
 #include "soa/service/zmq.hpp"
 #include "rtbkit/common/json_holder.h"
+#include <algorithm>
 
 namespace Datacratic {
 
@@ -97,11 +98,12 @@ struct Message {
         using namespace Datacratic;
         static auto desc = getDefaultDescriptionShared((T*) 0);
 
-        std::stringstream stream;
-        Datacratic::StreamJsonPrintingContext context(stream);
+        std::string result = "{\"" + desc->typeName + "\":";
+        Datacratic::StringJsonPrintingContext context(result);
         desc->printJson(&payload, context);
+        result += '}';
 
-        return ML::format("{\"%s\":%s}", desc->typeName, stream.str());
+        return result;
     }
 
     static Message<T> fromString(std::string const & value) {
@@ -121,6 +123,26 @@ struct Message {
     }
 };
 
+/** Names of the shared memory rings used between a router and the bidding
+    agents on the same host.  Each agent creates its own ring for the
+    auctions sent to it, and the router creates a single ring for the bids
+    of all of its agents.
+*/
+inline std::string sharedMemoryAuctionRing(const std::string & prefix,
+                                           const std::string & agent)
+{
+    std::string result = prefix + ".auctions." + agent;
+    std::replace(result.begin(), result.end(), '/', '_');
+    return result;
+}
+
+inline std::string sharedMemoryBidRing(const std::string & prefix)
+{
+    std::string result = prefix + ".bids";
+    std::replace(result.begin(), result.end(), '/', '_');
+    return result;
+}
+
 } // namespace RTBKIT
 
 #endif /* __router__messages_h__ */
@@ -9,6 +9,7 @@
 #include "soa/service/service_base.h"
 #include "soa/service/zmq_endpoint.h"
 #include "rtbkit/core/post_auction/event_forwarder.h"
+#include "jml/arch/timers.h"
 #include "post_auction_proxy.h"
 
 using namespace std;
@@ -23,15 +24,58 @@ namespace RTBKIT {
 PostAuctionProxy::
 PostAuctionProxy(ServiceBase& parent) :
     parent(&parent),
-    proxies(parent.getServices())
+    proxies(parent.getServices()),
+    batchSize(0),
+    auctionBatchSize(0),
+    compressAuctions(false),
+    shutdown_(false)
 {}
 
 PostAuctionProxy::
 PostAuctionProxy(std::shared_ptr<Datacratic::ServiceProxies> proxies) :
     parent(nullptr),
-    proxies(proxies)
+    proxies(proxies),
+    batchSize(0),
+    auctionBatchSize(0),
+    compressAuctions(false),
+    shutdown_(false)
 {}
 
+PostAuctionProxy::
+~PostAuctionProxy()
+{
+    shutdown();
+}
+
+void
+PostAuctionProxy::
+enableBatching(size_t maxEvents, size_t queueSize)
+{
+    ExcCheck(!batcher, "can't change the batching of a running proxy");
+
+    batchSize = maxEvents > 1 ? maxEvents : 0;
+    if (batchSize) {
+        typedef ML::RingBufferMPSC< std::shared_ptr<PostAuctionEvent> > Queue;
+        batchQueue.reset(new Queue(queueSize));
+    }
+    else batchQueue.reset();
+}
+
+void
+PostAuctionProxy::
+enableAuctionBatching(size_t maxAuctions, bool compress, size_t queueSize)
+{
+    ExcCheck(!batcher, "can't change the batching of a running proxy");
+
+    auctionBatchSize = maxAuctions > 1 ? maxAuctions : 0;
+    compressAuctions = compress;
+    if (auctionBatchSize) {
+        typedef ML::RingBufferMPSC< std::shared_ptr<SubmittedAuctionEvent> > Queue;
+        auctionQueue.reset(new Queue(queueSize));
+    }
+    else auctionQueue.reset();
+}
+
 void
 PostAuctionProxy::
 init()
@@ -39,6 +83,23 @@ init()
     if (proxies->params.isMember("postAuctionURIs"))
         initHTTP();
     else initZMQ();
+
+    // Over http, the EventForwarders do the batching.
+    if ((batchSize || auctionBatchSize) && zmq) {
+        shutdown_ = false;
+        batcher.reset(new std::thread([=] { this->runBatcher(); }));
+    }
+}
+
+void
+PostAuctionProxy::
+shutdown()
+{
+    if (!batcher) return;
+
+    shutdown_ = true;
+    batcher->join();
+    batcher.reset();
 }
 
 void
@@ -62,13 +123,18 @@ initHTTP()
     shards = uris.size();
     http.resize(uris.size());
 
+    EventForwarder::Batching batching;
+    batching.maxSize = batchSize;
+
     for (size_t i = 0; i < uris.size(); ++i) {
         std::string name = "postAuctionProxy" + std::to_string(i);
 
         if (parent)
-            http[i] = std::make_shared<EventForwarder>(*parent, uris[i].asString(), name);
+            http[i] = std::make_shared<EventForwarder>(
+                    *parent, uris[i].asString(), name, batching);
         else
-            http[i] = std::make_shared<EventForwarder>(proxies, uris[i].asString(), name);
+            http[i] = std::make_shared<EventForwarder>(
+                    proxies, uris[i].asString(), name, batching);
     }
 }
 
@@ -88,6 +154,15 @@ isConnected() const
 void
 PostAuctionProxy::
 sendAuction(std::shared_ptr<SubmittedAuctionEvent> event)
+{
+    // Only fall back to a direct send if the batcher can't keep up.
+    if (batcher && auctionQueue && auctionQueue->tryPush(event)) return;
+    sendAuctionNow(event);
+}
+
+void
+PostAuctionProxy::
+sendAuctionNow(const std::shared_ptr<SubmittedAuctionEvent> & event)
 {
     size_t shard = event->auctionId.hash() % shards;
 
@@ -101,6 +176,15 @@ sendAuction(std::shared_ptr<SubmittedAuctionEvent> event)
 void
 PostAuctionProxy::
 sendEvent(std::shared_ptr<PostAuctionEvent> event)
+{
+    // Only fall back to a direct send if the batcher can't keep up.
+    if (batcher && batchQueue && batchQueue->tryPush(event)) return;
+    sendEventNow(event);
+}
+
+void
+PostAuctionProxy::
+sendEventNow(const std::shared_ptr<PostAuctionEvent> & event)
 {
     size_t shard = event->auctionId.hash() % shards;
 
@@ -111,5 +195,72 @@ sendEvent(std::shared_ptr<PostAuctionEvent> event)
     }
 }
 
+void
+PostAuctionProxy::
+runBatcher()
+{
+    std::vector< std::vector<std::string> > frames(shards);
+    std::vector< std::vector< std::shared_ptr<SubmittedAuctionEvent> > >
+        submitted(shards);
+
+    auto onEvent = [&] (std::shared_ptr<PostAuctionEvent> && event) {
+        size_t shard = event->auctionId.hash() % shards;
+        frames[shard].emplace_back(ML::DB::serializeToString(*event));
+    };
+
+    auto onAuction = [&] (std::shared_ptr<SubmittedAuctionEvent> && event) {
+        size_t shard = event->auctionId.hash() % shards;
+        submitted[shard].emplace_back(std::move(event));
+    };
+
+    for (;;) {
+        // Read before draining so that everything queued before shutdown()
+        // makes it out.
+        bool stopping = shutdown_;
+
+        size_t popped = 0;
+
+        // The submissions of an auction are usually queued together, so a
+        // pass tends to put them in the same message.
+        if (auctionQueue) {
+            popped += auctionQueue->popBatch(onAuction,
+                                             auctionBatchSize * shards);
+
+            for (size_t shard = 0; shard < shards; ++shard) {
+                auto& batch = submitted[shard];
+                for (size_t i = 0; i < batch.size(); i += auctionBatchSize) {
+                    size_t last = std::min(batch.size(), i + auctionBatchSize);
+                    std::vector< std::shared_ptr<SubmittedAuctionEvent> > message(
+                            batch.begin() + i, batch.begin() + last);
+                    (void) zmq->sendMessageToShard(
+                            shard, "AUCTIONS",
+                            encodeSubmittedAuctions(message, compressAuctions));
+                }
+                batch.clear();
+            }
+        }
+
+        if (batchQueue) {
+            popped += batchQueue->popBatch(onEvent, batchSize * shards);
+
+            for (size_t shard = 0; shard < shards; ++shard) {
+                auto& batch = frames[shard];
+                for (size_t i = 0; i < batch.size(); i += batchSize) {
+                    size_t last = std::min(batch.size(), i + batchSize);
+                    std::vector<std::string> message(
+                            std::make_move_iterator(batch.begin() + i),
+                            std::make_move_iterator(batch.begin() + last));
+                    (void) zmq->sendMessageToShard(shard, "EVENTS", message);
+                }
+                batch.clear();
+            }
+        }
+
+        if (!popped) {
+            if (stopping) break;
+            ML::sleep(0.001);
+        }
+    }
+}
 
 } // namepsace RTBKIT
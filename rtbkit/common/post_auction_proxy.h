@@ -9,6 +9,10 @@
 #pragma once
 
 #include "rtbkit/common/auction_events.h"
+#include "jml/utils/ring_buffer.h"
+
+#include <atomic>
+#include <thread>
 
 namespace Datacratic {
 
@@ -31,14 +35,41 @@ struct EventForwarder;
     Requires that the postAuctionShard configuration parameter be provided in
     the bootstrap.json to determine the number of active post auction shards. If
     not present, assumes that there's only one active post auction shard.
+
+    Events can optionally be batched: sendEvent() then only queues the event
+    and a background thread forwards everything queued for a shard in a
+    single EVENTS message. Over http, the events are posted in batches to
+    the post auction loops' batch route instead. Either way, this requires
+    post auction loops that understand batches.
+
+    Submitted auctions can be batched the same way over zeromq, in AUCTIONS
+    messages encoded with encodeSubmittedAuctions().
  */
 struct PostAuctionProxy
 {
     PostAuctionProxy(Datacratic::ServiceBase& parent);
     PostAuctionProxy(std::shared_ptr<Datacratic::ServiceProxies> proxies);
+    ~PostAuctionProxy();
+
+    /** Batch up to maxEvents events per message. Must be called before
+        init(); 0 disables batching which is the default.
+    */
+    void enableBatching(size_t maxEvents, size_t queueSize = 1 << 16);
+
+    /** Batch up to maxAuctions submitted auctions per message, LZ4
+        compressed if compress is set.  Must be called before init(); 0
+        disables batching which is the default.  Has no effect over http,
+        where the EventForwarders already batch auctions.
+    */
+    void enableAuctionBatching(size_t maxAuctions, bool compress = false,
+                               size_t queueSize = 1 << 16);
 
     void init();
 
+    /** Flushes the queued events, if batching, and stops the batching
+        thread. */
+    void shutdown();
+
     // Returns true only the proxy is connected to all shards.
     bool isConnected() const;
 
@@ -52,12 +83,26 @@ private:
     void initZMQ();
     void initHTTP();
 
+    void sendEventNow(const std::shared_ptr<PostAuctionEvent> & event);
+    void sendAuctionNow(const std::shared_ptr<SubmittedAuctionEvent> & event);
+    void runBatcher();
+
     Datacratic::ServiceBase* parent;
     std::shared_ptr<Datacratic::ServiceProxies> proxies;
 
     size_t shards;
     std::unique_ptr<Datacratic::ZmqMultipleNamedClientBusProxy> zmq;
     std::vector< std::shared_ptr<EventForwarder> > http;
+
+    size_t batchSize;
+    std::unique_ptr< ML::RingBufferMPSC< std::shared_ptr<PostAuctionEvent> > > batchQueue;
+
+    size_t auctionBatchSize;
+    bool compressAuctions;
+    std::unique_ptr< ML::RingBufferMPSC< std::shared_ptr<SubmittedAuctionEvent> > > auctionQueue;
+
+    std::unique_ptr<std::thread> batcher;
+    std::atomic<bool> shutdown_;
 };
 
 } // namespace RTBKIT
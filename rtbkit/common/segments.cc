@@ -15,6 +15,12 @@
 #include "jml/db/persistent.h"
 #include <boost/make_shared.hpp>
 #include <boost/algorithm/string.hpp>
+#include <mutex>
+#include <unordered_map>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
 
 using namespace std;
 using namespace ML;
@@ -186,16 +192,92 @@ weight(const std::string & str) const
 template<typename Seq1, typename Seq2>
 bool anyMatchesLookup(const Seq1 & seq1, const Seq2 & seq2)
 {
+    // Gallop through seq2: both sequences are sorted so the search for each
+    // element of seq1 can start where the previous one finished.
     auto it2 = seq2.begin(), end2 = seq2.end();
     for (auto it1 = seq1.begin(), end1 = seq1.end();
-         it1 != end1;  ++it1)
-        if (std::binary_search(it2, end2, *it1)) return true;
+         it1 != end1 && it2 != end2;  ++it1) {
+        size_t step = 1;
+        auto bound = it2;
+        while (size_t(end2 - bound) > step && *(bound + step) < *it1) {
+            bound += step;
+            step *= 2;
+        }
+        auto last = size_t(end2 - bound) > step ? bound + step + 1 : end2;
+        it2 = std::lower_bound(bound, last, *it1);
+        if (it2 != end2 && !(*it1 < *it2)) return true;
+    }
+    return false;
+}
+
+/** Merge based intersection test of two sorted arrays of integers.  With
+    SSE2 it compares blocks of four elements against each other, throwing
+    away the block with the smaller maximum each time.
+*/
+static bool anyMatchesSorted(const int * p1, size_t n1,
+                             const int * p2, size_t n2)
+{
+    size_t i1 = 0, i2 = 0;
+
+#if defined(__SSE2__)
+    while (i1 + 4 <= n1 && i2 + 4 <= n2) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p1 + i1));
+        __m128i b = _mm_loadu_si128((const __m128i *)(p2 + i2));
+
+        __m128i eq = _mm_cmpeq_epi32(a, b);
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, 0x39)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, 0x4e)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, 0x93)));
+        if (_mm_movemask_epi8(eq))
+            return true;
+
+        int max1 = p1[i1 + 3], max2 = p2[i2 + 3];
+        if (max1 <= max2) i1 += 4;
+        if (max2 <= max1) i2 += 4;
+    }
+#endif
+
+    while (i1 < n1 && i2 < n2) {
+        if (p1[i1] == p2[i2]) return true;
+        else if (p1[i1] < p2[i2]) ++i1;
+        else ++i2;
+    }
+
+    return false;
+}
+
+template<typename Seq1, typename Seq2>
+bool anyMatchesMerge(const Seq1 & seq1, const Seq2 & seq2,
+                     std::true_type /* ints */)
+{
+    return anyMatchesSorted(&*seq1.begin(), seq1.size(),
+                            &*seq2.begin(), seq2.size());
+}
+
+template<typename Seq1, typename Seq2>
+bool anyMatchesMerge(const Seq1 & seq1, const Seq2 & seq2,
+                     std::false_type /* ints */)
+{
+    auto it1 = seq1.begin(), end1 = seq1.end();
+    auto it2 = seq2.begin(), end2 = seq2.end();
+
+    while (it1 != end1 && it2 != end2) {
+        if (*it1 == *it2) return true;
+        else if (*it1 < *it2) ++it1;
+        else ++it2;
+    }
+
     return false;
 }
 
 template<typename Seq1, typename Seq2>
 bool anyMatches(const Seq1 & seq1, const Seq2 & seq2)
 {
+    typedef std::integral_constant<
+        bool,
+        std::is_same<typename Seq1::value_type, int>::value
+        && std::is_same<typename Seq2::value_type, int>::value> IsInts;
+
     if (seq1.empty() || seq2.empty())
         return false;
     else if (seq1.size() * 5 < seq2.size()) {
@@ -208,16 +290,7 @@ bool anyMatches(const Seq1 & seq1, const Seq2 & seq2)
     }
     else {
         // roughly equal sizes; jointly iterate
-        auto it1 = seq1.begin(), end1 = seq1.end();
-        auto it2 = seq2.begin(), end2 = seq2.end();
-    
-        while (it1 != end1 && it2 != end2) {
-            if (*it1 == *it2) return true;
-            else if (*it1 < *it2) ++it1;
-            else ++it2;
-        }
-
-        return false;
+        return anyMatchesMerge(seq1, seq2, IsInts());
     }
 }
 
@@ -226,7 +299,7 @@ SegmentList::
 match(const SegmentList & other) const
 {
     return anyMatches(ints, other.ints)
-        || anyMatches(strings, other.strings);
+        || anyMatches(stringIds, other.stringIds);
 }
 
 bool
@@ -364,6 +437,7 @@ add(const std::string & str, float weight)
     int i = parseSegmentNum(str);
     if (i == -1) {
         strings.push_back(str);
+        stringIds.push_back(internSegment(str));
         if (weight != 1.0 || !weights.empty()) {
             if (weights.empty())
                 weights.resize(size() - 1, 1.0);
@@ -399,6 +473,8 @@ void
 SegmentList::
 sort()
 {
+    std::sort(stringIds.begin(), stringIds.end());
+
     if (weights.empty()) {
         std::sort(ints.begin(), ints.end());
         std::sort(strings.begin(), strings.end());
@@ -443,6 +519,11 @@ reconstitute(ML::DB::Store_Reader & store)
     if (version > 0)
         throw ML::Exception("unknown SegmentList version");
     store >> ints >> strings >> weights;
+
+    stringIds.clear();
+    for (auto & str: strings)
+        stringIds.push_back(internSegment(str));
+    std::sort(stringIds.begin(), stringIds.end());
 }
 
 std::string
@@ -459,6 +540,20 @@ reconstituteFromString(const std::string & str)
     return ML::DB::reconstituteFromString<SegmentList>(str);
 }
 
+int
+SegmentList::
+internSegment(const std::string & str)
+{
+    static std::mutex lock;
+    static std::unordered_map<std::string, int> ids;
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = ids.find(str);
+    if (it == ids.end())
+        it = ids.insert(make_pair(str, (int)ids.size())).first;
+    return it->second;
+}
+
 void
 SegmentList::
 forEach(const std::function<void (int, string, float)> & onSegment) const
@@ -483,7 +578,7 @@ SegmentsBySource()
 
 SegmentsBySource::
 SegmentsBySource(SegmentsBySourceBase && other)
-    : SegmentsBySourceBase(other)
+    : SegmentsBySourceBase(std::move(other))
 {
 }
 
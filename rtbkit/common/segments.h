@@ -5,6 +5,7 @@
 #pragma once
 
 #include "jml/utils/compact_vector.h"
+#include "jml/utils/compact_map.h"
 #include "jml/db/persistent_fwd.h"
 #include "soa/jsoncpp/json.h"
 #include "soa/types/value_description.h"
@@ -74,10 +75,20 @@ struct SegmentList {
     void forEach(const std::function<void (int, std::string, float)> & onSegment)
         const;
 
+    /** Return the process-wide integer that identifies the given string
+        segment, allocating one the first time the string is seen.  The
+        numbering is specific to the process and must not be persisted.
+    */
+    static int internSegment(const std::string & str);
+
     //private:    
     ML::compact_vector<int, 7> ints;          ///< Categories
     std::vector<std::string> strings;         ///< Those that aren't an integer
     ML::compact_vector<float, 5> weights;     ///< Weights over ints and strings
+
+    /// Interned numbers of the strings, sorted by number so that two lists
+    /// can be matched without comparing strings.
+    ML::compact_vector<int, 3> stringIds;
     
     void serialize(ML::DB::Store_Writer & store) const;
     void reconstitute(ML::DB::Store_Reader & store);
@@ -98,10 +109,12 @@ operator << (std::ostream & stream, const SegmentList & segs)
 /* SEGMENTS BY SOURCE                                                        */
 /*****************************************************************************/
 
-typedef std::map<std::string, std::shared_ptr<SegmentList> >
+typedef ML::compact_map<std::string, std::shared_ptr<SegmentList>, 3>
 SegmentsBySourceBase;
 
-/** A set of segments per segment provider. */
+/** A set of segments per segment provider.  There are usually only a few
+    providers so they are kept inline in a sorted vector.
+*/
 
 struct SegmentsBySource
     : public SegmentsBySourceBase {
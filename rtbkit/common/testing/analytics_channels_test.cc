@@ -0,0 +1,104 @@
+/* analytics_channels_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests of the channel sampling of the analytics.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "rtbkit/common/analytics_publisher.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+int countAccepted(const AnalyticsChannels & channels,
+                  const string & channel, int numMessages)
+{
+    int result = 0;
+    for (int i = 0;  i < numMessages;  ++i)
+        result += channels.accept(channel);
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_analytics_channels_rates )
+{
+    AnalyticsChannels channels;
+
+    // Unknown channels get the default rate
+    BOOST_CHECK(!channels.enabled("BID"));
+    BOOST_CHECK_EQUAL(countAccepted(channels, "BID", 100), 0);
+    channels.setDefaultRate(1.0);
+    BOOST_CHECK_EQUAL(countAccepted(channels, "BID", 100), 100);
+
+    channels.setRate("BID", 0.25);
+    BOOST_CHECK(channels.enabled("BID"));
+    BOOST_CHECK_EQUAL(countAccepted(channels, "BID", 100), 25);
+    // Changing the rate of a known channel keeps its count going
+    channels.setRate("BID", 0.1);
+    BOOST_CHECK_EQUAL(countAccepted(channels, "BID", 1000), 100);
+
+    Json::Value rates;
+    rates["BID"] = false;
+    rates["WIN"] = true;
+    rates["AUCTION"] = 0.5;
+    channels.setRates(rates);
+    channels.setDefaultRate(0.0);
+
+    BOOST_CHECK(!channels.enabled("BID"));
+    BOOST_CHECK_EQUAL(countAccepted(channels, "BID", 10), 0);
+    BOOST_CHECK_EQUAL(countAccepted(channels, "WIN", 10), 10);
+    BOOST_CHECK_EQUAL(channels.rate("AUCTION"), 0.5);
+    BOOST_CHECK_EQUAL(countAccepted(channels, "AUCTION", 10), 5);
+    BOOST_CHECK_EQUAL(countAccepted(channels, "LOSS", 10), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_analytics_channels_threads )
+{
+    AnalyticsChannels channels(1.0);
+    channels.setRate("BID", 0.5);
+
+    enum { NumThreads = 4, NumMessages = 100000 };
+    std::atomic<int> accepted(0);
+
+    // Channels are added while the others are being sampled
+    auto sampleThread = [&] (int thread)
+        {
+            for (unsigned i = 0;  i < NumMessages;  ++i) {
+                accepted += channels.accept("BID");
+                if (i % 1000 == 0)
+                    channels.setRate("CHANNEL" + to_string(thread * 1000 + i),
+                                     1.0);
+            }
+        };
+
+    vector<std::thread> threads;
+    for (unsigned i = 0;  i < NumThreads;  ++i)
+        threads.emplace_back(sampleThread, i);
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(accepted, NumThreads * NumMessages / 2);
+    BOOST_CHECK(channels.enabled("CHANNEL1000"));
+}
+
+BOOST_AUTO_TEST_CASE( test_analytics_lazy_arguments )
+{
+    int calls = 0;
+    auto lazy = [&] () { ++calls;  return string("value"); };
+
+    BOOST_CHECK_EQUAL(evaluateLazy(lazy, 0), "value");
+    BOOST_CHECK_EQUAL(calls, 1);
+    BOOST_CHECK_EQUAL(evaluateLazy(string("plain"), 0), "plain");
+    BOOST_CHECK_EQUAL(evaluateLazy(3, 0), 3);
+}
@@ -0,0 +1,118 @@
+/* auction_trace_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test for the sampled tracing of auctions.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/common/auction_trace.h"
+#include "jml/arch/exception_handler.h"
+#include <thread>
+
+
+using namespace std;
+using namespace RTBKIT;
+
+BOOST_AUTO_TEST_CASE( test_auction_trace_sampling )
+{
+    AuctionTrace::drain();
+
+    // Off by default
+    AuctionTrace::record(Id(1), AS_PARSE);
+    BOOST_CHECK(AuctionTrace::drain().events.empty());
+
+    // Everything, from several threads, each in order
+    AuctionTrace::setSampling(1);
+
+    auto doAuction = [] (int i)
+        {
+            Id id(i);
+            AuctionTrace::record(id, AS_PARSE);
+            AuctionTrace::record(id, AS_FILTER);
+            AuctionTrace::record(id, AS_BID);
+        };
+
+    std::thread t1([&] () { for (int i = 1;  i <= 100;  ++i) doAuction(i); });
+    std::thread t2([&] () { for (int i = 101;  i <= 200;  ++i) doAuction(i); });
+    t1.join();
+    t2.join();
+
+    auto batch = AuctionTrace::drain();
+    BOOST_CHECK_EQUAL(batch.events.size(), 600);
+    BOOST_CHECK_EQUAL(batch.numDropped, 0);
+
+    map<uint64_t, vector<AuctionTraceEvent> > traces;
+    for (auto & event: batch.events)
+        traces[event.traceId].push_back(event);
+    BOOST_CHECK_EQUAL(traces.size(), 200);
+    for (auto & trace: traces) {
+        BOOST_REQUIRE_EQUAL(trace.second.size(), 3);
+        BOOST_CHECK_EQUAL(trace.second[0].stage, AS_PARSE);
+        BOOST_CHECK_EQUAL(trace.second[2].stage, AS_BID);
+        BOOST_CHECK(trace.second[0].ticks <= trace.second[2].ticks);
+        BOOST_CHECK_EQUAL(trace.second[0].thread, trace.second[2].thread);
+    }
+
+    // The same auctions are sampled in every process
+    AuctionTrace::setSampling(4);
+    size_t numSampled = 0;
+    for (int i = 1;  i <= 100;  ++i) {
+        Id id(i);
+        AuctionTrace::record(id, AS_WIN);
+        if (id.hash() % 4 == 0) ++numSampled;
+        BOOST_CHECK_EQUAL(AuctionTrace::sampled(id), id.hash() % 4 == 0);
+    }
+    BOOST_CHECK_EQUAL(AuctionTrace::drain().events.size(), numSampled);
+
+    AuctionTrace::setSampling(0);
+}
+
+BOOST_AUTO_TEST_CASE( test_auction_trace_ring_full )
+{
+    AuctionTrace::drain();
+    AuctionTrace::setSampling(1);
+
+    for (unsigned i = 0;  i < AuctionTrace::RingSize + 10;  ++i)
+        AuctionTrace::record(Id(1), AS_BID);
+
+    auto batch = AuctionTrace::drain();
+    BOOST_CHECK_EQUAL(batch.events.size(), AuctionTrace::RingSize);
+    BOOST_CHECK_EQUAL(batch.numDropped, 10);
+
+    // Room again once drained
+    AuctionTrace::record(Id(1), AS_BID);
+    BOOST_CHECK_EQUAL(AuctionTrace::drain().events.size(), 1);
+
+    AuctionTrace::setSampling(0);
+}
+
+BOOST_AUTO_TEST_CASE( test_auction_trace_batch_serialization )
+{
+    AuctionTraceBatch batch;
+    batch.service = "router";
+    batch.ticksPerSecond = 1e9;
+    batch.ticksAtDate = 5000000000;
+    batch.date = Date::fromSecondsSinceEpoch(1000.0);
+    batch.numDropped = 3;
+    batch.events.push_back({ 12, 4000000000, AS_PARSE, 0, 1 });
+    batch.events.push_back({ 12, 4500000000, AS_FILTER, 0, 2 });
+
+    string data = batch.serialize();
+    auto batch2 = AuctionTraceBatch::reconstitute(data);
+    BOOST_CHECK_EQUAL(batch2.service, "router");
+    BOOST_CHECK_EQUAL(batch2.numDropped, 3);
+    BOOST_REQUIRE_EQUAL(batch2.events.size(), 2);
+    BOOST_CHECK_EQUAL(batch2.events[1].stage, AS_FILTER);
+    BOOST_CHECK_EQUAL(batch2.events[1].thread, 2);
+    BOOST_CHECK_CLOSE(batch2.toDate(batch2.events[0].ticks).secondsSinceEpoch(),
+                      999.0, 1e-9);
+
+    JML_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(AuctionTraceBatch::reconstitute(data.substr(0, 30)),
+                      ML::Exception);
+    BOOST_CHECK_THROW(AuctionTraceBatch::reconstitute(data + "x"),
+                      ML::Exception);
+}
@@ -0,0 +1,91 @@
+/* augmentation_list_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the encodings and merging of augmentation lists.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/common/augmentation.h"
+
+
+using namespace std;
+using namespace RTBKIT;
+
+namespace {
+
+AugmentationList makeList()
+{
+    AugmentationList list;
+    list.insertGlobal(Augmentation(set<string>{ "a", "b" }));
+    list[AccountKey("campaign:strategy")] = Augmentation(set<string>{ "b", "c" });
+
+    Json::Value data;
+    data["freq"] = 3;
+    list[AccountKey("campaign")] = Augmentation(set<string>{ "a" }, data);
+
+    return list;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_augmentation_list_binary )
+{
+    AugmentationList list = makeList();
+
+    string binary = list.toBinary();
+    BOOST_CHECK(AugmentationList::isBinary(binary));
+    BOOST_CHECK(!AugmentationList::isBinary(list.toJson().toString()));
+
+    AugmentationList decoded = AugmentationList::fromBinary(binary);
+    BOOST_CHECK_EQUAL(decoded.toJson(), list.toJson());
+
+    // Both encodings go through parse
+    BOOST_CHECK_EQUAL(AugmentationList::parse(binary).toJson(), list.toJson());
+    BOOST_CHECK_EQUAL(AugmentationList::parse(list.toJson().toString()).toJson(),
+                      list.toJson());
+    BOOST_CHECK(AugmentationList::parse("null").empty());
+    BOOST_CHECK(AugmentationList::parse("").empty());
+
+    // Tags are only written once
+    string json = list.toJson().toString();
+    BOOST_CHECK_LT(binary.size(), json.size());
+
+    AugmentationList empty;
+    BOOST_CHECK(AugmentationList::fromBinary(empty.toBinary()).empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_augmentation_list_merge )
+{
+    AugmentationList list = makeList();
+
+    AugmentationList other;
+    other.insertGlobal(Augmentation(set<string>{ "d" }));
+    other[AccountKey("other")] = Augmentation(set<string>{ "e" });
+
+    Json::Value data;
+    data["segments"] = 1;
+    other[AccountKey("campaign")] = Augmentation(data);
+
+    list.mergeWith(other);
+
+    BOOST_CHECK_EQUAL(list.size(), 4);
+
+    vector<string> expected = { "a", "b", "c", "d" };
+    BOOST_CHECK(list.tagsForAccount(AccountKey("campaign:strategy")) == expected);
+
+    Augmentation campaign = list[AccountKey("campaign")];
+    BOOST_CHECK_EQUAL(campaign.data["freq"].asInt(), 3);
+    BOOST_CHECK_EQUAL(campaign.data["segments"].asInt(), 1);
+
+    // Tag only augmentations leave the data alone
+    AugmentationList tagsOnly;
+    tagsOnly[AccountKey("campaign")] = Augmentation(set<string>{ "f" });
+    list.mergeWith(tagsOnly);
+
+    campaign = list[AccountKey("campaign")];
+    BOOST_CHECK_EQUAL(campaign.tags.count("f"), 1);
+    BOOST_CHECK_EQUAL(campaign.data["freq"].asInt(), 3);
+}
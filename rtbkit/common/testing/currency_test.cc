@@ -10,6 +10,7 @@
 #define BOOST_TEST_DYN_LINK
 
 #include "rtbkit/common/currency.h"
+#include "jml/arch/exception_handler.h"
 
 #include <boost/test/unit_test.hpp>
 #include <iostream>
@@ -95,3 +96,106 @@ BOOST_AUTO_TEST_CASE( currencyConversion)
         test2(price);
     }
 }
+
+BOOST_AUTO_TEST_CASE( currencyOverflow )
+{
+    ML::Set_Trace_Exceptions notrace(false);
+
+    Amount big(CurrencyCode::CC_USD, std::numeric_limits<int64_t>::max() - 1);
+    Amount one(CurrencyCode::CC_USD, 1);
+    BOOST_CHECK_EQUAL((big + one).value, std::numeric_limits<int64_t>::max());
+    BOOST_CHECK_THROW(big + one + one, ML::Exception);
+    BOOST_CHECK_THROW(-big - one - one - one, ML::Exception);
+    BOOST_CHECK_THROW(big * 2, ML::Exception);
+    BOOST_CHECK_THROW(big * 2.0, ML::Exception);
+
+    // Integer scaling is exact where a double isn't.
+    Amount odd(CurrencyCode::CC_USD, (int64_t(1) << 60) + 1);
+    BOOST_CHECK_EQUAL((odd * 3).value, 3 * ((int64_t(1) << 60) + 1));
+    BOOST_CHECK_EQUAL((one * 0.5).value, 0);
+
+    MicroUSD m1(std::numeric_limits<int64_t>::max());
+    BOOST_CHECK_THROW(m1 + MicroUSD(1), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( currencyTemplateArithmetic )
+{
+    MicroUSD a(100), b(50);
+
+    // Same currency keeps the type.
+    MicroUSD sum = a + b;
+    BOOST_CHECK_EQUAL(sum.value, 150);
+    BOOST_CHECK(sum.currencyCode == CurrencyCode::CC_USD);
+    BOOST_CHECK_EQUAL((a - b).value, 50);
+    BOOST_CHECK_EQUAL((a * 3).value, 300);
+
+    MicroUSD zero;
+    zero += a;
+    BOOST_CHECK_EQUAL(zero, a);
+
+    // Mixing with a plain Amount still checks the currencies.
+    ML::Set_Trace_Exceptions notrace(false);
+    Amount eur(CurrencyCode::CC_EUR, 10);
+    BOOST_CHECK_THROW(a + eur, ML::Exception);
+    BOOST_CHECK_EQUAL((a + Amount()).value, 100);
+}
+
+BOOST_AUTO_TEST_CASE( currencyPoolArithmetic )
+{
+    CurrencyPool p1;
+    p1 += MicroUSD(10);
+    p1 += Amount(CurrencyCode::CC_IMP, 3);
+    p1 += Amount(CurrencyCode::CC_CLK, 1);
+
+    // Kept sorted by currency code.
+    BOOST_REQUIRE_EQUAL(p1.currencyAmounts.size(), 3);
+    BOOST_CHECK(p1.currencyAmounts[0].currencyCode == CurrencyCode::CC_CLK);
+    BOOST_CHECK(p1.currencyAmounts[1].currencyCode == CurrencyCode::CC_IMP);
+    BOOST_CHECK(p1.currencyAmounts[2].currencyCode == CurrencyCode::CC_USD);
+
+    CurrencyPool p2;
+    p2 += MicroEUR(7);
+    p2 += MicroUSD(5);
+    p2 += Amount(CurrencyCode::CC_IMP, 3);
+
+    CurrencyPool sum = p1 + p2;
+    BOOST_REQUIRE_EQUAL(sum.currencyAmounts.size(), 4);
+    BOOST_CHECK_EQUAL(sum.getAvailable(CurrencyCode::CC_USD).value, 15);
+    BOOST_CHECK_EQUAL(sum.getAvailable(CurrencyCode::CC_EUR).value, 7);
+    BOOST_CHECK_EQUAL(sum.getAvailable(CurrencyCode::CC_IMP).value, 6);
+    BOOST_CHECK_EQUAL(sum.getAvailable(CurrencyCode::CC_CLK).value, 1);
+
+    // Same as adding the amounts one by one, zero totals included.
+    CurrencyPool diff = p1 - p2;
+    CurrencyPool expected = p1;
+    for (auto & am: p2.currencyAmounts)
+        expected -= am;
+    BOOST_CHECK_EQUAL(diff.toJson(), expected.toJson());
+    BOOST_CHECK_EQUAL(diff.getAvailable(CurrencyCode::CC_IMP).value, 0);
+    BOOST_CHECK_EQUAL(diff.currencyAmounts.size(), 4);
+}
+
+BOOST_AUTO_TEST_CASE( currencyAccumulator )
+{
+    CurrencyPool p1;
+    p1 += MicroUSD(10);
+    p1 += Amount(CurrencyCode::CC_IMP, 3);
+
+    CurrencyPool p2;
+    p2 += MicroUSD(4);
+    p2 += MicroEUR(2);
+
+    CurrencyAccumulator acc;
+    acc += p1;
+    acc -= p2;
+    acc += Amount(CurrencyCode::CC_IMP, -3);
+
+    CurrencyPool expected = p1 - p2 + Amount(CurrencyCode::CC_IMP, -3);
+    BOOST_CHECK_EQUAL(acc.pool().toJson(), expected.toJson());
+    BOOST_CHECK_EQUAL(acc.get(CurrencyCode::CC_USD).value, 6);
+
+    LineItems items;
+    items["a"] = p1;
+    items["b"] = p2;
+    BOOST_CHECK_EQUAL(items.total(), p1 + p2);
+}
@@ -0,0 +1,65 @@
+/* eligibility_summary_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test for the summary of the requests that the agents can bid on.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/common/eligibility_summary.h"
+
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+namespace {
+
+BidRequest makeRequest(Date timestamp, std::vector<Format> formats)
+{
+    BidRequest request;
+    request.timestamp = timestamp;
+
+    AdSpot spot;
+    for (const auto & format : formats)
+        spot.formats.push_back(format);
+    request.imp.push_back(spot);
+
+    return request;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_eligibility_summary )
+{
+    // Thursday 00:00 UTC
+    Date thursday = Date::fromSecondsSinceEpoch(0);
+    Date friday = thursday.plusSeconds(24 * 3600);
+    BOOST_REQUIRE_EQUAL(thursday.hourOfWeek(), 4 * 24);
+
+    EligibilitySummary summary;
+    BOOST_CHECK(!summary.wants(makeRequest(thursday, {})));
+
+    std::bitset<24 * 7> hours;
+    hours.set(thursday.hourOfWeek());
+    summary.addAgent(hours, { Format(300, 250), Format(728, 90) });
+    BOOST_CHECK_EQUAL(summary.agents(), 1);
+
+    BOOST_CHECK(summary.wants(makeRequest(thursday, { Format(728, 90) })));
+    BOOST_CHECK(summary.wants(makeRequest(thursday, { Format(160, 600),
+                                                      Format(300, 250) })));
+    BOOST_CHECK(!summary.wants(makeRequest(thursday, { Format(160, 600) })));
+    BOOST_CHECK(!summary.wants(makeRequest(friday, { Format(300, 250) })));
+
+    // A spot without formats takes any creative, and a request without a
+    // timestamp is left to the filters.
+    BOOST_CHECK(summary.wants(makeRequest(thursday, {})));
+    BOOST_CHECK(summary.wants(makeRequest(Date(), { Format(300, 250) })));
+
+    // The 0x0 creative fits any spot.
+    summary.addAgent(hours, { Format(0, 0) });
+    BOOST_CHECK(summary.wants(makeRequest(thursday, { Format(160, 600) })));
+    BOOST_CHECK_EQUAL(summary.toJson()["formats"].asString(), "any");
+}
@@ -14,6 +14,7 @@
 #include "rtbkit/common/bid_request.h"
 
 #include <boost/test/unit_test.hpp>
+#include <random>
 
 using namespace std;
 using namespace RTBKIT;
@@ -114,6 +115,45 @@ BOOST_AUTO_TEST_CASE(configSetTest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(configSetOpsTest)
+{
+    // Covers the scalar tails of the kernels as well as sets that spill out of
+    // the inline storage.
+    const size_t sizes[] = { 1, 64, 65, 130, 200, 256, 320, 512, 513, 1100 };
+
+    std::mt19937 rng(0);
+
+    for (size_t sizeA : sizes) {
+        for (size_t sizeB : sizes) {
+            for (int defaults = 0; defaults < 4; ++defaults) {
+                bool defA = defaults & 1;
+                bool defB = defaults & 2;
+
+                ConfigSet a(defA), b(defB);
+                for (size_t i = 0; i < sizeA; ++i) a.set(i, rng() % 2);
+                for (size_t i = 0; i < sizeB; ++i) b.set(i, rng() % 2);
+
+                ConfigSet andSet = a & b;
+                ConfigSet orSet = a | b;
+                ConfigSet xorSet = a ^ b;
+
+                size_t n = std::max(a.size(), b.size());
+                size_t andCount = 0;
+
+                for (size_t i = 0; i < n; ++i) {
+                    BOOST_REQUIRE_EQUAL(andSet.test(i), a.test(i) && b.test(i));
+                    BOOST_REQUIRE_EQUAL(orSet.test(i), a.test(i) || b.test(i));
+                    BOOST_REQUIRE_EQUAL(xorSet.test(i), a.test(i) != b.test(i));
+                    if (andSet.test(i)) andCount++;
+                }
+
+                BOOST_CHECK_EQUAL(andSet.count(), andCount);
+                BOOST_CHECK_EQUAL(andSet.empty(), andCount == 0);
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(creativeMatrixTest)
 {
     enum { n = 10, m = 100 };
@@ -183,7 +223,7 @@ BOOST_AUTO_TEST_CASE(creativeMatrixTest)
 }
 
 vector<CreativeMatrix>
-toMatrix(const unordered_map<unsigned, BiddableSpots>& spots)
+toMatrix(const FilterState::BiddableConfigs& spots)
 {
     vector<CreativeMatrix> creatives;
 
@@ -233,9 +273,19 @@ void checkBiddableSpots(
 
 void checkBiddableSpots(FilterState& state)
 {
-    const auto& value = toMatrix(state.biddableSpots());
+    const auto& biddable = state.biddableSpots();
+    for (size_t i = 1; i < biddable.size(); ++i)
+        BOOST_CHECK_LT(biddable[i - 1].first, biddable[i].first);
+
+    const auto& value = toMatrix(biddable);
     const auto& exp = getMatrix(state, state.request.imp.size());
     checkBiddableSpots(value, exp);
+
+    // Reusing a list replaces what was in it.
+    FilterState::BiddableConfigs reused(3);
+    state.biddableSpots(reused);
+    BOOST_CHECK_EQUAL(reused.size(), biddable.size());
+    checkBiddableSpots(toMatrix(reused), exp);
 }
 
 BOOST_AUTO_TEST_CASE(filterStateTest)
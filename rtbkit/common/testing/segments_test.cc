@@ -0,0 +1,101 @@
+/* segments_test.cc
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+   Tests for the segment lists.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/common/segments.h"
+
+using namespace std;
+using namespace RTBKIT;
+
+
+/* Reference implementation of the match. */
+bool naiveMatch(const SegmentList & list1, const SegmentList & list2)
+{
+    bool result = false;
+    list1.forEach([&] (int i1, const string & s1, float)
+        {
+            list2.forEach([&] (int i2, const string & s2, float)
+                {
+                    if (i1 == i2 && s1 == s2)
+                        result = true;
+                });
+        });
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE( test_segment_list_match )
+{
+    SegmentList ints1(vector<int>({ 1, 5, 9, 13, 17, 21, 25, 29, 33 }));
+    SegmentList ints2(vector<int>({ 2, 3, 4, 6, 7, 8, 10, 29 }));
+    SegmentList ints3(vector<int>({ 2, 3, 4, 6, 7, 8, 10, 30 }));
+
+    BOOST_CHECK(ints1.match(ints2));
+    BOOST_CHECK(ints2.match(ints1));
+    BOOST_CHECK(!ints1.match(ints3));
+    BOOST_CHECK(!ints3.match(ints1));
+
+    SegmentList strings1(vector<string>({ "dmp-a", "dmp-b", "dmp-c" }));
+    SegmentList strings2(vector<string>({ "dmp-c", "dmp-d" }));
+    SegmentList strings3(vector<string>({ "dmp-d", "dmp-e" }));
+
+    BOOST_CHECK(strings1.match(strings2));
+    BOOST_CHECK(!strings1.match(strings3));
+
+    // A string segment never matches an integer segment
+    SegmentList mixed(vector<string>({ "1", "dmp-e" }));
+    BOOST_CHECK(mixed.match(ints1));
+    BOOST_CHECK(mixed.match(strings3));
+    BOOST_CHECK(!mixed.match(strings1));
+    BOOST_CHECK(!mixed.match(ints3));
+
+    BOOST_CHECK(!SegmentList().match(ints1));
+    BOOST_CHECK(!ints1.match(SegmentList()));
+}
+
+BOOST_AUTO_TEST_CASE( test_segment_list_match_random )
+{
+    // Lists of all kinds of relative sizes so that the lookup, galloping
+    // and block paths are all exercised
+    srand(42);
+
+    for (unsigned i = 0;  i < 2000;  ++i) {
+        SegmentList list1, list2;
+        int n1 = rand() % 40, n2 = rand() % 40;
+        if (i % 3 == 0) n2 *= 10;
+
+        for (unsigned j = 0;  j < n1;  ++j) {
+            if (rand() % 4 == 0)
+                list1.add("s" + to_string(rand() % 500));
+            else list1.add(rand() % 1000);
+        }
+        for (unsigned j = 0;  j < n2;  ++j) {
+            if (rand() % 4 == 0)
+                list2.add("s" + to_string(rand() % 500));
+            else list2.add(rand() % 1000);
+        }
+
+        list1.sort();
+        list2.sort();
+
+        bool expected = naiveMatch(list1, list2);
+        BOOST_CHECK_EQUAL(list1.match(list2), expected);
+        BOOST_CHECK_EQUAL(list2.match(list1), expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_segment_list_reconstitute )
+{
+    SegmentList list(vector<string>({ "dmp-x", "dmp-y", "12" }));
+    SegmentList list2 = SegmentList::reconstituteFromString(
+            list.serializeToString());
+
+    BOOST_CHECK(list2.match(SegmentList(vector<string>({ "dmp-y" }))));
+    BOOST_CHECK(list2.match(SegmentList(vector<int>({ 12 }))));
+    BOOST_CHECK(!list2.match(SegmentList(vector<string>({ "dmp-z" }))));
+}
@@ -0,0 +1,92 @@
+/* submitted_auctions_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test of the batched encoding of the submitted auctions.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/common/auction_events.h"
+#include "jml/db/persistent.h"
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace RTBKIT;
+using namespace Datacratic;
+
+
+namespace {
+
+std::shared_ptr<SubmittedAuctionEvent>
+makeSubmission(const Id & auctionId, int spot, const std::string & agent,
+               const std::string & request)
+{
+    auto event = std::make_shared<SubmittedAuctionEvent>();
+    event->auctionId = auctionId;
+    event->adSpotId = Id(spot);
+    event->lossTimeout = Date::fromSecondsSinceEpoch(1000 + spot);
+    event->augmentations = Json::parse("{\"random\":{}}");
+    event->bidRequestStr = request;
+    event->bidRequestStrFormat = "datacratic";
+    event->bidResponse.agent = agent;
+    event->bidResponse.account = AccountKey("campaign:" + agent);
+    event->bidResponse.price = Auction::Price(USD_CPM(spot + 1));
+    return event;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_submitted_auctions_round_trip )
+{
+    string request(2000, 'x');
+
+    vector< std::shared_ptr<SubmittedAuctionEvent> > auctions = {
+        makeSubmission(Id(1), 0, "agent1", request + "1"),
+        makeSubmission(Id(2), 0, "agent1", request + "2"),
+        makeSubmission(Id(1), 1, "agent2", request + "1"),
+        makeSubmission(Id(1), 2, "agent1", request + "1"),
+    };
+
+    size_t separateSize = 0;
+    for (auto & auction: auctions)
+        separateSize += ML::DB::serializeToString(*auction).size();
+
+    for (bool compress: { false, true }) {
+        BOOST_TEST_CHECKPOINT(compress);
+
+        string encoded = encodeSubmittedAuctions(auctions, compress);
+
+        // The request of the first auction is only there once
+        BOOST_CHECK_LT(encoded.size(), separateSize);
+        if (compress)
+            BOOST_CHECK_LT(encoded.size(), request.size());
+
+        auto decoded = decodeSubmittedAuctions(encoded);
+        BOOST_REQUIRE_EQUAL(decoded.size(), auctions.size());
+
+        // Grouped by auction, in the order that the auctions came in
+        vector<int> order = { 0, 2, 3, 1 };
+        for (size_t i = 0; i < decoded.size(); ++i) {
+            const auto & expected = *auctions[order[i]];
+            const auto & event = *decoded[i];
+            BOOST_CHECK_EQUAL(event.auctionId, expected.auctionId);
+            BOOST_CHECK_EQUAL(event.adSpotId, expected.adSpotId);
+            BOOST_CHECK_EQUAL(event.lossTimeout, expected.lossTimeout);
+            BOOST_CHECK_EQUAL(event.augmentations.toString(),
+                              expected.augmentations.toString());
+            BOOST_CHECK(event.bidRequestStr == expected.bidRequestStr);
+            BOOST_CHECK_EQUAL(event.bidRequestStrFormat,
+                              expected.bidRequestStrFormat);
+            BOOST_CHECK_EQUAL(event.bidResponse.agent,
+                              expected.bidResponse.agent);
+            BOOST_CHECK_EQUAL(event.bidResponse.account,
+                              expected.bidResponse.account);
+            BOOST_CHECK_EQUAL(event.bidResponse.price.maxPrice,
+                              expected.bidResponse.price.maxPrice);
+        }
+    }
+
+    BOOST_CHECK(decodeSubmittedAuctions(encodeSubmittedAuctions({})).empty());
+    BOOST_CHECK_THROW(decodeSubmittedAuctions(string("\x07", 1)), ML::Exception);
+}
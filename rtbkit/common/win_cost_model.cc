@@ -25,6 +25,61 @@ struct NoWinCostModel {
     }
 };
 
+struct BoundNoWinCostModel : public BoundWinCostModel {
+
+    virtual Amount evaluate(Win const & win) const
+    {
+        return win.price;
+    }
+
+    virtual void evaluate(Win const * wins, Amount * costs, size_t n) const
+    {
+        for (size_t i = 0;  i < n;  ++i)
+            costs[i] = wins[i].price;
+    }
+};
+
+/** Models registered through registerModel() are called with a copy of the
+    WinCostModel that has the win metadata in its data. */
+struct BoundLegacyWinCostModel : public BoundWinCostModel {
+
+    BoundLegacyWinCostModel(WinCostModel model, WinCostModel::Model function)
+        : model(std::move(model)), function(std::move(function))
+    {
+    }
+
+    virtual Amount evaluate(Win const & win) const
+    {
+        if (!win.meta)
+            return function(model, *win.bid, win.price);
+
+        WinCostModel withMeta = model;
+        withMeta.data["win"] = *win.meta;
+        return function(withMeta, *win.bid, win.price);
+    }
+
+    WinCostModel model;
+    WinCostModel::Model function;
+};
+
+/** What registerBoundModel() puts in the plugin table, so that the model
+    is found by name like all the others, and bind() can get at the binder.
+*/
+struct BinderModel {
+    Amount operator () (WinCostModel const & model,
+                        Bid const & bid,
+                        Amount const & price) const
+    {
+        auto bound = binder(model.data);
+        if (!model.data.isMember("win"))
+            return bound->evaluate(bid, price);
+        Json::Value const & meta = model.data["win"];
+        return bound->evaluate(bid, price, &meta);
+    }
+
+    WinCostModel::Binder binder;
+};
+
 struct AtInit {
     AtInit()
     {
@@ -33,6 +88,24 @@ struct AtInit {
 } atInit;
 } // file scope
 
+
+/*****************************************************************************/
+/* BOUND WIN COST MODEL                                                      */
+/*****************************************************************************/
+
+void
+BoundWinCostModel::
+evaluate(Win const * wins, Amount * costs, size_t n) const
+{
+    for (size_t i = 0;  i < n;  ++i)
+        costs[i] = evaluate(wins[i]);
+}
+
+
+/*****************************************************************************/
+/* WIN COST MODEL                                                            */
+/*****************************************************************************/
+
 WinCostModel::
 WinCostModel()
 {
@@ -61,6 +134,42 @@ evaluate(Bid const & bid, Amount const & price) const
     return model(*this, bid, price);
 }
 
+std::shared_ptr<const BoundWinCostModel>
+WinCostModel::
+bind() const
+{
+    static const std::shared_ptr<const BoundWinCostModel>
+        none(new BoundNoWinCostModel());
+
+    if(name.empty() || name == "none") {
+        return none;
+    }
+
+    auto model = PluginInterface<WinCostModel>::getPlugin(name);
+    if(!model) {
+        throw ML::Exception("win cost model '%s' not found", name.c_str());
+    }
+
+    if(auto binderModel = model.target<BinderModel>()) {
+        auto bound = binderModel->binder(data);
+        if(!bound) {
+            throw ML::Exception("win cost model '%s' couldn't be bound",
+                                name.c_str());
+        }
+        return bound;
+    }
+
+    return std::make_shared<BoundLegacyWinCostModel>(*this, std::move(model));
+}
+
+void
+WinCostModel::
+registerBoundModel(const std::string & name, Binder binder)
+{
+    PluginInterface<WinCostModel>::registerPlugin(
+            name, BinderModel{std::move(binder)});
+}
+
 Json::Value
 WinCostModel::
 toJson() const
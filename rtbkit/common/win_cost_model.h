@@ -17,6 +17,7 @@
 namespace RTBKIT {
 
 class WinCostModelDescription;
+struct BoundWinCostModel;
 
 using namespace Datacratic;
 
@@ -31,6 +32,12 @@ struct WinCostModel {
     /// Get the win cost from the model
     Amount evaluate(Bid const & bid, Amount const & price) const;
 
+    /** Resolve the model from its name and parse its parameters, so that it
+        can be evaluated many times without going through the plugin
+        registry or the Json parameters.  Throws if there is no such model.
+    */
+    std::shared_ptr<const BoundWinCostModel> bind() const;
+
     Json::Value toJson() const;
     static WinCostModel fromJson(Json::Value const & json);
 
@@ -51,6 +58,16 @@ struct WinCostModel {
     {
         PluginInterface<WinCostModel>::registerPlugin(name, model);
     }
+
+    /// Signature of a function that parses the parameters of a model
+    typedef std::function<std::shared_ptr<const BoundWinCostModel>
+                          (Json::Value const & data)> Binder;
+
+    /** Register a model that parses its parameters once when it's bound.
+        It can still be evaluated through a WinCostModel, but that binds it
+        on every call.
+    */
+    static void registerBoundModel(const std::string & name, Binder binder);
   
     // --- plugin interface init
     // plugin interface expects this type to be called Factory
@@ -68,6 +85,52 @@ public:
 
 IMPL_SERIALIZE_RECONSTITUTE(WinCostModel);
 
+
+/*****************************************************************************/
+/* BOUND WIN COST MODEL                                                      */
+/*****************************************************************************/
+
+/** A win cost model that has been resolved and had its parameters parsed;
+    see WinCostModel::bind().  It's immutable, so it can be shared between
+    threads.
+*/
+
+struct BoundWinCostModel {
+    virtual ~BoundWinCostModel()
+    {
+    }
+
+    /** A win to get the cost of.  meta is the metadata of the win, which
+        models registered with WinCostModel::registerModel() find in the
+        "win" field of their data, or null if there is none.
+    */
+    struct Win {
+        Win(Bid const * bid = nullptr, Amount price = Amount(),
+            Json::Value const * meta = nullptr)
+            : bid(bid), price(price), meta(meta)
+        {
+        }
+
+        Bid const * bid;
+        Amount price;
+        Json::Value const * meta;
+    };
+
+    /// Get the win cost of one win
+    virtual Amount evaluate(Win const & win) const = 0;
+
+    /** Get the win cost of each of the n wins into costs, which has room for
+        n entries.  The default calls evaluate() for each one.
+    */
+    virtual void evaluate(Win const * wins, Amount * costs, size_t n) const;
+
+    Amount evaluate(Bid const & bid, Amount const & price,
+                    Json::Value const * meta = nullptr) const
+    {
+        return evaluate(Win(&bid, price, meta));
+    }
+};
+
 CREATE_CLASS_DESCRIPTION(WinCostModel)
 
 } // namespace RTBKIT
@@ -417,6 +417,8 @@ fromJson(const Json::Value& json)
 
         else ExcCheck(false, "Unknown AugmentorInfo field: " + m);
     }
+
+    compile();
 }
 
 AugmentationConfig
@@ -436,7 +438,8 @@ createFromJson(const Json::Value& json, const std::string& name)
 
 AgentConfig::
 AgentConfig(std::string name)
-    : externalId(0),
+    : accountHandle(0),
+      externalId(0),
       external(false),
       test(false),
       roundRobinWeight(0),
@@ -448,6 +451,8 @@ AgentConfig(std::string name)
       winFormat(BRF_FULL),
       lossFormat(BRF_LIGHTWEIGHT),
       errorFormat(BRF_LIGHTWEIGHT),
+      bidRequestFormat("jsonRaw"),
+      implicitLossSeconds(0.0),
       name(name)
 {
     addAugmentation("random");
@@ -549,6 +554,68 @@ toJson() const
     return result;
 }
 
+AgentConfig::ThrottleConfig::
+ThrottleConfig()
+    : enabled(false),
+      minProbability(0.01), maxProbability(1.0),
+      targetLatencyMs(20.0), maxTimeoutRate(0.05), maxInFlightRatio(0.8),
+      increase(0.05), decrease(0.5)
+{
+}
+
+void
+AgentConfig::ThrottleConfig::
+fromJson(const Json::Value & val)
+{
+    ExcCheckEqual(val.type(), Json::objectValue,
+                  "throttle must be an object");
+
+    *this = ThrottleConfig();
+    enabled = true;
+
+    for (auto it = val.begin(), end = val.end();  it != end;  ++it) {
+        string key = it.memberName();
+        float value = it->asDouble();
+
+        if (key == "minProbability") minProbability = value;
+        else if (key == "maxProbability") maxProbability = value;
+        else if (key == "targetLatencyMs") targetLatencyMs = value;
+        else if (key == "maxTimeoutRate") maxTimeoutRate = value;
+        else if (key == "maxInFlightRatio") maxInFlightRatio = value;
+        else if (key == "increase") increase = value;
+        else if (key == "decrease") decrease = value;
+        else throw ML::Exception("throttle had unknown key " + key);
+    }
+
+    if (minProbability <= 0 || minProbability > maxProbability
+        || maxProbability > 1.0)
+        throw ML::Exception("throttle probabilities must satisfy "
+                            "0 < minProbability <= maxProbability <= 1");
+    if (targetLatencyMs <= 0)
+        throw ML::Exception("throttle targetLatencyMs must be positive");
+    if (maxTimeoutRate < 0 || maxInFlightRatio <= 0)
+        throw ML::Exception("throttle maxTimeoutRate and maxInFlightRatio "
+                            "must be positive");
+    if (increase <= 0 || decrease <= 0 || decrease >= 1.0)
+        throw ML::Exception("throttle must have increase > 0 and "
+                            "0 < decrease < 1");
+}
+
+Json::Value
+AgentConfig::ThrottleConfig::
+toJson() const
+{
+    Json::Value result;
+    result["minProbability"] = minProbability;
+    result["maxProbability"] = maxProbability;
+    result["targetLatencyMs"] = targetLatencyMs;
+    result["maxTimeoutRate"] = maxTimeoutRate;
+    result["maxInFlightRatio"] = maxInFlightRatio;
+    result["increase"] = increase;
+    result["decrease"] = decrease;
+    return result;
+}
+
 Json::Value toJson(BidResultFormat fmt)
 {
     switch (fmt) {
@@ -589,213 +656,419 @@ createFromJson(const Json::Value & json)
 
     for (auto it = json.begin(), end = json.end(); it != end;  ++it) {
         //cerr << "parsing " << it.memberName() << " with value " << *it << endl;
+        newConfig.parseField(it.memberName(), *it);
+    }
 
-        if (it.memberName() == "account") {
-            newConfig.account = AccountKey::fromJson(*it);
-        }
-        else if (it.memberName() == "name") {
-            newConfig.name = it->asString();
-        }
-        else if (it.memberName() == "test") {
-            newConfig.test = it->asBool();
-        }
-        else if (it.memberName() == "external") {
-            newConfig.external = it->asBool();
-        }
-        else if (it.memberName() == "externalId") {
-            newConfig.externalId = it->asUInt();
-        }
-        else if (it.memberName() == "requiredIds") {
-            if (!it->isArray())
-                throw Exception("requiredIds must be an array of string");
-            for (unsigned i = 0;  i < it->size();  ++i) {
-                const Json::Value & val = (*it)[i];
-                newConfig.requiredIds.push_back(val.asString());
-            }
-        }
-        else if (it.memberName() == "roundRobin") {
-            for (auto jt = it->begin(), jend = it->end();
-                 jt != jend;  ++jt) {
-                if (jt.memberName() == "group")
-                    newConfig.roundRobinGroup = jt->asString();
-                else if (jt.memberName() == "weight")
-                    newConfig.roundRobinWeight = jt->asInt();
-                else throw Exception("roundRobin group had unknown key "
-                                     + jt.memberName());
-            }
-        }
-        else if (it.memberName() == "creatives") {
-            //cerr << "doing " << it->size() << " creatives" << endl;
-
-            newConfig.creatives.resize(it->size());
+    newConfig.validate();
+    newConfig.compile();
 
-            for (unsigned i = 0;
-                 i < newConfig.creatives.size();  ++i) {
-                try {
-                    newConfig.creatives[i].fromJson((*it)[i]);
-                } catch (const std::exception & exc) {
-                    throw Exception("parsing creative %d: %s",
-                                    i, exc.what());
-                }
-            }
+    return newConfig;
+}
 
-            //cerr << "got " << newConfig.creatives.size() << " creatives" << endl;
-        }
-        else if (it.memberName() == "bidProbability") {
-            newConfig.bidProbability = it->asDouble();
-            if (newConfig.bidProbability < 0 || newConfig.bidProbability > 1.0)
-                throw Exception("bidProbability %f not between 0 and 1",
-                                newConfig.bidProbability);
-        }
-        else if (it.memberName() == "minTimeAvailableMs") {
-            newConfig.minTimeAvailableMs = it->asDouble();
-            if (newConfig.minTimeAvailableMs < 0)
-                throw Exception("minTimeAvailableMs %f should be not less than 0",
-                                newConfig.minTimeAvailableMs);
-        }
-        else if (it.memberName() == "maxInFlight") {
-            newConfig.maxInFlight = it->asInt();
-            if (newConfig.maxInFlight < 0)
-                throw Exception("maxInFlight has wrong value: %d",
-                                newConfig.maxInFlight);
-        }
-        else if (it.memberName() == "bidderInterface")
-            newConfig.bidderInterface = it->asString();
-        else if (it.memberName() == "userPartition") {
-            newConfig.userPartition.fromJson(*it);
-        }
-        else if (it.memberName() == "urlFilter")
-            newConfig.urlFilter.fromJson(*it, "urlFilter");
-        else if (it.memberName() == "hostFilter")
-            newConfig.hostFilter.fromJson(*it, "hostFilter");
-        else if (it.memberName() == "locationFilter")
-            newConfig.locationFilter.fromJson(*it, "locationFilter");
-        else if (it.memberName() == "languageFilter")
-            newConfig.languageFilter.fromJson(*it, "languageFilter");
-        else if (it.memberName() == "exchangeFilter")
-            newConfig.exchangeFilter.fromJson(*it, "exchangeFilter");
-        else if (it.memberName() == "latLongDevFilter")
-            newConfig.latLongDevFilter.fromJson(*it);
-        else if (it.memberName() == "segmentFilter") {
-            for (auto jt = it->begin(), jend = it->end();
-                 jt != jend;  ++jt) {
-                string source = jt.memberName();
-                newConfig.segments[source].fromJson(*jt);
-            }
+void
+AgentConfig::
+parseField(const std::string & field, const Json::Value & value)
+{
+    if (field == "account") {
+        account = AccountKey::fromJson(value);
+    }
+    else if (field == "name") {
+        name = value.asString();
+    }
+    else if (field == "test") {
+        test = value.asBool();
+    }
+    else if (field == "external") {
+        external = value.asBool();
+    }
+    else if (field == "externalId") {
+        externalId = value.asUInt();
+    }
+    else if (field == "requiredIds") {
+        if (!value.isArray())
+            throw Exception("requiredIds must be an array of string");
+        for (unsigned i = 0;  i < value.size();  ++i) {
+            const Json::Value & val = value[i];
+            requiredIds.push_back(val.asString());
         }
-        else if (it.memberName() == "tagFilter") {
-            newConfig.tagFilter.fromJson(*it);
+    }
+    else if (field == "roundRobin") {
+        for (auto jt = value.begin(), jend = value.end();
+             jt != jend;  ++jt) {
+            if (jt.memberName() == "group")
+                roundRobinGroup = jt->asString();
+            else if (jt.memberName() == "weight")
+                roundRobinWeight = jt->asInt();
+            else throw Exception("roundRobin group had unknown key "
+                                 + jt.memberName());
         }
-        else if (it.memberName() == "foldPositionFilter") {
-            newConfig.foldPositionFilter.fromJson(*it, "foldPositionFilter");
+    }
+    else if (field == "creatives") {
+        //cerr << "doing " << value.size() << " creatives" << endl;
+
+        creatives.resize(value.size());
+
+        for (unsigned i = 0;
+             i < creatives.size();  ++i) {
+            try {
+                creatives[i].fromJson(value[i]);
+            } catch (const std::exception & exc) {
+                throw Exception("parsing creative %d: %s",
+                                i, exc.what());
+            }
         }
-        else if (it.memberName() == "hourOfWeekFilter") {
-            newConfig.hourOfWeekFilter.fromJson(*it);
+
+        //cerr << "got " << creatives.size() << " creatives" << endl;
+    }
+    else if (field == "bidProbability") {
+        bidProbability = value.asDouble();
+        if (bidProbability < 0 || bidProbability > 1.0)
+            throw Exception("bidProbability %f not between 0 and 1",
+                            bidProbability);
+    }
+    else if (field == "minTimeAvailableMs") {
+        minTimeAvailableMs = value.asDouble();
+        if (minTimeAvailableMs < 0)
+            throw Exception("minTimeAvailableMs %f should be not less than 0",
+                            minTimeAvailableMs);
+    }
+    else if (field == "maxInFlight") {
+        maxInFlight = value.asInt();
+        if (maxInFlight < 0)
+            throw Exception("maxInFlight has wrong value: %d",
+                            maxInFlight);
+    }
+    else if (field == "throttle")
+        throttle.fromJson(value);
+    else if (field == "bidderInterface")
+        bidderInterface = value.asString();
+    else if (field == "userPartition") {
+        userPartition.fromJson(value);
+    }
+    else if (field == "urlFilter")
+        urlFilter.fromJson(value, "urlFilter");
+    else if (field == "hostFilter")
+        hostFilter.fromJson(value, "hostFilter");
+    else if (field == "locationFilter")
+        locationFilter.fromJson(value, "locationFilter");
+    else if (field == "languageFilter")
+        languageFilter.fromJson(value, "languageFilter");
+    else if (field == "exchangeFilter")
+        exchangeFilter.fromJson(value, "exchangeFilter");
+    else if (field == "latLongDevFilter")
+        latLongDevFilter.fromJson(value);
+    else if (field == "segmentFilter") {
+        for (auto jt = value.begin(), jend = value.end();
+             jt != jend;  ++jt) {
+            string source = jt.memberName();
+            segments[source].fromJson(*jt);
         }
-        else if (it.memberName() == "augmentations") {
-            ExcCheckEqual(it->type(), Json::objectValue,
-                    "augment must be an object of augmentor name to config");
+    }
+    else if (field == "tagFilter") {
+        tagFilter.fromJson(value);
+    }
+    else if (field == "foldPositionFilter") {
+        foldPositionFilter.fromJson(value, "foldPositionFilter");
+    }
+    else if (field == "hourOfWeekFilter") {
+        hourOfWeekFilter.fromJson(value);
+    }
+    else if (field == "augmentations") {
+        ExcCheckEqual(value.type(), Json::objectValue,
+                "augment must be an object of augmentor name to config");
 
-            for (auto jt = (*it).begin(), end = (*it).end(); jt != end; ++jt) {
-                newConfig.augmentations.emplace_back(
-                        AugmentationConfig::createFromJson(*jt, jt.memberName()));
-            }
+        for (auto jt = value.begin(), end = value.end(); jt != end; ++jt) {
+            augmentations.emplace_back(
+                    AugmentationConfig::createFromJson(*jt, jt.memberName()));
         }
-        else if (it.memberName() == "blacklist") {
-            for (auto jt = it->begin(), jend = it->end();
-                 jt != jend;  ++jt) {
-                const Json::Value & val = *jt;
-                if (jt.memberName() == "type") {
-                    if (val.isNull())
-                        newConfig.blacklistType = BL_OFF;
-                    else {
-                        string s = ML::lowercase(val.asString());
-                        if (s == "off")
-                            newConfig.blacklistType = BL_OFF;
-                        else if (s == "user")
-                            newConfig.blacklistType = BL_USER;
-                        else if (s == "user_site")
-                            newConfig.blacklistType = BL_USER_SITE;
-                        else throw Exception("invalid blacklist type " + s);
-                    }
-                }
-                else if (jt.memberName() == "time") {
-                    newConfig.blacklistTime = val.asDouble();
-                }
-                else if (jt.memberName() == "scope") {
+    }
+    else if (field == "blacklist") {
+        for (auto jt = value.begin(), jend = value.end();
+             jt != jend;  ++jt) {
+            const Json::Value & val = *jt;
+            if (jt.memberName() == "type") {
+                if (val.isNull())
+                    blacklistType = BL_OFF;
+                else {
                     string s = ML::lowercase(val.asString());
-                    if (s == "agent")
-                        newConfig.blacklistScope = BL_AGENT;
-                    else if (s == "account")
-                        newConfig.blacklistScope = BL_ACCOUNT;
-                    else throw Exception("invalid blacklist scope " + s);
+                    if (s == "off")
+                        blacklistType = BL_OFF;
+                    else if (s == "user")
+                        blacklistType = BL_USER;
+                    else if (s == "user_site")
+                        blacklistType = BL_USER_SITE;
+                    else throw Exception("invalid blacklist type " + s);
                 }
-                else throw Exception("blacklist has invalid key: %s",
-                                     jt.memberName().c_str());
             }
-        }
-        else if (it.memberName() == "visits") {
-            for (auto jt = it->begin(), jend = it->end();
-                 jt != jend;  ++jt) {
-                const Json::Value & val = *jt;
-                if (jt.memberName() == "channels") {
-                    newConfig.visitChannels = SegmentList::createFromJson(val);
-                }
-                else if (jt.memberName() == "includeUnmatched") {
-                    newConfig.includeUnmatchedVisits = val.asBool();
-                }
-                else throw Exception("visits has invalid key: %s",
-                                     jt.memberName().c_str());
+            else if (jt.memberName() == "time") {
+                blacklistTime = val.asDouble();
             }
-        }
-        else if (it.memberName() == "bidControl") {
-            for (auto jt = it->begin(), jend = it->end();
-                 jt != jend;  ++jt) {
-                const Json::Value & val = *jt;
-                if (jt.memberName() == "type") {
-                    string s = ML::lowercase(val.asString());
-                    if (s == "relay")
-                        newConfig.bidControlType = BC_RELAY;
-                    else if (s == "relay_fixed")
-                        newConfig.bidControlType = BC_RELAY_FIXED;
-                    else if (s == "fixed")
-                        newConfig.bidControlType = BC_FIXED;
-                    else throw Exception("invalid bid control value " + s);
-                }
-                else if (jt.memberName() == "fixedBidCpmInMicros") {
-                    newConfig.fixedBidCpmInMicros = val.asInt();
-                }
-                else throw Exception("bidControl has invalid key: %s",
-                                     jt.memberName().c_str());
+            else if (jt.memberName() == "scope") {
+                string s = ML::lowercase(val.asString());
+                if (s == "agent")
+                    blacklistScope = BL_AGENT;
+                else if (s == "account")
+                    blacklistScope = BL_ACCOUNT;
+                else throw Exception("invalid blacklist scope " + s);
             }
+            else throw Exception("blacklist has invalid key: %s",
+                                 jt.memberName().c_str());
         }
-        else if (it.memberName() == "providerConfig") {
-            newConfig.providerConfig = *it;
-        }
-        else if (it.memberName() == "winFormat") {
-            RTBKIT::fromJson(newConfig.winFormat, *it);
-        }
-        else if (it.memberName() == "lossFormat") {
-            RTBKIT::fromJson(newConfig.lossFormat, *it);
+    }
+    else if (field == "visits") {
+        for (auto jt = value.begin(), jend = value.end();
+             jt != jend;  ++jt) {
+            const Json::Value & val = *jt;
+            if (jt.memberName() == "channels") {
+                visitChannels = SegmentList::createFromJson(val);
+            }
+            else if (jt.memberName() == "includeUnmatched") {
+                includeUnmatchedVisits = val.asBool();
+            }
+            else throw Exception("visits has invalid key: %s",
+                                 jt.memberName().c_str());
         }
-        else if (it.memberName() == "errorFormat") {
-            RTBKIT::fromJson(newConfig.errorFormat, *it);
+    }
+    else if (field == "bidControl") {
+        for (auto jt = value.begin(), jend = value.end();
+             jt != jend;  ++jt) {
+            const Json::Value & val = *jt;
+            if (jt.memberName() == "type") {
+                string s = ML::lowercase(val.asString());
+                if (s == "relay")
+                    bidControlType = BC_RELAY;
+                else if (s == "relay_fixed")
+                    bidControlType = BC_RELAY_FIXED;
+                else if (s == "fixed")
+                    bidControlType = BC_FIXED;
+                else throw Exception("invalid bid control value " + s);
+            }
+            else if (jt.memberName() == "fixedBidCpmInMicros") {
+                fixedBidCpmInMicros = val.asInt();
+            }
+            else throw Exception("bidControl has invalid key: %s",
+                                 jt.memberName().c_str());
         }
-        else if (it.memberName() == "ext") {
-            newConfig.ext = *it;
+    }
+    else if (field == "providerConfig") {
+        providerConfig = value;
+    }
+    else if (field == "winFormat") {
+        RTBKIT::fromJson(winFormat, value);
+    }
+    else if (field == "lossFormat") {
+        RTBKIT::fromJson(lossFormat, value);
+    }
+    else if (field == "errorFormat") {
+        RTBKIT::fromJson(errorFormat, value);
+    }
+    else if (field == "bidRequestFormat") {
+        bidRequestFormat = value.asString();
+        if (bidRequestFormat != "jsonRaw"
+            && bidRequestFormat != "binaryV1")
+            throw Exception("unknown bid request format: %s",
+                            bidRequestFormat.c_str());
+    }
+    else if (field == "eventBatching") {
+        for (auto jt = value.begin(), end = value.end();  jt != end;  ++jt) {
+            if (jt.memberName() == "maxEvents")
+                eventBatching.maxEvents = jt->asUInt();
+            else if (jt.memberName() == "maxDelayMs")
+                eventBatching.maxDelayMs = jt->asDouble();
+            else throw Exception("eventBatching has invalid key: %s",
+                                 jt.memberName().c_str());
         }
-        else {
-            newConfig.extensions.add(ExtensionRegistry::create(it.memberName(), *it));
+        if (eventBatching.maxDelayMs < 0)
+            throw Exception("eventBatching.maxDelayMs must be positive");
+    }
+    else if (field == "implicitLossSeconds") {
+        implicitLossSeconds = value.asDouble();
+        if (implicitLossSeconds < 0)
+            throw Exception("implicitLossSeconds must be positive");
+    }
+    else if (field == "frequencyCap") {
+        for (auto jt = value.begin(), end = value.end();  jt != end;  ++jt) {
+            if (jt.memberName() == "maxImpressions")
+                frequencyCap.maxImpressions = jt->asUInt();
+            else if (jt.memberName() == "windowSeconds")
+                frequencyCap.windowSeconds = jt->asDouble();
+            else throw Exception("frequencyCap has invalid key: %s",
+                                 jt.memberName().c_str());
         }
+        if (frequencyCap.windowSeconds <= 0)
+            throw Exception("frequencyCap.windowSeconds must be positive");
     }
+    else if (field == "ext") {
+        ext = value;
+    }
+    else {
+        extensions.add(ExtensionRegistry::create(field, value));
+    }
+}
 
-    if (newConfig.account.empty())
+void
+AgentConfig::
+validate() const
+{
+    if (account.empty())
         throw Exception("each agent must have an account specified");
     
-    if (newConfig.creatives.empty())
+    if (creatives.empty())
         throw Exception("can't configure a agent with no creatives");
+}
 
-    return newConfig;
+void
+AgentConfig::
+compile()
+{
+    accountHandle = AccountKeyRegistry::intern(account);
+
+    for (auto & augmentation : augmentations)
+        augmentation.compile();
+}
+
+bool
+AgentConfig::
+resetField(const std::string & field)
+{
+    static const AgentConfig defaults;
+
+    if (field == "account")
+        account = defaults.account;
+    else if (field == "name")
+        name = defaults.name;
+    else if (field == "test")
+        test = defaults.test;
+    else if (field == "external")
+        external = defaults.external;
+    else if (field == "externalId")
+        externalId = defaults.externalId;
+    else if (field == "requiredIds")
+        requiredIds.clear();
+    else if (field == "roundRobin") {
+        roundRobinGroup = defaults.roundRobinGroup;
+        roundRobinWeight = defaults.roundRobinWeight;
+    }
+    else if (field == "creatives")
+        creatives.clear();
+    else if (field == "bidProbability")
+        bidProbability = defaults.bidProbability;
+    else if (field == "minTimeAvailableMs")
+        minTimeAvailableMs = defaults.minTimeAvailableMs;
+    else if (field == "maxInFlight")
+        maxInFlight = defaults.maxInFlight;
+    else if (field == "throttle")
+        throttle = defaults.throttle;
+    else if (field == "bidderInterface")
+        bidderInterface = defaults.bidderInterface;
+    else if (field == "userPartition")
+        userPartition = defaults.userPartition;
+    else if (field == "urlFilter")
+        urlFilter = defaults.urlFilter;
+    else if (field == "hostFilter")
+        hostFilter = defaults.hostFilter;
+    else if (field == "locationFilter")
+        locationFilter = defaults.locationFilter;
+    else if (field == "languageFilter")
+        languageFilter = defaults.languageFilter;
+    else if (field == "exchangeFilter")
+        exchangeFilter = defaults.exchangeFilter;
+    else if (field == "latLongDevFilter")
+        latLongDevFilter = defaults.latLongDevFilter;
+    else if (field == "segmentFilter")
+        segments.clear();
+    else if (field == "tagFilter")
+        tagFilter = defaults.tagFilter;
+    else if (field == "foldPositionFilter")
+        foldPositionFilter = defaults.foldPositionFilter;
+    else if (field == "hourOfWeekFilter")
+        hourOfWeekFilter = defaults.hourOfWeekFilter;
+    else if (field == "augmentations")
+        augmentations.clear();  // createFromJson() doesn't keep the default
+    else if (field == "blacklist") {
+        blacklistType = defaults.blacklistType;
+        blacklistTime = defaults.blacklistTime;
+        blacklistScope = defaults.blacklistScope;
+    }
+    else if (field == "visits") {
+        visitChannels = defaults.visitChannels;
+        includeUnmatchedVisits = defaults.includeUnmatchedVisits;
+    }
+    else if (field == "bidControl") {
+        bidControlType = defaults.bidControlType;
+        fixedBidCpmInMicros = defaults.fixedBidCpmInMicros;
+    }
+    else if (field == "providerConfig")
+        providerConfig = defaults.providerConfig;
+    else if (field == "winFormat")
+        winFormat = defaults.winFormat;
+    else if (field == "lossFormat")
+        lossFormat = defaults.lossFormat;
+    else if (field == "errorFormat")
+        errorFormat = defaults.errorFormat;
+    else if (field == "bidRequestFormat")
+        bidRequestFormat = defaults.bidRequestFormat;
+    else if (field == "eventBatching")
+        eventBatching = defaults.eventBatching;
+    else if (field == "implicitLossSeconds")
+        implicitLossSeconds = defaults.implicitLossSeconds;
+    else if (field == "frequencyCap")
+        frequencyCap = defaults.frequencyCap;
+    else if (field == "ext")
+        ext = defaults.ext;
+    else return false;
+
+    return true;
+}
+
+Json::Value
+AgentConfig::
+diffJson(const Json::Value & from, const Json::Value & to)
+{
+    Json::Value delta(Json::objectValue);
+
+    for (auto it = to.begin(), end = to.end();  it != end;  ++it) {
+        const std::string & field = it.memberName();
+        if (!from.isMember(field) || from[field] != *it)
+            delta[field] = *it;
+    }
+
+    for (auto it = from.begin(), end = from.end();  it != end;  ++it) {
+        if (!to.isMember(it.memberName()))
+            delta[it.memberName()] = Json::Value();
+    }
+
+    return delta;
+}
+
+void
+AgentConfig::
+patchJson(Json::Value & json, const Json::Value & delta)
+{
+    for (auto it = delta.begin(), end = delta.end();  it != end;  ++it) {
+        if (it->isNull())
+            json.removeMember(it.memberName());
+        else json[it.memberName()] = *it;
+    }
+}
+
+AgentConfig
+AgentConfig::
+applyDelta(const Json::Value & delta, const Json::Value & json) const
+{
+    AgentConfig result(*this);
+
+    for (auto it = delta.begin(), end = delta.end();  it != end;  ++it) {
+        const std::string & field = it.memberName();
+        if (!result.resetField(field))
+            return createFromJson(json);
+        if (json.isMember(field))
+            result.parseField(field, json[field]);
+    }
+
+    result.validate();
+    result.compile();
+    return result;
 }
 
 Json::Value
@@ -833,6 +1106,8 @@ toJson(bool includeCreatives) const
     result["minTimeAvailableMs"] = minTimeAvailableMs;
     if (maxInFlight != 100)
         result["maxInFlight"] = maxInFlight;
+    if (throttle.enabled)
+        result["throttle"] = throttle.toJson();
 
     if (!bidderInterface.empty())
         result["bidderInterface"] = bidderInterface;
@@ -930,6 +1205,18 @@ toJson(bool includeCreatives) const
     result["winFormat"] = RTBKIT::toJson(winFormat);
     result["lossFormat"] = RTBKIT::toJson(lossFormat);
     result["errorFormat"] = RTBKIT::toJson(errorFormat);
+    if (bidRequestFormat != "jsonRaw")
+        result["bidRequestFormat"] = bidRequestFormat;
+    if (eventBatching.enabled()) {
+        result["eventBatching"]["maxEvents"] = eventBatching.maxEvents;
+        result["eventBatching"]["maxDelayMs"] = eventBatching.maxDelayMs;
+    }
+    if (implicitLossSeconds > 0)
+        result["implicitLossSeconds"] = implicitLossSeconds;
+    if (frequencyCap.enabled()) {
+        result["frequencyCap"]["maxImpressions"] = frequencyCap.maxImpressions;
+        result["frequencyCap"]["windowSeconds"] = frequencyCap.windowSeconds;
+    }
 
     for (const auto& extension: extensions.list()) {
         result[extension->extensionName()] = extension->toJson();
@@ -226,6 +226,10 @@ struct AugmentationConfig
     IncludeExclude<std::string> filters;
     bool required;
 
+    /** Hashed copy of filters that the router checks the tags of each
+        auction against.  Made by compile(), which fromJson() calls. */
+    CompiledIncludeExclude<std::string> compiledFilters;
+
     bool operator < (const AugmentationConfig & other) const
     {
         return name < other.name;
@@ -234,6 +238,9 @@ struct AugmentationConfig
     Json::Value toJson() const;
     void fromJson(const Json::Value&);
 
+    /** Rebuild compiledFilters after filters was changed. */
+    void compile() { compiledFilters = CompiledIncludeExclude<std::string>(filters); }
+
     static AugmentationConfig createFromJson(
             const Json::Value& json, const std::string& name = "");
 };
@@ -295,9 +302,47 @@ struct AgentConfig {
     void parse(const std::string & jsonStr);
     void fromJson(const Json::Value & json);
 
+    /** Return the delta that turns the JSON configuration from into to.
+        It's a merge patch over the top level fields: each field that
+        changed is there with its new value, and those that were removed
+        are there as null.
+    */
+    static Json::Value diffJson(const Json::Value & from,
+                                const Json::Value & to);
+
+    /** Apply a delta returned by diffJson() to a JSON configuration. */
+    static void patchJson(Json::Value & json, const Json::Value & delta);
+
+    /** Return a copy of this configuration with the given delta applied.
+        json is the whole configuration once patched; only the fields in
+        the delta are parsed from it, unless one of them can't be reset by
+        itself (eg. extensions) in which case all of it is parsed.
+    */
+    AgentConfig applyDelta(const Json::Value & delta,
+                           const Json::Value & json) const;
+
+    /** Parse a single top level field of the JSON configuration. */
+    void parseField(const std::string & field, const Json::Value & value);
+
+    /** Put a top level field back to its default value.  Returns false for
+        the fields that can't be reset this way.
+    */
+    bool resetField(const std::string & field);
+
+    /** Throws if the configuration is missing something it must have. */
+    void validate() const;
+
+    /** Rebuild the precomputed structures that are used while bidding from
+        the fields they are made from.  The JSON parsing functions do it,
+        but a configuration that is modified in code must be compiled
+        again before it's used.
+    */
+    void compile();
+
     Json::Value toJson(bool includeCreatives = true) const;
 
     AccountKey account;   ///< Who to bill this to
+    AccountHandle accountHandle;  ///< account, interned by compile()
 
     uint64_t externalId;  ///< Simplifies id reconciliation with external systems
 
@@ -312,6 +357,29 @@ struct AgentConfig {
 
     int maxInFlight;
 
+    /** Bounds of the closed loop throttling of the bid requests sent to the
+        agent.  The router lowers the proportion of the auctions that it
+        sends multiplicatively while the agent is overloaded, and raises it
+        additively otherwise (AIMD).  Off unless a "throttle" object is given.
+    */
+    struct ThrottleConfig {
+        ThrottleConfig();
+
+        bool enabled;
+        float minProbability;     ///< Never send less than this proportion
+        float maxProbability;     ///< Never send more than this proportion
+        float targetLatencyMs;    ///< Overloaded over this mean response time
+        float maxTimeoutRate;     ///< Overloaded over this rate of timeouts
+        float maxInFlightRatio;   ///< Overloaded over this ratio of maxInFlight
+        float increase;           ///< Added to the probability when healthy
+        float decrease;           ///< Factor of the probability when overloaded
+
+        void fromJson(const Json::Value & val);
+        Json::Value toJson() const;
+    };
+
+    ThrottleConfig throttle;
+
     std::string bidderInterface;
 
     std::vector<std::string> requiredIds;
@@ -427,6 +495,53 @@ struct AgentConfig {
 
     /** Message formats */
     BidResultFormat winFormat, lossFormat, errorFormat;
+
+    /** Format in which the bid requests are sent to the agent: "jsonRaw"
+        forwards the exchange's request untouched while "binaryV1" sends the
+        compact binary encoding of the canonical bid request.
+    */
+    std::string bidRequestFormat;
+
+    /** Win, loss and campaign event messages can be sent to the agent a
+        batch at a time, in a single BATCH message that the bidding agent
+        library unpacks.  A batch goes out once it has maxEvents events or
+        its oldest event is maxDelayMs old.  Off unless maxEvents > 1.
+    */
+    struct EventBatching {
+        EventBatching() : maxEvents(0), maxDelayMs(10.0) {}
+
+        bool enabled() const { return maxEvents > 1; }
+
+        unsigned maxEvents;
+        double maxDelayMs;
+    };
+
+    EventBatching eventBatching;
+
+    /** If positive, the router doesn't send the agent a LOSS message when
+        it loses the router's auction.  The agent is instead expected to
+        assume a loss for any bid that hasn't had a result this many
+        seconds after it was made, which the bidding agent library does
+        by calling onLoss itself.  Wins (and late wins) are still sent.
+        Off (0) by default.
+    */
+    double implicitLossSeconds;
+
+    /** Cap on the number of impressions (wins) of the account shown to a
+        user over a sliding window, enforced in the router by the
+        FrequencyCap filter before the bid request is sent to the agent.
+        Off unless maxImpressions is positive.
+    */
+    struct FrequencyCap {
+        FrequencyCap() : maxImpressions(0), windowSeconds(86400.0) {}
+
+        bool enabled() const { return maxImpressions > 0; }
+
+        unsigned maxImpressions;
+        double windowSeconds;
+    };
+
+    FrequencyCap frequencyCap;
     //
     Json::Value ext;
 
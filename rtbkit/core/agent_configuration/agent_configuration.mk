@@ -10,7 +10,7 @@ LIBAGENT_CONFIGURATION_SOURCES := \
 	fees.cc \
 
 LIBAGENT_CONFIGURATION_LINK := \
-	rtb zeromq boost_thread opstats gc services utils monitor
+	rtb zeromq boost_thread opstats gc services utils monitor worker_task
 
 $(eval $(call library,agent_configuration,$(LIBAGENT_CONFIGURATION_SOURCES),$(LIBAGENT_CONFIGURATION_LINK)))
 
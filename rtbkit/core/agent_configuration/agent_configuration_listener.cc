@@ -7,6 +7,7 @@
 
 #include "agent_configuration_listener.h"
 #include "agent_config.h"
+#include "jml/utils/worker_task.h"
 
 namespace RTBKIT {
 
@@ -61,59 +62,174 @@ getAgentEntry(const std::string & agent) const
 
 void
 AgentConfigurationListener::
-onMessage(const std::vector<std::string> & message)
+processPending()
+{
+    using namespace std;
+
+    if (pending.empty()) return;
+
+    vector<vector<string> > messages;
+    messages.swap(pending);
+
+    // Parsing the full configs is what takes the time and doesn't depend on
+    // the order of the messages.
+    vector<Json::Value> json(messages.size());
+    vector<shared_ptr<AgentConfig> > parsed(messages.size());
+
+    auto doParse = [&] (int i)
+        {
+            const vector<string> & message = messages[i];
+            if (message.size() < 3 || message[0] != "CONFIG" || message[2].empty())
+                return;
+
+            try {
+                json[i] = Json::parse(message[2]);
+                parsed[i].reset(new AgentConfig(AgentConfig::createFromJson(json[i])));
+            } catch (const std::exception & exc) {
+                cerr << "error parsing configuration of agent " << message[1]
+                     << ": " << exc.what() << endl;
+            }
+        };
+
+    size_t numConfigs = count_if(messages.begin(), messages.end(),
+            [] (const vector<string> & message)
+            {
+                return !message.empty() && message[0] == "CONFIG";
+            });
+
+    if (numConfigs >= 8)
+        ML::run_in_parallel(0, messages.size(), doParse);
+    else for (size_t i = 0;  i < messages.size();  ++i) doParse(i);
+
+    map<string, shared_ptr<const AgentConfig> > changes;
+    for (size_t i = 0;  i < messages.size();  ++i)
+        onMessage(messages[i], json[i], parsed[i], changes);
+
+    if (!changes.empty()) updateAgents(changes);
+}
+
+void
+AgentConfigurationListener::
+onMessage(const std::vector<std::string> & message,
+          Json::Value & json,
+          std::shared_ptr<AgentConfig> config,
+          std::map<std::string, std::shared_ptr<const AgentConfig> > & changes)
 {
     using namespace std;
 
     const std::string & topic = message.at(0);
+    const std::string & agent = message.at(1);
+
+    if (topic == "CONFIGDELTA") {
+        auto config = applyDelta(agent, message, changes);
+        if (config)
+            changes[agent] = config;
+        return;
+    }
+
     if (topic != "CONFIG") {
         cerr << "unknown message for agent configuration listener" << endl;
         cerr << message;
         return;
     }
-    const std::string & agent = message.at(1);
     const std::string & configStr = message.at(2);
 
-    std::shared_ptr<AgentConfig> config;
-
     if (!configStr.empty()) {
-        Json::Value j = Json::parse(configStr);
-        config.reset(new AgentConfig(AgentConfig::createFromJson(j)));
+        // It couldn't be parsed, which was reported already
+        if (!config) return;
+
+        // Older configuration services don't version their configs, in
+        // which case we'll never get a delta.
+        AgentJson & entry = agentJson[agent];
+        entry.config = std::move(json);
+        entry.version = message.size() > 3 ? std::stoull(message[3]) : 0;
     }
+    else agentJson.erase(agent);
 
+    changes[agent] = config;
+}
+
+std::shared_ptr<AgentConfig>
+AgentConfigurationListener::
+applyDelta(const std::string & agent, const std::vector<std::string> & message,
+           const std::map<std::string, std::shared_ptr<const AgentConfig> > & changes)
+{
+    using namespace std;
+
+    uint64_t baseVersion = std::stoull(message.at(2));
+    uint64_t version = std::stoull(message.at(3));
+
+    auto it = agentJson.find(agent);
+    if (it == agentJson.end() || it->second.version != baseVersion) {
+        cerr << "agent " << agent << " config delta from version "
+             << baseVersion << " doesn't apply; resyncing" << endl;
+        configEndpoint.sendMessage("RESYNC", agent);
+        return nullptr;
+    }
+
+    Json::Value delta = Json::parse(message.at(4));
+    Json::Value json = it->second.config;
+    AgentConfig::patchJson(json, delta);
+
+    std::shared_ptr<AgentConfig> config;
+
+    // An earlier message of the batch may have changed it
+    auto changed = changes.find(agent);
+    auto current = changed != changes.end()
+        ? changed->second : getAgentEntry(agent).config;
+    if (current)
+        config.reset(new AgentConfig(current->applyDelta(delta, json)));
+    else config.reset(new AgentConfig(AgentConfig::createFromJson(json)));
+
+    it->second.config = std::move(json);
+    it->second.version = version;
+
+    return config;
+}
+
+void
+AgentConfigurationListener::
+updateAgents(const std::map<std::string,
+                            std::shared_ptr<const AgentConfig> > & changes)
+{
     /* Now, update the current configuration list */
 
     GcLock::SharedGuard guard(allAgentsGc);
     AllAgentConfig * ac = allAgents;
-    
+
     /* Create a new object and copy the old ones in */
     std::unique_ptr<AllAgentConfig> newConfig(new AllAgentConfig());
-    bool found = false;
+
+    auto add = [&] (const AgentConfigEntry & ce)
+        {
+            newConfig->emplace_back(ce);
+
+            int i = newConfig->size() - 1;
+            newConfig->agentIndex[ce.name] = i;
+            newConfig->accountIndex[ce.config->account].push_back(i);
+        };
+
     for (auto & c: *ac) {
-        if (c.name == agent) {
-            found = true;
-            if (config) {
-                AgentConfigEntry ce = c;
-                ce.config = config;
-                newConfig->emplace_back(ce);
-            }
-            else continue;
+        auto it = changes.find(c.name);
+        if (it == changes.end()) {
+            add(c);
+            continue;
         }
-        else newConfig->emplace_back(c);
 
-        int i = newConfig->size() - 1;
-        newConfig->agentIndex[c.name] = i;
-        newConfig->accountIndex[newConfig->back().config->account].push_back(i);
+        if (it->second) {
+            AgentConfigEntry ce = c;
+            ce.config = it->second;
+            add(ce);
+        }
     }
-    if (!found && config) {
-        AgentConfigEntry ce;
-        ce.name = agent;
-        ce.config = config;
-        newConfig->emplace_back(ce);
 
-        int i = newConfig->size() - 1;
-        newConfig->agentIndex[agent] = i;
-        newConfig->accountIndex[newConfig->back().config->account].push_back(i);
+    for (const auto & change: changes) {
+        if (!change.second || ac->agentIndex.count(change.first)) continue;
+
+        AgentConfigEntry ce;
+        ce.name = change.first;
+        ce.config = change.second;
+        add(ce);
     }
 
     if (ML::cmp_xchg(allAgents, ac, (AllAgentConfig *)newConfig.get())) {
@@ -126,8 +242,10 @@ onMessage(const std::vector<std::string> & message)
         throw ML::Exception("cmp_exch failed for AgentConfigurationListener");
     }
 
-    if (onConfigChange)
-        onConfigChange(agent, config);
+    if (onConfigChange) {
+        for (const auto & change: changes)
+            onConfigChange(change.first, change.second);
+    }
 }
 
 
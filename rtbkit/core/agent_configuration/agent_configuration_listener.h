@@ -10,6 +10,7 @@
 #include "soa/service/zmq_endpoint.h"
 #include "rtbkit/core/router/router_types.h"
 #include "soa/gc/rcu_protected.h"
+#include <map>
 
 
 namespace RTBKIT {
@@ -78,9 +79,14 @@ struct AgentConfigurationListener: public MessageLoop {
                     using namespace std;
                     cerr << "got configuration message " << message[1] << endl;
                 }
-                this->onMessage(message);
+                pending.push_back(message);
             };
         addSource("AgentConfigurationListener::configEndpoint", configEndpoint);
+
+        // Configs arrive in bursts (all of them when we connect) so they are
+        // handled a batch at a time.
+        addPeriodic("AgentConfigurationListener::processPending", 0.01,
+                    [=] (uint64_t) { this->processPending(); });
     }
 
     void start()
@@ -114,7 +120,50 @@ struct AgentConfigurationListener: public MessageLoop {
     AgentConfigEntry getAgentEntry(const std::string & agent) const;
 
 private:
-    void onMessage(const std::vector<std::string> & message);
+    /** Handle the messages received since the last call.  The full configs
+        in the batch are parsed in parallel, then every message is applied
+        in order and the changed agents are published together.
+    */
+    void processPending();
+
+    /** Handle a message whose full config, if it has one, was parsed into
+        json and parsed.  The agents whose configuration changed are recorded
+        in changes.
+    */
+    void onMessage(const std::vector<std::string> & message,
+                   Json::Value & json,
+                   std::shared_ptr<AgentConfig> parsed,
+                   std::map<std::string, std::shared_ptr<const AgentConfig> > & changes);
+
+    /** Handle a CONFIGDELTA message.  Returns a null config when we don't
+        have the version that the delta applies to and asked for the whole
+        configuration instead.
+    */
+    std::shared_ptr<AgentConfig>
+    applyDelta(const std::string & agent, const std::vector<std::string> & message,
+               const std::map<std::string,
+                              std::shared_ptr<const AgentConfig> > & changes);
+
+    /** Publish the new configurations of the agents, or their removal when
+        the config is null.
+    */
+    void updateAgents(const std::map<std::string,
+                                     std::shared_ptr<const AgentConfig> > & changes);
+
+    /** Messages waiting for processPending.  Only used on the message loop
+        thread.
+    */
+    std::vector<std::vector<std::string> > pending;
+
+    /** Last configuration of each agent as sent over the wire, which the
+        deltas are applied to.  Only used on the message loop thread.
+    */
+    struct AgentJson {
+        Json::Value config;
+        uint64_t version;
+    };
+
+    std::unordered_map<std::string, AgentJson> agentJson;
 
     AllAgentConfig * allAgents;
     mutable GcLock allAgentsGc;
@@ -139,7 +188,7 @@ struct AgentBridge {
     void sendAgentMessage(const std::string & agent,
                           const std::string & messageType,
                           const Date & date,
-                          Args... args)
+                          Args &&... args)
     {
         agents.sendMessage(agent, messageType, date,
                            std::forward<Args>(args)...);
@@ -151,7 +200,7 @@ struct AgentBridge {
                           const std::string & eventType,
                           const std::string & messageType,
                           const Date & date,
-                          Args... args)
+                          Args &&... args)
     {
         agents.sendMessage(agent, eventType, messageType, date,
                            std::forward<Args>(args)...);
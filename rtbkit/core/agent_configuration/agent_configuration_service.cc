@@ -7,6 +7,7 @@
 
 #include "jml/utils/string_functions.h"
 #include "agent_configuration_service.h"
+#include "agent_config.h"
 #include "soa/service/rest_request_binding.h"
 
 using namespace std;
@@ -67,8 +68,7 @@ init()
             // we got a new listener...
             for (auto & a: agentInfo) {
                 if (!a.second.config.isNull())
-                    listeners.sendMessage(listener, "CONFIG", a.first,
-                                          a.second.config.toString());
+                    sendConfig(listener, a.first, a.second);
             }
         };
 
@@ -81,6 +81,11 @@ init()
 
     listeners.clientMessageHandler = [=] (const std::vector<std::string> & message)
         {
+            if (message.size() == 3 && message[1] == "RESYNC") {
+                handleResync(message[0], message[2]);
+                return;
+            }
+
             cerr << "listeners got client message " << message << endl;
             throw ML::Exception("unexpected listener message");
             //const std::string & agent = message.at(2);
@@ -122,7 +127,7 @@ init()
                        {"GET"},
                        "List all agents that are configured",
                        "Array of names",
-                       [] (const std::vector<std::string> & v) { return jsonEncode(v); },
+                       [] (const std::vector<std::string> & v) { return Datacratic::jsonEncode(v); },
                        &AgentConfigurationService::handleGetAgentList,
                        this);
     
@@ -237,11 +242,55 @@ handleAgentConfig(const std::string & agent,
     if (info.config == config)
         return;
 
+    uint64_t baseVersion = info.version;
+    std::string delta;
+    if (baseVersion != 0)
+        delta = AgentConfig::diffJson(info.config, config).toString();
+
     info.config = config;
+    info.configStr = config.toString();
+    ++info.version;
+
+    // Large configs tend to change a field at a time, so the listeners
+    // are usually sent a small delta instead of all of it
+    if (baseVersion != 0 && delta.size() < info.configStr.size()) {
+        std::string base = std::to_string(baseVersion);
+        std::string version = std::to_string(info.version);
+        for (auto & l: listenerInfo)
+            listeners.sendMessage(l.first, "CONFIGDELTA", agent,
+                                  base, version, delta);
+        return;
+    }
 
     // Broadcast the configuration to all listeners
     for (auto & l: listenerInfo)
-        listeners.sendMessage(l.first, "CONFIG", agent, config.toString());
+        sendConfig(l.first, agent, info);
+}
+
+void
+AgentConfigurationService::
+sendConfig(const std::string & listener, const std::string & agent,
+           const AgentInfo & info)
+{
+    listeners.sendMessage(listener, "CONFIG", agent, info.configStr,
+                          std::to_string(info.version));
+}
+
+void
+AgentConfigurationService::
+handleResync(const std::string & listener, const std::string & agent)
+{
+    cerr << "listener " << hexify_string(listener) << " resyncing agent "
+         << agent << endl;
+
+    auto it = agentInfo.find(agent);
+    if (it == agentInfo.end() || it->second.config.isNull()) {
+        // The agent went away in the meantime
+        listeners.sendMessage(listener, "CONFIG", agent, "");
+        return;
+    }
+
+    sendConfig(listener, agent, it->second);
 }
 
 void
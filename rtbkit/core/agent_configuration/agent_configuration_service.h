@@ -30,6 +30,17 @@ using namespace Datacratic;
     how the agents are configured) connect via zeromq.  They will be
     sent all configurations on connection, and will be sent any changed
     configurations once they are changed.
+
+    Each configuration of an agent has a version.  Changes are sent as
+    a CONFIGDELTA message with the delta from the previous version (see
+    AgentConfig::diffJson()) rather than the whole configuration, unless
+    the delta isn't any smaller.  A listener that doesn't have the
+    previous version asks for the whole configuration again with RESYNC.
+
+    Messages to the listeners:
+    - CONFIG <agent> <config> <version>: whole configuration, which is
+      empty when the agent went away.
+    - CONFIGDELTA <agent> <base version> <version> <delta>
 */
 
 struct AgentConfigurationService : public RestServiceEndpoint,
@@ -77,6 +88,9 @@ struct AgentConfigurationService : public RestServiceEndpoint,
 
     void handleDeleteConfig(const std::string & agent);
 
+    /// Handler for a RESYNC from a listener that missed a delta
+    void handleResync(const std::string & listener, const std::string & agent);
+
     /// Handler for GET /v1/agents/<name>/
     Json::Value handleGetAgent(const std::string & agent) const;
 
@@ -104,11 +118,18 @@ struct AgentConfigurationService : public RestServiceEndpoint,
     std::unordered_map<std::string, ListenerInfo> listenerInfo;
 
     struct AgentInfo {
+        AgentInfo() : version(0) {}
+
         Json::Value config;
         std::string configStr;
         Date lastHeartbeat;
+        uint64_t version;     ///< Bumped on every change of config
     };
 
+    /** Send the whole configuration of the agent to the listener. */
+    void sendConfig(const std::string & listener,
+                    const std::string & agent, const AgentInfo & info);
+
     std::unordered_map<std::string, AgentInfo> agentInfo;
 
     /* Reponds to Monitor requests */
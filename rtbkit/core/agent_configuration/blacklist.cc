@@ -7,137 +7,291 @@
 
 #include "blacklist.h"
 #include "agent_config.h"
+#include "jml/utils/exc_check.h"
+#include <cmath>
+#include <limits>
 
 namespace RTBKIT {
 
-Date
-BlacklistInfo::
-add(const BidRequest & bidRequest,
-    const std::string & agent,
-    const AgentConfig & config)
+
+/*****************************************************************************/
+/* BLACKLIST TABLE                                                           */
+/*****************************************************************************/
+
+namespace {
+
+enum { MinCapacity = 16 };
+
+/** Second zero of the packed expiries (1 January 2010), which leaves them
+    good until 2146. */
+const double Epoch = 1262304000.0;
+
+} // file scope
+
+BlacklistTable::
+BlacklistTable(size_t numSlots)
+    : table(MinCapacity), used(0), nextTick(0)
+{
+    size_t slots = 1;
+    while (slots < numSlots) slots <<= 1;
+    wheel.resize(slots);
+}
+
+uint32_t
+BlacklistTable::
+toSeconds(Date date, bool roundUp) const
+{
+    double seconds = date.secondsSinceEpoch() - Epoch;
+    seconds = roundUp ? std::ceil(seconds) : std::floor(seconds);
+    if (seconds < 0.0) return 0;
+    if (seconds > std::numeric_limits<uint32_t>::max())
+        return std::numeric_limits<uint32_t>::max();
+    return seconds;
+}
+
+size_t
+BlacklistTable::
+probe(uint64_t key) const
+{
+    size_t mask = table.size() - 1;
+    for (size_t index = bucket(key);; index = (index + 1) & mask) {
+        const Entry & entry = table[index];
+        if (entry.key == 0 || entry.key == key) return index;
+    }
+}
+
+bool
+BlacklistTable::
+add(uint64_t key, Date expiry)
 {
-    Entry entry;
-    entry.agent = agent;
-    entry.account = config.account;
-    entry.site = bidRequest.url.toString();
-    entry.expiry = Date::now().plusSeconds(config.blacklistTime);
+    ExcCheck(key != 0, "the blacklist key 0 is reserved");
 
-    entries.push_back(entry);
+    uint32_t seconds = toSeconds(expiry, true /* roundUp */);
 
-    if (entries.size() == 1 || entry.expiry < earliestExpiry) {
-        earliestExpiry = entry.expiry;
-        return earliestExpiry;
+    size_t index = probe(key);
+    Entry & entry = table[index];
+    if (entry.key == key) {
+        // It's already in the wheel, which moves it on if it's extended
+        entry.expiry = std::max(entry.expiry, seconds);
+        return false;
     }
 
-    return Date(); // no need to reset the expiry
+    entry.key = key;
+    entry.expiry = seconds;
+    ++used;
+
+    schedule(key, seconds);
+
+    if (used * 10 > table.size() * 7) grow();
+
+    return true;
+}
+
+bool
+BlacklistTable::
+contains(uint64_t key, Date now) const
+{
+    const Entry & entry = table[probe(key)];
+    return entry.key == key && entry.expiry > toSeconds(now, false);
 }
 
-Date
-BlacklistInfo::
+void
+BlacklistTable::
+schedule(uint64_t key, uint32_t expiry)
+{
+    // Anything already due goes in the next slot to be visited
+    uint64_t tick = std::max<uint64_t>(expiry, nextTick);
+    wheel[tick & (wheel.size() - 1)].push_back(key);
+}
+
+size_t
+BlacklistTable::
 expire(Date now)
 {
-    Date result = Date();
-    for (unsigned i = 0;  i < entries.size();  /* no inc */) {
-        if (entries[i].expiry <= now) {
-            std::swap(entries[i], entries.back());
-            entries.pop_back();
-            // no increment
-        }
-        else {
-            if (result == Date())
-                result = entries[i].expiry;
-            else result = std::min(result, entries[i].expiry);
-            ++i;
+    uint64_t nowTick = toSeconds(now, false);
+    if (nowTick < nextTick) return 0;
+
+    // Visiting a full revolution covers every slot
+    uint64_t lastTick = nowTick;
+    if (lastTick - nextTick >= wheel.size())
+        lastTick = nextTick + wheel.size() - 1;
+
+    size_t mask = wheel.size() - 1;
+    size_t numExpired = 0;
+
+    for (uint64_t tick = nextTick;  tick <= lastTick;  ++tick) {
+        std::vector<uint64_t> & slot = wheel[tick & mask];
+
+        size_t kept = 0;
+        for (size_t i = 0;  i < slot.size();  ++i) {
+            uint64_t key = slot[i];
+            size_t index = probe(key);
+            if (table[index].key != key) continue;  // cleared
+
+            uint32_t expiry = table[index].expiry;
+            if (expiry <= nowTick) {
+                remove(index);
+                ++numExpired;
+            }
+            else if ((expiry & mask) == (tick & mask))
+                slot[kept++] = key;  // a later revolution
+            else wheel[expiry & mask].push_back(key);
         }
+
+        slot.resize(kept);
+        if (slot.capacity() > 4 * kept + 16)
+            std::vector<uint64_t>(slot).swap(slot);
     }
-    return result;
+
+    // The current tick may get entries expiring within it, so it needs to be
+    // visited again next time
+    nextTick = nowTick;
+
+    return numExpired;
 }
 
-bool
-BlacklistInfo::
-matches(const BidRequest & bidRequest,
-        const std::string & agent,
-        const AgentConfig & config) const
+void
+BlacklistTable::
+remove(size_t index)
 {
-    auto matchesEntry = [&] (const Entry & entry) -> bool
-        {
-            switch (config.blacklistScope) {
-                case BL_AGENT:
-                    return entry.agent == agent;
-                case BL_ACCOUNT:
-                    return entry.account == config.account;
-            default:
-                throw ML::Exception("invalid blacklist scope");
-            }
-        };
+    size_t mask = table.size() - 1;
 
-    switch (config.blacklistType) {
-    case BL_OFF:
-        return false;  // shouldn't happen
+    for (size_t next = (index + 1) & mask;; next = (next + 1) & mask) {
+        Entry & entry = table[next];
+        if (entry.key == 0) break;
 
-    case BL_USER:  // fall through
-        for (unsigned i = 0;  i < entries.size();  ++i) {
-            const Entry & entry = entries[i];
-            if (matchesEntry(entry)) return true;
-        }
+        // Only move the entry if its home bucket isn't in (index, next]
+        size_t home = bucket(entry.key);
+        if (((next - home) & mask) < ((next - index) & mask)) continue;
 
-    case BL_USER_SITE:
-        for (unsigned i = 0;  i < entries.size();  ++i) {
-            const Entry & entry = entries[i];
-            if (!matchesEntry(entry)) continue;
-            if (entry.site != "" && entry.site == bidRequest.url.toString())
-                return true;
-        }
-        return false;
+        table[index] = entry;
+        index = next;
+    }
 
-    default:
-        throw ML::Exception("unknown blacklist type");
+    table[index].key = 0;
+    --used;
+}
+
+void
+BlacklistTable::
+grow()
+{
+    std::vector<Entry> old(table.size() * 2);
+    old.swap(table);
+
+    for (const Entry & entry: old) {
+        if (entry.key == 0) continue;
+        table[probe(entry.key)] = entry;
     }
 }
 
 void
-Blacklist::
-doExpiries()
+BlacklistTable::
+clear()
 {
-    Date start = Date::now();
+    std::vector<Entry>(MinCapacity).swap(table);
+    used = 0;
+    for (auto & slot: wheel)
+        std::vector<uint64_t>().swap(slot);
+    nextTick = 0;
+}
 
-    auto onBlacklistFinished = [&] (const Id & userId,
-                                    BlacklistInfo & info)
-        {
-            return info.expire(start);
-        };
+size_t
+BlacklistTable::
+memusage() const
+{
+    size_t result = table.capacity() * sizeof(Entry)
+        + wheel.capacity() * sizeof(wheel[0]);
+    for (auto & slot: wheel)
+        result += slot.capacity() * sizeof(uint64_t);
+    return result;
+}
+
+
+/*****************************************************************************/
+/* BLACKLIST                                                                 */
+/*****************************************************************************/
+
+namespace {
+
+enum KeyScope {
+    KEY_AGENT = 1,
+    KEY_ACCOUNT = 2
+};
 
-    entries.expire(onBlacklistFinished, start);
+/** Key of the given user's blacklisting by an agent or account (whose hash
+    is given), optionally on a given site (whose hash is given, or 0).
+*/
+uint64_t blacklistKey(const Id & user, uint64_t scopeHash, KeyScope scope,
+                      uint64_t siteHash)
+{
+    uint64_t inner = Hash128to64(std::make_pair(scopeHash, siteHash));
+    uint64_t result
+        = Hash128to64(std::make_pair(user.hash(), inner ^ scope));
+    return result ? result : 1;
+}
+
+} // file scope
+
+void
+Blacklist::
+doExpiries(Date now)
+{
+    entries.expire(now);
 }
 
 bool
 Blacklist::
 matches(const BidRequest & bidRequest, const std::string & agentName,
         const AgentConfig & config) const
-{  
-    bool blocked = false;
-    const Id & exchangeId = bidRequest.userIds.exchangeId;
-    if (!blocked && exchangeId) {
-        // TODO: read lock
-        auto bit = entries.find(exchangeId);
-        if (bit != entries.end()) {
-            const BlacklistInfo & binfo = bit->second;
-            if (binfo.matches(bidRequest, agentName, config))
-                blocked = true;
-        }
+{
+    uint64_t scopeHash;
+    KeyScope scope;
+
+    switch (config.blacklistScope) {
+    case BL_AGENT:
+        scopeHash = hashString(agentName);
+        scope = KEY_AGENT;
+        break;
+    case BL_ACCOUNT:
+        scopeHash = hashString(config.account.toString());
+        scope = KEY_ACCOUNT;
+        break;
+    default:
+        throw ML::Exception("invalid blacklist scope");
     }
-    const Id & providerId = bidRequest.userIds.providerId;
-    if (!blocked && providerId) {
-        // TODO: read lock
-        auto bit = entries.find(providerId);
-        if (bit != entries.end()) {
-            const BlacklistInfo & binfo = bit->second;
-            if (binfo.matches(bidRequest, agentName, config))
-                blocked = true;
-        }
+
+    uint64_t siteHash;
+    switch (config.blacklistType) {
+    case BL_OFF:
+        return false;  // shouldn't happen
+
+    case BL_USER:
+        siteHash = 0;
+        break;
+
+    case BL_USER_SITE: {
+        std::string site = bidRequest.url.toString();
+        if (site.empty()) return false;
+        siteHash = hashString(site);
+        break;
     }
 
-    return blocked;
+    default:
+        throw ML::Exception("unknown blacklist type");
+    }
+
+    Date now = Date::nowCoarse();
+
+    auto matchesUser = [&] (const Id & id)
+        {
+            return id
+                && entries.contains(blacklistKey(id, scopeHash, scope, siteHash),
+                                    now);
+        };
+
+    return matchesUser(bidRequest.userIds.exchangeId)
+        || matchesUser(bidRequest.userIds.providerId);
 }
 
 void
@@ -145,24 +299,28 @@ Blacklist::
 add(const BidRequest & bidRequest, const std::string & agent,
     const AgentConfig & agentConfig)
 {
+    Date expiry = Date::nowCoarse().plusSeconds(agentConfig.blacklistTime);
+
+    uint64_t agentHash = hashString(agent);
+    uint64_t accountHash = hashString(agentConfig.account.toString());
+    std::string site = bidRequest.url.toString();
+    uint64_t siteHash = site.empty() ? 0 : hashString(site);
+
     auto addToBlacklist = [&] (const Id & id)
         {
             if (!id) return;
 
-            auto it = this->entries.find(id);
-            if (it != this->entries.end()) {
-                Date newExpiry
-                    = it->second.add(bidRequest, agent, agentConfig);
-                if (newExpiry != Date())
-                    this->entries.updateTimeout(it, newExpiry);
-            }
-            else {
-                BlacklistInfo binfo;
-                Date timeout = binfo.add(bidRequest, agent, agentConfig);
-                this->entries.insert(id, binfo, timeout);
+            entries.add(blacklistKey(id, agentHash, KEY_AGENT, 0), expiry);
+            entries.add(blacklistKey(id, accountHash, KEY_ACCOUNT, 0), expiry);
+            if (siteHash) {
+                entries.add(blacklistKey(id, agentHash, KEY_AGENT, siteHash),
+                            expiry);
+                entries.add(blacklistKey(id, accountHash, KEY_ACCOUNT,
+                                         siteHash),
+                            expiry);
             }
         };
-    
+
     addToBlacklist(bidRequest.userIds.exchangeId);
     addToBlacklist(bidRequest.userIds.providerId);
 }
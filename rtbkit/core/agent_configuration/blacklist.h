@@ -12,7 +12,7 @@
 #include <vector>
 #include "rtbkit/common/bid_request.h"
 #include "rtbkit/core/router/router_types.h"
-#include "soa/service/timeout_map.h"
+#include "jml/compiler/compiler.h"
 
 
 namespace RTBKIT {
@@ -21,39 +21,80 @@ struct AgentConfig;
 
 
 /*****************************************************************************/
-/* BLACKLIST INFO                                                            */
+/* BLACKLIST TABLE                                                           */
 /*****************************************************************************/
 
-/** For the given user, contains information on who has blacklisted them
-    for how much time.
+/** Set of 64 bit keys that each expire at a given time, made to hold the
+    millions of entries of frequency capping style blacklists.
+
+    - The keys live in an open addressing table with linear probing and
+      backward shift deletion, next to their expiry packed as 32 bit seconds
+      since 2010, which takes 12 bytes per slot.
+    - Expiry is driven by a timer wheel of one second ticks that only holds
+      the keys.  Each key is in exactly one slot of the wheel; when its slot
+      comes round it's erased if it has expired, or moved to the slot of its
+      expiry if that was extended or is more than a revolution away.  There
+      is never any scan of the whole table.
+
+    Expiries are resolved to the second: a key is never expired before its
+    expiry but may stay for up to a second after it.  The key 0 is reserved.
 */
-struct BlacklistInfo {
-    struct Entry {
-        std::string agent;
-        AccountKey account;
-        std::string site;
-        Date expiry;
-    };
-    std::vector<Entry> entries;
-    Date earliestExpiry;
-
-    /* Does the given agent and bid request match the blacklist? */
-    bool matches(const BidRequest & request,
-                 const std::string & agent,
-                 const AgentConfig & agentConfig) const;
-        
-    /** Add the given entry to the blacklist.  Returns Date() if the
-        entry is not the earliest expiring entry, or the date of the
-        new expiry if not.
+
+struct BlacklistTable {
+    BlacklistTable(size_t numSlots = 1 << 12);
+
+    /** Add the key, expiring at the given date.  If it's already there it
+        expires at the later of its old and new expiry.  Returns true if the
+        key was added, or false if it was already there.
     */
-    Date add(const BidRequest & bidRequest,
-             const std::string & agent,
-             const AgentConfig & agentConfig);
-        
-    /* Expire any that need to be expired, and return the next lowest
-       expiry date or an empty date if none.
+    bool add(uint64_t key, Date expiry);
+
+    /** Is the key there and not expired at the given time? */
+    bool contains(uint64_t key, Date now) const;
+
+    /** Erase every key that has expired at the given time, and return how
+        many there were.
     */
-    Date expire(Date now);
+    size_t expire(Date now);
+
+    void clear();
+
+    /** Number of keys. */
+    size_t size() const { return used; }
+
+    /** Number of slots in the table. */
+    size_t capacity() const { return table.size(); }
+
+    /** Memory used by the table and the wheel, in bytes. */
+    size_t memusage() const;
+
+private:
+    struct Entry {
+        uint64_t key;       ///< 0 means empty
+        uint32_t expiry;    ///< Seconds since 2010, rounded up
+    } JML_PACKED;
+
+    size_t bucket(uint64_t key) const
+    {
+        return key & (table.size() - 1);
+    }
+
+    /** Index of the key or of the empty slot where it should go. */
+    size_t probe(uint64_t key) const;
+
+    void remove(size_t index);
+    void grow();
+
+    /** Put the key in the slot of the wheel for its expiry. */
+    void schedule(uint64_t key, uint32_t expiry);
+
+    uint32_t toSeconds(Date date, bool roundUp) const;
+
+    std::vector<Entry> table;
+    size_t used;
+
+    std::vector<std::vector<uint64_t> > wheel;
+    uint64_t nextTick;           ///< Next tick of the wheel to visit
 };
 
 
@@ -61,12 +102,23 @@ struct BlacklistInfo {
 /* BLACKLIST                                                                 */
 /*****************************************************************************/
 
-/** Indexed on user ID */
+/** Users that agents or accounts have blacklisted, either everywhere or on
+    a given site.  Each blacklisting is recorded under the 64 bit hash of
+    (user id, agent or account, site or nothing) so that both scopes and
+    both types can be checked with a single lookup each.  A false positive
+    needs a collision of the 64 bit hash.
+*/
 struct Blacklist {
-    void doExpiries();
+    void doExpiries(Date now = Date::nowCoarse());
 
+    /** Number of entries.  Each blacklisting adds up to four of them for
+        each of the user's ids.
+    */
     size_t size() const { return entries.size(); }
-    
+
+    /** Memory used, in bytes. */
+    size_t memusage() const { return entries.memusage(); }
+
     bool matches(const BidRequest & request,
                  const std::string & agentName,
                  const AgentConfig & config) const;
@@ -74,9 +126,8 @@ struct Blacklist {
     void add(const BidRequest & bidRequest,
              const std::string & agent,
              const AgentConfig & agentConfig);
-    
-    typedef TimeoutMap<Id, BlacklistInfo> Entries;
-    Entries entries;
+
+    BlacklistTable entries;
 };
 
 } // namespace RTBKIT
@@ -0,0 +1,84 @@
+/* rtb_agent_config_delta_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the deltas sent between agent configurations.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include <iostream>
+
+using namespace std;
+using namespace RTBKIT;
+
+namespace {
+
+Json::Value baseConfig()
+{
+    return Json::parse(R"JSON( {
+            "account" : ["hello", "world"],
+            "bidProbability": 0.5,
+            "requiredIds": ["exchange"],
+            "urlFilter": { "include": ["a.com", "b.com"] },
+            "creatives": [
+            {
+                "name": "MaCreative",
+                "height": 250,
+                "width": 300,
+                "id": 5
+            }]}
+        )JSON");
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_agent_config_diff_patch )
+{
+    Json::Value from = baseConfig();
+    Json::Value to = from;
+    to["bidProbability"] = 0.25;
+    to.removeMember("urlFilter");
+    to["maxInFlight"] = 10;
+
+    Json::Value delta = AgentConfig::diffJson(from, to);
+    BOOST_CHECK_EQUAL(delta.size(), 3);
+    BOOST_CHECK_EQUAL(delta["bidProbability"].asDouble(), 0.25);
+    BOOST_CHECK(delta["urlFilter"].isNull());
+    BOOST_CHECK(!delta.isMember("creatives"));
+
+    Json::Value patched = from;
+    AgentConfig::patchJson(patched, delta);
+    BOOST_CHECK_EQUAL(patched, to);
+
+    BOOST_CHECK_EQUAL(AgentConfig::diffJson(to, to).size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_agent_config_apply_delta )
+{
+    Json::Value from = baseConfig();
+    AgentConfig config = AgentConfig::createFromJson(from);
+
+    Json::Value to = from;
+    to["bidProbability"] = 0.25;
+    to["requiredIds"] = Json::parse(R"JSON( ["exchange", "user"] )JSON");
+    to.removeMember("urlFilter");
+
+    Json::Value delta = AgentConfig::diffJson(from, to);
+    AgentConfig updated = config.applyDelta(delta, to);
+
+    // Same as if the whole thing had been parsed again
+    AgentConfig expected = AgentConfig::createFromJson(to);
+    BOOST_CHECK_EQUAL(updated.toJson(), expected.toJson());
+    BOOST_CHECK_EQUAL(updated.requiredIds.size(), 2);
+    BOOST_CHECK_EQUAL(updated.bidProbability, 0.25);
+
+    // Removing a mandatory field is still caught
+    Json::Value noCreatives = to;
+    noCreatives.removeMember("creatives");
+    BOOST_CHECK_THROW(updated.applyDelta(AgentConfig::diffJson(to, noCreatives),
+                                         noCreatives),
+                      std::exception);
+}
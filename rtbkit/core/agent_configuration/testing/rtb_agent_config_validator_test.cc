@@ -235,3 +235,46 @@ BOOST_AUTO_TEST_CASE( test_agent_config_language_filter )
 
     BOOST_CHECK_THROW(config.parse(payload),ML::Exception);
 }
+
+BOOST_AUTO_TEST_CASE( test_augmentation_compiled_filters )
+{
+    AgentConfig config;
+    config.parse(R"JSON( {
+            "account" : ["hello", "worlds"],
+            "augmentations": {
+                "frequency-cap": {
+                    "filters": { "include": ["pass", "maybe"],
+                                 "exclude": ["banned"] }
+                },
+                "other": {}
+            },
+            "creatives": [
+            {
+                "name": "MaCreative",
+                "height": 250,
+                "width": 300,
+                "id": 5
+            }]}
+        )JSON");
+
+    BOOST_REQUIRE_EQUAL(config.augmentations.size(), 2);
+    const auto & filters = config.augmentations[0].filters;
+    const auto & compiled = config.augmentations[0].compiledFilters;
+    BOOST_CHECK(!compiled.unconstrained());
+    BOOST_CHECK(config.augmentations[1].compiledFilters.unconstrained());
+
+    std::vector<std::vector<std::string> > tagLists = {
+        {}, { "pass" }, { "other", "maybe" }, { "pass", "banned" },
+        { "banned" }, { "other" }
+    };
+
+    for (const auto & tags : tagLists)
+        BOOST_CHECK_EQUAL(compiled.anyIsIncluded(tags),
+                          filters.anyIsIncluded(tags));
+
+    // Changes made in code only show up once compiled again
+    config.augmentations[1].filters.exclude.push_back("banned");
+    BOOST_CHECK(config.augmentations[1].compiledFilters.unconstrained());
+    config.compile();
+    BOOST_CHECK(!config.augmentations[1].compiledFilters.anyIsIncluded(tagLists[4]));
+}
@@ -0,0 +1,113 @@
+/* rtb_blacklist_test.cc
+   Copyright (c) 2015 Datacratic.  All rights reserved.
+
+   Test of the blacklist and of its table of expiring keys.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/agent_configuration/blacklist.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include <iostream>
+
+using namespace std;
+using namespace RTBKIT;
+
+BOOST_AUTO_TEST_CASE( test_blacklist_table )
+{
+    Date start = Date::fromSecondsSinceEpoch(1400000000.0);
+
+    BlacklistTable table(16);
+
+    // More keys than slots in the table or the wheel, some of which expire
+    // more than one revolution away
+    for (uint64_t key = 1;  key <= 1000;  ++key)
+        BOOST_CHECK(table.add(key, start.plusSeconds(key % 50)));
+
+    BOOST_CHECK_EQUAL(table.size(), 1000);
+    BOOST_CHECK_GE(table.capacity(), 1000);
+    BOOST_CHECK_LT(table.memusage(), 64 * 1000);
+
+    // An existing key is extended, but never shortened
+    BOOST_CHECK(!table.add(10, start.plusSeconds(100)));
+    BOOST_CHECK(!table.add(11, start.plusSeconds(0)));
+
+    BOOST_CHECK(table.contains(1, start));
+    BOOST_CHECK(!table.contains(1, start.plusSeconds(1)));
+    BOOST_CHECK(!table.contains(1001, start));
+
+    for (int seconds = 0;  seconds < 50;  ++seconds) {
+        table.expire(start.plusSeconds(seconds));
+        // Everything that's expired is gone; nothing else is
+        size_t live = 0;
+        for (uint64_t key = 1;  key <= 1000;  ++key) {
+            int expiry = key == 10 ? 100 : key % 50;
+            live += expiry > seconds;
+            BOOST_REQUIRE_EQUAL(table.contains(key, start.plusSeconds(seconds)),
+                                expiry > seconds);
+        }
+        BOOST_CHECK_EQUAL(table.size(), live);
+    }
+
+    BOOST_CHECK(table.contains(10, start.plusSeconds(99)));
+
+    // A long gap expires everything in one go
+    BOOST_CHECK_EQUAL(table.expire(start.plusSeconds(100000)), 1);
+    BOOST_CHECK_EQUAL(table.size(), 0);
+
+    table.add(5, start);
+    table.clear();
+    BOOST_CHECK_EQUAL(table.size(), 0);
+    BOOST_CHECK(!table.contains(5, start));
+}
+
+BOOST_AUTO_TEST_CASE( test_blacklist )
+{
+    BidRequest request;
+    request.userIds.add(Id("user1"), ID_EXCHANGE);
+    request.url = Url("http://site1.com/");
+
+    BidRequest otherSite = request;
+    otherSite.url = Url("http://site2.com/");
+
+    BidRequest otherUser = request;
+    otherUser.userIds = UserIds();
+    otherUser.userIds.add(Id("user2"), ID_EXCHANGE);
+
+    AgentConfig config;
+    config.account = AccountKey("account1:campaign");
+    config.blacklistTime = 30;
+    config.blacklistType = BL_USER;
+    config.blacklistScope = BL_AGENT;
+
+    Blacklist blacklist;
+    blacklist.add(request, "agent1", config);
+
+    BOOST_CHECK_EQUAL(blacklist.size(), 4);
+    BOOST_CHECK(blacklist.matches(request, "agent1", config));
+    BOOST_CHECK(blacklist.matches(otherSite, "agent1", config));
+    BOOST_CHECK(!blacklist.matches(otherUser, "agent1", config));
+    BOOST_CHECK(!blacklist.matches(request, "agent2", config));
+
+    // By account, any agent of the account matches
+    AgentConfig byAccount = config;
+    byAccount.blacklistScope = BL_ACCOUNT;
+    BOOST_CHECK(blacklist.matches(request, "agent2", byAccount));
+    byAccount.account = AccountKey("account2:campaign");
+    BOOST_CHECK(!blacklist.matches(request, "agent2", byAccount));
+
+    // By site, only the same site
+    AgentConfig bySite = config;
+    bySite.blacklistType = BL_USER_SITE;
+    BOOST_CHECK(blacklist.matches(request, "agent1", bySite));
+    BOOST_CHECK(!blacklist.matches(otherSite, "agent1", bySite));
+
+    // Nothing's gone until it expires
+    blacklist.doExpiries();
+    BOOST_CHECK(blacklist.matches(request, "agent1", config));
+    blacklist.doExpiries(Date::now().plusSeconds(60));
+    BOOST_CHECK_EQUAL(blacklist.size(), 0);
+    BOOST_CHECK(!blacklist.matches(request, "agent1", config));
+}
@@ -7,6 +7,9 @@
 
 #include "account.h"
 #include "banker.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
 
 using namespace std;
 using namespace ML;
@@ -125,10 +128,16 @@ Account::
 getNetBudget()
     const
 {
-    return (budgetIncreases - budgetDecreases
-            + allocatedIn - allocatedOut
-            + recycledIn - recycledOut
-            + adjustmentsIn - adjustmentsOut);
+    CurrencyAccumulator result;
+    result += budgetIncreases;
+    result -= budgetDecreases;
+    result += allocatedIn;
+    result -= allocatedOut;
+    result += recycledIn;
+    result -= recycledOut;
+    result += adjustmentsIn;
+    result -= adjustmentsOut;
+    return result.pool();
 }
 
 std::ostream & operator << (std::ostream & stream, const Account & account)
@@ -353,7 +362,7 @@ void
 ShadowAccounts::
 logBidEvents(const Datacratic::EventRecorder & eventRecorder)
 {
-    Guard guard(lock);
+    ExclusiveGuard guard(mapLock);
 
     uint32_t attachedBids(0), detachedBids(0), commitments(0), expired(0);
 
@@ -366,6 +375,12 @@ logBidEvents(const Datacratic::EventRecorder & eventRecorder)
         expired += account.lastExpiredCommitments;
     }
 
+    for (auto & slice: slices) {
+        std::unique_lock<SliceLock> sliceGuard(slice->lock);
+        for (auto & it: slice->accounts)
+            commitments += it.second.commitments.size();
+    }
+
     eventRecorder.recordLevel(attachedBids,
                               "banker.total.attachedBids");
     eventRecorder.recordLevel(detachedBids,
@@ -376,15 +391,411 @@ logBidEvents(const Datacratic::EventRecorder & eventRecorder)
                               "banker.total.expiredCommitments");
 }
 
+namespace {
+
+/** Index of the calling thread, used to pick its slice. */
+unsigned threadIndex()
+{
+    static std::atomic<unsigned> numThreads(0);
+    static __thread unsigned index = 0;
+    static __thread bool hasIndex = false;
+
+    if (!hasIndex) {
+        index = numThreads++;
+        hasIndex = true;
+    }
+    return index;
+}
+
+} // file scope
+
+void
+ShadowAccounts::
+enableSlices(unsigned numSlices)
+{
+    ExclusiveGuard guard(mapLock);
+
+    ExcCheck(accounts.empty(), "slices must be enabled before use");
+
+    slices.clear();
+    if (numSlices < 2) return;
+
+    for (unsigned i = 0;  i < numSlices;  ++i)
+        slices.emplace_back(new Slice());
+}
+
+ShadowAccounts::Slice &
+ShadowAccounts::
+currentSlice()
+{
+    return *slices[threadIndex() % slices.size()];
+}
+
+bool
+ShadowAccounts::SliceAccount::
+authorize(const std::string & item, Amount amount)
+{
+    if (available.currencyCode != amount.currencyCode
+        || available.value < amount.value)
+        return false;
+
+    auto c = commitments.insert(make_pair(item,
+                                          ShadowAccount::Commitment(amount, Date::now())));
+    if (!c.second)
+        throw ML::Exception("attempt to re-open commitment");
+
+    available -= amount;
+    attachedBids++;
+    return true;
+}
+
+bool
+ShadowAccounts::
+authorizeSlicedBid(const AccountKey & accountKey,
+                   const std::string & item,
+                   Amount amount)
+{
+    Slice & slice = currentSlice();
+
+    // Common case: the slice still has some of its chunk left
+    {
+        std::unique_lock<SliceLock> sliceGuard(slice.lock);
+        auto it = slice.accounts.find(accountKey);
+        if (it != slice.accounts.end() && it->second.authorize(item, amount))
+            return true;
+    }
+
+    return withAccount(accountKey, [&] (AccountEntry & account)
+                       {
+                           if (account.outOfSync)
+                               return false;
+                           return refillSlice(account, slice, accountKey,
+                                              item, amount);
+                       });
+}
+
+bool
+ShadowAccounts::
+refillSlice(AccountEntry & account, Slice & slice,
+            const AccountKey & accountKey,
+            const std::string & item,
+            Amount amount)
+{
+    std::unique_lock<SliceLock> sliceGuard(slice.lock);
+    SliceAccount & sliced = slice.accounts[accountKey];
+
+    // Another thread on this slice may have refilled it in the meantime
+    if (sliced.authorize(item, amount))
+        return true;
+
+    // Bids in another currency than the chunk are done on the account itself
+    if (sliced.available && sliced.available.currencyCode != amount.currencyCode)
+        return account.authorizeBid(item, amount);
+
+    Amount balance = account.balance.getAvailable(amount.currencyCode);
+    if (balance.value < amount.value)
+        return false;
+
+    // Take our share of what's left so that the other slices get some too
+    int64_t share = std::max(amount.value, balance.value / int64_t(slices.size()));
+    Amount chunk(amount.currencyCode, std::min(share, balance.value));
+
+    account.checkInvariants();
+    account.balance -= chunk;
+    account.commitmentsMade += chunk;
+    account.checkInvariants();
+
+    sliced.available = Amount(amount.currencyCode,
+                              sliced.available.value + chunk.value);
+
+    return sliced.authorize(item, amount);
+}
+
+ShadowAccounts::Slice *
+ShadowAccounts::
+findCommitment(const AccountKey & accountKey,
+               const std::string & item,
+               std::unique_lock<SliceLock> & guard)
+{
+    // It's almost always on the slice of the thread that authorized it
+    Slice * current = &currentSlice();
+
+    auto hasCommitment = [&] (Slice * slice)
+        {
+            std::unique_lock<SliceLock> sliceGuard(slice->lock);
+            auto it = slice->accounts.find(accountKey);
+            if (it == slice->accounts.end()
+                || !it->second.commitments.count(item))
+                return false;
+            guard = std::move(sliceGuard);
+            return true;
+        };
+
+    if (hasCommitment(current))
+        return current;
+
+    for (auto & slice: slices) {
+        if (slice.get() != current && hasCommitment(slice.get()))
+            return slice.get();
+    }
+
+    return nullptr;
+}
+
+bool
+ShadowAccounts::
+commitSlicedBid(const AccountKey & accountKey,
+                const std::string & item,
+                Amount amountPaid,
+                const LineItems & lineItems)
+{
+    std::unique_lock<SliceLock> sliceGuard;
+    Slice * slice = findCommitment(accountKey, item, sliceGuard);
+    if (!slice) return false;
+
+    SliceAccount & sliced = slice->accounts[accountKey];
+    auto it = sliced.commitments.find(item);
+    Amount amountAuthorized = it->second.amount;
+    sliced.commitments.erase(it);
+    sliced.detachedBids++;
+
+    // What wasn't paid goes back to the slice
+    sliced.available = Amount(amountAuthorized.currencyCode,
+                              sliced.available.value + amountAuthorized.value);
+    sliced.available -= amountPaid;
+    sliced.spent += amountPaid;
+    sliced.lineItems += lineItems;
+
+    if (amountPaid)
+        sliced.spent += Amount(CurrencyCode::CC_IMP, 1.0);
+
+    return true;
+}
+
+bool
+ShadowAccounts::
+detachSlicedBid(const AccountKey & accountKey,
+                const std::string & item,
+                Amount & amountAuthorized)
+{
+    std::unique_lock<SliceLock> sliceGuard;
+    Slice * slice = findCommitment(accountKey, item, sliceGuard);
+    if (!slice) return false;
+
+    // It's now a commitment of the account, to be committed with
+    // commitDetachedBid(); its part of the chunk stays committed
+    SliceAccount & sliced = slice->accounts[accountKey];
+    auto it = sliced.commitments.find(item);
+    amountAuthorized = it->second.amount;
+    sliced.commitments.erase(it);
+    sliced.detachedBids++;
+
+    return true;
+}
+
+void
+ShadowAccounts::
+commitBids(const std::vector<BidCommit> & commits)
+{
+    // The commitments of the slices are settled without the account lock
+    vector<const BidCommit *> sorted;
+    sorted.reserve(commits.size());
+    for (auto & commit: commits) {
+        if (commit.type != BidCommit::FORCE_WIN && !slices.empty()
+            && commitSlicedBid(commit.account, commit.item,
+                               commit.amountPaid, commit.lineItems))
+            continue;
+        sorted.push_back(&commit);
+    }
+
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [] (const BidCommit * c1, const BidCommit * c2)
+                     {
+                         return c1->account < c2->account;
+                     });
+
+    std::exception_ptr firstError;
+
+    for (size_t i = 0; i < sorted.size();) {
+        size_t end = i + 1;
+        while (end < sorted.size() && sorted[end]->account == sorted[i]->account)
+            ++end;
+
+        withAccount(sorted[i]->account, [&] (AccountEntry & account)
+                    {
+                        for (size_t j = i; j < end; ++j) {
+                            const BidCommit & commit = *sorted[j];
+                            try {
+                                switch (commit.type) {
+                                case BidCommit::COMMIT:
+                                case BidCommit::WIN:
+                                    account.commitBid(commit.item,
+                                                      commit.amountPaid,
+                                                      commit.lineItems);
+                                    break;
+                                case BidCommit::CANCEL:
+                                    account.cancelBid(commit.item);
+                                    break;
+                                case BidCommit::FORCE_WIN:
+                                    account.forceWinBid(commit.amountPaid,
+                                                        commit.lineItems);
+                                    break;
+                                }
+                            } catch (...) {
+                                if (!firstError)
+                                    firstError = std::current_exception();
+                            }
+                        }
+                    });
+
+        i = end;
+    }
+
+    if (firstError)
+        std::rethrow_exception(firstError);
+}
+
+void
+ShadowAccounts::
+rebalance()
+{
+    ExclusiveGuard guard(mapLock);
+    rebalanceImpl();
+}
+
+void
+ShadowAccounts::
+rebalanceImpl()
+{
+    for (auto & slice: slices) {
+        std::unique_lock<SliceLock> sliceGuard(slice->lock);
+
+        for (auto & it: slice->accounts) {
+            SliceAccount & sliced = it.second;
+            AccountEntry & account = getAccountImpl(it.first);
+
+            account.checkInvariants();
+
+            // The chunk was committed when the slice took it: what was
+            // spent and what is left retire that commitment
+            account.spent += sliced.spent;
+            account.commitmentsRetired += sliced.spent;
+            account.commitmentsRetired += sliced.available;
+            account.balance += sliced.available;
+            account.lineItems += sliced.lineItems;
+            account.attachedBids += sliced.attachedBids;
+            account.detachedBids += sliced.detachedBids;
+
+            account.checkInvariants();
+
+            sliced.available = Amount(sliced.available.currencyCode, 0);
+            sliced.spent.clear();
+            sliced.lineItems.clear();
+            sliced.attachedBids = sliced.detachedBids = 0;
+        }
+    }
+}
+
+
 /*****************************************************************************/
 /* ACCOUNTS                                                                  */
 /*****************************************************************************/
 
+Accounts::
+Accounts(const Accounts & other)
+{
+    ExclusiveGuard guard(other.mapLock);
+
+    sessionStart = other.sessionStart;
+    accounts = other.accounts;
+    outOfSyncAccounts = other.outOfSyncAccounts;
+    inconsistentAccounts = other.inconsistentAccounts;
+    for (unsigned i = 0;  i < NumTreeLocks;  ++i)
+        dirtyTrees[i] = other.dirtyTrees[i];
+}
+
+Accounts &
+Accounts::
+operator = (const Accounts & other)
+{
+    if (&other == this)
+        return *this;
+
+    // Copied first so that we never hold both of the locks
+    Accounts copy(other);
+
+    ExclusiveGuard guard(mapLock);
+
+    sessionStart = copy.sessionStart;
+    accounts.swap(copy.accounts);
+    outOfSyncAccounts.swap(copy.outOfSyncAccounts);
+    inconsistentAccounts.swap(copy.inconsistentAccounts);
+    for (unsigned i = 0;  i < NumTreeLocks;  ++i)
+        dirtyTrees[i].swap(copy.dirtyTrees[i]);
+
+    return *this;
+}
+
+Accounts
+Accounts::
+takeDirtyAccounts()
+{
+    Accounts result;
+    result.sessionStart = sessionStart;
+
+    for (unsigned i = 0;  i < NumTreeLocks;  ++i) {
+        SharedGuard mapGuard(mapLock);
+        Guard treeGuard(treeLocks[i]);
+
+        for (const string & root: dirtyTrees[i])
+            copyTree(AccountKey({ root }), result);
+        dirtyTrees[i].clear();
+    }
+
+    return result;
+}
+
+void
+Accounts::
+copyTree(const AccountKey & key, Accounts & result) const
+{
+    auto it = accounts.find(key);
+    if (it == accounts.end())
+        return;
+
+    result.accounts[key] = it->second;
+    if (outOfSyncAccounts.count(key))
+        result.outOfSyncAccounts.insert(key);
+
+    for (const AccountKey & child: it->second.children)
+        copyTree(child, result);
+}
+
+void
+Accounts::
+markDirty(const Accounts & other)
+{
+    // Collected first so that we never hold both of the locks
+    vector<AccountKey> roots;
+    {
+        SharedGuard guard(other.mapLock);
+        for (const auto & it: other.accounts) {
+            if (it.first.size() == 1)
+                roots.push_back(it.first);
+        }
+    }
+
+    for (const AccountKey & root: roots) {
+        TreeGuard guard(*this, root);
+        markTreeDirty(root);
+    }
+}
+
 void
 Accounts::
 ensureInterAccountConsistency()
 {
-    Guard guard(lock);
+    ExclusiveGuard guard(mapLock);
 
     for (const auto & it: accounts) {
         if (it.first.size() == 1) {
@@ -414,7 +825,7 @@ Accounts::
 checkBudgetConsistency(const AccountKey & accountKey, int maxRecursion)
     const
 {
-    Guard guard(lock);
+    TreeGuard guard(*this, accountKey);
 
     ExcAssertEqual(accountKey.size(), 1);
 
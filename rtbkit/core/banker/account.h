@@ -18,6 +18,9 @@
 #include <mutex>
 #include <thread>
 #include "jml/arch/spinlock.h"
+#include "jml/arch/rwlock.h"
+#include "jml/arch/huge_page_pool.h"
+#include <boost/thread/locks.hpp>
 
 namespace Datacratic {
     struct EventRecorder;
@@ -672,15 +675,22 @@ struct ShadowAccount {
 
     void syncFromMaster(const Account & masterAccount)
     {
-        checkInvariants();
         masterAccount.checkInvariants();
+        syncFromMaster(masterAccount.getNetBudget(), masterAccount.status);
+    }
+
+    /** Same as above with only what we need from the master account. */
+    void syncFromMaster(const CurrencyPool & masterNetBudget,
+                        Account::Status masterStatus)
+    {
+        checkInvariants();
 
         // net budget: balance assuming spent, commitments are zero
-        netBudget = masterAccount.getNetBudget();
+        netBudget = masterNetBudget;
         balance = netBudget + commitmentsRetired
             - commitmentsMade - spent;
 
-        status = masterAccount.status;
+        status = masterStatus;
         checkInvariants();
     }
 
@@ -836,6 +846,9 @@ struct Accounts {
     {
     }
 
+    Accounts(const Accounts & other);
+    Accounts & operator = (const Accounts & other);
+
     Datacratic::Date sessionStart;
 
     struct AccountInfo: public Account {
@@ -848,7 +861,7 @@ struct Accounts {
     const Account createAccount(const AccountKey & account,
                                 AccountType type)
     {
-        Guard guard(lock);
+        ExclusiveGuard guard(mapLock);
         if (account.empty())
             throw ML::Exception("can't create account with empty key");
         return ensureAccount(account, type);
@@ -857,7 +870,7 @@ struct Accounts {
     void restoreAccount(const AccountKey & accountKey,
                         const Json::Value & jsonValue,
                         bool overwrite = false) {
-        Guard guard(lock);
+        ExclusiveGuard guard(mapLock);
 
         // if (accounts.count(accountKey) != 0 and !overwrite) {
         //     throw ML::Exception("an account already exists with that name");
@@ -886,7 +899,7 @@ struct Accounts {
 
     void reactivateAccount(const AccountKey & accountKey)
     {
-        Guard guard(lock);
+        TreeGuard guard(*this, accountKey);
         AccountKey parents = accountKey;
         while (!parents.empty()) {
             getAccountImpl(parents).status = Account::ACTIVE;
@@ -897,7 +910,7 @@ struct Accounts {
 
     const Account createBudgetAccount(const AccountKey & account)
     {
-        Guard guard(lock);
+        ExclusiveGuard guard(mapLock);
         if (account.empty())
             throw ML::Exception("can't create account with empty key");
         return ensureAccount(account, AT_BUDGET);
@@ -905,7 +918,7 @@ struct Accounts {
 
     const Account createSpendAccount(const AccountKey & account)
     {
-        Guard guard(lock);
+        ExclusiveGuard guard(mapLock);
         if (account.size() < 2)
             throw ML::Exception("commitment account must have parent");
         return ensureAccount(account, AT_SPEND);
@@ -913,13 +926,13 @@ struct Accounts {
 
     const AccountInfo getAccount(const AccountKey & account) const
     {
-        Guard guard(lock);
+        TreeGuard guard(*this, account);
         return getAccountImpl(account);
     }
 
     std::pair<bool, bool> accountPresentAndActive(const AccountKey & account) const
     {
-        Guard guard(lock);
+        TreeGuard guard(*this, account);
         return accountPresentAndActiveImpl(account);
     }
     
@@ -929,13 +942,13 @@ struct Accounts {
     */
     const Account closeAccount(const AccountKey & account)
     {
-        Guard guard(lock);
+        TreeGuard guard(*this, account);
         return closeAccountImpl(account);
     }
 
     void checkInvariants() const
     {
-        Guard guard(lock);
+        ExclusiveGuard guard(mapLock);
         for (auto & a: accounts) {
             a.second.checkInvariants();
         }
@@ -945,7 +958,7 @@ struct Accounts {
     {
         Json::Value result(Json::objectValue);
 
-        Guard guard(lock);
+        ExclusiveGuard guard(mapLock);
         for (auto & a: accounts) {
             result[a.first.toString()] = a.second.toJson();
         }
@@ -967,9 +980,21 @@ struct Accounts {
         using namespace std;
         //cerr << "setBudget with newBudget " << newBudget << endl;
 
-        Guard guard(lock);
         if (topLevelAccount.size() != 1)
             throw ML::Exception("can't setBudget except at top level");
+
+        {
+            TreeGuard guard(*this, topLevelAccount);
+            auto it = accounts.find(topLevelAccount);
+            if (it != accounts.end()) {
+                ExcAssertEqual(it->second.type, AT_BUDGET);
+                markTreeDirty(topLevelAccount);
+                it->second.setBudget(newBudget);
+                return it->second;
+            }
+        }
+
+        ExclusiveGuard guard(mapLock);
         auto & a = ensureAccount(topLevelAccount, AT_BUDGET);
         a.setBudget(newBudget);
         return a;
@@ -985,32 +1010,33 @@ struct Accounts {
                              CurrencyPool amount,
                              AccountType typeToCreate)
     {
-        Guard guard(lock);
-
-        if (typeToCreate != AT_NONE && !accounts.count(account)) {
-            auto & a = ensureAccount(account, typeToCreate);
-            a.setBalance(getParentAccount(account), amount);
-            return a;
-        }
-        else {
-            auto & a = getAccountImpl(account);
+        {
+            TreeGuard guard(*this, account);
+            if (typeToCreate == AT_NONE || accounts.count(account)) {
+                auto & a = getAccountImpl(account);
 
 #if 0
-            using namespace std;
-            if (a.type == AT_BUDGET)
-                cerr << Date::now()
-                     << " setBalance " << account << " " << " from " << a.balance
-                     << " to " << amount << endl;
+                using namespace std;
+                if (a.type == AT_BUDGET)
+                    cerr << Date::now()
+                         << " setBalance " << account << " " << " from " << a.balance
+                         << " to " << amount << endl;
 #endif
 
-            a.setBalance(getParentAccount(account), amount);
-            return a;
+                a.setBalance(getParentAccount(account), amount);
+                return a;
+            }
         }
+
+        ExclusiveGuard guard(mapLock);
+        auto & a = ensureAccount(account, typeToCreate);
+        a.setBalance(getParentAccount(account), amount);
+        return a;
     }
 
     const CurrencyPool getBalance(const AccountKey & account) const
     {
-        Guard guard(lock);
+        TreeGuard guard(*this, account);
         auto it = accounts.find(account);
         if (it == accounts.end())
             return CurrencyPool();
@@ -1020,7 +1046,7 @@ struct Accounts {
     const Account addAdjustment(const AccountKey & account,
                                 CurrencyPool amount)
     {
-        Guard guard(lock);
+        TreeGuard guard(*this, account);
 
         auto & a = getAccountImpl(account);
         a.addAdjustment(amount);
@@ -1040,14 +1066,14 @@ struct Accounts {
 
     void recuperate(const AccountKey & account)
     {
-        Guard guard(lock);
+        TreeGuard guard(*this, account);
         getAccountImpl(account).recuperateTo(getParentAccount(account));
     }
 
     AccountSummary getAccountSummary(const AccountKey & account,
                                      int maxDepth = -1) const
     {
-        Guard guard(lock);
+        TreeGuard guard(*this, account);
         return getAccountSummaryImpl(account, 0, maxDepth);
     }
 
@@ -1055,7 +1081,7 @@ struct Accounts {
     getAccountSummariesJson(bool simplified = false, int maxDepth = -1)
         const
     {
-        Guard guard(lock);
+        ExclusiveGuard guard(mapLock);
 
         Json::Value summaries;
 
@@ -1071,7 +1097,7 @@ struct Accounts {
     const Account importSpend(const AccountKey & account,
                               const CurrencyPool & amount)
     {
-        Guard guard(lock);
+        TreeGuard guard(*this, account);
         auto & a = getAccountImpl(account);
         a.importSpend(amount);
         return a;
@@ -1092,15 +1118,20 @@ struct Accounts {
     const Account syncFromShadow(const AccountKey & account,
                                  const ShadowAccount & shadow)
     {
-        Guard guard(lock);
+        {
+            TreeGuard guard(*this, account);
+            auto it = accounts.find(account);
+            if (it != accounts.end()) {
+                markTreeDirty(account);
+                return shadow.syncToMaster(it->second);
+            }
+        }
 
         // In the case that an account was added and the banker crashed
         // before it could be written to persistent storage, we need to
         // create the empty account here.
-        if (!accounts.count(account))
-            return shadow.syncToMaster(ensureAccount(account, AT_SPEND));
-        
-        return shadow.syncToMaster(getAccountImpl(account));
+        ExclusiveGuard guard(mapLock);
+        return shadow.syncToMaster(ensureAccount(account, AT_SPEND));
     }
 
     /* "Out of sync" here means that the in-memory version of the relevant
@@ -1108,14 +1139,14 @@ struct Accounts {
        backend */
     void markAccountOutOfSync(const AccountKey & account)
     {
-        Guard guard(lock);
+        ExclusiveGuard guard(mapLock);
 
         outOfSyncAccounts.insert(account);
     }
 
     bool isAccountOutOfSync(const AccountKey & account) const
     {
-        Guard guard(lock);
+        SharedGuard guard(mapLock);
         
         return (outOfSyncAccounts.count(account) > 0);
     }
@@ -1130,7 +1161,7 @@ struct Accounts {
     void ensureInterAccountConsistency();
     bool isAccountInconsistent(const AccountKey & account) const
     {
-        Guard guard(lock);
+        SharedGuard guard(mapLock);
         
         return (inconsistentAccounts.count(account) > 0);
     }
@@ -1144,6 +1175,17 @@ struct Accounts {
 
     /* Returns the amounts in recycledIn and recycledOut that were transferred
      * strictly from and to the parent account. */
+    /** Return a copy of the trees of accounts that were modified since the
+        last call, which are from then on considered clean.  Each tree is
+        copied under its own lock; as transfers never leave a tree, the copy
+        is consistent without stopping the operations on the other trees.
+    */
+    Accounts takeDirtyAccounts();
+
+    /** Mark the trees of the given accounts as modified again, typically
+        because persisting them failed. */
+    void markDirty(const Accounts & accounts);
+
     void getRecycledUp(const AccountKey & accountKey,
                        CurrencyPool & recycledInUp,
                        CurrencyPool & recycledOutUp) const;
@@ -1153,21 +1195,73 @@ private:
 
     typedef ML::Spinlock Lock;
     typedef std::unique_lock<Lock> Guard;
-    mutable Lock lock;
 
-    typedef std::map<AccountKey, AccountInfo> AccountMap;
+    /* The map of accounts is held shared by the operations on accounts that
+       already exist, and exclusively to add accounts or to go through all of
+       them.  As the transfers never leave the tree of a top level account,
+       the accounts themselves are protected by the lock of the stripe that
+       their top level account hashes to, so that the operations on
+       different campaigns run in parallel. */
+    typedef ML::RWLock MapLock;
+    typedef boost::shared_lock<MapLock> SharedGuard;
+    typedef std::unique_lock<MapLock> ExclusiveGuard;
+    mutable MapLock mapLock;
+
+    enum { NumTreeLocks = 64 };
+    mutable Lock treeLocks[NumTreeLocks];
+
+    static unsigned treeIndex(const AccountKey & account)
+    {
+        if (account.empty())
+            return 0;
+        return std::hash<std::string>()(account[0]) % NumTreeLocks;
+    }
+
+    Lock & treeLock(const AccountKey & account) const
+    {
+        return treeLocks[treeIndex(account)];
+    }
+
+    /** Lets through the operations on accounts of other trees. */
+    struct TreeGuard {
+        TreeGuard(const Accounts & accounts, const AccountKey & account)
+            : map(accounts.mapLock), tree(accounts.treeLock(account))
+        {
+        }
+
+        SharedGuard map;
+        Guard tree;
+    };
+
+    typedef std::map<AccountKey, AccountInfo, std::less<AccountKey>,
+                     ML::Huge_Page_Allocator<
+                         std::pair<const AccountKey, AccountInfo> > >
+        AccountMap;
     AccountMap accounts;
 
     typedef std::unordered_set<AccountKey> AccountSet;
     AccountSet outOfSyncAccounts;
     AccountSet inconsistentAccounts;
 
+    /* Top level accounts of the trees modified since the last call to
+       takeDirtyAccounts(), protected like the trees themselves by the lock
+       of their stripe. */
+    std::unordered_set<std::string> dirtyTrees[NumTreeLocks];
+
+    void markTreeDirty(const AccountKey & account)
+    {
+        if (!account.empty())
+            dirtyTrees[treeIndex(account)].insert(account[0]);
+    }
+
+    void copyTree(const AccountKey & root, Accounts & result) const;
+
 public:
     std::vector<AccountKey>
     getAccountKeys(const AccountKey & prefix = AccountKey(),
                    int maxDepth = -1) const
     {
-        Guard guard(lock);
+        SharedGuard guard(mapLock);
 
         std::vector<AccountKey> result;
 
@@ -1184,7 +1278,7 @@ public:
                                              const Account &)>
                    & onAccount) const
     {
-        Guard guard(lock);
+        ExclusiveGuard guard(mapLock);
         
         for (auto & a: accounts) {
             onAccount(a.first, a.second);
@@ -1193,13 +1287,13 @@ public:
                         
     size_t size() const
     {
-        Guard guard(lock);
+        SharedGuard guard(mapLock);
         return accounts.size();
     }
 
     bool empty() const
     {
-        Guard guard(lock);
+        SharedGuard guard(mapLock);
         return accounts.empty();
     }
 
@@ -1207,7 +1301,7 @@ public:
     Accounts getAccounts(const AccountKey & root, int maxDepth = 0)
     {
         Accounts result;
-        Guard guard(lock);
+        TreeGuard guard(*this, root);
 
         std::function<void (const AccountKey &, int, int)> doAccount
             = [&] (const AccountKey & key, int depth, int maxDepth)
@@ -1236,6 +1330,8 @@ private:
     {
         ExcAssertGreaterEqual(accountKey.size(), 1);
 
+        markTreeDirty(accountKey);
+
         auto it = accounts.find(accountKey);
         if (it != accounts.end()) {
             ExcAssertEqual(it->second.type, type);
@@ -1262,6 +1358,7 @@ private:
         auto it = accounts.find(account);
         if (it == accounts.end())
             throw ML::Exception("couldn't get account: " + account.toString());
+        markTreeDirty(account);
         return it->second;
     }
 
@@ -1343,10 +1440,17 @@ private:
 
         result.account = a;
         result.spent = a.spent;
-        result.budget = a.budgetIncreases - a.budgetDecreases;
-        result.effectiveBudget = a.budgetIncreases - a.budgetDecreases 
-                        + a.recycledIn - a.recycledOut
-                        + a.allocatedIn - a.allocatedOut;
+        CurrencyAccumulator budget;
+        budget += a.budgetIncreases;
+        budget -= a.budgetDecreases;
+        result.budget = budget.pool();
+
+        budget += a.recycledIn;
+        budget -= a.recycledOut;
+        budget += a.allocatedIn;
+        budget -= a.allocatedOut;
+        result.effectiveBudget = budget.pool();
+
         result.inFlight = a.commitmentsMade - a.commitmentsRetired;
         result.adjustments = a.adjustmentsIn - a.adjustmentsOut;
 
@@ -1370,6 +1474,40 @@ private:
 };
 
 
+/*****************************************************************************/
+/* BID COMMIT                                                                */
+/*****************************************************************************/
+
+/** One of the bid settlements that are applied together by
+    ShadowAccounts::commitBids() and Banker::commitBids().
+*/
+
+struct BidCommit {
+    enum Type {
+        COMMIT,         ///< commitBid()
+        WIN,            ///< winBid()
+        CANCEL,         ///< cancelBid(); nothing is paid
+        FORCE_WIN       ///< forceWinBid(); there is no item
+    };
+
+    BidCommit(Type type = COMMIT,
+              AccountKey account = AccountKey(),
+              std::string item = "",
+              Amount amountPaid = Amount(),
+              LineItems lineItems = LineItems())
+        : type(type), account(std::move(account)), item(std::move(item)),
+          amountPaid(amountPaid), lineItems(std::move(lineItems))
+    {
+    }
+
+    Type type;
+    AccountKey account;
+    std::string item;
+    Amount amountPaid;
+    LineItems lineItems;
+};
+
+
 /*****************************************************************************/
 /* SHADOW ACCOUNTS                                                           */
 /*****************************************************************************/
@@ -1383,18 +1521,33 @@ struct ShadowAccounts {
     
     const ShadowAccount activateAccount(const AccountKey & account)
     {
-        Guard guard(lock);
-        return getAccountImpl(account);
+        return withAccount(account, [] (AccountEntry & a) -> ShadowAccount
+                           {
+                               return a;
+                           });
     }
 
     const ShadowAccount syncFromMaster(const AccountKey & account,
                                        const Account & master)
     {
-        Guard guard(lock);
-        auto & a = getAccountImpl(account);
-        ExcAssert(!a.uninitialized);
-        a.syncFromMaster(master);
-        return a;
+        return withAccount(account, [&] (AccountEntry & a) -> ShadowAccount
+                           {
+                               ExcAssert(!a.uninitialized);
+                               a.syncFromMaster(master);
+                               return a;
+                           });
+    }
+
+    const ShadowAccount syncFromMaster(const AccountKey & account,
+                                       const CurrencyPool & netBudget,
+                                       Account::Status status)
+    {
+        return withAccount(account, [&] (AccountEntry & a) -> ShadowAccount
+                           {
+                               ExcAssert(!a.uninitialized);
+                               a.syncFromMaster(netBudget, status);
+                               return a;
+                           });
     }
 
     /** Initialize an account by merging with the initial state as
@@ -1404,17 +1557,18 @@ struct ShadowAccounts {
     initializeAndMergeState(const AccountKey & account,
                             const Account & master)
     {
-        Guard guard(lock);
-        auto & a = getAccountImpl(account);
-        ExcAssert(a.uninitialized);
-        a.initializeAndMergeState(master);
-        a.uninitialized = false;
-        return a;
+        return withAccount(account, [&] (AccountEntry & a) -> ShadowAccount
+                           {
+                               ExcAssert(a.uninitialized);
+                               a.initializeAndMergeState(master);
+                               a.uninitialized = false;
+                               return a;
+                           });
     }
 
     void checkInvariants() const
     {
-        Guard guard(lock);
+        ExclusiveGuard guard(mapLock);
         for (auto & a: accounts) {
             a.second.checkInvariants();
         }
@@ -1422,19 +1576,21 @@ struct ShadowAccounts {
 
     const ShadowAccount getAccount(const AccountKey & accountKey) const
     {
-        Guard guard(lock);
-        return getAccountImpl(accountKey);
+        SharedGuard guard(mapLock);
+        auto & a = getAccountImpl(accountKey);
+        Guard entryGuard(a.lock);
+        return a;
     }
 
     bool accountExists(const AccountKey & accountKey) const
     {
-        Guard guard(lock);
+        SharedGuard guard(mapLock);
         return accounts.count(accountKey);
     }
 
     bool createAccountAtomic(const AccountKey & accountKey)
     {
-    	Guard guard(lock);
+    	ExclusiveGuard guard(mapLock);
 
     	AccountEntry & account = getAccountImpl(accountKey, false /* call onCreate */);
     	bool result = account.first;
@@ -1451,8 +1607,8 @@ struct ShadowAccounts {
 
     void syncTo(Accounts & master) const
     {
-        Guard guard1(lock);
-        Guard guard2(master.lock);
+        ExclusiveGuard guard1(mapLock);
+        Accounts::ExclusiveGuard guard2(master.mapLock);
 
         for (auto & a: accounts)
             a.second.syncToMaster(master.getAccountImpl(a.first));
@@ -1460,21 +1616,25 @@ struct ShadowAccounts {
 
     void syncFrom(const Accounts & master)
     {
-        Guard guard1(lock);
-        Guard guard2(master.lock);
+        ExclusiveGuard guard1(mapLock);
+        Accounts::ExclusiveGuard guard2(master.mapLock);
+
+        rebalanceImpl();
 
         for (auto & a: accounts) {
             a.second.syncFromMaster(master.getAccountImpl(a.first));
             if (master.outOfSyncAccounts.count(a.first) > 0) {
-                outOfSyncAccounts.insert(a.first);
+                a.second.outOfSync = true;
             }
         }
     }
 
     void sync(Accounts & master)
     {
-        Guard guard1(lock);
-        Guard guard2(master.lock);
+        ExclusiveGuard guard1(mapLock);
+        Accounts::ExclusiveGuard guard2(master.mapLock);
+
+        rebalanceImpl();
 
         for (auto & a: accounts) {
             a.second.syncToMaster(master.getAccountImpl(a.first));
@@ -1484,24 +1644,28 @@ struct ShadowAccounts {
 
     bool isInitialized(const AccountKey & accountKey) const
     {
-        Guard guard(lock);
-        return !getAccountImpl(accountKey).uninitialized;
+        SharedGuard guard(mapLock);
+        auto & account = getAccountImpl(accountKey);
+        Guard entryGuard(account.lock);
+        return !account.uninitialized;
     }
 
     bool isStalled(const AccountKey & accountKey) const
     {
-        Guard guard(lock);
+        SharedGuard guard(mapLock);
         auto & account = getAccountImpl(accountKey);
+        Guard entryGuard(account.lock);
         return account.uninitialized && account.requested.minutesUntil(Date::now()) >= 1.0;
     }
 
     void reinitializeStalledAccount(const AccountKey & accountKey)
     {
         ExcAssert(isStalled(accountKey));
-        Guard guard(lock);
-        auto & account = getAccountImpl(accountKey);
-        account.first = true;
-        account.requested = Date::now();
+        withAccount(accountKey, [] (AccountEntry & account)
+                    {
+                        account.first = true;
+                        account.requested = Date::now();
+                    });
     }
 
     /*************************************************************************/
@@ -1512,9 +1676,31 @@ struct ShadowAccounts {
                       const std::string & item,
                       Amount amount)
     {
-        Guard guard(lock);
-        return (outOfSyncAccounts.count(accountKey) == 0
-                && getAccountImpl(accountKey).authorizeBid(item, amount));
+        if (!slices.empty())
+            return authorizeSlicedBid(accountKey, item, amount);
+
+        return withAccount(accountKey, [&] (AccountEntry & account)
+                           {
+                               return (!account.outOfSync
+                                       && account.authorizeBid(item, amount));
+                           });
+    }
+
+    /** Same as above, for an account key interned with
+        AccountKeyRegistry::intern(); the account is found by index. */
+    bool authorizeBid(AccountHandle handle,
+                      const std::string & item,
+                      Amount amount)
+    {
+        if (!slices.empty())
+            return authorizeSlicedBid(AccountKeyRegistry::key(handle),
+                                      item, amount);
+
+        return withAccount(handle, [&] (AccountEntry & account)
+                           {
+                               return (!account.outOfSync
+                                       && account.authorizeBid(item, amount));
+                           });
     }
     
     void commitBid(const AccountKey & accountKey,
@@ -1522,23 +1708,51 @@ struct ShadowAccounts {
                    Amount amountPaid,
                    const LineItems & lineItems)
     {
-        Guard guard(lock);
-        return getAccountImpl(accountKey).commitBid(item, amountPaid, lineItems);
+        if (!slices.empty()
+            && commitSlicedBid(accountKey, item, amountPaid, lineItems))
+            return;
+
+        withAccount(accountKey, [&] (AccountEntry & account)
+                    {
+                        account.commitBid(item, amountPaid, lineItems);
+                    });
     }
 
     void cancelBid(const AccountKey & accountKey,
                    const std::string & item)
     {
-        Guard guard(lock);
-        return getAccountImpl(accountKey).cancelBid(item);
+        if (!slices.empty()
+            && commitSlicedBid(accountKey, item, Amount(), LineItems()))
+            return;
+
+        withAccount(accountKey, [&] (AccountEntry & account)
+                    {
+                        account.cancelBid(item);
+                    });
+    }
+
+    void cancelBid(AccountHandle handle,
+                   const std::string & item)
+    {
+        if (!slices.empty()
+            && commitSlicedBid(AccountKeyRegistry::key(handle), item,
+                               Amount(), LineItems()))
+            return;
+
+        withAccount(handle, [&] (AccountEntry & account)
+                    {
+                        account.cancelBid(item);
+                    });
     }
     
     void forceWinBid(const AccountKey & accountKey,
                      Amount amountPaid,
                      const LineItems & lineItems)
     {
-        Guard guard(lock);
-        return getAccountImpl(accountKey).forceWinBid(amountPaid, lineItems);
+        withAccount(accountKey, [&] (AccountEntry & account)
+                    {
+                        account.forceWinBid(amountPaid, lineItems);
+                    });
     }
 
     /// Commit a bid that has been detached from its tracking
@@ -1547,40 +1761,169 @@ struct ShadowAccounts {
                            Amount amountPaid,
                            const LineItems & lineItems)
     {
-        Guard guard(lock);
-        return getAccountImpl(accountKey)
-            .commitDetachedBid(amountAuthorized, amountPaid, lineItems);
+        withAccount(accountKey, [&] (AccountEntry & account)
+                    {
+                        account.commitDetachedBid(amountAuthorized, amountPaid,
+                                                  lineItems);
+                    });
     }
 
     /// Commit a specific currency (amountToCommit)
     void commitEvent(const AccountKey & accountKey, const Amount & amountToCommit)
     {
-        Guard guard(lock);
-        return getAccountImpl(accountKey).commitEvent(amountToCommit);
+        withAccount(accountKey, [&] (AccountEntry & account)
+                    {
+                        account.commitEvent(amountToCommit);
+                    });
     }
 
     Amount detachBid(const AccountKey & accountKey,
                      const std::string & item)
     {
-        Guard guard(lock);
-        return getAccountImpl(accountKey).detachBid(item);
+        Amount amountAuthorized;
+        if (!slices.empty()
+            && detachSlicedBid(accountKey, item, amountAuthorized))
+            return amountAuthorized;
+
+        return withAccount(accountKey, [&] (AccountEntry & account)
+                           {
+                               return account.detachBid(item);
+                           });
+    }
+
+    Amount detachBid(AccountHandle handle,
+                     const std::string & item)
+    {
+        Amount amountAuthorized;
+        if (!slices.empty()
+            && detachSlicedBid(AccountKeyRegistry::key(handle), item,
+                               amountAuthorized))
+            return amountAuthorized;
+
+        return withAccount(handle, [&] (AccountEntry & account)
+                           {
+                               return account.detachBid(item);
+                           });
     }
 
     void attachBid(const AccountKey & accountKey,
                    const std::string & item,
                    Amount amountAuthorized)
     {
-        Guard guard(lock);
-        getAccountImpl(accountKey).attachBid(item, amountAuthorized);
+        withAccount(accountKey, [&] (AccountEntry & account)
+                    {
+                        account.attachBid(item, amountAuthorized);
+                    });
     }
 
+    /** Apply all of the commits, taking the lock of each account only once
+        for all of its commits.  The commits of an account are applied in
+        the order given.  A commit that fails doesn't stop the others; the
+        first exception is rethrown once they have all been applied.
+    */
+    void commitBids(const std::vector<BidCommit> & commits);
+
     void logBidEvents(const Datacratic::EventRecorder & eventRecorder);
 
+    /*************************************************************************/
+    /* BUDGET SLICES                                                         */
+    /*************************************************************************/
+
+    /** Split the budget of the accounts into numSlices slices, each used by
+        the threads whose index falls on it, so that threads bidding on the
+        same account don't contend on the lock of the accounts.
+
+        A slice takes a chunk of the balance of an account when it runs out
+        and keeps its own commitments; rebalance() folds what it spent back
+        into the account and returns what it didn't commit.  Must be called
+        before the accounts are used.  0 or 1 slices disables it.
+    */
+    void enableSlices(unsigned numSlices);
+
+    /** Fold the slices into their accounts.  Called when the accounts are
+        synchronized with the master banker. */
+    void rebalance();
+
 private:
+    /** Part of the budget of an account that belongs to a slice. */
+    struct SliceAccount {
+        SliceAccount()
+            : attachedBids(0), detachedBids(0)
+        {
+        }
+
+        Amount available;       ///< Taken from the account; not committed
+        CurrencyPool spent;     ///< Paid for bids committed from the slice
+        LineItems lineItems;
+        std::unordered_map<std::string, ShadowAccount::Commitment> commitments;
+        uint32_t attachedBids;
+        uint32_t detachedBids;
+
+        /** Authorize from what the slice has left. */
+        bool authorize(const std::string & item, Amount amount);
+    };
+
+    typedef ML::Spinlock SliceLock;
+
+    /** Only the threads using the slice take its lock, and the rebalancing
+        every once in a while, so it is not contended. */
+    struct Slice {
+        mutable SliceLock lock;
+        std::unordered_map<AccountKey, SliceAccount> accounts;
+    };
+
+    std::vector<std::unique_ptr<Slice> > slices;
+
+    Slice & currentSlice();
+
+    bool authorizeSlicedBid(const AccountKey & accountKey,
+                            const std::string & item,
+                            Amount amount);
+
+    struct AccountEntry;
+
+    /** Take a new chunk of the account's balance into the slice, and
+        authorize the bid from it.  Called with the account locked. */
+    bool refillSlice(AccountEntry & account, Slice & slice,
+                     const AccountKey & accountKey,
+                     const std::string & item,
+                     Amount amount);
+
+    /** Commit a bid authorized from a slice; false if no slice has it. */
+    bool commitSlicedBid(const AccountKey & accountKey,
+                         const std::string & item,
+                         Amount amountPaid,
+                         const LineItems & lineItems);
+
+    bool detachSlicedBid(const AccountKey & accountKey,
+                         const std::string & item,
+                         Amount & amountAuthorized);
+
+    /** Find the slice that has the commitment, and lock it. */
+    Slice * findCommitment(const AccountKey & accountKey,
+                           const std::string & item,
+                           std::unique_lock<SliceLock> & guard);
+
+    /** Must be called with the lock held. */
+    void rebalanceImpl();
+
+
+    typedef ML::Spinlock Lock;
+    typedef std::unique_lock<Lock> Guard;
+
+    /* The map of accounts is held shared by the operations on accounts that
+       already exist, and exclusively to add accounts or to go through all of
+       them; each account has its own lock, so that the bids on different
+       accounts don't wait on each other. */
+    typedef ML::RWLock MapLock;
+    typedef boost::shared_lock<MapLock> SharedGuard;
+    typedef std::unique_lock<MapLock> ExclusiveGuard;
+    mutable MapLock mapLock;
 
     struct AccountEntry : public ShadowAccount {
         AccountEntry(bool uninitialized = true, bool first = true)
-            : requested(Date::now()), uninitialized(uninitialized), first(first)
+            : requested(Date::now()), uninitialized(uninitialized), first(first),
+              outOfSync(false)
         {
         }
 
@@ -1598,8 +1941,55 @@ private:
         Date requested;
         bool uninitialized;
         bool first;
+
+        /** The master banker has this account marked out of sync with its
+            storage; no more bids are authorized on it. */
+        bool outOfSync;
+
+        mutable Lock lock;  ///< Held by the operations on this account
     };
 
+    /** Call fn with the entry of the account locked, creating the entry if
+        it doesn't exist yet. */
+    template<typename Fn>
+    auto withAccount(const AccountKey & account, Fn fn)
+        -> decltype(fn(std::declval<AccountEntry &>()))
+    {
+        {
+            SharedGuard guard(mapLock);
+            auto it = accounts.find(account);
+            if (it != accounts.end()) {
+                Guard entryGuard(it->second.lock);
+                return fn(it->second);
+            }
+        }
+
+        ExclusiveGuard guard(mapLock);
+        return fn(getAccountImpl(account));
+    }
+
+    /** Same as above, for an interned account key. */
+    template<typename Fn>
+    auto withAccount(AccountHandle handle, Fn fn)
+        -> decltype(fn(std::declval<AccountEntry &>()))
+    {
+        {
+            SharedGuard guard(mapLock);
+            if (handle < byHandle.size() && byHandle[handle]) {
+                AccountEntry & entry = *byHandle[handle];
+                Guard entryGuard(entry.lock);
+                return fn(entry);
+            }
+        }
+
+        ExclusiveGuard guard(mapLock);
+        AccountEntry & entry = getAccountImpl(AccountKeyRegistry::key(handle));
+        if (handle >= byHandle.size())
+            byHandle.resize(handle + 1);
+        byHandle[handle] = &entry;
+        return fn(entry);
+    }
+
     AccountEntry & getAccountImpl(const AccountKey & account,
                                   bool callOnNewAccount = true)
     {
@@ -1621,21 +2011,21 @@ private:
         return it->second;
     }
 
-    typedef ML::Spinlock Lock;
-    typedef std::unique_lock<Lock> Guard;
-    mutable Lock lock;
-
-    typedef std::map<AccountKey, AccountEntry> AccountMap;
+    typedef std::map<AccountKey, AccountEntry, std::less<AccountKey>,
+                     ML::Huge_Page_Allocator<
+                         std::pair<const AccountKey, AccountEntry> > >
+        AccountMap;
     AccountMap accounts;
 
-    typedef std::unordered_set<AccountKey> AccountSet;
-    AccountSet outOfSyncAccounts;
+    /* Entries of the accounts that were used through their handle, indexed
+       by it.  The entries of the map never move, and are never removed. */
+    std::vector<AccountEntry *> byHandle;
 
 public:
     std::vector<AccountKey>
     getAccountKeys(const AccountKey & prefix = AccountKey()) const
     {
-        Guard guard(lock);
+        SharedGuard guard(mapLock);
 
         std::vector<AccountKey> result;
 
@@ -1651,18 +2041,31 @@ public:
                                              const ShadowAccount &)> &
                    onAccount) const
     {
-        Guard guard(lock);
+        ExclusiveGuard guard(mapLock);
         
         for (auto & a: accounts) {
             onAccount(a.first, a.second);
         }
     }
 
+    void
+    forEachInitializedAccount(const std::function<void (const AccountKey &,
+                                                        const ShadowAccount &)> & onAccount)
+    {
+        ExclusiveGuard guard(mapLock);
+
+        for (auto & a: accounts) {
+            if (a.second.uninitialized)
+                continue;
+            onAccount(a.first, a.second);
+        }
+    }
+
     void
     forEachInitializedAndActiveAccount(const std::function<void (const AccountKey &,
                                                         const ShadowAccount &)> & onAccount)
     {
-        Guard guard(lock);
+        ExclusiveGuard guard(mapLock);
         
         for (auto & a: accounts) {
             if (a.second.uninitialized || a.second.status == Account::CLOSED)
@@ -1673,13 +2076,13 @@ public:
 
     size_t size() const
     {
-        Guard guard(lock);
+        SharedGuard guard(mapLock);
         return accounts.size();
     }
 
     bool empty() const
     {
-        Guard guard(lock);
+        SharedGuard guard(mapLock);
         return accounts.empty();
     }
 };
@@ -357,4 +357,18 @@ budgetResultCallback(const BudgetController::OnBudgetResult &onResult)
     };
 }
 
+
+/*****************************************************************************/
+/* LOCAL LAYER                                                               */
+/*****************************************************************************/
+
+void
+LocalLayer::
+init(RestServiceEndpoint * banker)
+{
+    proxy.reset(new RestProxy());
+    proxy->initLocal(banker, "masterBanker");
+    addSource("LocalLayer::proxy", proxy);
+}
+
 } // namespace RTBKIT
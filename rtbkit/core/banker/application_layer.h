@@ -6,7 +6,8 @@
    for the master banker.
 
    Currently, the SlaveBanker can talk to the MasterBanker eiter via HTTP through
-   the HttpLayer or zeromq via the ZmqLayer
+   the HttpLayer, zeromq via the ZmqLayer or, when they are in the same process,
+   directly via the LocalLayer
 
    Note that the ZmqLayer will discover the MasterBanker zmq endpoint via the
    ConfigurationService (most of the time ZooKeeper).
@@ -176,13 +177,25 @@ struct ZmqLayer : public ApplicationLayer {
                const RestParams &params,
                const std::string &content,
                OnRequestResult onResult);
-private:
+protected:
     std::shared_ptr<RestProxy> proxy;
 
     static RestProxy::OnDone
     budgetResultCallback(const BudgetController::OnBudgetResult & onResult);
 };
 
+/*****************************************************************************/
+/* LOCAL LAYER                                                               */
+/*****************************************************************************/
+
+/** Speaks the same protocol as the ZmqLayer but hands the requests straight
+    to a MasterBanker living in the same process, which saves the zeromq
+    round trip and the serialization of the messages.
+ */
+struct LocalLayer : public ZmqLayer {
+    void init(RestServiceEndpoint * banker);
+};
+
 template<typename Layer, typename... Args>
 std::shared_ptr<Layer> make_application_layer(Args&& ...args)
 {
@@ -273,6 +273,40 @@ addSpendAccount(const AccountKey & account, CurrencyPool accountFloat,
         onDone(p, std::move(res));
 }
 
+void
+Banker::
+commitBids(const std::vector<BidCommit> & commits)
+{
+    std::exception_ptr firstError;
+
+    for (auto & commit: commits) {
+        try {
+            switch (commit.type) {
+            case BidCommit::COMMIT:
+                commitBid(commit.account, commit.item,
+                          commit.amountPaid, commit.lineItems);
+                break;
+            case BidCommit::WIN:
+                winBid(commit.account, commit.item,
+                       commit.amountPaid, commit.lineItems);
+                break;
+            case BidCommit::CANCEL:
+                cancelBid(commit.account, commit.item);
+                break;
+            case BidCommit::FORCE_WIN:
+                forceWinBid(commit.account, commit.amountPaid, commit.lineItems);
+                break;
+            }
+        } catch (...) {
+            if (!firstError)
+                firstError = std::current_exception();
+        }
+    }
+
+    if (firstError)
+        std::rethrow_exception(firstError);
+}
+
 /*****************************************************************************/
 /* BANKER EXCEPTION                                                           */
 /*****************************************************************************/
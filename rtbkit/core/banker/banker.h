@@ -296,6 +296,17 @@ public:
                               const std::string & item,
                               Amount amount) = 0;
 
+    /** Same as above for an account key interned with
+        AccountKeyRegistry::intern().  Bankers that can find their accounts
+        by handle override it; by default the key is used.
+    */
+    virtual bool authorizeBid(AccountHandle account,
+                              const std::string & item,
+                              Amount amount)
+    {
+        return authorizeBid(AccountKeyRegistry::key(account), item, amount);
+    }
+
     /*
      * Cancel the bid that was previously authorized. If we fail to find the bid
      * we return false.Otherwise we return the bid amount to the available pool
@@ -310,6 +321,12 @@ public:
         return commitBid(account, item, Amount(), LineItems());
     }
 
+    virtual void cancelBid(AccountHandle account,
+                           const std::string & item)
+    {
+        return cancelBid(AccountKeyRegistry::key(account), item);
+    }
+
     virtual void winBid(const AccountKey & account,
                         const std::string & item,
                         Amount amountPaid,
@@ -325,6 +342,12 @@ public:
     virtual Amount detachBid(const AccountKey & account,
                              const std::string & item) = 0;
 
+    virtual Amount detachBid(AccountHandle account,
+                             const std::string & item)
+    {
+        return detachBid(AccountKeyRegistry::key(account), item);
+    }
+
     /** Commit a bid.  This is used internally to both cancel and win bids.
         Asynchonous and returns no value.
     */
@@ -342,6 +365,14 @@ public:
                              Amount amountPaid,
                              const LineItems & lineItems) = 0;
 
+    /** Apply many commits, cancels and wins at once, for callers that
+        settle bids in bursts.  Bankers that can apply them under fewer
+        locks override it; by default each one is applied on its own.  All
+        of the commits are applied even if some fail, and the first
+        exception is then rethrown.
+    */
+    virtual void commitBids(const std::vector<BidCommit> & commits);
+
     /*************************************************************************/
     /* INFORMATION                                                           */
     /*************************************************************************/
@@ -22,6 +22,8 @@ LocalBanker::LocalBanker(shared_ptr<ServiceProxies> services, GoAccountType type
           type(type),
           accountSuffix(accountSuffix),
           accountSuffixNoDot(accountSuffix),
+          syncPeriod(0),
+          maxSyncPeriods(8),
           spendRate(MicroUSD(100000)),
           syncRate(0.5),
           reauthRate(1.0),
@@ -30,6 +32,8 @@ LocalBanker::LocalBanker(shared_ptr<ServiceProxies> services, GoAccountType type
           reauthorizeSkipped(0),
           spendUpdateInProgress(false),
           spendUpdateSkipped(0),
+          bidCountsInProgress(false),
+          bidCountsSkipped(0),
           debug(false)
 {
     replace(accountSuffixNoDot.begin(), accountSuffixNoDot.end(), '.', '_');
@@ -91,6 +95,13 @@ LocalBanker::setDebug(bool debugSetting)
     debug = debugSetting;
 }
 
+void
+LocalBanker::setMaxSyncPeriods(unsigned maxPeriods)
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    maxSyncPeriods = std::max(maxPeriods, 1u);
+}
+
 void
 LocalBanker::start()
 {
@@ -239,7 +250,36 @@ LocalBanker::spendUpdate()
     const Date sentTime = Date::now();
     this->recordHit("spendUpdate.attempt");
 
-    auto onResponse = [&, sentTime] (const HttpRequest &req,
+    /* Only the accounts whose spend moved since the banker last took it
+       are sent, along with the idle ones that are due for a sync.  What
+       was sent is remembered once the banker acknowledges it.
+    */
+    struct Sent {
+        AccountKey key;
+        int64_t imp;
+        int64_t spend;
+    };
+    vector<Sent> sent;
+    Json::Value payload(Json::arrayValue);
+    {
+        std::lock_guard<std::mutex> guard(this->mutex);
+        ++syncPeriod;
+        for (auto & it : accounts.accounts) {
+            const GoPostAuctionAccount & pal = *it.second.pal;
+            Sent account { it.first, pal.imp, pal.spend.value };
+
+            SyncState & state = syncStates[it.first];
+            bool active = account.imp != state.imp
+                       || account.spend != state.spend;
+            if (!scheduleSync(state, active)) continue;
+
+            payload.append(it.second.toJson());
+            sent.push_back(account);
+        }
+    }
+    this->recordLevel(sent.size(), "spendUpdate.accounts");
+
+    auto onResponse = [&, sentTime, sent] (const HttpRequest &req,
             HttpClientError error,
             int status,
             string && headers,
@@ -256,6 +296,10 @@ LocalBanker::spendUpdate()
                  << "error:  " << error << endl
                  << "body:   " << body << endl;
             this->recordHit("spendUpdate.failure");
+            vector<AccountKey> keys;
+            for (auto & account : sent)
+                keys.push_back(account.key);
+            retrySync(keys);
         } else {
             Json::Value result;
             try {
@@ -266,6 +310,15 @@ LocalBanker::spendUpdate()
                 this->recordHit("spendUpdate.jsonParsingError");
                 return;
             }
+            {
+                std::lock_guard<std::mutex> guard(this->mutex);
+                for (auto & account : sent) {
+                    auto it = syncStates.find(account.key);
+                    if (it == syncStates.end()) continue;
+                    it->second.imp = account.imp;
+                    it->second.spend = account.spend;
+                }
+            }
             for ( auto it = result.begin(); it != result.end(); it++) {
                 string key = it.key().asString();
                 string value = (*it).asString();
@@ -283,13 +336,6 @@ LocalBanker::spendUpdate()
         }
     };
     auto const &cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
-    Json::Value payload(Json::arrayValue);
-    {
-        std::lock_guard<std::mutex> guard(this->mutex);
-        for (auto it : accounts.accounts) {
-            payload.append(it.second.toJson());
-        }
-    }
     httpClient->post("/spendupdate", cbs, payload, {}, {}, 1);
 }
 
@@ -310,7 +356,25 @@ LocalBanker::reauthorize()
     const Date sentTime = Date::now();
     this->recordHit("reauthorize.attempt");
 
-    auto onResponse = [&, sentTime] (const HttpRequest &req,
+    // The accounts that bid since their last reauthorization and the idle
+    // ones that are due for one.
+    vector<AccountKey> sent;
+    Json::Value payload(Json::arrayValue);
+    {
+        std::lock_guard<std::mutex> guard(this->mutex);
+        ++syncPeriod;
+        for (auto & it : accounts.accounts) {
+            const GoRouterAccount & router = *it.second.router;
+            bool active = router.balance != router.previousBalance;
+            if (!scheduleSync(syncStates[it.first], active)) continue;
+
+            payload.append(it.first.toString());
+            sent.push_back(it.first);
+        }
+    }
+    this->recordLevel(sent.size(), "reauthorize.accounts");
+
+    auto onResponse = [&, sentTime, sent] (const HttpRequest &req,
             HttpClientError error,
             int status,
             string && headers,
@@ -328,6 +392,7 @@ LocalBanker::reauthorize()
                  << "body:   " << body << endl
                  << "url:    " << req.url_ << endl;
             this->recordHit("reauthorize.failure");
+            retrySync(sent);
         } else {
             Json::Value jsonAccounts;
             try {
@@ -375,16 +440,35 @@ LocalBanker::reauthorize()
     };
 
     auto const &cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
-    Json::Value payload(Json::arrayValue);
-    {
-        std::lock_guard<std::mutex> guard(this->mutex);
-        for (auto it : accounts.accounts) {
-            payload.append(it.first.toString());
-        }
-    }
     httpClient->post("/reauthorize/1", cbs, payload, {}, {}, 1.0);
 }
 
+bool
+LocalBanker::scheduleSync(SyncState & state, bool active)
+{
+    if (active)
+        state.periods = 1;
+    else if (syncPeriod < state.next)
+        return false;
+    else
+        state.periods = std::min(state.periods * 2, maxSyncPeriods);
+
+    state.next = syncPeriod + state.periods;
+    return true;
+}
+
+void
+LocalBanker::retrySync(const vector<AccountKey> & keys)
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    for (auto & key : keys) {
+        auto it = syncStates.find(key);
+        if (it == syncStates.end()) continue;
+        it->second.periods = 1;
+        it->second.next = 0;
+    }
+}
+
 void
 LocalBanker::sendBidCounts()
 {
@@ -9,7 +9,9 @@
 
 #include <string>
 #include <mutex>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "banker.h"
 #include "soa/service/service_base.h"
@@ -33,6 +35,11 @@ struct LocalBanker : public Banker, Datacratic::MessageLoop, Datacratic::Service
     void setSpendRate(Amount spendRate);
     void setDebug(bool debugSetting);
 
+    /** Accounts whose spend doesn't move are synced less and less often,
+        down to once every maxPeriods sync periods.  Default is 8.
+    */
+    void setMaxSyncPeriods(unsigned maxPeriods);
+
     void start();
     void shutdown();
 
@@ -119,12 +126,37 @@ private:
 
     bool win(const AccountKey &key, Amount winPrice);
 
+    /** Sync state of an account.  An account that spent since its last
+        sync is sent with every period; one that didn't is sent after
+        twice as many periods as the last time, up to maxSyncPeriods, so
+        that the requests only grow with the accounts that are spending.
+    */
+    struct SyncState {
+        SyncState() : imp(0), spend(0), periods(1), next(0) {}
+
+        int64_t imp;            ///< Impressions the banker acknowledged
+        int64_t spend;          ///< Spend the banker acknowledged
+        unsigned periods;       ///< Periods between two syncs
+        uint64_t next;          ///< Period of the next sync
+    };
+
+    /** Whether the account goes in the request of this period, which
+        schedules its next one.  Called with the mutex held.
+    */
+    bool scheduleSync(SyncState & state, bool active);
+
+    /** Sync the accounts with the next period, their request failed. */
+    void retrySync(const std::vector<AccountKey> & keys);
+
     GoAccountType type;
     std::string accountSuffix;
     std::string accountSuffixNoDot;
     std::shared_ptr<Datacratic::HttpClient> httpClient;
     std::mutex mutex;
     std::unordered_set<AccountKey> uninitializedAccounts;
+    std::unordered_map<AccountKey, SyncState> syncStates;
+    uint64_t syncPeriod;
+    unsigned maxSyncPeriods;
     Amount spendRate;
     double syncRate;
     double reauthRate;
@@ -8,9 +8,11 @@
 #include <memory>
 #include <string>
 #include <algorithm>
+#include <mutex>
 #include "soa/jsoncpp/value.h"
 #include <boost/algorithm/string.hpp>
 #include <jml/arch/futex.h>
+#include "jml/utils/exc_check.h"
 
 #include "master_banker.h"
 #include "soa/service/rest_request_binding.h"
@@ -47,9 +49,15 @@ Logging::Category BankerPersistence::debug("BankerPersistence Debug", BankerPers
 const string RedisBankerPersistence::PREFIX = "banker-";
 
 struct RedisBankerPersistence::Itl {
+    Itl()
+        : timeout(Default::RedisTimeout), chunkSize(Default::SaveChunkSize)
+    {
+    }
+
     shared_ptr<Redis::AsyncConnection> redis;
 
     int timeout;
+    size_t chunkSize;
 };
 
 RedisBankerPersistence::
@@ -125,6 +133,36 @@ loadAll(const string & topLevelKey, OnLoadedCallback onLoaded)
     onLoaded(newAccounts, SUCCESS, "");
 }
 
+namespace {
+
+/** What the phases of a save have gathered so far.  The batches of a phase
+    complete on the thread of the Redis connection, in any order; the last
+    one to complete moves on to the next phase.
+*/
+struct SaveProgress {
+    SaveProgress(size_t numKeys)
+        : values(numKeys), exists(numKeys), pending(0)
+    {
+    }
+
+    std::mutex lock;
+    vector<string> values;      ///< stored value of each key, from phase 1
+    vector<char> exists;        ///< whether each key is present in storage
+    string error;               ///< first error returned by a batch
+    size_t pending;             ///< batches of the phase not completed yet
+    BankerPersistence::Result result;
+};
+
+} // file scope
+
+void
+RedisBankerPersistence::
+setChunkSize(size_t chunkSize)
+{
+    ExcCheckGreater(chunkSize, 0, "chunk size must be positive");
+    itl->chunkSize = chunkSize;
+}
+
 void
 RedisBankerPersistence::
 saveAll(const Accounts & toSave, OnSavedCallback onSaved)
@@ -135,61 +173,81 @@ saveAll(const Accounts & toSave, OnSavedCallback onSaved)
     // Phase 1: we load all of the keys.  This way we can know what is
     // present and deal with keys that should be zeroed out.  We can also
     // detect if we have a synchronization error and bail out.
+    //
+    // Both phases are split into batches of at most chunkSize keys that are
+    // all pipelined on the connection, so that a large save doesn't turn
+    // into a single huge MGET or transaction.
 
     const Date begin = Date::now();
-    vector<string> keys;
-
-    Redis::Command fetchCommand(MGET);
 
     auto latencyBetween = [](const Date& lhs, const Date& rhs) {
         return rhs.secondsSince(lhs) * 1000;
     };
 
-    /* fetch all account keys and values from storage */
+    // The callbacks run later on the Redis thread, and need the accounts
+    // as they are now
+    auto accounts = make_shared<Accounts>(toSave);
+    auto keys = make_shared<vector<string> >();
+
     auto onAccount = [&] (const AccountKey & key,
                           const Account & account)
         {
-            string keyStr = key.toString();
-            keys.push_back(keyStr);
-            fetchCommand.addArg(PREFIX + keyStr);
+            keys->push_back(key.toString());
         };
-    toSave.forEachAccount(onAccount);
+    accounts->forEachAccount(onAccount);
+
+    if (keys->size() == 0) {
+        /* no account to save */
+        BankerPersistence::Result result;
+        result.status = SUCCESS;
+        result.recordLatency("totalTimeMs", latencyBetween(begin, Date::now()));
+        onSaved(result, "");
+        return;
+    }
+
+    const size_t chunkSize = itl->chunkSize;
+    auto progress = make_shared<SaveProgress>(keys->size());
+    auto itl = this->itl;
 
     const Date beforePhase1Time = Date::now();
-    auto onPhase1Result = [=] (const Redis::Result & result)
+
+    auto onPhase1Done = [=] ()
         {
-            BankerPersistence::Result saveResult;
+            BankerPersistence::Result & saveResult = progress->result;
 
             const Date afterPhase1Time = Date::now();
             saveResult.recordLatency(
                     "redisPhase1TimeMs", latencyBetween(beforePhase1Time, afterPhase1Time));
 
-            if (!result.ok()) {
+            if (!progress->error.empty()) {
                 saveResult.status = PERSISTENCE_ERROR;
                 saveResult.recordLatency(
                         "totalTimeMs", latencyBetween(begin, Date::now()));
                 LOG(error) << "phase1 save operation failed with error '"
-                           << result.error() << "'" << std::endl;
-                onSaved(saveResult, result.error());
+                           << progress->error << "'" << std::endl;
+                onSaved(saveResult, progress->error);
                 return;
             }
 
-            vector<Redis::Command> storeCommands;
-            storeCommands.push_back(MULTI);
-
-            const Reply & reply = result.reply();
-            ExcAssert(reply.type() == ARRAY);
+            // Commands for each tree of accounts, which are never split
+            // across transactions
+            vector<vector<Redis::Command> > treeCommands;
 
             Json::Value badAccounts(Json::arrayValue);
             Json::Value archivedAccounts(Json::arrayValue);
 
             /* All accounts known to the banker are fetched.
-               We need to check them and restore them (if needed). */
-            for (int i = 0; i < reply.length(); i++) {
-                const string & key = keys[i];
+               We need to check them and restore them (if needed).  The keys
+               are sorted, so each tree starts with its top level account. */
+            for (unsigned i = 0; i < keys->size(); i++) {
+                const string & key = (*keys)[i];
+                if (key.find(':') == string::npos || treeCommands.empty())
+                    treeCommands.emplace_back();
+                vector<Redis::Command> & storeCommands = treeCommands.back();
+
                 const Accounts::AccountInfo & bankerAccount
-                    = toSave.getAccount(key);
-                if (toSave.isAccountOutOfSync(key)) {
+                    = accounts->getAccount(key);
+                if (accounts->isAccountOutOfSync(key)) {
                     LOG(trace) << "account '" << key
                                << "' is out of sync and will not be saved" << endl;
                     continue;
@@ -197,9 +255,7 @@ saveAll(const Accounts & toSave, OnSavedCallback onSaved)
                 Json::Value bankerValue = bankerAccount.toJson();
                 bool saveAccount(false);
 
-                Redis::Result result = reply[i];
-                Reply accountReply = result.reply();
-                if (accountReply.type() == STRING) {
+                if (progress->exists[i]) {
                     // We have here:
                     // a) an account that we want to write;
                     // b) the current in-database representation of that
@@ -214,7 +270,7 @@ saveAll(const Accounts & toSave, OnSavedCallback onSaved)
                     // 3.  Perform the modifications
 
                     Account storageAccount;
-                    Json::Value storageValue = Json::parse(accountReply.asString());
+                    Json::Value storageValue = Json::parse(progress->values[i]);
                     storageAccount = storageAccount.fromJson(storageValue);
                     if (bankerAccount.isSameOrPastVersion(storageAccount)) {
                         /* FIXME: the need for updating an account should
@@ -256,6 +312,22 @@ saveAll(const Accounts & toSave, OnSavedCallback onSaved)
                 }
             }
 
+            /* Pack the trees into transactions of about chunkSize
+               commands. */
+            vector<vector<Redis::Command> > transactions;
+            for (auto & commands: treeCommands) {
+                if (commands.empty())
+                    continue;
+                if (transactions.empty()
+                    || transactions.back().size() + commands.size() > chunkSize + 1) {
+                    transactions.emplace_back();
+                    transactions.back().push_back(MULTI);
+                }
+                auto & transaction = transactions.back();
+                transaction.insert(transaction.end(),
+                                   commands.begin(), commands.end());
+            }
+
             if (badAccounts.size() > 0) {
                 /* For now we do not save any account when at least one has
                    been detected as inconsistent. */
@@ -267,16 +339,25 @@ saveAll(const Accounts & toSave, OnSavedCallback onSaved)
                         "totalTimeMs", latencyBetween(begin, now));
                 onSaved(saveResult, boost::trim_copy(badAccounts.toString()));
             }
-            else if (storeCommands.size() > 1) {
-                 storeCommands.push_back(EXEC);
-                 
+            else if (!transactions.empty()) {
                  const Date beforePhase2Time = Date::now();
 
                  saveResult.recordLatency(
                         "inPhase1TimeMs", latencyBetween(afterPhase1Time, Date::now()));
 
-                 auto onPhase2Result = [=] (const Redis::Results & results) mutable
+                 progress->pending = transactions.size();
+                 string archived = boost::trim_copy(archivedAccounts.toString());
+
+                 auto onPhase2Result = [=] (const Redis::Results & results)
                  {
+                     std::unique_lock<std::mutex> guard(progress->lock);
+                     if (!results.ok() && progress->error.empty())
+                         progress->error = results.error();
+                     if (--progress->pending > 0)
+                         return;
+                     guard.unlock();
+
+                     BankerPersistence::Result & saveResult = progress->result;
                      const Date afterPhase2Time = Date::now();
                      saveResult.recordLatency(
                              "redisPhase2TimeMs", latencyBetween(beforePhase2Time, afterPhase2Time));
@@ -284,19 +365,22 @@ saveAll(const Accounts & toSave, OnSavedCallback onSaved)
                      saveResult.recordLatency(
                              "totalTimeMs", latencyBetween(begin, Date::now()));
 
-                     if (results.ok()) {
+                     if (progress->error.empty()) {
                          saveResult.status = SUCCESS;
-                         onSaved(saveResult, boost::trim_copy(archivedAccounts.toString()));
+                         onSaved(saveResult, archived);
                      }
                      else {
                          LOG(error) << "phase2 save operation failed with error '"
-                                   << results.error() << "'" << std::endl;
+                                   << progress->error << "'" << std::endl;
                          saveResult.status = PERSISTENCE_ERROR;
-                         onSaved(saveResult, results.error());
+                         onSaved(saveResult, progress->error);
                      }
                  };
 
-                 itl->redis->queueMulti(storeCommands, onPhase2Result, itl->timeout);
+                 for (auto & transaction: transactions) {
+                     transaction.push_back(EXEC);
+                     itl->redis->queueMulti(transaction, onPhase2Result, itl->timeout);
+                 }
             }
             else {
                 saveResult.status = SUCCESS;
@@ -308,16 +392,47 @@ saveAll(const Accounts & toSave, OnSavedCallback onSaved)
             }
         };
 
-    if (keys.size() == 0) {
-        /* no account to save */
-        BankerPersistence::Result result;
-        result.status = SUCCESS;
-        result.recordLatency("totalTimeMs", latencyBetween(begin, Date::now()));
-        onSaved(result, "");
-        return;
-    }
+    /* fetch the stored values of the accounts, one batch of keys at a
+       time */
+    progress->pending = (keys->size() + chunkSize - 1) / chunkSize;
+
+    for (size_t first = 0;  first < keys->size();  first += chunkSize) {
+        size_t last = std::min(first + chunkSize, keys->size());
+
+        Redis::Command fetchCommand(MGET);
+        for (size_t i = first;  i < last;  ++i)
+            fetchCommand.addArg(PREFIX + (*keys)[i]);
 
-    itl->redis->queue(fetchCommand, onPhase1Result, itl->timeout);
+        auto onPhase1Result = [=] (const Redis::Result & result)
+            {
+                std::unique_lock<std::mutex> guard(progress->lock);
+
+                if (!result.ok()) {
+                    if (progress->error.empty())
+                        progress->error = result.error();
+                }
+                else {
+                    const Reply & reply = result.reply();
+                    ExcAssert(reply.type() == ARRAY);
+                    ExcAssertEqual(reply.length(), int(last - first));
+                    for (size_t i = first;  i < last;  ++i) {
+                        Reply accountReply = reply[i - first];
+                        if (accountReply.type() == STRING) {
+                            progress->exists[i] = true;
+                            progress->values[i] = accountReply.asString();
+                        }
+                    }
+                }
+
+                if (--progress->pending > 0)
+                    return;
+                guard.unlock();
+
+                onPhase1Done();
+            };
+
+        itl->redis->queue(fetchCommand, onPhase1Result, itl->timeout);
+    }
 }
 
 void
@@ -620,6 +735,7 @@ init(const shared_ptr<BankerPersistence> & storage, double saveInterval)
 
     addPeriodic("MasterBanker::stats", 1.0, [=](uint64_t) {
                 recordStableLevel(accounts.size(), "accounts");
+                recordHugePageStats();
                 for (const auto& item : lastSaveLatency) {
                     recordStableLevel(item.second, "save." + item.first);
                 }
@@ -649,6 +765,9 @@ init(const shared_ptr<BankerPersistence> & storage, double saveInterval)
 
     auto & versionNode = router.addSubRouter("/v1", "version 1 of API");
 
+    addEventSamplerRoutes(versionNode, "/eventSampling",
+                          getServices()->eventSampler);
+
     addRouteSyncReturn(versionNode,
                        "/summary",
                        {"GET"},
@@ -721,6 +840,18 @@ init(const shared_ptr<BankerPersistence> & storage, double saveInterval)
                        this,
                        JsonParam<Json::Value>("", "list of accounts to sync"));
 
+    addRouteSyncReturn(accountsNode,
+                       "/sync",
+                       {"POST"},
+                       "Batched sync of the spend accounts of a slave banker: "
+                       "applies the spend of the accounts that changed and "
+                       "re-ups the balance of the ones that ask for it",
+                       "Net budget and status of each of the accounts",
+                       [] (const Json::Value & v) { return v; },
+                       &MasterBanker::syncBatched,
+                       this,
+                       JsonParam<Json::Value>("", "changes of each account"));
+
     auto & account
         = accountsNode.addSubRouter(Rx("/([^/]*)", "/<accountName>"),
                                     "operations on an individual account");
@@ -963,9 +1094,20 @@ saveState()
         return;
 
     saving = true;
-    storage_->saveAll(accounts, bind(&MasterBanker::onStateSaved, this,
-                                          placeholders::_1,
-                                          placeholders::_2));
+
+    // Only the trees that changed since the last save are written; they
+    // are marked again if they couldn't be, to be retried on the next one
+    auto toSave = make_shared<Accounts>(accounts.takeDirtyAccounts());
+
+    auto onSaved = [=] (const BankerPersistence::Result & result,
+                        const string & info)
+        {
+            if (result.status != BankerPersistence::SUCCESS)
+                accounts.markDirty(*toSave);
+            onStateSaved(result, info);
+        };
+
+    storage_->saveAll(*toSave, onSaved);
 }
 
 void
@@ -1285,6 +1427,56 @@ syncFromShadowBatched(const Json::Value &transfers)
     return result;
 }
 
+Json::Value
+MasterBanker::
+syncBatched(const Json::Value &deltas)
+{
+    Record record(this, "syncBatched");
+    checkPersistence();
+
+    Json::Value result(Json::objectValue);
+    for (const auto& key : deltas.getMemberNames()) {
+        AccountKey accountKey(key);
+        const auto& delta = deltas[key];
+
+        ExcCheck(delta.isMember("spent") || delta.isMember("balance"),
+                 "nothing to sync for account " + key);
+
+        Account account;
+
+        if (delta.isMember("spent")) {
+            // Only the totals that syncToMaster() uses are sent
+            ShadowAccount shadow;
+            shadow.commitmentsMade = CurrencyPool::fromJson(delta["made"]);
+            shadow.commitmentsRetired = CurrencyPool::fromJson(delta["retired"]);
+            shadow.spent = CurrencyPool::fromJson(delta["spent"]);
+            if (delta.isMember("lineItems"))
+                shadow.lineItems = LineItems::fromJson(delta["lineItems"]);
+            shadow.balance = shadow.commitmentsRetired
+                - shadow.commitmentsMade - shadow.spent;
+
+            // ignore if account is closed.
+            pair<bool, bool> presentActive
+                = accounts.accountPresentAndActive(accountKey);
+            if (presentActive.first && !presentActive.second)
+                account = accounts.getAccount(accountKey);
+            else account = accounts.syncFromShadow(accountKey, shadow);
+        }
+
+        if (delta.isMember("balance")) {
+            auto amount = CurrencyPool::fromJson(delta["balance"]);
+            reactivatePresentAccounts(accountKey);
+            account = accounts.setBalance(accountKey, amount, AT_SPEND);
+        }
+
+        Json::Value & entry = result[key];
+        entry["netBudget"] = account.getNetBudget().toJson();
+        entry["status"] = account.status == Account::CLOSED ? "closed" : "active";
+    }
+
+    return result;
+}
+
 void
 MasterBanker::
 reportLatencies(const std::string &category,
@@ -38,6 +38,7 @@ inline std::string restEncode(const AccountKey & val)
 namespace Default {
     static constexpr int RedisTimeout = 10;
     static constexpr double SaveInterval = 10.0;
+    static constexpr size_t SaveChunkSize = 1000;
 }
 
 
@@ -252,6 +253,11 @@ struct RedisBankerPersistence : public BankerPersistence {
     void loadAll(const std::string & topLevelKey, OnLoadedCallback onLoaded);
     void saveAll(const Accounts & toSave, OnSavedCallback onDone);
     void restoreFromArchive(const AccountKey & key, OnRestoredCallback onRestored);
+
+    /** Maximum number of accounts fetched by each MGET of a save, and
+        about the number of commands in each of its transactions.  A tree
+        of accounts is always written in a single transaction. */
+    void setChunkSize(size_t chunkSize);
 private:
     void moveToActive(const std::vector<AccountKey> & archivedAccountKeys,
                                 OnRestoredCallback onRestored);
@@ -324,7 +330,8 @@ struct MasterBanker
     Json::Value createAccount(const AccountKey & key, AccountType type);
     Json::Value getAccountsSimpleSummaries(int depth);
 
-    /** Save the entire state asynchronously.  Will return straight away. */
+    /** Save the accounts modified since the last save asynchronously.
+        Will return straight away. */
     void saveState();
 
     /** Load the entire state sychronously.  Will return once the state has
@@ -357,6 +364,7 @@ private:
     const Account addAdjustment(const AccountKey &key, CurrencyPool amount);
     const Account syncFromShadow(const AccountKey &key, const ShadowAccount &shadow);
     std::map<std::string, Account> syncFromShadowBatched(const Json::Value &transfers);
+    Json::Value syncBatched(const Json::Value &deltas);
 
     void reportLatencies(const std::string& category,
                          const BankerPersistence::LatencyMap& latencies) const;
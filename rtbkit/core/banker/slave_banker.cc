@@ -119,7 +119,8 @@ Logging::Category SlaveBanker::error("SlaveBanker Error", SlaveBanker::print);
 Logging::Category SlaveBanker::trace("SlaveBanker Trace", SlaveBanker::print);
 
 SlaveBanker::SlaveBanker()
-    : createdAccounts(128), reauthorizing(false), numReauthorized(0)
+    : createdAccounts(128), reauthorizing(false), numReauthorized(0),
+      syncingBatched(false), numBatchedSyncs(0)
 {
 }
 
@@ -129,7 +130,8 @@ SlaveBanker(
         CurrencyPool spendRate,
         double syncRate,
         bool batchedUpdates)
-    : createdAccounts(128), reauthorizing(false), numReauthorized(0)
+    : createdAccounts(128), reauthorizing(false), numReauthorized(0),
+      syncingBatched(false), numBatchedSyncs(0)
 {
     init(accountSuffix, spendRate, syncRate, batchedUpdates);
 }
@@ -193,18 +195,23 @@ init(const std::string & accountSuffix,
 
     lastSync = lastReauthorize = Date::now();
     
+    if (batchedUpdates) {
+        addPeriodic("SlaveBanker::syncBatched", syncRate,
+                    std::bind(&SlaveBanker::syncBatched,
+                              this,
+                              std::placeholders::_1),
+                    true /* single threaded */);
+        return;
+    }
+
     addPeriodic("SlaveBanker::reportSpend", syncRate,
                 std::bind(&SlaveBanker::reportSpend,
                           this,
                           std::placeholders::_1),
                 true /* single threaded */);
 
-    auto authorizePtr = batchedUpdates ?
-        &SlaveBanker::reauthorizeBudgetBatched :
-        &SlaveBanker::reauthorizeBudget;
-
     addPeriodic("SlaveBanker::reauthorizeBudget", syncRate,
-                std::bind(authorizePtr,
+                std::bind(&SlaveBanker::reauthorizeBudget,
                           this,
                           std::placeholders::_1),
                 true /* single threaded */);
@@ -319,6 +326,9 @@ void
 SlaveBanker::
 syncAll(std::function<void (std::exception_ptr)> onDone)
 {
+    // What the slices spent needs to be in the accounts that we report
+    accounts.rebalance();
+
     auto allKeys = accounts.getAccountKeys();
 
     vector<AccountKey> filteredKeys;
@@ -466,51 +476,134 @@ reportSpend(uint64_t numTimeoutsExpired)
 
 void
 SlaveBanker::
-reauthorizeBudgetBatched(uint64_t numTimeoutsExpired)
+syncBatched(uint64_t numTimeoutsExpired)
 {
-    Json::Value body;
-    body["amount"] = spendRate.toJson();
-    body["accountType"] = "spend";
+    if (numTimeoutsExpired > 1) {
+        cerr << "warning: slave banker missed " << numTimeoutsExpired
+             << " timeouts" << endl;
+    }
 
-    Json::Value request;
-    auto onAccount = [&](const AccountKey& key, const ShadowAccount& Account) {
-        request[getShadowAccountStr(key)] = body;
-    };
-    accounts.forEachInitializedAndActiveAccount(onAccount);
+    if (syncingBatched) {
+        cerr << "warning: batched sync still in progress" << endl;
+        return;
+    }
+
+    // What the slices spent needs to be in the accounts that we report
+    accounts.rebalance();
+
+    bool fullSync = numBatchedSyncs++ % FullSyncInterval == 0;
+
+    auto sent = std::make_shared<std::map<AccountKey, SyncedState> >();
+    Json::Value request(Json::objectValue);
+
+    auto onAccount = [&] (const AccountKey & key, const ShadowAccount & account)
+        {
+            // Closed accounts are only looked at on full syncs, to find out
+            // if they were reopened
+            bool closed = account.status == Account::CLOSED;
+            if (closed && !fullSync)
+                return;
+
+            auto it = syncedStates.find(key);
+            bool changed = fullSync
+                || it == syncedStates.end()
+                || it->second.spent != account.spent
+                || it->second.commitmentsMade != account.commitmentsMade
+                || it->second.commitmentsRetired != account.commitmentsRetired;
+
+            // An account that spent nothing and still has all of its float
+            // has nothing to tell the master
+            CurrencyPool balance;
+            if (!closed)
+                balance = floatFor(key, account);
+            bool needsBalance
+                = !closed && (fullSync || account.balance != balance);
+            if (!changed && !needsBalance)
+                return;
+
+            Json::Value delta(Json::objectValue);
+            if (changed) {
+                delta["made"] = account.commitmentsMade.toJson();
+                delta["retired"] = account.commitmentsRetired.toJson();
+                delta["spent"] = account.spent.toJson();
+
+                // The master replaces its line items with ours, so they are
+                // sent as long as there are any
+                if (!account.lineItems.isZero())
+                    delta["lineItems"] = account.lineItems.toJson();
+
+                SyncedState & state = (*sent)[key];
+                state.commitmentsMade = account.commitmentsMade;
+                state.commitmentsRetired = account.commitmentsRetired;
+                state.spent = account.spent;
+            }
+            if (needsBalance)
+                delta["balance"] = balance.toJson();
+
+            request[getShadowAccountStr(key)] = delta;
+        };
+    accounts.forEachInitializedAccount(onAccount);
+
+    if (request.empty()) {
+        std::lock_guard<Lock> guard(syncLock);
+        lastSync = lastReauthorize = Date::now();
+        return;
+    }
 
-    std::string payload = request.toStringNoNewLine();
+    syncingBatched = true;
+    reauthorizeDate = Date::now();
 
     using std::placeholders::_1;
     using std::placeholders::_2;
     using std::placeholders::_3;
-    applicationLayer->request("POST", "/v1/accounts/balance", {}, payload, std::bind(
-            &SlaveBanker::onReauthorizeBudgetBatchedResponse, this, _1, _2, _3));
+    applicationLayer->request("POST", "/v1/accounts/sync", {},
+                              request.toStringNoNewLine(),
+                              std::bind(&SlaveBanker::onSyncBatchedResponse,
+                                        this, sent, _1, _2, _3));
 }
 
 void
 SlaveBanker::
-onReauthorizeBudgetBatchedResponse(
+onSyncBatchedResponse(
+        const std::shared_ptr<std::map<AccountKey, SyncedState> > & sent,
         std::exception_ptr exc, int code, const std::string& payload)
 {
+    syncingBatched = false;
+
     if (exc) {
-        logException(exc, "Exception when reauthorizing budget", error);
+        logException(exc, "Exception when syncing with the master banker", error);
         return;
     }
 
     if (code != Default::ExpectedMasterHttpCode) {
-        LOG(error) << "Error when reauthorizing budget for account" << std::endl;
+        LOG(error) << "Error when syncing with the master banker" << std::endl;
         LOG(error) << "Expected HTTP " << Default::ExpectedMasterHttpCode
             << ", got " << code << std::endl;
         return;
     }
 
     Json::Value response = Json::parse(payload);
-    for (const auto& key : response.getMemberNames()) {
-        auto account = Account::fromJson(response[key]);
-        accounts.syncFromMaster(AccountKey(key).parent(), account);
+    for (const auto & key : response.getMemberNames()) {
+        AccountKey accountKey = AccountKey(key).parent();
+        const Json::Value & result = response[key];
+
+        auto netBudget = CurrencyPool::fromJson(result["netBudget"]);
+        auto status = result["status"].asString() == "closed"
+            ? Account::CLOSED : Account::ACTIVE;
+        accounts.syncFromMaster(accountKey, netBudget, status);
+
+        // Only what the master acknowledged is known to be in sync
+        auto it = sent->find(accountKey);
+        if (it != sent->end())
+            syncedStates[accountKey] = it->second;
     }
 
-    lastReauthorize = Date::now();
+    Date now = Date::now();
+    lastReauthorizeDelay = now - reauthorizeDate;
+    numReauthorized++;
+
+    std::lock_guard<Lock> guard(syncLock);
+    lastSync = lastReauthorize = now;
 }
 
 void
@@ -535,7 +628,7 @@ reauthorizeBudget(uint64_t numTimeoutsExpired)
     auto onAccount = [&] (const AccountKey & key,
                           const ShadowAccount & account)
         {
-            Json::Value payload = spendRate.toJson();
+            Json::Value payload = floatFor(key, account).toJson();
 
             auto onDone = std::bind(&SlaveBanker::onReauthorizeBudgetMessage, this,
                                     key,
@@ -559,6 +652,74 @@ reauthorizeBudget(uint64_t numTimeoutsExpired)
     }
 }
 
+void
+SlaveBanker::
+setAdaptiveFloat(double headroom, double smoothing,
+                 double minFactor, double maxFactor)
+{
+    ExcCheckGreaterEqual(headroom, 0.0, "headroom can't be negative");
+    ExcCheck(smoothing > 0.0 && smoothing <= 1.0,
+             "smoothing must be in (0, 1]");
+    ExcCheck(minFactor > 0.0 && minFactor <= maxFactor,
+             "invalid float factors");
+
+    adaptiveFloat.enabled = true;
+    adaptiveFloat.headroom = headroom;
+    adaptiveFloat.smoothing = smoothing;
+    adaptiveFloat.minFactor = minFactor;
+    adaptiveFloat.maxFactor = maxFactor;
+}
+
+CurrencyPool
+SlaveBanker::
+floatFor(const AccountKey & key, const ShadowAccount & account)
+{
+    if (!adaptiveFloat.enabled)
+        return spendRate;
+
+    SpendHistory & history = spendHistories[key];
+    CurrencyPool used = account.spent + account.commitmentsMade
+        - account.commitmentsRetired;
+
+    CurrencyPool result;
+    CurrencyPool rate;
+
+    for (const Amount & base: spendRate.currencyAmounts) {
+        CurrencyCode currency = base.currencyCode;
+
+        // Until we've seen an interval, expect what everyone gets
+        double predicted = base.value;
+        if (history.primed) {
+            double observed = used.getAvailable(currency).value
+                - history.used.getAvailable(currency).value;
+
+            // What an account that ran dry would have used is unknown, but
+            // it's more than it had
+            double granted = history.granted.getAvailable(currency).value;
+            double left = account.balance.getAvailable(currency).value;
+            if (granted > 0 && left * 10 < granted)
+                observed = std::max(observed, granted) * 2;
+
+            double s = adaptiveFloat.smoothing;
+            predicted = s * std::max(observed, 0.0)
+                + (1 - s) * history.rate.getAvailable(currency).value;
+        }
+        rate += Amount(currency, predicted);
+
+        double wanted = predicted * (1 + adaptiveFloat.headroom);
+        wanted = std::max(wanted, base.value * adaptiveFloat.minFactor);
+        wanted = std::min(wanted, base.value * adaptiveFloat.maxFactor);
+        result += Amount(currency, wanted);
+    }
+
+    history.used = used;
+    history.rate = rate;
+    history.granted = result;
+    history.primed = true;
+
+    return result;
+}
+
 void
 SlaveBanker::
 onReauthorizeBudgetMessage(const AccountKey & accountKey,
@@ -632,12 +793,15 @@ constexpr bool SlaveBankerArguments::Defaults::UseHttp;
 constexpr bool SlaveBankerArguments::Defaults::Batched;
 constexpr int SlaveBankerArguments::Defaults::HttpConnections;
 constexpr bool SlaveBankerArguments::Defaults::TcpNoDelay;
+constexpr double SlaveBankerArguments::Defaults::FloatHeadroom;
 const std::string SlaveBankerArguments::Defaults::SpendRate{"100000USD/1M"};
 
 SlaveBankerArguments::SlaveBankerArguments()
     : spendRateStr(Defaults::SpendRate)
     , syncRate(Defaults::SyncRate)
     , batched(Defaults::Batched)
+    , adaptiveFloat(false)
+    , floatHeadroom(Defaults::FloatHeadroom)
     , useHttp(Defaults::UseHttp)
     , httpTimeout(Defaults::HttpTimeout)
     , httpConnections(Defaults::HttpConnections)
@@ -664,6 +828,10 @@ SlaveBankerArguments::makeProgramOptions(std::string title)
          "frequency at which the slave banker syncs itself with the master banker.")
         ("banker-batched", po::bool_switch(&batched),
          "slave banker now uses batched communication to sync with the master banker.")
+        ("banker-adaptive-float", po::bool_switch(&adaptiveFloat),
+         "re-authorize each account from its recent spend instead of the spend rate")
+        ("banker-float-headroom", po::value<double>(&floatHeadroom),
+         "fraction added to the predicted spend with the adaptive float (default 0.5)")
         ("use-http-banker", po::bool_switch(&useHttp),
          "Communicate with the MasterBanker over http")
         ("banker-http-timeouts", po::value<double>(&httpTimeout),
@@ -688,6 +856,8 @@ makeBanker(std::shared_ptr<ServiceProxies> proxies, const std::string& accountSu
 {
     auto spendRate = CurrencyPool(Amount::parse(spendRateStr));
     auto banker = std::make_shared<SlaveBanker>(accountSuffix, spendRate, syncRate, batched);
+    if (adaptiveFloat)
+        banker->setAdaptiveFloat(floatHeadroom);
 
     banker->setApplicationLayer(makeApplicationLayer(std::move(proxies)));
     return banker;
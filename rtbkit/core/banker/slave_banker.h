@@ -144,6 +144,25 @@ struct SlaveBanker : public Banker, public MessageLoop {
         return accounts.authorizeBid(account, item, amount);
     }
 
+    virtual bool authorizeBid(AccountHandle account,
+                              const std::string & item,
+                              Amount amount)
+    {
+        return accounts.authorizeBid(account, item, amount);
+    }
+
+    virtual void cancelBid(const AccountKey & account,
+                           const std::string & item)
+    {
+        accounts.cancelBid(account, item);
+    }
+
+    virtual void cancelBid(AccountHandle account,
+                           const std::string & item)
+    {
+        accounts.cancelBid(account, item);
+    }
+
     virtual void commitBid(const AccountKey & account,
                            const std::string & item,
                            Amount amountPaid,
@@ -158,6 +177,12 @@ struct SlaveBanker : public Banker, public MessageLoop {
         return accounts.detachBid(account, item);
     }
 
+    virtual Amount detachBid(AccountHandle account,
+                             const std::string & item)
+    {
+        return accounts.detachBid(account, item);
+    }
+
     virtual void attachBid(const AccountKey & account,
                            const std::string & item,
                            Amount amountAuthorized)
@@ -193,6 +218,12 @@ struct SlaveBanker : public Banker, public MessageLoop {
         return accounts.forceWinBid(account, amountPaid, lineItems);
     }
 
+    /** Takes the lock of each account once for all of its commits. */
+    virtual void commitBids(const std::vector<BidCommit> & commits)
+    {
+        accounts.commitBids(commits);
+    }
+
     /** Sync the given account synchronously, returning the new status of
         the account.
     */
@@ -212,6 +243,24 @@ struct SlaveBanker : public Banker, public MessageLoop {
     void syncAll(std::function<void (std::exception_ptr)> onDone
                  = std::function<void (std::exception_ptr)>());
 
+    /** Give each of numSlices groups of bidding threads its own slice of
+        the budget of the accounts; see ShadowAccounts::enableSlices().
+        Must be called before any bid is authorized. */
+    void setBudgetSlices(unsigned numSlices)
+    {
+        accounts.enableSlices(numSlices);
+    }
+
+    /** Instead of re-upping every account to spendRate on each sync, give
+        each one a float sized from its recent spend: a moving average of
+        what it used per sync interval, with smoothing the weight of the
+        latest interval, plus headroom.  An account that ran dry is
+        assumed to have wanted twice what it got.  The float stays between
+        minFactor and maxFactor times spendRate.
+    */
+    void setAdaptiveFloat(double headroom = 0.5, double smoothing = 0.3,
+                          double minFactor = 0.1, double maxFactor = 10.0);
+
     /** Testing only: get the internal state of an account. */
     ShadowAccount getAccountStateDebug(AccountKey accountKey) const
     {
@@ -280,6 +329,38 @@ private:
     void reauthorizeBudget(uint64_t numTimeoutsExpired);
     CurrencyPool spendRate;
 
+    /** Balance to ask the master for on this sync; spendRate unless the
+        float is adaptive.  Called once per account and sync, from the
+        message loop's thread. */
+    CurrencyPool floatFor(const AccountKey & key, const ShadowAccount & account);
+
+    struct AdaptiveFloat {
+        AdaptiveFloat()
+            : enabled(false), headroom(0), smoothing(0),
+              minFactor(0), maxFactor(0)
+        {
+        }
+
+        bool enabled;
+        double headroom;
+        double smoothing;
+        double minFactor;
+        double maxFactor;
+    } adaptiveFloat;
+
+    /** What an account used over the last sync intervals. */
+    struct SpendHistory {
+        SpendHistory() : primed(false) {}
+
+        CurrencyPool used;      ///< spent plus outstanding commitments
+        CurrencyPool rate;      ///< predicted use over the next interval
+        CurrencyPool granted;   ///< float requested at the last sync
+        bool primed;
+    };
+
+    /** Only touched from the message loop's thread. */
+    std::unordered_map<AccountKey, SpendHistory> spendHistories;
+
 
     /// Called when we get an account status back from the master banker
     /// after a synchrnonization
@@ -310,10 +391,32 @@ private:
         return account.childKey(accountSuffix).toString();
     }
 
-    void reauthorizeBudgetBatched(uint64_t numTimeoutsExpired);
-    void onReauthorizeBudgetBatchedResponse(
+    /** Batched sync: reports the spend of the accounts that changed since
+        the last sync and re-ups the ones that need it, all in one request
+        to /v1/accounts/sync.  Replaces reportSpend and reauthorizeBudget
+        when the updates are batched. */
+    void syncBatched(uint64_t numTimeoutsExpired);
+
+    /** What the master acknowledged of an account on the last sync. */
+    struct SyncedState {
+        CurrencyPool commitmentsMade;
+        CurrencyPool commitmentsRetired;
+        CurrencyPool spent;
+    };
+
+    void onSyncBatchedResponse(
+            const std::shared_ptr<std::map<AccountKey, SyncedState> > & sent,
             std::exception_ptr exc, int code, const std::string& payload);
 
+    /** Only touched from the message loop's thread. */
+    std::unordered_map<AccountKey, SyncedState> syncedStates;
+    std::atomic<bool> syncingBatched;
+    size_t numBatchedSyncs;
+
+    /** Every so many syncs, all of the accounts are sent so that we find
+        out about the changes that were made on the master. */
+    enum { FullSyncInterval = 10 };
+
     std::atomic<bool> shutdown_;
     std::atomic<bool> reauthorizing;
     Date reauthorizeDate;
@@ -336,6 +439,7 @@ public:
         static const std::string SpendRate;
         static constexpr double SyncRate = 1.0;
         static constexpr bool Batched = false;
+        static constexpr double FloatHeadroom = 0.5;
 
         static constexpr bool UseHttp = false;
         static constexpr int HttpConnections = 128;
@@ -371,6 +475,8 @@ private:
     std::string spendRateStr;
     double syncRate;
     bool batched;
+    bool adaptiveFloat;
+    double floatHeadroom;
 
     bool useHttp;
     double httpTimeout;
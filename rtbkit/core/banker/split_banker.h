@@ -118,6 +118,37 @@ struct SplitBanker : public Banker {
         }
     }
 
+    /** The commits of the master banker's campaigns are passed on to it
+        together, and the local ones are applied one by one. */
+    virtual void commitBids(const std::vector<BidCommit> & commits)
+    {
+        std::vector<BidCommit> local, master;
+        for (auto & commit: commits) {
+            if (isLocal(commit.account))
+                local.push_back(commit);
+            else master.push_back(commit);
+        }
+
+        std::exception_ptr firstError;
+        try {
+            if (!master.empty())
+                masterBanker->commitBids(master);
+        } catch (...) {
+            firstError = std::current_exception();
+        }
+
+        try {
+            if (!local.empty())
+                Banker::commitBids(local);
+        } catch (...) {
+            if (!firstError)
+                firstError = std::current_exception();
+        }
+
+        if (firstError)
+            std::rethrow_exception(firstError);
+    }
+
     virtual MonitorIndicator getProviderIndicators() const
     {
         return masterBanker->getProviderIndicators();
@@ -933,3 +933,191 @@ BOOST_AUTO_TEST_CASE( test_account_summary_values )
     BOOST_CHECK_EQUAL(simpleValue, expected);
 }
 
+
+BOOST_AUTO_TEST_CASE( test_shadow_account_slices )
+{
+    Accounts master;
+    AccountKey campaign("campaign");
+    AccountKey strategy("campaign:strategy");
+    AccountKey spend("campaign:strategy:spend");
+
+    master.createBudgetAccount(campaign);
+    master.createBudgetAccount(strategy);
+    master.createSpendAccount(spend);
+    master.setBudget(campaign, USD(10));
+    master.setBalance(strategy, USD(2), AT_NONE);
+    master.setBalance(spend, USD(1), AT_NONE);
+
+    ShadowAccounts shadow;
+    shadow.enableSlices(4);
+    shadow.activateAccount(spend);
+    shadow.syncFrom(master);
+
+    int numThreads = 4;
+    int numBids = 1000;
+
+    // The last bid of each thread is committed from another thread, so
+    // that it needs to be found in the slice of another thread
+    vector<string> leftOver(numThreads);
+
+    auto runBidThread = [&] (int threadNum)
+        {
+            for (int i = 0;  i < numBids;  ++i) {
+                string item = ML::format("item%d-%d", threadNum, i);
+                BOOST_REQUIRE(shadow.authorizeBid(spend, item, MicroUSD(100)));
+
+                if (i == numBids - 1)
+                    leftOver[threadNum] = item;
+                else if (i % 2)
+                    shadow.cancelBid(spend, item);
+                else shadow.commitBid(spend, item, MicroUSD(50), LineItems());
+            }
+        };
+
+    boost::thread_group threads;
+    for (int i = 0;  i < numThreads;  ++i)
+        threads.create_thread(std::bind<void>(runBidThread, i));
+    threads.join_all();
+
+    for (auto & item: leftOver) {
+        Amount detached = shadow.detachBid(spend, item);
+        BOOST_CHECK_EQUAL(detached, MicroUSD(100));
+        shadow.commitDetachedBid(spend, detached, MicroUSD(50), LineItems());
+    }
+
+    shadow.rebalance();
+    shadow.checkInvariants();
+
+    // Nothing is left in the slices once they are folded back
+    ShadowAccount account = shadow.getAccount(spend);
+    BOOST_CHECK_EQUAL(account.spent.getAvailable(CurrencyCode::CC_USD),
+                      MicroUSD(numThreads * (numBids / 2 + 1) * 50));
+    BOOST_CHECK_EQUAL(account.commitmentsMade.getAvailable(CurrencyCode::CC_USD),
+                      account.commitmentsRetired.getAvailable(CurrencyCode::CC_USD));
+    BOOST_CHECK_EQUAL(account.balance.getAvailable(CurrencyCode::CC_USD),
+                      USD(1) - MicroUSD(numThreads * (numBids / 2 + 1) * 50));
+}
+
+BOOST_AUTO_TEST_CASE( test_accounts_dirty_trees )
+{
+    Accounts accounts;
+    AccountKey campaign1("campaign1"), strategy1("campaign1:strategy");
+    AccountKey campaign2("campaign2"), strategy2("campaign2:strategy");
+
+    accounts.createAccount(strategy1, AT_SPEND);
+    accounts.createAccount(strategy2, AT_SPEND);
+    accounts.setBudget(campaign1, MicroUSD(1000));
+    accounts.setBudget(campaign2, MicroUSD(1000));
+
+    /* everything is new */
+    Accounts dirty = accounts.takeDirtyAccounts();
+    BOOST_CHECK_EQUAL(dirty.size(), 4);
+    BOOST_CHECK(accounts.takeDirtyAccounts().empty());
+
+    /* touching a child gives its whole tree, and only that tree */
+    accounts.setBalance(strategy1, MicroUSD(100), AT_NONE);
+    dirty = accounts.takeDirtyAccounts();
+    BOOST_CHECK_EQUAL(dirty.size(), 2);
+    BOOST_CHECK_EQUAL(dirty.getAccount(campaign1).allocatedOut,
+                      accounts.getAccount(campaign1).allocatedOut);
+    BOOST_CHECK_EQUAL(dirty.getBalance(strategy1), MicroUSD(100));
+    BOOST_CHECK(!dirty.accountPresentAndActive(campaign2).first);
+
+    /* reading doesn't make a tree dirty */
+    accounts.getAccount(strategy2);
+    accounts.getBalance(strategy2);
+    BOOST_CHECK(accounts.takeDirtyAccounts().empty());
+
+    /* a failed save gives the trees back */
+    accounts.markDirty(dirty);
+    dirty = accounts.takeDirtyAccounts();
+    BOOST_CHECK_EQUAL(dirty.size(), 2);
+    BOOST_CHECK(dirty.accountPresentAndActive(strategy1).first);
+}
+
+BOOST_AUTO_TEST_CASE( test_shadow_account_handles )
+{
+    AccountKey spend("handles:strategy:spend");
+    AccountHandle handle = AccountKeyRegistry::intern(spend);
+
+    BOOST_CHECK_NE(handle, 0);
+    BOOST_CHECK_EQUAL(AccountKeyRegistry::intern(AccountKey("handles:strategy:spend")),
+                      handle);
+    BOOST_CHECK_EQUAL(AccountKeyRegistry::key(handle), spend);
+    BOOST_CHECK_EQUAL(AccountKeyRegistry::key(0), AccountKey());
+
+    Accounts master;
+    master.createSpendAccount(spend);
+    master.setBudget(AccountKey("handles"), USD(10));
+    master.setBalance(AccountKey("handles:strategy"), USD(2), AT_NONE);
+    master.setBalance(spend, USD(1), AT_NONE);
+
+    ShadowAccounts shadow;
+    shadow.activateAccount(spend);
+    shadow.syncFrom(master);
+
+    /* the handle and the key name the same account */
+    BOOST_CHECK(shadow.authorizeBid(handle, "item1", USD(0.5)));
+    BOOST_CHECK(shadow.authorizeBid(spend, "item2", USD(0.25)));
+    BOOST_CHECK(!shadow.authorizeBid(handle, "item3", USD(0.5)));
+    BOOST_CHECK_EQUAL(shadow.getAccount(spend).commitmentsMade, USD(0.75));
+
+    shadow.cancelBid(handle, "item2");
+    BOOST_CHECK_EQUAL(shadow.detachBid(handle, "item1"), USD(0.5));
+    shadow.commitDetachedBid(spend, USD(0.5), USD(0.125), LineItems());
+    BOOST_CHECK_EQUAL(shadow.getAccount(spend).spent.getAvailable(CurrencyCode::CC_USD),
+                      USD(0.125));
+    BOOST_CHECK_EQUAL(shadow.getAccount(spend).balance, USD(0.875));
+
+    /* no bids on an account that's out of sync */
+    master.markAccountOutOfSync(spend);
+    shadow.syncFrom(master);
+    BOOST_CHECK(!shadow.authorizeBid(handle, "item4", USD(0.01)));
+}
+
+BOOST_AUTO_TEST_CASE( test_shadow_accounts_commit_bids )
+{
+    AccountKey spend1("batch:strategy:spend1");
+    AccountKey spend2("batch:strategy:spend2");
+
+    Accounts master;
+    master.createSpendAccount(spend1);
+    master.createSpendAccount(spend2);
+    master.setBudget(AccountKey("batch"), USD(10));
+    master.setBalance(AccountKey("batch:strategy"), USD(4), AT_NONE);
+    master.setBalance(spend1, USD(1), AT_NONE);
+    master.setBalance(spend2, USD(1), AT_NONE);
+
+    ShadowAccounts shadow;
+    shadow.activateAccount(spend1);
+    shadow.activateAccount(spend2);
+    shadow.syncFrom(master);
+
+    BOOST_CHECK(shadow.authorizeBid(spend1, "item1", USD(0.5)));
+    BOOST_CHECK(shadow.authorizeBid(spend2, "item2", USD(0.5)));
+    BOOST_CHECK(shadow.authorizeBid(spend1, "item3", USD(0.25)));
+
+    /* the unknown commitment fails, but everything else is committed */
+    vector<BidCommit> commits = {
+        BidCommit(BidCommit::WIN, spend1, "item1", USD(0.125)),
+        BidCommit(BidCommit::CANCEL, spend2, "item2"),
+        BidCommit(BidCommit::CANCEL, spend1, "unknown"),
+        BidCommit(BidCommit::COMMIT, spend1, "item3", USD(0.25)),
+        BidCommit(BidCommit::FORCE_WIN, spend2, "", USD(0.0625))
+    };
+    BOOST_CHECK_THROW(shadow.commitBids(commits), ML::Exception);
+
+    ShadowAccount account1 = shadow.getAccount(spend1);
+    BOOST_CHECK(account1.commitments.empty());
+    BOOST_CHECK_EQUAL(account1.spent.getAvailable(CurrencyCode::CC_USD),
+                      USD(0.375));
+    BOOST_CHECK_EQUAL(account1.balance, USD(0.625));
+
+    ShadowAccount account2 = shadow.getAccount(spend2);
+    BOOST_CHECK(account2.commitments.empty());
+    BOOST_CHECK_EQUAL(account2.spent.getAvailable(CurrencyCode::CC_USD),
+                      USD(0.0625));
+    BOOST_CHECK_EQUAL(account2.balance, USD(0.9375));
+
+    shadow.commitBids({});
+}
@@ -0,0 +1,97 @@
+/* banker_contention_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Contention on the accounts of the master banker when a lot of routers
+   sync their shadow accounts with it at the same time.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/common/account_key.h"
+#include "rtbkit/core/banker/account.h"
+#include "jml/arch/timers.h"
+#include <boost/thread/thread.hpp>
+
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+BOOST_AUTO_TEST_CASE( bench_master_accounts_sync )
+{
+    const int numRouters = 50;
+    const int numCampaigns = 100;
+    const int numStrategies = 2;
+    const int numRounds = 20;
+
+    Accounts master;
+
+    // Each router has its own spend account under each strategy, for a
+    // total of 10k accounts
+    for (int c = 0;  c < numCampaigns;  ++c) {
+        AccountKey campaign("campaign" + to_string(c));
+        master.setBudget(campaign, USD(1000));
+
+        for (int s = 0;  s < numStrategies;  ++s) {
+            AccountKey strategy = campaign.childKey("strategy" + to_string(s));
+            master.setBalance(strategy, USD(100), AT_BUDGET);
+
+            for (int r = 0;  r < numRouters;  ++r)
+                master.createSpendAccount(strategy.childKey("router" + to_string(r)));
+        }
+    }
+
+    BOOST_CHECK_EQUAL(master.size(),
+                      numCampaigns * (1 + numStrategies * (1 + numRouters)));
+
+    auto runRouter = [&] (int router)
+        {
+            ShadowAccounts shadow;
+            vector<AccountKey> keys;
+
+            for (int c = 0;  c < numCampaigns;  ++c) {
+                for (int s = 0;  s < numStrategies;  ++s) {
+                    AccountKey key("campaign" + to_string(c));
+                    key = key.childKey("strategy" + to_string(s));
+                    key = key.childKey("router" + to_string(router));
+                    keys.push_back(key);
+
+                    shadow.activateAccount(key);
+                    shadow.initializeAndMergeState(key, master.getAccount(key));
+                }
+            }
+
+            // What a slave banker does on each of its periodic syncs: report
+            // what was spent, get a new balance and read back the account
+            for (int round = 0;  round < numRounds;  ++round) {
+                for (auto & key: keys) {
+                    string item = "item" + to_string(round);
+                    if (shadow.authorizeBid(key, item, MicroUSD(10)))
+                        shadow.commitBid(key, item, MicroUSD(5), LineItems());
+
+                    master.syncFromShadow(key, shadow.getAccount(key));
+                    master.setBalance(key, USD(0.01), AT_NONE);
+                    shadow.syncFromMaster(key, master.getAccount(key));
+                }
+            }
+        };
+
+    ML::Timer timer;
+
+    boost::thread_group routers;
+    for (int r = 0;  r < numRouters;  ++r)
+        routers.create_thread(std::bind<void>(runRouter, r));
+    routers.join_all();
+
+    double elapsed = timer.elapsed_wall();
+    int numSyncs = numRouters * numCampaigns * numStrategies * numRounds;
+
+    cerr << numSyncs << " account syncs from " << numRouters << " routers in "
+         << elapsed << "s: " << numSyncs / elapsed << " syncs/s" << endl;
+
+    master.checkInvariants();
+    BOOST_CHECK(master.checkBudgetConsistency(AccountKey("campaign0")));
+}
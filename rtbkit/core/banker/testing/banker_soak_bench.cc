@@ -0,0 +1,340 @@
+/** banker_soak_bench.cc                                       -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Soak test of a master banker persisting to redis, with a number of
+    slave bankers authorizing and committing bids on its accounts at a
+    fixed rate, as the routers and the post auction loops would.
+
+    Reports the latency of the requests to the master while it's under
+    load, how far behind the slaves it is, the load on redis and, once the
+    load stops, whether all of the spend made it to the master and to
+    redis.
+*/
+
+#include "rtbkit/core/banker/master_banker.h"
+#include "rtbkit/core/banker/slave_banker.h"
+#include "soa/service/http_rest_proxy.h"
+#include "soa/service/testing/redis_temporary_server.h"
+#include "soa/service/testing/zookeeper_temporary_server.h"
+#include "jml/arch/futex.h"
+#include "jml/arch/timers.h"
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <thread>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+/******************************************************************************/
+/* CONFIG                                                                     */
+/******************************************************************************/
+
+struct Config
+{
+    Config() :
+        slaves(4), campaigns(50), strategies(2), rate(1000), winRate(0.1),
+        duration(30), syncRate(1.0), saveInterval(1.0), batched(false)
+    {}
+
+    size_t slaves;       // number of slave bankers
+    size_t campaigns;    // top level accounts
+    size_t strategies;   // strategies per campaign, each a slave spend account
+    double rate;         // bids per second per slave
+    double winRate;      // fraction of the authorized bids that are won
+    double duration;     // seconds of load
+    double syncRate;     // seconds between the syncs of the slaves
+    double saveInterval; // seconds between the saves of the master
+    bool batched;        // slaves use the batched sync
+};
+
+Config getConfig(int argc, char** argv)
+{
+    using namespace boost::program_options;
+
+    Config config;
+
+    options_description opt;
+    opt.add_options()
+        ("slaves,s", value<size_t>(&config.slaves))
+        ("campaigns,c", value<size_t>(&config.campaigns))
+        ("strategies", value<size_t>(&config.strategies))
+        ("rate,r", value<double>(&config.rate))
+        ("win-rate,w", value<double>(&config.winRate))
+        ("duration,d", value<double>(&config.duration))
+        ("sync-rate", value<double>(&config.syncRate))
+        ("save-interval", value<double>(&config.saveInterval))
+        ("batched,b", bool_switch(&config.batched))
+        ("help,h","print this message");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(opt).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << opt << endl;
+        exit(1);
+    }
+
+    return config;
+}
+
+
+/******************************************************************************/
+/* UTILS                                                                      */
+/******************************************************************************/
+
+/** Spend on the given accounts and all of their children, in micro USD. */
+int64_t masterSpend(const Accounts & accounts, const vector<AccountKey> & roots)
+{
+    int64_t result = 0;
+    for (const AccountKey & root: roots)
+        result += accounts.getAccountSummary(root).spent
+            .getAvailable(CurrencyCode::CC_USD).value;
+    return result;
+}
+
+int64_t redisCommands(Redis::AsyncConnection & redis)
+{
+    Redis::Result result = redis.exec(Redis::Command("INFO"), 5);
+    if (!result.ok())
+        throw ML::Exception("INFO failed: " + result.error());
+
+    string info = result.reply().asString();
+    static const string field = "total_commands_processed:";
+    size_t pos = info.find(field);
+    if (pos == string::npos)
+        throw ML::Exception("no command count in redis INFO");
+    return std::stoll(info.substr(pos + field.size()));
+}
+
+double percentile(vector<double> & values, double p)
+{
+    if (values.empty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    return values[std::min<size_t>(values.size() - 1, p * values.size())];
+}
+
+
+/******************************************************************************/
+/* MAIN                                                                       */
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    Config config = getConfig(argc, argv);
+
+    ZooKeeper::TemporaryServer zookeeper;
+    zookeeper.start();
+    Redis::RedisTemporaryServer redis;
+
+    auto proxies = std::make_shared<ServiceProxies>();
+    proxies->useZookeeper(ML::format("localhost:%d", zookeeper.getPort()));
+
+    MasterBanker master(proxies);
+    master.init(make_shared<RedisBankerPersistence>(redis), config.saveInterval);
+    auto addr = master.bindTcp();
+    master.start();
+
+    vector<AccountKey> campaigns, strategies;
+    for (size_t c = 0;  c < config.campaigns;  ++c) {
+        AccountKey campaign("campaign" + to_string(c));
+        master.accounts.setBudget(campaign, USD(1000000));
+        campaigns.push_back(campaign);
+
+        for (size_t s = 0;  s < config.strategies;  ++s) {
+            AccountKey strategy = campaign.childKey("strategy" + to_string(s));
+            master.accounts.setBalance(strategy, USD(10000), AT_BUDGET);
+            strategies.push_back(strategy);
+        }
+    }
+
+    vector<unique_ptr<SlaveBanker> > slaves;
+    for (size_t i = 0;  i < config.slaves;  ++i) {
+        slaves.emplace_back(new SlaveBanker("slave" + to_string(i),
+                                            SlaveBanker::DefaultSpendRate,
+                                            config.syncRate, config.batched));
+        SlaveBanker & slave = *slaves.back();
+        slave.setApplicationLayer(make_application_layer<ZmqLayer>(proxies));
+        slave.start();
+        for (const AccountKey & strategy: strategies)
+            slave.addSpendAccountSync(strategy);
+    }
+
+    cerr << "master on " << addr.second << ", " << slaves.size()
+         << " slaves on " << strategies.size() << " accounts" << endl;
+
+    /* load */
+
+    std::atomic<bool> stop(false);
+    std::atomic<int64_t> spent(0);          // what the slaves committed
+    std::atomic<uint64_t> authorized(0), refused(0);
+
+    auto runSlave = [&] (int index)
+        {
+            SlaveBanker & slave = *slaves[index];
+            mt19937 rng(index);
+            uniform_int_distribution<size_t> accountDist(0, strategies.size() - 1);
+            uniform_real_distribution<double> unit(0.0, 1.0);
+            uniform_int_distribution<int> priceDist(100, 2000);
+
+            double interval = 1.0 / config.rate;
+            Date next = Date::now();
+
+            for (uint64_t i = 0;  !stop;  ++i) {
+                const AccountKey & account = strategies[accountDist(rng)];
+                string item = ML::format("bid%d-%lld", index, (long long)i);
+                Amount price = MicroUSD(priceDist(rng));
+
+                if (!slave.authorizeBid(account, item, price)) {
+                    ++refused;
+                }
+                else {
+                    ++authorized;
+                    if (unit(rng) < config.winRate) {
+                        Amount paid = MicroUSD(price.value / 2);
+                        slave.winBid(account, item, paid);
+                        spent += paid.value;
+                    }
+                    else slave.cancelBid(account, item);
+                }
+
+                next.addSeconds(interval);
+                double wait = next.secondsSince(Date::now());
+                if (wait > 0)
+                    ML::sleep(wait);
+            }
+        };
+
+    // Requests to the master that are unrelated to the load, to see how
+    // long the banker makes everyone else wait
+    vector<double> latencies;
+    unsigned probeErrors = 0;
+
+    auto runProbe = [&] ()
+        {
+            HttpRestProxy proxy(addr.second);
+            for (size_t i = 0;  !stop;  ++i) {
+                const AccountKey & account = strategies[i % strategies.size()];
+                ML::Timer timer;
+                auto response = proxy.get("/v1/accounts/" + account.toString()
+                                          + "/summary",
+                                          {}, {}, 5.0, false);
+                latencies.push_back(timer.elapsed_wall() * 1000.0);
+                if (response.code() != 200)
+                    ++probeErrors;
+                ML::sleep(0.01);
+            }
+        };
+
+    Redis::AsyncConnection connection(redis);
+    int64_t commandsBefore = redisCommands(connection);
+    Date start = Date::now();
+
+    vector<std::thread> threads;
+    for (size_t i = 0;  i < slaves.size();  ++i)
+        threads.emplace_back(runSlave, i);
+    threads.emplace_back(runProbe);
+
+    // How much of the slaves' spend the master hasn't seen yet
+    double maxLagUsd = 0.0, totalLagUsd = 0.0;
+    unsigned lagSamples = 0;
+
+    while (Date::now().secondsSince(start) < config.duration) {
+        ML::sleep(1.0);
+        double lag = (spent - masterSpend(master.accounts, campaigns)) / 1e6;
+        maxLagUsd = std::max(maxLagUsd, lag);
+        totalLagUsd += lag;
+        ++lagSamples;
+        cerr << ML::format("%6.1fs: authorized %lld, refused %lld, spend lag $%.4f",
+                           Date::now().secondsSince(start),
+                           (long long)authorized, (long long)refused, lag)
+             << endl;
+    }
+
+    stop = true;
+    for (auto & thread: threads)
+        thread.join();
+
+    double elapsed = Date::now().secondsSince(start);
+    int64_t commandsDuring = redisCommands(connection) - commandsBefore;
+
+    /* drain: wait for the master to have the slaves' spend */
+
+    Date stopped = Date::now();
+    double drainTime = -1;
+    while (Date::now().secondsSince(stopped) < 10 * config.syncRate + 10) {
+        if (masterSpend(master.accounts, campaigns) == spent) {
+            drainTime = Date::now().secondsSince(stopped);
+            break;
+        }
+        ML::sleep(0.05);
+    }
+
+    int64_t masterSpent = masterSpend(master.accounts, campaigns);
+
+    for (auto & slave: slaves)
+        slave->shutdown();
+
+    // Let the last save through, and read back what redis has
+    ML::sleep(2 * config.saveInterval + 1);
+
+    int64_t redisSpent = 0;
+    {
+        RedisBankerPersistence storage(redis);
+        int done = 0;
+        storage.loadAll("", [&] (shared_ptr<Accounts> accounts,
+                                 BankerPersistence::PersistenceCallbackStatus status,
+                                 const string & info)
+                        {
+                            if (status == BankerPersistence::SUCCESS)
+                                redisSpent = masterSpend(*accounts, campaigns);
+                            else cerr << "couldn't load accounts: " << info << endl;
+                            done = 1;
+                            ML::futex_wake(done);
+                        });
+        while (!done)
+            ML::futex_wait(done, 0);
+    }
+
+    master.shutdown();
+
+    /* report */
+
+    size_t numProbes = latencies.size();
+
+    cerr << endl
+         << "load:" << endl
+         << "    elapsed=" << elapsed << "s authorized=" << authorized
+         << " (" << authorized / elapsed << "/s) refused=" << refused << endl
+         << "master request latency:" << endl
+         << "    requests=" << numProbes << " errors=" << probeErrors << endl
+         << "    p50=" << percentile(latencies, 0.5) << "ms"
+         << " p99=" << percentile(latencies, 0.99) << "ms"
+         << " max=" << percentile(latencies, 1.0) << "ms" << endl
+         << "sync lag:" << endl
+         << "    spend lag avg=$" << (lagSamples ? totalLagUsd / lagSamples : 0.0)
+         << " max=$" << maxLagUsd << endl
+         << "    drain=" << (drainTime < 0 ? string("timeout")
+                             : to_string(drainTime) + "s") << endl
+         << "redis:" << endl
+         << "    commands=" << commandsDuring
+         << " (" << commandsDuring / elapsed << "/s)" << endl
+         << "lost spend:" << endl
+         << "    slaves=$" << spent / 1e6
+         << " master=$" << masterSpent / 1e6
+         << " (error $" << (spent - masterSpent) / 1e6 << ")"
+         << " redis=$" << redisSpent / 1e6
+         << " (error $" << (spent - redisSpent) / 1e6 << ")" << endl;
+
+    return masterSpent == spent && redisSpent == spent ? 0 : 1;
+}
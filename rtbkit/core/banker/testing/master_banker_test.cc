@@ -108,3 +108,51 @@ BOOST_AUTO_TEST_CASE( test_master_banker_http_headers )
 
     BOOST_CHECK_EQUAL(response.getHeader("Access-Control-Allow-Origin"), "*");
 }
+
+BOOST_AUTO_TEST_CASE( test_master_banker_batched_sync )
+{
+    auto serviceProxies = std::make_shared<ServiceProxies>();
+
+    MasterBanker testBanker(serviceProxies);
+    testBanker.init(std::make_shared<NoBankerPersistence>());
+    auto uri = testBanker.bindTcp().second;
+    testBanker.start();
+
+    testBanker.accounts.setBudget(AccountKey("campaign"), USD(10));
+    testBanker.accounts.setBalance(AccountKey("campaign:strategy"), USD(5),
+                                   AT_BUDGET);
+
+    HttpRestProxy proxy(uri);
+
+    // First sync of a new slave: only asks for its float
+    Json::Value request;
+    request["campaign:strategy:slave"]["balance"] = CurrencyPool(USD(1)).toJson();
+
+    auto response = proxy.post("/v1/accounts/sync", request);
+    BOOST_CHECK_EQUAL(response.code(), 200);
+
+    Json::Value result = response.jsonBody()["campaign:strategy:slave"];
+    BOOST_CHECK_EQUAL(CurrencyPool::fromJson(result["netBudget"]),
+                      CurrencyPool(USD(1)));
+    BOOST_CHECK_EQUAL(result["status"].asString(), "active");
+
+    // Then it reports what it spent and gets its float back
+    Json::Value sync;
+    sync["made"] = CurrencyPool(USD(0.5)).toJson();
+    sync["retired"] = CurrencyPool(USD(0.5)).toJson();
+    sync["spent"] = CurrencyPool(USD(0.25)).toJson();
+    sync["balance"] = CurrencyPool(USD(1)).toJson();
+    request["campaign:strategy:slave"] = sync;
+
+    response = proxy.post("/v1/accounts/sync", request);
+    BOOST_CHECK_EQUAL(response.code(), 200);
+
+    result = response.jsonBody()["campaign:strategy:slave"];
+    BOOST_CHECK_EQUAL(CurrencyPool::fromJson(result["netBudget"]),
+                      CurrencyPool(USD(1.25)));
+
+    Account account = testBanker.accounts.getAccount(
+            AccountKey("campaign:strategy:slave"));
+    BOOST_CHECK_EQUAL(account.spent, CurrencyPool(USD(0.25)));
+    BOOST_CHECK_EQUAL(account.balance, CurrencyPool(USD(1)));
+}
@@ -478,3 +478,65 @@ BOOST_AUTO_TEST_CASE( test_redis_persistence_archive_accounts )
 
 
 }
+
+BOOST_AUTO_TEST_CASE( test_redis_persistence_saveall_chunked )
+{
+    RedisTemporaryServer redis;
+    std::shared_ptr<AsyncConnection> connection
+        = std::make_shared<AsyncConnection>(redis);
+    RedisBankerPersistence storage(connection);
+    storage.setChunkSize(3);
+
+    int done(false);
+    BankerPersistence::PersistenceCallbackStatus lastStatus;
+    auto onSaved = [&] (const BankerPersistence::Result& result,
+                        const string & info) {
+        lastStatus = result.status;
+        done = true;
+        ML::futex_wake(done);
+    };
+
+    auto save = [&] (const Accounts & accounts) {
+        done = false;
+        storage.saveAll(accounts, onSaved);
+        while (!done) {
+            ML::futex_wait(done, false);
+        }
+    };
+
+    /* ten trees of three accounts: several MGETs, and transactions that
+       hold whole trees */
+    Accounts accounts;
+    for (int i = 0;  i < 10;  ++i) {
+        string campaign = "campaign" + to_string(i);
+        accounts.createAccount(AccountKey(campaign + ":strategy:router"),
+                               AT_SPEND);
+        accounts.setBudget(AccountKey(campaign), MicroUSD(1000 + i));
+        accounts.setBalance(AccountKey(campaign + ":strategy"),
+                            MicroUSD(100), AT_NONE);
+    }
+
+    save(accounts);
+    BOOST_CHECK_EQUAL(lastStatus, BankerPersistence::SUCCESS);
+
+    Redis::Result result = connection->exec(SMEMBERS("banker:accounts"), 5);
+    BOOST_CHECK(result.ok());
+    BOOST_CHECK_EQUAL(result.reply().length(), 30);
+
+    /* saving only the modified trees leaves the others alone */
+    accounts.takeDirtyAccounts();
+    accounts.setBalance(AccountKey("campaign7:strategy"),
+                        MicroUSD(50), AT_NONE);
+    Accounts dirty = accounts.takeDirtyAccounts();
+    BOOST_CHECK_EQUAL(dirty.size(), 3);
+    save(dirty);
+    BOOST_CHECK_EQUAL(lastStatus, BankerPersistence::SUCCESS);
+
+    for (const string & key: { "campaign1:strategy", "campaign7:strategy" }) {
+        result = connection->exec(GET("banker-" + key), 5);
+        BOOST_CHECK(result.ok());
+        Json::Value storageJson = Json::parse(result.reply().asString());
+        BOOST_CHECK_EQUAL(storageJson,
+                          accounts.getAccount(AccountKey(key)).toJson());
+    }
+}
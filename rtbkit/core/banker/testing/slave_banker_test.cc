@@ -577,3 +577,58 @@ BOOST_AUTO_TEST_CASE( test_commit_event )
     BOOST_CHECK_EQUAL(summ.spent, total);
 }
 #endif
+
+BOOST_AUTO_TEST_CASE( test_adaptive_float )
+{
+    /* An account that spends all of its float gets more of it, and one that
+       spends nothing gets less. */
+
+    ZooKeeper::TemporaryServer zookeeper;
+    zookeeper.start();
+
+    auto proxies = std::make_shared<ServiceProxies>();
+    proxies->useZookeeper(ML::format("localhost:%d", zookeeper.getPort()));
+
+    MasterBanker master(proxies);
+    master.init(make_shared<NoBankerPersistence>());
+    master.bindTcp();
+    master.start();
+
+    SlaveBudgetController slave;
+    slave.setApplicationLayer(make_application_layer<ZmqLayer>(proxies));
+    slave.start();
+    slave.addAccountSync({"hello", "fast"});
+    slave.addAccountSync({"hello", "slow"});
+    slave.setBudgetSync("hello", USD(200));
+    slave.topupTransferSync({"hello", "fast"}, USD(100));
+    slave.topupTransferSync({"hello", "slow"}, USD(100));
+
+    SlaveBanker banker("slave", USD(0.1));
+    banker.setAdaptiveFloat();
+    banker.setApplicationLayer(make_application_layer<ZmqLayer>(proxies));
+    banker.start();
+    banker.addSpendAccountSync({"hello", "fast"});
+    banker.addSpendAccountSync({"hello", "slow"});
+
+    // Fixed at the spend rate, this would be at most $0.70
+    int numBids = 0;
+    for (Date end = Date::now().plusSeconds(6.0);  Date::now() < end;) {
+        while (banker.authorizeBid({"hello", "fast"},
+                                   ML::format("bid%d", numBids), USD(0.01))) {
+            banker.winBid({"hello", "fast"}, ML::format("bid%d", numBids),
+                          USD(0.01));
+            ++numBids;
+        }
+        ML::sleep(0.05);
+    }
+
+    auto fast = banker.getAccountStateDebug({"hello", "fast"});
+    auto slow = banker.getAccountStateDebug({"hello", "slow"});
+    cerr << "fast: " << fast << endl << "slow: " << slow << endl;
+
+    BOOST_CHECK_GT(numBids, 100);
+    BOOST_CHECK_LT(slow.balance.getAvailable(CurrencyCode::CC_USD), USD(0.1));
+
+    banker.shutdown();
+    slave.shutdown();
+}
@@ -31,6 +31,25 @@ init(std::shared_ptr<ConfigurationService> & config,
                 true);
 
     RestProxy::initServiceClass(config, serviceName, "zeromq", true);
+
+    statusSubscriber.init(config);
+    statusSubscriber.messageHandler
+        = std::bind(&MonitorClient::onStatusMessage, this,
+                    std::placeholders::_1);
+    statusSubscriber.connectAllServiceProviders(serviceName, "status",
+                                                { "STATUS" });
+    addSource("MonitorClient::statusSubscriber", statusSubscriber);
+}
+
+void
+MonitorClient::
+initLocal(RestServiceEndpoint * monitor)
+{
+    addPeriodic("MonitorClient::checkStatus", 1.0,
+                std::bind(&MonitorClient::checkStatus, this),
+                true);
+
+    RestProxy::initLocal(monitor, "monitor");
 }
 
 void
@@ -45,12 +64,13 @@ void
 MonitorClient::
 checkStatus()
 {
-    if (!testMode) {
-        Guard(requestLock);
+    if (testMode || pendingRequest) return;
 
-        if (lastSuccess.plusSeconds(checkTimeout_) < Date::now()) {
-            push(onDone, "GET", "/v1/status");
-        } else ; // too soon, lastSuccess  still considered good
+    /* The status published by the Monitor keeps lastCheck recent; we only
+       query it when it went silent. */
+    if (lastCheck.seconds + checkTimeout_ < Date::now().secondsSinceEpoch()) {
+        pendingRequest = true;
+        push(onDone, "GET", "/v1/status");
     }
 }
 
@@ -63,7 +83,7 @@ onResponseReceived(exception_ptr ext, int responseCode, const string & body)
         try {
             Json::Value parsedBody = Json::parse(body);
             if (parsedBody.isMember("status") && parsedBody["status"] == "ok") {
-                lastSuccess = lastCheck;
+                lastSuccess = Date::now();
             }
         }
         catch (const Json::Exception & exc) {
@@ -71,6 +91,23 @@ onResponseReceived(exception_ptr ext, int responseCode, const string & body)
     }
 
     lastCheck = Date::now();
+    pendingRequest = false;
+}
+
+void
+MonitorClient::
+onStatusMessage(const vector<zmq::message_t> & message)
+{
+    if (message.size() < 2) {
+        LOG(error) << "invalid status message of "
+                   << message.size() << " parts" << endl;
+        return;
+    }
+
+    Date now = Date::now();
+    if (message[1].toString() == "ok")
+        lastSuccess = now;
+    lastCheck = now;
 }
 
 bool
@@ -80,7 +117,7 @@ getStatus(double tolerance)
 {
     if (testMode) return testResponse;
     ExcCheckLessEqual(checkTimeout_, tolerance / 2, "Check timeout must be less or equal to tolerance divided by two");
-    return Date::now().secondsSince(lastSuccess) < tolerance;
+    return Date::now().secondsSinceEpoch() - lastSuccess.seconds < tolerance;
 }
 
 } // RTB
@@ -5,18 +5,22 @@
 
 #pragma once
 
+#include <atomic>
 #include <mutex>
 #include <vector>
 #include "soa/types/date.h"
 #include "soa/service/rest_proxy.h"
+#include "soa/service/zmq_named_pub_sub.h"
 #include "soa/service/logs.h"
 
 namespace RTBKIT {
     using namespace Datacratic;
 
-/* This class connects to the Monitor service and queries it periodically to
+/* This class subscribes to the status that the Monitor services publish to
  * deduce whether the current service (probably the Router) can continue
- * processing its client requests. */
+ * processing its client requests.  The Monitor is only queried when nothing
+ * was heard from it for checkTimeout seconds.  The status is cached in
+ * atomics so that getStatus never blocks. */
 struct MonitorClient : public RestProxy
 {
 
@@ -29,7 +33,9 @@ struct MonitorClient : public RestProxy
                   int checkTimeout = DefaultCheckTimeout)
         : RestProxy(context),
           checkTimeout_(checkTimeout),
-          testMode(false), testResponse(false)
+          testMode(false), testResponse(false),
+          statusSubscriber(context),
+          pendingRequest(false)
     {
         onDone = std::bind(&MonitorClient::onResponseReceived, this,
                            std::placeholders::_1, std::placeholders::_2,
@@ -41,6 +47,11 @@ struct MonitorClient : public RestProxy
     void init(std::shared_ptr<ConfigurationService> & config,
               const std::string & serviceName = "monitor");
 
+    /** Query the given Monitor, which lives in the same process, directly
+        instead of through zeromq.
+    */
+    void initLocal(RestServiceEndpoint * monitor);
+
     /** shutdown the MessageLoop but make sure all requests have been
         completed beforehand. */
     void shutdown();
@@ -57,27 +68,65 @@ struct MonitorClient : public RestProxy
     /** method executed when we receive the response from the Monitor */
     void onResponseReceived(std::exception_ptr ext,
                             int responseCode, const std::string & body);
+
+    /** method executed when a Monitor publishes its status */
+    void onStatusMessage(const std::vector<zmq::message_t> & message);
     
     /** bound instance of onResponseReceived */
     RestProxy::OnDone onDone;
 
-    /** the mutex used when pendingRequest is tested and modified */
-    typedef std::unique_lock<std::mutex> Guard;
-    mutable std::mutex requestLock;
-
     /** the timeout that determines whether the last check is too old */
     int checkTimeout_;
 
-    /** the timestamp when "lastStatus" was last updated */
-    Date lastCheck;
+    /** Date that can be read and written from different threads */
+    struct AtomicDate {
+        AtomicDate()
+            : seconds(0)
+        {
+        }
+
+        AtomicDate & operator = (Date date)
+        {
+            seconds.store(date.secondsSinceEpoch(),
+                          std::memory_order_relaxed);
+            return *this;
+        }
+
+        operator Date () const
+        {
+            return Date::fromSecondsSinceEpoch(
+                    seconds.load(std::memory_order_relaxed));
+        }
+
+        bool operator == (Date date) const
+        {
+            return Date(*this) == date;
+        }
+
+        bool operator != (Date date) const
+        {
+            return !(*this == date);
+        }
+
+        std::atomic<double> seconds;
+    };
+
+    /** the timestamp when the status was last heard of */
+    AtomicDate lastCheck;
 
     /** the timestamp of the last successful check */
-    Date lastSuccess;
+    AtomicDate lastSuccess;
 
     /** helper members to make testing of dependent services easier */
     bool testMode;
     bool testResponse;
 
+    /** receives the status published by the Monitor services */
+    ZmqNamedMultipleSubscriber statusSubscriber;
+
+    /** whether a query to the Monitor is awaiting its response */
+    std::atomic<bool> pendingRequest;
+
     static Logging::Category print;
     static Logging::Category error;
     static Logging::Category trace;
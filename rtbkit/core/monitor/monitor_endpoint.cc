@@ -26,7 +26,9 @@ MonitorEndpoint(shared_ptr<ServiceProxies> proxies,
     : ServiceBase(serviceName, proxies),
       RestServiceEndpoint(proxies->zmqContext),
       checkTimeout_(10),
-      disabled(false)
+      disabled(false),
+      statusPublisher(proxies->zmqContext),
+      publishedStatus(-1)
 {
 }
 
@@ -51,6 +53,12 @@ init(const vector<string> & providerClasses)
     auto config = getServices()->config;
     config->removePath(serviceName_);
     RestServiceEndpoint::init(config, serviceName_);
+
+    statusPublisher.init(config, serviceName_ + "/status");
+    addSource("MonitorEndpoint::statusPublisher", statusPublisher);
+    addPeriodic("MonitorEndpoint::publishStatus", 1.0,
+                [=] (uint64_t) { publishStatus(true); });
+
     selfWatch.init([&](const std::string &path,
                        ConfigurationService::ChangeType change)
         {
@@ -127,6 +135,9 @@ std::pair<std::string, std::string>
 MonitorEndpoint::
 bindTcp(const std::string& host)
 {
+    statusPublisher.bindTcp(getServices()->ports->getRange("monitor.status"),
+                            host);
+
     return RestServiceEndpoint::bindTcp(
             getServices()->ports->getRange("monitor.zmq"),
             getServices()->ports->getRange("monitor.http"),
@@ -140,6 +151,8 @@ getMonitorStatus()
 {
     if (disabled) return true;
 
+    Guard guard(statusLock);
+
     // If any of the classes are sick then the system is considered sick.
     for (const auto & it : providersStatus_)
         if (!it.second.getClassStatus(checkTimeout_)) return false;
@@ -172,11 +185,13 @@ postServiceIndicators(const string & providerClass,
                       const string & indicatorsStr)
 {
     MonitorIndicator ind;
+    bool heartbeat;
 
     ML::Set_Trace_Exceptions notrace(false);
     try {
         Json::Value indJson = Json::parse(indicatorsStr);
         ind = MonitorIndicator::fromJson(indJson);
+        heartbeat = indJson.get("heartbeat", false).asBool();
         ExcCheck(!ind.serviceName.empty(), "service name can't be empty");
     }
     catch (...) {
@@ -185,19 +200,43 @@ postServiceIndicators(const string & providerClass,
         return false;
     }
 
-    MonitorProviderStatus status;
-    status.lastCheck = Date::now();
-    status.lastStatus = ind.status;
-    status.lastMessage = ind.message;
+    {
+        Guard guard(statusLock);
+        ClassStatus & classStatus = providersStatus_[providerClass];
+
+        if (heartbeat) {
+            auto it = classStatus.find(ind.serviceName);
+            if (it == classStatus.end()) return false;
+            it->second.lastCheck = Date::now();
+            it->second.lastStatus = ind.status;
+        }
+        else {
+            MonitorProviderStatus & status = classStatus[ind.serviceName];
+            status.lastCheck = Date::now();
+            status.lastStatus = ind.status;
+            status.lastMessage = ind.message;
+        }
+    }
 
-    providersStatus_[providerClass][ind.serviceName] = status;
+    publishStatus(false);
     return true;
 }
 
+void
+MonitorEndpoint::
+publishStatus(bool force)
+{
+    int status = getMonitorStatus();
+    int previous = publishedStatus.exchange(status);
+    if (force || status != previous)
+        statusPublisher.publish("STATUS", status ? "ok" : "failure");
+}
+
 void
 MonitorEndpoint::
 dump(ostream& stream) const
 {
+    Guard guard(statusLock);
     for (const auto& it: providersStatus_) {
         stream << it.first << ": " << endl;
         it.second.dump(checkTimeout_, stream);
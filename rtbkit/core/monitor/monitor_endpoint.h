@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -15,6 +17,7 @@
 #include "soa/service/service_base.h"
 #include "soa/service/rest_request_router.h"
 #include "soa/service/rest_service_endpoint.h"
+#include "soa/service/zmq_named_pub_sub.h"
 
 
 namespace RTBKIT {
@@ -40,9 +43,18 @@ struct MonitorEndpoint : public Datacratic::ServiceBase,
     /** Human readable dump of the state of the various components */
     void dump(std::ostream& stream = std::cerr) const;
 
+    /** Records the indicators posted by a provider.  A heartbeat, which has
+        "heartbeat": true, only refreshes the last indicators of a provider
+        that is already known and keeps its message.
+    */
     bool postServiceIndicators(const std::string & providerName,
                                const std::string & indicatorsStr);
 
+    /** Publishes the status on the "status" endpoint when it changed since
+        it was last published, or always when force is true.
+    */
+    void publishStatus(bool force);
+
     Datacratic::RestRequestRouter router;
     int checkTimeout_;
 
@@ -64,8 +76,22 @@ struct MonitorEndpoint : public Datacratic::ServiceBase,
 
     std::map<std::string, ClassStatus> providersStatus_;
 
+    /** Protects providersStatus_, which local providers update from their
+        own threads.
+    */
+    typedef std::unique_lock<std::mutex> Guard;
+    mutable std::mutex statusLock;
+
     bool disabled;
 
+    /** Pushes "STATUS" messages with "ok" or "failure" to the MonitorClient
+        instances, every second and as soon as the status changes.
+    */
+    Datacratic::ZmqNamedPublisher statusPublisher;
+
+    /** Last published status: 1, 0 or -1 when none was published yet. */
+    std::atomic<int> publishedStatus;
+
     Datacratic::ConfigurationService::Watch selfWatch;
 };
 
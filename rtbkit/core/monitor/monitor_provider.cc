@@ -18,8 +18,10 @@ namespace RTBKIT {
 MonitorProviderClient::
 MonitorProviderClient(const std::shared_ptr<zmq::context_t> & context)
         : MultiRestProxy(context),
-          inhibit_(false)
+          inhibit_(false),
+          resend_(true)
 {
+    connectHandler = [&] (const string &) { resend_ = true; };
 }
 
 MonitorProviderClient::
@@ -33,6 +35,7 @@ MonitorProviderClient::
 addProvider(const MonitorProvider *provider)
 {
     providers.push_back(provider);
+    lastPayloads.emplace_back();
 }
 
 void
@@ -49,6 +52,17 @@ init(std::shared_ptr<ConfigurationService> & config,
     MultiRestProxy::connectAllServiceProviders(serviceClass, "zeromq", localized);
 }
 
+void
+MonitorProviderClient::
+initLocal(RestServiceEndpoint * monitor)
+{
+    addPeriodic("MonitorProviderClient::postStatus", 1.0,
+                std::bind(&MonitorProviderClient::postStatus, this),
+                true);
+
+    MultiRestProxy::connectLocal("monitor", monitor);
+}
+
 void
 MonitorProviderClient::
 shutdown()
@@ -69,11 +83,30 @@ postStatus()
 {
     if (inhibit_) return;
 
-    for (const MonitorProvider *provider: providers) {
-        const string payload = provider->getProviderIndicators().toJson().toString();
+    bool resend = resend_.exchange(false);
+
+    auto onResponse = [=] (const string & serviceName, exception_ptr ex,
+                           int responseCode, const string & body)
+        {
+            if (ex || responseCode < 200 || responseCode >= 300)
+                resend_ = true;
+        };
+
+    for (size_t i = 0; i < providers.size(); i++) {
+        const MonitorProvider *provider = providers[i];
+        const MonitorIndicator ind = provider->getProviderIndicators();
         const string url = "/v1/services/" + provider->getProviderClass();
 
-        MultiRestProxy::OnResponse onResponse; // no-op
+        string payload = ind.toJson().toString();
+        if (!resend && payload == lastPayloads[i]) {
+            Json::Value heartbeat;
+            heartbeat["serviceName"] = ind.serviceName;
+            heartbeat["status"] = ind.status;
+            heartbeat["heartbeat"] = true;
+            payload = heartbeat.toString();
+        }
+        else lastPayloads[i] = payload;
+
         push(onResponse, "POST", url, RestParams(), payload);
     }
 }
@@ -45,6 +45,12 @@ struct MonitorProviderClient : public MultiRestProxy
             const std::string & serviceClass = "monitor",
             bool localized = true);
 
+    /** Post the status straight to the given Monitor, which lives in the
+        same process, instead of discovering and connecting to the Monitor
+        services.
+    */
+    void initLocal(RestServiceEndpoint * monitor);
+
     /** shutdown the MessageLoop but make sure all requests have been
         completed beforehand. */
     void shutdown();
@@ -53,12 +59,21 @@ struct MonitorProviderClient : public MultiRestProxy
 private:
 
     /** this method is invoked periodically to query the MonitorProvider and
-     * "POST" the result to the Monitor */
+     * "POST" the result to the Monitor.  The full indicators are only sent
+     * when they changed, the other posts are heartbeats carrying the
+     * service name and status. */
     void postStatus();
 
     /** monitored service proxy */
     std::vector<const MonitorProvider *> providers;
 
+    /** last full indicators posted for each provider */
+    std::vector<std::string> lastPayloads;
+
+    /** set when a Monitor may not have our full indicators: when it just
+     * connected or when it rejected a post */
+    std::atomic<bool> resend_;
+
     /** flag enabling the inhibition of requests to the Monitor service */
     std::atomic<bool> inhibit_;
 
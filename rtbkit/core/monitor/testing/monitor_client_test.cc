@@ -69,3 +69,39 @@ BOOST_AUTO_TEST_CASE( test_monitor_client_onResponseReceived )
     BOOST_CHECK_EQUAL(client.getStatus(), true);
 }
 
+
+BOOST_AUTO_TEST_CASE( test_monitor_client_onStatusMessage )
+{
+    Date pastDate = Date::now().plusSeconds(-10.0);
+
+    /* setup */
+    std::shared_ptr<zmq::context_t> zero_context;
+    MonitorClient client(zero_context);
+
+    auto message = [] (const string & status)
+        {
+            vector<zmq::message_t> result;
+            result.emplace_back(string("STATUS"));
+            result.emplace_back(status);
+            return result;
+        };
+
+    cerr << "test: failure status published\n=> status = false\n";
+    client.lastSuccess = pastDate;
+    client.lastCheck = pastDate;
+    client.onStatusMessage(message("failure"));
+    BOOST_CHECK_EQUAL(client.getStatus(), false);
+    BOOST_CHECK(Date(client.lastCheck) != pastDate);
+
+    cerr << "test: ok status published\n=> status = true\n";
+    client.lastSuccess = pastDate;
+    client.onStatusMessage(message("ok"));
+    BOOST_CHECK_EQUAL(client.getStatus(), true);
+
+    cerr << "test: truncated message\n=> status unchanged\n";
+    client.lastSuccess = pastDate;
+    client.lastCheck = pastDate;
+    client.onStatusMessage(vector<zmq::message_t>());
+    BOOST_CHECK_EQUAL(client.getStatus(), false);
+    BOOST_CHECK_EQUAL(Date(client.lastCheck), pastDate);
+}
@@ -137,3 +137,31 @@ BOOST_AUTO_TEST_CASE( test_monitor_postServiceIndicators )
     BOOST_CHECK_EQUAL(endpoint.providersStatus_["c1"]["s1"].lastStatus, true);
     BOOST_CHECK(endpoint.providersStatus_["c1"]["s1"].lastMessage.empty());
 }
+
+BOOST_AUTO_TEST_CASE( test_monitor_postServiceIndicators_heartbeat )
+{
+    auto proxies = std::make_shared<ServiceProxies>();
+    MonitorEndpoint endpoint(proxies);
+    endpoint.init({"c1"});
+
+    Date oldDate = Date::now().plusSeconds(-3600);
+
+    // cerr << "test: heartbeat of an unknown service\n=> rc = false\n";
+    string statusStr = "{ 'status': true, 'serviceName': 's1', 'heartbeat': true }";
+    bool rc = endpoint.postServiceIndicators("c1", statusStr);
+    BOOST_CHECK_EQUAL(rc, false);
+    BOOST_CHECK_EQUAL(endpoint.providersStatus_["c1"].count("s1"), 0);
+
+    // cerr << "test: heartbeat keeps the message\n=> rc = true\n";
+    statusStr = "{ 'status': false, 'serviceName': 's1', 'message': 'err' }";
+    rc = endpoint.postServiceIndicators("c1", statusStr);
+    BOOST_CHECK_EQUAL(rc, true);
+
+    endpoint.providersStatus_["c1"]["s1"].lastCheck = oldDate;
+    statusStr = "{ 'status': false, 'serviceName': 's1', 'heartbeat': true }";
+    rc = endpoint.postServiceIndicators("c1", statusStr);
+    BOOST_CHECK_EQUAL(rc, true);
+    BOOST_CHECK(endpoint.providersStatus_["c1"]["s1"].lastCheck != oldDate);
+    BOOST_CHECK_EQUAL(endpoint.providersStatus_["c1"]["s1"].lastStatus, false);
+    BOOST_CHECK_EQUAL(endpoint.providersStatus_["c1"]["s1"].lastMessage, "err");
+}
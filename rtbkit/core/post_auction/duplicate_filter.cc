@@ -0,0 +1,157 @@
+/** duplicate_filter.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Duplicate event filter implementation.
+
+*/
+
+#include "duplicate_filter.h"
+#include "jml/utils/exc_check.h"
+
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+using namespace std;
+
+namespace RTBKIT {
+
+/******************************************************************************/
+/* UTILS                                                                      */
+/******************************************************************************/
+
+namespace {
+
+uint64_t combine(uint64_t hash, uint64_t value)
+{
+    return Hash128to64(make_pair(hash, value));
+}
+
+/** Spreads the bits so that the block index, which comes from the high bits,
+    doesn't depend on the same bits as the positions within the block.
+*/
+uint64_t mix(uint64_t hash)
+{
+    return hash * 0x9E3779B97F4A7C15ULL;
+}
+
+} // namespace anonymous
+
+
+/******************************************************************************/
+/* DUPLICATE EVENT FILTER                                                     */
+/******************************************************************************/
+
+DuplicateEventFilter::
+DuplicateEventFilter(size_t eventsPerWindow, double window,
+                     double falsePositiveRate) :
+    eventsPerWindow(eventsPerWindow),
+    window(window),
+    currentEvents(0),
+    windowStart(Date::notADate()),
+    filtered_(0)
+{
+    ExcCheckGreater(eventsPerWindow, 0, "duplicate filter can't hold any event");
+    ExcCheckGreater(window, 0.0, "invalid duplicate filter window");
+    ExcCheck(falsePositiveRate > 0.0 && falsePositiveRate < 1.0,
+             "invalid duplicate filter false positive rate");
+
+    hashes = std::ceil(-std::log2(falsePositiveRate));
+    hashes = std::max(1U, std::min(hashes, 24U));
+
+    // Optimal bits per key for a standard bloom filter plus some slack for
+    // the uneven load of the blocks.
+    double bits = eventsPerWindow * hashes / M_LN2 * 1.2;
+    size_t blocks = std::max<size_t>(1, std::ceil(bits / Block::Bits));
+
+    current.resize(blocks);
+    previous.resize(blocks);
+    memset(current.data(), 0, blocks * sizeof(Block));
+    memset(previous.data(), 0, blocks * sizeof(Block));
+}
+
+uint64_t
+DuplicateEventFilter::
+fingerprint(const PostAuctionEvent & event)
+{
+    uint64_t hash = combine(event.auctionId.hash(), event.adSpotId.hash());
+    hash = combine(hash, event.type);
+    hash = combine(hash, std::hash<std::string>()(event.label));
+
+    double seconds = event.timestamp.secondsSinceEpoch();
+    uint64_t secondsBits;
+    memcpy(&secondsBits, &seconds, sizeof(seconds));
+    hash = combine(hash, secondsBits);
+
+    hash = combine(hash, event.winPrice.value);
+    return combine(hash, uint64_t(event.winPrice.currencyCode));
+}
+
+bool
+DuplicateEventFilter::
+test(const vector<Block> & generation, uint64_t hash) const
+{
+    const Block & block
+        = generation[((unsigned __int128) mix(hash) * generation.size()) >> 64];
+
+    uint32_t h1 = hash, h2 = (hash >> 32) | 1;
+    for (unsigned i = 0;  i < hashes;  ++i) {
+        unsigned bit = (h1 + i * h2) % Block::Bits;
+        if (!(block.words[bit / 64] & (1ULL << (bit % 64))))
+            return false;
+    }
+    return true;
+}
+
+void
+DuplicateEventFilter::
+set(vector<Block> & generation, uint64_t hash)
+{
+    Block & block
+        = generation[((unsigned __int128) mix(hash) * generation.size()) >> 64];
+
+    uint32_t h1 = hash, h2 = (hash >> 32) | 1;
+    for (unsigned i = 0;  i < hashes;  ++i) {
+        unsigned bit = (h1 + i * h2) % Block::Bits;
+        block.words[bit / 64] |= 1ULL << (bit % 64);
+    }
+}
+
+void
+DuplicateEventFilter::
+rotate(Date now)
+{
+    current.swap(previous);
+    memset(current.data(), 0, current.size() * sizeof(Block));
+
+    // Nothing came in over the last window so what we have is too old.
+    if (now.secondsSince(windowStart) >= 2 * window)
+        memset(previous.data(), 0, previous.size() * sizeof(Block));
+
+    currentEvents = 0;
+    windowStart = now;
+}
+
+bool
+DuplicateEventFilter::
+isDuplicate(const PostAuctionEvent & event, Date now)
+{
+    if (!windowStart.isADate())
+        windowStart = now;
+    else if (now.secondsSince(windowStart) >= window
+            || currentEvents >= eventsPerWindow)
+        rotate(now);
+
+    uint64_t hash = fingerprint(event);
+
+    if (test(current, hash) || test(previous, hash)) {
+        ++filtered_;
+        return true;
+    }
+
+    set(current, hash);
+    ++currentEvents;
+    return false;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,86 @@
+/** duplicate_filter.h                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Cheap detection of resent post auction events.
+
+*/
+
+#pragma once
+
+#include "rtbkit/common/auction_events.h"
+#include "soa/types/date.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace RTBKIT {
+
+/******************************************************************************/
+/* DUPLICATE EVENT FILTER                                                     */
+/******************************************************************************/
+
+/** Remembers the fingerprint of the events seen over the last window so that
+    the ones resent by the exchanges can be discarded before they go through
+    the matcher.
+
+    Two generations of a blocked bloom filter are kept: each fingerprint sets
+    its bits within a single cache line of the current generation, and the
+    current generation becomes the previous one at the end of every window
+    (or as soon as it holds more than eventsPerWindow events, so that the
+    false positive rate stays bounded). An event is therefore remembered for
+    at least one and at most two windows.
+
+    Being a bloom filter, an event that was never seen is reported as a
+    duplicate with a probability of about falsePositiveRate.
+
+    Not thread safe.
+*/
+
+struct DuplicateEventFilter
+{
+    DuplicateEventFilter(size_t eventsPerWindow,
+                         double window = 60.0,
+                         double falsePositiveRate = 1e-6);
+
+    /** Returns true if an identical event went through the filter in the
+        last window, otherwise remembers it and returns false.
+    */
+    bool isDuplicate(const PostAuctionEvent & event, Date now = Date::now());
+
+    /** Hash of the fields that identify an event: its type, ids, label,
+        timestamp and win price. */
+    static uint64_t fingerprint(const PostAuctionEvent & event);
+
+    /** Number of events reported as duplicate so far. */
+    uint64_t filtered() const { return filtered_; }
+
+    size_t numBlocks() const { return current.size(); }
+    unsigned numHashes() const { return hashes; }
+
+private:
+
+    /** One cache line worth of bits. */
+    struct Block
+    {
+        enum { Words = 8, Bits = Words * 64 };
+        uint64_t words[Words];
+    };
+
+    bool test(const std::vector<Block> & generation, uint64_t hash) const;
+    void set(std::vector<Block> & generation, uint64_t hash);
+
+    void rotate(Date now);
+
+    size_t eventsPerWindow;
+    double window;
+    unsigned hashes;
+
+    std::vector<Block> current;
+    std::vector<Block> previous;
+    size_t currentEvents;
+    Date windowStart;
+
+    uint64_t filtered_;
+};
+
+} // namespace RTBKIT
@@ -14,12 +14,28 @@
 #include "soa/service/typed_message_channel.h"
 #include "rtbkit/common/auction_events.h"
 
+#include <deque>
+#include <fstream>
+
 namespace RTBKIT {
 
 /******************************************************************************/
 /* EVENT FORWARDER                                                            */
 /******************************************************************************/
 
+/** Relays the auctions and events to another post auction service over its
+    REST interface.
+
+    By default every auction and event is posted on its own. When batching is
+    enabled they're instead grouped into a single request to the batch routes
+    of the destination, up to maxSize of them or whatever came in over
+    maxDelay seconds. At most maxInFlight batches are posted at a time so that
+    a slow destination doesn't grow an unbounded backlog in the http client;
+    the batches that have to wait are held in memory, up to maxPending of them,
+    and then appended to spillPath to be sent once the destination caught up.
+    Without spillPath, they're dropped instead. Batches read back from the
+    spill file don't keep their order with the ones held in memory.
+ */
 struct EventForwarder :
         public Datacratic::ServiceBase,
         public Datacratic::MessageLoop
@@ -30,24 +46,44 @@ struct EventForwarder :
         EventQueueSize = 1 << 8,
     };
 
+    struct Batching
+    {
+        Batching() :
+            maxSize(0), maxDelay(0.01), maxInFlight(ConnectionCount),
+            maxPending(1 << 12)
+        {}
+
+        bool enabled() const { return maxSize > 1; }
+
+        size_t maxSize;
+        double maxDelay;
+        size_t maxInFlight;
+        size_t maxPending;
+        std::string spillPath;
+    };
+
     EventForwarder(
             Datacratic::ServiceBase & parent,
-            std::string uri, std::string name) :
+            std::string uri, std::string name,
+            Batching batching = Batching()) :
         ServiceBase(std::move(name), parent),
         client(std::move(uri), ConnectionCount),
         auctionQueue(AuctionQueueSize),
-        eventQueue(EventQueueSize)
+        eventQueue(EventQueueSize),
+        batching(std::move(batching))
     {
         init();
     }
 
     EventForwarder(
             std::shared_ptr<Datacratic::ServiceProxies>& proxies,
-            std::string uri, std::string name) :
+            std::string uri, std::string name,
+            Batching batching = Batching()) :
         ServiceBase(std::move(name), proxies),
         client(std::move(uri), ConnectionCount),
         auctionQueue(AuctionQueueSize),
-        eventQueue(EventQueueSize)
+        eventQueue(EventQueueSize),
+        batching(std::move(batching))
     {
         init();
     }
@@ -89,22 +125,38 @@ private:
         addSource("PostAuctionService::EventForwarder::auctionQueue", auctionQueue);
         addSource("PostAuctionService::EventForwarder::eventQueue", eventQueue);
 
+        inFlight = spilled = 0;
+
+        if (batching.enabled()) {
+            auctionBatch.endpoint = "auctions";
+            eventBatch.endpoint = "events";
+
+            addPeriodic("PostAuctionService::EventForwarder::flush",
+                        std::min(batching.maxDelay, 0.1),
+                        [=] (uint64_t) { this->flushExpired(); });
+        }
+
         MessageLoop::start();
     }
 
     template<typename T>
-    void send(const std::string& endpoint, const T& obj)
+    static std::string toJson(const T& obj)
     {
-        recordHit("%s.send", endpoint);
-        Date start = Date::now();
-
         static auto desc = getDefaultDescriptionShared((T*) 0);
 
-        std::stringstream stream;
-        Datacratic::StreamJsonPrintingContext ctx(stream);
+        std::string result;
+        Datacratic::StringJsonPrintingContext ctx(result);
         desc->printJson(&obj, ctx);
+        return result;
+    }
 
-        HttpRequest::Content body(stream.str(), "application/json");
+    template<typename T>
+    void send(const std::string& endpoint, const T& obj)
+    {
+        recordHit("%s.send", endpoint);
+        Date start = Date::now();
+
+        HttpRequest::Content body(toJson(obj), "application/json");
 
         auto onDone = [=] (const HttpRequest&, HttpClientError err) {
             if (err != HttpClientError::None) {
@@ -123,17 +175,196 @@ private:
 
     void sendAuction(std::shared_ptr<SubmittedAuctionEvent> auction)
     {
-        send("auctions", *auction);
+        if (batching.enabled()) add(auctionBatch, toJson(*auction));
+        else send("auctions", *auction);
     }
 
     void sendEvent(std::shared_ptr<PostAuctionEvent> event)
     {
-        send("events", *event);
+        if (batching.enabled()) add(eventBatch, toJson(*event));
+        else send("events", *event);
+    }
+
+
+    /************************************************************************/
+    /* BATCHING                                                             */
+    /************************************************************************/
+
+    /** JSON array of the objects for one of the batch routes. */
+    struct Batch
+    {
+        Batch() : count(0) {}
+
+        std::string endpoint;
+        std::string body;
+        size_t count;
+        Date oldest;
+    };
+
+    void add(Batch& batch, std::string json)
+    {
+        if (!batch.count) {
+            batch.body = "[";
+            batch.oldest = Date::now();
+        }
+        else batch.body += ',';
+
+        batch.body += json;
+        if (++batch.count >= batching.maxSize) flush(batch);
+    }
+
+    void flush(Batch& batch)
+    {
+        if (!batch.count) return;
+
+        batch.body += ']';
+        recordLevel(batch.count, "%s.batchSize", batch.endpoint);
+        post(batch.endpoint, std::move(batch.body), batch.count);
+
+        batch.body.clear();
+        batch.count = 0;
+    }
+
+    void flushExpired()
+    {
+        Date now = Date::now();
+        for (Batch* batch : { &auctionBatch, &eventBatch }) {
+            if (batch->count && now.secondsSince(batch->oldest) >= batching.maxDelay)
+                flush(*batch);
+        }
+
+        drain();
+
+        recordLevel(inFlight, "batches.inFlight");
+        recordLevel(pending.size(), "batches.pending");
+        recordLevel(spilled, "batches.spilled");
+    }
+
+    struct Pending
+    {
+        std::string endpoint;
+        std::string body;
+        size_t count;
+    };
+
+    /** Batches wait their turn behind the ones already held back so that
+        at most maxInFlight of them are with the http client at any time. */
+    void post(const std::string& endpoint, std::string body, size_t count)
+    {
+        if (pending.size() < batching.maxPending)
+            pending.push_back({ endpoint, std::move(body), count });
+        else if (!spill(endpoint, body))
+            recordCount(count, "%s.dropped", endpoint);
+
+        drain();
+    }
+
+    void postNow(const std::string& endpoint, std::string body, size_t count)
+    {
+        recordHit("%s.send", endpoint);
+        Date start = Date::now();
+        ++inFlight;
+
+        auto onDone = [=] (const HttpRequest&, HttpClientError err) {
+            --inFlight;
+
+            if (err != HttpClientError::None)
+                recordHit("%s.error", endpoint);
+            else {
+                recordHit("%s.success", endpoint);
+                recordOutcome(Date::now().secondsSince(start), "%s.latency", endpoint);
+            }
+
+            this->drain();
+        };
+
+        auto cb = std::make_shared<HttpClientCallbacks>(nullptr, nullptr, nullptr, onDone);
+
+        HttpRequest::Content content(std::move(body), "application/json");
+        client.post("/v1/" + endpoint + "/batch", cb, content,
+                    RestParams(), RestParams(), 1);
+    }
+
+    /** Moves the held back batches, oldest first, to the http client until
+        we're back to maxInFlight. */
+    void drain()
+    {
+        while (inFlight < batching.maxInFlight && !pending.empty()) {
+            Pending next = std::move(pending.front());
+            pending.pop_front();
+            postNow(next.endpoint, std::move(next.body), next.count);
+        }
+
+        while (inFlight < batching.maxInFlight && spilled) {
+            std::string endpoint, body;
+            if (!unspill(endpoint, body)) break;
+            postNow(endpoint, std::move(body), 0);
+        }
+    }
+
+    /** One line per batch: the endpoint, a tab and the body, which is JSON
+        and so can't contain a newline. */
+    bool spill(const std::string& endpoint, const std::string& body)
+    {
+        if (batching.spillPath.empty()) return false;
+
+        if (!spillOut.is_open())
+            spillOut.open(batching.spillPath, std::ios::out | std::ios::trunc);
+
+        spillOut << endpoint << '\t' << body << '\n';
+        spillOut.flush();
+        if (!spillOut) {
+            recordHit("spill.error");
+            return false;
+        }
+
+        recordHit("%s.spilled", endpoint);
+        ++spilled;
+        return true;
+    }
+
+    bool unspill(std::string& endpoint, std::string& body)
+    {
+        if (!spillIn.is_open())
+            spillIn.open(batching.spillPath);
+
+        std::string line;
+        if (!std::getline(spillIn, line)) {
+            spillIn.clear();
+            return false;
+        }
+
+        --spilled;
+        if (!spilled) {
+            // Everything was read back so start the file over.
+            spillIn.close();
+            spillOut.close();
+        }
+
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos) {
+            recordHit("spill.corrupt");
+            return spilled && unspill(endpoint, body);
+        }
+
+        endpoint = line.substr(0, tab);
+        body = line.substr(tab + 1);
+        return true;
     }
 
     HttpClient client;
     TypedMessageSink< std::shared_ptr< SubmittedAuctionEvent> > auctionQueue;
     TypedMessageSink< std::shared_ptr< PostAuctionEvent> > eventQueue;
+
+    Batching batching;
+    Batch auctionBatch;
+    Batch eventBatch;
+    size_t inFlight;
+
+    std::deque<Pending> pending;
+    size_t spilled;
+    std::ofstream spillOut;
+    std::ifstream spillIn;
 };
 
 
@@ -31,16 +31,43 @@ struct EventMatcher : public EventRecorder
         DefaultWinTimeout = 1 * 60 * 60
     };
 
+    /** How much of each auction is held on to while waiting for its win and
+        campaign events.
+    */
+    enum Retention
+    {
+        /// The whole bid request, as received from the router.
+        RetainFullRequest,
+
+        /// Only the fields needed to match the events, with the bid request
+        /// and augmentations LZ4 compressed for the matched events.
+        RetainPackedRequest,
+
+        /// Only the fields needed to match the events; the matched events
+        /// have no bid request or augmentations.
+        RetainMatchingOnly
+    };
+
+    static Retention parseRetention(const std::string & name)
+    {
+        if (name == "full") return RetainFullRequest;
+        if (name == "packed") return RetainPackedRequest;
+        if (name == "matching") return RetainMatchingOnly;
+        throw ML::Exception("unknown auction retention '%s'", name.c_str());
+    }
+
     EventMatcher(std::string prefix, std::shared_ptr<EventService> events) :
         EventRecorder(prefix, std::move(events)),
         auctionTimeout(DefaultAuctionTimeout),
-        winTimeout(DefaultWinTimeout)
+        winTimeout(DefaultWinTimeout),
+        retention(RetainFullRequest)
     {}
 
     EventMatcher(std::string prefix, std::shared_ptr<ServiceProxies> proxies) :
         EventRecorder(prefix, std::move(proxies)),
         auctionTimeout(DefaultAuctionTimeout),
-        winTimeout(DefaultWinTimeout)
+        winTimeout(DefaultWinTimeout),
+        retention(RetainFullRequest)
     {}
 
     virtual void start() {}
@@ -71,6 +98,16 @@ struct EventMatcher : public EventRecorder
         banker = newBanker;
     }
 
+    /** Hold back up to maxCommits commits, cancels and wins for the banker
+        and hand them over together with Banker::commitBids().  Whatever is
+        held back goes out on the next flushBanker().  0 or 1 sends each one
+        as it happens, which is the default.
+    */
+    virtual void setBankerBatching(size_t maxCommits) {}
+
+    /** Hand the commits held back to the banker.  Called periodically. */
+    virtual void flushBanker() {}
+
     /**************************************************************************/
     /* TIMEOUTS                                                               */
     /**************************************************************************/
@@ -91,6 +128,12 @@ struct EventMatcher : public EventRecorder
         auctionTimeout = timeout;
     }
 
+    /** Only applies to the auctions that come in from now on. */
+    virtual void setRetention(Retention newRetention)
+    {
+        retention = newRetention;
+    }
+
 
     /************************************************************************/
     /* EVENT MATCHING                                                       */
@@ -145,6 +188,7 @@ protected:
 
     float auctionTimeout;
     float winTimeout;
+    Retention retention;
 
     std::shared_ptr<Banker> banker;
 
@@ -44,10 +44,10 @@ initFinishedInfo(const FinishedInfo& info)
     winPrice = info.winPrice;
     rawWinPrice = info.rawWinPrice;
     response = info.bid;
-    requestStr = info.bidRequestStr;
+    requestStr = info.getBidRequestStr();
     requestStrFormat = info.bidRequestStrFormat;
     meta = info.winMeta;
-    augmentations = info.augmentations;
+    augmentations = info.getAugmentations();
 }
 
 void
@@ -152,14 +152,14 @@ MatchedCampaignEvent(std::string label, const FinishedInfo& info) :
     impId(info.adSpotId),
     impIndex(info.spotIndex),
     account(info.bid.account),
-    requestStr(info.bidRequestStr),
+    requestStr(info.getBidRequestStr()),
     requestStrFormat(info.bidRequestStrFormat),
     response(info.bid),
     bid(info.bidToJson()),
     win(info.winToJson()),
     campaignEvents(info.campaignEvents.toJson()),
     visits(info.visitsToJson()),
-    augmentations(info.augmentations)
+    augmentations(info.getAugmentations())
 {
     auto it = std::find_if(info.campaignEvents.begin(), info.campaignEvents.end(),
                     [&](const CampaignEvent& event) {
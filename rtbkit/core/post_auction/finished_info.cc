@@ -17,6 +17,22 @@ namespace RTBKIT {
 /* FINISHED INFO                                                             */
 /*****************************************************************************/
 
+Datacratic::UnicodeString
+FinishedInfo::
+getBidRequestStr() const
+{
+    if (packedBidRequestStr.empty()) return bidRequestStr;
+    return Datacratic::UnicodeString(packedBidRequestStr.unpack());
+}
+
+JsonHolder
+FinishedInfo::
+getAugmentations() const
+{
+    if (packedAugmentations.empty()) return augmentations;
+    return JsonHolder(packedAugmentations.unpack());
+}
+
 Json::Value
 FinishedInfo::
 bidToJson() const
@@ -100,4 +116,52 @@ reconstitute(DB::Store_Reader & store)
 
 IMPL_SERIALIZE_RECONSTITUTE(FinishedInfo::Visit);
 
+void
+FinishedInfo::
+serialize(DB::Store_Writer & store) const
+{
+    unsigned char version = 1;
+    store << version << auctionTime << auctionId << adSpotId << spotIndex
+          << bidRequestStr << bidRequestStrFormat << augmentations
+          << packedBidRequestStr << packedAugmentations
+          << uids << visitChannels << bidTime;
+    bid.serialize(store);
+    store << winTime << int(reportedStatus) << winPrice << rawWinPrice
+          << winMeta;
+
+    store << DB::compact_size_t(campaignEvents.size());
+    for (const CampaignEvent & event : campaignEvents)
+        event.serialize(store);
+
+    store << visits << fromOldRouter;
+}
+
+void
+FinishedInfo::
+reconstitute(DB::Store_Reader & store)
+{
+    unsigned char version;
+    store >> version;
+    if (version != 1)
+        throw ML::Exception("invalid version");
+
+    store >> auctionTime >> auctionId >> adSpotId >> spotIndex
+          >> bidRequestStr >> bidRequestStrFormat >> augmentations
+          >> packedBidRequestStr >> packedAugmentations
+          >> uids >> visitChannels >> bidTime;
+    bid.reconstitute(store);
+
+    int status;
+    store >> winTime >> status >> winPrice >> rawWinPrice >> winMeta;
+    reportedStatus = BidStatus(status);
+
+    DB::compact_size_t numEvents(store);
+    campaignEvents.clear();
+    campaignEvents.resize(numEvents);
+    for (CampaignEvent & event : campaignEvents)
+        event.reconstitute(store);
+
+    store >> visits >> fromOldRouter;
+}
+
 } // namepsace RTBKIT
@@ -11,6 +11,7 @@
 #include "rtbkit/common/auction.h"
 #include "rtbkit/common/auction_events.h"
 #include "soa/types/string.h"
+#include "packed_string.h"
 
 #include <memory>
 
@@ -40,6 +41,16 @@ struct FinishedInfo {
     Datacratic::UnicodeString bidRequestStr;
     std::string bidRequestStrFormat;
     JsonHolder augmentations;
+
+    /** When the auction's submission was packed (see
+        EventMatcher::Retention), bidRequestStr and augmentations are empty
+        and these hold them instead, if anything.
+    */
+    PackedString packedBidRequestStr;
+    PackedString packedAugmentations;
+
+    Datacratic::UnicodeString getBidRequestStr() const;
+    JsonHolder getAugmentations() const;
     std::set<Id> uids;                ///< All UIDs for this user
 
     /** The set of channels that are associated with this request.  They
@@ -128,7 +139,12 @@ struct FinishedInfo {
     Json::Value toJson() const;
 
     bool fromOldRouter;
+
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
 };
 
+IMPL_SERIALIZE_RECONSTITUTE(FinishedInfo);
+
 
 } // namespace RTBKIT
@@ -0,0 +1,368 @@
+/** matcher_journal.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Matcher journal implementation.
+
+*/
+
+#include "matcher_journal.h"
+#include "jml/db/persistent.h"
+#include "jml/arch/timers.h"
+#include "jml/utils/exc_assert.h"
+#include "leveldb/db.h"
+#include "leveldb/write_batch.h"
+
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using namespace ML;
+
+namespace RTBKIT {
+
+/******************************************************************************/
+/* UTILS                                                                      */
+/******************************************************************************/
+
+namespace {
+
+enum { ValueVersion = 1 };
+
+/** Prefix of the keys that follows the table byte.  Big endian so that the
+    keys sort on the hash.
+*/
+void appendHash(std::string & str, uint64_t hash)
+{
+    for (int shift = 56;  shift >= 0;  shift -= 8)
+        str += char((hash >> shift) & 0xff);
+}
+
+template<typename Info>
+std::string encodeValue(const Info & info, Date timeout)
+{
+    ostringstream stream;
+    {
+        DB::Store_Writer store(stream);
+        store << (unsigned char)ValueVersion << timeout << info;
+    }
+    return stream.str();
+}
+
+template<typename Info>
+void decodeValue(const leveldb::Slice & value, Info & info, Date & timeout)
+{
+    istringstream stream(value.ToString());
+    DB::Store_Reader store(stream);
+
+    unsigned char version;
+    store >> version;
+    if (version != ValueVersion)
+        throw ML::Exception("unknown matcher journal version %d", int(version));
+
+    store >> timeout >> info;
+}
+
+template<typename Info>
+struct Recovered
+{
+    MatcherJournal::Key key;
+    Info info;
+    Date timeout;
+};
+
+} // namespace anonymous
+
+
+/******************************************************************************/
+/* MATCHER JOURNAL                                                            */
+/******************************************************************************/
+
+MatcherJournal::
+MatcherJournal(size_t queueSize, size_t batchSize) :
+    queue(queueSize),
+    batchSize(batchSize),
+    shutdown_(false),
+    written_(0),
+    dropped_(0)
+{
+}
+
+MatcherJournal::
+~MatcherJournal()
+{
+    shutdown();
+}
+
+void
+MatcherJournal::
+open(const std::string & path)
+{
+    leveldb::DB* result;
+    leveldb::Options options;
+    options.create_if_missing = true;
+
+    leveldb::Status status = leveldb::DB::Open(options, path, &result);
+    if (!status.ok())
+        throw ML::Exception("opening matcher journal %s: %s",
+                            path.c_str(), status.ToString().c_str());
+    db.reset(result);
+}
+
+void
+MatcherJournal::
+start()
+{
+    ExcCheck(db, "matcher journal isn't open");
+    ExcCheck(!writer, "matcher journal already started");
+
+    shutdown_ = false;
+    writer.reset(new std::thread([=] () { this->runWriter(); }));
+}
+
+void
+MatcherJournal::
+shutdown()
+{
+    if (!writer) return;
+
+    shutdown_ = true;
+    writer->join();
+    writer.reset();
+}
+
+std::string
+MatcherJournal::
+encodeKey(Table table, const Key & key)
+{
+    if (!key.second || key.second.type == Id::NULLID)
+        throw ML::Exception("attempt to store null ID");
+
+    std::string result(1, char(table));
+    appendHash(result, Hash128to64(make_pair(key.first.hash(), key.second.hash())));
+
+    ostringstream stream;
+    {
+        DB::Store_Writer store(stream);
+        store << key.first << key.second;
+    }
+    return result + stream.str();
+}
+
+MatcherJournal::Key
+MatcherJournal::
+decodeKey(const std::string & str)
+{
+    ExcCheckGreater(str.size(), 9, "matcher journal key is too short");
+
+    istringstream stream(str.substr(9));
+    DB::Store_Reader store(stream);
+    Key result;
+    store >> result.first >> result.second;
+    return result;
+}
+
+bool
+MatcherJournal::
+push(Op && op)
+{
+    if (queue.tryPush(std::move(op))) return true;
+
+    ++dropped_;
+    return false;
+}
+
+bool
+MatcherJournal::
+putSubmitted(const Key & key, const SubmissionInfo & info, Date timeout)
+{
+    Op op;
+    op.table = SubmittedTable;
+    op.key = key;
+    op.timeout = timeout;
+    op.submission = std::make_shared<SubmissionInfo>(info);
+    return push(std::move(op));
+}
+
+bool
+MatcherJournal::
+eraseSubmitted(const Key & key)
+{
+    Op op;
+    op.table = SubmittedTable;
+    op.key = key;
+    return push(std::move(op));
+}
+
+bool
+MatcherJournal::
+putFinished(const Key & key, const FinishedInfo & info, Date timeout)
+{
+    Op op;
+    op.table = FinishedTable;
+    op.key = key;
+    op.timeout = timeout;
+    op.finished = std::make_shared<FinishedInfo>(info);
+    return push(std::move(op));
+}
+
+bool
+MatcherJournal::
+eraseFinished(const Key & key)
+{
+    Op op;
+    op.table = FinishedTable;
+    op.key = key;
+    return push(std::move(op));
+}
+
+void
+MatcherJournal::
+runWriter()
+{
+    std::vector<Op> ops;
+    ops.reserve(batchSize);
+
+    for (;;) {
+        // Read before draining so that everything queued before shutdown()
+        // makes it out.
+        bool stopping = shutdown_;
+
+        ops.clear();
+        queue.popBatch([&] (Op && op) { ops.push_back(std::move(op)); },
+                       batchSize);
+
+        if (ops.empty()) {
+            if (stopping) break;
+            ML::sleep(0.005);
+            continue;
+        }
+
+        leveldb::WriteBatch batch;
+        size_t bad = 0;
+
+        for (const Op & op : ops) {
+            try {
+                std::string key = encodeKey(op.table, op.key);
+                if (op.submission)
+                    batch.Put(key, encodeValue(*op.submission, op.timeout));
+                else if (op.finished)
+                    batch.Put(key, encodeValue(*op.finished, op.timeout));
+                else batch.Delete(key);
+            } catch (const std::exception & exc) {
+                cerr << "matcher journal couldn't write entry: "
+                     << exc.what() << endl;
+                ++bad;
+            }
+        }
+
+        leveldb::Status status = db->Write(leveldb::WriteOptions(), &batch);
+        if (!status.ok()) {
+            cerr << "matcher journal write failed: " << status.ToString() << endl;
+            dropped_ += ops.size();
+            continue;
+        }
+
+        written_ += ops.size() - bad;
+        dropped_ += bad;
+    }
+}
+
+size_t
+MatcherJournal::
+recover(const OnSubmitted & onSubmitted,
+        const OnFinished & onFinished,
+        unsigned numThreads)
+{
+    ExcCheck(db, "matcher journal isn't open");
+    ExcCheck(!writer, "can't recover a running matcher journal");
+
+    numThreads = std::max(1U, std::min(numThreads, 256U));
+
+    struct Part
+    {
+        std::vector<Recovered<SubmissionInfo> > submitted;
+        std::vector<Recovered<FinishedInfo> > finished;
+        std::vector<std::string> corrupt;
+    };
+
+    std::vector<Part> parts(numThreads);
+    const leveldb::Snapshot * snapshot = db->GetSnapshot();
+
+    // Each thread gets a range of the first byte of the hash in both tables.
+    auto readPart = [&] (unsigned index)
+        {
+            Part & part = parts[index];
+
+            leveldb::ReadOptions options;
+            options.snapshot = snapshot;
+            options.fill_cache = false;
+            std::unique_ptr<leveldb::Iterator> it(db->NewIterator(options));
+
+            unsigned first = index * 256 / numThreads;
+            unsigned last = (index + 1) * 256 / numThreads;
+
+            for (char table : { char(SubmittedTable), char(FinishedTable) }) {
+                std::string begin = std::string(1, table) + char(first);
+                std::string end = last == 256
+                    ? std::string(1, table + 1)
+                    : std::string(1, table) + char(last);
+
+                for (it->Seek(begin);
+                     it->Valid() && it->key().compare(end) < 0;
+                     it->Next())
+                {
+                    std::string key = it->key().ToString();
+                    try {
+                        if (table == SubmittedTable) {
+                            Recovered<SubmissionInfo> entry;
+                            entry.key = decodeKey(key);
+                            decodeValue(it->value(), entry.info, entry.timeout);
+                            part.submitted.emplace_back(std::move(entry));
+                        }
+                        else {
+                            Recovered<FinishedInfo> entry;
+                            entry.key = decodeKey(key);
+                            decodeValue(it->value(), entry.info, entry.timeout);
+                            part.finished.emplace_back(std::move(entry));
+                        }
+                    } catch (const std::exception & exc) {
+                        part.corrupt.push_back(key);
+                    }
+                }
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1;  i < numThreads;  ++i)
+        threads.emplace_back(readPart, i);
+    readPart(0);
+    for (auto & thread : threads) thread.join();
+
+    db->ReleaseSnapshot(snapshot);
+
+    size_t recovered = 0;
+    leveldb::WriteBatch corrupt;
+
+    for (Part & part : parts) {
+        for (auto & entry : part.submitted)
+            onSubmitted(entry.key, entry.info, entry.timeout);
+        for (auto & entry : part.finished)
+            onFinished(entry.key, entry.info, entry.timeout);
+        recovered += part.submitted.size() + part.finished.size();
+
+        for (const std::string & key : part.corrupt)
+            corrupt.Delete(key);
+        if (!part.corrupt.empty())
+            cerr << "matcher journal dropped " << part.corrupt.size()
+                 << " unreadable entries" << endl;
+    }
+
+    leveldb::Status status = db->Write(leveldb::WriteOptions(), &corrupt);
+    if (!status.ok())
+        throw ML::Exception("matcher journal cleanup failed: "
+                            + status.ToString());
+
+    return recovered;
+}
+
+} // namespace RTBKIT
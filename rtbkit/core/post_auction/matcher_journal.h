@@ -0,0 +1,142 @@
+/** matcher_journal.h                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Durable copy of the auctions held by an event matcher.
+
+*/
+
+#pragma once
+
+#include "submission_info.h"
+#include "finished_info.h"
+#include "jml/utils/ring_buffer.h"
+#include "soa/types/date.h"
+#include "soa/types/id.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace leveldb { class DB; }
+
+namespace RTBKIT {
+
+/******************************************************************************/
+/* MATCHER JOURNAL                                                            */
+/******************************************************************************/
+
+/** Keeps a leveldb copy of an event matcher's submitted and finished maps so
+    that they survive a restart.
+
+    The matcher thread only queues up its changes, along with a copy of the
+    entry, and never waits on the disk: if the queue is full the change is
+    dropped and the put methods return false.  A writer thread serializes
+    the queued changes and writes them to leveldb in batches, which appends
+    them to its log and lets its compactions drop the erased entries.
+
+    Entries are keyed on a hash of their (auction id, spot id) so that
+    recover() can split the key space evenly between its threads.
+*/
+
+struct MatcherJournal
+{
+    typedef std::pair<Id, Id> Key;
+
+    enum {
+        DefaultQueueSize = 1 << 16,
+        DefaultBatchSize = 1 << 10
+    };
+
+    MatcherJournal(size_t queueSize = DefaultQueueSize,
+                   size_t batchSize = DefaultBatchSize);
+    ~MatcherJournal();
+
+    /** Open or create the database in the given directory. */
+    void open(const std::string & path);
+
+    void start();
+
+    /** Writes out whatever is still queued before stopping the writer. */
+    void shutdown();
+
+
+    /************************************************************************/
+    /* WRITES                                                               */
+    /************************************************************************/
+
+    bool putSubmitted(const Key & key, const SubmissionInfo & info, Date timeout);
+    bool eraseSubmitted(const Key & key);
+
+    bool putFinished(const Key & key, const FinishedInfo & info, Date timeout);
+    bool eraseFinished(const Key & key);
+
+
+    /************************************************************************/
+    /* RECOVERY                                                             */
+    /************************************************************************/
+
+    typedef std::function<void (const Key &, SubmissionInfo &, Date)> OnSubmitted;
+    typedef std::function<void (const Key &, FinishedInfo &, Date)> OnFinished;
+
+    /** Read back everything in the database, with the entries decoded on
+        numThreads threads.  The callbacks are called on the calling thread
+        once all of the entries have been read.  Entries that can't be
+        decoded are removed from the database.
+
+        Must be called after open() and before start().  Returns the number
+        of entries that were recovered.
+    */
+    size_t recover(const OnSubmitted & onSubmitted,
+                   const OnFinished & onFinished,
+                   unsigned numThreads = 4);
+
+
+    /************************************************************************/
+    /* STATS                                                                */
+    /************************************************************************/
+
+    /** Changes written to the database. */
+    uint64_t written() const { return written_; }
+
+    /** Changes lost because the queue was full or the write failed. */
+    uint64_t dropped() const { return dropped_; }
+
+private:
+
+    enum Table : char {
+        SubmittedTable = 's',
+        FinishedTable = 'f'
+    };
+
+    /** An erase if it has neither a submission nor a finished info. */
+    struct Op
+    {
+        Op() : table(SubmittedTable) {}
+
+        Table table;
+        Key key;
+        Date timeout;
+        std::shared_ptr<const SubmissionInfo> submission;
+        std::shared_ptr<const FinishedInfo> finished;
+    };
+
+    bool push(Op && op);
+    void runWriter();
+
+    static std::string encodeKey(Table table, const Key & key);
+    static Key decodeKey(const std::string & str);
+
+    std::shared_ptr<leveldb::DB> db;
+
+    ML::RingBufferMPSC<Op> queue;
+    size_t batchSize;
+
+    std::unique_ptr<std::thread> writer;
+    std::atomic<bool> shutdown_;
+
+    std::atomic<uint64_t> written_;
+    std::atomic<uint64_t> dropped_;
+};
+
+} // namespace RTBKIT
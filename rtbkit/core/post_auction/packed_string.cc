@@ -0,0 +1,97 @@
+/** packed_string.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Packed string implementation.
+
+*/
+
+#include "packed_string.h"
+#include "jml/utils/lz4.h"
+#include "jml/arch/exception.h"
+#include "jml/db/persistent.h"
+
+#include <limits>
+
+using namespace std;
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* PACKED STRING                                                              */
+/******************************************************************************/
+
+void
+PackedString::
+pack(const std::string & str)
+{
+    if (str.size() > std::numeric_limits<int>::max())
+        throw ML::Exception("string of %zu bytes is too large to pack",
+                            str.size());
+
+    size_ = str.size();
+    raw_ = false;
+    if (str.empty()) {
+        data_.reset();
+        return;
+    }
+
+    std::string packed(LZ4_compressBound(str.size()), '\0');
+    int len = LZ4_compress(str.data(), &packed[0], str.size());
+
+    if (len <= 0 || size_t(len) >= str.size()) {
+        raw_ = true;
+        data_ = make_shared<std::string>(str);
+        return;
+    }
+
+    packed.resize(len);
+    packed.shrink_to_fit();
+    data_ = make_shared<std::string>(std::move(packed));
+}
+
+std::string
+PackedString::
+unpack() const
+{
+    if (empty()) return std::string();
+    if (raw_) return *data_;
+
+    std::string result(size_, '\0');
+    int len = LZ4_decompress_safe(data_->data(), &result[0],
+                                  data_->size(), size_);
+    if (len < 0 || uint32_t(len) != size_)
+        throw ML::Exception("corrupt packed string");
+
+    return result;
+}
+
+void
+PackedString::
+serialize(ML::DB::Store_Writer & store) const
+{
+    unsigned char version = 1;
+    store << version << size_ << raw_;
+    if (!empty())
+        store << *data_;
+}
+
+void
+PackedString::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    unsigned char version;
+    store >> version;
+    if (version != 1)
+        throw ML::Exception("invalid version");
+
+    store >> size_ >> raw_;
+    data_.reset();
+    if (!empty()) {
+        std::string data;
+        store >> data;
+        data_ = make_shared<std::string>(std::move(data));
+    }
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,55 @@
+/** packed_string.h                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    LZ4 compressed string for the data the post auction loop holds on to.
+
+*/
+
+#pragma once
+
+#include "jml/db/persistent_fwd.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace RTBKIT {
+
+/******************************************************************************/
+/* PACKED STRING                                                              */
+/******************************************************************************/
+
+/** Immutable compressed copy of a string.  The compressed bytes are shared
+    between copies, so copying a submission or finished info in and out of
+    its timeout map doesn't copy the bid request along with it.
+*/
+
+struct PackedString
+{
+    PackedString() : size_(0), raw_(false) {}
+    explicit PackedString(const std::string & str) { pack(str); }
+
+    void pack(const std::string & str);
+    std::string unpack() const;
+
+    bool empty() const { return size_ == 0; }
+
+    /** Size of the original string. */
+    size_t size() const { return size_; }
+
+    /** Bytes actually held. */
+    size_t packedSize() const { return data_ ? data_->size() : 0; }
+
+    /** Written as is, without unpacking. */
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
+
+private:
+    std::shared_ptr<const std::string> data_;
+    uint32_t size_;
+    bool raw_;    ///< didn't compress, so data_ is the string itself
+};
+
+IMPL_SERIALIZE_RECONSTITUTE(PackedString);
+
+} // namespace RTBKIT
@@ -5,6 +5,10 @@ LIB_POST_AUCTION_SOURCES := \
 	sharded_event_matcher.cc \
 	events.cc \
 	finished_info.cc \
+	submission_info.cc \
+	packed_string.cc \
+	matcher_journal.cc \
+	duplicate_filter.cc \
 	post_auction_service.cc
 
 LIB_POST_AUCTION_LINK := \
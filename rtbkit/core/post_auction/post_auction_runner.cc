@@ -11,10 +11,12 @@
 #include "rtbkit/core/banker/local_banker.h"
 #include "rtbkit/core/banker/split_banker.h"
 #include "rtbkit/core/banker/null_banker.h"
+#include "rtbkit/common/auction_trace.h"
 #include "soa/service/service_utils.h"
 #include "soa/service/process_stats.h"
 #include "soa/utils/print_utils.h"
 #include "jml/utils/file_functions.h"
+#include "jml/arch/rt.h"
 
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/parsers.hpp>
@@ -41,15 +43,23 @@ static Json::Value loadJsonFromFile(const std::string & filename)
 PostAuctionRunner::
 PostAuctionRunner() :
     shard(0),
+    matcherShards(1),
     auctionTimeout(EventMatcher::DefaultAuctionTimeout),
     winTimeout(EventMatcher::DefaultWinTimeout),
+    auctionRetention("full"),
+    duplicateFilterSize(0),
+    duplicateFilterWindow(60.0),
+    bankerBatchSize(0),
     bidderConfigurationFile("rtbkit/examples/bidder-config.json"),
     analyticsConfigurationFile(""),
     winLossPipeTimeout(PostAuctionService::DefaultWinLossPipeTimeout),
     campaignEventPipeTimeout(PostAuctionService::DefaultCampaignEventPipeTimeout),
     analyticsPublisherOn(false),
     analyticsPublisherConnections(1),
-    localBankerDebug(false)
+    forwardBatchSize(0),
+    forwardBatchDelay(0.01),
+    localBankerDebug(false),
+    traceSampling(0)
 {
 }
 
@@ -68,10 +78,31 @@ doOptions(int argc, char ** argv,
          "configuration file for analytics")
         ("shard,s", value<size_t>(&shard),
          "Shard index starting at 0 for this post auction loop")
+        ("matcher-shards", value<size_t>(&matcherShards),
+         "number of threads to spread the event matching over "
+         "(1 matches on the main loop)")
+        ("matcher-affinity", value<string>(&matcherAffinity),
+         "CPUs to pin the matcher shards to, one per shard, as a list like "
+         "0-3,8 or node:N for the CPUs of a NUMA node")
         ("win-seconds", value<float>(&winTimeout),
          "Timeout for storing win auction")
         ("auction-seconds", value<float>(&auctionTimeout),
          "Timeout to get late win auction")
+        ("auction-retention", value<string>(&auctionRetention),
+         "what to keep of each auction until its events come in: full (the "
+         "whole bid request), packed (the matching fields and a compressed "
+         "copy of the request) or matching (only the matching fields)")
+        ("state-path", value<string>(&statePath),
+         "directory in which to keep the auctions being matched so that they "
+         "survive a restart; they're only kept in memory when not given")
+        ("duplicate-filter-size", value<size_t>(&duplicateFilterSize),
+         "number of events to remember to discard the ones that are resent; "
+         "0 lets all of them through")
+        ("duplicate-filter-seconds", value<double>(&duplicateFilterWindow),
+         "how long to remember the events for when discarding duplicates")
+        ("banker-batch", value<size_t>(&bankerBatchSize),
+         "hand the commits of the matched bids to the banker in batches of "
+         "up to this many, at least every 10ms; 0 commits them one by one")
         ("winlossPipe-seconds", value<int>(&winLossPipeTimeout),
          "Timeout before sending error on WinLoss pipe")
         ("campaignEventPipe-seconds", value<int>(&campaignEventPipeTimeout),
@@ -82,12 +113,24 @@ doOptions(int argc, char ** argv,
          "Number of connections for the analytics publisher.")
         ("forward-auctions", value<std::string>(&forwardAuctionsUri),
          "When provided the PAL will forward all auctions to the given URI.")
+        ("forward-batch-size", value<size_t>(&forwardBatchSize),
+         "number of auctions to forward per request (0 sends them one by one)")
+        ("forward-batch-seconds", value<double>(&forwardBatchDelay),
+         "longest time an auction waits for its batch to be forwarded")
+        ("forward-spill-path", value<string>(&forwardSpillPath),
+         "file in which to keep the batches that can't be forwarded as fast "
+         "as they come in; they're dropped when not given")
         ("local-banker", value<string>(&localBankerUri),
          "address of where the local banker can be found.")
         ("local-banker-debug", bool_switch(&localBankerDebug),
          "enable local banker debug for more precise tracking by account")
         ("banker-choice", value<string>(&bankerChoice),
-         "split or local banker can be chosen.");
+         "split or local banker can be chosen.")
+        ("trace-sampling", value<uint32_t>(&traceSampling),
+         "trace the stages of one auction in this many; 0 disables it. "
+         "Must be the same in the router and the post auction loop")
+        ("trace-file", value<string>(&traceFile),
+         "file to which the auction traces are appended");
 
     options_description all_opt = opts;
     all_opt
@@ -124,20 +167,34 @@ init()
     if (!analyticsConfigurationFile.empty())
         analyticsConfig = loadJsonFromFile(analyticsConfigurationFile);
 
+    if (!traceFile.empty())
+        AuctionTrace::setSink(serviceName, AuctionTrace::fileSink(traceFile));
+    AuctionTrace::setSampling(traceSampling);
+
     postAuctionLoop = std::make_shared<PostAuctionService>(proxies, serviceName);
     postAuctionLoop->initBidderInterface(bidderConfig);
     postAuctionLoop->initAnalytics(analyticsConfig);
-    postAuctionLoop->init(shard);
+    if (!matcherAffinity.empty())
+        postAuctionLoop->setMatcherShardAffinity(ML::parseCpuList(matcherAffinity));
+    postAuctionLoop->init(shard, matcherShards);
 
     postAuctionLoop->setWinTimeout(winTimeout);
     postAuctionLoop->setAuctionTimeout(auctionTimeout);
+    postAuctionLoop->setAuctionRetention(
+            EventMatcher::parseRetention(auctionRetention));
     postAuctionLoop->setWinLossPipeTimeout(winLossPipeTimeout);
     postAuctionLoop->setCampaignEventPipeTimeout(campaignEventPipeTimeout);
+    postAuctionLoop->setDuplicateFilter(duplicateFilterSize, duplicateFilterWindow);
+    postAuctionLoop->setBankerBatching(bankerBatchSize);
 
     LOG(print) << "win timeout is " << winTimeout << std::endl;
     LOG(print) << "auction timeout is " << auctionTimeout << std::endl;
+    LOG(print) << "auction retention is " << auctionRetention << std::endl;
     LOG(print) << "winLoss pipe timeout is " << winLossPipeTimeout << std::endl;
     LOG(print) << "campaignEvent pipe timeout is " << campaignEventPipeTimeout << std::endl;
+    if (duplicateFilterSize)
+        LOG(print) << "filtering duplicates out of the last "
+                   << duplicateFilterSize << " events" << std::endl;
 
     if (localBankerUri != "") {
         localBanker = make_shared<LocalBanker>(proxies, POST_AUCTION, postAuctionLoop->serviceName());
@@ -174,6 +231,11 @@ init()
     }
     postAuctionLoop->setBanker(banker);
 
+    if (!statePath.empty()) {
+        LOG(print) << "persisting the auctions in " << statePath << std::endl;
+        postAuctionLoop->initStatePersistence(statePath);
+    }
+
     if (analyticsPublisherOn) {
         const auto & analyticsPublisherUri = proxies->params["analytics-uri"].asString();
         if (!analyticsPublisherUri.empty()) {
@@ -186,7 +248,8 @@ init()
     postAuctionLoop->bindTcp();
 
     if (!forwardAuctionsUri.empty())
-        postAuctionLoop->forwardAuctions(forwardAuctionsUri);
+        postAuctionLoop->forwardAuctions(forwardAuctionsUri, forwardBatchSize,
+                                         forwardBatchDelay, forwardSpillPath);
 }
 
 void
@@ -29,8 +29,15 @@ struct PostAuctionRunner {
     SlaveBankerArguments bankerArgs;
 
     size_t shard;
+    size_t matcherShards;
+    std::string matcherAffinity;
     float auctionTimeout;
     float winTimeout;
+    std::string auctionRetention;
+    std::string statePath;
+    size_t duplicateFilterSize;
+    double duplicateFilterWindow;
+    size_t bankerBatchSize;
     std::string bidderConfigurationFile;
     std::string analyticsConfigurationFile;
 
@@ -40,9 +47,14 @@ struct PostAuctionRunner {
     int analyticsPublisherConnections;
 
     std::string forwardAuctionsUri;
+    size_t forwardBatchSize;
+    double forwardBatchDelay;
+    std::string forwardSpillPath;
     std::string localBankerUri;
     bool localBankerDebug;
     std::string bankerChoice;
+    uint32_t traceSampling;
+    std::string traceFile;
 
     void doOptions(int argc, char ** argv,
                    const boost::program_options::options_description & opts
@@ -14,6 +14,7 @@
 #include "soa/service/rest_request_params.h"
 #include "soa/service/rest_request_binding.h"
 #include "rtbkit/common/analytics.h"
+#include "rtbkit/common/auction_trace.h"
 
 using namespace std;
 using namespace Datacratic;
@@ -38,6 +39,8 @@ PostAuctionService(
 
       auctionTimeout(EventMatcher::DefaultAuctionTimeout),
       winTimeout(EventMatcher::DefaultWinTimeout),
+      retention(EventMatcher::RetainFullRequest),
+      bankerBatchSize(0),
       winLossPipeTimeout(DefaultWinLossPipeTimeout),
       campaignEventPipeTimeout(DefaultCampaignEventPipeTimeout),
 
@@ -54,7 +57,8 @@ PostAuctionService(
 
       totalEvents(0),
       orphanEvents(0),
-      orphanRatios(30, 0)
+      orphanRatios(30, 0),
+      localMonitor(nullptr)
 {
     monitorProviderClient.addProvider(this);
 }
@@ -65,6 +69,8 @@ PostAuctionService(ServiceBase & parent, const std::string & serviceName)
 
       auctionTimeout(EventMatcher::DefaultAuctionTimeout),
       winTimeout(EventMatcher::DefaultWinTimeout),
+      retention(EventMatcher::RetainFullRequest),
+      bankerBatchSize(0),
 
       loopMonitor(*this),
       configListener(getZmqContext()),
@@ -79,7 +85,8 @@ PostAuctionService(ServiceBase & parent, const std::string & serviceName)
 
       totalEvents(0),
       orphanEvents(0),
-      orphanRatios(30, 0)
+      orphanRatios(30, 0),
+      localMonitor(nullptr)
 {
     monitorProviderClient.addProvider(this);
 }
@@ -124,7 +131,8 @@ init(size_t externalShard, size_t internalShards)
     initMatcher(internalShards);
     initConnections(externalShard);
     initRestEndpoint();
-    monitorProviderClient.init(getServices()->config);
+    if (localMonitor) monitorProviderClient.initLocal(localMonitor);
+    else monitorProviderClient.init(getServices()->config);
 
     auto checkOrphans = [=] (double) {
         double ratio = 0;
@@ -166,6 +174,7 @@ initMatcher(size_t shards)
         ShardedEventMatcher* m;
         matcher.reset(m = new ShardedEventMatcher(serviceName(), getServices()));
         m->init(shards);
+        m->setShardAffinity(matcherShardAffinity);
         loop.addSource("PostAuctionService::matcher", *m);
     }
 
@@ -185,6 +194,8 @@ initMatcher(size_t shards)
 
     matcher->setWinTimeout(winTimeout);
     matcher->setAuctionTimeout(auctionTimeout);
+    matcher->setRetention(retention);
+    matcher->setBankerBatching(bankerBatchSize);
 }
 
 
@@ -214,9 +225,11 @@ initConnections(size_t shard)
     endpoint.init(getServices()->config, ZMQ_XREP, serviceName() + "/events");
 
     router.bind("AUCTION", std::bind(&PostAuctionService::doAuctionMessage, this, _1));
+    router.bind("AUCTIONS", std::bind(&PostAuctionService::doAuctionsMessage, this, _1));
     router.bind("WIN", std::bind(&PostAuctionService::doWinMessage, this, _1));
     router.bind("LOSS", std::bind(&PostAuctionService::doLossMessage, this,_1));
     router.bind("EVENT", std::bind(&PostAuctionService::doCampaignEventMessage, this, _1));
+    router.bind("EVENTS", std::bind(&PostAuctionService::doEventsMessage, this, _1));
     router.defaultHandler = [=](const std::vector<std::string> & message) {
         LOG(error) << "unroutable message: " << message[0] << std::endl;
     };
@@ -242,6 +255,15 @@ initConnections(size_t shard)
     // Every second we check for expired auctions
     loop.addPeriodic("PostAuctionService::checkExpiredAuctions", 0.1,
             std::bind(&EventMatcher::checkExpiredAuctions, matcher.get()));
+
+    loop.addPeriodic("PostAuctionService::flushBanker", 0.01,
+            std::bind(&EventMatcher::flushBanker, matcher.get()));
+
+    loop.addPeriodic("PostAuctionService::flushTrace", 1.0,
+            [] (uint64_t) { AuctionTrace::flush(); });
+
+    loop.addPeriodic("PostAuctionService::hugePageStats", 1.0,
+            [=] (uint64_t) { recordHugePageStats(); });
 }
 
 void
@@ -260,6 +282,7 @@ initAnalytics(const Json::Value & config)
 
     Analytics::Factory factory = PluginInterface<Analytics>::getPlugin(pluginName);
     analytics.reset(factory(serviceName(), getServices()));
+    analytics->configure(config);
 }
 
 void
@@ -285,6 +308,9 @@ initRestEndpoint()
 
     auto & versionNode = restRouter->addSubRouter("/v1", "version 1 of API");
 
+    addEventSamplerRoutes(versionNode, "/eventSampling",
+                          getServices()->eventSampler);
+
     addRouteSync(
             versionNode,
             "/auctions",
@@ -303,18 +329,66 @@ initRestEndpoint()
             this,
             JsonParam< std::shared_ptr< PostAuctionEvent> >("", "event to submit"));
 
+    typedef std::vector< std::shared_ptr<SubmittedAuctionEvent> > Auctions;
+    addRouteSync(
+            versionNode,
+            "/auctions/batch",
+            {"POST"},
+            "Submit a batch of auctions to the PAL",
+            &PostAuctionService::doAuctions,
+            this,
+            JsonParam<Auctions>("", "auctions to submit"));
+
+    typedef std::vector< std::shared_ptr<PostAuctionEvent> > Events;
+    addRouteSync(
+            versionNode,
+            "/events/batch",
+            {"POST"},
+            "Submit a batch of events to the PAL",
+            &PostAuctionService::doEvents,
+            this,
+            JsonParam<Events>("", "events to submit"));
+
     addSource("PostAuctionService::restEndpoint", *restEndpoint);
 }
 
 void
 PostAuctionService::
-forwardAuctions(const std::string& uri)
+forwardAuctions(const std::string& uri,
+                size_t batchSize, double batchDelay,
+                const std::string& spillPath)
 {
     ExcAssert(!forwarder);
     ExcCheck(!uri.empty(), "empty forwarding uri");
 
+    EventForwarder::Batching batching;
+    batching.maxSize = batchSize;
+    batching.maxDelay = batchDelay;
+    batching.spillPath = spillPath;
+
     LOG(print) << "forwarding all bids to: " << uri << endl;
-    forwarder.reset(new EventForwarder(*this, uri, "forwarder"));
+    if (batching.enabled())
+        LOG(print) << "forwarding in batches of " << batchSize << endl;
+
+    forwarder.reset(new EventForwarder(*this, uri, "forwarder", batching));
+}
+
+void
+PostAuctionService::
+doAuctions(std::vector< std::shared_ptr<SubmittedAuctionEvent> > auctions)
+{
+    recordLevel(auctions.size(), "batches.auctions");
+    for (auto& auction : auctions)
+        doAuction(std::move(auction));
+}
+
+void
+PostAuctionService::
+doEvents(std::vector< std::shared_ptr<PostAuctionEvent> > events)
+{
+    recordLevel(events.size(), "batches.events");
+    for (auto& event : events)
+        doEvent(std::move(event));
 }
 
 
@@ -335,9 +409,11 @@ void
 PostAuctionService::
 shutdown()
 {
-    matcher->shutdown();
     loopMonitor.shutdown();
     loop.shutdown();
+
+    // After the loop so that the journal gets the matcher's last changes.
+    matcher->shutdown();
     if (analytics) analytics->shutdown();
     bridge.shutdown();
     endpoint.shutdown();
@@ -380,6 +456,19 @@ doAuctionMessage(const std::vector<std::string> & message)
     doAuction(std::move(event));
 }
 
+void
+PostAuctionService::
+doAuctionsMessage(const std::vector<std::string> & message)
+{
+    recordHit("messages.AUCTIONS");
+    recordLevel(message.at(2).size(), "messages.AUCTIONS.bytes");
+
+    auto auctions = decodeSubmittedAuctions(message.at(2));
+    recordLevel(auctions.size(), "messages.AUCTIONS.size");
+    for (auto & auction: auctions)
+        doAuction(std::move(auction));
+}
+
 void
 PostAuctionService::
 doWinMessage(const std::vector<std::string> & message)
@@ -410,6 +499,21 @@ doCampaignEventMessage(const std::vector<std::string> & message)
     doEvent(event);
 }
 
+void
+PostAuctionService::
+doEventsMessage(const std::vector<std::string> & message)
+{
+    recordHit("messages.EVENTS");
+    recordLevel(message.size() - 2, "messages.EVENTS.size");
+
+    for (size_t i = 2; i < message.size(); ++i) {
+        auto event = std::make_shared<PostAuctionEvent>(
+                ML::DB::reconstituteFromString<PostAuctionEvent>(message[i]));
+        recordHit(std::string("messages.") + RTBKIT::print(event->type));
+        doEvent(event);
+    }
+}
+
 
 void
 PostAuctionService::
@@ -527,6 +631,12 @@ PostAuctionService::
 doEvent(std::shared_ptr<PostAuctionEvent> event)
 {
     stats.events++;
+
+    if (duplicates && duplicates->isDuplicate(*event)) {
+        recordHit("duplicateEvents." + std::string(RTBKIT::print(event->type)));
+        return;
+    }
+
     matcher->doEvent(std::move(event));
 }
 
@@ -542,6 +652,9 @@ void
 PostAuctionService::
 doMatchedWinLoss(std::shared_ptr<MatchedWinLoss> event)
 {
+    AuctionTrace::record(event->auctionId,
+                         event->type == MatchedWinLoss::Loss ? AS_LOSS : AS_WIN);
+
     if (event->type == MatchedWinLoss::Win || event->type == MatchedWinLoss::LateWin) {
         lastWinLoss = Date::now();
         stats.matchedWins++;
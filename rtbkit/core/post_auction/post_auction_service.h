@@ -9,6 +9,7 @@
 #pragma once
 
 #include "event_matcher.h"
+#include "duplicate_filter.h"
 #include "rtbkit/core/monitor/monitor_provider.h"
 #include "rtbkit/core/agent_configuration/agent_configuration_listener.h"
 #include "rtbkit/common/bidder_interface.h"
@@ -81,6 +82,14 @@ struct PostAuctionService : public ServiceBase, public MonitorProvider
         monitorProviderClient.addProvider(banker.get());
     }
 
+    /** Post our status to the given Monitor, which lives in the same process,
+        directly instead of through zeromq.  Must be called before init().
+    */
+    void setLocalMonitor(RestServiceEndpoint * monitor)
+    {
+        localMonitor = monitor;
+    }
+
 
     /**************************************************************************/
     /* TIMEOUTS                                                               */
@@ -120,6 +129,46 @@ struct PostAuctionService : public ServiceBase, public MonitorProvider
         campaignEventPipeTimeout = timeout;
     }
 
+    /** How much of each auction the matcher keeps around while waiting for
+        its events; see EventMatcher::Retention.
+    */
+    void setAuctionRetention(EventMatcher::Retention newRetention)
+    {
+        retention = newRetention;
+        if (matcher) matcher->setRetention(newRetention);
+    }
+
+    /** Hand the matcher's banker commits over in batches of up to
+        maxCommits, flushed at least every 10ms; see
+        EventMatcher::setBankerBatching().  Must be set before init().
+    */
+    void setBankerBatching(size_t maxCommits)
+    {
+        bankerBatchSize = maxCommits;
+    }
+
+    /** CPUs to pin the threads of the matcher's shards to, one CPU per
+        shard (see ShardedEventMatcher::setShardAffinity).  Only used with
+        more than one internal shard, and must be set before init().
+    */
+    void setMatcherShardAffinity(const std::vector<int> & cpus)
+    {
+        matcherShardAffinity = cpus;
+    }
+
+    /** Discard the events that are identical to one received over the last
+        window seconds before they get to the matcher (see
+        DuplicateEventFilter).  The filter is sized for eventsPerWindow
+        events; 0 disables it, which is the default.
+    */
+    void setDuplicateFilter(size_t eventsPerWindow, double window = 60.0,
+                            double falsePositiveRate = 1e-6)
+    {
+        if (!eventsPerWindow) duplicates.reset();
+        else duplicates.reset(new DuplicateEventFilter(
+                        eventsPerWindow, window, falsePositiveRate));
+    }
+
 
     /************************************************************************/
     /* EVENT MATCHING                                                       */
@@ -183,10 +232,13 @@ struct PostAuctionService : public ServiceBase, public MonitorProvider
     /* PERSISTENCE                                                          */
     /************************************************************************/
 
+    /** Keep the matcher's auctions in a journal under the given directory
+        and restore whatever it already holds.  Must be called after init()
+        and before start().
+    */
     void initStatePersistence(const std::string & path)
     {
-        throw ML::Exception(
-                "post auction service persistence is not yet implemented.");
+        matcher->initStatePersistence(path);
     }
 
 
@@ -223,7 +275,21 @@ struct PostAuctionService : public ServiceBase, public MonitorProvider
     /* MISC                                                                 */
     /************************************************************************/
 
-    void forwardAuctions(const std::string& uri);
+    /** Relay all the auctions to the post auction service at the given
+        uri. With a batchSize above 1 they're sent in batches, each one
+        waiting at most batchDelay seconds, and the batches the destination
+        can't keep up with overflow to spillPath if given (see
+        EventForwarder).
+    */
+    void forwardAuctions(const std::string& uri,
+                         size_t batchSize = 0,
+                         double batchDelay = 0.01,
+                         const std::string& spillPath = "");
+
+    /** Handle the batches relayed by the EventForwarder of another post
+        auction service. */
+    void doAuctions(std::vector< std::shared_ptr<SubmittedAuctionEvent> > auctions);
+    void doEvents(std::vector< std::shared_ptr<PostAuctionEvent> > events);
     
 private:
 
@@ -245,6 +311,10 @@ private:
     /** Decode from zeromq and handle a new auction that came in. */
     void doAuctionMessage(const std::vector<std::string> & message);
 
+    /** Decode from zeromq and handle a batch of auctions, as encoded by
+        encodeSubmittedAuctions() in a batching PostAuctionProxy. */
+    void doAuctionsMessage(const std::vector<std::string> & message);
+
     /** Decode from zeromq and handle a new auction that came in. */
     void doWinMessage(const std::vector<std::string> & message);
 
@@ -255,6 +325,10 @@ private:
      * in. */
     void doCampaignEventMessage(const std::vector<std::string> & message);
 
+    /** Decode from zeromq and handle a batch of wins, losses and campaign
+        events, one per frame, as sent by a batching PostAuctionProxy. */
+    void doEventsMessage(const std::vector<std::string> & message);
+
     void doConfigChange(
             const std::string & agent,
             std::shared_ptr<const AgentConfig> config);
@@ -272,6 +346,8 @@ private:
 
     float auctionTimeout;
     float winTimeout;
+    EventMatcher::Retention retention;
+    size_t bankerBatchSize;
 
     int winLossPipeTimeout;
     int campaignEventPipeTimeout;
@@ -283,12 +359,14 @@ private:
     LoopMonitor loopMonitor;
 
     std::unique_ptr<EventMatcher> matcher;
+    std::vector<int> matcherShardAffinity;
+    std::unique_ptr<DuplicateEventFilter> duplicates;
     std::shared_ptr<Banker> banker;
     AgentConfigurationListener configListener;
     MonitorProviderClient monitorProviderClient;
 
-    TypedMessageSink<std::shared_ptr<SubmittedAuctionEvent> > auctions;
-    TypedMessageSink<std::shared_ptr<PostAuctionEvent> > events;
+    TypedMessageRingSink<std::shared_ptr<SubmittedAuctionEvent> > auctions;
+    TypedMessageRingSink<std::shared_ptr<PostAuctionEvent> > events;
 
     std::unique_ptr<Analytics> analytics;
     ZmqNamedEndpoint endpoint;
@@ -309,6 +387,9 @@ private:
     size_t orphanEvents;
     std::vector<double> orphanRatios;
 
+    /** Monitor in the same process, if any; see setLocalMonitor(). */
+    RestServiceEndpoint * localMonitor;
+
 };
 
 } // namespace RTBKIT
@@ -11,6 +11,9 @@
 
 #include "sharded_event_matcher.h"
 
+#include <sys/stat.h>
+#include <errno.h>
+
 using namespace std;
 using namespace ML;
 
@@ -29,8 +32,8 @@ Logging::Category ShardedEventMatcher::trace("ShardedEventMatcher Trace", Sharde
 ShardedEventMatcher::
 ShardedEventMatcher(std::string prefix, std::shared_ptr<EventService> events) :
     EventMatcher(std::move(prefix), std::move(events)),
-    matchedWinLossEvents(1 << 10),
-    matchedCampaignEvents(1 << 8),
+    matchedWinLossEvents(1 << 12),
+    matchedCampaignEvents(1 << 10),
     unmatchedEvents(1 << 4),
     errorEvents(1 << 4)
 {}
@@ -39,8 +42,8 @@ ShardedEventMatcher(std::string prefix, std::shared_ptr<EventService> events) :
 ShardedEventMatcher::
 ShardedEventMatcher(std::string prefix, std::shared_ptr<ServiceProxies> proxies) :
     EventMatcher(std::move(prefix), std::move(proxies)),
-    matchedWinLossEvents(1 << 10),
-    matchedCampaignEvents(1 << 8),
+    matchedWinLossEvents(1 << 12),
+    matchedCampaignEvents(1 << 10),
     unmatchedEvents(1 << 4),
     errorEvents(1 << 4)
 {}
@@ -48,15 +51,15 @@ ShardedEventMatcher(std::string prefix, std::shared_ptr<ServiceProxies> proxies)
 ShardedEventMatcher::Shard::
 Shard(std::string prefix, std::shared_ptr<EventService> events) :
     matcher(std::move(prefix), std::move(events)),
-    auctions(1 << 8),
-    events(1 << 6)
+    auctions(1 << 12),
+    events(1 << 12)
 {}
 
 ShardedEventMatcher::Shard::
 Shard(std::string prefix, std::shared_ptr<ServiceProxies> proxies) :
     matcher(std::move(prefix), std::move(proxies)),
-    auctions(1 << 8),
-    events(1 << 6)
+    auctions(1 << 12),
+    events(1 << 12)
 {}
 
 void
@@ -122,6 +125,9 @@ init(size_t shard, ShardedEventMatcher* parent)
     addPeriodic("ShardedEventMatcher::checkExpiredAuctions", 0.1,
             std::bind(&SimpleEventMatcher::checkExpiredAuctions, &matcher));
 
+    addPeriodic("ShardedEventMatcher::flushBanker", 0.01,
+            std::bind(&SimpleEventMatcher::flushBanker, &matcher));
+
 
 
     matcher.onMatchedWinLoss = [=] (std::shared_ptr<MatchedWinLoss> event) {
@@ -153,6 +159,13 @@ setBanker(const std::shared_ptr<Banker> & newBanker)
     for (auto& shard : shards) shard->matcher.setBanker(newBanker);
 }
 
+void
+ShardedEventMatcher::
+setBankerBatching(size_t maxCommits)
+{
+    for (auto& shard : shards) shard->matcher.setBankerBatching(maxCommits);
+}
+
 void
 ShardedEventMatcher::
 setWinTimeout(float timeout)
@@ -167,6 +180,36 @@ setAuctionTimeout(float timeout)
     for (auto& shard : shards) shard->matcher.setAuctionTimeout(timeout);
 }
 
+void
+ShardedEventMatcher::
+setRetention(Retention newRetention)
+{
+    EventMatcher::setRetention(newRetention);
+    for (auto& shard : shards) shard->matcher.setRetention(newRetention);
+}
+
+void
+ShardedEventMatcher::
+initStatePersistence(const std::string & path)
+{
+    // leveldb only creates the last directory of the path
+    if (::mkdir(path.c_str(), 0755) == -1 && errno != EEXIST)
+        throw ML::Exception(errno, "couldn't create " + path);
+
+    for (size_t i = 0; i < shards.size(); ++i)
+        shards[i]->matcher.initStatePersistence(path + "/shard" + std::to_string(i));
+}
+
+
+void
+ShardedEventMatcher::
+setShardAffinity(const std::vector<int> & cpus)
+{
+    for (size_t i = 0; i < shards.size(); ++i) {
+        if (cpus.empty()) shards[i]->setThreadAffinity({});
+        else shards[i]->setThreadAffinity({ cpus[i % cpus.size()] });
+    }
+}
 
 void
 ShardedEventMatcher::
@@ -180,8 +223,10 @@ void
 ShardedEventMatcher::
 shutdown()
 {
-    for (size_t i = 0; i < shards.size(); ++i)
+    for (size_t i = 0; i < shards.size(); ++i) {
         shards[i]->shutdown();
+        shards[i]->matcher.shutdown();
+    }
 }
 
 
@@ -189,7 +234,17 @@ ShardedEventMatcher::Shard&
 ShardedEventMatcher::
 shard(const Id& auctionId)
 {
-    return *shards[auctionId.hash() % shards.size()];
+    return *shards[shardIndex(auctionId, shards.size())];
+}
+
+size_t
+ShardedEventMatcher::
+shardIndex(const Id& auctionId, size_t numShards)
+{
+    // PostAuctionProxy picks the loop with hash() % loops; taking the same
+    // modulo here would leave shards idle when the two counts share a factor.
+    static constexpr uint64_t Salt = 0x9ae16a3b2f90404fULL;
+    return Hash128to64(std::make_pair(auctionId.hash(), Salt)) % numShards;
 }
 
 void
@@ -29,12 +29,29 @@ struct ShardedEventMatcher : public EventMatcher, public MessageLoop
     ShardedEventMatcher(std::string prefix, std::shared_ptr<ServiceProxies> proxies);
 
     void init(size_t shards);
+
+    /** Pin each shard's thread to one of the given CPUs, round robin, so
+        that a shard's auctions stay in a single core's cache.  Must be
+        called between init() and start(); an empty list lets the shards
+        run anywhere.
+    */
+    void setShardAffinity(const std::vector<int> & cpus);
+
     void start();
     void shutdown();
 
     virtual void setBanker(const std::shared_ptr<Banker> & newBanker);
+
+    /** Each shard batches its own commits and flushes them on its thread. */
+    virtual void setBankerBatching(size_t maxCommits);
     virtual void setWinTimeout(float timeout);
     virtual void setAuctionTimeout(float timeout);
+    virtual void setRetention(Retention newRetention);
+
+    /** Each shard keeps its own journal in the shard<n> subdirectory of
+        path, so the number of shards must stay the same across restarts.
+    */
+    virtual void initStatePersistence(const std::string & path);
 
 
     /************************************************************************/
@@ -50,6 +67,14 @@ struct ShardedEventMatcher : public EventMatcher, public MessageLoop
     /** Periodic auction expiry. */
     virtual void checkExpiredAuctions() {}
 
+    /** Shard of an auction.  Only depends on the id and the number of
+        shards so it's the same from one run to the next, and is mixed
+        differently from the hash that the routers use to pick a post
+        auction loop so that each loop still spreads over all of its
+        shards.
+    */
+    static size_t shardIndex(const Id & auctionId, size_t numShards);
+
 private:
 
     struct Shard : public MessageLoop
@@ -59,17 +84,17 @@ private:
         void init(size_t shard, ShardedEventMatcher* parent);
 
         SimpleEventMatcher matcher;
-        TypedMessageSink<std::shared_ptr<SubmittedAuctionEvent> > auctions;
-        TypedMessageSink<std::shared_ptr<PostAuctionEvent> > events;
+        TypedMessageRingSink<std::shared_ptr<SubmittedAuctionEvent> > auctions;
+        TypedMessageRingSink<std::shared_ptr<PostAuctionEvent> > events;
     };
 
     std::vector< std::unique_ptr<Shard> > shards;
     Shard& shard(const Id& auctionId);
 
-    TypedMessageSink<std::shared_ptr<MatchedWinLoss> > matchedWinLossEvents;
-    TypedMessageSink<std::shared_ptr<MatchedCampaignEvent> > matchedCampaignEvents;
-    TypedMessageSink<std::shared_ptr<UnmatchedEvent> > unmatchedEvents;
-    TypedMessageSink<std::shared_ptr<PostAuctionErrorEvent> > errorEvents;
+    TypedMessageRingSink<std::shared_ptr<MatchedWinLoss> > matchedWinLossEvents;
+    TypedMessageRingSink<std::shared_ptr<MatchedCampaignEvent> > matchedCampaignEvents;
+    TypedMessageRingSink<std::shared_ptr<UnmatchedEvent> > unmatchedEvents;
+    TypedMessageRingSink<std::shared_ptr<PostAuctionErrorEvent> > errorEvents;
 
     static Logging::Category print;
     static Logging::Category error;
@@ -9,7 +9,9 @@
 #include "simple_event_matcher.h"
 #include "jml/utils/guard.h"
 
+#include <algorithm>
 #include <iostream>
+#include <thread>
 
 using namespace std;
 using namespace Datacratic;
@@ -39,9 +41,9 @@ namespace RTBKIT {
 
 namespace {
 
-template<typename Value>
+template<typename Value, template<typename> class Allocator>
 bool findAuction(
-        TimeoutMap<pair<Id,Id>, Value> & pending,
+        TimeoutMap<pair<Id,Id>, Value, Allocator> & pending,
         const std::unordered_map<Id, Id>& spotIdMap,
         const Id & auctionId, Id & adSpotId, Value & val)
 {
@@ -79,12 +81,14 @@ Logging::Category SimpleEventMatcher::trace("SimpleEventMatcher Trace", SimpleEv
 
 SimpleEventMatcher::
 SimpleEventMatcher(std::string prefix, std::shared_ptr<EventService> events) :
-    EventMatcher(std::move(prefix), std::move(events))
+    EventMatcher(std::move(prefix), std::move(events)),
+    bankerBatchSize(0)
 {}
 
 SimpleEventMatcher::
 SimpleEventMatcher(std::string prefix, std::shared_ptr<ServiceProxies> proxies) :
-    EventMatcher(std::move(prefix), std::move(proxies))
+    EventMatcher(std::move(prefix), std::move(proxies)),
+    bankerBatchSize(0)
 {}
 
 
@@ -97,10 +101,12 @@ expireSubmitted(Date start, const pair<Id, Id> & key, const SubmissionInfo & inf
 
     // Just making sure it doesn't leak if doBidResult throws.
     spotIdMap.erase(key.first);
+    if (journal && !journal->eraseSubmitted(key))
+        recordHit("persistence.dropped");
 
     recordHit("submittedAuctionExpiry");
 
-    if (!info.bidRequest) {
+    if (!info.hasAuction()) {
         recordHit("submittedAuctionExpiryWithoutBid");
 
         for(const auto& event : info.pendingWinEvents)
@@ -135,6 +141,8 @@ SimpleEventMatcher::
 expireFinished(const pair<Id, Id> & key, const FinishedInfo & info)
 {
     spotIdMap.erase(key.first);
+    if (journal && !journal->eraseFinished(key))
+        recordHit("persistence.dropped");
 
     recordHit("finishedAuctionExpiry");
     return Date();
@@ -144,7 +152,7 @@ void
 SimpleEventMatcher::
 checkExpiredAuctions()
 {
-    Date now = Date::now();
+    Date now = Date::nowCoarse();
 
     using std::placeholders::_1;
     using std::placeholders::_2;
@@ -159,9 +167,54 @@ checkExpiredAuctions()
             std::bind(&SimpleEventMatcher::expireFinished, this, _1, _2),
             now);
 
+    // The losses that were just assumed don't wait for the next flush
+    flushBanker();
+
     banker->logBidEvents(*this);
 }
 
+void
+SimpleEventMatcher::
+setBankerBatching(size_t maxCommits)
+{
+    flushBanker();
+    bankerBatchSize = maxCommits > 1 ? maxCommits : 0;
+    bankerCommits.reserve(bankerBatchSize);
+}
+
+void
+SimpleEventMatcher::
+commitToBanker(BidCommit commit)
+{
+    if (!bankerBatchSize) {
+        banker->commitBids({ std::move(commit) });
+        return;
+    }
+
+    bankerCommits.emplace_back(std::move(commit));
+    if (bankerCommits.size() >= bankerBatchSize)
+        flushBanker();
+}
+
+void
+SimpleEventMatcher::
+flushBanker()
+{
+    if (bankerCommits.empty()) return;
+
+    std::vector<BidCommit> commits;
+    commits.reserve(bankerBatchSize);
+    commits.swap(bankerCommits);
+
+    recordLevel(commits.size(), "banker.batchSize");
+
+    try {
+        banker->commitBids(commits);
+    } catch (const std::exception & exc) {
+        doError("flushBanker", exc.what());
+    }
+}
+
 
 
 void
@@ -215,12 +268,20 @@ doAuction(std::shared_ptr<SubmittedAuctionEvent> event)
         }
 
         submission.bidRequest = event->bidRequest();
+        submission.packed.reset();
         submission.bidRequestStrFormat = std::move(event->bidRequestStrFormat);
         submission.augmentations = std::move(event->augmentations);
         submission.bid = std::move(event->bidResponse);
 
+        if (retention != RetainFullRequest) {
+            submission.pack(key.second, retention == RetainPackedRequest);
+            if (submission.packed->spotIndex == -1)
+                recordHit("packedAuctionSpotNotFound");
+        }
+
         submitted.emplace(key, submission, lossTimeout);
         spotIdMap[key.first] = key.second;
+        persistSubmitted(key);
 
         string transId =
             makeBidId(auctionId, event->adSpotId, submission.bid.agent);
@@ -296,9 +357,10 @@ doWinLoss(std::shared_ptr<PostAuctionEvent> event, bool isReplay)
         else recordHit("bidResult.%s.auctionAlreadyFinished", typeStr);
 
         if (event->type == PAE_WIN) {
-            info.bid.wcm.data["win"] = meta.toJson();
-            Amount price = info.bid.wcm.evaluate(
-                    info.bid.bidData.bidForSpot(info.spotIndex), winPrice);
+            Json::Value winMeta = meta.toJson();
+            Amount price = bindWinCostModel(info.bid.agent, info.bid.wcm)
+                .evaluate(info.bid.bidData.bidForSpot(info.spotIndex),
+                          winPrice, &winMeta);
 
             recordOutcome(winPrice.value, "accounts.%s.winPrice.%s",
                     info.bid.account.toString('.'), winPrice.getCurrencyStr());
@@ -308,11 +370,13 @@ doWinLoss(std::shared_ptr<PostAuctionEvent> event, bool isReplay)
 
 
             // Late win with auction still around
-            banker->forceWinBid(info.bid.account, price, LineItems());
+            commitToBanker(BidCommit(BidCommit::FORCE_WIN, info.bid.account,
+                                     "", price));
 
             info.forceWin(timestamp, price, winPrice, meta.toString());
 
             finished.get(key) = info;
+            persistFinished(key);
 
             doMatchedWinLoss(std::make_shared<MatchedWinLoss>(
                             MatchedWinLoss::LateWin,
@@ -348,8 +412,9 @@ doWinLoss(std::shared_ptr<PostAuctionEvent> event, bool isReplay)
         */
         SubmissionInfo info;
         info.pendingWinEvents.push_back(event);
-        submitted.emplace(key, info, Date::now().plusSeconds(auctionTimeout));
+        submitted.emplace(key, info, Date::nowCoarse().plusSeconds(auctionTimeout));
         spotIdMap[key.first] = key.second;
+        persistSubmitted(key);
 
         return;
     }
@@ -357,17 +422,20 @@ doWinLoss(std::shared_ptr<PostAuctionEvent> event, bool isReplay)
     SubmissionInfo info = submitted.pop(key);
     spotIdMap.erase(key.first);
 
-    if (!info.bidRequest) {
+    if (!info.hasAuction()) {
         // We doubled up on a WIN without having got the auction yet
         info.pendingWinEvents.push_back(event);
-        submitted.emplace(key, info, Date::now().plusSeconds(auctionTimeout));
+        submitted.emplace(key, info, Date::nowCoarse().plusSeconds(auctionTimeout));
         spotIdMap[key.first] = key.second;
+        persistSubmitted(key);
         return;
     }
 
+    persistSubmitted(key);
+
    if(uids.empty()) {
         // If uids is empty in win message, try to get them form BR
-        uids  = info.bidRequest->userIds;
+        uids  = info.userIds();
     }
 
     auto confidence = status == BS_WIN ?
@@ -389,7 +457,8 @@ SimpleEventMatcher::
 doReallyLateWin(const std::shared_ptr<PostAuctionEvent>& event)
 {
     if (!event->account.empty()) {
-        banker->forceWinBid(event->account, event->winPrice, LineItems());
+        commitToBanker(BidCommit(BidCommit::FORCE_WIN, event->account,
+                                 "", event->winPrice));
     }
 
     recordHit("bidResult.%s.unmatched", RTBKIT::print(event->type));
@@ -439,6 +508,7 @@ doCampaignEvent(std::shared_ptr<PostAuctionEvent> event)
         submissionInfo.earlyCampaignEvents.push_back(event);
         submitted.get(make_pair(auctionId, adSpotId)) = submissionInfo;
         spotIdMap[auctionId] = adSpotId;
+        persistSubmitted(make_pair(auctionId, adSpotId));
         return;
     }
 
@@ -467,6 +537,7 @@ doCampaignEvent(std::shared_ptr<PostAuctionEvent> event)
         finishedInfo.addUids(uids);
 
         finished.get(key) = finishedInfo;
+        persistFinished(key);
 
         doMatchedCampaignEvent(
                 std::make_shared<MatchedCampaignEvent>(label, finishedInfo));
@@ -519,7 +590,7 @@ doBidResult(
     string agent = submission.bid.agent;
 
     // Find the adspot ID
-    int adspot_num = submission.bidRequest->findAdSpotIndex(adSpotId);
+    int adspot_num = submission.spotIndex(adSpotId);
     if (adspot_num == -1) {
         doError("doBidResult.adSpotIdNotFound",
                 "adspot ID " + adSpotId.toString() +
@@ -544,7 +615,7 @@ doBidResult(
     // Make sure we account for the bid no matter what
     ML::Call_Guard guard ([&] () {
                 auto transId = makeBidId(auctionId, adSpotId, agent);
-                banker->cancelBid(account, transId);
+                commitToBanker(BidCommit(BidCommit::CANCEL, account, transId));
             });
 
     // No bid
@@ -556,11 +627,10 @@ doBidResult(
     Amount price = winPrice;
 
     if (status == BS_WIN) {
-        WinCostModel wcm = response.wcm;
-        wcm.data["win"] = winLossMeta;
-        Bids bids = response.bidData;
-        Bid bid = bids.bidForSpot(adspot_num);
-        price = wcm.evaluate(bid, winPrice);
+        Json::Value winMeta(winLossMeta);
+        const Bid & bid = response.bidData.bidForSpot(adspot_num);
+        price = bindWinCostModel(agent, response.wcm)
+            .evaluate(bid, winPrice, &winMeta);
 
         recordOutcome(bid.price.value, "accounts.%s.bidPrice.%s",
                 account.toString('.'),
@@ -578,23 +648,29 @@ doBidResult(
         guard.clear();
 
         auto transId = makeBidId(auctionId, adSpotId, agent);
-        banker->winBid(account, transId, price, LineItems());
+        commitToBanker(BidCommit(BidCommit::WIN, account, transId, price));
 
-        auto winLatency = Date::now().secondsSince(submission.bidRequest->timestamp);
+        auto winLatency = Date::now().secondsSince(submission.auctionTime());
         recordOutcome(winLatency * 1000.0, "winLatencyMs");
     }
 
     // Finally, place it in the finished queue
     FinishedInfo i;
-    i.auctionTime = submission.bidRequest->timestamp;
+    i.auctionTime = submission.auctionTime();
     i.auctionId = auctionId;
     i.adSpotId = adSpotId;
     i.spotIndex = adspot_num;
-    i.bidRequestStr = submission.bidRequestStr();
+    if (submission.packed) {
+        i.packedBidRequestStr = submission.packed->requestStr;
+        i.packedAugmentations = submission.packed->augmentations;
+    }
+    else {
+        i.bidRequestStr = submission.bidRequestStr();
+        i.augmentations = submission.augmentations;
+    }
     i.bidRequestStrFormat = submission.bidRequestStrFormat ;
     i.bid = response;
     i.reportedStatus = status;
-    i.augmentations = submission.augmentations;
     i.setWin(timestamp, status, price, winPrice, winLossMeta);
     i.addUids(uids);
 
@@ -611,184 +687,113 @@ doBidResult(
     if (status == BS_LOSS)
         expiryInterval = auctionTimeout;
 
-    Date expiryTime = Date::now().plusSeconds(expiryInterval);
+    Date expiryTime = Date::nowCoarse().plusSeconds(expiryInterval);
     finished.emplace(make_pair(auctionId, adSpotId), i, expiryTime);
     spotIdMap[auctionId] = adSpotId;
+    persistFinished(make_pair(auctionId, adSpotId));
 }
 
 
 
-/******************************************************************************/
-/* PERSISTENCE                                                                */
-/******************************************************************************/
-// Needs to be properly tested before enabling.
-
-namespace {
-
-std::pair<Id, Id>
-unstringifyPair(const std::string & str)
-{
-    istringstream stream(str);
-    DB::Store_Reader store(stream);
-    pair<Id, Id> result;
-    store >> result.first >> result.second;
-    return result;
-}
-
-std::string stringifyPair(const std::pair<Id, Id> & vals)
+const BoundWinCostModel &
+SimpleEventMatcher::
+bindWinCostModel(const std::string & agent, const WinCostModel & wcm)
 {
-    if (!vals.second || vals.second.type == Id::NULLID)
-        throw ML::Exception("attempt to store null ID");
+    auto & entry = boundWinCostModels[agent];
 
-    ostringstream stream;
+    if (!entry.bound
+            || entry.model.name != wcm.name
+            || entry.model.data != wcm.data)
     {
-        DB::Store_Writer store(stream);
-        store << vals.first << vals.second;
+        recordHit("winCostModel.bound");
+        entry.bound = wcm.bind();
+        entry.model = wcm;
     }
 
-    return stream.str();
+    return *entry.bound;
 }
 
-} // file scope
-
 
-#if 0 // Persistence layer that needs to be reworked.
+/******************************************************************************/
+/* PERSISTENCE                                                                */
+/******************************************************************************/
 
 void
 SimpleEventMatcher::
 initStatePersistence(const std::string & path)
 {
-    typedef PendingPersistenceT<pair<Id, Id>, SubmissionInfo>
-        SubmittedPending;
-
-    auto submittedDb = std::make_shared<LeveldbPendingPersistence>();
-    submittedDb->open(path + "/submitted");
-
-    auto submittedPersistence
-        = std::make_shared<SubmittedPending>();
-    submittedPersistence->store = submittedDb;
-
-    auto stringifySubmissionInfo = [] (const SubmissionInfo & info)
-        {
-            return info.serializeToString();
-        };
+    ExcCheck(!journal, "state persistence already initialized");
+    ExcCheck(!submitted.size() && !finished.size(),
+            "state persistence initialized after auctions came in");
 
-    auto unstringifySubmissionInfo = [] (const std::string & str)
-        {
-            SubmissionInfo info;
-            info.reconstituteFromString(str);
-            return info;
-        };
-
-    submittedPersistence->stringifyKey = stringifyPair;
-    submittedPersistence->unstringifyKey = unstringifyPair;
-    submittedPersistence->stringifyValue = stringifySubmissionInfo;
-    submittedPersistence->unstringifyValue = unstringifySubmissionInfo;
+    std::unique_ptr<MatcherJournal> newJournal(new MatcherJournal());
+    newJournal->open(path);
 
-    Date newTimeout = Date::now().plusSeconds(15);
+    Date now = Date::nowCoarse();
 
-    auto acceptSubmitted = [&] (pair<Id, Id> & key,
-                                SubmissionInfo & info,
-                                Date & timeout) -> bool
+    auto onSubmitted = [&] (const pair<Id, Id> & key,
+                            SubmissionInfo & info,
+                            Date timeout)
         {
             info.fromOldRouter = true;
-            newTimeout.addSeconds(0.001);
-            timeout = newTimeout;
-            // this->debugSpot(key.first, key.second, "RECONST SUBMITTED");
-            return true;
-        };
-
-    submitted.initFromStore(submittedPersistence,
-                            acceptSubmitted,
-                            Date::now().plusSeconds(15));
-
-    typedef PendingPersistenceT<pair<Id, Id>, FinishedInfo>
-        FinishedPending;
-
-    auto finishedDb = std::make_shared<LeveldbPendingPersistence>();
-    finishedDb->open(path + "/finished");
-
-    auto finishedPersistence
-        = std::make_shared<FinishedPending>();
-    finishedPersistence->store = finishedDb;
-
-    auto stringifyFinishedInfo = [] (const FinishedInfo & info)
-        {
-            return info.serializeToString();
+            submitted.emplace(key, std::move(info), std::max(timeout, now));
+            spotIdMap[key.first] = key.second;
         };
 
-    auto unstringifyFinishedInfo = [] (const std::string & str)
+    auto onFinished = [&] (const pair<Id, Id> & key,
+                           FinishedInfo & info,
+                           Date timeout)
         {
-            FinishedInfo info;
-            info.reconstituteFromString(str);
-            return info;
+            info.fromOldRouter = true;
+            finished.emplace(key, std::move(info), std::max(timeout, now));
+            spotIdMap[key.first] = key.second;
         };
 
-    finishedPersistence->stringifyKey = stringifyPair;
-    finishedPersistence->unstringifyKey = unstringifyPair;
-    finishedPersistence->stringifyValue = stringifyFinishedInfo;
-    finishedPersistence->unstringifyValue = unstringifyFinishedInfo;
+    Date start = Date::now();
+    size_t recovered = newJournal->recover(
+            onSubmitted, onFinished,
+            std::max(1U, std::thread::hardware_concurrency()));
 
-    newTimeout = Date::now().plusSeconds(auctionTimeout);
+    recordOutcome(Date::now().secondsSince(start) * 1000.0,
+            "persistence.recoveryTimeMs");
+    recordCount(recovered, "persistence.recovered");
+    LOG(print) << "recovered " << submitted.size() << " submitted and "
+        << finished.size() << " finished auctions from " << path << endl;
 
-    auto acceptFinished = [&] (pair<Id, Id> & key,
-                               FinishedInfo & info,
-                               Date & timeout) -> bool
-        {
-            info.fromOldRouter = true;
-            newTimeout.addSeconds(0.001);
-            timeout = newTimeout;
-            // this->debugSpot(key.first, key.second, "RECONST FINISHED");
-
-            return true;
-        };
+    journal = std::move(newJournal);
+    journal->start();
+}
 
-    finished.initFromStore(finishedPersistence,
-                           acceptFinished,
-                           Date::now().plusSeconds(auctionTimeout));
+void
+SimpleEventMatcher::
+persistSubmitted(const pair<Id, Id> & key)
+{
+    if (!journal) return;
 
-    auto backgroundWork = [=] (volatile int & shutdown, int64_t threadId)
-        {
-            while (!shutdown) {
-                futex_wait(const_cast<int &>(shutdown), 0, 600.0);
-                if (shutdown) break;
-                //continue;
-
-                {
-                    Date start = Date::now();
-                    submittedDb->compact();
-                    Date end = Date::now();
-                    this->recordEvent("persistentData.submitted.compactTimeMs",
-                                  ET_OUTCOME,
-                                  1000.0 * (end.secondsSince(start)));
-                    uint64_t size = submittedDb->getDbSize();
-                    //cerr << "submitted db is " << size / 1024.0 / 1024.0
-                    //     << "MB" << endl;
-                    this->recordEvent("persistentData.submitted.dbSizeMb",
-                                  ET_LEVEL, size / 1024.0 / 1024.0);
-                }
-
-                {
-                    Date start = Date::now();
-                    finishedDb->compact();
-                    Date end = Date::now();
-                    this->recordEvent("persistentData.finished.compactTimeMs",
-                                  ET_OUTCOME,
-                                  1000.0 * (end.secondsSince(start)));
-                    uint64_t size = finishedDb->getDbSize();
-                    //cerr << "finished db is " << size / 1024.0 / 1024.0
-                    //     << "MB" << endl;
-                    this->recordEvent("persistentData.finished.dbSizeMb",
-                                  ET_LEVEL, size / 1024.0 / 1024.0);
-                }
-            }
+    bool queued = submitted.count(key)
+        ? journal->putSubmitted(key, submitted.get(key), submitted.getTimeout(key))
+        : journal->eraseSubmitted(key);
+    if (!queued) recordHit("persistence.dropped");
+}
 
-            cerr << "exiting background work thread" << endl;
-        };
+void
+SimpleEventMatcher::
+persistFinished(const pair<Id, Id> & key)
+{
+    if (!journal) return;
 
-    // loop.startSubordinateThread(backgroundWork);
+    bool queued = finished.count(key)
+        ? journal->putFinished(key, finished.get(key), finished.getTimeout(key))
+        : journal->eraseFinished(key);
+    if (!queued) recordHit("persistence.dropped");
 }
 
-#endif
+void
+SimpleEventMatcher::
+shutdown()
+{
+    flushBanker();
+    if (journal) journal->shutdown();
+}
 
 } // RTBKIT
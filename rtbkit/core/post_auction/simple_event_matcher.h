@@ -11,10 +11,13 @@
 #include "event_matcher.h"
 #include "finished_info.h"
 #include "submission_info.h"
+#include "matcher_journal.h"
 #include "rtbkit/common/auction.h"
-// #include "soa/service/pending_list.h"
+#include "rtbkit/common/win_cost_model.h"
 #include "soa/service/logs.h"
+#include "jml/arch/huge_page_pool.h"
 
+#include <memory>
 #include <utility>
 
 
@@ -44,6 +47,8 @@ struct SimpleEventMatcher : public EventMatcher
     SimpleEventMatcher(std::string prefix, std::shared_ptr<EventService> events);
     SimpleEventMatcher(std::string prefix, std::shared_ptr<ServiceProxies> proxies);
 
+    /** Stops the journal, if any, once it's written out what it has. */
+    virtual void shutdown();
 
     /************************************************************************/
     /* EVENT MATCHING                                                       */
@@ -59,11 +64,27 @@ struct SimpleEventMatcher : public EventMatcher
     virtual void checkExpiredAuctions();
 
 
+    /************************************************************************/
+    /* BANKER                                                               */
+    /************************************************************************/
+
+    virtual void setBankerBatching(size_t maxCommits);
+    virtual void flushBanker();
+
+
     /************************************************************************/
     /* PERSISTENCE                                                          */
     /************************************************************************/
 
-    // virtual void initStatePersistence(const std::string & path);
+    /** Restore the submitted and finished auctions from the journal in the
+        given directory, then keep it up to date with every change.  Must be
+        called before any auction comes in.
+
+        Restored entries are flagged fromOldRouter and keep their timeouts,
+        except for those that ran out while we were down which are expired
+        on the next check.
+    */
+    virtual void initStatePersistence(const std::string & path);
 
     static Logging::Category print;
     static Logging::Category error;
@@ -80,6 +101,10 @@ private:
 
     void doReallyLateWin(const std::shared_ptr<PostAuctionEvent>& event);
 
+    /** Queue the commit for the banker, or hand it over right away if the
+        commits aren't batched. */
+    void commitToBanker(BidCommit commit);
+
     /** We got a win/loss.  Match it up with its bid and pass on to the
         winning bidder.
     */
@@ -105,6 +130,18 @@ private:
 
     Date expireFinished(const std::pair<Id, Id> & key, const FinishedInfo & info);
 
+    /** Queue the current state of the entry, or its removal, for the
+        journal.  No-ops without persistence.
+    */
+    void persistSubmitted(const std::pair<Id, Id> & key);
+    void persistFinished(const std::pair<Id, Id> & key);
+
+    /** Get the bound version of the given agent's win cost model, which is
+        only bound again when it has changed since the agent's last win.
+    */
+    const BoundWinCostModel &
+    bindWinCostModel(const std::string & agent, const WinCostModel & wcm);
+
 
     /** List of auctions we're currently tracking as submitted.  Note that an
         auction may be both submitted and in flight (if we had submitted a bid
@@ -113,7 +150,8 @@ private:
         The key is the (auction id, spot id) pair since after submission,
         the result from every auction comes back separately.
     */
-    typedef TimeoutMap<std::pair<Id, Id>, SubmissionInfo> Submitted;
+    typedef TimeoutMap<std::pair<Id, Id>, SubmissionInfo,
+                       ML::Huge_Page_Allocator> Submitted;
     Submitted submitted;
 
     /** List of auctions we've won and we're waiting for a campaign event
@@ -124,7 +162,8 @@ private:
         We keep this list around for 5 minutes for those that were lost,
         and one hour for those that were won.
     */
-    typedef TimeoutMap<std::pair<Id, Id>, FinishedInfo> Finished;
+    typedef TimeoutMap<std::pair<Id, Id>, FinishedInfo,
+                       ML::Huge_Page_Allocator> Finished;
     Finished finished;
 
     /** Maintains a map of auction id with the most recently seen spot id. Used
@@ -137,6 +176,19 @@ private:
         entry.
      */
     std::unordered_map<Id, Id> spotIdMap;
+
+    /** Last win cost model of each agent, and its bound version. */
+    struct BoundWinCostModelEntry {
+        WinCostModel model;
+        std::shared_ptr<const BoundWinCostModel> bound;
+    };
+    std::unordered_map<std::string, BoundWinCostModelEntry> boundWinCostModels;
+
+    std::unique_ptr<MatcherJournal> journal;
+
+    /** Commits for the banker held back until the next flushBanker(). */
+    size_t bankerBatchSize;
+    std::vector<BidCommit> bankerCommits;
 };
 
 } // RTBKIT
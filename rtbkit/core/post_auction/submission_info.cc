@@ -0,0 +1,70 @@
+/** submission_info.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Implementation of submission info.
+
+*/
+
+#include "submission_info.h"
+#include "jml/db/persistent.h"
+
+using namespace std;
+using namespace ML;
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* SUBMISSION INFO                                                           */
+/*****************************************************************************/
+
+void
+SubmissionInfo::
+serialize(DB::Store_Writer & store) const
+{
+    unsigned char version = 1;
+    store << version;
+
+    // The binary format is lossless, unlike BidRequest::serialize()
+    store << (bidRequest ? bidRequest->toBinaryStr() : string());
+    store << bidRequestStrFormat << augmentations;
+    bid.serialize(store);
+    store << fromOldRouter << pendingWinEvents << earlyCampaignEvents;
+
+    store << bool(packed);
+    if (packed) {
+        store << packed->timestamp << packed->spotIndex << packed->userIds
+              << packed->requestStr << packed->augmentations;
+    }
+}
+
+void
+SubmissionInfo::
+reconstitute(DB::Store_Reader & store)
+{
+    unsigned char version;
+    store >> version;
+    if (version != 1)
+        throw ML::Exception("invalid version");
+
+    string request;
+    store >> request;
+    bidRequest.reset();
+    if (!request.empty())
+        bidRequest.reset(BidRequest::parse(BidRequest::BinaryFormat, request));
+
+    store >> bidRequestStrFormat >> augmentations;
+    bid.reconstitute(store);
+    store >> fromOldRouter >> pendingWinEvents >> earlyCampaignEvents;
+
+    bool isPacked;
+    store >> isPacked;
+    packed.reset();
+    if (isPacked) {
+        auto result = make_shared<PackedRequest>();
+        store >> result->timestamp >> result->spotIndex >> result->userIds
+              >> result->requestStr >> result->augmentations;
+        packed = std::move(result);
+    }
+}
+
+} // namespace RTBKIT
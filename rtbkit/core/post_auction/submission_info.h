@@ -11,6 +11,7 @@
 #include "rtbkit/common/auction.h"
 #include "rtbkit/common/auction_events.h"
 #include "soa/types/string.h"
+#include "packed_string.h"
 
 namespace RTBKIT {
 
@@ -29,14 +30,67 @@ struct SubmissionInfo {
     {
     }
 
-    std::shared_ptr<BidRequest> bidRequest;
+    std::shared_ptr<BidRequest> bidRequest;   ///< Null once packed
     std::string bidRequestStrFormat;
 
+    /** What's left of the bid request once the submission is packed: the
+        fields needed to match up the events, and optionally a compressed
+        copy of the request and augmentations to pass on with them.
+    */
+    struct PackedRequest {
+        Date timestamp;
+        int spotIndex;
+        UserIds userIds;
+        PackedString requestStr;
+        PackedString augmentations;
+    };
+
+    std::shared_ptr<const PackedRequest> packed;
+
+    /** Replace the bid request and augmentations by a PackedRequest for the
+        given spot, which is the only one the submission is for.
+    */
+    void pack(const Id & adSpotId, bool keepRequest)
+    {
+        auto result = std::make_shared<PackedRequest>();
+        result->timestamp = bidRequest->timestamp;
+        result->spotIndex = bidRequest->findAdSpotIndex(adSpotId);
+        result->userIds = bidRequest->userIds;
+        if (keepRequest) {
+            result->requestStr.pack(bidRequest->toJsonStr());
+            if (augmentations.isNonNull())
+                result->augmentations.pack(augmentations.toString());
+        }
+
+        packed = std::move(result);
+        bidRequest.reset();
+        augmentations.clear();
+    }
+
+    bool hasAuction() const { return bidRequest || packed; }
+
+    Date auctionTime() const
+    {
+        return packed ? packed->timestamp : bidRequest->timestamp;
+    }
+
+    int spotIndex(const Id & adSpotId) const
+    {
+        return packed ? packed->spotIndex : bidRequest->findAdSpotIndex(adSpotId);
+    }
+
+    const UserIds & userIds() const
+    {
+        return packed ? packed->userIds : bidRequest->userIds;
+    }
+
     Datacratic::UnicodeString bidRequestStr() const {
+        if (packed)
+            return Datacratic::UnicodeString(packed->requestStr.unpack());
         return Datacratic::UnicodeString(bidRequest->toJsonStr());
     }
 
-    JsonHolder augmentations;
+    JsonHolder augmentations;             ///< Null once packed
     Auction::Response  bid;               ///< Bid we passed on
     bool fromOldRouter;                   ///< Was reconstituted
 
@@ -48,7 +102,15 @@ struct SubmissionInfo {
     */
     std::vector<std::shared_ptr<PostAuctionEvent> > pendingWinEvents;
     std::vector<std::shared_ptr<PostAuctionEvent> > earlyCampaignEvents;
+
+    /** The agent configuration of the bid isn't written; see
+        Auction::Response.
+    */
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
 };
 
+IMPL_SERIALIZE_RECONSTITUTE(SubmissionInfo);
+
 
 } // namespace RTBKIT
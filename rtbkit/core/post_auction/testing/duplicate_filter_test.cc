@@ -0,0 +1,101 @@
+/** duplicate_filter_test.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Tests for the filter that discards resent post auction events.
+
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/core/post_auction/duplicate_filter.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+namespace {
+
+PostAuctionEvent makeWin(unsigned auction, Date timestamp)
+{
+    PostAuctionEvent event;
+    event.type = PAE_WIN;
+    event.auctionId = Id(auction + 1);
+    event.adSpotId = Id(1);
+    event.timestamp = timestamp;
+    event.winPrice = MicroUSD(1000);
+    return event;
+}
+
+} // namespace anonymous
+
+BOOST_AUTO_TEST_CASE( test_duplicates )
+{
+    Date now = Date::fromSecondsSinceEpoch(1400000000);
+    DuplicateEventFilter filter(1000, 10.0);
+
+    auto win = makeWin(0, now);
+    BOOST_CHECK(!filter.isDuplicate(win, now));
+    BOOST_CHECK(filter.isDuplicate(win, now));
+    BOOST_CHECK_EQUAL(filter.filtered(), 1);
+
+    // Anything that tells the events apart lets them through.
+    auto click = win;
+    click.type = PAE_CAMPAIGN_EVENT;
+    click.label = "CLICK";
+    BOOST_CHECK(!filter.isDuplicate(click, now));
+
+    auto conversion = click;
+    conversion.label = "CONVERSION";
+    BOOST_CHECK(!filter.isDuplicate(conversion, now));
+
+    auto later = win;
+    later.timestamp = now.plusSeconds(1);
+    BOOST_CHECK(!filter.isDuplicate(later, now));
+
+    auto cheaper = win;
+    cheaper.winPrice = MicroUSD(999);
+    BOOST_CHECK(!filter.isDuplicate(cheaper, now));
+
+    BOOST_CHECK_EQUAL(filter.filtered(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_window )
+{
+    Date now = Date::fromSecondsSinceEpoch(1400000000);
+    DuplicateEventFilter filter(1000, 10.0);
+
+    auto win = makeWin(0, now);
+    BOOST_CHECK(!filter.isDuplicate(win, now));
+
+    // Still there in the next window...
+    BOOST_CHECK(filter.isDuplicate(win, now.plusSeconds(11)));
+
+    // ... but gone once another window went by.
+    BOOST_CHECK(!filter.isDuplicate(win, now.plusSeconds(22)));
+
+    // And entirely forgotten after a long pause.
+    BOOST_CHECK(!filter.isDuplicate(makeWin(1, now), now.plusSeconds(30)));
+    BOOST_CHECK(!filter.isDuplicate(makeWin(1, now), now.plusSeconds(100)));
+}
+
+BOOST_AUTO_TEST_CASE( test_false_positives )
+{
+    enum { Events = 100000 };
+
+    Date now = Date::fromSecondsSinceEpoch(1400000000);
+    DuplicateEventFilter filter(Events, 3600.0, 1e-4);
+
+    for (unsigned i = 0;  i < Events;  ++i)
+        filter.isDuplicate(makeWin(i, now), now);
+
+    BOOST_CHECK_LT(filter.filtered(), Events * 1e-3);
+
+    // Everything is remembered.
+    uint64_t before = filter.filtered();
+    for (unsigned i = 0;  i < Events;  ++i)
+        filter.isDuplicate(makeWin(i, now), now);
+    BOOST_CHECK_EQUAL(filter.filtered() - before, Events);
+}
@@ -0,0 +1,172 @@
+/** matcher_journal_test.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Tests for the journal that persists the event matcher's auctions.
+
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/core/post_auction/matcher_journal.h"
+#include "jml/db/persistent.h"
+
+#include <boost/test/unit_test.hpp>
+#include <map>
+#include <stdlib.h>
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+namespace {
+
+typedef MatcherJournal::Key Key;
+
+std::string tempDir()
+{
+    char path[] = "/tmp/matcher_journal_test.XXXXXX";
+    BOOST_REQUIRE(mkdtemp(path));
+    return path;
+}
+
+std::shared_ptr<BidRequest> makeRequest(const Id & auctionId)
+{
+    auto request = make_shared<BidRequest>();
+    request->auctionId = auctionId;
+    request->timestamp = Date::fromSecondsSinceEpoch(1400000000);
+    request->imp.resize(1);
+    request->imp[0].id = Id(1);
+    request->userIds.add(Id("user"), ID_PROVIDER);
+    return request;
+}
+
+} // namespace anonymous
+
+BOOST_AUTO_TEST_CASE( test_info_serialization )
+{
+    SubmissionInfo submission;
+    submission.bidRequest = makeRequest(Id("auction"));
+    submission.bidRequestStrFormat = "datacratic";
+    submission.bid.agent = "agent";
+    submission.bid.price.maxPrice = MicroUSD(2000);
+
+    auto early = make_shared<PostAuctionEvent>();
+    early->type = PAE_WIN;
+    early->auctionId = Id("auction");
+    submission.pendingWinEvents.push_back(early);
+
+    auto copy = ML::DB::reconstituteFromString<SubmissionInfo>(
+            ML::DB::serializeToString(submission));
+    BOOST_REQUIRE(copy.bidRequest);
+    BOOST_CHECK_EQUAL(copy.bidRequest->auctionId, Id("auction"));
+    BOOST_CHECK_EQUAL(copy.bidRequestStrFormat, "datacratic");
+    BOOST_CHECK_EQUAL(copy.bid.agent, "agent");
+    BOOST_CHECK_EQUAL(copy.bid.price.maxPrice, MicroUSD(2000));
+    BOOST_REQUIRE_EQUAL(copy.pendingWinEvents.size(), 1);
+    BOOST_CHECK_EQUAL(copy.pendingWinEvents[0]->auctionId, Id("auction"));
+    BOOST_CHECK(!copy.packed);
+
+    submission.pack(Id(1), true);
+    copy = ML::DB::reconstituteFromString<SubmissionInfo>(
+            ML::DB::serializeToString(submission));
+    BOOST_CHECK(!copy.bidRequest);
+    BOOST_REQUIRE(copy.packed);
+    BOOST_CHECK_EQUAL(copy.spotIndex(Id(1)), 0);
+    BOOST_CHECK_EQUAL(copy.auctionTime(), submission.auctionTime());
+    BOOST_CHECK_EQUAL(copy.bidRequestStr(), submission.bidRequestStr());
+
+    FinishedInfo finished;
+    finished.auctionId = Id("auction");
+    finished.adSpotId = Id(1);
+    finished.spotIndex = 0;
+    finished.packedBidRequestStr = submission.packed->requestStr;
+    finished.bid.agent = "agent";
+    finished.setWin(Date::fromSecondsSinceEpoch(1400000001), BS_WIN,
+                    MicroUSD(1500), MicroUSD(1000), "meta");
+    finished.campaignEvents.setEvent("CLICK", Date::fromSecondsSinceEpoch(1400000002),
+                                     JsonHolder());
+    finished.addUids(submission.userIds());
+
+    auto finishedCopy = ML::DB::reconstituteFromString<FinishedInfo>(
+            ML::DB::serializeToString(finished));
+    BOOST_CHECK_EQUAL(finishedCopy.auctionId, Id("auction"));
+    BOOST_CHECK_EQUAL(finishedCopy.spotIndex, 0);
+    BOOST_CHECK_EQUAL(finishedCopy.getBidRequestStr(), finished.getBidRequestStr());
+    BOOST_CHECK_EQUAL(finishedCopy.reportedStatus, BS_WIN);
+    BOOST_CHECK_EQUAL(finishedCopy.winPrice, MicroUSD(1500));
+    BOOST_CHECK_EQUAL(finishedCopy.winMeta, "meta");
+    BOOST_CHECK(finishedCopy.campaignEvents.hasEvent("CLICK"));
+    BOOST_CHECK_EQUAL(finishedCopy.uids.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_journal_recovery )
+{
+    string path = tempDir();
+    Date timeout = Date::fromSecondsSinceEpoch(1500000000);
+    enum { NumAuctions = 1000 };
+
+    {
+        MatcherJournal journal;
+        journal.open(path);
+        journal.start();
+
+        for (unsigned i = 0;  i < NumAuctions;  ++i) {
+            Key key(Id(i + 1), Id(1));
+
+            SubmissionInfo submission;
+            submission.bidRequest = makeRequest(key.first);
+            BOOST_CHECK(journal.putSubmitted(key, submission, timeout));
+
+            // Every other auction moves over to finished
+            if (i % 2) continue;
+
+            FinishedInfo finished;
+            finished.auctionId = key.first;
+            finished.adSpotId = key.second;
+            BOOST_CHECK(journal.eraseSubmitted(key));
+            BOOST_CHECK(journal.putFinished(key, finished, timeout.plusSeconds(i)));
+        }
+
+        journal.shutdown();
+        BOOST_CHECK_EQUAL(journal.dropped(), 0);
+        BOOST_CHECK_EQUAL(journal.written(), NumAuctions * 2);
+    }
+
+    MatcherJournal journal;
+    journal.open(path);
+
+    map<Key, Date> submitted, finished;
+
+    auto onSubmitted = [&] (const Key & key, SubmissionInfo & info, Date when)
+        {
+            BOOST_CHECK(info.bidRequest);
+            BOOST_CHECK_EQUAL(info.bidRequest->auctionId, key.first);
+            submitted[key] = when;
+        };
+
+    auto onFinished = [&] (const Key & key, FinishedInfo & info, Date when)
+        {
+            BOOST_CHECK_EQUAL(info.auctionId, key.first);
+            finished[key] = when;
+        };
+
+    size_t recovered = journal.recover(onSubmitted, onFinished, 4);
+    BOOST_CHECK_EQUAL(recovered, NumAuctions);
+    BOOST_CHECK_EQUAL(submitted.size(), NumAuctions / 2);
+    BOOST_CHECK_EQUAL(finished.size(), NumAuctions / 2);
+
+    for (unsigned i = 0;  i < NumAuctions;  ++i) {
+        Key key(Id(i + 1), Id(1));
+        if (i % 2) {
+            BOOST_CHECK_EQUAL(submitted.count(key), 1);
+            BOOST_CHECK_EQUAL(submitted[key], timeout);
+        }
+        else {
+            BOOST_CHECK_EQUAL(finished.count(key), 1);
+            BOOST_CHECK_EQUAL(finished[key], timeout.plusSeconds(i));
+        }
+    }
+
+    system(("rm -rf " + path).c_str());
+}
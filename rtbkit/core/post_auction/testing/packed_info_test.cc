@@ -0,0 +1,97 @@
+/** packed_info_test.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Tests for the packed representation of the submitted and finished
+    auctions.
+
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/core/post_auction/packed_string.h"
+#include "rtbkit/core/post_auction/submission_info.h"
+#include "rtbkit/core/post_auction/finished_info.h"
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+BOOST_AUTO_TEST_CASE( test_packed_string )
+{
+    PackedString empty;
+    BOOST_CHECK(empty.empty());
+    BOOST_CHECK_EQUAL(empty.unpack(), "");
+
+    string json;
+    for (unsigned i = 0;  i < 100;  ++i)
+        json += "{\"id\":\"" + to_string(i) + "\",\"banner\":{\"w\":300,\"h\":250}},";
+
+    PackedString packed(json);
+    BOOST_CHECK_EQUAL(packed.size(), json.size());
+    BOOST_CHECK_LT(packed.packedSize(), json.size() / 2);
+    BOOST_CHECK_EQUAL(packed.unpack(), json);
+
+    // Copies share the compressed bytes
+    PackedString copy = packed;
+    BOOST_CHECK_EQUAL(copy.unpack(), json);
+
+    // Doesn't compress, so it's kept as is
+    mt19937 rng(1);
+    string noise;
+    for (unsigned i = 0;  i < 1000;  ++i)
+        noise += char(rng());
+
+    PackedString raw(noise);
+    BOOST_CHECK_EQUAL(raw.packedSize(), noise.size());
+    BOOST_CHECK_EQUAL(raw.unpack(), noise);
+}
+
+BOOST_AUTO_TEST_CASE( test_submission_pack )
+{
+    auto request = make_shared<BidRequest>();
+    request->auctionId = Id("auction");
+    request->timestamp = Date::fromSecondsSinceEpoch(1400000000);
+    request->imp.resize(2);
+    request->imp[0].id = Id(1);
+    request->imp[1].id = Id(2);
+    request->userIds.add(Id("user"), ID_EXCHANGE);
+
+    string requestStr = request->toJsonStr();
+
+    for (bool keepRequest: { true, false }) {
+        SubmissionInfo info;
+        info.bidRequest = request;
+        info.augmentations = string("{\"segments\":[1,2,3]}");
+
+        info.pack(Id(2), keepRequest);
+
+        BOOST_CHECK(!info.bidRequest);
+        BOOST_CHECK(info.hasAuction());
+        BOOST_CHECK(!info.augmentations.isNonNull());
+        BOOST_CHECK_EQUAL(info.auctionTime(), request->timestamp);
+        BOOST_CHECK_EQUAL(info.spotIndex(Id(2)), 1);
+        BOOST_CHECK_EQUAL(info.userIds().exchangeId, Id("user"));
+
+        FinishedInfo finished;
+        finished.packedBidRequestStr = info.packed->requestStr;
+        finished.packedAugmentations = info.packed->augmentations;
+
+        if (keepRequest) {
+            BOOST_CHECK_EQUAL(info.bidRequestStr().utf8String(), requestStr);
+            BOOST_CHECK_EQUAL(finished.getBidRequestStr().utf8String(), requestStr);
+            BOOST_CHECK_EQUAL(finished.getAugmentations().toString(),
+                              "{\"segments\":[1,2,3]}");
+        }
+        else {
+            BOOST_CHECK(info.packed->requestStr.empty());
+            BOOST_CHECK(!finished.getAugmentations().isNonNull());
+        }
+    }
+
+    SubmissionInfo pending;
+    BOOST_CHECK(!pending.hasAuction());
+}
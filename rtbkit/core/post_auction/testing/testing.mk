@@ -1,2 +1,8 @@
 $(eval $(call program,post_auction_redis_bench,post_auction redis))
 $(eval $(call program,post_auction_sharding_bench,post_auction boost_program_options))
+$(eval $(call program,timeout_map_bench,types boost_program_options))
+
+$(eval $(call test,timing_wheel_map_test,types,boost))
+$(eval $(call test,packed_info_test,post_auction,boost))
+$(eval $(call test,matcher_journal_test,post_auction,boost))
+$(eval $(call test,duplicate_filter_test,post_auction,boost))
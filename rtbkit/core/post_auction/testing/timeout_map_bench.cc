@@ -0,0 +1,162 @@
+/** timeout_map_bench.cc                                 -*- C++ -*-
+    FreeBSD-style copyright and disclaimer apply
+
+    Compares TimeoutMap with TimingWheelMap under a steady state similar to
+    the router's in-flight auctions: a constant stream of inserts at a given
+    rate, some timeout updates and most entries removed before they expire.
+
+*/
+
+#include "rtbkit/core/post_auction/timeout_map.h"
+#include "rtbkit/core/post_auction/timing_wheel_map.h"
+#include "soa/types/id.h"
+#include "jml/arch/timers.h"
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+/******************************************************************************/
+/* CONFIG                                                                     */
+/******************************************************************************/
+
+struct Config
+{
+    Config() :
+        rate(50000), timeoutMs(100), pollMs(1), durationSec(10),
+        erasePct(90), updatePct(10)
+    {}
+
+    size_t rate;        // inserts per simulated second
+    size_t timeoutMs;   // timeout of each entry
+    size_t pollMs;      // simulated interval between expire calls
+    size_t durationSec; // simulated duration of the run
+    size_t erasePct;    // entries removed before they expire
+    size_t updatePct;   // entries which get their timeout pushed back
+};
+
+Config getConfig(int argc, char** argv)
+{
+    using namespace boost::program_options;
+
+    Config config;
+
+    options_description opt;
+    opt.add_options()
+        ("rate,r", value<size_t>(&config.rate))
+        ("timeoutMs,t", value<size_t>(&config.timeoutMs))
+        ("pollMs,p", value<size_t>(&config.pollMs))
+        ("durationSec,d", value<size_t>(&config.durationSec))
+        ("erasePct,e", value<size_t>(&config.erasePct))
+        ("updatePct,u", value<size_t>(&config.updatePct))
+        ("help,h","print this message");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(opt).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << opt << endl;
+        exit(1);
+    }
+
+    return config;
+}
+
+
+/******************************************************************************/
+/* BENCH                                                                      */
+/******************************************************************************/
+
+struct Value
+{
+    Value() : a(0), b(0) {}
+    Value(uint64_t a) : a(a), b(a) {}
+    uint64_t a, b;
+};
+
+template<typename Map>
+void bench(const std::string& name, const Config& config)
+{
+    Map map;
+    std::mt19937_64 rng(0);
+
+    Date now = Date::fromSecondsSinceEpoch(1400000000);
+    double step = config.pollMs / 1000.0;
+    size_t perStep = std::max<size_t>(1, config.rate * config.pollMs / 1000);
+    size_t steps = config.durationSec * 1000 / config.pollMs;
+
+    // Auctions that are still in the map and that we'll remove before they
+    // expire, bucketed by the step at which they get removed; mimics bids or
+    // wins coming back for an auction.
+    size_t timeoutSteps = std::max<size_t>(1, config.timeoutMs / config.pollMs);
+    std::vector< std::vector<Id> > pending(timeoutSteps);
+
+    size_t inserts = 0, erases = 0, updates = 0, expired = 0, maxSize = 0;
+    uint64_t counter = 0;
+
+    auto onExpire = [&] (Id&&, Value&&) {};
+
+    Timer timer;
+
+    for (size_t i = 0; i < steps; ++i) {
+        now.addSeconds(step);
+
+        for (size_t j = 0; j < perStep; ++j) {
+            Id id(++counter);
+            Date timeout = now.plusSeconds(config.timeoutMs / 1000.0);
+            map.emplace(id, Value(counter), timeout);
+            ++inserts;
+
+            uint64_t dice = rng() % 100;
+            if (dice < config.updatePct) {
+                map.update(id, timeout.plusSeconds(config.timeoutMs / 1000.0));
+                ++updates;
+            }
+            if (rng() % 100 < config.erasePct) {
+                size_t delay = rng() % timeoutSteps;
+                pending[(i + delay) % timeoutSteps].push_back(id);
+            }
+        }
+
+        auto& toErase = pending[i % timeoutSteps];
+        for (const Id& id : toErase)
+            erases += map.erase(id);
+        toErase.clear();
+
+        maxSize = std::max(maxSize, map.size());
+        expired += map.expire(onExpire, now);
+    }
+
+    double elapsed = timer.elapsed_wall();
+    size_t ops = inserts + erases + updates + expired;
+
+    cerr << name << ":" << endl
+         << "    inserts=" << inserts << " erases=" << erases
+         << " updates=" << updates << " expired=" << expired
+         << " maxSize=" << maxSize << endl
+         << "    elapsed=" << elapsed << "s ("
+         << (ops / elapsed / 1000000.0) << "M ops/s, "
+         << (elapsed / ops * 1000000000.0) << "ns/op)" << endl;
+}
+
+
+/******************************************************************************/
+/* MAIN                                                                       */
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    Config config = getConfig(argc, argv);
+
+    bench< TimeoutMap<Id, Value> >("TimeoutMap", config);
+    bench< TimingWheelMap<Id, Value> >("TimingWheelMap", config);
+}
@@ -0,0 +1,117 @@
+/** timing_wheel_map_test.cc                                 -*- C++ -*-
+    FreeBSD-style copyright and disclaimer apply
+
+    Tests for the timing wheel implementation of the timeout map.
+
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/core/post_auction/timing_wheel_map.h"
+#include "rtbkit/core/post_auction/timeout_map.h"
+
+#include <boost/test/unit_test.hpp>
+#include <map>
+#include <random>
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+typedef TimingWheelMap<uint64_t, uint64_t> Map;
+
+const Date start = Date::fromSecondsSinceEpoch(1400000000);
+
+BOOST_AUTO_TEST_CASE( basics )
+{
+    Map map;
+
+    BOOST_CHECK(map.emplace(1, 10, start.plusSeconds(1)));
+    BOOST_CHECK(!map.emplace(1, 11, start.plusSeconds(1)));
+    BOOST_CHECK(map.emplace(2, 20, start.plusSeconds(2)));
+    BOOST_CHECK_EQUAL(map.size(), 2);
+    BOOST_CHECK(map.count(1));
+    BOOST_CHECK_EQUAL(map.get(1), 10);
+
+    BOOST_CHECK_EQUAL(map.pop(1), 10);
+    BOOST_CHECK(!map.count(1));
+    BOOST_CHECK(!map.erase(1));
+    BOOST_CHECK(map.erase(2));
+    BOOST_CHECK_EQUAL(map.size(), 0);
+    BOOST_CHECK_THROW(map.get(2), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( expiry )
+{
+    Map map;
+    std::vector<uint64_t> expired;
+    auto onExpire = [&] (uint64_t key, uint64_t) { expired.push_back(key); };
+
+    map.emplace(1, 0, start.plusSeconds(0.010));
+    map.emplace(2, 0, start.plusSeconds(0.020));
+    map.emplace(3, 0, start.plusSeconds(100.0)); // several revolutions
+    map.emplace(4, 0, start.plusSeconds(0.030));
+    map.update(4, start.plusSeconds(0.005));
+    map.emplace(5, 0, start.plusSeconds(0.015));
+    map.erase(5);
+
+    BOOST_CHECK_EQUAL(map.expire(onExpire, start), 0);
+
+    BOOST_CHECK_EQUAL(map.expire(onExpire, start.plusSeconds(0.0105)), 2);
+    BOOST_CHECK_EQUAL(expired[0], 4);
+    BOOST_CHECK_EQUAL(expired[1], 1);
+
+    // Entry already due when inserted is expired on the next call.
+    map.emplace(6, 0, start);
+    BOOST_CHECK_EQUAL(map.expire(onExpire, start.plusSeconds(0.011)), 1);
+    BOOST_CHECK_EQUAL(expired.back(), 6);
+
+    BOOST_CHECK_EQUAL(map.expire(onExpire, start.plusSeconds(50.0)), 1);
+    BOOST_CHECK_EQUAL(expired.back(), 2);
+    BOOST_CHECK_EQUAL(map.size(), 1);
+
+    BOOST_CHECK_EQUAL(map.expire(onExpire, start.plusSeconds(100.0)), 1);
+    BOOST_CHECK_EQUAL(expired.back(), 3);
+    BOOST_CHECK_EQUAL(map.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( against_timeout_map )
+{
+    Map map(0.001, 64);
+    TimeoutMap<uint64_t, uint64_t> ref;
+
+    std::mt19937 rng(0);
+    Date now = start;
+
+    std::map<uint64_t, uint64_t> expired, refExpired;
+
+    for (size_t i = 0; i < 100000; ++i) {
+        uint64_t key = rng() % 1000;
+        Date timeout = now.plusSeconds((rng() % 200) / 1000.0);
+
+        switch (rng() % 4) {
+        case 0:
+            BOOST_REQUIRE_EQUAL(
+                    map.emplace(key, i, timeout), ref.emplace(key, i, timeout));
+            break;
+        case 1:
+            if (!ref.count(key)) break;
+            map.update(key, timeout);
+            ref.update(key, timeout);
+            break;
+        case 2:
+            BOOST_REQUIRE_EQUAL(map.erase(key), ref.erase(key));
+            break;
+        case 3:
+            now.addSeconds((rng() % 5) / 1000.0);
+            map.expire([&] (uint64_t k, uint64_t v) { expired[k] += v; }, now);
+            ref.expire([&] (uint64_t k, uint64_t v) { refExpired[k] += v; }, now);
+            break;
+        }
+
+        BOOST_REQUIRE_EQUAL(map.size(), ref.size());
+    }
+
+    BOOST_CHECK(expired == refExpired);
+}
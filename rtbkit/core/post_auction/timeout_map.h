@@ -12,9 +12,12 @@
 #pragma once
 
 #include "soa/types/date.h"
+#include "jml/utils/exc_check.h"
 
+#include <memory>
 #include <set>
 #include <queue>
+#include <unordered_map>
 
 namespace RTBKIT {
 
@@ -22,7 +25,12 @@ namespace RTBKIT {
 /* TIMEOUT MAP                                                                */
 /******************************************************************************/
 
-template<typename Key, typename Value>
+/** The entries and the timeout queue are allocated with Allocator, which
+    can be ML::Huge_Page_Allocator for the large maps that live for a long
+    time.
+*/
+template<typename Key, typename Value,
+         template<typename> class Allocator = std::allocator>
 struct TimeoutMap
 {
 
@@ -50,6 +58,13 @@ struct TimeoutMap
         return it->second.value;
     }
 
+    Datacratic::Date getTimeout(const Key& key) const
+    {
+        auto it = map.find(key);
+        ExcCheck(it != map.end(), "key not present in the timeout map.");
+        return it->second.timeout;
+    }
+
     bool emplace(Key key, Value value, Datacratic::Date timeout)
     {
         auto ret = map.insert(std::make_pair(
@@ -135,8 +150,11 @@ private:
         }
     };
 
-    std::unordered_map<Key, Entry> map;
-    std::priority_queue<TimeoutEntry> queue;
+    std::unordered_map<Key, Entry, std::hash<Key>, std::equal_to<Key>,
+                       Allocator<std::pair<const Key, Entry> > > map;
+    std::priority_queue<TimeoutEntry,
+                        std::vector<TimeoutEntry, Allocator<TimeoutEntry> > >
+        queue;
 };
 
 } // namespace RTBKIT
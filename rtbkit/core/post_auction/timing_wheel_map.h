@@ -0,0 +1,314 @@
+/* timing_wheel_map.h                            -*- C++ -*-
+   FreeBSD-style copyright and disclaimer apply
+
+   Map that maintains a timeout mechanism using a hashed timing wheel.
+
+   Drop-in alternative to RTBKIT::TimeoutMap for large in-flight sets. The
+   entries live in an open-addressing hash table and the timeouts are kept
+   in a wheel of buckets indexed by tick, which makes insert, update and
+   expire O(1) amortized instead of paying for a priority queue.
+
+   Differences with TimeoutMap:
+   - Key and Value must be default constructible.
+   - References returned by get() are invalidated by emplace().
+   - Timeouts are only resolved to the wheel's tick resolution; an entry is
+     never expired before its timeout but may be expired up to one tick
+     late.
+
+*/
+
+#pragma once
+
+#include "soa/types/date.h"
+#include "jml/utils/exc_check.h"
+
+#include <vector>
+#include <functional>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace RTBKIT {
+
+/******************************************************************************/
+/* TIMING WHEEL MAP                                                           */
+/******************************************************************************/
+
+template<typename Key, typename Value, typename Hash = std::hash<Key> >
+struct TimingWheelMap
+{
+    /** resolution is the duration of one tick of the wheel in seconds and
+        numSlots the number of ticks in one revolution of the wheel (rounded
+        up to a power of 2). Entries whose timeout is further away than one
+        revolution are kept in their slot until their round comes up.
+     */
+    TimingWheelMap(double resolution = 0.001, size_t numSlots = 1 << 12) :
+        resolution(resolution),
+        used(0),
+        nextTick(std::numeric_limits<uint64_t>::max()),
+        started(false)
+    {
+        ExcCheckGreater(resolution, 0.0, "invalid timing wheel resolution");
+
+        size_t slots = 1;
+        while (slots < numSlots) slots <<= 1;
+        wheel.resize(slots);
+
+        table.resize(MinCapacity);
+    }
+
+    size_t size() const
+    {
+        return used;
+    }
+
+    bool count(const Key& key) const
+    {
+        return find(key) != NotFound;
+    }
+
+    Value& get(const Key& key)
+    {
+        size_t index = find(key);
+        ExcCheck(index != NotFound, "key not present in the timeout map.");
+        return table[index].value;
+    }
+
+    const Value& get(const Key& key) const
+    {
+        size_t index = find(key);
+        ExcCheck(index != NotFound, "key not present in the timeout map.");
+        return table[index].value;
+    }
+
+    Datacratic::Date getTimeout(const Key& key) const
+    {
+        size_t index = find(key);
+        ExcCheck(index != NotFound, "key not present in the timeout map.");
+        return table[index].timeout;
+    }
+
+    bool emplace(Key key, Value value, Datacratic::Date timeout)
+    {
+        if ((used + 1) * 2 > table.size()) grow();
+
+        size_t index = probe(key);
+        Entry& entry = table[index];
+        if (entry.used) return false;
+
+        entry.used = true;
+        entry.key = std::move(key);
+        entry.value = std::move(value);
+        ++used;
+
+        schedule(entry, timeout);
+        return true;
+    }
+
+    void update(const Key& key, Datacratic::Date timeout)
+    {
+        size_t index = find(key);
+        ExcCheck(index != NotFound, "key not present in the timeout map.");
+
+        // The old wheel entry becomes stale and is dropped when its slot is
+        // next visited.
+        schedule(table[index], timeout);
+    }
+
+    Value pop(const Key& key)
+    {
+        size_t index = find(key);
+        ExcCheck(index != NotFound, "key not present in the timeout map.");
+
+        Value value = std::move(table[index].value);
+        remove(index);
+        return value;
+    }
+
+    bool erase(const Key& key)
+    {
+        size_t index = find(key);
+        if (index == NotFound) return false;
+
+        remove(index);
+        return true;
+    }
+
+    template<typename Fn>
+    size_t expire(const Fn& fn, Datacratic::Date now = Datacratic::Date::now())
+    {
+        uint64_t nowTick = toTick(now);
+
+        // Until the first call, nextTick tracks the earliest scheduled tick.
+        if (!started && nowTick < nextTick) nextTick = nowTick;
+        started = true;
+
+        if (nowTick < nextTick) return 0;
+
+        std::vector< std::pair<Key, Value> > toExpire;
+        toExpire.reserve(1 << 4);
+
+        // Visiting a full revolution covers every slot so there's no point
+        // in going further when we've fallen behind.
+        uint64_t lastTick = nowTick;
+        if (lastTick - nextTick >= wheel.size())
+            lastTick = nextTick + wheel.size() - 1;
+
+        for (uint64_t tick = nextTick; tick <= lastTick; ++tick) {
+            Slot& slot = wheel[tick & (wheel.size() - 1)];
+
+            size_t kept = 0;
+            for (size_t i = 0; i < slot.size(); ++i) {
+                size_t index = find(slot[i].key);
+
+                // Erased or rescheduled since it was added to this slot.
+                if (index == NotFound || table[index].tick != slot[i].tick)
+                    continue;
+
+                Entry& entry = table[index];
+                if (entry.timeout > now) {
+                    if (kept != i) slot[kept] = std::move(slot[i]);
+                    ++kept;
+                    continue;
+                }
+
+                toExpire.emplace_back(
+                        std::move(entry.key), std::move(entry.value));
+                remove(index);
+            }
+            slot.resize(kept);
+        }
+
+        // The current tick may still hold entries that time out later within
+        // the same tick so it needs to be revisited on the next call.
+        nextTick = nowTick;
+
+        for (auto& entry : toExpire)
+            fn(std::move(entry.first), std::move(entry.second));
+
+        return toExpire.size();
+    }
+
+private:
+
+    enum { MinCapacity = 16 };
+    static constexpr size_t NotFound = size_t(-1);
+
+    struct Entry
+    {
+        Entry() : used(false), tick(0) {}
+
+        bool used;
+        Key key;
+        Value value;
+        Datacratic::Date timeout;
+        uint64_t tick;
+    };
+
+    struct TimeoutEntry
+    {
+        TimeoutEntry() : tick(0) {}
+        TimeoutEntry(Key key, uint64_t tick) :
+            key(std::move(key)), tick(tick)
+        {}
+
+        Key key;
+        uint64_t tick;
+    };
+
+    typedef std::vector<TimeoutEntry> Slot;
+
+    uint64_t toTick(Datacratic::Date date) const
+    {
+        double ticks = std::ceil(date.secondsSinceEpoch() / resolution);
+        return ticks < 0.0 ? 0 : ticks;
+    }
+
+    void schedule(Entry& entry, Datacratic::Date timeout)
+    {
+        uint64_t tick = toTick(timeout);
+
+        // Anything already due goes in the next slot to be visited.
+        if (!started) nextTick = std::min(nextTick, tick);
+        else if (tick < nextTick) tick = nextTick;
+
+        bool scheduled = entry.timeout != Datacratic::Date() && entry.tick == tick;
+        entry.timeout = timeout;
+        if (scheduled) return;
+
+        // A wheel entry is only valid if its tick matches the one of the
+        // entry which makes any previous wheel entry stale.
+        entry.tick = tick;
+        wheel[tick & (wheel.size() - 1)].emplace_back(entry.key, tick);
+    }
+
+    size_t bucket(const Key& key) const
+    {
+        return Hash()(key) & (table.size() - 1);
+    }
+
+    /** Returns the index of the key or of the empty entry where it should be
+        inserted.
+     */
+    size_t probe(const Key& key) const
+    {
+        size_t mask = table.size() - 1;
+        for (size_t index = bucket(key);; index = (index + 1) & mask) {
+            const Entry& entry = table[index];
+            if (!entry.used || entry.key == key) return index;
+        }
+    }
+
+    size_t find(const Key& key) const
+    {
+        size_t index = probe(key);
+        return table[index].used ? index : NotFound;
+    }
+
+    /** Backward shift deletion which keeps the probe sequences intact without
+        having to resort to tombstones.
+     */
+    void remove(size_t index)
+    {
+        size_t mask = table.size() - 1;
+
+        for (size_t next = (index + 1) & mask;; next = (next + 1) & mask) {
+            Entry& entry = table[next];
+            if (!entry.used) break;
+
+            // Only move the entry if its home bucket isn't in (index, next].
+            size_t home = bucket(entry.key);
+            if (((next - home) & mask) < ((next - index) & mask)) continue;
+
+            table[index] = std::move(entry);
+            index = next;
+        }
+
+        table[index] = Entry();
+        --used;
+    }
+
+    void grow()
+    {
+        std::vector<Entry> old(table.size() * 2);
+        old.swap(table);
+
+        for (Entry& entry : old) {
+            if (!entry.used) continue;
+            table[probe(entry.key)] = std::move(entry);
+        }
+    }
+
+    double resolution;
+    size_t used;
+    std::vector<Entry> table;
+
+    std::vector<Slot> wheel;
+    uint64_t nextTick;
+    bool started;
+};
+
+template<typename Key, typename Value, typename Hash>
+constexpr size_t TimingWheelMap<Key, Value, Hash>::NotFound;
+
+} // namespace RTBKIT
@@ -0,0 +1,75 @@
+/* agent_throttle.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Closed loop throttling of the auctions sent to an agent.
+*/
+
+#include "agent_throttle.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include <algorithm>
+
+
+using namespace std;
+
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* AGENT THROTTLE                                                            */
+/*****************************************************************************/
+
+AgentThrottle::
+AgentThrottle()
+    : probability(1.0), meanLatencyMs(0.0), timeoutRate(0.0),
+      overloaded(false),
+      responses(0), timeouts(0), totalLatencyMs(0.0)
+{
+}
+
+double
+AgentThrottle::
+update(const AgentConfig & agentConfig, size_t numBidsInFlight)
+{
+    const AgentConfig::ThrottleConfig & config = agentConfig.throttle;
+    int maxInFlight = agentConfig.maxInFlight;
+
+    uint64_t total = responses + timeouts;
+
+    // Nothing to go on in a period without traffic, which mustn't keep a
+    // throttled agent throttled
+    meanLatencyMs = responses ? totalLatencyMs / responses : 0.0;
+    timeoutRate = total ? 1.0 * timeouts / total : 0.0;
+
+    overloaded
+        = meanLatencyMs > config.targetLatencyMs
+        || timeoutRate > config.maxTimeoutRate
+        || (maxInFlight > 0
+            && numBidsInFlight >= config.maxInFlightRatio * maxInFlight);
+
+    if (overloaded) probability *= config.decrease;
+    else probability += config.increase;
+
+    probability = std::min<double>(config.maxProbability,
+                                   std::max<double>(config.minProbability,
+                                                    probability));
+
+    responses = timeouts = 0;
+    totalLatencyMs = 0.0;
+
+    return probability;
+}
+
+Json::Value
+AgentThrottle::
+toJson() const
+{
+    Json::Value result;
+    result["probability"] = probability;
+    result["meanLatencyMs"] = meanLatencyMs;
+    result["timeoutRate"] = timeoutRate;
+    result["overloaded"] = overloaded;
+    return result;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,69 @@
+/* agent_throttle.h                                                -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Closed loop throttling of the auctions sent to an agent.
+*/
+
+#pragma once
+
+#include "soa/jsoncpp/value.h"
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace RTBKIT {
+
+struct AgentConfig;
+
+
+/*****************************************************************************/
+/* AGENT THROTTLE                                                            */
+/*****************************************************************************/
+
+/** AIMD controller of the proportion of the auctions that the router sends
+    to an agent, within the bounds of its AgentConfig::ThrottleConfig.
+
+    The router records the agent's response times and timeouts as they
+    happen, then calls update() periodically.  An agent whose mean response
+    time, timeout rate or number of bids in flight went over the configured
+    limits during the period is considered overloaded, and its probability is
+    multiplied by the decrease factor; otherwise the increase is added to it.
+
+    Not thread safe; it's used under the router's agentsLock.
+*/
+
+struct AgentThrottle {
+
+    AgentThrottle();
+
+    /** The agent responded after the given time. */
+    void recordResponse(double latencyMs)
+    {
+        ++responses;
+        totalLatencyMs += latencyMs;
+    }
+
+    /** The agent didn't respond in time. */
+    void recordTimeout() { ++timeouts; }
+
+    /** Run one step of the controller over what was recorded since the last
+        one, given the agent's config and current number of bids in flight,
+        and return the new probability.
+    */
+    double update(const AgentConfig & config, size_t numBidsInFlight);
+
+    /** Current probability, and what was measured over the last period. */
+    double probability;
+    double meanLatencyMs;
+    double timeoutRate;
+    bool overloaded;
+
+    Json::Value toJson() const;
+
+private:
+    uint64_t responses;
+    uint64_t timeouts;
+    double totalLatencyMs;
+};
+
+} // namespace RTBKIT
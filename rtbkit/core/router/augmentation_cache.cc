@@ -0,0 +1,111 @@
+/* augmentation_cache.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Cache of the augmentations of a user.
+*/
+
+#include "augmentation_cache.h"
+
+
+using namespace std;
+
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* AUGMENTATION CACHE                                                        */
+/*****************************************************************************/
+
+namespace {
+
+/** Rough memory taken by an entry on top of its payload: the list node, the
+    index node and the strings' headers. */
+const size_t EntryOverhead = 160;
+
+} // file scope
+
+AugmentationCache::
+AugmentationCache(size_t maxBytes)
+    : maxBytes_(maxBytes), bytes_(0)
+{
+}
+
+void
+AugmentationCache::
+setMaxBytes(size_t maxBytes)
+{
+    maxBytes_ = maxBytes;
+    evict();
+}
+
+std::string
+AugmentationCache::
+makeKey(const std::string & augmentor, const std::string & userId)
+{
+    std::string key;
+    key.reserve(augmentor.size() + 1 + userId.size());
+    key += augmentor;
+    key += '\0';
+    key += userId;
+    return key;
+}
+
+const AugmentationList *
+AugmentationCache::
+get(const std::string & augmentor, const std::string & userId, Date now)
+{
+    auto it = index.find(makeKey(augmentor, userId));
+    if (it == index.end()) return nullptr;
+
+    auto entry = it->second;
+    if (entry->expiry <= now) {
+        erase(entry);
+        return nullptr;
+    }
+
+    entries.splice(entries.begin(), entries, entry);
+    return &entry->augmentation;
+}
+
+void
+AugmentationCache::
+put(const std::string & augmentor, const std::string & userId,
+    AugmentationList augmentation, Date expiry, size_t sizeBytes)
+{
+    if (!enabled()) return;
+
+    std::string key = makeKey(augmentor, userId);
+
+    auto it = index.find(key);
+    if (it != index.end())
+        erase(it->second);
+
+    size_t bytes = sizeBytes + 2 * key.size() + EntryOverhead;
+    if (bytes > maxBytes_) return;
+
+    entries.push_front(Entry { key, std::move(augmentation), expiry, bytes });
+    index[std::move(key)] = entries.begin();
+    bytes_ += bytes;
+
+    evict();
+}
+
+void
+AugmentationCache::
+erase(Entries::iterator it)
+{
+    bytes_ -= it->bytes;
+    index.erase(it->key);
+    entries.erase(it);
+}
+
+void
+AugmentationCache::
+evict()
+{
+    while (bytes_ > maxBytes_ && !entries.empty())
+        erase(std::prev(entries.end()));
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,79 @@
+/* augmentation_cache.h                                            -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Cache of the augmentations of a user.
+*/
+
+#pragma once
+
+#include "rtbkit/common/augmentation.h"
+#include "soa/types/date.h"
+#include <list>
+#include <unordered_map>
+
+
+namespace RTBKIT {
+
+using namespace Datacratic;
+
+
+/*****************************************************************************/
+/* AUGMENTATION CACHE                                                        */
+/*****************************************************************************/
+
+/** Keeps the augmentations that augmentors said could be reused for the same
+    user, until their TTL runs out.  It is bounded by an estimate of its
+    memory use; the least recently used entries are dropped to stay under it.
+
+    Not thread safe; it belongs to the AugmentationLoop's thread.
+*/
+
+struct AugmentationCache {
+
+    AugmentationCache(size_t maxBytes = 0);
+
+    /** Set the memory bound.  0 disables the cache. */
+    void setMaxBytes(size_t maxBytes);
+
+    bool enabled() const { return maxBytes_ > 0; }
+
+    /** Returns the cached augmentation for the user, or a null pointer if
+        there is none or it expired.  The pointer is valid until the cache
+        is next modified.
+    */
+    const AugmentationList *
+    get(const std::string & augmentor, const std::string & userId, Date now);
+
+    /** Cache the augmentation until expiry.  sizeBytes is the size of the
+        augmentation it came from, used to estimate the memory it takes.
+    */
+    void put(const std::string & augmentor, const std::string & userId,
+             AugmentationList augmentation, Date expiry, size_t sizeBytes);
+
+    size_t size() const { return entries.size(); }
+    size_t bytes() const { return bytes_; }
+
+private:
+    struct Entry {
+        std::string key;
+        AugmentationList augmentation;
+        Date expiry;
+        size_t bytes;
+    };
+
+    /** Most recently used first. */
+    typedef std::list<Entry> Entries;
+    Entries entries;
+    std::unordered_map<std::string, Entries::iterator> index;
+
+    size_t maxBytes_;
+    size_t bytes_;
+
+    static std::string makeKey(const std::string & augmentor,
+                               const std::string & userId);
+
+    void erase(Entries::iterator it);
+    void evict();
+};
+
+} // namespace RTBKIT
@@ -34,6 +34,11 @@ AugmentationLoop(ServiceBase & parent,
                  const std::string & name)
     : ServiceBase(name, parent),
       allAugmentors(0),
+      startPolicy(WAIT_FOR_ALL),
+      ejectLatencyFactor(3.0),
+      ejectMaxTimeouts(5),
+      ejectSeconds(5.0),
+      cacheMaxTtl(0),
       idle_(1),
       inbox(65536),
       disconnections(1024),
@@ -47,6 +52,11 @@ AugmentationLoop(std::shared_ptr<ServiceProxies> proxies,
                  const std::string & name)
     : ServiceBase(name, proxies),
       allAugmentors(0),
+      startPolicy(WAIT_FOR_ALL),
+      ejectLatencyFactor(3.0),
+      ejectMaxTimeouts(5),
+      ejectSeconds(5.0),
+      cacheMaxTtl(0),
       idle_(1),
       inbox(65536),
       disconnections(1024),
@@ -105,7 +115,7 @@ init()
     addSource("AugmentationLoop::toAugmentors", toAugmentors);
 
     addPeriodic("AugmentationLoop::checkExpiries", 0.001,
-                [=] (int) { checkExpiries(); });
+                [=] (int) { checkExpiries(); expireAugmentorDeadlines(); });
 
     addPeriodic("AugmentationLoop::recordStats", 0.977,
                 [=] (int) { recordStats(); });
@@ -135,6 +145,14 @@ shutdown()
     toAugmentors.shutdown();
 }
 
+void
+AugmentationLoop::
+setAugmentorTimeout(const std::string & augmentor, double timeoutMs)
+{
+    ExcCheckGreater(timeoutMs, 0.0, "augmentor timeout must be positive");
+    augmentorTimeouts[augmentor] = timeoutMs;
+}
+
 size_t
 AugmentationLoop::
 numAugmenting() const
@@ -179,12 +197,29 @@ recordStats()
     for (auto it = augmentors.begin(), end = augmentors.end();
          it != end;  ++it)
     {
+        Date now = Date::now();
         size_t inFlights = 0;
-        for (const auto& instance : it->second->instances)
+        for (const auto& instance : it->second->instances) {
             inFlights += instance->numInFlight;
 
+            recordLevel(instance->numInFlight,
+                        "augmentor.%s.instances.%s.numInFlight",
+                        it->first, instance->addr);
+            recordLevel(instance->latencyMs,
+                        "augmentor.%s.instances.%s.averageLatencyMs",
+                        it->first, instance->addr);
+            recordLevel(instance->ejected(now),
+                        "augmentor.%s.instances.%s.ejected",
+                        it->first, instance->addr);
+        }
+
         recordLevel(inFlights, "augmentor.%s.numInFlight", it->first);
     }
+
+    if (cache.enabled()) {
+        recordLevel(cache.size(), "cache.entries");
+        recordLevel(cache.bytes(), "cache.bytes");
+    }
 }
 
 
@@ -208,6 +243,7 @@ checkExpiries()
             return Date();
         };
 
+
     if (augmenting.earliest <= now)
         augmenting.expire(onExpired, now);
 
@@ -218,6 +254,25 @@ checkExpiries()
 
 }
 
+void
+AugmentationLoop::
+expireAugmentorDeadlines()
+{
+    augmentorDeadlines.expire(Date::now(), [&] (AugmentorDeadline & deadline)
+        {
+            auto it = augmenting.find(deadline.id);
+            if (it == augmenting.end()) return;
+
+            // Stale if it already replied
+            std::shared_ptr<Entry> entry = it->second;
+            if (!entry->outstanding.erase(deadline.augmentor)) return;
+
+            recordHit("augmentor.%s.deadlineExpired", deadline.augmentor);
+            this->instanceTimedOut(*entry, deadline.augmentor);
+            this->augmentorDone(deadline.id, entry);
+        });
+}
+
 // Is not thread safe and should only be called from the polling loop thread.
 void
 AugmentationLoop::
@@ -333,6 +388,22 @@ augment(const std::shared_ptr<AugmentationInfo> & info,
     }
 #endif
 
+    if (!entry->outstanding.empty() && startPolicy != WAIT_FOR_ALL) {
+        size_t numGroups = info->potentialGroups.size();
+        entry->groupWaitsFor.resize(numGroups);
+        entry->groupStarted.resize(numGroups, false);
+
+        for (unsigned i = 0;  i < numGroups;  ++i) {
+            for (const PotentialBidder & bidder : info->potentialGroups[i]) {
+                for (const auto & aug : bidder.config->augmentations) {
+                    if (startPolicy == SPECULATIVE && !aug.required) continue;
+                    if (entry->outstanding.count(aug.name))
+                        entry->groupWaitsFor[i].insert(aug.name);
+                }
+            }
+        }
+    }
+
     if (entry->outstanding.empty()) {
         // No augmentors required... run the auction straight away
         onFinished(info);
@@ -347,26 +418,146 @@ std::shared_ptr<AugmentorInstanceInfo>
 AugmentationLoop::
 pickInstance(AugmentorInfo& aug)
 {
-    std::shared_ptr<AugmentorInstanceInfo> instance;
-    int minInFlights = std::numeric_limits<int>::max();
+    Date now = Date::now();
 
-    stringstream ss;
+    // Candidates are the instances that can take a request
+    std::shared_ptr<AugmentorInstanceInfo> first, second;
+    size_t numCandidates = 0;
 
-    for (auto it = aug.instances.begin(), end = aug.instances.end();
-         it != end; ++it)
-    {
-        auto & ptr = *it;
-        if (ptr->numInFlight >= minInFlights) continue;
+    for (auto & ptr : aug.instances) {
         if (ptr->numInFlight >= ptr->maxInFlight) continue;
-
-        instance = ptr;
-        minInFlights = ptr->numInFlight;
+        if (ptr->ejected(now)) continue;
+
+        // Reservoir sampling of two of the candidates
+        ++numCandidates;
+        if (numCandidates == 1) first = ptr;
+        else if (numCandidates == 2) second = ptr;
+        else {
+            size_t i = rng() % numCandidates;
+            if (i == 0) first = ptr;
+            else if (i == 1) second = ptr;
+        }
     }
 
+    auto instance = first;
+    if (second && second->load() < first->load())
+        instance = second;
+
     if (instance) instance->numInFlight++;
     return instance;
 }
 
+void
+AugmentationLoop::
+recordInstanceOutcome(AugmentorInfo & aug,
+                      AugmentorInstanceInfo & instance,
+                      double latencyMs)
+{
+    Date now = Date::now();
+
+    bool eject;
+    if (latencyMs < 0) {
+        recordHit("augmentor.%s.instances.%s.timeout", aug.name, instance.addr);
+        eject = ++instance.numTimeouts >= ejectMaxTimeouts;
+    }
+    else {
+        recordOutcome(latencyMs, "augmentor.%s.instances.%s.latencyMs",
+                      aug.name, instance.addr);
+        instance.recordLatency(latencyMs);
+
+        // Needs enough samples for the average to mean something
+        double fastest = std::numeric_limits<double>::max();
+        for (const auto & other : aug.instances) {
+            if (other.get() == &instance || other->ejected(now)) continue;
+            if (other->numSamples < 10) continue;
+            fastest = std::min(fastest, other->latencyMs);
+        }
+
+        eject = instance.numSamples >= 10
+            && fastest != std::numeric_limits<double>::max()
+            && instance.latencyMs > ejectLatencyFactor * fastest;
+    }
+
+    if (!eject || instance.ejected(now)) return;
+
+    bool othersUsable = false;
+    for (const auto & other : aug.instances) {
+        if (other.get() != &instance && !other->ejected(now))
+            othersUsable = true;
+    }
+    if (!othersUsable) return;
+
+    recordHit("augmentor.%s.instances.%s.ejected", aug.name, instance.addr);
+    instance.ejectedUntil = now.plusSeconds(ejectSeconds);
+
+    // It gets traffic again as if it was new
+    instance.reset();
+}
+
+void
+AugmentationLoop::
+instanceTimedOut(Entry & entry, const std::string & augmentor)
+{
+    auto it = entry.instances.find(augmentor);
+    if (it == entry.instances.end()) return;
+
+    // If the instance still exists (it is still alive), we decrement
+    // the inFlight count
+    auto instance = it->second.lock();
+    entry.instances.erase(it);
+    if (!instance) return;
+
+    instance->numInFlight--;
+
+    auto aug = augmentors.find(augmentor);
+    if (aug != augmentors.end())
+        recordInstanceOutcome(*aug->second, *instance, -1);
+}
+
+void
+AugmentationLoop::
+setCache(size_t maxBytes, double maxTtlSeconds)
+{
+    ExcCheckGreaterEqual(maxTtlSeconds, 0.0, "negative cache TTL");
+    cache.setMaxBytes(maxBytes);
+    cacheMaxTtl = maxTtlSeconds;
+}
+
+std::string
+AugmentationLoop::
+cacheUserId(const Auction & auction)
+{
+    if (!auction.request) return "";
+
+    const UserIds & ids = auction.request->userIds;
+    if (ids.exchangeId) return "x:" + ids.exchangeId.toString();
+    if (ids.providerId) return "p:" + ids.providerId.toString();
+    return "";
+}
+
+void
+AugmentationLoop::
+addAugmentation(Entry & entry, const std::string & augmentor,
+                const AugmentationList & augmentation)
+{
+    if (entry.groupWaitsFor.empty()) {
+        auto& auctionAugs = entry.info->auction->augmentations;
+        auctionAugs[augmentor].mergeWith(augmentation);
+    }
+    else entry.results[augmentor].mergeWith(augmentation);
+}
+
+void
+AugmentationLoop::
+setInstanceEjection(double latencyFactor, int maxTimeouts, double seconds)
+{
+    ExcCheckGreater(latencyFactor, 1.0, "ejection latency factor too small");
+    ExcCheckGreater(maxTimeouts, 0, "ejection needs at least one timeout");
+    ejectLatencyFactor = latencyFactor;
+    ejectMaxTimeouts = maxTimeouts;
+    ejectSeconds = seconds;
+}
+
 
 void
 AugmentationLoop::
@@ -384,6 +575,28 @@ doAugmentation(std::shared_ptr<Entry>&& entry)
     }
 
     bool sentToAugmentor = false;
+    std::vector<std::string> skipped;
+
+    // Augmentations that we already have for this user don't need a request
+    if (cache.enabled()) {
+        std::string userId = cacheUserId(*entry->info->auction);
+        if (!userId.empty()) {
+            for (auto it = entry->outstanding.begin();
+                 it != entry->outstanding.end();)
+            {
+                auto cached = cache.get(*it, userId, now);
+                if (!cached) {
+                    recordHit("augmentor.%s.cacheMiss", *it);
+                    ++it;
+                    continue;
+                }
+
+                recordHit("augmentor.%s.cacheHit", *it);
+                addAugmentation(*entry, *it, *cached);
+                it = entry->outstanding.erase(it);
+            }
+        }
+    }
 
     for (auto it = entry->outstanding.begin(), end = entry->outstanding.end();
          it != end;  ++it)
@@ -393,6 +606,7 @@ doAugmentation(std::shared_ptr<Entry>&& entry)
         auto instance = pickInstance(aug);
         if (!instance) {
             recordHit("augmentor.%s.skippedTooManyInFlight", *it);
+            skipped.push_back(*it);
             continue;
         }
         recordHit("augmentor.%s.instances.%s.request", *it, instance->addr);
@@ -416,11 +630,32 @@ doAugmentation(std::shared_ptr<Entry>&& entry)
                 Date::now());
 
         sentToAugmentor = true;
+
+        auto timeout = augmentorTimeouts.find(*it);
+        if (timeout != augmentorTimeouts.end()) {
+            Date deadline = now.plusSeconds(timeout->second * 0.001);
+            if (deadline < entry->timeout)
+                augmentorDeadlines.insert(deadline, { entry->info->auction->id, *it });
+        }
+    }
+
+    // The groups that start early don't wait for the augmentors that we
+    // couldn't send to anyway
+    if (!entry->groupWaitsFor.empty()) {
+        for (const auto & name : skipped)
+            entry->outstanding.erase(name);
     }
 
-    if (sentToAugmentor)
-        augmenting.insert(entry->info->auction->id, std::move(entry), entry->timeout);
-    else entry->onFinished(entry->info);
+    if (sentToAugmentor) {
+        Id id = entry->info->auction->id;
+        std::shared_ptr<Entry> inserted
+            = augmenting.insert(id, std::move(entry), entry->timeout);
+
+        // Some groups might not need any of the augmentors we sent it to
+        if (!inserted->groupWaitsFor.empty())
+            augmentorDone(id, inserted);
+    }
+    else startGroups(*entry, true);
 
     recordLevel(Date::now().secondsSince(now), "requestTimeMs");
 
@@ -432,7 +667,7 @@ AugmentationLoop::
 doConfig(const std::vector<std::string> & message)
 {
     ExcCheckGreaterEqual(message.size(), 4, "config message has wrong size");
-    ExcCheckLessEqual(message.size(), 5, "config message has wrong size");
+    ExcCheckLessEqual(message.size(), 6, "config message has wrong size");
 
     const string & addr = message[0];
     const string & version = message[2];
@@ -446,6 +681,12 @@ doConfig(const std::vector<std::string> & message)
     ExcCheckEqual(version, "1.0", "unknown version for config message");
     ExcCheck(!name.empty(), "no augmentor name specified");
 
+    // Optional timeout in milliseconds for this augmentor's responses
+    if (message.size() >= 6) {
+        double timeoutMs = std::stod(message[5]);
+        if (timeoutMs > 0) augmentorTimeouts[name] = timeoutMs;
+    }
+
     //cerr << "configuring augmentor " << name << " on " << connectTo
     //     << endl;
 
@@ -518,7 +759,8 @@ doResponse(const std::vector<std::string> & message)
     recordEvent("augmentation.response");
     //cerr << "doResponse " << message << endl;
 
-    ExcCheckEqual(message.size(), 7, "response message has wrong size");
+    ExcCheckGreaterEqual(message.size(), 7, "response message has wrong size");
+    ExcCheckLessEqual(message.size(), 8, "response message has wrong size");
 
     const string & version = message[2];
     ExcCheckEqual(version, "1.0", "unknown response version");
@@ -532,17 +774,16 @@ doResponse(const std::vector<std::string> & message)
     ML::Timer timer;
 
     AugmentationList augmentationList;
+    bool parsed = true;
     if (augmentation != "" && augmentation != "null") {
         try {
-            Json::Value augmentationJson;
-
             JML_TRACE_EXCEPTIONS(false);
-            augmentationJson = Json::parse(augmentation);
-            augmentationList = AugmentationList::fromJson(augmentationJson);
+            augmentationList = AugmentationList::parse(augmentation);
         } catch (const std::exception & exc) {
             string eventName = "augmentor." + augmentor
                 + ".responseParsingExceptions";
             recordEvent(eventName.c_str(), ET_COUNT);
+            parsed = false;
         }
     }
 
@@ -561,12 +802,24 @@ doResponse(const std::vector<std::string> & message)
     }
 
     auto augmentorIt = augmentors.find(augmentor);
-    if (augmentorIt != augmentors.end()) {
-        auto instance = augmentorIt->second->findInstance(addr);
-        if (instance) instance->numInFlight--;
-    }
+    std::shared_ptr<AugmentorInstanceInfo> instance;
+    if (augmentorIt != augmentors.end())
+        instance = augmentorIt->second->findInstance(addr);
 
     auto augmentingIt = augmenting.find(id);
+
+    // Only an auction that is still waiting for it holds an in flight
+    // request; the others were already counted as timeouts
+    if (instance) {
+        double latencyMs = startTime.secondsUntil(Date::now()) * 1000.0;
+        if (augmentingIt != augmenting.end()
+            && augmentingIt->second->instances.erase(augmentor)) {
+            instance->numInFlight--;
+            instance->numTimeouts = 0;
+        }
+        recordInstanceOutcome(*augmentorIt->second, *instance, latencyMs);
+    }
+
     if (augmentingIt == augmenting.end()) {
         recordHit("augmentation.unknown");
         recordHit("augmentor.%s.unknown", augmentor, addr);
@@ -574,7 +827,7 @@ doResponse(const std::vector<std::string> & message)
         return;
     }
 
-    auto& entry = *augmentingIt;
+    std::shared_ptr<Entry> entry = augmentingIt->second;
 
     const char* eventType =
         (augmentation == "" || augmentation == "null") ?
@@ -582,28 +835,103 @@ doResponse(const std::vector<std::string> & message)
     recordHit("augmentor.%s.%s", augmentor, eventType);
     recordHit("augmentor.%s.instances.%s.%s", augmentor, addr, eventType);
 
-    auto& auctionAugs = entry.second->info->auction->augmentations;
-    auctionAugs[augmentor].mergeWith(augmentationList);
+    // Optional number of seconds for which the augmentation can be reused
+    // for the same user
+    if (message.size() == 8 && cache.enabled() && parsed) {
+        double ttl = std::min(std::stod(message[7]), cacheMaxTtl);
+        std::string userId = cacheUserId(*entry->info->auction);
+        if (ttl > 0 && !userId.empty())
+            cache.put(augmentor, userId, augmentationList,
+                      Date::now().plusSeconds(ttl), augmentation.size());
+    }
+
+    addAugmentation(*entry, augmentor, augmentationList);
+
+    // Already given up on if it's not there
+    if (entry->outstanding.erase(augmentor))
+        augmentorDone(id, entry);
+}
 
-    entry.second->outstanding.erase(augmentor);
-    if (entry.second->outstanding.empty()) {
-        entry.second->onFinished(entry.second->info);
-        augmenting.erase(augmentingIt);
+void
+AugmentationLoop::
+augmentorDone(const Id & id, const std::shared_ptr<Entry> & entry)
+{
+    if (entry->outstanding.empty()) {
+        if (!entry->finished) startGroups(*entry, true);
+        augmenting.erase(id);
     }
+    else if (!entry->finished && !entry->groupWaitsFor.empty())
+        startGroups(*entry, false);
 }
 
 void
 AugmentationLoop::
-augmentationExpired(const Id & id, const Entry & entry)
+startGroups(Entry & entry, bool all)
 {
-    for (const auto & instance: entry.instances) {
-        // If the instance still exsits (it is still alive), we decrement
-        // the inFlight count
-        auto info = instance.second.lock();
-        if (info) info->numInFlight--;
+    ExcAssert(!entry.finished);
+
+    auto & info = entry.info;
+
+    if (entry.groupWaitsFor.empty()) {
+        if (all) {
+            entry.finished = true;
+            entry.onFinished(info);
+        }
+        return;
     }
 
-    entry.onFinished(entry.info);
+    auto isDone = [&] (const std::set<std::string> & augmentors)
+        {
+            for (const auto & name : augmentors)
+                if (entry.outstanding.count(name)) return false;
+            return true;
+        };
+
+    std::vector<unsigned> ready;
+    size_t remaining = 0;
+    for (unsigned i = 0;  i < entry.groupWaitsFor.size();  ++i) {
+        if (entry.groupStarted[i]) continue;
+        if (all || isDone(entry.groupWaitsFor[i]))
+            ready.push_back(i);
+        else ++remaining;
+    }
+
+    if (ready.empty() && remaining) return;
+
+    entry.finished = remaining == 0;
+
+    // Nothing was started yet so the auction is still all ours
+    if (!entry.batched && entry.finished) {
+        for (auto & result : entry.results)
+            info->auction->augmentations[result.first].mergeWith(result.second);
+        entry.onFinished(info);
+        return;
+    }
+
+    auto batch = std::make_shared<AugmentationInfo>(info->auction, info->lossTimeout);
+    for (unsigned i : ready) {
+        entry.groupStarted[i] = true;
+        batch->potentialGroups.push_back(std::move(info->potentialGroups[i]));
+    }
+    batch->augmentations = entry.results;
+    batch->firstBatch = !entry.batched;
+    batch->lastBatch = entry.finished;
+
+    entry.batched = true;
+
+    recordHit("augmentation.batches");
+    entry.onFinished(batch);
+}
+
+void
+AugmentationLoop::
+augmentationExpired(const Id & id, Entry & entry)
+{
+    for (const auto & augmentor : entry.outstanding)
+        instanceTimedOut(entry, augmentor);
+
+    if (!entry.finished)
+        startGroups(entry, true);
 }                     
 
 } // namespace RTBKIT
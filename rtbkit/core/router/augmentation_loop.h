@@ -10,9 +10,11 @@
 
 #include "rtbkit/common/augmentation.h"
 #include "soa/service/timeout_map.h"
+#include "soa/service/timer_wheel.h"
 #include "soa/service/zmq_endpoint.h"
 #include "soa/service/typed_message_channel.h"
 #include "router_types.h"
+#include "augmentation_cache.h"
 #include <boost/scoped_ptr.hpp>
 #include <boost/thread/thread.hpp>
 #include "soa/service/zmq.hpp"
@@ -21,6 +23,8 @@
 #include "jml/arch/spinlock.h"
 #include <boost/thread/locks.hpp>
 #include "soa/gc/gc_lock.h"
+#include <unordered_map>
+#include <random>
 
 
 namespace RTBKIT {
@@ -34,12 +38,44 @@ namespace RTBKIT {
  */
 struct AugmentorInstanceInfo {
     AugmentorInstanceInfo(const std::string& addr = "", int maxInFlight = 0) :
-        addr(addr), numInFlight(0), maxInFlight(maxInFlight)
+        addr(addr), numInFlight(0), maxInFlight(maxInFlight),
+        latencyMs(0), numSamples(0), numTimeouts(0)
     {}
 
     std::string addr;
     int numInFlight;
     int maxInFlight;
+
+    double latencyMs;       ///< Moving average of the response time
+    size_t numSamples;      ///< Responses that went into latencyMs
+    int numTimeouts;        ///< Timeouts since the last response
+    Date ejectedUntil;      ///< Gets no requests until then
+
+    bool ejected(Date now) const { return now < ejectedUntil; }
+
+    /** Time that one more request is expected to wait for; the instance
+        with the lowest one gets the request.  Instances that don't have
+        a latency yet count as fast ones so that they get some traffic.
+    */
+    double load() const
+    {
+        return (numInFlight + 1) * (numSamples ? latencyMs : 1.0);
+    }
+
+    void recordLatency(double ms)
+    {
+        static constexpr double Alpha = 0.05;
+        latencyMs = numSamples ? latencyMs + Alpha * (ms - latencyMs) : ms;
+        ++numSamples;
+    }
+
+    /** Forget what was measured so that the instance starts over. */
+    void reset()
+    {
+        latencyMs = 0;
+        numSamples = 0;
+        numTimeouts = 0;
+    }
 };
 
 /** Information about a given class of augmentor. */
@@ -64,18 +100,34 @@ struct AugmentorInfo {
 // Information about an auction being augmented
 struct AugmentationInfo {
     AugmentationInfo()
+        : firstBatch(true), lastBatch(true)
     {
     }
 
     AugmentationInfo(const std::shared_ptr<Auction> & auction,
                      Date lossTimeout)
-        : auction(auction), lossTimeout(lossTimeout)
+        : auction(auction), lossTimeout(lossTimeout),
+          firstBatch(true), lastBatch(true)
     {
     }
 
     std::shared_ptr<Auction> auction;   ///< Our copy of the auction
     Date lossTimeout;                     ///< When we send a loss if
     std::vector<GroupPotentialBidders> potentialGroups; ///< One per group
+
+    /** When the groups are started as their augmentations come in (see
+        AugmentationLoop::StartPolicy), the auction is handed over in
+        several batches of groups.  Only the first batch creates the
+        auction, and it can't finish before the last batch was seen.
+    */
+    bool firstBatch;
+    bool lastBatch;
+
+    /** Augmentations received so far for a batch, to be copied into the
+        auction by the thread that owns it.  Empty when they were already
+        put in the auction.
+    */
+    std::unordered_map<std::string, AugmentationList> augmentations;
 };
 
 
@@ -94,6 +146,39 @@ struct AugmentationLoop : public ServiceBase, public MessageLoop {
     typedef boost::function<void (const std::shared_ptr<AugmentationInfo> &)>
         OnFinished;
 
+    /** When the groups of agents of an auction are passed on for bidding. */
+    enum StartPolicy {
+        WAIT_FOR_ALL,       ///< Once every augmentor replied or timed out
+        START_GROUPS_EARLY, ///< Each group once the augmentors it uses did
+        SPECULATIVE         ///< Each group once the augmentors that are
+                            ///< required by one of its agents did
+    };
+
+    /** Set the start policy.  Must be called before start(). */
+    void setStartPolicy(StartPolicy policy) { startPolicy = policy; }
+
+    /** Give up on the given augmentor after timeoutMs instead of waiting
+        for the timeout of the whole augmentation.  Can also be set by the
+        augmentor in its CONFIG message.  Must be called before start().
+    */
+    void setAugmentorTimeout(const std::string & augmentor, double timeoutMs);
+
+    /** When an instance of an augmentor is taken out of the rotation for
+        ejectSeconds: after maxTimeouts timeouts in a row, or once its
+        average latency is more than latencyFactor times the one of the
+        fastest instance.  The last usable instance of an augmentor is
+        never ejected.  Must be called before start().
+    */
+    void setInstanceEjection(double latencyFactor, int maxTimeouts,
+                             double ejectSeconds);
+
+    /** Reuse the augmentations of a user for later auctions of the same
+        user, for as long as the augmentor allowed in its response but never
+        more than maxTtlSeconds.  The cache takes about maxBytes of memory;
+        0 disables it, which is the default.  Must be called before start().
+    */
+    void setCache(size_t maxBytes, double maxTtlSeconds);
+
     void init();
 
     void start();
@@ -124,8 +209,46 @@ private:
         std::map<std::string, std::set<std::string> > augmentorAgents;
         OnFinished onFinished;
         Date timeout;
+
+        /** With an early start policy, the augmentors that each group
+            waits for and whether it was started.  Empty otherwise. */
+        std::vector<std::set<std::string> > groupWaitsFor;
+        std::vector<bool> groupStarted;
+
+        /** With an early start policy, the augmentations are gathered
+            here as the auction may already belong to the router. */
+        std::unordered_map<std::string, AugmentationList> results;
+
+        bool batched = false;   ///< A batch of groups was started
+        bool finished = false;  ///< All the groups were started
     };
 
+    StartPolicy startPolicy;
+
+    std::map<std::string, double> augmentorTimeouts;
+
+    double ejectLatencyFactor;
+    int ejectMaxTimeouts;
+    double ejectSeconds;
+
+    AugmentationCache cache;
+    double cacheMaxTtl;
+
+    /** Id under which the augmentations of the auction's user are cached,
+        or an empty string if it has none. */
+    static std::string cacheUserId(const Auction & auction);
+
+    /** Picks the two instances that are compared in pickInstance(). */
+    std::minstd_rand rng;
+
+    /** Deadline of a single augmentor for an auction. */
+    struct AugmentorDeadline {
+        Id id;
+        std::string augmentor;
+    };
+
+    TimerWheel<AugmentorDeadline> augmentorDeadlines;
+
     /** List of auctions we're currently augmenting.  Once the augmentation
         process is finished the auction will be passed on.
     */
@@ -167,7 +290,25 @@ private:
 
     void handleAugmentorMessage(const std::vector<std::string> & message);
 
+    /** Pick the instance to send a request to with the power of two
+        choices: the least loaded of two random instances that are neither
+        ejected nor full.
+    */
     std::shared_ptr<AugmentorInstanceInfo> pickInstance(AugmentorInfo& aug);
+
+    /** Account for a response taking latencyMs, or for a timeout if it is
+        negative, and eject the instance if it became too slow.
+    */
+    void recordInstanceOutcome(AugmentorInfo & aug,
+                               AugmentorInstanceInfo & instance,
+                               double latencyMs);
+
+    /** Add the augmentor's augmentation to the entry. */
+    void addAugmentation(Entry & entry, const std::string & augmentor,
+                         const AugmentationList & augmentation);
+
+    /** The entry gave up on its request to the augmentor. */
+    void instanceTimedOut(Entry & entry, const std::string & augmentor);
     void doAugmentation(std::shared_ptr<Entry>&& entry);
 
     void recordStats();
@@ -186,7 +327,18 @@ private:
     /** Handle a message asking for augmentation. */
     void doAugment(const std::vector<std::string> & message);
 
-    void augmentationExpired(const Id & id, const Entry & entry);
+    void augmentationExpired(const Id & id, Entry & entry);
+
+    /** Start the groups of the entry that have all of their augmentations,
+        or all of the remaining ones if all is true.  Sets entry.finished
+        once every group was started.
+    */
+    void startGroups(Entry & entry, bool all);
+
+    /** Called once an augmentor replied for the entry or ran out of time. */
+    void augmentorDone(const Id & id, const std::shared_ptr<Entry> & entry);
+
+    void expireAugmentorDeadlines();
 };
 
 } // namespace RTBKIT
@@ -0,0 +1,140 @@
+/* compatibility_cache.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Cache of the compatibility of campaigns and creatives with the exchanges.
+*/
+
+#include "compatibility_cache.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include <algorithm>
+#include <functional>
+
+
+using namespace std;
+
+
+namespace RTBKIT {
+
+namespace {
+
+uint64_t hashJson(const char * kind, const Json::Value & json,
+                  bool includeReasons)
+{
+    string str = kind;
+    str += includeReasons ? "+" : "-";
+    str += json.toStringNoNewLine();
+    return std::hash<string>()(str);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COMPATIBILITY CACHE                                                       */
+/*****************************************************************************/
+
+CompatibilityCache::
+CompatibilityCache()
+    : hits(0), misses(0)
+{
+}
+
+template<typename Fn>
+const CompatibilityCache::ExchangeCompatibility &
+CompatibilityCache::
+get(const ExchangeConnector & exchange, const std::string & agent,
+    uint64_t hash, Fn && compute)
+{
+    Key key;
+    key.exchange = exchange.exchangeName();
+    key.hash = hash;
+
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        ++misses;
+        it = entries.insert(make_pair(key, Entry())).first;
+        it->second.result = compute();
+    }
+    else ++hits;
+
+    ++it->second.refs;
+    agentKeys[agent].push_back(std::move(key));
+
+    return it->second.result;
+}
+
+const CompatibilityCache::ExchangeCompatibility &
+CompatibilityCache::
+campaign(const ExchangeConnector & exchange,
+         const std::string & agent,
+         const AgentConfig & config,
+         bool includeReasons)
+{
+    uint64_t hash = hashJson("campaign", config.toJson(false), includeReasons);
+    return get(exchange, agent, hash, [&] {
+                return exchange.getCampaignCompatibility(config, includeReasons);
+            });
+}
+
+const CompatibilityCache::ExchangeCompatibility &
+CompatibilityCache::
+creative(const ExchangeConnector & exchange,
+         const std::string & agent,
+         const Creative & creative,
+         bool includeReasons)
+{
+    uint64_t hash = hashJson("creative", creative.toJson(), includeReasons);
+    return get(exchange, agent, hash, [&] {
+                return exchange.getCreativeCompatibility(creative, includeReasons);
+            });
+}
+
+void
+CompatibilityCache::
+release(const std::string & agent)
+{
+    auto it = agentKeys.find(agent);
+    if (it == agentKeys.end()) return;
+
+    for (auto & key : it->second) {
+        auto entry = entries.find(key);
+        if (entry == entries.end()) continue;   // exchange was removed
+        if (--entry->second.refs == 0)
+            unused.push_back(std::move(key));
+    }
+
+    agentKeys.erase(it);
+}
+
+void
+CompatibilityCache::
+sweep()
+{
+    for (const auto & key : unused) {
+        auto entry = entries.find(key);
+        if (entry != entries.end() && entry->second.refs == 0)
+            entries.erase(entry);
+    }
+    unused.clear();
+}
+
+void
+CompatibilityCache::
+removeExchange(const std::string & exchange)
+{
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->first.exchange == exchange)
+            it = entries.erase(it);
+        else ++it;
+    }
+
+    // The agents that are configured again on the new exchange will hold
+    // new references to the same keys.
+    auto onExchange = [&] (const Key & key) { return key.exchange == exchange; };
+    for (auto & agent : agentKeys) {
+        auto & keys = agent.second;
+        keys.erase(remove_if(keys.begin(), keys.end(), onExchange), keys.end());
+    }
+}
+
+} // namespace RTBKIT
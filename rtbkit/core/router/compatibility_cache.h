@@ -0,0 +1,110 @@
+/* compatibility_cache.h                                           -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Cache of the compatibility of campaigns and creatives with the exchanges.
+*/
+
+#pragma once
+
+#include "rtbkit/common/exchange_connector.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+namespace RTBKIT {
+
+struct AgentConfig;
+struct Creative;
+
+
+/*****************************************************************************/
+/* COMPATIBILITY CACHE                                                       */
+/*****************************************************************************/
+
+/** Remembers what ExchangeConnector::getCampaignCompatibility() and
+    getCreativeCompatibility() returned, by exchange and by a hash of the
+    JSON of the campaign (without its creatives) or of the creative, so that
+    an agent whose new config only changes a few creatives, or only its
+    campaign section, doesn't have every other creative validated again by
+    every exchange.  Identical creatives of different agents also share
+    their results.
+
+    Entries are counted by the agents that use them.  release() drops the
+    references of an agent and sweep() then forgets the entries that nobody
+    uses anymore; an agent that is reconfigured is released before its new
+    config is looked up, and swept after, so that what didn't change is
+    found again.
+
+    Not thread safe; it's used under the router's agentsLock.
+*/
+
+struct CompatibilityCache {
+
+    typedef ExchangeConnector::ExchangeCompatibility ExchangeCompatibility;
+
+    CompatibilityCache();
+
+    /** Compatibility of the agent's campaign with the exchange. */
+    const ExchangeCompatibility &
+    campaign(const ExchangeConnector & exchange,
+             const std::string & agent,
+             const AgentConfig & config,
+             bool includeReasons);
+
+    /** Compatibility of one of the agent's creatives with the exchange. */
+    const ExchangeCompatibility &
+    creative(const ExchangeConnector & exchange,
+             const std::string & agent,
+             const Creative & creative,
+             bool includeReasons);
+
+    /** Drop the references of the agent to its entries. */
+    void release(const std::string & agent);
+
+    /** Forget the entries that don't have any reference left. */
+    void sweep();
+
+    /** Forget everything about the exchange, which was replaced. */
+    void removeExchange(const std::string & exchange);
+
+    size_t size() const { return entries.size(); }
+
+    uint64_t hits;
+    uint64_t misses;
+
+private:
+    struct Key {
+        std::string exchange;
+        uint64_t hash;
+
+        bool operator < (const Key & other) const
+        {
+            if (hash != other.hash) return hash < other.hash;
+            return exchange < other.exchange;
+        }
+    };
+
+    struct Entry {
+        Entry() : refs(0) {}
+
+        ExchangeCompatibility result;
+        int refs;
+    };
+
+    template<typename Fn>
+    const ExchangeCompatibility &
+    get(const ExchangeConnector & exchange, const std::string & agent,
+        uint64_t hash, Fn && compute);
+
+    std::map<Key, Entry> entries;
+
+    /** Keys that each agent holds a reference to, once per reference. */
+    std::map<std::string, std::vector<Key> > agentKeys;
+
+    /** Keys whose entries may have lost their last reference. */
+    std::vector<Key> unused;
+};
+
+} // namespace RTBKIT
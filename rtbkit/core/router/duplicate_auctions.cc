@@ -0,0 +1,133 @@
+/* duplicate_auctions.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Detection of the auctions that are sent to the router more than once.
+*/
+
+#include "duplicate_auctions.h"
+#include "jml/arch/exception.h"
+#include "jml/utils/hash_specializations.h"
+#include <cmath>
+#include <functional>
+#include <new>
+#include <stdlib.h>
+
+
+using namespace std;
+
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* DUPLICATE AUCTIONS                                                        */
+/*****************************************************************************/
+
+void
+DuplicateAuctions::Deleter::
+operator () (std::atomic<uint64_t> * words) const
+{
+    free(words);
+}
+
+DuplicateAuctions::
+DuplicateAuctions()
+    : numBuckets(0), windowMs(0)
+{
+}
+
+void
+DuplicateAuctions::
+init(double windowSeconds, size_t maxAuctionsPerSecond)
+{
+    if (windowSeconds < 0)
+        throw ML::Exception("duplicate auction window must be positive");
+    if (windowSeconds * 1000.0 >= TimeMask / 2)
+        throw ML::Exception("duplicate auction window of %f seconds is too "
+                            "long", windowSeconds);
+
+    words.reset();
+    numBuckets = 0;
+    windowMs = std::ceil(windowSeconds * 1000.0);
+    if (!windowMs) return;
+
+    double auctions = 2.0 * windowSeconds * maxAuctionsPerSecond;
+    numBuckets = 1;
+    while (numBuckets * BucketSize < auctions)
+        numBuckets *= 2;
+
+    void * mem = 0;
+    if (posix_memalign(&mem, 64, numBuckets * BucketSize * sizeof(uint64_t)))
+        throw ML::Exception("couldn't allocate the duplicate auction table");
+
+    words.reset(static_cast<std::atomic<uint64_t> *>(mem));
+    for (size_t i = 0;  i < numBuckets * BucketSize;  ++i)
+        new (&words[i]) std::atomic<uint64_t>(0);
+}
+
+uint64_t
+DuplicateAuctions::
+key(const Id & auctionId, const std::string & exchange)
+{
+    uint64_t result = ML::chain_hash(auctionId.hash(),
+                                     std::hash<std::string>()(exchange));
+
+    // Final mix of MurmurHash3, as the bucket and the word both come from it
+    result ^= result >> 33;
+    result *= 0xff51afd7ed558ccdULL;
+    result ^= result >> 33;
+    result *= 0xc4ceb9fe1a85ec53ULL;
+    result ^= result >> 33;
+    return result;
+}
+
+bool
+DuplicateAuctions::
+isDuplicate(uint64_t key, Date now)
+{
+    if (!enabled()) return false;
+
+    // The bucket comes from the low bits and the word from the high ones.
+    std::atomic<uint64_t> * bucket
+        = &words[(key & (numBuckets - 1)) * BucketSize];
+    uint64_t hash = key >> TimeBits;
+    if (!hash) hash = 1;   // 0 is an empty word
+
+    uint64_t time = uint64_t(now.secondsSinceEpoch() * 1000.0) & TimeMask;
+    uint64_t word = hash << TimeBits | time;
+
+    // Another thread can take the word we're replacing; we then look again
+    // since it could have been a copy of our auction.
+    for (unsigned attempt = 0;  attempt < 4;  ++attempt) {
+        unsigned oldest = 0;
+        uint64_t oldestWord = 0, oldestAge = 0;
+
+        for (unsigned i = 0;  i < BucketSize;  ++i) {
+            uint64_t current = bucket[i].load(std::memory_order_relaxed);
+            uint64_t age = current
+                ? (time - current) & TimeMask
+                : TimeMask + 1;
+
+            // Seen by a thread whose clock was read a bit after ours
+            if (current && age > TimeMask / 2)
+                age = 0;
+
+            if (current >> TimeBits == hash && age <= windowMs)
+                return true;
+
+            if (i == 0 || age > oldestAge) {
+                oldest = i;
+                oldestWord = current;
+                oldestAge = age;
+            }
+        }
+
+        if (bucket[oldest].compare_exchange_strong(oldestWord, word,
+                                                   std::memory_order_relaxed))
+            return false;
+    }
+
+    return false;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,83 @@
+/* duplicate_auctions.h                                            -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Detection of the auctions that are sent to the router more than once.
+*/
+
+#pragma once
+
+#include "soa/types/date.h"
+#include "soa/types/id.h"
+#include <atomic>
+#include <memory>
+#include <string>
+
+
+namespace RTBKIT {
+
+using namespace Datacratic;
+
+
+/*****************************************************************************/
+/* DUPLICATE AUCTIONS                                                        */
+/*****************************************************************************/
+
+/** Remembers the auctions seen in the last window so that those which are
+    resent, by the exchange or by a proxy in front of the router, can be
+    dropped before they go through the filters and out to the agents.
+
+    The auctions are kept as 64 bit words in a hash table of cache line
+    sized buckets of 8 words, each word holding 40 bits of the hash of the
+    auction and the millisecond at which it was seen.  A lookup reads a
+    single bucket, and an auction that isn't in it replaces the oldest
+    word of the bucket.  The table is sized for the auctions of twice the
+    window so that a bucket rarely loses an auction before its window is
+    up; when it does, a duplicate can go through but an auction is never
+    wrongly dropped short of a 40 bit hash collision in its bucket.
+
+    Thread-safe and lock free; it is used by all of the exchange threads.
+*/
+
+struct DuplicateAuctions {
+
+    DuplicateAuctions();
+
+    /** Remember the auctions for windowSeconds, with room for up to
+        maxAuctionsPerSecond.  A window of 0 disables the detection.  Not
+        thread-safe; must be called before the auctions come in.
+    */
+    void init(double windowSeconds, size_t maxAuctionsPerSecond);
+
+    bool enabled() const { return numBuckets > 0; }
+
+    double windowSeconds() const { return windowMs / 1000.0; }
+
+    /** Returns true if an auction with the same key was seen in the last
+        window, and otherwise remembers it as seen now.
+    */
+    bool isDuplicate(uint64_t key, Date now = Date::now());
+
+    /** Key of an auction.  Ids are only unique within an exchange. */
+    static uint64_t key(const Id & auctionId, const std::string & exchange);
+
+    size_t capacity() const { return numBuckets * BucketSize; }
+    size_t memoryBytes() const { return capacity() * sizeof(uint64_t); }
+
+private:
+    enum {
+        BucketSize = 8,         ///< Words in a 64 byte cache line
+        TimeBits = 24           ///< Milliseconds, wrapping every 4.6 hours
+    };
+
+    static constexpr uint64_t TimeMask = (uint64_t(1) << TimeBits) - 1;
+
+    struct Deleter {
+        void operator () (std::atomic<uint64_t> * words) const;
+    };
+
+    std::unique_ptr<std::atomic<uint64_t>[], Deleter> words;
+    size_t numBuckets;
+    uint64_t windowMs;
+};
+
+} // namespace RTBKIT
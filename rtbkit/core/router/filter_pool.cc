@@ -11,6 +11,7 @@
 #include "rtbkit/common/exchange_connector.h"
 #include "rtbkit/core/agent_configuration/agent_config.h"
 #include "soa/service/service_base.h"
+#include "soa/service/scope_profiler.h"
 #include "jml/utils/exc_check.h"
 #include "jml/arch/tick_counter.h"
 
@@ -21,13 +22,29 @@ using namespace ML;
 
 namespace RTBKIT {
 
+namespace {
+
+// One in StatsSamplingPeriod requests is sampled for the filter stats.
+enum { StatsSamplingPeriod = 10 };
+
+} // file scope
+
 
 /******************************************************************************/
 /* FILTER POOL                                                                */
 /******************************************************************************/
 
 FilterPool::
-FilterPool() : data(new Data()), events(nullptr) {}
+FilterPool() :
+    data(new Data()),
+    generations(0),
+    adaptive(false),
+    adaptivePeriod(1000),
+    adaptiveSamples(0),
+    order(nullptr),
+    reasonsRatio(1000 / StatsSamplingPeriod),
+    events(nullptr)
+{}
 
 
 void
@@ -42,12 +59,21 @@ bool
 FilterPool::
 setData(Data*& oldData, unique_ptr<Data>& newData)
 {
+    if (newData) {
+        newData->generation = ++generations;
+        newData->stats.reset(new FilterStats[newData->filters.size()]);
+    }
+
     if (!data.compare_exchange_strong(oldData, newData.get()))
         return false;
 
     newData.release();
     gc.defer([=] { delete oldData; });
 
+    // Orders are tied to the layout of the filters in the old data.
+    FilterOrder* oldOrder = order.exchange(nullptr);
+    if (oldOrder) gc.defer([=] { delete oldOrder; });
+
     return true;
 }
 
@@ -64,24 +90,27 @@ FilterPool::
     }
 
     gc.deferBarrier();
+    delete order.load();
 }
 
 
 void
 FilterPool::
-recordDiff(const Data* data, const FilterBase* filter, const ConfigSet& diff)
+recordDiff(const Data* data, const FilterBase* filter, const ConfigSet& diff,
+           const char* phase)
 {
     for (size_t cfg = diff.next(); cfg < diff.size(); cfg = diff.next(cfg+1)) {
         const AgentConfig& config = *data->configs[cfg].config;
 
-        events->recordHit("accounts.%s.filter.static.%s",
-                config.account.toString('.'), filter->name());
+        events->recordHit("accounts.%s.filter.%s.%s",
+                config.account.toString('.'), phase, filter->name());
     }
 }
 
 void
 FilterPool::
-recordReason(const Data* data, const FilterBase* f, FilterState & state){
+recordReason(const Data* data, const FilterBase* f, FilterState & state,
+             float weight){
 
     FilterState::FilterReasons& reasons = state.getFilterReasons();
     for ( auto it = reasons.begin() ; it != reasons.end(); ++it) {
@@ -91,26 +120,23 @@ recordReason(const Data* data, const FilterBase* f, FilterState & state){
              idx = it->second.next(idx + 1))
         {
             const AgentConfig& config = *data->configs[idx].config;
-            events->recordHit("accounts.%s.filter.static.reasons.%s.%s",
-                               config.account.toString('.'),
-                               f->name(),
-                               it->first);
+            events->recordCount(weight,
+                                "accounts.%s.filter.static.reasons.%s.%s",
+                                config.account.toString('.'),
+                                f->name(),
+                                it->first);
         }
 
     }
 
 }
 
-uint64_t
+void
 FilterPool::
-recordTime(uint64_t start, const FilterBase* filter)
+recordTime(uint64_t start, uint64_t end, const FilterBase* filter)
 {
-    uint64_t now = ticks();
-    double us = ((now - start) / ticks_per_second) * 1000000.0;
-
+    double us = ((end - start) / ticks_per_second) * 1000000.0;
     events->recordLevel(us, "filters.timingUs.%s", filter->name());
-
-    return now;
 }
 
 
@@ -118,6 +144,26 @@ FilterPool::ConfigList
 FilterPool::
 filter(const BidRequest& br, const ExchangeConnector* conn, const ConfigSet& mask)
 {
+    ConfigList result;
+
+    filter(br, conn, [&] (const ConfigEntry& entry, BiddableSpots& spots) {
+                result.push_back(entry);
+                result.back().biddableSpots = std::move(spots);
+            }, mask);
+
+    return result;
+}
+
+
+void
+FilterPool::
+filter(const BidRequest& br,
+       const ExchangeConnector* conn,
+       const OnBiddable& onBiddable,
+       const ConfigSet& mask)
+{
+    ProfileScope scope("filter");
+
     GcLockBase::SharedGuard guard(gc, GcLockBase::RD_NO);
 
     const Data* current = data.load();
@@ -128,23 +174,52 @@ filter(const BidRequest& br, const ExchangeConnector* conn, const ConfigSet& mas
 
     ConfigSet configs = state.configs();
 
-    bool sampleStats = events && (random() % 10 == 0);
+    bool isAdaptive = adaptive.load(memory_order_relaxed);
+    const FilterOrder* currentOrder = isAdaptive ? order.load() : nullptr;
+    if (currentOrder && currentOrder->generation != current->generation)
+        currentOrder = nullptr;
+
+    bool sampleStats =
+        (events || isAdaptive) && (random() % StatsSamplingPeriod == 0);
+
+    size_t ratio = reasonsRatio;
+    bool sampleReasons = sampleStats && events && (random() % ratio == 0);
+    state.setRecordReasons(sampleReasons);
     uint64_t ticksStart = sampleStats ? ticks() : 0;
 
-    for (FilterBase* filter : current->filters) {
+    for (size_t i = 0; i < current->filters.size(); ++i) {
+        unsigned index = currentOrder ? currentOrder->filters[i] : i;
+        FilterBase* filter = current->filters[index];
+
         filter->filter(state);
 
         const ConfigSet& filtered = state.configs();
 
         if (sampleStats) {
-            ticksStart = recordTime(ticksStart, filter);
-            recordDiff(current, filter, configs ^ filtered);
-            if (!state.getFilterReasons().empty()) {
-                recordReason(current, filter, state);
+            uint64_t ticksEnd = ticks();
+
+            if (isAdaptive) {
+                // Filters can only narrow the set of configs.
+                FilterStats& stats = current->stats[index];
+                stats.ticks += ticksEnd - ticksStart;
+                stats.eliminated += configs.count() - filtered.count();
+                stats.samples++;
+            }
+
+            if (events) {
+                recordTime(ticksStart, ticksEnd, filter);
+                recordDiff(current, filter, configs ^ filtered);
             }
+
+            if (sampleReasons) {
+                if (!state.getFilterReasons().empty())
+                    recordReason(current, filter, state, ratio);
+                state.resetFilterReasons();
+            }
+
             configs = filtered;
+            ticksStart = ticks();
         }
-        state.resetFilterReasons();
 
         if (filtered.empty()) {
             if (sampleStats) 
@@ -153,17 +228,59 @@ filter(const BidRequest& br, const ExchangeConnector* conn, const ConfigSet& mas
         }
     }
 
-    auto biddableSpots = state.biddableSpots();
-    configs = state.configs();
+    if (sampleStats && isAdaptive && ++adaptiveSamples % adaptivePeriod == 0)
+        reorderFilters(current);
 
-    ConfigList result;
-    for (size_t i = configs.next(); i < configs.size(); i = configs.next(i + 1)) {
-        ConfigEntry entry = current->configs[i];
-        entry.biddableSpots = std::move(biddableSpots[i]);
-        result.emplace_back(std::move(entry));
+    // The list is swapped out of its thread's spare so that its storage is
+    // reused by the next request, even if onBiddable filters another one.
+    static thread_local FilterState::BiddableConfigs spare;
+
+    FilterState::BiddableConfigs biddable;
+    biddable.swap(spare);
+    state.biddableSpots(biddable);
+
+    for (auto& config : biddable)
+        onBiddable(current->configs[config.first], config.second);
+
+    biddable.clear();
+    spare.swap(biddable);
+}
+
+
+ConfigSet
+FilterPool::
+filterAugmented(
+        const BidRequest& br,
+        const ExchangeConnector* conn,
+        const Auction::Augmentations& augmentations,
+        const ConfigSet& mask)
+{
+    ProfileScope scope("filterAugmented");
+
+    GcLockBase::SharedGuard guard(gc, GcLockBase::RD_NO);
+
+    const Data* current = data.load();
+
+    FilterState state(br, conn, current->activeConfigs, &augmentations);
+    state.narrowConfigs(mask);
+    state.setRecordReasons(false);
+
+    bool sampleStats = events && (random() % StatsSamplingPeriod == 0);
+    ConfigSet configs = state.configs();
+
+    for (FilterBase* filter : current->postFilters) {
+        if (state.configs().empty()) break;
+
+        filter->filter(state);
+
+        if (sampleStats) {
+            const ConfigSet& filtered = state.configs();
+            recordDiff(current, filter, configs ^ filtered, "augmented");
+            configs = filtered;
+        }
     }
 
-    return result;
+    return state.configs();
 }
 
 
@@ -285,6 +402,116 @@ removeConfig(const string& name)
     if (events) events->recordHit("filters.removeConfig");
 }
 
+vector< pair<string, unsigned> >
+FilterPool::
+updateConfigs(const ConfigUpdates& updates)
+{
+    if (updates.empty()) return {};
+
+    GcLockBase::SharedGuard guard(gc);
+
+    unique_ptr<Data> newData;
+    Data* oldData = data.load();
+    vector< pair<string, unsigned> > indexes;
+
+    do {
+        newData.reset(new Data(*oldData));
+        indexes.clear();
+
+        for (const auto& op : updates.ops) {
+            const ConfigEntry& entry = op.second;
+
+            if (op.first)
+                indexes.emplace_back(entry.name, newData->addConfig(entry));
+            else newData->removeConfig(entry.name);
+        }
+    } while (!setData(oldData, newData));
+
+    if (events) {
+        size_t added = indexes.size();
+        size_t removed = updates.size() - added;
+        if (added) events->recordCount(added, "filters.addConfig");
+        if (removed) events->recordCount(removed, "filters.removeConfig");
+        events->recordHit("filters.updateConfigs");
+    }
+
+    return indexes;
+}
+
+void
+FilterPool::
+setReasonsSampling(size_t period)
+{
+    ExcCheckGreater(period, 0, "invalid reasons sampling period");
+    reasonsRatio = std::max<size_t>(1, period / StatsSamplingPeriod);
+}
+
+
+void
+FilterPool::
+setAdaptiveOrdering(bool enabled, size_t period)
+{
+    ExcCheckGreater(period, 0, "invalid adaptive ordering period");
+
+    GcLockBase::SharedGuard guard(gc);
+
+    adaptivePeriod = period;
+    adaptive = enabled;
+
+    if (!enabled) {
+        FilterOrder* oldOrder = order.exchange(nullptr);
+        if (oldOrder) gc.defer([=] { delete oldOrder; });
+    }
+}
+
+void
+FilterPool::
+reorderFilters(const Data* current)
+{
+    size_t numFilters = current->filters.size();
+    vector<double> scores(numFilters, 0.0);
+
+    for (size_t i = 0; i < numFilters; ++i) {
+        FilterStats& stats = current->stats[i];
+
+        uint64_t samples = stats.samples;
+        uint64_t ticks = stats.ticks;
+        uint64_t eliminated = stats.eliminated;
+
+        // Decay the totals so that the order follows the traffic mix.
+        stats.samples -= samples / 2;
+        stats.ticks -= ticks / 2;
+        stats.eliminated -= eliminated / 2;
+
+        // Filters that never got to execute are moved up front so that we
+        // get a chance to measure them.
+        if (!samples) continue;
+
+        double cost = double(ticks) / samples;
+        double selectivity = double(eliminated) / samples;
+
+        // Cost per eliminated config; the constant orders the filters that
+        // never eliminate anything by cost.
+        scores[i] = cost / (selectivity + 0.01);
+    }
+
+    unique_ptr<FilterOrder> newOrder(new FilterOrder);
+    newOrder->generation = current->generation;
+    newOrder->filters.resize(numFilters);
+    for (size_t i = 0; i < numFilters; ++i) newOrder->filters[i] = i;
+
+    // Ties are broken by the static priority order of Data::filters.
+    stable_sort(newOrder->filters.begin(), newOrder->filters.end(),
+            [&] (unsigned lhs, unsigned rhs) {
+                return scores[lhs] < scores[rhs];
+            });
+
+    FilterOrder* oldOrder = order.exchange(newOrder.release());
+    if (oldOrder) gc.defer([=] { delete oldOrder; });
+
+    if (events) events->recordHit("filters.reorder");
+}
+
 std::vector<string>
 FilterPool::
 getFilterNames() const
@@ -293,11 +520,14 @@ getFilterNames() const
 
     const Data* current = data.load();
     std::vector<string> filter_names;
-    filter_names.reserve(current->filters.size());
+    filter_names.reserve(current->filters.size() + current->postFilters.size());
 
     for (FilterBase* filter : current->filters) {
         filter_names.push_back(filter->name());
     }
+    for (FilterBase* filter : current->postFilters) {
+        filter_names.push_back(filter->name());
+    }
 
     return filter_names;
 }
@@ -310,11 +540,16 @@ getFilterNames() const
 FilterPool::Data::
 Data(const Data& other) :
     configs(other.configs),
-    activeConfigs(other.activeConfigs)
+    activeConfigs(other.activeConfigs),
+    generation(0)
 {
     filters.reserve(other.filters.size());
     for (FilterBase* filter : other.filters)
         filters.push_back(filter->clone());
+
+    postFilters.reserve(other.postFilters.size());
+    for (FilterBase* filter : other.postFilters)
+        postFilters.push_back(filter->clone());
 }
 
 
@@ -322,6 +557,7 @@ FilterPool::Data::
 ~Data()
 {
     for (FilterBase* filter : filters) delete filter;
+    for (FilterBase* filter : postFilters) delete filter;
 }
 
 ssize_t
@@ -337,23 +573,33 @@ findConfig(const string& name) const
 unsigned
 FilterPool::Data::
 addConfig(const string& name, const AgentInfo& info)
+{
+    return addConfig(ConfigEntry(name, info));
+}
+
+unsigned
+FilterPool::Data::
+addConfig(const ConfigEntry& entry)
 {
     // If our config already exists, we have to deregister it with the filters
     // before we can add the new config.
-    removeConfig(name);
+    removeConfig(entry.name);
 
     ssize_t index = findConfig("");
     if (index >= 0)
-        configs[index] = ConfigEntry(name, info);
+        configs[index] = entry;
     else {
         index = configs.size();
-        configs.emplace_back(name, info);
+        configs.push_back(entry);
     }
+    configs[index].index = index;
 
-    activeConfigs.setConfig(index, info.config->creatives.size());
+    activeConfigs.setConfig(index, entry.config->creatives.size());
 
     for (FilterBase* filter : filters)
-        filter->addConfig(index, info.config);
+        filter->addConfig(index, entry.config);
+    for (FilterBase* filter : postFilters)
+        filter->addConfig(index, entry.config);
 
     return index;
 }
@@ -369,6 +615,8 @@ removeConfig(const string& name)
 
     for (FilterBase* filter : filters)
         filter->removeConfig(index, configs[index].config);
+    for (FilterBase* filter : postFilters)
+        filter->removeConfig(index, configs[index].config);
 
     configs[index].reset();
 }
@@ -396,8 +644,11 @@ addFilter(FilterBase* filter)
         filter->addConfig(cfgId, configs[cfgId].config);
     }
 
-    filters.push_back(filter);
-    sort(filters.begin(), filters.end(), [] (FilterBase* lhs, FilterBase* rhs) {
+    auto& list = filter->phase() == FilterBase::PostAugmentation
+        ? postFilters : filters;
+
+    list.push_back(filter);
+    sort(list.begin(), list.end(), [] (FilterBase* lhs, FilterBase* rhs) {
                 return lhs->priority() < rhs->priority();
             });
 }
@@ -407,7 +658,15 @@ FilterPool::Data::
 removeFilter(const string& name)
 {
     ssize_t index = findFilter(name);
-    if (index < 0) return;
+    if (index < 0) {
+        auto it = find_if(postFilters.begin(), postFilters.end(),
+                [&] (FilterBase* filter) { return filter->name() == name; });
+        if (it == postFilters.end()) return;
+
+        delete *it;
+        postFilters.erase(it);
+        return;
+    }
 
     delete filters[index];
 
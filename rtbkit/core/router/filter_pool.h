@@ -12,6 +12,7 @@
 #include "soa/gc/gc_lock.h"
 
 #include <atomic>
+#include <functional>
 #include <vector>
 #include <memory>
 #include <string>
@@ -48,11 +49,16 @@ struct FilterPool
     {
         ConfigEntry(std::string name, const AgentInfo& info) :
             name(std::move(name)),
+            index(-1),
             config(info.config),
             status(info.status),
             stats(info.stats)
         {}
 
+        explicit ConfigEntry(std::string name) :
+            name(std::move(name)), index(-1)
+        {}
+
         void reset()
         {
             name = "";
@@ -61,6 +67,10 @@ struct FilterPool
         }
 
         std::string name;
+
+        // Index of the config in the pool; set once the entry is added.
+        unsigned index;
+
         std::shared_ptr<AgentConfig> config;
         std::shared_ptr<AgentStatus> status;
         std::shared_ptr<AgentStats> stats;
@@ -75,6 +85,31 @@ struct FilterPool
             const ExchangeConnector* conn,
             const ConfigSet& mask = ConfigSet(true));
 
+    typedef std::function<void (const ConfigEntry&, BiddableSpots&)> OnBiddable;
+
+    /** Calls onBiddable, in order of config index, for each config that
+        passes the filters along with the spots it can bid on. The entry
+        belongs to the pool and is only valid for the duration of the call so
+        only the configs that the caller keeps need to have their shared_ptrs
+        copied. The spots can be moved from.
+     */
+    void filter(
+            const BidRequest& br,
+            const ExchangeConnector* conn,
+            const OnBiddable& onBiddable,
+            const ConfigSet& mask = ConfigSet(true));
+
+    /** Executes the filters of the PostAugmentation phase on the configs of
+        mask, which should be indexes of entries that filter() returned for
+        the same request, and returns those that pass. Unlike filter(), only
+        the configs are narrowed and not the spots they can bid on.
+     */
+    ConfigSet filterAugmented(
+            const BidRequest& br,
+            const ExchangeConnector* conn,
+            const Auction::Augmentations& augmentations,
+            const ConfigSet& mask);
+
 
     // \todo Need batch interfaces of these to alleviate overhead.
     void addFilter(const std::string& name);
@@ -83,23 +118,86 @@ struct FilterPool
     void initWithFiltersFromJson(const Json::Value & json);
 
 
-    // \todo Need batch interfaces to alleviate overhead.
     unsigned addConfig(const std::string& name, const AgentInfo& info);
     void removeConfig(const std::string& name);
 
+
+    /** Sequence of config changes that are applied by updateConfigs in a
+        single copy of the pool's state. The changes are applied in the order
+        they were added to the batch.
+     */
+    struct ConfigUpdates
+    {
+        void add(const std::string& name, const AgentInfo& info)
+        {
+            ops.emplace_back(true, ConfigEntry(name, info));
+        }
+
+        void remove(const std::string& name)
+        {
+            ops.emplace_back(false, ConfigEntry(name));
+        }
+
+        bool empty() const { return ops.empty(); }
+        size_t size() const { return ops.size(); }
+        void clear() { ops.clear(); }
+
+    private:
+        friend struct FilterPool;
+
+        // true for an add and false for a remove.
+        std::vector< std::pair<bool, ConfigEntry> > ops;
+    };
+
+    /** Applies all the changes in the batch with one copy of the filters.
+        Returns the name and index of every added config in the order in which
+        they were added to the batch.
+     */
+    std::vector< std::pair<std::string, unsigned> >
+    updateConfigs(const ConfigUpdates& updates);
+
+    /** When enabled, the cost and selectivity of each filter is measured on
+        the sampled bid requests and every period samples the filters are
+        reordered such that the filters which eliminate the most configs for
+        the least amount of time are executed first. The priority() order is
+        used until the first reordering and whenever the filters change.
+     */
+    void setAdaptiveOrdering(bool enabled, size_t period = 1000);
+
+    /** The filter reasons are only gathered and recorded for one in period
+        bid requests. They're taken from the requests sampled for the other
+        filter stats and weighted such that they keep the same ratio to them
+        as if every sampled request had recorded its reasons.
+     */
+    void setReasonsSampling(size_t period);
+
     // Added for test purposes
     std::vector<string> getFilterNames() const;
 
 private:
 
+    /** Running totals of the sampled executions of a filter. Updated
+        concurrently by the filtering threads so no attempt is made to keep the
+        three values consistent with each others.
+     */
+    struct FilterStats
+    {
+        FilterStats() : ticks(0), eliminated(0), samples(0) {}
+
+        std::atomic<uint64_t> ticks;
+        std::atomic<uint64_t> eliminated;
+        std::atomic<uint64_t> samples;
+    };
+
     struct Data
     {
-        Data() {}
+        Data() : generation(0) {}
         Data(const Data& other);
         ~Data();
 
         ssize_t findConfig(const std::string& name) const;
         unsigned addConfig(const std::string& name, const AgentInfo& info);
+        unsigned addConfig(const ConfigEntry& entry);
         void removeConfig(const std::string& name);
 
         ssize_t findFilter(const std::string& name) const;
@@ -109,19 +207,48 @@ private:
         // \todo Use unique_ptr when moving to gcc 4.7
         std::vector<FilterBase*> filters;
 
+        // Filters of the PostAugmentation phase, kept out of filters so that
+        // neither the stats nor the adaptive ordering have to know about them.
+        std::vector<FilterBase*> postFilters;
+
         std::vector<ConfigEntry> configs;
         CreativeMatrix activeConfigs;
+
+        // Set when the data is published by setData.
+        uint64_t generation;
+        std::unique_ptr<FilterStats[]> stats;
+    };
+
+    /** Order in which to execute the filters of the data with the given
+        generation as indexes into Data::filters.
+     */
+    struct FilterOrder
+    {
+        uint64_t generation;
+        std::vector<unsigned> filters;
     };
 
     bool setData(Data*&, std::unique_ptr<Data>&);
-    void recordDiff(const Data* data, const FilterBase* f, const ConfigSet& diff);
-    void recordReason(const Data* data, const FilterBase* f, FilterState & state);
-    uint64_t recordTime(uint64_t ticks, const FilterBase* filter);
+    void recordDiff(const Data* data, const FilterBase* f, const ConfigSet& diff,
+                    const char* phase = "static");
+    void recordReason(const Data* data, const FilterBase* f, FilterState & state,
+                      float weight);
+    void recordTime(uint64_t start, uint64_t end, const FilterBase* filter);
+    void reorderFilters(const Data* data);
 
     std::atomic<Data*> data;
+    std::atomic<uint64_t> generations;
     std::vector< std::shared_ptr<AgentConfig> > configs;
     mutable Datacratic::GcLock gc;
 
+    std::atomic<bool> adaptive;
+    size_t adaptivePeriod;
+    std::atomic<uint64_t> adaptiveSamples;
+    std::atomic<FilterOrder*> order;
+
+    // One in reasonsRatio requests sampled for the stats records its reasons.
+    size_t reasonsRatio;
+
     EventRecorder* events;
 };
 
@@ -0,0 +1,98 @@
+/** augmentation_filters.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Filters of the configs on the augmentations of an auction.
+
+*/
+
+#include "augmentation_filters.h"
+#include "rtbkit/common/auction.h"
+
+
+using namespace std;
+using namespace ML;
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* AUGMENTATION TAGS FILTER                                                   */
+/******************************************************************************/
+
+void
+AugmentationTagsFilter::
+setConfig(unsigned cfgIndex, const AgentConfig& config, bool value)
+{
+    for (const auto& aug : config.augmentations) {
+        Augmentor& augmentor = augmentors[aug.name];
+
+        if (aug.required) augmentor.required.set(cfgIndex, value);
+
+        // Don't bother fetching the tags when nothing is filtered.
+        if (!aug.compiledFilters.unconstrained()) {
+            augmentor.constrained.set(cfgIndex, value);
+
+            if (value)
+                augmentor.tagFilters[cfgIndex] = { config.account, aug.compiledFilters };
+            else augmentor.tagFilters.erase(cfgIndex);
+        }
+
+        if (augmentor.required.empty() && augmentor.constrained.empty())
+            augmentors.erase(aug.name);
+    }
+}
+
+void
+AugmentationTagsFilter::
+filter(FilterState& state) const
+{
+    if (!state.augmentations) return;
+
+    ConfigSet mask;
+
+    for (const auto& entry : augmentors) {
+        const Augmentor& augmentor = entry.second;
+
+        auto it = state.augmentations->find(entry.first);
+        if (it == state.augmentations->end()) {
+            mask |= augmentor.required;
+            continue;
+        }
+
+        ConfigSet toCheck = augmentor.constrained & state.configs();
+
+        for (size_t cfgId = toCheck.next();
+             cfgId < toCheck.size();
+             cfgId = toCheck.next(cfgId + 1))
+        {
+            auto filterIt = augmentor.tagFilters.find(cfgId);
+            ExcAssert(filterIt != augmentor.tagFilters.end());
+            const TagFilter& tagFilter = filterIt->second;
+
+            vector<string> tags = it->second.tagsForAccount(tagFilter.account);
+            if (!tagFilter.tags.anyIsIncluded(tags)) mask.set(cfgId);
+        }
+    }
+
+    state.narrowConfigs(mask.negate());
+}
+
+
+} // namespace RTBKIT
+
+
+/******************************************************************************/
+/* INIT FILTERS                                                               */
+/******************************************************************************/
+
+namespace {
+
+struct AtInit {
+    AtInit()
+    {
+        RTBKIT::FilterBase::registerFactory<RTBKIT::AugmentationTagsFilter>();
+    }
+
+} AtInit;
+
+} // namespace anonymous
@@ -0,0 +1,56 @@
+/** augmentation_filters.h                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Filters of the configs on the augmentations of an auction.
+
+*/
+
+#pragma once
+
+#include "generic_filters.h"
+#include "priority.h"
+
+#include <string>
+#include <unordered_map>
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* AUGMENTATION TAGS FILTER                                                   */
+/******************************************************************************/
+
+/** Filters out the configs whose required augmentations are missing or whose
+    augmentation tags don't match their tag filters.  Executed once the
+    auction is augmented and only on the configs that made it through the
+    filters of the bid request.
+ */
+struct AugmentationTagsFilter : public FilterBaseT<AugmentationTagsFilter>
+{
+    static constexpr const char* name = "AugmentationTags";
+    unsigned priority() const { return Priority::AugmentationTags; }
+    Phase phase() const { return PostAugmentation; }
+
+    void setConfig(unsigned cfgIndex, const AgentConfig& config, bool value);
+    void filter(FilterState& state) const;
+
+private:
+
+    struct TagFilter
+    {
+        AccountKey account;
+        CompiledIncludeExclude<std::string> tags;
+    };
+
+    struct Augmentor
+    {
+        ConfigSet required;
+        ConfigSet constrained;
+        std::unordered_map<unsigned, TagFilter> tagFilters;
+    };
+
+    std::unordered_map<std::string, Augmentor> augmentors;
+};
+
+
+} // namespace RTBKIT
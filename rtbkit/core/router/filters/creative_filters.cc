@@ -7,6 +7,9 @@
 */
 
 #include "creative_filters.h"
+#include "jml/arch/exception.h"
+
+#include <atomic>
 
 using namespace std;
 using namespace ML;
@@ -14,6 +17,91 @@ using namespace ML;
 namespace RTBKIT {
 
 
+/******************************************************************************/
+/* FORMAT REGISTRY                                                            */
+/******************************************************************************/
+
+namespace {
+
+// Open addressing table of the formats where each word holds the key of a
+// format in its upper half and its id + 1 in the lower half; 0 is empty.
+std::atomic<uint64_t> formatSlots[FormatRegistry::Capacity];
+std::atomic<unsigned> numFormats(0);
+std::mutex formatsLock;
+
+uint32_t formatKey(const Format& format)
+{
+    return uint32_t(uint16_t(format.width)) << 16 | uint16_t(format.height);
+}
+
+size_t formatSlot(uint32_t key)
+{
+    // Fibonacci hashing; the keys themselves are far from uniform.
+    return (key * 2654435769U) >> (32 - 12);
+}
+
+static_assert(FormatRegistry::Capacity == 1 << 12,
+        "formatSlot depends on the capacity of the registry");
+
+} // namespace anonymous
+
+constexpr unsigned FormatRegistry::NoId;
+
+unsigned
+FormatRegistry::
+find(const Format& format)
+{
+    uint32_t key = formatKey(format);
+
+    for (size_t i = formatSlot(key), probes = 0;
+         probes < Capacity;
+         i = (i + 1) % Capacity, ++probes)
+    {
+        uint64_t word = formatSlots[i].load(std::memory_order_acquire);
+        if (!word) return NoId;
+        if (word >> 32 == key) return uint32_t(word) - 1;
+    }
+
+    return NoId;
+}
+
+unsigned
+FormatRegistry::
+add(const Format& format)
+{
+    unsigned id = find(format);
+    if (id != NoId) return id;
+
+    std::lock_guard<std::mutex> guard(formatsLock);
+
+    id = find(format);
+    if (id != NoId) return id;
+
+    // Keep the table sparse enough for the probes to stay short.
+    if (numFormats >= Capacity / 2)
+        throw ML::Exception("too many distinct creative formats: %d",
+                            int(numFormats));
+
+    uint32_t key = formatKey(format);
+    size_t i = formatSlot(key);
+    while (formatSlots[i].load(std::memory_order_relaxed))
+        i = (i + 1) % Capacity;
+
+    id = numFormats++;
+    formatSlots[i].store(uint64_t(key) << 32 | (id + 1),
+                         std::memory_order_release);
+    return id;
+}
+
+size_t
+FormatRegistry::
+size()
+{
+    return numFormats;
+}
+
+
+
 /******************************************************************************/
 /* CREATIVE SEGMENTS FILTER                                                   */
 /******************************************************************************/
@@ -15,10 +15,38 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <mutex>
+#include <vector>
 
 namespace RTBKIT {
 
 
+/******************************************************************************/
+/* FORMAT REGISTRY                                                            */
+/******************************************************************************/
+
+/** Process wide registry which gives a small integer id to each distinct
+    format of the creatives so that the format filter can keep its masks in a
+    vector indexed by id.
+
+    Lookups are lock free since they're done by the filtering threads while
+    the formats of new creatives are added by the config thread. Ids are never
+    released as a router only ever sees a handful of creative formats.
+ */
+struct FormatRegistry
+{
+    enum { Capacity = 1 << 12 };
+    static constexpr unsigned NoId = -1;
+
+    /** Returns the id of the format, giving it one if it's new. */
+    static unsigned add(const Format& format);
+
+    /** Returns the id of the format or NoId if it was never added. */
+    static unsigned find(const Format& format);
+
+    static size_t size();
+};
+
+
 /******************************************************************************/
 /* CREATIVE FORTMAT FILTER                                                    */
 /******************************************************************************/
@@ -31,15 +59,16 @@ struct CreativeFormatFilter : public CreativeFilter<CreativeFormatFilter>
     void addCreative(
             unsigned cfgIndex, unsigned crIndex, const Creative& creative)
     {
-        auto formatKey = makeKey(creative.format);
-        formatFilter[formatKey].set(crIndex, cfgIndex);
+        unsigned id = FormatRegistry::add(creative.format);
+        if (id >= formatMasks.size()) formatMasks.resize(id + 1);
+        formatMasks[id].set(crIndex, cfgIndex);
     }
 
     void removeCreative(
             unsigned cfgIndex, unsigned crIndex, const Creative& creative)
     {
-        auto formatKey = makeKey(creative.format);
-        formatFilter[formatKey].reset(crIndex, cfgIndex);
+        unsigned id = FormatRegistry::find(creative.format);
+        if (id < formatMasks.size()) formatMasks[id].reset(crIndex, cfgIndex);
     }
 
     void filterImpression(
@@ -48,10 +77,11 @@ struct CreativeFormatFilter : public CreativeFilter<CreativeFormatFilter>
         if(!(imp.formats.empty()))
         {
             // The 0x0 format means: match anything.
-            CreativeMatrix creatives = get(Format(0,0));
+            CreativeMatrix creatives;
+            addMask(creatives, Format(0,0));
 
             for (const auto& format : imp.formats)
-                creatives |= get(format);
+                addMask(creatives, format);
 
             state.narrowCreativesForImp(impIndex, creatives);
         }
@@ -60,22 +90,14 @@ struct CreativeFormatFilter : public CreativeFilter<CreativeFormatFilter>
 
 private:
 
-    typedef uint32_t FormatKey;
-    static_assert(sizeof(FormatKey) == sizeof(Format),
-            "Conversion of FormatKey depends on size of Format");
-
-    FormatKey makeKey(const Format& format) const
-    {
-        return uint32_t(format.width << 16 | format.height);
-    }
-
-    CreativeMatrix get(const Format& format) const
+    void addMask(CreativeMatrix& creatives, const Format& format) const
     {
-        auto it = formatFilter.find(makeKey(format));
-        return it == formatFilter.end() ? CreativeMatrix() : it->second;
+        unsigned id = FormatRegistry::find(format);
+        if (id < formatMasks.size()) creatives |= formatMasks[id];
     }
 
-    std::unordered_map<uint32_t, CreativeMatrix> formatFilter;
+    // Indexed by the id of the format in the FormatRegistry.
+    std::vector<CreativeMatrix> formatMasks;
 };
 
 
@@ -11,7 +11,10 @@
 
 LIB_FILTERS_SOURCES := \
 	static_filters.cc \
-        creative_filters.cc
+        creative_filters.cc \
+        literal_matcher.cc \
+        frequency_cap_filter.cc \
+        augmentation_filters.cc
 
 LIB_FILTERS_LINK := \
 	arch utils filter_registry agent_configuration rtb
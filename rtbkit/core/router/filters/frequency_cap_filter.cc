@@ -0,0 +1,388 @@
+/** frequency_cap_filter.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Frequency capping of the agents in the router.
+
+*/
+
+#include "frequency_cap_filter.h"
+#include "jml/utils/hash_specializations.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+using namespace std;
+using namespace ML;
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* FREQUENCY CAP SKETCH                                                       */
+/******************************************************************************/
+
+namespace {
+
+// Final mix of MurmurHash3, so that the rows use well spread bits.
+uint64_t mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+} // namespace anonymous
+
+FrequencyCapSketch::Params::
+Params() :
+    epsilon(0.001), delta(0.01),
+    slotSeconds(3600.0), numSlots(24),
+    numShards(16),
+    exactThreshold(3)
+{
+}
+
+void
+FrequencyCapSketch::Params::
+fromJson(const Json::Value & val)
+{
+    ExcCheckEqual(val.type(), Json::objectValue,
+                  "frequency cap sketch params must be an object");
+
+    for (auto it = val.begin(), end = val.end();  it != end;  ++it) {
+        string key = it.memberName();
+
+        if (key == "epsilon") epsilon = it->asDouble();
+        else if (key == "delta") delta = it->asDouble();
+        else if (key == "slotSeconds") slotSeconds = it->asDouble();
+        else if (key == "numSlots") numSlots = it->asUInt();
+        else if (key == "numShards") numShards = it->asUInt();
+        else if (key == "exactThreshold") exactThreshold = it->asUInt();
+        else throw ML::Exception("frequency cap sketch had unknown key " + key);
+    }
+
+    if (epsilon <= 0 || epsilon >= 1 || delta <= 0 || delta >= 1)
+        throw ML::Exception("frequency cap sketch must have "
+                            "0 < epsilon < 1 and 0 < delta < 1");
+    if (slotSeconds <= 0 || !numSlots || !numShards)
+        throw ML::Exception("frequency cap sketch must have positive "
+                            "slotSeconds, numSlots and numShards");
+}
+
+Json::Value
+FrequencyCapSketch::Params::
+toJson() const
+{
+    Json::Value result;
+    result["epsilon"] = epsilon;
+    result["delta"] = delta;
+    result["slotSeconds"] = slotSeconds;
+    result["numSlots"] = numSlots;
+    result["numShards"] = numShards;
+    result["exactThreshold"] = exactThreshold;
+    return result;
+}
+
+FrequencyCapSketch::
+FrequencyCapSketch(const Params & params) :
+    params_(params),
+    width(std::ceil(M_E / params.epsilon)),
+    depth(std::max(1.0, std::ceil(std::log(1.0 / params.delta))))
+{
+    ExcCheck(params.slotSeconds > 0, "frequency cap slots must have a length");
+    ExcCheck(params.numSlots && params.numShards,
+             "frequency cap sketch needs slots and shards");
+
+    shards.reserve(params.numShards);
+    for (unsigned i = 0; i < params.numShards; ++i) {
+        shards.emplace_back(new Shard);
+        shards.back()->counters.resize(params.numSlots * depth * width);
+        shards.back()->slotIndex.resize(params.numSlots, -1);
+    }
+}
+
+uint64_t
+FrequencyCapSketch::
+userHash(const UserIds & user)
+{
+    uint64_t result = 0;
+    if (user.exchangeId.notNull())
+        result = user.exchangeId.hash();
+    else if (user.providerId.notNull())
+        result = user.providerId.hash();
+    else return 0;
+
+    return result ? result : 1;
+}
+
+uint64_t
+FrequencyCapSketch::
+accountHash(const AccountKey & account)
+{
+    return std::hash<std::string>()(account.toString());
+}
+
+int64_t
+FrequencyCapSketch::
+slotOf(Date date) const
+{
+    return std::floor(date.secondsSinceEpoch() / params_.slotSeconds);
+}
+
+size_t
+FrequencyCapSketch::
+counter(unsigned slot, unsigned row, uint64_t key) const
+{
+    // Double hashing gives the column of each row from a single hash.
+    uint64_t h1 = key, h2 = (key >> 32) | 1;
+    return (size_t(slot) * depth + row) * width + (h1 + row * h2) % width;
+}
+
+bool
+FrequencyCapSketch::
+isExact(uint64_t account) const
+{
+    std::lock_guard<ML::Spinlock> guard(exactLock);
+    return exactAccounts.count(account);
+}
+
+void
+FrequencyCapSketch::
+recordImpression(const UserIds & user, const AccountKey & account, Date when)
+{
+    uint64_t userKey = userHash(user);
+    if (!userKey) return;
+
+    uint64_t accountKey = accountHash(account);
+    uint64_t key = mix(chain_hash(userKey, accountKey));
+    bool exact = isExact(accountKey);
+
+    int64_t index = slotOf(when);
+    unsigned slot = index % params_.numSlots;
+
+    Shard & shard = *shards[userKey % shards.size()];
+    std::lock_guard<ML::Spinlock> guard(shard.lock);
+
+    if (exact) {
+        Times & times = shard.exact[key];
+        times.push_back(when);
+        if (times.size() > params_.exactThreshold)
+            times.erase(std::min_element(times.begin(), times.end()));
+    }
+
+    // Wins older than all of the slots can only be counted exactly.
+    if (shard.slotIndex[slot] > index) return;
+
+    if (shard.slotIndex[slot] != index) {
+        auto first = shard.counters.begin() + size_t(slot) * depth * width;
+        std::fill(first, first + depth * width, 0);
+        shard.slotIndex[slot] = index;
+    }
+
+    for (unsigned row = 0; row < depth; ++row)
+        ++shard.counters[counter(slot, row, key)];
+}
+
+size_t
+FrequencyCapSketch::
+estimate(const UserIds & user, const AccountKey & account,
+         double windowSeconds, bool exact, Date now) const
+{
+    return estimate(userHash(user), accountHash(account),
+                    windowSeconds, exact, now);
+}
+
+size_t
+FrequencyCapSketch::
+estimate(uint64_t userKey, uint64_t accountKey,
+         double windowSeconds, bool exact, Date now) const
+{
+    if (!userKey) return 0;
+
+    uint64_t key = mix(chain_hash(userKey, accountKey));
+
+    const Shard & shard = *shards[userKey % shards.size()];
+    std::lock_guard<ML::Spinlock> guard(shard.lock);
+
+    if (exact) {
+        auto it = shard.exact.find(key);
+        if (it == shard.exact.end()) return 0;
+
+        Date start = now.plusSeconds(-windowSeconds);
+        return std::count_if(it->second.begin(), it->second.end(),
+                [&] (Date time) { return time > start; });
+    }
+
+    int64_t last = slotOf(now);
+    int64_t numWindowSlots = std::ceil(windowSeconds / params_.slotSeconds);
+    numWindowSlots = std::min<int64_t>(numWindowSlots, params_.numSlots);
+
+    // The minimum of each slot is an upper bound of its count, so their sum
+    // is one of the window's while being tighter than the minimum of sums.
+    size_t result = 0;
+    for (int64_t index = last - numWindowSlots + 1; index <= last; ++index) {
+        unsigned slot = index % params_.numSlots;
+        if (shard.slotIndex[slot] != index) continue;
+
+        uint32_t count = std::numeric_limits<uint32_t>::max();
+        for (unsigned row = 0; row < depth; ++row)
+            count = std::min(count, shard.counters[counter(slot, row, key)]);
+        result += count;
+    }
+
+    return result;
+}
+
+void
+FrequencyCapSketch::
+setExactAccounts(const std::vector<AccountKey> & accounts)
+{
+    std::unordered_set<uint64_t> newAccounts;
+    for (const auto & account : accounts)
+        newAccounts.insert(accountHash(account));
+
+    std::lock_guard<ML::Spinlock> guard(exactLock);
+    exactAccounts.swap(newAccounts);
+}
+
+void
+FrequencyCapSketch::
+expire(Date now)
+{
+    Date start = now.plusSeconds(-params_.slotSeconds * params_.numSlots);
+
+    for (auto & shard : shards) {
+        std::lock_guard<ML::Spinlock> guard(shard->lock);
+
+        for (auto it = shard->exact.begin(); it != shard->exact.end();) {
+            const Times & times = it->second;
+            if (*std::max_element(times.begin(), times.end()) < start)
+                it = shard->exact.erase(it);
+            else ++it;
+        }
+    }
+}
+
+size_t
+FrequencyCapSketch::
+memoryBytes() const
+{
+    size_t result = 0;
+
+    for (const auto & shard : shards) {
+        std::lock_guard<ML::Spinlock> guard(shard->lock);
+        result += shard->counters.capacity() * sizeof(uint32_t);
+        result += shard->slotIndex.capacity() * sizeof(int64_t);
+
+        // Nodes of the hash table along with their next pointer.
+        result += shard->exact.size()
+            * (sizeof(std::pair<const uint64_t, Times>) + sizeof(void*));
+        result += shard->exact.bucket_count() * sizeof(void*);
+    }
+
+    return result;
+}
+
+
+/******************************************************************************/
+/* FREQUENCY CAP FILTER                                                       */
+/******************************************************************************/
+
+namespace {
+
+std::mutex sketchLock;
+std::shared_ptr<FrequencyCapSketch> globalSketch;
+
+} // namespace anonymous
+
+void
+FrequencyCapFilter::
+setSketch(std::shared_ptr<FrequencyCapSketch> sketch)
+{
+    std::lock_guard<std::mutex> guard(sketchLock);
+    globalSketch = std::move(sketch);
+}
+
+std::shared_ptr<FrequencyCapSketch>
+FrequencyCapFilter::
+getSketch()
+{
+    std::lock_guard<std::mutex> guard(sketchLock);
+    return globalSketch;
+}
+
+void
+FrequencyCapFilter::
+setConfig(unsigned cfgIndex, const AgentConfig& config, bool value)
+{
+    if (!config.frequencyCap.enabled()) return;
+
+    capped.set(cfgIndex, value);
+
+    if (!value) {
+        caps.erase(cfgIndex);
+        return;
+    }
+
+    Cap& cap = caps[cfgIndex];
+    cap.account = FrequencyCapSketch::accountHash(config.account);
+    cap.maxImpressions = config.frequencyCap.maxImpressions;
+    cap.windowSeconds = config.frequencyCap.windowSeconds;
+    cap.exact = sketch && sketch->needsExact(cap.maxImpressions);
+}
+
+void
+FrequencyCapFilter::
+filter(FilterState& state) const
+{
+    if (!sketch) return;
+
+    ConfigSet toCheck = state.configs() & capped;
+    if (toCheck.empty()) return;
+
+    uint64_t user = FrequencyCapSketch::userHash(state.request.userIds);
+    if (!user) return;
+
+    Date now = Date::now();
+    ConfigSet mask;
+
+    for (size_t cfgId = toCheck.next();
+         cfgId < toCheck.size();
+         cfgId = toCheck.next(cfgId + 1))
+    {
+        auto it = caps.find(cfgId);
+        ExcAssert(it != caps.end());
+        const Cap& cap = it->second;
+
+        size_t count = sketch->estimate(
+                user, cap.account, cap.windowSeconds, cap.exact, now);
+        if (count >= cap.maxImpressions) mask.set(cfgId);
+    }
+
+    state.narrowConfigs(mask.negate());
+}
+
+
+} // namespace RTBKIT
+
+
+/******************************************************************************/
+/* INIT FILTERS                                                               */
+/******************************************************************************/
+
+namespace {
+
+struct AtInit {
+    AtInit()
+    {
+        RTBKIT::FilterBase::registerFactory<RTBKIT::FrequencyCapFilter>();
+    }
+
+} AtInit;
+
+} // namespace anonymous
@@ -0,0 +1,196 @@
+/** frequency_cap_filter.h                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Frequency capping of the agents in the router, from impression counts
+    kept in memory instead of in an augmentor and its external store.
+
+*/
+
+#pragma once
+
+#include "generic_filters.h"
+#include "priority.h"
+#include "jml/arch/spinlock.h"
+#include "jml/utils/compact_vector.h"
+#include "soa/types/date.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* FREQUENCY CAP SKETCH                                                       */
+/******************************************************************************/
+
+/** Number of impressions of each account shown to each user over a sliding
+    window, kept in a count-min sketch for each time slot of the window.
+
+    The impressions are counted by slots of slotSeconds, numSlots of which
+    are kept; a window is rounded up to a whole number of slots that ends
+    with the current one.  Whatever the number of users, each slot takes
+    depth x width counters, with width = e / epsilon and
+    depth = ln(1 / delta): an estimate is never below the actual count and,
+    with a probability of 1 - delta, it isn't over by more than epsilon
+    times the impressions recorded in the window by the users of its shard.
+
+    Such an error matters for the low caps, where a single collision caps a
+    user too early.  The impressions of the accounts given to
+    setExactAccounts() are also counted exactly, by keeping the times of
+    the last exactThreshold impressions of each of their users, which can
+    then be asked for instead of the estimate.
+
+    The users are spread over numShards shards, each with its own lock, so
+    that the recording of the wins and the estimates of the filter threads
+    rarely wait for each other.  Thread-safe.
+*/
+struct FrequencyCapSketch
+{
+    struct Params
+    {
+        Params();
+
+        double epsilon;             ///< Relative error of the estimates
+        double delta;               ///< Probability of exceeding the error
+        double slotSeconds;         ///< Time resolution of the windows
+        unsigned numSlots;          ///< Slots kept; bounds the window length
+        unsigned numShards;         ///< Independently locked shards
+        unsigned exactThreshold;    ///< Caps up to this one are exact
+
+        void fromJson(const Json::Value & val);
+        Json::Value toJson() const;
+    };
+
+    FrequencyCapSketch(const Params & params = Params());
+
+    const Params & params() const { return params_; }
+
+    /** Count a win of the account on a user.  Wins of users without any id
+        are ignored, since they can't be capped either.
+    */
+    void recordImpression(const UserIds & user, const AccountKey & account,
+                          Date when = Date::now());
+
+    /** Upper bound on the number of impressions of the account shown to the
+        user in the windowSeconds before now.  If exact, the exact count is
+        returned instead, which is only known for the impressions recorded
+        since the account was given to setExactAccounts().
+    */
+    size_t estimate(const UserIds & user, const AccountKey & account,
+                    double windowSeconds, bool exact = false,
+                    Date now = Date::now()) const;
+
+    /** Same as above, given the userHash() and accountHash(). */
+    size_t estimate(uint64_t user, uint64_t account,
+                    double windowSeconds, bool exact = false,
+                    Date now = Date::now()) const;
+
+    /** Whether a cap is low enough to be checked against the exact counts. */
+    bool needsExact(unsigned maxImpressions) const
+    {
+        return maxImpressions <= params_.exactThreshold;
+    }
+
+    /** Count the impressions of these accounts exactly, and stop counting
+        those of the others.
+    */
+    void setExactAccounts(const std::vector<AccountKey> & accounts);
+
+    /** Drop the exact counts whose impressions are all out of the longest
+        window.  Meant to be called periodically.
+    */
+    void expire(Date now = Date::now());
+
+    /** Memory used by the counters of the sketch and the exact counts. */
+    size_t memoryBytes() const;
+
+    /** Hash used by the sketch for the user, or 0 if it has no id. */
+    static uint64_t userHash(const UserIds & user);
+
+    static uint64_t accountHash(const AccountKey & account);
+
+private:
+
+    typedef ML::compact_vector<Date, 4> Times;
+
+    struct Shard
+    {
+        mutable ML::Spinlock lock;
+
+        /// numSlots x depth x width counters, by slot and then by row
+        std::vector<uint32_t> counters;
+
+        /// Index of the time slot that each slot currently holds
+        std::vector<int64_t> slotIndex;
+
+        /// Times of the last impressions by (user, account) hash
+        std::unordered_map<uint64_t, Times> exact;
+    };
+
+    size_t counter(unsigned slot, unsigned row, uint64_t key) const;
+
+    int64_t slotOf(Date date) const;
+
+    bool isExact(uint64_t account) const;
+
+    Params params_;
+    unsigned width;
+    unsigned depth;
+
+    std::vector<std::unique_ptr<Shard> > shards;
+
+    mutable ML::Spinlock exactLock;
+    std::unordered_set<uint64_t> exactAccounts;
+};
+
+
+/******************************************************************************/
+/* FREQUENCY CAP FILTER                                                       */
+/******************************************************************************/
+
+/** Filters out the configs whose frequencyCap has been reached for the user
+    of the request, according to the sketch given to setSketch().  Does
+    nothing until the router enables frequency capping, nor for the requests
+    without a user id.
+
+    The sketch is shared by all the copies of the filter, since the filter
+    pool makes new ones on every configuration change.
+*/
+struct FrequencyCapFilter : public FilterBaseT<FrequencyCapFilter>
+{
+    FrequencyCapFilter() : sketch(getSketch()) {}
+
+    static constexpr const char* name = "FrequencyCap";
+    unsigned priority() const { return Priority::FrequencyCap; }
+
+    void setConfig(unsigned cfgIndex, const AgentConfig& config, bool value);
+    void filter(FilterState& state) const;
+
+    /** Sketch given to the frequency cap filters created from now on.  Must
+        be called before the filters of the router are initialized.
+    */
+    static void setSketch(std::shared_ptr<FrequencyCapSketch> sketch);
+    static std::shared_ptr<FrequencyCapSketch> getSketch();
+
+private:
+
+    struct Cap
+    {
+        uint64_t account;
+        unsigned maxImpressions;
+        double windowSeconds;
+        bool exact;
+    };
+
+    std::shared_ptr<FrequencyCapSketch> sketch;
+
+    ConfigSet capped;
+    std::unordered_map<unsigned, Cap> caps;
+};
+
+
+} // namespace RTBKIT
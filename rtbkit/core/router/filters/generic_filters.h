@@ -11,11 +11,86 @@
 #include "rtbkit/core/agent_configuration/agent_config.h"
 #include "rtbkit/core/agent_configuration/include_exclude.h"
 #include "rtbkit/common/filter.h"
+#include "rtbkit/core/router/filters/literal_matcher.h"
+#include "jml/arch/thread_specific.h"
+
+#include <unordered_map>
+#include <algorithm>
 
 
 namespace RTBKIT {
 
 
+/******************************************************************************/
+/* FILTER MASK CACHE                                                          */
+/******************************************************************************/
+
+/** Per-thread cache of the ConfigSet produced by a filter for a given value of
+    the bid request feature it filters on. Only useful for filters whose output
+    depends solely on that value and where a small number of distinct values
+    covers most of the traffic.
+
+    Each thread has its own cache so lookups don't require any locking. The
+    cache is dropped whenever the generation passed to get changes or when it
+    grows beyond maxEntries.
+
+    Copying a cache yields an empty cache which is what we want when a filter
+    is cloned.
+ */
+template<typename Key, typename Hash = std::hash<Key> >
+struct FilterMaskCache
+{
+    explicit FilterMaskCache(size_t maxEntries = 1 << 10) :
+        maxEntries(maxEntries)
+    {}
+
+    FilterMaskCache(const FilterMaskCache& other) :
+        maxEntries(other.maxEntries)
+    {}
+
+    FilterMaskCache& operator= (const FilterMaskCache& other)
+    {
+        maxEntries = other.maxEntries;
+        return *this;
+    }
+
+    /** Returns the cached mask for key or caches the result of fn() if there
+        isn't one. The reference is valid until the next call on the same
+        thread.
+     */
+    template<typename Fn>
+    const ConfigSet& get(uint64_t generation, const Key& key, const Fn& fn) const
+    {
+        Entries* entries = cache.get();
+
+        if (entries->generation != generation ||
+                entries->masks.size() >= maxEntries)
+        {
+            entries->masks.clear();
+            entries->generation = generation;
+        }
+
+        auto it = entries->masks.find(key);
+        if (it != entries->masks.end()) return it->second;
+
+        return entries->masks.insert(std::make_pair(key, fn())).first->second;
+    }
+
+private:
+
+    struct Entries
+    {
+        Entries() : generation(0) {}
+
+        uint64_t generation;
+        std::unordered_map<Key, ConfigSet, Hash> masks;
+    };
+
+    size_t maxEntries;
+    ML::ThreadSpecificInstanceInfo<Entries, FilterMaskCache> cache;
+};
+
+
 /******************************************************************************/
 /* FILTER BASE T                                                              */
 /******************************************************************************/
@@ -24,6 +99,8 @@ namespace RTBKIT {
 template<typename Filter>
 struct FilterBaseT : public FilterBase
 {
+    FilterBaseT() : configGeneration(0) {}
+
     std::string name() const { return Filter::name; }
 
     FilterBase* clone() const
@@ -33,12 +110,14 @@ struct FilterBaseT : public FilterBase
 
     void addConfig(unsigned cfgIndex, const std::shared_ptr<AgentConfig>& config)
     {
+        configGeneration++;
         setConfig(cfgIndex, *config, true);
     }
 
     void removeConfig(
             unsigned cfgIndex, const std::shared_ptr<AgentConfig>& config)
     {
+        configGeneration++;
         setConfig(cfgIndex, *config, false);
     }
 
@@ -49,6 +128,23 @@ struct FilterBaseT : public FilterBase
         ExcAssert(false);
     }
 
+protected:
+
+    /** Returns the mask computed by fn for the given feature value, memoized
+        in cache until the next config change of the filter. Filters that
+        override addConfig or removeConfig must bump configGeneration
+        themselves to use this.
+     */
+    template<typename Key, typename Hash, typename Fn>
+    const ConfigSet& memoize(
+            const FilterMaskCache<Key, Hash>& cache,
+            const Key& key,
+            const Fn& fn) const
+    {
+        return cache.get(configGeneration, key, fn);
+    }
+
+    uint64_t configGeneration;
 };
 
 
@@ -236,9 +332,23 @@ private:
 /* DOMAIN FILTER                                                              */
 /******************************************************************************/
 
+/** Include filter for host names where a domain also matches all of its sub
+    domains.
+
+    The domains of all the configs are stored in a single trie of reversed
+    labels (com -> example -> www) where each node holds the set of configs
+    for that domain. Filtering is a single walk down the trie following the
+    labels of the host which makes the cost independent of the number of
+    configs and domains.
+
+    Nodes refer to each other by index so that the default copy constructor
+    does the right thing when the filter pool clones the filter.
+ */
 template<typename Str>
 struct DomainFilter
 {
+    DomainFilter() : nodes(1) {}
+
     template<typename List>
     bool isEmpty(const List& list) const
     {
@@ -259,22 +369,36 @@ struct DomainFilter
             removeConfig(cfgIndex, value);
     }
 
-    ConfigSet filter(const Url& host) const
+    ConfigSet filter(const Url& url) const
     {
         ConfigSet matches;
+        std::string host = url.host();
 
-        for (const auto& key : getKeys(host)) {
-            auto it = domainMap.find(key);
-            if (it == domainMap.end()) continue;
+        unsigned node = Root;
+        forEachLabel(host, [&] (const char* label, size_t size) {
+                    node = findChild(node, label, size);
+                    if (node == NoNode) return false;
 
-            matches |= it->second;
-        }
+                    matches |= nodes[node].configs;
+                    return true;
+                });
 
         return matches;
     }
 
 private:
 
+    enum { Root = 0, NoNode = unsigned(-1) };
+
+    struct Node
+    {
+        std::string label;
+        ConfigSet configs;
+
+        // Sorted by hash of the label of the child.
+        std::vector< std::pair<uint64_t, unsigned> > children;
+    };
+
     void addConfig(unsigned cfgIndex, const DomainMatcher& matcher)
     {
         ExcAssert(matcher.isLiteral);
@@ -289,31 +413,99 @@ private:
 
     void addConfig(unsigned cfgIndex, const Str& host)
     {
-        domainMap[host].set(cfgIndex);
+        nodes[insert(host)].configs.set(cfgIndex);
     }
 
     void removeConfig(unsigned cfgIndex, const Str& host)
     {
-        domainMap[host].reset(cfgIndex);
+        unsigned node = find(host);
+        if (node != NoNode) nodes[node].configs.reset(cfgIndex);
     }
 
-    std::vector<std::string> getKeys(const Url& host) const
+    /** Calls fn on every label of the host starting from the top level one.
+        Stops when fn returns false.
+     */
+    template<typename Fn>
+    static void forEachLabel(const std::string& host, const Fn& fn)
     {
-        std::vector<std::string> keys;
+        size_t end = host.size();
 
-        std::string domain = host.host();
         while (true) {
-            keys.push_back(domain);
+            size_t dot = end ? host.rfind('.', end - 1) : std::string::npos;
+            size_t start = dot == std::string::npos ? 0 : dot + 1;
+
+            if (!fn(host.data() + start, end - start)) return;
+            if (dot == std::string::npos) return;
+
+            end = dot;
+        }
+    }
 
-            size_t pos = domain.find('.');
-            if (pos == std::string::npos) break;
-            domain = domain.substr(pos+1);
+    static uint64_t hashLabel(const char* label, size_t size)
+    {
+        // FNV-1a which is plenty good enough for short labels.
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= (unsigned char) label[i];
+            hash *= 1099511628211ULL;
         }
+        return hash;
+    }
+
+    unsigned findChild(unsigned node, const char* label, size_t size) const
+    {
+        uint64_t hash = hashLabel(label, size);
+        const auto& children = nodes[node].children;
+
+        auto it = std::lower_bound(
+                children.begin(), children.end(), std::make_pair(hash, 0u));
 
-        return keys;
+        for (; it != children.end() && it->first == hash; ++it) {
+            const std::string& other = nodes[it->second].label;
+            if (other.size() == size && !other.compare(0, size, label, size))
+                return it->second;
+        }
+
+        return NoNode;
+    }
+
+    unsigned find(const std::string& host) const
+    {
+        unsigned node = Root;
+        forEachLabel(host, [&] (const char* label, size_t size) {
+                    node = findChild(node, label, size);
+                    return node != NoNode;
+                });
+        return node;
     }
 
-    std::unordered_map<std::string, ConfigSet> domainMap;
+    unsigned insert(const std::string& host)
+    {
+        unsigned node = Root;
+
+        forEachLabel(host, [&] (const char* label, size_t size) {
+                    unsigned child = findChild(node, label, size);
+
+                    if (child == NoNode) {
+                        child = nodes.size();
+                        nodes.emplace_back();
+                        nodes.back().label.assign(label, size);
+
+                        auto& children = nodes[node].children;
+                        auto entry = std::make_pair(hashLabel(label, size), child);
+                        children.insert(std::upper_bound(
+                                        children.begin(), children.end(), entry),
+                                entry);
+                    }
+
+                    node = child;
+                    return true;
+                });
+
+        return node;
+    }
+
+    std::vector<Node> nodes;
 };
 
 /******************************************************************************/
@@ -322,12 +514,33 @@ private:
 
 /** Generic include filter for regexes.
 
-    \todo We could add a TLS cache of all seen values such that we can avoid the
-    regex entirely.
+    Instead of running every regex against the input, a literal that must be
+    part of any match is extracted from each regex (see requiredLiteral) and
+    all these literals are searched for in a single pass using an Aho-Corasick
+    automaton. Only the regexes whose literal was found, along with the ones
+    that have no usable literal, are then evaluated.
+
+    Matching every regex is still expensive so filters built on top of this
+    should memoize their masks using a FilterMaskCache.
  */
 template<typename Regex, typename Str>
 struct RegexFilter
 {
+    RegexFilter() {}
+
+    // The index points into data so it needs to be rebuilt on copies.
+    RegexFilter(const RegexFilter& other) : data(other.data)
+    {
+        index();
+    }
+
+    RegexFilter& operator= (const RegexFilter& other)
+    {
+        data = other.data;
+        index();
+        return *this;
+    }
+
     template<typename List>
     bool isEmpty(const List& list) const
     {
@@ -352,19 +565,38 @@ struct RegexFilter
     {
         ConfigSet matches;
 
-        for (const auto& entry : data)
-            matches |= entry.second.filter(str);
+        for (const RegexData* entry : unindexed)
+            matches |= entry->filter(str);
+
+        if (literals.empty()) return matches;
+
+        ConfigSet found = literals.match(text(str));
+        for (size_t id = found.next(); id < found.size(); id = found.next(id + 1)) {
+            for (const RegexData* entry : byLiteral[id])
+                matches |= entry->filter(str);
+        }
 
         return matches;
     }
 
 private:
 
+    static const std::string& text(const std::string& str) { return str; }
+
+    static const std::string& text(const Datacratic::Utf8String& str)
+    {
+        return str.rawString();
+    }
+
     void addConfig(unsigned cfgIndex, const Regex& regex)
     {
         auto& entry = data[regex.str()];
-        if (entry.regex.empty()) entry.regex = regex;
         entry.configs.set(cfgIndex);
+
+        if (entry.regex.empty()) {
+            entry.regex = regex;
+            index();
+        }
     }
 
     void addConfig(unsigned cfgIndex, const CachedRegex<Regex, Str>& regex)
@@ -379,7 +611,10 @@ private:
         if (it == data.end()) return;
 
         it->second.configs.reset(cfgIndex);
-        if (it->second.configs.empty()) data.erase(it);
+        if (!it->second.configs.empty()) return;
+
+        data.erase(it);
+        index();
     }
 
     void removeConfig(unsigned cfgIndex, const CachedRegex<Regex, Str>& regex)
@@ -398,6 +633,35 @@ private:
         }
     };
 
+    /** Rebuilds the literal index from scratch. Only called when the set of
+        regexes changes which is rare compared to the number of filter calls.
+     */
+    void index()
+    {
+        unindexed.clear();
+        byLiteral.clear();
+
+        std::map<std::string, unsigned> ids;
+        std::vector<std::string> list;
+
+        for (const auto& it : data) {
+            std::string literal = requiredLiteral(it.second.regex);
+            if (literal.empty()) {
+                unindexed.push_back(&it.second);
+                continue;
+            }
+
+            auto res = ids.insert(std::make_pair(literal, list.size()));
+            if (res.second) {
+                list.push_back(literal);
+                byLiteral.emplace_back();
+            }
+            byLiteral[res.first->second].push_back(&it.second);
+        }
+
+        literals.build(list);
+    }
+
     typedef std::basic_string<typename Regex::value_type> KeyT;
 
     /* \todo gcc 4.6 can't hash u32strings so use a map for now.
@@ -407,6 +671,10 @@ private:
        own because, you guessed it, gcc already defines it. Glorious is it not?
     */
     std::map<KeyT, RegexData> data;
+
+    std::vector<const RegexData*> unindexed;
+    std::vector< std::vector<const RegexData*> > byLiteral;
+    LiteralMatcher literals;
 };
 
 
@@ -471,6 +739,11 @@ private:
 
 /** Segments have quirks and are best handled seperatly from the list filter.
 
+    This is an inverted index from segment to the set of configs that list it
+    so filtering a SegmentList is just the union of the sets of each of its
+    segments. Bid requests can carry hundreds of segments so the filtering path
+    walks the segment list directly instead of going through
+    SegmentList::forEach which formats every int segment into a string.
  */
 struct SegmentListFilter
 {
@@ -491,16 +764,27 @@ struct SegmentListFilter
 
     ConfigSet filter(int i, const std::string& str) const
     {
-        return i >= 0 ? get(intSet, i) : get(strSet, str);
+        const ConfigSet* configs = i >= 0 ? get(intSet, i) : get(strSet, str);
+        return configs ? *configs : ConfigSet();
     }
 
     ConfigSet filter(const SegmentList& segments) const
     {
         ConfigSet configs;
 
-        segments.forEach([&](int i, std::string str, float) {
-                    configs |= filter(i, str);
-                });
+        for (int i : segments.ints) {
+            // Mimics forEach which would route negative ints to strSet.
+            const ConfigSet* set = i >= 0 ?
+                get(intSet, i) : get(strSet, ML::format("%d", i));
+            if (set) configs |= *set;
+        }
+
+        if (!strSet.empty()) {
+            for (const std::string& str : segments.strings) {
+                const ConfigSet* set = get(strSet, str);
+                if (set) configs |= *set;
+            }
+        }
 
         return configs;
     }
@@ -516,10 +800,10 @@ private:
     }
 
     template<typename K>
-    ConfigSet get(const std::unordered_map<K, ConfigSet>& m, K k) const
+    const ConfigSet* get(const std::unordered_map<K, ConfigSet>& m, const K& k) const
     {
         auto it = m.find(k);
-        return it != m.end() ? it->second : ConfigSet();
+        return it != m.end() ? &it->second : nullptr;
     }
 
     std::unordered_map<int, ConfigSet> intSet;
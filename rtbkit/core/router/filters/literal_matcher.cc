@@ -0,0 +1,255 @@
+/** literal_matcher.cc                                 -*- C++ -*-
+    FreeBSD-style copyright and disclaimer apply
+
+    Implementation of the literal extraction and of the Aho-Corasick
+    automaton.
+
+*/
+
+#include "literal_matcher.h"
+
+#include <algorithm>
+#include <deque>
+#include <cctype>
+
+
+using namespace std;
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* REQUIRED LITERAL                                                           */
+/******************************************************************************/
+
+namespace {
+
+bool isQuantifier(char c)
+{
+    return c == '*' || c == '?' || c == '+' || c == '{';
+}
+
+// Returns the index of the end of the character class starting at i or
+// string::npos if the class isn't terminated.
+size_t skipClass(const string& regex, size_t i)
+{
+    i++; // [
+    if (i < regex.size() && regex[i] == '^') i++;
+    if (i < regex.size() && regex[i] == ']') i++;
+
+    for (; i < regex.size(); ++i) {
+        if (regex[i] == '\\') i++;
+        else if (regex[i] == ']') return i;
+    }
+
+    return string::npos;
+}
+
+} // namespace anonymous
+
+string
+requiredLiteral(const string& regex)
+{
+    string best, current;
+    int depth = 0;
+
+    auto flush = [&] {
+        if (current.size() > best.size()) best = current;
+        current.clear();
+    };
+
+    for (size_t i = 0; i < regex.size(); ++i) {
+        char c = regex[i];
+
+        if (c == '[') {
+            flush();
+            i = skipClass(regex, i);
+            if (i == string::npos) return "";
+            continue;
+        }
+
+        if (c == '(') {
+            // Inline modifiers and assertions change the meaning of what
+            // follows so don't even try.
+            if (i + 1 < regex.size() && regex[i + 1] == '?') {
+                if (i + 2 >= regex.size() || regex[i + 2] != ':') return "";
+            }
+
+            flush();
+            depth++;
+            continue;
+        }
+
+        if (c == ')') {
+            if (!depth) return "";
+            depth--;
+            continue;
+        }
+
+        // An alternation at the top level means that none of the literals are
+        // required. Within a group, we skip the content of the group anyway.
+        if (c == '|') {
+            if (!depth) return "";
+            continue;
+        }
+
+        if (c == '\\') {
+            if (i + 1 >= regex.size()) return "";
+            char escaped = regex[++i];
+
+            // \Q...\E quoting isn't worth the trouble.
+            if (escaped == 'Q') return "";
+
+            // Character classes, assertions, back-references, etc.
+            if (isalnum((unsigned char) escaped)) {
+                flush();
+                continue;
+            }
+
+            c = escaped;
+        }
+        else if (isQuantifier(c)) {
+            // The last atom is optional unless it's a +; either way it's the
+            // last character of the literal we can rely on.
+            if (c != '+' && !current.empty()) current.resize(current.size() - 1);
+            flush();
+
+            if (c == '{') {
+                i = regex.find('}', i);
+                if (i == string::npos) return "";
+            }
+            continue;
+        }
+        else if (c == '.' || c == '^' || c == '$' || c == ']' || c == '}') {
+            flush();
+            continue;
+        }
+
+        if (depth) continue;
+        current += c;
+    }
+
+    if (depth) return "";
+
+    flush();
+    return best;
+}
+
+string
+requiredLiteral(const boost::regex& regex)
+{
+    if (regex.empty()) return "";
+
+    // Only the default perl syntax is understood.
+    if (regex.flags() != boost::regex::normal) return "";
+
+    return requiredLiteral(regex.str());
+}
+
+
+/******************************************************************************/
+/* LITERAL MATCHER                                                            */
+/******************************************************************************/
+
+void
+LiteralMatcher::
+clear()
+{
+    states.clear();
+    states.emplace_back();
+}
+
+unsigned
+LiteralMatcher::
+child(unsigned state, unsigned char c) const
+{
+    const auto& next = states[state].next;
+
+    auto it = lower_bound(next.begin(), next.end(), make_pair(c, 0u));
+    if (it == next.end() || it->first != c) return 0;
+    return it->second;
+}
+
+unsigned
+LiteralMatcher::
+addChild(unsigned state, unsigned char c)
+{
+    unsigned index = child(state, c);
+    if (index) return index;
+
+    index = states.size();
+    states.emplace_back();
+
+    auto& next = states[state].next;
+    auto it = lower_bound(next.begin(), next.end(), make_pair(c, 0u));
+    next.insert(it, make_pair(c, index));
+
+    return index;
+}
+
+void
+LiteralMatcher::
+build(const vector<string>& literals)
+{
+    clear();
+
+    for (size_t id = 0; id < literals.size(); ++id) {
+        const string& literal = literals[id];
+        if (literal.empty()) continue;
+
+        unsigned state = 0;
+        for (char c : literal) state = addChild(state, c);
+        states[state].literal = id;
+    }
+
+    // Breadth first traversal to compute the fail links of a state from the
+    // fail links of its parent.
+    deque<unsigned> queue;
+    for (const auto& edge : states[0].next) queue.push_back(edge.second);
+
+    while (!queue.empty()) {
+        unsigned state = queue.front();
+        queue.pop_front();
+
+        for (const auto& edge : states[state].next) {
+            unsigned next = edge.second;
+            queue.push_back(next);
+
+            unsigned fail = states[state].fail;
+            while (fail && !child(fail, edge.first))
+                fail = states[fail].fail;
+            fail = child(fail, edge.first);
+
+            states[next].fail = fail;
+            states[next].output =
+                states[fail].literal != NoLiteral ? fail : states[fail].output;
+        }
+    }
+}
+
+ConfigSet
+LiteralMatcher::
+match(const char* text, size_t size) const
+{
+    ConfigSet found;
+    unsigned state = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+        unsigned char c = text[i];
+
+        unsigned next;
+        while (!(next = child(state, c)) && state)
+            state = states[state].fail;
+        state = next;
+
+        if (states[state].literal != NoLiteral)
+            found.set(states[state].literal);
+
+        for (unsigned out = states[state].output; out; out = states[out].output)
+            found.set(states[out].literal);
+    }
+
+    return found;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,98 @@
+/** literal_matcher.h                                 -*- C++ -*-
+    FreeBSD-style copyright and disclaimer apply
+
+    Multi-pattern literal matching used to prefilter regexes.
+
+*/
+
+#pragma once
+
+#include "rtbkit/common/filter.h"
+
+#include <boost/regex.hpp>
+#include <boost/regex/icu.hpp>
+#include <string>
+#include <vector>
+
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* REQUIRED LITERAL                                                           */
+/******************************************************************************/
+
+/** Returns the longest literal string that must appear in any string matched
+    by the given perl regex or an empty string if no such literal could be
+    found.
+
+    The analysis is conservative: anything that isn't understood (alternations,
+    groups, classes, inline modifiers, etc.) is simply skipped or causes the
+    regex to be rejected.
+ */
+std::string requiredLiteral(const std::string& regex);
+
+std::string requiredLiteral(const boost::regex& regex);
+
+// Matching is done on the utf-8 string so we don't attempt to analyse
+// unicode regexes.
+inline std::string requiredLiteral(const boost::u32regex&) { return ""; }
+
+
+/******************************************************************************/
+/* LITERAL MATCHER                                                            */
+/******************************************************************************/
+
+/** Aho-Corasick automaton that finds all the occurrences of a set of literals
+    in a single pass over the input string.
+
+    The output is returned as a ConfigSet where the bit i is set if the literal
+    with id i was found which makes it easy to combine with the rest of the
+    filtering machinery.
+ */
+struct LiteralMatcher
+{
+    LiteralMatcher() { clear(); }
+
+    /** Rebuilds the automaton for the given literals where the id of each
+        literal is its index in the vector. Empty literals are ignored.
+     */
+    void build(const std::vector<std::string>& literals);
+
+    void clear();
+
+    bool empty() const { return states.size() == 1; }
+
+    ConfigSet match(const char* text, size_t size) const;
+
+    ConfigSet match(const std::string& text) const
+    {
+        return match(text.data(), text.size());
+    }
+
+private:
+
+    enum { NoLiteral = unsigned(-1) };
+
+    struct State
+    {
+        State() : fail(0), output(0), literal(NoLiteral) {}
+
+        // Sorted by character.
+        std::vector< std::pair<unsigned char, unsigned> > next;
+
+        unsigned fail;
+
+        // Closest state in the fail chain that terminates a literal.
+        unsigned output;
+
+        unsigned literal;
+    };
+
+    unsigned child(unsigned state, unsigned char c) const;
+    unsigned addChild(unsigned state, unsigned char c);
+
+    std::vector<State> states;
+};
+
+} // namespace RTBKIT
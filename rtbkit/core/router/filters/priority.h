@@ -38,6 +38,10 @@ struct Priority
 
     static constexpr unsigned CreativeSegments     = 0x3500;
 
+    // Looks up the sketch for each capped config so do it on as few as
+    // possible.
+    static constexpr unsigned FrequencyCap         = 0xE000;
+
     static constexpr unsigned ExchangePre          = 0xF000;
 
     // Really slow so delay as much as possible.
@@ -46,6 +50,9 @@ struct Priority
     static constexpr unsigned LatLong              = 0xF200;
 
     static constexpr unsigned ExchangePost         = 0xFF00;
+
+    // PostAugmentation phase; only ordered relative to each other.
+    static constexpr unsigned AugmentationTags     = 0x0100;
 };
 
 
@@ -81,6 +81,8 @@ SegmentsFilter::
 fillFilterReasons(FilterState& state, ConfigSet& beforeFilt,
                   ConfigSet& afterFilt, const std::string & segment) const {
 
+    if (!state.recordReasons()) return;
+
     // Some Magic to get all the filtered out configs by this segment.
     FilterState::FilterReasons& reasons = state.getFilterReasons();
     reasons[segment] = beforeFilt ^ (beforeFilt & afterFilt);
@@ -91,11 +93,9 @@ void
 SegmentsFilter::
 filter(FilterState& state) const
 {
-    unordered_set<string> toCheck = excludeIfNotPresent;
-
-    for (const auto& segment : state.request.segments) {
-        toCheck.erase(segment.first);
+    const auto& segments = state.request.segments;
 
+    for (const auto& segment : segments) {
         auto it = data.find(segment.first);
         if (it == data.end()) continue;
 
@@ -110,7 +110,9 @@ filter(FilterState& state) const
         if (state.configs().empty()) return;
     }
 
-    for (const auto& segment : toCheck) {
+    for (const auto& segment : excludeIfNotPresent) {
+        if (segments.count(segment)) continue;
+
         auto it = data.find(segment);
         if (it == data.end()) continue;
 
@@ -244,6 +246,7 @@ void LatLongDevFilter::addConfig(unsigned cfgIndex,
         squares.push_back(sq);
     }
     if ( ! squares.empty()){
+        for (const auto & sq : squares) indexSquare(cfgIndex, sq);
         squares_by_confindx[cfgIndex] = squares;
         configs_with_filt.set(cfgIndex);
     }
@@ -252,36 +255,118 @@ void LatLongDevFilter::addConfig(unsigned cfgIndex,
 void LatLongDevFilter::removeConfig(unsigned cfgIndex,
         const std::shared_ptr<RTBKIT::AgentConfig>& config)
 {
-    if ( squares_by_confindx.count(cfgIndex) > 0){
-        squares_by_confindx.erase(cfgIndex);
-        configs_with_filt.reset(cfgIndex);
-    }
+    auto it = squares_by_confindx.find(cfgIndex);
+    if (it == squares_by_confindx.end()) return;
+
+    for (const auto & sq : it->second) unindexSquare(cfgIndex, sq);
+    squares_by_confindx.erase(it);
+    configs_with_filt.reset(cfgIndex);
 }
 
 void LatLongDevFilter::filter(RTBKIT::FilterState& state) const
  {
-    RTBKIT::ConfigSet matches = state.configs();
-
-    auto it = squares_by_confindx.begin();
     if ( ! checkLatLongPresent(state.request)){
         // If there is no geo info the filter, then filter out all the
         // agent configs that has this filter present.
         state.narrowConfigs(configs_with_filt.negate());
     } else {
         // Filter using the lat long of the request and from the configs
-        // of the agents.
-        for ( ; it != squares_by_confindx.end(); ++it ){
-            if (pointInsideAnySquare(state.request.device->geo->lat.val,
-                    state.request.device->geo->lon.val, it->second)) {
-                continue;
-            }
-            matches.reset(it->first);
+        // of the agents. Only the squares of the request's cell and the
+        // large squares can contain the point.
+        const float lat = state.request.device->geo->lat.val;
+        const float lon = state.request.device->geo->lon.val;
+        const float y = lat * LATITUDE_1DEGREE_KMS;
+        const float x = lon * LONGITUDE_1DEGREE_KMS * cosInDegrees(lat);
+
+        RTBKIT::ConfigSet matches = configs_with_filt.negate();
+
+        if (std::isfinite(x) && std::isfinite(y)) {
+            int64_t cx = std::floor(x / CELL_KMS);
+            int64_t cy = std::floor(y / CELL_KMS);
+
+            auto it = grid.find(cellKey(cx, cy));
+            if (it != grid.end()) matchSquares(x, y, it->second, matches);
+            matchSquares(x, y, large_squares, matches);
         }
+
         state.narrowConfigs(matches);
     }
 
  }
 
+bool LatLongDevFilter::cellRange(const Square & sq,
+        int64_t & x_min, int64_t & x_max,
+        int64_t & y_min, int64_t & y_max)
+{
+    float x_cells = std::floor(sq.x_max / CELL_KMS) - std::floor(sq.x_min / CELL_KMS);
+    float y_cells = std::floor(sq.y_max / CELL_KMS) - std::floor(sq.y_min / CELL_KMS);
+
+    // Also catches the NaNs and infinities.
+    if (!(x_cells >= 0 && y_cells >= 0 &&
+          (x_cells + 1) * (y_cells + 1) <= MAX_CELLS_PER_SQUARE))
+        return false;
+
+    x_min = std::floor(sq.x_min / CELL_KMS);
+    x_max = std::floor(sq.x_max / CELL_KMS);
+    y_min = std::floor(sq.y_min / CELL_KMS);
+    y_max = std::floor(sq.y_max / CELL_KMS);
+    return true;
+}
+
+void LatLongDevFilter::indexSquare(unsigned cfgIndex, const Square & sq)
+{
+    GridEntry entry;
+    entry.cfgIndex = cfgIndex;
+    entry.square = sq;
+
+    int64_t x_min, x_max, y_min, y_max;
+    if (!cellRange(sq, x_min, x_max, y_min, y_max)) {
+        large_squares.push_back(entry);
+        return;
+    }
+
+    for (int64_t x = x_min; x <= x_max; ++x)
+        for (int64_t y = y_min; y <= y_max; ++y)
+            grid[cellKey(x, y)].push_back(entry);
+}
+
+void LatLongDevFilter::unindexSquare(unsigned cfgIndex, const Square & sq)
+{
+    auto eraseFrom = [&] (GridEntryList & entries) {
+        entries.erase(
+                std::remove_if(entries.begin(), entries.end(),
+                        [&] (const GridEntry & entry) {
+                            return entry.cfgIndex == cfgIndex;
+                        }),
+                entries.end());
+    };
+
+    int64_t x_min, x_max, y_min, y_max;
+    if (!cellRange(sq, x_min, x_max, y_min, y_max)) {
+        eraseFrom(large_squares);
+        return;
+    }
+
+    for (int64_t x = x_min; x <= x_max; ++x) {
+        for (int64_t y = y_min; y <= y_max; ++y) {
+            auto it = grid.find(cellKey(x, y));
+            if (it == grid.end()) continue;
+
+            eraseFrom(it->second);
+            if (it->second.empty()) grid.erase(it);
+        }
+    }
+}
+
+void LatLongDevFilter::matchSquares(float x, float y,
+        const GridEntryList & entries, ConfigSet & matches)
+{
+    for (const auto & entry : entries) {
+        if (matches[entry.cfgIndex]) continue;
+        if (insideSquare(x, y, entry.square)) matches.set(entry.cfgIndex);
+    }
+}
+
 bool LatLongDevFilter::checkLatLongPresent(
         const RTBKIT::BidRequest & req) const
 {
@@ -192,12 +192,16 @@ struct LanguageFilter : public FilterBaseT<LanguageFilter>
 
     void filter(FilterState& state) const
     {
-        state.narrowConfigs(impl.filter(state.request.language.utf8String()));
+        const std::string& language = state.request.language.utf8String();
+        state.narrowConfigs(memoize(cache, language, [&] {
+                    return impl.filter(language);
+                }));
     }
 
 private:
     typedef RegexFilter<boost::regex, std::string> BaseFilter;
     IncludeExcludeFilter<BaseFilter> impl;
+    FilterMaskCache<std::string> cache;
 };
 
 
@@ -218,12 +222,15 @@ struct LocationFilter : public FilterBaseT<LocationFilter>
     void filter(FilterState& state) const
     {
         Datacratic::UnicodeString location = state.request.location.fullLocationString();
-        state.narrowConfigs(impl.filter(location));
+        state.narrowConfigs(memoize(cache, location.utf8String(), [&] {
+                    return impl.filter(location);
+                }));
     }
 
 private:
     typedef RegexFilter<boost::u32regex, Datacratic::UnicodeString> BaseFilter;
     IncludeExcludeFilter<BaseFilter> impl;
+    FilterMaskCache<std::string> cache;
 };
 
 
@@ -284,11 +291,15 @@ struct ExchangeNameFilter : public FilterBaseT<ExchangeNameFilter>
 
     void filter(FilterState& state) const
     {
-        state.narrowConfigs(data.filter(state.request.exchange));
+        const std::string& exchange = state.request.exchange;
+        state.narrowConfigs(memoize(cache, exchange, [&] {
+                    return data.filter(exchange);
+                }));
     }
 
 private:
     IncludeExcludeFilter< ListFilter<std::string> > data;
+    FilterMaskCache<std::string> cache;
 };
 
 
@@ -309,13 +320,16 @@ struct FoldPositionFilter : public FilterBaseT<FoldPositionFilter>
     void filter(FilterState& state) const
     {
         for (const auto& imp : state.request.imp) {
-            state.narrowConfigs(impl.filter(imp.position));
+            state.narrowConfigs(memoize(cache, imp.position.val, [&] {
+                        return impl.filter(imp.position);
+                    }));
             if (state.configs().empty()) break;
         }
     }
 
 private:
     IncludeExcludeFilter< ListFilter<OpenRTB::AdPosition> > impl;
+    FilterMaskCache<int> cache;
 };
 
 
@@ -442,6 +456,40 @@ struct LatLongDevFilter : public RTBKIT::FilterBaseT<LatLongDevFilter>
         return cos(degrees * deeToGrad);
     }
 
+private:
+
+    /**
+     * Squares are also indexed in a uniform grid of the same 2D space so that
+     * a request only has to check the squares that overlap its cell instead
+     * of every square of every config. Squares that would cover too many
+     * cells are kept aside and always checked.
+     */
+    static constexpr float CELL_KMS = 10.0;
+    enum { MAX_CELLS_PER_SQUARE = 64 };
+
+    struct GridEntry {
+        unsigned cfgIndex;
+        Square square;
+    };
+
+    typedef std::vector<GridEntry> GridEntryList;
+    std::unordered_map<uint64_t, GridEntryList> grid;
+    GridEntryList large_squares;
+
+    static bool cellRange(const Square & sq,
+            int64_t & x_min, int64_t & x_max,
+            int64_t & y_min, int64_t & y_max);
+
+    static uint64_t cellKey(int64_t x, int64_t y)
+    {
+        return (uint64_t(uint32_t(x)) << 32) | uint32_t(y);
+    }
+
+    void indexSquare(unsigned cfgIndex, const Square & sq);
+    void unindexSquare(unsigned cfgIndex, const Square & sq);
+
+    static void matchSquares(float x, float y,
+            const GridEntryList & entries, ConfigSet & matches);
 };
 
 
@@ -0,0 +1,104 @@
+/** augmentation_filters_test.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Tests for the filters of the augmentations.
+
+ */
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "utils.h"
+#include "rtbkit/core/router/filters/augmentation_filters.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include "rtbkit/common/bid_request.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT::Test;
+
+namespace {
+
+AugmentationConfig
+augmentation(const string& name, bool required, const IncludeExclude<string>& tags)
+{
+    AugmentationConfig result(name);
+    result.required = required;
+    result.filters = tags;
+    result.compile();
+    return result;
+}
+
+Augmentation tagged(const string& tag)
+{
+    return Augmentation(set<string>({ tag }));
+}
+
+} // namespace anonymous
+
+
+BOOST_AUTO_TEST_CASE( augmentationTagsFilter )
+{
+    AugmentationTagsFilter filter;
+    ConfigSet mask;
+
+    Auction::Augmentations augmentations;
+
+    auto doCheck = [&] (const initializer_list<size_t>& expected)
+    {
+        BidRequest request;
+        check(filter, request, "ex1", mask, expected, &augmentations);
+    };
+
+    AgentConfig c0;
+
+    AgentConfig c1;
+    c1.account = AccountKey("a:b");
+    c1.augmentations.push_back(augmentation("aug1", true, ie<string>()));
+
+    AgentConfig c2;
+    c2.account = AccountKey("a:c");
+    c2.augmentations.push_back(augmentation("aug1", false, ie<string>({ "t1" }, {})));
+
+    AgentConfig c3;
+    c3.account = AccountKey("a:b");
+    c3.augmentations.push_back(augmentation("aug2", true, ie<string>({}, { "t2" })));
+
+    title("augmentationTags-1");
+    addConfig(filter, 0, c0); mask.set(0);
+    addConfig(filter, 1, c1); mask.set(1);
+    addConfig(filter, 2, c2); mask.set(2);
+    addConfig(filter, 3, c3); mask.set(3);
+
+    // Before the augmentation, nothing is filtered.
+    {
+        BidRequest request;
+        check(filter, request, "ex1", mask, { 0, 1, 2, 3 });
+    }
+
+    // The missing augmentations are only filtered when required.
+    doCheck({ 0, 2 });
+
+    title("augmentationTags-2");
+    augmentations["aug1"].insertGlobal(tagged("t0"));
+    augmentations["aug2"].insertGlobal(tagged("t0"));
+    doCheck({ 0, 1, 3 });
+
+    title("augmentationTags-3");
+    augmentations["aug1"][AccountKey("a:c")] = tagged("t1");
+    augmentations["aug2"][AccountKey("a")] = tagged("t2");
+    doCheck({ 0, 1, 2 });
+
+    title("augmentationTags-4");
+    removeConfig(filter, 1, c1); mask.reset(1);
+    removeConfig(filter, 2, c2); mask.reset(2);
+    augmentations.erase("aug1");
+    doCheck({ 0 });
+
+    removeConfig(filter, 3, c3); mask.reset(3);
+    augmentations.clear();
+    doCheck({ 0 });
+}
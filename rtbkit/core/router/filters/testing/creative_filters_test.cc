@@ -23,6 +23,30 @@ using namespace ML;
 using namespace Datacratic;
 using namespace RTBKIT::Test;
 
+/******************************************************************************/
+/* FORMAT REGISTRY                                                            */
+/******************************************************************************/
+
+BOOST_AUTO_TEST_CASE( testFormatRegistry )
+{
+    size_t size = FormatRegistry::size();
+
+    BOOST_CHECK_EQUAL(FormatRegistry::find(Format(123, 456)), FormatRegistry::NoId);
+
+    unsigned id = FormatRegistry::add(Format(123, 456));
+    BOOST_CHECK_EQUAL(id, size);
+    BOOST_CHECK_EQUAL(FormatRegistry::add(Format(123, 456)), id);
+    BOOST_CHECK_EQUAL(FormatRegistry::find(Format(123, 456)), id);
+    BOOST_CHECK_EQUAL(FormatRegistry::find(Format(456, 123)), FormatRegistry::NoId);
+
+    // Ids are dense so that they can be used as indexes.
+    for (unsigned i = 0; i < 100; ++i)
+        FormatRegistry::add(Format(1000 + i, 1000 - i));
+    BOOST_CHECK_EQUAL(FormatRegistry::size(), size + 101);
+    BOOST_CHECK_EQUAL(FormatRegistry::find(Format(1099, 901)), size + 100);
+}
+
+
 /******************************************************************************/
 /* FORMAT FILTER                                                              */
 /******************************************************************************/
@@ -0,0 +1,425 @@
+/** filter_pool_bench.cc                                     -*- C++ -*-
+    FreeBSD-style copyright and disclaimer apply
+
+    Measures the cost of every registered filter and of the whole FilterPool
+    over populations of synthetic agent configs of growing sizes, along with
+    the number of allocations made per bid request.
+
+    The bid requests are either synthetic or read from a file with one
+    request per line, in the format given by --format.
+
+*/
+
+#include "rtbkit/core/router/filter_pool.h"
+#include "rtbkit/core/router/filters/static_filters.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include "rtbkit/common/exchange_connector.h"
+#include "rtbkit/common/bid_request.h"
+#include "soa/utils/benchmarks.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
+#include "jml/utils/exc_check.h"
+#include "jml/utils/smart_ptr_utils.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+/******************************************************************************/
+/* ALLOCATIONS                                                                */
+/******************************************************************************/
+
+namespace {
+
+std::atomic<size_t> allocations(0);
+
+} // namespace anonymous
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+
+/******************************************************************************/
+/* CONFIG                                                                     */
+/******************************************************************************/
+
+struct Config
+{
+    Config() :
+        configs({ 10, 100, 1000, 5000 }),
+        requests(10000),
+        format("datacratic")
+    {}
+
+    vector<size_t> configs; // sizes of the config populations
+    size_t requests;        // number of synthetic bid requests
+    string requestsFile;    // recorded bid requests, one per line
+    string format;          // format of the recorded bid requests
+};
+
+Config getConfig(int argc, char** argv)
+{
+    using namespace boost::program_options;
+
+    Config config;
+    string configs;
+
+    options_description opt;
+    opt.add_options()
+        ("configs,c", value<string>(&configs),
+         "comma separated sizes of the config populations")
+        ("requests,n", value<size_t>(&config.requests))
+        ("requests-file,f", value<string>(&config.requestsFile))
+        ("format", value<string>(&config.format))
+        ("help,h","print this message");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(opt).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << opt << endl;
+        exit(1);
+    }
+
+    if (!configs.empty()) {
+        vector<string> sizes;
+        boost::split(sizes, configs, boost::is_any_of(","));
+
+        config.configs.clear();
+        for (const string& size : sizes)
+            config.configs.push_back(stoul(size));
+    }
+
+    return config;
+}
+
+
+/******************************************************************************/
+/* POPULATION                                                                 */
+/******************************************************************************/
+
+/** Values that the synthetic configs and bid requests draw from. Each config
+    only uses a few of the filters, as real campaigns do, so that every filter
+    has configs to eliminate and configs to let through.
+ */
+struct Population
+{
+    Population() : rng(0)
+    {
+        for (size_t i = 0; i < 200; ++i)
+            domains.push_back("site" + to_string(i) + ".com");
+
+        exchanges = { "exch0", "exch1", "exch2", "exch3" };
+        countries = { "US", "CA", "GB", "FR", "DE", "BR" };
+        languages = { "en", "fr", "de", "pt" };
+    }
+
+    template<typename T>
+    const T& pick(const vector<T>& values)
+    {
+        return values[uniform_int_distribution<size_t>(0, values.size() - 1)(rng)];
+    }
+
+    bool chance(double p)
+    {
+        return uniform_real_distribution<double>(0, 1)(rng) < p;
+    }
+
+    int segment()
+    {
+        return uniform_int_distribution<int>(0, 999)(rng);
+    }
+
+    Json::Value include(const vector<string>& values)
+    {
+        Json::Value result;
+        for (const string& value : values)
+            result["include"].append(value);
+        return result;
+    }
+
+    AgentConfig makeConfig()
+    {
+        Json::Value json;
+        json["account"][0] = "bench";
+
+        Json::Value creative;
+        creative["id"] = 1;
+        creative["name"] = "creative";
+        creative["width"] = chance(0.5) ? 300 : 728;
+        creative["height"] = creative["width"].asInt() == 300 ? 250 : 90;
+        json["creatives"][0] = creative;
+
+        if (chance(0.5)) {
+            Json::Value filter;
+            for (size_t i = 0; i < 20; ++i)
+                filter["include"].append(segment());
+            filter["excludeIfNotPresent"] = chance(0.5);
+            json["segmentFilter"]["users"] = filter;
+        }
+
+        if (chance(0.3))
+            json["hostFilter"] = include({ pick(domains) });
+
+        if (chance(0.3)) {
+            json["urlFilter"] = include({
+                        "^http://(www\\.)?" + pick(domains) + "/" });
+        }
+
+        if (chance(0.3))
+            json["locationFilter"] = include({ "^" + pick(countries) + ":" });
+
+        if (chance(0.2))
+            json["languageFilter"] = include({ pick(languages) });
+
+        if (chance(0.5)) {
+            json["exchangeFilter"] = include({
+                        pick(exchanges), pick(exchanges) });
+        }
+
+        if (chance(0.3)) {
+            string bitmap(168, '0');
+            for (char& hour : bitmap)
+                if (chance(0.7)) hour = '1';
+            json["hourOfWeekFilter"]["hourlyBitmapSundayMidnightUtc"] = bitmap;
+        }
+
+        return AgentConfig::createFromJson(json);
+    }
+
+    BidRequest makeRequest()
+    {
+        BidRequest br;
+        br.auctionId = Id(rng());
+        br.exchange = pick(exchanges);
+        br.timestamp = Date::fromSecondsSinceEpoch(1400000000 + rng() % 604800);
+        br.language = pick(languages);
+        br.location.countryCode = pick(countries);
+
+        const string& domain = pick(domains);
+        br.url = Url("http://www." + domain + "/page" + to_string(rng() % 100));
+
+        AdSpot imp;
+        imp.formats.push_back(Format(300, 250));
+        if (chance(0.5)) imp.formats.push_back(Format(728, 90));
+        br.imp.push_back(imp);
+
+        auto segments = make_shared<SegmentList>();
+        for (size_t i = 0; i < 10; ++i)
+            segments->add(segment());
+        segments->sort();
+        br.segments["users"] = segments;
+
+        br.userIds.add(Id(rng()), ID_EXCHANGE);
+        br.userIds.add(Id(rng()), ID_PROVIDER);
+
+        return br;
+    }
+
+    mt19937 rng;
+    vector<string> domains;
+    vector<string> exchanges;
+    vector<string> countries;
+    vector<string> languages;
+};
+
+vector<BidRequest> loadRequests(const string& file, const string& format)
+{
+    ifstream stream(file);
+    if (!stream) throw ML::Exception("couldn't open " + file);
+
+    vector<BidRequest> requests;
+    string line;
+    while (getline(stream, line)) {
+        if (line.empty()) continue;
+        unique_ptr<BidRequest> br(BidRequest::parse(format, line));
+        requests.push_back(*br);
+    }
+
+    return requests;
+}
+
+
+/******************************************************************************/
+/* BENCH                                                                      */
+/******************************************************************************/
+
+/** The filters look up the exchange connector by name, so each exchange of
+    the requests gets its own.
+ */
+struct BenchExchangeConnector : public ExchangeConnector
+{
+    BenchExchangeConnector(const string& name) :
+        ExchangeConnector(name), name(name)
+    {}
+
+    string exchangeName() const { return name; }
+
+    void configure(const Json::Value& parameters) {}
+    void enableUntil(Date date) {}
+
+private:
+    string name;
+};
+
+struct Connectors
+{
+    const ExchangeConnector* get(const string& exchange)
+    {
+        auto& conn = connectors[exchange];
+        if (!conn) conn.reset(new BenchExchangeConnector(exchange));
+        return conn.get();
+    }
+
+    map<string, shared_ptr<BenchExchangeConnector> > connectors;
+};
+
+struct Result
+{
+    string name;
+    double nsPerRequest;
+    double allocsPerRequest;
+    double passed;          // average configs left by the filter
+};
+
+template<typename Fn>
+Result bench(
+        Benchmarks& benchmarks,
+        const string& tag,
+        const vector<BidRequest>& requests,
+        Fn&& fn)
+{
+    size_t passed = 0;
+    size_t allocsBefore = allocations.load();
+
+    {
+        Benchmark benchmark(benchmarks, tag);
+        for (const BidRequest& br : requests)
+            passed += fn(br);
+    }
+
+    size_t allocs = allocations.load() - allocsBefore;
+
+    Result result;
+    result.name = tag;
+    result.nsPerRequest = benchmarks.data_[tag] / requests.size() * 1e9;
+    result.allocsPerRequest = double(allocs) / requests.size();
+    result.passed = double(passed) / requests.size();
+    return result;
+}
+
+void report(size_t numConfigs, const vector<Result>& results)
+{
+    cerr << "configs=" << numConfigs << endl;
+
+    for (const Result& result : results) {
+        cerr << ML::format("    %-20s %12.1f ns/request %8.2f allocs/request"
+                           " %10.1f passed",
+                           result.name.c_str(), result.nsPerRequest,
+                           result.allocsPerRequest, result.passed)
+             << endl;
+    }
+}
+
+void run(size_t numConfigs, Population& population,
+         const vector<BidRequest>& requests, Connectors& connectors)
+{
+    vector< shared_ptr<AgentConfig> > configs;
+    for (size_t i = 0; i < numConfigs; ++i)
+        configs.push_back(make_shared<AgentConfig>(population.makeConfig()));
+
+    CreativeMatrix activeConfigs;
+    for (size_t i = 0; i < configs.size(); ++i)
+        activeConfigs.setConfig(i, configs[i]->creatives.size());
+
+    Benchmarks benchmarks;
+    vector<Result> results;
+
+    // Each filter on its own with every config active.
+    for (const string& name : PluginInterface<FilterBase>::getNames()) {
+        unique_ptr<FilterBase> filter = FilterBase::create(name);
+        for (size_t i = 0; i < configs.size(); ++i)
+            filter->addConfig(i, configs[i]);
+
+        results.push_back(bench(benchmarks, name, requests,
+                        [&] (const BidRequest& br) {
+                            FilterState state(
+                                    br, connectors.get(br.exchange),
+                                    activeConfigs);
+                            filter->filter(state);
+                            return state.configs().count();
+                        }));
+
+        for (size_t i = 0; i < configs.size(); ++i)
+            filter->removeConfig(i, configs[i]);
+    }
+
+    // The whole chain, as the router runs it.
+    FilterPool pool;
+    pool.initWithDefaultFilters();
+
+    FilterPool::ConfigUpdates updates;
+    for (size_t i = 0; i < configs.size(); ++i) {
+        AgentInfo info;
+        info.config = configs[i];
+        updates.add("agent" + to_string(i), info);
+    }
+    pool.updateConfigs(updates);
+
+    results.push_back(bench(benchmarks, "FilterPool", requests,
+                    [&] (const BidRequest& br) {
+                        return pool.filter(br, connectors.get(br.exchange))
+                            .size();
+                    }));
+
+    report(numConfigs, results);
+}
+
+
+/******************************************************************************/
+/* MAIN                                                                       */
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    Config config = getConfig(argc, argv);
+
+    Population population;
+
+    vector<BidRequest> requests;
+    if (!config.requestsFile.empty())
+        requests = loadRequests(config.requestsFile, config.format);
+    else {
+        for (size_t i = 0; i < config.requests; ++i)
+            requests.push_back(population.makeRequest());
+    }
+    ExcCheck(!requests.empty(), "no bid requests to filter");
+
+    cerr << "requests=" << requests.size() << endl;
+
+    Connectors connectors;
+    for (size_t numConfigs : config.configs)
+        run(numConfigs, population, requests, connectors);
+}
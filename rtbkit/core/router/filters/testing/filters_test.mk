@@ -9,5 +9,8 @@
 $(eval $(call test,generic_filters_test,static_filters,boost))
 $(eval $(call test,static_filters_test,static_filters,boost))
 $(eval $(call test,creative_filters_test,static_filters,boost))
+$(eval $(call test,frequency_cap_filter_test,static_filters,boost))
+$(eval $(call test,augmentation_filters_test,static_filters,boost))
 
-
+$(eval $(call program,lat_long_filter_bench,static_filters boost_program_options))
+$(eval $(call program,filter_pool_bench,rtb_router static_filters test_utils boost_program_options))
@@ -0,0 +1,225 @@
+/** frequency_cap_filter_test.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Tests for the frequency cap sketch and filter.
+
+ */
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "utils.h"
+#include "rtbkit/core/router/filters/frequency_cap_filter.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include "rtbkit/common/bid_request.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT::Test;
+
+namespace {
+
+UserIds user(unsigned i)
+{
+    UserIds result;
+    result.add(Id(i + 1), ID_EXCHANGE);
+    return result;
+}
+
+} // namespace anonymous
+
+
+BOOST_AUTO_TEST_CASE( sketch_estimates )
+{
+    FrequencyCapSketch::Params params;
+    params.epsilon = 0.001;
+    params.numShards = 4;
+    FrequencyCapSketch sketch(params);
+
+    AccountKey a0("a:b");
+    Date now = Date::fromSecondsSinceEpoch(1e9);
+
+    // User i gets i % 7 impressions.
+    const unsigned numUsers = 2000;
+    size_t total = 0;
+    for (unsigned i = 0; i < numUsers; ++i) {
+        for (unsigned j = 0; j < i % 7; ++j)
+            sketch.recordImpression(user(i), a0, now);
+        total += i % 7;
+    }
+
+    size_t overestimated = 0;
+    for (unsigned i = 0; i < numUsers; ++i) {
+        size_t count = sketch.estimate(user(i), a0, 3600.0, false, now);
+        BOOST_CHECK_GE(count, i % 7);
+        BOOST_CHECK_LE(count - i % 7, params.epsilon * total);
+        if (count != i % 7) ++overestimated;
+    }
+
+    cerr << overestimated << " of " << numUsers << " users overestimated"
+         << endl;
+    BOOST_CHECK_LT(overestimated, numUsers / 10);
+
+    BOOST_CHECK_EQUAL(sketch.estimate(UserIds(), a0, 3600.0, false, now), 0);
+    BOOST_CHECK_GT(sketch.memoryBytes(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( sketch_window )
+{
+    FrequencyCapSketch::Params params;
+    params.slotSeconds = 60.0;
+    params.numSlots = 10;
+    FrequencyCapSketch sketch(params);
+
+    AccountKey account("a:b");
+    UserIds u0 = user(0);
+    Date start = Date::fromSecondsSinceEpoch(6000.0);
+
+    // One impression a minute for 5 minutes.
+    for (unsigned i = 0; i < 5; ++i)
+        sketch.recordImpression(u0, account, start.plusSeconds(i * 60.0));
+
+    Date now = start.plusSeconds(4 * 60.0);
+    BOOST_CHECK_EQUAL(sketch.estimate(u0, account, 60.0, false, now), 1);
+    BOOST_CHECK_EQUAL(sketch.estimate(u0, account, 180.0, false, now), 3);
+    BOOST_CHECK_EQUAL(sketch.estimate(u0, account, 600.0, false, now), 5);
+
+    // Windows longer than the slots are cut down to them.
+    BOOST_CHECK_EQUAL(sketch.estimate(u0, account, 6000.0, false, now), 5);
+
+    // The slots are recycled once they fall out of the window.
+    now = start.plusSeconds(12 * 60.0);
+    BOOST_CHECK_EQUAL(sketch.estimate(u0, account, 600.0, false, now), 2);
+    sketch.recordImpression(u0, account, now);
+    BOOST_CHECK_EQUAL(sketch.estimate(u0, account, 600.0, false, now), 3);
+
+    // Too late for the sketch, whose slot was recycled.
+    sketch.recordImpression(u0, account, start.plusSeconds(2 * 60.0));
+    BOOST_CHECK_EQUAL(sketch.estimate(u0, account, 600.0, false, now), 3);
+}
+
+BOOST_AUTO_TEST_CASE( sketch_exact )
+{
+    FrequencyCapSketch::Params params;
+    params.epsilon = 0.5;   // Collides all the time
+    params.delta = 0.5;
+    params.numShards = 1;
+    params.exactThreshold = 2;
+    FrequencyCapSketch sketch(params);
+
+    BOOST_CHECK(sketch.needsExact(1));
+    BOOST_CHECK(sketch.needsExact(2));
+    BOOST_CHECK(!sketch.needsExact(3));
+
+    AccountKey exact("exact"), other("other");
+    sketch.setExactAccounts({ exact });
+
+    Date now = Date::fromSecondsSinceEpoch(1e9);
+    for (unsigned i = 0; i < 100; ++i) {
+        sketch.recordImpression(user(i), exact, now.plusSeconds(-10.0));
+        sketch.recordImpression(user(i), other, now.plusSeconds(-10.0));
+    }
+    sketch.recordImpression(user(0), exact, now);
+
+    // The sketch is way off but the exact counts aren't.
+    BOOST_CHECK_GT(sketch.estimate(user(1), exact, 60.0, false, now), 1);
+    BOOST_CHECK_EQUAL(sketch.estimate(user(1), exact, 60.0, true, now), 1);
+    BOOST_CHECK_EQUAL(sketch.estimate(user(0), exact, 60.0, true, now), 2);
+    BOOST_CHECK_EQUAL(sketch.estimate(user(0), exact, 5.0, true, now), 1);
+    BOOST_CHECK_EQUAL(sketch.estimate(user(1), other, 60.0, true, now), 0);
+
+    // Only the last exactThreshold impressions are kept.
+    sketch.recordImpression(user(0), exact, now);
+    BOOST_CHECK_EQUAL(sketch.estimate(user(0), exact, 60.0, true, now), 2);
+
+    sketch.expire(now.plusSeconds(params.slotSeconds * params.numSlots + 1));
+    BOOST_CHECK_EQUAL(sketch.estimate(user(0), exact, 1e9, true, now), 0);
+}
+
+BOOST_AUTO_TEST_CASE( frequencyCapFilter )
+{
+    FrequencyCapSketch::Params params;
+    params.exactThreshold = 1;
+    auto sketch = make_shared<FrequencyCapSketch>(params);
+
+    // Without a sketch the filter does nothing.
+    {
+        FrequencyCapFilter filter;
+        ConfigSet mask;
+
+        AgentConfig c0;
+        c0.account = AccountKey("a0");
+        c0.frequencyCap.maxImpressions = 1;
+
+        addConfig(filter, 0, c0); mask.set(0);
+
+        BidRequest r0; r0.userIds = user(0);
+        check(filter, r0, "ex1", mask, { 0 });
+    }
+
+    FrequencyCapFilter::setSketch(sketch);
+
+    FrequencyCapFilter filter;
+    ConfigSet mask;
+
+    auto doCheck = [&] (
+            BidRequest& request,
+            const initializer_list<size_t>& expected)
+    {
+        check(filter, request, "ex1", mask, expected);
+    };
+
+    AgentConfig c0;
+    c0.account = AccountKey("a0");
+
+    AgentConfig c1;
+    c1.account = AccountKey("a1");
+    c1.frequencyCap.maxImpressions = 1;
+
+    AgentConfig c2;
+    c2.account = AccountKey("a2");
+    c2.frequencyCap.maxImpressions = 3;
+    c2.frequencyCap.windowSeconds = 3600.0;
+
+    sketch->setExactAccounts({ c1.account });
+
+    BidRequest r0; r0.userIds = user(0);
+    BidRequest r1; r1.userIds = user(1);
+    BidRequest r2;
+
+    title("frequencyCap-1");
+    addConfig(filter, 0, c0); mask.set(0);
+    addConfig(filter, 1, c1); mask.set(1);
+    addConfig(filter, 2, c2); mask.set(2);
+
+    doCheck(r0, { 0, 1, 2 });
+    doCheck(r1, { 0, 1, 2 });
+    doCheck(r2, { 0, 1, 2 });
+
+    title("frequencyCap-2");
+    for (const auto& account : { c0.account, c1.account, c2.account })
+        sketch->recordImpression(r0.userIds, account);
+
+    doCheck(r0, { 0, 2 });
+    doCheck(r1, { 0, 1, 2 });
+    doCheck(r2, { 0, 1, 2 });
+
+    title("frequencyCap-3");
+    sketch->recordImpression(r0.userIds, c2.account);
+    sketch->recordImpression(r0.userIds, c2.account);
+
+    doCheck(r0, { 0 });
+    doCheck(r1, { 0, 1, 2 });
+
+    title("frequencyCap-4");
+    removeConfig(filter, 1, c1); mask.reset(1);
+    removeConfig(filter, 2, c2); mask.reset(2);
+
+    doCheck(r0, { 0 });
+    doCheck(r1, { 0 });
+
+    FrequencyCapFilter::setSketch(nullptr);
+}
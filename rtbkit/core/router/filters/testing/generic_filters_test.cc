@@ -172,6 +172,17 @@ BOOST_AUTO_TEST_CASE(domainFilterTest)
     check(filter.filter(Url("blooh.org")),       { });
     check(filter.filter(Url("bob.org")),         { });
     check(filter.filter(Url("random.net")),      { });
+
+    title("domain-4");
+    filter.addConfig(3, makeList<string>({ "a.site.google.com", "org" }));
+    DomainFilter<std::string> copy = filter;
+    filter.removeConfig(3, makeList<string>({ "org" }));
+
+    check(copy.filter(Url("b.a.site.google.com")), { 1, 3 });
+    check(copy.filter(Url("site.google.com")),     { 1 });
+    check(copy.filter(Url("bob.org")),             { 3 });
+    check(copy.filter(Url("googlecom")),           { });
+    check(filter.filter(Url("bob.org")),           { });
 }
 
 BOOST_AUTO_TEST_CASE(regexFilterTest)
@@ -219,6 +230,51 @@ BOOST_AUTO_TEST_CASE(regexFilterTest)
     check(filter.filter("d"),   { });
 }
 
+BOOST_AUTO_TEST_CASE(literalMatcherTest)
+{
+    BOOST_CHECK_EQUAL(requiredLiteral("abc"), "abc");
+    BOOST_CHECK_EQUAL(requiredLiteral("^ab+"), "ab");
+    BOOST_CHECK_EQUAL(requiredLiteral("abc?d"), "ab");
+    BOOST_CHECK_EQUAL(requiredLiteral("a{2}bcd"), "bcd");
+    BOOST_CHECK_EQUAL(requiredLiteral("x(a|b)yz"), "yz");
+    BOOST_CHECK_EQUAL(requiredLiteral("[abc]+foo.*bar"), "foo");
+    BOOST_CHECK_EQUAL(requiredLiteral("\\dfoo\\d"), "foo");
+    BOOST_CHECK_EQUAL(requiredLiteral("www\\.google\\.com"), "www.google.com");
+    BOOST_CHECK_EQUAL(requiredLiteral("a|b"), "");
+    BOOST_CHECK_EQUAL(requiredLiteral("(?i)google"), "");
+    BOOST_CHECK_EQUAL(
+            requiredLiteral(boost::regex("google", boost::regex::icase)), "");
+
+    LiteralMatcher matcher;
+    BOOST_CHECK(matcher.empty());
+
+    matcher.build({ "he", "she", "his", "hers", "", "s" });
+    check(matcher.match("ushers"), { 0, 1, 3, 5 });
+    check(matcher.match("this"),   { 2, 5 });
+    check(matcher.match("xyz"),    { });
+}
+
+BOOST_AUTO_TEST_CASE(regexFilterCopyTest)
+{
+    using boost::regex;
+    RegexFilter<regex, string> filter;
+
+    filter.addConfig(0, makeList({ regex("foo.*bar"), regex("a|b") }));
+    filter.addConfig(1, makeList({ regex("ba+r") }));
+
+    // The literal index points into the filter's data so make sure it
+    // survives a copy.
+    RegexFilter<regex, string> copy(filter);
+    filter.removeConfig(1, makeList({ regex("ba+r") }));
+
+    check(copy.filter("foo-bar"), { 0, 1 });
+    check(copy.filter("baaar"),   { 0, 1 });
+    check(copy.filter("xyz"),     { });
+
+    check(filter.filter("foo-bar"), { 0 });
+    check(filter.filter("baaar"),   { 0 });
+}
+
 BOOST_AUTO_TEST_CASE(segmentListTest)
 {
     SegmentListFilter filter;
@@ -0,0 +1,153 @@
+/** lat_long_filter_bench.cc                                 -*- C++ -*-
+    FreeBSD-style copyright and disclaimer apply
+
+    Compares the grid index of LatLongDevFilter with a linear scan over every
+    square of every config for a large number of hyperlocal geofences
+    clustered over a metropolitan area.
+
+*/
+
+#include "rtbkit/core/router/filters/static_filters.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include "rtbkit/common/bid_request.h"
+#include "jml/arch/timers.h"
+#include "jml/utils/smart_ptr_utils.h"
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+/******************************************************************************/
+/* CONFIG                                                                     */
+/******************************************************************************/
+
+struct Config
+{
+    Config() :
+        configs(1000), fences(10), radius(2.0), requests(100000)
+    {}
+
+    size_t configs;     // number of agent configs
+    size_t fences;      // geofences per agent config
+    double radius;      // maximum radius of a geofence in kms
+    size_t requests;    // number of bid requests to filter
+};
+
+Config getConfig(int argc, char** argv)
+{
+    using namespace boost::program_options;
+
+    Config config;
+
+    options_description opt;
+    opt.add_options()
+        ("configs,c", value<size_t>(&config.configs))
+        ("fences,f", value<size_t>(&config.fences))
+        ("radius,r", value<double>(&config.radius))
+        ("requests,n", value<size_t>(&config.requests))
+        ("help,h","print this message");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(opt).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << opt << endl;
+        exit(1);
+    }
+
+    return config;
+}
+
+
+/******************************************************************************/
+/* BENCH                                                                      */
+/******************************************************************************/
+
+template<typename Fn>
+void bench(const string& name, const vector<BidRequest>& requests, Fn&& fn)
+{
+    size_t matches = 0;
+
+    Timer timer;
+
+    for (const BidRequest& br : requests)
+        matches += fn(br);
+
+    double elapsed = timer.elapsed_wall();
+
+    cerr << name << ":" << endl
+         << "    requests=" << requests.size() << " matches=" << matches << endl
+         << "    elapsed=" << elapsed << "s ("
+         << (elapsed / requests.size() * 1000000000.0) << "ns/request)" << endl;
+}
+
+
+/******************************************************************************/
+/* MAIN                                                                       */
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    Config config = getConfig(argc, argv);
+
+    mt19937 rng(0);
+    uniform_real_distribution<float> latDist(40.5, 41.0);
+    uniform_real_distribution<float> lonDist(-74.3, -73.7);
+    uniform_real_distribution<float> radiusDist(0.1, config.radius);
+
+    LatLongDevFilter filter;
+    vector<AgentConfig> configs(config.configs);
+    ConfigSet mask;
+
+    for (size_t i = 0; i < configs.size(); ++i) {
+        for (size_t j = 0; j < config.fences; ++j) {
+            configs[i].latLongDevFilter.latlonrads.emplace_back(
+                    latDist(rng), lonDist(rng), radiusDist(rng));
+        }
+        filter.addConfig(i, make_unowned_sp(configs[i]));
+        mask.set(i);
+    }
+
+    vector<BidRequest> requests(config.requests);
+    for (BidRequest& br : requests) {
+        br.exchange = "exch0";
+        br.imp.emplace_back();
+        br.device.emplace();
+        br.device->geo.emplace();
+        br.device->geo->lat.val = latDist(rng);
+        br.device->geo->lon.val = lonDist(rng);
+    }
+
+    cerr << "geofences=" << (config.configs * config.fences) << endl;
+
+    CreativeMatrix activeConfigs;
+    for (size_t i = mask.next(); i < mask.size(); i = mask.next(i + 1))
+        activeConfigs.setConfig(i, 1);
+
+    bench("linear", requests, [&] (const BidRequest& br) {
+                const auto& geo = *br.device->geo;
+                size_t matches = 0;
+
+                for (const auto& entry : filter.squares_by_confindx) {
+                    matches += LatLongDevFilter::pointInsideAnySquare(
+                            geo.lat.val, geo.lon.val, entry.second);
+                }
+                return matches;
+            });
+
+    bench("grid", requests, [&] (const BidRequest& br) {
+                // The filter doesn't look at the exchange.
+                FilterState state(br, nullptr, activeConfigs);
+                filter.filter(state);
+                return state.configs().count();
+            });
+}
@@ -23,6 +23,7 @@
 #include "jml/utils/vector_utils.h"
 
 #include <boost/test/unit_test.hpp>
+#include <random>
 
 using namespace std;
 using namespace ML;
@@ -224,6 +225,21 @@ BOOST_AUTO_TEST_CASE( segmentFilter_filter_reasons )
     exp["seg1"].push_back(0);
     exp["seg2"].push_back(1);
     checkReasons(exp, r2, mask);
+
+    title("SegmentFilter-reasons-unsampled");
+    {
+        FilterExchangeConnector conn("conn");
+        CreativeMatrix activeConfigs;
+        for (size_t i = mask.next(); i < mask.size(); i = mask.next(i+1))
+            activeConfigs.setConfig(i, 1);
+
+        FilterState state(r2, &conn, activeConfigs);
+        state.setRecordReasons(false);
+        filter.filter(state);
+
+        BOOST_CHECK(state.getFilterReasons().empty());
+        BOOST_CHECK_EQUAL(state.configs().count(), 2);
+    }
 }
 
 
@@ -481,11 +497,39 @@ BOOST_AUTO_TEST_CASE( exchangeName )
 
     BidRequest req;
 
+    AgentConfig c1;
+    c1.exchangeFilter = ie<string>({ "adx" }, { "casale" });
+
     title("exchangeName-1");
     addConfig(filter, 0, c0); mask.set(0);
 
     doCheck(req, "appnexus", { 0 });
     doCheck(req, "adx", { });
+
+    // The masks are memoized per exchange so make sure that they're
+    // invalidated when the configs change.
+    title("exchangeName-2");
+    addConfig(filter, 1, c1); mask.set(1);
+
+    doCheck(req, "appnexus", { 0 });
+    doCheck(req, "adx", { 1 });
+    doCheck(req, "casale", { 0 });
+    doCheck(req, "adx", { 1 });
+
+    title("exchangeName-3");
+    removeConfig(filter, 0, c0); mask.reset(0);
+
+    doCheck(req, "appnexus", { });
+    doCheck(req, "adx", { 1 });
+    doCheck(req, "casale", { });
+
+    title("exchangeName-4");
+    FilterBase* clone = filter.clone();
+    addConfig(*clone, 0, c0); mask.set(0);
+
+    check(*clone, req, "appnexus", mask, { 0 });
+    check(filter, req, "appnexus", mask, { });
+    delete clone;
 }
 
 BOOST_AUTO_TEST_CASE( requiredIds )
@@ -697,4 +741,81 @@ BOOST_AUTO_TEST_CASE( LatLongDevFilterTest)
     doCheck(br8, { 2, 3});
     doCheck(br9, { 2, 3});
 
+    title("Latitude/Longitude Filter - 4");
+
+    // Too large to be indexed in the grid.
+    AgentConfig c4 = createConfAg({ p0 }, 5000.0);
+    addConfig(filt, 4, c4); mask.set(4);
+
+    doCheck(br0, { });
+    doCheck(br1, { 4 });
+    doCheck(br2, { 3, 4 });
+    doCheck(br4, { 4 });
+    doCheck(br7, { 2, 3, 4 });
+
+    removeConfig(filt, 4, c4); mask.reset(4);
+
+    doCheck(br1, { });
+    doCheck(br2, { 3 });
+}
+
+/** Compares the grid index with a linear scan over all the squares for lots
+    of small geofences clustered in the same area.
+ */
+BOOST_AUTO_TEST_CASE( LatLongDevFilterGridTest )
+{
+    enum { Configs = 200, Requests = 1000 };
+
+    LatLongDevFilter filt;
+    vector<AgentConfig> configs(Configs);
+    ConfigSet mask;
+
+    mt19937 rng(0);
+    uniform_real_distribution<float> latDist(37.0, 38.0);
+    uniform_real_distribution<float> lonDist(-78.0, -77.0);
+    uniform_real_distribution<float> radiusDist(0.5, 60.0);
+
+    for (size_t i = 0; i < Configs; ++i) {
+        for (size_t j = 0; j < 1 + i % 3; ++j) {
+            configs[i].latLongDevFilter.latlonrads.emplace_back(
+                    latDist(rng), lonDist(rng), radiusDist(rng));
+        }
+        addConfig(filt, i, configs[i]); mask.set(i);
+    }
+
+    // Exercise the removal path of the index.
+    for (size_t i = 0; i < Configs; i += 7) {
+        removeConfig(filt, i, configs[i]); mask.reset(i);
+    }
+
+    FilterExchangeConnector conn("exch0");
+
+    for (size_t i = 0; i < Requests; ++i) {
+        float lat = latDist(rng), lon = lonDist(rng);
+
+        BidRequest br;
+        br.exchange = "exch0";
+        br.imp.emplace_back();
+        br.device.emplace();
+        br.device->geo.emplace();
+        br.device->geo->lat.val = lat;
+        br.device->geo->lon.val = lon;
+
+        CreativeMatrix activeConfigs;
+        for (size_t cfg = mask.next(); cfg < mask.size(); cfg = mask.next(cfg + 1))
+            activeConfigs.setConfig(cfg, 1);
+
+        FilterState state(br, &conn, activeConfigs);
+        filt.filter(state);
+
+        ConfigSet expected;
+        for (const auto& entry : filt.squares_by_confindx) {
+            if (LatLongDevFilter::pointInsideAnySquare(lat, lon, entry.second))
+                expected.set(entry.first);
+        }
+
+        ConfigSet diff = state.configs() & mask;
+        diff ^= expected;
+        BOOST_CHECK(diff.empty());
+    }
 }
@@ -119,7 +119,8 @@ void check(
         BidRequest& request,
         const string exchangeName,
         const ConfigSet& mask,
-        const initializer_list<size_t>& exp)
+        const initializer_list<size_t>& exp,
+        const Auction::Augmentations* augmentations = nullptr)
 {
     FilterExchangeConnector conn(exchangeName);
 
@@ -138,7 +139,7 @@ void check(
     for (size_t i = mask.next(); i < mask.size(); i = mask.next(i+1))
         activeConfigs.setConfig(i, 1);
 
-    FilterState state(request, &conn, activeConfigs);
+    FilterState state(request, &conn, activeConfigs, augmentations);
 
     filter.filter(state);
     check(state.configs() & mask, exp);
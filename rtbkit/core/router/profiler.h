@@ -9,6 +9,7 @@
 #include "jml/arch/timers.h"
 #include "jml/arch/exception.h"
 #include "jml/arch/atomic_ops.h"
+#include "soa/service/scope_profiler.h"
 
 namespace RTBKIT {
 
@@ -43,22 +44,30 @@ inline int64_t microsecondsBetween(double after, double before)
 }
 
 
+/** Adds the microseconds spent in its scope to the duty cycle counter.
+    When given a scope name, the scope is also profiled under it by the
+    ScopeProfiler, so that the nested scopes show up as a tree.
+*/
 struct RouterProfiler {
 
-    RouterProfiler(uint64_t & counter)
-        : counter(counter)
+    RouterProfiler(uint64_t & counter, const char * scope = 0)
+        : counter(counter), scope(scope), startTicks(ML::ticks())
     {
-        startTime = getProfilingTime();
     }
 
     ~RouterProfiler()
     {
+        uint64_t ticks = ML::ticks();
+        // Not monotonic over all CPUs on some machines
+        if (ticks < startTicks) ticks = startTicks;
         ML::atomic_add(counter,
-                       microsecondsBetween(getProfilingTime(), startTime));
+                       uint64_t((ticks - startTicks)
+                                * ML::seconds_per_tick * 1000000));
     }
 
     uint64_t & counter;
-    double startTime;
+    Datacratic::ProfileScope scope;
+    uint64_t startTicks;
 };
 
 } // namespace RTBKIT
@@ -6,6 +6,8 @@
 */
 
 #include <atomic>
+#include <algorithm>
+#include <poll.h>
 #include "router.h"
 #include "soa/service/zmq_utils.h"
 #include "jml/arch/backtrace.h"
@@ -17,6 +19,7 @@
 #include "jml/utils/set_utils.h"
 #include "jml/utils/environment.h"
 #include "jml/arch/info.h"
+#include "jml/arch/rt.h"
 #include "jml/utils/lightweight_hash.h"
 #include "jml/math/xdiv.h"
 #include <boost/tuple/tuple.hpp>
@@ -34,6 +37,8 @@
 #include "rtbkit/common/win_cost_model.h"
 #include "rtbkit/common/bidder_interface.h"
 #include "rtbkit/common/analytics.h"
+#include "rtbkit/common/auction_trace.h"
+#include "jml/utils/worker_task.h"
 
 using namespace std;
 using namespace ML;
@@ -103,6 +108,125 @@ dumpSpot(Id spot) const
 }
 
 
+/*****************************************************************************/
+/* ROUTER SHARD                                                              */
+/*****************************************************************************/
+
+RouterShard::
+RouterShard(Router & router, unsigned index)
+    : router(router),
+      index(index),
+      startBiddingBuffer(65536),
+      doBidBuffer(65536),
+      wakeup(EFD_NONBLOCK),
+      shutdown_(false),
+      numInFlight_(0)
+{
+}
+
+RouterShard::
+~RouterShard()
+{
+    shutdown();
+}
+
+void
+RouterShard::
+start()
+{
+    ExcAssert(!thread);
+    shutdown_ = false;
+    thread.reset(new std::thread([=] ()
+        {
+            if (!ML::setCurrentThreadAffinity(cpuAffinity))
+                cerr << "couldn't set CPU affinity of router shard "
+                     << index << endl;
+            this->run();
+        }));
+}
+
+void
+RouterShard::
+shutdown()
+{
+    if (!thread) return;
+
+    shutdown_ = true;
+    wakeup.signal();
+    thread->join();
+    thread.reset();
+}
+
+void
+RouterShard::
+pushStartBidding(const std::shared_ptr<AugmentationInfo> & info)
+{
+    if (!startBiddingBuffer.tryPush(info)) {
+        router.recordHit("shards.%d.startBiddingOverflow", index);
+        info->auction->setError("router overloaded",
+                                "router shard can't keep up");
+        return;
+    }
+    wakeup.signal();
+}
+
+bool
+RouterShard::
+pushBid(BidMessage && message)
+{
+    if (!doBidBuffer.tryPush(std::move(message)))
+        return false;
+    wakeup.signal();
+    return true;
+}
+
+void
+RouterShard::
+run()
+{
+    pollfd item = { wakeup.fd(), POLLIN, 0 };
+
+    while (!shutdown_) {
+        // Same cadence as the main loop: process what's there, expire,
+        // then sleep for at most a millisecond waiting for more work.
+        int res = 0;
+        if (router.busyPollUs > 0) {
+            Date deadline
+                = Date::now().plusSeconds(router.busyPollUs * 0.000001);
+            do {
+                res = ::poll(&item, 1, 0);
+            } while (res == 0 && Date::now() < deadline);
+        }
+        if (res == 0)
+            res = ::poll(&item, 1, 1 /* milliseconds */);
+        if (res == -1 && errno != EINTR)
+            throw ML::Exception(errno, "router shard poll");
+
+        eventfd_t val;
+        while (wakeup.tryRead(val)) ;
+
+        std::shared_ptr<AugmentationInfo> info;
+        while (startBiddingBuffer.tryPop(info))
+            router.doStartBidding(info);
+
+        BidMessage message;
+        while (doBidBuffer.tryPop(message)) {
+            try {
+                router.doBidImpl(message);
+            } catch (const std::exception & exc) {
+                cerr << "shard " << index << ": error handling bid for "
+                     << message.auctionId << ": " << exc.what() << endl;
+                router.logRouterError("doBid", exc.what());
+            }
+        }
+
+        router.expireInFlight(inFlight, Date::nowCoarse());
+
+        numInFlight_ = inFlight.size();
+    }
+}
+
+
 /*****************************************************************************/
 /* ROUTER                                                                    */
 /*****************************************************************************/
@@ -135,6 +259,12 @@ Router(ServiceBase & parent,
       globalBidProbability(1.0),
       bidsErrorRate(0.0),
       budgetErrorRate(0.0),
+      statsSnapshotPeriod(1.0),
+      maxExpiriesPerPass(1000),
+      busyPollUs(0),
+      warmUpTimeout(0.0),
+      warmedUp(true),
+      eligibilitySummaries(false),
       connectPostAuctionLoop(connectPostAuctionLoop),
       enableBidProbability(enableBidProbability),
       allAgents(new AllAgentInfo()),
@@ -155,7 +285,8 @@ Router(ServiceBase & parent,
       monitorProviderClient(getZmqContext()),
       maxBidAmount(maxBidAmount),
       slowModeTolerance(MonitorClient::DefaultTolerance),
-      augmentationWindow(augmentationWindow)
+      augmentationWindow(augmentationWindow),
+      localMonitor(nullptr)
 {
     monitorProviderClient.addProvider(this);
 }
@@ -188,6 +319,12 @@ Router(std::shared_ptr<ServiceProxies> services,
       globalBidProbability(1.0),
       bidsErrorRate(0.0),
       budgetErrorRate(0.0),
+      statsSnapshotPeriod(1.0),
+      maxExpiriesPerPass(1000),
+      busyPollUs(0),
+      warmUpTimeout(0.0),
+      warmedUp(true),
+      eligibilitySummaries(false),
       connectPostAuctionLoop(connectPostAuctionLoop),
       enableBidProbability(enableBidProbability),
       allAgents(new AllAgentInfo()),
@@ -208,7 +345,8 @@ Router(std::shared_ptr<ServiceProxies> services,
       monitorProviderClient(getZmqContext()),
       maxBidAmount(maxBidAmount),
       slowModeTolerance(MonitorClient::DefaultTolerance),
-      augmentationWindow(augmentationWindow)
+      augmentationWindow(augmentationWindow),
+      localMonitor(nullptr)
 
 {
     monitorProviderClient.addProvider(this);
@@ -303,6 +441,21 @@ initFilters(const Json::Value & config) {
                     throw Exception("Filter-activate must be an array");
                 }
             }
+            else if (field == "adaptive-ordering") {
+                const Json::Value & adaptive = config[field];
+                if (adaptive.isBool())
+                    filters.setAdaptiveOrdering(adaptive.asBool());
+                else if (adaptive.isObject())
+                    filters.setAdaptiveOrdering(
+                            adaptive.get("enabled", true).asBool(),
+                            adaptive.get("period", 1000).asUInt());
+                else throw Exception("adaptive-ordering must be a bool or an object");
+            }
+            else if (field == "reasons-sampling") {
+                if (!config[field].isIntegral())
+                    throw Exception("reasons-sampling must be an integer");
+                filters.setReasonsSampling(config[field].asUInt());
+            }
             else
                 throw Exception("Unknown field " + field + " in filter config file");
         }
@@ -360,6 +513,7 @@ initAnalytics(const Json::Value & config)
 
     Analytics::Factory factory = PluginInterface<Analytics>::getPlugin(pluginName);
     analytics.reset(factory(serviceName(), getServices()));
+    analytics->configure(config);
 }
 
 void
@@ -410,11 +564,51 @@ init()
             submitToPostAuctionService(auction, adSpotId, response);
         };
 
-    monitorClient.init(getServices()->config);
-    monitorProviderClient.init(getServices()->config);
+    if (localMonitor) {
+        monitorClient.initLocal(localMonitor);
+        monitorProviderClient.initLocal(localMonitor);
+    }
+    else {
+        monitorClient.init(getServices()->config);
+        monitorProviderClient.init(getServices()->config);
+    }
+
+    if (frequencyCaps) {
+        frequencyCapWins->init(getServices()->config);
+
+        // See ZmqAnalytics::logMatchedWinLoss for the fields.
+        frequencyCapWins->messageHandler
+            = [=] (const vector<zmq::message_t> & msg)
+            {
+                if (msg.size() < 20) {
+                    recordHit("frequencyCap.invalidWin");
+                    return;
+                }
+
+                AccountKey account(msg[19].toString());
+                UserIds uids = UserIds::createFromString(msg[15].toString());
+                frequencyCaps->recordImpression(uids, account);
+                recordHit("frequencyCap.wins");
+            };
+
+        frequencyCapWins->connectAllServiceProviders(
+                "rtbPostAuctionService", "logger", { "MATCHEDWIN" });
+
+        double period = std::min(frequencyCaps->params().slotSeconds, 60.0);
+        frequencyCapWins->addPeriodic(
+                "Router::frequencyCapExpiry", period,
+                [=] (uint64_t)
+                {
+                    frequencyCaps->expire();
+                    recordLevel(frequencyCaps->memoryBytes() / 1000000.0,
+                                "frequencyCap.memoryMB");
+                });
+    }
 
     loopMonitor.init();
     loopMonitor.addMessageLoop("augmentationLoop", &augmentationLoop);
+    if (frequencyCapWins)
+        loopMonitor.addMessageLoop("frequencyCapWins", frequencyCapWins.get());
     loopMonitor.addMessageLoop("configListener", &configListener);
     loopMonitor.addMessageLoop("monitorClient", &monitorClient);
     loopMonitor.addMessageLoop("monitorProviderClient", &monitorProviderClient);
@@ -513,6 +707,105 @@ unsafeDisableAuctionProbability()
     disableAuctionProb = true;
 }
 
+void
+Router::
+setNumShards(unsigned numShards)
+{
+    ExcAssert(!initialized);
+
+    shards.clear();
+    for (unsigned i = 0;  i < numShards;  ++i)
+        shards.emplace_back(new RouterShard(*this, i));
+}
+
+void
+Router::
+enableFrequencyCapping(const FrequencyCapSketch::Params & params)
+{
+    ExcAssert(!initialized);
+
+    frequencyCaps = std::make_shared<FrequencyCapSketch>(params);
+    FrequencyCapFilter::setSketch(frequencyCaps);
+
+    frequencyCapWins.reset(new ZmqNamedMultipleSubscriber(getZmqContext()));
+
+    cerr << "frequency capping with a sketch of "
+         << frequencyCaps->memoryBytes() / 1000000 << "MB" << endl;
+}
+
+void
+Router::
+updateExactFrequencyCaps()
+{
+    if (!frequencyCaps) return;
+
+    vector<AccountKey> exact;
+    for (const auto & agent : agents) {
+        const auto & config = agent.second.config;
+        if (!config || !config->frequencyCap.enabled()) continue;
+        if (frequencyCaps->needsExact(config->frequencyCap.maxImpressions))
+            exact.push_back(config->account);
+    }
+
+    frequencyCaps->setExactAccounts(exact);
+}
+
+void
+Router::
+enableEligibilitySummaries(bool enable)
+{
+    eligibilitySummaries = enable;
+}
+
+void
+Router::
+updateEligibility()
+{
+    if (!eligibilitySummaries) return;
+
+    forAllExchanges([&] (const std::shared_ptr<ExchangeConnector> & exchange) {
+        auto name = exchange->exchangeName();
+        auto summary = std::make_shared<EligibilitySummary>();
+
+        for (const auto & agent : agents) {
+            const auto & config = agent.second.config;
+            if (!config || !config->exchangeFilter.isIncluded(name)) continue;
+
+            {
+                std::lock_guard<ML::Spinlock> guard(config->lock);
+                if (!config->providerData.count(name)) continue;
+            }
+
+            vector<Format> formats;
+            for (const auto & creative : config->creatives) {
+                std::lock_guard<ML::Spinlock> guard(creative.lock);
+                if (creative.providerData.count(name))
+                    formats.push_back(creative.format);
+            }
+
+            summary->addAgent(config->hourOfWeekFilter.hourBitmap, formats);
+        }
+
+        exchange->setEligibility(summary);
+    });
+}
+
+void
+Router::
+setThreadAffinity(const std::string & role, const std::vector<int> & cpus)
+{
+    if (runThread)
+        throw ML::Exception("setThreadAffinity must be called before start");
+
+    if (role == "router")
+        routerAffinity = cpus;
+    else if (role == "shards")
+        shardAffinity = cpus;
+    else if (role == "augmentation")
+        augmentationLoop.setThreadAffinity(cpus);
+    else throw ML::Exception("unknown router thread role '%s'", role.c_str());
+}
+
 void
 Router::
 start(boost::function<void ()> onStop)
@@ -540,7 +833,13 @@ start(boost::function<void ()> onStop)
     if (analytics) analytics->start();
     analyticsPublisher.start();
     augmentationLoop.start();
+    for (auto & shard : shards) {
+        shard->cpuAffinity = shardAffinity;
+        shard->start();
+    }
     runThread.reset(new boost::thread(runfn));
+    if (!ML::setThreadAffinity(*runThread, routerAffinity))
+        cerr << "couldn't set CPU affinity of the router loop" << endl;
 
     if (connectPostAuctionLoop) {
         postAuctionEndpoint.init();
@@ -549,12 +848,19 @@ start(boost::function<void ()> onStop)
     configListener.init(getServices()->config);
     configListener.start();
 
+    if (frequencyCapWins) frequencyCapWins->start();
+
     /* This is an extra thread which sits there deleting auctions
        to take this out of the hands of the main loop (it can easily use
-       up nearly 20% of the capacity of the main loop).
+       up nearly 20% of the capacity of the main loop).  It also runs
+       the deferred frees of the agent configurations, so that the
+       threads bidding never do.
     */
+    allAgentsGc.offloadReclamation();
+
     auto auctionDeleter = [=] ()
         {
+            Date lastGauge = Date::now();
             while (!this->shutdown_) {
                 std::shared_ptr<Auction> toDelete;
                 auctionGraveyard.tryPop(toDelete, 0.05);
@@ -563,6 +869,17 @@ start(boost::function<void ()> onStop)
                     ++numDeleted;
                 //cerr << "deleted " << numDeleted << " auctions"
                 //     << endl;
+                this->allAgentsGc.reclaim();
+
+                Date now = Date::now();
+                if (now.secondsSince(lastGauge) >= 1.0) {
+                    auto stats = this->allAgentsGc.deferStats();
+                    this->recordLevel(stats.numPending,
+                                      "gc.allAgents.pendingDefers");
+                    this->recordLevel(stats.bytes,
+                                      "gc.allAgents.pendingDeferBytes");
+                    lastGauge = now;
+                }
                 ML::sleep(0.001);
             }
         };
@@ -582,7 +899,7 @@ numNonIdle() const
     size_t numInFlight, numAwaitingAugmentation;
     {
         Guard guard(lock);
-        numInFlight = inFlight.size();
+        numInFlight = this->numInFlight();
         numAwaitingAugmentation = augmentationLoop.numAugmenting();
     }
 
@@ -617,6 +934,84 @@ issueTimestamp()
          << endl;
 }
 
+void
+Router::
+updateThrottles()
+{
+    Guard guard(agentsLock);
+
+    for (auto & agent: agents) {
+        AgentInfo & info = agent.second;
+        if (!info.config) continue;
+
+        double probability = 1.0;
+        if (info.config->throttle.enabled) {
+            probability = info.throttle.update(*info.config,
+                                               info.numBidsInFlight());
+            recordLevel(probability, "accounts.%s.throttleProbability",
+                        info.config->account.toString('.'));
+        }
+
+        info.status->throttleProbability = probability;
+    }
+}
+
+void
+Router::
+setWarmUpRequests(const std::string & format,
+                  std::vector<std::string> requests,
+                  double timeout)
+{
+    if (runThread)
+        throw ML::Exception("warm-up requests must be set before start");
+
+    warmUpFormat = format;
+    warmUpRequests = std::move(requests);
+    warmUpTimeout = timeout;
+    warmedUp = warmUpRequests.empty();
+}
+
+void
+Router::
+warmUp()
+{
+    using namespace std;
+
+    vector<std::shared_ptr<BidRequest> > requests(warmUpRequests.size());
+    std::atomic<size_t> numParseErrors(0);
+
+    // Parsing doesn't touch any of the router's state
+    ML::run_in_parallel(0, requests.size(), [&] (int i)
+        {
+            try {
+                requests[i].reset(BidRequest::parse(warmUpFormat,
+                                                    warmUpRequests[i]));
+            } catch (const std::exception & exc) {
+                ++numParseErrors;
+            }
+        });
+
+    // The filters run on the router loop as they would for an auction
+    size_t numBidders = 0;
+    for (auto & request: requests) {
+        if (!request) continue;
+        try {
+            numBidders += filters.filter(*request, nullptr).size();
+        } catch (const std::exception & exc) {
+            cerr << "error filtering warm-up request: " << exc.what() << endl;
+        }
+    }
+
+    cerr << "router warmed up with " << requests.size() << " requests ("
+         << numParseErrors << " unparseable) and " << allAgents->size()
+         << " agents; " << numBidders << " potential bidders" << endl;
+
+    recordLevel(numParseErrors, "warmUp.parseErrors");
+
+    vector<string>().swap(warmUpRequests);
+    warmedUp = true;
+}
+
 void
 Router::
 run()
@@ -629,7 +1024,8 @@ run()
     };
 
     double last_check = ML::wall_time(), last_check_pace = last_check,
-        lastPings = last_check;
+        lastPings = last_check, lastStats = 0.0, started = last_check,
+        lastThrottles = last_check;
 
     //cerr << "server listening" << endl;
 
@@ -704,7 +1100,19 @@ run()
                 recordTime("checkExpiredAuctions", atStart);
             }
 
-            {
+            if (busyPollUs > 0) {
+                double atStart = getTime();
+
+                // Keep polling rather than sleeping so that what comes in
+                // is picked up straight away.
+                Date deadline = Date::now().plusSeconds(busyPollUs * 0.000001);
+                do {
+                    rc = zmq_poll(items, 2, 0);
+                } while (rc == 0 && Date::now() < deadline);
+
+                recordTime("busyPoll", atStart);
+            }
+            else {
                 double atStart = getTime();
 
                 // Try to sleep only once per 1/2 a millisecond to avoid too
@@ -720,9 +1128,11 @@ run()
                 recordTime("sleep", atStart);
             }
 
-            double pollStart = getTime();
-            rc = zmq_poll(items, 2, 50 /* milliseconds */);
-            recordTime("sleepPoll", pollStart);
+            if (rc == 0) {
+                double pollStart = getTime();
+                rc = zmq_poll(items, 2, 50 /* milliseconds */);
+                recordTime("sleepPoll", pollStart);
+            }
         }
 
         afterSleep = getTime();
@@ -755,17 +1165,25 @@ run()
             recordTime("doBid", atStart);
         }
 
+        // Everything from here on touches the agents, which are shared
+        // with the shards.
+        Guard agentsGuard(agentsLock);
+
         {
             double atStart = getTime();
 
+            bool newExchanges = false;
             std::shared_ptr<ExchangeConnector> exchange;
             while (exchangeBuffer.tryPop(exchange)) {
+                compatibility.removeExchange(exchange->exchangeName());
                 for (auto & agent : agents) {
                     configureAgentOnExchange(exchange,
                                              agent.first,
                                              *agent.second.config);
                 };
+                newExchanges = true;
             }
+            if (newExchanges) updateEligibility();
 
             recordTime("configureAgentOnExchange", atStart);
         }
@@ -773,11 +1191,17 @@ run()
         {
             double atStart = getTime();
 
+            // Configs tend to arrive in bursts (eg. after a deploy) so batch
+            // them up to avoid copying the filter pool for each of them.
+            FilterPool::ConfigUpdates updates;
+
             std::pair<std::string, std::shared_ptr<const AgentConfig> > config;
             while (configBuffer.tryPop(config)) {
-                doConfig(config.first, config.second);
+                doConfig(config.first, config.second, updates);
             }
 
+            if (!updates.empty()) applyConfigUpdates(updates);
+
             recordTime("doConfig", atStart);
         }
 
@@ -828,6 +1252,29 @@ run()
             recordTime("sendPings", atStart);
         }
 
+        // The listener publishes the initial burst of configs together, so
+        // the first agents we see are all of them.
+        if (!warmedUp && (!allAgents->empty() || now - started > warmUpTimeout)) {
+            double atStart = getTime();
+            warmUp();
+            recordTime("warmUp", atStart);
+        }
+
+        if (now - lastThrottles > 0.25) {
+            double atStart = getTime();
+            updateThrottles();
+            lastThrottles = now;
+            recordTime("updateThrottles", atStart);
+        }
+
+        if (now - lastStats > statsSnapshotPeriod) {
+            double atStart = getTime();
+            AuctionTrace::flush();
+            publishStats();
+            lastStats = now;
+            recordTime("publishStats", atStart);
+        }
+
         double beforeChecks = getTime();
 
         if (now - last_check_pace > 10.0) {
@@ -841,6 +1288,7 @@ run()
 
         if (now - last_check > 10.0) {
             logUsageMetrics(10.0);
+            ScopeProfiler::record(*this);
             if (analytics) analytics->logUsageMessage(*this, 10.0);
             if (analytics) analytics->logMarkMessage(*this,last_check);
             dutyCycleCurrent.ending = Date::now();
@@ -852,6 +1300,7 @@ run()
                                        dutyCycleHistory.end() - 100);
 
             checkDeadAgents();
+            recordHugePageStats();
 
             double total = 0.0;
             for (auto it = times.begin(); it != times.end();  ++it)
@@ -906,6 +1355,7 @@ shutdown()
     loopMonitor.shutdown();
 
     configListener.shutdown();
+    if (frequencyCapWins) frequencyCapWins->shutdown();
 
     shutdown_ = true;
     futex_wake(shutdown_);
@@ -916,9 +1366,12 @@ shutdown()
     if (runThread)
         runThread->join();
     runThread.reset();
+    for (auto & shard : shards)
+        shard->shutdown();
     if (cleanupThread)
         cleanupThread->join();
     cleanupThread.reset();
+    allAgentsGc.reclaim();
 
     if (analytics) analytics->shutdown();
     banker.reset();
@@ -942,6 +1395,17 @@ injectAuction(std::shared_ptr<Auction> auction, double lossTime)
     }
 
     auction->lossAssumed = getCurrentTime().plusSeconds(lossTime);
+
+    if (duplicateAuctions.enabled()) {
+        const string & exchange = auction->request->exchange;
+        uint64_t key = DuplicateAuctions::key(auction->id, exchange);
+        if (duplicateAuctions.isDuplicate(key)) {
+            recordHit("exchange.%s.duplicateAuctions", exchange.c_str());
+            auction->finish();
+            return;
+        }
+    }
+
     onNewAuction(auction);
 }
 
@@ -994,6 +1458,45 @@ numAuctionsInProgress() const
     return -1;//inFlight.size();
 }
 
+size_t
+Router::
+numInFlight() const
+{
+    if (shards.empty()) return inFlight.size();
+
+    size_t result = 0;
+    for (auto & shard : shards)
+        result += shard->numInFlight();
+    return result;
+}
+
+void
+Router::
+pushStartBidding(const std::shared_ptr<AugmentationInfo> & info)
+{
+    if (shards.empty()) {
+        startBiddingBuffer.push(info);
+        wakeupMainLoop.signal();
+        return;
+    }
+
+    shards[shardIndex(info->auction->id)]->pushStartBidding(info);
+}
+
+bool
+Router::
+pushBid(BidMessage && message)
+{
+    if (shards.empty()) {
+        if (!doBidBuffer.tryPush(std::move(message)))
+            return false;
+        wakeupMainLoop.signal();
+        return true;
+    }
+
+    return shards[shardIndex(message.auctionId)]->pushBid(std::move(message));
+}
+
 void
 Router::
 handleAgentMessage(const std::vector<std::string> & message)
@@ -1167,7 +1670,10 @@ checkDeadAgents()
 
                     this->recordHit("accounts.%s.lostBids", account);
 
-                    bidder->sendBidLostMessage(info.config, it->first, inFlight[id].auction);
+                    // When sharded the auction belongs to another thread;
+                    // its own expiry will already have notified the agent.
+                    if (shards.empty())
+                        bidder->sendBidLostMessage(info.config, it->first, inFlight[id].auction);
 
                     toExpire.push_back(id);
                 }
@@ -1223,14 +1729,22 @@ checkDeadAgents()
         }
     }
 
+    FilterPool::ConfigUpdates updates;
+
     for (auto it = deadAgents.begin(), end = deadAgents.end();
          it != end;  ++it) {
         cerr << "WARNING: dead agent doesn't clean up its state properly"
              << endl;
         // TODO: undo all bids in progress
-        filters.removeConfig((*it)->first);
+        updates.remove((*it)->first);
+        compatibility.release((*it)->first);
         agents.erase(*it);
     }
+    compatibility.sweep();
+
+    filters.updateConfigs(updates);
+    updateExactFrequencyCaps();
+    updateEligibility();
 
     if (!deadAgents.empty())
         // Broadcast that we have different agents
@@ -1246,10 +1760,38 @@ checkExpiredAuctions()
 {
     //recentlySubmitted.clear();
 
+    Date start = Date::nowCoarse();
+
+    // When sharded, each shard expires its own auctions
+    if (shards.empty())
+        expireInFlight(inFlight, start);
+
+    {
+        RouterProfiler profiler(dutyCycleCurrent.nsExpireBlacklist, "expireBlacklist");
+        Guard guard(agentsLock);
+        blacklist.doExpiries();
+    }
+
+    if (doDebug) {
+        RouterProfiler profiler(dutyCycleCurrent.nsExpireDebug, "expireDebug");
+        expireDebugInfo();
+    }
+}
+
+size_t
+Router::
+expireInFlight(InFlight & inFlight, Date now)
+{
+    if (!inFlight.hasExpired(now)) return 0;
+
+    size_t numExpired;
     Date start = Date::now();
 
     {
-        RouterProfiler profiler(dutyCycleCurrent.nsExpireInFlight);
+        RouterProfiler profiler(dutyCycleCurrent.nsExpireInFlight, "expireInFlight");
+
+        // One lock for the whole batch, which is bounded anyway
+        Guard guard(this->agentsLock);
 
         // Look for in flight timeout expiries
         auto onExpiredInFlight = [&] (const Id & auctionId,
@@ -1267,6 +1809,7 @@ checkExpiredAuctions()
                     if (agents[agent].expireBidInFlight(auctionId)) {
                         AgentInfo & info = this->agents[agent];
                         ++info.stats->tooLate;
+                        info.throttle.recordTimeout();
 
                         this->recordHit("accounts.%s.EXPIRED",
                                         info.config->account.toString('.'));
@@ -1302,18 +1845,16 @@ checkExpiredAuctions()
                 return Date();
             };
 
-        inFlight.expire(onExpiredInFlight, start);
+        numExpired = inFlight.expire(onExpiredInFlight, now, maxExpiriesPerPass);
     }
 
-    {
-        RouterProfiler profiler(dutyCycleCurrent.nsExpireBlacklist);
-        blacklist.doExpiries();
-    }
+    recordOutcome(Date::now().secondsSince(start) * 1000.0,
+                  "expireInFlight.batchTimeMs");
+    recordOutcome(numExpired, "expireInFlight.batchSize");
+    if (inFlight.hasExpired(now))
+        recordHit("expireInFlight.carriedOver");
 
-    if (doDebug) {
-        RouterProfiler profiler(dutyCycleCurrent.nsExpireDebug);
-        expireDebugInfo();
-    }
+    return numExpired;
 }
 
 void
@@ -1326,6 +1867,7 @@ returnErrorResponse(const std::vector<std::string> & message,
     if (analytics) analytics->logErrorMessage(error,message);
     logMessageToAnalytics("ERROR", error, message);
     const auto& agent = message[0];
+    Guard guard(agentsLock);
     AgentInfo & info = this->agents[agent];
     bidder->sendErrorMessage(info.config, agent, error, message);
 }
@@ -1337,6 +1879,7 @@ returnInvalidBid(
         const std::shared_ptr<Auction> &auction,
         const char *reason, const char *message, ...) {
 
+    Guard guard(agentsLock);
     auto& agentInfo = agents[agent];
     const auto& agentConfig = agentInfo.config;
     this->recordHit("bidErrors.%s", reason);
@@ -1374,6 +1917,7 @@ returnInvalidBid(
         const std::shared_ptr<Auction> &auction,
         const std::string &reason, const char *message, ...) {
 
+    Guard guard(agentsLock);
     auto& agentInfo = agents[agent];
     const auto& agentConfig = agentInfo.config;
     this->recordHit("bidErrors.%s", reason);
@@ -1404,15 +1948,16 @@ returnInvalidBid(
     bidder->sendBidInvalidMessage(agentConfig, agent, formatted, auction);
 }
 
-void
+Json::Value
 Router::
-doStats(const std::vector<std::string> & message)
+buildStats() const
 {
     Json::Value result(Json::objectValue);
 
     result["numAugmenting"] = augmentationLoop.numAugmenting();
-    result["numInFlight"] = inFlight.size();
-    result["blacklistUsers"] = blacklist.size();
+    result["numInFlight"] = numInFlight();
+    result["blacklistEntries"] = blacklist.size();
+    result["blacklistMemory"] = blacklist.memusage();
 
     result["numAgents"] = agents.size();
 
@@ -1422,7 +1967,7 @@ doStats(const std::vector<std::string> & message)
 
     int totalAgentInFlight = 0;
 
-    BOOST_FOREACH(auto agent, agents) {
+    for (const auto & agent : agents) {
         agentsVal[agent.first] = agent.second.toJson(false, false);
         totalAgentInFlight += agent.second.numBidsInFlight();
     }
@@ -1446,7 +1991,25 @@ doStats(const std::vector<std::string> & message)
     result["numNoBidders"] = numNoBidders;
     result["numNoPotentialBidders"] = numNoPotentialBidders;
 
-    //sendMessage(controlEndpoint, message[0], result);
+    return result;
+}
+
+void
+Router::
+publishStats()
+{
+    auto snapshot = std::make_shared<StatsSnapshot>();
+    snapshot->date = Date::now();
+    snapshot->stats = buildStats();
+    snapshot->agents = Json::Value(Json::objectValue);
+
+    forEachAgent([&] (const AgentInfoEntry & info)
+            {
+                snapshot->agents[info.name] = info.toJson();
+            });
+
+    std::atomic_store(&statsSnapshot,
+                      std::shared_ptr<const StatsSnapshot>(std::move(snapshot)));
 }
 
 
@@ -1471,6 +2034,13 @@ augmentAuction(const std::shared_ptr<AugmentationInfo> & info)
 
     auto onDoneAugmenting = [=] (const std::shared_ptr<AugmentationInfo> & info)
         {
+            // Later batches belong to an auction that the router already
+            // has, which needs them to know when it can finish.
+            if (!info->firstBatch) {
+                this->pushStartBidding(info);
+                return;
+            }
+
             info->auction->doneAugmenting = Date::now();
 
             if (info->auction->tooLate()) {
@@ -1479,10 +2049,12 @@ augmentAuction(const std::shared_ptr<AugmentationInfo> & info)
             }
 
             // Send it off to be farmed out to the bidders
-            startBiddingBuffer.push(info);
-            wakeupMainLoop.signal();
+            this->pushStartBidding(info);
         };
 
+    AuctionTrace::record(info->auction->id, AS_AUGMENT);
+
+    ProfileScope scope("augmentAuction");
     augmentationLoop.augment(info, Date::now().plusSeconds(augmentationWindow.count()),
                              onDoneAugmenting);
 }
@@ -1491,14 +2063,18 @@ std::shared_ptr<AugmentationInfo>
 Router::
 preprocessAuction(const std::shared_ptr<Auction> & auction)
 {
+    ProfileScope scope("preprocessAuction");
+
     ML::atomic_inc(numAuctions);
 
+    AuctionTrace::record(auction->id, AS_FILTER);
+
     Date now = Date::now();
     auction->inPrepro = now;
 
     if (auction->lossAssumed == Date())
         auction->lossAssumed
-            = Date::now().plusSeconds(secondsUntilLossAssumed_);
+            = Date::nowCoarse().plusSeconds(secondsUntilLossAssumed_);
     Date lossTimeout = auction->lossAssumed;
 
     //cerr << "AUCTION " << auction->id << " " << auction->requestStr << endl;
@@ -1544,9 +2120,6 @@ preprocessAuction(const std::shared_ptr<Auction> & auction)
                 });
     }
 
-    // Do the actual filtering.
-    auto biddableConfigs = filters.filter(*auction->request, exchangeConnector);
-
     auto checkAgent = [&] (
             const AgentConfig & config,
             const AgentStatus & status,
@@ -1574,25 +2147,40 @@ preprocessAuction(const std::shared_ptr<Auction> & auction)
             return true;
         };
 
-    for (const auto& entry : biddableConfigs) {
-        if (entry.biddableSpots.empty()) continue;
-        if (!checkAgent(*entry.config, *entry.status, *entry.stats)) continue;
+    // Do the actual filtering. Only the agents that make it through the
+    // checks get copies of the pool's entries.
+    auto onBiddable = [&] (const FilterPool::ConfigEntry& entry, BiddableSpots& spots)
+        {
+            if (!checkAgent(*entry.config, *entry.status, *entry.stats)) return;
+
+            // Closed loop throttling of overloaded agents; see updateThrottles()
+            float throttleProbability = entry.status->throttleProbability;
+            if (throttleProbability < 1.0
+                && (random() % 1000000) / 1000000.0 >= throttleProbability) {
+                ML::atomic_inc(entry.stats->throttled);
+                doFilterStat(*entry.config, "static.throttled");
+                return;
+            }
+
+            ML::atomic_inc(entry.stats->passedStaticFilters);
+            doFilterStat(*entry.config, "passedStaticFilters");
 
-        ML::atomic_inc(entry.stats->passedStaticFilters);
-        doFilterStat(*entry.config, "passedStaticFilters");
+            const string & rrGroup = entry.config->roundRobinGroup.empty()
+                ? entry.name : entry.config->roundRobinGroup;
 
-        string rrGroup = entry.config->roundRobinGroup;
-        if (rrGroup == "") rrGroup = entry.name;
+            PotentialBidder bidder;
+            bidder.agent = entry.name;
+            bidder.config = entry.config;
+            bidder.stats = entry.stats;
+            bidder.filterIndex = entry.index;
+            bidder.imp = std::move(spots);
 
-        PotentialBidder bidder;
-        bidder.agent = entry.name;
-        bidder.config = entry.config;
-        bidder.stats = entry.stats;
-        bidder.imp = std::move(entry.biddableSpots);
+            auto & group = groupAgents[rrGroup];
+            group.totalBidProbability += entry.config->bidProbability;
+            group.push_back(std::move(bidder));
+        };
 
-        groupAgents[rrGroup].push_back(bidder);
-        groupAgents[rrGroup].totalBidProbability += entry.config->bidProbability;
-    }
+    filters.filter(*auction->request, exchangeConnector, onBiddable);
 
 
     std::vector<GroupPotentialBidders> validGroups;
@@ -1617,7 +2205,7 @@ preprocessAuction(const std::shared_ptr<Auction> & auction)
 
         // Group is valid for bidding; next step is to augment the bid
         // request
-        validGroups.push_back(it->second);
+        validGroups.push_back(std::move(it->second));
     }
 
     this->recordLevel(validGroups.size(), "potentialBiddersPerRequest");
@@ -1658,11 +2246,22 @@ Router::
 doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
 {
     //static const char *fName = "Router::doStartBidding:";
-    RouterProfiler profiler(dutyCycleCurrent.nsStartBidding);
+    RouterProfiler profiler(dutyCycleCurrent.nsStartBidding, "doStartBidding");
 
     try {
         Id auctionId = augInfo->auction->id;
-        if (inFlight.count(auctionId)) {
+        InFlight & inFlight = inFlightFor(auctionId);
+
+        AuctionInfo * batchOf = nullptr;
+        if (!augInfo->firstBatch) {
+            auto it = inFlight.find(auctionId);
+            if (it == inFlight.end()) {
+                recordHit("augmentation.batchAfterFinish");
+                return;
+            }
+            batchOf = &it->second;
+        }
+        else if (inFlight.count(auctionId)) {
             throwException("doStartBidding.alreadyInFlight",
                            "auction with ID %s already in progress",
                            auctionId.toString().c_str());
@@ -1679,10 +2278,18 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
 
         auto groupAgents = augInfo->potentialGroups;
 
-        AuctionInfo & auctionInfo = addAuction(augInfo->auction,
-                                               augInfo->lossTimeout);
+        AuctionInfo & auctionInfo = batchOf ? *batchOf
+            : addAuction(augInfo->auction, augInfo->lossTimeout);
+        auctionInfo.moreBatches = !augInfo->lastBatch;
         auto auction = augInfo->auction;
 
+        // The augmentations that came with this batch
+        for (const auto & aug : augInfo->augmentations)
+            auction->augmentations[aug.first] = aug.second;
+
+        // Bidders of this batch, when it's not the first
+        std::map<std::string, BidInfo> batchBidders;
+
         Date now = Date::now();
 
         auction->inStartBidding = now;
@@ -1694,6 +2301,25 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
 
         const auto& augList = augInfo->auction->augmentations;
 
+        Guard agentsGuard(agentsLock);
+
+        /* Second phase of the filters, on the augmentations.  The bidders
+           whose config changed since the first phase are left out as their
+           index could now be that of another config.
+        */
+        ConfigSet preAugmented;
+        for (const auto & group : groupAgents) {
+            for (const auto & bidder : group) {
+                auto it = agents.find(bidder.agent);
+                if (it != agents.end() && it->second.config == bidder.config)
+                    preAugmented.set(bidder.filterIndex);
+            }
+        }
+
+        ConfigSet augmented = filters.filterAugmented(
+                *auction->request, auction->exchangeConnector,
+                augList, preAugmented);
+
         /* For each round-robin group, send the request off to exactly one
            element. */
         for (auto it = groupAgents.begin(), end = groupAgents.end();
@@ -1789,32 +2415,16 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
                     continue;
                 }
 
-                stringstream ss;
-                ss << endl;
-
-                /* Filter on the augmentation tags */
-                bool filteredByAugmentation = false;
-                for (const auto& augConfig : config.augmentations) {
-                    auto it = augList.find(augConfig.name);
-
-                    if (it == augList.end()) {
-                        if (!augConfig.required) continue;
-                        string stat = "dynamic." + augConfig.name + ".missing";
-                        doFilterStat(stat.c_str());
-                        filteredByAugmentation = true;
-                        break;
-                    }
-
-                    vector<string> tags = it->second.tagsForAccount(config.account);
-                    if (augConfig.filters.anyIsIncluded(tags)) continue;
-
+                /* Filtered out on the augmentations */
+                if (!preAugmented.test(bidder.filterIndex)) {
+                    doFilterStat("dynamic.configChanged");
+                    continue;
+                }
+                if (!augmented.test(bidder.filterIndex)) {
                     ML::atomic_inc(info.stats->augmentationTagsExcluded);
-                    string stat = "dynamic." + augConfig.name + ".tags";
-                    doFilterStat(stat.c_str());
-                    filteredByAugmentation = true;
-                    break;
+                    doFilterStat("dynamic.augmentations");
+                    continue;
                 }
-                if (filteredByAugmentation) continue;
 
 
                 /* Check that there is no blacklist hit on the user. */
@@ -1880,6 +2490,7 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
             bidInfo.bidTime = Date::now();
             bidInfo.imp = winner.imp;
 
+            if (batchOf) batchBidders.insert(make_pair(agent, bidInfo));
             auctionInfo.bidders.insert(make_pair(agent, std::move(bidInfo)));  // create empty bid response
             if (!info.trackBidInFlight(auctionId, bidInfo.bidTime))
                 throwException("doStartBidding.agentAlreadyBidding",
@@ -1898,11 +2509,19 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
             // Unwind everything?
         }
 
-        this->recordLevel(auctionInfo.bidders.size(), "bidRequestsSentToBiddersPerRequest");
+        agentsGuard.unlock();
+
+        const auto & sendTo = batchOf ? batchBidders : auctionInfo.bidders;
+
+        this->recordLevel(sendTo.size(), "bidRequestsSentToBiddersPerRequest");
 
-        if (!auctionInfo.bidders.empty()) {
+        if (!sendTo.empty()) {
+            AuctionTrace::record(auctionId, AS_BID);
             bidder->sendAuctionMessage(
-                    auctionInfo.auction, timeLeftMs, auctionInfo.bidders);
+                    auctionInfo.auction, timeLeftMs, sendTo);
+        }
+        else if (!auctionInfo.bidders.empty() || auctionInfo.moreBatches) {
+            // Waiting on the bidders of the other batches
         }
         else {
             /* No bidders; don't bother with the bid */
@@ -1933,7 +2552,7 @@ addAuction(std::shared_ptr<Auction> auction, Date lossTimeout)
 
     try {
         AuctionInfo & result
-            = inFlight.insert(id, AuctionInfo(auction, lossTimeout),
+            = inFlightFor(id).insert(id, AuctionInfo(auction, lossTimeout),
                               getCurrentTime().plusSeconds(bidMemoryWindow));
         return result;
     } catch (const std::exception & exc) {
@@ -1980,11 +2599,18 @@ doBid(const std::vector<std::string> & message)
     bidMessage.wcm = std::move(wcm);
     bidMessage.meta = std::move(meta);
 
-    Bids bids;
     try {
-        bids = Bids::fromJson(biddata);
+        bidMessage.bids = Bids::fromJson(biddata);
     }
     catch (const std::exception & exc) {
+        // The in-flight auctions belong to the shards, which we can't look
+        // into from here.
+        if (!shards.empty()) {
+            recordHit("bidError.bidParseError");
+            returnErrorResponse(message, "couldn't parse bid JSON");
+            return;
+        }
+
         auto it = inFlight.find(auctionId);
         if (it == inFlight.end()) {
             recordHit("bidError.unknownAuction");
@@ -1998,7 +2624,14 @@ doBid(const std::vector<std::string> & message)
         }
         return;
     }
-    bidMessage.bids = std::move(bids);
+
+    if (!shards.empty()) {
+        if (!pushBid(std::move(bidMessage))) {
+            recordHit("bidError.shardOverflow");
+            returnErrorResponse(message, "router can't keep up with bids");
+        }
+        return;
+    }
 
     doBidImpl(bidMessage, message);
 }
@@ -2017,8 +2650,10 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
     ExcAssert(!message.agents.empty());
 
     const auto& auctionId = message.auctionId;
+    InFlight & inFlight = inFlightFor(auctionId);
     auto it = inFlight.find(auctionId);
     if (it == inFlight.end()) {
+        if (message.deadline) return;
         recordHit("bidError.unknownAuction");
         returnErrorResponse(originalMessage, "unknown auction");
         return;
@@ -2026,6 +2661,8 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
 
     AuctionInfo & auctionInfo = it->second;
 
+    Guard agentsGuard(agentsLock);
+
     for (const auto &agent: message.agents) {
         if (!agents.count(agent)) {
             returnErrorResponse(originalMessage, "unknown agent");
@@ -2034,6 +2671,7 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
 
         auto biddersIt = auctionInfo.bidders.find(agent);
         if (biddersIt == auctionInfo.bidders.end()) {
+            if (message.deadline) return;
             recordHit("bidError.agentSkippedAuction");
             returnErrorResponse(originalMessage,
                                 "agent shouldn't bid on this auction");
@@ -2047,6 +2685,8 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
             returnErrorResponse(originalMessage, "agent wasn't bidding on this auction");
             return;
         }
+        info.throttle.recordResponse(
+                Date::now().secondsSince(biddersIt->second.bidTime) * 1000.0);
         auto & config = *biddersIt->second.agentConfig;
         recordHit("accounts.%s.bids", config.account.toString('.'));
     }
@@ -2057,23 +2697,43 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
     int numValidBids = 0;
 
     recordHit("bid");
+    if (message.deadline)
+        recordHit("bidDeadlineExpired");
 
     const auto& agent = message.agents[0];
     auto biddersIt = auctionInfo.bidders.find(agent);
     auto & config = *biddersIt->second.agentConfig;
-    AgentInfo & info = agents[agent];
-    const auto& agentConfig = info.config;
+
+    // Take our own references so that the agent can be reconfigured or
+    // removed by the main loop while we process the bid.
+    const auto agentConfig = agents[agent].config;
+    const auto stats = agents[agent].stats;
+
+    agentsGuard.unlock();
+
+    // The account goes into most of the keys recorded below
+    const std::string account = config.account.toString('.');
 
     const auto& bids = message.bids;
-    auto bidsString = bids.toJson().toStringNoNewLine();
+
+    // Serializing the bids is only needed to log them, which doesn't happen
+    // for agents that pass on the auction.
+    std::string bidsStringCache;
+    auto bidsString = [&] () -> const std::string &
+        {
+            if (bidsStringCache.empty())
+                bidsStringCache = bids.toJson().toStringNoNewLine();
+            return bidsStringCache;
+        };
 
     BidInfo bidInfo(std::move(biddersIt->second));
 
-    RouterProfiler profiler(dutyCycleCurrent.nsBid);
+    RouterProfiler profiler(dutyCycleCurrent.nsBid, "doBid");
 
     ML::atomic_inc(numBids);
 
     int numPassedBids = 0;
+    Bid clampedBid;
 
     ExcCheckEqual(bids.size(), bidInfo.imp.size(),
             "invalid shape for bids array");
@@ -2084,73 +2744,84 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
 
     for (int i = 0; i < bids.size(); ++i) {
 
-        Bid bid = bids[i];
+        // Only copied in the rare case where we have to change the price
+        const Bid * bidPtr = &bids[i];
 
-        if (bid.isNullBid()) {
+        if (bidPtr->isNullBid()) {
             ++numPassedBids;
             continue;
         }
 
         int spotIndex = bidInfo.imp[i].first;
 
-        if (bid.creativeIndex == -1) {
-            returnInvalidBid(agent, bidsString, auctionInfo.auction,
+        if (bidPtr->creativeIndex == -1) {
+            returnInvalidBid(agent, bidsString(), auctionInfo.auction,
                     "nullCreativeField",
                     "creative field is null in response %s",
-                    bidsString.c_str());
+                    bidsString().c_str());
             continue;
         }
 
-        if (bid.creativeIndex < 0
-                || bid.creativeIndex >= config.creatives.size())
+        if (bidPtr->creativeIndex < 0
+                || bidPtr->creativeIndex >= config.creatives.size())
         {
-            returnInvalidBid(agent, bidsString, auctionInfo.auction,
+            returnInvalidBid(agent, bidsString(), auctionInfo.auction,
                     "outOfRangeCreative",
                     "parsing field 'creative' of %s: creative "
                     "number %d out of range 0-%zd",
-                    bidsString.c_str(), bid.creativeIndex,
+                    bidsString().c_str(), bidPtr->creativeIndex,
                     config.creatives.size());
             continue;
         }
 
-        if (bid.price.isNegative() || bid.price > maxBidAmount) {
+        if (bidPtr->price.isNegative() || bidPtr->price > maxBidAmount) {
             if (slowModePeriodicSpentReached) {
-                bid.price = maxBidAmount;
+                clampedBid = *bidPtr;
+                clampedBid.price = maxBidAmount;
+                bidPtr = &clampedBid;
             } else {
-                returnInvalidBid(agent, bidsString, auctionInfo.auction,
+                returnInvalidBid(agent, bidsString(), auctionInfo.auction,
                     "invalidPrice",
                     "bid price of %s is outside range of $0-%s parsing bid %s",
-                    bid.price.toString().c_str(),
+                    bidPtr->price.toString().c_str(),
                     maxBidAmount.toString().c_str(),
-                    bidsString.c_str());
+                    bidsString().c_str());
                 continue;
             }
         }
 
-     auto getbid = auctionInfo.auction->exchangeConnector->getBidValidity(bid, imp, spotIndex);
+        const Bid & bid = *bidPtr;
+
+        auto getbid = auctionInfo.auction->exchangeConnector->getBidValidity(bid, imp, spotIndex);
 
         if (!getbid.isValidbid) {
-            returnInvalidBid(agent, bidsString, auctionInfo.auction,
+            returnInvalidBid(agent, bidsString(), auctionInfo.auction,
                 "noBid",
                 getbid.reason_.c_str());
             continue;
         }
         const Creative & creative = config.creatives.at(bid.creativeIndex);
 
-        if (!creative.compatible(imp[spotIndex])) {
+        // The creatives that the filters let through for this spot are
+        // already known to fit it; only the others need to be checked.
+        const auto & filtered = bidInfo.imp[i].second;
+        bool prefiltered = std::find(filtered.begin(), filtered.end(),
+                                     bid.creativeIndex) != filtered.end();
+
+        if (!prefiltered && !creative.compatible(imp[spotIndex])) {
 #if 1
             cerr << "creative not compatible with spot: " << endl;
             cerr << "auction: " << auctionInfo.auction->requestStr
                 << endl;
             cerr << "config: " << config.toJson().toStringNoNewLine() << endl;
-            cerr << "bid: " << bidsString << endl;
+            cerr << "bid: " << bidsString() << endl;
             cerr << "spot: " << imp[i].toJson().toStringNoNewLine() << endl;
             cerr << "spot num: " << spotIndex << endl;
             cerr << "bid num: " << i << endl;
             cerr << "creative num: " << bid.creativeIndex << endl;
             cerr << "creative: " << creative.toJson().toStringNoNewLine() << endl;
 #endif
-            returnInvalidBid(agent, bidsString, auctionInfo.auction,
+            returnInvalidBid(agent, bidsString(), auctionInfo.auction,
                     "creativeNotCompatibleWithSpot",
                     "creative %s not compatible with spot %s",
                     creative.toJson().toString().c_str(),
@@ -2158,9 +2829,9 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
             continue;
         }
 
-        if (!creative.biddable(auctionInfo.auction->request->exchange,
+        if (!prefiltered && !creative.biddable(auctionInfo.auction->request->exchange,
                         auctionInfo.auction->request->protocolVersion)) {
-            returnInvalidBid(agent, bidsString, auctionInfo.auction,
+            returnInvalidBid(agent, bidsString(), auctionInfo.auction,
                     "creativeNotBiddableOnExchange",
                     "creative not biddable on exchange/version");
             continue;
@@ -2175,6 +2846,7 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
         Amount price = message.wcm.evaluate(bid, bid.price);
 
         if (!monitorClient.getStatus(slowModeTolerance)) {
+            Guard guard(agentsLock);
             Date now = Date::now();
             if ((uint32_t) slowModeLastAuction.secondsSinceEpoch()
                     < (uint32_t) now.secondsSinceEpoch()) {
@@ -2196,7 +2868,7 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
                     slowModePeriodicSpentReached = true;
                     bidder->sendBidDroppedMessage(agentConfig, agent, auctionInfo.auction);
                     recordHit("slowMode.droppedBid");
-                    recordHit("accounts.%s.IGNORED", config.account.toString('.'));
+                    recordHit("accounts.%s.IGNORED", account);
                 continue;
                 }
             }
@@ -2206,15 +2878,16 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
             slowModePeriodicSpentReached = false;
         }
 
-        if (!banker->authorizeBid(config.account, auctionKey, price) || failBid(budgetErrorRate))
+        if (!banker->authorizeBid(config.accountHandle, auctionKey, price) || failBid(budgetErrorRate))
         {
-            ++info.stats->noBudget;
+            ML::atomic_inc(stats->noBudget);
 
             bidder->sendNoBudgetMessage(agentConfig, agent, auctionInfo.auction);
 
-            if (analytics) analytics->logNoBudgetMessage(agent, auctionId, bidsString, message.meta);
+            if (analytics && analytics->isEnabled("NOBUDGET"))
+                analytics->logNoBudgetMessage(agent, auctionId, bidsString(), message.meta);
             this->logMessageToAnalytics("NOBUDGET", agent, auctionId);
-            recordHit("accounts.%s.NOBUDGET", config.account.toString('.'));
+            recordHit("accounts.%s.NOBUDGET", account);
             continue;
         }
         
@@ -2241,7 +2914,7 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
                 agent,
                 bids,
                 meta,
-                info.config,
+                agentConfig,
                 config.visitChannels,
                 bid.creativeIndex,
                 message.wcm);
@@ -2267,47 +2940,55 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
                             auctionKey.c_str(), msg.c_str()));
 
 
+        Guard statsGuard(agentsLock);
+
         switch (localResult.val) {
         case Auction::WinLoss::PENDING: {
-            ++info.stats->bids;
-            info.stats->totalBid += price;
+            ++stats->bids;
+            stats->totalBid += price;
             break; // response will be sent later once local winning bid known
         }
         case Auction::WinLoss::LOSS:
-            ++info.stats->bids;
-            info.stats->totalBid += price;
+            ++stats->bids;
+            stats->totalBid += price;
             // fall through
         case Auction::WinLoss::TOOLATE:
         case Auction::WinLoss::INVALID: {
             if (localResult.val == Auction::WinLoss::TOOLATE)
-                ++info.stats->tooLate;
+                ++stats->tooLate;
             else if (localResult.val == Auction::WinLoss::INVALID)
-                ++info.stats->invalid;
+                ++stats->invalid;
+
+            statsGuard.unlock();
 
-            banker->cancelBid(config.account, auctionKey);
+            banker->cancelBid(config.accountHandle, auctionKey);
 
             BidStatus status;
             switch (localResult.val) {
             case Auction::WinLoss::LOSS:
                 status = BS_LOSS;
-                bidder->sendLossMessage(agentConfig, agent, auctionId.toString ());
-                recordHit("accounts.%s.LOCAL_LOSS", config.account.toString('.'));
+                if (agentConfig->implicitLossSeconds > 0)
+                    recordHit("accounts.%s.IMPLICIT_LOSS", account);
+                else
+                    bidder->sendLossMessage(agentConfig, agent, auctionId.toString ());
+                recordHit("accounts.%s.LOCAL_LOSS", account);
                 break;
             case Auction::WinLoss::TOOLATE:
                 status = BS_TOOLATE;
                 bidder->sendTooLateMessage(agentConfig, agent, auctionInfo.auction);
-                recordHit("accounts.%s.TOOLATE", config.account.toString('.'));
+                recordHit("accounts.%s.TOOLATE", account);
                 continue;
             case Auction::WinLoss::INVALID:
                 status = BS_INVALID;
                 bidder->sendBidInvalidMessage(agentConfig, agent, msg, auctionInfo.auction);
-                recordHit("accounts.%s.INVALID", config.account.toString('.'));
+                recordHit("accounts.%s.INVALID", account);
                 break;
             default:
                 throw ML::Exception("logic error");
             }
 
-            if (analytics) analytics->logMessage(msg, agent, auctionId, bidsString, message.meta);
+            if (analytics && analytics->isEnabled(msg))
+                analytics->logMessage(msg, agent, auctionId, bidsString(), message.meta);
             this->logMessageToAnalytics(msg, agent, auctionId, bidsString);
             continue;
         }
@@ -2324,7 +3005,8 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
 
     if (numValidBids > 0) {
         if (logBids) {
-            if (analytics) analytics->logBidMessage(agent, auctionId, bidsString, message.meta);
+            if (analytics && analytics->isEnabled("BID"))
+                analytics->logBidMessage(agent, auctionId, bidsString(), message.meta);
         }
         logMessageToAnalytics("BID", agent, auctionId, bidsString);
         ML::atomic_add(numNonEmptyBids, 1);
@@ -2332,8 +3014,9 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
     else if (numPassedBids > 0) {
         // Passed on the ... add to the blacklist
         if (config.hasBlacklist()) {
+            Guard guard(agentsLock);
             const BidRequest & bidRequest = *auctionInfo.auction->request;
-            blacklist.add(bidRequest, agent, *info.config);
+            blacklist.add(bidRequest, agent, *agentConfig);
         }
     }
 
@@ -2350,10 +3033,10 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
 
     recordOutcome(1000.0 * bidTime,
                   "accounts.%s.bidResponseTimeMs",
-                  config.account.toString('.'));
+                  account);
 
 
-    if (auctionInfo.bidders.empty()) {
+    if (auctionInfo.bidders.empty() && !auctionInfo.moreBatches) {
         debugAuction(auctionId, "FINISH", originalMessage);
         if (!auctionInfo.auction->finish()) {
             debugAuction(auctionId, "FINISH TOO LATE", originalMessage);
@@ -2376,7 +3059,7 @@ doSubmitted(std::shared_ptr<Auction> auction)
     // Either a) move it across to the win queue, or b) drop it if we
     // didn't bid anything
 
-    RouterProfiler profiler(dutyCycleCurrent.nsSubmitted);
+    RouterProfiler profiler(dutyCycleCurrent.nsSubmitted, "doSubmitted");
 
     const Id & auctionId = auction->id;
 
@@ -2448,7 +3131,7 @@ doSubmitted(std::shared_ptr<Auction> auction)
             ML::Call_Guard guard
                 ([&] ()
                  {
-                     banker->cancelBid(response.agentConfig->account, auctionKey);
+                     banker->cancelBid(response.agentConfig->accountHandle, auctionKey);
                  });
 
             // No bid
@@ -2475,7 +3158,10 @@ doSubmitted(std::shared_ptr<Auction> auction)
                 bidStatus = BS_LOSS;
                 ++info.stats->losses;
                 msg = "LOSS";
-                bidder->sendLossMessage(agentConfig, response.agent, auctionId.toString());
+                if (agentConfig->implicitLossSeconds > 0)
+                    recordHit("accounts.%s.IMPLICIT_LOSS", agentConfig->account.toString('.'));
+                else
+                    bidder->sendLossMessage(agentConfig, response.agent, auctionId.toString());
                 recordHit("accounts.%s.LOCAL_LOSS", agentConfig->account.toString('.'));
                 break;
             case Auction::WinLoss::TOOLATE:
@@ -2503,7 +3189,8 @@ doSubmitted(std::shared_ptr<Auction> auction)
         ML::atomic_add(numAuctionsWithBid, 1);
         //cerr << fName << "injecting submitted auction " << endl;
 
-        logMessageToAnalytics("SUBMITTED", auction->id, responses[0].agent, responses[0].price.toJsonStr());
+        logMessageToAnalytics("SUBMITTED", auction->id, responses[0].agent,
+                              [&] { return responses[0].price.toJsonStr(); });
         onSubmittedAuction(auction, spotId, responses[0]);
         //postAuctionLoop.injectSubmittedAuction(auction, spotId, responses[0]);
     }
@@ -2658,7 +3345,18 @@ Router::
 doConfig(const std::string & agent,
          std::shared_ptr<const AgentConfig> config)
 {
-    RouterProfiler profiler(dutyCycleCurrent.nsConfig);
+    FilterPool::ConfigUpdates updates;
+    doConfig(agent, config, updates);
+    applyConfigUpdates(updates);
+}
+
+void
+Router::
+doConfig(const std::string & agent,
+         std::shared_ptr<const AgentConfig> config,
+         FilterPool::ConfigUpdates & updates)
+{
+    RouterProfiler profiler(dutyCycleCurrent.nsConfig, "doConfig");
 
     if (!config) {
         auto it = agents.find(agent);
@@ -2667,19 +3365,26 @@ doConfig(const std::string & agent,
         // configuration to the ACS.
         if (it != std::end(agents)) {
             cerr << "agent " << agent << " lost configuration" << endl;
-            filters.removeConfig(agent);
+            updates.remove(agent);
+            compatibility.release(agent);
+            compatibility.sweep();
             agents.erase(it);
         }
     } else {
         AgentInfo & info = agents[agent];
-        if (analytics) analytics->logConfigMessage(agent, boost::trim_copy(config->toJson().toString()));
-        logMessageToAnalytics("CONFIG", agent, boost::trim_copy(config->toJson().toString()));
+        if (analytics && analytics->isEnabled("CONFIG"))
+            analytics->logConfigMessage(agent, boost::trim_copy(config->toJson().toString()));
+        logMessageToAnalytics("CONFIG", agent,
+                              [&] { return boost::trim_copy(config->toJson().toString()); });
 
         // TODO: no need for this...
         auto newConfig = std::make_shared<AgentConfig>(*config);
         if (newConfig->roundRobinGroup == "")
             newConfig->roundRobinGroup = agent;
 
+        // Configs built in code (eg. in tests) may not have been compiled
+        newConfig->compile();
+
 
         if (info.configured) {
             unconfigure(agent, *info.config);
@@ -2690,15 +3395,30 @@ doConfig(const std::string & agent,
         //cerr << "configured " << agent << " strategy : " << info.config->strategy << " campaign "
         //     <<  info.config->campaign << endl;
 
-        string bidRequestFormat = "jsonRaw";
-        info.setBidRequestFormat(bidRequestFormat);
+        info.setBidRequestFormat(newConfig->bidRequestFormat);
 
         configure(agent, *newConfig);
         info.configured = true;
         bidder->sendMessage(config, agent, "GOTCONFIG");
 
-        info.filterIndex = filters.addConfig(agent, info);
+        updates.add(agent, info);
     }
+}
+
+void
+Router::
+applyConfigUpdates(const FilterPool::ConfigUpdates & updates)
+{
+    RouterProfiler profiler(dutyCycleCurrent.nsConfig, "applyConfigUpdates");
+
+    for (const auto & added : filters.updateConfigs(updates)) {
+        // The agent may have lost its configuration later on in the batch.
+        auto it = agents.find(added.first);
+        if (it != agents.end()) it->second.filterIndex = added.second;
+    }
+
+    updateExactFrequencyCaps();
+    updateEligibility();
 
     // Broadcast that we have a new agent or it has a new configuration
     updateAllAgents();
@@ -2708,6 +3428,9 @@ void
 Router::
 unconfigure(const std::string & agent, const AgentConfig & config)
 {
+    // The entries are only swept once the new config was configured, so the
+    // parts of it which didn't change are found again.
+    compatibility.release(agent);
 }
 
 void
@@ -2719,7 +3442,8 @@ configureAgentOnExchange(std::shared_ptr<ExchangeConnector> const & exchange,
 {
     auto name = exchange->exchangeName();
 
-    auto ecomp = exchange->getCampaignCompatibility(config, includeReasons);
+    const auto & ecomp
+        = compatibility.campaign(*exchange, agent, config, includeReasons);
     if(!ecomp.isCompatible) {
         cerr << "campaign not compatible: " << ecomp.reasons << endl;
         this->recordHit("%s.compaignNotCompatible", name);
@@ -2729,7 +3453,8 @@ configureAgentOnExchange(std::shared_ptr<ExchangeConnector> const & exchange,
     int numCompatibleCreatives = 0;
 
     for(auto & c : config.creatives) {
-        auto ccomp = exchange->getCreativeCompatibility(c, includeReasons);
+        const auto & ccomp
+            = compatibility.creative(*exchange, agent, c, includeReasons);
         if(!ccomp.isCompatible) {
             cerr << "creative not compatible: " << ccomp.reasons << endl;
             this->recordHit("%s.creativeNotCompatible", name);
@@ -2762,6 +3487,7 @@ configure(const std::string & agent, AgentConfig & config)
     forAllExchanges([&] (const std::shared_ptr<ExchangeConnector> & exchange) {
         configureAgentOnExchange(exchange, agent, config);
     });
+    compatibility.sweep();
 
     auto onDone = [=] (std::exception_ptr exc, ShadowAccount&& ac)
         {
@@ -2781,21 +3507,18 @@ Json::Value
 Router::
 getStats() const
 {
-    return Json::Value();
-#if 0
-    sendMesg(control(), "STATS");
-    vector<string> stats = recvAll(control());
-
-    Json::Value result = Json::parse(stats.at(0));
-
-    return result;
-#endif
+    auto snapshot = std::atomic_load(&statsSnapshot);
+    if (!snapshot) return Json::Value();
+    return snapshot->stats;
 }
 
 Json::Value
 Router::
 getAgentInfo(const std::string & agent) const
 {
+    auto snapshot = std::atomic_load(&statsSnapshot);
+    if (snapshot && snapshot->agents.isMember(agent))
+        return snapshot->agents[agent];
     return getAgentEntry(agent).toJson();
 }
 
@@ -2803,6 +3526,9 @@ Json::Value
 Router::
 getAllAgentInfo() const
 {
+    auto snapshot = std::atomic_load(&statsSnapshot);
+    if (snapshot) return snapshot->agents;
+
     Json::Value result;
 
     auto onAgent = [&] (const AgentInfoEntry & info)
@@ -2953,6 +3679,7 @@ submitToPostAuctionService(std::shared_ptr<Auction> auction,
         bid.price.maxPrice = bid.wcm.evaluate(bid.bidData[0], bid.price.maxPrice);
         event->bidResponse = bid;
 
+        AuctionTrace::record(auction->id, AS_SUBMIT);
         postAuctionEndpoint.sendAuction(event);
     }
 
@@ -3061,14 +3788,16 @@ getProviderIndicators()
 {
     bool connectedToPal = !connectPostAuctionLoop || postAuctionEndpoint.isConnected();
     bool bankerOk = banker->getProviderIndicators().status;
+    bool warm = warmedUp;
 
     MonitorIndicator ind;
 
     ind.serviceName = serviceName();
-    ind.status = connectedToPal && bankerOk;
+    ind.status = connectedToPal && bankerOk && warm;
     ind.message = string()
         + "Connection to PAL: " + (connectedToPal ? "OK" : "ERROR") + ", "
-        + "Banker: " + (bankerOk ? "OK": "ERROR");
+        + "Banker: " + (bankerOk ? "OK": "ERROR") + ", "
+        + "Warm-up: " + (warm ? "OK" : "PENDING");
 
     return ind;
 }
@@ -10,6 +10,7 @@
 
 #include <atomic>
 #include "filter_pool.h"
+#include "filters/frequency_cap_filter.h"
 #include "soa/service/zmq.hpp"
 #include <unordered_map>
 #include <boost/thread/thread.hpp>
@@ -21,10 +22,13 @@
 #include "soa/service/pending_list.h"
 #include "soa/service/loop_monitor.h"
 #include "augmentation_loop.h"
+#include "duplicate_auctions.h"
 #include "router_types.h"
+#include "compatibility_cache.h"
 #include "soa/gc/gc_lock.h"
 #include "jml/utils/ring_buffer.h"
 #include "jml/arch/wakeup_fd.h"
+#include "jml/arch/huge_page_pool.h"
 #include "jml/utils/smart_ptr_utils.h"
 #include <unordered_set>
 #include <thread>
@@ -39,6 +43,7 @@
 
 namespace RTBKIT {
 
+struct Router;
 struct Banker;
 struct BudgetController;
 struct Accountant;
@@ -95,6 +100,61 @@ struct AuctionDebugInfo {
     std::vector<Message> messages;
 };
 
+/*****************************************************************************/
+/* ROUTER SHARD                                                              */
+/*****************************************************************************/
+
+/** Worker loop that owns a slice of the router's in-flight auctions.
+
+    Auctions are assigned to a shard by hashing their id, so that the
+    startBidding, bid and expiry processing of a given auction always
+    happens on the same thread.  Each shard has its own in-flight map
+    which is only ever touched from the shard's thread; state shared
+    between shards (agents, blacklist, slow mode accounting) is protected
+    by Router::agentsLock.
+*/
+struct RouterShard {
+    RouterShard(Router & router, unsigned index);
+    ~RouterShard();
+
+    void start();
+    void shutdown();
+
+    /** Number of auctions in flight on this shard.  Safe to call from
+        any thread.
+    */
+    size_t numInFlight() const { return numInFlight_; }
+
+    /** Queue an augmented auction for bidding on this shard. */
+    void pushStartBidding(const std::shared_ptr<AugmentationInfo> & info);
+
+    /** Queue an agent bid for processing on this shard. */
+    bool pushBid(BidMessage && message);
+
+    Router & router;
+    unsigned index;
+
+    /** CPUs the shard's thread is restricted to; empty for any.  Must be
+        set before start().
+    */
+    std::vector<int> cpuAffinity;
+
+    ML::RingBufferSRMW<std::shared_ptr<AugmentationInfo> > startBiddingBuffer;
+    ML::RingBufferSRMW<BidMessage> doBidBuffer;
+    ML::Wakeup_Fd wakeup;
+
+    /** Auctions owned by this shard. */
+    TimeoutMap<Id, AuctionInfo, ML::Huge_Page_Allocator> inFlight;
+
+private:
+    void run();
+
+    std::atomic<bool> shutdown_;
+    std::atomic<size_t> numInFlight_;
+    std::unique_ptr<std::thread> thread;
+};
+
+
 /*****************************************************************************/
 /* ROUTER                                                                    */
 /*****************************************************************************/
@@ -142,6 +202,14 @@ struct Router : public ServiceBase,
     std::shared_ptr<Banker> getBanker() const;
     void setBanker(const std::shared_ptr<Banker> & newBanker);
 
+    /** Talk to the given Monitor, which lives in the same process, directly
+        instead of through zeromq.  Must be called before init().
+    */
+    void setLocalMonitor(RestServiceEndpoint * monitor)
+    {
+        localMonitor = monitor;
+    }
+
     /** Initialize the bidder interface. */
     void initBidderInterface(Json::Value const & json);
 
@@ -183,6 +251,23 @@ struct Router : public ServiceBase,
     */
     void unsafeDisableSlowMode();
 
+    /** Spread the in-flight auctions over the given number of worker
+        loops, each running on its own thread.  Zero (the default) keeps
+        all of the auction processing on the main router loop.  Must be
+        called before init().
+    */
+    void setNumShards(unsigned numShards);
+
+    unsigned numShards() const { return shards.size(); }
+
+    /** Restrict the threads of the given role to the given CPUs (see
+        ML::parseCpuList).  The roles are "router" for the main loop,
+        "shards" for the worker shards and "augmentation" for the
+        augmentation loop.  Must be called before start().
+    */
+    void setThreadAffinity(const std::string & role,
+                           const std::vector<int> & cpus);
+
     /** Start the router running in a separate thread.  The given function
         will be called when the thread is stopped. */
     virtual void
@@ -358,7 +443,16 @@ struct Router : public ServiceBase,
     /** Return the number of auctions awaiting a win/loss message. */
     int numAuctionsAwaitingResult() const;
 
-    /** Return a stats object that tells us what's going on. */
+    /** Return the number of auctions currently in flight, over all of the
+        shards.
+    */
+    size_t numInFlight() const;
+
+    /** Return a stats object that tells us what's going on.  This and the
+        agent info below are served from the last published stats snapshot
+        and so never touch the router loop; they can lag by up to
+        statsSnapshotPeriod seconds.
+    */
     Json::Value getStats() const;
 
     /** Return information about a given agent. */
@@ -367,6 +461,83 @@ struct Router : public ServiceBase,
     /** Return information about all agents. */
     Json::Value getAllAgentInfo() const;
 
+    /** Number of seconds between the refreshes of the stats snapshot by the
+        router loop.
+    */
+    void setStatsSnapshotPeriod(double seconds) { statsSnapshotPeriod = seconds; }
+
+    /** Maximum number of in-flight auctions that the router loop, or a
+        shard, expires in one pass.  What's left is expired on the next
+        passes, so that a burst of timeouts doesn't stall the loop.
+    */
+    void setMaxExpiriesPerPass(size_t val) { maxExpiriesPerPass = val; }
+
+    /** Have the router loop, the shards and the augmentation loop spin for
+        up to spinUs microseconds polling for work before they go to sleep,
+        rather than sleeping between passes.  Each of them then takes a
+        core but picks up what comes in without waiting for the kernel to
+        wake it up.  0, the default, sleeps as usual.  Must be called
+        before start().
+    */
+    void setBusyPoll(int spinUs)
+    {
+        busyPollUs = spinUs;
+        augmentationLoop.setBusyPoll(spinUs);
+    }
+
+    /** Drop the auctions whose id was already seen from the same exchange
+        in the last windowSeconds as they come in, before they are
+        filtered, counting them in exchange.<name>.duplicateAuctions.  The
+        table is sized for maxAuctionsPerSecond.  Off (0) by default.  Must
+        be called before start().
+    */
+    void setDuplicateAuctionWindow(double windowSeconds,
+                                   size_t maxAuctionsPerSecond = 100000)
+    {
+        duplicateAuctions.init(windowSeconds, maxAuctionsPerSecond);
+    }
+
+    /** Enforce the frequencyCap of the agent configs in the router, with
+        the impressions counted in a sketch with the given parameters from
+        the MATCHEDWIN messages of the post auction loops' logger.  Off by
+        default, in which case the FrequencyCap filter lets everything
+        through.  Must be called before init().
+    */
+    void enableFrequencyCapping(
+            const FrequencyCapSketch::Params & params
+                = FrequencyCapSketch::Params());
+
+    /** Publish to each exchange connector a summary of the requests that
+        the agents configured on it could bid on, rebuilt whenever the
+        configurations change, so that the connector answers the others
+        with a no-bid before making auctions out of them.  They are counted
+        in auctionEarlyDrop.noEligibleAgent.  Off by default.
+    */
+    void enableEligibilitySummaries(bool enable = true);
+
+    /** Send the submitted auctions to the post auction loop in batches of
+        up to maxAuctions, with the bid request of an auction sent once for
+        all of its spots, and LZ4 compressed if compress is set.  Must be
+        called before start(), and requires post auction loops that
+        understand AUCTIONS messages.
+    */
+    void batchPostAuctionSubmissions(size_t maxAuctions, bool compress = false)
+    {
+        postAuctionEndpoint.enableAuctionBatching(maxAuctions, compress);
+    }
+
+    /** Recorded bid requests, in the given format (see BidRequest::parse),
+        to run through the parsers and the filters once the agents are
+        configured so that the first auctions don't pay for the cold caches
+        and the lazily built state.  Until that's done, or timeout seconds
+        after the router loop started if no agent shows up, the router
+        reports itself as not ready to the monitor.  Must be called before
+        start().
+    */
+    void setWarmUpRequests(const std::string & format,
+                           std::vector<std::string> requests,
+                           double timeout = 10.0);
+
     /** Return information about all agents bidding on the given
         account. */
     Json::Value getAccountInfo(const AccountKey & account) const;
@@ -417,6 +588,10 @@ protected:
     // don't have to run in the main loop
     boost::scoped_ptr<boost::thread> cleanupThread;
 
+    /// CPUs for the main loop and shard threads; see setThreadAffinity()
+    std::vector<int> routerAffinity;
+    std::vector<int> shardAffinity;
+
     typedef std::recursive_mutex Lock;
     typedef std::unique_lock<Lock> Guard;
 
@@ -443,16 +618,46 @@ public:
 
     FilterPool filters;
 
+    /** Compatibility of the agents' campaigns and creatives with the
+        exchanges; protected by agentsLock.
+    */
+    CompatibilityCache compatibility;
+
     AugmentationLoop augmentationLoop;
     Blacklist blacklist;
 
     LoopMonitor loopMonitor;
     LoadStabilizer loadStabilizer;
 
-    /** List of auctions we're currently tracking as active. */
-    typedef TimeoutMap<Id, AuctionInfo> InFlight;
+    /** List of auctions we're currently tracking as active.  Only used
+        when the router isn't sharded.
+    */
+    typedef TimeoutMap<Id, AuctionInfo, ML::Huge_Page_Allocator> InFlight;
     InFlight inFlight;
 
+    /** Worker shards; empty when all the auctions run on the main loop. */
+    std::vector<std::unique_ptr<RouterShard> > shards;
+
+    unsigned shardIndex(const Id & auctionId) const
+    {
+        return auctionId.hash() % shards.size();
+    }
+
+    /** In-flight map that owns the given auction. */
+    InFlight & inFlightFor(const Id & auctionId)
+    {
+        if (shards.empty()) return inFlight;
+        return shards[shardIndex(auctionId)]->inFlight;
+    }
+
+    /** Hand over an augmented auction to the loop that owns it. */
+    void pushStartBidding(const std::shared_ptr<AugmentationInfo> & info);
+
+    /** Hand over a bid to the loop that owns its auction.  Safe to call
+        from any thread; returns false if the loop can't keep up.
+    */
+    bool pushBid(BidMessage && message);
+
     /** Add the given auction to our data structures. */
     AuctionInfo &
     addAuction(std::shared_ptr<Auction> auction, Date timeout);
@@ -468,6 +673,11 @@ public:
 
     void checkExpiredAuctions();
 
+    /** Expire up to maxExpiriesPerPass of the timed out auctions of the
+        given in-flight map.  Returns the number expired.
+    */
+    size_t expireInFlight(InFlight & inFlight, Date now);
+
     void returnErrorResponse(const std::vector<std::string> & message,
                              const std::string & error);
 
@@ -522,8 +732,33 @@ public:
     */
     void sendPings();
 
-    /** Someone wants stats. */
-    void doStats(const std::vector<std::string> & message);
+    /** Immutable copy of the stats, published for the readers outside of
+        the router loop.
+    */
+    struct StatsSnapshot {
+        Date date;
+        Json::Value stats;
+        Json::Value agents;  ///< Indexed by agent name
+    };
+
+    /** Build the stats on the router loop and publish them as the new
+        snapshot.
+    */
+    void publishStats();
+
+    /** Current stats; must be called from the router loop. */
+    Json::Value buildStats() const;
+
+    /** Run a step of the AgentThrottle of each agent that enables it, and
+        publish the new probabilities in their status.  Called periodically
+        from the router loop.
+    */
+    void updateThrottles();
+
+    /** Run the warm-up requests through the parsers, in parallel, and then
+        through the filters.  Called once from the router loop.
+    */
+    void warmUp();
 
     /** We got a new auction. */
     void onNewAuction(std::shared_ptr<Auction> auction);
@@ -540,6 +775,19 @@ public:
     void doConfig(const std::string & agent,
                   std::shared_ptr<const AgentConfig> config);
 
+    /** Same as doConfig but the filter changes are queued in the given batch
+        instead of being applied right away. applyConfigUpdates must be called
+        once all the configuration messages have been processed.
+     */
+    void doConfig(const std::string & agent,
+                  std::shared_ptr<const AgentConfig> config,
+                  FilterPool::ConfigUpdates & updates);
+
+    /** Applies a batch of filter changes built by doConfig and broadcasts the
+        new set of agents.
+     */
+    void applyConfigUpdates(const FilterPool::ConfigUpdates & updates);
+
     /* Add a given agent (with the given configuration) to the exchange */
     void configureAgentOnExchange(std::shared_ptr<ExchangeConnector> const & exchange,
                                   std::string const & agent,
@@ -558,12 +806,48 @@ public:
 
     mutable Lock lock;
 
+    /** Protects the state that is shared between the main loop and the
+        shards: the agents map and its entries, the blacklist and the slow
+        mode accounting.
+    */
+    mutable Lock agentsLock;
+
     std::shared_ptr<Banker> banker;
 
     double secondsUntilLossAssumed_;
     double globalBidProbability;
     double bidsErrorRate;
     double budgetErrorRate;
+
+    /** Current snapshot; null until the first one is published.  Swapped
+        with std::atomic_store so the readers never wait on the router loop.
+    */
+    std::shared_ptr<const StatsSnapshot> statsSnapshot;
+    double statsSnapshotPeriod;
+
+    size_t maxExpiriesPerPass;
+    int busyPollUs;
+
+    /** See setDuplicateAuctionWindow(). */
+    DuplicateAuctions duplicateAuctions;
+
+    /** See enableFrequencyCapping(); both null unless it was called. */
+    std::shared_ptr<FrequencyCapSketch> frequencyCaps;
+    std::unique_ptr<ZmqNamedMultipleSubscriber> frequencyCapWins;
+
+    /** Count the impressions of the accounts with low caps exactly. */
+    void updateExactFrequencyCaps();
+
+    /** See enableEligibilitySummaries(). */
+    bool eligibilitySummaries;
+    void updateEligibility();
+
+    /** See setWarmUpRequests().  warmedUp is read by the monitor. */
+    std::string warmUpFormat;
+    std::vector<std::string> warmUpRequests;
+    double warmUpTimeout;
+    std::atomic<bool> warmedUp;
+
     bool connectPostAuctionLoop;
     bool enableBidProbability;
 
@@ -629,8 +913,9 @@ public:
                         const std::string & exception,
                         Args... args)
     {
-        analyticsPublisher.publish("ROUTERERROR", Date::now().print(5),
-                       function, exception, args...);
+        analyticsPublisher.publish("ROUTERERROR",
+                                   [] { return Date::now().print(5); },
+                                   function, exception, args...);
         recordHit("error.%s", function);
     }
 
@@ -721,11 +1006,17 @@ public:
     bool logBids;
 
 
-    /** Log a given message to analyticsPublisher endpoint on given channel. */
+    /** Log a given message to analyticsPublisher endpoint on given channel.
+        Arguments that are callables are only called if the channel is
+        enabled; see AnalyticsPublisher::publish().
+    */
     template<typename... Args>
-    void logMessageToAnalytics(const std::string & channel, Args... args)
+    void logMessageToAnalytics(const std::string & channel,
+                               const Args & ... args)
     {
-        analyticsPublisher.publish(channel, Date::now().print(5), args...);
+        analyticsPublisher.publish(channel,
+                                   [] { return Date::now().print(5); },
+                                   args...);
     }
 
 
@@ -807,6 +1098,9 @@ public:
 
     double slowModeTolerance;
     Seconds augmentationWindow;
+
+    /** Monitor in the same process, if any; see setLocalMonitor(). */
+    RestServiceEndpoint * localMonitor;
 };
 
 
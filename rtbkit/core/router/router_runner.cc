@@ -16,13 +16,16 @@
 #include <boost/thread/thread.hpp>
 
 #include "rtbkit/common/bidder_interface.h"
+#include "rtbkit/common/auction_trace.h"
 #include "rtbkit/core/router/router.h"
 #include "rtbkit/core/banker/slave_banker.h"
 #include "rtbkit/core/banker/local_banker.h"
 #include "rtbkit/core/banker/split_banker.h"
 #include "rtbkit/core/banker/null_banker.h"
+#include "soa/service/allocation_counters.h"
 #include "soa/service/process_stats.h"
 #include "jml/arch/timers.h"
+#include "jml/arch/rt.h"
 #include "jml/utils/file_functions.h"
 
 using namespace std;
@@ -64,7 +67,21 @@ RouterRunner() :
     analyticsPublisherOn(false),
     analyticsPublisherConnections(1),
     augmentationWindowms(5),
-    dableSlowMode(false)
+    dableSlowMode(false),
+    numShards(0),
+    maxExpiriesPerPass(1000),
+    busyPollUs(0),
+    postAuctionBatch(0),
+    postAuctionCompression(false),
+    profileAllocations(false),
+    rejectIneligibleRequests(false),
+    duplicateAuctionWindowMs(0.0),
+    augmentationStart("all"),
+    augmentationCacheMb(0),
+    augmentationCacheMaxTtl(60.0),
+    warmUpFormat("datacratic"),
+    warmUpTimeout(10.0),
+    traceSampling(0)
 {
 }
 
@@ -118,7 +135,68 @@ doOptions(int argc, char ** argv,
          ("augmenter-timeout",value<int>(&augmentationWindowms),
          "configure the augmenter  timeout (in milliseconds)")
         ("no slow mode", value<bool>(&dableSlowMode)->zero_tokens(),
-         "disable the slow mode.");
+         "disable the slow mode.")
+        ("router-shards", value<unsigned>(&numShards),
+         "number of worker loops to spread the in-flight auctions over "
+         "(0 runs everything on the main router loop)")
+        ("max-expiries-per-pass", value<size_t>(&maxExpiriesPerPass),
+         "number of timed out auctions that a router loop expires at once; "
+         "the rest waits for the next pass")
+        ("busy-poll-us", value<int>(&busyPollUs),
+         "spin for up to this many microseconds polling for work before the "
+         "router loops sleep; each of them then takes a whole core")
+        ("post-auction-batch", value<size_t>(&postAuctionBatch),
+         "send up to this many submitted auctions per message to the post "
+         "auction loop; 0 sends them one by one")
+        ("post-auction-compression", bool_switch(&postAuctionCompression),
+         "LZ4 compress the batches of submitted auctions, for post auction "
+         "loops on other hosts")
+        ("duplicate-auction-window-ms",
+         value<double>(&duplicateAuctionWindowMs),
+         "drop the auctions whose id was already seen from the same exchange "
+         "within this many milliseconds; 0 lets them all through")
+        ("profile-allocations", bool_switch(&profileAllocations),
+         "count the allocations made in each profiled scope, such as "
+         "parseBidRequest, filter, augmentAuction, doBid and doSubmitted, "
+         "and record them in the profile stats; needs tcmalloc")
+        ("reject-ineligible-requests", bool_switch(&rejectIneligibleRequests),
+         "have the exchange connectors answer the bid requests that no agent "
+         "could bid on (exchange, creative formats, hour of the week) with a "
+         "no-bid before making auctions out of them")
+        ("frequency-capping", value<string>(&frequencyCapping),
+         "enforce the frequencyCap of the agent configs from the wins seen "
+         "by the post auction loops; the value is a JSON object of sketch "
+         "parameters (epsilon, delta, slotSeconds, numSlots, numShards, "
+         "exactThreshold), or {} for the defaults")
+        ("thread-affinity", value<vector<string> >(&threadAffinity),
+         "restrict a role's threads to some CPUs, as role=cpus; the role is "
+         "router, shards, augmentation or banker and the CPUs are a list "
+         "like 0-3,8 or node:N for the CPUs of a NUMA node")
+        ("augmentation-start", value<string>(&augmentationStart),
+         "when the agents start bidding on an augmented auction: all (once "
+         "every augmentor replied), group (each round robin group once its "
+         "augmentors replied) or speculative (each group once the augmentors "
+         "its agents require replied)")
+        ("augmentor-timeout", value<vector<string> >(&augmentorTimeouts),
+         "give up on an augmentor before the augmenter-timeout, as "
+         "name=milliseconds")
+        ("augmentation-cache-mb", value<int>(&augmentationCacheMb),
+         "memory for reusing the augmentations of a user that the augmentors "
+         "allow to be cached; 0 disables the cache")
+        ("augmentation-cache-max-ttl", value<double>(&augmentationCacheMaxTtl),
+         "longest time in seconds that a cached augmentation is reused")
+        ("warm-up-requests", value<string>(&warmUpRequestsFile),
+         "file of recorded bid requests, one per line, to run through the "
+         "parsers and filters before the router reports itself as ready")
+        ("warm-up-format", value<string>(&warmUpFormat),
+         "format of the warm-up requests, as understood by BidRequest::parse")
+        ("warm-up-timeout", value<double>(&warmUpTimeout),
+         "seconds to wait for the agents before warming up without them")
+        ("trace-sampling", value<uint32_t>(&traceSampling),
+         "trace the stages of one auction in this many; 0 disables it. "
+         "Must be the same in the router and the post auction loop")
+        ("trace-file", value<string>(&traceFile),
+         "file to which the auction traces are appended");
 
     options_description all_opt = opts;
     all_opt
@@ -159,6 +237,10 @@ init()
     if (!analyticsConfigurationFile.empty())
         analyticsConfig = loadJsonFromFile(analyticsConfigurationFile);
 
+    if (!traceFile.empty())
+        AuctionTrace::setSink(serviceName, AuctionTrace::fileSink(traceFile));
+    AuctionTrace::setSampling(traceSampling);
+
 
     const auto amountSlowModeMoneyLimit = Amount::parse(slowModeMoneyLimit);
     const auto maxBidPriceAmount = USD_CPM(maxBidPrice);
@@ -183,6 +265,20 @@ init()
                                       USD_CPM(maxBidPrice),
                                       slowModeTimeout, amountSlowModeMoneyLimit, augmentationWindow);
     router->slowModeTolerance = slowModeTolerance;
+    router->setNumShards(numShards);
+    router->setMaxExpiriesPerPass(maxExpiriesPerPass);
+    router->setBusyPoll(busyPollUs);
+    router->batchPostAuctionSubmissions(postAuctionBatch, postAuctionCompression);
+    router->setDuplicateAuctionWindow(duplicateAuctionWindowMs / 1000.0);
+    if (profileAllocations && !AllocationCounters::install())
+        throw ML::Exception("--profile-allocations needs a build with "
+                            "TCMALLOC_ENABLED=1");
+    router->enableEligibilitySummaries(rejectIneligibleRequests);
+    if (!frequencyCapping.empty()) {
+        FrequencyCapSketch::Params params;
+        params.fromJson(Json::parse(frequencyCapping));
+        router->enableFrequencyCapping(params);
+    }
     router->initBidderInterface(bidderConfig);
     if (dableSlowMode) {
        router->unsafeDisableSlowMode();
@@ -230,6 +326,51 @@ init()
     router->initExchanges(exchangeConfig);
     router->initFilters(filterConfig);
     router->bindTcp();
+
+    if (augmentationStart == "group")
+        router->augmentationLoop.setStartPolicy(AugmentationLoop::START_GROUPS_EARLY);
+    else if (augmentationStart == "speculative")
+        router->augmentationLoop.setStartPolicy(AugmentationLoop::SPECULATIVE);
+    else if (augmentationStart != "all")
+        THROW(error) << "invalid augmentation-start '" << augmentationStart
+                     << "': expected all, group or speculative" << endl;
+
+    if (augmentationCacheMb > 0)
+        router->augmentationLoop.setCache(size_t(augmentationCacheMb) << 20,
+                                          augmentationCacheMaxTtl);
+
+    for (const string & spec: augmentorTimeouts) {
+        auto pos = spec.find('=');
+        if (pos == string::npos)
+            THROW(error) << "invalid augmentor-timeout '" << spec
+                         << "': expected name=milliseconds" << endl;
+        router->augmentationLoop.setAugmentorTimeout(
+                spec.substr(0, pos), std::stod(spec.substr(pos + 1)));
+    }
+
+    for (const string & spec: threadAffinity) {
+        auto pos = spec.find('=');
+        if (pos == string::npos)
+            THROW(error) << "invalid thread-affinity '" << spec
+                         << "': expected role=cpus" << endl;
+        string role(spec, 0, pos);
+        auto cpus = ML::parseCpuList(spec.substr(pos + 1));
+
+        if (role == "banker") {
+            if (slaveBanker) slaveBanker->setThreadAffinity(cpus);
+            if (localBanker) localBanker->setThreadAffinity(cpus);
+        }
+        else router->setThreadAffinity(role, cpus);
+    }
+
+    if (!warmUpRequestsFile.empty()) {
+        ML::filter_istream stream(warmUpRequestsFile);
+        vector<string> requests;
+        for (string line;  getline(stream, line);)
+            if (!line.empty()) requests.push_back(std::move(line));
+        router->setWarmUpRequests(warmUpFormat, std::move(requests),
+                                  warmUpTimeout);
+    }
 }
 
 void
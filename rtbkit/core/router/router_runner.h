@@ -56,6 +56,25 @@ struct RouterRunner {
     int analyticsPublisherConnections;
     int augmentationWindowms;
     bool dableSlowMode;
+    unsigned numShards;
+    size_t maxExpiriesPerPass;
+    int busyPollUs;
+    size_t postAuctionBatch;
+    bool postAuctionCompression;
+    std::string frequencyCapping;
+    bool profileAllocations;
+    bool rejectIneligibleRequests;
+    double duplicateAuctionWindowMs;
+    std::vector<std::string> threadAffinity;
+    std::string augmentationStart;
+    std::vector<std::string> augmentorTimeouts;
+    int augmentationCacheMb;
+    double augmentationCacheMaxTtl;
+    std::string warmUpRequestsFile;
+    std::string warmUpFormat;
+    double warmUpTimeout;
+    uint32_t traceSampling;
+    std::string traceFile;
 
     void doOptions(int argc, char ** argv,
                    const boost::program_options::options_description & opts
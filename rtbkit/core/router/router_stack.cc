@@ -22,7 +22,8 @@ namespace RTBKIT {
 RouterStack::
 RouterStack(std::shared_ptr<ServiceProxies> services,
             const std::string & serviceName,
-            double secondsUntilLossAssumed)
+            double secondsUntilLossAssumed,
+            bool localTransport)
     : ServiceBase(serviceName, services),
       router(*this, "router", secondsUntilLossAssumed,
              false /* connect to post auction loop */),
@@ -30,6 +31,7 @@ RouterStack(std::shared_ptr<ServiceProxies> services,
       postAuctionLoop(*this, "postAuction"),
       config(services, "config"),
       monitor(services, "monitor"),
+      localTransport(localTransport),
       initialized(false)
 {
 }
@@ -51,17 +53,33 @@ init()
     auto bankerAddr = masterBanker.bindTcp().second;
     masterBanker.start();
 
-    budgetController.setApplicationLayer(make_application_layer<ZmqLayer>(getServices()));
+    // The local providers post to the monitor as soon as they're initialized
+    monitor.init({"router", "postAuction", "masterBanker"});
+    monitor.bindTcp();
+    monitor.start();
+
+    auto makeLayer = [=] () -> std::shared_ptr<ApplicationLayer>
+        {
+            if (localTransport)
+                return make_application_layer<LocalLayer>(&masterBanker);
+            return make_application_layer<ZmqLayer>(getServices());
+        };
+
+    budgetController.setApplicationLayer(makeLayer());
     budgetController.start();
 
     auto makeSlaveBanker = [=] (const std::string & name)
         {
             auto res = make_shared<SlaveBanker>(name);
-            res->setApplicationLayer(make_application_layer<ZmqLayer>(getServices()));
+            res->setApplicationLayer(makeLayer());
             res->start();
             return res;
         };
 
+    if (localTransport) {
+        postAuctionLoop.setLocalMonitor(&monitor);
+        router.setLocalMonitor(&monitor);
+    }
  
     // getServices()->config->dump(cerr);
 
@@ -74,10 +92,6 @@ init()
     router.setBanker(makeSlaveBanker("router"));
     router.bindTcp();
 
-    monitor.init({"router", "postAuction", "masterBanker"});
-    monitor.bindTcp();
-    monitor.start();
-
     initialized = true;
 }
 
@@ -135,7 +149,7 @@ numNonIdle() const
 {
     size_t numInFlight, numAwaitingAugmentation;
     {
-        numInFlight = router.inFlight.size();
+        numInFlight = router.numInFlight();
         numAwaitingAugmentation = router.augmentationLoop.numAugmenting();
     }
 
@@ -27,6 +27,11 @@ namespace RTBKIT {
     together.  This is mostly used for where we need an integrated component
     (simulations, etc); normally they would be run separately.
 
+    With localTransport, the bankers, the router and the post auction loop
+    talk to the master banker and the monitor through direct in-process
+    calls instead of zeromq.  The auctions submitted by the router always go
+    straight to the post auction loop's queue.
+
     \todo There's a lot of commonalities here between the
     rtbkit_integration_test's Components class.
 */
@@ -35,7 +40,8 @@ struct RouterStack: public ServiceBase {
     
     RouterStack(std::shared_ptr<ServiceProxies> services,
                 const std::string & serviceName = "routerStack",
-                double secondsUntilLossAssumed = 2.0);
+                double secondsUntilLossAssumed = 2.0,
+                bool localTransport = false);
 
     void init();
     
@@ -148,6 +154,7 @@ struct RouterStack: public ServiceBase {
 
     MonitorEndpoint monitor;
 
+    bool localTransport;
     bool initialized;
 };
 
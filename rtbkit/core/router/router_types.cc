@@ -8,6 +8,7 @@
 #include "router_types.h"
 #include "rtbkit/core/agent_configuration/agent_config.h"
 #include "jml/db/persistent.h"
+#include "soa/service/zmq_utils.h"
 
 using namespace std;
 using namespace ML;
@@ -109,6 +110,8 @@ toJson(bool includeConfig, bool includeStats) const
     result["numInFlight"] = status->numBidsInFlight;
     if (config && includeConfig) result["config"] = config->toJson(false);
     if (stats && includeStats) result["stats"] = stats->toJson();
+    if (config && config->throttle.enabled)
+        result["throttle"] = throttle.toJson();
     
     return result;
 }
@@ -124,6 +127,8 @@ const std::string &
 AgentInfo::
 encodeBidRequest(const Auction & auction) const
 {
+    if (bidRequestFormat == BRF_BINARY_V1)
+        return auction.requestBinary();
     return auction.requestStr;
 }
 
@@ -131,14 +136,39 @@ const std::string &
 AgentInfo::
 getBidRequestEncoding(const Auction & auction) const
 {
+    if (bidRequestFormat == BRF_BINARY_V1)
+        return BidRequest::BinaryFormat;
     return auction.requestStrFormat;
 }
 
+std::shared_ptr<const std::string>
+AgentInfo::
+encodeWinCostModel(const WinCostModel & wcm) const
+{
+    auto current = std::atomic_load(&winCostModelEncoding);
+    if (current
+            && current->model.name == wcm.name
+            && current->model.data == wcm.data)
+        return current->encoded;
+
+    auto encoding = std::make_shared<WinCostModelEncoding>();
+    encoding->model = wcm;
+    encoding->encoded = std::make_shared<std::string>(
+            chomp(wcm.toJson().toString()));
+    std::atomic_store(&winCostModelEncoding,
+                      std::shared_ptr<const WinCostModelEncoding>(encoding));
+    return encoding->encoded;
+}
+
 void
 AgentInfo::
 setBidRequestFormat(const std::string & val)
 {
-    // TODO
+    if (val == "jsonRaw")
+        bidRequestFormat = BRF_JSON_RAW;
+    else if (val == "binaryV1")
+        bidRequestFormat = BRF_BINARY_V1;
+    else throw ML::Exception("unknown bid request format " + val);
 }
 
 AgentStats::
@@ -146,6 +176,7 @@ AgentStats()
     : auctions(0), bids(0), wins(0), losses(0), tooLate(0),
       invalid(0), noBudget(0),
       tooManyInFlight(0), noSpots(0), skippedBidProbability(0),
+      throttled(0),
       urlFiltered(0), hourOfWeekFiltered(0),
       locationFiltered(0), languageFiltered(0),
       userPartitionFiltered(0),
@@ -187,6 +218,7 @@ toJson() const
 
     result["filter_noSpots"] = noSpots;
     result["filter_skippedBidProbability"] = skippedBidProbability;
+    result["filter_throttled"] = throttled;
     result["filter_urlFiltered"] = urlFiltered;
     result["filter_hourOfWeekFiltered"] = hourOfWeekFiltered;
     result["filter_locationFiltered"] = locationFiltered;
@@ -14,6 +14,7 @@
 #include <set>
 #include "rtbkit/common/currency.h"
 #include "rtbkit/common/bids.h"
+#include "agent_throttle.h"
 
 
 namespace RTBKIT {
@@ -58,6 +59,7 @@ struct AgentStats {
     uint64_t tooManyInFlight;
     uint64_t noSpots;
     uint64_t skippedBidProbability;
+    uint64_t throttled;
     uint64_t urlFiltered;
     uint64_t hourOfWeekFiltered;
     uint64_t locationFiltered;
@@ -94,7 +96,7 @@ struct AgentStats {
 
 struct AgentStatus {
     AgentStatus()
-        : dead(false), numBidsInFlight(0)
+        : dead(false), numBidsInFlight(0), throttleProbability(1.0)
     {
         lastHeartbeat = Date::now();
     }
@@ -102,6 +104,10 @@ struct AgentStatus {
     bool dead;
     Date lastHeartbeat;
     size_t numBidsInFlight;
+
+    /** Proportion of the auctions to send to the agent, set by the router
+        loop from its AgentThrottle. */
+    float throttleProbability;
 };
 
 /// Information about a agent
@@ -110,8 +116,7 @@ struct AgentInfo {
         : bidRequestFormat(BRF_JSON_RAW),
           configured(false),
           status(new AgentStatus()),
-          stats(new AgentStats()),
-          throttleProbability(1.0)
+          stats(new AgentStats())
     {
     }
 
@@ -126,7 +131,10 @@ struct AgentInfo {
     std::shared_ptr<AgentConfig> config;
     std::shared_ptr<AgentStatus> status;
     std::shared_ptr<AgentStats> stats;
-    double throttleProbability;
+
+    /** Controller of status->throttleProbability, used when the config
+        enables it. */
+    AgentThrottle throttle;
 
     /** Address of the zeromq socket for this agent. */
     std::string address;
@@ -139,9 +147,24 @@ struct AgentInfo {
     const std::string & encodeBidRequest(const Auction & auction) const;
     const std::string & getBidRequestEncoding(const Auction & auction) const;
 
+    /** Encode the win cost model to be sent along with an auction to this
+        agent.  The encoding is kept and shared while the model stays the
+        same, so that it's not serialized again for every auction.
+    */
+    std::shared_ptr<const std::string>
+    encodeWinCostModel(const WinCostModel & wcm) const;
+
     /** Set the bid request format. */
     void setBidRequestFormat(const std::string & val);
 
+    /** Last win cost model sent to this agent and its encoding.  Accessed
+        atomically as auctions are sent from several threads. */
+    struct WinCostModelEncoding {
+        WinCostModel model;
+        std::shared_ptr<const std::string> encoded;
+    };
+    mutable std::shared_ptr<const WinCostModelEncoding> winCostModelEncoding;
+
     /** Structure in which we record the information on ping timings. */
     struct PingInfo {
         PingInfo()
@@ -237,10 +260,11 @@ struct PotentialBidder {
     // If inFlightProp == NULL_PROP then the bidder has been filtered out.
     enum { NULL_PROP = 1000000 };
 
-    PotentialBidder() : inFlightProp(NULL_PROP) {}
+    PotentialBidder() : inFlightProp(NULL_PROP), filterIndex(-1) {}
 
     std::string agent;
     float inFlightProp;
+    unsigned filterIndex;   ///< Index of the config in the FilterPool
     BiddableSpots imp;
     std::shared_ptr<const AgentConfig> config;
     std::shared_ptr<AgentStats> stats;
@@ -287,15 +311,19 @@ struct BidInfo {
 
 // Information about an in-flight auction
 struct AuctionInfo : public AuctionInfoBase {
-    AuctionInfo() {}
+    AuctionInfo() : moreBatches(false) {}
     AuctionInfo(const std::shared_ptr<Auction> & auction,
                 Date lossTimeout)
-        : AuctionInfoBase(auction, lossTimeout)
+        : AuctionInfoBase(auction, lossTimeout), moreBatches(false)
     {
     }
 
     std::map<std::string, BidInfo> bidders;  ///< List of bidders
 
+    /** More groups of bidders are still being augmented, so the auction
+        can't finish once the current bidders are done. */
+    bool moreBatches;
+
 };
 
 struct FormatInfo {
@@ -363,6 +391,10 @@ struct BidMessage {
 
     std::string meta;
 
+    /** No-bid sent on behalf of agents that haven't answered by a deadline
+        shorter than the auction's.  It is silently dropped for the agents
+        that did answer, or if the auction is already over. */
+    bool deadline = false;
 };
 
 } // namespace RTBKIT
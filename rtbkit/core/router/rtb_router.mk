@@ -6,7 +6,9 @@
 
 LIB_FILTERS_SOURCES := \
 	filters/static_filters.cc \
-        filters/creative_filters.cc
+        filters/creative_filters.cc \
+        filters/frequency_cap_filter.cc \
+        filters/augmentation_filters.cc
 
 LIB_FILTERS_LINK := \
 	arch utils filter_registry agent_configuration rtb
@@ -15,13 +17,17 @@ $(eval $(call library,static_filters,$(LIB_FILTERS_SOURCES),$(LIB_FILTERS_LINK))
 
 LIBRTB_ROUTER_SOURCES := \
 	augmentation_loop.cc \
+	augmentation_cache.cc \
+	duplicate_auctions.cc \
 	router.cc \
 	router_types.cc \
 	router_stack.cc \
+	agent_throttle.cc \
+	compatibility_cache.cc \
 	filter_pool.cc
 
 LIBRTB_ROUTER_LINK := \
-	rtb zeromq boost_thread logger opstats crypto++ leveldb gc services redis banker gobanker agent_configuration monitor monitor_service post_auction static_filters openrtb
+	rtb zeromq boost_thread logger opstats crypto++ leveldb gc services redis banker gobanker agent_configuration monitor monitor_service post_auction static_filters openrtb worker_task
 
 $(eval $(call library,rtb_router,$(LIBRTB_ROUTER_SOURCES),$(LIBRTB_ROUTER_LINK)))
 
@@ -0,0 +1,93 @@
+/* agent_throttle_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test for the closed loop throttling of agents.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/router/agent_throttle.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include "jml/arch/exception_handler.h"
+
+
+using namespace std;
+using namespace RTBKIT;
+
+namespace {
+
+AgentConfig makeConfig()
+{
+    AgentConfig config;
+    config.account = { "test", "throttle" };
+    config.creatives.push_back(Creative::sampleLB);
+    config.maxInFlight = 100;
+    config.throttle.fromJson(Json::parse(
+        "{ \"minProbability\": 0.1, \"maxProbability\": 0.9,"
+        "  \"targetLatencyMs\": 10, \"maxTimeoutRate\": 0.1,"
+        "  \"increase\": 0.2, \"decrease\": 0.5 }"));
+    return config;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_throttle_aimd )
+{
+    AgentConfig config = makeConfig();
+    AgentThrottle throttle;
+
+    // Healthy agents are capped by maxProbability
+    throttle.recordResponse(5.0);
+    BOOST_CHECK_CLOSE(throttle.update(config, 10), 0.9, 1e-4);
+    BOOST_CHECK(!throttle.overloaded);
+
+    // Too slow: multiplicative decrease
+    throttle.recordResponse(15.0);
+    throttle.recordResponse(25.0);
+    BOOST_CHECK_CLOSE(throttle.update(config, 10), 0.45, 1e-4);
+    BOOST_CHECK(throttle.overloaded);
+    BOOST_CHECK_CLOSE(throttle.meanLatencyMs, 20.0, 1e-4);
+
+    // Too many timeouts
+    throttle.recordResponse(1.0);
+    throttle.recordTimeout();
+    BOOST_CHECK_CLOSE(throttle.update(config, 10), 0.225, 1e-4);
+    BOOST_CHECK_CLOSE(throttle.timeoutRate, 0.5, 1e-4);
+
+    // Too many in flight, which bottoms out at minProbability
+    throttle.update(config, 80);
+    BOOST_CHECK_CLOSE(throttle.update(config, 99), 0.1, 1e-4);
+
+    // Recovers additively, even without traffic
+    BOOST_CHECK_CLOSE(throttle.update(config, 0), 0.3, 1e-4);
+    BOOST_CHECK_CLOSE(throttle.update(config, 0), 0.5, 1e-4);
+    BOOST_CHECK(!throttle.overloaded);
+}
+
+BOOST_AUTO_TEST_CASE( test_throttle_config )
+{
+    AgentConfig config = makeConfig();
+
+    Json::Value json = config.toJson();
+    BOOST_REQUIRE(json.isMember("throttle"));
+
+    AgentConfig config2 = AgentConfig::createFromJson(json);
+    BOOST_CHECK(config2.throttle.enabled);
+    BOOST_CHECK_CLOSE(config2.throttle.minProbability, 0.1, 1e-4);
+    BOOST_CHECK_CLOSE(config2.throttle.targetLatencyMs, 10.0, 1e-4);
+    BOOST_CHECK_CLOSE(config2.throttle.maxInFlightRatio, 0.8, 1e-4);
+
+    BOOST_CHECK(!AgentConfig().throttle.enabled);
+    BOOST_CHECK(!AgentConfig().toJson(false).isMember("throttle"));
+
+    JML_TRACE_EXCEPTIONS(false);
+    AgentConfig::ThrottleConfig throttle;
+    BOOST_CHECK_THROW(throttle.fromJson(Json::parse("{\"decrease\": 1.5}")),
+                      ML::Exception);
+    BOOST_CHECK_THROW(throttle.fromJson(Json::parse("{\"minProbability\": 0}")),
+                      ML::Exception);
+    BOOST_CHECK_THROW(throttle.fromJson(Json::parse("{\"other\": 1}")),
+                      ML::Exception);
+}
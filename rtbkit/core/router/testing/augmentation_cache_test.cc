@@ -0,0 +1,89 @@
+/* augmentation_cache_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test for the augmentation cache.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/router/augmentation_cache.h"
+
+
+using namespace std;
+using namespace RTBKIT;
+
+namespace {
+
+AugmentationList makeAugmentation(const std::string & tag)
+{
+    Augmentation aug;
+    aug.tags.insert(tag);
+
+    AugmentationList result;
+    result.insertGlobal(aug);
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_augmentation_cache_ttl )
+{
+    AugmentationCache cache(1 << 20);
+    Date now = Date::now();
+
+    BOOST_CHECK(!cache.get("aug", "user", now));
+
+    cache.put("aug", "user", makeAugmentation("a"), now.plusSeconds(1), 10);
+
+    auto cached = cache.get("aug", "user", now);
+    BOOST_REQUIRE(cached);
+    BOOST_CHECK_EQUAL(cached->tagsForAccount(AccountKey()).at(0), "a");
+
+    // Keyed by augmentor and user
+    BOOST_CHECK(!cache.get("other", "user", now));
+    BOOST_CHECK(!cache.get("aug", "other", now));
+
+    // Gone once expired
+    BOOST_CHECK(!cache.get("aug", "user", now.plusSeconds(2)));
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+    BOOST_CHECK_EQUAL(cache.bytes(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_augmentation_cache_lru )
+{
+    AugmentationCache cache(1 << 20);
+    Date now = Date::now();
+    Date expiry = now.plusSeconds(10);
+
+    cache.put("aug", "u1", makeAugmentation("1"), expiry, 100);
+    size_t entryBytes = cache.bytes();
+
+    // Room for two entries
+    cache.setMaxBytes(2 * entryBytes);
+
+    cache.put("aug", "u2", makeAugmentation("2"), expiry, 100);
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+
+    // u1 becomes the most recently used so u2 is the one evicted
+    BOOST_CHECK(cache.get("aug", "u1", now));
+    cache.put("aug", "u3", makeAugmentation("3"), expiry, 100);
+
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+    BOOST_CHECK(cache.get("aug", "u1", now));
+    BOOST_CHECK(!cache.get("aug", "u2", now));
+    BOOST_CHECK(cache.get("aug", "u3", now));
+
+    // Replacing an entry doesn't count it twice
+    cache.put("aug", "u3", makeAugmentation("4"), expiry, 100);
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+    BOOST_CHECK_EQUAL(cache.bytes(), 2 * entryBytes);
+    BOOST_CHECK_EQUAL(cache.get("aug", "u3", now)->tagsForAccount(AccountKey()).at(0), "4");
+
+    // Disabled caches keep nothing
+    cache.setMaxBytes(0);
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+    cache.put("aug", "u1", makeAugmentation("1"), expiry, 100);
+    BOOST_CHECK(!cache.get("aug", "u1", now));
+}
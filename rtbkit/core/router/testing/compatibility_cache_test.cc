@@ -0,0 +1,155 @@
+/* compatibility_cache_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test for the cache of the exchange compatibility of the agents.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/router/compatibility_cache.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+
+
+using namespace std;
+using namespace RTBKIT;
+
+namespace {
+
+/** Counts the compatibility checks; creatives wider than 600 aren't
+    compatible. */
+struct CountingExchangeConnector : public ExchangeConnector {
+    CountingExchangeConnector(const string & name)
+        : ExchangeConnector(name), name(name),
+          campaigns(0), creatives(0)
+    {
+    }
+
+    string exchangeName() const { return name; }
+
+    void configure(const Json::Value & parameters) {}
+    void enableUntil(Date date) {}
+
+    ExchangeCompatibility
+    getCampaignCompatibility(const AgentConfig & config,
+                             bool includeReasons) const
+    {
+        ++campaigns;
+        ExchangeCompatibility result;
+        result.setCompatible();
+        return result;
+    }
+
+    ExchangeCompatibility
+    getCreativeCompatibility(const Creative & creative,
+                             bool includeReasons) const
+    {
+        ++creatives;
+        ExchangeCompatibility result;
+        if (creative.format.width > 600)
+            result.setIncompatible("too wide", includeReasons);
+        else result.setCompatible();
+        result.info = std::make_shared<int>(creative.format.width);
+        return result;
+    }
+
+    string name;
+    mutable int campaigns;
+    mutable int creatives;
+};
+
+AgentConfig makeConfig()
+{
+    AgentConfig config;
+    config.account = { "test", "compatibility" };
+    config.creatives.push_back(Creative::sampleLB);
+    config.creatives.push_back(Creative::sampleBB);
+    return config;
+}
+
+void configure(CompatibilityCache & cache,
+               const ExchangeConnector & exchange,
+               const string & agent,
+               const AgentConfig & config)
+{
+    cache.release(agent);
+    cache.campaign(exchange, agent, config, true);
+    for (auto & creative : config.creatives)
+        cache.creative(exchange, agent, creative, true);
+    cache.sweep();
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_compatibility_cache )
+{
+    CountingExchangeConnector exchange("counting");
+    CompatibilityCache cache;
+
+    AgentConfig config = makeConfig();
+    configure(cache, exchange, "agent1", config);
+    BOOST_CHECK_EQUAL(exchange.campaigns, 1);
+    BOOST_CHECK_EQUAL(exchange.creatives, 2);
+    BOOST_CHECK_EQUAL(cache.size(), 3);
+
+    // Results are the exchange's.
+    BOOST_CHECK(cache.creative(exchange, "agent1", config.creatives[0], true));
+    BOOST_CHECK(!cache.creative(exchange, "agent1", config.creatives[1], true));
+    BOOST_CHECK_EQUAL(
+            cache.creative(exchange, "agent1", config.creatives[1], true)
+            .reasons.size(), 1);
+
+    // A change to the campaign only recomputes the campaign.
+    config.maxInFlight = 42;
+    configure(cache, exchange, "agent1", config);
+    BOOST_CHECK_EQUAL(exchange.campaigns, 2);
+    BOOST_CHECK_EQUAL(exchange.creatives, 2);
+    BOOST_CHECK_EQUAL(cache.size(), 3);
+
+    // A changed creative is recomputed and the old one is forgotten.
+    config.creatives[1].name = "changed";
+    configure(cache, exchange, "agent1", config);
+    BOOST_CHECK_EQUAL(exchange.campaigns, 2);
+    BOOST_CHECK_EQUAL(exchange.creatives, 3);
+    BOOST_CHECK_EQUAL(cache.size(), 3);
+
+    // An identical agent shares everything.
+    configure(cache, exchange, "agent2", config);
+    BOOST_CHECK_EQUAL(exchange.campaigns, 2);
+    BOOST_CHECK_EQUAL(exchange.creatives, 3);
+    BOOST_CHECK_EQUAL(cache.size(), 3);
+
+    // The entries live as long as one agent uses them.
+    cache.release("agent1");
+    cache.sweep();
+    BOOST_CHECK_EQUAL(cache.size(), 3);
+    cache.release("agent2");
+    cache.sweep();
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_compatibility_cache_remove_exchange )
+{
+    CountingExchangeConnector exchange1("exchange1");
+    CountingExchangeConnector exchange2("exchange2");
+    CompatibilityCache cache;
+
+    AgentConfig config = makeConfig();
+    configure(cache, exchange1, "agent", config);
+    cache.campaign(exchange2, "agent", config, true);
+    BOOST_CHECK_EQUAL(cache.size(), 4);
+
+    // The replacement exchange is asked again.
+    cache.removeExchange("exchange1");
+    BOOST_CHECK_EQUAL(cache.size(), 1);
+
+    CountingExchangeConnector replacement("exchange1");
+    cache.campaign(replacement, "agent", config, true);
+    BOOST_CHECK_EQUAL(replacement.campaigns, 1);
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+
+    cache.release("agent");
+    cache.sweep();
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+}
@@ -0,0 +1,116 @@
+/* duplicate_auctions_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test for the detection of the duplicate auctions.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/router/duplicate_auctions.h"
+#include "jml/arch/timers.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+using namespace std;
+using namespace RTBKIT;
+
+
+BOOST_AUTO_TEST_CASE( test_duplicate_auctions_window )
+{
+    DuplicateAuctions duplicates;
+    BOOST_CHECK(!duplicates.enabled());
+    BOOST_CHECK(!duplicates.isDuplicate(1));
+    BOOST_CHECK(!duplicates.isDuplicate(1));
+
+    duplicates.init(0.05, 100000);
+    BOOST_CHECK(duplicates.enabled());
+    BOOST_CHECK_GE(duplicates.capacity(), 10000);
+    cerr << "capacity " << duplicates.capacity() << " for "
+         << duplicates.memoryBytes() << " bytes" << endl;
+
+    Date now = Date::now();
+
+    uint64_t key = DuplicateAuctions::key(Id("auction1"), "exchange1");
+    BOOST_CHECK(!duplicates.isDuplicate(key, now));
+    BOOST_CHECK(duplicates.isDuplicate(key, now.plusSeconds(0.01)));
+    BOOST_CHECK(duplicates.isDuplicate(key, now.plusSeconds(0.05)));
+
+    // Read by a thread whose clock is a little behind
+    BOOST_CHECK(duplicates.isDuplicate(key, now.plusSeconds(-0.001)));
+
+    // The same id is another auction on another exchange
+    uint64_t other = DuplicateAuctions::key(Id("auction1"), "exchange2");
+    BOOST_CHECK_NE(key, other);
+    BOOST_CHECK(!duplicates.isDuplicate(other, now));
+
+    // Once the window is over it's taken as a new auction
+    BOOST_CHECK(!duplicates.isDuplicate(key, now.plusSeconds(0.1)));
+    BOOST_CHECK(duplicates.isDuplicate(key, now.plusSeconds(0.11)));
+
+    BOOST_CHECK_THROW(duplicates.init(-1.0, 1000), ML::Exception);
+    duplicates.init(0.0, 1000);
+    BOOST_CHECK(!duplicates.enabled());
+}
+
+BOOST_AUTO_TEST_CASE( test_duplicate_auctions_capacity )
+{
+    DuplicateAuctions duplicates;
+    duplicates.init(0.1, 100000);
+
+    // A full window's worth of auctions are all found again.
+    Date now = Date::now();
+    size_t numAuctions = 10000;
+    for (size_t i = 0;  i < numAuctions;  ++i)
+        BOOST_CHECK(!duplicates.isDuplicate(DuplicateAuctions::key(Id(i), "ex"),
+                                            now));
+
+    size_t found = 0;
+    for (size_t i = 0;  i < numAuctions;  ++i)
+        found += duplicates.isDuplicate(DuplicateAuctions::key(Id(i), "ex"),
+                                        now);
+    cerr << found << " of " << numAuctions << " duplicates found" << endl;
+    BOOST_CHECK_GE(found, numAuctions * 0.99);
+
+    // Timing of the lookups
+    size_t numLookups = 10000000;
+    ML::Timer timer;
+    for (size_t i = 0;  i < numLookups;  ++i)
+        duplicates.isDuplicate(i * 0x9e3779b97f4a7c15ULL, now);
+    double elapsed = timer.elapsed_wall();
+    cerr << elapsed / numLookups * 1e9 << "ns per lookup" << endl;
+}
+
+BOOST_AUTO_TEST_CASE( test_duplicate_auctions_threads )
+{
+    DuplicateAuctions duplicates;
+    duplicates.init(1.0, 100000);
+
+    // Each auction is sent by every thread; one of them takes it, or very
+    // rarely two when they race to replace different words.
+    size_t numAuctions = 100000;
+    std::atomic<size_t> numNew(0);
+
+    auto run = [&] ()
+        {
+            Date now = Date::now();
+            for (size_t i = 0;  i < numAuctions;  ++i) {
+                uint64_t key = DuplicateAuctions::key(Id(i), "ex");
+                if (!duplicates.isDuplicate(key, now))
+                    ++numNew;
+            }
+        };
+
+    vector<thread> threads;
+    for (unsigned i = 0;  i < 4;  ++i)
+        threads.emplace_back(run);
+    for (auto & t : threads)
+        t.join();
+
+    cerr << numNew << " new auctions for " << numAuctions << endl;
+    BOOST_CHECK_GE(numNew, numAuctions);
+    BOOST_CHECK_LE(numNew, numAuctions * 1.01);
+}
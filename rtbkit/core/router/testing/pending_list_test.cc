@@ -10,6 +10,7 @@
 
 #include <boost/test/unit_test.hpp>
 #include "jml/arch/format.h"
+#include "jml/utils/file_functions.h"
 #include "soa/service/pending_list.h"
 #include "soa/types/id.h"
 #include "jml/utils/pair_utils.h"
@@ -116,3 +117,108 @@ BOOST_AUTO_TEST_CASE( test_router_init_persistence )
     BOOST_CHECK_EQUAL(pending.completePrefix(o, isPrefix), none);
 }
 
+
+namespace {
+
+struct TemporaryLeveldb {
+    TemporaryLeveldb(const std::string & name)
+        : path("./tmp/" + name + "-" + to_string(getpid()))
+    {
+        system(("rm -rf " + path + " && mkdir -p ./tmp").c_str());
+    }
+
+    ~TemporaryLeveldb()
+    {
+        system(("rm -rf " + path).c_str());
+    }
+
+    std::string path;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_leveldb_persistence_batching )
+{
+    TemporaryLeveldb tmp("pending_list_test_batching");
+
+    {
+        LeveldbPendingPersistence store;
+        store.open(tmp.path);
+        store.enableBatching(100, 10.0);
+
+        for (unsigned i = 0;  i < 250;  ++i)
+            store.put(format("key%03d", i), format("value%d", i));
+        store.erase("key007");
+        store.put("key008", "changed");
+
+        // Reads see what is not written yet
+        BOOST_CHECK_EQUAL(store.get("key249"), "value249");
+        BOOST_CHECK_EQUAL(store.get("key008"), "changed");
+        BOOST_CHECK_THROW(store.get("key007"), ML::Exception);
+        BOOST_CHECK_EQUAL(store.pop("key009"), "value9");
+        BOOST_CHECK_THROW(store.get("key009"), ML::Exception);
+
+        // Scanning writes everything first
+        int numEntries = 0;
+        store.scan([&] (std::string key, std::string value)
+                   {
+                       ++numEntries;
+                   },
+                   PendingPersistence::OnError());
+        BOOST_CHECK_EQUAL(numEntries, 248);
+
+        store.put("last", "written by the destructor");
+    }
+
+    LeveldbPendingPersistence store;
+    store.open(tmp.path);
+    BOOST_CHECK_EQUAL(store.get("last"), "written by the destructor");
+    BOOST_CHECK_EQUAL(store.get("key008"), "changed");
+    BOOST_CHECK_THROW(store.get("key007"), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( benchmark_leveldb_persistence_batching )
+{
+    enum { NumOps = 20000 };
+
+    auto run = [&] (bool sync, bool batched)
+        {
+            TemporaryLeveldb tmp("pending_list_test_bench");
+            LeveldbPendingPersistence store;
+            store.open(tmp.path);
+            store.sync = sync;
+            if (batched)
+                store.enableBatching();
+
+            Date start = Date::now();
+            for (unsigned i = 0;  i < NumOps;  ++i) {
+                std::string key = format("auction%d", i);
+                store.put(key, std::string(200, 'x'));
+                if (i >= 1000)
+                    store.erase(format("auction%d", i - 1000));
+            }
+            store.flush();
+            double elapsed = Date::now().secondsSince(start);
+
+            cerr << (sync ? "sync" : "async")
+                 << (batched ? " batched" : " per-op")
+                 << ": " << NumOps / elapsed << " puts/sec" << endl;
+        };
+
+    run(false, false);
+    run(false, true);
+    run(true, true);
+
+    // Synchronous writes one at a time are too slow to do many of them
+    enum { NumSyncOps = 500 };
+    TemporaryLeveldb tmp("pending_list_test_bench");
+    LeveldbPendingPersistence store;
+    store.open(tmp.path);
+    store.sync = true;
+    Date start = Date::now();
+    for (unsigned i = 0;  i < NumSyncOps;  ++i)
+        store.put(format("auction%d", i), std::string(200, 'x'));
+    cerr << "sync per-op: "
+         << NumSyncOps / Date::now().secondsSince(start) << " puts/sec"
+         << endl;
+}
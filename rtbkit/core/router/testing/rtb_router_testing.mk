@@ -6,9 +6,13 @@
 $(eval $(call nodejs_test,rtb_router_unit_test,rtb sync))
 $(eval $(call nodejs_test,rtb_new_format_test,bid_request sync_utils))
 #$(eval $(call test,rtb_router_leak_test,rtb_router rtbsim,boost valgrind))
-$(eval $(call test,pending_list_test,types,boost))
+$(eval $(call test,pending_list_test,types leveldb,boost))
 #$(eval $(call test,router_banker_test,rtb_router dataflow bidding_agent,boost))
 #$(eval $(call test,augmentation_test,rtb_router bid_request augmentor_base,boost))
+$(eval $(call test,augmentation_cache_test,rtb_router,boost))
+$(eval $(call test,duplicate_auctions_test,rtb_router,boost))
+$(eval $(call test,agent_throttle_test,rtb_router,boost))
+$(eval $(call test,compatibility_cache_test,rtb_router,boost))
 
 $(eval $(call test,router_analytics_test,boost_program_options rtb_router,boost))
 
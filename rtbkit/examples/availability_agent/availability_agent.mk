@@ -6,7 +6,7 @@ LIBAVAILABILITY_SOURCES := \
 	availability_agent.cc
 
 LIBAVAILABILITY_LINK := \
-	arch utils services types gc bidding_agent rtb_router opstats zmq jsoncpp boost_program_options
+	arch utils worker_task services types gc bidding_agent rtb_router opstats zmq jsoncpp boost_program_options
 
 $(eval $(call library,availability,$(LIBAVAILABILITY_SOURCES),$(LIBAVAILABILITY_LINK)))
 $(eval $(call program,availability_runner,availability))
@@ -9,8 +9,11 @@
 #include "availability_check.h"
 #include "jml/arch/timers.h"
 #include "jml/utils/guard.h"
+#include "jml/utils/worker_task.h"
 #include "rtbkit/core/router/router_types.h"
 
+#include <unordered_map>
+
 using namespace std;
 using namespace ML;
 using namespace RTBKIT;
@@ -22,14 +25,20 @@ namespace Datacratic {
 /******************************************************************************/
 
 AvailabilityCheck::
-AvailabilityCheck(size_t size) :
-    size(0), pos(0), requests(size)
+AvailabilityCheck(size_t size, unsigned numShards) :
+    size(0), pos(0), requests(size), checkCount(0)
 {
     pos = 0;
     for (size_t i = 0; i < requests.size(); ++i)
         requests[i] = NULL;
 
-    filters.initWithDefaultFilters();
+    if (!numShards) numShards = num_threads();
+    numShards = std::max<size_t>(1, std::min<size_t>(numShards, size));
+
+    for (unsigned i = 0; i < numShards; ++i) {
+        shards.emplace_back(new FilterPool);
+        shards.back()->initWithDefaultFilters();
+    }
 }
 
 
@@ -56,37 +65,11 @@ addRequest(const BidRequest& newRequest)
     }
 }
 
+namespace {
+
 Json::Value
-AvailabilityCheck::
-checkConfig(const AgentConfig& config)
+makeReport(const AgentStats& stats, uint64_t requestCount, uint64_t biddableCount)
 {
-    ML::Timer tm;
-
-    AgentInfo info;
-    info.config = std::make_shared<AgentConfig>(config);
-    info.stats = std::make_shared<AgentStats>();
-    const auto& stats = *info.stats;
-
-    filters.addConfig("config", info);
-    ML::Call_Guard guard([&] { filters.removeConfig("config"); });
-
-    uint64_t requestCount = 0;
-    uint64_t biddableCount = 0;
-
-    {
-        GcLock::SharedGuard guard(gcLock);
-
-        for (size_t i = 0; i < requests.size(); ++i) {
-            BidRequest* br = requests[i];
-            if (br == NULL) continue;
-
-            requestCount++;
-
-            FilterPool::ConfigList result = filters.filter(*br, nullptr);
-            if (!result.empty()) biddableCount++;
-        }
-    }
-
     auto makeFilter = [](const string& name, uint64_t value) {
         Json::Value val(Json::arrayValue);
         val.append(name);
@@ -114,16 +97,99 @@ checkConfig(const AgentConfig& config)
     report["total"] = requestCount;
     report["biddable"] = biddableCount;
     report["filters"] = filters;
+    return report;
+}
+
+} // namespace anonymous
+
+
+Json::Value
+AvailabilityCheck::
+checkConfig(const AgentConfig& config)
+{
+    return checkConfigs({ config })[0];
+}
+
+Json::Value
+AvailabilityCheck::
+checkConfigs(const vector<AgentConfig>& configs)
+{
+    ML::Timer tm;
+
+    uint64_t check = checkCount.fetch_add(1);
+
+    FilterPool::ConfigUpdates addUpdates, removeUpdates;
+    vector<AgentInfo> infos(configs.size());
+    unordered_map<const AgentConfig*, size_t> configIndex;
+
+    for (size_t i = 0; i < configs.size(); ++i) {
+        AgentInfo& info = infos[i];
+        info.config = std::make_shared<AgentConfig>(configs[i]);
+        info.stats = std::make_shared<AgentStats>();
+        configIndex[info.config.get()] = i;
+
+        string name = "check." + to_string(check) + "." + to_string(i);
+        addUpdates.add(name, info);
+        removeUpdates.remove(name);
+    }
+
+    // Every shard gets all the configs; since they all share the same
+    // AgentConfig objects the results of every shard map to the same index.
+    for (auto& shard : shards) shard->updateConfigs(addUpdates);
+    ML::Call_Guard guard([&] {
+                for (auto& shard : shards) shard->updateConfigs(removeUpdates);
+            });
+
+    size_t numShards = shards.size();
+    vector<uint64_t> requestCounts(numShards, 0);
+    vector< vector<uint64_t> > biddableCounts(
+            numShards, vector<uint64_t>(configs.size(), 0));
+
+    auto doShard = [&] (int shard)
+        {
+            FilterPool& filters = *shards[shard];
+            vector<uint64_t>& biddable = biddableCounts[shard];
+
+            size_t begin = requests.size() * shard / numShards;
+            size_t end = requests.size() * (shard + 1) / numShards;
+
+            for (size_t i = begin; i < end; ++i) {
+                BidRequest* br = requests[i];
+                if (br == NULL) continue;
+
+                requestCounts[shard]++;
+
+                FilterPool::ConfigList result = filters.filter(*br, nullptr);
+                for (const auto& entry : result)
+                    biddable[configIndex.at(entry.config.get())]++;
+            }
+        };
+
+    {
+        // The workers read the ring under our guard which keeps the requests
+        // that they see alive until they're done.
+        GcLock::SharedGuard guard(gcLock);
+        run_in_parallel(0, numShards, doShard);
+    }
+
+    uint64_t requestCount = 0;
+    for (uint64_t count : requestCounts) requestCount += count;
+
+    Json::Value reports(Json::arrayValue);
+    for (size_t i = 0; i < configs.size(); ++i) {
+        uint64_t biddableCount = 0;
+        for (const auto& shard : biddableCounts) biddableCount += shard[i];
+        reports.append(makeReport(*infos[i].stats, requestCount, biddableCount));
+    }
 
     if (onEvent) {
-        onEvent("checks", ET_COUNT, 1);
+        onEvent("checks", ET_COUNT, configs.size());
 
         uint64_t elapsedMicros = tm.elapsed_wall() * 1000000.0;
         onEvent("checkConfigMicros", ET_OUTCOME, elapsedMicros);
     }
 
-
-    return report;
+    return reports;
 }
 
 
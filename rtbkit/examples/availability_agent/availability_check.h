@@ -17,6 +17,7 @@
 #include "soa/service/stats_events.h"
 
 #include <atomic>
+#include <memory>
 #include <vector>
 
 namespace Datacratic {
@@ -33,11 +34,18 @@ namespace Datacratic {
     SWMR but could easily be expanded to MWMR if pos is atomically incremented
     before inserting the new element.
 
+    The ring is split into contiguous shards that are filtered in parallel,
+    each through its own FilterPool so that the shards never share a filter's
+    state or contend on a pool's lock.
+
 */
 struct AvailabilityCheck
 {
-    /** size is the total number of BidRequest to keep in the ring buffer. */
-    AvailabilityCheck(size_t size);
+    /** size is the total number of BidRequest to keep in the ring buffer and
+        numShards the number of parts in which it's split to be filtered in
+        parallel; 0 means one per thread.
+    */
+    AvailabilityCheck(size_t size, unsigned numShards = 0);
 
     /** Atomically adds a bid request to the ring buffer.
 
@@ -48,6 +56,15 @@ struct AvailabilityCheck
     /** Reports the effectiveness of each filters employed by the router. */
     Json::Value checkConfig(const RTBKIT::AgentConfig& config);
 
+    /** Same as checkConfig for each of the configs but they all go through
+        the filters together in a single pass over the recorded requests,
+        which costs little more than checking one of them. Returns an array
+        of the reports in the same order as the configs.
+
+        Thread-safe with concurrent calls to itself and to checkConfig.
+    */
+    Json::Value checkConfigs(const std::vector<RTBKIT::AgentConfig>& configs);
+
 
     /** Notify any attached logger that an event took place. */
     std::function<void(const std::string&, StatEventType, float)> onEvent;
@@ -58,7 +75,11 @@ private:
     std::vector<RTBKIT::BidRequest*> requests; // ring buffer.
     GcLock gcLock;
 
-    RTBKIT::FilterPool filters;
+    /** One pool per shard of the ring. */
+    std::vector< std::unique_ptr<RTBKIT::FilterPool> > shards;
+
+    /** Makes the names of the configs unique across concurrent checks. */
+    std::atomic<uint64_t> checkCount;
 };
 
 } // Recoset
@@ -23,6 +23,7 @@
 #include "soa/service/testing/redis_temporary_server.h"
 #include "rtbkit/testing/generic_exchange_connector.h"
 #include "rtbkit/testing/mock_exchange.h"
+#include "rtbkit/testing/load_generator.h"
 #include "rtbkit/testing/test_agent.h"
 #include "rtbkit/examples/mock_exchange_connector.h"
 #include "rtbkit/plugins/adserver/mock_adserver_connector.h"
@@ -460,6 +461,24 @@ int main(int argc, char ** argv)
         doCheckBanker("router2", components.router2.getBanker());
     }
 
+    // Capacity test: drive each exchange connector at the given rate with
+    // the open-loop load generator and report what it sustained.
+    Env_Option<double> capacityQps("RTBKIT_CAPACITY_QPS", 0.0);
+    if (capacityQps > 0) {
+        for (int port : components.exchangePorts) {
+            LoadGenerator::Config config;
+            config.port = port;
+            config.qps = capacityQps;
+            config.threads = 4;
+            config.connections = 64;
+            config.duration = 10.0;
+
+            auto results = LoadGenerator(config).run();
+            cerr << "capacity of port " << port << " at " << capacityQps
+                 << " qps: " << results.toJson() << endl;
+        }
+    }
+
     cerr << "SHUTDOWN\n";
     _exit(0);
     // Test is done; clean up time.
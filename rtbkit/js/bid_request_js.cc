@@ -40,6 +40,138 @@ void to_js(JS::JSValue & value, const Format & f)
 }
 
 
+/*****************************************************************************/
+/* CACHED PROPERTIES                                                         */
+/*****************************************************************************/
+
+/* The properties of the wrappers are converted on their first access and
+   the result is kept in a hidden value of the same name on the object, so
+   that an agent which looks at the same field several times, or from
+   several filters, pays for the conversion only once per request.  Setters
+   drop the cached value of their property.
+*/
+
+v8::Handle<v8::Value>
+getCached(v8::Handle<v8::Object> This, v8::Handle<v8::String> property)
+{
+    return This->GetHiddenValue(property);
+}
+
+v8::Handle<v8::Value>
+setCached(v8::Handle<v8::Object> This, v8::Handle<v8::String> property,
+          v8::Handle<v8::Value> value)
+{
+    This->SetHiddenValue(property, value);
+    return value;
+}
+
+void
+dropCached(v8::Handle<v8::Object> This, v8::Handle<v8::String> property)
+{
+    This->DeleteHiddenValue(property);
+}
+
+/** ASCII strings from this length on are handed to V8 as external strings
+    rather than copied into its heap. */
+enum { MinExternalStringLength = 32 };
+
+/** Characters of an external string.  It holds its own std::string, which
+    with the reference counted strings of the toolchains that this targets
+    shares the buffer of the field instead of copying it, and stays valid
+    whatever happens to the field afterwards.
+*/
+struct SharedAsciiString : public v8::String::ExternalAsciiStringResource {
+    SharedAsciiString(const std::string & str)
+        : str(str)
+    {
+    }
+
+    const char * data() const { return str.data(); }
+    size_t length() const { return str.length(); }
+
+    std::string str;
+};
+
+v8::Handle<v8::Value>
+toJSString(const std::string & str, bool isAscii)
+{
+    if (!isAscii || str.length() < MinExternalStringLength)
+        return JS::toJS(str);
+    return v8::String::NewExternal(new SharedAsciiString(str));
+}
+
+v8::Handle<v8::Value>
+toCachedJS(const std::string & str)
+{
+    return toJSString(str, Utf8String::isAscii(str.data(), str.length()));
+}
+
+v8::Handle<v8::Value>
+toCachedJS(const Utf8String & str)
+{
+    if (!str.isAscii())
+        return JS::toJS(str);
+    return toJSString(str.rawString(), true);
+}
+
+v8::Handle<v8::Value>
+toCachedJS(const Url & url)
+{
+    return toCachedJS(url.toString());
+}
+
+template<typename T>
+v8::Handle<v8::Value>
+toCachedJS(const T & value)
+{
+    return JS::toJS(value);
+}
+
+/** Property of a wrapped object whose conversion is cached. */
+template<typename T, typename Obj, typename Base>
+struct CachedProperty {
+    static v8::Handle<v8::Value>
+    getter(v8::Local<v8::String> property,
+           const v8::AccessorInfo & info)
+    {
+        try {
+            v8::Handle<v8::Value> cached = getCached(info.This(), property);
+            if (!cached.IsEmpty())
+                return cached;
+
+            T (Obj::* pm) = valueToPm<T, Obj>(info.Data());
+            const Obj & o = *Base::getShared(info.This());
+            return setCached(info.This(), property, toCachedJS(o.*pm));
+        } HANDLE_JS_EXCEPTIONS;
+    }
+
+    static void
+    setter(v8::Local<v8::String> property,
+           v8::Local<v8::Value> value,
+           const v8::AccessorInfo & info)
+    {
+        try {
+            T (Obj::* pm) = valueToPm<T, Obj>(info.Data());
+            Obj & o = *Base::getShared(info.This());
+            o.*pm = from_js(JSValue(value), (T *)0);
+            dropCached(info.This(), property);
+        } HANDLE_JS_EXCEPTIONS_SETTER;
+    }
+};
+
+template<typename Wrapper, typename T, typename Obj>
+void registerCachedProperty(T (Obj::* ptr), const char * name)
+{
+    Wrapper::tmpl->InstanceTemplate()
+        ->SetAccessor(v8::String::NewSymbol(name),
+                      CachedProperty<T, Obj, Wrapper>::getter,
+                      CachedProperty<T, Obj, Wrapper>::setter,
+                      pmToValue(ptr),
+                      v8::DEFAULT,
+                      v8::PropertyAttribute(v8::DontDelete));
+}
+
+
 /*****************************************************************************/
 /* SEGMENT LIST JS                                                           */
 /*****************************************************************************/
@@ -101,6 +233,11 @@ struct SegmentListJS
             ->SetAccessor(String::NewSymbol("length"), lengthGetter,
                           0, v8::Handle<v8::Value>(), DEFAULT,
                           PropertyAttribute(ReadOnly | DontEnum | DontDelete));
+
+        t->InstanceTemplate()
+            ->SetAccessor(String::NewSymbol("ints"), intsGetter,
+                          0, v8::Handle<v8::Value>(), DEFAULT,
+                          PropertyAttribute(ReadOnly | DontEnum | DontDelete));
                           
         t->InstanceTemplate()
             ->SetIndexedPropertyHandler(getIndexed, setIndexed, queryIndexed,
@@ -114,10 +251,47 @@ struct SegmentListJS
             auto segs = getShared(args.This());
             segs->add(getArg<string>(args, 0, "segment"));
             segs->sort();
+
+            // The integers may have moved
+            v8::Handle<v8::Value> ints
+                = getCached(args.This(), String::NewSymbol("ints"));
+            if (!ints.IsEmpty())
+                setIntsData(ints->ToObject(), *segs);
+
             return args.This();
         } HANDLE_JS_EXCEPTIONS;
     }
 
+    static void
+    setIntsData(v8::Handle<v8::Object> ints, SegmentList & segs)
+    {
+        ints->SetIndexedPropertiesToExternalArrayData
+            (segs.ints.unsafe_raw_data(), v8::kExternalIntArray,
+             segs.ints.size());
+        ints->Set(String::NewSymbol("length"),
+                  v8::Integer::New(segs.ints.size()),
+                  PropertyAttribute(ReadOnly | DontEnum));
+    }
+
+    /** The integer segments as an Int32Array-like view of the list, without
+        any conversion.  The view keeps the list alive. */
+    static v8::Handle<v8::Value>
+    intsGetter(v8::Local<v8::String> property,
+               const AccessorInfo & info)
+    {
+        try {
+            v8::Handle<v8::Value> cached = getCached(info.This(), property);
+            if (!cached.IsEmpty())
+                return cached;
+
+            v8::Handle<v8::Object> ints = v8::Object::New();
+            setIntsData(ints, *getShared(info.This()));
+            ints->SetHiddenValue(String::NewSymbol("segmentList"),
+                                 info.This());
+            return setCached(info.This(), property, ints);
+        } HANDLE_JS_EXCEPTIONS;
+    }
+
     static v8::Handle<v8::Value>
     forEach(const Arguments & args)
     {
@@ -358,16 +532,34 @@ struct SegmentsBySourceJS
                                       deleteNamed, listNamed);
     }
 
+    /** Wrapper of the list of a source.  The same wrapper, and so its
+        cached properties, is returned for as long as the source has the same
+        list. */
+    static v8::Handle<v8::Value>
+    getList(v8::Handle<v8::Object> This, const std::string & name,
+            v8::Handle<v8::String> key)
+    {
+        SegmentsBySource * segs = getShared(This);
+
+        auto it = segs->find(name);
+        if (it == segs->end())
+            return NULL_HANDLE;
+
+        v8::Handle<v8::Value> cached = getCached(This, key);
+        if (!cached.IsEmpty()
+            && SegmentListJS::getShared(cached) == it->second.get())
+            return cached;
+
+        return setCached(This, key, JS::toJS(it->second));
+    }
+
     static v8::Handle<v8::Value>
     getIndexed(uint32_t index, const v8::AccessorInfo & info)
     {
         try {
-            SegmentsBySource * segs = getShared(info.This());
-
             string strIdx = to_string(index);
-            return (segs->count(strIdx) > 0
-                    ? JS::toJS(segs->at(strIdx))
-                    : NULL_HANDLE);
+            return getList(info.This(), strIdx,
+                           v8::String::New(strIdx.c_str(), strIdx.length()));
         } HANDLE_JS_EXCEPTIONS;
     }
 
@@ -424,14 +616,7 @@ struct SegmentsBySourceJS
                 return scope.Close(object_prop);
             
             // Is it a column name?
-            string name = cstr(property);
-            
-            SegmentsBySource * segs = getShared(info.This());
-            
-            if (!segs->count(name))
-                return NULL_HANDLE;
-
-            return scope.Close(JS::toJS(segs->find(name)->second));
+            return scope.Close(getList(info.This(), cstr(property), property));
         } HANDLE_JS_EXCEPTIONS;
     }
 
@@ -1346,6 +1531,10 @@ struct PropertyAccessViaDescription {
            const v8::AccessorInfo & info)
     {
         try {
+            v8::Handle<v8::Value> cached = getCached(info.This(), property);
+            if (!cached.IsEmpty())
+                return cached;
+
             const ValueDescription * vd
                 = reinterpret_cast<const ValueDescription *>
                 (v8::External::Unwrap(info.Data()));
@@ -1353,7 +1542,9 @@ struct PropertyAccessViaDescription {
             Obj * o = p.get();
             const StructureDescriptionBase::FieldDescription & fd
                 = vd->getField(cstr(property));
-            return getFromJs(addOffset(o, fd.offset), *fd.description, p);
+            return setCached(info.This(), property,
+                             getFromJs(addOffset(o, fd.offset),
+                                       *fd.description, p));
         } HANDLE_JS_EXCEPTIONS;
     }
 
@@ -1370,6 +1561,7 @@ struct PropertyAccessViaDescription {
             const StructureDescriptionBase::FieldDescription & fd
                 = vd->getField(cstr(property));
             setFromJs(addOffset(o, fd.offset), value, *fd.description);
+            dropCached(info.This(), property);
         } HANDLE_JS_EXCEPTIONS_SETTER;
     }
 };
@@ -1568,16 +1760,16 @@ struct BidRequestJS
         registerRWProperty(&BidRequest::timeAvailableMs, "timeAvailableMs", v8::DontDelete);
         registerRWProperty(&BidRequest::timestamp, "timestamp", v8::DontDelete);
         registerRWProperty(&BidRequest::isTest, "isTest", v8::DontDelete);
-        registerRWProperty(&BidRequest::url, "url", v8::DontDelete);
-        registerRWProperty(&BidRequest::meta, "meta", v8::DontDelete);
-        registerRWProperty(&BidRequest::ipAddress, "ipAddress", v8::DontDelete);
-        registerRWProperty(&BidRequest::userAgent, "userAgent", v8::DontDelete);
-        registerRWProperty(&BidRequest::language, "language", v8::DontDelete);
-        registerRWProperty(&BidRequest::protocolVersion,
-                           "protocolVersion", v8::DontDelete);
-        registerRWProperty(&BidRequest::exchange, "exchange", v8::DontDelete);
-        registerRWProperty(&BidRequest::provider, "provider", v8::DontDelete);
-        registerRWProperty(&BidRequest::ext, "ext", v8::DontDelete);
+        registerCachedProperty<BidRequestJS>(&BidRequest::url, "url");
+        registerCachedProperty<BidRequestJS>(&BidRequest::meta, "meta");
+        registerCachedProperty<BidRequestJS>(&BidRequest::ipAddress, "ipAddress");
+        registerCachedProperty<BidRequestJS>(&BidRequest::userAgent, "userAgent");
+        registerCachedProperty<BidRequestJS>(&BidRequest::language, "language");
+        registerCachedProperty<BidRequestJS>(&BidRequest::protocolVersion,
+                                             "protocolVersion");
+        registerCachedProperty<BidRequestJS>(&BidRequest::exchange, "exchange");
+        registerCachedProperty<BidRequestJS>(&BidRequest::provider, "provider");
+        registerCachedProperty<BidRequestJS>(&BidRequest::ext, "ext");
 
         static DefaultDescription<BidRequest> desc;
 
@@ -1641,13 +1833,18 @@ struct BidRequestJS
                   const v8::AccessorInfo & info)
     {
         try {
+            // A view of the member, which stays valid through its setter
+            v8::Handle<v8::Value> cached = getCached(info.This(), property);
+            if (!cached.IsEmpty())
+                return cached;
+
             v8::Handle<v8::Value> segs
                 = SegmentsBySourceJS::toJS
                 (ML::make_unowned_std_sp(getShared(info.This())->segments));
             SegmentsBySourceJS * wrapper
                 = SegmentsBySourceJS::getWrapper(segs);
             wrapper->owner_ = getSharedPtr(info.This());
-            return segs;
+            return setCached(info.This(), property, segs);
         } HANDLE_JS_EXCEPTIONS;
     }
 
@@ -1678,13 +1875,18 @@ struct BidRequestJS
                   const v8::AccessorInfo & info)
     {
         try {
+            // A view of the member, which stays valid through its setter
+            v8::Handle<v8::Value> cached = getCached(info.This(), property);
+            if (!cached.IsEmpty())
+                return cached;
+
             v8::Handle<v8::Value> segs
                 = SegmentsBySourceJS::toJS
                 (ML::make_unowned_std_sp(getShared(info.This())->restrictions));
             SegmentsBySourceJS * wrapper
                 = SegmentsBySourceJS::getWrapper(segs);
             wrapper->owner_ = getSharedPtr(info.This());
-            return segs;
+            return setCached(info.This(), property, segs);
         } HANDLE_JS_EXCEPTIONS;
     }
 
@@ -1715,8 +1917,13 @@ struct BidRequestJS
                   const v8::AccessorInfo & info)
     {
         try {
+            v8::Handle<v8::Value> cached = getCached(info.This(), property);
+            if (!cached.IsEmpty())
+                return cached;
+
             auto owner = getSharedPtr(info.This());
-            return UserIdsJS::toJS(owner->userIds, owner);
+            return setCached(info.This(), property,
+                             UserIdsJS::toJS(owner->userIds, owner));
         } HANDLE_JS_EXCEPTIONS;
     }
 
@@ -1750,8 +1957,13 @@ struct BidRequestJS
                   const v8::AccessorInfo & info)
     {
         try {
+            v8::Handle<v8::Value> cached = getCached(info.This(), property);
+            if (!cached.IsEmpty())
+                return cached;
+
             auto owner = getSharedPtr(info.This());
-            return LocationJS::toJS(owner->location, owner);
+            return setCached(info.This(), property,
+                             LocationJS::toJS(owner->location, owner));
         } HANDLE_JS_EXCEPTIONS;
     }
 
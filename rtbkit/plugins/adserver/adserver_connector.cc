@@ -43,6 +43,7 @@ initAnalytics(const Json::Value & config)
 
     Analytics::Factory factory = PluginInterface<Analytics>::getPlugin(pluginName);
     analytics.reset(factory(serviceName(), getServices()));
+    analytics->configure(config);
     
     // And initialize the generic publisher on a predefined range of ports to try avoiding that
     // collision between different kind of service occurs.
@@ -62,6 +63,13 @@ init(shared_ptr<ConfigurationService> config)
     toPostAuctionService_.init();
 }
 
+void
+AdServerConnector::
+batchPostAuctionEvents(size_t maxEvents)
+{
+    toPostAuctionService_.enableBatching(maxEvents);
+}
+
 void
 AdServerConnector::
 start()
@@ -75,6 +83,7 @@ void
 AdServerConnector::
 shutdown()
 {
+    toPostAuctionService_.shutdown();
     if (analytics) analytics->shutdown();
 }
 
@@ -36,6 +36,12 @@ struct AdServerConnector : public Datacratic::ServiceBase
     
     void init(std::shared_ptr<ConfigurationService> config);
 
+    /** Forward up to maxEvents events at a time to each post auction loop
+        instead of one message per event. Must be called before init() and
+        requires post auction loops that accept EVENTS messages.
+    */
+    void batchPostAuctionEvents(size_t maxEvents);
+
     virtual void shutdown();
 
     virtual void start();
@@ -19,8 +19,9 @@ using namespace RTBKIT;
 
 HttpAdServerConnectionHandler::
 HttpAdServerConnectionHandler(HttpAdServerHttpEndpoint & endpoint,
-                              const HttpAdServerRequestCb & requestCb)
-    : endpoint_(endpoint), requestCb_(requestCb)
+                              const HttpAdServerRequestCb & requestCb,
+                              const HttpAdServerPayloadCb & payloadCb)
+    : endpoint_(endpoint), requestCb_(requestCb), payloadCb_(payloadCb)
 {
 }
 
@@ -35,10 +36,40 @@ handleUnknownHeader(const HttpHeader& header) {
     throw ML::Exception("Unknown resource '" + header.resource + "'");
 }
 
+void
+HttpAdServerConnectionHandler::
+handleHttpPayload(const HttpHeader & header, const string & payload)
+{
+    if (!payloadCb_) {
+        JsonConnectionHandler::handleHttpPayload(header, payload);
+        return;
+    }
+
+    // The payload is only turned into a Json::Value to report an error.
+    auto getJson = [&] () {
+        try {
+            return Json::parse(payload);
+        } catch (const exception & exc) {
+            return Json::Value(payload);
+        }
+    };
+
+    handleRequest([&] () { return payloadCb_(header, payload); }, getJson);
+}
+
 void
 HttpAdServerConnectionHandler::
 handleJson(const HttpHeader & header, const Json::Value & json,
            const string & jsonStr)
+{
+    handleRequest([&] () { return requestCb_(header, json, jsonStr); },
+                  [&] () { return json; });
+}
+
+void
+HttpAdServerConnectionHandler::
+handleRequest(const function<HttpAdServerResponse ()> & request,
+              const function<Json::Value ()> & getJson)
 {
     string resultMsg;
 
@@ -54,7 +85,7 @@ handleJson(const HttpHeader & header, const Json::Value & json,
     };
 
     try {
-        HttpAdServerResponse returnValue = requestCb_(header, json, jsonStr);
+        HttpAdServerResponse returnValue = request();
         if(returnValue.valid) {
             resultMsg = ("HTTP/1.1 200 OK\r\n"
                      "Content-Type: none\r\n"
@@ -63,10 +94,11 @@ handleJson(const HttpHeader & header, const Json::Value & json,
         }
         else {
             endpoint_.doEvent("error.rqParsingError");
-            resultMsg = sendErrorResponse(returnValue.error, returnValue.details, json);
+            resultMsg = sendErrorResponse(returnValue.error, returnValue.details, getJson());
         }
     }
     catch (const exception & exc) {
+        Json::Value json = getJson();
         cerr << "error parsing adserver request " << json << ": "
              << exc.what() << endl;
         endpoint_.doEvent("error.rqParsingError");
@@ -110,12 +142,20 @@ HttpAdServerHttpEndpoint(int port, const HttpAdServerRequestCb & requestCb)
 {
 }
 
+HttpAdServerHttpEndpoint::
+HttpAdServerHttpEndpoint(int port, const HttpAdServerPayloadCb & payloadCb)
+    : HttpEndpoint("adserver-ep-" + to_string(port)),
+      port_(port), payloadCb_(payloadCb)
+{
+}
+
 HttpAdServerHttpEndpoint::
 HttpAdServerHttpEndpoint(HttpAdServerHttpEndpoint && otherEndpoint)
 : HttpEndpoint("adserver-ep-" + to_string(otherEndpoint.port_))
 {
     port_ = otherEndpoint.port_;
     requestCb_ = otherEndpoint.requestCb_;
+    payloadCb_ = otherEndpoint.payloadCb_;
 }
 
 HttpAdServerHttpEndpoint::
@@ -131,6 +171,7 @@ operator = (const HttpAdServerHttpEndpoint& other)
     if (this != &other) {
         port_ = other.port_;
         requestCb_ = other.requestCb_;
+        payloadCb_ = other.payloadCb_;
     }
 
     return *this;
@@ -148,7 +189,8 @@ shared_ptr<ConnectionHandler>
 HttpAdServerHttpEndpoint::
 makeNewHandler()
 {
-    return std::make_shared<HttpAdServerConnectionHandler>(*this, requestCb_);
+    return std::make_shared<HttpAdServerConnectionHandler>(*this, requestCb_,
+                                                           payloadCb_);
 }
 
 
@@ -159,7 +201,8 @@ makeNewHandler()
 HttpAdServerConnector::
 HttpAdServerConnector(const string & serviceName,
                       const shared_ptr<Datacratic::ServiceProxies> & proxy)
-    : AdServerConnector(serviceName, proxy)
+    : AdServerConnector(serviceName, proxy),
+      numThreads_(4)
 {
 }
 
@@ -170,6 +213,13 @@ registerEndpoint(int port, const HttpAdServerRequestCb & requestCb)
     endpoints_.emplace_back(port, requestCb);
 }
 
+void
+HttpAdServerConnector::
+registerPayloadEndpoint(int port, const HttpAdServerPayloadCb & payloadCb)
+{
+    endpoints_.emplace_back(port, payloadCb);
+}
+
 void
 HttpAdServerConnector::
 init(const shared_ptr<ConfigurationService> & config)
@@ -198,7 +248,7 @@ HttpAdServerConnector::
 bindTcp()
 {
     for (HttpAdServerHttpEndpoint & endpoint: endpoints_) {
-        endpoint.init(endpoint.getPort(), "0.0.0.0", 4);
+        endpoint.init(endpoint.getPort(), "0.0.0.0", numThreads_);
     }
 }
 
@@ -40,22 +40,37 @@ typedef std::function<HttpAdServerResponse (const HttpHeader & header,
                             const std::string & jsonStr)>
     HttpAdServerRequestCb;
 
+/** Callback that gets the raw payload instead, for connectors that would
+    rather parse it themselves than go through a Json::Value.
+*/
+typedef std::function<HttpAdServerResponse (const HttpHeader & header,
+                            const std::string & payload)>
+    HttpAdServerPayloadCb;
+
 struct HttpAdServerConnectionHandler
     : public Datacratic::JsonConnectionHandler {
     HttpAdServerConnectionHandler(HttpAdServerHttpEndpoint & endpoint,
-                                  const HttpAdServerRequestCb & requestCb);
+                                  const HttpAdServerRequestCb & requestCb,
+                                  const HttpAdServerPayloadCb & payloadCb);
 
     virtual void handleUnknownHeader(const HttpHeader& header);
 
+    virtual void handleHttpPayload(const HttpHeader & header,
+                                   const std::string & payload);
+
     virtual void handleJson(const HttpHeader & header,
                             const Json::Value & json,
                             const std::string & jsonStr);
 
 private:
+    void handleRequest(const std::function<HttpAdServerResponse ()> & request,
+                       const std::function<Json::Value ()> & getJson);
+
     std::string sendErrorResponse(const std::string & error, const std::string & details, const Json::Value & json);
     
     HttpAdServerHttpEndpoint & endpoint_;
     const HttpAdServerRequestCb & requestCb_;
+    const HttpAdServerPayloadCb & payloadCb_;
 };
 
 
@@ -66,6 +81,8 @@ private:
 struct HttpAdServerHttpEndpoint : public Datacratic::HttpEndpoint {
     HttpAdServerHttpEndpoint(int port,
                              const HttpAdServerRequestCb & requestCb);
+    HttpAdServerHttpEndpoint(int port,
+                             const HttpAdServerPayloadCb & payloadCb);
     HttpAdServerHttpEndpoint(HttpAdServerHttpEndpoint && otherEndpoint);
 
     ~HttpAdServerHttpEndpoint();
@@ -98,6 +115,7 @@ struct HttpAdServerHttpEndpoint : public Datacratic::HttpEndpoint {
 private:
     int port_;
     HttpAdServerRequestCb requestCb_;
+    HttpAdServerPayloadCb payloadCb_;
 };
         
 /****************************************************************************/
@@ -113,6 +131,11 @@ struct HttpAdServerConnector : public AdServerConnector {
     }
 
     void registerEndpoint(int port, const HttpAdServerRequestCb & requestCb);
+    void registerPayloadEndpoint(int port, const HttpAdServerPayloadCb & payloadCb);
+
+    /** Number of threads serving each of the endpoints. Must be set before
+        bindTcp(). */
+    void setNumThreads(int threads) { numThreads_ = threads; }
 
     void init(const std::shared_ptr<ConfigurationService> & config);
     void shutdown();
@@ -125,6 +148,7 @@ struct HttpAdServerConnector : public AdServerConnector {
 
 private:
     std::vector<HttpAdServerHttpEndpoint> endpoints_;
+    int numThreads_;
 };
 
 } //namespace RTBKIT
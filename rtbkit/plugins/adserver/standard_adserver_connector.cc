@@ -11,6 +11,7 @@
 #include "soa/service/service_base.h"
 #include "soa/service/service_utils.h"
 #include "soa/types/date.h"
+#include "soa/types/json_parsing.h"
 
 #include "standard_adserver_connector.h"
 
@@ -37,8 +38,11 @@ StandardAdServerConnector(std::string const & serviceName,
     verbose = json.get("verbose", false).asBool();
     bool analytics = json.get("analytics", false).asBool();
     int conns = json.get("analytics-connections", 16).asInt();
+    bool streaming = json.get("streamingParser", true).asBool();
+    setNumThreads(json.get("threads", 4).asInt());
+    batchPostAuctionEvents(json.get("batchEvents", 0).asInt());
     initEventType(json);
-    init(winPort, eventsPort, verbose, analytics, conns);
+    init(winPort, eventsPort, verbose, analytics, conns, streaming);
 }
 
 void
@@ -63,7 +67,8 @@ initEventType(const Json::Value &json) {
 void
 StandardAdServerConnector::
 init(int winsPort, int eventsPort, bool verbose, 
-     bool analyticsPublisherOn, int analyticsPublisherConnections)
+     bool analyticsPublisherOn, int analyticsPublisherConnections,
+     bool streaming)
 {
     if(!verbose) {
         adserverTrace.deactivate();
@@ -71,11 +76,20 @@ init(int winsPort, int eventsPort, bool verbose,
 
     shared_ptr<ServiceProxies> services = getServices();
 
-    auto win = &StandardAdServerConnector::handleWinRq;
-    registerEndpoint(winsPort, bind(win, this, _1, _2, _3));
+    if (streaming) {
+        auto win = &StandardAdServerConnector::handleWinPayload;
+        registerPayloadEndpoint(winsPort, bind(win, this, _1, _2));
 
-    auto delivery = &StandardAdServerConnector::handleDeliveryRq;
-    registerEndpoint(eventsPort, bind(delivery, this, _1, _2, _3));
+        auto delivery = &StandardAdServerConnector::handleDeliveryPayload;
+        registerPayloadEndpoint(eventsPort, bind(delivery, this, _1, _2));
+    }
+    else {
+        auto win = &StandardAdServerConnector::handleWinRq;
+        registerEndpoint(winsPort, bind(win, this, _1, _2, _3));
+
+        auto delivery = &StandardAdServerConnector::handleDeliveryRq;
+        registerEndpoint(eventsPort, bind(delivery, this, _1, _2, _3));
+    }
 
     HttpAdServerConnector::init(services->config);
 
@@ -124,40 +138,155 @@ errorResponseHelper(HttpAdServerResponse & resp,
     resp.details = details;
 }
 
+StandardAdServerConnector::Notice
+StandardAdServerConnector::
+parseNotice(const Json::Value & json)
+{
+    Notice notice;
+
+    if (json.isMember("timestamp")) {
+        notice.hasTimestamp = true;
+        if(json["timestamp"].isString()) {
+           double tm = stod(json["timestamp"].asString());
+           notice.timestamp = Date::fromSecondsSinceEpoch(tm);
+        } else {
+            notice.timestamp = Date::fromSecondsSinceEpoch(json["timestamp"].asDouble());
+        }
+    }
+
+    if (json.isMember("bidRequestId")) {
+        notice.hasBidRequestId = true;
+        notice.bidRequestId = json["bidRequestId"].asString();
+    }
+
+    if (json.isMember("impid")) {
+        notice.hasImpId = true;
+        notice.impId = json["impid"].asString();
+    }
+
+    if (json.isMember("price")) {
+        notice.hasPrice = true;
+        notice.price = json["price"].asDouble();
+    }
+
+    if (json.isMember("type")) {
+        notice.hasType = true;
+        notice.type = json["type"].asString();
+    }
+
+    if (json.isMember("userIds")) {
+        auto item =  json["userIds"];
+        if(!item.empty()) {
+            notice.hasUserId = true;
+            notice.userId = item[0].asString();
+        }
+    }
+
+    if (json.isMember("passback")) {
+        notice.passback =  json["passback"].asString();
+    }
+
+    return notice;
+}
+
+StandardAdServerConnector::Notice
+StandardAdServerConnector::
+parseNotice(const std::string & payload)
+{
+    Notice notice;
+
+    // Ids are usually strings but anything that Json::Value::asString()
+    // accepts is fine.
+    auto expectString = [] (StreamingJsonParsingContext & context) {
+        if (context.isString())
+            return context.expectStringAscii();
+        return context.expectJson().asString();
+    };
+
+    StreamingJsonParsingContext context("adserver notice",
+                                        payload.c_str(),
+                                        payload.c_str() + payload.size());
+
+    auto onMember = [&] () {
+        std::string field = context.fieldName();
+
+        if (field == "timestamp") {
+            notice.hasTimestamp = true;
+            double tm = context.isString()
+                ? stod(context.expectStringAscii())
+                : context.expectDouble();
+            notice.timestamp = Date::fromSecondsSinceEpoch(tm);
+        }
+        else if (field == "bidRequestId") {
+            notice.hasBidRequestId = true;
+            notice.bidRequestId = expectString(context);
+        }
+        else if (field == "impid") {
+            notice.hasImpId = true;
+            notice.impId = expectString(context);
+        }
+        else if (field == "price") {
+            notice.hasPrice = true;
+            notice.price = context.expectDouble();
+        }
+        else if (field == "type") {
+            notice.hasType = true;
+            notice.type = expectString(context);
+        }
+        else if (field == "userIds" && context.isArray()) {
+            context.forEachElement([&] () {
+                    if (notice.hasUserId) {
+                        context.skip();
+                        return;
+                    }
+                    notice.hasUserId = true;
+                    notice.userId = expectString(context);
+                });
+        }
+        else if (field == "passback") {
+            notice.passback = expectString(context);
+        }
+        else context.skip();
+    };
+
+    context.forEachMember(onMember);
+    return notice;
+}
+
 HttpAdServerResponse
 StandardAdServerConnector::
 handleWinRq(const HttpHeader & header,
             const Json::Value & json, const std::string & jsonStr)
 {
-    HttpAdServerResponse response;
+    return handleWin(parseNotice(json));
+}
+
+HttpAdServerResponse
+StandardAdServerConnector::
+handleWinPayload(const HttpHeader & header, const std::string & payload)
+{
+    return handleWin(parseNotice(payload));
+}
 
-    Date timestamp;
-    string bidRequestIdStr;
-    string impIdStr;
-    double winPriceDbl;
+HttpAdServerResponse
+StandardAdServerConnector::
+handleWin(const Notice & notice)
+{
+    HttpAdServerResponse response;
 
     Id bidRequestId;
     Id impId;
     USD_CPM winPrice;
 
     UserIds userIds;
-    string userIdStr;
-    string passback;
 
     /*
      *  Timestamp is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("timestamp")) {
-        if(json["timestamp"].isString()) {
-           double tm = stod(json["timestamp"].asString());
-           timestamp = Date::fromSecondsSinceEpoch(tm);
-        } else {
-            timestamp = Date::fromSecondsSinceEpoch(json["timestamp"].asDouble());
-        }
-
+    if (notice.hasTimestamp) {
         // Check if timestamp is finite when treated as seconds
-        if(!timestamp.isADate()) {
+        if(!notice.timestamp.isADate()) {
             errorResponseHelper(response,
                                 "TIMESTAMP_NOT_SECONDS",
                                 "The timestamp field is not in seconds.");
@@ -176,9 +305,8 @@ handleWinRq(const HttpHeader & header,
      *  bidRequestId is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("bidRequestId")) {
-        bidRequestIdStr = json["bidRequestId"].asString();
-        bidRequestId = Id(bidRequestIdStr); 
+    if (notice.hasBidRequestId) {
+        bidRequestId = Id(notice.bidRequestId);
     } else {
         errorResponseHelper(response,
                             "MISSING_BIDREQUESTID",
@@ -191,9 +319,8 @@ handleWinRq(const HttpHeader & header,
      *  impid is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("impid")) {
-        impIdStr = json["impid"].asString();
-        impId = Id(impIdStr);
+    if (notice.hasImpId) {
+        impId = Id(notice.impId);
     } else {
         errorResponseHelper(response,
                             "MISSING_IMPID",
@@ -206,9 +333,8 @@ handleWinRq(const HttpHeader & header,
      *  price is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("price")) {
-        winPriceDbl = json["price"].asDouble();
-        winPrice = USD_CPM(winPriceDbl);
+    if (notice.hasPrice) {
+        winPrice = USD_CPM(notice.price);
     } else {
         errorResponseHelper(response,
                             "MISSING_WINPRICE",
@@ -221,25 +347,15 @@ handleWinRq(const HttpHeader & header,
      *  UserIds is an optional field.
      *  If null, we just put an empty array.
      */
-    if (json.isMember("userIds")) {
-        auto item =  json["userIds"];
-        if(!item.empty())
-            userIds.add(Id(item[0].asString()), ID_PROVIDER);
-    }
-    else {
-        // UserIds is optional
-    }
+    if (notice.hasUserId)
+        userIds.add(Id(notice.userId), ID_PROVIDER);
 
     /*
      *  Passback is an optional field.
      *  If null, we just put an empty string.
      */
-    if (json.isMember("passback")) {
-        passback =  json["passback"].asString();
-    }
-    else {
-        // Passback is optional
-    }
+
+    const Date & timestamp = notice.timestamp;
 
     LOG(adserverTrace) << "{\"timestamp\":\"" << timestamp.print(3) << "\"," <<
         "\"bidRequestId\":\"" << bidRequestId << "\"," <<
@@ -248,13 +364,13 @@ handleWinRq(const HttpHeader & header,
 
     if(response.valid) {
         publishWin(bidRequestId, impId, winPrice, timestamp, Json::Value(), userIds,
-                   AccountKey(passback), Date());
+                   AccountKey(notice.passback), Date());
         if (analytics) analytics->logStandardWinMessage(timestamp.print(3),
-                                                        bidRequestIdStr,
-                                                        impIdStr,
+                                                        notice.bidRequestId,
+                                                        notice.impId,
                                                         winPrice.toString());
-        analyticsPublisher_.publish("WIN", timestamp.print(3), bidRequestIdStr,
-                           impIdStr, winPrice.toString());
+        analyticsPublisher_.publish("WIN", timestamp.print(3), notice.bidRequestId,
+                           notice.impId, winPrice.toString());
     }
 
     return response;
@@ -265,26 +381,32 @@ StandardAdServerConnector::
 handleDeliveryRq(const HttpHeader & header,
                  const Json::Value & json, const std::string & jsonStr)
 {    
+    return handleDelivery(parseNotice(json));
+}
+
+HttpAdServerResponse
+StandardAdServerConnector::
+handleDeliveryPayload(const HttpHeader & header, const std::string & payload)
+{
+    return handleDelivery(parseNotice(payload));
+}
+
+HttpAdServerResponse
+StandardAdServerConnector::
+handleDelivery(const Notice & notice)
+{
     HttpAdServerResponse response;
-    string bidRequestIdStr, impIdStr, userIdStr, event;
-    Id bidRequestId, impId, userId;
+    Id bidRequestId, impId;
     UserIds userIds;
-    Date timestamp;
+    const std::string & event = notice.type;
     
     /*
      *  Timestamp is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("timestamp")) {
-        if(json["timestamp"].isString()) {
-           double tm = stod(json["timestamp"].asString());
-           timestamp = Date::fromSecondsSinceEpoch(tm);
-        } else {
-            timestamp = Date::fromSecondsSinceEpoch(json["timestamp"].asDouble());
-        }
-        
+    if (notice.hasTimestamp) {
         // Check if timestamp is finite when treated as seconds
-        if(!timestamp.isADate()) {
+        if(!notice.timestamp.isADate()) {
             errorResponseHelper(response,
                                 "TIMESTAMP_NOT_SECONDS",
                                 "The timestamp field is not in seconds.");
@@ -303,10 +425,8 @@ handleDeliveryRq(const HttpHeader & header,
      *  type is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("type")) {
+    if (notice.hasType) {
 
-        event = (json["type"].asString());
-        
         if(eventType.find(event) == eventType.end()) {
             errorResponseHelper(response,
                                 "UNSUPPORTED_TYPE",
@@ -328,9 +448,7 @@ handleDeliveryRq(const HttpHeader & header,
      *  impid is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("impid")) {
-
-    } else {
+    if (!notice.hasImpId) {
         errorResponseHelper(response,
                             "MISSING_IMPID",
                             "A campaign event requires the impId field.");
@@ -342,9 +460,7 @@ handleDeliveryRq(const HttpHeader & header,
      *  bidRequestId is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("bidRequestId")) {
-
-    } else {
+    if (!notice.hasBidRequestId) {
         errorResponseHelper(response,
                             "MISSING_BIDREQUESTID",
                             "A campaign event requires the bidRequestId field.");
@@ -356,37 +472,30 @@ handleDeliveryRq(const HttpHeader & header,
      *  UserIds is an optional field.
      *  If null, we just put an empty array.
      */
-    if (json.isMember("userIds")) {
-        auto item =  json["userIds"];
-
-        if(!item.empty())
-            userIds.add(Id(item[0].asString()), ID_PROVIDER);
-    }
-    else {
-        // UserIds is optional
-    }
+    if (notice.hasUserId)
+        userIds.add(Id(notice.userId), ID_PROVIDER);
 
-    bidRequestIdStr = json["bidRequestId"].asString();
-    impIdStr = json["impid"].asString();
-    bidRequestId = Id(bidRequestIdStr);
-    impId = Id(impIdStr);
+    bidRequestId = Id(notice.bidRequestId);
+    impId = Id(notice.impId);
+    const Date & timestamp = notice.timestamp;
     
     LOG(adserverTrace) << "{\"timestamp\":\"" << timestamp.print(3) << "\"," <<
-        "\"bidRequestId\":\"" << bidRequestIdStr << "\"," <<
-        "\"impId\":\"" << impIdStr << "\"," <<
+        "\"bidRequestId\":\"" << notice.bidRequestId << "\"," <<
+        "\"impId\":\"" << notice.impId << "\"," <<
         "\"event\":\"" << event << 
         "\"userIds\":" << userIds.toString() << "\"}";
 
     if(response.valid) {
-        publishCampaignEvent(eventType[event], bidRequestId, impId, timestamp,
+        const std::string & label = eventType.find(event)->second;
+        publishCampaignEvent(label, bidRequestId, impId, timestamp,
                                  Json::Value(), userIds);
-        if (analytics) analytics->logStandardEventMessage(eventType[event],
+        if (analytics) analytics->logStandardEventMessage(label,
                                                           timestamp.print(3),
-                                                          bidRequestIdStr,
-                                                          impIdStr,
+                                                          notice.bidRequestId,
+                                                          notice.impId,
                                                           userIds.toString());
-        analyticsPublisher_.publish(eventType[event], timestamp.print(3), bidRequestIdStr,
-                                impIdStr, userIds.toString());
+        analyticsPublisher_.publish(label, timestamp.print(3), notice.bidRequestId,
+                                notice.impId, userIds.toString());
     }
     return response;
 }
@@ -39,6 +39,13 @@ struct StandardAdServerConnector : public HttpAdServerConnector
                                           const Json::Value & json,
                                           const std::string & jsonStr);
 
+    /** Same as handleWinRq and handleDeliveryRq but parse the payload
+        as it's read instead of going through a Json::Value. */
+    HttpAdServerResponse handleWinPayload(const HttpHeader & header,
+                                          const std::string & payload);
+    HttpAdServerResponse handleDeliveryPayload(const HttpHeader & header,
+                                               const std::string & payload);
+
     void publishError(HttpAdServerResponse & resp);
 
     /** */
@@ -46,8 +53,34 @@ struct StandardAdServerConnector : public HttpAdServerConnector
 
 private :
 
+    /** Fields of a win or campaign event notice that we care about. */
+    struct Notice {
+        Notice() :
+            hasTimestamp(false), hasBidRequestId(false), hasImpId(false),
+            hasPrice(false), hasType(false), hasUserId(false), price(0.0)
+        {}
+
+        bool hasTimestamp, hasBidRequestId, hasImpId, hasPrice, hasType;
+        bool hasUserId;
+
+        Date timestamp;
+        std::string bidRequestId;
+        std::string impId;
+        double price;
+        std::string type;
+        std::string userId;
+        std::string passback;
+    };
+
+    static Notice parseNotice(const Json::Value & json);
+    static Notice parseNotice(const std::string & payload);
+
+    HttpAdServerResponse handleWin(const Notice & notice);
+    HttpAdServerResponse handleDelivery(const Notice & notice);
+
     void init(int winsPort, int eventsPort, bool verbose,
-                    bool analyticsPublisherOn = false, int analyticsPublisherConnections = 1);
+                    bool analyticsPublisherOn = false, int analyticsPublisherConnections = 1,
+                    bool streaming = false);
     virtual void initEventType(const Json::Value &json);
 
     std::map<std::string, std::string> eventType;
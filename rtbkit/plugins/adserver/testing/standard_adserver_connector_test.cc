@@ -187,3 +187,45 @@ BOOST_AUTO_TEST_CASE( test_standard_adserver_conversion )
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_CASE( test_standard_adserver_streaming )
+{
+    Json::Value config;
+    config["winPort"] = 18145;
+    config["eventsPort"] = 18146;
+    config["threads"] = 2;
+    config["streamingParser"] = true;
+
+    auto proxies = std::make_shared<ServiceProxies>();
+    StandardAdServerConnector connector("streaming-connector", proxies, config);
+    connector.start();
+
+    StandardWinSource winSource(NetworkAddress(18145));
+
+    auto post = [&] (const std::string & payload) {
+        winSource.write(ML::format("POST / HTTP/1.1\r\n"
+                                   "Content-Length: %zd\r\n"
+                                   "Content-Type: application/json\r\n"
+                                   "\r\n"
+                                   "%s",
+                                   payload.size(), payload.c_str()));
+        return winSource.read();
+    };
+
+    // Several notices on the same connection.
+    std::string strJson = loadFile(win_sample_filename);
+    for (unsigned i = 0; i < 3; ++i) {
+        std::string result = post(strJson);
+        BOOST_CHECK_EQUAL(result.compare(0, statusOK.length(), statusOK), 0);
+    }
+
+    std::string result = post("{\"timestamp\":\"1396461865\","
+                              "\"bidRequestId\":\"abc\",\"impid\":\"1\"}");
+    BOOST_CHECK_NE(result.find("400 Bad Request"), std::string::npos);
+    BOOST_CHECK_NE(result.find("MISSING_WINPRICE"), std::string::npos);
+
+    result = post("{\"timestamp\":");
+    BOOST_CHECK_NE(result.find("400 Bad Request"), std::string::npos);
+
+    connector.shutdown();
+}
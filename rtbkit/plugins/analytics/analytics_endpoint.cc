@@ -80,6 +80,22 @@ init()
                     JsonParam<string>("event", "event to publish")
             );
 
+    addRouteSyncReturn(versionNode,
+                    "/events",
+                    {"POST","PUT"},
+                    "Add a batch of events of a channel to the logs.",
+                    "Returns a success notice.",
+                    [] (const string & r) {
+                        Json::Value response(Json::stringValue);
+                        response = r;
+                        return response;
+                    },
+                    &AnalyticsRestEndpoint::addEvents,
+                    this,
+                    JsonParam<string>("channel", "channel to use for the events"),
+                    JsonParam<vector<string> >("events", "events to publish")
+            );
+
     addRouteSyncReturn(versionNode,
                     "/channels",
                     {"GET"},
@@ -165,6 +181,20 @@ addEvent(const string & channel, const string & event) const
     return print(channel, event);
 }
 
+string
+AnalyticsRestEndpoint::
+addEvents(const string & channel, const vector<string> & events) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(access);
+    auto it = channelFilter.find(channel);
+    if (it == channelFilter.end() ||  !it->second) 
+        return "channel not found or not enabled";
+
+    for (auto & event: events)
+        print(channel, event);
+    return "success";
+}
+
 Json::Value
 AnalyticsRestEndpoint::
 listChannels() const
@@ -10,6 +10,7 @@
 #include <unordered_map>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 #include "rtbkit/common/analytics_publisher.h"
 #include "soa/service/rest_service_endpoint.h"
@@ -54,6 +55,9 @@ private:
     std::string addEvent(const std::string & channel,
                          const std::string & event) const;
 
+    std::string addEvents(const std::string & channel,
+                          const std::vector<std::string> & events) const;
+
     std::string print(const std::string & channel,
                       const std::string & event) const;
 
@@ -18,18 +18,49 @@
 
 using namespace Datacratic;
 
+namespace {
+
+/** Current time, only printed once the message is accepted. */
+struct Now {
+    Now(int precision) : precision(precision) {}
+    std::string operator () () const { return Date::now().print(precision); }
+    int precision;
+};
+
+} // file scope
+
 namespace RTBKIT {
 
 ZmqAnalytics::ZmqAnalytics(const std::string & service_name, std::shared_ptr<ServiceProxies> proxies)
     : Analytics(service_name+"/logger", proxies),
-      zmq_publisher_(getZmqContext())
+      channels(1.0),
+      batchInterval(0.01),
+      maxPending(100000),
+      zmq_publisher_(getZmqContext()),
+      numDropped(0)
 {}
 
 ZmqAnalytics::~ZmqAnalytics() {}
 
+void ZmqAnalytics::configure(const Json::Value & config)
+{
+    if (!config.isObject()) return;
+
+    if (config.isMember("defaultRate"))
+        channels.setDefaultRate(config["defaultRate"].asDouble());
+    if (config.isMember("channels"))
+        channels.setRates(config["channels"]);
+    if (config.isMember("batchInterval"))
+        batchInterval = config["batchInterval"].asDouble();
+    if (config.isMember("maxPending"))
+        maxPending = config["maxPending"].asUInt();
+}
+
 void ZmqAnalytics::init()
 {
     zmq_publisher_.init(getServices()->config, serviceName());
+    zmq_publisher_.addPeriodic("ZmqAnalytics::flush", batchInterval,
+                               [=] (uint64_t) { flush(); });
 }
 
 void ZmqAnalytics::bindTcp(const std::string & port_range)
@@ -47,6 +78,33 @@ void ZmqAnalytics::shutdown()
     zmq_publisher_.shutdown();
 }
 
+bool ZmqAnalytics::isEnabled(const std::string & channel) const
+{
+    return channels.enabled(channel);
+}
+
+void ZmqAnalytics::queue(std::vector<zmq::message_t> && message)
+{
+    std::lock_guard<std::mutex> guard(pendingLock);
+    if (pending.size() >= maxPending) {
+        ++numDropped;
+        return;
+    }
+    pending.emplace_back(std::move(message));
+}
+
+void ZmqAnalytics::flush()
+{
+    std::vector<std::vector<zmq::message_t> > toSend;
+    {
+        std::lock_guard<std::mutex> guard(pendingLock);
+        toSend.swap(pending);
+    }
+
+    for (auto & message: toSend)
+        zmq_publisher_.sendFromLoop(std::move(message));
+}
+
 
 /**********************************************************************************************
 * USED IN ROUTER
@@ -55,15 +113,17 @@ void ZmqAnalytics::shutdown()
 void ZmqAnalytics::logMarkMessage(const Router & router,
                                   const double & last_check)
 {
-    zmq_publisher_.publish("MARK",
-                           Date::now().print(5),
-                           Date::fromSecondsSinceEpoch(last_check).print(),
-                           ML::format("active: %zd augmenting, %zd inFlight, "
-                                      "%zd agents",
-                                      router.augmentationLoop.numAugmenting(),
-                                      router.inFlight.size(),                                             
-                                      router.agents.size())
-                           );
+    if (!channels.accept("MARK")) return;
+
+    publishAccepted("MARK",
+                    Now(5),
+                    Date::fromSecondsSinceEpoch(last_check).print(),
+                    ML::format("active: %zd augmenting, %zd inFlight, "
+                               "%zd agents",
+                               router.augmentationLoop.numAugmenting(),
+                               router.numInFlight(),
+                               router.agents.size())
+                    );
 }
 
 void ZmqAnalytics::logBidMessage(const std::string & agent,
@@ -71,33 +131,33 @@ void ZmqAnalytics::logBidMessage(const std::string & agent,
                                  const std::string & bids,
                                  const std::string & meta) 
 {
-    zmq_publisher_.publish("BID",
-                           Date::now().print(5),
-                           agent,
-                           auctionId.toString(),
-                           bids,
-                           meta
-                           );
+    publish("BID",
+            Now(5),
+            agent,
+            auctionId.toString(),
+            bids,
+            meta
+            );
 }
 
 void ZmqAnalytics::logAuctionMessage(const Id & auctionId,
                                      const std::string & auctionRequest)
 {
-    zmq_publisher_.publish("AUCTION", 
-                           Date::now().print(5),
-                           auctionId.toString(),
-                           auctionRequest
-                           );
+    publish("AUCTION", 
+            Now(5),
+            auctionId.toString(),
+            auctionRequest
+            );
 }
 
 void ZmqAnalytics::logConfigMessage(const std::string & agent,
                                     const std::string & config)
 {
-    zmq_publisher_.publish("CONFIG",
-                           Date::now().print(5),
-                           agent,
-                           config
-                          );
+    publish("CONFIG",
+            Now(5),
+            agent,
+            config
+            );
 }
 
 void ZmqAnalytics::logNoBudgetMessage(const std::string agent,
@@ -105,13 +165,13 @@ void ZmqAnalytics::logNoBudgetMessage(const std::string agent,
                                       const std::string & bids,
                                       const std::string & meta)
 {
-    zmq_publisher_.publish("NOBUDGET",
-                           Date::now().print(5),
-                           agent,
-                           auctionId.toString(),
-                           bids,
-                           meta
-                          );
+    publish("NOBUDGET",
+            Now(5),
+            agent,
+            auctionId.toString(),
+            bids,
+            meta
+            );
 }
 
 void ZmqAnalytics::logMessage(const std::string & msg,
@@ -120,13 +180,13 @@ void ZmqAnalytics::logMessage(const std::string & msg,
                               const std::string & bids,
                               const std::string & meta)
 {
-    zmq_publisher_.publish(msg,
-                           Date::now().print(5),
-                           agent,
-                           auctionId.toString(),
-                           bids,
-                           meta
-                          );
+    publish(msg,
+            Now(5),
+            agent,
+            auctionId.toString(),
+            bids,
+            meta
+            );
 
 }
 
@@ -156,18 +216,18 @@ void ZmqAnalytics::logUsageMessage(Router & router,
                                      info.stats->bids);
         Router::AgentUsageMetrics delta = newMetrics - last;
 
-        zmq_publisher_.publish("USAGE",
-                               Date::now().print(5),
-                               "AGENT", 
-                               p, 
-                               item.first,
-                               info.config->account.toString(),
-                               delta.intoFilters,
-                               delta.passedStaticFilters,
-                               delta.passedDynamicFilters,
-                               delta.auctions,
-                               delta.bids,
-                               info.config->bidProbability);
+        publish("USAGE",
+                Now(5),
+                "AGENT", 
+                p, 
+                item.first,
+                info.config->account.toString(),
+                delta.intoFilters,
+                delta.passedStaticFilters,
+                delta.passedDynamicFilters,
+                delta.auctions,
+                delta.bids,
+                info.config->bidProbability);
         last = move(newMetrics);
     }
 
@@ -189,16 +249,16 @@ void ZmqAnalytics::logUsageMessage(Router & router,
         Router:: RouterUsageMetrics delta = newMetrics - router.lastRouterUsageMetrics;
 
 
-        zmq_publisher_.publish("USAGE",
-                               Date::now().print(5),
-                               "ROUTER", 
-                               p, 
-                               delta.numRequests,
-                               delta.numAuctions,
-                               delta.numNoPotentialBidders,
-                               delta.numBids,
-                               delta.numAuctionsWithBid,
-                               acceptAuctionProbability / numExchanges);
+        publish("USAGE",
+                Now(5),
+                "ROUTER", 
+                p, 
+                delta.numRequests,
+                delta.numAuctions,
+                delta.numNoPotentialBidders,
+                delta.numBids,
+                delta.numAuctionsWithBid,
+                acceptAuctionProbability / numExchanges);
 
         router.lastRouterUsageMetrics = move(newMetrics);
     }
@@ -207,23 +267,23 @@ void ZmqAnalytics::logUsageMessage(Router & router,
 void ZmqAnalytics::logErrorMessage(const std::string & error,
                                    const std::vector<std::string> & message)
 {
-    zmq_publisher_.publish("ERROR",
-                           Date::now().print(5),
-                           error,
-                           message
-                          );
+    publish("ERROR",
+            Now(5),
+            error,
+            message
+            );
 }
 
 void ZmqAnalytics::logRouterErrorMessage(const std::string & function,
                                          const std::string & exception, 
                                          const std::vector<std::string> & message)
 {
-    zmq_publisher_.publish("ROUTERERROR",
-                           Date::now().print(5),
-                           function,
-                           exception,
-                           message
-                          );
+    publish("ROUTERERROR",
+            Now(5),
+            function,
+            exception,
+            message
+            );
 }
 
 
@@ -233,9 +293,13 @@ void ZmqAnalytics::logRouterErrorMessage(const std::string & function,
 
 void ZmqAnalytics::logMatchedWinLoss(const MatchedWinLoss & matchedWinLoss) 
 {
-    zmq_publisher_.publish(
-            "MATCHED" + matchedWinLoss.typeString(),                // 0
-            Date::now().print(5),                                   // 1
+    // Only build the arguments of the messages that are published
+    std::string channel = "MATCHED" + matchedWinLoss.typeString();
+    if (!channels.accept(channel)) return;
+
+    publishAccepted(
+            channel,                                                // 0
+            Now(5),                                                 // 1
 
             matchedWinLoss.auctionId.toString(),                    // 2
             std::to_string(matchedWinLoss.impIndex),                // 3
@@ -275,9 +339,12 @@ void ZmqAnalytics::logMatchedWinLoss(const MatchedWinLoss & matchedWinLoss)
 
 void ZmqAnalytics::logMatchedCampaignEvent(const MatchedCampaignEvent & matchedCampaignEvent)
 {
-    zmq_publisher_.publish(
-            "MATCHED" + matchedCampaignEvent.label,    // 0
-            Date::now().print(5),                      // 1
+    std::string channel = "MATCHED" + matchedCampaignEvent.label;
+    if (!channels.accept(channel)) return;
+
+    publishAccepted(
+            channel,                                   // 0
+            Now(5),                                    // 1
 
             matchedCampaignEvent.auctionId.toString(), // 2
             matchedCampaignEvent.impId.toString(),     // 3
@@ -298,10 +365,13 @@ void ZmqAnalytics::logMatchedCampaignEvent(const MatchedCampaignEvent & matchedC
 
 void ZmqAnalytics::logUnmatchedEvent(const UnmatchedEvent & unmatchedEvent)
 {
-    zmq_publisher_.publish(
-            // Use event type not label since label is only defined for campaign events.
-            "UNMATCHED" + string(print(unmatchedEvent.event.type)),             // 0
-            Date::now().print(5),                                               // 1
+    // Use event type not label since label is only defined for campaign events.
+    std::string channel = "UNMATCHED" + string(print(unmatchedEvent.event.type));
+    if (!channels.accept(channel)) return;
+
+    publishAccepted(
+            channel,                                                            // 0
+            Now(5),                                                             // 1
 
             unmatchedEvent.reason,                                              // 2
             unmatchedEvent.event.auctionId.toString(),                          // 3
@@ -314,22 +384,22 @@ void ZmqAnalytics::logUnmatchedEvent(const UnmatchedEvent & unmatchedEvent)
 
 void ZmqAnalytics::logPostAuctionErrorEvent(const PostAuctionErrorEvent & postAuctionErrorEvent)
 {
-    zmq_publisher_.publish("PAERROR",
-                           Date::now().print(5),
-                           postAuctionErrorEvent.key,
-                           postAuctionErrorEvent.message);
+    publish("PAERROR",
+            Now(5),
+            postAuctionErrorEvent.key,
+            postAuctionErrorEvent.message);
 }
 
 void ZmqAnalytics::logPAErrorMessage(const std::string & function,
                                      const std::string & exception, 
                                      const std::vector<std::string> & message)
 {
-    zmq_publisher_.publish("PAERROR",
-                           Date::now().print(5),
-                           function,
-                           exception,
-                           message
-                          );
+    publish("PAERROR",
+            Now(5),
+            function,
+            exception,
+            message
+            );
 }
 
 
@@ -340,11 +410,11 @@ void ZmqAnalytics::logPAErrorMessage(const std::string & function,
 void ZmqAnalytics::logMockWinMessage(const std::string & eventAuctionId,
                                      const std::string & eventWinPrice)
 {
-    zmq_publisher_.publish("WIN",
-                           Date::now().print(3),
-                           eventAuctionId,
-                           eventWinPrice,
-                           "0");
+    publish("WIN",
+            Now(3),
+            eventAuctionId,
+            eventWinPrice,
+            "0");
 }
 
 /**********************************************************************************************
@@ -356,11 +426,11 @@ void ZmqAnalytics::logStandardWinMessage(const std::string & timestamp,
                                          const std::string & impId,
                                          const std::string & winPrice) 
 {
-    zmq_publisher_.publish("WIN",
-                           timestamp,
-                           bidRequestId,
-                           impId,
-                           winPrice);
+    publish("WIN",
+            timestamp,
+            bidRequestId,
+            impId,
+            winPrice);
 }
 
 void ZmqAnalytics::logStandardEventMessage(const std::string & eventType,
@@ -369,11 +439,11 @@ void ZmqAnalytics::logStandardEventMessage(const std::string & eventType,
                                            const std::string & impId,
                                            const std::string & userIds)
 {
-    zmq_publisher_.publish(eventType,
-                           timestamp,
-                           bidRequestId,
-                           impId,
-                           userIds);
+    publish(eventType,
+            timestamp,
+            bidRequestId,
+            impId,
+            userIds);
 }
 
 /**********************************************************************************************
@@ -384,10 +454,10 @@ void ZmqAnalytics::logAdserverEvent(const std::string & type,
                                     const std::string & bidRequestId,
                                     const std::string & impId)
 {
-    zmq_publisher_.publish(type,
-                           type,
-                           bidRequestId,
-                           impId);
+    publish(type,
+            type,
+            bidRequestId,
+            impId);
 }
 
 void ZmqAnalytics::logAdserverWin(const std::string & timestamp,
@@ -397,13 +467,13 @@ void ZmqAnalytics::logAdserverWin(const std::string & timestamp,
                                   const std::string & winPrice,
                                   const std::string & dataCost)
 {
-    zmq_publisher_.publish("WIN",
-                           timestamp,
-                           auctionId,
-                           adSpotId,
-                           accountKey,
-                           winPrice,
-                           dataCost);
+    publish("WIN",
+            timestamp,
+            auctionId,
+            adSpotId,
+            accountKey,
+            winPrice,
+            dataCost);
 }
 
 void ZmqAnalytics::logAuctionEventMessage(const std::string & event,
@@ -412,20 +482,20 @@ void ZmqAnalytics::logAuctionEventMessage(const std::string & event,
                                           const std::string & adSpotId,
                                           const std::string & userId)
 {
-    zmq_publisher_.publish(event,
-                           timestamp,
-                           auctionId,
-                           adSpotId,
-                           userId);
+    publish(event,
+            timestamp,
+            auctionId,
+            adSpotId,
+            userId);
 }
 
 void ZmqAnalytics::logEventJson(const std::string & event,
                                 const std::string & timestamp,
                                 const std::string & json)
 {
-    zmq_publisher_.publish(event,
-                           timestamp,
-                           json);
+    publish(event,
+            timestamp,
+            json);
 }
 
 void ZmqAnalytics::logDetailedWin(const std::string timestamp,
@@ -438,16 +508,16 @@ void ZmqAnalytics::logDetailedWin(const std::string timestamp,
                                   const std::string & strategy,
                                   const std::string & bidTimeStamp)
 {
-    zmq_publisher_.publish("WIN",
-                           timestamp,
-                           json,
-                           auctionId,
-                           spotId,
-                           price,
-                           userIds,
-                           campaign,
-                           strategy,
-                           bidTimeStamp);
+    publish("WIN",
+            timestamp,
+            json,
+            auctionId,
+            spotId,
+            price,
+            userIds,
+            campaign,
+            strategy,
+            bidTimeStamp);
 }
 
 } // namespace RTBKIT
@@ -7,11 +7,15 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <functional>
 #include <string>
+#include <vector>
 
 #include "rtbkit/common/analytics.h"
+#include "rtbkit/common/analytics_publisher.h"
 #include "soa/service/zmq_named_pub_sub.h"
 
 namespace RTBKIT {
@@ -28,17 +32,42 @@ namespace Datacratic {
 
 namespace RTBKIT {
 
+/** Publishes the analytics messages on a zeromq publisher.
+
+    The messages are published on channels of their name, all of them by
+    default.  Accepted messages are queued and sent in batches every
+    batchInterval seconds from the thread of the publisher, so that the
+    callers never wait on zeromq.  The "analytics" configuration can hold:
+
+        "channels": { "<channel>": <rate or boolean>, ... }
+        "defaultRate": rate of the other channels (1 by default)
+        "batchInterval": seconds between batches (0.01 by default)
+        "maxPending": queued messages past which new ones are dropped
+*/
+
 class ZmqAnalytics : public Analytics {
 
 public:
     ZmqAnalytics(const std::string & service_name, std::shared_ptr<Datacratic::ServiceProxies> proxies);
     virtual ~ZmqAnalytics(); 
 
+    virtual void configure(const Json::Value & config);
     virtual void init();
     virtual void bindTcp(const std::string & port_range = "logs");
     virtual void start();
     virtual void shutdown();
 
+    virtual bool isEnabled(const std::string & channel) const;
+
+    /** Sampling rates of the channels; see AnalyticsChannels. */
+    AnalyticsChannels channels;
+
+    double batchInterval;
+    size_t maxPending;
+
+    /** Number of messages dropped because too many were queued. */
+    uint64_t dropped() const { return numDropped; }
+
     // USED IN ROUTER 
     virtual void logMarkMessage(const Router & router,
                                 const double & last_check);
@@ -122,6 +151,36 @@ public:
 private:
     Datacratic::ZmqNamedPublisher zmq_publisher_;
 
+    std::mutex pendingLock;
+    std::vector<std::vector<zmq::message_t> > pending;
+    std::atomic<uint64_t> numDropped;
+
+    /** Queue a message if the channel accepts it.  Arguments that are
+        callables are only called once it does.
+    */
+    template<typename... Args>
+    void publish(const std::string & channel, const Args & ... args)
+    {
+        if (!channels.accept(channel)) return;
+        publishAccepted(channel, args...);
+    }
+
+    /** Queue a message for a channel that already accepted it. */
+    template<typename... Args>
+    void publishAccepted(const std::string & channel, const Args & ... args)
+    {
+        std::vector<zmq::message_t> message;
+        message.reserve(sizeof...(Args) + 1);
+        Datacratic::encodeAll(message, channel,
+                              Datacratic::evaluateLazy(args, 0)...);
+        queue(std::move(message));
+    }
+
+    void queue(std::vector<zmq::message_t> && message);
+
+    /** Send the queued messages; runs in the thread of the publisher. */
+    void flush();
+
 }; // class ZmqEventLogger
 
 } // namespace RTBKIT
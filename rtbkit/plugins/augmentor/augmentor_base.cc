@@ -36,6 +36,9 @@ Augmentor(const std::string & augmentorName,
           std::shared_ptr<ServiceProxies> proxies)
     : ServiceBase(serviceName, proxies),
       augmentorName(augmentorName),
+      cacheTtl(0),
+      binaryResponses(false),
+      maxBatchSize(0),
       toRouters(getZmqContext()),
       responseQueue(QueueSize),
       requestQueue(QueueSize),
@@ -50,6 +53,9 @@ Augmentor(const std::string & augmentorName,
           ServiceBase& parent)
     : ServiceBase(serviceName, parent),
       augmentorName(augmentorName),
+      cacheTtl(0),
+      binaryResponses(false),
+      maxBatchSize(0),
       toRouters(getZmqContext()),
       responseQueue(QueueSize),
       requestQueue(QueueSize),
@@ -70,17 +76,33 @@ init(int numThreads)
 {
     responseQueue.onEvent = [=] (const Response& resp)
         {
-            const AugmentationRequest& request = resp.first;
-            const AugmentationList& response = resp.second;
-
-            toRouters.sendMessage(
-                    request.router,
-                    "RESPONSE",
-                    "1.0",
-                    request.startTime,
-                    request.id.toString(),
-                    request.augmentor,
-                    chomp(response.toJson().toString()));
+            const AugmentationRequest& request = resp.request;
+            const AugmentationList& response = resp.response;
+            std::string encoded = binaryResponses
+                ? response.toBinary()
+                : chomp(response.toJson().toString());
+
+            if (resp.cacheTtl > 0) {
+                toRouters.sendMessage(
+                        request.router,
+                        "RESPONSE",
+                        "1.0",
+                        request.startTime,
+                        request.id.toString(),
+                        request.augmentor,
+                        encoded,
+                        ML::format("%f", resp.cacheTtl));
+            }
+            else {
+                toRouters.sendMessage(
+                        request.router,
+                        "RESPONSE",
+                        "1.0",
+                        request.startTime,
+                        request.id.toString(),
+                        request.augmentor,
+                        encoded);
+            }
 
             recordHit("messages.RESPONSE");
         };
@@ -113,8 +135,11 @@ init(int numThreads)
 
 
     stopWorkers = false;
-    for (size_t i = 0; i < numThreads; ++i)
-        workers.create_thread([=] { this->runWorker(); });
+    for (size_t i = 0; i < numThreads; ++i) {
+        if (maxBatchSize > 1 && handleRequests)
+            workers.create_thread([=] { this->runBatchWorker(); });
+        else workers.create_thread([=] { this->runWorker(); });
+    }
 
     loopMonitor.init();
     loopMonitor.addMessageLoop("augmentor", this);
@@ -145,7 +170,15 @@ void
 Augmentor::
 respond(const AugmentationRequest & request, const AugmentationList & response)
 {
-    if (responseQueue.tryPush(make_pair(request, response)))
+    respond(request, response, cacheTtl);
+}
+
+void
+Augmentor::
+respond(const AugmentationRequest & request, const AugmentationList & response,
+        double cacheTtl)
+{
+    if (responseQueue.tryPush(Response { request, response, cacheTtl }))
         return;
 
     cerr << "Dropping augmentation response: response queue is full" << endl;
@@ -233,5 +266,37 @@ runWorker()
     }
 }
 
+void
+Augmentor::
+runBatchWorker()
+{
+    std::vector<AugmentationRequest> requests;
+    Message message;
+
+    while(!stopWorkers) {
+        if (!requestQueue.tryPop(message, 1.0)) continue;
+
+        // Only what is already there; the first request doesn't wait
+        requests.clear();
+        do {
+            AugmentationRequest request;
+            try { parseMessage(request, message); }
+            catch (const std::exception& ex) {
+                cerr << "error while parsing message: "
+                    << message << " -> " << ex.what()
+                    << endl;
+                continue;
+            }
+            requests.emplace_back(std::move(request));
+        } while (requests.size() < maxBatchSize
+                 && requestQueue.tryPop(message));
+
+        if (requests.empty()) continue;
+
+        recordLevel(requests.size(), "requestBatchSize");
+        handleRequests(requests);
+    }
+}
+
 } // namespace RTBKIT
 
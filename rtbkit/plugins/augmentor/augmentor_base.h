@@ -72,6 +72,11 @@ struct Augmentor : public ServiceBase, public MessageLoop {
 
     ~Augmentor();
 
+    /** The requests are handled by numThreads worker threads, so the
+        request callbacks must be thread safe when there is more than one.
+        Responding is thread safe: the responses are queued and sent from
+        the message loop.
+    */
     void init(int numThreads = 1);
     void start();
     void shutdown();
@@ -80,6 +85,32 @@ struct Augmentor : public ServiceBase, public MessageLoop {
     void respond(const AugmentationRequest & request,
                  const AugmentationList & response);
 
+    /** Respond and let the routers reuse the response for the same user for
+        cacheTtl seconds instead of asking again.  Only responses that don't
+        depend on the agents of the request should be cached.
+    */
+    void respond(const AugmentationRequest & request,
+                 const AugmentationList & response,
+                 double cacheTtl);
+
+    /** TTL given to the responses sent without one; 0, the default, means
+        that they can't be cached. */
+    void setCacheTtl(double seconds) { cacheTtl = seconds; }
+
+    /** Send the responses with AugmentationList::toBinary() instead of as
+        JSON, which is smaller and faster to parse.  The routers must be
+        recent enough to read it.
+    */
+    void setBinaryResponses(bool binary) { binaryResponses = binary; }
+
+    /** Let a worker take up to maxRequests of the requests that are already
+        waiting and handle them in a single call, for augmentors that do
+        better with many requests at once (see SyncAugmentor::doRequests).
+        A worker never waits for a batch to fill up.  Must be called before
+        init(); 0 or 1 handles the requests one at a time, the default.
+    */
+    void setRequestBatching(size_t maxRequests) { maxBatchSize = maxRequests; }
+
     double sampleLoad() { return loopMonitor.sampleLoad().load; }
     double shedProbability() { return loadStabilizer.shedProbability(); }
 
@@ -89,12 +120,26 @@ protected:
     typedef boost::function<void (const AugmentationRequest &)> RequestHandle;
     RequestHandle handleRequest;
 
+    /** Handles a batch of requests when setRequestBatching() is used; if
+        not set, each of them goes to handleRequest. */
+    typedef boost::function<void (const std::vector<AugmentationRequest> &)>
+        RequestBatchHandle;
+    RequestBatchHandle handleRequests;
+
 private:
     std::string augmentorName; // This can differ from the servicenName!
 
     ZmqMultipleNamedClientBusProxy toRouters;
 
-    typedef std::pair<AugmentationRequest, AugmentationList> Response;
+    double cacheTtl;
+    bool binaryResponses;
+    size_t maxBatchSize;
+
+    struct Response {
+        AugmentationRequest request;
+        AugmentationList response;
+        double cacheTtl;
+    };
     TypedMessageSink<Response> responseQueue;
 
     typedef std::pair<std::string, std::vector<std::string> > Message;
@@ -107,6 +152,7 @@ private:
     LoadStabilizer loadStabilizer;
 
     void runWorker();
+    void runBatchWorker();
     void handleRouterMessage(const std::string & router,
                              std::vector<std::string> & message);
 
@@ -123,6 +169,10 @@ private:
     To return an augmentation to the router, simply return it from the doRequest
     function.
 
+    With setRequestBatching(), the requests are given to doRequests instead,
+    which returns one augmentation per request in the same order.  By
+    default it calls doRequest for each of them.
+
  */
 struct SyncAugmentor : public Augmentor
 {
@@ -154,16 +204,38 @@ struct SyncAugmentor : public Augmentor
         throw ML::Exception("onRequest or doRequest must be overridden");
     }
 
+    boost::function<std::vector<AugmentationList>
+                    (const std::vector<AugmentationRequest> &)> doRequests;
+
+    virtual std::vector<AugmentationList>
+    onRequests(const std::vector<AugmentationRequest> & requests)
+    {
+        std::vector<AugmentationList> responses;
+        responses.reserve(requests.size());
+        for (auto & request: requests)
+            responses.push_back(doRequest(request));
+        return responses;
+    }
+
 private:
 
     void setup()
     {
         doRequest = boost::bind(&SyncAugmentor::onRequest, this, _1);
+        doRequests = boost::bind(&SyncAugmentor::onRequests, this, _1);
 
         handleRequest = [=] (const AugmentationRequest & request) {
             AugmentationList response = doRequest(request);
             respond(request, response);
         };
+
+        handleRequests = [=] (const std::vector<AugmentationRequest> & requests) {
+            std::vector<AugmentationList> responses = doRequests(requests);
+            ExcCheckEqual(responses.size(), requests.size(),
+                          "doRequests must return one response per request");
+            for (size_t i = 0; i < requests.size(); ++i)
+                respond(requests[i], responses[i]);
+        };
     }
 
 };
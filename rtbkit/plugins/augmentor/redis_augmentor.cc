@@ -16,11 +16,54 @@ using namespace std;
 namespace RTBKIT {
 
 
+RedisAugmentor::
+RedisAugmentor(const std::string& augmentorName,
+               const std::string& serviceName,
+               std::shared_ptr<ServiceProxies> proxies,
+               const std::vector<Redis::Address>& shards,
+               int connectionsPerShard)
+    : RTBKIT::AsyncAugmentor(augmentorName,serviceName,proxies)
+    , agent_config_ (proxies->zmqContext)
+{
+    ExcCheck(!shards.empty(), "redis augmentor needs at least one shard");
+    ExcCheckGreater(connectionsPerShard, 0, "redis augmentor needs connections");
+
+    for (const auto& address: shards)
+    {
+        vector<shared_ptr<Redis::AsyncConnection>> connections;
+        for (auto i: boost::irange (0,connectionsPerShard))
+        {
+            (void) i;
+            connections.push_back(make_shared<Redis::AsyncConnection>(address));
+        }
+        addShard(std::move(connections));
+    }
+}
+
 RedisAugmentor::
 ~RedisAugmentor()
 {
 }
 
+void
+RedisAugmentor::
+addShard(vector<shared_ptr<Redis::AsyncConnection>> connections)
+{
+    unique_ptr<Shard> shard(new Shard);
+    shard->connections = std::move(connections);
+    shards_.push_back(std::move(shard));
+}
+
+void
+RedisAugmentor::
+setBatching(double windowMs, size_t maxKeys)
+{
+    ExcCheckGreaterEqual(windowMs, 0.0, "negative batching window");
+    ExcCheckGreater(maxKeys, 0, "batches need at least one key");
+    window_ = windowMs * 0.001;
+    maxKeys_ = maxKeys;
+}
+
 /** Sets up the internal components of the augmentor.
 
     Note that AsyncAugmentorBase is a MessageLoop so we can attach all our
@@ -35,22 +78,118 @@ init(int nthreads)
     /* Manages all the communications with the AgentConfigurationService. */
     agent_config_.init(getServices()->config);
     addSource("RedisAugmentor::agentConfig", agent_config_);
+
+    // Sends the batches that didn't fill up, and answers the requests that
+    // ran out of time
+    double period = window_ > 0 ? window_ : 0.001;
+    addPeriodic("RedisAugmentor::flush", period, [=] (uint64_t)
+        {
+            if (window_ > 0)
+                for (auto& shard: shards_) flush(*shard);
+
+            deadlines_.expire(Date::now(), [&] (weak_ptr<Request>& ptr)
+                {
+                    auto request = ptr.lock();
+                    if (!request) return;
+                    recordHit("requestTimeout");
+                    finish(*request);
+                });
+        });
 }
 
+void
+RedisAugmentor::
+flush(Shard & shard)
+{
+    vector<string> keys;
+    vector<vector<shared_ptr<Request>>> waiting;
+    Date deadline;
+    {
+        lock_guard<mutex> guard(shard.lock);
+        if (shard.pending.empty()) return;
+
+        keys.reserve(shard.pending.size());
+        waiting.reserve(shard.pending.size());
+        for (auto& ii: shard.pending)
+        {
+            keys.push_back(ii.first);
+            waiting.push_back(std::move(ii.second));
+        }
+        shard.pending.clear();
+        deadline = shard.deadline;
+    }
+
+    recordOutcome(keys.size(), "batchKeys");
+
+    Redis::Command mget = Redis::MGET;
+    for (const auto& key: keys) mget.addArg(key);
+
+    auto& connection = shard.connections[shard.next++ % shard.connections.size()];
+    connection->queue(mget,
+                      [=](const Redis::Result& result) { onKeys(keys, waiting, result); },
+                      deadline);
+}
 
 void
 RedisAugmentor::
-onRequest(const AugmentationRequest & request, SendResponseCB sendResponse)
+onKeys(const vector<string> & keys,
+       const vector<vector<shared_ptr<Request>>> & waiting,
+       const Redis::Result & result)
+{
+    if (!result)
+    {
+        cerr << "RedisAugmentor::onKeys error: " << result.error() << endl ;
+        recordHit("redisError."+result.error());
+    }
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        string res;
+        if (result) res = result.reply()[i].asString();
+
+        for (const auto& request: waiting[i])
+        {
+            bool done;
+            {
+                lock_guard<mutex> guard(request->lock);
+                if (!res.empty())
+                    for (const auto& account: request->jobs.at(keys[i]))
+                        request->result[account].data.atStr(keys[i]) = res;
+                done = --request->outstanding == 0;
+            }
+            if (done) finish(*request);
+        }
+    }
+}
+
+void
+RedisAugmentor::
+finish(Request & request)
 {
-    ML::Timer tm;
+    AugmentationList result;
+    {
+        lock_guard<mutex> guard(request.lock);
+        if (request.answered) return;
+        request.answered = true;
+        result = std::move(request.result);
+    }
+
+    recordOutcome(request.timer.elapsed_wall() * 1000.0, "redisResponseMs");
+    request.sendResponse(result);
+}
+
 
+void
+RedisAugmentor::
+onRequest(const AugmentationRequest & request, SendResponseCB sendResponse)
+{
     recordHit("requests");
 
-    // we build an *ordered* map indexed by Redis keys, pointing
-    // at set of account keys. It will be captured by copy by the
-    // Redis lambda call back, and used in order to build the
-    // augmentation list.
-    map<string,set<RTBKIT::AccountKey>> jobs;
+    // we build a map indexed by Redis keys, pointing at set of
+    // account keys. It is kept in the pending request and used to
+    // build the augmentation list as the keys come back.
+    auto pending = make_shared<Request>();
+    auto& jobs = pending->jobs;
     auto br = request.bidRequest->toJson();
     for (const string& agent : request.agents)
     {
@@ -99,37 +238,32 @@ onRequest(const AugmentationRequest & request, SendResponseCB sendResponse)
         return;
     }
 
-    auto doResponse = [=](const Redis::Results& results) {
-        ExcAssertEqual (results.size(), jobs.size());
-        AugmentationList auglret;
-        if (results)
-        {
-            auto i=0;
-            for (const auto& ii: jobs)
-            {
-                const auto& res = results.at(i).reply().asString();
-                if (!res.empty())
-                    for (const auto& jj: ii.second)
-                        auglret[jj].data.atStr(ii.first) = res;
-                ++i;
-            }
-        }
-        else
-        {
-            cerr << "RedisAugmentor::onRequest::lambda(doResponse) error: " << results.error() << endl ;
-            recordHit("redisError."+results.error());
-        }
-        recordOutcome(tm.elapsed_wall() * 1000.0, "redisResponseMs");
-        sendResponse(auglret);
-    };
+    pending->sendResponse = sendResponse;
+    pending->outstanding = jobs.size();
 
-    // build a vector of commands
-    vector<Redis::Command> cmds;
-    for (auto& ii: jobs)
-        cmds.emplace_back (Redis::GET(ii.first));
+    double timeLeft = timeout_;
+    if (request.timeAvailableMs > 0)
+        timeLeft = std::min(timeLeft, request.timeAvailableMs * 0.001);
+    Date deadline = Date::now().plusSeconds(timeLeft);
+    deadlines_.insert(deadline, pending);
 
-    // and post it
-    redis_->queueMulti(cmds, doResponse, 0.004);
+    // Queue the keys on their shard; a key that another request is already
+    // waiting for is only looked up once
+    for (const auto& ii: jobs)
+    {
+        size_t index = std::hash<string>()(ii.first) % shards_.size();
+        Shard& shard = *shards_[index];
 
+        bool full;
+        {
+            lock_guard<mutex> guard(shard.lock);
+            if (shard.pending.empty() || shard.deadline < deadline)
+                shard.deadline = deadline;
+            shard.pending[ii.first].push_back(pending);
+            full = shard.pending.size() >= maxKeys_;
+        }
+
+        if (full || window_ == 0) flush(shard);
+    }
 }
 } /* namespace RTBKIT */
@@ -9,14 +9,24 @@
 #define REDIS_AUGMENTOR_H_
 
 #include <string>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
 #include "augmentor_base.h"
 #include "soa/service/redis.h"
+#include "soa/service/timer_wheel.h"
+#include "jml/arch/timers.h"
 #include "rtbkit/core/agent_configuration/agent_configuration_listener.h"
 
 namespace RTBKIT {
 
 /**
  *     Redis Augmentor.
+ *
+ *     The keys of the requests that arrive within a small window of each
+ *     other are looked up together, with one MGET per Redis node.  Keys are
+ *     spread over the nodes by hash and each node can have a few
+ *     connections that the batches are spread over.
  */
 class RedisAugmentor: public RTBKIT::AsyncAugmentor {
 public:
@@ -26,8 +36,8 @@ public:
                    const Redis::Address& redis)
         : RTBKIT::AsyncAugmentor(augmentorName,serviceName,proxies)
         , agent_config_ (proxies->zmqContext)
-        , redis_(std::make_shared<Redis::AsyncConnection>(redis))
     {
+        addShard({ std::make_shared<Redis::AsyncConnection>(redis) });
     }
 
     RedisAugmentor(const std::string& augmentorName,
@@ -36,8 +46,8 @@ public:
                    std::shared_ptr<Redis::AsyncConnection> redis)
         : RTBKIT::AsyncAugmentor(augmentorName,serviceName,proxies)
         , agent_config_ (proxies->zmqContext)
-        , redis_(redis)
     {
+        addShard({ redis });
     }
 
     RedisAugmentor(const std::string& augmentorName,
@@ -46,8 +56,8 @@ public:
                    const Redis::Address& redis)
         : RTBKIT::AsyncAugmentor(augmentorName,serviceName,parent)
         , agent_config_ (parent.getZmqContext())
-        , redis_(std::make_shared<Redis::AsyncConnection>(redis))
     {
+        addShard({ std::make_shared<Redis::AsyncConnection>(redis) });
     }
 
     RedisAugmentor(const std::string& augmentorName,
@@ -56,16 +66,79 @@ public:
                    std::shared_ptr<Redis::AsyncConnection> redis)
         : RTBKIT::AsyncAugmentor(augmentorName,serviceName,parent)
         , agent_config_ (parent.getZmqContext())
-        , redis_ (redis)
     {
+        addShard({ redis });
     }
 
+    /** Keys are sharded over the given nodes, with connectionsPerShard
+        connections to each of them. */
+    RedisAugmentor(const std::string& augmentorName,
+                   const std::string& serviceName,
+                   std::shared_ptr<ServiceProxies> proxies,
+                   const std::vector<Redis::Address>& shards,
+                   int connectionsPerShard = 1);
+
+    /** Look up the keys that arrive within windowMs of each other together,
+        with at most maxKeys keys per MGET.  A window of 0 looks up the keys
+        of each request on their own.  Must be called before init().
+    */
+    void setBatching(double windowMs, size_t maxKeys);
+
+    /** Longest that a request waits for Redis; it also never waits for more
+        than the time the router gave it.  It is then answered with the keys
+        that were found so far.
+    */
+    void setTimeout(double timeoutMs) { timeout_ = timeoutMs * 0.001; }
+
     void init(int nthreads);
     virtual ~RedisAugmentor() ;
 private:
     void onRequest(const AugmentationRequest & request, SendResponseCB sendResponse);
     RTBKIT::AgentConfigurationListener agent_config_;
-    std::shared_ptr<Redis::AsyncConnection> redis_ ;
+
+    /** An augmentation request waiting for its keys. */
+    struct Request {
+        std::map<std::string, std::set<RTBKIT::AccountKey>> jobs;
+        SendResponseCB sendResponse;
+        ML::Timer timer;
+
+        std::mutex lock;
+        AugmentationList result;
+        size_t outstanding = 0;   ///< Keys that didn't come back yet
+        bool answered = false;
+    };
+
+    struct Shard {
+        std::vector<std::shared_ptr<Redis::AsyncConnection>> connections;
+        std::atomic<size_t> next { 0 };   ///< Round robin over connections
+
+        std::mutex lock;
+        /** Keys that are waiting to be looked up, with who wants them, and
+            the latest deadline of those. */
+        std::unordered_map<std::string, std::vector<std::shared_ptr<Request>>> pending;
+        Date deadline;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    double window_ = 0.0005;
+    size_t maxKeys_ = 256;
+    double timeout_ = 0.004;
+
+    /** Requests that didn't get all their keys, by deadline. */
+    TimerWheel<std::weak_ptr<Request>> deadlines_;
+
+    void addShard(std::vector<std::shared_ptr<Redis::AsyncConnection>> connections);
+
+    /** Send the keys that are waiting on the shard to Redis. */
+    void flush(Shard & shard);
+
+    void onKeys(const std::vector<std::string> & keys,
+                const std::vector<std::vector<std::shared_ptr<Request>>> & waiting,
+                const Redis::Result & result);
+
+    /** Answer the request with what it got so far, unless it was already. */
+    void finish(Request & request);
 };
 
 } /* namespace RTBKIT */
@@ -9,6 +9,7 @@
 #include "jml/utils/json_parsing.h"
 #include "rtbkit/openrtb/openrtb.h"
 #include "rtbkit/openrtb/openrtb_parsing.h"
+#include "jml/arch/thread_specific.h"
 
 using namespace std;
 
@@ -21,7 +22,25 @@ namespace RTBKIT {
 
     static DefaultDescription<OpenRTB::BidRequest> desc;
 
-namespace { const char* DefaultVersion = "2.2"; }
+namespace {
+
+const char* DefaultVersion = "2.2";
+
+// Unknown fields are skipped rather than collected as a Json::Value tree.
+struct SkipUnparseableDescription : public DefaultDescription<OpenRTB::BidRequest>
+{
+    SkipUnparseableDescription()
+    {
+        onUnknownField = [] (OpenRTB::BidRequest *, JsonParsingContext & context)
+            {
+                context.skip();
+            };
+    }
+};
+
+SkipUnparseableDescription skipUnparseableDesc;
+
+} // namespace anonymous
 
 std::unique_ptr<OpenRTBBidRequestParser>
 OpenRTBBidRequestParser::
@@ -37,6 +56,39 @@ openRTBBidRequestParserFactory(const std::string & version)
     THROW(OpenRTBBidRequestLogs::error) << "Version : " << version << " not supported in RTBkit." << endl;
 }
 
+namespace {
+
+struct ThreadParsers {
+    std::unique_ptr<OpenRTBBidRequestParser> v2point1;
+    std::unique_ptr<OpenRTBBidRequestParser> v2point2;
+};
+
+ML::ThreadSpecificInstanceInfo<ThreadParsers, OpenRTBBidRequestParser> threadParsers;
+
+} // namespace anonymous
+
+OpenRTBBidRequestParser &
+OpenRTBBidRequestParser::
+threadLocalParser(const std::string & version)
+{
+    ThreadParsers * parsers = threadParsers.get();
+
+    std::unique_ptr<OpenRTBBidRequestParser> * parser = nullptr;
+    if(version == "2.0" || version == "2.1") {
+        parser = &parsers->v2point1;
+    } else if(version == "2.2") {
+        parser = &parsers->v2point2;
+    } else {
+        THROW(OpenRTBBidRequestLogs::error) << "Version : " << version << " not supported in RTBkit." << endl;
+    }
+
+    if(!*parser)
+        *parser = openRTBBidRequestParserFactory(version);
+
+    (*parser)->skipUnparseable = false;
+    return **parser;
+}
+
 OpenRTB::BidRequest
 OpenRTBBidRequestParser::
 toBidRequest(const RTBKIT::BidRequest & br) {
@@ -120,7 +172,10 @@ parseBidRequest(const std::string & jsonValue)
                                             strStart + jsonValue.size());
 
     OpenRTB::BidRequest req;
-    desc.parseJson(&req, jsonContext);
+    if(skipUnparseable)
+        skipUnparseableDesc.parseJson(&req, jsonContext);
+    else
+        desc.parseJson(&req, jsonContext);
     return std::move(req);
 }
 
@@ -131,7 +186,10 @@ parseBidRequest(ML::Parse_Context & context)
     StreamingJsonParsingContext jsonContext(context);
 
     OpenRTB::BidRequest req;
-    desc.parseJson(&req, jsonContext);
+    if(skipUnparseable)
+        skipUnparseableDesc.parseJson(&req, jsonContext);
+    else
+        desc.parseJson(&req, jsonContext);
     return std::move(req);
 }
 
@@ -247,7 +305,7 @@ onBidRequest(OpenRTB::BidRequest & br) {
 
     // Currencies allowed to bid
     if (!br.cur.empty()) {
-        for(auto curr : br.cur)
+        for(const auto & curr : br.cur)
             ctx.br->bidCurrency.push_back(parseCurrencyCode(curr));
     } else {
         // Assume USD
@@ -256,7 +314,8 @@ onBidRequest(OpenRTB::BidRequest & br) {
 
     // Blocked cats if any, put into restriction segment
     std::vector<string> bcats;
-    for(auto b : br.bcat)
+    bcats.reserve(br.bcat.size());
+    for(const auto & b : br.bcat)
         bcats.push_back(b.val);
 
     ctx.br->restrictions.addStrings("bcat", bcats);
@@ -264,7 +323,8 @@ onBidRequest(OpenRTB::BidRequest & br) {
 
     // Blocked advertisers, put into restrictions segment
     std::vector<string> badvs;
-    for(auto b : br.badv)
+    badvs.reserve(br.badv.size());
+    for(const auto & b : br.badv)
         badvs.push_back(b.utf8String());
 
     ctx.br->restrictions.addStrings("badv", badvs);
@@ -609,6 +669,7 @@ onData(OpenRTB::Data & data) {
         key = data.name.extractAscii();
 
     std::vector<std::string> values;
+    values.reserve(data.segment.size());
 
     for (auto & s : data.segment) {
         if(s.id)
@@ -749,8 +810,8 @@ struct AtInit {
     AtInit()
     {
         auto parser = [](const std::string& request) {
-            auto parser = OpenRTBBidRequestParser::openRTBBidRequestParserFactory(DefaultVersion);
-            return parser->parseBidRequest(request, "", "");
+            auto & parser = OpenRTBBidRequestParser::threadLocalParser(DefaultVersion);
+            return parser.parseBidRequest(request, "", "");
         };
         PluginInterface<BidRequest>::registerPlugin("openrtb", parser);
     }
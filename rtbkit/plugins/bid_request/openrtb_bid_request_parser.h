@@ -30,6 +30,13 @@ struct OpenRTBBidRequestLogs {
 //                                 IBidRequestParser<OpenRTB::BidRequest, ML::Parse_Context>
 struct OpenRTBBidRequestParser
 {
+    OpenRTBBidRequestParser() : skipUnparseable(false) {}
+
+    /** When set, fields that aren't part of the OpenRTB spec are skipped
+        instead of being decoded into the unparseable field of the bid
+        request. Only useful when nothing downstream looks at them.
+     */
+    bool skipUnparseable;
 
     OpenRTB::BidRequest parseBidRequest(const std::string & jsonValue);
     OpenRTB::BidRequest parseBidRequest(ML::Parse_Context & context);
@@ -47,6 +54,16 @@ struct OpenRTBBidRequestParser
     static std::unique_ptr<OpenRTBBidRequestParser>
         openRTBBidRequestParserFactory(const std::string & version);
 
+    /** Returns a parser for the given version that is owned by the calling
+        thread and reused across calls. Parsers hold per-request state so they
+        can't be shared between threads but there's no need to create a new
+        one for every bid request either.
+
+        The options of the parser are reset to their default on every call.
+     */
+    static OpenRTBBidRequestParser &
+        threadLocalParser(const std::string & version);
+
     struct OpenRTBParsingContext {
         std::unique_ptr<RTBKIT::BidRequest> br;
         AdSpot spot;
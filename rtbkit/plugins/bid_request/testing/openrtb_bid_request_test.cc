@@ -103,6 +103,61 @@ BOOST_AUTO_TEST_CASE( test_openrtb_sample_requests )
         testBidRequest(s, "2.2");
 }
 
+BOOST_AUTO_TEST_CASE( test_openrtb_thread_local_parser )
+{
+    auto & p21 = OpenRTBBidRequestParser::threadLocalParser("2.1");
+    auto & p22 = OpenRTBBidRequestParser::threadLocalParser("2.2");
+
+    BOOST_CHECK_EQUAL(&p21, &OpenRTBBidRequestParser::threadLocalParser("2.1"));
+    BOOST_CHECK_EQUAL(&p21, &OpenRTBBidRequestParser::threadLocalParser("2.0"));
+    BOOST_CHECK_EQUAL(&p22, &OpenRTBBidRequestParser::threadLocalParser("2.2"));
+    BOOST_CHECK_NE(&p21, &p22);
+    BOOST_CHECK_THROW(OpenRTBBidRequestParser::threadLocalParser("1.0"), std::exception);
+
+    // Reusing the parser must not leak any state between bid requests.
+    for (unsigned round = 0;  round < 2;  ++round) {
+        for (auto s: samples) {
+            ML::Parse_Context context(s);
+            std::unique_ptr<BidRequest> br(p21.parseBidRequest(context, "test", "test"));
+
+            ML::Parse_Context refContext(s);
+            auto p = OpenRTBBidRequestParser::openRTBBidRequestParserFactory("2.1");
+            std::unique_ptr<BidRequest> ref(p->parseBidRequest(refContext, "test", "test"));
+
+            br->timestamp = ref->timestamp;
+            BOOST_CHECK_EQUAL(br->toJsonStr(), ref->toJsonStr());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_openrtb_skip_unparseable )
+{
+    size_t unparseable = 0;
+
+    for (auto s: samples) {
+        auto & p = OpenRTBBidRequestParser::threadLocalParser("2.1");
+        ML::Parse_Context refContext(s);
+        std::unique_ptr<BidRequest> ref(p.parseBidRequest(refContext, "test", "test"));
+
+        auto & skipping = OpenRTBBidRequestParser::threadLocalParser("2.1");
+        skipping.skipUnparseable = true;
+        ML::Parse_Context context(s);
+        std::unique_ptr<BidRequest> br(skipping.parseBidRequest(context, "test", "test"));
+
+        BOOST_CHECK(br->unparseable.isNull());
+        if (!ref->unparseable.isNull()) ++unparseable;
+
+        // Everything else is left untouched.
+        ref->unparseable = Json::Value();
+        br->timestamp = ref->timestamp;
+        BOOST_CHECK_EQUAL(br->toJsonStr(), ref->toJsonStr());
+    }
+
+    // Otherwise the test is pointless.
+    BOOST_CHECK_GT(unparseable, 0);
+    BOOST_CHECK(!OpenRTBBidRequestParser::threadLocalParser("2.1").skipUnparseable);
+}
+
 bool jsonDiff(const Json::Value & v1, const Json::Value & v2,
               bool oneOnly = false,
               string path = "")
@@ -444,6 +499,64 @@ BOOST_AUTO_TEST_CASE( benchmark_canonical_parsing )
          << done / elapsed << "/s" << endl;
 }
 
+BOOST_AUTO_TEST_CASE( test_binary_round_trip )
+{
+    auto & p = OpenRTBBidRequestParser::threadLocalParser("2.1");
+
+    for (auto s: samples) {
+        ML::Parse_Context context(s);
+        std::unique_ptr<BidRequest> br(p.parseBidRequest(context, "test", "test"));
+
+        string json = br->toJsonStr();
+        string binary = br->toBinaryStr();
+        BOOST_CHECK_LT(binary.size(), json.size());
+
+        // The binary encoding must carry exactly what the canonical one does.
+        std::unique_ptr<BidRequest> fromJson(BidRequest::parse("rtbkit", json));
+        std::unique_ptr<BidRequest> fromBinary
+            (BidRequest::parse(BidRequest::BinaryFormat, binary));
+        BOOST_CHECK_EQUAL(fromBinary->toJsonStr(), fromJson->toJsonStr());
+
+        string badVersion = binary;
+        badVersion[3] = 2;
+        BOOST_CHECK_THROW(BidRequest::parse(BidRequest::BinaryFormat, badVersion),
+                          ML::Exception);
+        BOOST_CHECK_THROW(BidRequest::parse(BidRequest::BinaryFormat, json),
+                          ML::Exception);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( benchmark_binary_parsing )
+{
+    cerr << "benchmarking binary parsing of OpenRTB-derived bid requests" << endl;
+
+    vector<string> reqs;
+
+    auto & p = OpenRTBBidRequestParser::threadLocalParser("2.1");
+
+    for (auto s: samples) {
+        ML::Parse_Context context(s);
+        std::unique_ptr<BidRequest> br(p.parseBidRequest(context, "openrtb", "openrtb"));
+        reqs.push_back(br->toBinaryStr());
+    }
+
+    int done = 0;
+    
+    Date before = Date::now();
+
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        
+        for (unsigned i = 0;  i < reqs.size();  ++i, ++done) {
+            std::unique_ptr<BidRequest> br2(BidRequest::parse(BidRequest::BinaryFormat, reqs[i]));
+        }
+    }
+
+    double elapsed = Date::now().secondsSince(before);
+    
+    cerr << "did " << done << " in " << elapsed << "s at "
+         << done / elapsed << "/s" << endl;
+}
+
 BOOST_AUTO_TEST_CASE( id_provider ) {
 
     cerr << "id provider test : making sure we parse it correctly and always set it" << endl;
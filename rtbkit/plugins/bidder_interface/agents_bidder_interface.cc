@@ -20,26 +20,138 @@ AgentsBidderInterface::~AgentsBidderInterface() {
     this->shutdown();
 }
 
+void AgentsBidderInterface::start() {
+    BidderInterface::start();
+
+    batchLoop.addPeriodic("AgentsBidderInterface::flushBatches", 0.001,
+                          [=] (uint64_t) { this->flushExpiredBatches(false); });
+    batchLoop.start();
+}
+
+void AgentsBidderInterface::shutdown() {
+    batchLoop.shutdown();
+    flushExpiredBatches(true);
+
+    BidderInterface::shutdown();
+}
+
+namespace {
+
+/** The frame that the value would be sent as by sendAgentMessage(). */
+template<typename T>
+std::string encodeFrame(const T & value) {
+    zmq::message_t message = encodeMessage(value);
+    return std::string(static_cast<const char *>(message.data()), message.size());
+}
+
+inline void appendFrames(std::vector<std::string> & frames) {
+}
+
+template<typename T, typename... Args>
+void appendFrames(std::vector<std::string> & frames, const T & value, const Args &... args) {
+    frames.push_back(encodeFrame(value));
+    appendFrames(frames, args...);
+}
+
+} // file scope
+
+template<typename... Args>
+void AgentsBidderInterface::sendEventMessage(
+        const std::shared_ptr<const AgentConfig> & agentConfig,
+        std::string const & agent,
+        Args &&... args) {
+    if (!agentConfig || !agentConfig->eventBatching.enabled()) {
+        bridge->sendAgentMessage(agent, std::forward<Args>(args)...);
+        return;
+    }
+
+    std::vector<std::string> frames;
+    appendFrames(frames, args...);
+
+    const auto & config = agentConfig->eventBatching;
+
+    std::lock_guard<std::mutex> guard(batchesLock);
+    EventBatch & batch = batches[agent];
+    if (batch.events == 0)
+        batch.oldest = Date::now();
+    batch.maxDelayMs = config.maxDelayMs;
+
+    batch.frames.push_back(std::to_string(frames.size()));
+    batch.frames.insert(batch.frames.end(),
+                        std::make_move_iterator(frames.begin()),
+                        std::make_move_iterator(frames.end()));
+    ++batch.events;
+
+    if (batch.events >= config.maxEvents)
+        flushBatch(agent, batch);
+}
+
+void AgentsBidderInterface::flushBatch(
+        std::string const & agent, EventBatch & batch) {
+    if (batch.events == 0) return;
+
+    recordLevel(batch.events, "eventBatchSize");
+    bridge->sendAgentMessage(agent, "BATCH", Date::now(), batch.frames);
+
+    batch.frames.clear();
+    batch.events = 0;
+}
+
+void AgentsBidderInterface::flushExpiredBatches(bool all) {
+    std::lock_guard<std::mutex> guard(batchesLock);
+
+    Date now = Date::now();
+    for (auto it = batches.begin(); it != batches.end();) {
+        EventBatch & batch = it->second;
+        if (all || now.secondsSince(batch.oldest) * 1000.0 >= batch.maxDelayMs)
+            flushBatch(it->first, batch);
+
+        // Agents that stop getting events don't keep their entry forever
+        if (batch.events == 0) it = batches.erase(it);
+        else ++it;
+    }
+}
+
 void AgentsBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                                                double timeLeftMs,
                                                std::map<std::string, BidInfo> const & bidders) {
 
+    // The agents are shared with the router shards
+    std::lock_guard<std::recursive_mutex> guard(router->agentsLock);
+
+    // The bid request is the bulk of the message and it's the same for all
+    // the agents that use a given format.  Each encoding gets a single zeromq
+    // message pointing into the auction, which it keeps alive, and that
+    // message is shared by all its recipients instead of being copied.
+    std::vector<std::pair<const std::string *, zmq::message_t> > requests;
+
+    auto getRequest = [&] (const std::string & request) -> const zmq::message_t &
+        {
+            for (const auto & entry : requests)
+                if (entry.first == &request) return entry.second;
+
+            std::shared_ptr<const std::string> payload(auction, &request);
+            requests.emplace_back(&request, sharedStringMessage(payload));
+            return requests.back().second;
+        };
+
     for(auto & item : bidders) {
         auto & agent = item.first;
         auto & spots = item.second.imp;
         auto & info = router->agents[agent];
         WinCostModel wcm = auction->exchangeConnector->getWinCostModel(*auction, *info.config);
+        auto model = info.encodeWinCostModel(wcm);
 
         bridge->sendAgentMessage(agent,
                                  "AUCTION",
                                  auction->start,
                                  auction->id,
                                  info.getBidRequestEncoding(*auction),
-                                 info.encodeBidRequest(*auction),
+                                 getRequest(info.encodeBidRequest(*auction)),
                                  spots.toJsonStr(),
                                  std::to_string(timeLeftMs),
                                  auction->agentAugmentations[agent],
-                                 wcm.toJson());
+                                 *model);
     }
 }
 
@@ -49,55 +161,58 @@ void AgentsBidderInterface::sendWinLossMessage(
     std::string channel =
         event.type == MatchedWinLoss::LateWin ? "LATEWIN" : event.typeString();
 
-    bridge->sendAgentMessage(event.response.agent,
-                              channel,
-                              event.timestamp,
-                              event.confidenceString(),
+    sendEventMessage(agentConfig,
+                     event.response.agent,
+                     channel,
+                     event.timestamp,
+                     event.confidenceString(),
 
-                              event.auctionId.toString(),
-                              std::to_string(event.impIndex),
-                              event.winPrice.toString(),
+                     event.auctionId.toString(),
+                     std::to_string(event.impIndex),
+                     event.winPrice.toString(),
 
-                              event.requestStrFormat,
-                              event.requestStr,
-                              event.response.bidData.toJsonStr(),
-                              event.response.meta,
-                              event.augmentations.toJson());
+                     event.requestStrFormat,
+                     event.requestStr,
+                     event.response.bidData.toJsonStr(),
+                     event.response.meta,
+                     event.augmentations.toJson());
 
 }
 
 void AgentsBidderInterface::sendLossMessage(
         const std::shared_ptr<const AgentConfig>& agentConfig,
         std::string const & agent, std::string const & id) {
-    bridge->sendAgentMessage(agent,
-                             "LOSS",
-                             Date::now(),
-                             "guaranteed",
-                             id,
-                             0,
-                             Amount().toString());
+    sendEventMessage(agentConfig,
+                     agent,
+                     "LOSS",
+                     Date::now(),
+                     "guaranteed",
+                     id,
+                     0,
+                     Amount().toString());
 }
 
 void AgentsBidderInterface::sendCampaignEventMessage(
         const std::shared_ptr<const AgentConfig>& agentConfig,
         std::string const & agent, MatchedCampaignEvent const & event) {
-    bridge->sendAgentMessage(agent,
-                             "CAMPAIGN_EVENT",
-                             event.label,
-                             Date::now(),
-
-                             event.auctionId.toString(),
-                             event.impId.toString(),
-                             std::to_string(event.impIndex),
-
-                             event.requestStrFormat,
-                             event.requestStr,
-                             event.augmentations.toJson(),
-
-                             event.bid,
-                             event.win,
-                             event.campaignEvents,
-                             event.visits);
+    sendEventMessage(agentConfig,
+                     agent,
+                     "CAMPAIGN_EVENT",
+                     event.label,
+                     Date::now(),
+
+                     event.auctionId.toString(),
+                     event.impId.toString(),
+                     std::to_string(event.impIndex),
+
+                     event.requestStrFormat,
+                     event.requestStr,
+                     event.augmentations.toJson(),
+
+                     event.bid,
+                     event.win,
+                     event.campaignEvents,
+                     event.visits);
 
 }
 
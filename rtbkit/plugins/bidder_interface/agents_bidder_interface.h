@@ -6,8 +6,11 @@
 #pragma once
 
 #include "rtbkit/common/bidder_interface.h"
+#include "soa/service/message_loop.h"
 #include "soa/jsoncpp/json.h"
+#include "soa/types/date.h"
 #include <iostream>
+#include <mutex>
 
 namespace RTBKIT {
 
@@ -19,6 +22,11 @@ struct AgentsBidderInterface : public BidderInterface
 
     ~AgentsBidderInterface();
 
+    void start();
+
+    /** Sends whatever is left in the event batches. */
+    void shutdown();
+
     void sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                             double timeLeftMs,
                             std::map<std::string, BidInfo> const & bidders);
@@ -68,6 +76,36 @@ struct AgentsBidderInterface : public BidderInterface
                          std::string const & agent,
                          int ping);
 
+private:
+
+    /** Events waiting to go out to an agent that has eventBatching in its
+        configuration: each one is its number of frames followed by the
+        frames that it would have been sent as on its own.
+    */
+    struct EventBatch {
+        EventBatch() : events(0), maxDelayMs(0) {}
+
+        std::vector<std::string> frames;
+        unsigned events;
+        Date oldest;
+        double maxDelayMs;
+    };
+
+    std::mutex batchesLock;
+    std::map<std::string, EventBatch> batches;
+
+    /** Flushes the batches that have been waiting too long. */
+    MessageLoop batchLoop;
+
+    /** Send the event to the agent, either right away or in its batch. */
+    template<typename... Args>
+    void sendEventMessage(const std::shared_ptr<const AgentConfig> & agentConfig,
+                          const std::string & agent,
+                          Args &&... args);
+
+    /** Must be called with batchesLock held. */
+    void flushBatch(const std::string & agent, EventBatch & batch);
+    void flushExpiredBatches(bool all);
 };
 
 }
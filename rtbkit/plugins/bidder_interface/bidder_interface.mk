@@ -1,7 +1,9 @@
 $(eval $(call library,agents_bidder,agents_bidder_interface.cc,rtb_router))
 $(eval $(call library,http_bidder,http_bidder_interface.cc,rtb_router openrtb_bid_request))
 $(eval $(call library,multi_bidder,multi_bidder_interface.cc,agent_configuration))
+$(eval $(call library,shm_bidder,shm_bidder_interface.cc,agents_bidder rtb_router services))
+$(eval $(call library,inprocess_bidder,in_process_bidder_interface.cc,rtb_router services))
 
-bidder_interface_plugins: $(LIB)/libagents_bidder.so $(LIB)/libhttp_bidder.so $(LIB)/libmulti_bidder.so
+bidder_interface_plugins: $(LIB)/libagents_bidder.so $(LIB)/libhttp_bidder.so $(LIB)/libmulti_bidder.so $(LIB)/libshm_bidder.so $(LIB)/libinprocess_bidder.so
 
 .PHONY: bidder_interface_plugins
@@ -17,6 +17,21 @@ using namespace RTBKIT;
 
 namespace {
     DefaultDescription<OpenRTB::BidRequest> desc;
+    DefaultDescription<OpenRTB::Impression> impDesc;
+
+    /** Print the object without its closing brace so that more members can
+        be written to it. */
+    template<typename T>
+    std::string printUnterminated(const ValueDescriptionT<T> & description,
+                                  const T & val)
+    {
+        std::string result;
+        StringJsonPrintingContext context(result);
+        description.printJson(&val, context);
+        ExcAssert(!result.empty() && result.back() == '}');
+        result.pop_back();
+        return result;
+    }
 
     std::string httpErrorString(HttpClientError code)  {
         switch (code) {
@@ -49,10 +64,19 @@ Logging::Category HttpBidderInterface::trace("HttpBidderInterface Trace", HttpBi
 HttpBidderInterface::HttpBidderInterface(std::string serviceName,
                                          std::shared_ptr<ServiceProxies> proxies,
                                          Json::Value const & json)
-        : BidderInterface(proxies, serviceName) {
+        : BidderInterface(proxies, serviceName),
+          hedgePercentile(95.0),
+          batchWindow(0.0),
+          maxBatchSize(32),
+          hedgeAfterMs(0.0),
+          batchLatencyMs(0.0),
+          inFlight(0),
+          hedgeInFlight(0) {
 
     int routerHttpActiveConnections = 0;
     int adserverHttpActiveConnections = 0;
+    int hedgeHttpActiveConnections = 0;
+    bool routerPipelining = false;
 
     try {
         const auto& router = json["router"];
@@ -61,6 +85,15 @@ HttpBidderInterface::HttpBidderInterface(std::string serviceName,
         routerHost = router["host"].asString();
         routerPath = router["path"].asString();
         routerHttpActiveConnections = router.get("httpActiveConnections", 1024).asInt();
+        routerPipelining = router.get("pipelining", false).asBool();
+
+        hedgeHost = router.get("hedgeHost", "").asString();
+        hedgePercentile = router.get("hedgePercentile", 95.0).asDouble();
+        hedgeHttpActiveConnections = router.get("hedgeHttpActiveConnections",
+                                                routerHttpActiveConnections).asInt();
+
+        batchWindow = router.get("batchWindowUs", 0).asDouble() / 1000000.0;
+        maxBatchSize = router.get("maxBatchSize", 32).asInt();
 
         adserverHost = adserver["host"].asString();
 
@@ -83,6 +116,18 @@ HttpBidderInterface::HttpBidderInterface(std::string serviceName,
                    << "\t\t\"format\" : <string : message format>" << std::endl
                    << "\t\t\"httpActiveConnections\" : <int : concurrent connections>"
                    << std::endl
+                   << "\t\t\"pipelining\" : <bool : pipeline requests on the connections>"
+                   << std::endl
+                   << "\t\t\"hedgeHost\" : <string : second bidder to send slow requests to>"
+                   << std::endl
+                   << "\t\t\"hedgePercentile\" : <double : response time percentile after which to hedge>"
+                   << std::endl
+                   << "\t\t\"hedgeHttpActiveConnections\" : <int : concurrent connections to the hedge host>"
+                   << std::endl
+                   << "\t\t\"batchWindowUs\" : <int : microseconds to wait for auctions to batch together>"
+                   << std::endl
+                   << "\t\t\"maxBatchSize\" : <int : most auctions in a batch>"
+                   << std::endl
                    << "\t\t"
                    << "\t}" << std::endl << "\t{" << std::endl 
                    << "\t{" << std::endl << "\t\"adserver\" : {" << std::endl
@@ -101,15 +146,30 @@ HttpBidderInterface::HttpBidderInterface(std::string serviceName,
                    << "\t}" << std::endl << "}";
     }
 
-    // Force http_client_v2 to avoid latency added by curl in v1
-    httpClientRouter.reset(new HttpClient(routerHost, routerHttpActiveConnections, 0, 2));
+    // Force http_client_v2 to avoid latency added by curl in v1, unless the
+    // requests are to be pipelined which only v1 supports
+    int routerImplVersion = routerPipelining ? 1 : 2;
+
+    httpClientRouter.reset(new HttpClient(routerHost, routerHttpActiveConnections, 0,
+                                          routerImplVersion));
     /* We do not want curl to add an extra "Expect: 100-continue" HTTP header
      * and then pay the cost of an extra HTTP roundtrip. Thus we remove this
      * header
      */
     httpClientRouter->sendExpect100Continue(false);
+    if (routerPipelining)
+        httpClientRouter->enablePipelining(true);
     loop.addSource("HttpBidderInterface::httpClientRouter", httpClientRouter);
 
+    if (!hedgeHost.empty()) {
+        httpClientHedge.reset(new HttpClient(hedgeHost, hedgeHttpActiveConnections, 0,
+                                             routerImplVersion));
+        httpClientHedge->sendExpect100Continue(false);
+        if (routerPipelining)
+            httpClientHedge->enablePipelining(true);
+        loop.addSource("HttpBidderInterface::httpClientHedge", httpClientHedge);
+    }
+
     std::string winHost = adserverHost + ':' + std::to_string(adserverWinPort);
     httpClientAdserverWins.reset(new HttpClient(winHost, adserverHttpActiveConnections));
     httpClientAdserverWins->sendExpect100Continue(false);
@@ -127,6 +187,23 @@ HttpBidderInterface::HttpBidderInterface(std::string serviceName,
 
     loop.addPeriodic("HttpBidderInterface::reportQueues", 1.0, [=](uint64_t) {
         recordLevel(httpClientRouter->queuedRequests(), "queuedRequests");
+        recordLevel(inFlight, "inFlightRequests");
+
+        if (httpClientHedge) {
+            recordLevel(httpClientHedge->queuedRequests(), "hedge.queuedRequests");
+            recordLevel(hedgeInFlight, "hedge.inFlightRequests");
+
+            hedgeAfterMs = responseTimes.percentile(hedgePercentile);
+            recordLevel(hedgeAfterMs, "hedge.thresholdMs");
+        }
+
+        if (batchWindow > 0)
+            batchLatencyMs = responseTimes.percentile(95.0);
+    });
+
+    // Enforces the deadlines, sends the hedged requests and the batches
+    loop.addPeriodic("HttpBidderInterface::pendingTimers", 0.001, [=](uint64_t ticks) {
+        expirePendingTimers(ticks);
     });
 
 }
@@ -151,11 +228,6 @@ void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & au
     using namespace std;
 
     BidRequest & originalRequest = *auction->request;
-    std::vector<Datacratic::Id> ids;
-    ids.reserve(originalRequest.imp.size());
-    for(auto & imp : originalRequest.imp) {
-        ids.push_back(imp.id);
-   }
 
     std::string openRtbVersion;
     string requestStr;
@@ -164,16 +236,50 @@ void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & au
     parseFormat(originalRequest, auction, bidders, requestStr, context, openRtbVersion);
 
     Date sentResponseTime = Date::now();
+    auto pending = std::make_shared<PendingRequest>();
+    std::weak_ptr<PendingRequest> weakPending = pending;
+
+    pending->expire = [=]()
+        {
+            recordHit("expiredRequests");
+            AgentBids bidsToSubmit = noBids(auction, bidders);
+            submitBids(bidsToSubmit);
+        };
+
+    pendingTimers.insert(auction->expiry, PendingTimer{ pending, false });
+
+    if (batchWindow > 0) {
+        addToBatch(BatchEntry{ auction, bidders, std::move(requestStr), pending },
+                   openRtbVersion);
+        return;
+    }
+
     /* We need to capture by copy inside the lambda otherwise we might get
-       a dangling reference if we go out of scope before receiving the http response
+       a dangling reference if we go out of scope before receiving the http response.
+
+       The pending request is only kept alive until the auction deadline, so
+       a response that comes in after that finds it gone.
     */
-    auto callbacks = std::make_shared<HttpClientSimpleCallbacks>(
-            [=](const HttpRequest &, HttpClientError errorCode,
-                int statusCode, const std::string &, std::string &&body)
+    auto onResponse = std::make_shared<std::function<void (bool, HttpClientError, int, std::string &&)> >(
+            [=](bool hedged, HttpClientError errorCode,
+                int statusCode, std::string &&body)
             {
                 Date responseReceivedTime = Date::now();
                 const double responseTime = responseReceivedTime.secondsSince(sentResponseTime);
-                recordOutcome(1000.0 * responseTime, "httpResponseTimeMs");
+                --(hedged ? hedgeInFlight : inFlight);
+
+                // Slow responses still count towards the hedging threshold
+                if (!hedged && errorCode == HttpClientError::None)
+                    responseTimes.add(1000.0 * responseTime);
+
+                auto request = weakPending.lock();
+                if (!request || request->done.exchange(true)) {
+                    recordHit(hedged ? "hedge.ignoredResponses" : "ignoredResponses");
+                    return;
+                }
+
+                recordOutcome(1000.0 * responseTime,
+                              hedged ? "hedge.httpResponseTimeMs" : "httpResponseTimeMs");
                // cerr << "Response: " << "HTTP " << statusCode << std::endl << body << endl;
 
                  /* We need to make sure that we re-inject bids into the router for each
@@ -183,26 +289,7 @@ void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & au
                   * be artificially waiting for that particular bidder to bid, and will
                   * expire the auction.
                   */
-                 AgentBids bidsToSubmit;
-
-                for (const auto &bidder: bidders) {
-                     AgentBidsInfo info;
-                     info.agentName = bidder.first;
-                     info.agentConfig = bidder.second.agentConfig;
-                     info.auctionId = auction->id;
-                     info.wcm = auction->exchangeConnector->getWinCostModel(
-                                       *auction, *info.agentConfig);
-
-                     const BiddableSpots& imps = bidder.second.imp;
-                     info.bids.reserve(imps.size());
-                     for (size_t i = 0; i < imps.size(); ++i) {
-                         Bid bid;
-                         bid.spotIndex = imps[i].first;
-                         info.bids.push_back(bid);
-                     }
-
-                     bidsToSubmit[bidder.first] = info;
-                 }
+                 AgentBids bidsToSubmit = noBids(auction, bidders);
 
                  // Make sure to submit the bids no matter what
                  ML::Call_Guard submitGuard([&] { submitBids(bidsToSubmit); });
@@ -222,63 +309,7 @@ void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & au
                      static DefaultDescription<OpenRTB::BidResponse> respDesc;
                      respDesc.parseJson(&response, jsonContext);
 
-                     for (const auto &seatbid: response.seatbid) {
-
-                         for (const auto &bid: seatbid.bid) {
-                             Bid theBid;
-                             string agent;
-                             shared_ptr<const AgentConfig> config;
-
-                             routerFormat(bid, theBid, agent, config, body, bidders);
-
-                             ExcCheck(!agent.empty(), "Invalid agent");
-
-                             if (!bid.crid) {
-                                 LOG(error) << "crid not found in BidResponse: " << body << std::endl;
-                                 recordError("unknown");
-                                 return;
-                             }
-
-                             Id crid = bid.crid;
-                             int creativeId = 0;
-
-                             if (crid.type == Id::STR) {
-                                 creativeId = std::stoi(crid.toString());
-                             } else {
-                                 creativeId = crid.toInt();
-                             }
-
-                             int creativeIndex = indexOf(config->creatives,
-                                 &Creative::id, creativeId);
-
-                             if (creativeIndex == -1) {
-                                 LOG(error) << "Unknown creative id: " << crid << std::endl;
-                                 recordError("unknown");
-                                 return;
-                             }
-
-                             theBid.creativeIndex = creativeIndex;
-                             theBid.price = USD_CPM(bid.price.val);
-
-                             int spotIndex = -1;
-                             for(size_t i = 0; i < ids.size(); i++) {
-                                if(bid.impid == ids[i]) {
-                                    spotIndex = i;
-                                    break;
-                                }
-                             }
-
-                             if (spotIndex == -1) {
-                                 LOG(error) <<"Unknown impression id: " << bid.impid.toString() << std::endl;
-                                 recordError("unknown");
-                                 return;
-                             }
-                             auto &bidInfo = bidsToSubmit[agent];
-                             theBid.spotIndex = spotIndex;
-                             bidInfo.bids.bidForSpot(spotIndex) = theBid;
-                         }
-                     }
-
+                     submitResponse(response, body, auction, bidders, bidsToSubmit);
                  }
                  else if (statusCode != 204) {
                      LOG(error) << "Invalid HTTP status code: " << statusCode << std::endl
@@ -287,8 +318,17 @@ void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & au
                      return;
                  }
 
-            }
-    );
+            });
+
+    auto makeCallbacks = [=](bool hedged)
+        {
+            return std::make_shared<HttpClientSimpleCallbacks>(
+                    [=](const HttpRequest &, HttpClientError errorCode,
+                        int statusCode, const std::string &, std::string &&body)
+                    {
+                        (*onResponse)(hedged, errorCode, statusCode, std::move(body));
+                    });
+        };
 
     HttpRequest::Content reqContent { requestStr, "application/json" };
 
@@ -296,8 +336,342 @@ void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & au
    // std::cerr << "Sending HTTP POST to: " << routerHost << " " << routerPath << std::endl;
    // std::cerr << "Content " << reqContent.str << std::endl;
 
-    httpClientRouter->post(routerPath, callbacks, reqContent,
-                     { } /* queryParams */, headers);
+    // The http clients time out in whole seconds; the deadline below is what
+    // actually bounds the wait, this only gets the connection back
+    int timeout = std::max(1, int(std::ceil(timeLeftMs / 1000.0)));
+
+    double hedgeAfter = hedgeAfterMs;
+    if (httpClientHedge && hedgeAfter > 0) {
+        Date hedgeAt = sentResponseTime.plusSeconds(hedgeAfter / 1000.0);
+        if (hedgeAt < auction->expiry) {
+            pending->sendHedge = [=]()
+                {
+                    recordHit("hedgedRequests");
+                    ++hedgeInFlight;
+                    if (!httpClientHedge->post(routerPath, makeCallbacks(true), reqContent,
+                                               { } /* queryParams */, headers, timeout)) {
+                        --hedgeInFlight;
+                        recordError("hedge.queue");
+                    }
+                };
+            pendingTimers.insert(hedgeAt, PendingTimer{ pending, true });
+        }
+    }
+
+    ++inFlight;
+    if (!httpClientRouter->post(routerPath, makeCallbacks(false), reqContent,
+                                { } /* queryParams */, headers, timeout)) {
+        --inFlight;
+        recordError("queue");
+    }
+}
+
+void HttpBidderInterface::submitResponse(const OpenRTB::BidResponse &response,
+                                         std::string &body,
+                                         const std::shared_ptr<Auction> &auction,
+                                         const std::map<std::string, BidInfo> &bidders,
+                                         AgentBids &bidsToSubmit)
+{
+    using namespace std;
+
+    const BidRequest & originalRequest = *auction->request;
+    std::vector<Datacratic::Id> ids;
+    ids.reserve(originalRequest.imp.size());
+    for(auto & imp : originalRequest.imp) {
+        ids.push_back(imp.id);
+    }
+
+    for (const auto &seatbid: response.seatbid) {
+
+        for (const auto &bid: seatbid.bid) {
+            Bid theBid;
+            string agent;
+            shared_ptr<const AgentConfig> config;
+
+            routerFormat(bid, theBid, agent, config, body, bidders);
+
+            ExcCheck(!agent.empty(), "Invalid agent");
+
+            if (!bid.crid) {
+                LOG(error) << "crid not found in BidResponse: " << body << std::endl;
+                recordError("unknown");
+                return;
+            }
+
+            Id crid = bid.crid;
+            int creativeId = 0;
+
+            if (crid.type == Id::STR) {
+                creativeId = std::stoi(crid.toString());
+            } else {
+                creativeId = crid.toInt();
+            }
+
+            int creativeIndex = indexOf(config->creatives,
+                &Creative::id, creativeId);
+
+            if (creativeIndex == -1) {
+                LOG(error) << "Unknown creative id: " << crid << std::endl;
+                recordError("unknown");
+                return;
+            }
+
+            theBid.creativeIndex = creativeIndex;
+            theBid.price = USD_CPM(bid.price.val);
+
+            int spotIndex = -1;
+            for(size_t i = 0; i < ids.size(); i++) {
+               if(bid.impid == ids[i]) {
+                   spotIndex = i;
+                   break;
+               }
+            }
+
+            if (spotIndex == -1) {
+                LOG(error) <<"Unknown impression id: " << bid.impid.toString() << std::endl;
+                recordError("unknown");
+                return;
+            }
+            auto &bidInfo = bidsToSubmit[agent];
+            theBid.spotIndex = spotIndex;
+            bidInfo.bids.bidForSpot(spotIndex) = theBid;
+        }
+    }
+
+}
+
+void HttpBidderInterface::addToBatch(BatchEntry &&entry,
+                                     const std::string &openRtbVersion)
+{
+    Date now = Date::now();
+
+    /* The window is cut short when waiting for it would leave less than the
+       bidder's usual response time before the deadline.
+    */
+    Date flushAt = now.plusSeconds(batchWindow);
+    Date flushBy = entry.auction->expiry.plusSeconds(-batchLatencyMs / 1000.0);
+    if (flushBy < flushAt)
+        flushAt = flushBy;
+
+    std::vector<BatchEntry> toSend;
+    std::string toSendVersion;
+
+    {
+        std::lock_guard<std::mutex> guard(batchLock);
+
+        // A batch is sent with a single x-openrtb-version header
+        if (!batch.empty() && openRtbVersion != batchVersion) {
+            toSend.swap(batch);
+            toSendVersion = batchVersion;
+        }
+
+        if (batch.empty()) {
+            batchVersion = openRtbVersion;
+            batchFlushAt = flushAt;
+        }
+        else if (flushAt < batchFlushAt)
+            batchFlushAt = flushAt;
+
+        batch.emplace_back(std::move(entry));
+
+        if (toSend.empty()
+            && (batch.size() >= maxBatchSize || batchFlushAt <= now)) {
+            toSend.swap(batch);
+            toSendVersion = batchVersion;
+        }
+    }
+
+    if (!toSend.empty())
+        sendBatch(std::move(toSend), toSendVersion);
+}
+
+void HttpBidderInterface::flushBatch(Date now)
+{
+    std::vector<BatchEntry> toSend;
+    std::string toSendVersion;
+
+    {
+        std::lock_guard<std::mutex> guard(batchLock);
+        if (batch.empty() || now < batchFlushAt)
+            return;
+        toSend.swap(batch);
+        toSendVersion = batchVersion;
+    }
+
+    sendBatch(std::move(toSend), toSendVersion);
+}
+
+void HttpBidderInterface::sendBatch(std::vector<BatchEntry> &&entries,
+                                    const std::string &openRtbVersion)
+{
+    recordOutcome(entries.size(), "batchSize");
+
+    std::string requestStr = "[";
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (i > 0) requestStr += ',';
+        requestStr += entries[i].requestStr;
+        entries[i].requestStr.clear();
+    }
+    requestStr += ']';
+
+    Date sentResponseTime = Date::now();
+
+    Date lastExpiry = sentResponseTime;
+    for (auto & entry: entries)
+        lastExpiry = std::max(lastExpiry, entry.auction->expiry);
+    int timeout = std::max(1, int(std::ceil(lastExpiry.secondsSince(sentResponseTime))));
+
+    // Only the pending requests are kept alive until the deadline
+    std::vector<std::weak_ptr<PendingRequest> > weakPending;
+    for (auto & entry: entries) {
+        weakPending.emplace_back(entry.pending);
+        entry.pending.reset();
+    }
+
+    auto sharedEntries
+        = std::make_shared<std::vector<BatchEntry> >(std::move(entries));
+
+    auto callbacks = std::make_shared<HttpClientSimpleCallbacks>(
+            [=](const HttpRequest &, HttpClientError errorCode,
+                int statusCode, const std::string &, std::string &&body)
+            {
+                const double responseTime = Date::now().secondsSince(sentResponseTime);
+                --inFlight;
+
+                if (errorCode == HttpClientError::None)
+                    responseTimes.add(1000.0 * responseTime);
+                recordOutcome(1000.0 * responseTime, "httpResponseTimeMs");
+
+                std::vector<OpenRTB::BidResponse> responses;
+
+                if (errorCode != HttpClientError::None) {
+                    LOG(error) << "Error requesting " << routerHost << " ("
+                        << httpErrorString(errorCode) << ")" << std::endl;
+                    recordError("network");
+                }
+                else if (statusCode == 200) {
+                    try {
+                        ML::Parse_Context context("payload",
+                              body.c_str(), body.size());
+                        StreamingJsonParsingContext jsonContext(context);
+                        static DefaultDescription<std::vector<OpenRTB::BidResponse> > respDesc;
+                        respDesc.parseJson(&responses, jsonContext);
+                    } catch (const std::exception & exc) {
+                        LOG(error) << "Invalid batch BidResponse: " << exc.what()
+                                   << std::endl << body << std::endl;
+                        recordError("response");
+                    }
+                }
+                else if (statusCode != 204) {
+                    LOG(error) << "Invalid HTTP status code: " << statusCode << std::endl
+                               << body << std::endl;
+                    recordError("response");
+                }
+
+                // Each response is matched to its auction by its id; the
+                // auctions without one didn't get any bid
+                for (size_t i = 0; i < sharedEntries->size(); ++i) {
+                    const BatchEntry & entry = (*sharedEntries)[i];
+
+                    auto request = weakPending[i].lock();
+                    if (!request || request->done.exchange(true)) {
+                        recordHit("ignoredResponses");
+                        continue;
+                    }
+
+                    AgentBids bidsToSubmit = noBids(entry.auction, entry.bidders);
+                    ML::Call_Guard submitGuard([&] { submitBids(bidsToSubmit); });
+
+                    for (const auto &response: responses) {
+                        if (response.id == entry.auction->id) {
+                            submitResponse(response, body, entry.auction,
+                                           entry.bidders, bidsToSubmit);
+                            break;
+                        }
+                    }
+                }
+            });
+
+    HttpRequest::Content reqContent { requestStr, "application/json" };
+    RestParams headers { { "x-openrtb-version", openRtbVersion },
+                         { "x-openrtb-batch", std::to_string(sharedEntries->size()) } };
+
+    ++inFlight;
+    if (!httpClientRouter->post(routerPath, callbacks, reqContent,
+                                { } /* queryParams */, headers, timeout)) {
+        --inFlight;
+        recordError("queue");
+    }
+}
+
+HttpBidderInterface::AgentBids
+HttpBidderInterface::noBids(const std::shared_ptr<Auction> &auction,
+                            const std::map<std::string, BidInfo> &bidders) const
+{
+    AgentBids result;
+
+    for (const auto &bidder: bidders) {
+        AgentBidsInfo info;
+        info.agentName = bidder.first;
+        info.agentConfig = bidder.second.agentConfig;
+        info.auctionId = auction->id;
+        info.wcm = auction->exchangeConnector->getWinCostModel(
+                          *auction, *info.agentConfig);
+
+        const BiddableSpots& imps = bidder.second.imp;
+        info.bids.reserve(imps.size());
+        for (size_t i = 0; i < imps.size(); ++i) {
+            Bid bid;
+            bid.spotIndex = imps[i].first;
+            info.bids.push_back(bid);
+        }
+
+        result[bidder.first] = info;
+    }
+
+    return result;
+}
+
+void HttpBidderInterface::expirePendingTimers(uint64_t) {
+    pendingTimers.expire(Date::now(), [&](PendingTimer & timer) {
+        PendingRequest & request = *timer.request;
+        if (timer.hedge) {
+            if (!request.done)
+                request.sendHedge();
+        }
+        else if (!request.done.exchange(true)) {
+            request.expire();
+        }
+    });
+
+    if (batchWindow > 0)
+        flushBatch(Date::now());
+}
+
+void HttpBidderInterface::ResponseTimes::add(double ms) {
+    static constexpr size_t NumSamples = 1000;
+
+    std::lock_guard<ML::Spinlock> guard(lock);
+    if (samples.size() < NumSamples)
+        samples.push_back(ms);
+    else samples[next] = ms;
+    next = (next + 1) % NumSamples;
+}
+
+double HttpBidderInterface::ResponseTimes::percentile(double p) const {
+    std::vector<float> sorted;
+    {
+        std::lock_guard<ML::Spinlock> guard(lock);
+        sorted = samples;
+    }
+
+    // Not enough of a history to tell what a slow response is
+    if (sorted.size() < 100)
+        return 0.0;
+
+    auto it = sorted.begin() + std::min<size_t>(sorted.size() - 1, sorted.size() * p / 100.0);
+    std::nth_element(sorted.begin(), it, sorted.end());
+    return *it;
 }
 
 void HttpBidderInterface::parseFormat (BidRequest & originalRequest,
@@ -310,15 +684,104 @@ void HttpBidderInterface::parseFormat (BidRequest & originalRequest,
     else
         openRtbVersion = "2.1";
 
-    std::shared_ptr<OpenRTBBidRequestParser> parser = OpenRTBBidRequestParser::openRTBBidRequestParserFactory(openRtbVersion);
+    auto base = auction->sharedEncoding<OpenRtbBase>(
+            "http-openrtb-" + openRtbVersion,
+            [&] ()
+            {
+                return std::make_shared<const OpenRtbBase>(originalRequest,
+                                                           openRtbVersion);
+            });
 
-    OpenRTB::BidRequest openRtbRequest;
-    openRtbRequest = parser->toBidRequest(originalRequest);
-    if(!prepareStandardRequest(openRtbRequest, originalRequest, auction, bidders)) {
-        return;
+    writeRequest(*base, originalRequest, auction, bidders, requestStr);
+}
+
+HttpBidderInterface::OpenRtbBase::
+OpenRtbBase(const BidRequest & originalRequest,
+            const std::string & openRtbVersion)
+{
+    auto & parser = OpenRTBBidRequestParser::threadLocalParser(openRtbVersion);
+    request = parser.toBidRequest(originalRequest);
+
+    // Take out what the overlay writes, and put it back once printed
+    std::vector<OpenRTB::Impression> imps;
+    Json::Value ext;
+    TaggedInt tmax = request.tmax;
+    std::swap(imps, request.imp);
+    std::swap(ext, request.ext);
+    request.tmax.val = -1;
+
+    head = printUnterminated(desc, request);
+
+    std::swap(imps, request.imp);
+    std::swap(ext, request.ext);
+    request.tmax = tmax;
+
+    for (auto & imp: request.imp) {
+        Json::Value impExt;
+        std::swap(impExt, imp.ext);
+        impHeads.push_back(printUnterminated(impDesc, imp));
+        std::swap(impExt, imp.ext);
     }
-    desc.printJson(&openRtbRequest, context);
-    requestStr = context.output.toString();
+}
+
+bool HttpBidderInterface::writeRequest(const OpenRtbBase & base,
+                                       const RTBKIT::BidRequest &originalRequest,
+                                       const std::shared_ptr<Auction> &auction,
+                                       const std::map<std::string, BidInfo> &bidders,
+                                       std::string & requestStr) const
+{
+    // Only the fields that are tagged per request, starting with their
+    // values in the base
+    OpenRTB::BidRequest overlay;
+    overlay.imp.resize(base.request.imp.size());
+    for (size_t i = 0;  i < overlay.imp.size();  ++i)
+        overlay.imp[i].ext = base.request.imp[i].ext;
+    overlay.ext = base.request.ext;
+
+    if (!prepareStandardRequest(overlay, originalRequest, auction, bidders))
+        return false;
+
+    std::string & out = requestStr;
+    out = base.head;
+    bool first = base.head.size() == 1;
+
+    auto startMember = [&] (bool & first, const char * name)
+        {
+            if (!first) out += ',';
+            first = false;
+            out += '"';
+            out += name;
+            out += "\":";
+        };
+
+    if (!overlay.imp.empty()) {
+        startMember(first, "imp");
+        out += '[';
+        for (size_t i = 0;  i < overlay.imp.size();  ++i) {
+            if (i > 0) out += ',';
+            out += base.impHeads[i];
+            bool impFirst = base.impHeads[i].size() == 1;
+            if (!overlay.imp[i].ext.isNull()) {
+                startMember(impFirst, "ext");
+                out += overlay.imp[i].ext.toStringNoNewLine();
+            }
+            out += '}';
+        }
+        out += ']';
+    }
+
+    if (overlay.tmax.val != -1) {
+        startMember(first, "tmax");
+        out += std::to_string(overlay.tmax.val);
+    }
+
+    if (!overlay.ext.isNull()) {
+        startMember(first, "ext");
+        out += overlay.ext.toStringNoNewLine();
+    }
+
+    out += '}';
+    return true;
 }
 
 void HttpBidderInterface::routerFormat(OpenRTB::Bid const & bid, Bid & theBid,
@@ -651,13 +1114,12 @@ void HttpBidderInterface::injectBids(const std::string &agent, Id auctionId,
      // calling doBid from the context of an other thread (the MessageLoop worker thread).
      // Since the object that handles in flight BidRequests for an agent is not
      // thread-safe, we can not call the doBid function from an other thread.
-     // Instead, we use a queue to communicate with the router thread. We then avoid
-     // an evil race condition.
+     // Instead, we use a queue to communicate with the router thread (or with
+     // the shard owning the auction). We then avoid an evil race condition.
 
-     if (!router->doBidBuffer.tryPush(std::move(message))) {
+     if (!router->pushBid(std::move(message))) {
          throw ML::Exception("Main router loop can not keep up with HttpBidderInterface");
      }
-     router->wakeupMainLoop.signal();
 }
 
 void HttpBidderInterface::submitBids(AgentBids &info) {
@@ -8,6 +8,10 @@
 #include "rtbkit/common/bidder_interface.h"
 #include "soa/service/http_client.h"
 #include "soa/service/logs.h"
+#include "soa/service/timer_wheel.h"
+#include "jml/arch/spinlock.h"
+#include <atomic>
+#include <mutex>
 
 namespace RTBKIT {
 
@@ -103,8 +107,74 @@ protected:
 
     typedef std::map<std::string, AgentBidsInfo> AgentBids;
 
+    /** State of a bid request that was sent to the bidder.  Whichever of the
+        response, the hedged response and the auction deadline comes first
+        sets done and submits the bids; the others are ignored.
+    */
+    struct PendingRequest {
+        PendingRequest() : done(false) {}
+
+        std::atomic<bool> done;
+        std::function<void ()> sendHedge;
+        std::function<void ()> expire;
+    };
+
+    struct PendingTimer {
+        std::shared_ptr<PendingRequest> request;
+        bool hedge;     ///< Time to send the hedge, rather than the deadline
+    };
+
+    /** Recent response times of the bidder, from which the time after which
+        a request gets hedged is computed. */
+    struct ResponseTimes {
+        ResponseTimes() : next(0) {}
+
+        void add(double ms);
+        double percentile(double p) const;
+
+        std::vector<float> samples;
+        size_t next;
+        mutable ML::Spinlock lock;
+    };
+
+    /** Auction waiting to be sent along with others in a single request
+        holding an array of bid requests.  The response is then an array of
+        bid responses, each with the id of its auction. */
+    struct BatchEntry {
+        std::shared_ptr<Auction> auction;
+        std::map<std::string, BidInfo> bidders;
+        std::string requestStr;
+        std::shared_ptr<PendingRequest> pending;
+    };
+
+    /** OpenRTB version of an auction's request, shared between all of the
+        requests sent for the auction: those for each batch of bidders and
+        those of the other HTTP bidder interfaces.  It's serialized once
+        without its impressions, ext and tmax, which are what differs
+        between the requests; each impression is serialized without its
+        ext.
+    */
+    struct OpenRtbBase {
+        OpenRtbBase(const BidRequest & originalRequest,
+                    const std::string & openRtbVersion);
+
+        OpenRTB::BidRequest request;        ///< Whole converted request
+        std::string head;                   ///< Unterminated JSON object
+        std::vector<std::string> impHeads;  ///< Unterminated JSON objects
+    };
+
+    /** Write the request for the given bidders, which is the base with an
+        overlay of the ext fields and tmax that prepareStandardRequest()
+        sets.  Returns false if the request shouldn't be sent. */
+    bool writeRequest(const OpenRtbBase & base,
+                      const RTBKIT::BidRequest &originalRequest,
+                      const std::shared_ptr<Auction> &auction,
+                      const std::map<std::string, BidInfo> &bidders,
+                      std::string & requestStr) const;
+
     MessageLoop loop;
     std::shared_ptr<HttpClient> httpClientRouter;
+    std::shared_ptr<HttpClient> httpClientHedge;
     std::shared_ptr<HttpClient> httpClientAdserverWins;
     std::shared_ptr<HttpClient> httpClientAdserverEvents;
     std::shared_ptr<HttpClient> httpClientAdserverErrors;
@@ -112,6 +182,30 @@ protected:
     std::string routerHost;
     std::string routerPath;
 
+    /** Optional second endpoint to which a duplicate of the request is sent
+        when the first one is slower than hedgePercentile of its recent
+        response times. */
+    std::string hedgeHost;
+    double hedgePercentile;
+
+    TimerWheel<PendingTimer> pendingTimers;
+    ResponseTimes responseTimes;
+    /** How long to wait for more auctions before sending a batch, in
+        seconds; batching is disabled if this is 0.  The wait is cut short so
+        that the bidder's usual response time fits before the deadline. */
+    double batchWindow;
+    size_t maxBatchSize;
+
+    std::mutex batchLock;
+    std::vector<BatchEntry> batch;
+    std::string batchVersion;
+    Date batchFlushAt;
+
+    std::atomic<double> hedgeAfterMs;      ///< 0 until there are enough samples
+    std::atomic<double> batchLatencyMs;
+    std::atomic<int> inFlight;
+    std::atomic<int> hedgeInFlight;
+
     std::string adserverHost;
 
     uint16_t adserverWinPort;
@@ -128,6 +222,22 @@ protected:
 
     void submitBids(AgentBids &info);
 
+    AgentBids noBids(const std::shared_ptr<Auction> &auction,
+                     const std::map<std::string, BidInfo> &bidders) const;
+
+    void expirePendingTimers(uint64_t);
+
+    void submitResponse(const OpenRTB::BidResponse &response,
+                        std::string &body,
+                        const std::shared_ptr<Auction> &auction,
+                        const std::map<std::string, BidInfo> &bidders,
+                        AgentBids &bidsToSubmit);
+
+    void addToBatch(BatchEntry &&entry, const std::string &openRtbVersion);
+    void flushBatch(Date now);
+    void sendBatch(std::vector<BatchEntry> &&entries,
+                   const std::string &openRtbVersion);
+
     bool prepareRequest(OpenRTB::BidRequest &request,
                         const RTBKIT::BidRequest &originalRequest,
                         const std::shared_ptr<Auction> &auction,
@@ -0,0 +1,299 @@
+/* in_process_bidder_interface.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+*/
+
+#include "in_process_bidder_interface.h"
+#include "rtbkit/core/router/router.h"
+#include "jml/utils/exc_check.h"
+
+using namespace Datacratic;
+using namespace RTBKIT;
+
+InProcessBidderInterface::
+InProcessBidderInterface(std::string const & serviceName,
+                         std::shared_ptr<ServiceProxies> proxies,
+                         Json::Value const & config)
+    : BidderInterface(proxies, serviceName)
+{
+    int numThreads = config.get("threads", 2).asInt();
+    ExcCheckGreater(numThreads, 0, "in process bidder interface needs threads");
+
+    for (int i = 0;  i < numThreads;  ++i) {
+        std::unique_ptr<Worker> worker(new Worker());
+        worker->jobs->onEvent = [] (Job && job) { job(); };
+        worker->loop.addSource("InProcessBidderInterface::jobs", worker->jobs);
+        workers.emplace_back(std::move(worker));
+    }
+
+    const auto & agentsConfig = config["agents"];
+    for (auto it = agentsConfig.begin(), end = agentsConfig.end();  it != end;  ++it) {
+        std::string agent = it.memberName();
+        std::string type = (*it).get("type", "").asString();
+        if (type.empty())
+            throw ML::Exception("in process agent '%s' has no type", agent.c_str());
+
+        auto factory = PluginInterface<InProcessAgent>::getPlugin(type);
+        agents[agent].reset(factory(agent, *it));
+    }
+}
+
+InProcessBidderInterface::
+~InProcessBidderInterface()
+{
+    shutdown();
+}
+
+void
+InProcessBidderInterface::
+start()
+{
+    for (auto & worker: workers)
+        worker->loop.start();
+}
+
+void
+InProcessBidderInterface::
+shutdown()
+{
+    for (auto & worker: workers)
+        worker->loop.shutdown();
+}
+
+InProcessAgent *
+InProcessBidderInterface::
+getAgent(const std::string & agent) const
+{
+    auto it = agents.find(agent);
+    return it == agents.end() ? nullptr : it->second.get();
+}
+
+void
+InProcessBidderInterface::
+dispatch(const Id & auctionId, Job && job)
+{
+    size_t index = auctionId.hash() % workers.size();
+    workers[index]->jobs->push(std::move(job));
+}
+
+void
+InProcessBidderInterface::
+sendAuctionMessage(std::shared_ptr<Auction> const & auction,
+                   double timeLeftMs,
+                   std::map<std::string, BidInfo> const & bidders)
+{
+    // Each agent's bid gets its own job so that the agents of an auction
+    // are not waiting on each other
+    for (auto & item : bidders) {
+        std::string agent = item.first;
+        BidInfo info = item.second;
+
+        dispatch(auction->id, [=] () { bid(auction, timeLeftMs, agent, info); });
+    }
+}
+
+void
+InProcessBidderInterface::
+bid(const std::shared_ptr<Auction> & auction,
+    double timeLeftMs,
+    const std::string & agent,
+    const BidInfo & info)
+{
+    BidMessage message;
+    message.agents.push_back(agent);
+    message.auctionId = auction->id;
+    message.meta = "null";
+    message.wcm = auction->exchangeConnector->getWinCostModel(*auction, *info.agentConfig);
+
+    message.bids.reserve(info.imp.size());
+    for (const auto & spot : info.imp) {
+        Bid bid;
+        bid.spotIndex = spot.first;
+        bid.availableCreatives = spot.second;
+        message.bids.push_back(bid);
+    }
+
+    InProcessAgent * handler = getAgent(agent);
+    if (!handler) {
+        recordHit("unknownAgent");
+    }
+    else {
+        // Time spent in the queue comes out of what the agent has left
+        double queuedMs = Date::now().secondsSince(info.bidTime) * 1000.0;
+
+        try {
+            handler->onBidRequest(auction, agent, *info.agentConfig,
+                                  timeLeftMs - queuedMs, message.bids, message.wcm);
+        } catch (const std::exception & exc) {
+            recordHit("agentError");
+            std::cerr << "in process agent " << agent << " threw: "
+                      << exc.what() << std::endl;
+
+            // Whatever it had done so far is dropped
+            for (Bid & bid : message.bids) {
+                bid.price = Amount();
+                bid.creativeIndex = -1;
+            }
+        }
+    }
+
+    // A no-bid still needs to be sent so that the router doesn't wait for it
+    if (!router->pushBid(std::move(message)))
+        recordHit("routerQueueFull");
+}
+
+void
+InProcessBidderInterface::
+sendBidResult(const std::string & agent, const std::string & result,
+              const Id & auctionId)
+{
+    auto handler = agents.find(agent);
+    if (handler == agents.end())
+        return;
+
+    std::shared_ptr<InProcessAgent> target = handler->second;
+    dispatch(auctionId, [=] () { target->onBidResult(agent, result, auctionId); });
+}
+
+void
+InProcessBidderInterface::
+sendWinLossMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                   MatchedWinLoss const & event)
+{
+    std::string agent = event.response.agent;
+    auto handler = agents.find(agent);
+    if (handler == agents.end())
+        return;
+
+    std::shared_ptr<InProcessAgent> target = handler->second;
+    dispatch(event.auctionId, [=] () { target->onWinLoss(agent, event); });
+}
+
+void
+InProcessBidderInterface::
+sendLossMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                std::string const & agent, std::string const & id)
+{
+    sendBidResult(agent, "LOSS", Id(id));
+}
+
+void
+InProcessBidderInterface::
+sendCampaignEventMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                         std::string const & agent,
+                         MatchedCampaignEvent const & event)
+{
+    auto handler = agents.find(agent);
+    if (handler == agents.end())
+        return;
+
+    std::shared_ptr<InProcessAgent> target = handler->second;
+    dispatch(event.auctionId, [=] () { target->onCampaignEvent(agent, event); });
+}
+
+void
+InProcessBidderInterface::
+sendBidLostMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                   std::string const & agent,
+                   std::shared_ptr<Auction> const & auction)
+{
+    sendBidResult(agent, "LOST", auction->id);
+}
+
+void
+InProcessBidderInterface::
+sendBidDroppedMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                      std::string const & agent,
+                      std::shared_ptr<Auction> const & auction)
+{
+    sendBidResult(agent, "DROPPEDBID", auction->id);
+}
+
+void
+InProcessBidderInterface::
+sendBidInvalidMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                      std::string const & agent,
+                      std::string const & reason,
+                      std::shared_ptr<Auction> const & auction)
+{
+    sendBidResult(agent, "INVALID", auction->id);
+}
+
+void
+InProcessBidderInterface::
+sendNoBudgetMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                    std::string const & agent,
+                    std::shared_ptr<Auction> const & auction)
+{
+    sendBidResult(agent, "NOBUDGET", auction->id);
+}
+
+void
+InProcessBidderInterface::
+sendTooLateMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                   std::string const & agent,
+                   std::shared_ptr<Auction> const & auction)
+{
+    sendBidResult(agent, "TOOLATE", auction->id);
+}
+
+void
+InProcessBidderInterface::
+sendMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+            std::string const & agent, std::string const & message)
+{
+}
+
+void
+InProcessBidderInterface::
+sendErrorMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                 std::string const & agent, std::string const & error,
+                 std::vector<std::string> const & payload)
+{
+    std::cerr << "error for in process agent " << agent << ": " << error
+              << std::endl;
+}
+
+void
+InProcessBidderInterface::
+sendPingMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                std::string const & agent, int ping)
+{
+    ExcCheck(ping == 0 || ping == 1, "Bad PING level, must be either 0 or 1");
+
+    // The agents live in this process, so they are alive as long as we are
+    const std::string sentTime
+        = ML::format("%.5f", Date::now().secondsSinceEpoch());
+    const std::string pong = (ping == 0 ? "PONG0" : "PONG1");
+    std::vector<std::string> message { agent, pong, sentTime, sentTime };
+    router->handleAgentMessage(message);
+}
+
+void
+InProcessBidderInterface::
+registerLoopMonitor(LoopMonitor *monitor) const
+{
+    for (size_t i = 0;  i < workers.size();  ++i)
+        monitor->addMessageLoop(serviceName() + ".worker" + std::to_string(i),
+                                &workers[i]->loop);
+}
+
+//
+// factory
+//
+
+namespace {
+
+struct AtInit {
+    AtInit()
+    {
+      PluginInterface<BidderInterface>::registerPlugin("inprocess",
+          [](std::string const &serviceName,
+             std::shared_ptr<ServiceProxies> const &proxies,
+             Json::Value const &json)
+          {
+              return new InProcessBidderInterface(serviceName, proxies, json);
+          });
+    }
+} atInit;
+
+}
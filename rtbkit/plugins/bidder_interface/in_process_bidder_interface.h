@@ -0,0 +1,185 @@
+/* in_process_bidder_interface.h                                   -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Bidder interface that runs bidding agents inside the router process.
+*/
+
+#pragma once
+
+#include "rtbkit/common/bidder_interface.h"
+#include "soa/service/message_loop.h"
+#include "soa/service/typed_message_channel.h"
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* IN PROCESS AGENT                                                          */
+/*****************************************************************************/
+
+/** Bidding agent that is loaded as a plugin into the router and called
+    directly by the InProcessBidderInterface, without any serialization.
+
+    Plugins register a factory with
+    PluginInterface<InProcessAgent>::registerPlugin(), and are loaded from
+    lib<type>_agent.so when they are not already registered.
+
+    All of the calls for a given auction are made on the same thread, one
+    of the interface's worker threads; calls for different auctions may be
+    concurrent.
+*/
+
+struct InProcessAgent
+{
+    virtual ~InProcessAgent() {}
+
+    /** Bid on an auction.  bids has one entry per biddable spot with its
+        spotIndex and availableCreatives set; leaving one untouched means no
+        bid on that spot.  The auction is kept alive while this runs but
+        must not be modified.
+    */
+    virtual void onBidRequest(const std::shared_ptr<Auction> & auction,
+                              const std::string & agent,
+                              const AgentConfig & config,
+                              double timeLeftMs,
+                              Bids & bids,
+                              WinCostModel & wcm) = 0;
+
+    virtual void onWinLoss(const std::string & agent,
+                           const MatchedWinLoss & event)
+    {
+    }
+
+    virtual void onCampaignEvent(const std::string & agent,
+                                 const MatchedCampaignEvent & event)
+    {
+    }
+
+    /** Called for the other bid results: LOST, DROPPEDBID, INVALID,
+        NOBUDGET and TOOLATE. */
+    virtual void onBidResult(const std::string & agent,
+                             const std::string & result,
+                             const Id & auctionId)
+    {
+    }
+
+    typedef std::function<InProcessAgent * (std::string const & agent,
+                                            Json::Value const & config)> Factory;
+
+    /** plugin interface needs to be able to request the root name of the plugin library */
+    static const std::string libNameSufix() { return "agent"; }
+};
+
+
+/*****************************************************************************/
+/* IN PROCESS BIDDER INTERFACE                                               */
+/*****************************************************************************/
+
+/** Runs the auctions of its agents on a pool of threads in the router.
+
+    The agents must still be configured through the agent configuration
+    service like any other, with their bidderInterface pointing to this
+    interface when behind a MultiBidderInterface.
+
+    Configuration:
+    {
+        "type": "inprocess",
+        "threads": <int : number of worker threads, defaults to 2>,
+        "agents": {
+            "<agent name>": { "type": <string : plugin name>, ... }
+        }
+    }
+
+    The object for each agent is passed to its plugin's factory.
+*/
+
+struct InProcessBidderInterface : public BidderInterface
+{
+    InProcessBidderInterface(std::string const & serviceName = "bidderService",
+                             std::shared_ptr<ServiceProxies> proxies = std::make_shared<ServiceProxies>(),
+                             Json::Value const & config = Json::Value());
+
+    ~InProcessBidderInterface();
+
+    void start();
+    void shutdown();
+
+    void sendAuctionMessage(std::shared_ptr<Auction> const & auction,
+                            double timeLeftMs,
+                            std::map<std::string, BidInfo> const & bidders);
+
+    void sendWinLossMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                            MatchedWinLoss const & event);
+
+    void sendLossMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                         std::string const & agent,
+                         std::string const & id);
+
+    void sendCampaignEventMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                                  std::string const & agent,
+                                  MatchedCampaignEvent const & event);
+
+    void sendBidLostMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                            std::string const & agent,
+                            std::shared_ptr<Auction> const & auction);
+
+    void sendBidDroppedMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                               std::string const & agent,
+                               std::shared_ptr<Auction> const & auction);
+
+    void sendBidInvalidMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                               std::string const & agent,
+                               std::string const & reason,
+                               std::shared_ptr<Auction> const & auction);
+
+    void sendNoBudgetMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                             std::string const & agent,
+                             std::shared_ptr<Auction> const & auction);
+
+    void sendTooLateMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                            std::string const & agent,
+                            std::shared_ptr<Auction> const & auction);
+
+    void sendMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                     std::string const & agent,
+                     std::string const & message);
+
+    void sendErrorMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                          std::string const & agent,
+                          std::string const & error,
+                          std::vector<std::string> const & payload);
+
+    void sendPingMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
+                         std::string const & agent,
+                         int ping);
+
+    void registerLoopMonitor(LoopMonitor *monitor) const;
+
+private:
+    typedef std::function<void ()> Job;
+
+    struct Worker {
+        Worker() : jobs(std::make_shared<TypedMessageSink<Job> >(65536)) {}
+
+        MessageLoop loop;
+        std::shared_ptr<TypedMessageSink<Job> > jobs;
+    };
+
+    std::vector<std::unique_ptr<Worker> > workers;
+    std::map<std::string, std::shared_ptr<InProcessAgent> > agents;
+
+    InProcessAgent * getAgent(const std::string & agent) const;
+
+    /** Run the job on the worker that handles the given auction. */
+    void dispatch(const Id & auctionId, Job && job);
+
+    void bid(const std::shared_ptr<Auction> & auction,
+             double timeLeftMs,
+             const std::string & agent,
+             const BidInfo & info);
+
+    void sendBidResult(const std::string & agent,
+                       const std::string & result,
+                       const Id & auctionId);
+};
+
+} // namespace RTBKIT
@@ -38,7 +38,19 @@ MultiBidderInterface::MultiBidderInterface(
 
         bidderInterfaces.insert(
                 std::make_pair(name, bidder));
+
+        Dispatch & entry = dispatch[name];
+        entry.deadlineMs = config.get("deadlineMs", 0.0).asDouble();
+        if (config.get("dispatchThread", false).asBool()) {
+            entry.loop.reset(new MessageLoop());
+            entry.jobs = std::make_shared<TypedMessageSink<Job> >(65536);
+            entry.jobs->onEvent = [] (Job && job) { job(); };
+            entry.loop->addSource("MultiBidderInterface::" + name, entry.jobs);
+        }
     }
+
+    deadlineLoop.addPeriodic("MultiBidderInterface::deadlines", 0.001,
+                             [=] (uint64_t ticks) { expireDeadlines(ticks); });
 }
 
 void MultiBidderInterface::init(AgentBridge *bridge, Router *router)
@@ -56,9 +68,21 @@ void MultiBidderInterface::start() {
     for (const auto &iface: bidderInterfaces) {
         iface.second->start();
     }
+
+    for (auto &entry: dispatch) {
+        if (entry.second.loop)
+            entry.second.loop->start();
+    }
+    deadlineLoop.start();
 }
 
 void MultiBidderInterface::shutdown() {
+    deadlineLoop.shutdown();
+    for (auto &entry: dispatch) {
+        if (entry.second.loop)
+            entry.second.loop->shutdown();
+    }
+
     for (const auto &iface: bidderInterfaces) {
         iface.second->shutdown();
     }
@@ -83,10 +107,60 @@ void MultiBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & a
     }
 
     for (const auto &iface: aggregate) {
-        iface.first->sendAuctionMessage(auction, timeLeftMs, iface.second);
+        const std::string &name = iface.first->interfaceName();
+        const Dispatch &entry = dispatch.at(name);
+
+        recordHit("interfaces.%s.auctions", name);
+
+        if (entry.deadlineMs > 0 && entry.deadlineMs < timeLeftMs) {
+            Deadline deadline;
+            deadline.interface = name;
+            deadline.auctionId = auction->id;
+
+            for (const auto &bidder: iface.second) {
+                Bids bids;
+                for (const auto &spot: bidder.second.imp) {
+                    Bid bid;
+                    bid.spotIndex = spot.first;
+                    bids.push_back(bid);
+                }
+                deadline.noBids.emplace_back(bidder.first, std::move(bids));
+            }
+
+            deadlines.insert(Date::now().plusSeconds(entry.deadlineMs / 1000.0),
+                             std::move(deadline));
+        }
+
+        auto send = [=] ()
+            {
+                Date start = Date::now();
+                iface.first->sendAuctionMessage(auction, timeLeftMs, iface.second);
+                recordOutcome(Date::now().secondsSince(start) * 1000.0,
+                              "interfaces.%s.dispatchMs", name);
+            };
+
+        if (entry.jobs) entry.jobs->push(std::move(send));
+        else send();
     }
 }
 
+void MultiBidderInterface::expireDeadlines(uint64_t) {
+    deadlines.expire(Date::now(), [&] (Deadline &deadline) {
+        for (auto &noBid: deadline.noBids) {
+            BidMessage message;
+            message.agents.push_back(noBid.first);
+            message.auctionId = deadline.auctionId;
+            message.bids = std::move(noBid.second);
+            message.meta = "null";
+            message.deadline = true;
+
+            if (!router->pushBid(std::move(message)))
+                recordHit("interfaces.%s.deadlineDropped", deadline.interface);
+        }
+        recordHit("interfaces.%s.deadlines", deadline.interface);
+    });
+}
+
 void MultiBidderInterface::sendLossMessage(
         const std::shared_ptr<const AgentConfig>& agentConfig,
         std::string const & agent, std::string const & id) {
@@ -9,6 +9,9 @@
 
 #include "rtbkit/common/bidder_interface.h"
 #include "rtbkit/core/router/router.h"
+#include "soa/service/message_loop.h"
+#include "soa/service/typed_message_channel.h"
+#include "soa/service/timer_wheel.h"
 
 namespace RTBKIT {
 
@@ -156,6 +159,35 @@ struct MultiBidderInterface : public BidderInterface {
 
 private:
     std::map<std::string, std::shared_ptr<BidderInterface>> bidderInterfaces;
+
+    typedef std::function<void ()> Job;
+
+    /** How the auctions are handed to one of the interfaces.  Interfaces
+        with a deadline get no-bids in the name of their agents that haven't
+        answered in time, so that the auction doesn't wait for them; those
+        with a thread of their own don't hold up the others while they
+        prepare their requests.
+    */
+    struct Dispatch {
+        Dispatch() : deadlineMs(0.0) {}
+
+        double deadlineMs;      ///< 0 to use the auction's own deadline
+        std::unique_ptr<MessageLoop> loop;
+        std::shared_ptr<TypedMessageSink<Job> > jobs;
+    };
+
+    std::map<std::string, Dispatch> dispatch;
+
+    struct Deadline {
+        std::string interface;
+        Id auctionId;
+        std::vector<std::pair<std::string, Bids> > noBids;
+    };
+
+    MessageLoop deadlineLoop;
+    TimerWheel<Deadline> deadlines;
+
+    void expireDeadlines(uint64_t);
     std::shared_ptr<BidderInterface> findInterface(
                 const std::string &name,
                 const std::string &agent) {
@@ -0,0 +1,212 @@
+/* shm_bidder_interface.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+*/
+
+#include "rtbkit/common/messages.h"
+#include "rtbkit/core/router/router.h"
+#include "soa/service/zmq_utils.h"
+#include "shm_bidder_interface.h"
+
+using namespace Datacratic;
+using namespace RTBKIT;
+
+SharedMemoryBidderInterface::
+SharedMemoryBidderInterface(std::string const & serviceName,
+                            std::shared_ptr<ServiceProxies> proxies,
+                            Json::Value const & config)
+    : AgentsBidderInterface(serviceName, proxies, config),
+      prefix("rtbkit"),
+      bidRingSize(16 * 1024 * 1024),
+      shutdown_(false)
+{
+    if (config.isMember("prefix"))
+        prefix = config["prefix"].asString();
+    if (config.isMember("bidRingSize"))
+        bidRingSize = config["bidRingSize"].asUInt();
+}
+
+SharedMemoryBidderInterface::
+~SharedMemoryBidderInterface()
+{
+    shutdown();
+}
+
+void
+SharedMemoryBidderInterface::
+start()
+{
+    AgentsBidderInterface::start();
+
+    bids = SharedMemoryRing::create(sharedMemoryBidRing(prefix), bidRingSize);
+    shutdown_ = false;
+    bidThread.reset(new std::thread([=] () { this->runBidThread(); }));
+}
+
+void
+SharedMemoryBidderInterface::
+shutdown()
+{
+    if (bidThread) {
+        shutdown_ = true;
+        bidThread->join();
+        bidThread.reset();
+    }
+
+    // Tells the agents to stop sending bids to us
+    bids.reset();
+
+    AgentsBidderInterface::shutdown();
+}
+
+SharedMemoryRing *
+SharedMemoryBidderInterface::
+getAgentRing(const std::string & agent)
+{
+    AgentRing & entry = agentRings[agent];
+
+    if (entry.ring && entry.ring->closed())
+        entry.ring.reset();
+
+    if (!entry.ring) {
+        Date now = Date::now();
+        if (now < entry.nextAttempt)
+            return nullptr;
+
+        // Opening the segment is a few system calls; don't do it on every
+        // auction for agents that don't use shared memory
+        entry.ring = SharedMemoryRing::open(sharedMemoryAuctionRing(prefix, agent));
+        if (!entry.ring) {
+            entry.nextAttempt = now.plusSeconds(1.0);
+            return nullptr;
+        }
+    }
+
+    return entry.ring.get();
+}
+
+void
+SharedMemoryBidderInterface::
+sendAuctionMessage(std::shared_ptr<Auction> const & auction,
+                   double timeLeftMs,
+                   std::map<std::string, BidInfo> const & bidders)
+{
+    // The agents and our rings are shared with the router shards
+    std::lock_guard<std::recursive_mutex> guard(router->agentsLock);
+
+    std::map<std::string, BidInfo> others;
+
+    std::string timestamp = ML::format("%.5f", auction->start.secondsSinceEpoch());
+    std::string id = auction->id.toString();
+    std::string timeLeft = std::to_string(timeLeftMs);
+
+    for (auto & item : bidders) {
+        auto & agent = item.first;
+
+        SharedMemoryRing * ring = getAgentRing(agent);
+        if (!ring) {
+            others.insert(item);
+            continue;
+        }
+
+        auto & info = router->agents[agent];
+        WinCostModel wcm = auction->exchangeConnector->getWinCostModel(*auction, *info.config);
+
+        const std::string & encoding = info.getBidRequestEncoding(*auction);
+        const std::string & request = info.encodeBidRequest(*auction);
+        std::string spots = item.second.imp.toJsonStr();
+        const std::string & augmentations = auction->agentAugmentations[agent];
+        auto model = info.encodeWinCostModel(wcm);
+
+        static const std::string type("AUCTION");
+
+        // The bid request is copied straight from the auction into the ring
+        const std::string * parts[9] = {
+            &type, &timestamp, &id, &encoding, &request, &spots, &timeLeft,
+            &augmentations, model.get()
+        };
+
+        iovec iov[9];
+        for (unsigned i = 0;  i < 9;  ++i) {
+            iov[i].iov_base = (void *)parts[i]->data();
+            iov[i].iov_len = parts[i]->size();
+        }
+
+        if (!ring->tryWrite(iov, 9)) {
+            recordHit("sharedMemory.auctionRingFull");
+            others.insert(item);
+        }
+    }
+
+    if (!others.empty()) {
+        recordCount(others.size(), "sharedMemory.zmqFallback");
+        AgentsBidderInterface::sendAuctionMessage(auction, timeLeftMs, others);
+    }
+}
+
+void
+SharedMemoryBidderInterface::
+runBidThread()
+{
+    std::vector<std::string> message;
+
+    while (!shutdown_) {
+        if (!bids->tryRead(message)) {
+            bids->wait(0.1);
+            continue;
+        }
+
+        try {
+            handleBid(message);
+        } catch (const std::exception & exc) {
+            recordHit("sharedMemory.bidError");
+            std::cerr << "error handling shared memory bid: " << exc.what()
+                      << std::endl;
+        }
+    }
+}
+
+void
+SharedMemoryBidderInterface::
+handleBid(const std::vector<std::string> & message)
+{
+    // Same layout as the BID messages that the agents send over zeromq:
+    // agent, "BID", auction id, bids, win cost model and optionally meta
+    if (message.size() < 5 || message.size() > 6 || message[1] != "BID")
+        throw ML::Exception("invalid shared memory bid message of %zu parts",
+                            message.size());
+
+    const std::string & model = message[4];
+
+    BidMessage bid;
+    bid.agents.push_back(message[0]);
+    bid.auctionId = Id(message[2]);
+    bid.bids = Bids::fromJson(message[3]);
+    bid.wcm = WinCostModel::fromJson(model.empty() ? Json::Value() : Json::parse(model));
+    bid.meta = message.size() == 6 ? message[5] : "null";
+
+    recordHit("sharedMemory.bids");
+
+    if (!router->pushBid(std::move(bid)))
+        throw ML::Exception("router can't keep up with shared memory bids");
+}
+
+//
+// factory
+//
+
+namespace {
+
+struct AtInit {
+    AtInit()
+    {
+      PluginInterface<BidderInterface>::registerPlugin("shm",
+          [](std::string const &serviceName,
+             std::shared_ptr<ServiceProxies> const &proxies,
+             Json::Value const &json)
+          {
+              return new SharedMemoryBidderInterface(serviceName, proxies, json);
+          });
+    }
+} atInit;
+
+}
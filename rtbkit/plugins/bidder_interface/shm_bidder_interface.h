@@ -0,0 +1,74 @@
+/* shm_bidder_interface.h                                          -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Bidder interface that talks to the bidding agents running on the same host
+   through shared memory rings instead of zeromq.
+*/
+
+#pragma once
+
+#include "agents_bidder_interface.h"
+#include "soa/service/shared_memory_ring.h"
+#include "soa/types/date.h"
+#include <atomic>
+#include <thread>
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* SHARED MEMORY BIDDER INTERFACE                                            */
+/*****************************************************************************/
+
+/** Sends the AUCTION messages to each agent through the shared memory ring
+    that the agent created with BiddingAgent::useSharedMemory(), and reads
+    the BID messages of all the agents from a single ring that it owns.
+
+    Agents that have no ring, or whose ring is full, get their auctions over
+    zeromq exactly like with the "agents" interface, as do all of the other
+    messages (configuration, pings, wins and losses).
+
+    Configuration:
+    - prefix: prefix of the names of the rings; must match the agents'.
+      Defaults to "rtbkit".
+    - bidRingSize: size in bytes of the ring the bids come back on.
+*/
+
+struct SharedMemoryBidderInterface : public AgentsBidderInterface
+{
+    SharedMemoryBidderInterface(std::string const & serviceName = "bidderService",
+                                std::shared_ptr<ServiceProxies> proxies = std::make_shared<ServiceProxies>(),
+                                Json::Value const & config = Json::Value());
+
+    ~SharedMemoryBidderInterface();
+
+    void start();
+    void shutdown();
+
+    void sendAuctionMessage(std::shared_ptr<Auction> const & auction,
+                            double timeLeftMs,
+                            std::map<std::string, BidInfo> const & bidders);
+
+private:
+    std::string prefix;
+    size_t bidRingSize;
+
+    std::shared_ptr<Datacratic::SharedMemoryRing> bids;
+    std::unique_ptr<std::thread> bidThread;
+    std::atomic<bool> shutdown_;
+
+    /** Ring of an agent, or the time at which we'll look for it again.
+        Protected by the router's agentsLock. */
+    struct AgentRing {
+        std::shared_ptr<Datacratic::SharedMemoryRing> ring;
+        Date nextAttempt;
+    };
+
+    std::map<std::string, AgentRing> agentRings;
+
+    Datacratic::SharedMemoryRing * getAgentRing(const std::string & agent);
+
+    void runBidThread();
+    void handleBid(const std::vector<std::string> & message);
+};
+
+} // namespace RTBKIT
@@ -7,6 +7,7 @@
 
 #include "rtbkit/plugins/bidding_agent/bidding_agent.h"
 #include "rtbkit/core/agent_configuration/agent_config.h"
+#include "rtbkit/common/messages.h"
 
 #include "jml/arch/exception.h"
 #include "jml/arch/timers.h"
@@ -96,7 +97,9 @@ BiddingAgent(std::shared_ptr<ServiceProxies> proxies,
       toPostAuctionServices(getZmqContext()),
       toConfigurationAgent(getZmqContext()),
       toRouterChannel(65536),
-      requiresAllCB(true)
+      requiresAllCB(true),
+      shutdownAuctionThread(false),
+      implicitLossDeadlines(0.01, 4096)
 {
 }
 
@@ -111,7 +114,9 @@ BiddingAgent(ServiceBase& parent,
       toPostAuctionServices(getZmqContext()),
       toConfigurationAgent(getZmqContext()),
       toRouterChannel(65536),
-      requiresAllCB(true)
+      requiresAllCB(true),
+      shutdownAuctionThread(false),
+      implicitLossDeadlines(0.01, 4096)
 {
 }
 
@@ -121,6 +126,45 @@ BiddingAgent::
     shutdown();
 }
 
+const std::string BiddingAgent::sharedMemoryRouter("sharedMemory");
+
+void
+BiddingAgent::
+useSharedMemory(const std::string & prefix, size_t ringSize)
+{
+    ExcCheck(!auctionThread, "useSharedMemory must be called before init");
+
+    sharedMemoryPrefix = prefix;
+    auctionRing = SharedMemoryRing::create
+        (sharedMemoryAuctionRing(prefix, agentName), ringSize);
+}
+
+void
+BiddingAgent::
+useWorkerThreads(int numThreads)
+{
+    ExcCheck(workers.empty(), "useWorkerThreads can only be called once");
+    ExcCheckGreater(numThreads, 0, "need at least one worker thread");
+
+    for (int i = 0;  i < numThreads;  ++i) {
+        std::unique_ptr<Worker> worker(new Worker());
+
+        worker->queue->onEvent = [=] (WorkerMessage && msg)
+            {
+                try {
+                    processRouterMessage(msg.fromRouter, msg.message);
+                }
+                catch (const std::exception& ex) {
+                    recordHit("error");
+                    cerr << "Error handling auction message " << ex.what() << endl;
+                }
+            };
+        worker->loop.addSource("BiddingAgent::worker::queue", worker->queue);
+
+        workers.emplace_back(std::move(worker));
+    }
+}
+
 void
 BiddingAgent::
 init()
@@ -180,6 +224,16 @@ init()
     addSource("BiddingAgent::toPostAuctionServices", toPostAuctionServices);
     addSource("BiddingAgent::toConfigurationAgent", toConfigurationAgent);
     addSource("BiddingAgent::toRouterChannel", toRouterChannel);
+    addPeriodic("BiddingAgent::implicitLosses", 0.05,
+                [=] (uint64_t) { checkImplicitLosses(); });
+
+    for (auto & worker: workers)
+        worker->loop.start();
+
+    if (auctionRing) {
+        shutdownAuctionThread = false;
+        auctionThread.reset(new std::thread([=] () { runAuctionThread(); }));
+    }
 
     // No need to init() message loop; it was done in the constructor
 }
@@ -188,17 +242,69 @@ void
 BiddingAgent::
 shutdown()
 {
+    if (auctionThread) {
+        shutdownAuctionThread = true;
+        auctionThread->join();
+        auctionThread.reset();
+    }
+
+    // Lets the routers know that they need to go back to zeromq
+    auctionRing.reset();
+
     MessageLoop::shutdown();
 
+    // Anything still queued for the workers is dropped
+    for (auto & worker: workers)
+        worker->loop.shutdown();
+
     toConfigurationAgent.shutdown();
     toRouters.shutdown();
     //toPostAuctionService.shutdown();
 }
 
+BiddingAgent::Worker *
+BiddingAgent::
+getWorker(const std::vector<std::string> & message) const
+{
+    if (workers.empty() || message.empty())
+        return nullptr;
+
+    // Position of the auction id in the messages that get dispatched
+    size_t idIndex;
+    switch (hash(message[0])) {
+        case hash_compile_time("AUCTION") : idIndex = 2; break;
+        case hash_compile_time("WIN") :
+        case hash_compile_time("LOSS") :
+        case hash_compile_time("LATEWIN") :
+        case hash_compile_time("NOBUDGET") :
+        case hash_compile_time("TOOLATE") :
+        case hash_compile_time("INVALID") :
+        case hash_compile_time("DROPPEDBID") : idIndex = 3; break;
+        default : return nullptr;
+    }
+
+    if (message.size() <= idIndex)
+        return nullptr;
+
+    size_t index = std::hash<std::string>()(message[idIndex]) % workers.size();
+    return workers[index].get();
+}
+
 void
 BiddingAgent::
 handleRouterMessage(const std::string & fromRouter,
                     const std::vector<std::string> & message)
+{
+    Worker * worker = getWorker(message);
+    if (worker)
+        worker->queue->push(WorkerMessage{ fromRouter, message });
+    else processRouterMessage(fromRouter, message);
+}
+
+void
+BiddingAgent::
+processRouterMessage(const std::string & fromRouter,
+                     const std::vector<std::string> & message)
 {
     if (message.empty()) {
         cerr << "invalid empty message received" << endl;
@@ -260,6 +366,7 @@ handleRouterMessage(const std::string & fromRouter,
             break;
         }
         case hash_compile_time("DROPPEDBID") : handleResult(message, onDroppedBid); break;
+        case hash_compile_time("BATCH") : handleBatch(fromRouter, message); break;
         case hash_compile_time("GOTCONFIG") : /* no-op */ ; break;
         case hash_compile_time("ERROR") : handleError(message, onError) ; break;
         case hash_compile_time("BYEBYE"): {
@@ -414,11 +521,18 @@ void
 BiddingAgent::
 handleResult(const std::vector<std::string>& msg, ResultCbFn& callback)
 {
-    ExcCheck(!requiresAllCB || callback, "Null callback for " + msg[0]);
-    if (!callback) return;
-
     checkMessageSize(msg, 6);
 
+    // A win for a bid that was already taken as lost corrects the loss
+    ResultCbFn * cb = &callback;
+    if (!resolvePendingResult(msg)) {
+        recordHit("implicitLossLateWin");
+        cb = &onLateWin;
+    }
+
+    ExcCheck(!requiresAllCB || *cb, "Null callback for " + msg[0]);
+    if (!*cb) return;
+
     recordHit(eventName(msg[0]));
     BidResult result = BidResult::parse(msg);
 
@@ -429,7 +543,7 @@ handleResult(const std::vector<std::string>& msg, ResultCbFn& callback)
         recordLevel(int64_t(MicroUSD(bid.price)), "bidPriceOnWin");
     }
 
-    callback(result);
+    (*cb)(result);
 
     if (result.result == BS_DROPPEDBID) {
         lock_guard<mutex> guard (requestsLock);
@@ -437,6 +551,66 @@ handleResult(const std::vector<std::string>& msg, ResultCbFn& callback)
     }
 }
 
+bool
+BiddingAgent::
+resolvePendingResult(const std::vector<std::string>& msg)
+{
+    Id id(msg[3]);
+    bool dropped = msg[0] == "DROPPEDBID";
+
+    lock_guard<mutex> guard(pendingResultsLock);
+    auto it = pendingResults.find(id);
+    if (it == pendingResults.end()) {
+        if (msg[0] != "WIN") return true;
+
+        // Only wins are corrected, and only if any losses might have been
+        // made up; pendingResults is empty if implicit losses were never on
+        lock_guard<mutex> configGuard(agentConfigLock);
+        return !agent_config || agent_config->implicitLossSeconds <= 0;
+    }
+
+    if (dropped) it->second.clear();
+    else {
+        int spot = boost::lexical_cast<int>(msg[4]);
+        if (!it->second.erase(spot) && msg[0] == "WIN")
+            return false;
+    }
+
+    if (it->second.empty())
+        pendingResults.erase(it);
+    return true;
+}
+
+void
+BiddingAgent::
+checkImplicitLosses()
+{
+    vector<pair<Id, set<int> > > lost;
+
+    implicitLossDeadlines.expire(Date::now(), [&] (const Id & id)
+        {
+            lock_guard<mutex> guard(pendingResultsLock);
+            auto it = pendingResults.find(id);
+            if (it == pendingResults.end()) return;
+            lost.emplace_back(id, std::move(it->second));
+            pendingResults.erase(it);
+        });
+
+    string now = to_string(Date::now().secondsSinceEpoch());
+    string price = Amount().toString();
+
+    // Goes through the workers like a loss from the router would, so that
+    // the results of an auction are still handled in order
+    for (auto & auction: lost) {
+        for (int spot: auction.second) {
+            recordHit("implicitLoss");
+            handleRouterMessage("", { "LOSS", now, "inferred",
+                                      auction.first.toString(),
+                                      to_string(spot), price });
+        }
+    }
+}
+
 void
 BiddingAgent::
 handleError(const std::vector<std::string>& msg, ErrorCbFn& callback)
@@ -454,6 +628,29 @@ handleError(const std::vector<std::string>& msg, ErrorCbFn& callback)
     callback(timestamp, description, originalMessage);
 }
 
+void
+BiddingAgent::
+handleBatch(const std::string & fromRouter, const std::vector<std::string>& msg)
+{
+    checkMessageSize(msg, 2);
+
+    // BATCH, timestamp, then each event as its number of frames followed
+    // by its frames
+    size_t pos = 2;
+    while (pos < msg.size()) {
+        size_t size = boost::lexical_cast<size_t>(msg[pos++]);
+        if (size == 0 || size > msg.size() - pos)
+            throw ML::Exception("invalid event of %zu frames at %zu in a batch "
+                                "of %zu frames", size, pos, msg.size());
+
+        std::vector<std::string> event(msg.begin() + pos,
+                                       msg.begin() + pos + size);
+        pos += size;
+
+        handleRouterMessage(fromRouter, event);
+    }
+}
+
 void
 BiddingAgent::
 handleDelivery(const std::vector<std::string>& msg, DeliveryCbFn& callback)
@@ -473,13 +670,20 @@ void
 BiddingAgent::
 doBid(Id id, Bids bids, const Json::Value & jsonMeta, const WinCostModel & wcm)
 {
+    std::shared_ptr<const AgentConfig> config;
+    {
+        lock_guard<mutex> guard (agentConfigLock);
+        config = agent_config;
+    }
+
     for (Bid& bid : bids) {
         if (bid.creativeIndex >= 0) {
             if (!bid.isNullBid()) {
                 recordLevel(bid.price.value, "bidPrice." + bid.price.getCurrencyStr());
             }
 
-            bid.price = agent_config.creatives[bid.creativeIndex].fees->applyFees(bid.price);
+            ExcCheck(config, "bid with a creative before doConfig");
+            bid.price = config->creatives.at(bid.creativeIndex).fees->applyFees(bid.price);
         }
     }
 
@@ -519,8 +723,31 @@ doBid(Id id, Bids bids, const Json::Value & jsonMeta, const WinCostModel & wcm)
 
     recordLevel((afterSend - beforeSend) * 1000.0, "timeTakenMs");
 
-    toRouterChannel.push(RouterMessage(
-                    fromRouter, "BID", { id.toString(), response, model, meta }));
+    // Registered before the bid goes out so that its result can't beat it
+    if (config && config->implicitLossSeconds > 0) {
+        set<int> spots;
+        for (const Bid& bid : bids)
+            if (!bid.isNullBid()) spots.insert(bid.spotIndex);
+
+        if (!spots.empty()) {
+            {
+                lock_guard<mutex> guard(pendingResultsLock);
+                pendingResults[id] = std::move(spots);
+            }
+            implicitLossDeadlines.insert(
+                    afterSend.plusSeconds(config->implicitLossSeconds), id);
+        }
+    }
+
+    if (fromRouter == sharedMemoryRouter) {
+        if (!sendSharedMemoryBid(
+                        { agentName, "BID", id.toString(), response, model, meta }))
+            recordHit("sharedMemory.droppedBids");
+    }
+    else {
+        toRouterChannel.push(RouterMessage(
+                        fromRouter, "BID", { id.toString(), response, model, meta }));
+    }
 
     /** Gather some stats */
     for (const Bid& bid : bids) {
@@ -532,6 +759,41 @@ doBid(Id id, Bids bids, const Json::Value & jsonMeta, const WinCostModel & wcm)
     }
 }
 
+void
+BiddingAgent::
+runAuctionThread()
+{
+    vector<string> message;
+
+    while (!shutdownAuctionThread) {
+        if (!auctionRing->tryRead(message)) {
+            auctionRing->wait(0.1);
+            continue;
+        }
+
+        try {
+            handleRouterMessage(sharedMemoryRouter, message);
+        }
+        catch (const std::exception& ex) {
+            recordHit("error");
+            cerr << "Error handling shared memory auction " << ex.what() << endl;
+        }
+    }
+}
+
+bool
+BiddingAgent::
+sendSharedMemoryBid(const std::vector<std::string> & message)
+{
+    lock_guard<mutex> guard (bidRingLock);
+
+    // The router's ring is replaced whenever it restarts
+    if (!bidRing || bidRing->closed())
+        bidRing = SharedMemoryRing::open(sharedMemoryBidRing(sharedMemoryPrefix));
+
+    return bidRing && bidRing->tryWrite(message);
+}
+
 void
 BiddingAgent::
 handlePing(const std::string & fromRouter,
@@ -584,7 +846,10 @@ doConfigJson(Json::Value jsonConfig)
 
     sendConfig(newConfig);
 
-    agent_config = AgentConfig::createFromJson(jsonConfig);
+    auto parsed = std::make_shared<AgentConfig>(AgentConfig::createFromJson(jsonConfig));
+
+    lock_guard<mutex> guard (agentConfigLock);
+    agent_config = parsed;
 
 }
 
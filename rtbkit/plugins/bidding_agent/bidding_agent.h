@@ -21,6 +21,8 @@
 #include "soa/service/service_base.h"
 #include "soa/service/zmq_endpoint.h"
 #include "soa/service/typed_message_channel.h"
+#include "soa/service/shared_memory_ring.h"
+#include "soa/service/timer_wheel.h"
 
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
@@ -31,6 +33,8 @@
 #include <vector>
 #include <thread>
 #include <map>
+#include <set>
+#include <atomic>
 
 
 namespace RTBKIT {
@@ -72,6 +76,29 @@ struct BiddingAgent : public ServiceBase, public MessageLoop {
     */
     void strictMode(bool strict) { requiresAllCB = strict; }
 
+    /** Receive auctions from, and send bids to, the routers on this host
+        through shared memory instead of zeromq.  This only takes effect with
+        routers that use the "shm" bidder interface with the same prefix;
+        everything else, including the auctions that don't fit in the ring,
+        still goes through zeromq.  Should be called before init().
+
+        Note that the auction callback is then called from a thread of its
+        own, concurrently with the other callbacks.
+    */
+    void useSharedMemory(const std::string & prefix = "rtbkit",
+                         size_t ringSize = 16 * 1024 * 1024);
+
+    /** Run the auction callback, and the bid result callbacks (win, loss,
+        no budget, too late, invalid and dropped bid), on a pool of the given
+        number of threads instead of the message loop's thread.  All of the
+        callbacks for a given auction run on the same thread, in the order in
+        which the messages were received.  The other callbacks stay on the
+        message loop's thread.  Should be called before init().
+
+        doBid may be called from any thread.
+    */
+    void useWorkerThreads(int numThreads);
+
     void init();
     void shutdown();
 
@@ -167,10 +194,19 @@ struct BiddingAgent : public ServiceBase, public MessageLoop {
     ResultCbFn onWin;
 
     /** We won the auction and we should expect to receive delivery noticifation
-        shortly if not already received. */
+        shortly if not already received.
+
+        With AgentConfig::implicitLossSeconds, this is also called for a win
+        that comes in after onLoss was called for the bid. */
     ResultCbFn onLateWin;
     
-    /** We lost either the internal router auction or the exchange auction. */
+    /** We lost either the internal router auction or the exchange auction.
+
+        If the configuration has implicitLossSeconds set, the router doesn't
+        send losses and this is instead called for each spot that was bid on
+        but that had no other result implicitLossSeconds after doBid.  The
+        confidence of those results is "inferred".
+    */
     ResultCbFn onLoss;
 
     /** No bids were placed because the the account for our agent does not
@@ -276,6 +312,43 @@ private:
     std::map<Id, RequestStatus> requests;
     std::mutex requestsLock; // Protects concurrent writes to requests
 
+    /** Shared memory transport with the local routers; see useSharedMemory().
+        Auctions that came in through it have sharedMemoryRouter as their
+        fromRouter.
+    */
+    static const std::string sharedMemoryRouter;
+    std::string sharedMemoryPrefix;
+    std::shared_ptr<Datacratic::SharedMemoryRing> auctionRing;
+    std::shared_ptr<Datacratic::SharedMemoryRing> bidRing;
+    std::mutex bidRingLock; // Protects the opening of and writes to bidRing
+    std::unique_ptr<std::thread> auctionThread;
+    std::atomic<bool> shutdownAuctionThread;
+
+    void runAuctionThread();
+    bool sendSharedMemoryBid(const std::vector<std::string> & message);
+
+    /** Message from a router waiting for a worker thread. */
+    struct WorkerMessage {
+        std::string fromRouter;
+        std::vector<std::string> message;
+    };
+
+    /** Each worker is a message loop of its own, fed by a queue. */
+    struct Worker {
+        Worker() : queue(std::make_shared<TypedMessageSink<WorkerMessage> >(65536)) {}
+
+        MessageLoop loop;
+        std::shared_ptr<TypedMessageSink<WorkerMessage> > queue;
+    };
+
+    std::vector<std::unique_ptr<Worker> > workers;
+
+    /** Returns the worker that handles the given message, or nullptr if it
+        should be handled on the message loop's thread. */
+    Worker * getWorker(const std::vector<std::string> & message) const;
+    void processRouterMessage(const std::string & fromRouter,
+                              const std::vector<std::string> & msg);
+
     bool requiresAllCB;
 
 
@@ -286,7 +359,29 @@ private:
      */
     std::mutex configLock;
     std::string config; // The agent's configuration.
-    AgentConfig agent_config;
+
+    /** Configuration that the bids are priced with.  Replaced as a whole by
+        doConfig so that doBid can run concurrently with it. */
+    std::shared_ptr<const AgentConfig> agent_config;
+    std::mutex agentConfigLock;
+
+    /** Spots that were bid on and that are waiting for a result, by auction,
+        when the configuration asks for implicit losses.  Once the deadline
+        in implicitLossDeadlines passes, a LOSS is made up for the spots that
+        are still there.  Nothing is kept for the spots after that, so a win
+        for a spot that isn't pending is taken to be a late win.
+    */
+    std::map<Id, std::set<int> > pendingResults;
+    std::mutex pendingResultsLock;
+    TimerWheel<Id> implicitLossDeadlines;
+
+    /** Called periodically to call onLoss for the expired pending results. */
+    void checkImplicitLosses();
+
+    /** Removes the spot of the result from pendingResults.  Returns false if
+        the result is for a spot that was not pending while implicit losses
+        are on. */
+    bool resolvePendingResult(const std::vector<std::string>& msg);
 
     void sendConfig(const std::string& newConfig = "");
 
@@ -307,6 +402,11 @@ private:
             const std::vector<std::string>& msg, DeliveryCbFn& callback);
     void handlePing(const std::string & fromRouter,
             const std::vector<std::string>& msg, PingCbFn& callback);
+
+    /** Unpack a BATCH of events (see AgentConfig::eventBatching) and handle
+        each one as if it had come in on its own. */
+    void handleBatch(const std::string & fromRouter,
+            const std::vector<std::string>& msg);
 };
 
 
@@ -15,6 +15,7 @@
 #include <string>
 #include <boost/range/irange.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/tss.hpp>
 #include "adx_exchange_connector.h"
 #include "rtbkit/plugins/exchange/http_auction_handler.h"
 #include "rtbkit/plugins/exchange/realtime-bidding.pb.h"
@@ -196,6 +197,33 @@ typedef ::BidResponse GoogleBidResponse ;
 
 namespace {
 
+/** Message of the given type owned by the calling thread.  Parsing into or
+    Clear()ing a message that is reused keeps the memory of its strings and
+    repeated fields, so after warming up a request no longer allocates the
+    protobuf objects from scratch.
+*/
+template<typename Message>
+Message & threadMessage()
+{
+    static boost::thread_specific_ptr<Message> message;
+    if (!message.get())
+        message.reset(new Message());
+    return *message;
+}
+
+std::string binaryToHex(const std::string & str)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    std::string result(str.size() * 2, '0');
+    for (size_t i = 0;  i < str.size();  ++i) {
+        unsigned char c = str[i];
+        result[i * 2] = digits[c >> 4];
+        result[i * 2 + 1] = digits[c & 15];
+    }
+    return result;
+}
+
 /**
  *    void ParseGbrMobile ()
  *
@@ -515,8 +543,9 @@ parseBidRequest(HttpAuctionHandler & connection,
         return std::shared_ptr<BidRequest> ();
     }
 
-    // Try and parse the protocol buffer payload
-    GoogleBidRequest gbr;
+    // Try and parse the protocol buffer payload; parsing clears the
+    // message left over from this thread's previous request
+    GoogleBidRequest & gbr = threadMessage<GoogleBidRequest>();
     if (!gbr.ParseFromString (payload))
     {
         connection.sendErrorResponse("couldn't decode BidRequest message");
@@ -538,18 +567,8 @@ parseBidRequest(HttpAuctionHandler & connection,
 
     auto& br = *res ;
 
-    // TODO: check reuse
-    auto binary_to_hexstr = [] (const std::string& str)
-    {
-        std::ostringstream os;
-        os << std::hex << std::setfill('0');
-        const unsigned char* pc = reinterpret_cast<const unsigned char*>(str.c_str()) ;
-        for (auto i=0 ; i<str.size(); i++,pc++) os << std::setw(2) << int(*pc) ;
-        return os.str() ;
-    };
-
     // TODO couldn't get Id() to represent correctly [required bytes id = 2;]
-    br.auctionId = Id (binary_to_hexstr(gbr.id()));
+    br.auctionId = Id (binaryToHex(gbr.id()));
     // AdX is a second price auction type.
 
     br.timestamp = Date::now();
@@ -642,7 +661,7 @@ parseBidRequest(HttpAuctionHandler & connection,
 
     if (gbr.has_hosted_match_data())
     {
-        br.user->buyeruid = Id(binary_to_hexstr(gbr.hosted_match_data()));
+        br.user->buyeruid = Id(binaryToHex(gbr.hosted_match_data()));
         // Provider ID is needed to map different bid requests to the same user
         br.userIds.add(br.user->buyeruid, ID_PROVIDER);
     }
@@ -654,7 +673,8 @@ parseBidRequest(HttpAuctionHandler & connection,
         }
         else if (gbr.has_ip() && has_user_agent){
             // Use a hashing function of IP + User Agent concatenation
-            br.userAgentIPHash = Id(CityHash64((gbr.ip() + gbr.user_agent()).c_str(),(gbr.ip() + gbr.user_agent()).length()));
+            std::string ipUa = gbr.ip() + gbr.user_agent();
+            br.userAgentIPHash = Id(CityHash64(ipUa.c_str(), ipUa.length()));
             br.userIds.add(br.userAgentIPHash, ID_PROVIDER);
         }
         else {
@@ -680,7 +700,7 @@ parseBidRequest(HttpAuctionHandler & connection,
 #else
         device.ua = Datacratic::UnicodeString(gbr.user_agent());
 #endif
-        br.userAgent = Datacratic::UnicodeString(gbr.user_agent());
+        br.userAgent = device.ua;
     }
 
     // See function comment.
@@ -742,7 +762,8 @@ getResponse(const HttpAuctionHandler & connection,
     if (current->hasError())
         return getErrorResponse(connection,current->error + ": " + current->details);
 
-    GoogleBidResponse gresp ;
+    GoogleBidResponse & gresp = threadMessage<GoogleBidResponse>();
+    gresp.Clear();
     gresp.set_processing_time_ms(static_cast<uint32_t>(auction.timeUsed()*1000));
 
     auto en = exchangeName();
@@ -837,13 +858,21 @@ AdXExchangeConnector::
 getDroppedAuctionResponse(const HttpAuctionHandler & connection,
                           const std::string & reason) const
 {
-    //
-    GoogleBidResponse resp ;
     // AdX requires us to set the processing time on an empty BidResponse
     // however we do not have this time here, for there is no auction available.
-    // Arbitrary chose to set the processing time to 0 millisecond
-    resp.set_processing_time_ms(0);
-    return HttpResponse(200, "application/octet-stream", resp.SerializeAsString());
+    // Arbitrary chose to set the processing time to 0 millisecond.  It's the
+    // same for every dropped auction, so it's rendered only once.
+    static const HttpResponse response = [] ()
+        {
+            GoogleBidResponse resp ;
+            resp.set_processing_time_ms(0);
+            HttpResponse result(200, "application/octet-stream",
+                                resp.SerializeAsString());
+            result.preRender();
+            return result;
+        } ();
+
+    return response;
 }
 
 HttpResponse
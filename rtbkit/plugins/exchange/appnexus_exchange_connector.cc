@@ -140,7 +140,7 @@ AppNexusExchangeConnector::
 getDroppedAuctionResponse(const HttpAuctionHandler & connection,
                           const std::string & reason) const
 {
-    return HttpResponse(204, "none", "");
+    return noBidResponse();
 }
 
 HttpResponse
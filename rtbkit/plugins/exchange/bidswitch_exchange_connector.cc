@@ -360,7 +360,9 @@ parseBidRequest(HttpAuctionHandler & connection,
 
     // Parse the bid request
     ML::Parse_Context context("Bid Request", payload.c_str(), payload.size());
-    res.reset(OpenRTBBidRequestParser::openRTBBidRequestParserFactory("2.2")->parseBidRequest(context, exchangeName(), exchangeName()));
+    auto & parser = OpenRTBBidRequestParser::threadLocalParser("2.2");
+    parser.skipUnparseable = skipUnparseable;
+    res.reset(parser.parseBidRequest(context, exchangeName(), exchangeName()));
 
     //Parsing "ssp" filed
     if (res!=nullptr){
@@ -47,6 +47,16 @@ public:
     virtual std::string expand(const std::string& templateString,
                        const Context& context) const = 0;
 
+    /** Append the expansion of the template to output, so that a caller
+        can reuse the same buffer from one response to the next.
+    */
+    virtual void expand(const std::string& templateString,
+                        const Context& context,
+                        std::string& output) const
+    {
+        output += expand(templateString, context);
+    }
+
     void addExpanderVariable(const std::string& key, ExpanderCallable value)
     {
         expanderDict_[key] = value;
@@ -101,12 +111,17 @@ public:
     std::string expand(const std::string& templateString,
                        const Context& context) const;
 
+    void expand(const std::string& templateString,
+                const Context& context,
+                std::string& output) const;
+
 private:
     std::vector<ExpandVariable>
     extractVariables(const std::string& snippet) const;
 
     Expander
-    generateExpander(const std::vector<ExpandVariable>& variables) const;
+    generateExpander(const std::string& snippet,
+                     const std::vector<ExpandVariable>& variables) const;
 
     ExpanderCallable getAssociatedCallable(ExpandVariable const& var) const;
     std::string jsonValueToStr(Json::Value const& val) const;
@@ -128,42 +143,54 @@ const std::string TypedCreativeConfiguration<CreativeData>::VARIABLE_MARKER_BEGI
 template<typename CreativeData>
 const std::string TypedCreativeConfiguration<CreativeData>::VARIABLE_MARKER_END = "}";
 
+/** Snippet compiled into the literal text between its variables and the
+    callables that produce the value of each variable, so that expanding it
+    is a single pass of appends.
+*/
 template<typename CreativeData>
 struct TypedCreativeConfiguration<CreativeData>::Expander
 {
-    typedef std::vector<std::pair<ExpandVariable, ExpanderCallable>> FunctorCollection;
+    /** Literal text followed by the variable that comes after it. */
+    struct Segment {
+        std::string literal;
+        ExpanderCallable fn;
+    };
 
-    void addFunctor(const ExpandVariable& var, ExpanderCallable fn)
+    Expander()
+        : literalSize(0)
     {
-        collection.push_back(std::make_pair(var, fn));
     }
 
-    void finalize()
+    void addSegment(std::string literal, ExpanderCallable fn)
     {
-        std::reverse(collection.begin(), collection.end());
+        literalSize += literal.size();
+        segments.push_back(Segment{ std::move(literal), std::move(fn) });
     }
 
-    std::string expand(std::string toExpand, const Context& ctx) const
+    void setTail(std::string literal)
     {
-        for (auto& element : collection) {
-            auto const& var = element.first;
-            auto const& fn = element.second;
+        literalSize += literal.size();
+        tail = std::move(literal);
+    }
 
-            auto const& location = var.getReplaceLocation();
+    void expand(const Context& ctx, std::string& output) const
+    {
+        output.reserve(output.size() + literalSize);
 
-            toExpand.replace(
-                location.first, location.second - location.first, fn(ctx));
+        for (auto& segment : segments) {
+            output += segment.literal;
+            output += segment.fn(ctx);
         }
 
-        return toExpand;
+        output += tail;
     }
 
-    FunctorCollection collection;
-
+    std::vector<Segment> segments;
+    std::string tail;
+    size_t literalSize;   ///< Total size of the literal text
 };
 
 
-
 template <typename CreativeData>
 RTBKIT::ExchangeConnector::ExchangeCompatibility
 TypedCreativeConfiguration<CreativeData>::handleCreativeCompatibility(
@@ -225,7 +252,8 @@ TypedCreativeConfiguration<CreativeData>::handleCreativeCompatibility(
             if (field.isSnippet()) {
                 // assume string
                 auto const& snippet = value.asString();
-                auto expander = generateExpander(extractVariables(snippet));
+                auto expander = generateExpander(snippet,
+                                                 extractVariables(snippet));
                 boost::unique_lock<boost::shared_mutex> lock(mutex_);
                 expanders_[snippet] = expander;
             }
@@ -281,15 +309,15 @@ TypedCreativeConfiguration<CreativeData>::getAssociatedCallable(
     {
 
         auto const& path = var.getPath();
-        auto val = jsonVal;
+        const Json::Value * val = &jsonVal;
         for (auto it = std::begin(path) + 1, end = std::end(path);
-             val != Json::Value::null && it != end;
+             !val->isNull() && it != end;
              ++it) {
-            val = val[*it];
+            val = &(*val)[*it];
         }
 
-        if (val != Json::Value::null) {
-            return this->jsonValueToStr(val);
+        if (!val->isNull()) {
+            return this->jsonValueToStr(*val);
         }
 
         return "";
@@ -324,10 +352,18 @@ TypedCreativeConfiguration<CreativeData>::getAssociatedCallable(
 template <typename CreativeData>
 typename TypedCreativeConfiguration<CreativeData>::Expander
 TypedCreativeConfiguration<CreativeData>::generateExpander(
+    const std::string& snippet,
     const std::vector<ExpandVariable>& variables) const
 {
     Expander expander;
+    size_t literalBegin = 0;
+
     for (auto const& variable : variables) {
+        auto const& location = variable.getReplaceLocation();
+        auto literal = snippet.substr(literalBegin,
+                                      location.first - literalBegin);
+        literalBegin = location.second;
+
         auto callable = getAssociatedCallable(variable);
 
         ExpanderFilterCallable filterFn;
@@ -353,19 +389,19 @@ TypedCreativeConfiguration<CreativeData>::generateExpander(
 
         if (filterFn) {
 
-            expander.addFunctor(
-                    variable,
+            expander.addSegment(
+                    std::move(literal),
                     [filterFn, callable](Context const & ctx) {
                         std::string result = callable(ctx);
                         filterFn(result);
                         return result;
             });
         } else {
-            expander.addFunctor(variable, callable);
+            expander.addSegment(std::move(literal), callable);
         }
     }
 
-    expander.finalize();
+    expander.setTail(snippet.substr(literalBegin));
     return expander;
 }
 
@@ -397,10 +433,27 @@ template <typename CreativeData>
 std::string
 TypedCreativeConfiguration<CreativeData>::expand(const std::string& templateString,
                                             const Context& context) const
+{
+    std::string result;
+    expand(templateString, context, result);
+    return result;
+}
+
+template <typename CreativeData>
+void
+TypedCreativeConfiguration<CreativeData>::expand(const std::string& templateString,
+                                            const Context& context,
+                                            std::string& output) const
 {
     boost::shared_lock<boost::shared_mutex> lock(mutex_);
-    auto const& expander = expanders_[templateString];
-    return expander.expand(templateString, context);
+    auto it = expanders_.find(templateString);
+    if (it == expanders_.end()) {
+        // Not a snippet that we know of, so there is nothing to expand
+        output += templateString;
+        return;
+    }
+
+    it->second.expand(context, output);
 }
 
 
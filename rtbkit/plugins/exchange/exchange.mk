@@ -19,7 +19,7 @@ $(eval $(call library,nexage_exchange,nexage_exchange_connector.cc,openrtb_excha
 $(eval $(call library,appnexus_exchange,appnexus_exchange_connector.cc,exchange bid_test_utils appnexus_bid_request))
 $(eval $(call library,gumgum_exchange,gumgum_exchange_connector.cc,exchange bid_test_utils openrtb_bid_request))
 $(eval $(call library,fbx_exchange,fbx_exchange_connector.cc,exchange bid_test_utils fbx_bid_request))
-$(eval $(call library,adx_exchange,realtime-bidding.proto adx_exchange_connector.cc,exchange protobuf))
+$(eval $(call library,adx_exchange,realtime-bidding.proto adx_exchange_connector.cc,exchange protobuf boost_thread))
 $(eval $(call library,rtbkit_exchange,rtbkit_exchange_connector.cc,openrtb_exchange))
 $(eval $(call library,casale_exchange,casale_exchange_connector.cc,openrtb_exchange))
 $(eval $(call library,spotx_exchange,spotx_exchange_connector.cc,openrtb_exchange))
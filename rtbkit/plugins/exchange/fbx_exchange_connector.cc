@@ -142,11 +142,11 @@ getResponse(const HttpAuctionHandler & connection,
     }
 
     static Datacratic::DefaultDescription<FBX::BidResponse> desc;
-    std::ostringstream stream;
-    StreamJsonPrintingContext context(stream);
+    std::string & buffer = StringJsonPrintingContext::threadBuffer();
+    StringJsonPrintingContext context(buffer);
     desc.printJsonTyped(&response, context);
 
-    return HttpResponse(200, "application/json", stream.str());
+    return HttpResponse(200, "application/json", buffer);
 }
 
 } // namespace RTBKIT
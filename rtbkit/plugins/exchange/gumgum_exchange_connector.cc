@@ -137,7 +137,7 @@ parseBidRequest(HttpAuctionHandler & connection,
 
     // Parse the bid request
     ML::Parse_Context context("Bid Request", payload.c_str(), payload.size());
-    res.reset(OpenRTBBidRequestParser::openRTBBidRequestParserFactory(openRtbVersion)->parseBidRequest(context, exchangeName(), exchangeName()));
+    res.reset(OpenRTBBidRequestParser::threadLocalParser(openRtbVersion).parseBidRequest(context, exchangeName(), exchangeName()));
         
     cerr << res->toJson() << endl;
 
@@ -253,16 +253,16 @@ getResponse(const HttpAuctionHandler & connection,
     }
 
     if (seatToBid.empty())
-        return HttpResponse(204, "none", "");
+        return noBidResponse();
 
     static Datacratic::DefaultDescription<OpenRTB::BidResponse> desc;
-    std::ostringstream stream;
-    StreamJsonPrintingContext context(stream);
+    std::string & buffer = StringJsonPrintingContext::threadBuffer();
+    StringJsonPrintingContext context(buffer);
     desc.printJsonTyped(&response, context);
 
-    cerr << Json::parse(stream.str());
+    cerr << Json::parse(buffer);
 
-    return HttpResponse(200, "application/json", stream.str());
+    return HttpResponse(200, "application/json", buffer);
 }
 
 HttpResponse
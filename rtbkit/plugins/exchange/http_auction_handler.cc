@@ -15,6 +15,8 @@
 #include "jml/utils/set_utils.h"
 #include "jml/utils/vector_utils.h"
 #include "jml/arch/timers.h"
+#include "rtbkit/common/auction_trace.h"
+#include "soa/service/scope_profiler.h"
 #include <set>
 
 #include <boost/foreach.hpp>
@@ -42,7 +44,9 @@ recordRequest(HttpHeader const & headers, std::string const & body) {
         stream.open(filename);
     }
 
-    stream << headers << body << std::endl;
+    // The time line is skipped by readers looking for the next request
+    stream << "RECORDED " << ML::format("%.6f", Date::now().secondsSinceEpoch())
+           << "\r\n" << headers << body << std::endl;
     ++requestCount;
     if(requestCount == requestLimit) {
         stream.close();
@@ -63,6 +67,15 @@ unsigned
 HttpAuctionLogger::
 parse(const std::string & filename,
       const std::function<void(const std::string &)> & callback)
+{
+    return parse(filename,
+                 [&] (const std::string & request, Date) { callback(request); });
+}
+
+unsigned
+HttpAuctionLogger::
+parse(const std::string & filename,
+      const std::function<void(const std::string &, Date)> & callback)
 {
     cerr << "reading packets from " << filename << endl;
 
@@ -75,10 +88,15 @@ parse(const std::string & filename,
         try {
             Parse_Context::Hold_Token hold(context);
 
+            Date recorded = Date::notADate();
             while (context) {
                 Parse_Context::Revert_Token token(context);
                 if (context.match_literal("POST")) break;
                 token.ignore();
+                if (context.match_literal("RECORDED ")) {
+                    recorded = Date::fromSecondsSinceEpoch
+                        (context.expect_double());
+                }
                 context.expect_line();
             }
 
@@ -114,7 +132,7 @@ parse(const std::string & filename,
 
             context.match_eol();
 
-            callback(request);
+            callback(request, recorded);
             ++count;
         }
         catch (const std::exception & exc) {
@@ -136,7 +154,8 @@ long HttpAuctionHandler::destroyed = 0;
 
 HttpAuctionHandler::
 HttpAuctionHandler()
-    : hasTimer(false), disconnected(false), servingRequest(false)
+    : hasTimer(false), timerGeneration(0), disconnected(false),
+      servingRequest(false)
 {
     atomic_add(created, 1);
 }
@@ -212,6 +231,17 @@ handleTimeout(Date date, size_t cookie)
     }
 }
 
+void
+HttpAuctionHandler::
+handleDeadline(uint64_t generation)
+{
+    if (!hasTimer || generation != timerGeneration)
+        return;  // cancelled in the meantime
+
+    hasTimer = false;
+    handleTimeout(Date::now(), 1);
+}
+
 void
 HttpAuctionHandler::
 cancelTimer()
@@ -221,7 +251,7 @@ cancelTimer()
     //cerr << "cancelling timer" << endl;
 
     addActivityS("cancelTimer");
-    ConnectionHandler::cancelTimer();
+    ++timerGeneration;
     hasTimer = false;
 }
 
@@ -319,7 +349,16 @@ handleHttpPayload(const HttpHeader & header,
         return;
     }
 
-    double acceptProbability = endpoint->acceptAuctionProbability;
+    // Shed load before spending any time parsing the request
+    if (endpoint->tooManyServingRequests()) {
+        doEvent("auctionEarlyDrop.tooManyServingRequests");
+        if(!endpoint->disableAcceptProbability) {
+            dropAuction("too many requests being served");
+            return;
+        }
+    }
+
+    double acceptProbability = endpoint->admissionProbability();
     if (acceptProbability < 1.0
         && random() % 1000000 > 1000000 * acceptProbability) {
         // early drop...
@@ -394,6 +433,7 @@ handleHttpPayload(const HttpHeader & header,
             return;
         }
 
+        uint64_t parseStart = ML::ticks();
         auto bidRequest = parseBidRequest(header, payload);
 
         if (!bidRequest) {
@@ -403,12 +443,22 @@ handleHttpPayload(const HttpHeader & header,
             return;
         }
 
+        // Don't make an auction out of a request that no agent could bid on
+        auto eligibility = endpoint->getEligibility();
+        if (eligibility && !eligibility->wants(*bidRequest)) {
+            doEvent("auctionEarlyDrop.noEligibleAgent");
+            dropAuction("no eligible agent");
+            return;
+        }
+
         auction.reset(new Auction(endpoint,
                                   handleAuction, bidRequest,
                                   bidRequest->toJsonStr(),
                                   "datacratic",
                                   firstData, expiry));
 
+        AuctionTrace::record(auction->id, AS_PARSE, parseStart);
+
         auction->requestOriginal = payload;
         endpoint->adjustAuction(auction);
 
@@ -473,7 +523,8 @@ handleHttpPayload(const HttpHeader & header,
     
     addActivity("timeAvailable: %.1fms", timeAvailableMs);
     
-    scheduleTimerAbsolute(expiry, 1);
+    ++timerGeneration;
+    endpoint->scheduleAuctionDeadline(*this, expiry);
     hasTimer = true;
     
     addActivity("gotTimer for %s",
@@ -494,6 +545,8 @@ sendResponse()
     if (!transport().lockedByThisThread())
         throw Exception("sendResponse must be in handler context");
 
+    ProfileScope scope("sendResponse");
+
     addActivityS("sendResponse");
 
     //cerr << "locked by " << bid->lock.get_thread_id() << endl;
@@ -519,6 +572,8 @@ sendResponse()
     
     cancelTimer();
 
+    AuctionTrace::record(auction->id, AS_RESPONSE);
+
     endpoint->onAuctionDone(auction);
 
     //cerr << "sendResponse " << this << ": disconnected "
@@ -628,6 +683,7 @@ HttpAuctionHandler::
 parseBidRequest(const HttpHeader & header,
                 const std::string & payload)
 {
+    ProfileScope scope("parseBidRequest");
     return endpoint->parseBidRequest(*this, header, payload);
 }
 
@@ -34,6 +34,14 @@ struct HttpAuctionLogger :
     static unsigned parse(const std::string & filename,
                           const std::function<void(const std::string &)> & callback);
 
+    /** Parse a log file, also passing the time at which each request was
+        recorded.  Logs written before the time was recorded give an
+        invalid Date.
+    */
+    static unsigned parse(const std::string & filename,
+                          const std::function<void(const std::string &,
+                                                   Date)> & callback);
+
 private:
     /// make sure requests are serialized
     std::mutex lock;
@@ -68,6 +76,7 @@ struct HttpAuctionHandler
     std::shared_ptr<Auction> auction;
     std::shared_ptr<HttpAuctionLogger> logger;
     bool hasTimer;
+    uint64_t timerGeneration;  ///< Incremented whenever the timer changes
     bool disconnected;
     bool servingRequest;  ///< Are we currently, actively serving a request?
 
@@ -91,6 +100,12 @@ struct HttpAuctionHandler
 
     virtual void handleTimeout(Date date, size_t cookie);
 
+    /** Called in handler context when an auction deadline scheduled with
+        the endpoint expires.  Times out the auction unless the timer has
+        been cancelled or rescheduled since.
+    */
+    void handleDeadline(uint64_t generation);
+
     virtual void onDisassociate();
     virtual void onCleanup();
     virtual std::string status() const;
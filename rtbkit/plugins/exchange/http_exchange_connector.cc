@@ -14,6 +14,7 @@
 #include "jml/utils/set_utils.h"
 #include "jml/utils/vector_utils.h"
 #include "jml/arch/timers.h"
+#include "jml/arch/rt.h"
 #include "rtbkit/core/router/router.h"
 #include <set>
 
@@ -58,12 +59,17 @@ postConstructorInit()
     bindHost = "*";
     performNameLookup = true;
     backlog = DEF_BACKLOG;
+    numAcceptors = 1;
+    busyPollUs = 0;
     pingTimeUnknownHostsMs = 20;
     auctionVerb = "POST";
     auctionResource = "/";
     absoluteTimeMax = 50.0;
     disableAcceptProbability = false;
     disableExceptionPrinting = false;
+    shedWeight = 1.0;
+    minAcceptRatio = 0.0;
+    maxServingRequests = 0;
 
     numServingRequest = 0;
 
@@ -83,6 +89,10 @@ postConstructorInit()
     addPeriodic(1.0,
                 [=] (uint64_t numWakeUps)
                 { this->periodicCallback(numWakeUps); });
+
+    addPeriodic(0.001,
+                [=] (uint64_t numWakeUps)
+                { this->expireAuctionDeadlines(numWakeUps); });
 }
 
 HttpExchangeConnector::
@@ -99,10 +109,14 @@ configure(const Json::Value & parameters)
 
     getParam(parameters, numThreads, "numThreads");
     getParam(parameters, realTimePriority, "realTimePriority");
+    if (parameters.isMember("cpuAffinity"))
+        cpuAffinity = ML::parseCpuList(parameters["cpuAffinity"].asString());
     getParam(parameters, listenPort, "listenPort");
     getParam(parameters, bindHost, "bindHost");
     getParam(parameters, performNameLookup, "performNameLookup");
     getParam(parameters, backlog, "connectionBacklog");
+    getParam(parameters, numAcceptors, "numAcceptors");
+    getParam(parameters, busyPollUs, "busyPollUs");
     getParam(parameters, auctionResource, "auctionResource");
     getParam(parameters, auctionVerb, "auctionVerb");
     getParam(parameters, pingTimesByHostMs, "pingTimesByHostMs");
@@ -110,6 +124,14 @@ configure(const Json::Value & parameters)
     getParam(parameters, absoluteTimeMax, "absoluteTimeMax");
     getParam(parameters, disableAcceptProbability, "disableAcceptProbability");
     getParam(parameters, disableExceptionPrinting, "disableExceptionPrinting");
+    getParam(parameters, shedWeight, "shedWeight");
+    getParam(parameters, minAcceptRatio, "minAcceptRatio");
+    getParam(parameters, maxServingRequests, "maxServingRequests");
+
+    if (shedWeight < 0)
+        throw ML::Exception("shedWeight must not be negative");
+    if (minAcceptRatio < 0 || minAcceptRatio > 1)
+        throw ML::Exception("minAcceptRatio must be between 0 and 1");
 
     if (parameters.isMember("realTimePolling"))
         realTimePolling(parameters["realTimePolling"].asBool());
@@ -141,7 +163,8 @@ configureHttp(int numThreads,
               const std::string & auctionVerb,
               int realTimePriority,
               bool realTimePolling,
-              double absoluteTimeMax)
+              double absoluteTimeMax,
+              int numAcceptors)
 {
     this->numThreads = numThreads;
     this->realTimePriority = realTimePriority;
@@ -149,6 +172,7 @@ configureHttp(int numThreads,
     this->bindHost = bindHost;
     this->performNameLookup = performNameLookup;
     this->backlog = backlog;
+    this->numAcceptors = numAcceptors;
     this->auctionResource = auctionResource;
     this->auctionVerb = auctionVerb;
     this->realTimePolling(realTimePolling);
@@ -161,11 +185,15 @@ void
 HttpExchangeConnector::
 start()
 {
+    PassiveEndpoint::setBusyPoll(busyPollUs);
     PassiveEndpoint::init(listenPort, bindHost, numThreads, true,
-                          performNameLookup, backlog);
+                          performNameLookup, backlog, numAcceptors);
     if (realTimePriority > -1) {
         PassiveEndpoint::makeRealTime(realTimePriority);
     }
+    if (!cpuAffinity.empty()) {
+        PassiveEndpoint::setThreadAffinity(cpuAffinity);
+    }
 }
 
 void
@@ -305,7 +333,29 @@ HttpExchangeConnector::
 getDroppedAuctionResponse(const HttpAuctionHandler & connection,
                           const std::string & reason) const
 {
-    return HttpResponse(204, "none", "");
+    return noBidResponse();
+}
+
+const HttpResponse &
+HttpExchangeConnector::
+noBidResponse()
+{
+    static const HttpResponse response = [] ()
+        {
+            HttpResponse result(204, "none", "");
+            result.preRender();
+            return result;
+        } ();
+
+    return response;
+}
+
+double
+HttpExchangeConnector::
+admissionProbability() const
+{
+    double shed = (1.0 - acceptAuctionProbability) * shedWeight;
+    return std::max(minAcceptRatio, std::min(1.0, 1.0 - shed));
 }
 
 HttpResponse
@@ -357,6 +407,44 @@ periodicCallback(uint64_t numWakeups) const
     recordLevel(numConnections(), "httpConnections");
 }
 
+void
+HttpExchangeConnector::
+scheduleAuctionDeadline(HttpAuctionHandler & handler, Date expiry)
+{
+    AuctionDeadline deadline;
+    deadline.transport = handler.transport().shared_from_this();
+    deadline.handler = handler.shared_from_this();
+    deadline.generation = handler.timerGeneration;
+
+    auctionDeadlines.insert(expiry, std::move(deadline));
+}
+
+void
+HttpExchangeConnector::
+expireAuctionDeadlines(uint64_t numWakeups)
+{
+    auto onExpired = [&] (const AuctionDeadline & deadline)
+        {
+            auto transport = deadline.transport.lock();
+            if (!transport)
+                return;
+
+            /* The timeout needs to run with the connection locked, like it
+               would for a timer on the transport itself. */
+            auto handler = deadline.handler;
+            uint64_t generation = deadline.generation;
+            transport->doAsync([=] ()
+                               {
+                                   auto sp = handler.lock();
+                                   if (sp)
+                                       sp->handleDeadline(generation);
+                               },
+                               "auctionDeadline");
+        };
+
+    auctionDeadlines.expire(Date::now(), onExpired);
+}
+
 PipelineStatus
 HttpExchangeConnector::
 preBidRequest(const HttpHeader& header, const std::string& payload) {
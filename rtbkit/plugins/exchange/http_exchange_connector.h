@@ -12,6 +12,7 @@
 #include "jml/arch/atomic_ops.h"
 #include "soa/service/json_endpoint.h"
 #include "soa/service/stats_events.h"
+#include "soa/service/timer_wheel.h"
 #include "rtbkit/common/auction.h"
 #include <limits>
 #include "rtbkit/common/exchange_connector.h"
@@ -62,7 +63,10 @@ struct HttpExchangeConnector
 
     void configurePipeline(const Json::Value& config);
 
-    /** Configure just the HTTP part of the server. */
+    /** Configure just the HTTP part of the server.  numAcceptors greater
+        than one binds that many SO_REUSEPORT listening sockets so that the
+        kernel spreads new connections over several accept threads.
+    */
     void configureHttp(int numThreads,
                        const PortRange & listenPort,
                        const std::string & bindHost = "*",
@@ -72,7 +76,8 @@ struct HttpExchangeConnector
                        const std::string & auctionVerb = "POST",
                        int realTimePriority = -1,
                        bool realTimePolling = false,
-                       double absoluteTimeMax = 50.0);
+                       double absoluteTimeMax = 50.0,
+                       int numAcceptors = 1);
 
     /** Start the exchange connector running */
     virtual void start();
@@ -211,6 +216,28 @@ struct HttpExchangeConnector
     getDroppedAuctionResponse(const HttpAuctionHandler & connection,
                               const std::string & reason) const;
 
+    /** Empty 204 No Content response, with its headers rendered once for
+        the whole process.  This is the default dropped auction response
+        and what connectors should return when nothing was bid.
+    */
+    static const HttpResponse & noBidResponse();
+
+    /** Probability with which an incoming auction is let through to be
+        parsed.  This is the acceptAuctionProbability set by the router's
+        load stabilizer, with this exchange's shedWeight applied to the part
+        that is shed, and never below minAcceptRatio.
+    */
+    double admissionProbability() const;
+
+    /** True if more than maxServingRequests requests are currently being
+        served, in which case new ones are dropped before being parsed.
+    */
+    bool tooManyServingRequests() const
+    {
+        return maxServingRequests > 0
+            && numServingRequest > maxServingRequests;
+    }
+
     /** Return a stringified JSON of the response for our auction.  Default
         implementation calls getResponse() and stringifies the result.
 
@@ -266,6 +293,13 @@ struct HttpExchangeConnector
     /** Method invoked every second for accounting */
     virtual void periodicCallback(uint64_t numWakeups) const;
 
+    /** Arrange for the handler's auction to be timed out at the given
+        time, unless the handler cancels its timer first.  All of the
+        deadlines of the connector are kept in a single timer wheel driven by
+        one periodic timer, rather than in one timer per connection.
+    */
+    void scheduleAuctionDeadline(HttpAuctionHandler & handler, Date expiry);
+
     /** Invokes the pre bid-request pipeline operation */
     PipelineStatus
     preBidRequest(const HttpHeader& header, const std::string& payload);
@@ -302,16 +336,24 @@ protected:
     /// Configuration parameters
     int numThreads;
     int realTimePriority;
+    std::vector<int> cpuAffinity;    ///< CPUs for the serving threads
     PortRange listenPort;
     std::string bindHost;
     bool performNameLookup;
     int backlog;
+    int numAcceptors;
+    int busyPollUs;                  ///< SO_BUSY_POLL and spin budget
     std::string auctionResource;
     std::string auctionVerb;
     double absoluteTimeMax;
     bool disableAcceptProbability;
     bool disableExceptionPrinting;
 
+    /// Load shedding parameters; see admissionProbability()
+    double shedWeight;        ///< 0 never sheds this exchange, 1 is nominal
+    double minAcceptRatio;    ///< Fraction always accepted under overload
+    int maxServingRequests;   ///< Drop above this many in flight; 0 = none
+
     /// The ping time to known hosts in milliseconds
     std::unordered_map<std::string, float> pingTimesByHostMs;
 
@@ -324,6 +366,20 @@ private:
     std::shared_ptr<HttpAuctionLogger> logger;
     std::shared_ptr<BidRequestPipeline> pipeline;
 
+    /** Pending auction deadline.  The generation tells a deadline that is
+        still wanted from one that the handler has since cancelled.
+    */
+    struct AuctionDeadline {
+        std::weak_ptr<TransportBase> transport;
+        std::weak_ptr<HttpAuctionHandler> handler;
+        uint64_t generation;
+    };
+
+    TimerWheel<AuctionDeadline> auctionDeadlines;
+
+    /** Hand every auction deadline that has passed to its handler. */
+    void expireAuctionDeadlines(uint64_t numWakeups);
+
     Lock handlersLock;
     std::set<std::shared_ptr<HttpAuctionHandler> > handlers;
     void finishedWithHandler(std::shared_ptr<HttpAuctionHandler> handler);
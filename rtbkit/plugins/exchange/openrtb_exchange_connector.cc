@@ -84,17 +84,28 @@ BOOST_STATIC_ASSERT(hasFromJson<int>::value == false);
 
 OpenRTBExchangeConnector::
 OpenRTBExchangeConnector(ServiceBase & owner, const std::string & name)
-    : HttpExchangeConnector(name, owner)
+    : HttpExchangeConnector(name, owner),
+      skipUnparseable(false)
 {
 }
 
 OpenRTBExchangeConnector::
 OpenRTBExchangeConnector(const std::string & name,
                          std::shared_ptr<ServiceProxies> proxies)
-    : HttpExchangeConnector(name, proxies)
+    : HttpExchangeConnector(name, proxies),
+      skipUnparseable(false)
 {
 }
 
+void
+OpenRTBExchangeConnector::
+configure(const Json::Value & parameters)
+{
+    HttpExchangeConnector::configure(parameters);
+
+    getParam(parameters, skipUnparseable, "skipUnparseable");
+}
+
 std::shared_ptr<BidRequest>
 OpenRTBExchangeConnector::
 parseBidRequest(HttpAuctionHandler & connection,
@@ -154,7 +165,9 @@ parseBidRequest(HttpAuctionHandler & connection,
     try {
         JML_TRACE_EXCEPTIONS(!disableExceptionPrinting);
         ML::Parse_Context context("Bid Request", payload.c_str(), payload.size());
-        result.reset(OpenRTBBidRequestParser::openRTBBidRequestParserFactory(openRtbVersion)->parseBidRequest(context,
+        auto & parser = OpenRTBBidRequestParser::threadLocalParser(openRtbVersion);
+        parser.skipUnparseable = skipUnparseable;
+        result.reset(parser.parseBidRequest(context,
                                                                                               exchangeName(),
                                                                                               exchangeName()));
         result->protocolVersion = openRtbVersion;
@@ -223,14 +236,14 @@ getResponse(const HttpAuctionHandler & connection,
     }
 
     if (response.seatbid.empty())
-        return HttpResponse(204, "none", "");
+        return noBidResponse();
 
     static Datacratic::DefaultDescription<OpenRTB::BidResponse> desc;
-    std::ostringstream stream;
-    StreamJsonPrintingContext context(stream);
+    std::string & buffer = StringJsonPrintingContext::threadBuffer();
+    StringJsonPrintingContext context(buffer);
     desc.printJsonTyped(&response, context);
 
-    return HttpResponse(200, "application/json", stream.str());
+    return HttpResponse(200, "application/json", buffer);
 }
 
 Json::Value
@@ -246,7 +259,7 @@ OpenRTBExchangeConnector::
 getDroppedAuctionResponse(const HttpAuctionHandler & connection,
                           const std::string & reason) const
 {
-    return HttpResponse(204, "none", "");
+    return noBidResponse();
 }
 
 HttpResponse
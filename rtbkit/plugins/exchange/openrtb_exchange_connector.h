@@ -17,7 +17,10 @@ namespace RTBKIT {
 /** Generic exchange connector using the OpenRTB protocol.
 
     Configuration options are the same as the HttpExchangeConnector on which
-    it is based.
+    it is based with the addition of:
+
+    - skipUnparseable: don't decode the fields that aren't part of the OpenRTB
+      spec into BidRequest::unparseable (false by default).
 */
 
 struct OpenRTBExchangeConnector : public HttpExchangeConnector {
@@ -33,6 +36,8 @@ struct OpenRTBExchangeConnector : public HttpExchangeConnector {
         return exchangeNameString();
     }
 
+    virtual void configure(const Json::Value & parameters);
+
     virtual std::shared_ptr<BidRequest>
     parseBidRequest(HttpAuctionHandler & connection,
                     const HttpHeader & header,
@@ -65,6 +70,8 @@ private:
                    const Auction & auction) const;
 protected:
 
+    bool skipUnparseable;
+
     virtual void setSeatBid(Auction const & auction,
                             int spotNum,
                             OpenRTB::BidResponse & response) const;
@@ -122,7 +122,9 @@ parseBidRequest(HttpAuctionHandler & connection,
     std::shared_ptr<BidRequest> result;
     try {
         ML::Parse_Context context("Bid Request", payload.c_str(), payload.size());
-        result.reset(OpenRTBBidRequestParser::openRTBBidRequestParserFactory(openRtbVersion)->parseBidRequest(context,
+        auto & parser = OpenRTBBidRequestParser::threadLocalParser(openRtbVersion);
+        parser.skipUnparseable = skipUnparseable;
+        result.reset(parser.parseBidRequest(context,
                                                                                               exchangeName(),
                                                                                               exchangeName()));
     }
@@ -4,6 +4,7 @@
 #include <iostream>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/algorithm/string.hpp>
 
 #include "rtbkit/core/agent_configuration/agent_config.h"
 #include "rtbkit/plugins/exchange/creative_configuration.h"
@@ -183,6 +184,47 @@ BOOST_AUTO_TEST_CASE(test_snippet)
     }
 }
 
+BOOST_AUTO_TEST_CASE(test_snippet_literals)
+{
+    TestCreativeConfiguration conf("test");
+
+    const std::string snippet
+        = "<a href=\"http://x/?id=%{bidrequest.id}&n=%{creative.name#upper}\">"
+          "%{bidrequest.id}</a>";
+
+    Json::Value providerConfig;
+    providerConfig["test"]["snippet"] = snippet;
+    example1.providerConfig = providerConfig;
+
+    conf.addField("snippet",
+                  [](const Json::Value &, Dummy &) { return true; }
+    ).snippet();
+
+    auto result = conf.handleCreativeCompatibility(example1, true);
+    BOOST_CHECK(result.isCompatible);
+
+    RTBKIT::BidRequest bidrequest;
+    bidrequest.auctionId = Datacratic::Id("abc");
+    RTBKIT::Auction::Response response;
+    TestCreativeConfiguration::Context context{example1, response, bidrequest, 0};
+
+    std::string name = example1.name;
+    boost::algorithm::to_upper(name);
+    const std::string expected
+        = "<a href=\"http://x/?id=abc&n=" + name + "\">abc</a>";
+
+    BOOST_CHECK_EQUAL(conf.expand(snippet, context), expected);
+
+    // Expanding into a buffer appends to what is already there
+    std::string buffer = "x";
+    conf.expand(snippet, context, buffer);
+    BOOST_CHECK_EQUAL(buffer, "x" + expected);
+
+    // Unknown templates are returned as they are
+    BOOST_CHECK_EQUAL(conf.expand("no %{expansion}", context),
+                      "no %{expansion}");
+}
+
 namespace {
 struct MyNiceStruct{};
 
@@ -78,6 +78,8 @@ MyFilter::
 fillFilterReasons(FilterState& state, ConfigSet& beforeFilt,
                   ConfigSet& afterFilt, const std::string & segment) const {
 
+    if (!state.recordReasons()) return;
+
     // Some Magic to get all the filtered out configs by this segment.
     FilterState::FilterReasons& reasons = state.getFilterReasons();
     reasons[segment] = beforeFilt ^ (beforeFilt & afterFilt);
@@ -0,0 +1,169 @@
+/* chain_pipeline.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Implementation of the Chain Pipeline
+*/
+
+#include "chain_pipeline.h"
+#include "jml/utils/exc_check.h"
+
+#include <chrono>
+
+using namespace Datacratic;
+
+namespace RTBKIT {
+
+namespace {
+
+/** Copy of the raw request shared by the async stages, which may outlive
+    the request in the exchange thread. */
+struct Request {
+    Request(const HttpHeader& header, const std::string& payload)
+        : header(header), payload(payload)
+    { }
+
+    HttpHeader header;
+    std::string payload;
+};
+
+} // file scope
+
+ChainBidRequestPipeline::ChainBidRequestPipeline(
+        std::shared_ptr<ServiceProxies> proxies, std::string serviceName,
+        const Json::Value& json)
+    : BidRequestPipeline(std::move(proxies), std::move(serviceName))
+{
+    int threads = json.get("threads", 1).asInt();
+    ExcCheckGreater(threads, 0, "chain pipeline needs at least one thread");
+
+    for (const auto& config : json["stages"]) {
+        Stage stage;
+        stage.name = config.get("name", config.get("type", "null")).asString();
+        stage.async = config.get("async", false).asBool();
+        stage.deadline = config.get("deadlineMs", 5.0).asDouble() / 1000.0;
+        stage.pipeline = BidRequestPipeline::create(
+                this->serviceName() + "." + stage.name, getServices(), config);
+        stages.push_back(std::move(stage));
+    }
+
+    workers.reset(new ML::Worker_Task(threads));
+}
+
+std::vector<ChainBidRequestPipeline::Pending>&
+ChainBidRequestPipeline::pending()
+{
+    struct Current {
+        Current() : owner(nullptr) { }
+
+        const ChainBidRequestPipeline* owner;
+        std::vector<Pending> pending;
+    };
+
+    static thread_local Current current;
+
+    if (current.owner != this) {
+        current.owner = this;
+        current.pending.clear();
+    }
+    return current.pending;
+}
+
+PipelineStatus
+ChainBidRequestPipeline::preBidRequest(
+        const ExchangeConnector* exchange,
+        const HttpHeader& header,
+        const std::string& payload) {
+
+    auto& current = pending();
+    current.clear();
+
+    std::shared_ptr<Request> request;
+    Date now = Date::now();
+
+    for (const auto& stage : stages) {
+        if (!stage.async) continue;
+        if (!request) request = std::make_shared<Request>(header, payload);
+
+        auto promise = std::make_shared<std::promise<PostStage> >();
+
+        Pending next;
+        next.postStage = promise->get_future();
+        next.deadline = now.plusSeconds(stage.deadline);
+        current.push_back(std::move(next));
+
+        auto pipeline = stage.pipeline;
+        workers->add([=] {
+                try {
+                    promise->set_value(pipeline->prepareBidRequest(
+                                    exchange, request->header, request->payload));
+                } catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            }, stage.name);
+    }
+
+    for (const auto& stage : stages) {
+        if (stage.async) continue;
+        if (stage.pipeline->preBidRequest(exchange, header, payload) == PipelineStatus::Stop)
+            return PipelineStatus::Stop;
+    }
+
+    return PipelineStatus::Continue;
+}
+
+PipelineStatus
+ChainBidRequestPipeline::postBidRequest(
+        const ExchangeConnector* exchange,
+        const std::shared_ptr<Auction>& auction) {
+
+    auto& current = pending();
+    size_t next = 0;
+    PipelineStatus status = PipelineStatus::Continue;
+
+    for (const auto& stage : stages) {
+        if (!stage.async)
+            status = stage.pipeline->postBidRequest(exchange, auction);
+
+        else {
+            // preBidRequest wasn't called from this thread.
+            if (next == current.size()) continue;
+
+            Pending& prepared = current[next++];
+
+            double timeLeft = std::max(0.0, prepared.deadline.secondsSince(Date::now()));
+            auto ready = prepared.postStage.wait_for(
+                    std::chrono::duration<double>(timeLeft));
+
+            if (ready != std::future_status::ready) {
+                recordHit("stage.%s.timeout", stage.name);
+                continue;
+            }
+
+            status = prepared.postStage.get()(auction);
+        }
+
+        if (status == PipelineStatus::Stop) break;
+    }
+
+    current.clear();
+    return status;
+}
+
+namespace {
+
+struct AtInit {
+    AtInit()
+    {
+      PluginInterface<BidRequestPipeline>::registerPlugin("chain",
+          [](std::string serviceName,
+             std::shared_ptr<ServiceProxies> proxies,
+             Json::Value const &json)
+          {
+              return new ChainBidRequestPipeline(std::move(proxies), std::move(serviceName), json);
+          });
+    }
+} atInit;
+
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,83 @@
+/* chain_pipeline.h
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   A Bid Request Pipeline made of other pipelines, some of which run on a
+   thread pool while the exchange thread parses the request.
+*/
+
+#pragma once
+
+#include "rtbkit/common/bid_request_pipeline.h"
+#include "jml/utils/worker_task.h"
+
+#include <future>
+#include <vector>
+
+namespace RTBKIT {
+
+/** Runs its stages in order; the first one that stops the request stops the
+    chain. It is configured with
+
+        {
+            "type": "chain",
+            "threads": 2,
+            "stages": [
+                { "type": "geo", "async": true, "deadlineMs": 3, ... },
+                { "type": "null" }
+            ]
+        }
+
+    where each stage is the configuration of a BidRequestPipeline plugin.
+
+    The stages marked "async" are prepared on the chain's threads as soon as
+    the request comes in, so that they overlap with the parsing of the request
+    and with each other. Their PostStage is then applied on the exchange
+    thread, in the order of the stages, when the auction is available. A
+    stage which isn't prepared within its deadline, counted from the arrival
+    of the request, is skipped for that request; its work carries on in the
+    background but its result is thrown away.
+
+    The prepared stages are handed from preBidRequest to postBidRequest
+    through the calling thread, so both must be called for a request from the
+    same thread, as the HttpAuctionHandler does.
+ */
+class ChainBidRequestPipeline : public BidRequestPipeline {
+public:
+
+    ChainBidRequestPipeline(
+            std::shared_ptr<Datacratic::ServiceProxies> proxies, std::string serviceName,
+            const Json::Value& json);
+
+    PipelineStatus
+    preBidRequest(
+            const ExchangeConnector* exchange,
+            const HttpHeader& header,
+            const std::string& payload);
+
+    PipelineStatus
+    postBidRequest(
+            const ExchangeConnector* exchange,
+            const std::shared_ptr<Auction>& auction);
+
+private:
+
+    struct Stage {
+        std::string name;
+        std::shared_ptr<BidRequestPipeline> pipeline;
+        bool async;
+        double deadline;    // seconds
+    };
+
+    /** Async stage of the current request of a thread. */
+    struct Pending {
+        std::future<PostStage> postStage;
+        Datacratic::Date deadline;
+    };
+
+    std::vector<Stage> stages;
+    std::unique_ptr<ML::Worker_Task> workers;
+
+    std::vector<Pending>& pending();
+};
+
+} // namespace RTBKIT
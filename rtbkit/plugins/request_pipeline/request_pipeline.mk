@@ -1 +1,4 @@
 $(eval $(call library,null_pipeline,null_pipeline.cc,rtb))
+$(eval $(call library,chain_pipeline,chain_pipeline.cc,rtb worker_task))
+
+$(eval $(call include_sub_make,request_pipeline_testing,testing,request_pipeline_testing.mk))
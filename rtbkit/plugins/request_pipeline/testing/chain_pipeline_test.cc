@@ -0,0 +1,170 @@
+/* chain_pipeline_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the chain pipeline.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "rtbkit/plugins/request_pipeline/chain_pipeline.h"
+#include "jml/arch/timers.h"
+
+#include <atomic>
+#include <thread>
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+/** Stage which sleeps for "sleepMs" while it's prepared, can stop the
+    request and counts its calls.
+ */
+struct TestPipeline : public BidRequestPipeline {
+
+    TestPipeline(std::shared_ptr<ServiceProxies> proxies, std::string serviceName,
+                 const Json::Value& json)
+        : BidRequestPipeline(std::move(proxies), std::move(serviceName)),
+          sleep(json.get("sleepMs", 0).asDouble() / 1000.0),
+          stop(json.get("stop", false).asBool())
+    { }
+
+    PipelineStatus
+    preBidRequest(const ExchangeConnector*, const HttpHeader&, const std::string&)
+    {
+        if (sleep > 0) ML::sleep(sleep);
+        preThread = std::this_thread::get_id();
+        ++pre;
+        return PipelineStatus::Continue;
+    }
+
+    PipelineStatus
+    postBidRequest(const ExchangeConnector*, const std::shared_ptr<Auction>&)
+    {
+        postThread = std::this_thread::get_id();
+        ++post;
+        return stop ? PipelineStatus::Stop : PipelineStatus::Continue;
+    }
+
+    double sleep;
+    bool stop;
+
+    std::atomic<int> pre { 0 };
+    std::atomic<int> post { 0 };
+    std::thread::id preThread;
+    std::thread::id postThread;
+};
+
+std::vector<TestPipeline*> created;
+
+struct AtInit {
+    AtInit()
+    {
+        PluginInterface<BidRequestPipeline>::registerPlugin("test",
+            [](std::string serviceName,
+               std::shared_ptr<ServiceProxies> proxies,
+               Json::Value const &json)
+            {
+                auto pipeline = new TestPipeline(std::move(proxies), std::move(serviceName), json);
+                created.push_back(pipeline);
+                return pipeline;
+            });
+    }
+} atInit;
+
+std::shared_ptr<BidRequestPipeline>
+makeChain(const std::string& stagesJson)
+{
+    created.clear();
+
+    Json::Value config;
+    config["type"] = "chain";
+    config["threads"] = 2;
+    config["stages"] = Json::parse(stagesJson);
+
+    return BidRequestPipeline::create("", std::make_shared<ServiceProxies>(), config);
+}
+
+double runRequest(BidRequestPipeline& chain, PipelineStatus& status)
+{
+    Date start = Date::now();
+
+    status = chain.preBidRequest(nullptr, HttpHeader(), "{}");
+    if (status == PipelineStatus::Continue)
+        status = chain.postBidRequest(nullptr, nullptr);
+
+    return Date::now().secondsSince(start);
+}
+
+BOOST_AUTO_TEST_CASE( test_chain_runs_stages_in_order )
+{
+    auto chain = makeChain(
+            "[ { 'type': 'test', 'name': 'a' },"
+            "  { 'type': 'test', 'name': 'b', 'async': true, 'deadlineMs': 1000 } ]");
+    BOOST_REQUIRE_EQUAL(created.size(), 2);
+
+    PipelineStatus status;
+    runRequest(*chain, status);
+
+    BOOST_CHECK(status == PipelineStatus::Continue);
+    for (auto stage : created) {
+        BOOST_CHECK_EQUAL(stage->pre, 1);
+        BOOST_CHECK_EQUAL(stage->post, 1);
+        BOOST_CHECK(stage->postThread == std::this_thread::get_id());
+    }
+
+    BOOST_CHECK(created[0]->preThread == std::this_thread::get_id());
+    BOOST_CHECK(created[1]->preThread != std::this_thread::get_id());
+}
+
+BOOST_AUTO_TEST_CASE( test_chain_async_stages_overlap )
+{
+    auto chain = makeChain(
+            "[ { 'type': 'test', 'async': true, 'sleepMs': 50, 'deadlineMs': 1000 },"
+            "  { 'type': 'test', 'async': true, 'sleepMs': 50, 'deadlineMs': 1000 } ]");
+
+    PipelineStatus status;
+    double elapsed = runRequest(*chain, status);
+
+    BOOST_CHECK(status == PipelineStatus::Continue);
+    BOOST_CHECK_EQUAL(created[0]->post, 1);
+    BOOST_CHECK_EQUAL(created[1]->post, 1);
+    BOOST_CHECK_LT(elapsed, 0.09);
+}
+
+BOOST_AUTO_TEST_CASE( test_chain_deadline )
+{
+    auto chain = makeChain(
+            "[ { 'type': 'test', 'async': true, 'sleepMs': 200, 'deadlineMs': 10 },"
+            "  { 'type': 'test' } ]");
+
+    PipelineStatus status;
+    double elapsed = runRequest(*chain, status);
+
+    BOOST_CHECK(status == PipelineStatus::Continue);
+    BOOST_CHECK_LT(elapsed, 0.1);
+    BOOST_CHECK_EQUAL(created[0]->post, 0);
+    BOOST_CHECK_EQUAL(created[1]->post, 1);
+
+    // The late stage finishes in the background and is not applied later.
+    ML::sleep(0.3);
+    BOOST_CHECK_EQUAL(created[0]->pre, 1);
+    BOOST_CHECK_EQUAL(created[0]->post, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_chain_stop )
+{
+    auto chain = makeChain(
+            "[ { 'type': 'test', 'async': true, 'stop': true, 'deadlineMs': 1000 },"
+            "  { 'type': 'test' } ]");
+
+    PipelineStatus status;
+    runRequest(*chain, status);
+
+    BOOST_CHECK(status == PipelineStatus::Stop);
+    BOOST_CHECK_EQUAL(created[0]->post, 1);
+    BOOST_CHECK_EQUAL(created[1]->post, 0);
+}
@@ -0,0 +1,3 @@
+# request_pipeline_testing.mk
+
+$(eval $(call test,chain_pipeline_test,chain_pipeline rtb,boost))
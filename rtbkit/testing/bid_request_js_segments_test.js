@@ -111,8 +111,42 @@ var segmentsTest = {
 };
 
 
+var cachedPropertiesTest = {
+    topic: function() {
+        return new brm.BidRequest(JSON.stringify(requestWithSegments),
+                                  "datacratic");
+    },
+    checkSameObjects: function(x) {
+        assert(x.segments === x.segments,
+               "segments must be converted once");
+        assert(x.segments["100"] === x.segments["100"],
+               "segment lists must be converted once");
+        assert(x.imp === x.imp, "imp must be converted once");
+    },
+    checkStrings: function(x) {
+        assert.equal(x.userAgent, requestWithSegments.userAgent);
+        assert.equal(x.exchange, "zeExchange");
+        x.exchange = "otherExchange";
+        assert.equal(x.exchange, "otherExchange");
+    },
+    checkInts: function(x) {
+        var seg100 = x.segments["100"];
+        var ints = seg100.ints;
+        assert(ints === seg100.ints, "ints must be a single view");
+        assert.equal(ints.length, 3);
+        assert.deepEqual([ints[0], ints[1], ints[2]], [1, 43, 125]);
+
+        seg100.add("7");
+        assert.equal(ints.length, 4);
+        assert.equal(ints[0], 1);
+        assert.equal(ints[1], 7);
+    }
+};
+
+
 var tests = {
-    'segments': [ segmentsTest ]
+    'segments': [ segmentsTest ],
+    'cached properties': [ cachedPropertiesTest ]
 };
 
 vows.describe('rtb_bid_request_segments_test').addVows(tests).export(module);
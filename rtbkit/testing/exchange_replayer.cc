@@ -0,0 +1,490 @@
+/* exchange_replayer.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Replays captured bid requests against a running exchange connector over
+   a pool of keep-alive connections, either at a constant rate or with the
+   timing they were recorded with, and reports latency percentiles, no-bid
+   rate and timeouts.
+
+   Requests are read either from a log written by
+   HttpExchangeConnector::startRequestLogging, or from a file with one bid
+   request body per line (such as
+   rtbkit/core/router/testing/20000-datacratic-auctions.xz) which is posted
+   with the given resource and content type.
+*/
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <poll.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/positional_options.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
+#include "jml/utils/filter_streams.h"
+#include "soa/types/date.h"
+#include "rtbkit/plugins/exchange/http_auction_handler.h"
+
+
+using namespace std;
+using namespace boost::program_options;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+/*****************************************************************************/
+/* REQUEST                                                                   */
+/*****************************************************************************/
+
+/** A request ready to go on the wire, with the time it was recorded at
+    (relative to the first request) when it's known.
+*/
+struct Request {
+    std::string text;
+    double offset;
+};
+
+vector<Request>
+loadRequestLog(const string & filename)
+{
+    vector<Request> result;
+    Date first = Date::notADate();
+
+    HttpAuctionLogger::parse(filename, [&] (const string & text, Date recorded)
+        {
+            if (!first.isADate())
+                first = recorded;
+            double offset = recorded.isADate() && first.isADate()
+                ? recorded.secondsSince(first) : -1.0;
+            result.push_back({ text, offset });
+        });
+
+    return result;
+}
+
+vector<Request>
+loadBodies(const string & filename, const string & host,
+           const string & resource, const string & contentType)
+{
+    vector<Request> result;
+
+    ML::filter_istream stream(filename);
+    string body;
+    while (getline(stream, body)) {
+        if (body.empty())
+            continue;
+        string text = "POST " + resource + " HTTP/1.1\r\n"
+            + "Host: " + host + "\r\n"
+            + "Content-Type: " + contentType + "\r\n"
+            + ML::format("Content-Length: %zd\r\n", body.size())
+            + "\r\n" + body;
+        result.push_back({ std::move(text), -1.0 });
+    }
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* CONNECTION                                                                */
+/*****************************************************************************/
+
+/** Keep-alive connection that has at most one request outstanding. */
+
+struct Connection {
+    Connection()
+        : fd(-1), written(0), busy(false), eof(false)
+    {
+    }
+
+    int fd;
+    string output;        ///< Request being written
+    size_t written;       ///< How much of output has gone out
+    string input;         ///< Response accumulated so far
+    bool busy;            ///< Request outstanding
+    bool eof;             ///< Other end closed the connection
+    Date sent;            ///< When the outstanding request was started
+
+    void open(const sockaddr_in & addr)
+    {
+        close();
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == -1)
+            throw ML::Exception(errno, "socket");
+
+        int res = connect(fd, reinterpret_cast<const sockaddr *>(&addr),
+                          sizeof(addr));
+        if (res == -1)
+            throw ML::Exception(errno, "connect");
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+    }
+
+    void close()
+    {
+        if (fd != -1)
+            ::close(fd);
+        fd = -1;
+        output.clear();
+        written = 0;
+        input.clear();
+        busy = false;
+        eof = false;
+    }
+
+    void start(const string & request, Date now)
+    {
+        output = request;
+        written = 0;
+        input.clear();
+        busy = true;
+        sent = now;
+        write();
+    }
+
+    /** Write as much of the request as the socket will take.  Returns false
+        if the connection was lost.
+    */
+    bool write()
+    {
+        while (written < output.size()) {
+            ssize_t res = ::send(fd, output.data() + written,
+                                 output.size() - written, MSG_NOSIGNAL);
+            if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return true;
+            if (res == -1 && errno == EINTR)
+                continue;
+            if (res <= 0)
+                return false;
+            written += res;
+        }
+        return true;
+    }
+
+    /** Read whatever is available.  Returns 0 if the response is not
+        complete yet, and otherwise the HTTP status code of the complete
+        response.  Sets eof if the connection was closed or lost.
+    */
+    int read()
+    {
+        char buf[65536];
+        for (;;) {
+            ssize_t res = ::recv(fd, buf, sizeof(buf), 0);
+            if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            if (res == -1 && errno == EINTR)
+                continue;
+            if (res <= 0) {
+                eof = true;
+                break;
+            }
+            input.append(buf, res);
+        }
+
+        if (!busy)
+            return 0;
+
+        string::size_type headerEnd = input.find("\r\n\r\n");
+        if (headerEnd == string::npos)
+            return 0;
+
+        int code = 0;
+        if (sscanf(input.c_str(), "HTTP/%*d.%*d %d", &code) != 1)
+            throw ML::Exception("invalid response '%s'", input.c_str());
+
+        size_t contentLength = 0;
+        string header(input, 0, headerEnd);
+        std::transform(header.begin(), header.end(), header.begin(), ::tolower);
+        string::size_type pos = header.find("\r\ncontent-length:");
+        if (pos != string::npos)
+            contentLength = strtoul(header.c_str() + pos + 17, 0, 10);
+
+        if (input.size() < headerEnd + 4 + contentLength)
+            return 0;
+
+        busy = false;
+        return code;
+    }
+};
+
+
+/*****************************************************************************/
+/* REPLAYER                                                                  */
+/*****************************************************************************/
+
+struct Replayer {
+    Replayer(const vector<Request> & requests, const sockaddr_in & addr,
+             int numConnections, double qps, double speed, int count,
+             double timeoutMs)
+        : requests(requests), addr(addr), connections(numConnections),
+          qps(qps), speed(speed), count(count), timeoutMs(timeoutMs),
+          numSent(0), numLate(0), numTimeouts(0), numErrors(0)
+    {
+    }
+
+    const vector<Request> & requests;
+    sockaddr_in addr;
+    vector<Connection> connections;
+    double qps;          ///< Constant rate; 0 means as fast as possible
+    double speed;        ///< Recorded timing speedup; 0 means not used
+    int count;
+    double timeoutMs;
+
+    Date start;
+    int numSent;
+    int numLate;         ///< Sent more than 1ms after their due time
+    int numTimeouts;
+    int numErrors;
+    map<int, int> responseCodes;
+    vector<double> latenciesMs;
+
+    /** Time at which the given request is due to go out. */
+    Date due(int i) const
+    {
+        if (speed > 0) {
+            double offset = requests[i % requests.size()].offset;
+            return start.plusSeconds(std::max(offset, 0.0) / speed);
+        }
+        if (qps > 0)
+            return start.plusSeconds(i / qps);
+        return start;
+    }
+
+    void perform()
+    {
+        for (auto & c: connections)
+            c.open(addr);
+
+        start = Date::now();
+
+        for (;;) {
+            Date now = Date::now();
+
+            // Start every request that is due while there is a free
+            // connection to carry it
+            for (auto & c: connections) {
+                if (numSent == count || due(numSent) > now)
+                    break;
+                if (c.busy)
+                    continue;
+                if (now.secondsSince(due(numSent)) > 0.001)
+                    ++numLate;
+                c.start(requests[numSent % requests.size()].text, now);
+                ++numSent;
+            }
+
+            int numBusy = 0;
+            vector<pollfd> fds;
+            for (auto & c: connections) {
+                short events = POLLIN;
+                if (c.busy && c.written < c.output.size())
+                    events |= POLLOUT;
+                fds.push_back({ c.fd, events, 0 });
+                numBusy += c.busy;
+            }
+
+            if (numSent == count && numBusy == 0)
+                break;
+
+            // Wake up for the next due request or the next timeout
+            double waitMs = 100;
+            if (numSent < count && numBusy < connections.size())
+                waitMs = std::min(waitMs,
+                                  due(numSent).secondsSince(now) * 1000);
+            for (auto & c: connections) {
+                if (c.busy)
+                    waitMs = std::min(waitMs, timeoutMs
+                                      - now.secondsSince(c.sent) * 1000);
+            }
+
+            int res = poll(&fds[0], fds.size(), std::max(0, (int)waitMs));
+            if (res == -1 && errno != EINTR)
+                throw ML::Exception(errno, "poll");
+
+            now = Date::now();
+
+            for (unsigned i = 0;  i < connections.size();  ++i) {
+                Connection & c = connections[i];
+
+                if (fds[i].revents & POLLOUT) {
+                    if (!c.write()) {
+                        ++numErrors;
+                        c.open(addr);
+                        continue;
+                    }
+                }
+
+                if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                    int code = c.read();
+                    if (code > 0) {
+                        ++responseCodes[code];
+                        latenciesMs.push_back(now.secondsSince(c.sent) * 1000);
+                    }
+                    if (c.eof) {
+                        // The connector occasionally closes a connection
+                        // after a response; only losing an outstanding
+                        // request is an error.
+                        if (c.busy)
+                            ++numErrors;
+                        c.open(addr);
+                        continue;
+                    }
+                }
+
+                if (c.busy && now.secondsSince(c.sent) * 1000 > timeoutMs) {
+                    ++numTimeouts;
+                    c.open(addr);
+                }
+            }
+        }
+
+        for (auto & c: connections)
+            c.close();
+    }
+
+    void report() const
+    {
+        double elapsed = Date::now().secondsSince(start);
+        int numResponses = latenciesMs.size();
+
+        cerr << "sent " << numSent << " requests in " << elapsed
+             << "s (" << numSent / elapsed << " qps); "
+             << numLate << " went out late" << endl;
+        cerr << numResponses << " responses, " << numTimeouts
+             << " timeouts, " << numErrors << " connection errors" << endl;
+
+        for (auto & rc: responseCodes)
+            cerr << "  HTTP " << rc.first << ": " << rc.second
+                 << ML::format(" (%.2f%%)", 100.0 * rc.second / numSent)
+                 << endl;
+
+        auto it = responseCodes.find(204);
+        int numNoBids = it == responseCodes.end() ? 0 : it->second;
+        cerr << ML::format("no-bid rate: %.2f%%",
+                           numResponses ? 100.0 * numNoBids / numResponses : 0.0)
+             << endl;
+
+        if (latenciesMs.empty())
+            return;
+
+        vector<double> sorted = latenciesMs;
+        std::sort(sorted.begin(), sorted.end());
+
+        auto percentile = [&] (double p)
+            {
+                size_t i = std::min<size_t>(sorted.size() - 1,
+                                            p / 100.0 * sorted.size());
+                return sorted[i];
+            };
+
+        cerr << ML::format("latency ms: p50 %.3f p90 %.3f p99 %.3f "
+                           "p99.9 %.3f max %.3f",
+                           percentile(50), percentile(90), percentile(99),
+                           percentile(99.9), sorted.back())
+             << endl;
+    }
+};
+
+
+int main(int argc, char ** argv)
+{
+    string host = "localhost";
+    int port = 0;
+    string logFile;
+    string bodiesFile;
+    string resource = "/auctions";
+    string contentType = "application/json";
+    int numConnections = 16;
+    double qps = 0;
+    double speed = 0;
+    int count = -1;
+    double timeoutMs = 100;
+
+    options_description options("Options");
+    options.add_options()
+        ("host,h", value(&host), "host of the exchange connector")
+        ("port,p", value(&port), "port of the exchange connector")
+        ("request-log,l", value(&logFile),
+         "file written by startRequestLogging to replay")
+        ("bodies,b", value(&bodiesFile),
+         "file with one request body per line to replay")
+        ("resource,r", value(&resource),
+         "resource to post bodies to (with --bodies)")
+        ("content-type,t", value(&contentType),
+         "content type of bodies (with --bodies)")
+        ("connections,c", value(&numConnections),
+         "number of keep-alive connections")
+        ("qps,q", value(&qps),
+         "constant request rate (0 = as fast as the connections allow)")
+        ("recorded-timing,s", value(&speed),
+         "replay with the recorded timing, sped up by the given factor "
+         "(request log only)")
+        ("count,n", value(&count),
+         "number of requests to send (default: each one once)")
+        ("timeout-ms,T", value(&timeoutMs),
+         "time after which a request counts as timed out")
+        ("help", "print this message");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(options).run(), vm);
+    notify(vm);
+
+    if (vm.count("help") || port == 0
+        || logFile.empty() == bodiesFile.empty()) {
+        cerr << "exactly one of --request-log and --bodies is required, "
+             << "as is --port" << endl << options << endl;
+        return 1;
+    }
+
+    vector<Request> requests = logFile.empty()
+        ? loadBodies(bodiesFile, host, resource, contentType)
+        : loadRequestLog(logFile);
+
+    if (requests.empty())
+        throw ML::Exception("no requests to replay");
+
+    if (speed > 0) {
+        if (requests[0].offset < 0)
+            throw ML::Exception("request log has no recorded timing");
+        if (count > (int)requests.size())
+            throw ML::Exception("recorded timing can't replay more requests "
+                                "than were recorded");
+    }
+
+    if (count == -1)
+        count = requests.size();
+
+    addrinfo hints = {}, * info = 0;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    int res = getaddrinfo(host.c_str(), to_string(port).c_str(),
+                          &hints, &info);
+    if (res != 0)
+        throw ML::Exception("couldn't resolve %s: %s",
+                            host.c_str(), gai_strerror(res));
+    sockaddr_in addr = *reinterpret_cast<sockaddr_in *>(info->ai_addr);
+    freeaddrinfo(info);
+
+    cerr << "replaying " << count << " of " << requests.size()
+         << " requests over " << numConnections << " connections" << endl;
+
+    Replayer replayer(requests, addr, numConnections, qps, speed, count,
+                      timeoutMs);
+    replayer.perform();
+    replayer.report();
+}
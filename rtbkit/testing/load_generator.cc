@@ -0,0 +1,648 @@
+/** load_generator.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Open-loop HTTP load generator.
+
+*/
+
+#include "load_generator.h"
+#include "soa/types/date.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
+#include "jml/arch/timers.h"
+#include "jml/utils/exc_check.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <thread>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+using namespace std;
+using namespace Datacratic;
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* REQUEST TEMPLATE                                                           */
+/******************************************************************************/
+
+RequestTemplate::Variable
+RequestTemplate::Variable::
+fromJson(const std::string& name, const Json::Value& json)
+{
+    Variable result;
+    result.name = name;
+
+    for (auto it = json.begin(), end = json.end(); it != end; ++it) {
+        if (it.memberName() == "values") {
+            for (const auto& value : *it)
+                result.values.push_back(value.asString());
+        }
+        else if (it.memberName() == "range")
+            result.range = it->asUInt();
+        else if (it.memberName() == "distribution") {
+            string distribution = it->asString();
+            if (distribution == "zipf") result.zipf = true;
+            else if (distribution != "uniform")
+                throw ML::Exception("unknown distribution: " + distribution);
+        }
+        else if (it.memberName() == "exponent")
+            result.exponent = it->asDouble();
+        else if (it.memberName() == "count")
+            result.count = it->asUInt();
+        else if (it.memberName() == "separator")
+            result.separator = it->asString();
+        else throw ML::Exception("unknown variable field: " + it.memberName());
+    }
+
+    return result;
+}
+
+void
+RequestTemplate::Variable::
+init()
+{
+    uint64_t size = values.empty() ? range : values.size();
+    ExcCheck(size > 0, "variable " + name + " has no values");
+    ExcCheck(count > 0, "variable " + name + " draws no values");
+
+    if (!zipf) return;
+
+    ExcCheck(size <= 10000000, "too many values for a zipf distribution");
+
+    cdf.resize(size);
+    double total = 0;
+    for (uint64_t i = 0; i < size; ++i) {
+        total += 1.0 / pow(i + 1, exponent);
+        cdf[i] = total;
+    }
+    for (double& p : cdf) p /= total;
+}
+
+void
+RequestTemplate::Variable::
+draw(std::mt19937_64& rng, std::string& out) const
+{
+    uint64_t size = values.empty() ? range : values.size();
+
+    for (unsigned i = 0; i < count; ++i) {
+        if (i) out += separator;
+
+        uint64_t index;
+        if (zipf) {
+            double p = std::uniform_real_distribution<double>(0, 1)(rng);
+            index = std::lower_bound(cdf.begin(), cdf.end(), p) - cdf.begin();
+            if (index >= size) index = size - 1;
+        }
+        else index = std::uniform_int_distribution<uint64_t>(0, size - 1)(rng);
+
+        if (values.empty()) out += to_string(index);
+        else out += values[index];
+    }
+}
+
+RequestTemplate::
+RequestTemplate(const std::string& body, std::vector<Variable> variables) :
+    variables(std::move(variables))
+{
+    for (Variable& variable : this->variables)
+        variable.init();
+
+    size_t pos = 0;
+    for (;;) {
+        size_t start = body.find("{{", pos);
+        if (start == string::npos) break;
+
+        size_t end = body.find("}}", start);
+        if (end == string::npos)
+            throw ML::Exception("unterminated placeholder in request template");
+
+        Part part;
+        part.literal = body.substr(pos, start - pos);
+
+        string name = body.substr(start + 2, end - start - 2);
+        if (name == "id") part.variable = Id;
+        else if (name == "timestamp") part.variable = Timestamp;
+        else {
+            auto it = find_if(this->variables.begin(), this->variables.end(),
+                    [&] (const Variable& variable) {
+                        return variable.name == name;
+                    });
+            if (it == this->variables.end())
+                throw ML::Exception("unknown placeholder in request template: "
+                                    + name);
+            part.variable = it - this->variables.begin();
+        }
+
+        parts.push_back(part);
+        pos = end + 2;
+    }
+
+    parts.push_back({ body.substr(pos), None });
+}
+
+RequestTemplate
+RequestTemplate::
+defaultTemplate()
+{
+    string body =
+        "{\"!!CV\":\"RTBKIT-JSON-1.0\","
+        "\"id\":\"{{id}}\","
+        "\"timestamp\":{{timestamp}},"
+        "\"url\":\"http://{{site}}/\","
+        "\"language\":\"en\","
+        "\"exchange\":\"mock\","
+        "\"location\":{\"countryCode\":\"CA\",\"regionCode\":\"QC\","
+                      "\"cityName\":\"Montreal\"},"
+        "\"imp\":[{\"id\":\"1\",\"formats\":[\"160x600\"]},"
+                 "{\"id\":\"2\",\"formats\":[\"300x250\"]}],"
+        "\"segments\":{\"mock\":[{{segments}}]},"
+        "\"userIds\":{\"xchg\":\"{{user}}\",\"prov\":\"{{user}}\"}}";
+
+    vector<Variable> variables(3);
+
+    variables[0].name = "user";
+    variables[0].range = 1000000;
+    variables[0].zipf = true;
+
+    variables[1].name = "site";
+    for (size_t i = 0; i < 10000; ++i)
+        variables[1].values.push_back("site" + to_string(i) + ".com");
+    variables[1].zipf = true;
+
+    variables[2].name = "segments";
+    variables[2].range = 1000;
+    variables[2].count = 5;
+
+    return RequestTemplate(body, std::move(variables));
+}
+
+RequestTemplate
+RequestTemplate::
+fromJson(const Json::Value& json)
+{
+    vector<Variable> variables;
+
+    const Json::Value& vars = json["variables"];
+    for (auto it = vars.begin(), end = vars.end(); it != end; ++it)
+        variables.push_back(Variable::fromJson(it.memberName(), *it));
+
+    ExcCheck(json.isMember("body"), "request template has no body");
+    return RequestTemplate(json["body"].asString(), std::move(variables));
+}
+
+void
+RequestTemplate::
+render(std::mt19937_64& rng, const std::string& id, std::string& out) const
+{
+    for (const Part& part : parts) {
+        out += part.literal;
+
+        switch (part.variable) {
+        case None: break;
+        case Id: out += id; break;
+        case Timestamp:
+            out += to_string(Date::now().secondsSinceEpoch());
+            break;
+        default: variables[part.variable].draw(rng, out);
+        }
+    }
+}
+
+
+/******************************************************************************/
+/* RESULTS                                                                    */
+/******************************************************************************/
+
+LoadGenerator::Results&
+LoadGenerator::Results::
+operator += (const Results& other)
+{
+    sent += other.sent;
+    bids += other.bids;
+    noBids += other.noBids;
+    errors += other.errors;
+    dropped += other.dropped;
+    elapsed = std::max(elapsed, other.elapsed);
+    latencyMs += other.latencyMs;
+    return *this;
+}
+
+Json::Value
+LoadGenerator::Results::
+toJson() const
+{
+    Json::Value result;
+    result["sent"] = sent;
+    result["bids"] = bids;
+    result["noBids"] = noBids;
+    result["errors"] = errors;
+    result["dropped"] = dropped;
+    result["elapsed"] = elapsed;
+    result["qps"] = qps();
+
+    Json::Value& latency = result["latencyMs"];
+    latency["mean"] = latencyMs.mean();
+    latency["p50"] = latencyMs.percentile(50);
+    latency["p90"] = latencyMs.percentile(90);
+    latency["p99"] = latencyMs.percentile(99);
+    latency["p999"] = latencyMs.percentile(99.9);
+    latency["max"] = latencyMs.max();
+
+    return result;
+}
+
+
+/******************************************************************************/
+/* CONFIG                                                                     */
+/******************************************************************************/
+
+LoadGenerator::Config
+LoadGenerator::Config::
+fromJson(const Json::Value& json)
+{
+    Config config;
+
+    if (json.isMember("url")) {
+        string url = json["url"].asString();
+        size_t colon = url.rfind(':');
+        if (colon == string::npos)
+            throw ML::Exception("url should be host:port: " + url);
+        config.host = url.substr(0, colon);
+        config.port = stoi(url.substr(colon + 1));
+    }
+
+    config.host = json.get("host", config.host).asString();
+    config.port = json.get("port", config.port).asInt();
+    config.verb = json.get("verb", config.verb).asString();
+    config.resource = json.get("resource", config.resource).asString();
+    config.qps = json.get("qps", config.qps).asDouble();
+    config.threads = json.get("threads", config.threads).asUInt();
+    config.connections = json.get("connections", config.connections).asUInt();
+    config.duration = json.get("duration", config.duration).asDouble();
+    config.maxBacklog = json.get("maxBacklog", config.maxBacklog).asDouble();
+
+    if (json.isMember("request"))
+        config.request = RequestTemplate::fromJson(json["request"]);
+
+    return config;
+}
+
+
+/******************************************************************************/
+/* WORKER                                                                     */
+/******************************************************************************/
+
+namespace {
+
+double now()
+{
+    return ML::ticks() * ML::seconds_per_tick;
+}
+
+} // file scope
+
+/** Drives its own connections from a single thread with epoll. Each worker
+    runs the same schedule shifted by its index so that the requests of all
+    the workers are evenly spread.
+ */
+struct LoadGenerator::Worker
+{
+    struct Connection
+    {
+        Connection() : fd(-1), written(0), busy(false), scheduled(0) {}
+
+        int fd;
+        std::string out;
+        size_t written;
+        std::string in;
+        bool busy;
+        double scheduled;   // when the request in flight was scheduled
+    };
+
+    Worker(const Config& config, unsigned index, const addrinfo* addr,
+           unsigned numConnections) :
+        config(config), index(index), addr(addr),
+        connections(numConnections), rng(index), numRequests(0)
+    {
+        epollFd = epoll_create1(0);
+        ExcCheckErrno(epollFd != -1, "epoll_create1");
+
+        for (Connection& conn : connections) {
+            connect(conn);
+            if (conn.fd != -1) idle.push_back(&conn);
+        }
+    }
+
+    ~Worker()
+    {
+        for (Connection& conn : connections)
+            if (conn.fd != -1) ::close(conn.fd);
+        ::close(epollFd);
+    }
+
+    void connect(Connection& conn)
+    {
+        conn = Connection();
+
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        ExcCheckErrno(fd != -1, "socket");
+
+        if (::connect(fd, addr->ai_addr, addr->ai_addrlen) == -1) {
+            ::close(fd);
+            return;
+        }
+
+        int flag = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = &conn;
+        int res = epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        ExcCheckErrno(res != -1, "epoll_ctl");
+
+        conn.fd = fd;
+    }
+
+    /** Replaces a connection that the server closed. An idle one is still
+        in the idle list, where it's skipped if it couldn't reconnect.
+     */
+    void lost(Connection& conn)
+    {
+        bool busy = conn.busy;
+        if (busy) ++results.errors;
+
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        ::close(conn.fd);
+
+        connect(conn);
+        if (busy && conn.fd != -1) idle.push_back(&conn);
+    }
+
+    void watchWrites(Connection& conn, bool enabled)
+    {
+        epoll_event event;
+        event.events = EPOLLIN | (enabled ? EPOLLOUT : 0);
+        event.data.ptr = &conn;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, conn.fd, &event);
+    }
+
+    void send(Connection& conn, double scheduled)
+    {
+        body.clear();
+        config.request.render(
+                rng, to_string(index) + "-" + to_string(++numRequests), body);
+
+        conn.out = ML::format(
+                "%s %s HTTP/1.1\r\n"
+                "Host: %s\r\n"
+                "Content-Type: application/json\r\n"
+                "Content-Length: %zd\r\n"
+                "Connection: Keep-Alive\r\n"
+                "\r\n",
+                config.verb.c_str(), config.resource.c_str(),
+                config.host.c_str(), body.size());
+        conn.out += body;
+        conn.written = 0;
+        conn.busy = true;
+        conn.scheduled = scheduled;
+
+        ++results.sent;
+        flush(conn);
+    }
+
+    void flush(Connection& conn)
+    {
+        while (conn.written < conn.out.size()) {
+            ssize_t res = ::send(conn.fd, conn.out.data() + conn.written,
+                                 conn.out.size() - conn.written, MSG_NOSIGNAL);
+            if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                watchWrites(conn, true);
+                return;
+            }
+            if (res <= 0) {
+                lost(conn);
+                return;
+            }
+            conn.written += res;
+        }
+
+        if (!conn.out.empty()) {
+            conn.out.clear();
+            watchWrites(conn, false);
+        }
+    }
+
+    void read(Connection& conn)
+    {
+        char buffer[16384];
+        bool closed = false;
+
+        for (;;) {
+            ssize_t res = recv(conn.fd, buffer, sizeof(buffer), 0);
+            if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            if (res <= 0) {
+                closed = true;
+                break;
+            }
+            conn.in.append(buffer, res);
+        }
+
+        int status;
+        while (parseResponse(conn.in, status)) {
+            if (!conn.busy) continue;   // Unsolicited; nothing to measure
+
+            results.latencyMs.record((now() - conn.scheduled) * 1000.0);
+            if (status == 200) ++results.bids;
+            else if (status == 204) ++results.noBids;
+            else ++results.errors;
+
+            conn.busy = false;
+            idle.push_back(&conn);
+        }
+
+        // The last response can come along with the close.
+        if (closed) lost(conn);
+    }
+
+    /** Consumes the first complete response in the buffer, if any. */
+    static bool parseResponse(std::string& in, int& status)
+    {
+        size_t headerEnd = in.find("\r\n\r\n");
+        if (headerEnd == string::npos) return false;
+
+        size_t space = in.find(' ');
+        status = space < headerEnd ? atoi(in.c_str() + space + 1) : 0;
+
+        size_t contentLength = 0;
+        const char* header = strcasestr(in.c_str(), "\r\ncontent-length:");
+        if (header && header < in.c_str() + headerEnd)
+            contentLength = strtoul(header + 17, nullptr, 10);
+
+        size_t total = headerEnd + 4 + contentLength;
+        if (in.size() < total) return false;
+
+        in.erase(0, total);
+        return true;
+    }
+
+    void poll(int timeoutMs)
+    {
+        epoll_event events[64];
+        int res = epoll_wait(epollFd, events, 64, timeoutMs);
+        if (res == -1 && errno == EINTR) return;
+        ExcCheckErrno(res != -1, "epoll_wait");
+
+        for (int i = 0; i < res; ++i) {
+            Connection& conn = *static_cast<Connection*>(events[i].data.ptr);
+            if (events[i].events & EPOLLOUT) flush(conn);
+            if (conn.fd == -1) continue;
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                read(conn);
+        }
+    }
+
+    void run(const std::atomic<bool>& shutdown, double start)
+    {
+        double interval = config.threads / config.qps;
+        double end = start + config.duration;
+        double next = start + index / config.qps;
+
+        std::deque<double> backlog;
+
+        for (;;) {
+            double t = now();
+            if (t >= end || shutdown) break;
+
+            for (; next <= t && next < end; next += interval)
+                backlog.push_back(next);
+
+            while (!backlog.empty()
+                   && t - backlog.front() > config.maxBacklog) {
+                backlog.pop_front();
+                ++results.dropped;
+            }
+
+            while (!backlog.empty() && !idle.empty()) {
+                Connection* conn = idle.back();
+                idle.pop_back();
+                if (conn->fd == -1) continue;
+                send(*conn, backlog.front());
+                backlog.pop_front();
+            }
+
+            // Spin when the next request is due within the millisecond.
+            double wait = backlog.empty() ? next - now() : 0.0;
+            poll(wait > 0.001 ? std::min<int>(wait * 1000, 100) : 0);
+        }
+
+        results.dropped += backlog.size();
+
+        // Give the requests in flight the backlog time to complete.
+        double drainEnd = now() + config.maxBacklog;
+        while (now() < drainEnd && inFlight() && !shutdown)
+            poll(1);
+
+        results.errors += inFlight();
+        results.elapsed = now() - start;
+    }
+
+    size_t inFlight() const
+    {
+        size_t result = 0;
+        for (const Connection& conn : connections)
+            if (conn.busy) ++result;
+        return result;
+    }
+
+    const Config& config;
+    unsigned index;
+    const addrinfo* addr;
+
+    int epollFd;
+    std::vector<Connection> connections;
+    std::vector<Connection*> idle;
+
+    std::mt19937_64 rng;
+    uint64_t numRequests;
+    std::string body;
+
+    Results results;
+};
+
+
+/******************************************************************************/
+/* LOAD GENERATOR                                                             */
+/******************************************************************************/
+
+LoadGenerator::
+LoadGenerator(Config config) :
+    config(std::move(config)),
+    shutdown_(false)
+{
+    ExcCheck(this->config.port > 0, "load generator needs a port");
+    ExcCheck(this->config.qps > 0, "load generator needs a rate");
+    ExcCheck(this->config.threads > 0, "load generator needs threads");
+    ExcCheck(this->config.connections >= this->config.threads,
+             "load generator needs a connection per thread");
+
+    if (this->config.request.empty())
+        this->config.request = RequestTemplate::defaultTemplate();
+}
+
+LoadGenerator::Results
+LoadGenerator::
+run()
+{
+    if (config.host.empty()) config.host = "localhost";
+
+    addrinfo hint = { 0, AF_INET, SOCK_STREAM, 0, 0, 0, 0, 0 };
+    addrinfo* addr = nullptr;
+    int res = getaddrinfo(config.host.c_str(), to_string(config.port).c_str(),
+                          &hint, &addr);
+    if (res || !addr)
+        throw ML::Exception("couldn't resolve " + config.host);
+
+    vector< unique_ptr<Worker> > workers;
+    try {
+        for (unsigned i = 0; i < config.threads; ++i) {
+            unsigned numConnections = config.connections / config.threads
+                + (i < config.connections % config.threads);
+            workers.emplace_back(new Worker(config, i, addr, numConnections));
+        }
+    } catch (...) {
+        freeaddrinfo(addr);
+        throw;
+    }
+
+    double start = now();
+
+    vector<thread> threads;
+    for (auto& worker : workers) {
+        Worker* w = worker.get();
+        threads.emplace_back([=] { w->run(shutdown_, start); });
+    }
+    for (auto& th : threads) th.join();
+
+    Results results;
+    for (auto& worker : workers)
+        results += worker->results;
+
+    workers.clear();
+    freeaddrinfo(addr);
+    return results;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,182 @@
+/** load_generator.h                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Open-loop HTTP load generator to measure the capacity of an exchange
+    connector.
+
+*/
+
+#pragma once
+
+#include "soa/service/hdr_histogram.h"
+#include "soa/jsoncpp/json.h"
+
+#include <atomic>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* REQUEST TEMPLATE                                                           */
+/******************************************************************************/
+
+/** Body of the bid requests with {{name}} placeholders that are replaced by
+    values drawn for every request. Besides the variables, {{id}} is a unique
+    auction id and {{timestamp}} the current time in seconds since the epoch.
+ */
+struct RequestTemplate
+{
+    /** Values of a placeholder: either the given strings or the integers of
+        [0, range), drawn uniformly or following a zipf distribution with the
+        given exponent. When count is more than one, that many values are drawn
+        and joined with the separator, which is handy for lists of segments.
+     */
+    struct Variable
+    {
+        Variable() :
+            range(0), zipf(false), exponent(1.0), count(1), separator(",")
+        {}
+
+        std::string name;
+        std::vector<std::string> values;
+        uint64_t range;
+        bool zipf;
+        double exponent;
+        unsigned count;
+        std::string separator;
+
+        static Variable
+        fromJson(const std::string& name, const Json::Value& json);
+
+    private:
+        friend struct RequestTemplate;
+
+        void init();
+        void draw(std::mt19937_64& rng, std::string& out) const;
+
+        // Cumulative distribution of the zipf draws.
+        std::vector<double> cdf;
+    };
+
+    RequestTemplate() {}
+    RequestTemplate(const std::string& body, std::vector<Variable> variables);
+
+    /** Default template: a datacratic formatted bid request with the user
+        ids, site and segments drawn from a million users, ten thousand sites
+        and a thousand segments, the first two following a zipf distribution.
+     */
+    static RequestTemplate defaultTemplate();
+
+    /** Expects {"body": "...", "variables": {"name": {...}, ...}}. */
+    static RequestTemplate fromJson(const Json::Value& json);
+
+    bool empty() const { return parts.empty(); }
+
+    /** Renders a body in out, using the given id for {{id}}. */
+    void render(std::mt19937_64& rng, const std::string& id,
+                std::string& out) const;
+
+private:
+    enum { None = -1, Id = -2, Timestamp = -3 };
+
+    /** Literal followed by a placeholder: an index into variables, Id,
+        Timestamp or None for the last part.
+     */
+    struct Part
+    {
+        std::string literal;
+        int variable;
+    };
+
+    std::vector<Part> parts;
+    std::vector<Variable> variables;
+};
+
+
+/******************************************************************************/
+/* LOAD GENERATOR                                                             */
+/******************************************************************************/
+
+/** Sends bid requests at a fixed rate from many threads, each with its own set
+    of keep-alive connections which carry one request at a time.
+
+    The generator is open-loop: requests are scheduled at regular intervals
+    regardless of how fast the responses come back and their latency is
+    measured from the time that they were scheduled at. A request that has to
+    wait for a free connection therefore counts the wait, which keeps a slow
+    server from hiding its stalls by slowing down the generator (coordinated
+    omission). Requests that are late by more than maxBacklog are dropped.
+ */
+struct LoadGenerator
+{
+    struct Config
+    {
+        Config() :
+            port(0), verb("POST"), resource("/bids"),
+            qps(1000), threads(1), connections(8),
+            duration(10.0), maxBacklog(1.0)
+        {}
+
+        std::string host;
+        int port;
+        std::string verb;
+        std::string resource;
+
+        double qps;             ///< Total rate over all threads
+        unsigned threads;
+        unsigned connections;   ///< Total over all threads
+        double duration;        ///< Seconds
+        double maxBacklog;      ///< Seconds
+
+        RequestTemplate request;    ///< Default template when empty
+
+        /** Expects the members above by name plus an optional "request"
+            template; the host and port can also be given as "url".
+         */
+        static Config fromJson(const Json::Value& json);
+    };
+
+    struct Results
+    {
+        Results() :
+            sent(0), bids(0), noBids(0), errors(0), dropped(0), elapsed(0)
+        {}
+
+        uint64_t sent;
+        uint64_t bids;      ///< 200 responses
+        uint64_t noBids;    ///< 204 responses
+        uint64_t errors;    ///< Other responses and lost connections
+        uint64_t dropped;   ///< Never sent because they were too late
+        double elapsed;
+
+        Datacratic::HdrHistogram latencyMs;
+
+        double qps() const
+        {
+            return elapsed > 0 ? (bids + noBids + errors) / elapsed : 0;
+        }
+
+        Results& operator += (const Results& other);
+
+        Json::Value toJson() const;
+    };
+
+    LoadGenerator(Config config);
+
+    /** Runs for the configured duration and returns the results. */
+    Results run();
+
+    /** Makes run return early. */
+    void shutdown() { shutdown_ = true; }
+
+private:
+    struct Worker;
+
+    Config config;
+    std::atomic<bool> shutdown_;
+};
+
+} // namespace RTBKIT
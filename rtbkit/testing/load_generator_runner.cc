@@ -0,0 +1,68 @@
+/* load_generator_runner.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Runs the open-loop load generator against an exchange connector.
+*/
+
+#include "load_generator.h"
+#include "jml/utils/file_functions.h"
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <iostream>
+
+using namespace std;
+using namespace RTBKIT;
+
+int main(int argc, char ** argv)
+{
+    using namespace boost::program_options;
+
+    string configuration;
+    string url;
+    double qps = 0;
+    unsigned threads = 0;
+    unsigned connections = 0;
+    double duration = 0;
+
+    options_description options("Load Generator");
+    options.add_options()
+        ("configuration,f", value(&configuration),
+         "load generator configuration file, with the request template")
+        ("url,u", value(&url), "host:port of the exchange connector")
+        ("qps,q", value(&qps), "requests per second over all threads")
+        ("threads,t", value(&threads), "number of sending threads")
+        ("connections,c", value(&connections),
+         "number of keep-alive connections over all threads")
+        ("duration,d", value(&duration), "seconds to run for")
+        ("help,h", "Print this message");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv) .options(options) .run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << options << endl;
+        exit(1);
+    }
+
+    Json::Value json;
+    if (!configuration.empty()) {
+        ML::File_Read_Buffer buf(configuration);
+        json = Json::parse(std::string(buf.start(), buf.end()));
+    }
+
+    // The command line overrides the configuration file.
+    if (!url.empty()) json["url"] = url;
+    if (qps) json["qps"] = qps;
+    if (threads) json["threads"] = threads;
+    if (connections) json["connections"] = connections;
+    if (duration) json["duration"] = duration;
+
+    LoadGenerator generator(LoadGenerator::Config::fromJson(json));
+    auto results = generator.run();
+
+    cout << results.toJson() << endl;
+    return 0;
+}
@@ -0,0 +1,192 @@
+/* load_generator_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test for the open-loop load generator.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/testing/load_generator.h"
+#include "jml/arch/exception_handler.h"
+#include "jml/utils/exc_check.h"
+
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+using namespace std;
+using namespace RTBKIT;
+
+
+/** Keep-alive HTTP server that answers every request with a 204 and can be
+    told to close the connections after some number of requests.
+ */
+struct NoBidServer {
+    NoBidServer(int closeAfter = 0)
+        : closeAfter(closeAfter), requests(0), shutdown(false)
+    {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        ExcCheckErrno(fd != -1, "socket");
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        ExcCheckErrno(::bind(fd, (sockaddr *)&addr, sizeof(addr)) == 0, "bind");
+        ExcCheckErrno(::listen(fd, 128) == 0, "listen");
+
+        socklen_t len = sizeof(addr);
+        getsockname(fd, (sockaddr *)&addr, &len);
+        port = ntohs(addr.sin_port);
+
+        acceptor = std::thread([=] { this->acceptLoop(); });
+    }
+
+    ~NoBidServer()
+    {
+        shutdown = true;
+        ::shutdown(fd, SHUT_RDWR);
+        ::close(fd);
+        acceptor.join();
+        for (auto & th: handlers) th.join();
+    }
+
+    void acceptLoop()
+    {
+        while (!shutdown) {
+            int conn = accept(fd, nullptr, nullptr);
+            if (conn == -1) return;
+            handlers.emplace_back([=] { this->serve(conn); });
+        }
+    }
+
+    void serve(int conn)
+    {
+        string in;
+        int served = 0;
+        char buffer[16384];
+
+        while (!shutdown) {
+            ssize_t res = recv(conn, buffer, sizeof(buffer), 0);
+            if (res <= 0) break;
+            in.append(buffer, res);
+
+            for (;;) {
+                size_t headerEnd = in.find("\r\n\r\n");
+                if (headerEnd == string::npos) break;
+                const char * header = strcasestr(in.c_str(), "content-length:");
+                size_t length = header ? strtoul(header + 15, nullptr, 10) : 0;
+                if (in.size() < headerEnd + 4 + length) break;
+                in.erase(0, headerEnd + 4 + length);
+
+                ++requests;
+                static const string response
+                    = "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n";
+                ::send(conn, response.data(), response.size(), MSG_NOSIGNAL);
+
+                if (closeAfter && ++served == closeAfter) {
+                    ::close(conn);
+                    return;
+                }
+            }
+        }
+        ::close(conn);
+    }
+
+    int fd;
+    int port;
+    int closeAfter;
+    std::atomic<uint64_t> requests;
+    std::atomic<bool> shutdown;
+    std::thread acceptor;
+    vector<std::thread> handlers;
+};
+
+BOOST_AUTO_TEST_CASE( test_request_template )
+{
+    RequestTemplate::Variable site;
+    site.name = "site";
+    site.values = { "a.com", "b.com" };
+
+    RequestTemplate::Variable segments;
+    segments.name = "segments";
+    segments.range = 10;
+    segments.count = 3;
+    segments.zipf = true;
+
+    RequestTemplate request("{\"id\":\"{{id}}\",\"url\":\"{{site}}\","
+                            "\"segments\":[{{segments}}]}",
+                            { site, segments });
+
+    std::mt19937_64 rng(0);
+    for (unsigned i = 0;  i < 100;  ++i) {
+        string body;
+        request.render(rng, "abc", body);
+
+        Json::Value json = Json::parse(body);
+        BOOST_CHECK_EQUAL(json["id"].asString(), "abc");
+        string url = json["url"].asString();
+        BOOST_CHECK(url == "a.com" || url == "b.com");
+        BOOST_REQUIRE_EQUAL(json["segments"].size(), 3);
+        for (auto & segment: json["segments"])
+            BOOST_CHECK(segment.asInt() >= 0 && segment.asInt() < 10);
+    }
+
+    JML_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(RequestTemplate("{{nope}}", {}), ML::Exception);
+    BOOST_CHECK_THROW(RequestTemplate("{{id", {}), ML::Exception);
+
+    // The default template is valid JSON
+    string body;
+    RequestTemplate::defaultTemplate().render(rng, "id", body);
+    BOOST_CHECK_NO_THROW(Json::parse(body));
+}
+
+BOOST_AUTO_TEST_CASE( test_load_generator_rate )
+{
+    NoBidServer server;
+
+    LoadGenerator::Config config;
+    config.port = server.port;
+    config.qps = 2000;
+    config.threads = 2;
+    config.connections = 8;
+    config.duration = 1.0;
+
+    LoadGenerator generator(config);
+    auto results = generator.run();
+    cerr << results.toJson() << endl;
+
+    // Open-loop: the number of requests only depends on the rate
+    BOOST_CHECK_CLOSE(double(results.sent), 2000.0, 2.0);
+    BOOST_CHECK_EQUAL(results.noBids, results.sent);
+    BOOST_CHECK_EQUAL(results.errors, 0);
+    BOOST_CHECK_EQUAL(results.dropped, 0);
+    BOOST_CHECK_EQUAL(results.latencyMs.count(), results.sent);
+    BOOST_CHECK_EQUAL(server.requests, results.sent);
+}
+
+BOOST_AUTO_TEST_CASE( test_load_generator_reconnects )
+{
+    NoBidServer server(10);
+
+    LoadGenerator::Config config;
+    config.port = server.port;
+    config.qps = 500;
+    config.connections = 2;
+    config.duration = 0.5;
+
+    LoadGenerator generator(config);
+    auto results = generator.run();
+    cerr << results.toJson() << endl;
+
+    BOOST_CHECK(results.sent > 200);
+    BOOST_CHECK_EQUAL(results.noBids + results.errors, results.sent);
+    BOOST_CHECK(results.noBids > results.sent * 0.9);
+}
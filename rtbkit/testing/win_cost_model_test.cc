@@ -30,6 +30,32 @@ Amount linearWinCostModel(WinCostModel const & model,
     return price * m + b;
 }
 
+/** Linear model that parses its parameters once, when it's bound. */
+struct BoundLinearWinCostModel : public BoundWinCostModel {
+    BoundLinearWinCostModel(Json::Value const & data)
+        : m(data["m"].asDouble()), b(Amount::fromJson(data["b"]))
+    {
+    }
+
+    virtual Amount evaluate(Win const & win) const
+    {
+        Amount result = win.price * m + b;
+        if (win.meta && win.meta->isMember("extra"))
+            result += Amount::fromJson((*win.meta)["extra"]);
+        return result;
+    }
+
+    double m;
+    Amount b;
+};
+
+Amount metaWinCostModel(WinCostModel const & model,
+                        Bid const & bid,
+                        Amount const & price)
+{
+    return price + Amount::fromJson(model.data["win"]["extra"]);
+}
+
 struct TestExchangeConnector : public OpenRTBExchangeConnector {
     TestExchangeConnector(ServiceBase & owner,
                           const std::string & name)
@@ -86,3 +112,59 @@ BOOST_AUTO_TEST_CASE( win_cost_model_test )
     BOOST_CHECK_EQUAL(events["router.cummulatedAuthorizedPrice"], count * 505);
 }
 
+BOOST_AUTO_TEST_CASE( bound_win_cost_model_test )
+{
+    WinCostModel::registerModel("test-legacy", linearWinCostModel);
+    WinCostModel::registerModel("test-meta", metaWinCostModel);
+    WinCostModel::registerBoundModel(
+            "test-bound",
+            [] (Json::Value const & data)
+            {
+                return std::make_shared<BoundLinearWinCostModel>(data);
+            });
+
+    Json::Value data;
+    data["m"] = 0.5;
+    data["b"] = MicroUSD(5.0).toJson();
+
+    Bid bid;
+    Json::Value meta;
+    meta["extra"] = MicroUSD(1.0).toJson();
+
+    // No model means the price is the cost
+    auto none = WinCostModel().bind();
+    BOOST_CHECK_EQUAL(none->evaluate(bid, MicroUSD(100.0)), MicroUSD(100.0));
+
+    for (std::string name: { "test-legacy", "test-bound" }) {
+        WinCostModel wcm(name, data);
+        auto bound = wcm.bind();
+
+        BOOST_CHECK_EQUAL(bound->evaluate(bid, MicroUSD(100.0)),
+                          MicroUSD(55.0));
+        BOOST_CHECK_EQUAL(wcm.evaluate(bid, MicroUSD(100.0)),
+                          MicroUSD(55.0));
+
+        std::vector<BoundWinCostModel::Win> wins;
+        for (int i = 0;  i < 10;  ++i)
+            wins.emplace_back(&bid, MicroUSD(i * 10.0));
+
+        std::vector<Amount> costs(wins.size());
+        bound->evaluate(wins.data(), costs.data(), wins.size());
+        for (int i = 0;  i < 10;  ++i)
+            BOOST_CHECK_EQUAL(costs[i], MicroUSD(i * 5.0 + 5.0));
+    }
+
+    // The win metadata gets to both kinds of models
+    auto legacy = WinCostModel("test-meta", Json::Value()).bind();
+    BOOST_CHECK_EQUAL(legacy->evaluate(bid, MicroUSD(100.0), &meta),
+                      MicroUSD(101.0));
+
+    auto bound = WinCostModel("test-bound", data).bind();
+    BOOST_CHECK_EQUAL(bound->evaluate(bid, MicroUSD(100.0), &meta),
+                      MicroUSD(56.0));
+
+    WinCostModel withMeta("test-bound", data);
+    withMeta.data["win"] = meta;
+    BOOST_CHECK_EQUAL(withMeta.evaluate(bid, MicroUSD(100.0)),
+                      MicroUSD(56.0));
+}
@@ -7,6 +7,7 @@
 #include "jml/arch/tick_counter.h"
 #include "jml/arch/spinlock.h"
 #include "jml/arch/futex.h"
+#include "jml/arch/timers.h"
 #include "jml/utils/exc_check.h"
 #include "jml/utils/guard.h"
 
@@ -15,8 +16,13 @@
 #include <boost/static_assert.hpp>
 #include <sys/mman.h>
 #include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <atomic>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 using namespace std;
 using namespace ML;
@@ -223,10 +229,22 @@ struct GcLockBase::DeferredList {
 };
 
 struct GcLockBase::Deferred {
+    Deferred()
+        : stopReclaim(false)
+    {
+    }
+
     mutable ML::Spinlock lock;
     std::map<int32_t, DeferredList *> entries;
     std::vector<DeferredList *> spares;
 
+    /// Batches of the threads, once the reclamation is offloaded
+    std::vector<DeferredBatch *> batches;
+
+    std::mutex reclaimLock;      ///< Held for the whole of reclaim()
+    std::thread reclaimThread;
+    std::atomic<bool> stopReclaim;
+
     bool empty() const
     {
         boost::lock_guard<ML::Spinlock> guard(lock);
@@ -234,6 +252,137 @@ struct GcLockBase::Deferred {
     }
 };
 
+/** Work deferred by one thread, kept in place until a reclaim() or the
+    thread itself hands it over to the deferred lists.  The lock is only
+    contended while that happens.
+*/
+struct GcLockBase::DeferredBatch {
+    enum { CAPACITY = 256 };
+
+    DeferredBatch(GcLockBase * owner)
+        : owner(owner), epoch(0), size(0)
+    {
+    }
+
+    struct Entry {
+        int arity;
+        DeferredEntry3 work;    ///< fn is cast back to its arity to run
+    };
+
+    ML::Spinlock lock;
+    GcLockBase * owner;         ///< Null once the lock was destroyed
+    int32_t epoch;              ///< Newest epoch the entries wait for
+    unsigned size;
+    Entry entries[CAPACITY];
+
+    /** Add the work, which waits for the given epoch.  Returns false if the
+        batch is full.  The batch waits for the newest of the epochs of its
+        entries, which holds the older ones back a little.
+    */
+    bool add(int32_t forEpoch, int arity, void (fn) (void *, void *, void *),
+             void * data1, void * data2, void * data3)
+    {
+        boost::lock_guard<ML::Spinlock> guard(lock);
+        if (size == CAPACITY)
+            return false;
+        if (size == 0 || compareEpochs(forEpoch, epoch) > 0)
+            epoch = forEpoch;
+        Entry & entry = entries[size++];
+        entry.arity = arity;
+        entry.work = DeferredEntry3(fn, data1, data2, data3);
+        return true;
+    }
+
+    bool add(int32_t forEpoch, void (fn) (void *), void * data)
+    {
+        typedef void (Fn3) (void *, void *, void *);
+        return add(forEpoch, 1, (Fn3 *)fn, data, 0, 0);
+    }
+
+    bool add(int32_t forEpoch, void (fn) (void *, void *),
+             void * data1, void * data2)
+    {
+        typedef void (Fn3) (void *, void *, void *);
+        return add(forEpoch, 2, (Fn3 *)fn, data1, data2, 0);
+    }
+
+    bool add(int32_t forEpoch, void (fn) (void *, void *, void *),
+             void * data1, void * data2, void * data3)
+    {
+        return add(forEpoch, 3, fn, data1, data2, data3);
+    }
+
+    /** Move the entries to the list.  Must be called with lock held. */
+    void moveTo(DeferredList & list)
+    {
+        typedef void (Fn1) (void *);
+        typedef void (Fn2) (void *, void *);
+
+        for (unsigned i = 0;  i < size;  ++i) {
+            const DeferredEntry3 & work = entries[i].work;
+            switch (entries[i].arity) {
+            case 1:
+                list.addDeferred(epoch, (Fn1 *)work.fn, work.data1);
+                break;
+            case 2:
+                list.addDeferred(epoch, (Fn2 *)work.fn, work.data1, work.data2);
+                break;
+            default:
+                list.addDeferred(epoch, work.fn,
+                                 work.data1, work.data2, work.data3);
+            }
+        }
+        size = 0;
+    }
+};
+
+/** Reader counters of the scalable mode.
+
+    Each thread increments and decrements the counter of its slot for the
+    epoch that it's in, so that a critical section touches a cache line
+    shared with only the threads that were given the same slot.  The epoch,
+    visibleEpoch and exclusive fields of Data are still used but only the
+    scan, under its lock, moves the epoch on.
+*/
+struct GcLockBase::Slots {
+    enum { NUM_SLOTS = 64 };
+
+    Slots()
+        : rescan(0), waiters(0), pending(0), next(0)
+    {
+        for (unsigned i = 0;  i < NUM_SLOTS;  ++i)
+            slot[i].in[0] = slot[i].in[1] = 0;
+    }
+
+    struct Slot {
+        volatile int64_t in[2];    ///< Threads in the even and odd epochs
+    } JML_ALIGNED(64);
+
+    Slot slot[NUM_SLOTS];
+
+    ML::Spinlock lock JML_ALIGNED(64);  ///< Held while scanning
+    volatile int rescan;       ///< Someone wants a scan
+    volatile int waiters;      ///< Threads waiting on visibleEpoch
+    volatile int pending;      ///< Epochs with deferred work
+    int next;                  ///< Next slot to give out
+
+    /** Number of threads in epochs of the same parity as epoch.  Only
+        conclusive when nothing can enter those epochs anymore.
+    */
+    int64_t inEpoch(int32_t epoch) const
+    {
+        int64_t result = 0;
+        for (unsigned i = 0;  i < NUM_SLOTS;  ++i)
+            result += slot[i].in[epoch & 1];
+        return result;
+    }
+
+    int64_t inAny() const
+    {
+        return inEpoch(0) + inEpoch(1);
+    }
+};
+
 std::string
 GcLockBase::ThreadGcInfoEntry::
 print() const
@@ -329,6 +478,7 @@ print() const
 
 GcLockBase::
 GcLockBase()
+    : slots(0), offloaded(0)
 {
     deferred = new Deferred();
 }
@@ -336,11 +486,90 @@ GcLockBase()
 GcLockBase::
 ~GcLockBase()
 {
+    stopReclaimThread();
+
+    // What the threads still have in their batches is left in the lists
+    // like the rest; the batches themselves go with their threads.
+    {
+        boost::lock_guard<ML::Spinlock> guard(deferred->lock);
+        for (DeferredBatch * batch: deferred->batches) {
+            flushBatch(*batch);
+            boost::lock_guard<ML::Spinlock> guard(batch->lock);
+            batch->owner = 0;
+        }
+        deferred->batches.clear();
+    }
+
     if (!deferred->empty()) {
         dump();
     }
 
     delete deferred;
+
+    if (slots) {
+        slots->~Slots();
+        free(slots);
+    }
+}
+
+int
+GcLockBase::
+assignSlot() const
+{
+    if (!slots) return 0;
+    return __sync_fetch_and_add(&slots->next, 1) % Slots::NUM_SLOTS;
+}
+
+void
+GcLockBase::
+scanSlots(RunDefer runDefer)
+{
+    // Ask for a scan and try to do it.  If the lock is taken then its
+    // holder looks at rescan once it's done, so the request isn't lost.
+    slots->rescan = 1;
+    ML::memory_barrier();
+
+    bool wake = false;
+
+    while (slots->rescan) {
+        if (!slots->lock.try_lock()) break;
+
+        slots->rescan = 0;
+        ML::memory_barrier();
+
+        // Nobody can enter the old epoch anymore, so once its counters are
+        // down to zero it's finished and we can move on.  The barrier pairs
+        // with the one in enterCS: a reader that didn't see the new epoch
+        // is counted by the next sum.
+        for (unsigned i = 0;  i < 2;  ++i) {
+            int32_t epoch = data->epoch;
+            if (slots->inEpoch(epoch - 1) != 0) break;
+            data->epoch = epoch + 1;
+            ML::memory_barrier();
+        }
+
+        int32_t epoch = data->epoch;
+        int32_t visible = slots->inEpoch(epoch - 1) == 0
+            ? epoch - 1 : epoch - 2;
+
+        // A reader backing out of an epoch that moved on can make the old
+        // epoch look busy for a moment; visibleEpoch never goes back.
+        if (compareEpochs(visible, data->visibleEpoch) > 0) {
+            data->visibleEpoch = visible;
+            wake = true;
+        }
+
+        slots->lock.unlock();
+        ML::memory_barrier();
+    }
+
+    if (wake)
+        futex_wake(data->visibleEpoch);
+
+    // The scan may have been done by a thread that can't run deferred
+    // work, so check even if we didn't change anything ourselves.
+    if (runDefer && slots->pending && !offloaded)
+        runDefers();
 }
 
 bool
@@ -375,7 +604,7 @@ updateData(Data & oldValue, Data & newValue, RunDefer runDefer)
         // anything that was waiting for it to be visible and run any
         // deferred handlers.
         futex_wake(data->visibleEpoch);
-        if (runDefer) {
+        if (runDefer && !offloaded) {
             runDefers();
         }
     }
@@ -383,7 +612,7 @@ updateData(Data & oldValue, Data & newValue, RunDefer runDefer)
     return true;
 }
 
-void
+size_t
 GcLockBase::
 runDefers()
 {
@@ -391,12 +620,17 @@ runDefers()
     {
         boost::lock_guard<ML::Spinlock> guard(deferred->lock);
         toRun = checkDefers();
+        if (slots)
+            slots->pending = deferred->entries.size();
     }
 
+    size_t result = 0;
     for (unsigned i = 0;  i < toRun.size();  ++i) {
+        result += toRun[i]->size();
         toRun[i]->runAll();
         delete toRun[i];
     }
+    return result;
 }
 
 std::vector<GcLockBase::DeferredList *>
@@ -439,6 +673,28 @@ enterCS(ThreadGcInfoEntry * entry, RunDefer runDefer)
         
     ExcAssertEqual(entry->inEpoch, -1);
 
+    if (slots) {
+        Slots::Slot & slot = slots->slot[entry->slot];
+
+        for (;;) {
+            int32_t epoch = data->epoch;
+            if (data->exclusive) {
+                futex_wait(data->exclusive, 1);
+                continue;
+            }
+
+            // Count ourselves in, then check that the epoch didn't move on
+            // and that no writer came in before the count was visible.
+            volatile int64_t & in = slot.in[epoch & 1];
+            __sync_fetch_and_add(&in, 1);
+            if (data->epoch == epoch && !data->exclusive) {
+                entry->inEpoch = epoch & 1;
+                return;
+            }
+            __sync_fetch_and_add(&in, -1);
+        }
+    }
+
 #if 0 // later...
     // Be optimistic...
     int optimisticEpoch = data->epoch;
@@ -488,6 +744,16 @@ exitCS(ThreadGcInfoEntry * entry, RunDefer runDefer /* = true */)
 
     ExcCheck(entry->inEpoch == 0 || entry->inEpoch == 1,
             "Invalid inEpoch");
+
+    if (slots) {
+        __sync_fetch_and_add(&slots->slot[entry->slot].in[entry->inEpoch], -1);
+        entry->inEpoch = -1;
+
+        if ((runDefer && slots->pending && !offloaded) || slots->waiters)
+            scanSlots(runDefer);
+        return;
+    }
+
     // Fast path
     if (__sync_fetch_and_add(data->in + entry->inEpoch, -1) > 1) {
         entry->inEpoch = -1;
@@ -516,6 +782,23 @@ enterCSExclusive(ThreadGcInfoEntry * entry)
 {
     ExcAssertEqual(entry->inEpoch, -1);
 
+    if (slots) {
+        for (;;) {
+            int old = 0;
+            if (ML::cmp_xchg(data->exclusive, old, 1)) break;
+            futex_wait(data->exclusive, 1);
+        }
+
+        // Readers check exclusive after counting themselves in, so once the
+        // counters are down to zero they are all out or backing out.
+        ML::memory_barrier();
+        while (slots->inAny() != 0)
+            sched_yield();
+
+        entry->inEpoch = data->epoch & 1;
+        return;
+    }
+
     Data current = *data, newValue;
 
     for (;;) {
@@ -639,6 +922,24 @@ visibleBarrier()
         throw ML::Exception("visibleBarrier called in critical section will "
                             "deadlock");
 
+    if (slots) {
+        // Everything in a critical section now is in startEpoch or before,
+        // so we wait for a scan to find that epoch finished.  Readers exiting
+        // while we wait do the scans.
+        int32_t startEpoch = data->epoch;
+
+        __sync_fetch_and_add(&slots->waiters, 1);
+        Call_Guard guard([&] () { __sync_fetch_and_add(&slots->waiters, -1); });
+
+        for (;;) {
+            scanSlots(RD_NO);
+            int32_t visible = data->visibleEpoch;
+            if (compareEpochs(visible, startEpoch) >= 0)
+                return;
+            futex_wait(data->visibleEpoch, visible, 0.01);
+        }
+    }
+
     Data current = *data;
     int startEpoch = data->epoch;
     //int startVisible = data.visibleEpoch;
@@ -682,6 +983,14 @@ deferBarrier()
 
     visibleBarrier();
 
+    // Everything deferred so far is now invisible, so all it takes is to
+    // hand it over and run it.  reclaim() waits for a concurrent one that
+    // may be running some of it.
+    if (offloaded) {
+        reclaim();
+        return;
+    }
+
     // Do it twice to make sure that everything is cycled over two different
     // epochs
     for (unsigned i = 0;  i < 2;  ++i) {
@@ -751,6 +1060,61 @@ doDefer(void (fn) (Args...), Args... args)
     // If there are threads in the current epoch (irrespective of the old
     // epoch) then we need to wait until the current epoch is done.
 
+    if (offloaded) {
+        int32_t forEpoch;
+
+        if (slots) {
+            ML::memory_barrier();
+            if (slots->inAny() == 0) {
+                fn(std::forward<Args>(args)...);
+                return;
+            }
+            forEpoch = data->epoch;
+        }
+        else {
+            Data current = *data;
+            if (current.inCurrent() + current.inOld() == 0) {
+                fn(std::forward<Args>(args)...);
+                return;
+            }
+            forEpoch = current.epoch;
+            if (current.inCurrent() == 0) --forEpoch;
+        }
+
+        DeferredBatch & batch = threadBatch(getEntry());
+        while (!batch.add(forEpoch, fn, std::forward<Args>(args)...)) {
+            boost::lock_guard<ML::Spinlock> guard(deferred->lock);
+            flushBatch(batch);
+        }
+        return;
+    }
+
+    if (slots) {
+        // Whoever may still see what is being deferred counted itself in
+        // before it was unlinked, and stays counted until it exits, so
+        // counters all at zero mean that nobody can see it.  Otherwise it
+        // waits for whatever epoch it is now to finish.
+        ML::memory_barrier();
+
+        if (slots->inAny() == 0) {
+            fn(std::forward<Args>(args)...);
+            return;
+        }
+
+        boost::lock_guard<ML::Spinlock> guard(deferred->lock);
+
+        int32_t epoch = data->epoch;
+        auto epochIt
+            = deferred->entries.insert
+            (make_pair(epoch, (DeferredList *)0)).first;
+        if (epochIt->second == 0)
+            epochIt->second = new DeferredList();
+        epochIt->second->addDeferred(epoch, fn, std::forward<Args>(args)...);
+
+        slots->pending = deferred->entries.size();
+        return;
+    }
+
     Data current = *data;
 
     int32_t newestVisibleEpoch = current.epoch;
@@ -836,6 +1200,145 @@ defer(void (work) (void *, void *, void *), void * arg1, void * arg2, void * arg
     doDefer(work, arg1, arg2, arg3);
 }
 
+void
+GcLockBase::
+offloadReclamation()
+{
+    offloaded = 1;
+    ML::memory_barrier();
+}
+
+GcLockBase::DeferredBatch &
+GcLockBase::
+threadBatch(ThreadGcInfoEntry & entry)
+{
+    if (!entry.batch) {
+        DeferredBatch * batch = new DeferredBatch(this);
+        boost::lock_guard<ML::Spinlock> guard(deferred->lock);
+        deferred->batches.push_back(batch);
+        entry.batch = batch;
+    }
+    return *entry.batch;
+}
+
+void
+GcLockBase::
+flushBatch(DeferredBatch & batch)
+{
+    boost::lock_guard<ML::Spinlock> guard(batch.lock);
+    if (batch.size == 0)
+        return;
+
+    auto epochIt
+        = deferred->entries.insert
+        (make_pair(batch.epoch, (DeferredList *)0)).first;
+    if (epochIt->second == 0)
+        epochIt->second = new DeferredList();
+    batch.moveTo(*epochIt->second);
+
+    if (slots)
+        slots->pending = deferred->entries.size();
+}
+
+void
+GcLockBase::
+releaseBatch(DeferredBatch * batch)
+{
+    GcLockBase * owner;
+    {
+        boost::lock_guard<ML::Spinlock> guard(batch->lock);
+        owner = batch->owner;
+    }
+
+    if (owner) {
+        boost::lock_guard<ML::Spinlock> guard(owner->deferred->lock);
+        owner->flushBatch(*batch);
+        auto & batches = owner->deferred->batches;
+        batches.erase(std::find(batches.begin(), batches.end(), batch));
+    }
+
+    delete batch;
+}
+
+size_t
+GcLockBase::
+reclaim()
+{
+    if (!offloaded)
+        return 0;
+
+    std::lock_guard<std::mutex> guard(deferred->reclaimLock);
+
+    {
+        boost::lock_guard<ML::Spinlock> guard(deferred->lock);
+        for (DeferredBatch * batch: deferred->batches)
+            flushBatch(*batch);
+    }
+
+    // In the scalable mode nobody else moves the epochs on anymore
+    if (slots)
+        scanSlots(RD_NO);
+
+    return runDefers();
+}
+
+void
+GcLockBase::
+startReclaimThread(double interval)
+{
+    if (deferred->reclaimThread.joinable())
+        throw ML::Exception("GcLock reclaim thread already started");
+
+    offloadReclamation();
+
+    deferred->stopReclaim = false;
+    deferred->reclaimThread = std::thread([=] ()
+        {
+            while (!deferred->stopReclaim) {
+                reclaim();
+                ML::sleep(interval);
+            }
+        });
+}
+
+void
+GcLockBase::
+stopReclaimThread()
+{
+    if (!deferred->reclaimThread.joinable())
+        return;
+
+    deferred->stopReclaim = true;
+    deferred->reclaimThread.join();
+}
+
+GcLockBase::DeferStats
+GcLockBase::
+deferStats() const
+{
+    DeferStats result;
+
+    boost::lock_guard<ML::Spinlock> guard(deferred->lock);
+
+    for (auto & entry: deferred->entries) {
+        const DeferredList & list = *entry.second;
+        result.numPending += list.size();
+        result.bytes += sizeof(DeferredList)
+            + list.deferred1.capacity() * sizeof(DeferredEntry1)
+            + list.deferred2.capacity() * sizeof(DeferredEntry2)
+            + list.deferred3.capacity() * sizeof(DeferredEntry3);
+    }
+
+    for (DeferredBatch * batch: deferred->batches) {
+        boost::lock_guard<ML::Spinlock> guard(batch->lock);
+        result.numPending += batch->size;
+        result.bytes += sizeof(DeferredBatch);
+    }
+    result.numBatches = deferred->batches.size();
+
+    return result;
+}
+
 void
 GcLockBase::
 dump()
@@ -844,6 +1347,9 @@ dump()
     cerr << "epoch " << current.epoch << " in " << current.inCurrent()
          << " in-1 " << current.inOld() << " vis " << current.visibleEpoch
          << " excl " << current.exclusive << endl;
+    if (slots)
+        cerr << "slots: in " << slots->inEpoch(current.epoch)
+             << " in-1 " << slots->inEpoch(current.epoch - 1) << endl;
     cerr << "deferred: ";
     {
         boost::lock_guard<ML::Spinlock> guard(deferred->lock);
@@ -856,6 +1362,10 @@ dump()
         }
     }
     cerr << endl;
+
+    DeferStats stats = deferStats();
+    cerr << "pending: " << stats.numPending << " in " << stats.numBatches
+         << " batches, " << stats.bytes << " bytes" << endl;
 }
 
 
@@ -863,16 +1373,33 @@ dump()
 /* GC LOCK                                                                   */
 /*****************************************************************************/
 
+GcScalable GC_SCALABLE;
+
 GcLock::
 GcLock()
 {
     data = &localData;
 }
 
+GcLock::
+GcLock(GcScalable)
+{
+    data = &localData;
+
+    // The slots have to be on cache lines of their own, which new doesn't
+    // promise for over-aligned types.
+    void * mem;
+    int res = posix_memalign(&mem, 64, sizeof(Slots));
+    if (res != 0)
+        throw ML::Exception(res, "posix_memalign of GcLock slots");
+    slots = new (mem) Slots();
+}
+
 GcLock::
 ~GcLock()
 {
-    // Nothing to cleanup.
+    // The reclaim thread mustn't outlive data.
+    stopReclaimThread();
 }
 
 void
@@ -947,6 +1474,7 @@ SharedGcLock(GcOpen, const string& name) :
 SharedGcLock::
 ~SharedGcLock()
 {
+    stopReclaimThread();
     munmap(addr, GcLockFileSize);
     close(fd);
 }
@@ -68,12 +68,15 @@ public:
         RD_YES = 1      ///< Potentially run deferred work on this call
     };
 
+    /// Deferred work of a thread that wasn't handed over yet
+    struct DeferredBatch;
+
     /// A thread's bookkeeping info about each GC area
     struct ThreadGcInfoEntry {
         ThreadGcInfoEntry()
             : inEpoch(-1), readLocked(0), writeLocked(0),
               specLocked(0), specUnlocked(0),
-              owner(0)
+              slot(0), batch(0), owner(0)
         {
         }
 
@@ -90,7 +93,9 @@ public:
                 unlockShared(RD_YES);
                 specUnlocked = 0;
             }
-           
+
+            if (batch)
+                releaseBatch(batch);
         } 
 
 
@@ -101,11 +106,17 @@ public:
         int specLocked;
         int specUnlocked;
 
+        int slot;     ///< Counter used in the scalable mode
+
+        DeferredBatch * batch;  ///< Defers waiting to be handed over
+
         GcLockBase *owner;
 
         void init(const GcLockBase * const self) {
-            if (!owner) 
+            if (!owner) {
                 owner = const_cast<GcLockBase *>(self);
+                slot = owner->assignSlot();
+            }
         }
                 
 
@@ -262,6 +273,14 @@ public:
         return data->epoch;
     }
 
+    /** Whether the lock counts its readers per thread rather than in
+        data; see GcLock(GcScalable).
+    */
+    bool isScalable() const
+    {
+        return slots;
+    }
+
     JML_ALWAYS_INLINE ThreadGcInfoEntry &
     getEntry(GcInfo::PerThreadInfo * info = 0) const
     {
@@ -554,11 +573,63 @@ public:
         this->defer(bound);
     }
 
+    /** Stop running the deferred work in the threads that exit critical
+        sections, whatever their RunDefer, so that readers don't get the
+        latency of whatever work they happen to be the last one to allow.
+        Deferred work is collected in a batch per thread instead, which
+        costs no allocation or shared write per defer() in the common case,
+        and is run by reclaim().  Can't be undone.
+    */
+    void offloadReclamation();
+
+    /** Whether offloadReclamation() was called. */
+    bool isReclamationOffloaded() const
+    {
+        return offloaded;
+    }
+
+    /** Hand over the batches of all the threads and run the deferred work
+        that nothing can see anymore.  Meant to be called regularly from a
+        housekeeping thread once the reclamation is offloaded; it's a no-op
+        otherwise.  Returns the number of deferred calls that were run.
+    */
+    size_t reclaim();
+
+    /** Offload the reclamation to a thread of the lock's own, which calls
+        reclaim() every interval seconds until stopReclaimThread() or the
+        destruction of the lock.
+    */
+    void startReclaimThread(double interval = 0.001);
+
+    void stopReclaimThread();
+
+    /// Gauge of the work that is waiting to be run
+    struct DeferStats {
+        DeferStats()
+            : numPending(0), numBatches(0), bytes(0)
+        {
+        }
+
+        size_t numPending;   ///< Deferred calls not yet run
+        size_t numBatches;   ///< Threads with a batch
+        size_t bytes;        ///< Memory taken by the bookkeeping of those
+    };
+
+    /** Pending deferred work.  Doesn't count what the work would free. */
+    DeferStats deferStats() const;
+
     void dump();
 
 protected:
     Data* data;
 
+    struct Slots;
+
+    /** Padded reader counters of the scalable mode, or null for the
+        classic mode where they are part of data.
+    */
+    Slots * slots;
+
 private:
     struct Deferred;
     struct DeferredList;
@@ -579,13 +650,41 @@ private:
     */
     bool updateData(Data & oldValue, Data & newValue, RunDefer runDefer);
 
-    /** Executes any available deferred work. */
-    void runDefers();
+    /** Executes any available deferred work.  Returns the number of
+        deferred calls that were run.
+    */
+    size_t runDefers();
 
     /** Check what deferred updates need to be run and do them.  Must be
         called with deferred locked.
     */
     std::vector<DeferredList *> checkDefers();
+
+    /** Counter that a new thread uses in the scalable mode. */
+    int assignSlot() const;
+
+    /** Set once the deferred work is run only by reclaim(). */
+    volatile int offloaded;
+
+    /** Batch of the calling thread, created the first time. */
+    DeferredBatch & threadBatch(ThreadGcInfoEntry & entry);
+
+    /** Move the work of the batch to the deferred lists.  Must be called
+        with deferred locked.
+    */
+    void flushBatch(DeferredBatch & batch);
+
+    /** Called when a thread with a batch exits, which may be after its
+        lock was destroyed.
+    */
+    static void releaseBatch(DeferredBatch * batch);
+
+    /** Scalable mode: work out from the counters which epochs are still
+        visible, moving on to a new epoch when the old one is drained, and
+        wake up the waiters if that changed visibleEpoch.  If another thread
+        is already scanning it is left to pick up the request.
+    */
+    void scanSlots(RunDefer runDefer);
 };
 
 
@@ -593,11 +692,28 @@ private:
 /* GC LOCK                                                                   */
 /*****************************************************************************/
 
+/** Selects the scalable mode of the GcLock constructor. */
+extern struct GcScalable {} GC_SCALABLE;
+
 /** GcLock for use within a single process. */
 
 struct GcLock : public GcLockBase
 {
     GcLock();
+
+    /** GcLock whose critical sections don't share a cache line between
+        threads.  Each thread counts itself in one of a set of counters that
+        are a cache line apart, instead of in the single Data word that all
+        threads update with a compare and swap, so that entering and exiting
+        critical sections scales with the number of readers.
+
+        The price is paid by the writers: defer(), visibleBarrier() and
+        lockExclusive() have to sum up all the counters to find out which
+        epochs are still visible, and the deferred work is run a little
+        later than in the classic mode, once a scan moved the epoch on.
+        Worth it for read mostly structures with many reader threads.
+    */
+    GcLock(GcScalable);
     virtual ~GcLock();
 
     virtual void unlink();
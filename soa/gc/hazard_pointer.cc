@@ -0,0 +1,298 @@
+/* hazard_pointer.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Hazard pointers.
+*/
+
+#include "soa/gc/hazard_pointer.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/spinlock.h"
+#include "jml/utils/exc_assert.h"
+#include <algorithm>
+#include <vector>
+#include <sched.h>
+
+
+using namespace std;
+using namespace ML;
+
+
+namespace Datacratic {
+
+namespace {
+
+struct Retired {
+    void * ptr;
+    void (*deleter) (void *);
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* HAZARD DOMAIN                                                             */
+/*****************************************************************************/
+
+/** A record is taken by a thread the first time it uses the domain and
+    handed back when it exits, for another thread to reuse.  Records are
+    only freed with the domain, so that scans can walk the list without a
+    lock.
+*/
+struct HazardDomain::Record {
+    Record()
+        : used(0), active(1), numRetired(0), next(0)
+    {
+        for (unsigned i = 0;  i < SLOTS_PER_THREAD;  ++i)
+            hazards[i] = 0;
+    }
+
+    const void * volatile hazards[SLOTS_PER_THREAD];
+    volatile unsigned used;        ///< Bitmap of the hazards given out
+    volatile int active;           ///< Owned by a live thread
+    volatile size_t numRetired;    ///< For stats(); retired is unlocked
+    Record * next;
+
+    /// Only touched by the owning thread
+    std::vector<Retired> retired;
+
+    // Readers write their hazards all the time; keep the next record off
+    // the same cache line.
+    char padding[64];
+};
+
+struct HazardDomain::Itl {
+    Itl()
+        : head(0), numRecords(0)
+    {
+    }
+
+    ~Itl()
+    {
+        for (auto & r: orphans)
+            r.deleter(r.ptr);
+
+        for (Record * record = head;  record; ) {
+            for (auto & r: record->retired)
+                r.deleter(r.ptr);
+            Record * next = record->next;
+            delete record;
+            record = next;
+        }
+    }
+
+    Record * volatile head;
+    volatile int numRecords;
+
+    /// What exited threads retired and couldn't free yet
+    mutable ML::Spinlock orphansLock;
+    std::vector<Retired> orphans;
+
+    size_t threshold(size_t configured) const
+    {
+        if (configured) return configured;
+        return std::max<size_t>(64, 2 * SLOTS_PER_THREAD * numRecords);
+    }
+
+    /** Sorted list of what is protected right now. */
+    void protectedPointers(std::vector<const void *> & result) const
+    {
+        result.clear();
+        for (Record * record = head;  record;  record = record->next) {
+            for (unsigned i = 0;  i < SLOTS_PER_THREAD;  ++i) {
+                const void * ptr = record->hazards[i];
+                if (ptr) result.push_back(ptr);
+            }
+        }
+        std::sort(result.begin(), result.end());
+    }
+
+    size_t scan(Record & record)
+    {
+        {
+            boost::lock_guard<ML::Spinlock> guard(orphansLock);
+            record.retired.insert(record.retired.end(),
+                                  orphans.begin(), orphans.end());
+            orphans.clear();
+        }
+
+        // Pairs with the barrier in Hazard::protect(): a reader that
+        // protected one of these before it was retired is seen here.
+        ML::memory_barrier();
+
+        std::vector<const void *> hazards;
+        protectedPointers(hazards);
+
+        // The deleters may retire more objects, which go to record.retired
+        std::vector<Retired> candidates;
+        candidates.swap(record.retired);
+
+        size_t result = 0;
+        for (auto & r: candidates) {
+            if (std::binary_search(hazards.begin(), hazards.end(), r.ptr))
+                record.retired.push_back(r);
+            else {
+                r.deleter(r.ptr);
+                ++result;
+            }
+        }
+
+        record.numRetired = record.retired.size();
+        return result;
+    }
+};
+
+HazardDomain::ThreadEntry::
+~ThreadEntry()
+{
+    if (!record) return;
+
+    {
+        boost::lock_guard<ML::Spinlock> guard(owner->itl->orphansLock);
+        owner->itl->orphans.insert(owner->itl->orphans.end(),
+                                   record->retired.begin(),
+                                   record->retired.end());
+    }
+    record->retired.clear();
+    record->numRetired = 0;
+
+    ML::memory_barrier();
+    record->active = 0;
+}
+
+HazardDomain::
+HazardDomain(size_t retireThreshold)
+    : retireThreshold(retireThreshold), itl(new Itl())
+{
+}
+
+HazardDomain::
+~HazardDomain()
+{
+}
+
+HazardDomain::Record &
+HazardDomain::
+threadRecord()
+{
+    ThreadEntry * entry = threadInfo.get();
+    if (entry->record)
+        return *entry->record;
+
+    entry->owner = this;
+
+    for (Record * record = itl->head;  record;  record = record->next) {
+        int inactive = 0;
+        if (!record->active && ML::cmp_xchg(record->active, inactive, 1)) {
+            entry->record = record;
+            return *record;
+        }
+    }
+
+    Record * record = new Record();
+    Record * head = itl->head;
+    do {
+        record->next = head;
+    } while (!ML::cmp_xchg(itl->head, head, record));
+    __sync_fetch_and_add(&itl->numRecords, 1);
+
+    entry->record = record;
+    return *record;
+}
+
+HazardDomain::Hazard::
+Hazard(HazardDomain & domain)
+    : record(&domain.threadRecord()), slot(0)
+{
+    for (;;) {
+        unsigned used = record->used;
+        if (used == (1U << SLOTS_PER_THREAD) - 1)
+            throw ML::Exception("a thread can't hold more than %d hazard "
+                                "pointers", (int)SLOTS_PER_THREAD);
+
+        slot = __builtin_ctz(~used);
+        if (ML::cmp_xchg(record->used, used, used | (1U << slot)))
+            return;
+    }
+}
+
+void
+HazardDomain::Hazard::
+set(const void * ptr)
+{
+    ExcAssert(record);
+    record->hazards[slot] = ptr;
+}
+
+void
+HazardDomain::Hazard::
+release()
+{
+    if (!record) return;
+
+    record->hazards[slot] = 0;
+    __sync_fetch_and_and(&record->used, ~(1U << slot));
+    record = 0;
+}
+
+void
+HazardDomain::
+retire(void * ptr, void (*deleter) (void *))
+{
+    Record & record = threadRecord();
+    record.retired.push_back(Retired{ptr, deleter});
+    record.numRetired = record.retired.size();
+
+    if (record.retired.size() >= itl->threshold(retireThreshold))
+        itl->scan(record);
+}
+
+size_t
+HazardDomain::
+collect()
+{
+    return itl->scan(threadRecord());
+}
+
+void
+HazardDomain::
+waitUnprotected(const void * ptr) const
+{
+    ML::memory_barrier();
+
+    for (;;) {
+        bool found = false;
+        for (Record * record = itl->head;  record && !found;
+             record = record->next) {
+            for (unsigned i = 0;  i < SLOTS_PER_THREAD;  ++i) {
+                if (record->hazards[i] == ptr) {
+                    found = true;
+                    break;
+                }
+            }
+        }
+
+        if (!found) return;
+        sched_yield();
+    }
+}
+
+HazardDomain::Stats
+HazardDomain::
+stats() const
+{
+    Stats result;
+
+    for (Record * record = itl->head;  record;  record = record->next) {
+        ++result.numRecords;
+        for (unsigned i = 0;  i < SLOTS_PER_THREAD;  ++i)
+            if (record->hazards[i]) ++result.numProtected;
+        result.numRetired += record->numRetired;
+    }
+
+    boost::lock_guard<ML::Spinlock> guard(itl->orphansLock);
+    result.numRetired += itl->orphans.size();
+
+    return result;
+}
+
+} // namespace Datacratic
@@ -0,0 +1,204 @@
+/* hazard_pointer.h                                                -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Hazard pointers, for the structures where the memory held back by a slow
+   reader has to stay bounded.
+*/
+
+#pragma once
+
+#include "jml/arch/atomic_ops.h"
+#include "jml/arch/thread_specific.h"
+#include <boost/noncopyable.hpp>
+#include <memory>
+
+
+/** Hazard pointers are the other classic answer to the reclamation problem
+    that GcLock solves.  Instead of announcing that it is in a critical
+    section, a reader announces the exact object it is about to use by
+    storing its address in one of its hazard pointers; an object that was
+    retired is only freed once no hazard pointer points to it.
+
+    Compared with GcLock, reading costs more (a full memory barrier for each
+    object protected, and a limit on how many objects a thread can hold at
+    once) but a reader that stalls only holds back the objects that it
+    protects rather than everything that was retired since it started.  The
+    number of objects waiting to be freed is bounded by the number of hazard
+    pointers plus the retire threshold of each thread.
+*/
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* HAZARD DOMAIN                                                             */
+/*****************************************************************************/
+
+/** Set of hazard pointers and of the objects retired under them.  An object
+    has to be protected and retired through the same domain.
+*/
+
+struct HazardDomain : public boost::noncopyable {
+
+    /// Number of objects a thread can protect at the same time
+    enum { SLOTS_PER_THREAD = 4 };
+
+    /// Hazard pointers and retired objects of a thread
+    struct Record;
+
+    /** Retired objects are looked at once a thread has retireThreshold of
+        them.  0 picks twice the number of hazard pointers, with a minimum
+        of 64, which keeps the cost of a scan per object constant.
+    */
+    HazardDomain(size_t retireThreshold = 0);
+
+    /** Frees whatever is still retired.  Nothing may be protected anymore. */
+    ~HazardDomain();
+
+    /** One hazard pointer of the calling thread, held for the lifetime of
+        the object.  It may be moved to and released by another thread.
+    */
+    struct Hazard {
+        Hazard()
+            : record(0), slot(0)
+        {
+        }
+
+        Hazard(HazardDomain & domain);
+
+        Hazard(Hazard && other)
+            : record(other.record), slot(other.slot)
+        {
+            other.record = 0;
+        }
+
+        Hazard & operator = (Hazard && other)
+        {
+            if (this != &other) {
+                release();
+                record = other.record;
+                slot = other.slot;
+                other.record = 0;
+            }
+            return *this;
+        }
+
+        ~Hazard()
+        {
+            release();
+        }
+
+        /** Read the pointer at src and protect it.  After this returns,
+            the object it points to can't be freed until the hazard is
+            cleared, released or protects something else.
+        */
+        template<typename T>
+        T * protect(T * const volatile & src)
+        {
+            T * ptr = src;
+            for (;;) {
+                set(ptr);
+                // Has to be seen by a scan before we check that it's still
+                // current; otherwise it may have been retired and freed in
+                // between.
+                ML::memory_barrier();
+                T * check = src;
+                if (check == ptr)
+                    return ptr;
+                ptr = check;
+            }
+        }
+
+        /** Protect ptr, which mustn't be retired yet; for example because
+            it wasn't published.
+        */
+        void set(const void * ptr);
+
+        void clear()
+        {
+            set(0);
+        }
+
+        /** Give the hazard pointer back to its thread. */
+        void release();
+
+    private:
+
+        Record * record;
+        int slot;
+    };
+
+    /** Free ptr with deleter once no hazard pointer protects it. */
+    void retire(void * ptr, void (*deleter) (void *));
+
+    template<typename T>
+    void retire(T * ptr, void (*deleter) (T *))
+    {
+        retire((void *)ptr, (void (*) (void *))deleter);
+    }
+
+    template<typename T>
+    static void doDelete(T * ptr)
+    {
+        delete ptr;
+    }
+
+    template<typename T>
+    void retireDelete(T * ptr)
+    {
+        if (!ptr) return;
+        retire(ptr, doDelete<T>);
+    }
+
+    /** Free whatever the calling thread retired that isn't protected
+        anymore, along with what exited threads left behind.  Returns the
+        number of objects freed.
+    */
+    size_t collect();
+
+    /** Wait until nothing protects ptr anymore. */
+    void waitUnprotected(const void * ptr) const;
+
+    /// Gauge of the domain
+    struct Stats {
+        Stats()
+            : numRecords(0), numProtected(0), numRetired(0)
+        {
+        }
+
+        size_t numRecords;     ///< Threads that ever used the domain
+        size_t numProtected;   ///< Hazard pointers that are set
+        size_t numRetired;     ///< Objects waiting to be freed
+    };
+
+    Stats stats() const;
+
+    const size_t retireThreshold;
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+
+    /// Record of a thread in the domain
+    struct ThreadEntry {
+        ThreadEntry()
+            : record(0), owner(0)
+        {
+        }
+
+        ~ThreadEntry();
+
+        Record * record;
+        HazardDomain * owner;
+    };
+
+    typedef ML::ThreadSpecificInstanceInfo<ThreadEntry, HazardDomain>
+        ThreadInfo;
+
+    /** Destroyed before itl, so that the threads' records go back to it. */
+    ThreadInfo threadInfo;
+
+    Record & threadRecord();
+};
+
+} // namespace Datacratic
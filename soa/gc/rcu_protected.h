@@ -9,11 +9,22 @@
 #define __mmap__rcu_protected_h__
 
 #include "gc_lock.h"
+#include "hazard_pointer.h"
 #include "jml/utils/unnamed_bool.h"
 #include "jml/arch/atomic_ops.h"
 
 namespace Datacratic {
 
+/** Policies for RcuProtected.  RcuGcPolicy protects the readers with the
+    critical sections of a GcLock: reading is cheap, but a reader that
+    stays in its critical section holds back everything retired through
+    that lock.  RcuHazardPolicy protects them with the hazard pointers of a
+    HazardDomain: reading costs a memory barrier, but a stalled reader only
+    holds back the value it read.
+*/
+struct RcuGcPolicy {};
+struct RcuHazardPolicy {};
+
 template<typename T>
 struct RcuLocked {
     RcuLocked(T * ptr = nullptr, GcLock * lock = nullptr)
@@ -108,6 +119,72 @@ struct RcuLocked {
 };
 
 template<typename T>
+struct HazardLocked {
+    HazardLocked()
+        : ptr(nullptr)
+    {
+    }
+
+    /// Protect the value at src
+    template<typename Src>
+    HazardLocked(Src * const volatile & src, HazardDomain & domain)
+        : hazard(domain)
+    {
+        ptr = hazard.protect(src);
+    }
+
+    /// Take over a hazard that already protects ptr
+    HazardLocked(HazardDomain::Hazard && hazard, T * ptr)
+        : ptr(ptr), hazard(std::move(hazard))
+    {
+    }
+
+    HazardLocked(HazardLocked && other)
+        : ptr(other.ptr), hazard(std::move(other.hazard))
+    {
+        other.ptr = nullptr;
+    }
+
+    HazardLocked & operator = (HazardLocked && other)
+    {
+        hazard = std::move(other.hazard);
+        ptr = other.ptr;
+        other.ptr = nullptr;
+        return *this;
+    }
+
+    void unlock()
+    {
+        hazard.release();
+        ptr = nullptr;
+    }
+
+    T * ptr;
+
+    operator T * () const
+    {
+        return ptr;
+    }
+
+    T * operator -> () const
+    {
+        if (!ptr)
+            throw ML::Exception("dereferencing null HazardLocked");
+        return ptr;
+    }
+
+    T & operator * () const
+    {
+        if (!ptr)
+            throw ML::Exception("dereferencing null HazardLocked");
+        return *ptr;
+    }
+
+private:
+    HazardDomain::Hazard hazard;
+};
+
+template<typename T, typename Policy = RcuGcPolicy>
 struct RcuProtected {
     T * val;
     GcLock * lock;
@@ -229,6 +306,124 @@ private:
     void operator = (const RcuProtected & other);
 };
 
+/** RcuProtected whose readers hold a hazard pointer on the value that they
+    read rather than a GcLock critical section.  Each thread can only read
+    HazardDomain::SLOTS_PER_THREAD values at the same time, across all the
+    structures of the domain, and the value read must be held through the
+    HazardLocked rather than under a guard.
+*/
+template<typename T>
+struct RcuProtected<T, RcuHazardPolicy> {
+    T * val;
+    HazardDomain * domain;
+
+    template<typename... Args>
+    RcuProtected(HazardDomain & domain, Args&&... args)
+        : val(new T(std::forward<Args>(args)...)), domain(&domain)
+    {
+    }
+
+    RcuProtected(T * val, HazardDomain & domain)
+        : val(val), domain(&domain)
+    {
+    }
+
+    RcuProtected(RcuProtected && other)
+        : val(other.val), domain(other.domain)
+    {
+        other.val = 0;
+    }
+
+    RcuProtected & operator = (RcuProtected && other)
+    {
+        auto toDelete = val;
+        val = other.val;
+        domain = other.domain;
+        other.val = 0;
+        domain->retireDelete(toDelete);
+        return *this;
+    }
+
+    ~RcuProtected()
+    {
+        domain->retireDelete(val);
+        val = 0;
+    }
+
+    JML_IMPLEMENT_OPERATOR_BOOL(val);
+
+    HazardLocked<T> operator () ()
+    {
+        return HazardLocked<T>(val, *domain);
+    }
+
+    HazardLocked<const T> operator () () const
+    {
+        return HazardLocked<const T>(val, *domain);
+    }
+
+    HazardLocked<const T> getImmutable() const
+    {
+        return HazardLocked<const T>(val, *domain);
+    }
+
+    T * unsafePtr() const
+    {
+        return val;
+    }
+
+    void replace(T * newVal, bool defer = true)
+    {
+        T * toDelete = ML::atomic_xchg(val, newVal);
+        if (toDelete) {
+            ExcAssertNotEqual(toDelete, val);
+            if (defer) domain->retireDelete(toDelete);
+            else {
+                domain->waitUnprotected(toDelete);
+                delete toDelete;
+            }
+        }
+    }
+
+    std::unique_ptr<T> replaceCustomCleanup(T * newVal)
+    {
+        return std::unique_ptr<T>(ML::atomic_xchg(val, newVal));
+    }
+
+    bool cmp_xchg(HazardLocked<T> & current, std::auto_ptr<T> & newValue,
+                  bool defer = true,
+                  void (*cleanup) (T *) = HazardDomain::doDelete<T>)
+    {
+        // The new value is protected before it's published, so that
+        // current can go on reading it whatever happens to it after.
+        HazardDomain::Hazard hazard(*domain);
+        hazard.set(newValue.get());
+        ML::memory_barrier();
+
+        T * currentVal = current.ptr;
+        if (!ML::cmp_xchg(val, currentVal, newValue.get()))
+            return false;
+
+        ExcAssertNotEqual(currentVal, val);
+        current = HazardLocked<T>(std::move(hazard), newValue.release());
+
+        if (currentVal && cleanup) {
+            if (defer)
+                domain->retire(currentVal, cleanup);
+            else {
+                domain->waitUnprotected(currentVal);
+                cleanup(currentVal);
+            }
+        }
+        return true;
+    }
+
+private:
+    RcuProtected();
+    RcuProtected(const RcuProtected & other);
+    void operator = (const RcuProtected & other);
+};
+
 template<typename T>
 struct RcuProtectedCopyable : public RcuProtected<T> {
 
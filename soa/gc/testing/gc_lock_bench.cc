@@ -0,0 +1,86 @@
+/* gc_lock_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Contention of the GcLock critical sections, in the classic and the
+   scalable modes, over a range of reader thread counts.
+
+   Usage: gc_lock_bench [seconds per run] [max threads]
+*/
+
+#include "soa/gc/gc_lock.h"
+#include "jml/arch/format.h"
+#include "jml/arch/timers.h"
+#include <boost/thread.hpp>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <stdlib.h>
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+/** Run nthreads readers entering and exiting critical sections on the lock
+    for the given time, with a writer deferring a deletion every
+    millisecond, and return the critical sections per second.
+*/
+double run(GcLock & gc, int nthreads, double seconds)
+{
+    volatile bool finished = false;
+    std::atomic<uint64_t> total(0);
+
+    auto reader = [&] ()
+        {
+            uint64_t n = 0;
+            while (!finished) {
+                GcLock::SharedGuard guard(gc);
+                ++n;
+            }
+            total += n;
+        };
+
+    auto writer = [&] ()
+        {
+            while (!finished) {
+                gc.deferDelete(new int(0));
+                ML::sleep(0.001);
+            }
+        };
+
+    boost::thread_group tg;
+    for (unsigned i = 0;  i < nthreads;  ++i)
+        tg.create_thread(reader);
+    tg.create_thread(writer);
+
+    ML::sleep(seconds);
+    finished = true;
+    tg.join_all();
+
+    gc.deferBarrier();
+
+    return total / seconds;
+}
+
+int main(int argc, char ** argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    int maxThreads = argc > 2 ? atoi(argv[2])
+        : 2 * boost::thread::hardware_concurrency();
+
+    cout << "threads      classic     scalable   ratio" << endl;
+
+    for (int nthreads = 1;  nthreads <= maxThreads;  nthreads *= 2) {
+        GcLock classic;
+        double classicRate = run(classic, nthreads, seconds);
+
+        GcLock scalable(GC_SCALABLE);
+        double scalableRate = run(scalable, nthreads, seconds);
+
+        cout << ML::format("%7d %10.2fM %10.2fM %7.2f",
+                           nthreads, classicRate / 1e6, scalableRate / 1e6,
+                           scalableRate / classicRate)
+             << endl;
+    }
+}
@@ -729,3 +729,203 @@ BOOST_AUTO_TEST_CASE ( test_defer_race )
 }
 
 #endif
+
+struct ScalableGcLockProxy : public GcLock {
+    ScalableGcLockProxy() :
+        GcLock(GC_SCALABLE)
+    {}
+};
+
+BOOST_AUTO_TEST_CASE ( test_scalable_gc )
+{
+    ScalableGcLockProxy gc;
+    BOOST_CHECK(gc.isScalable());
+
+    bool deferred = false;
+
+    // Nothing in a critical section so it's run straight away
+    gc.defer([&] () { deferred = true; memory_barrier(); });
+    BOOST_CHECK(deferred);
+
+    deferred = false;
+    gc.lockShared();
+    BOOST_CHECK(gc.isLockedShared());
+
+    gc.defer([&] () { deferred = true; memory_barrier(); });
+    BOOST_CHECK(!deferred);
+
+    gc.unlockShared();
+
+    BOOST_CHECK(!gc.isLockedShared());
+    BOOST_CHECK(deferred);
+
+    gc.deferBarrier();
+    gc.visibleBarrier();
+}
+
+BOOST_AUTO_TEST_CASE ( test_scalable_mutual_exclusion )
+{
+    cerr << "testing scalable mutual exclusion" << endl;
+
+    ScalableGcLockProxy lock;
+    volatile bool finished = false;
+    volatile int numExclusive = 0;
+    volatile int numShared = 0;
+    int errors = 0;
+
+    auto sharedThread = [&] ()
+        {
+            while (!finished) {
+                GcLock::SharedGuard guard(lock);
+                ML::atomic_inc(numShared);
+                if (numExclusive > 0)
+                    ML::atomic_inc(errors);
+                ML::atomic_dec(numShared);
+            }
+        };
+
+    auto exclusiveThread = [&] ()
+        {
+            while (!finished) {
+                GcLock::ExclusiveGuard guard(lock);
+                ML::atomic_inc(numExclusive);
+                if (numExclusive > 1 || numShared > 0)
+                    ML::atomic_inc(errors);
+                ML::atomic_dec(numExclusive);
+            }
+        };
+
+    boost::thread_group tg;
+    for (unsigned i = 0;  i < 4;  ++i)
+        tg.create_thread(sharedThread);
+    for (unsigned i = 0;  i < 2;  ++i)
+        tg.create_thread(exclusiveThread);
+    sleep(1);
+    finished = true;
+    tg.join_all();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+}
+
+BOOST_AUTO_TEST_CASE ( test_scalable_gc_sync_many_threads_contention )
+{
+    cerr << "testing contention synchronized scalable GcLock" << endl;
+
+    int nthreads = 8;
+    int nSpinThreads = 16;
+    int nblocks = 2;
+
+    TestBase<ScalableGcLockProxy> test(nthreads, nblocks, nSpinThreads);
+    test.run(boost::bind(
+                    &TestBase<ScalableGcLockProxy>::allocThreadSync, &test, _1));
+}
+
+BOOST_AUTO_TEST_CASE ( test_scalable_gc_deferred_contention )
+{
+    cerr << "testing contended deferred scalable GcLock" << endl;
+
+    int nthreads = 8;
+    int nSpinThreads = 16;
+    int nblocks = 2;
+
+    TestBase<ScalableGcLockProxy> test(nthreads, nblocks, nSpinThreads);
+    test.run(boost::bind(
+                    &TestBase<ScalableGcLockProxy>::allocThreadDefer, &test, _1));
+}
+
+BOOST_AUTO_TEST_CASE ( test_offloaded_reclamation )
+{
+    GcLock gc;
+    gc.offloadReclamation();
+    BOOST_CHECK(gc.isReclamationOffloaded());
+
+    int deferred = 0;
+    auto incr = [] (int * val) { ++*val; };
+
+    // Nothing in a critical section so it's still run straight away
+    gc.defer(+incr, &deferred);
+    BOOST_CHECK_EQUAL(deferred, 1);
+
+    gc.lockShared();
+    gc.defer(+incr, &deferred);
+    gc.defer(+incr, &deferred);
+
+    auto stats = gc.deferStats();
+    BOOST_CHECK_EQUAL(stats.numPending, 2);
+    BOOST_CHECK_EQUAL(stats.numBatches, 1);
+    BOOST_CHECK(stats.bytes > 0);
+
+    // Still visible
+    BOOST_CHECK_EQUAL(gc.reclaim(), 0);
+
+    // Unlocking no longer runs it...
+    gc.unlockShared();
+    BOOST_CHECK_EQUAL(deferred, 1);
+
+    // ... reclaim does
+    BOOST_CHECK_EQUAL(gc.reclaim(), 2);
+    BOOST_CHECK_EQUAL(deferred, 3);
+    BOOST_CHECK_EQUAL(gc.deferStats().numPending, 0);
+}
+
+BOOST_AUTO_TEST_CASE ( test_offloaded_batch_overflow )
+{
+    GcLock gc;
+    gc.offloadReclamation();
+
+    int deferred = 0;
+    auto incr = [] (int * val) { ++*val; };
+
+    gc.lockShared();
+    for (unsigned i = 0;  i < 1000;  ++i)
+        gc.defer(+incr, &deferred);
+    BOOST_CHECK_EQUAL(gc.deferStats().numPending, 1000);
+    gc.unlockShared();
+
+    gc.deferBarrier();
+    BOOST_CHECK_EQUAL(deferred, 1000);
+}
+
+struct OffloadedGcLockProxy : public GcLock {
+    OffloadedGcLockProxy()
+    {
+        startReclaimThread();
+    }
+};
+
+struct OffloadedScalableGcLockProxy : public GcLock {
+    OffloadedScalableGcLockProxy() :
+        GcLock(GC_SCALABLE)
+    {
+        startReclaimThread();
+    }
+};
+
+BOOST_AUTO_TEST_CASE ( test_offloaded_gc_deferred_contention )
+{
+    cerr << "testing contended deferred GcLock with a reclaim thread" << endl;
+
+    int nthreads = 8;
+    int nSpinThreads = 16;
+    int nblocks = 2;
+
+    TestBase<OffloadedGcLockProxy> test(nthreads, nblocks, nSpinThreads);
+    test.run(boost::bind(
+                    &TestBase<OffloadedGcLockProxy>::allocThreadDefer,
+                    &test, _1));
+}
+
+BOOST_AUTO_TEST_CASE ( test_offloaded_scalable_gc_deferred_contention )
+{
+    cerr << "testing contended deferred scalable GcLock with a reclaim thread"
+         << endl;
+
+    int nthreads = 8;
+    int nSpinThreads = 16;
+    int nblocks = 2;
+
+    TestBase<OffloadedScalableGcLockProxy> test(nthreads, nblocks, nSpinThreads);
+    test.run(boost::bind(
+                    &TestBase<OffloadedScalableGcLockProxy>::allocThreadDefer,
+                    &test, _1));
+}
@@ -8,4 +8,7 @@
 
 $(eval $(call test,gc_test,gc,boost))
 $(eval $(call test,rcu_protected_test,gc,boost timed))
+$(eval $(call test,hazard_pointer_test,gc,boost))
 
+$(eval $(call program,gc_lock_bench,gc boost_thread))
+$(eval $(call program,rcu_protected_bench,gc))
@@ -0,0 +1,179 @@
+/* hazard_pointer_test.cc
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+   Tests for the hazard pointers and the RcuProtected that uses them.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "soa/gc/hazard_pointer.h"
+#include "soa/gc/rcu_protected.h"
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <thread>
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+std::atomic<int> numLive(0);
+
+struct Payload {
+    Payload(int value = 0)
+        : value(value), magic(MAGIC)
+    {
+        ++numLive;
+    }
+
+    Payload(const Payload & other)
+        : value(other.value), magic(MAGIC)
+    {
+        ++numLive;
+    }
+
+    ~Payload()
+    {
+        magic = 0;
+        --numLive;
+    }
+
+    enum { MAGIC = 0x1234567 };
+    int value;
+    volatile int magic;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_protect_and_retire )
+{
+    HazardDomain domain(1);   // scan on every retire
+    {
+        Payload * volatile shared = new Payload(1);
+
+        HazardDomain::Hazard hazard(domain);
+        Payload * read = hazard.protect(shared);
+        BOOST_CHECK_EQUAL(read, shared);
+        BOOST_CHECK_EQUAL(domain.stats().numProtected, 1);
+
+        shared = new Payload(2);
+        domain.retireDelete(read);
+
+        // Still protected
+        BOOST_CHECK_EQUAL(read->magic, Payload::MAGIC);
+        BOOST_CHECK_EQUAL(domain.stats().numRetired, 1);
+        BOOST_CHECK_EQUAL(numLive, 2);
+
+        hazard.release();
+        BOOST_CHECK_EQUAL(domain.collect(), 1);
+        BOOST_CHECK_EQUAL(numLive, 1);
+        BOOST_CHECK_EQUAL(domain.stats().numRetired, 0);
+
+        delete shared;
+    }
+    BOOST_CHECK_EQUAL(numLive, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_hazard_limit )
+{
+    HazardDomain domain;
+    std::vector<HazardDomain::Hazard> hazards;
+    for (unsigned i = 0;  i < HazardDomain::SLOTS_PER_THREAD;  ++i)
+        hazards.emplace_back(domain);
+
+    BOOST_CHECK_THROW(HazardDomain::Hazard hazard(domain), ML::Exception);
+
+    // Once one is given back it can be taken again
+    hazards.pop_back();
+    HazardDomain::Hazard hazard(domain);
+}
+
+BOOST_AUTO_TEST_CASE( test_stalled_reader_bounded )
+{
+    HazardDomain domain;
+    RcuProtected<Payload, RcuHazardPolicy> value(domain, 0);
+
+    // The reader holds on to the first value for the whole test
+    auto stalled = value();
+    BOOST_CHECK_EQUAL(stalled->value, 0);
+
+    for (unsigned i = 1;  i <= 10000;  ++i)
+        value.replace(new Payload(i));
+
+    BOOST_CHECK_EQUAL(stalled->magic, Payload::MAGIC);
+    BOOST_CHECK_EQUAL(stalled->value, 0);
+
+    // Only what's under the threshold and what's protected is left
+    BOOST_CHECK_LE(domain.stats().numRetired, 64);
+    BOOST_CHECK_LE(numLive, 66);
+
+    stalled.unlock();
+    domain.collect();
+    BOOST_CHECK_EQUAL(numLive, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_exited_thread_retired_objects )
+{
+    HazardDomain domain(1000);
+    Payload * volatile shared = new Payload(1);
+
+    HazardDomain::Hazard hazard(domain);
+    hazard.protect(shared);
+
+    std::thread([&] () { domain.retireDelete(shared); }).join();
+
+    // Left behind by the thread and still protected
+    BOOST_CHECK_EQUAL(domain.stats().numRetired, 1);
+    BOOST_CHECK_EQUAL(domain.collect(), 0);
+
+    hazard.release();
+    BOOST_CHECK_EQUAL(domain.collect(), 1);
+    BOOST_CHECK_EQUAL(numLive, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_rcu_hazard_concurrent )
+{
+    HazardDomain domain;
+    RcuProtected<Payload, RcuHazardPolicy> value(domain, 0);
+
+    std::atomic<bool> shutdown(false);
+    std::atomic<int> errors(0);
+
+    auto reader = [&] ()
+        {
+            while (!shutdown) {
+                auto current = value();
+                if (current->magic != Payload::MAGIC)
+                    ++errors;
+            }
+        };
+
+    auto writer = [&] ()
+        {
+            while (!shutdown) {
+                auto current = value();
+                std::auto_ptr<Payload> newValue
+                    (new Payload(current->value + 1));
+                value.cmp_xchg(current, newValue);
+                if (current->magic != Payload::MAGIC)
+                    ++errors;
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0;  i < 4;  ++i)
+        threads.emplace_back(reader);
+    for (unsigned i = 0;  i < 2;  ++i)
+        threads.emplace_back(writer);
+
+    ::sleep(1);
+    shutdown = true;
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+    cerr << "value reached " << value()->value << endl;
+}
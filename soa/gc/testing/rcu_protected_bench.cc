@@ -0,0 +1,171 @@
+/* rcu_protected_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Compares the GcLock and hazard pointer policies of RcuProtected: read
+   throughput over a range of thread counts, and the memory held back when
+   one reader stalls while a writer keeps replacing the value.
+
+   Usage: rcu_protected_bench [seconds per run] [max threads]
+*/
+
+#include "soa/gc/rcu_protected.h"
+#include "jml/arch/format.h"
+#include "jml/arch/timers.h"
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+std::atomic<int64_t> numLive(0);
+std::atomic<int64_t> maxLive(0);
+
+/** Value of about a kilobyte, which counts how many of it are alive. */
+struct Payload {
+    Payload(int value = 0)
+        : value(value)
+    {
+        int64_t live = ++numLive;
+        int64_t seen = maxLive;
+        while (live > seen && !maxLive.compare_exchange_weak(seen, live)) ;
+    }
+
+    ~Payload()
+    {
+        --numLive;
+    }
+
+    int value;
+    char data[1020];
+};
+
+struct GcSetup {
+    static const char * name() { return "gclock"; }
+    GcLock lock;
+    RcuProtected<Payload> value { lock, 0 };
+};
+
+struct HazardSetup {
+    static const char * name() { return "hazard"; }
+    HazardDomain domain;
+    RcuProtected<Payload, RcuHazardPolicy> value { domain, 0 };
+};
+
+/** Reads per second with nthreads readers and a writer replacing the value
+    every 10us.
+*/
+template<typename Setup>
+double readThroughput(int nthreads, double seconds)
+{
+    Setup setup;
+    std::atomic<bool> finished(false);
+    std::atomic<uint64_t> total(0);
+
+    auto reader = [&] ()
+        {
+            uint64_t n = 0, sum = 0;
+            while (!finished) {
+                auto current = setup.value();
+                sum += current->value;
+                ++n;
+            }
+            total += n + (sum == 1);   // keep sum alive
+        };
+
+    auto writer = [&] ()
+        {
+            for (int i = 1;  !finished;  ++i) {
+                setup.value.replace(new Payload(i));
+                ML::sleep(0.00001);
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0;  i < nthreads;  ++i)
+        threads.emplace_back(reader);
+    threads.emplace_back(writer);
+
+    ML::sleep(seconds);
+    finished = true;
+    for (auto & t: threads)
+        t.join();
+
+    return total / seconds;
+}
+
+/** Most values alive at once while a reader holds on to the first one and
+    a writer replaces it the given number of times.
+*/
+template<typename Setup>
+int64_t stalledReaderPeak(int replacements)
+{
+    int64_t before = numLive;
+    maxLive = 0;
+
+    Setup setup;
+    std::atomic<bool> finished(false);
+    std::atomic<bool> reading(false);
+    int64_t peak = 0;
+
+    auto stalled = [&] ()
+        {
+            auto current = setup.value();
+            reading = true;
+            while (!finished)
+                ML::sleep(0.001);
+        };
+
+    auto writer = [&] ()
+        {
+            while (!reading) ;
+            for (int i = 1;  i <= replacements;  ++i)
+                setup.value.replace(new Payload(i));
+            peak = maxLive - before;
+            finished = true;
+        };
+
+    std::thread reader(stalled);
+    std::thread write(writer);
+    reader.join();
+    write.join();
+
+    return peak;
+}
+
+} // file scope
+
+int main(int argc, char ** argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    int maxThreads = argc > 2 ? atoi(argv[2])
+        : 2 * std::thread::hardware_concurrency();
+
+    cout << "read throughput (reads per second)" << endl;
+    cout << "threads       gclock       hazard" << endl;
+    for (int nthreads = 1;  nthreads <= maxThreads;  nthreads *= 2) {
+        double gc = readThroughput<GcSetup>(nthreads, seconds);
+        double hazard = readThroughput<HazardSetup>(nthreads, seconds);
+        cout << ML::format("%7d %11.2fM %11.2fM",
+                           nthreads, gc / 1e6, hazard / 1e6)
+             << endl;
+    }
+
+    cout << endl << "stalled reader over 100000 replacements "
+         << "(peak values alive)" << endl;
+    for (auto run: { make_pair(GcSetup::name(), &stalledReaderPeak<GcSetup>),
+                     make_pair(HazardSetup::name(),
+                               &stalledReaderPeak<HazardSetup>) }) {
+        int64_t peak = run.second(100000);
+        cout << ML::format("%s: %lld values, %.2f MB", run.first,
+                           (long long)peak,
+                           peak * sizeof(Payload) / 1048576.0)
+             << endl;
+    }
+}
@@ -19,6 +19,10 @@
 /// Only has effects if JSON_VALUE_USE_INTERNAL_MAP is defined.
 //#  define JSON_USE_SIMPLE_INTERNAL_ALLOCATOR 1
 
+/// If defined, the nodes of the maps of object values are recycled through a
+/// small per-thread cache instead of going back to the heap every time.
+# define JSON_USE_MEMBER_POOL 1
+
 /// If defined, indicates that Json use exception to report invalid type manipulation
 /// instead of C assert macro.
 # define JSON_USE_EXCEPTION 1
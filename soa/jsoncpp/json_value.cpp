@@ -111,6 +111,190 @@ static struct DummyValueAllocatorInitializer {
 } dummyValueAllocatorInitializer;
 
 
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// class InternedKeys
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+
+/** Member names that are found in nearly every bid request, response and
+ * configuration.  The object members with one of these names point to the
+ * single static copy here instead of having their own.
+ */
+static const char * const internedKeyNames[] = {
+   "id", "ext", "w", "h", "imp", "banner", "video", "site", "app", "device",
+   "user", "geo", "bid", "seatbid", "seat", "price", "adm", "adid", "crid",
+   "impid", "nurl", "cur", "bidfloor", "bidfloorcur", "tagid", "pos",
+   "format", "mimes", "battr", "btype", "cat", "bcat", "badv", "domain",
+   "page", "ref", "publisher", "name", "keywords", "ua", "ip", "language",
+   "lat", "lon", "country", "region", "city", "zip", "metro", "type", "os",
+   "osv", "make", "model", "devicetype", "carrier", "js", "dnt", "buyeruid",
+   "yob", "gender", "data", "segment", "value", "tmax", "at", "wseat",
+   "account", "agent", "creative", "creatives", "externalId", "meta",
+   "timestamp", "exchange", "spots", "segments", "augmentations", "tags",
+   "priority", "width", "height", "formats", "url", "version", "provider",
+   "location", "timezone", "userIds", "exchangeId", "providerId"
+};
+
+class InternedKeys
+{
+public:
+   enum { maxLength = 16, tableSize = 256 };
+
+   InternedKeys()
+   {
+      memset( table_, 0, sizeof(table_) );
+      for ( const char *key : internedKeyNames )
+      {
+         unsigned int slot = hash( key, strlen(key) ) % tableSize;
+         while ( table_[slot] )
+            slot = (slot + 1) % tableSize;
+         table_[slot] = key;
+      }
+   }
+
+   /// The interned copy of key, or 0 if it's not one of the common names.
+   const char *find( const char *key ) const
+   {
+      size_t length = 0;
+      while ( key[length] )
+      {
+         if ( ++length > maxLength )
+            return 0;
+      }
+
+      for ( unsigned int slot = hash( key, length ) % tableSize;
+            table_[slot];
+            slot = (slot + 1) % tableSize )
+      {
+         if ( strcmp( table_[slot], key ) == 0 )
+            return table_[slot];
+      }
+      return 0;
+   }
+
+private:
+   static unsigned int hash( const char *key, size_t length )
+   {
+      unsigned int result = 2166136261u;
+      for ( size_t i = 0; i < length; ++i )
+         result = (result ^ (unsigned char)key[i]) * 16777619u;
+      return result;
+   }
+
+   const char *table_[tableSize];
+};
+
+static const InternedKeys &internedKeys()
+{
+   static const InternedKeys keys;
+   return keys;
+}
+
+
+# ifdef JSON_USE_MEMBER_POOL
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// class MemberPool
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+
+namespace {
+
+enum
+{
+   poolGranularity = 16,
+   poolClasses = 16,      // blocks of up to 256 bytes are cached
+   poolMaxFree = 1024     // per class and per thread
+};
+
+/** Released blocks of a thread.  This is plain data, so that it is still
+ * there for the values that are destroyed after the thread's cache was
+ * flushed.
+ */
+struct PoolCache
+{
+   void *free_[poolClasses];
+   unsigned int count_[poolClasses];
+   bool registered_;
+   bool dead_;
+};
+
+thread_local PoolCache poolCache;
+
+struct PoolCacheFlusher
+{
+   ~PoolCacheFlusher()
+   {
+      for ( int i = 0; i < poolClasses; ++i )
+      {
+         while ( void *block = poolCache.free_[i] )
+         {
+            poolCache.free_[i] = *static_cast<void **>( block );
+            ::operator delete( block );
+         }
+         poolCache.count_[i] = 0;
+      }
+      poolCache.dead_ = true;
+   }
+
+   void touch()
+   {
+   }
+};
+
+thread_local PoolCacheFlusher poolCacheFlusher;
+
+} // file scope
+
+namespace MemberPool {
+
+void *allocate( size_t size )
+{
+   size_t index = (size - 1) / poolGranularity;
+   if ( index < poolClasses )
+   {
+      if ( void *block = poolCache.free_[index] )
+      {
+         poolCache.free_[index] = *static_cast<void **>( block );
+         --poolCache.count_[index];
+         return block;
+      }
+      size = (index + 1) * poolGranularity;
+   }
+   return ::operator new( size );
+}
+
+void deallocate( void *block, size_t size )
+{
+   size_t index = (size - 1) / poolGranularity;
+   if ( index >= poolClasses  ||  poolCache.dead_
+        ||  poolCache.count_[index] >= poolMaxFree )
+   {
+      ::operator delete( block );
+      return;
+   }
+
+   if ( !poolCache.registered_ )
+   {
+      // Makes sure that the blocks are released when the thread exits
+      poolCacheFlusher.touch();
+      poolCache.registered_ = true;
+   }
+
+   *static_cast<void **>( block ) = poolCache.free_[index];
+   poolCache.free_[index] = block;
+   ++poolCache.count_[index];
+}
+
+} // namespace MemberPool
+# endif // ifdef JSON_USE_MEMBER_POOL
+
+
 
 // //////////////////////////////////////////////////////////////////
 // //////////////////////////////////////////////////////////////////
@@ -179,19 +363,35 @@ Value::CZString::CZString( int index )
 }
 
 Value::CZString::CZString( const char *cstr, DuplicationPolicy allocate )
-   : cstr_( allocate == duplicate ? valueAllocator()->makeMemberName(cstr)
-                                  : cstr )
+   : cstr_( cstr )
    , index_( allocate )
 {
+   if ( allocate == duplicate )
+      makeOwnCopy();
 }
 
 Value::CZString::CZString( const CZString &other )
-: cstr_( other.index_ != noDuplication &&  other.cstr_ != 0
-                ?  valueAllocator()->makeMemberName( other.cstr_ )
-                : other.cstr_ )
-   , index_( other.cstr_ ? (other.index_ == noDuplication ? noDuplication : duplicate)
-                         : other.index_ )
+: cstr_( other.cstr_ )
+   , index_( other.index_ )
+{
+   if ( cstr_  &&  index_ != noDuplication )
+      makeOwnCopy();
+}
+
+void
+Value::CZString::makeOwnCopy()
 {
+   // The common names are shared as if they were static strings
+   if ( const char *interned = internedKeys().find( cstr_ ) )
+   {
+      cstr_ = interned;
+      index_ = noDuplication;
+   }
+   else
+   {
+      cstr_ = valueAllocator()->makeMemberName( cstr_ );
+      index_ = duplicate;
+   }
 }
 
 Value::CZString::CZString( CZString &&other )
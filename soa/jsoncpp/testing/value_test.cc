@@ -0,0 +1,88 @@
+/* value_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test of the object members of Json::Value, whose common names are
+   interned and whose map nodes go through the member pool.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "soa/jsoncpp/json.h"
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+BOOST_AUTO_TEST_CASE( test_interned_keys )
+{
+    Json::Value x = Json::parse("{\"id\":1,\"ext\":{\"w\":300,\"h\":250},"
+                                "\"someVeryLongUncommonMemberName\":2,"
+                                "\"idx\":3}");
+
+    BOOST_CHECK_EQUAL(x["id"].asInt(), 1);
+    BOOST_CHECK_EQUAL(x["ext"]["w"].asInt(), 300);
+    BOOST_CHECK_EQUAL(x["someVeryLongUncommonMemberName"].asInt(), 2);
+    BOOST_CHECK_EQUAL(x["idx"].asInt(), 3);
+    BOOST_CHECK(!x.isMember("i"));
+
+    // Keys built from a temporary buffer don't depend on it
+    {
+        string key = "ext";
+        string other = "notInterned";
+        x[key] = "replaced";
+        x[other] = 4;
+        key[0] = other[0] = 'X';
+    }
+    BOOST_CHECK_EQUAL(x["ext"].asString(), "replaced");
+    BOOST_CHECK_EQUAL(x["notInterned"].asInt(), 4);
+
+    Json::Value copy = x;
+    x.clear();
+    vector<string> names = copy.getMemberNames();
+    vector<string> expected = { "ext", "id", "idx", "notInterned",
+                                "someVeryLongUncommonMemberName" };
+    BOOST_CHECK_EQUAL_COLLECTIONS(names.begin(), names.end(),
+                                  expected.begin(), expected.end());
+
+    for (auto it = copy.begin(), end = copy.end();  it != end;  ++it)
+        BOOST_CHECK_EQUAL(it.key().asString(), it.memberName());
+
+    BOOST_CHECK_EQUAL(copy.toStringNoNewLine(),
+                      "{\"ext\":\"replaced\",\"id\":1,\"idx\":3,"
+                      "\"notInterned\":4,"
+                      "\"someVeryLongUncommonMemberName\":2}");
+}
+
+BOOST_AUTO_TEST_CASE( test_members_across_threads )
+{
+    // Objects built on one thread and destroyed on others
+    vector<Json::Value> values(1000);
+    for (unsigned i = 0;  i < values.size();  ++i) {
+        values[i]["id"] = i;
+        values[i]["member" + to_string(i)] = i;
+        values[i]["ext"]["nested"] = i;
+    }
+
+    vector<std::thread> threads;
+    for (unsigned t = 0;  t < 4;  ++t) {
+        threads.emplace_back([&, t] {
+                for (unsigned i = t;  i < values.size();  i += 4) {
+                    BOOST_CHECK_EQUAL(values[i]["id"].asUInt(), i);
+                    values[i] = Json::Value();
+
+                    Json::Value local;
+                    for (unsigned j = 0;  j < 10;  ++j)
+                        local["key" + to_string(j)] = j;
+                    BOOST_CHECK_EQUAL(local.size(), 10);
+                }
+            });
+    }
+
+    for (auto & th: threads)
+        th.join();
+
+    for (auto & v: values)
+        BOOST_CHECK(v.isNull());
+}
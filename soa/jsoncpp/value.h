@@ -17,6 +17,7 @@
 
 # ifndef JSON_USE_CPPTL_SMALLMAP
 #  include <map>
+#  include <memory>
 # else
 #  include <cpptl/smallmap.h>
 # endif
@@ -96,6 +97,52 @@ namespace Json {
       const char *str_;
    };
 
+# ifdef JSON_USE_MEMBER_POOL
+   /** \brief Per-thread cache of the blocks of the object member maps.
+    *
+    * The blocks are allocated one by one, so that any thread can release a
+    * block that another one allocated.  Each thread keeps a bounded number
+    * of released blocks of each size for its next allocations.
+    */
+   namespace MemberPool
+   {
+      JSON_API void *allocate( size_t size );
+      JSON_API void deallocate( void *block, size_t size );
+   }
+
+   /** \brief Allocator of the object member maps, on top of MemberPool.
+    */
+   template<typename T>
+   class MemberAllocator : public std::allocator<T>
+   {
+   public:
+      template<typename U>
+      struct rebind
+      {
+         typedef MemberAllocator<U> other;
+      };
+
+      MemberAllocator()
+      {
+      }
+
+      template<typename U>
+      MemberAllocator( const MemberAllocator<U> & )
+      {
+      }
+
+      T *allocate( size_t n, const void * = 0 )
+      {
+         return static_cast<T *>( MemberPool::allocate( n * sizeof(T) ) );
+      }
+
+      void deallocate( T *block, size_t n )
+      {
+         MemberPool::deallocate( block, n * sizeof(T) );
+      }
+   };
+# endif // ifdef JSON_USE_MEMBER_POOL
+
    /** \brief Represents a <a HREF="http://www.json.org">JSON</a> value.
     *
     * This class is a discriminated union wrapper that can represents a:
@@ -169,16 +216,21 @@ namespace Json {
          bool isStaticString() const;
       private:
          void swap( CZString &other );
+         void makeOwnCopy();
          const char *cstr_;
          int index_;
       };
 
    public:
-#  ifndef JSON_USE_CPPTL_SMALLMAP
-      typedef std::map<CZString, Value> ObjectValues;
-#  else
+#  if defined(JSON_USE_CPPTL_SMALLMAP)
       typedef CppTL::SmallMap<CZString, Value> ObjectValues;
-#  endif // ifndef JSON_USE_CPPTL_SMALLMAP
+#  elif defined(JSON_USE_MEMBER_POOL)
+      typedef std::map<CZString, Value, std::less<CZString>,
+                       MemberAllocator<std::pair<const CZString, Value> > >
+         ObjectValues;
+#  else
+      typedef std::map<CZString, Value> ObjectValues;
+#  endif
 # endif // ifndef JSON_VALUE_USE_INTERNAL_MAP
 #endif // ifndef JSONCPP_DOC_EXCLUDE_IMPLEMENTATION
 
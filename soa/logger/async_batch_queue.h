@@ -0,0 +1,194 @@
+/* async_batch_queue.h                                             -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Queue that hands batches of items to a writer thread.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* ASYNC BATCH QUEUE                                                         */
+/*****************************************************************************/
+
+/** Bounded queue of items that are written by a thread of their own, in
+    batches, so that whatever does the writing (a database round trip, for
+    example) is kept off the thread that produces them.
+
+    onBatch is called with up to maxBatchSize of the waiting items once
+    there are that many of them or the oldest one waited maxBatchDelay
+    seconds, whichever comes first.  push() never blocks: past maxQueueSize
+    waiting items the new ones are dropped and counted.  Exceptions thrown by onBatch are
+    printed and counted, and the batch is lost.
+*/
+
+template<typename Item>
+struct AsyncBatchQueue {
+
+    typedef std::function<void (std::vector<Item> & batch)> OnBatch;
+
+    AsyncBatchQueue(OnBatch onBatch,
+                    size_t maxBatchSize = 1000,
+                    double maxBatchDelay = 1.0,
+                    size_t maxQueueSize = 100000)
+        : onBatch(onBatch),
+          maxBatchSize(maxBatchSize), maxBatchDelay(maxBatchDelay),
+          maxQueueSize(maxQueueSize),
+          shutdown(false), numPushed(0), numDone(0), flushWaiters(0),
+          numDropped(0), numErrors(0), numWritten(0)
+    {
+        writer = std::thread([=] () { this->run(); });
+    }
+
+    ~AsyncBatchQueue()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            shutdown = true;
+        }
+        wakeup.notify_all();
+        writer.join();
+    }
+
+    /** Queue the item.  Returns false if it was dropped because the queue
+        is full.
+    */
+    bool push(Item item)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if (queue.size() >= maxQueueSize) {
+            ++numDropped;
+            return false;
+        }
+        if (queue.empty())
+            oldest = std::chrono::steady_clock::now();
+        queue.push_back(std::move(item));
+        ++numPushed;
+        bool full = queue.size() >= maxBatchSize;
+        guard.unlock();
+
+        if (full)
+            wakeup.notify_all();
+        return true;
+    }
+
+    /** Wait until the items pushed so far were written. */
+    void flush()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        uint64_t target = numPushed;
+        ++flushWaiters;
+        wakeup.notify_all();
+        flushed.wait(guard, [&] () { return numDone >= target; });
+        --flushWaiters;
+    }
+
+    /** Items dropped as the queue was full. */
+    uint64_t dropped() const
+    {
+        return numDropped;
+    }
+
+    /** Batches for which onBatch threw. */
+    uint64_t errors() const
+    {
+        return numErrors;
+    }
+
+    /** Items given to onBatch. */
+    uint64_t written() const
+    {
+        return numWritten;
+    }
+
+    const OnBatch onBatch;
+    const size_t maxBatchSize;
+    const double maxBatchDelay;
+    const size_t maxQueueSize;
+
+private:
+    void run()
+    {
+        std::vector<Item> batch;
+        std::unique_lock<std::mutex> guard(lock);
+
+        for (;;) {
+            auto delay = std::chrono::duration_cast
+                <std::chrono::steady_clock::duration>
+                (std::chrono::duration<double>(maxBatchDelay));
+
+            auto ready = [&] ()
+                {
+                    return shutdown
+                        || (flushWaiters > 0 && !queue.empty())
+                        || queue.size() >= maxBatchSize;
+                };
+
+            if (queue.empty())
+                wakeup.wait(guard, ready);
+            else wakeup.wait_until(guard, oldest + delay, ready);
+
+            if (queue.size() <= maxBatchSize)
+                batch.swap(queue);
+            else {
+                auto end = queue.begin() + maxBatchSize;
+                batch.assign(std::make_move_iterator(queue.begin()),
+                             std::make_move_iterator(end));
+                queue.erase(queue.begin(), end);
+                oldest = std::chrono::steady_clock::now();
+            }
+            bool done = shutdown;
+            guard.unlock();
+
+            if (!batch.empty()) {
+                try {
+                    onBatch(batch);
+                    numWritten += batch.size();
+                } catch (const std::exception & exc) {
+                    ++numErrors;
+                    std::cerr << "error writing batch of " << batch.size()
+                              << " items: " << exc.what() << std::endl;
+                }
+            }
+
+            guard.lock();
+            numDone += batch.size();
+            batch.clear();
+            flushed.notify_all();
+
+            if (done && queue.empty())
+                return;
+        }
+    }
+
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::condition_variable flushed;
+    std::vector<Item> queue;
+    std::chrono::steady_clock::time_point oldest;
+    bool shutdown;
+    uint64_t numPushed;       ///< Items queued so far
+    uint64_t numDone;         ///< Items taken off the queue and written
+    int flushWaiters;
+
+    std::atomic<uint64_t> numDropped;
+    std::atomic<uint64_t> numErrors;
+    std::atomic<uint64_t> numWritten;
+
+    std::thread writer;
+};
+
+} // namespace Datacratic
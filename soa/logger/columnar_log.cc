@@ -0,0 +1,854 @@
+/* columnar_log.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Block-columnar binary format for the log messages.
+*/
+
+#include <future>
+#include <set>
+#include <unordered_map>
+
+#include "jml/arch/exception.h"
+#include "jml/utils/exc_assert.h"
+#include "jml/utils/guard.h"
+#include "jml/utils/lz4.h"
+#include "jml/utils/lz4hc.h"
+#include "columnar_log.h"
+#include "file_output.h"
+
+
+using namespace std;
+
+
+namespace Datacratic {
+
+
+namespace {
+
+const char Magic[8] = { 'D', 'C', 'C', 'O', 'L', 'L', 'O', 'G' };
+
+enum ChunkEncoding {
+    PLAIN = 0,    ///< length (or Absent) and bytes of each row
+    DICT = 1      ///< dictionary of the values, then code of each row
+};
+
+const uint32_t Absent = 0xFFFFFFFF;
+
+template<typename T>
+void append(std::string & buffer, T value)
+{
+    buffer.append((const char *)&value, sizeof(value));
+}
+
+void appendString(std::string & buffer, const std::string & value)
+{
+    append<uint32_t>(buffer, value.size());
+    buffer.append(value);
+}
+
+template<typename T>
+T extract(const char * & p, const char * end)
+{
+    if (end - p < sizeof(T))
+        throw ML::Exception("truncated columnar chunk");
+    T result;
+    memcpy(&result, p, sizeof(T));
+    p += sizeof(T);
+    return result;
+}
+
+std::string extractString(const char * & p, const char * end, uint32_t len)
+{
+    if (end - p < len)
+        throw ML::Exception("truncated columnar chunk");
+    std::string result(p, len);
+    p += len;
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COLUMNAR LOG WRITER                                                       */
+/*****************************************************************************/
+
+struct ColumnarLogWriter::Itl {
+
+    struct Column {
+        std::vector<std::string> values;
+        std::vector<bool> present;
+    };
+
+    struct Channel {
+        Channel()
+            : blockRows(0), numRows(0), numFields(0)
+        {
+        }
+
+        std::vector<ColumnarField> fields;
+
+        /// Members of the fields that are structures, by field
+        std::vector<std::set<std::string> > members;
+
+        std::vector<std::string> columnNames;
+        std::map<std::string, size_t> columnIndex;
+        std::vector<Column> columns;
+
+        size_t blockRows;
+        size_t numRows;
+        size_t numFields;
+    };
+
+    Itl(const OnData & onData, int compressionLevel, size_t rowsPerBlock)
+        : onData(onData),
+          compressFn(compressionLevel < 3 ? LZ4_compress : LZ4_compressHC),
+          rowsPerBlock(rowsPerBlock), blocks(Json::arrayValue),
+          offset(0), numMessages(0), finished(false)
+    {
+        ExcAssert(rowsPerBlock > 0);
+    }
+
+    OnData onData;
+    int (*compressFn)(const char *, char *, int);
+    size_t rowsPerBlock;
+
+    std::map<std::string, Channel> channels;
+    Json::Value blocks;
+    uint64_t offset;
+    size_t numMessages;
+    bool finished;
+
+    void addChannel(const std::string & name,
+                    const std::vector<ColumnarField> & fields)
+    {
+        Channel & channel = channels[name];
+        if (channel.numRows)
+            throw ML::Exception("channel %s described after its first "
+                                "message", name.c_str());
+
+        channel.fields = fields;
+        channel.members.clear();
+        channel.members.resize(fields.size());
+        for (unsigned i = 0;  i < fields.size();  ++i) {
+            auto & desc = fields[i].description;
+            if (!desc || desc->kind != ValueKind::STRUCTURE)
+                continue;
+            desc->forEachField(nullptr,
+                               [&] (const ValueDescription::FieldDescription & f)
+                               {
+                                   channel.members[i].insert(f.fieldName);
+                               });
+        }
+    }
+
+    Column & getColumn(Channel & channel, const std::string & name)
+    {
+        auto it = channel.columnIndex.find(name);
+        if (it != channel.columnIndex.end())
+            return channel.columns[it->second];
+
+        channel.columnIndex[name] = channel.columns.size();
+        channel.columnNames.push_back(name);
+        channel.columns.emplace_back();
+        Column & column = channel.columns.back();
+        column.values.resize(channel.blockRows);
+        column.present.resize(channel.blockRows);
+        return column;
+    }
+
+    void set(Channel & channel, const std::string & name, std::string value)
+    {
+        Column & column = getColumn(channel, name);
+        if (column.values.size() == channel.blockRows) {
+            column.values.emplace_back(std::move(value));
+            column.present.push_back(true);
+        }
+        else column.values.back() = std::move(value);
+    }
+
+    void setStructure(Channel & channel, const std::string & name,
+                      const std::set<std::string> & members,
+                      const char * start, const char * end)
+    {
+        // Only objects are split; the reader would complain about the rest
+        const char * p = start;
+        while (p < end && isspace(*p))
+            ++p;
+
+        Json::Value value;
+        Json::Reader reader;
+        if (p == end || *p != '{'
+            || !reader.parse(start, end, value, false)
+            || !value.isObject() || value.empty()) {
+            set(channel, name, std::string(start, end));
+            return;
+        }
+
+        Json::Value others;
+        for (auto & member: value.getMemberNames()) {
+            if (members.count(member))
+                set(channel, name + "." + member,
+                    value[member].toStringNoNewLine());
+            else others[member] = value[member];
+        }
+
+        if (!others.isNull())
+            set(channel, name + ".*", others.toStringNoNewLine());
+    }
+
+    void write(const std::string & name, const std::string & message)
+    {
+        if (finished)
+            throw ML::Exception("write to a finished columnar log");
+
+        Channel & channel = channels[name];
+
+        const char * p = message.c_str();
+        const char * end = p + message.size();
+        for (size_t i = 0;  p <= end;  ++i) {
+            const char * fieldEnd = p;
+            while (fieldEnd < end && *fieldEnd != '\t')
+                ++fieldEnd;
+
+            if (i < channel.fields.size()) {
+                const std::string & fieldName = channel.fields[i].name;
+                if (!channel.members[i].empty())
+                    setStructure(channel, fieldName, channel.members[i],
+                                 p, fieldEnd);
+                else set(channel, fieldName, std::string(p, fieldEnd));
+            }
+            else set(channel, std::to_string(i), std::string(p, fieldEnd));
+
+            channel.numFields = std::max(channel.numFields, i + 1);
+            p = fieldEnd + 1;
+        }
+
+        // Columns not in this message are absent from its row
+        ++channel.blockRows;
+        ++channel.numRows;
+        for (auto & column: channel.columns) {
+            if (column.values.size() < channel.blockRows) {
+                column.values.emplace_back();
+                column.present.push_back(false);
+            }
+        }
+
+        ++numMessages;
+
+        if (channel.blockRows >= rowsPerBlock)
+            writeBlock(name, channel);
+    }
+
+    void output(const char * data, size_t len)
+    {
+        size_t done = 0;
+        while (done < len)
+            done += onData(data + done, len - done);
+        offset += len;
+    }
+
+    void output(const std::string & data)
+    {
+        output(data.data(), data.size());
+    }
+
+    /** Encode the values of a column, with a dictionary if there are at
+        most half as many distinct values as rows.
+    */
+    std::string encode(const Column & column, size_t numRows) const
+    {
+        std::unordered_map<std::string, uint32_t> codes;
+        std::vector<const std::string *> dictionary;
+        std::vector<uint32_t> rows(numRows);
+
+        bool useDictionary = true;
+        for (size_t i = 0;  i < numRows && useDictionary;  ++i) {
+            if (!column.present[i]) {
+                rows[i] = 0;
+                continue;
+            }
+            auto res = codes.insert(make_pair(column.values[i],
+                                              dictionary.size() + 1));
+            if (res.second) {
+                dictionary.push_back(&res.first->first);
+                useDictionary = dictionary.size() <= numRows / 2;
+            }
+            rows[i] = res.first->second;
+        }
+
+        std::string result;
+        if (useDictionary) {
+            append<uint8_t>(result, DICT);
+            append<uint32_t>(result, dictionary.size());
+            for (auto value: dictionary)
+                appendString(result, *value);
+            result.append((const char *)rows.data(),
+                          rows.size() * sizeof(uint32_t));
+        }
+        else {
+            append<uint8_t>(result, PLAIN);
+            for (size_t i = 0;  i < numRows;  ++i) {
+                if (column.present[i])
+                    appendString(result, column.values[i]);
+                else append<uint32_t>(result, Absent);
+            }
+        }
+
+        return result;
+    }
+
+    void writeHeader()
+    {
+        if (offset == 0)
+            output(Magic, sizeof(Magic));
+    }
+
+    void writeBlock(const std::string & name, Channel & channel)
+    {
+        if (!channel.blockRows)
+            return;
+
+        writeHeader();
+
+        Json::Value block;
+        block["channel"] = name;
+        block["rows"] = (Json::UInt)channel.blockRows;
+
+        std::vector<char> compressed;
+        for (unsigned i = 0;  i < channel.columns.size();  ++i) {
+            std::string encoded = encode(channel.columns[i], channel.blockRows);
+
+            compressed.resize(LZ4_compressBound(encoded.size()));
+            int compressedSize = compressFn(encoded.data(), compressed.data(),
+                                            encoded.size());
+
+            // Offset, stored size and encoded size; a chunk is stored raw
+            // when both sizes are equal
+            Json::Value & entry = block["columns"][channel.columnNames[i]];
+            entry.append((Json::UInt)offset);
+            if (compressedSize <= 0 || compressedSize >= encoded.size()) {
+                entry.append((Json::UInt)encoded.size());
+                output(encoded);
+            }
+            else {
+                entry.append((Json::UInt)compressedSize);
+                output(compressed.data(), compressedSize);
+            }
+            entry.append((Json::UInt)encoded.size());
+
+            channel.columns[i] = Column();
+        }
+
+        blocks.append(block);
+        channel.blockRows = 0;
+    }
+
+    void flush()
+    {
+        for (auto & entry: channels)
+            writeBlock(entry.first, entry.second);
+    }
+
+    void finish()
+    {
+        if (finished)
+            return;
+
+        flush();
+        writeHeader();
+
+        Json::Value footer;
+        footer["version"] = 1;
+        footer["blocks"] = blocks;
+        footer["channels"] = Json::Value(Json::objectValue);
+        for (auto & entry: channels) {
+            const Channel & channel = entry.second;
+            Json::Value & out = footer["channels"][entry.first];
+            out["rows"] = (Json::UInt)channel.numRows;
+            out["fields"] = Json::Value(Json::arrayValue);
+            for (size_t i = 0;  i < channel.numFields;  ++i) {
+                Json::Value field;
+                if (i < channel.fields.size()) {
+                    field["name"] = channel.fields[i].name;
+                    if (channel.fields[i].description)
+                        field["type"]
+                            = channel.fields[i].description->typeName;
+                    if (!channel.members[i].empty())
+                        field["structure"] = true;
+                }
+                else field["name"] = std::to_string(i);
+                out["fields"].append(field);
+            }
+            out["columns"] = Json::Value(Json::arrayValue);
+            for (auto & column: channel.columnNames)
+                out["columns"].append(column);
+        }
+
+        uint64_t footerOffset = offset;
+        std::string data = footer.toStringNoNewLine();
+        append<uint64_t>(data, footerOffset);
+        append<uint64_t>(data, data.size() - sizeof(uint64_t));
+        data.append(Magic, sizeof(Magic));
+        output(data);
+
+        finished = true;
+    }
+};
+
+ColumnarLogWriter::
+ColumnarLogWriter(const OnData & onData, int compressionLevel,
+                  size_t rowsPerBlock)
+    : itl(new Itl(onData, compressionLevel, rowsPerBlock))
+{
+}
+
+ColumnarLogWriter::
+~ColumnarLogWriter()
+{
+}
+
+void
+ColumnarLogWriter::
+addChannel(const std::string & channel,
+           const std::vector<ColumnarField> & fields)
+{
+    itl->addChannel(channel, fields);
+}
+
+void
+ColumnarLogWriter::
+write(const std::string & channel, const std::string & message)
+{
+    itl->write(channel, message);
+}
+
+void
+ColumnarLogWriter::
+flush()
+{
+    itl->flush();
+}
+
+void
+ColumnarLogWriter::
+finish()
+{
+    itl->finish();
+}
+
+size_t
+ColumnarLogWriter::
+numMessages() const
+{
+    return itl->numMessages;
+}
+
+size_t
+ColumnarLogWriter::
+numBytes() const
+{
+    return itl->offset;
+}
+
+
+/*****************************************************************************/
+/* COLUMNAR OUTPUT                                                           */
+/*****************************************************************************/
+
+ColumnarOutput::
+ColumnarOutput(size_t ringBufferSize)
+    : WorkerThreadOutput(ringBufferSize)
+{
+}
+
+ColumnarOutput::
+~ColumnarOutput()
+{
+    close();
+}
+
+void
+ColumnarOutput::
+addChannel(const std::string & channel,
+           const std::vector<ColumnarField> & fields)
+{
+    if (writer)
+        throw ML::Exception("ColumnarOutput::addChannel() after open()");
+    channels[channel] = fields;
+}
+
+void
+ColumnarOutput::
+open(const std::string & filename, int compressionLevel, size_t rowsPerBlock)
+{
+    close();
+
+    sink.reset(new FileSink(filename, false /* append */));
+
+    auto onData = std::bind(&CompressingOutput::Sink::write, sink,
+                            std::placeholders::_1, std::placeholders::_2);
+    writer.reset(new ColumnarLogWriter(onData, compressionLevel,
+                                       rowsPerBlock));
+    for (auto & entry: channels)
+        writer->addChannel(entry.first, entry.second);
+
+    startWorkerThread();
+}
+
+void
+ColumnarOutput::
+close()
+{
+    // The worker thread stops without looking at what is left in the ring
+    // buffer, so the footer is written from there, after all the messages
+    if (logThread && writer) {
+        std::promise<void> finished;
+        pushOperation([&] ()
+                      {
+                          ML::Call_Guard guard([&] ()
+                                               { finished.set_value(); });
+                          writer->finish();
+                      });
+        finished.get_future().wait();
+    }
+
+    stopWorkerThread();
+
+    if (writer) {
+        writer->finish();
+        writer.reset();
+    }
+    if (sink) {
+        sink->close();
+        sink.reset();
+    }
+}
+
+Json::Value
+ColumnarOutput::
+stats() const
+{
+    Json::Value result = WorkerThreadOutput::stats();
+    if (writer) {
+        result["messages"] = (Json::UInt)writer->numMessages();
+        result["bytes"] = (Json::UInt)writer->numBytes();
+    }
+    return result;
+}
+
+void
+ColumnarOutput::
+implementLogMessage(const std::string & channel,
+                    const std::string & message)
+{
+    if (!writer)
+        throw ML::Exception("implementLogMessage without open()");
+    writer->write(channel, message);
+}
+
+
+/*****************************************************************************/
+/* COLUMNAR LOG READER                                                       */
+/*****************************************************************************/
+
+/** Decoded values of a column of a block.  Code 0 is an absent value. */
+
+struct ColumnarLogReader::Chunk {
+    std::vector<std::string> dictionary;
+    std::vector<uint32_t> codes;
+
+    const std::string * get(size_t row) const
+    {
+        uint32_t code = codes.empty() ? 0 : codes[row];
+        return code ? &dictionary[code - 1] : nullptr;
+    }
+};
+
+/** A column that is asked for: either a column that is stored, or a field
+    with a structure which is rebuilt from its columns.
+*/
+
+struct ColumnarLogReader::Projection {
+    Projection()
+        : isStructure(false)
+    {
+    }
+
+    std::string name;
+    bool isStructure;
+
+    /// Names of the members with a column, as well as their column
+    std::vector<std::pair<std::string, std::string> > members;
+};
+
+ColumnarLogReader::
+ColumnarLogReader(const std::string & filename)
+    : file(filename)
+{
+    const char * start = file.start();
+    const char * end = file.end();
+    size_t trailerSize = 2 * sizeof(uint64_t) + sizeof(Magic);
+
+    if (file.size() < sizeof(Magic) + trailerSize
+        || memcmp(start, Magic, sizeof(Magic)) != 0
+        || memcmp(end - sizeof(Magic), Magic, sizeof(Magic)) != 0)
+        throw ML::Exception("%s is not a complete columnar log",
+                            filename.c_str());
+
+    const char * p = end - trailerSize;
+    uint64_t footerOffset = extract<uint64_t>(p, end);
+    uint64_t footerLength = extract<uint64_t>(p, end);
+    if (footerOffset + footerLength + trailerSize != file.size())
+        throw ML::Exception("%s has a corrupted columnar log footer",
+                            filename.c_str());
+
+    index = Json::parse(std::string(start + footerOffset, footerLength));
+    if (index["version"].asInt() != 1)
+        throw ML::Exception("unsupported columnar log version %d",
+                            index["version"].asInt());
+}
+
+ColumnarLogReader::
+~ColumnarLogReader()
+{
+}
+
+std::vector<std::string>
+ColumnarLogReader::
+channels() const
+{
+    return index["channels"].getMemberNames();
+}
+
+size_t
+ColumnarLogReader::
+numRows(const std::string & channel) const
+{
+    return index["channels"][channel]["rows"].asUInt();
+}
+
+std::vector<std::string>
+ColumnarLogReader::
+columns(const std::string & channel) const
+{
+    const Json::Value & info = index["channels"][channel];
+
+    std::vector<std::string> result;
+    std::set<std::string> fields;
+    for (auto & field: info["fields"]) {
+        result.push_back(field["name"].asString());
+        fields.insert(field["name"].asString());
+    }
+    for (auto & column: info["columns"]) {
+        if (!fields.count(column.asString()))
+            result.push_back(column.asString());
+    }
+
+    return result;
+}
+
+std::shared_ptr<ColumnarLogReader::Chunk>
+ColumnarLogReader::
+readChunk(const Json::Value & block, const std::string & column) const
+{
+    std::shared_ptr<Chunk> result(new Chunk());
+
+    const Json::Value & entry = block["columns"][column];
+    if (entry.isNull())
+        return result;
+
+    uint64_t offset = entry[0].asUInt();
+    size_t compressedSize = entry[1].asUInt();
+    size_t size = entry[2].asUInt();
+    if (offset + compressedSize > file.size())
+        throw ML::Exception("columnar chunk past the end of the file");
+
+    const char * data = file.start() + offset;
+    std::vector<char> decompressed;
+    if (compressedSize != size) {
+        decompressed.resize(size);
+        int res = LZ4_decompress_safe(data, decompressed.data(),
+                                      compressedSize, size);
+        if (res != size)
+            throw ML::Exception("malformed columnar chunk of %s",
+                                column.c_str());
+        data = decompressed.data();
+    }
+
+    const char * p = data;
+    const char * end = data + size;
+    size_t numRows = block["rows"].asUInt();
+
+    uint8_t encoding = extract<uint8_t>(p, end);
+    if (encoding == DICT) {
+        uint32_t numValues = extract<uint32_t>(p, end);
+        result->dictionary.reserve(numValues);
+        for (unsigned i = 0;  i < numValues;  ++i) {
+            uint32_t len = extract<uint32_t>(p, end);
+            result->dictionary.emplace_back(extractString(p, end, len));
+        }
+        result->codes.resize(numRows);
+        for (size_t i = 0;  i < numRows;  ++i) {
+            result->codes[i] = extract<uint32_t>(p, end);
+            if (result->codes[i] > numValues)
+                throw ML::Exception("invalid columnar dictionary code");
+        }
+    }
+    else if (encoding == PLAIN) {
+        result->codes.resize(numRows);
+        for (size_t i = 0;  i < numRows;  ++i) {
+            uint32_t len = extract<uint32_t>(p, end);
+            if (len == Absent)
+                continue;
+            result->dictionary.emplace_back(extractString(p, end, len));
+            result->codes[i] = result->dictionary.size();
+        }
+    }
+    else throw ML::Exception("unknown columnar chunk encoding %d", encoding);
+
+    return result;
+}
+
+ColumnarLogReader::Projection
+ColumnarLogReader::
+project(const std::string & channel, const std::string & column) const
+{
+    const Json::Value & info = index["channels"][channel];
+
+    Projection result;
+    result.name = column;
+
+    for (auto & field: info["fields"]) {
+        if (field["name"].asString() != column
+            || !field["structure"].asBool())
+            continue;
+
+        result.isStructure = true;
+        std::string prefix = column + ".";
+        for (auto & stored: info["columns"]) {
+            std::string name = stored.asString();
+            if (name.compare(0, prefix.size(), prefix) == 0)
+                result.members.emplace_back(name.substr(prefix.size()), name);
+        }
+    }
+
+    return result;
+}
+
+bool
+ColumnarLogReader::
+forEachRow(const std::string & channel,
+           const std::vector<std::string> & columns,
+           const OnRow & onRow) const
+{
+    std::vector<Projection> projections;
+    for (auto & column: columns)
+        projections.push_back(project(channel, column));
+
+    for (auto & block: index["blocks"]) {
+        if (block["channel"].asString() != channel)
+            continue;
+        if (!forEachRowOfBlock(block, projections, onRow))
+            return false;
+    }
+
+    return true;
+}
+
+bool
+ColumnarLogReader::
+forEachRowOfBlock(const Json::Value & block,
+                  const std::vector<Projection> & projections,
+                  const OnRow & onRow) const
+{
+    struct Loaded {
+        std::shared_ptr<Chunk> raw;
+        std::vector<std::shared_ptr<Chunk> > members;
+        std::string rebuilt;
+    };
+
+    std::vector<Loaded> loaded(projections.size());
+    for (unsigned i = 0;  i < projections.size();  ++i) {
+        auto & projection = projections[i];
+        loaded[i].raw = readChunk(block, projection.name);
+        for (auto & member: projection.members)
+            loaded[i].members.push_back(readChunk(block, member.second));
+    }
+
+    std::vector<const std::string *> values(projections.size());
+    size_t numRows = block["rows"].asUInt();
+    for (size_t row = 0;  row < numRows;  ++row) {
+        for (unsigned i = 0;  i < projections.size();  ++i) {
+            auto & projection = projections[i];
+            values[i] = loaded[i].raw->get(row);
+            if (values[i] || !projection.isStructure)
+                continue;
+
+            Json::Value value;
+            for (unsigned j = 0;  j < projection.members.size();  ++j) {
+                const std::string * member = loaded[i].members[j]->get(row);
+                if (!member)
+                    continue;
+                Json::Value memberValue = Json::parse(*member);
+                if (projection.members[j].first != "*")
+                    value[projection.members[j].first] = memberValue;
+                else {
+                    for (auto & name: memberValue.getMemberNames())
+                        value[name] = memberValue[name];
+                }
+            }
+
+            if (!value.isNull()) {
+                loaded[i].rebuilt = value.toStringNoNewLine();
+                values[i] = &loaded[i].rebuilt;
+            }
+        }
+
+        if (!onRow(values))
+            return false;
+    }
+
+    return true;
+}
+
+bool
+ColumnarLogReader::
+forEachMessage(const OnMessage & onMessage) const
+{
+    std::map<std::string, std::vector<Projection> > channelProjections;
+    for (auto & channel: channels()) {
+        auto & projections = channelProjections[channel];
+        for (auto & field: index["channels"][channel]["fields"])
+            projections.push_back(project(channel, field["name"].asString()));
+    }
+
+    for (auto & block: index["blocks"]) {
+        std::string channel = block["channel"].asString();
+        std::string message;
+
+        auto onRow = [&] (const std::vector<const std::string *> & values)
+            {
+                // Trailing absent fields weren't in the message
+                size_t numFields = values.size();
+                while (numFields > 0 && !values[numFields - 1])
+                    --numFields;
+
+                message.clear();
+                for (size_t i = 0;  i < numFields;  ++i) {
+                    if (i > 0)
+                        message.push_back('\t');
+                    if (values[i])
+                        message.append(*values[i]);
+                }
+                return onMessage(channel, message);
+            };
+
+        if (!forEachRowOfBlock(block, channelProjections[channel], onRow))
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace Datacratic
@@ -0,0 +1,224 @@
+/* columnar_log.h                                                  -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Block-columnar binary format for the log messages, with an output for
+   the logger and a reader that projects columns.
+*/
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "jml/utils/file_functions.h"
+#include "soa/jsoncpp/json.h"
+#include "soa/types/value_description.h"
+#include "compressing_output.h"
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* COLUMNAR FIELD                                                            */
+/*****************************************************************************/
+
+/** Description of one of the tab separated fields of the messages of a
+    channel.
+
+    A field with the description of a structure holds the JSON of such a
+    structure (a bid request, for example).  Each member that the
+    description knows about is stored as JSON in a column of its own,
+    named "<field>.<member>", so that it can be read without parsing the
+    rest;
+    the other members go to the "<field>.*" column, and values that aren't
+    JSON objects are stored whole in the "<field>" column.
+*/
+
+struct ColumnarField {
+    ColumnarField(const std::string & name = "",
+                  std::shared_ptr<const ValueDescription> description
+                      = nullptr)
+        : name(name), description(description)
+    {
+    }
+
+    std::string name;
+    std::shared_ptr<const ValueDescription> description;
+};
+
+
+/*****************************************************************************/
+/* COLUMNAR LOG WRITER                                                       */
+/*****************************************************************************/
+
+/** Writes log messages in a block-columnar binary format.
+
+    The messages of each channel are split into their fields and
+    accumulated by column.  Once a channel has rowsPerBlock messages, each
+    of its columns is encoded on its own, with a dictionary when its values
+    repeat enough, and compressed with LZ4 (HC from level 3).  A footer
+    indexes the blocks and the offsets of their columns.
+
+    Layout of a file:
+
+        magic                  8 bytes, "DCCOLLOG"
+        column chunks
+        footer                 JSON index of the channels and blocks
+        footer offset          uint64
+        footer length          uint64
+        magic                  8 bytes
+
+    Fields of channels without a description, or past the end of their
+    description, are named after their position in the message.
+*/
+
+struct ColumnarLogWriter {
+
+    typedef std::function<size_t (const char * data, size_t len)> OnData;
+
+    ColumnarLogWriter(const OnData & onData,
+                      int compressionLevel = 0,
+                      size_t rowsPerBlock = 65536);
+
+    /** Doesn't write the pending messages; finish() must be called for the
+        file to be readable.
+    */
+    ~ColumnarLogWriter();
+
+    /** Describe the fields of the messages of the given channel.  Must be
+        called before the first message of the channel.
+    */
+    void addChannel(const std::string & channel,
+                    const std::vector<ColumnarField> & fields);
+
+    void write(const std::string & channel, const std::string & message);
+
+    /** Write out the pending messages of all channels as blocks. */
+    void flush();
+
+    /** Write out the pending messages and the footer.  Nothing can be
+        written afterwards.
+    */
+    void finish();
+
+    /** Number of messages and bytes written so far. */
+    size_t numMessages() const;
+    size_t numBytes() const;
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+
+/*****************************************************************************/
+/* COLUMNAR OUTPUT                                                           */
+/*****************************************************************************/
+
+/** LogOutput that writes its messages to a file in the columnar format.
+    The encoding and compression are done in a separate thread.
+*/
+
+struct ColumnarOutput : public WorkerThreadOutput {
+
+    ColumnarOutput(size_t ringBufferSize = 65536);
+
+    virtual ~ColumnarOutput();
+
+    /** See ColumnarLogWriter::addChannel().  Must be called before
+        open().
+    */
+    void addChannel(const std::string & channel,
+                    const std::vector<ColumnarField> & fields);
+
+    void open(const std::string & filename,
+              int compressionLevel = 0,
+              size_t rowsPerBlock = 65536);
+
+    /** Write out the pending messages and the footer, and close the
+        file.
+    */
+    virtual void close();
+
+    virtual Json::Value stats() const;
+
+protected:
+    virtual void implementLogMessage(const std::string & channel,
+                                     const std::string & message);
+
+private:
+    std::map<std::string, std::vector<ColumnarField> > channels;
+    std::shared_ptr<CompressingOutput::Sink> sink;
+    std::unique_ptr<ColumnarLogWriter> writer;
+};
+
+
+/*****************************************************************************/
+/* COLUMNAR LOG READER                                                       */
+/*****************************************************************************/
+
+/** Reads a file written by ColumnarLogWriter.  Only the chunks of the
+    columns that are asked for are decompressed and decoded.
+*/
+
+struct ColumnarLogReader {
+
+    ColumnarLogReader(const std::string & filename);
+
+    ~ColumnarLogReader();
+
+    std::vector<std::string> channels() const;
+
+    size_t numRows(const std::string & channel) const;
+
+    /** Names of the fields of the messages of the channel, followed by
+        those of the columns of the members of their structures.
+    */
+    std::vector<std::string> columns(const std::string & channel) const;
+
+    /** Values of a row, in the order of the columns that were asked for.
+        Absent values are null; the pointers are only valid during the
+        call.
+    */
+    typedef std::function<bool (const std::vector<const std::string *> &)>
+        OnRow;
+
+    /** Call onRow for each message of the channel, in the order in which
+        they were logged, until it returns false.  A field with a structure
+        is rebuilt from the columns of its members.  Returns false if onRow
+        did.
+    */
+    bool forEachRow(const std::string & channel,
+                    const std::vector<std::string> & columns,
+                    const OnRow & onRow) const;
+
+    typedef std::function<bool (const std::string & channel,
+                                const std::string & message)> OnMessage;
+
+    /** Call onMessage for each message, rebuilt from all of its fields, in
+        the order of the blocks of the file.  The messages of each channel
+        come in the order in which they were logged.
+    */
+    bool forEachMessage(const OnMessage & onMessage) const;
+
+private:
+    ML::File_Read_Buffer file;
+    Json::Value index;
+
+    struct Chunk;
+    struct Projection;
+
+    std::shared_ptr<Chunk> readChunk(const Json::Value & block,
+                                     const std::string & column) const;
+    bool forEachRowOfBlock(const Json::Value & block,
+                           const std::vector<Projection> & projections,
+                           const OnRow & onRow) const;
+    Projection project(const std::string & channel,
+                       const std::string & column) const;
+};
+
+} // namespace Datacratic
@@ -187,6 +187,7 @@ CompressingOutput::
 CompressingOutput(size_t ringBufferSize,
                   Compressor::FlushLevel flushLevel)
     : WorkerThreadOutput(ringBufferSize),
+      compressionThreads(1),
       compressorFlushLevel(flushLevel)
 {
 }
@@ -205,7 +206,8 @@ open(std::shared_ptr<Sink> sink,
     if (compressor)
         throw ML::Exception("can't open compressor without closing the "
                             "previous one");
-    compressor.reset(Compressor::create(compression, compressionLevel));
+    compressor.reset(Compressor::create(compression, compressionLevel,
+                                        compressionThreads));
 
     this->sink = sink;
 
@@ -132,6 +132,11 @@ struct CompressingOutput : public WorkerThreadOutput {
 
     boost::function<void (std::string, std::size_t)> onFileWrite;
 
+    /** Number of threads used by the compressors that can work in parallel
+        (lz4).  Taken into account by the next call to open().
+    */
+    int compressionThreads;
+
 protected:
     Compressor::FlushLevel compressorFlushLevel;
     std::shared_ptr<Sink> sink;
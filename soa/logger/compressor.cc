@@ -7,8 +7,13 @@
 
 #include "compressor.h"
 #include "jml/utils/exc_assert.h"
+#include "jml/utils/lz4_filter.h"
 #include <zlib.h>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 using namespace std;
 
@@ -45,16 +50,21 @@ filenameToCompression(const std::string & filename)
         return "bzip2";
     if (ends_with(filename, ".xz") || ends_with(filename, ".xz~"))
         return "lzma";
+    if (ends_with(filename, ".lz4") || ends_with(filename, ".lz4~"))
+        return "lz4";
     return "none";
 }
 
 Compressor *
 Compressor::
 create(const std::string & compression,
-       int level)
+       int level,
+       int numThreads)
 {
     if (compression == "gzip" || compression == "gz")
         return new GzipCompressor(level);
+    else if (compression == "lz4")
+        return new Lz4Compressor(level, numThreads);
     else if (compression == "" || compression == "none")
         return new NullCompressor();
     else throw ML::Exception("unknown compression %s:%d", compression.c_str(),
@@ -242,6 +252,268 @@ finish(const OnData & onData)
 }
 
 
+/*****************************************************************************/
+/* LZ4 COMPRESSOR                                                            */
+/*****************************************************************************/
+
+struct Lz4Compressor::Itl {
+
+    Itl(int level, int numThreads, int blockSizeId)
+        : head(blockSizeId, true /* blockIndependence */,
+               true /* blockChecksum */, false /* streamChecksum */),
+          headerWritten(false),
+          compressFn(level < 3 ? LZ4_compress : LZ4_compressHC),
+          blockSize(head.blockSize()),
+          shutdown(false)
+    {
+        current.reserve(blockSize);
+
+        if (numThreads > 1) {
+            for (int i = 0;  i < numThreads;  ++i)
+                workers.emplace_back([=] () { this->runWorker(); });
+        }
+    }
+
+    ~Itl()
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            shutdown = true;
+        }
+        workAvailable.notify_all();
+
+        for (auto & worker: workers)
+            worker.join();
+    }
+
+    /** A block that is compressed by one of the workers. */
+    struct Block {
+        Block()
+            : done(false)
+        {
+        }
+
+        std::vector<char> input;
+        std::vector<char> output;
+        bool done;
+    };
+
+    size_t compress(const char * data, size_t len, const OnData & onData)
+    {
+        size_t result = 0;
+
+        while (len > 0) {
+            size_t toCopy = std::min(len, blockSize - current.size());
+            current.insert(current.end(), data, data + toCopy);
+            data += toCopy;
+            len -= toCopy;
+
+            if (current.size() == blockSize)
+                result += endBlock(onData);
+        }
+
+        return result;
+    }
+
+    size_t flush(FlushLevel flushLevel, const OnData & onData)
+    {
+        if (flushLevel == FLUSH_NONE)
+            return 0;
+
+        // Blocks are independent, so any flush level is a restart point
+        size_t result = endBlock(onData);
+        return result + writeDone(onData, 0);
+    }
+
+    size_t finish(const OnData & onData)
+    {
+        size_t result = endBlock(onData);
+        result += writeDone(onData, 0);
+
+        const uint32_t eos = 0;
+        return result + write((const char *)&eos, sizeof(eos), onData);
+    }
+
+private:
+    ML::lz4::Header head;
+    bool headerWritten;
+    int (*compressFn)(const char *, char *, int);
+    size_t blockSize;
+
+    /// Block being filled
+    std::vector<char> current;
+
+    /// Blocks given to the workers, in the order of the stream
+    std::deque<std::shared_ptr<Block> > inFlight;
+
+    std::mutex lock;
+    std::condition_variable workAvailable;
+    std::condition_variable blockDone;
+    std::deque<std::shared_ptr<Block> > todo;
+    bool shutdown;
+    std::vector<std::thread> workers;
+
+    /** Encode the given data as a block of the frame into output: its size,
+        its compressed contents (or the raw ones when they don't compress)
+        and their checksum.
+    */
+    void encode(const std::vector<char> & input,
+                std::vector<char> & output) const
+    {
+        size_t len = input.size();
+        output.resize(2 * sizeof(uint32_t) + LZ4_compressBound(len));
+        char * data = output.data() + sizeof(uint32_t);
+
+        int compressedSize = compressFn(input.data(), data, len);
+
+        uint32_t size = compressedSize;
+        if (compressedSize <= 0 || compressedSize >= len) {
+            std::memcpy(data, input.data(), len);
+            compressedSize = len;
+            size = len | ML::lz4::NotCompressedMask;
+        }
+
+        uint32_t checksum = XXH32(data, compressedSize, ML::lz4::ChecksumSeed);
+        std::memcpy(output.data(), &size, sizeof(size));
+        std::memcpy(data + compressedSize, &checksum, sizeof(checksum));
+        output.resize(2 * sizeof(uint32_t) + compressedSize);
+    }
+
+    /** Close the current block, and either write it out or hand it over to
+        the workers.
+    */
+    size_t endBlock(const OnData & onData)
+    {
+        if (current.empty())
+            return 0;
+
+        if (workers.empty()) {
+            std::vector<char> output;
+            encode(current, output);
+            current.clear();
+            return write(output.data(), output.size(), onData);
+        }
+
+        std::shared_ptr<Block> block(new Block());
+        block->input.swap(current);
+        current.reserve(blockSize);
+        inFlight.push_back(block);
+
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            todo.push_back(block);
+        }
+        workAvailable.notify_one();
+
+        // Bound the memory used when the workers fall behind
+        return writeDone(onData, 2 * workers.size());
+    }
+
+    /** Write out the blocks that are done at the head of the stream,
+        waiting for those that aren't until at most maxInFlight are left.
+    */
+    size_t writeDone(const OnData & onData, size_t maxInFlight)
+    {
+        size_t result = 0;
+
+        while (!inFlight.empty()) {
+            const std::shared_ptr<Block> & block = inFlight.front();
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                if (!block->done) {
+                    if (inFlight.size() <= maxInFlight)
+                        break;
+                    blockDone.wait(guard, [&] () { return block->done; });
+                }
+            }
+
+            result += write(block->output.data(), block->output.size(),
+                            onData);
+            inFlight.pop_front();
+        }
+
+        return result;
+    }
+
+    size_t write(const char * data, size_t len, const OnData & onData)
+    {
+        size_t result = 0;
+        if (!headerWritten) {
+            headerWritten = true;
+            result += write((const char *)&head, sizeof(head), onData);
+        }
+
+        size_t done = 0;
+        while (done < len)
+            done += onData(data + done, len - done);
+
+        return result + done;
+    }
+
+    void runWorker()
+    {
+        for (;;) {
+            std::shared_ptr<Block> block;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                workAvailable.wait(guard, [&] ()
+                                   { return shutdown || !todo.empty(); });
+                if (todo.empty())
+                    return;
+                block = todo.front();
+                todo.pop_front();
+            }
+
+            encode(block->input, block->output);
+            block->input = std::vector<char>();
+
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                block->done = true;
+            }
+            blockDone.notify_all();
+        }
+    }
+};
+
+Lz4Compressor::
+Lz4Compressor(int level, int numThreads, int blockSizeId)
+{
+    if (blockSizeId < 4 || blockSizeId > 7)
+        throw ML::Exception("invalid lz4 block size id %d", blockSizeId);
+    if (numThreads < 1)
+        throw ML::Exception("invalid number of lz4 threads %d", numThreads);
+
+    itl.reset(new Itl(level, numThreads, blockSizeId));
+}
+
+Lz4Compressor::
+~Lz4Compressor()
+{
+}
+
+size_t
+Lz4Compressor::
+compress(const char * data, size_t len, const OnData & onData)
+{
+    return itl->compress(data, len, onData);
+}
+    
+size_t
+Lz4Compressor::
+flush(FlushLevel flushLevel, const OnData & onData)
+{
+    return itl->flush(flushLevel, onData);
+}
+
+size_t
+Lz4Compressor::
+finish(const OnData & onData)
+{
+    return itl->finish(onData);
+}
+
+
 /*****************************************************************************/
 /* LZMA COMPRESSOR                                                           */
 /*****************************************************************************/
@@ -65,9 +65,12 @@ struct Compressor {
     /** Convert a filename to a compression scheme. */
     static std::string filenameToCompression(const std::string & filename);
 
-    /** Create a compressor with the given scheme. */
+    /** Create a compressor with the given scheme.  The number of threads
+        is only used by the schemes that can compress in parallel (lz4).
+    */
     static Compressor * create(const std::string & compression,
-                               int level);
+                               int level,
+                               int numThreads = 1);
 };
 
 
@@ -135,6 +138,40 @@ private:
     std::unique_ptr<Itl> itl;
 };
 
+/*****************************************************************************/
+/* LZ4 COMPRESSOR                                                            */
+/*****************************************************************************/
+
+/** Compressor that writes the lz4 frame format with independent blocks, as
+    read by the lz4_decompressor of filter_istream.  A level of 3 or more
+    selects LZ4 HC.
+
+    With more than one thread, full blocks are compressed by a pool of
+    threads while the next ones are filled, and written out in order as
+    they are done.  Each flush below FLUSH_NONE closes the current block
+    and waits for all of those in flight, so the parallelism is only
+    obtained when the flushes are infrequent.
+*/
+
+struct Lz4Compressor : public Compressor {
+
+    /** The block size id goes from 4 (64kb blocks) to 7 (4mb blocks). */
+    Lz4Compressor(int level, int numThreads = 1, int blockSizeId = 7);
+
+    virtual ~Lz4Compressor();
+
+    virtual size_t compress(const char * data, size_t len,
+                            const OnData & onData);
+    
+    virtual size_t flush(FlushLevel flushLevel, const OnData & onData);
+
+    virtual size_t finish(const OnData & onData);
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
 } // namespace Datacratic
 
 #endif /* __logger__compressor_h__ */
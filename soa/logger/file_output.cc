@@ -6,7 +6,14 @@
 
 #include "file_output.h"
 #include "jml/utils/parse_context.h"
+#include "jml/utils/guard.h"
 #include <boost/tuple/tuple.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #define BOOST_SYSTEM_NO_DEPRECATED
 
@@ -257,13 +264,320 @@ flush(FileFlushLevel flushLevel)
 }
 
 
+/*****************************************************************************/
+/* ASYNC FILE SINK                                                           */
+/*****************************************************************************/
+
+struct AsyncFileSink::Itl {
+
+    struct Buffer {
+        char * data;
+        size_t size;
+    };
+
+    Itl(const Options & options)
+        : options(options), pageSize(getpagesize()),
+          pending(false), shutdown(false), offset(0), allocated(0)
+    {
+        bufferSize = std::max<size_t>(options.bufferSize + pageSize - 1,
+                                      pageSize);
+        bufferSize -= bufferSize % pageSize;
+
+        for (Buffer * buffer: { &filling, &writing }) {
+            void * mem;
+            if (posix_memalign(&mem, pageSize, bufferSize))
+                throw ML::Exception("couldn't allocate AsyncFileSink buffer");
+            buffer->data = (char *)mem;
+            buffer->size = 0;
+        }
+    }
+
+    ~Itl()
+    {
+        try {
+            close();
+        } catch (const std::exception & exc) {
+            cerr << "warning: AsyncFileSink close threw: " << exc.what()
+                 << endl;
+        }
+
+        free(filling.data);
+        free(writing.data);
+    }
+
+    Options options;
+    size_t pageSize;
+    size_t bufferSize;
+
+    /// Opens and names the file, and owns its descriptor
+    FileSink file;
+
+    /// Buffer being filled by write()
+    Buffer filling;
+
+    /// Buffer given to the I/O thread when pending is set
+    Buffer writing;
+
+    std::mutex lock;
+    std::condition_variable cond;
+    bool pending;
+    bool shutdown;
+    std::exception_ptr error;
+
+    /// Bytes written and preallocated so far; only touched by the thread
+    /// that writes: the I/O thread while it is running
+    uint64_t offset;
+    uint64_t allocated;
+
+    std::thread ioThread;
+
+    void open(const std::string & filename, bool append)
+    {
+        close();
+
+        file.open(filename, append, true /* disambiguate */);
+
+        if (options.direct) {
+            int flags = fcntl(file.fd, F_GETFL);
+            if (flags == -1 || fcntl(file.fd, F_SETFL, flags | O_DIRECT) == -1)
+                throw ML::Exception(errno, "O_DIRECT for " + file.currentUri);
+        }
+
+        filling.size = writing.size = 0;
+        offset = allocated = 0;
+        pending = shutdown = false;
+        error = nullptr;
+
+        ioThread = std::thread([=] () { this->runIoThread(); });
+    }
+
+    void close()
+    {
+        if (!ioThread.joinable())
+            return;
+
+        ML::Call_Guard guard([&] () { this->stopIoThread(); });
+        size_t len = writableSize();
+        if (len)
+            handOff(len);
+        waitUntilIdle();
+        guard.clear();
+        stopIoThread();
+
+        // What is left is less than a page, which O_DIRECT can't write
+        if (filling.size) {
+            if (options.direct) {
+                int flags = fcntl(file.fd, F_GETFL);
+                if (flags == -1
+                    || fcntl(file.fd, F_SETFL, flags & ~O_DIRECT) == -1)
+                    throw ML::Exception(errno, "O_DIRECT for "
+                                        + file.currentUri);
+            }
+            writeAll(filling.data, filling.size);
+            filling.size = 0;
+        }
+
+        // Give back what was preallocated past the end
+        if (allocated > offset && ftruncate(file.fd, offset) == -1)
+            throw ML::Exception(errno, "ftruncate " + file.currentUri);
+
+        file.close();
+    }
+
+    size_t write(const char * data, size_t size)
+    {
+        size_t done = 0;
+        while (done < size) {
+            size_t toCopy = std::min(size - done, bufferSize - filling.size);
+            memcpy(filling.data + filling.size, data + done, toCopy);
+            filling.size += toCopy;
+            done += toCopy;
+
+            if (filling.size == bufferSize)
+                handOff(bufferSize);
+        }
+
+        return done;
+    }
+
+    size_t flush(FileFlushLevel flushLevel)
+    {
+        if (flushLevel == FLUSH_NONE)
+            return 0;
+
+        size_t len = writableSize();
+        if (len)
+            handOff(len);
+        waitUntilIdle();
+
+        if (flushLevel == FLUSH_TO_DISK)
+            file.flush(FLUSH_TO_DISK);
+
+        return 0;
+    }
+
+    /** Bytes of the buffer being filled that can be written now. */
+    size_t writableSize() const
+    {
+        if (options.direct)
+            return filling.size - filling.size % pageSize;
+        return filling.size;
+    }
+
+    /** Give the first len bytes of the buffer being filled to the I/O
+        thread, once it is done with the previous ones.  The rest is carried
+        over to the other buffer.
+    */
+    void handOff(size_t len)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        cond.wait(guard, [&] () { return !pending; });
+        checkError();
+
+        std::swap(filling, writing);
+        filling.size = writing.size - len;
+        memcpy(filling.data, writing.data + len, filling.size);
+        writing.size = len;
+
+        pending = true;
+        cond.notify_all();
+    }
+
+    void waitUntilIdle()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        cond.wait(guard, [&] () { return !pending; });
+        checkError();
+    }
+
+    void checkError()
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    void stopIoThread()
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            shutdown = true;
+        }
+        cond.notify_all();
+        ioThread.join();
+    }
+
+    void runIoThread()
+    {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                cond.wait(guard, [&] () { return pending || shutdown; });
+                if (!pending)
+                    return;
+            }
+
+            try {
+                preallocate(writing.size);
+                writeAll(writing.data, writing.size);
+            } catch (...) {
+                std::unique_lock<std::mutex> guard(lock);
+                error = std::current_exception();
+            }
+
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                pending = false;
+            }
+            cond.notify_all();
+        }
+    }
+
+    void preallocate(size_t len)
+    {
+        if (!options.preallocate || offset + len <= allocated)
+            return;
+
+        uint64_t start = std::max(offset, allocated);
+        uint64_t size = std::max<uint64_t>(options.preallocate, len);
+        if (fallocate(file.fd, FALLOC_FL_KEEP_SIZE, start, size) == -1) {
+            if (errno != EOPNOTSUPP && errno != ENOSYS)
+                throw ML::Exception(errno, "fallocate " + file.currentUri);
+            // Not supported by the filesystem; do without
+            options.preallocate = 0;
+            return;
+        }
+        allocated = start + size;
+    }
+
+    void writeAll(const char * data, size_t size)
+    {
+        size_t done = 0;
+        while (done < size) {
+            ssize_t res = ::write(file.fd, data + done, size - done);
+            if (res == -1) {
+                if (errno == EINTR)
+                    continue;
+                throw ML::Exception(errno, "write to AsyncFileSink for "
+                                    + file.currentUri);
+            }
+            done += res;
+        }
+        offset += size;
+    }
+};
+
+AsyncFileSink::
+AsyncFileSink(const std::string & filename, bool append,
+              const Options & options)
+    : itl(new Itl(options))
+{
+    if (filename != "")
+        open(filename, append);
+}
+
+AsyncFileSink::
+~AsyncFileSink()
+{
+}
+
+void
+AsyncFileSink::
+open(const std::string & filename, bool append)
+{
+    itl->open(filename, append);
+    currentUri = itl->file.currentUri;
+}
+
+void
+AsyncFileSink::
+close()
+{
+    itl->close();
+    currentUri = "";
+}
+
+size_t
+AsyncFileSink::
+write(const char * data, size_t size)
+{
+    return itl->write(data, size);
+}
+
+size_t
+AsyncFileSink::
+flush(FileFlushLevel flushLevel)
+{
+    return itl->flush(flushLevel);
+}
+
+
 /*****************************************************************************/
 /* FILE OUTPUT                                                               */
 /*****************************************************************************/
 
 FileOutput::
 FileOutput(const std::string & filename, size_t ringBufferSize)
-    : NamedOutput(ringBufferSize)
+    : NamedOutput(ringBufferSize), asyncSink(false)
 {
     if (filename != "")
         open(filename);
@@ -279,6 +593,9 @@ std::shared_ptr<CompressingOutput::Sink>
 FileOutput::
 createSink(const std::string & filename, bool append)
 {
+    if (asyncSink)
+        return std::make_shared<AsyncFileSink>(filename, append,
+                                               asyncSinkOptions);
     return std::make_shared<FileSink>(filename, append);
 }
 
@@ -291,7 +608,8 @@ RotatingFileOutput::
 RotatingFileOutput()
     : RotatingOutputAdaptor(std::bind(&RotatingFileOutput::createFile,
                                       this,
-                                      std::placeholders::_1))
+                                      std::placeholders::_1)),
+      compressionThreads(1), asyncSink(false)
 {
 }
 
@@ -331,6 +649,9 @@ createFile(const std::string & filename)
     result->onFileWrite = [=] (const string& channel, const std::size_t bytes)
 	{ if (this->onFileWrite) this->onFileWrite(channel, bytes); };
 
+    result->compressionThreads = compressionThreads;
+    result->asyncSink = asyncSink;
+    result->asyncSinkOptions = asyncSinkOptions;
     result->open(filename, compression, level);
 
     return result.release();
@@ -96,6 +96,55 @@ struct FileSink : public CompressingOutput::Sink {
 };
 
 
+/*****************************************************************************/
+/* ASYNC FILE SINK                                                           */
+/*****************************************************************************/
+
+/** Sink that writes to a file from a thread of its own.
+
+    The data is copied into one of two large buffers; once it is full, the
+    I/O thread writes it out while the other one is filled, so that the
+    compressing thread only waits when the disk can't keep up.  The file is
+    preallocated with fallocate() ahead of the writes, and can be written
+    with O_DIRECT to keep the logs out of the page cache.
+
+    With O_DIRECT, only whole pages can be written until the file is
+    closed, so a flush leaves the end of a partial page in the buffer.
+*/
+
+struct AsyncFileSink : public CompressingOutput::Sink {
+
+    struct Options {
+        Options()
+            : bufferSize(1 << 20), preallocate(64 << 20), direct(false)
+        {
+        }
+
+        size_t bufferSize;   ///< Size of each buffer; rounded to pages
+        size_t preallocate;  ///< Bytes to preallocate at once; 0 for none
+        bool direct;         ///< Bypass the page cache with O_DIRECT
+    };
+
+    AsyncFileSink(const std::string & filename = "",
+                  bool append = true,
+                  const Options & options = Options());
+
+    virtual ~AsyncFileSink();
+
+    void open(const std::string & filename, bool append);
+
+    virtual void close();
+
+    virtual size_t write(const char * data, size_t size);
+
+    virtual size_t flush(FileFlushLevel flushLevel);
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+
 /*****************************************************************************/
 /* FILE OUTPUT                                                               */
 /*****************************************************************************/
@@ -116,6 +165,13 @@ struct FileOutput : public NamedOutput {
 
     virtual std::shared_ptr<Sink>
     createSink(const std::string & filename, bool append);
+
+    /** Write the files through an AsyncFileSink with the given options
+        rather than directly from the compressing thread.  Taken into account
+        by the next call to open().
+    */
+    bool asyncSink;
+    AsyncFileSink::Options asyncSinkOptions;
 };
 
 
@@ -136,6 +192,15 @@ struct RotatingFileOutput : public RotatingOutputAdaptor {
               const std::string & periodPattern,
               const std::string & compression = "",
               int level = -1);
+
+    /** Number of compression threads of each of the files; see
+        CompressingOutput::compressionThreads.
+    */
+    int compressionThreads;
+
+    /** Sink of each of the files; see FileOutput::asyncSink. */
+    bool asyncSink;
+    AsyncFileSink::Options asyncSinkOptions;
     
 private:
     FileOutput * createFile(const std::string & filename);
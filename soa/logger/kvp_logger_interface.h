@@ -14,11 +14,18 @@ namespace Datacratic{
 class IKvpLogger{
     public:
         struct KvpLoggerParams{
+            KvpLoggerParams() :
+                failSafe(false), maxBatchSize(1000), maxBatchDelay(1.0),
+                maxQueueSize(100000){};
+
             std::string hostAndPort;//format host:port
             std::string db;
             std::string user;
             std::string pwd;
             bool failSafe;//if true, all errors are catched but printed to cerr
+            size_t maxBatchSize;//documents per bulk insert
+            double maxBatchDelay;//seconds a document waits for its batch
+            size_t maxQueueSize;//documents waiting past which more are dropped
         };
 
         /**
@@ -31,6 +31,8 @@ KvpLoggerMongoDb::KvpLoggerMongoDb(const KvpLoggerParams& params) :
                                         params.user,
                                         params.pwd);
     doIt(init);
+    startWriter(params.maxBatchSize, params.maxBatchDelay,
+                params.maxQueueSize);
 }
 
 KvpLoggerMongoDb::KvpLoggerMongoDb(const boost::property_tree::ptree& pt) :
@@ -41,6 +43,54 @@ KvpLoggerMongoDb::KvpLoggerMongoDb(const boost::property_tree::ptree& pt) :
                                         pt.get<string>("user"),
                                         pt.get<string>("pwd"));
     doIt(init);
+    KvpLoggerParams defaults;
+    startWriter(pt.get<size_t>("maxBatchSize", defaults.maxBatchSize),
+                pt.get<double>("maxBatchDelay", defaults.maxBatchDelay),
+                pt.get<size_t>("maxQueueSize", defaults.maxQueueSize));
+}
+
+void KvpLoggerMongoDb
+::startWriter(size_t maxBatchSize, double maxBatchDelay, size_t maxQueueSize)
+{
+    auto onBatch = [=](vector<Document>& batch){
+        insertBatch(batch);
+    };
+    writer.reset(new AsyncBatchQueue<Document>(onBatch, maxBatchSize,
+                                               maxBatchDelay, maxQueueSize));
+}
+
+void KvpLoggerMongoDb
+::insertBatch(vector<Document>& batch){
+    // One unordered bulk insert per collection, in the order of their
+    // first document
+    vector<string> colls;
+    map<string, vector<mongo::BSONObj> > docs;
+    for(Document& doc: batch){
+        vector<mongo::BSONObj>& collDocs = docs[doc.coll];
+        if(collDocs.empty()){
+            colls.push_back(doc.coll);
+        }
+        if(doc.json.empty()){
+            collDocs.push_back(doc.obj);
+            continue;
+        }
+        try{
+            collDocs.push_back(mongo::fromjson(doc.json));
+        }catch(const exception& e){
+            cerr << "KvpLoggerMongoDb: dropping invalid document: "
+                 << e.what() << endl;
+        }
+    }
+
+    for(const string& coll: colls){
+        function<void()> insert = [&](){
+            conn.insert(db + "." + coll, docs[coll],
+                        mongo::InsertOption_ContinueOnError);
+        };
+        // Errors can't reach the caller anymore; doIt prints them when
+        // failSafe and the writer prints and counts them otherwise.
+        doIt(insert);
+    }
 }
 
 void KvpLoggerMongoDb
@@ -52,9 +102,7 @@ void KvpLoggerMongoDb
         for(it = data.begin(); it != data.end(); it ++){
             b.append((*it).first, (*it).second);
         }
-        mongo::BSONObj p = b.obj();
-        conn.insert(db + "." + coll, p);
-        cerr << "ID: " << p["_id"].toString() << endl;
+        writer->push(Document{coll, b.obj(), ""});
     };
     doIt(_log);
 }
@@ -66,13 +114,15 @@ void KvpLoggerMongoDb
         if(*jsonStr.rbegin() == '\n'){
             jsonStr = jsonStr.substr(0, jsonStr.length() - 1);
         }
-        mongo::BSONObj o = mongo::fromjson(jsonStr);
-        conn.insert(db + "." + coll, o);
-        //cerr << "ID: " << o["_id"].toString() << endl;
+        writer->push(Document{coll, mongo::BSONObj(), std::move(jsonStr)});
     };
     doIt(_log);
 }
 
+void KvpLoggerMongoDb::flush(){
+    writer->flush();
+}
+
 void KvpLoggerMongoDb::doIt(function<void()>& fct){
     if(failSafe){
         try{
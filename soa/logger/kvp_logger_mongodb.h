@@ -1,6 +1,7 @@
 #pragma once
 
 #include "soa/logger/kvp_logger_interface.h"
+#include "soa/logger/async_batch_queue.h"
 #include <iostream>
 #include "mongo/client/dbclient.h"
 #include <boost/property_tree/json_parser.hpp>
@@ -9,6 +10,11 @@ namespace Datacratic{
 
 /**
  * This kvp_logger logs to mongodb
+ *
+ * The documents are queued and inserted by a thread of their own, in
+ * unordered bulk inserts of up to maxBatchSize documents per collection,
+ * so that logging doesn't wait on the database.  Documents are dropped
+ * (and counted) when more than maxQueueSize of them are waiting.
  */
 class KvpLoggerMongoDb : public IKvpLogger{
     public:
@@ -17,11 +23,32 @@ class KvpLoggerMongoDb : public IKvpLogger{
         void log(const std::map<std::string, std::string>&, const std::string&);
         void log(Json::Value&, const std::string&);
 
+        /** Wait until the documents logged so far were inserted. */
+        void flush();
+
+        /** Documents dropped as too many were waiting. */
+        uint64_t dropped() const{
+            return writer->dropped();
+        }
+
     private:
+        /** Document waiting to be inserted; json is only parsed by the
+            writer thread.
+        */
+        struct Document{
+            std::string coll;
+            mongo::BSONObj obj;
+            std::string json;
+        };
+
         mongo::DBClientConnection conn;
         const std::string db;
         const bool failSafe;
+        std::unique_ptr<AsyncBatchQueue<Document> > writer;
         void doIt(std::function<void()>& fct);
+        void startWriter(size_t maxBatchSize, double maxBatchDelay,
+                         size_t maxQueueSize);
+        void insertBatch(std::vector<Document>& batch);
 
         //std::function<void()> makeInitFct(KvpLoggerParams& );
         std::function<void()> makeInitFct(const std::string& hostAndPort,
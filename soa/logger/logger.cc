@@ -14,7 +14,14 @@
 #include "file_output.h"
 #include "publish_output.h"
 #include "callback_output.h"
+#include "jml/arch/wakeup_fd.h"
+#include "jml/arch/spinlock.h"
 #include <boost/make_shared.hpp>
+#include <boost/thread/tss.hpp>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
 
 
 using namespace std;
@@ -147,9 +154,10 @@ struct Logger::Output {
     Output(const boost::regex & allowChannels,
            const boost::regex & denyChannels,
            std::shared_ptr<LogOutput> output,
-           double logProbability)
+           double logProbability,
+           std::shared_ptr<const MessageFilter> filter = nullptr)
         : allowChannels(allowChannels), denyChannels(denyChannels),
-          output(output), logProbability(logProbability)
+          output(output), logProbability(logProbability), filter(filter)
     {
     }
     
@@ -157,6 +165,7 @@ struct Logger::Output {
     boost::regex denyChannels;  // channels to filter out
     std::shared_ptr<LogOutput> output;  // thing to write to
     double logProbability;
+    std::shared_ptr<const MessageFilter> filter;  // messages to match
 };
 
 /// List of entries to output to
@@ -182,33 +191,109 @@ struct Logger::Outputs : public std::vector<Output> {
     {
         if (old) delete old;
     }
-    
+
+    static bool takes(const Output & output, const std::string & channel)
+    {
+        return (output.allowChannels.empty()
+                || boost::regex_match(channel, output.allowChannels))
+            && (output.denyChannels.empty()
+                || !boost::regex_match(channel, output.denyChannels));
+    }
+
+    /** Outputs that take the messages of a channel. */
+    struct Route {
+        Route()
+            : outputs(0), filtered(0)
+        {
+        }
+
+        uint64_t outputs;   ///< Bit i is set if output i takes some of them
+        uint64_t filtered;  ///< Bit i is set if they go through filters[i]
+        std::vector<MessageFilter::ForChannel> filters;
+    };
+
+    /** Route of the given channel.  The filters are evaluated once per
+        channel, as there are few channels and each of them sees many
+        messages; only the parts of the message filters that depend on
+        the messages are left for each of them.  Only for up to 64
+        outputs.
+
+        The routes are never removed, so the result stays valid for the
+        lifetime of the outputs; past MaxRoutes of them the route is
+        computed into scratch instead.
+    */
+    const Route & route(const std::string & channel, Route & scratch)
+    {
+        {
+            std::lock_guard<ML::Spinlock> guard(routesLock);
+            auto it = routes.find(channel);
+            if (it != routes.end())
+                return it->second;
+        }
+
+        Route result;
+        for (unsigned i = 0;  i < size();  ++i) {
+            const Output & output = (*this)[i];
+            try {
+                if (!takes(output, channel))
+                    continue;
+                if (output.filter) {
+                    auto filter = output.filter->forChannel(channel);
+                    if (filter.takesNone())
+                        continue;
+                    if (!filter.takesAll()) {
+                        result.filters.resize(size());
+                        result.filters[i] = std::move(filter);
+                        result.filtered |= uint64_t(1) << i;
+                    }
+                }
+                result.outputs |= uint64_t(1) << i;
+            } catch (const std::exception & exc) {
+                cerr << "error: filtering channel " << channel
+                     << " for output " << ML::type_name(*output.output)
+                     << ": " << exc.what() << endl;
+            }
+        }
+
+        std::lock_guard<ML::Spinlock> guard(routesLock);
+        if (routes.size() < MaxRoutes)
+            return routes.insert(make_pair(channel, std::move(result)))
+                .first->second;
+        scratch = std::move(result);
+        return scratch;
+    }
+
     void logMessage(const std::string & channel,
                     const std::string & message)
     {
-        for (auto it = begin(); it != end();  ++it) {
+        bool routed = size() <= 64;
+        Route scratch;
+        const Route * channelRoute = routed ? &route(channel, scratch) : 0;
+
+        for (unsigned i = 0;  i < size();  ++i) {
+            Output & output = (*this)[i];
             try {
-                //cerr << "channel = " << channel << endl;
-                //cerr << "output = " << ML::type_name(*it->output) << endl;
-                //cerr << "it->allowChannels = " << it->allowChannels.str() << endl;
-                //cerr << "it->denyChannels = " << it->denyChannels.str() << endl;
-                if (it->allowChannels.empty()
-                    || boost::regex_match(channel, it->allowChannels)) {
-                    //cerr << "   allow" << endl;
-                    if (it->denyChannels.empty()
-                        || !boost::regex_match(channel, it->denyChannels)) {
-
-                        if (it->logProbability == 1.0
-                            || ((random() % 100000)
-                                < (it->logProbability * 100000))) {
-                            it->output->logMessage(channel, message);
-                        }
-                        //cerr << "  *** log" << endl;
-                    }
+                if (routed) {
+                    uint64_t bit = uint64_t(1) << i;
+                    if (!(channelRoute->outputs & bit))
+                        continue;
+                    if ((channelRoute->filtered & bit)
+                        && !channelRoute->filters[i](message))
+                        continue;
+                }
+                else if (!takes(output, channel)
+                         || (output.filter
+                             && !(*output.filter)(channel, message)))
+                    continue;
+
+                if (output.logProbability == 1.0
+                    || ((random() % 100000)
+                        < (output.logProbability * 100000))) {
+                    output.output->logMessage(channel, message);
                 }
             } catch (const std::exception & exc) {
                 cerr << "error: writing message to channel " << channel
-                     << " with output " << ML::type_name(*it->output)
+                     << " with output " << ML::type_name(*output.output)
                      << ": " << exc.what() << "; message = "
                      << message << endl;
             }
@@ -216,6 +301,12 @@ struct Logger::Outputs : public std::vector<Output> {
     }
     
     Outputs * old;   // to allow cleanup
+
+    /// Past this many channels, the filters are evaluated for each message
+    enum { MaxRoutes = 4096 };
+
+    ML::Spinlock routesLock;
+    std::unordered_map<std::string, Route> routes;
 };
 
 bool startsWith(std::string & s,
@@ -267,6 +358,35 @@ addOutput(std::shared_ptr<LogOutput> output,
     }
 }
 
+void
+Logger::
+addOutput(std::shared_ptr<LogOutput> output,
+          std::shared_ptr<const MessageFilter> filter,
+          double logProbability)
+{
+    Outputs * current = outputs;
+
+    for (;;) {
+        auto_ptr<Outputs> newOutputs
+            (new Outputs(current, Output(boost::regex(), boost::regex(),
+                                         output, logProbability, filter)));
+        if (ML::cmp_xchg(outputs, current, newOutputs.get())) {
+            newOutputs.release();
+            break;
+        }
+    }
+}
+
+void
+Logger::
+addCallback(boost::function<void (std::string, std::string)> callback,
+            std::shared_ptr<const MessageFilter> filter,
+            double logProbability)
+{
+    addOutput(std::make_shared<CallbackOutput>(callback),
+              filter, logProbability);
+}
+
 void
 Logger::
 addCallback(boost::function<void (std::string, std::string)> callback,
@@ -295,11 +415,343 @@ clearOutputs()
     newOutputs.release();
 }
 
+/** Ring buffer of the messages logged by one thread.  Each record is a
+    header with the sizes of the channel and of the message, followed by
+    their bytes and padded to 8 bytes, so that a header never wraps around.
+    Single producer (the thread) and single consumer (the logging thread).
+*/
+struct Logger::ThreadBuffer {
+    ThreadBuffer(size_t size)
+        : sent(0), orphaned(false), head(0), tail(0)
+    {
+        size_t capacity = 64;
+        while (capacity < size)
+            capacity *= 2;
+        data.reset(new char[capacity]);
+        mask = capacity - 1;
+    }
+
+    struct Header {
+        uint32_t channelSize;
+        uint32_t messageSize;
+    };
+
+    static size_t recordSize(size_t channelSize, size_t messageSize)
+    {
+        return (sizeof(Header) + channelSize + messageSize + 7) & ~size_t(7);
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    /** Producer only.  Returns false if there is no room for the record. */
+    bool tryWrite(const std::string & channel,
+                  const char * message, size_t messageSize)
+    {
+        size_t size = recordSize(channel.size(), messageSize);
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        if (pos + size - tail.load(std::memory_order_acquire) > capacity())
+            return false;
+
+        Header header = { (uint32_t)channel.size(), (uint32_t)messageSize };
+        ::memcpy(data.get() + (pos & mask), &header, sizeof(header));
+        copyIn(pos + sizeof(header), channel.data(), channel.size());
+        copyIn(pos + sizeof(header) + channel.size(), message, messageSize);
+
+        head.store(pos + size, std::memory_order_release);
+        sent.store(sent.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+        return true;
+    }
+
+    /** Consumer only.  Calls onRecord with the channel and the message of
+        up to maxRecords records, and returns how many there were.
+    */
+    template<typename Fn>
+    size_t drain(std::string & channel, std::string & message,
+                 Fn && onRecord, size_t maxRecords)
+    {
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        uint64_t end = head.load(std::memory_order_acquire);
+
+        size_t done = 0;
+        while (pos != end && done < maxRecords) {
+            Header header;
+            ::memcpy(&header, data.get() + (pos & mask), sizeof(header));
+            copyOut(channel, pos + sizeof(header), header.channelSize);
+            copyOut(message, pos + sizeof(header) + header.channelSize,
+                    header.messageSize);
+            pos += recordSize(header.channelSize, header.messageSize);
+
+            // Free the space before calling out, so that the producer can
+            // go on
+            tail.store(pos, std::memory_order_release);
+            onRecord(channel, message);
+            ++done;
+        }
+
+        return done;
+    }
+
+    bool empty() const
+    {
+        return tail.load(std::memory_order_relaxed)
+            == head.load(std::memory_order_acquire);
+    }
+
+    /// Scratch string where the producer builds its records
+    std::string record;
+
+    /// Number of records written
+    std::atomic<uint64_t> sent;
+
+    /// Set when the thread exits; the buffer is forgotten once drained
+    std::atomic<bool> orphaned;
+
+private:
+    void copyIn(uint64_t pos, const char * bytes, size_t size)
+    {
+        size_t offset = pos & mask;
+        size_t first = std::min(size, capacity() - offset);
+        ::memcpy(data.get() + offset, bytes, first);
+        ::memcpy(data.get(), bytes + first, size - first);
+    }
+
+    void copyOut(std::string & result, uint64_t pos, size_t size) const
+    {
+        size_t offset = pos & mask;
+        size_t first = std::min(size, capacity() - offset);
+        result.assign(data.get() + offset, first);
+        result.append(data.get(), size - first);
+    }
+
+    std::unique_ptr<char[]> data;
+    uint64_t mask;
+
+    // Producer and consumer on separate cache lines
+    std::atomic<uint64_t> head JML_ALIGNED(64);
+    std::atomic<uint64_t> tail JML_ALIGNED(64);
+};
+
+/** Event source of the logging thread that drains the buffers of all the
+    threads.  The producers only write to the wakeup fd when the logging
+    thread has gone idle (see TypedMessageRingSink).
+*/
+struct Logger::ThreadBuffers : public AsyncEventSource {
+    ThreadBuffers(Logger * logger, size_t bufferSize)
+        : logger(logger), bufferSize(bufferSize),
+          forgottenSent(0), sentBase(0),
+          wakeup(EFD_NONBLOCK), idle(true)
+    {
+    }
+
+    enum { BatchSize = 256 };
+
+    /** Buffer of the calling thread, created on its first message. */
+    ThreadBuffer & get()
+    {
+        Holder * holder = current.get();
+        if (JML_UNLIKELY(!holder)) {
+            holder = new Holder(std::make_shared<ThreadBuffer>(bufferSize));
+            current.reset(holder);
+            std::lock_guard<ML::Spinlock> guard(lock);
+            buffers.push_back(holder->buffer);
+        }
+        return *holder->buffer;
+    }
+
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (idle.load(std::memory_order_relaxed)
+                && idle.exchange(false, std::memory_order_relaxed))
+            wakeup.signal();
+    }
+
+    /** Records written so far by all the threads. */
+    uint64_t sent() const
+    {
+        uint64_t result = 0;
+        std::lock_guard<ML::Spinlock> guard(lock);
+        for (auto & buffer: buffers)
+            result += buffer->sent.load(std::memory_order_relaxed);
+        return result + forgottenSent - sentBase;
+    }
+
+    void resetSent()
+    {
+        sentBase = 0;
+        sentBase = sent();
+    }
+
+    virtual int selectFd() const
+    {
+        return wakeup.fd();
+    }
+
+    virtual bool poll() const
+    {
+        std::lock_guard<ML::Spinlock> guard(lock);
+        for (auto & buffer: buffers)
+            if (!buffer->empty())
+                return true;
+        return false;
+    }
+
+    virtual bool processOne()
+    {
+        wakeup.tryRead();
+
+        std::vector<std::shared_ptr<ThreadBuffer> > toDrain;
+        {
+            std::lock_guard<ML::Spinlock> guard(lock);
+            toDrain = buffers;
+        }
+
+        auto onRecord = [&] (const std::string & channel,
+                             const std::string & message)
+            {
+                logger->handleBufferedMessage(channel, message);
+            };
+
+        bool more = false;
+        for (auto & buffer: toDrain) {
+            buffer->drain(channel, message, onRecord, BatchSize);
+            if (!buffer->empty())
+                more = true;
+            else if (buffer->orphaned)
+                forget(buffer);
+        }
+        if (more)
+            return true;
+
+        // A producer that pushes after the check below is guaranteed to see
+        // the flag and signal us; one that pushed before it is caught by the
+        // check itself.
+        idle.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!poll())
+            return false;
+
+        idle.store(false, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    struct Holder {
+        Holder(std::shared_ptr<ThreadBuffer> buffer)
+            : buffer(std::move(buffer))
+        {
+        }
+
+        ~Holder()
+        {
+            buffer->orphaned = true;
+        }
+
+        std::shared_ptr<ThreadBuffer> buffer;
+    };
+
+    void forget(const std::shared_ptr<ThreadBuffer> & buffer)
+    {
+        std::lock_guard<ML::Spinlock> guard(lock);
+        auto it = std::find(buffers.begin(), buffers.end(), buffer);
+        if (it == buffers.end())
+            return;
+        forgottenSent += buffer->sent;
+        buffers.erase(it);
+    }
+
+    Logger * logger;
+    size_t bufferSize;
+
+    mutable ML::Spinlock lock;
+    std::vector<std::shared_ptr<ThreadBuffer> > buffers;
+    uint64_t forgottenSent;   ///< sent by the buffers that were forgotten
+    uint64_t sentBase;        ///< sent before the last start()
+
+    boost::thread_specific_ptr<Holder> current;
+
+    ML::Wakeup_Fd wakeup;
+    std::atomic<bool> idle;
+
+    /// Consumer's copies of the current record
+    std::string channel, message;
+};
+
+void
+Logger::
+enableThreadBuffers(size_t bytesPerThread)
+{
+    if (threadBuffers)
+        throw ML::Exception("thread buffers are already enabled");
+
+    threadBuffers = std::make_shared<ThreadBuffers>(this, bytesPerThread);
+    messageLoop.addSource("Logger::threadBuffers", threadBuffers);
+}
+
+std::string &
+Logger::
+startBuffered()
+{
+    std::string & record = threadBuffers->get().record;
+    record.clear();
+    return record;
+}
+
+void
+Logger::
+finishBuffered(const std::string & channel)
+{
+    ThreadBuffer & buffer = threadBuffers->get();
+
+    // Skip the tab in front of the first part
+    const char * message = buffer.record.data();
+    size_t messageSize = buffer.record.size();
+    if (messageSize) {
+        ++message;
+        --messageSize;
+    }
+
+    size_t size = ThreadBuffer::recordSize(channel.size(), messageSize);
+    if (size > buffer.capacity() / 2) {
+        ML::atomic_add(messagesSent, 1);
+        messages.push(std::vector<std::string>{
+                channel, std::string(message, messageSize) });
+        return;
+    }
+
+    while (!buffer.tryWrite(channel, message, messageSize)) {
+        threadBuffers->notify();
+        std::this_thread::yield();
+    }
+    threadBuffers->notify();
+}
+
+void
+Logger::
+warnIllegalChar(const std::string & part)
+{
+    cerr << "warning: part of message has illegal char: '"
+         << part << "'" << endl;
+}
+
+uint64_t
+Logger::
+numMessagesSent() const
+{
+    uint64_t result = messagesSent;
+    if (threadBuffers)
+        result += threadBuffers->sent();
+    return result;
+}
+
 void
 Logger::
 start(std::function<void ()> onStop)
 {
     messagesSent = messagesDone = 0;
+    if (threadBuffers)
+        threadBuffers->resetSent();
     doShutdown = false;
 
     messageLoop.start(onStop);
@@ -321,7 +773,7 @@ void
 Logger::
 waitUntilFinished()
 {
-    while (messagesDone < messagesSent) {
+    while (messagesDone < numMessagesSent()) {
         //cerr << "sent " << messagesSent << " done "
         //     << messagesDone << endl;
         ML::sleep(0.01);
@@ -518,6 +970,30 @@ handleMessage(std::vector<zmq::message_t> && message)
     current->logMessage(message[0].toString(), message[1].toString());
 }
 
+void
+Logger::
+handleBufferedMessage(const std::string & channel,
+                      const std::string & message)
+{
+    Outputs * current = outputs;
+
+    if (!current) return;
+
+    if (current->empty()) {
+        current = 0;  // TODO: delete it
+    }
+    else if (current->old) {
+        delete current->old;
+        current->old = 0;
+    }
+
+    atomic_add(messagesDone, 1);
+
+    if (!current) return;
+
+    current->logMessage(channel, message);
+}
+
 #if 0
 void
 Logger::
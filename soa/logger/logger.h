@@ -9,6 +9,7 @@
 #include "soa/service/zmq_named_pub_sub.h"
 #include "soa/service/zmq_utils.h"
 #include "soa/service/socket_per_thread.h"
+#include <string.h>
 #include <sstream>
 #include "jml/utils/filter_streams.h"
 #include <boost/thread/thread.hpp>
@@ -20,6 +21,7 @@
 #include <boost/regex.hpp>
 #include <boost/shared_ptr.hpp>
 #include "soa/jsoncpp/json.h"
+#include "message_filter.h"
 
 
 namespace Datacratic {
@@ -128,6 +130,15 @@ struct Logger {
                    const boost::regex & denyChannels = boost::regex(),
                    double logProbability = 1.0);
 
+    /** Send the messages that pass the given filter to the output.  The
+        filter is compiled once for each channel, so that the channels it
+        doesn't depend on the messages of cost nothing more per message
+        than those of addOutput() above.
+    */
+    void addOutput(std::shared_ptr<LogOutput> output,
+                   std::shared_ptr<const MessageFilter> filter,
+                   double logProbability = 1.0);
+
     /** Set up a callback that will call the given function when a message
         matching the filter is obtained.
     */
@@ -136,9 +147,24 @@ struct Logger {
                      const boost::regex & denyChannels = boost::regex(),
                      double logProbability = 1.0);
 
+    void addCallback(boost::function<void (std::string, std::string)> callback,
+                     std::shared_ptr<const MessageFilter> filter,
+                     double logProbability = 1.0);
+
     /** Clear all outputs. */
     void clearOutputs();
 
+    /** Have each thread that logs write its messages into a ring buffer of
+        its own of the given size, which the logging thread drains in
+        batches.  Logging a message then doesn't touch any shared state nor
+        allocate a vector of strings.  Messages too large for half of the
+        buffer still go through the shared queue, and thus may be reordered
+        with the others of the same thread.
+
+        Must be called after init() and before anything is logged.
+    */
+    void enableThreadBuffers(size_t bytesPerThread = 1 << 20);
+
     /** Log a given message to the given channel.  Each of the arguments will
         be converted to a string and logged like that.
     */
@@ -152,6 +178,11 @@ struct Logger {
     void logMessage(const std::string & channel, Args&&... args)
     {
         if (!outputs) return;
+        if (threadBuffers) {
+            logBuffered(channel, Date::now().print(5),
+                        std::forward<Args>(args)...);
+            return;
+        }
         ML::atomic_add(messagesSent, 1);
         messages.push(
            std::vector<std::string>{ channel, Date::now().print(5),
@@ -162,6 +193,10 @@ struct Logger {
     void logMessageNoTimestamp(const std::string & channel, Args&&... args)
     {
         if (!outputs) return;
+        if (threadBuffers) {
+            logBuffered(channel, std::forward<Args>(args)...);
+            return;
+        }
         ML::atomic_add(messagesSent, 1);
         messages.push(
              std::vector<std::string>{ channel, std::forward<Args>(args)... });
@@ -174,6 +209,14 @@ struct Logger {
         if (message.empty())
             throw ML::Exception("can't log empty message");
 
+        if (threadBuffers) {
+            std::string & record = startBuffered();
+            for (unsigned i = 1;  i < message.size();  ++i)
+                appendPart(record, message[i]);
+            finishBuffered(message[0]);
+            return;
+        }
+
         ML::atomic_add(messagesSent, 1);
         messages.push(message);
     }
@@ -185,6 +228,15 @@ struct Logger {
     {
         if (!outputs) return;
 
+        if (threadBuffers) {
+            std::string & record = startBuffered();
+            appendPart(record, Date::now().print(5));
+            for (unsigned i = 0;  i < numElements;  ++i)
+                appendPart(record, getElement(i));
+            finishBuffered(channel);
+            return;
+        }
+
         std::vector<std::string> message;
         message.push_back(channel);
         message.push_back(Date::now().print(5));
@@ -214,7 +266,7 @@ struct Logger {
     void replayDirect(const std::string & filename,
                       ssize_t maxEvents = -1) const;
     
-    uint64_t numMessagesSent() const { return messagesSent; }
+    uint64_t numMessagesSent() const;
     uint64_t numMessagesDone() const { return messagesDone; }
 
     void handleListenerMessage(std::vector<std::string> const & message);
@@ -243,6 +295,50 @@ private:
 
     struct Output;
     struct Outputs;
+    struct ThreadBuffer;
+    struct ThreadBuffers;
+
+    /// Per-thread ring buffers, when enabled
+    std::shared_ptr<ThreadBuffers> threadBuffers;
+
+    /** Write the parts of a message in the record of the calling thread,
+        then push it into its ring buffer.  The record is the tab-separated
+        parts, each preceded by a tab.
+    */
+    template<typename... Args>
+    void logBuffered(const std::string & channel, Args&&... args)
+    {
+        std::string & record = startBuffered();
+        int parts[] = { 0, (appendPart(record, std::forward<Args>(args)), 0)... };
+        (void) parts;
+        finishBuffered(channel);
+    }
+
+    std::string & startBuffered();
+    void finishBuffered(const std::string & channel);
+
+    static void appendPart(std::string & record, const std::string & part)
+    {
+        if (JML_UNLIKELY(part.find_first_of("\n\t\0\r")
+                         != std::string::npos))
+            warnIllegalChar(part);
+        record += '\t';
+        record += part;
+    }
+
+    static void appendPart(std::string & record, const char * part)
+    {
+        if (JML_UNLIKELY(::strpbrk(part, "\n\t") != nullptr))
+            warnIllegalChar(part);
+        record += '\t';
+        record += part;
+    }
+
+    static void warnIllegalChar(const std::string & part);
+
+    /** Log a message drained from a thread buffer; in the logging thread. */
+    void handleBufferedMessage(const std::string & channel,
+                               const std::string & message);
 
     /// Current list of outputs.  Must be swapped atomically.
     Outputs * outputs;
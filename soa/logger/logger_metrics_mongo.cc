@@ -44,6 +44,62 @@ LoggerMetricsMongo::LoggerMetricsMongo(Json::Value config,
     conn->insert(db + "." + coll, obj);
     objectId = obj["_id"].OID();
     logToTerm = config["logToTerm"].asBool();
+
+    size_t maxBatchSize = config.get("maxBatchSize", 1000).asInt();
+    double maxBatchDelay = config.get("maxBatchDelay", 1.0).asDouble();
+    size_t maxQueueSize = config.get("maxQueueSize", 100000).asInt();
+    auto onBatch = [=](vector<BSONObj>& batch){
+        writeBatch(batch);
+    };
+    writer.reset(new AsyncBatchQueue<BSONObj>(onBatch, maxBatchSize,
+                                              maxBatchDelay, maxQueueSize));
+}
+
+LoggerMetricsMongo::~LoggerMetricsMongo()
+{
+    // Writes what's queued before the connection goes
+    writer.reset();
+}
+
+void LoggerMetricsMongo::flush()
+{
+    writer->flush();
+}
+
+void LoggerMetricsMongo::setFields(BSONObj fields)
+{
+    if(!writer->push(std::move(fields)) && logToTerm){
+        cerr << "LoggerMetricsMongo: queue full; dropped update" << endl;
+    }
+}
+
+void LoggerMetricsMongo::writeBatch(vector<BSONObj>& batch)
+{
+    // A single $set with the last value of each field
+    map<string, BSONElement> fields;
+    vector<string> order;
+    for(const BSONObj& obj: batch){
+        BSONObjIterator it(obj);
+        while(it.more()){
+            BSONElement el = it.next();
+            auto res = fields.insert(make_pair(el.fieldName(), el));
+            if(res.second){
+                order.push_back(el.fieldName());
+            }else{
+                res.first->second = el;
+            }
+        }
+    }
+
+    BSONObjBuilder bson;
+    for(const string& field: order){
+        bson.append(fields[field]);
+    }
+
+    conn->update(db + "." + coll,
+                BSON("_id" << objectId),
+                BSON("$set" << bson.obj()),
+                true);
 }
 
 void LoggerMetricsMongo::logInCategory(const string& category,
@@ -110,10 +166,7 @@ void LoggerMetricsMongo::logInCategory(const string& category,
              << ": " << json.toStyledString() << endl;
     }
 
-    conn->update(db + "." + coll,
-                BSON("_id" << objectId),
-                BSON("$set" << bson.obj()),
-                    true);
+    setFields(bson.obj());
 }
 
 void LoggerMetricsMongo
@@ -163,10 +216,7 @@ void LoggerMetricsMongo
     if(logToTerm){
         cerr << bsonObj.toString() << endl;
     }
-    conn->update(db + "." + coll,
-                BSON("_id" << objectId),
-                BSON("$set" << bsonObj),
-                true);
+    setFields(bsonObj);
 }
 
 const std::string LoggerMetricsMongo::getProcessId() const{
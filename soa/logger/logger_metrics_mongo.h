@@ -1,12 +1,34 @@
 #pragma once
 
 #include "logger_metrics_interface.h"
+#include "async_batch_queue.h"
 #include "mongo/client/dbclient.h"
 
 namespace Datacratic{
+
+/**
+ * Logs the metrics in a mongodb document per process.
+ *
+ * The updates are queued and applied by a thread of their own, which merges
+ * the fields set by a batch of them into a single update, so that logging
+ * doesn't wait on the database.  The batches are of up to maxBatchSize
+ * updates or maxBatchDelay seconds, and updates are dropped once
+ * maxQueueSize of them are waiting; all three can be given in the config.
+ */
 class LoggerMetricsMongo : public ILoggerMetrics{
     friend class ILoggerMetrics;
 
+    public:
+        ~LoggerMetricsMongo();
+
+        /** Wait until the metrics logged so far were written. */
+        void flush();
+
+        /** Updates dropped as too many were waiting. */
+        uint64_t dropped() const{
+            return writer->dropped();
+        }
+
     protected:
         mongo::OID objectId;
         std::string db;
@@ -24,5 +46,10 @@ class LoggerMetricsMongo : public ILoggerMetrics{
     
     private:
         bool logToTerm;
+
+        /** Fields to $set, applied in order. */
+        std::unique_ptr<AsyncBatchQueue<mongo::BSONObj> > writer;
+        void setFields(mongo::BSONObj fields);
+        void writeBatch(std::vector<mongo::BSONObj>& batch);
 };
 }//namespace Datacratic
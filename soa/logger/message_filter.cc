@@ -0,0 +1,638 @@
+/* message_filter.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Filters of log messages, compiled from a small expression language.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+#include <boost/regex.hpp>
+
+#include "jml/arch/exception.h"
+#include "jml/utils/exc_assert.h"
+#include "jml/utils/json_parsing.h"
+#include "jml/utils/parse_context.h"
+#include "message_filter.h"
+
+
+using namespace std;
+using namespace ML;
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* MESSAGE FIELDS                                                            */
+/*****************************************************************************/
+
+std::pair<const char *, size_t>
+MessageFields::
+operator [] (int n) const
+{
+    ExcAssertGreaterEqual(n, 1);
+    size_t index = n - 1;
+
+    while (!complete && starts.size() < index + 2) {
+        size_t pos = message.find('\t', starts.back());
+        if (pos == string::npos) {
+            starts.push_back(message.size() + 1);
+            complete = true;
+        }
+        else starts.push_back(pos + 1);
+    }
+
+    if (index + 1 >= starts.size())
+        return make_pair(message.data() + message.size(), 0);
+    return make_pair(message.data() + starts[index],
+                     starts[index + 1] - 1 - starts[index]);
+}
+
+
+/*****************************************************************************/
+/* EXPRESSIONS                                                               */
+/*****************************************************************************/
+
+namespace {
+
+typedef std::pair<const char *, size_t> Span;
+
+struct Operand {
+    enum Type {
+        CHANNEL,
+        FIELD,
+        STRING,
+        NUMBER
+    };
+
+    Operand()
+        : type(STRING), field(0), number(0.0)
+    {
+    }
+
+    Type type;
+    int field;
+    std::string str;     ///< String, or text of the number
+    double number;
+};
+
+} // file scope
+
+struct MessageFilter::Expr {
+    enum Op {
+        AND, OR, NOT,
+        EQ, NE, LT, LE, GT, GE,
+        MATCH, NOT_MATCH,
+        IN
+    };
+
+    Expr(Op op)
+        : op(op)
+    {
+    }
+
+    Op op;
+    std::vector<std::shared_ptr<const Expr> > children;  ///< AND, OR, NOT
+    Operand lhs, rhs;                                     ///< Comparisons
+    std::shared_ptr<const boost::regex> regex;            ///< MATCH
+    std::vector<Operand> set;                             ///< IN
+};
+
+namespace {
+
+typedef MessageFilter::Expr Expr;
+
+
+/*****************************************************************************/
+/* PARSER                                                                    */
+/*****************************************************************************/
+
+struct Parser {
+    Parser(Parse_Context & context)
+        : context(context)
+    {
+    }
+
+    Parse_Context & context;
+
+    std::shared_ptr<Expr> parse()
+    {
+        auto result = parseOr();
+        context.skip_whitespace();
+        if (!context.eof())
+            context.exception("unexpected text after the expression");
+        return result;
+    }
+
+    static std::shared_ptr<Expr>
+    combine(Expr::Op op, std::shared_ptr<Expr> lhs, std::shared_ptr<Expr> rhs)
+    {
+        if (lhs->op == op) {
+            lhs->children.push_back(rhs);
+            return lhs;
+        }
+        auto result = std::make_shared<Expr>(op);
+        result->children = { lhs, rhs };
+        return result;
+    }
+
+    std::shared_ptr<Expr> parseOr()
+    {
+        auto result = parseAnd();
+        for (;;) {
+            context.skip_whitespace();
+            if (!context.match_literal("||"))
+                return result;
+            result = combine(Expr::OR, result, parseAnd());
+        }
+    }
+
+    std::shared_ptr<Expr> parseAnd()
+    {
+        auto result = parseUnary();
+        for (;;) {
+            context.skip_whitespace();
+            if (!context.match_literal("&&"))
+                return result;
+            result = combine(Expr::AND, result, parseUnary());
+        }
+    }
+
+    std::shared_ptr<Expr> parseUnary()
+    {
+        context.skip_whitespace();
+        if (context.match_literal('!')) {
+            auto result = std::make_shared<Expr>(Expr::NOT);
+            result->children.push_back(parseUnary());
+            return result;
+        }
+        if (context.match_literal('(')) {
+            auto result = parseOr();
+            context.skip_whitespace();
+            context.expect_literal(')');
+            return result;
+        }
+        return parseComparison();
+    }
+
+    std::shared_ptr<Expr> parseComparison()
+    {
+        Operand lhs = parseOperand();
+
+        context.skip_whitespace();
+        std::shared_ptr<Expr> result;
+        if (context.match_literal("=="))
+            result = std::make_shared<Expr>(Expr::EQ);
+        else if (context.match_literal("!="))
+            result = std::make_shared<Expr>(Expr::NE);
+        else if (context.match_literal("<="))
+            result = std::make_shared<Expr>(Expr::LE);
+        else if (context.match_literal(">="))
+            result = std::make_shared<Expr>(Expr::GE);
+        else if (context.match_literal('<'))
+            result = std::make_shared<Expr>(Expr::LT);
+        else if (context.match_literal('>'))
+            result = std::make_shared<Expr>(Expr::GT);
+        else if (context.match_literal("!~"))
+            result = std::make_shared<Expr>(Expr::NOT_MATCH);
+        else if (context.match_literal('~'))
+            result = std::make_shared<Expr>(Expr::MATCH);
+        else if (context.match_literal("in"))
+            result = std::make_shared<Expr>(Expr::IN);
+        else context.exception("expected a comparison operator");
+
+        result->lhs = lhs;
+
+        if (result->op == Expr::MATCH || result->op == Expr::NOT_MATCH)
+            result->regex = parseRegex();
+        else if (result->op == Expr::IN)
+            result->set = parseSet();
+        else result->rhs = parseOperand();
+
+        return result;
+    }
+
+    Operand parseOperand()
+    {
+        context.skip_whitespace();
+
+        Operand result;
+        double number;
+        if (context.match_literal("channel"))
+            result.type = Operand::CHANNEL;
+        else if (context.match_literal('$')) {
+            result.field = context.expect_int(0, 1000000,
+                                              "expected a field number");
+            result.type = result.field == 0 ? Operand::CHANNEL : Operand::FIELD;
+        }
+        else if (!context.eof() && *context == '"') {
+            result.type = Operand::STRING;
+            result.str = expectJsonString(context);
+        }
+        else {
+            const char * start = context.get_offset() + expressionStart;
+            if (!context.match_double(number))
+                context.exception("expected an operand");
+            result.type = Operand::NUMBER;
+            result.number = number;
+            result.str.assign(start, context.get_offset() + expressionStart);
+        }
+
+        return result;
+    }
+
+    std::shared_ptr<const boost::regex> parseRegex()
+    {
+        context.skip_whitespace();
+        context.expect_literal('/', "expected a regex between slashes");
+
+        string pattern;
+        for (;;) {
+            if (context.eof())
+                context.exception("unterminated regex");
+            char c = *context++;
+            if (c == '/')
+                break;
+            if (c == '\\' && context.match_literal('/'))
+                c = '/';
+            else if (c == '\\')
+                pattern += '\\', c = *context++;
+            pattern += c;
+        }
+
+        try {
+            return std::make_shared<boost::regex>(pattern);
+        } catch (const std::exception & exc) {
+            context.exception("invalid regex /" + pattern + "/: "
+                              + exc.what());
+        }
+    }
+
+    std::vector<Operand> parseSet()
+    {
+        context.skip_whitespace();
+        context.expect_literal('[');
+
+        std::vector<Operand> result;
+        context.skip_whitespace();
+        if (context.match_literal(']'))
+            return result;
+
+        for (;;) {
+            Operand literal = parseOperand();
+            if (literal.type != Operand::STRING
+                && literal.type != Operand::NUMBER)
+                context.exception("expected a string or a number");
+            result.push_back(literal);
+
+            context.skip_whitespace();
+            if (context.match_literal(']'))
+                return result;
+            context.expect_literal(',');
+        }
+    }
+
+    const char * expressionStart;
+};
+
+
+/*****************************************************************************/
+/* COMPILATION                                                               */
+/*****************************************************************************/
+
+/** Expression compiled for a channel: either a constant or a closure over
+    the fields of the messages.
+*/
+struct Compiled {
+    Compiled(int constant = -1)
+        : constant(constant)
+    {
+    }
+
+    Compiled(std::function<bool (const MessageFields &)> fn)
+        : constant(-1), fn(std::move(fn))
+    {
+    }
+
+    int constant;
+    std::function<bool (const MessageFields &)> fn;
+};
+
+int compareSpans(const Span & a, const Span & b)
+{
+    int result = memcmp(a.first, b.first, std::min(a.second, b.second));
+    if (result) return result;
+    return a.second < b.second ? -1 : (a.second > b.second ? 1 : 0);
+}
+
+Span spanOf(const std::string & str)
+{
+    return Span(str.data(), str.size());
+}
+
+/** The number in the span.  Fields are followed by a tab or by the end of
+    the message, so strtod() stops at the end of the field.
+*/
+bool toNumber(const Span & span, double & result)
+{
+    if (span.second == 0) return false;
+    char * end;
+    result = strtod(span.first, &end);
+    return end == span.first + span.second;
+}
+
+bool toNumber(const Operand & operand, double & result)
+{
+    if (operand.type == Operand::NUMBER) {
+        result = operand.number;
+        return true;
+    }
+    return toNumber(spanOf(operand.str), result);
+}
+
+Operand bind(Operand operand, const std::string & channel)
+{
+    if (operand.type == Operand::CHANNEL) {
+        operand.type = Operand::STRING;
+        operand.str = channel;
+    }
+    return operand;
+}
+
+template<typename Cmp>
+Compiled compileNumeric(const Operand & lhs, const Operand & rhs, Cmp cmp)
+{
+    bool lhsField = lhs.type == Operand::FIELD;
+    bool rhsField = rhs.type == Operand::FIELD;
+    double x, y;
+
+    if (!lhsField && !rhsField)
+        return Compiled(toNumber(lhs, x) && toNumber(rhs, y) && cmp(x, y));
+
+    if (lhsField && rhsField) {
+        int a = lhs.field, b = rhs.field;
+        return Compiled([=] (const MessageFields & fields)
+                        {
+                            double x, y;
+                            return toNumber(fields[a], x)
+                                && toNumber(fields[b], y)
+                                && cmp(x, y);
+                        });
+    }
+
+    if (lhsField) {
+        if (!toNumber(rhs, y)) return Compiled(0);
+        int a = lhs.field;
+        return Compiled([=] (const MessageFields & fields)
+                        {
+                            double x;
+                            return toNumber(fields[a], x) && cmp(x, y);
+                        });
+    }
+
+    if (!toNumber(lhs, x)) return Compiled(0);
+    int b = rhs.field;
+    return Compiled([=] (const MessageFields & fields)
+                    {
+                        double y;
+                        return toNumber(fields[b], y) && cmp(x, y);
+                    });
+}
+
+/** Comparison of strings; cmp is applied to the result of compareSpans()
+    and 0.
+*/
+template<typename Cmp>
+Compiled compileString(const Operand & lhs, const Operand & rhs, Cmp cmp)
+{
+    bool lhsField = lhs.type == Operand::FIELD;
+    bool rhsField = rhs.type == Operand::FIELD;
+
+    if (!lhsField && !rhsField)
+        return Compiled(cmp(compareSpans(spanOf(lhs.str), spanOf(rhs.str)),
+                            0));
+
+    if (lhsField && rhsField) {
+        int a = lhs.field, b = rhs.field;
+        return Compiled([=] (const MessageFields & fields)
+                        {
+                            return cmp(compareSpans(fields[a], fields[b]), 0);
+                        });
+    }
+
+    if (lhsField) {
+        int a = lhs.field;
+        string value = rhs.str;
+        return Compiled([=] (const MessageFields & fields)
+                        {
+                            return cmp(compareSpans(fields[a],
+                                                    spanOf(value)),
+                                       0);
+                        });
+    }
+
+    int b = rhs.field;
+    string value = lhs.str;
+    return Compiled([=] (const MessageFields & fields)
+                    {
+                        return cmp(compareSpans(spanOf(value), fields[b]), 0);
+                    });
+}
+
+template<template<typename> class Cmp>
+Compiled compileComparison(const Operand & lhs, const Operand & rhs)
+{
+    if (lhs.type == Operand::NUMBER || rhs.type == Operand::NUMBER)
+        return compileNumeric(lhs, rhs, Cmp<double>());
+    return compileString(lhs, rhs, Cmp<int>());
+}
+
+Compiled compileMatch(const Operand & operand,
+                      std::shared_ptr<const boost::regex> regex,
+                      bool negate)
+{
+    if (operand.type != Operand::FIELD)
+        return Compiled(boost::regex_search(operand.str, *regex) != negate);
+
+    int a = operand.field;
+    return Compiled([=] (const MessageFields & fields)
+                    {
+                        Span value = fields[a];
+                        return boost::regex_search(value.first,
+                                                   value.first + value.second,
+                                                   *regex) != negate;
+                    });
+}
+
+Compiled compileIn(const Operand & operand, const std::vector<Operand> & set)
+{
+    bool numeric = !set.empty();
+    for (auto & literal: set)
+        numeric = numeric && literal.type == Operand::NUMBER;
+
+    if (numeric) {
+        std::vector<double> numbers;
+        for (auto & literal: set)
+            numbers.push_back(literal.number);
+        std::sort(numbers.begin(), numbers.end());
+
+        auto test = [=] (const Span & value)
+            {
+                double x;
+                return toNumber(value, x)
+                    && std::binary_search(numbers.begin(), numbers.end(), x);
+            };
+
+        if (operand.type != Operand::FIELD)
+            return Compiled(test(spanOf(operand.str)));
+
+        int a = operand.field;
+        return Compiled([=] (const MessageFields & fields)
+                        {
+                            return test(fields[a]);
+                        });
+    }
+
+    std::vector<string> strings;
+    for (auto & literal: set)
+        strings.push_back(literal.str);
+    std::sort(strings.begin(), strings.end());
+
+    auto test = [=] (const Span & value)
+        {
+            auto less = [] (const string & str, const Span & value)
+                {
+                    return compareSpans(spanOf(str), value) < 0;
+                };
+            auto it = std::lower_bound(strings.begin(), strings.end(), value,
+                                       less);
+            return it != strings.end() && compareSpans(spanOf(*it), value) == 0;
+        };
+
+    if (operand.type != Operand::FIELD)
+        return Compiled(test(spanOf(operand.str)));
+
+    int a = operand.field;
+    return Compiled([=] (const MessageFields & fields)
+                    {
+                        return test(fields[a]);
+                    });
+}
+
+Compiled compile(const Expr & expr, const std::string & channel)
+{
+    switch (expr.op) {
+
+    case Expr::AND:
+    case Expr::OR: {
+        // The value that decides the result on its own
+        int decisive = expr.op == Expr::OR;
+
+        std::vector<std::function<bool (const MessageFields &)> > parts;
+        for (auto & child: expr.children) {
+            Compiled compiled = compile(*child, channel);
+            if (compiled.constant == decisive)
+                return Compiled(decisive);
+            if (compiled.constant == -1)
+                parts.push_back(std::move(compiled.fn));
+        }
+
+        if (parts.empty())
+            return Compiled(!decisive);
+
+        Compiled result;
+        result.fn = parts[0];
+        for (unsigned i = 1;  i < parts.size();  ++i) {
+            auto lhs = result.fn, rhs = parts[i];
+            if (decisive)
+                result.fn = [=] (const MessageFields & fields)
+                    {
+                        return lhs(fields) || rhs(fields);
+                    };
+            else
+                result.fn = [=] (const MessageFields & fields)
+                    {
+                        return lhs(fields) && rhs(fields);
+                    };
+        }
+        return result;
+    }
+
+    case Expr::NOT: {
+        Compiled compiled = compile(*expr.children.at(0), channel);
+        if (compiled.constant != -1)
+            return Compiled(!compiled.constant);
+        auto fn = compiled.fn;
+        return Compiled([=] (const MessageFields & fields)
+                        {
+                            return !fn(fields);
+                        });
+    }
+
+    default:
+        break;
+    }
+
+    Operand lhs = bind(expr.lhs, channel), rhs = bind(expr.rhs, channel);
+
+    switch (expr.op) {
+    case Expr::EQ:  return compileComparison<std::equal_to>(lhs, rhs);
+    case Expr::NE:  return compileComparison<std::not_equal_to>(lhs, rhs);
+    case Expr::LT:  return compileComparison<std::less>(lhs, rhs);
+    case Expr::LE:  return compileComparison<std::less_equal>(lhs, rhs);
+    case Expr::GT:  return compileComparison<std::greater>(lhs, rhs);
+    case Expr::GE:  return compileComparison<std::greater_equal>(lhs, rhs);
+    case Expr::MATCH:  return compileMatch(lhs, expr.regex, false);
+    case Expr::NOT_MATCH:  return compileMatch(lhs, expr.regex, true);
+    case Expr::IN:  return compileIn(lhs, expr.set);
+    default:
+        throw ML::Exception("unknown message filter operation");
+    }
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* MESSAGE FILTER                                                            */
+/*****************************************************************************/
+
+MessageFilter::
+MessageFilter(const std::string & expression)
+    : expression_(expression)
+{
+    Parse_Context context("message filter", expression_.c_str(),
+                          expression_.size());
+    Parser parser(context);
+    parser.expressionStart = expression_.c_str();
+    root = parser.parse();
+}
+
+MessageFilter::
+~MessageFilter()
+{
+}
+
+MessageFilter::ForChannel
+MessageFilter::
+forChannel(const std::string & channel) const
+{
+    Compiled compiled = compile(*root, channel);
+
+    ForChannel result;
+    result.constant = compiled.constant;
+    result.predicate = std::move(compiled.fn);
+    return result;
+}
+
+bool
+MessageFilter::
+operator () (const std::string & channel, const std::string & message) const
+{
+    return forChannel(channel)(message);
+}
+
+} // namespace Datacratic
@@ -0,0 +1,127 @@
+/* message_filter.h                                                -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Filters of log messages, compiled from a small expression language.
+*/
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* MESSAGE FIELDS                                                            */
+/*****************************************************************************/
+
+/** Tab separated fields of a log message, which are only split as far as
+    they are asked for.
+*/
+
+struct MessageFields {
+
+    MessageFields(const std::string & message)
+        : message(message), complete(false)
+    {
+        starts.push_back(0);
+    }
+
+    /** Start and length of field n, where 1 is the first field of the
+        message.  Fields past the last one are empty.
+    */
+    std::pair<const char *, size_t> operator [] (int n) const;
+
+private:
+    const std::string & message;
+    mutable std::vector<size_t> starts;  ///< Start of each field found
+    mutable bool complete;               ///< Whether all of them were found
+};
+
+
+/*****************************************************************************/
+/* MESSAGE FILTER                                                            */
+/*****************************************************************************/
+
+/** Predicate over the log messages, compiled from an expression such as
+
+        channel == "BID" && $3 > 0.5 && $2 !~ /^test/
+
+    The operands are the channel (also $0), the fields of the message ($1
+    is the first one), strings in double quotes and numbers.  They are
+    combined with:
+
+        a == b, a != b              equality
+        a < b, a <= b, a > b, a >= b
+                                    comparison; numeric if either side is a
+                                    number, in which case a field that isn't a
+                                    number fails it
+        a ~ /regex/, a !~ /regex/   whether the regex is found in a
+        a in [ x, y, ... ]          equality with any of the literals
+        !e, e && f, e || f, (e)
+
+    The expression is compiled once per channel into a tree of closures
+    over the fields of the messages, with everything that only depends on
+    the channel already evaluated.  For most filters, that decides whether
+    a channel is taken at all, so that only the messages of the channels
+    that depend on their fields are looked at.
+*/
+
+struct MessageFilter {
+
+    /** Parse the expression.  Throws an ML::Exception that tells where the
+        syntax error is.
+    */
+    MessageFilter(const std::string & expression);
+
+    ~MessageFilter();
+
+    const std::string & expression() const
+    {
+        return expression_;
+    }
+
+    /** Filter specialized for the messages of a channel. */
+    struct ForChannel {
+        ForChannel()
+            : constant(1)
+        {
+        }
+
+        bool takesAll() const { return constant == 1; }
+        bool takesNone() const { return constant == 0; }
+
+        bool operator () (const std::string & message) const
+        {
+            if (constant != -1)
+                return constant;
+            MessageFields fields(message);
+            return predicate(fields);
+        }
+
+        /// 0 or 1 if it doesn't depend on the message, otherwise -1
+        int constant;
+        std::function<bool (const MessageFields &)> predicate;
+    };
+
+    ForChannel forChannel(const std::string & channel) const;
+
+    /** Whether the message passes the filter.  Compiles the filter for the
+        channel each time; use forChannel() for anything repeated.
+    */
+    bool operator () (const std::string & channel,
+                      const std::string & message) const;
+
+    struct Expr;
+
+private:
+    std::string expression_;
+    std::shared_ptr<const Expr> root;
+};
+
+} // namespace Datacratic
@@ -6,10 +6,7 @@
 */
 
 #include "remote_input.h"
-#include <boost/iostreams/categories.hpp>
-#include <boost/iostreams/filtering_stream.hpp>
-#include <boost/iostreams/filter/bzip2.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
+#include "remote_log_frame.h"
 
 using namespace std;
 
@@ -22,27 +19,9 @@ namespace Datacratic {
 
 struct RemoteInputConnection : public PassiveConnectionHandler {
 
-    RemoteInputConnection()
-        : bytes_in(0)
+    RemoteInputConnection(RemoteInput * owner)
+        : owner(owner), bytes_in(0), received(0), credits(owner->credits)
     {
-#if 0
-        using namespace boost::iostreams;
-
-        auto_ptr<filtering_ostream> new_stream
-            (new filtering_ostream());
-
-        bool gzip = true;
-        bool bzip2 = false;
-
-        if (gzip)
-            new_stream->push(gzip_decompressor());
-        else if (bzip2)
-            new_stream->push(bzip2_decompressor());
-    
-        new_stream->push(ConnectionSink(this));
-
-        stream.reset(new_stream.release());
-#endif
     }
 
     ~RemoteInputConnection()
@@ -55,14 +34,53 @@ struct RemoteInputConnection : public PassiveConnectionHandler {
     {
         cerr << "on input got transport" << endl;
         startReading();
+
+        // Let the output start sending
+        send(RemoteLogFrame::encodeAck(0, credits));
     }
 
     virtual void handleData(const std::string & data)
     {
-        // We shouldn't get anything back on this (yet)
-        //cerr << "warning: input handleData: shouldn't have received anything"
-        //     << " but got " << data.size() << " bytes" << endl;
         bytes_in += data.size();
+        if (owner->onData)
+            owner->onData(data);
+
+        uint64_t receivedBefore = received;
+
+        try {
+            auto onFrame = [&] (RemoteLogFrame && frame)
+                {
+                    if (frame.type != RemoteLogFrame::BATCH)
+                        throw ML::Exception("unexpected frame from output");
+                    ++received;
+                    if (!owner->isNewBatch(frame.stream, frame.seq)) {
+                        ++owner->numSkipped;
+                        return;
+                    }
+
+                    uint64_t numMessages = 0;
+                    auto onMessage = [&] (const std::string & channel,
+                                          const std::string & message)
+                    {
+                        ++numMessages;
+                        if (owner->onMessage)
+                            owner->onMessage(channel, message);
+                    };
+
+                    RemoteLogFrame::forEachMessage(frame.decodePayload(),
+                                                   onMessage);
+                    owner->numMessages += numMessages;
+                };
+
+            parser.feed(data, onFrame);
+        } catch (const std::exception & exc) {
+            doError("remote input: " + string(exc.what()));
+            return;
+        }
+
+        // One acknowledgement for everything that came in at once
+        if (received != receivedBefore)
+            send(RemoteLogFrame::encodeAck(received, credits));
     }
 
     virtual void handleError(const std::string & error)
@@ -83,44 +101,11 @@ struct RemoteInputConnection : public PassiveConnectionHandler {
         closeWhenHandlerFinished();
     }
 
+    RemoteInput * owner;
     uint64_t bytes_in;
-
-#if 0
-    void logMessage(const std::string & channel,
-                    const std::string & message)
-    {
-        //cerr << "remoteOutputConnection::logMessage()" << endl;
-        (*stream) << channel << '\t' << message << flush;
-        //this->send(channel + "-" + message, NEXT_CONTINUE, onSendFinished);
-    }
-
-    boost::scoped_ptr<std::ostream> stream;
-
-    // TODO: how to deal with dropped messages?
-    struct ConnectionSink : public boost::iostreams::sink {
-        ConnectionSink(RemoteOutputConnection * connection)
-            : connection(connection)
-        {
-        }
-        
-        RemoteOutputConnection * connection;
-
-        std::streamsize write(const char * s, std::streamsize n)
-        {
-            auto onSendFinished = [=] ()
-                {
-                    cerr << "finished sending remote log message" << endl;
-                    abort();
-                };
-            
-            connection->send(std::string(s, n),
-                             NEXT_CONTINUE,
-                             onSendFinished);
-
-            return n;
-        }
-    };
-#endif    
+    uint64_t received;    ///< Batches received on this connection
+    uint32_t credits;
+    RemoteLogFrameParser parser;
 };
 
 
@@ -131,7 +116,7 @@ struct RemoteInputConnection : public PassiveConnectionHandler {
 
 RemoteInput::
 RemoteInput()
-    : endpoint("RemoteInput")
+    : credits(64), numMessages(0), numSkipped(0), endpoint("RemoteInput")
 {
 }
 
@@ -152,7 +137,7 @@ listen(int port,
     endpoint.onMakeNewHandler
         = [=] () -> std::shared_ptr<ConnectionHandler>
         {
-            return ML::make_std_sp(new RemoteInputConnection());
+            return ML::make_std_sp(new RemoteInputConnection(this));
         };
 
     endpoint.onAcceptError = [=] (const std::string & str)
@@ -172,6 +157,18 @@ listen(int port,
     this->onShutdown = onShutdown;
 }
 
+bool
+RemoteInput::
+isNewBatch(uint64_t stream, uint64_t seq)
+{
+    std::lock_guard<std::mutex> guard(streamsLock);
+    uint64_t & lastSeq = lastSeqs[stream];
+    if (seq <= lastSeq)
+        return false;
+    lastSeq = seq;
+    return true;
+}
+
 void
 RemoteInput::
 shutdown()
@@ -9,10 +9,29 @@
 
 #include "logger.h"
 #include "soa/service/passive_endpoint.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
 
 
 namespace Datacratic {
 
+struct RemoteInputConnection;
+
+
+/*****************************************************************************/
+/* REMOTE INPUT                                                              */
+/*****************************************************************************/
+
+/** Receives the batches of log messages of RemoteOutputs.  Each batch is
+    acknowledged once its messages were given to onMessage, and each output
+    may have up to credits batches unacknowledged, so a slow onMessage
+    holds the outputs back.
+
+    Batches that were already received from the same output, which it sends
+    again after a reconnection, are skipped.
+*/
+
 struct RemoteInput {
     
     RemoteInput();
@@ -33,10 +52,45 @@ struct RemoteInput {
         return endpoint.port();
     }
 
-    /** Function used to respond to having data. */
+    /** Function used to respond to having data, as received. */
     boost::function<void (const std::string &)> onData;
 
+    /** Function called with each message received. */
+    boost::function<void (const std::string & channel,
+                          const std::string & message)> onMessage;
+
+    /** Number of batches that an output may have sent without having them
+        acknowledged.  Taken into account by the connections made after it
+        is set.
+    */
+    uint32_t credits;
+
+    /** Number of messages received, and of batches that were skipped as
+        they had already been received.
+    */
+    uint64_t messagesReceived() const
+    {
+        return numMessages;
+    }
+
+    uint64_t batchesSkipped() const
+    {
+        return numSkipped;
+    }
+
 private:
+    friend struct RemoteInputConnection;
+
+    /** Whether the batch is new, in which case it is recorded as having
+        been received.
+    */
+    bool isNewBatch(uint64_t stream, uint64_t seq);
+
+    std::mutex streamsLock;
+    std::unordered_map<uint64_t, uint64_t> lastSeqs;  ///< Seq per stream
+    std::atomic<uint64_t> numMessages;
+    std::atomic<uint64_t> numSkipped;
+
     PassiveEndpointT<SocketTransport> endpoint;
     boost::function<void ()> onShutdown;
 };
@@ -0,0 +1,213 @@
+/* remote_log_frame.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Framing of the messages between a RemoteOutput and a RemoteInput.
+*/
+
+#include "remote_log_frame.h"
+#include "jml/arch/exception.h"
+#include <zlib.h>
+
+
+using namespace std;
+using namespace ML;
+
+
+namespace Datacratic {
+
+namespace {
+
+/** Largest payload accepted, so that garbage on a connection is detected
+    rather than buffered.
+*/
+enum { MaxPayload = 256 * 1024 * 1024 };
+
+void putLE(std::string & result, uint64_t value, int bytes)
+{
+    for (int i = 0;  i < bytes;  ++i)
+        result.push_back(char((value >> (8 * i)) & 0xff));
+}
+
+uint64_t getLE(const char * data, int bytes)
+{
+    uint64_t result = 0;
+    for (int i = 0;  i < bytes;  ++i)
+        result |= uint64_t((unsigned char)data[i]) << (8 * i);
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* REMOTE LOG FRAME                                                          */
+/*****************************************************************************/
+
+std::string
+RemoteLogFrame::
+encode() const
+{
+    std::string result;
+    result.reserve(HEADER_SIZE + payload.size());
+    putLE(result, MAGIC, 4);
+    putLE(result, type, 2);
+    putLE(result, flags, 2);
+    putLE(result, stream, 8);
+    putLE(result, seq, 8);
+    putLE(result, rawLength, 4);
+    putLE(result, payload.size(), 4);
+    result.append(payload);
+    return result;
+}
+
+std::string
+RemoteLogFrame::
+decodePayload() const
+{
+    if (!(flags & COMPRESSED)) {
+        if (payload.size() != rawLength)
+            throw Exception("remote log batch has length %zd not %d",
+                            payload.size(), (int)rawLength);
+        return payload;
+    }
+
+    if (rawLength > MaxPayload)
+        throw Exception("remote log batch of %d bytes", (int)rawLength);
+
+    std::string result(rawLength, '\0');
+    uLongf length = rawLength;
+    int res = uncompress((Bytef *)&result[0], &length,
+                         (const Bytef *)payload.data(), payload.size());
+    if (res != Z_OK || length != rawLength)
+        throw Exception("remote log batch doesn't decompress: %s",
+                        zError(res));
+    return result;
+}
+
+std::string
+RemoteLogFrame::
+encodeBatch(uint64_t stream, uint64_t seq, const std::string & payload,
+            int compressionLevel)
+{
+    RemoteLogFrame frame;
+    frame.stream = stream;
+    frame.seq = seq;
+    frame.rawLength = payload.size();
+
+    if (compressionLevel > 0 && payload.size() > 64) {
+        uLongf length = compressBound(payload.size());
+        frame.payload.resize(length);
+        int res = compress2((Bytef *)&frame.payload[0], &length,
+                            (const Bytef *)payload.data(), payload.size(),
+                            compressionLevel);
+        if (res != Z_OK)
+            throw Exception("remote log batch compression failed: %s",
+                            zError(res));
+        if (length < payload.size()) {
+            frame.payload.resize(length);
+            frame.flags = COMPRESSED;
+            return frame.encode();
+        }
+    }
+
+    frame.payload = payload;
+    return frame.encode();
+}
+
+std::string
+RemoteLogFrame::
+encodeAck(uint64_t received, uint32_t credits)
+{
+    RemoteLogFrame frame;
+    frame.type = ACK;
+    frame.seq = received;
+    frame.rawLength = credits;
+    return frame.encode();
+}
+
+void
+RemoteLogFrame::
+appendMessage(std::string & payload,
+              const std::string & channel,
+              const std::string & message)
+{
+    putLE(payload, channel.size(), 4);
+    putLE(payload, message.size(), 4);
+    payload.append(channel);
+    payload.append(message);
+}
+
+void
+RemoteLogFrame::
+forEachMessage(const std::string & payload,
+               const std::function<void (const std::string & channel,
+                                         const std::string & message)>
+                   & onMessage)
+{
+    const char * p = payload.data();
+    const char * e = p + payload.size();
+
+    std::string channel, message;
+    while (p < e) {
+        if (e - p < 8)
+            throw Exception("truncated remote log message header");
+        size_t channelLength = getLE(p, 4);
+        size_t messageLength = getLE(p + 4, 4);
+        p += 8;
+        if ((size_t)(e - p) < channelLength + messageLength)
+            throw Exception("truncated remote log message");
+        channel.assign(p, channelLength);
+        p += channelLength;
+        message.assign(p, messageLength);
+        p += messageLength;
+        onMessage(channel, message);
+    }
+}
+
+
+/*****************************************************************************/
+/* REMOTE LOG FRAME PARSER                                                   */
+/*****************************************************************************/
+
+void
+RemoteLogFrameParser::
+feed(const char * data, size_t length, const OnFrame & onFrame)
+{
+    buffer.append(data, length);
+
+    size_t done = 0;
+    while (buffer.size() - done >= RemoteLogFrame::HEADER_SIZE) {
+        const char * header = buffer.data() + done;
+
+        if (getLE(header, 4) != RemoteLogFrame::MAGIC)
+            throw Exception("remote log connection: bad frame magic");
+
+        size_t payloadLength = getLE(header + 28, 4);
+        if (payloadLength > MaxPayload)
+            throw Exception("remote log connection: frame of %zd bytes",
+                            payloadLength);
+        if (buffer.size() - done
+            < RemoteLogFrame::HEADER_SIZE + payloadLength)
+            break;
+
+        RemoteLogFrame frame;
+        unsigned type = getLE(header + 4, 2);
+        if (type != RemoteLogFrame::BATCH && type != RemoteLogFrame::ACK)
+            throw Exception("remote log connection: unknown frame type %d",
+                            type);
+        frame.type = RemoteLogFrame::Type(type);
+        frame.flags = getLE(header + 6, 2);
+        frame.stream = getLE(header + 8, 8);
+        frame.seq = getLE(header + 16, 8);
+        frame.rawLength = getLE(header + 24, 4);
+        frame.payload.assign(header + RemoteLogFrame::HEADER_SIZE,
+                             payloadLength);
+        done += RemoteLogFrame::HEADER_SIZE + payloadLength;
+
+        onFrame(std::move(frame));
+    }
+
+    buffer.erase(0, done);
+}
+
+} // namespace Datacratic
@@ -0,0 +1,137 @@
+/* remote_log_frame.h                                              -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Framing of the messages between a RemoteOutput and a RemoteInput.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* REMOTE LOG FRAME                                                          */
+/*****************************************************************************/
+
+/** Unit of the protocol between a RemoteOutput and a RemoteInput.  Each
+    frame is a fixed 32 byte header followed by the payload:
+
+        uint32 magic         'RLF1'
+        uint16 type          BATCH or ACK
+        uint16 flags         COMPRESSED if the payload is zlib compressed
+        uint64 stream        random id of the RemoteOutput that made it
+        uint64 seq           sequence number within the stream
+        uint32 rawLength     length of the payload once decompressed
+        uint32 length        length of the payload as sent
+
+    all in little endian.
+
+    A BATCH frame carries a number of log messages, each of them as a
+    uint32 channel length, a uint32 message length and the two strings.
+    Batches are compressed one by one rather than as a stream, so that
+    any of them can be replayed on a new connection.
+
+    An ACK frame goes the other way with no payload.  Its seq is the
+    number of batches received so far on the connection, and its rawLength
+    the number of batches that the output may have sent but not had
+    acknowledged (its credits).
+*/
+
+struct RemoteLogFrame {
+
+    enum {
+        MAGIC = 0x31464c52,  // 'RLF1'
+        HEADER_SIZE = 32
+    };
+
+    enum Type {
+        BATCH = 1,
+        ACK = 2
+    };
+
+    enum Flags {
+        COMPRESSED = 1
+    };
+
+    RemoteLogFrame()
+        : type(BATCH), flags(0), stream(0), seq(0), rawLength(0)
+    {
+    }
+
+    Type type;
+    unsigned flags;
+    uint64_t stream;
+    uint64_t seq;
+    uint32_t rawLength;
+    std::string payload;   ///< As sent; see decodePayload()
+
+    /** Encode the frame, header included. */
+    std::string encode() const;
+
+    /** Payload once decompressed.  Throws on a corrupt payload. */
+    std::string decodePayload() const;
+
+    /** Batch frame for the given payload, compressed at the given zlib level
+        (0 for none) unless that doesn't make it smaller.
+    */
+    static std::string encodeBatch(uint64_t stream, uint64_t seq,
+                                   const std::string & payload,
+                                   int compressionLevel = 1);
+
+    static std::string encodeAck(uint64_t received, uint32_t credits);
+
+    /** Append a message to the payload of a batch. */
+    static void appendMessage(std::string & payload,
+                              const std::string & channel,
+                              const std::string & message);
+
+    /** Call onMessage for each of the messages of a decoded batch payload.
+        Throws on a corrupt payload.
+    */
+    static void
+    forEachMessage(const std::string & payload,
+                   const std::function<void (const std::string & channel,
+                                             const std::string & message)>
+                       & onMessage);
+};
+
+
+/*****************************************************************************/
+/* REMOTE LOG FRAME PARSER                                                   */
+/*****************************************************************************/
+
+/** Reassembles the frames out of the data received on a connection, which
+    is split anywhere.
+*/
+
+struct RemoteLogFrameParser {
+
+    typedef std::function<void (RemoteLogFrame && frame)> OnFrame;
+
+    /** Add the given data, calling onFrame for each frame that it completes.
+        Throws an ML::Exception on data that can't be a frame, after which
+        the connection can't be trusted anymore.
+    */
+    void feed(const char * data, size_t length, const OnFrame & onFrame);
+
+    void feed(const std::string & data, const OnFrame & onFrame)
+    {
+        feed(data.c_str(), data.length(), onFrame);
+    }
+
+    /** Bytes waiting for the rest of their frame. */
+    size_t buffered() const
+    {
+        return buffer.size();
+    }
+
+private:
+    std::string buffer;
+};
+
+} // namespace Datacratic
@@ -5,15 +5,12 @@
 */
 
 #include "remote_output.h"
-#include <boost/iostreams/categories.hpp>
-#include <boost/iostreams/filtering_stream.hpp>
-#include <boost/iostreams/filter/bzip2.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
-#include "filter.h"
+#include "remote_log_frame.h"
+#include <boost/bind.hpp>
+#include <random>
 
 using namespace std;
 using namespace ML;
-using namespace boost::iostreams;
 
 namespace Datacratic {
 
@@ -26,15 +23,9 @@ namespace Datacratic {
 struct RemoteOutputConnection
     : public PassiveConnectionHandler {
 
-    RemoteOutputConnection()
-        : messageSerial(0), messageWritten(0)
+    RemoteOutputConnection(RemoteOutput * owner)
+        : owner(owner)
     {
-        std::shared_ptr<ZlibCompressor> filter
-            (new ZlibCompressor());
-        filter->onOutput = boost::bind(&RemoteOutputConnection::write,
-                                       this,
-                                       _1, _2, _4);
-        this->filter = filter;
     }
 
     ~RemoteOutputConnection()
@@ -46,13 +37,28 @@ struct RemoteOutputConnection
     {
         cerr << "on got transport" << endl;
         startReading();
+        scheduleTimerRelative(owner->maxBatchDelay);
     }
 
     virtual void handleData(const std::string & data)
     {
-        // We shouldn't get anything back on this (yet)
-        cerr << "warning: handleData: shouldn't have received anything"
-             << " but got " << data << endl;
+        try {
+            auto onFrame = [&] (RemoteLogFrame && frame)
+                {
+                    if (frame.type != RemoteLogFrame::ACK)
+                        throw ML::Exception("unexpected frame from input");
+                    owner->handleAck(this, frame.seq, frame.rawLength);
+                };
+            parser.feed(data, onFrame);
+        } catch (const std::exception & exc) {
+            doError("remote output: " + string(exc.what()));
+        }
+    }
+
+    virtual void handleTimeout(Date time, size_t cookie)
+    {
+        owner->handleTimer();
+        scheduleTimerRelative(owner->maxBatchDelay);
     }
 
     virtual void handleError(const std::string & error)
@@ -72,59 +78,19 @@ struct RemoteOutputConnection
         closeWhenHandlerFinished();
     }
 
-    void logMessage(const std::string & channel,
-                    const std::string & message,
-                    boost::function<void ()> onMessageDone)
-    {
-        string buf = format("%s\t%s\n\r", channel.c_str(), message.c_str());
-        filter->process(buf, FLUSH_SYNC, onMessageDone);
-    }
-
-    void flush(FlushLevel level = FLUSH_FULL,
-               boost::function<void ()> onFlushDone
-                   = boost::function<void ()>())
+    /** Send a frame; safe to call from any thread. */
+    void sendFrame(const std::string & frame)
     {
-        filter->flush(level, onFlushDone);
-    }
-
-    void close(boost::function<void ()> onCloseDone
-                   = boost::function<void ()>())
-    {
-        cerr << "closing" << endl;
-        filter->flush(FLUSH_FINISH, onCloseDone);
-    }
-
-    size_t messageSerial;
-    size_t messageWritten;
-
-    std::shared_ptr<Filter> filter;
-
-    // TODO: how to deal with dropped messages?
-    std::streamsize write(const char * s, size_t n,
-                          boost::function<void ()> onWriteFinished)
-    {
-        size_t serial JML_UNUSED = ++messageSerial;
-        //cerr << "sending " << n << " bytes" << endl;
-
-        std::string toSend(s, n);
-        
-        auto onSendFinished = [=] ()
-            {
-                ++messageWritten;
-                if (onWriteFinished)
-                    onWriteFinished();
-            };
-        
         auto doSend = [=] ()
             {
-                this->send(toSend, NEXT_CONTINUE, onSendFinished);
+                this->send(frame, NEXT_CONTINUE);
             };
         
         doAsync(doSend, "doSendLog");
-        
-        return n;
     }
-    
+
+    RemoteOutput * owner;
+    RemoteLogFrameParser parser;
 };
 
 
@@ -134,9 +100,18 @@ struct RemoteOutputConnection
 
 RemoteOutput::
 RemoteOutput()
-    : ActiveEndpointT<SocketTransport>("remoteOutput")
+    : ActiveEndpointT<SocketTransport>("remoteOutput"),
+      maxBatchBytes(64 * 1024), maxBatchDelay(0.05), compressionLevel(1),
+      maxBacklog(1000), timeout(10.0),
+      nextSeq(1), batchMessages(0), sentOnConnection(0),
+      ackedOnConnection(0), credits(0),
+      batchesSent(0), batchesAcked(0), batchesSpilled(0), messagesDropped(0),
+      pending(0)
 {
     shuttingDown = false;
+
+    std::random_device random;
+    stream = (uint64_t(random()) << 32) ^ random();
 }
 
 RemoteOutput::
@@ -145,6 +120,16 @@ RemoteOutput::
     shutdown();
 }
 
+void
+RemoteOutput::
+spillTo(const std::string & directory, uint64_t maxBytes,
+        uint64_t segmentSize)
+{
+    Guard guard(lock);
+    spill.reset(new SpillQueue(directory, segmentSize, maxBytes));
+    updatePending();
+}
+
 void
 RemoteOutput::
 connect(int port, const std::string & hostname, double timeout)
@@ -204,11 +189,15 @@ setupConnection(std::shared_ptr<TransportBase> transport,
         {
             try {
                 std::shared_ptr<RemoteOutputConnection> connection
-                    (new RemoteOutputConnection());
+                    (new RemoteOutputConnection(this));
                 transport->associate(connection);
 
+                // Nothing is sent until the input gives us credits
                 Guard guard(this->lock);
                 this->connection = connection;
+                sentOnConnection = 0;
+                ackedOnConnection = 0;
+                credits = 0;
                 if (onFinished) onFinished();
             } catch (const std::exception & exc) {
                 onError("setupConnection: error: " + string(exc.what()));
@@ -221,89 +210,189 @@ setupConnection(std::shared_ptr<TransportBase> transport,
 
 void
 RemoteOutput::
-barrier()
+sealBatch()
 {
-    Guard guard(lock);
+    if (batch.empty())
+        return;
 
-    ACE_Semaphore sem(0);
+    std::string frame = RemoteLogFrame::encodeBatch(stream, nextSeq++, batch,
+                                                    compressionLevel);
+    size_t numMessages = batchMessages;
+    batch.clear();
+    batchMessages = 0;
+
+    bool waiting = spill ? !spill->empty() : !backlog.empty();
+    if (connection && !waiting && sentOnConnection < credits) {
+        unacked.push_back(std::move(frame));
+        ++sentOnConnection;
+        ++batchesSent;
+        connection->sendFrame(unacked.back());
+    }
+    else if (spill) {
+        if (spill->push(frame))
+            ++batchesSpilled;
+        else messagesDropped += numMessages;
+    }
+    else if (backlog.size() < maxBacklog)
+        backlog.push_back(std::move(frame));
+    else messagesDropped += numMessages;
 
-    auto onBarrierDone = [&] ()
-        {
-            sem.release();
-        };
+    updatePending();
+}
 
-    auto finishBarrier = [&] ()
-        {
-            this->connection->flush(FLUSH_NONE, onBarrierDone);
-        };
+void
+RemoteOutput::
+pump()
+{
+    if (!connection)
+        return;
 
-    connection->doAsync(finishBarrier, "finishBarrier");
-    
-    sem.acquire();
+    // First those that weren't acknowledged on a previous connection
+    while (sentOnConnection < credits && sentOnConnection < unacked.size()) {
+        connection->sendFrame(unacked[sentOnConnection++]);
+        ++batchesSent;
+    }
+
+    std::string frame;
+    while (sentOnConnection < credits) {
+        if (spill && spill->front(frame))
+            spill->pop();
+        else if (!spill && !backlog.empty()) {
+            frame = std::move(backlog.front());
+            backlog.pop_front();
+        }
+        else break;
+
+        unacked.push_back(std::move(frame));
+        ++sentOnConnection;
+        ++batchesSent;
+        connection->sendFrame(unacked.back());
+    }
 }
 
 void
 RemoteOutput::
-sync()
+updatePending()
+{
+    uint64_t numPending = unacked.size() + backlog.size()
+        + (spill ? spill->size() : 0) + !batch.empty();
+    if (numPending == pending)
+        return;
+
+    {
+        std::lock_guard<std::mutex> pendingGuard(pendingLock);
+        pending = numPending;
+    }
+    pendingChanged.notify_all();
+}
+
+void
+RemoteOutput::
+handleAck(RemoteOutputConnection * connection,
+          uint64_t received, uint32_t credits)
 {
     Guard guard(lock);
 
-    ACE_Semaphore sem(0);
+    // Acks for a connection that was replaced
+    if (this->connection.get() != connection)
+        return;
 
-    auto onSyncDone = [&] ()
-        {
-            sem.release();
-        };
+    if (received < ackedOnConnection
+        || received - ackedOnConnection > sentOnConnection) {
+        cerr << "remote output: input acknowledged " << received
+             << " batches but was only sent "
+             << ackedOnConnection + sentOnConnection << endl;
+        return;
+    }
 
-    auto finishSync = [&] ()
-        {
-            this->connection->flush(FLUSH_SYNC, onSyncDone);
-        };
+    size_t numAcked = received - ackedOnConnection;
+    unacked.erase(unacked.begin(), unacked.begin() + numAcked);
+    sentOnConnection -= numAcked;
+    ackedOnConnection = received;
+    batchesAcked += numAcked;
+    this->credits = credits;
 
-    connection->doAsync(finishSync, "finishSync");
-    
-    sem.acquire();
+    pump();
+    updatePending();
 }
 
 void
 RemoteOutput::
-flush()
+handleTimer()
+{
+    Guard guard(lock);
+    if (!batch.empty()
+        && Date::now().secondsSince(batchStarted) >= maxBatchDelay)
+        sealBatch();
+    pump();
+}
+
+void
+RemoteOutput::
+barrier()
 {
     Guard guard(lock);
 
+    sealBatch();
+    pump();
+
+    if (!connection)
+        return;
+
     ACE_Semaphore sem(0);
 
-    auto onFlushDone = [&] ()
+    // Runs once the sends queued so far were handed to the socket
+    auto finishBarrier = [&] ()
         {
             sem.release();
         };
 
-    auto finishFlush = [&] ()
-        {
-            this->connection->flush(FLUSH_FULL, onFlushDone);
-        };
-
-    connection->doAsync(finishFlush, "finishFlush");
+    connection->doAsync(finishBarrier, "finishBarrier");
     
     sem.acquire();
 }
 
+void
+RemoteOutput::
+sync()
+{
+    flush();
+}
+
+bool
+RemoteOutput::
+flush()
+{
+    {
+        Guard guard(lock);
+        sealBatch();
+        pump();
+        updatePending();
+    }
+
+    std::unique_lock<std::mutex> pendingGuard(pendingLock);
+    return pendingChanged.wait_for(pendingGuard,
+                                   std::chrono::duration<double>(timeout),
+                                   [&] () { return pending == 0; });
+}
+
 void
 RemoteOutput::
 close()
 {
+    flush();
+
     Guard guard(lock);
 
-    ACE_Semaphore sem(0);
+    if (!connection)
+        return;
 
-    auto onCloseDone = [&] ()
-        {
-            sem.release();
-        };
+    ACE_Semaphore sem(0);
 
     auto finishClose = [&] ()
         {
-            this->connection->close(onCloseDone);
+            this->connection->closeWhenHandlerFinished();
+            sem.release();
         };
 
     connection->doAsync(finishClose, "finishClose");
@@ -315,10 +404,15 @@ void
 RemoteOutput::
 shutdown()
 {
-    shuttingDown = true;
+    {
+        Guard guard(lock);
+        shuttingDown = true;
+    }
 
+    // Give the input its chance to acknowledge what's outstanding; the
+    // spill queue keeps what's waiting for the next process.
     if (connection)
-        connection->flush();
+        flush();
 
     ActiveEndpointT<SocketTransport>::shutdown();
 
@@ -335,22 +429,36 @@ logMessage(const std::string & channel,
     if (shuttingDown)
         throw Exception("attempt to log message whilst shutting down");
 
-    if (!connection) {
-        cerr << "adding to backlog; currently " << backlog.size()
-             << " messages" << endl;
-        backlog.push_back(make_pair(channel, message));
-        return;
+    if (batch.empty())
+        batchStarted = Date::now();
+    RemoteLogFrame::appendMessage(batch, channel, message);
+    ++batchMessages;
+
+    if (batch.size() >= maxBatchBytes) {
+        sealBatch();
+        pump();
     }
+}
 
-    auto onMessageLogged = [] () {};
+Json::Value
+RemoteOutput::
+stats() const
+{
+    Guard guard(lock);
 
-    // Safe to call from any thread on the connection
-    connection->doAsync(std::bind(&RemoteOutputConnection::logMessage,
-                                  connection,
-                                  channel,
-                                  message,
-                                  onMessageLogged),
-                        "logMessage");
+    Json::Value result;
+    result["batchesSent"] = (Json::UInt)batchesSent;
+    result["batchesAcked"] = (Json::UInt)batchesAcked;
+    result["batchesSpilled"] = (Json::UInt)batchesSpilled;
+    result["messagesDropped"] = (Json::UInt)messagesDropped;
+    result["unacked"] = (Json::UInt)unacked.size();
+    result["credits"] = credits;
+    result["backlog"] = (Json::UInt)backlog.size();
+    if (spill) {
+        result["spilled"] = (Json::UInt)spill->size();
+        result["spilledBytes"] = (Json::UInt)spill->bytes();
+    }
+    return result;
 }
 
 void
@@ -361,7 +469,10 @@ notifyCloseTransport(const std::shared_ptr<TransportBase> & transport)
 
     ActiveEndpointT<SocketTransport>::notifyCloseTransport(transport);
 
+    // The unacknowledged batches are sent again on the next connection
     this->connection.reset();
+    sentOnConnection = 0;
+    credits = 0;
 
     if (shuttingDown) return;
 
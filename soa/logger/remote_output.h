@@ -10,7 +10,12 @@
 #pragma once
 
 #include "logger.h"
+#include "spill_queue.h"
 #include "soa/service/active_endpoint.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 
 
 namespace Datacratic {
@@ -25,6 +30,20 @@ struct RemoteOutputConnection;
 
 /** Logging output class that establishes a connection to another machine and
     sends zipped versions of the log file to that machine.
+
+    The messages are sent in batches (see RemoteLogFrame), which are sealed
+    once they reach maxBatchBytes or are maxBatchDelay seconds old.  The
+    flow of batches is credit based: the RemoteInput tells how many batches
+    may be awaiting its acknowledgement, and the batches past that wait
+    until it acknowledges some, so that a slow collector slows the output
+    down instead of having its buffers grow.  The waiting batches go to the
+    spill queue on disk if spillTo() was called, and otherwise to a
+    backlog of at most maxBacklog batches in memory, past which messages
+    are dropped.
+
+    The batches that were sent but not acknowledged are sent again on the
+    next connection, followed by the waiting ones.  The input recognizes
+    the batches it already got, so that each message gets through once.
 */
 
 struct RemoteOutput
@@ -35,6 +54,31 @@ struct RemoteOutput
 
     virtual ~RemoteOutput();
 
+    /** Payload size at which a batch is sent. */
+    size_t maxBatchBytes;
+
+    /** Longest time in seconds that a message waits for its batch to
+        fill up.
+    */
+    double maxBatchDelay;
+
+    /** zlib compression level of the batches; 0 for none. */
+    int compressionLevel;
+
+    /** Batches kept in memory when they can't be sent, if there is no
+        spill queue.
+    */
+    size_t maxBacklog;
+
+    /** Keep the batches that can't be sent in a spill queue in the given
+        directory rather than in memory, up to maxBytes of them (0 for no
+        limit).  Batches from a previous process are sent first.  To be
+        called before connect().
+    */
+    void spillTo(const std::string & directory,
+                 uint64_t maxBytes = 0,
+                 uint64_t segmentSize = 64 * 1024 * 1024);
+
     /** Connect to the remote endpoint and start sending on down those logs. */
     void connect(int port, const std::string & hostname, double timeout = 10.0);
     
@@ -45,11 +89,13 @@ struct RemoteOutput
         returning from this function. */
     void barrier();
 
-    /** Flush out the current messages, waiting until everything is done
-        before we stop. */
-    void flush();
+    /** Flush out the current messages, waiting until they have all been
+        acknowledged by the input or until the connection timeout.  Returns
+        whether they all were.
+    */
+    bool flush();
 
-    /** Sync all data and wait for it to finish */
+    /** Same as flush(). */
     void sync();
 
     /** Close the connection. */
@@ -58,6 +104,8 @@ struct RemoteOutput
     virtual void logMessage(const std::string & channel,
                             const std::string & message);
 
+    virtual Json::Value stats() const;
+
     /** Notification that a connection was closed.  This can be used to give a
         new set of data.
     */
@@ -70,6 +118,8 @@ struct RemoteOutput
     boost::function<void (const std::string)> onConnectionError;
 
 private:
+    friend struct RemoteOutputConnection;
+
     /** Internal helper function used to reconnect to the remote server. */
     void reconnect(boost::function<void ()> onFinished,
                    boost::function<void (const std::string &)> onError,
@@ -83,14 +133,56 @@ private:
                          boost::function<void ()> onFinished,
                          boost::function<void (const std::string &)> onError);
 
+    /** Turn the current batch into a frame and queue it. */
+    void sealBatch();
+
+    /** Send whatever the credits allow. */
+    void pump();
+
+    /** The input acknowledged received batches on the connection and allows
+        credits of them to be unacknowledged.
+    */
+    void handleAck(RemoteOutputConnection * connection,
+                   uint64_t received, uint32_t credits);
+
+    /** Called periodically from the connection to send the batches that
+        are old enough.
+    */
+    void handleTimer();
+
+    void updatePending();
+
     int port;
     std::string hostname;
     double timeout;
     std::shared_ptr<RemoteOutputConnection> connection;
     bool shuttingDown;
 
-    /** Backlog of messages to send whilst connection is down. */
-    std::vector<std::pair<std::string, std::string> > backlog;
+    uint64_t stream;             ///< Identifies our batches to the input
+    uint64_t nextSeq;
+    std::string batch;           ///< Payload of the batch being filled
+    size_t batchMessages;
+    Date batchStarted;
+
+    /** Batches sent but not acknowledged, in order.  The first
+        sentOnConnection of them were sent on the current connection.
+    */
+    std::deque<std::string> unacked;
+    size_t sentOnConnection;
+    uint64_t ackedOnConnection;
+    uint32_t credits;
+
+    /** Batches waiting for credits, when there's no spill queue. */
+    std::deque<std::string> backlog;
+    std::unique_ptr<SpillQueue> spill;
+
+    uint64_t batchesSent, batchesAcked, batchesSpilled;
+    uint64_t messagesDropped;
+
+    /** Number of batches not yet acknowledged, for flush() to wait on. */
+    std::atomic<uint64_t> pending;
+    std::mutex pendingLock;
+    std::condition_variable pendingChanged;
 };
 
 } // namespace Datacratic
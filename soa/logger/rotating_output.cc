@@ -20,6 +20,7 @@ namespace Datacratic {
 
 RotatingOutput::
 RotatingOutput()
+    : openAhead(0.0)
 {
 }
 
@@ -80,6 +81,12 @@ performRotation()
     rotateSubordinate(currentPeriodStart);
 }
 
+void
+RotatingOutput::
+prepareSubordinate(Date newDate)
+{
+}
+
 void
 RotatingOutput::
 runRotateThread()
@@ -89,14 +96,25 @@ runRotateThread()
     up_ = true;
     futex_wake(up_);
 
+    Date prepared;
+
     while (!shutdown_) {
         Date now = Date::now();
         Date nextRotation = currentPeriodStart.plusSeconds(interval);
         double secondsUntilRotation = now.secondsUntil(nextRotation);
+        double secondsUntilPrepare = secondsUntilRotation - openAhead;
 
         if (secondsUntilRotation <= 0) {
             performRotation();
         }
+        else if (openAhead > 0 && prepared != nextRotation) {
+            if (secondsUntilPrepare <= 0) {
+                Guard guard(lock);
+                prepareSubordinate(nextRotation);
+                prepared = nextRotation;
+            }
+            else futex_wait(shutdown_, false, secondsUntilPrepare);
+        }
         else {
             futex_wait(shutdown_, false, secondsUntilRotation);
         }
@@ -181,8 +199,8 @@ rotateSubordinate(Date currentPeriodStart)
     if (onBeforeLogRotation)
         onBeforeLogRotation(oldFilename, newFilename);
 
-    // We don't close, as calling openSubordinate() will automatically close
-    // the old one once it's not in use anymore
+    // We don't close, as calling openSubordinate() will close the old one
+    // once it's not in use anymore
     openSubordinate(currentPeriodStart);
     
     if (onAfterLogRotation)
@@ -193,9 +211,11 @@ void
 RotatingOutputAdaptor::
 closeSubordinate()
 {
-    if (logger)
-        logger()->close();
-    logger.replace(0);
+    if (nextLogger) {
+        nextLogger->close();
+        nextLogger.reset();
+    }
+    replaceSubordinate(0);
 }
 
 void
@@ -203,7 +223,44 @@ RotatingOutputAdaptor::
 openSubordinate(Date currentPeriodStart)
 {
     currentFilename = filenameFor(currentPeriodStart, filenamePattern);
-    logger.replace(loggerFactory(currentFilename));
+
+    std::unique_ptr<LogOutput> newLogger;
+    if (nextLogger && nextFilename == currentFilename)
+        newLogger = std::move(nextLogger);
+    else {
+        if (nextLogger) {
+            nextLogger->close();
+            nextLogger.reset();
+        }
+        newLogger.reset(loggerFactory(currentFilename));
+    }
+
+    replaceSubordinate(newLogger.release());
+}
+
+void
+RotatingOutputAdaptor::
+prepareSubordinate(Date newDate)
+{
+    if (nextLogger)
+        nextLogger->close();
+    nextLogger.reset();
+
+    nextFilename = filenameFor(newDate, filenamePattern);
+    nextLogger.reset(loggerFactory(nextFilename));
+}
+
+void
+RotatingOutputAdaptor::
+replaceSubordinate(LogOutput * newLogger)
+{
+    std::unique_ptr<LogOutput> oldLogger
+        = logger.replaceCustomCleanup(newLogger);
+    if (!oldLogger)
+        return;
+
+    gcLock.visibleBarrier();
+    oldLogger->close();
 }
 
 
@@ -35,6 +35,13 @@ struct RotatingOutput : public LogOutput {
 
     virtual void close();
 
+    /** Number of seconds before each rotation at which the next sink is
+        prepared with prepareSubordinate(), so that the rotation itself only
+        has to swap it in.  Zero (the default) prepares nothing.  Taken into
+        account by the next call to open().
+    */
+    double openAhead;
+
 protected:
     typedef boost::recursive_mutex Lock;
     mutable Lock lock;
@@ -64,6 +71,13 @@ protected:
 
     /** Subclass must override to close the current sink. */
     virtual void closeSubordinate() = 0;
+
+    /** Subclass can override this to get the sink for the given date
+        ready ahead of time; see openAhead.  It is called from the rotation
+        thread before the rotateSubordinate() call for the same date.  The
+        default does nothing.
+    */
+    virtual void prepareSubordinate(Date newDate);
     
 private:
     /// Thread to do the rotating
@@ -131,11 +145,23 @@ private:
 
     std::string currentFilename;
 
+    /** Logger opened ahead of the next rotation, for nextFilename. */
+    std::unique_ptr<LogOutput> nextLogger;
+    std::string nextFilename;
+
     virtual void openSubordinate(Date newDate);
 
     virtual void rotateSubordinate(Date newDate);
 
     virtual void closeSubordinate();
+
+    virtual void prepareSubordinate(Date newDate);
+
+    /** Swap in the given logger, then close the old one from the calling
+        thread once the logging threads are done with it, rather than from
+        whichever of them leaves it last.
+    */
+    void replaceSubordinate(LogOutput * newLogger);
 };
 
 
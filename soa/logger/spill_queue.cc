@@ -0,0 +1,387 @@
+/* spill_queue.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Queue of records on disk.
+*/
+
+#include "spill_queue.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+
+using namespace std;
+using namespace ML;
+namespace fs = boost::filesystem;
+
+
+namespace Datacratic {
+
+namespace {
+
+/** Each record is its length and crc32, then its data. */
+enum { RecordHeader = 8 };
+
+void encodeHeader(char * header, uint32_t length, uint32_t crc)
+{
+    for (int i = 0;  i < 4;  ++i) {
+        header[i] = (length >> (8 * i)) & 0xff;
+        header[i + 4] = (crc >> (8 * i)) & 0xff;
+    }
+}
+
+void decodeHeader(const char * header, uint32_t & length, uint32_t & crc)
+{
+    length = crc = 0;
+    for (int i = 0;  i < 4;  ++i) {
+        length |= uint32_t((unsigned char)header[i]) << (8 * i);
+        crc |= uint32_t((unsigned char)header[i + 4]) << (8 * i);
+    }
+}
+
+uint32_t checksum(const char * data, size_t length)
+{
+    return crc32(crc32(0, Z_NULL, 0), (const Bytef *)data, length);
+}
+
+/** Read exactly length bytes at offset, or return false. */
+bool readAt(int fd, char * data, size_t length, uint64_t offset)
+{
+    while (length > 0) {
+        ssize_t res = ::pread(fd, data, length, offset);
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res == -1)
+            throw ML::Exception(errno, "pread of spill segment");
+        if (res == 0)
+            return false;
+        data += res;
+        length -= res;
+        offset += res;
+    }
+    return true;
+}
+
+void writeAll(int fd, const char * data, size_t length,
+              const std::string & filename)
+{
+    while (length > 0) {
+        ssize_t res = ::write(fd, data, length);
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res == -1)
+            throw ML::Exception(errno, "write to spill segment " + filename);
+        data += res;
+        length -= res;
+    }
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* SPILL QUEUE                                                               */
+/*****************************************************************************/
+
+struct SpillQueue::Itl {
+
+    struct Segment {
+        Segment(uint64_t number, const std::string & filename)
+            : number(number), filename(filename), fd(-1), bytes(0),
+              records(0)
+        {
+        }
+
+        uint64_t number;
+        std::string filename;
+        int fd;
+        uint64_t bytes;     ///< Valid bytes in the file
+        uint64_t records;   ///< Records in the file, popped or not
+    };
+
+    Itl(const std::string & directory, uint64_t segmentSize,
+        uint64_t maxBytes)
+        : directory(directory), segmentSize(segmentSize), maxBytes(maxBytes),
+          readOffset(0), readRecords(0), size(0), bytes(0), cursorFd(-1)
+    {
+        fs::create_directories(directory);
+        recover();
+    }
+
+    ~Itl()
+    {
+        for (auto & segment: segments)
+            if (segment.fd != -1)
+                ::close(segment.fd);
+        if (cursorFd != -1)
+            ::close(cursorFd);
+    }
+
+    std::string directory;
+    uint64_t segmentSize;
+    uint64_t maxBytes;
+
+    std::deque<Segment> segments;
+    uint64_t readOffset;    ///< Offset of the front record in segments[0]
+    uint64_t readRecords;   ///< Records of segments[0] already popped
+    uint64_t size;
+    uint64_t bytes;
+
+    /** File with the segment, offset and number of records of the front
+        record, so that the popped records stay popped over a restart.
+    */
+    int cursorFd;
+
+    std::string filename(uint64_t number) const
+    {
+        return directory + format("/segment-%012llu.spill",
+                                  (unsigned long long)number);
+    }
+
+    void open(Segment & segment)
+    {
+        segment.fd = ::open(segment.filename.c_str(),
+                            O_RDWR | O_CREAT, 0644);
+        if (segment.fd == -1)
+            throw ML::Exception(errno, "open of " + segment.filename);
+    }
+
+    /** Pick up the segments of a previous instance, checking their records;
+        anything past the first bad one is truncated away.
+    */
+    void recover()
+    {
+        std::vector<uint64_t> numbers;
+        for (fs::directory_iterator it(directory), end;  it != end;  ++it) {
+            std::string name = it->path().filename().string();
+            unsigned long long number;
+            char tail;
+            if (sscanf(name.c_str(), "segment-%llu.spil%c", &number, &tail)
+                == 2 && tail == 'l')
+                numbers.push_back(number);
+        }
+        std::sort(numbers.begin(), numbers.end());
+
+        std::string data;
+        for (uint64_t number: numbers) {
+            segments.emplace_back(number, filename(number));
+            Segment & segment = segments.back();
+            open(segment);
+
+            char header[RecordHeader];
+            for (;;) {
+                uint32_t length, crc;
+                if (!readAt(segment.fd, header, RecordHeader, segment.bytes))
+                    break;
+                decodeHeader(header, length, crc);
+                data.resize(length);
+                if (!readAt(segment.fd, &data[0], length,
+                            segment.bytes + RecordHeader)
+                    || checksum(data.data(), length) != crc)
+                    break;
+                segment.bytes += RecordHeader + length;
+                ++segment.records;
+            }
+
+            if (::ftruncate(segment.fd, segment.bytes) == -1)
+                throw ML::Exception(errno, "ftruncate of " + segment.filename);
+
+            if (segment.records == 0) {
+                ::close(segment.fd);
+                ::unlink(segment.filename.c_str());
+                segments.pop_back();
+                continue;
+            }
+
+            size += segment.records;
+            bytes += segment.bytes;
+        }
+
+        std::string cursorFilename = directory + "/cursor";
+        cursorFd = ::open(cursorFilename.c_str(), O_RDWR | O_CREAT, 0644);
+        if (cursorFd == -1)
+            throw ML::Exception(errno, "open of " + cursorFilename);
+
+        uint64_t cursor[3];
+        if (!segments.empty()
+            && readAt(cursorFd, (char *)cursor, sizeof(cursor), 0)
+            && cursor[0] == segments.front().number
+            && cursor[1] <= segments.front().bytes
+            && cursor[2] <= segments.front().records) {
+            readOffset = cursor[1];
+            readRecords = cursor[2];
+            size -= readRecords;
+            bytes -= readOffset;
+        }
+        writeCursor();
+    }
+
+    void writeCursor()
+    {
+        uint64_t cursor[3] = {
+            segments.empty() ? 0 : segments.front().number,
+            readOffset, readRecords
+        };
+        ssize_t res = ::pwrite(cursorFd, cursor, sizeof(cursor), 0);
+        if (res != sizeof(cursor))
+            throw ML::Exception(errno, "write of spill queue cursor");
+    }
+
+    Segment & writeSegment(size_t length)
+    {
+        if (segments.empty()
+            || (segments.back().bytes > 0
+                && segments.back().bytes + length > segmentSize)) {
+            uint64_t number = segments.empty() ? 0 : segments.back().number + 1;
+            segments.emplace_back(number, filename(number));
+            open(segments.back());
+        }
+        return segments.back();
+    }
+
+    bool push(const std::string & record)
+    {
+        size_t length = RecordHeader + record.size();
+        if (maxBytes && bytes + length > maxBytes)
+            return false;
+
+        Segment & segment = writeSegment(length);
+
+        char header[RecordHeader];
+        encodeHeader(header, record.size(),
+                     checksum(record.data(), record.size()));
+
+        if (::lseek(segment.fd, segment.bytes, SEEK_SET) == -1)
+            throw ML::Exception(errno, "lseek of " + segment.filename);
+        writeAll(segment.fd, header, RecordHeader, segment.filename);
+        writeAll(segment.fd, record.data(), record.size(), segment.filename);
+
+        segment.bytes += length;
+        ++segment.records;
+        ++size;
+        bytes += length;
+        return true;
+    }
+
+    bool front(std::string & record)
+    {
+        if (size == 0)
+            return false;
+
+        Segment & segment = segments.front();
+        char header[RecordHeader];
+        uint32_t length, crc;
+        if (!readAt(segment.fd, header, RecordHeader, readOffset))
+            throw ML::Exception("spill segment " + segment.filename
+                                + " was truncated");
+        decodeHeader(header, length, crc);
+        record.resize(length);
+        if (!readAt(segment.fd, &record[0], length, readOffset + RecordHeader)
+            || checksum(record.data(), length) != crc)
+            throw ML::Exception("spill segment " + segment.filename
+                                + " is corrupt");
+        return true;
+    }
+
+    void pop()
+    {
+        if (size == 0)
+            throw ML::Exception("pop of empty spill queue");
+
+        Segment & segment = segments.front();
+        char header[RecordHeader];
+        uint32_t length, crc;
+        if (!readAt(segment.fd, header, RecordHeader, readOffset))
+            throw ML::Exception("spill segment " + segment.filename
+                                + " was truncated");
+        decodeHeader(header, length, crc);
+
+        readOffset += RecordHeader + length;
+        ++readRecords;
+        --size;
+        bytes -= RecordHeader + length;
+
+        if (readRecords < segment.records) {
+            writeCursor();
+            return;
+        }
+
+        // Segment finished.  The last one is kept for the writes to come,
+        // but emptied so that it doesn't grow forever.
+        if (segments.size() == 1) {
+            if (::ftruncate(segment.fd, 0) == -1)
+                throw ML::Exception(errno, "ftruncate of " + segment.filename);
+            segment.bytes = segment.records = 0;
+        }
+        else {
+            ::close(segment.fd);
+            ::unlink(segment.filename.c_str());
+            segments.pop_front();
+        }
+        readOffset = readRecords = 0;
+        writeCursor();
+    }
+};
+
+SpillQueue::
+SpillQueue(const std::string & directory, uint64_t segmentSize,
+           uint64_t maxBytes)
+    : directory_(directory),
+      itl(new Itl(directory, segmentSize, maxBytes))
+{
+}
+
+SpillQueue::
+~SpillQueue()
+{
+}
+
+bool
+SpillQueue::
+push(const std::string & record)
+{
+    return itl->push(record);
+}
+
+bool
+SpillQueue::
+front(std::string & record)
+{
+    return itl->front(record);
+}
+
+void
+SpillQueue::
+pop()
+{
+    itl->pop();
+}
+
+uint64_t
+SpillQueue::
+size() const
+{
+    return itl->size;
+}
+
+uint64_t
+SpillQueue::
+bytes() const
+{
+    return itl->bytes;
+}
+
+size_t
+SpillQueue::
+numSegments() const
+{
+    return itl->segments.size();
+}
+
+} // namespace Datacratic
@@ -0,0 +1,83 @@
+/* spill_queue.h                                                   -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Queue of records on disk, for the data that can't be sent yet.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* SPILL QUEUE                                                               */
+/*****************************************************************************/
+
+/** First in, first out queue of records kept in segment files of a
+    directory.  Records are appended to the newest segment, which is
+    replaced by a new one when it reaches segmentSize bytes; a segment is
+    deleted once all of its records were popped.
+
+    The segments left in the directory by a previous instance are picked
+    up by the constructor, along with the position of its front record, so
+    that what was spilled and not popped survives a restart.
+    Each record has a checksum and a record that was only partly written
+    when the previous instance stopped is discarded along with what
+    follows it in its segment.
+
+    The records aren't synced to disk as they are written.  Not thread
+    safe.
+*/
+
+struct SpillQueue {
+
+    SpillQueue(const std::string & directory,
+               uint64_t segmentSize = 64 * 1024 * 1024,
+               uint64_t maxBytes = 0 /* unlimited */);
+
+    ~SpillQueue();
+
+    /** Add the record at the back of the queue.  Returns false, without
+        adding it, if that would take the queue past maxBytes.
+    */
+    bool push(const std::string & record);
+
+    /** Put the record at the front of the queue into record.  Returns false
+        if the queue is empty.
+    */
+    bool front(std::string & record);
+
+    /** Remove the record at the front of the queue. */
+    void pop();
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    /** Number of records in the queue. */
+    uint64_t size() const;
+
+    /** Bytes on disk taken by the records of the queue. */
+    uint64_t bytes() const;
+
+    /** Number of segment files. */
+    size_t numSegments() const;
+
+    const std::string & directory() const
+    {
+        return directory_;
+    }
+
+private:
+    std::string directory_;
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+} // namespace Datacratic
@@ -0,0 +1,112 @@
+/* async_batch_queue_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests of the queue of batches written asynchronously.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "soa/logger/async_batch_queue.h"
+#include "jml/arch/exception.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_async_batch_queue_batches )
+{
+    std::mutex lock;
+    vector<size_t> batchSizes;
+    vector<int> written;
+
+    auto onBatch = [&] (vector<int> & batch)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            batchSizes.push_back(batch.size());
+            written.insert(written.end(), batch.begin(), batch.end());
+        };
+
+    {
+        AsyncBatchQueue<int> queue(onBatch, 100 /* batch size */,
+                                   10.0 /* delay */);
+        for (int i = 0;  i < 1000;  ++i)
+            BOOST_CHECK(queue.push(i));
+        queue.flush();
+
+        std::lock_guard<std::mutex> guard(lock);
+        BOOST_CHECK_EQUAL(written.size(), 1000);
+        for (size_t size: batchSizes)
+            BOOST_CHECK_LE(size, 100);
+        BOOST_CHECK_EQUAL(queue.written(), 1000);
+    }
+
+    for (int i = 0;  i < 1000;  ++i)
+        BOOST_CHECK_EQUAL(written[i], i);
+
+    // Items that don't fill a batch go after the delay, without a flush
+    batchSizes.clear();
+    {
+        AsyncBatchQueue<int> queue(onBatch, 100, 0.01);
+        queue.push(1);
+        for (int i = 0;  i < 500;  ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            std::lock_guard<std::mutex> guard(lock);
+            if (!batchSizes.empty())
+                break;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        BOOST_REQUIRE_EQUAL(batchSizes.size(), 1);
+        BOOST_CHECK_EQUAL(batchSizes[0], 1);
+    }
+
+    // What's still queued is written on destruction
+    batchSizes.clear();
+    written.clear();
+    {
+        AsyncBatchQueue<int> queue(onBatch, 100, 10.0);
+        queue.push(7);
+    }
+    BOOST_CHECK_EQUAL(written.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_async_batch_queue_bounds )
+{
+    std::mutex blocked;
+    blocked.lock();
+
+    int numWritten = 0;
+    auto onBatch = [&] (vector<int> & batch)
+        {
+            // Holds the writer until the queue was filled
+            std::lock_guard<std::mutex> guard(blocked);
+            numWritten += batch.size();
+            if (batch[0] == -1)
+                throw ML::Exception("write error");
+        };
+
+    AsyncBatchQueue<int> queue(onBatch, 1, 10.0, 10 /* queue size */);
+    queue.push(0);
+
+    // The writer takes the first item and waits; the rest fills the queue
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    int numPushed = 0;
+    for (int i = 0;  i < 100;  ++i)
+        numPushed += queue.push(i);
+
+    BOOST_CHECK_EQUAL(numPushed, 10);
+    BOOST_CHECK_EQUAL(queue.dropped(), 90);
+
+    blocked.unlock();
+    queue.flush();
+    BOOST_CHECK_EQUAL(numWritten, 11);
+
+    // Errors are counted rather than stopping the writer
+    queue.push(-1);
+    queue.push(3);
+    queue.flush();
+    BOOST_CHECK_EQUAL(queue.errors(), 1);
+    BOOST_CHECK_EQUAL(numWritten, 13);
+}
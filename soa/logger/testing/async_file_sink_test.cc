@@ -0,0 +1,99 @@
+/* async_file_sink_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests of the asynchronous file sink.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include "soa/logger/file_output.h"
+#include "jml/arch/exception.h"
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+namespace {
+
+string readFile(const string & filename)
+{
+    ifstream stream(filename);
+    return string(istreambuf_iterator<char>(stream),
+                  istreambuf_iterator<char>());
+}
+
+/** Write the input in chunks of varying sizes, flushing now and then. */
+void writeAll(AsyncFileSink & sink, const string & input)
+{
+    for (size_t i = 0, n = 0;  i < input.size();  ++n) {
+        size_t len = std::min<size_t>(1 + (n * 7919) % 20000,
+                                      input.size() - i);
+        BOOST_CHECK_EQUAL(sink.write(input.data() + i, len), len);
+        i += len;
+        if (n % 13 == 0)
+            sink.flush(FLUSH_TO_OS);
+    }
+}
+
+string makeInput(size_t size)
+{
+    string result;
+    while (result.size() < size)
+        result += "message " + to_string(result.size()) + "\n";
+    result.resize(size);
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_async_file_sink )
+{
+    string filename = "tmp/async_file_sink_test.log";
+    ::unlink(filename.c_str());
+    string input = makeInput(3000001);
+
+    AsyncFileSink::Options options;
+    options.bufferSize = 65536;
+    options.preallocate = 1 << 20;
+
+    {
+        AsyncFileSink sink(filename, false, options);
+        writeAll(sink, input);
+        sink.flush(FLUSH_TO_OS);
+        // Flushed data is in the file, but the preallocation doesn't count
+        BOOST_CHECK_EQUAL(readFile(filename).size(), input.size());
+        sink.close();
+    }
+    BOOST_CHECK(readFile(filename) == input);
+}
+
+BOOST_AUTO_TEST_CASE( test_async_file_sink_direct )
+{
+    string filename = "tmp/async_file_sink_direct_test.log";
+    ::unlink(filename.c_str());
+    string input = makeInput(1000003);
+
+    AsyncFileSink::Options options;
+    options.bufferSize = 10000;
+    options.direct = true;
+
+    try {
+        AsyncFileSink sink(filename, false, options);
+        writeAll(sink, input);
+        sink.close();
+    } catch (const ML::Exception & exc) {
+        // Some filesystems, like tmpfs, don't support O_DIRECT
+        BOOST_TEST_MESSAGE("O_DIRECT unsupported: " << exc.what());
+        return;
+    }
+
+    BOOST_CHECK(readFile(filename) == input);
+}
@@ -0,0 +1,204 @@
+/* columnar_log_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests of the columnar log format.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <algorithm>
+#include <fstream>
+
+#include <boost/test/unit_test.hpp>
+
+#include "soa/logger/columnar_log.h"
+#include "soa/types/basic_value_descriptions.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+struct Request {
+    std::string id;
+    int width;
+};
+
+CREATE_STRUCTURE_DESCRIPTION(Request)
+
+RequestDescription::
+RequestDescription()
+{
+    addField("id", &Request::id, "");
+    addField("width", &Request::width, "");
+}
+
+namespace {
+
+struct FileWriter {
+    FileWriter(const std::string & filename, size_t rowsPerBlock)
+        : stream(filename),
+          writer([&] (const char * data, size_t len)
+                 {
+                     stream.write(data, len);
+                     return len;
+                 },
+                 0, rowsPerBlock)
+    {
+    }
+
+    void finish()
+    {
+        writer.finish();
+        stream.close();
+    }
+
+    std::ofstream stream;
+    ColumnarLogWriter writer;
+};
+
+string requestJson(int i)
+{
+    return "{\"id\":\"req" + to_string(i) + "\",\"width\":" + to_string(300)
+        + (i % 10 == 0 ? ",\"extra\":true}" : "}");
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_columnar_round_trip )
+{
+    string filename = "tmp/columnar_log_test.col";
+
+    vector<pair<string, string> > messages;
+    {
+        FileWriter file(filename, 100);
+        file.writer.addChannel("AUCTION",
+                               { { "timestamp" },
+                                 { "exchange" },
+                                 { "request",
+                                   getDefaultDescriptionShared((Request *)0) }
+                               });
+
+        for (unsigned i = 0;  i < 1050;  ++i) {
+            string request = (i % 100 == 7 ? "not json" : requestJson(i));
+            messages.emplace_back("AUCTION",
+                                  to_string(1000 + i) + "\texchange"
+                                  + to_string(i % 3) + "\t" + request);
+            if (i % 4 == 0)
+                messages.emplace_back("WIN", "win\t" + to_string(i)
+                                      + (i % 8 == 0 ? "\textra" : ""));
+        }
+        messages.emplace_back("WIN", "");
+
+        for (auto & m: messages)
+            file.writer.write(m.first, m.second);
+        BOOST_CHECK_EQUAL(file.writer.numMessages(), messages.size());
+        file.finish();
+    }
+
+    ColumnarLogReader reader(filename);
+    BOOST_CHECK(reader.channels() == (vector<string>{ "AUCTION", "WIN" }));
+    BOOST_CHECK_EQUAL(reader.numRows("AUCTION"), 1050);
+    BOOST_CHECK_EQUAL(reader.numRows("WIN"), 264);
+
+    vector<string> columns = reader.columns("AUCTION");
+    BOOST_CHECK_EQUAL(columns[0], "timestamp");
+    BOOST_CHECK(std::count(columns.begin(), columns.end(), "request.id"));
+    BOOST_CHECK(std::count(columns.begin(), columns.end(), "request.*"));
+
+    // Project a member of the structure and a plain column
+    size_t row = 0;
+    reader.forEachRow("AUCTION", { "request.id", "exchange" },
+                      [&] (const vector<const string *> & values)
+                      {
+                          if (row % 100 == 7)
+                              BOOST_CHECK(!values[0]);
+                          else BOOST_CHECK_EQUAL(*values[0],
+                                                 "\"req" + to_string(row)
+                                                 + "\"");
+                          BOOST_CHECK_EQUAL(*values[1],
+                                            "exchange" + to_string(row % 3));
+                          ++row;
+                          return true;
+                      });
+    BOOST_CHECK_EQUAL(row, 1050);
+
+    // Rebuild the structures from their columns
+    row = 0;
+    reader.forEachRow("AUCTION", { "request", "missing" },
+                      [&] (const vector<const string *> & values)
+                      {
+                          BOOST_CHECK(!values[1]);
+                          if (row % 100 == 7)
+                              BOOST_CHECK_EQUAL(*values[0], "not json");
+                          else BOOST_CHECK_EQUAL(Json::parse(*values[0]),
+                                                 Json::parse(requestJson(row)));
+                          ++row;
+                          return row < 10;
+                      });
+    BOOST_CHECK_EQUAL(row, 10);
+
+    // All the messages come back, in order within each channel
+    map<string, vector<string> > expected, found;
+    for (auto & m: messages) {
+        string message = m.second;
+        // Structures are rewritten, so compare their JSON
+        if (m.first == "AUCTION" && message.find("not json") == string::npos) {
+            size_t pos = message.rfind('\t');
+            message = message.substr(0, pos + 1)
+                + Json::parse(message.substr(pos + 1)).toStringNoNewLine();
+        }
+        expected[m.first].push_back(message);
+    }
+
+    reader.forEachMessage([&] (const string & channel, const string & message)
+                          {
+                              found[channel].push_back(message);
+                              return true;
+                          });
+
+    BOOST_CHECK_EQUAL(found["AUCTION"].size(), expected["AUCTION"].size());
+    BOOST_CHECK(found["AUCTION"] == expected["AUCTION"]);
+    BOOST_CHECK(found["WIN"] == expected["WIN"]);
+}
+
+BOOST_AUTO_TEST_CASE( test_columnar_output )
+{
+    string filename = "tmp/columnar_output_test.col";
+
+    {
+        ColumnarOutput output;
+        output.addChannel("BID", { { "id" }, { "price" } });
+        output.open(filename, 9 /* HC */);
+        for (unsigned i = 0;  i < 10000;  ++i)
+            output.logMessage("BID", to_string(i) + "\t" + to_string(i % 7));
+        output.close();
+    }
+
+    ColumnarLogReader reader(filename);
+    BOOST_CHECK_EQUAL(reader.numRows("BID"), 10000);
+
+    size_t row = 0;
+    reader.forEachRow("BID", { "price" },
+                      [&] (const vector<const string *> & values)
+                      {
+                          BOOST_CHECK_EQUAL(*values[0], to_string(row % 7));
+                          ++row;
+                          return true;
+                      });
+    BOOST_CHECK_EQUAL(row, 10000);
+}
+
+BOOST_AUTO_TEST_CASE( test_columnar_truncated )
+{
+    string filename = "tmp/columnar_truncated_test.col";
+    {
+        FileWriter file(filename, 100);
+        file.writer.write("BID", "1\t2");
+        // No footer
+        file.writer.flush();
+        file.stream.close();
+    }
+
+    BOOST_CHECK_THROW(ColumnarLogReader reader(filename), ML::Exception);
+}
@@ -5,6 +5,13 @@ $(eval $(call vowscoffee_test,logger_fs_test,logger))
 $(eval $(call test,logger_deadlock_test,logger,boost manual))
 
 $(eval $(call test,multi_output_logger_test,logger,boost))
+$(eval $(call test,logger_thread_buffers_test,logger,boost))
+$(eval $(call test,lz4_compressor_test,logger,boost))
+$(eval $(call test,columnar_log_test,logger,boost))
+$(eval $(call test,async_file_sink_test,logger,boost))
+$(eval $(call test,message_filter_test,logger,boost))
+$(eval $(call test,remote_log_spill_test,logger,boost))
+$(eval $(call test,async_batch_queue_test,logger,boost))
 $(eval $(call test,rotating_file_logger_test,logger,manual boost))
 
 ifeq ($(NODEJS_ENABLED),1)
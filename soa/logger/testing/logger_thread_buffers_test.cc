@@ -0,0 +1,114 @@
+/* logger_thread_buffers_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests of the per-thread buffers of the logger.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "soa/logger/logger.h"
+#include "jml/arch/timers.h"
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+struct Received {
+    void operator () (std::string channel, std::string message)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        messages[channel].push_back(message);
+    }
+
+    boost::function<void (std::string, std::string)> callback()
+    {
+        return [=] (std::string channel, std::string message)
+            {
+                (*this)(channel, message);
+            };
+    }
+
+    std::mutex lock;
+    std::map<std::string, std::vector<std::string> > messages;
+};
+
+BOOST_AUTO_TEST_CASE( test_thread_buffers_many_threads )
+{
+    Logger logger;
+    logger.init();
+    logger.enableThreadBuffers(4096);
+
+    Received received;
+    logger.addCallback(received.callback());
+    logger.start();
+
+    enum { NumThreads = 8, NumMessages = 10000 };
+
+    auto logThread = [&] (int thread)
+        {
+            string channel = "THREAD" + to_string(thread);
+            for (unsigned i = 0;  i < NumMessages;  ++i)
+                logger.logMessageNoTimestamp(channel, to_string(i), "x");
+        };
+
+    vector<std::thread> threads;
+    for (unsigned i = 0;  i < NumThreads;  ++i)
+        threads.emplace_back(logThread, i);
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(logger.numMessagesSent(), NumThreads * NumMessages);
+    logger.waitUntilFinished();
+    logger.shutdown();
+
+    // Every message arrives, in the order of its thread
+    for (unsigned i = 0;  i < NumThreads;  ++i) {
+        auto & messages = received.messages["THREAD" + to_string(i)];
+        BOOST_REQUIRE_EQUAL(messages.size(), NumMessages);
+        for (unsigned j = 0;  j < NumMessages;  ++j)
+            BOOST_CHECK_EQUAL(messages[j], to_string(j) + "\tx");
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_thread_buffers_filters_and_large_messages )
+{
+    Logger logger;
+    logger.init();
+    logger.enableThreadBuffers(1024);
+
+    Received allowed, denied;
+    logger.addCallback(allowed.callback(), boost::regex("BID|WIN"),
+                       boost::regex("WIN"));
+    logger.addCallback(denied.callback(), boost::regex(),
+                       boost::regex("BID|WIN"));
+    logger.start();
+
+    string large(2000, 'a');
+    for (unsigned i = 0;  i < 100;  ++i) {
+        logger.logMessageNoTimestamp("BID", "bid");
+        logger.logMessageNoTimestamp("WIN", "win");
+        logger.logMessageNoTimestamp("LOSS", "loss");
+    }
+    logger.logMessageNoTimestamp(std::vector<std::string>{ "BID", large });
+
+    logger.waitUntilFinished();
+    logger.shutdown();
+
+    BOOST_CHECK_EQUAL(allowed.messages["BID"].size(), 101);
+    // Too large for the buffer, so it went through the shared queue
+    auto & bids = allowed.messages["BID"];
+    BOOST_CHECK_EQUAL(std::count(bids.begin(), bids.end(), large), 1);
+    BOOST_CHECK_EQUAL(allowed.messages.count("WIN"), 0);
+    BOOST_CHECK_EQUAL(allowed.messages.count("LOSS"), 0);
+    BOOST_CHECK_EQUAL(denied.messages["LOSS"].size(), 100);
+    BOOST_CHECK_EQUAL(denied.messages.count("BID"), 0);
+}
@@ -0,0 +1,146 @@
+/* lz4_compressor_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests of the lz4 compressor, serial and parallel, against the
+   decompressor of filter_istream.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <fstream>
+#include <iterator>
+
+#include <boost/test/unit_test.hpp>
+
+#include "soa/logger/compressor.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/arch/exception.h"
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+namespace {
+
+/** Lines that compress well, with enough variation to catch reordered
+    blocks.
+*/
+string makeInput(size_t numLines)
+{
+    string result;
+    for (size_t i = 0;  i < numLines;  ++i)
+        result += "line " + to_string(i) + "\tsome log message contents\n";
+    return result;
+}
+
+/** Compress the input in chunks of the given size, flushing every
+    flushEvery chunks if non-zero.
+*/
+string compress(Compressor & compressor, const string & input,
+                size_t chunkSize, size_t flushEvery = 0)
+{
+    string result;
+    auto onData = [&] (const char * data, size_t len)
+        {
+            result.append(data, len);
+            return len;
+        };
+
+    for (size_t i = 0, n = 0;  i < input.size();  i += chunkSize, ++n) {
+        compressor.compress(input.data() + i,
+                            std::min(chunkSize, input.size() - i),
+                            onData);
+        if (flushEvery && n % flushEvery == 0)
+            compressor.flush(Compressor::FLUSH_AVAILABLE, onData);
+    }
+    compressor.finish(onData);
+
+    return result;
+}
+
+string decompress(const string & compressed)
+{
+    string filename = "tmp/lz4_compressor_test.lz4";
+    {
+        ofstream stream(filename);
+        stream << compressed;
+    }
+
+    filter_istream stream(filename);
+    return string(istreambuf_iterator<char>(stream),
+                  istreambuf_iterator<char>());
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_lz4_serial )
+{
+    string input = makeInput(100000);
+
+    Lz4Compressor fast(0);
+    string compressed = compress(fast, input, 1000);
+    BOOST_CHECK_LT(compressed.size(), input.size() / 2);
+    BOOST_CHECK(decompress(compressed) == input);
+
+    Lz4Compressor hc(9);
+    string compressedHc = compress(hc, input, 1000);
+    BOOST_CHECK_LE(compressedHc.size(), compressed.size());
+    BOOST_CHECK(decompress(compressedHc) == input);
+
+    // Empty streams are still valid frames
+    Lz4Compressor empty(0);
+    BOOST_CHECK_EQUAL(decompress(compress(empty, "", 1)), "");
+}
+
+BOOST_AUTO_TEST_CASE( test_lz4_parallel )
+{
+    string input = makeInput(200000);
+
+    // Small blocks so that many of them are in flight at once
+    for (int numThreads: { 2, 4, 8 }) {
+        Lz4Compressor compressor(0, numThreads, 4);
+        string compressed = compress(compressor, input, 777);
+        BOOST_CHECK(decompress(compressed) == input);
+
+        // Independent blocks give the same result whatever the number of
+        // threads
+        Lz4Compressor serial(0, 1, 4);
+        BOOST_CHECK(compressed == compress(serial, input, 777));
+    }
+
+    // Flushes write out the partial blocks in order
+    Lz4Compressor flushed(0, 4, 4);
+    BOOST_CHECK(decompress(compress(flushed, input, 777, 50)) == input);
+
+    // Incompressible data is stored raw
+    string random;
+    for (unsigned i = 0;  i < 200000;  ++i)
+        random.push_back(rand());
+    Lz4Compressor raw(0, 4, 4);
+    BOOST_CHECK(decompress(compress(raw, random, 4096)) == random);
+}
+
+BOOST_AUTO_TEST_CASE( test_lz4_concatenated_frames )
+{
+    string input1 = makeInput(1000), input2 = makeInput(2000);
+
+    Lz4Compressor compressor1(0), compressor2(0, 2);
+    string compressed = compress(compressor1, input1, 100)
+        + compress(compressor2, input2, 100);
+
+    BOOST_CHECK(decompress(compressed) == input1 + input2);
+}
+
+BOOST_AUTO_TEST_CASE( test_lz4_create )
+{
+    BOOST_CHECK_EQUAL(Compressor::filenameToCompression("file.log.lz4"),
+                      "lz4");
+
+    std::unique_ptr<Compressor> compressor(Compressor::create("lz4", -1, 4));
+    BOOST_CHECK(dynamic_cast<Lz4Compressor *>(compressor.get()));
+
+    BOOST_CHECK_THROW(Lz4Compressor(0, 1, 3), ML::Exception);
+    BOOST_CHECK_THROW(Lz4Compressor(0, 0), ML::Exception);
+}
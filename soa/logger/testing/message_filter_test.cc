@@ -0,0 +1,113 @@
+/* message_filter_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests of the compiled log message filters.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "soa/logger/message_filter.h"
+#include "jml/arch/exception.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+bool matches(const string & expression, const string & channel,
+             const string & message)
+{
+    return MessageFilter(expression)(channel, message);
+}
+
+string field(const string & message, int n)
+{
+    MessageFields fields(message);
+    auto span = fields[n];
+    return string(span.first, span.second);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_message_fields )
+{
+    BOOST_CHECK_EQUAL(field("a\tbc\t\td", 1), "a");
+    BOOST_CHECK_EQUAL(field("a\tbc\t\td", 2), "bc");
+    BOOST_CHECK_EQUAL(field("a\tbc\t\td", 3), "");
+    BOOST_CHECK_EQUAL(field("a\tbc\t\td", 4), "d");
+    BOOST_CHECK_EQUAL(field("a\tbc\t\td", 5), "");
+    BOOST_CHECK_EQUAL(field("", 1), "");
+
+    // Out of order accesses
+    string message = "x\ty\tz";
+    MessageFields fields(message);
+    BOOST_CHECK_EQUAL(string(fields[3].first, fields[3].second), "z");
+    BOOST_CHECK_EQUAL(string(fields[1].first, fields[1].second), "x");
+}
+
+BOOST_AUTO_TEST_CASE( test_message_filter_syntax_errors )
+{
+    const char * bad[] = {
+        "", "channel ==", "$1 == \"a", "$1 ~ /abc", "($1 == 1",
+        "$1 in [1, 2", "$1 == 1 &&", "$ == 1", "$1 == 1 junk", "$1 ~ /(/"
+    };
+
+    for (auto expression: bad) {
+        BOOST_CHECK_THROW(MessageFilter filter(expression), ML::Exception);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_message_filter_predicates )
+{
+    string message = "BID\t0.75\ttest-account\t42";
+
+    BOOST_CHECK(matches("$1 == \"BID\"", "X", message));
+    BOOST_CHECK(!matches("$1 != \"BID\"", "X", message));
+    BOOST_CHECK(matches("$2 > 0.5", "X", message));
+    BOOST_CHECK(matches("$2 <= 0.75", "X", message));
+    BOOST_CHECK(!matches("$2 < 0.75", "X", message));
+    BOOST_CHECK(matches("$4 == 42.0", "X", message));
+    // Not a number, so it fails numeric comparisons either way
+    BOOST_CHECK(!matches("$3 > 0", "X", message));
+    BOOST_CHECK(!matches("$3 <= 0", "X", message));
+    // But string comparisons are lexicographic
+    BOOST_CHECK(matches("$3 > \"test\"", "X", message));
+
+    BOOST_CHECK(matches("$3 ~ /^test-/", "X", message));
+    BOOST_CHECK(matches("$3 !~ /^prod/", "X", message));
+    BOOST_CHECK(matches("$3 ~ /a\\/b|acc/", "X", message));
+
+    BOOST_CHECK(matches("$4 in [1, 42, 3]", "X", message));
+    BOOST_CHECK(!matches("$4 in [1, 3]", "X", message));
+    BOOST_CHECK(matches("$1 in [\"WIN\", \"BID\"]", "X", message));
+
+    BOOST_CHECK(matches("($1 == \"WIN\" || $2 > 0.5) && !($4 < 10)",
+                        "X", message));
+    BOOST_CHECK(!matches("$1 == \"WIN\" || $2 > 0.8", "X", message));
+}
+
+BOOST_AUTO_TEST_CASE( test_message_filter_channels )
+{
+    MessageFilter filter("channel == \"BID\" && $1 > 0.5 || $0 ~ /^WIN/");
+
+    // Decided by the channel alone
+    BOOST_CHECK(filter.forChannel("WIN").takesAll());
+    BOOST_CHECK(filter.forChannel("WINLOSS").takesAll());
+    BOOST_CHECK(filter.forChannel("AUCTION").takesNone());
+
+    // Depends on the message
+    auto bid = filter.forChannel("BID");
+    BOOST_CHECK(!bid.takesAll());
+    BOOST_CHECK(!bid.takesNone());
+    BOOST_CHECK(bid("0.6\tx"));
+    BOOST_CHECK(!bid("0.4\tx"));
+
+    BOOST_CHECK(MessageFilter("channel in [\"A\", \"B\"]")
+                .forChannel("B").takesAll());
+    BOOST_CHECK(MessageFilter("!(channel == \"A\")")
+                .forChannel("A").takesNone());
+}
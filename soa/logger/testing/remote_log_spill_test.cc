@@ -0,0 +1,145 @@
+/* remote_log_spill_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests of the framing and of the spill queue of the remote logging.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include "soa/logger/remote_log_frame.h"
+#include "soa/logger/spill_queue.h"
+#include "jml/arch/exception.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_remote_log_frames )
+{
+    string payload;
+    for (unsigned i = 0;  i < 100;  ++i)
+        RemoteLogFrame::appendMessage(payload, "channel" + to_string(i % 3),
+                                      "message\twith\nseparators "
+                                      + to_string(i));
+
+    string stream
+        = RemoteLogFrame::encodeBatch(1234, 1, payload)
+        + RemoteLogFrame::encodeAck(1, 16)
+        + RemoteLogFrame::encodeBatch(1234, 2, payload, 0 /* no compression */);
+
+    // Fed a byte at a time, as the data can be split anywhere
+    vector<RemoteLogFrame> frames;
+    RemoteLogFrameParser parser;
+    for (char c: stream)
+        parser.feed(&c, 1, [&] (RemoteLogFrame && frame)
+                    { frames.push_back(std::move(frame)); });
+
+    BOOST_CHECK_EQUAL(parser.buffered(), 0);
+    BOOST_REQUIRE_EQUAL(frames.size(), 3);
+
+    BOOST_CHECK_EQUAL(frames[0].type, RemoteLogFrame::BATCH);
+    BOOST_CHECK(frames[0].flags & RemoteLogFrame::COMPRESSED);
+    BOOST_CHECK_EQUAL(frames[0].stream, 1234);
+    BOOST_CHECK_EQUAL(frames[0].seq, 1);
+    BOOST_CHECK(frames[0].decodePayload() == payload);
+
+    BOOST_CHECK_EQUAL(frames[1].type, RemoteLogFrame::ACK);
+    BOOST_CHECK_EQUAL(frames[1].seq, 1);
+    BOOST_CHECK_EQUAL(frames[1].rawLength, 16);
+
+    BOOST_CHECK(!(frames[2].flags & RemoteLogFrame::COMPRESSED));
+    BOOST_CHECK(frames[2].decodePayload() == payload);
+
+    int numMessages = 0;
+    RemoteLogFrame::forEachMessage
+        (frames[2].decodePayload(),
+         [&] (const string & channel, const string & message)
+         {
+             BOOST_CHECK_EQUAL(channel, "channel" + to_string(numMessages % 3));
+             BOOST_CHECK_EQUAL(message, "message\twith\nseparators "
+                               + to_string(numMessages));
+             ++numMessages;
+         });
+    BOOST_CHECK_EQUAL(numMessages, 100);
+
+    // Garbage on the connection is detected
+    RemoteLogFrameParser garbageParser;
+    BOOST_CHECK_THROW(garbageParser.feed(string(40, 'x'),
+                                         [] (RemoteLogFrame &&) {}),
+                      ML::Exception);
+    BOOST_CHECK_THROW(RemoteLogFrame::forEachMessage(payload.substr(0, 17),
+                                                     [] (const string &,
+                                                         const string &) {}),
+                      ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_spill_queue )
+{
+    string directory = "tmp/remote_log_spill_test";
+    boost::filesystem::remove_all(directory);
+
+    auto record = [] (int i) { return "record " + to_string(i); };
+
+    {
+        SpillQueue queue(directory, 1000 /* segment size */);
+        for (unsigned i = 0;  i < 200;  ++i)
+            BOOST_CHECK(queue.push(record(i)));
+        BOOST_CHECK_EQUAL(queue.size(), 200);
+        BOOST_CHECK_GT(queue.numSegments(), 1);
+
+        string front;
+        for (unsigned i = 0;  i < 50;  ++i) {
+            BOOST_REQUIRE(queue.front(front));
+            BOOST_CHECK_EQUAL(front, record(i));
+            queue.pop();
+        }
+    }
+
+    // A new instance picks up where the previous one stopped
+    {
+        SpillQueue queue(directory, 1000);
+        BOOST_CHECK_EQUAL(queue.size(), 150);
+    }
+
+    // Damage the end of the last segment, as a crash in a write would
+    vector<string> segments;
+    for (boost::filesystem::directory_iterator it(directory), end;
+         it != end;  ++it)
+        segments.push_back(it->path().string());
+    std::sort(segments.begin(), segments.end());
+    int fd = ::open(segments.back().c_str(), O_WRONLY | O_APPEND);
+    BOOST_REQUIRE(fd != -1);
+    BOOST_CHECK_EQUAL(::write(fd, "\x40\0\0\0junk", 8), 8);
+    ::close(fd);
+
+    {
+        SpillQueue queue(directory, 1000, 2000 /* max bytes */);
+        BOOST_CHECK_EQUAL(queue.size(), 150);
+
+        string front;
+        for (unsigned i = 50;  i < 200;  ++i) {
+            BOOST_REQUIRE(queue.front(front));
+            BOOST_CHECK_EQUAL(front, record(i));
+            queue.pop();
+        }
+        BOOST_CHECK(queue.empty());
+        BOOST_CHECK(!queue.front(front));
+        BOOST_CHECK_EQUAL(queue.numSegments(), 1);
+
+        // Records are refused past the maximum size
+        unsigned numPushed = 0;
+        while (queue.push(record(numPushed)))
+            ++numPushed;
+        BOOST_CHECK_GT(numPushed, 50);
+        BOOST_CHECK_LE(queue.bytes(), 2000);
+        BOOST_CHECK(queue.front(front));
+        BOOST_CHECK_EQUAL(front, record(0));
+    }
+}
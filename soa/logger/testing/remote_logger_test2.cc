@@ -12,6 +12,7 @@
 #include "soa/logger/remote_input.h"
 #include "soa/logger/remote_output.h"
 #include <sys/socket.h>
+#include <atomic>
 #include "jml/utils/guard.h"
 #include "jml/arch/exception_handler.h"
 #include "jml/utils/testing/watchdog.h"
@@ -29,6 +30,13 @@ BOOST_AUTO_TEST_CASE( test_remote_logger )
     // get to the other end.
 
     RemoteInput input;
+    std::atomic<int> numReceived(0);
+    input.onMessage = [&] (const std::string & channel,
+                           const std::string & message)
+        {
+            BOOST_CHECK_EQUAL(channel, "channelname");
+            ++numReceived;
+        };
     input.listen(-1, "localhost");
     int port = input.port();
 
@@ -42,6 +50,16 @@ BOOST_AUTO_TEST_CASE( test_remote_logger )
         output.barrier();
     }
     
+    BOOST_CHECK(output.flush());
+    BOOST_CHECK_EQUAL(numReceived, 1000);
+
+    // Messages are batched when there's no barrier
+    for (int i = 0;  i < 1000;  ++i)
+        output.logMessage("channelname", "message " + to_string(i));
+    BOOST_CHECK(output.flush());
+    BOOST_CHECK_EQUAL(numReceived, 2000);
+    BOOST_CHECK_EQUAL(input.batchesSkipped(), 0);
+
     //output.close();
 
     output.shutdown();
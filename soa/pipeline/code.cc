@@ -15,6 +15,7 @@ using namespace Datacratic;
 // source files
 #include "block.cc"
 #include "default_pipeline.cc"
+#include "threaded_pipeline.cc"
 #include "file_reader_block.cc"
 #include "file_writer_block.cc"
 #include "importer_block.cc"
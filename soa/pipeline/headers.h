@@ -9,6 +9,14 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <map>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 namespace Datacratic
 {
@@ -17,14 +25,18 @@ namespace Datacratic
     struct IncomingPin;
     struct OutgoingPin;
     struct Connector;
+    struct StreamQueue;
 }
 
+#include "jml/utils/ring_buffer.h"
+
 #include "soa/types/basic_value_descriptions.h"
 #include "soa/service/logs.h"
 #include "soa/pipeline/pin.h"
 #include "soa/pipeline/block.h"
 #include "soa/pipeline/pipeline.h"
 #include "soa/pipeline/default_pipeline.h"
+#include "soa/pipeline/threaded_pipeline.h"
 #include "soa/pipeline/file_reader_block.h"
 #include "soa/pipeline/file_writer_block.h"
 #include "soa/pipeline/importer_block.h"
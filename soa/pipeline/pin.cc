@@ -161,6 +161,12 @@ Connector * IncomingPin::getConnector() const {
     return connector;
 }
 
+std::shared_ptr<StreamQueue> IncomingPin::readQueuedFrom(OutgoingPin * pin,
+                                                         StreamQueue::Options const & options) {
+    readFrom(pin);
+    return nullptr;
+}
+
 IncomingPin * IncomingPin::getAsIncomingPin() {
     return this;
 }
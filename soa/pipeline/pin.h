@@ -74,6 +74,49 @@ namespace Datacratic
         friend class OutgoingPin;
     };
 
+    // base abstraction for a bounded queue carrying batches of streamed records from the
+    // thread of the producing block to the one running the handlers of the consuming block
+    struct StreamQueue {
+        struct Options {
+            Options() : batchSize(1024), capacity(16) {
+            }
+
+            size_t batchSize; // records sent at once
+            size_t capacity; // batches in flight before the producer waits
+        };
+
+        struct Stats {
+            Stats() : records(0), batches(0), stalls(0), seconds(0) {
+            }
+
+            double getRate() const {
+                return seconds > 0 ? records / seconds : 0;
+            }
+
+            std::string path;
+            uint64_t records;
+            uint64_t batches;
+            uint64_t stalls; // batches for which the producer had to wait on a full queue
+            double seconds; // from the first batch to the end of the stream
+        };
+
+        virtual ~StreamQueue() {
+        }
+
+        // runs the handlers of the consumer on the batches until the end of the stream
+        virtual void drain() = 0;
+
+        // ends the stream when its producer failed before it was done
+        virtual void close() = 0;
+
+        Stats const & getStats() const {
+            return stats;
+        }
+
+    protected:
+        Stats stats;
+    };
+
     // base abstraction for pin that consumes data
     struct IncomingPin
         : public Pin
@@ -85,6 +128,11 @@ namespace Datacratic
 
         virtual void readFrom(OutgoingPin * pin) = 0;
 
+        // reads from the pin such that the data streamed through it goes through a queue
+        // which is drained on another thread; pins that aren't streams read the value
+        virtual std::shared_ptr<StreamQueue> readQueuedFrom(OutgoingPin * pin,
+                                                            StreamQueue::Options const & options);
+
     private:
         IncomingPin * getAsIncomingPin();
         void onCreateConnector(Connector * handle);
@@ -270,6 +318,134 @@ namespace Datacratic
         std::shared_ptr<const ValueDescriptionT<T>> inner;
     };
 
+    // stream whose records are batched through a queue between two threads
+    template<typename T>
+    struct QueuedStream :
+        public StreamQueue
+    {
+        typedef std::vector<T> Batch;
+
+        QueuedStream(std::string path,
+                     std::shared_ptr<Stream<T>> consumer,
+                     StreamQueue::Options const & options) :
+            consumer(std::move(consumer)),
+            options(options),
+            queue(std::max<size_t>(options.capacity, 1) + 1),
+            done(false) {
+            stats.path = std::move(path);
+            batch.reserve(options.batchSize);
+        }
+
+        // stream given to the producer in place of the consumer's
+        std::shared_ptr<Stream<T>> producer() {
+            auto result = std::make_shared<Stream<T>>();
+            result->pushHandler = [this](T const & value) {
+                batch.push_back(value);
+                if(batch.size() >= options.batchSize) {
+                    flush();
+                }
+            };
+
+            result->doneHandler = [this]() {
+                flush();
+                close();
+            };
+
+            return result;
+        }
+
+        void drain() {
+            auto start = std::chrono::steady_clock::now();
+            bool started = false;
+            std::exception_ptr failure;
+
+            for(;;) {
+                auto item = queue.pop();
+                if(!item) {
+                    break;
+                }
+
+                if(!started) {
+                    start = std::chrono::steady_clock::now();
+                    started = true;
+                }
+
+                // keep popping after a failure so that the producer doesn't wait forever
+                if(failure) {
+                    continue;
+                }
+
+                try {
+                    for(auto & value : *item) {
+                        consumer->pushHandler(value);
+                    }
+                }
+                catch(...) {
+                    failure = std::current_exception();
+                }
+
+                stats.records += item->size();
+                stats.batches += 1;
+            }
+
+            if(failure) {
+                std::rethrow_exception(failure);
+            }
+
+            consumer->doneHandler();
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            stats.seconds = elapsed.count();
+        }
+
+        void close() {
+            if(!done) {
+                done = true;
+                queue.push(std::shared_ptr<Batch>());
+            }
+        }
+
+    private:
+        void flush() {
+            if(batch.empty()) {
+                return;
+            }
+
+            auto item = std::make_shared<Batch>();
+            item->reserve(options.batchSize);
+            item->swap(batch);
+
+            if(!queue.tryPush(item)) {
+                stats.stalls += 1;
+                queue.push(std::move(item));
+            }
+        }
+
+        std::shared_ptr<Stream<T>> consumer;
+        StreamQueue::Options options;
+        Batch batch;
+        ML::RingBufferSWMR<std::shared_ptr<Batch>> queue;
+        bool done;
+    };
+
+    // pin of a producer reading the stream of a consumer
+    template<typename T>
+    struct StreamingPin :
+        public ReadingPin<Stream<T>>
+    {
+        StreamingPin(Block * block, std::string name) :
+            ReadingPin<Stream<T>>(block, std::move(name)) {
+        }
+
+        std::shared_ptr<StreamQueue> readQueuedFrom(OutgoingPin * pin,
+                                                    StreamQueue::Options const & options) {
+            auto item = static_cast<WritingPin<Stream<T>> *>(pin);
+            auto queue = std::make_shared<QueuedStream<T>>(pin->getPath(), item->get(), options);
+            this->set(queue->producer());
+            return queue;
+        }
+    };
+
     // pin for producing streaming data
     template<typename T>
     struct PushingPin :
@@ -292,6 +468,11 @@ namespace Datacratic
                 pin->doneHandler();
             }
         }
+
+    private:
+        std::shared_ptr<IncomingPin> createPin(Block * block, std::string name) {
+            return std::make_shared<StreamingPin<T>>(block, std::move(name));
+        }
     };
 
     // pin for consuming streaming data
@@ -164,3 +164,159 @@ BOOST_AUTO_TEST_CASE( test_blocks )
     }
 }
 
+
+struct MyBlockThatCounts :
+    public Block
+{
+    MyBlockThatCounts() :
+        numbers(this, "numbers"), count(0) {
+    }
+
+    void run() {
+        for(int i = 0; i != count; ++i) {
+            numbers.push(i);
+        }
+
+        numbers.done();
+    }
+
+    PushingPin<int> numbers;
+    int count;
+};
+
+struct MyBlockThatDoubles :
+    public Block
+{
+    MyBlockThatDoubles() :
+        input(this, "input"), output(this, "output") {
+    }
+
+    void run() {
+        input->pushHandler = [&](int const & value) {
+            output.push(value * 2);
+        };
+
+        input->doneHandler = [&]() {
+            output.done();
+        };
+
+        input.push();
+    }
+
+    PullingPin<int> input;
+    PushingPin<int> output;
+};
+
+struct MyBlockThatSums :
+    public Block
+{
+    MyBlockThatSums() :
+        numbers(this, "numbers"), total(this, "total"), count(0) {
+    }
+
+    void run() {
+        total.set("0");
+        sum = 0;
+
+        numbers->pushHandler = [&](int const & value) {
+            if(std::this_thread::get_id() == thread) {
+                THROW(error) << "handler called on the thread of the block" << std::endl;
+            }
+
+            sum += value;
+            count += 1;
+        };
+
+        numbers->doneHandler = [&]() {
+            total.push(std::to_string(sum));
+        };
+
+        thread = std::this_thread::get_id();
+        numbers.push();
+    }
+
+    PullingPin<int> numbers;
+    WritingPin<std::string> total;
+    std::thread::id thread;
+    long long sum;
+    int count;
+};
+
+BOOST_AUTO_TEST_CASE( test_threaded_pipeline )
+{
+    ThreadedPipeline pipeline;
+
+    // small queues so that the producer has to wait on its consumers
+    pipeline.options.batchSize = 7;
+    pipeline.options.capacity = 2;
+
+    auto a = pipeline.create<MyBlockThatCounts>("a");
+    a->count = 100000;
+
+    auto b = pipeline.create<MyBlockThatDoubles>("b");
+    b->input.connectWith(a->numbers);
+
+    auto c = pipeline.create<MyBlockThatSums>("c");
+    c->numbers.connectWith(b->output);
+
+    auto d = pipeline.create<MyBlock>("d");
+    d->text = "is the total";
+    d->readingPin.connectWith(c->total);
+
+    pipeline.run();
+
+    BOOST_CHECK_EQUAL(c->count, 100000);
+    BOOST_CHECK_EQUAL(*(d->writingPin), "9999900000 is the total");
+
+    auto stats = pipeline.getStats();
+    BOOST_CHECK_EQUAL(stats.size(), 2);
+    for(auto & item : stats) {
+        BOOST_CHECK_EQUAL(item.records, 100000);
+        BOOST_CHECK_EQUAL(item.batches, (100000 + 6) / 7);
+    }
+
+}
+
+struct MyBlockThatFails :
+    public Block
+{
+    MyBlockThatFails() :
+        numbers(this, "numbers"), count(0) {
+    }
+
+    void run() {
+        numbers->pushHandler = [&](int const & value) {
+            if(++count == 1000) {
+                THROW(error) << "failed after " << count << " records" << std::endl;
+            }
+        };
+
+        numbers->doneHandler = [&]() {
+        };
+
+        numbers.push();
+    }
+
+    PullingPin<int> numbers;
+    int count;
+};
+
+BOOST_AUTO_TEST_CASE( test_threaded_pipeline_failure )
+{
+    ThreadedPipeline pipeline;
+    pipeline.options.batchSize = 10;
+    pipeline.options.capacity = 1;
+
+    // the producer of the failed stream still gets to run to completion
+    auto a = pipeline.create<MyBlockThatCounts>("a");
+    a->count = 100000;
+
+    auto b = pipeline.create<MyBlockThatDoubles>("b");
+    b->input.connectWith(a->numbers);
+
+    auto c = pipeline.create<MyBlockThatFails>("c");
+    c->numbers.connectWith(b->output);
+
+    BOOST_CHECK_THROW(pipeline.run(), std::exception);
+    BOOST_CHECK_EQUAL(c->count, 1000);
+}
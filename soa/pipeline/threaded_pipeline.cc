@@ -0,0 +1,162 @@
+/* threaded_pipeline.cc
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+*/
+
+ThreadedPipeline::ThreadedPipeline() :
+    running(0) {
+}
+
+void ThreadedPipeline::run() {
+    std::unique_lock<std::mutex> guard(lock);
+
+    counts.clear();
+    queues.clear();
+    failure = nullptr;
+
+    for(auto & item : connectors) {
+        item->pipeline = this;
+    }
+
+    std::vector<Block *> ready;
+    for(auto item : getBlocks()) {
+        int count = 0;
+        for(auto pin : item->getIncomingPins()) {
+            if(pin->isConnected()) {
+                count++;
+            }
+        }
+
+        if(count == 0) {
+            ready.push_back(item.get());
+        }
+        else {
+            counts[item.get()] = count;
+        }
+    }
+
+    for(auto item : ready) {
+        start(item);
+    }
+
+    idle.wait(guard, [&]() {
+        return running == 0;
+    });
+
+    guard.unlock();
+
+    for(auto & item : threads) {
+        item.join();
+    }
+
+    threads.clear();
+
+    for(auto & item : queues) {
+        auto & stats = item.queue->getStats();
+        LOG(trace) << "stream '" << stats.path << "' carried "
+                   << stats.records << " records in "
+                   << stats.batches << " batches at a rate of "
+                   << stats.getRate() << " records/s with "
+                   << stats.stalls << " stalls" << std::endl;
+    }
+
+    if(failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+std::vector<StreamQueue::Stats> ThreadedPipeline::getStats() const {
+    std::vector<StreamQueue::Stats> result;
+    for(auto & item : queues) {
+        result.push_back(item.queue->getStats());
+    }
+
+    return result;
+}
+
+Connector * ThreadedPipeline::createConnector(IncomingPin * incoming, OutgoingPin * outgoing) {
+    auto item = std::make_shared<ThreadedConnector>(incoming, outgoing);
+    connectors.insert(item);
+    return item.get();
+}
+
+void ThreadedPipeline::start(Block * block) {
+    LOG(debug) << "starting block='" << block->getPath() << "'" << std::endl;
+
+    ++running;
+    threads.emplace_back([=]() {
+        auto start = std::chrono::steady_clock::now();
+        execute([=]() { block->run(); }, block);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        LOG(trace) << "block '" << block->getPath() << "' ran for " << elapsed.count() << "s" << std::endl;
+    });
+}
+
+void ThreadedPipeline::drain(Queue const & item) {
+    ++running;
+    threads.emplace_back([=]() {
+        execute([=]() { item.queue->drain(); }, item.consumer);
+    });
+}
+
+void ThreadedPipeline::execute(std::function<void()> const & task, Block * block) {
+    std::exception_ptr error;
+
+    try {
+        task();
+    }
+    catch(...) {
+        error = std::current_exception();
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    // the streams of a block that failed would never end otherwise; this is the thread
+    // that was writing to them so it's safe to close them here
+    if(error) {
+        if(!failure) {
+            failure = error;
+        }
+
+        for(auto & item : queues) {
+            if(item.producer == block) {
+                item.queue->close();
+            }
+        }
+    }
+
+    if(--running == 0) {
+        idle.notify_all();
+    }
+}
+
+ThreadedPipeline::
+ThreadedConnector::ThreadedConnector(IncomingPin * incoming, OutgoingPin * outgoing) :
+    Connector(incoming, outgoing),
+    pipeline(nullptr) {
+}
+
+void ThreadedPipeline::ThreadedConnector::push() {
+    auto incoming = getIncomingPin();
+    auto outgoing = getOutgoingPin();
+    LOG(pipeline->debug) << "push from '" << outgoing->getPath() << "'" << std::endl;
+
+    // the block of the incoming pin can't be running yet so its pin is ours to set
+    auto queue = incoming->readQueuedFrom(outgoing, pipeline->options);
+
+    std::lock_guard<std::mutex> guard(pipeline->lock);
+
+    if(queue) {
+        Queue item;
+        item.queue = queue;
+        item.producer = incoming->getBlock();
+        item.consumer = outgoing->getBlock();
+        pipeline->queues.push_back(item);
+        pipeline->drain(item);
+    }
+
+    auto block = incoming->getBlock();
+    if(--pipeline->counts[block] == 0) {
+        pipeline->start(block);
+    }
+}
@@ -0,0 +1,58 @@
+/* threaded_pipeline.h
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+*/
+
+namespace Datacratic
+{
+    // pipeline that runs each block on its own thread as soon as it's ready and where the
+    // streams between blocks go through bounded queues of batches, so that the handlers of
+    // a consumer run on their own thread and a producer waits when its consumer falls behind
+    struct ThreadedPipeline :
+        public Pipeline
+    {
+        ThreadedPipeline();
+
+        void run();
+
+        Connector * createConnector(IncomingPin * incoming, OutgoingPin * outgoing);
+
+        // throughput of each stream of the last run
+        std::vector<StreamQueue::Stats> getStats() const;
+
+        StreamQueue::Options options;
+
+    private:
+        struct ThreadedConnector :
+            public Connector
+        {
+            ThreadedConnector(IncomingPin * incoming, OutgoingPin * outgoing);
+
+            void push();
+
+            ThreadedPipeline * pipeline;
+        };
+
+        struct Queue {
+            std::shared_ptr<StreamQueue> queue;
+            Block * producer;
+            Block * consumer;
+        };
+
+        void start(Block * block);
+        void drain(Queue const & item);
+        void execute(std::function<void()> const & task, Block * block);
+
+        std::set<std::shared_ptr<ThreadedConnector>> connectors;
+        std::map<Block *, int> counts;
+        std::vector<Queue> queues;
+        std::vector<std::thread> threads;
+        std::exception_ptr failure;
+        int running;
+
+        std::mutex lock;
+        std::condition_variable idle;
+
+        friend struct ThreadedConnector;
+    };
+}
@@ -0,0 +1,78 @@
+/* allocation_counters.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Counts of the memory allocations made by each thread.
+*/
+
+#include "allocation_counters.h"
+
+#include <atomic>
+#include <mutex>
+
+#if DATACRATIC_TCMALLOC_HOOKS
+#include <gperftools/malloc_hook_c.h>
+#endif
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* ALLOCATION COUNTERS                                                       */
+/*****************************************************************************/
+
+__thread AllocationCounters::Counts
+AllocationCounters::threadCounts = { 0, 0, 0 };
+
+namespace {
+
+std::mutex installLock;
+std::atomic<bool> hooksInstalled(false);
+
+#if DATACRATIC_TCMALLOC_HOOKS
+
+void onNew(const void * ptr, size_t size)
+{
+    if (ptr) AllocationCounters::recordAllocation(size);
+}
+
+void onDelete(const void * ptr)
+{
+    if (ptr) AllocationCounters::recordFree();
+}
+
+#endif
+
+} // file scope
+
+bool
+AllocationCounters::
+install()
+{
+    std::unique_lock<std::mutex> guard(installLock);
+    if (hooksInstalled)
+        return true;
+
+#if DATACRATIC_TCMALLOC_HOOKS
+    if (!MallocHook_AddNewHook(&onNew))
+        return false;
+    if (!MallocHook_AddDeleteHook(&onDelete)) {
+        MallocHook_RemoveNewHook(&onNew);
+        return false;
+    }
+
+    hooksInstalled = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool
+AllocationCounters::
+installed()
+{
+    return hooksInstalled;
+}
+
+} // namespace Datacratic
@@ -0,0 +1,87 @@
+/* allocation_counters.h                                           -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Counts of the memory allocations made by each thread.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* ALLOCATION COUNTERS                                                       */
+/*****************************************************************************/
+
+/** Allocations and frees made by the calling thread since it started.
+
+    The counts come from the hooks of the allocator that install() puts in
+    place, which is only possible when built with TCMALLOC_ENABLED=1 (the
+    hooks are those of tcmalloc).  Without them the counts stay at zero,
+    unless something calls recordAllocation() itself.
+
+    Reading them is two loads from thread local storage, so that the
+    ScopeProfiler can attribute the allocations to the scopes they are made
+    in.
+*/
+
+struct AllocationCounters {
+    AllocationCounters()
+        : allocs(0), bytes(0), frees(0)
+    {
+    }
+
+    uint64_t allocs;    ///< Number of allocations
+    uint64_t bytes;     ///< Bytes requested by the allocations
+    uint64_t frees;     ///< Number of frees
+
+    /** Install the allocator hooks.  Returns false when the allocator has
+        none.  Can be called more than once.
+    */
+    static bool install();
+
+    /** Whether the hooks are installed. */
+    static bool installed();
+
+    /** Counters of the calling thread. */
+    static AllocationCounters thisThread()
+    {
+        AllocationCounters result;
+        result.allocs = threadCounts.allocs;
+        result.bytes = threadCounts.bytes;
+        result.frees = threadCounts.frees;
+        return result;
+    }
+
+    /** Count an allocation of the calling thread. */
+    static void recordAllocation(size_t bytes)
+    {
+        threadCounts.allocs += 1;
+        threadCounts.bytes += bytes;
+    }
+
+    /** Count a free of the calling thread. */
+    static void recordFree()
+    {
+        threadCounts.frees += 1;
+    }
+
+private:
+    struct Counts {
+        uint64_t allocs;
+        uint64_t bytes;
+        uint64_t frees;
+    };
+
+    /** Initial exec TLS never allocates when a thread first touches it,
+        which the hooks couldn't cope with.
+    */
+    static __thread Counts threadCounts
+        __attribute__((tls_model("initial-exec")));
+};
+
+} // namespace Datacratic
@@ -37,6 +37,9 @@ AsyncWriterSource(const OnClosed & onClosed,
       bytesSent_(0),
       bytesReceived_(0),
       msgsSent_(0),
+      writeCalls_(0),
+      coalescedWrites_(0),
+      coalescedBytes_(0),
       onClosed_(onClosed),
       onReceivedData_(onReceivedData)
 {
@@ -221,6 +224,13 @@ handleQueueNotification()
     }
 }
 
+ssize_t
+AsyncWriterSource::
+writeData(const ::iovec * iov, int iovcnt, bool more)
+{
+    return ::writev(fd_, iov, iovcnt);
+}
+
 void
 AsyncWriterSource::
 flush()
@@ -230,59 +240,81 @@ flush()
         return;
     }
 
-    auto popWrite = [&] () {
-        if (queue_.size() == 0) {
-            return false;
-        }
-        auto writes = queue_.pop_front(1);
-        ExcAssert(writes.size() > 0);
-        currentWrite_ = move(writes[0]);
-        return true;
-    };
+    errno = 0;
 
-    if (currentWrite_.message.empty()) {
-        if (!popWrite()) {
-            return;
+    while (true) {
+        /* gather everything that was queued since the last call */
+        if (pendingWrites_.size() < MaxCoalescedWrites) {
+            size_t room = MaxCoalescedWrites - pendingWrites_.size();
+            if (queue_.size() > 0) {
+                auto writes = queue_.pop_front(room);
+                for (auto & write: writes) {
+                    pendingWrites_.emplace_back(move(write));
+                }
+            }
         }
-        if (currentWrite_.message.empty()) {
+        if (pendingWrites_.empty()) {
+            break;
+        }
+        if (pendingWrites_.front().message.empty()) {
             ExcAssert(closing_);
+            pendingWrites_.pop_front();
             handleClosing(false, true);
-            return;
+            break;
         }
-    }
 
-    ssize_t remaining(currentWrite_.message.size() - currentWrite_.sent);
-
-    errno = 0;
+        ::iovec iov[MaxCoalescedWrites];
+        int iovcnt(0);
+        for (const AsyncWrite & write: pendingWrites_) {
+            if (write.message.empty()) {
+                break;
+            }
+            iov[iovcnt].iov_base = (void *) (write.message.c_str() + write.sent);
+            iov[iovcnt].iov_len = write.message.size() - write.sent;
+            iovcnt++;
+        }
+        bool more = (iovcnt < pendingWrites_.size()
+                     && !pendingWrites_[iovcnt].message.empty());
 
-    while (true) {
-        const char * data = currentWrite_.message.c_str() + currentWrite_.sent;
-        ssize_t len = ::write(fd_, data, remaining);
+        ssize_t len = writeData(iov, iovcnt, more || queue_.size() > 0);
+        writeCalls_++;
         if (len > 0) {
-            currentWrite_.sent += len;
-            remaining -= len;
             bytesSent_ += len;
-            if (remaining == 0) {
-                msgsSent_++;
-                handleWriteResult(0, move(currentWrite_));
-                if (!popWrite()) {
-                    break;
-                }
-                if (currentWrite_.message.empty()) {
-                    ExcAssert(closing_);
-                    handleClosing(false, true);
+            if (iovcnt > 1) {
+                coalescedWrites_ += iovcnt - 1;
+                coalescedBytes_ += len;
+            }
+
+            /* the callbacks may enqueue new writes, which will be sent in
+               the next call */
+            while (len > 0) {
+                AsyncWrite & write = pendingWrites_.front();
+                size_t remaining = write.message.size() - write.sent;
+                if (size_t(len) < remaining) {
+                    write.sent += len;
                     break;
                 }
-                remaining = currentWrite_.message.size();
+                len -= remaining;
+                write.sent += remaining;
+                msgsSent_++;
+                AsyncWrite done(move(write));
+                pendingWrites_.pop_front();
+                handleWriteResult(0, move(done));
+            }
+            if (fd_ == -1) {
+                break;
             }
         }
         else if (len < 0) {
             writeReady_ = false;
-            if (errno == EWOULDBLOCK || errno == EAGAIN) {
+            int error = errno;
+            if (error == EWOULDBLOCK || error == EAGAIN) {
                 break;
             }
-            handleWriteResult(errno, move(currentWrite_));
-            if (errno == EPIPE || errno == EBADF) {
+            AsyncWrite failed(move(pendingWrites_.front()));
+            pendingWrites_.pop_front();
+            handleWriteResult(error, move(failed));
+            if (error == EPIPE || error == EBADF) {
                 handleClosing(true, true);
                 break;
             }
@@ -290,7 +322,7 @@ flush()
                 /* This exception indicates a lack of code in the handling of
                    errno. In a perfect world, it should never ever be
                    thrown. */
-                throw ML::Exception(errno, "unhandled write error");
+                throw ML::Exception(error, "unhandled write error");
             }
         }
     }
@@ -349,6 +381,13 @@ emptyMessageQueue()
 {
     std::vector<std::string> messages;
 
+    for (auto & write: pendingWrites_) {
+        if (!write.message.empty()) {
+            messages.emplace_back(move(write.message));
+        }
+    }
+    pendingWrites_.clear();
+
     auto writes = queue_.pop_front(0);
     for (auto & write: writes) {
         messages.emplace_back(move(write.message));
@@ -7,7 +7,10 @@
 
 #pragma once
 
+#include <sys/uio.h>
+
 #include <atomic>
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -47,7 +50,10 @@ struct AsyncWriteResult {
 /****************************************************************************/
 
 /* A base class enabling the asynchronous and buffered writing of data to a
- * file descriptor. */
+ * file descriptor. All the messages queued by the time the file descriptor
+ * is flushed are coalesced and handed to the kernel with a single "writev",
+ * so that many small writes issued during a loop iteration do not cost one
+ * system call (and one packet) each. */
 
 struct AsyncWriterSource : public EpollLoop
 {
@@ -114,6 +120,18 @@ struct AsyncWriterSource : public EpollLoop
     size_t msgsSent() const
     { return msgsSent_; }
 
+    /* number of system calls used to send them */
+    size_t writeCalls() const
+    { return writeCalls_; }
+
+    /* number of system calls saved by coalescing messages and number of
+       bytes sent in such coalesced calls */
+    size_t coalescedWrites() const
+    { return coalescedWrites_; }
+
+    uint64_t coalescedBytes() const
+    { return coalescedBytes_; }
+
 protected:
     /* set the "main" file descriptor, for which epoll events are monitored
      * and the onWriteResult, onReceivedData and onClosed callbacks are
@@ -142,6 +160,11 @@ protected:
 
     std::vector<std::string> emptyMessageQueue();
 
+    /* performs the actual write of "iovcnt" buffers, where "more" indicates
+       that more data is about to be written right after; returns the same
+       values as writev(2) */
+    virtual ssize_t writeData(const ::iovec * iov, int iovcnt, bool more);
+
 private:
     /* Structure holding a write operation */
     struct AsyncWrite {
@@ -169,6 +192,9 @@ private:
         OnWriteResult onWriteResult;
     };
 
+    /* maximum number of messages coalesced into a single call */
+    static constexpr size_t MaxCoalescedWrites = 64;
+
     /* fd operations */
     void flush();
 
@@ -189,11 +215,17 @@ private:
 
     bool queueEnabled_;
     TypedMessageQueue<AsyncWrite> queue_;
-    AsyncWrite currentWrite_;
+
+    /* writes taken from the queue and not entirely sent yet, where an empty
+       message marks the closing request */
+    std::deque<AsyncWrite> pendingWrites_;
 
     uint64_t bytesSent_;
     uint64_t bytesReceived_;
     size_t msgsSent_;
+    size_t writeCalls_;
+    size_t coalescedWrites_;
+    uint64_t coalescedBytes_;
 
     OnClosed onClosed_;
     OnWriteResult onWriteResult_;
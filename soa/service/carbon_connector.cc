@@ -20,6 +20,7 @@
 #include <boost/bind.hpp>
 #include <boost/make_shared.hpp>
 #include <poll.h>
+#include <algorithm>
 
 
 using namespace std;
@@ -33,9 +34,16 @@ namespace Datacratic {
 /* MULTI AGGREGATOR                                                          */
 /*****************************************************************************/
 
+namespace {
+
+std::atomic<uint64_t> numInstances(0);
+
+} // file scope
+
 MultiAggregator::
 MultiAggregator()
-    : doShutdown(false), doDump(false), dumpInterval(0.0)
+    : instance(++numInstances),
+      doShutdown(false), doDump(false), dumpInterval(0.0)
 {
 }
 
@@ -44,7 +52,7 @@ MultiAggregator(const std::string & path,
                 const OutputFn & output,
                 double dumpInterval,
                 std::function<void ()> onStop)
-    : doShutdown(false), doDump(false)
+    : instance(++numInstances), doShutdown(false), doDump(false)
 {
     open(path, output, dumpInterval, onStop);
 }
@@ -118,7 +126,125 @@ StatAggregator * createNewLevel()
 
 StatAggregator * createNewOutcome(const std::vector<int>& percentiles)
 {
-    return new GaugeAggregator(GaugeAggregator::Outcome, percentiles);
+    return new OutcomeAggregator(percentiles);
+}
+
+MultiAggregator::StatHandle
+MultiAggregator::
+intern(const std::string & stat,
+       StatEventType type,
+       const std::vector<int> & percentiles)
+{
+    switch (type) {
+    case ET_HIT:
+    case ET_COUNT:
+        return getHandle(stat, createNewCounter);
+    case ET_STABLE_LEVEL:
+        return getHandle(stat, createNewStableLevel);
+    case ET_LEVEL:
+        return getHandle(stat, createNewLevel);
+    case ET_OUTCOME:
+        return getHandle(stat, std::bind(createNewOutcome, percentiles));
+    default:
+        throw ML::Exception("unknown stat type %d for %s",
+                            type, stat.c_str());
+    }
+}
+
+MultiAggregator::StatHandle
+MultiAggregator::
+addHandle(Shard & shard, const std::string & stat, const CreateFn & create)
+{
+    StatHandle handle;
+    {
+        std::unique_lock<Lock> guard(lock);
+
+        auto found = statIndex.find(stat);
+        if (found != statIndex.end())
+            handle = found->second;
+        else {
+            handle = stats.size();
+            stats.push_back(StatEntry());
+            StatEntry & entry = stats.back();
+            entry.name = stat;
+            entry.create = create;
+            entry.aggregator.reset(create());
+            statIndex[stat] = handle;
+        }
+    }
+
+    shard.handles[stat] = handle;
+    return handle;
+}
+
+MultiAggregator::Shard &
+MultiAggregator::
+newShard()
+{
+    auto shard = std::make_shared<Shard>(instance);
+    {
+        std::unique_lock<Lock> guard(lock);
+        shards.push_back(shard);
+    }
+    localShard.reset(new ShardRef(shard));
+    return *shard;
+}
+
+StatAggregator &
+MultiAggregator::
+addAggregator(Shard & shard, StatHandle stat)
+{
+    CreateFn create;
+    {
+        std::unique_lock<Lock> guard(lock);
+        ExcAssertLess(stat, stats.size());
+        create = stats[stat].create;
+    }
+
+    std::unique_ptr<StatAggregator> aggregator(create());
+
+    std::unique_lock<std::mutex> guard(shard.lock);
+    if (shard.aggregators.size() <= stat)
+        shard.aggregators.resize(stat + 1);
+    shard.aggregators[stat] = std::move(aggregator);
+
+    return *shard.aggregators[stat];
+}
+
+std::vector<const MultiAggregator::StatEntry *>
+MultiAggregator::
+mergeShards() const
+{
+    std::vector<const StatEntry *> entries;
+    std::vector<std::shared_ptr<Shard> > toMerge;
+    {
+        std::unique_lock<Lock> guard(lock);
+
+        entries.reserve(stats.size());
+        for (auto & entry: stats)
+            entries.push_back(&entry);
+
+        // Orphaned shards get their values merged one last time below
+        toMerge = shards;
+        shards.erase(std::remove_if(shards.begin(), shards.end(),
+                                    [] (const std::shared_ptr<Shard> & shard)
+                                    {
+                                        return shard->orphaned.load();
+                                    }),
+                     shards.end());
+    }
+
+    for (auto & shard: toMerge) {
+        std::unique_lock<std::mutex> guard(shard->lock);
+
+        size_t n = std::min(shard->aggregators.size(), entries.size());
+        for (size_t i = 0;  i < n;  ++i) {
+            if (shard->aggregators[i])
+                entries[i]->aggregator->merge(*shard->aggregators[i]);
+        }
+    }
+
+    return entries;
 }
 
 void
@@ -153,28 +279,28 @@ void
 MultiAggregator::
 recordHit(const std::string & stat)
 {
-    getAggregator(stat, createNewCounter).record(1.0);
+    record(getHandle(stat, createNewCounter), 1.0);
 }
 
 void
 MultiAggregator::
 recordCount(const std::string & stat, float quantity)
 {
-    getAggregator(stat, createNewCounter).record(quantity);
+    record(getHandle(stat, createNewCounter), quantity);
 }
 
 void
 MultiAggregator::
 recordStableLevel(const std::string & stat, float value)
 {
-    getAggregator(stat, createNewStableLevel).record(value);
+    record(getHandle(stat, createNewStableLevel), value);
 }
 
 void
 MultiAggregator::
 recordLevel(const std::string & stat, float value)
 {
-    getAggregator(stat, createNewLevel).record(value);
+    record(getHandle(stat, createNewLevel), value);
 }
     
 void
@@ -182,7 +308,14 @@ MultiAggregator::
 recordOutcome(const std::string & stat, float value,
               const std::vector<int>& percentiles)
 {
-    getAggregator(stat, createNewOutcome, percentiles).record(value);
+    Shard & shard = getShard();
+    auto found = shard.handles.find(stat);
+    StatHandle handle;
+    if (found != shard.handles.end())
+        handle = found->second;
+    else handle = addHandle(shard, stat,
+                            std::bind(createNewOutcome, percentiles));
+    record(handle, value);
 }
 
 
@@ -202,10 +335,8 @@ void
 MultiAggregator::
 dumpSync(std::ostream & stream) const
 {
-    std::unique_lock<Lock> guard(this->lock);
-
-    for (auto & s: stats) {
-        auto vals = s.second->read(s.first);
+    for (const StatEntry * entry: mergeShards()) {
+        auto vals = entry->aggregator->read(entry->name);
         for (auto v: vals) {
             stream << v.name << ":\t" << v.value << endl;
         }
@@ -249,14 +380,8 @@ runDumpingThread()
         if (cond.wait_until(lock, nextWakeup.toStd(), [&] { return doShutdown.load(); }))
             break;
 
-        // Get the read lock to extract a list of stats to dump
-        vector<Stats::iterator> toDump;
-        {
-            std::unique_lock<Lock> guard(this->lock);
-            toDump.reserve(stats.size());
-            for (auto it = stats.begin(), end = stats.end(); it != end;  ++it)
-                toDump.push_back(it);
-        }
+        // Gather the values recorded by each thread
+        vector<const StatEntry *> toDump = mergeShards();
 
         ++current;
         bool dumpNow = doDump.exchange(false) ||
@@ -267,7 +392,7 @@ runDumpingThread()
         for (auto it = toDump.begin(), end = toDump.end(); it != end;  ++it) {
 
             try {
-                auto stat = (*it)->second->read((*it)->first);
+                auto stat = (*it)->aggregator->read((*it)->name);
 
                 // Hack: ensures that all timestamps are consistent and that we
                 // will not have any gaps within carbon.
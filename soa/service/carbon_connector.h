@@ -10,9 +10,11 @@
 #include "soa/service/stat_aggregator.h"
 #include "soa/service/stats_events.h"
 #include "ace/INET_Addr.h"
+#include "jml/compiler/compiler.h"
 #include "jml/stats/distribution.h"
 #include "soa/types/date.h"
 #include <unordered_map>
+#include <deque>
 #include <map>
 #include <memory>
 #include <thread>
@@ -101,6 +103,34 @@ struct MultiAggregator {
     void recordOutcome(const std::string & stat, float value,
             const std::vector<int>& percentiles = DefaultOutcomePercentiles);
 
+    /** Handle to an interned stat; see intern(). */
+    typedef unsigned StatHandle;
+
+    /** Resolve the name of a stat to a handle once, so that it can then be
+        recorded without looking up its name.  The type of a stat is set by
+        the first call that records or interns it.
+    */
+    StatHandle intern(const std::string & stat,
+                      StatEventType type = ET_COUNT,
+                      const std::vector<int> & percentiles
+                          = DefaultOutcomePercentiles);
+
+    /** Record a value for an interned stat.  Only the aggregator of the
+        calling thread is touched; those of all the threads are merged when
+        the stats are dumped.
+
+        Lock-free (except the first time it's called for each stat in each
+        thread) and thread safe.
+    */
+    void record(StatHandle stat, float value = 1.0)
+    {
+        Shard & shard = getShard();
+        if (JML_LIKELY(stat < shard.aggregators.size()
+                       && shard.aggregators[stat]))
+            shard.aggregators[stat]->record(value);
+        else addAggregator(shard, stat).record(value);
+    }
+
     /** Dump synchronously (taking the lock).  This should only be used in
         testing or debugging, not when connected to Carbon.
     */
@@ -125,69 +155,118 @@ protected:
     std::function<void ()> onPreShutdown, onPostShutdown;
 
 private:
-    // This map can only have things removed from it, never added to
-    typedef std::map<std::string, std::shared_ptr<StatAggregator> > Stats;
+    typedef std::function<StatAggregator * ()> CreateFn;
+
+    /** Stat that was interned.  Entries are never modified or removed once
+        added, and a StatHandle is the index of its entry.
+    */
+    struct StatEntry {
+        std::string name;
+        CreateFn create;
+
+        /// Aggregator in which the values of all the threads are merged
+        std::shared_ptr<StatAggregator> aggregator;
+    };
+
+    // A deque as references to the entries must stay valid as it grows
+    typedef std::deque<StatEntry> Stats;
     Stats stats;
+    std::unordered_map<std::string, StatHandle> statIndex;
 
-    // R/W mutex for reading/writing stats.  Read to look up, write to
-    // add a new stat.
+    // Mutex for adding stats and shards.  Never taken on the recording path
+    // once a thread has seen a stat.
     typedef std::mutex Lock;
     mutable Lock lock;
 
-    typedef std::unordered_map<std::string, Stats::iterator> LookupCache;
+    /** Aggregators of a single thread, which are the only ones touched when
+        a value is recorded.  Their values are moved into the StatEntry
+        aggregators when dumping.
+    */
+    struct Shard {
+        Shard(uint64_t owner)
+            : owner(owner), orphaned(false)
+        {
+        }
+
+        uint64_t owner;               ///< instance of the MultiAggregator
 
-    // Cache of lookups for each thread to avoid needing to acquire a lock
-    // very much.
-    boost::thread_specific_ptr<LookupCache> lookupCache;
+        // Cache of the names looked up by the thread.  Only used by the
+        // thread.
+        std::unordered_map<std::string, StatHandle> handles;
 
-    /** Thread that's started up to start dumping. */
-    void runDumpingThread();
+        // Indexed by StatHandle.  Only modified by the thread, with the lock
+        // held so that it may be read while dumping.
+        std::vector<std::unique_ptr<StatAggregator> > aggregators;
+        std::mutex lock;
 
-    /** Shutdown everything. */
-    void shutdown();
+        std::atomic<bool> orphaned;   ///< the thread has exited
+    };
 
-    /** Look for the aggregator for this given stat.  If it doesn't exist,
-        then initialize it from the given function.
+    /** Thread specific reference to a shard, which flags the shard as
+        orphaned once the thread exits so that it can be dropped after its
+        last values have been merged.
     */
-    template<typename... Args>
-    StatAggregator & getAggregator(const std::string & stat,
-                                   StatAggregator * (*createFn) (Args...),
-                                   Args&&... args)
-    {
-        if (!lookupCache.get())
-            lookupCache.reset(new LookupCache());
+    struct ShardRef {
+        ShardRef(const std::shared_ptr<Shard> & shard)
+            : shard(shard)
+        {
+        }
 
-        auto found = lookupCache->find(stat);
-        if (found != lookupCache->end())
-            return *found->second->second;
+        ~ShardRef()
+        {
+            shard->orphaned = true;
+        }
 
-        // Get the read lock to look for the aggregator
-        std::unique_lock<Lock> guard(lock);
+        std::shared_ptr<Shard> shard;
+    };
 
-        auto found2 = stats.find(stat);
+    // Unique number of this instance, which tells apart the shards of a
+    // previous instance allocated at the same address
+    uint64_t instance;
 
-        if (found2 != stats.end()) {
-            guard.unlock();
+    boost::thread_specific_ptr<ShardRef> localShard;
+    mutable std::vector<std::shared_ptr<Shard> > shards;
 
-            (*lookupCache)[stat] = found2;
+    /** Thread that's started up to start dumping. */
+    void runDumpingThread();
 
-            return *found2->second;
-        }
+    /** Shutdown everything. */
+    void shutdown();
 
-        guard.unlock();
+    /** Return the shard of the calling thread. */
+    Shard & getShard()
+    {
+        ShardRef * ref = localShard.get();
+        if (JML_UNLIKELY(!ref || ref->shard->owner != instance))
+            return newShard();
+        return *ref->shard;
+    }
 
-        // Get the write lock to add it to the aggregator
-        std::unique_lock<Lock> guard2(lock);
+    Shard & newShard();
 
-        // Add it in
-        found2 = stats.insert(
-                make_pair(stat, std::shared_ptr<StatAggregator>(createFn(std::forward<Args>(args)...)))).first;
+    /** Create the aggregator of the calling thread for the given stat. */
+    StatAggregator & addAggregator(Shard & shard, StatHandle stat);
 
-        guard2.unlock();
-        (*lookupCache)[stat] = found2;
-        return *found2->second;
+    /** Look for the handle of a stat by name, interning it with the given
+        function if it doesn't exist yet.
+    */
+    StatHandle getHandle(const std::string & stat, const CreateFn & create)
+    {
+        Shard & shard = getShard();
+        auto found = shard.handles.find(stat);
+        if (found != shard.handles.end())
+            return found->second;
+        return addHandle(shard, stat, create);
     }
-    
+
+    StatHandle addHandle(Shard & shard, const std::string & stat,
+                         const CreateFn & create);
+
+    /** Take a snapshot of the stats that exist and move the values of all
+        the shards into them.
+    */
+    std::vector<const StatEntry *> mergeShards() const;
+
     std::unique_ptr<std::thread> dumpingThread;
 
     std::condition_variable cond;  // to wake up dumping thread
@@ -261,38 +261,69 @@ handleOutput()
     //cerr << "output: elapsed = " << format("%.1fms", elapsed * 1000)
     //     << endl;
 
-    const string & str = toWrite.front().data;
-
-    //cerr << "writing " << str << endl;
+    if (done < 0 || (done >= toWrite.front().size() && toWrite.front().size()))
+        throw Exception("invalid done");
 
-    int len = str.length();
+    /* Gather everything that is queued up into a single write, stopping
+       after an entry that closes or recycles the connection. */
+    enum { MAX_IOV = 64 };
+    iovec iov[MAX_IOV];
+    int iovcnt = 0;
+    size_t skip = done;
+
+    for (auto & entry: toWrite) {
+        for (const string * part: { &entry.data, &entry.tail }) {
+            if (skip >= part->size()) {
+                skip -= part->size();
+                continue;
+            }
+            if (iovcnt == MAX_IOV)
+                break;
+
+            iov[iovcnt].iov_base = (void *)(part->c_str() + skip);
+            iov[iovcnt].iov_len = part->size() - skip;
+            ++iovcnt;
+            skip = 0;
+        }
 
-    if (done < 0 || (done >= len && len != 0))
-        throw Exception("invalid done");
+        if (iovcnt == MAX_IOV || entry.next != NEXT_CONTINUE)
+            break;
+    }
 
     /* Send data */
-    ssize_t written
-        = ConnectionHandler::
-        send(str.c_str() + done, len - done, MSG_NOSIGNAL | MSG_DONTWAIT);
+    ssize_t written = 0;
+    if (iovcnt) {
+        written = ConnectionHandler::
+            sendv(iov, iovcnt, MSG_NOSIGNAL | MSG_DONTWAIT);
 
-    if (written == -1 && errno == EWOULDBLOCK) {
-        //cerr << "write would block" << endl;
-        return;
-    }    
+        if (written == -1 && errno == EWOULDBLOCK) {
+            //cerr << "write would block" << endl;
+            return;
+        }
 
-    if (written == -1) {
-        doError("writing: " + string(strerror(errno)));
-        return;
+        if (written == -1) {
+            doError("writing: " + string(strerror(errno)));
+            return;
+        }
     }
-            
-    done += written;
-        
-    if (done == len) {
+
+    /* Retire the entries that were completely written */
+    while (!toWrite.empty()) {
+        size_t remaining = toWrite.front().size() - done;
+        if ((size_t)written < remaining) {
+            done += written;
+            return;
+        }
+
+        written -= remaining;
+
         //cerr << "SEND FINISHED " << str << endl;
 
-        WriteEntry entry = toWrite.front();
-        if (entry.onWriteFinished)
-            entry.onWriteFinished();
+        WriteEntry & entry = toWrite.front();
+        NextAction next = entry.next;
+        OnWriteFinished onWriteFinished = std::move(entry.onWriteFinished);
+        if (onWriteFinished)
+            onWriteFinished();
 
         toWrite.pop_front();
         done = 0;
@@ -300,19 +331,20 @@ handleOutput()
         if (toWrite.empty())
             stopWriting();
 
-        if (entry.next == NEXT_CONTINUE)
-            return;
+        if (next == NEXT_CONTINUE)
+            continue;
 
         if (!toWrite.empty())
             throw Exception("CLOSE or RECYCLE with data to write");
 
-        if (entry.next == NEXT_CLOSE) {
+        if (next == NEXT_CLOSE) {
             closeWhenHandlerFinished();
         }
-        else if (entry.next == NEXT_RECYCLE) {
+        else if (next == NEXT_RECYCLE) {
             recycleWhenHandlerFinished();
         }
         else throw Exception("invalid next action");
+        return;
     }
 }
 
@@ -321,28 +353,39 @@ PassiveConnectionHandler::
 send(const std::string & str,
      NextAction next,
      OnWriteFinished onWriteFinished)
+{
+    send(str, string(), next, onWriteFinished);
+}
+
+void
+PassiveConnectionHandler::
+send(std::string data,
+     std::string tail,
+     NextAction next,
+     OnWriteFinished onWriteFinished)
 {
     // If we're not in the right thread, then set the send up to be
     // asynchronous.
     if (!transport().lockedByThisThread()) {
-        doAsync([=] () { this->send(str, next, onWriteFinished); },
+        doAsync([=] () { this->send(data, tail, next, onWriteFinished); },
                 "deferredSend");
         return;
     }
 
-    //cerr << "message being sent<" << str << "> on handle" << transport().getHandle() <<  endl;
+    //cerr << "message being sent<" << data << "> on handle" << transport().getHandle() <<  endl;
     transport().assertLockedByThisThread();
 
     WriteEntry entry;
     entry.date = Date::now();
-    entry.data = str;
+    entry.data = std::move(data);
+    entry.tail = std::move(tail);
     entry.next = next;
     entry.onWriteFinished = onWriteFinished;
 
-    //if (str.find("POST") != 0)
-    //    cerr << "SEND " << str << endl;
+    //if (entry.data.find("POST") != 0)
+    //    cerr << "SEND " << entry.data << endl;
 
-    toWrite.push_back(entry);
+    toWrite.push_back(std::move(entry));
 
     if (toWrite.size() == 1) {
         done = 0;
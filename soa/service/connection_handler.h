@@ -99,6 +99,12 @@ struct ConnectionHandler {
         return transport().send(buf, len, flags);
     }
 
+    /** Pass on a scatter-gather send request to the transport. */
+    ssize_t sendv(const iovec * iov, int iovcnt, int flags)
+    {
+        return transport().sendv(iov, iovcnt, flags);
+    }
+
     /** Pass on a recv request to the transport. */
     ssize_t recv(char * buf, size_t buf_size, int flags)
     {
@@ -256,10 +262,16 @@ struct PassiveConnectionHandler: public ConnectionHandler {
     struct WriteEntry {
         Date date;
         std::string data;
+        std::string tail;    ///< Sent straight after data, without joining
         OnWriteFinished onWriteFinished;
         NextAction next;
+
+        size_t size() const { return data.size() + tail.size(); }
     };
 
+    /** Entries waiting to be written.  done is the number of bytes of the
+        first one that have already been written.
+    */
     std::list<WriteEntry> toWrite;
     
     /** Send some data, with the given set of actions to be done once it's
@@ -268,6 +280,13 @@ struct PassiveConnectionHandler: public ConnectionHandler {
     void send(const std::string & str,
               NextAction action = NEXT_CONTINUE,
               OnWriteFinished onWriteFinished = OnWriteFinished());
+
+    /** Send data followed by tail, without copying them into one buffer.
+        Typically used to send a header and a body.
+    */
+    void send(std::string data, std::string tail,
+              NextAction action = NEXT_CONTINUE,
+              OnWriteFinished onWriteFinished = OnWriteFinished());
     
     /** Function called out to when we got some data */
     virtual void handleData(const std::string & data) = 0;
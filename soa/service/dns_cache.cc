@@ -0,0 +1,145 @@
+/* dns_cache.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+*/
+
+#include <netdb.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "dns_cache.h"
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+/****************************************************************************/
+/* DNS CACHE                                                                */
+/****************************************************************************/
+
+DnsCache::
+DnsCache()
+    : shutdown_(false)
+{
+    resolver_ = thread([&] () { this->runResolver(); });
+}
+
+DnsCache::
+~DnsCache()
+{
+    {
+        unique_lock<mutex> guard(lock_);
+        shutdown_ = true;
+    }
+    wakeup_.notify_all();
+    resolver_.join();
+}
+
+DnsCache &
+DnsCache::
+instance()
+{
+    static DnsCache * cache = new DnsCache();
+    return *cache;
+}
+
+void
+DnsCache::
+resolve(const string & hostname, double maxAge,
+        const OnResolved & onResolved)
+{
+    static constexpr double FailureMaxAge(1.0);
+
+    unique_lock<mutex> guard(lock_);
+
+    Entry & entry = entries_[hostname];
+    if (!entry.pending && entry.resolved.isADate()) {
+        double age = Date::now().secondsSince(entry.resolved);
+        if (age < (entry.error == 0 ? maxAge : FailureMaxAge)) {
+            int error = entry.error;
+            string address = entry.address;
+            guard.unlock();
+            onResolved(error, address);
+            return;
+        }
+    }
+
+    entry.waiting.push_back(onResolved);
+    if (!entry.pending) {
+        entry.pending = true;
+        toResolve_.push_back(hostname);
+        wakeup_.notify_one();
+    }
+}
+
+void
+DnsCache::
+clear()
+{
+    unique_lock<mutex> guard(lock_);
+
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->second.pending) {
+            ++it;
+        }
+        else {
+            it = entries_.erase(it);
+        }
+    }
+}
+
+void
+DnsCache::
+runResolver()
+{
+    unique_lock<mutex> guard(lock_);
+
+    while (!shutdown_) {
+        if (toResolve_.empty()) {
+            wakeup_.wait(guard);
+            continue;
+        }
+
+        string hostname = move(toResolve_.front());
+        toResolve_.pop_front();
+        guard.unlock();
+
+        addrinfo hints;
+        ::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+
+        string address;
+        addrinfo * results(nullptr);
+        int error = ::getaddrinfo(hostname.c_str(), nullptr, &hints, &results);
+        if (error == 0) {
+            char buffer[INET_ADDRSTRLEN];
+            auto addr = (const sockaddr_in *) results->ai_addr;
+            if (::inet_ntop(AF_INET, &addr->sin_addr, buffer, sizeof(buffer))) {
+                address = buffer;
+            }
+            else {
+                error = EAI_FAIL;
+            }
+            ::freeaddrinfo(results);
+        }
+
+        guard.lock();
+        Entry & entry = entries_[hostname];
+        entry.address = address;
+        entry.error = error;
+        entry.resolved = Date::now();
+        entry.pending = false;
+        vector<OnResolved> waiting;
+        waiting.swap(entry.waiting);
+        guard.unlock();
+
+        for (const auto & onResolved: waiting) {
+            onResolved(error, address);
+        }
+
+        guard.lock();
+    }
+}
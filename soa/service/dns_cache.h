@@ -0,0 +1,84 @@
+/* dns_cache.h                                                     -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Asynchronous resolution and caching of host names.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "soa/types/date.h"
+
+
+namespace Datacratic {
+
+/****************************************************************************/
+/* DNS CACHE                                                                */
+/****************************************************************************/
+
+/* Resolves host names to IPv4 addresses from a background thread, so that
+ * the callers never block on the resolver, and keeps the results around so
+ * that they are not resolved again for each connection. Concurrent lookups
+ * of the same host share a single resolution. */
+
+struct DnsCache {
+    /* "error" is 0 on success or the EAI_* code returned by getaddrinfo, in
+       which case "address" is empty. Otherwise "address" is in dotted
+       notation. */
+    typedef std::function<void (int error, const std::string & address)>
+        OnResolved;
+
+    DnsCache();
+    ~DnsCache();
+
+    DnsCache(const DnsCache & other) = delete;
+    DnsCache & operator = (const DnsCache & other) = delete;
+
+    /* The cache shared by the whole process. It is never destroyed, so that
+       it can be used by objects with a static lifetime. */
+    static DnsCache & instance();
+
+    /* Resolves "hostname" and invokes "onResolved" with the result. When a
+       result that is not older than "maxAge" seconds is in the cache, the
+       callback is invoked right away from the calling thread; otherwise it
+       is invoked from the resolver thread once the resolution is
+       complete. Failures are only cached for a second. */
+    void resolve(const std::string & hostname, double maxAge,
+                 const OnResolved & onResolved);
+
+    /* Forget all the cached results. */
+    void clear();
+
+private:
+    struct Entry {
+        Entry()
+            : error(0), pending(false)
+        {}
+
+        std::string address;
+        int error;
+        Date resolved;
+        bool pending;
+        std::vector<OnResolved> waiting;
+    };
+
+    void runResolver();
+
+    std::mutex lock_;
+    std::condition_variable wakeup_;
+    std::deque<std::string> toResolve_;
+    std::unordered_map<std::string, Entry> entries_;
+    bool shutdown_;
+
+    std::thread resolver_;
+};
+
+} // namespace Datacratic
@@ -149,6 +149,17 @@ makeRealTime(int priority)
         makeThreadRealTime(*eventThreadList[i], priority);
 }
 
+void
+EndpointBase::
+setThreadAffinity(const std::vector<int> & cpus)
+{
+    for (unsigned i = 0;  i < eventThreadList.size();  ++i) {
+        if (!ML::setThreadAffinity(*eventThreadList[i], cpus))
+            throw ML::Exception("couldn't set affinity of thread %d of "
+                                "endpoint %s", i, name_.c_str());
+    }
+}
+
 void
 EndpointBase::
 shutdown()
@@ -126,6 +126,11 @@ struct EndpointBase : public Epoller {
     /** Set this endpoint up to handle events in realtime. */
     void makeRealTime(int priority = 1);
 
+    /** Restrict the event threads to the given CPUs (see ML::parseCpuList).
+        Must be called after the threads have been spun up.
+    */
+    void setThreadAffinity(const std::vector<int> & cpus);
+
     /** Set the polling mode to the given value. */
     void setPollingMode(enum PollingMode mode);
 
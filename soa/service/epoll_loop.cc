@@ -71,9 +71,11 @@ loop(int maxEvents, int timeout)
                 (*fn)(events[i]);
             }
 
-            for (auto & unreg: delayedUnregistrations_) {
-                auto cb = move(unreg.second);
-                unregisterFdCallback(unreg.first, false, cb);
+            /* unregisterFdCallback erases the entries from the map */
+            auto unregs = move(delayedUnregistrations_);
+            delayedUnregistrations_.clear();
+            for (auto & unreg: unregs) {
+                unregisterFdCallback(unreg.first, false, unreg.second);
             }
         }
         catch (const std::exception & exc) {
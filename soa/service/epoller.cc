@@ -5,12 +5,15 @@
 */
 
 #include "soa/service/epoller.h"
+#include "soa/service/io_uring_poller.h"
 
 #include <sys/epoll.h>
 #include <poll.h>
 #include "jml/arch/exception.h"
 #include "jml/arch/backtrace.h"
+#include "jml/arch/tick_counter.h"
 #include <string.h>
+#include <stdlib.h>
 #include <iostream>
 #include "soa/types/date.h"
 
@@ -29,7 +32,7 @@ static constexpr int MaxEvents = 1024;
 
 Epoller::
 Epoller()
-    : epoll_fd(-1), timeout_(0), numFds_(0)
+    : epoll_fd(-1), timeout_(0), numFds_(0), busyPollUs_(0)
 {
 }
 
@@ -39,14 +42,45 @@ Epoller::
     close();
 }
 
+Epoller::Backend
+Epoller::
+defaultBackend()
+{
+    static const Backend result = [] () {
+        const char * env = getenv("EPOLLER_BACKEND");
+        if (env && strcmp(env, "io_uring") == 0)
+            return IoUringBackend;
+        return EpollBackend;
+    } ();
+
+    return result;
+}
+
 void
 Epoller::
-init(int maxFds, int timeout)
+init(int maxFds, int timeout, Backend backend)
 {
     //cerr << "initializing epoller at " << this << endl;
     //backtrace();
     close();
 
+    if (backend == DefaultBackend)
+        backend = defaultBackend();
+
+    if (backend == IoUringBackend) {
+        if (IoUringPoller::supported()) {
+            uring_.reset(new IoUringPoller(maxFds));
+            timeout_ = timeout;
+            return;
+        }
+
+        static bool warned = false;
+        if (!warned) {
+            cerr << "io_uring is not available, falling back to epoll" << endl;
+            warned = true;
+        }
+    }
+
     epoll_fd = epoll_create(maxFds);
     if (epoll_fd == -1)
         throw ML::Exception(errno, "EndpointBase epoll_create()");
@@ -54,10 +88,26 @@ init(int maxFds, int timeout)
     timeout_ = timeout;
 }
 
+Epoller::Backend
+Epoller::
+backend() const
+{
+    return uring_ ? IoUringBackend : EpollBackend;
+}
+
+int
+Epoller::
+selectFd() const
+{
+    return uring_ ? uring_->selectFd() : epoll_fd;
+}
+
 void
 Epoller::
 close()
 {
+    uring_.reset();
+
     if (epoll_fd < 0)
         return;
     //cerr << "closing epoller at " << this << endl;
@@ -72,7 +122,9 @@ removeFd(int fd)
 {
     //cerr << Date::now().print(4) << "removed " << fd << endl;
 
-    int res = epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, 0);
+    int res = 0;
+    if (uring_) uring_->removeFd(fd);
+    else res = epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, 0);
     
     if (res == -1) {
         if (errno != EBADF)
@@ -112,29 +164,44 @@ handleEvents(int usToWait, int nEvents,
     if (nEvents > MaxEvents)
         nEvents = MaxEvents;
 
+    if (uring_)
+        return handleUringEvents(usToWait, nEvents, handleEvent,
+                                 beforeSleep, afterSleep);
+
     for (;;) {
         epoll_event events[nEvents];
                 
         if (beforeSleep)
             beforeSleep();
 
-        // Do the sleep with nanosecond resolution
-        // Let's hope it doesn't busy-wait
-        if (usToWait != 0) {
-            pollfd fd[1] = { { epoll_fd, POLLIN, 0 } };
-            timespec timeout = { 0, usToWait * 1000 };
-            int res = ppoll(fd, 1, &timeout, 0);
-            if (res == -1 && errno == EBADF) {
-                cerr << "got bad FD on sleep" << endl;
-                return -1;
-            }
-            if (res == -1 && errno == EINTR)
-                continue;
-            //if (debug) cerr << "handleEvents: res = " << res << endl;
-            if (res == 0) return 0;
+        // With busy polling, the events that come in within the spin budget
+        // are picked up without going to sleep at all
+        int res = 0;
+        if (busyPollUs_ > 0 && (usToWait != 0 || timeout_ != 0)) {
+            res = spinForEvents(events, nEvents);
+            if (usToWait != 0)
+                usToWait = std::max(usToWait - busyPollUs_, 1);
         }
 
-        int res = epoll_wait(epoll_fd, events, nEvents, timeout_);
+        if (res == 0) {
+            // Do the sleep with nanosecond resolution
+            // Let's hope it doesn't busy-wait
+            if (usToWait != 0) {
+                pollfd fd[1] = { { epoll_fd, POLLIN, 0 } };
+                timespec timeout = { 0, usToWait * 1000 };
+                int res = ppoll(fd, 1, &timeout, 0);
+                if (res == -1 && errno == EBADF) {
+                    cerr << "got bad FD on sleep" << endl;
+                    return -1;
+                }
+                if (res == -1 && errno == EINTR)
+                    continue;
+                //if (debug) cerr << "handleEvents: res = " << res << endl;
+                if (res == 0) return 0;
+            }
+
+            res = epoll_wait(epoll_fd, events, nEvents, timeout_);
+        }
 
         if (afterSleep)
             afterSleep();
@@ -163,10 +230,83 @@ handleEvents(int usToWait, int nEvents,
     }
 }
 
+int
+Epoller::
+spinForEvents(epoll_event * events, int nEvents)
+{
+    uint64_t budget = busyPollUs_ * 0.000001 / seconds_per_tick;
+    uint64_t start = ticks();
+
+    for (;;) {
+        int res = epoll_wait(epoll_fd, events, nEvents, 0);
+        if (res != 0 && !(res == -1 && errno == EINTR))
+            return res;
+        if (ticks() - start >= budget)
+            return 0;
+    }
+}
+
+int
+Epoller::
+handleUringEvents(int usToWait, int nEvents,
+                  const HandleEvent & handleEvent,
+                  const OnEvent & beforeSleep,
+                  const OnEvent & afterSleep)
+{
+    // Same as above except that epoll_wait is replaced by a poll on the ring
+    // fd, which is readable when there are completions to read, since the
+    // completions themselves are read straight out of the ring.
+    int ringFd = uring_->selectFd();
+
+    for (;;) {
+        if (beforeSleep)
+            beforeSleep();
+
+        uring_->submit();
+
+        if (usToWait != 0 && !uring_->hasCompletions()) {
+            pollfd fd[1] = { { ringFd, POLLIN, 0 } };
+            timespec timeout = { 0, usToWait * 1000 };
+            int res = ppoll(fd, 1, &timeout, 0);
+            if (res == -1 && errno == EBADF) {
+                cerr << "got bad FD on sleep" << endl;
+                return -1;
+            }
+            if (res == -1 && errno == EINTR)
+                continue;
+            if (res == 0) return 0;
+        }
+
+        if (timeout_ != 0 && !uring_->hasCompletions()) {
+            pollfd fd[1] = { { ringFd, POLLIN, 0 } };
+            int res = ::poll(fd, 1, timeout_);
+            if (res == -1 && errno == EINTR) {
+                if (afterSleep)
+                    afterSleep();
+                continue;
+            }
+            if (res == -1)
+                throw Exception(errno, "poll on io_uring");
+        }
+
+        if (afterSleep)
+            afterSleep();
+
+        auto onEvent = [&] (epoll_event & event) {
+            return handleEvent(event) != SHUTDOWN;
+        };
+
+        return uring_->handleCompletions(nEvents, onEvent);
+    }
+}
+
 bool
 Epoller::
 poll() const
 {
+    if (uring_)
+        return uring_->hasCompletions();
+
     for (;;) {
         pollfd fds[1] = { { epoll_fd, POLLIN, 0 } };
         int res = ::poll(fds, 1, 0);
@@ -195,6 +335,14 @@ performAddFd(int fd, void * data, bool oneshot, bool restart)
     //          + " restart=" + to_string(restart)
     //          + "\n");
 
+    if (uring_) {
+        if (!restart) {
+            numFds_++;
+        }
+        uring_->addFd(fd, data, oneshot, restart);
+        return;
+    }
+
     struct epoll_event event;
     event.events = EPOLLIN;
     if (oneshot) {
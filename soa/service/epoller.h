@@ -9,27 +9,48 @@
 #define __endpoint__epoller_h__
 
 #include <functional>
+#include <memory>
 #include "soa/service/async_event_source.h"
 
 struct epoll_event;
 
 namespace Datacratic {
 
+struct IoUringPoller;
+
 /*****************************************************************************/
 /* EPOLLER                                                                   */
 /*****************************************************************************/
 
 /** Basic wrapper around the epoll interface to turn it into an async event
     source.
+
+    The notifications can alternatively come from io_uring (see
+    IoUringPoller), which batches the system calls made to arm and wait on
+    the fds.  Epoll remains the default and is what we fall back to when the
+    kernel can't do io_uring.
 */
 
 struct Epoller: public AsyncEventSource {
 
+    enum Backend {
+        DefaultBackend, ///< given by the EPOLLER_BACKEND environment variable
+        EpollBackend,
+        IoUringBackend
+    };
+
     Epoller();
 
     ~Epoller();
 
-    void init(int maxFds, int timeout = 0);
+    void init(int maxFds, int timeout = 0, Backend backend = DefaultBackend);
+
+    /** Backend actually in use since the last init(). */
+    Backend backend() const;
+
+    /** Backend used for DefaultBackend: io_uring when EPOLLER_BACKEND is set
+        to "io_uring", epoll otherwise. */
+    static Backend defaultBackend();
 
     void close();
 
@@ -38,6 +59,23 @@ struct Epoller: public AsyncEventSource {
     {
         timeout_ = newTimeout;
     }
+
+    /** Spin for up to the given number of microseconds on a non-blocking
+        epoll_wait before handleEvents() blocks, which it does when either
+        usToWait or the poll timeout is not zero.  This burns the core while
+        idle but saves the cost of being woken up by the kernel when the
+        events come in quickly enough.
+        0, the default, never spins.  Only the epoll backend spins.
+    */
+    void setBusyPoll(int spinUs)
+    {
+        busyPollUs_ = spinUs;
+    }
+
+    int busyPoll() const
+    {
+        return busyPollUs_;
+    }
     
     /** Add the given fd to multiplex fd.  It will repeatedly wake up the
         loop without being restarted.
@@ -94,10 +132,7 @@ struct Epoller: public AsyncEventSource {
                      const OnEvent & beforeSleep = OnEvent(),
                      const OnEvent & afterSleep = OnEvent());
 
-    virtual int selectFd() const
-    {
-        return epoll_fd;
-    }
+    virtual int selectFd() const;
 
     virtual bool poll() const;
 
@@ -107,6 +142,16 @@ private:
     /* Perform the fd addition and modification */
     void performAddFd(int fd, void * data, bool oneShot, bool restart);
 
+    /* handleEvents() with io_uring */
+    int handleUringEvents(int usToWait, int nEvents,
+                          const HandleEvent & handleEvent,
+                          const OnEvent & beforeSleep,
+                          const OnEvent & afterSleep);
+
+    /* Spin on epoll_wait for up to busyPollUs_ microseconds.  Returns what
+       the last epoll_wait returned, which is 0 once the budget is spent. */
+    int spinForEvents(epoll_event * events, int nEvents);
+
     /* Fd for the epoll mechanism. */
     int epoll_fd;
 
@@ -115,6 +160,12 @@ private:
 
     /* Number of registered file descriptors */
     size_t numFds_;
+
+    /* Busy poll budget in microseconds, see setBusyPoll() */
+    int busyPollUs_;
+
+    /* Replaces epoll_fd when using io_uring */
+    std::unique_ptr<IoUringPoller> uring_;
 };
 
 } // namespace Datacratic
@@ -0,0 +1,278 @@
+/* event_sampler.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+*/
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "jml/arch/exception.h"
+#include "soa/service/rest_request_router.h"
+#include "event_sampler.h"
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+/* Each change to any sampler gets a new generation, so that a thread never
+   confuses the cache of a sampler with that of a previous one at the same
+   address. */
+std::atomic<uint64_t> numGenerations(0);
+
+} // file scope
+
+
+/*****************************************************************************/
+/* EVENT SAMPLER                                                             */
+/*****************************************************************************/
+
+EventSampler::
+EventSampler()
+    : budget(0), enabled(false), generation(++numGenerations),
+      sampledOut(0), overBudget(0)
+{
+}
+
+void
+EventSampler::
+setSampleRate(const std::string & prefix, double rate)
+{
+    if (!(rate > 0.0 && rate <= 1.0))
+        throw ML::Exception("invalid sample rate %f for '%s'",
+                            rate, prefix.c_str());
+
+    std::unique_lock<std::mutex> guard(lock);
+    rates[prefix] = rate;
+    changed();
+}
+
+void
+EventSampler::
+clearSampleRates()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    rates.clear();
+    changed();
+}
+
+double
+EventSampler::
+getSampleRate(const std::string & event) const
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    // The map is ordered, so the last matching prefix is the longest one
+    double rate(1.0);
+    for (const auto & entry: rates) {
+        if (event.compare(0, entry.first.size(), entry.first) == 0)
+            rate = entry.second;
+    }
+
+    return rate;
+}
+
+void
+EventSampler::
+setMetricBudget(size_t newBudget)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    budget = newBudget;
+    admitted.clear();
+    changed();
+}
+
+size_t
+EventSampler::
+getMetricBudget() const
+{
+    std::unique_lock<std::mutex> guard(lock);
+    return budget;
+}
+
+Json::Value
+EventSampler::
+getConfig() const
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    Json::Value result;
+    result["metricBudget"] = (Json::UInt) budget;
+    Json::Value & sampleRates = result["sampleRates"];
+    sampleRates = Json::Value(Json::objectValue);
+    for (const auto & entry: rates)
+        sampleRates[entry.first] = entry.second;
+
+    return result;
+}
+
+void
+EventSampler::
+setConfig(const Json::Value & config)
+{
+    if (!config.isObject())
+        throw ML::Exception("event sampler configuration must be an object");
+
+    size_t newBudget(0);
+    if (config.isMember("metricBudget"))
+        newBudget = config["metricBudget"].asUInt();
+
+    std::map<std::string, double> newRates;
+    const Json::Value & sampleRates = config["sampleRates"];
+    if (!sampleRates.isNull()) {
+        if (!sampleRates.isObject())
+            throw ML::Exception("sampleRates must be an object");
+        for (auto it = sampleRates.begin(); it != sampleRates.end(); ++it) {
+            double rate = it->asDouble();
+            if (!(rate > 0.0 && rate <= 1.0))
+                throw ML::Exception("invalid sample rate %f for '%s'",
+                                    rate, it.memberName().c_str());
+            newRates[it.memberName()] = rate;
+        }
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    rates.swap(newRates);
+    if (newBudget != budget) {
+        budget = newBudget;
+        admitted.clear();
+    }
+    changed();
+}
+
+Json::Value
+EventSampler::
+getStatus() const
+{
+    Json::Value result = getConfig();
+    result["sampledOut"] = (Json::UInt) numSampledOut();
+    result["overBudget"] = (Json::UInt) numOverBudget();
+    return result;
+}
+
+void
+EventSampler::
+changed()
+{
+    bool enable = budget > 0;
+    for (const auto & entry: rates)
+        if (entry.second < 1.0)
+            enable = true;
+
+    generation = ++numGenerations;
+    enabled = enable;
+}
+
+EventSampler::Decision
+EventSampler::
+decide(const std::string & name)
+{
+    Decision result;
+    result.rate = getSampleRate(name);
+
+    std::unique_lock<std::mutex> guard(lock);
+    result.admitted = (budget == 0 || admitted.count(name)
+                       || admitted.size() < budget);
+    if (result.admitted && budget > 0)
+        admitted.insert(name);
+
+    return result;
+}
+
+bool
+EventSampler::
+doSample(const std::string & prefix, const char * event,
+         StatEventType & type, float & value)
+{
+    ThreadCache * threadCache = cache.get();
+    uint64_t currentGeneration = generation;
+    if (!threadCache) {
+        threadCache = new ThreadCache();
+        threadCache->seed = ::syscall(SYS_gettid) ^ ::time(nullptr) ^ 1;
+        cache.reset(threadCache);
+    }
+    if (threadCache->generation != currentGeneration) {
+        threadCache->decisions.clear();
+        threadCache->generation = currentGeneration;
+    }
+
+    // Same naming as the one of the event services
+    std::string & name = threadCache->name;
+    name = prefix;
+    if (!prefix.empty())
+        name.push_back('.');
+    name.append(event);
+
+    auto found = threadCache->decisions.find(name);
+    if (found == threadCache->decisions.end())
+        found = threadCache->decisions.insert(make_pair(name, decide(name)))
+            .first;
+    const Decision & decision = found->second;
+
+    if (!decision.admitted) {
+        overBudget.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if (decision.rate >= 1.0)
+        return true;
+
+    if (rand_r(&threadCache->seed) >= decision.rate * RAND_MAX) {
+        sampledOut.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if (type == ET_HIT) {
+        type = ET_COUNT;
+        value = 1.0 / decision.rate;
+    }
+    else if (type == ET_COUNT)
+        value /= decision.rate;
+
+    return true;
+}
+
+
+/*****************************************************************************/
+/* REST ROUTES                                                               */
+/*****************************************************************************/
+
+void
+Datacratic::
+addEventSamplerRoutes(RestRequestRouter & router,
+                      const std::string & path,
+                      const std::shared_ptr<EventSampler> & sampler)
+{
+    auto getConfig = [=] (const RestServiceEndpoint::ConnectionId & connection,
+                          const RestRequest & request,
+                          RestRequestParsingContext & context)
+        {
+            connection.sendResponse(200, sampler->getStatus());
+            return RestRequestRouter::MR_YES;
+        };
+
+    auto setConfig = [=] (const RestServiceEndpoint::ConnectionId & connection,
+                          const RestRequest & request,
+                          RestRequestParsingContext & context)
+        {
+            try {
+                sampler->setConfig(Json::parse(request.payload));
+            } catch (const std::exception & exc) {
+                connection.sendErrorResponse(400, exc.what(),
+                                             "application/json");
+                return RestRequestRouter::MR_YES;
+            }
+            connection.sendResponse(200, sampler->getStatus());
+            return RestRequestRouter::MR_YES;
+        };
+
+    router.addRoute(path, "GET",
+                    "Return the sample rates and metric budget of the events",
+                    getConfig, Json::Value());
+    router.addRoute(path, "PUT",
+                    "Replace the sample rates and metric budget of the events",
+                    setConfig, Json::Value());
+}
@@ -0,0 +1,136 @@
+/* event_sampler.h                                                 -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Sampling and budgeting of the events recorded by services.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <boost/thread/tss.hpp>
+
+#include "jml/compiler/compiler.h"
+#include "soa/jsoncpp/json.h"
+#include "soa/service/stats_events.h"
+
+
+namespace Datacratic {
+
+struct RestRequestRouter;
+
+
+/*****************************************************************************/
+/* EVENT SAMPLER                                                             */
+/*****************************************************************************/
+
+/** Decides which of the events recorded through an EventRecorder are passed
+    on to the EventService, to bound the cost of high cardinality or high
+    rate events:
+
+    - each event is kept with the sample rate of the longest prefix of its
+      full name that has one, and counters that are kept are scaled by the
+      inverse of the rate so that their totals remain correct;
+    - the metric budget is the number of distinct event names that are
+      allowed through; events with a new name are dropped once it is
+      reached.
+
+    Both can be changed at any time.  Decisions are cached per thread and
+    per event name, so that an event only costs a lookup when sampling is
+    enabled and nothing at all otherwise.
+*/
+
+struct EventSampler {
+    EventSampler();
+
+    /** Set the sample rate, in ]0, 1], of the events whose name starts with
+        the given prefix.  The empty prefix sets the default rate.
+    */
+    void setSampleRate(const std::string & prefix, double rate);
+
+    /** Remove all the sample rates. */
+    void clearSampleRates();
+
+    /** Sample rate that applies to the given event name. */
+    double getSampleRate(const std::string & event) const;
+
+    /** Set the maximum number of distinct event names, or 0 for no limit.
+        Changing it starts counting the names again.
+    */
+    void setMetricBudget(size_t budget);
+    size_t getMetricBudget() const;
+
+    /** Configuration as { "metricBudget": n, "sampleRates": { prefix: rate } }.
+        setConfig replaces the whole configuration.
+    */
+    Json::Value getConfig() const;
+    void setConfig(const Json::Value & config);
+
+    /** Configuration along with the number of events that were dropped. */
+    Json::Value getStatus() const;
+
+    /** Decide whether the given event is to be recorded.  When a counter is
+        kept by sampling, its value is scaled up and a hit becomes a count.
+    */
+    bool sample(const std::string & prefix, const char * event,
+                StatEventType & type, float & value)
+    {
+        if (JML_LIKELY(!enabled.load(std::memory_order_relaxed)))
+            return true;
+        return doSample(prefix, event, type, value);
+    }
+
+    uint64_t numSampledOut() const { return sampledOut; }
+    uint64_t numOverBudget() const { return overBudget; }
+
+private:
+    struct Decision {
+        double rate;
+        bool admitted;
+    };
+
+    struct ThreadCache {
+        uint64_t generation;
+        std::string name;
+        std::unordered_map<std::string, Decision> decisions;
+        unsigned int seed;
+    };
+
+    bool doSample(const std::string & prefix, const char * event,
+                  StatEventType & type, float & value);
+
+    Decision decide(const std::string & name);
+
+    /** Invalidate the decisions cached by the threads.  Called with the
+        lock held.
+    */
+    void changed();
+
+    mutable std::mutex lock;
+    std::map<std::string, double> rates;
+    size_t budget;
+    std::unordered_set<std::string> admitted;
+
+    std::atomic<bool> enabled;
+    std::atomic<uint64_t> generation;
+    boost::thread_specific_ptr<ThreadCache> cache;
+
+    std::atomic<uint64_t> sampledOut;
+    std::atomic<uint64_t> overBudget;
+};
+
+
+/** Add GET and PUT routes on the given path to read and change the
+    configuration of the sampler at runtime.
+*/
+void addEventSamplerRoutes(RestRequestRouter & router,
+                           const std::string & path,
+                           const std::shared_ptr<EventSampler> & sampler);
+
+} // namespace Datacratic
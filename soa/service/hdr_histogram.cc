@@ -0,0 +1,195 @@
+/* hdr_histogram.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+*/
+
+#include <algorithm>
+#include <sstream>
+
+#include "jml/arch/exception.h"
+#include "jml/db/persistent.h"
+#include "hdr_histogram.h"
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+/*****************************************************************************/
+/* HDR HISTOGRAM                                                             */
+/*****************************************************************************/
+
+void
+HdrHistogram::
+clear()
+{
+    counts.clear();
+    offset = ZeroIndex;
+    count_ = 0;
+    sum_ = 0.0;
+    min_ = max_ = 0.0;
+}
+
+void
+HdrHistogram::
+extend(int index)
+{
+    if (counts.empty()) {
+        counts.resize(1);
+        offset = index;
+        return;
+    }
+
+    int end = offset + counts.size();
+    if (index < offset) {
+        counts.insert(counts.begin(), offset - index, 0);
+        offset = index;
+    }
+    else if (index >= end)
+        counts.resize(index + 1 - offset);
+}
+
+float
+HdrHistogram::
+bucketUpperBound(int index)
+{
+    if (index == ZeroIndex)
+        return 0.0;
+
+    if (index > ZeroIndex) {
+        int i = index - ZeroIndex - 1;
+        double mantissa = 1.0 + double(i % SubBuckets + 1) / SubBuckets;
+        return std::ldexp(mantissa, i / SubBuckets + MinExponent);
+    }
+
+    int i = ZeroIndex - 1 - index;
+    double mantissa = 1.0 + double(i % SubBuckets) / SubBuckets;
+    return -std::ldexp(mantissa, i / SubBuckets + MinExponent);
+}
+
+float
+HdrHistogram::
+percentile(double percentile) const
+{
+    if (count_ == 0)
+        return 0.0;
+
+    uint64_t target = std::ceil(count_ * std::min(percentile, 100.0) / 100.0);
+    if (target == 0)
+        return min_;
+
+    uint64_t total(0);
+    for (size_t i = 0; i < counts.size(); i++) {
+        total += counts[i];
+        if (total >= target) {
+            float bound = bucketUpperBound(offset + i);
+            return std::max(min_, std::min(bound, max_));
+        }
+    }
+
+    return max_;
+}
+
+HdrHistogram &
+HdrHistogram::
+operator += (const HdrHistogram & other)
+{
+    if (other.count_ == 0)
+        return *this;
+
+    extend(other.offset);
+    extend(other.offset + other.counts.size() - 1);
+    for (size_t i = 0; i < other.counts.size(); i++)
+        counts[other.offset + i - offset] += other.counts[i];
+
+    if (count_ == 0 || other.min_ < min_)
+        min_ = other.min_;
+    if (count_ == 0 || other.max_ > max_)
+        max_ = other.max_;
+    count_ += other.count_;
+    sum_ += other.sum_;
+
+    return *this;
+}
+
+void
+HdrHistogram::
+serialize(ML::DB::Store_Writer & store) const
+{
+    using namespace ML::DB;
+
+    unsigned char version = 0;
+    store << version << compact_size_t(count_) << sum_ << min_ << max_;
+
+    size_t numBuckets(0);
+    for (uint64_t count: counts)
+        if (count)
+            numBuckets++;
+    store << compact_size_t(numBuckets);
+
+    // Each bucket is written with its distance from the previous one
+    int last = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        if (!counts[i])
+            continue;
+        int index = offset + i;
+        store << compact_size_t(index - last) << compact_size_t(counts[i]);
+        last = index;
+    }
+}
+
+void
+HdrHistogram::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    using namespace ML::DB;
+
+    unsigned char version;
+    store >> version;
+    if (version != 0)
+        throw ML::Exception("invalid HdrHistogram version %d", version);
+
+    HdrHistogram result;
+    compact_size_t count, numBuckets;
+    store >> count >> result.sum_ >> result.min_ >> result.max_
+          >> numBuckets;
+    result.count_ = count;
+
+    uint64_t total(0);
+    int index = 0;
+    for (size_t i = 0; i < numBuckets; i++) {
+        compact_size_t delta, bucketCount;
+        store >> delta >> bucketCount;
+        index += delta;
+        if (index >= NumBuckets)
+            throw ML::Exception("invalid HdrHistogram bucket %d", index);
+        result.extend(index);
+        result.counts[index - result.offset] = bucketCount;
+        total += bucketCount;
+    }
+
+    if (total != result.count_)
+        throw ML::Exception("HdrHistogram bucket counts do not add up");
+
+    *this = std::move(result);
+}
+
+std::string
+HdrHistogram::
+toBinary() const
+{
+    ostringstream stream;
+    ML::DB::Store_Writer store(stream);
+    serialize(store);
+    return stream.str();
+}
+
+HdrHistogram
+HdrHistogram::
+fromBinary(const std::string & binary)
+{
+    istringstream stream(binary);
+    ML::DB::Store_Reader store(stream);
+    HdrHistogram result;
+    result.reconstitute(store);
+    return result;
+}
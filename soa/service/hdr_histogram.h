@@ -0,0 +1,143 @@
+/* hdr_histogram.h                                                 -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Log-linear histogram of floating point values that can be merged.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "jml/compiler/compiler.h"
+#include "jml/db/persistent_fwd.h"
+
+
+namespace Datacratic {
+
+/*****************************************************************************/
+/* HDR HISTOGRAM                                                             */
+/*****************************************************************************/
+
+/** Histogram in the manner of HdrHistogram, for values of any sign and
+    scale: each power of two is split into SubBuckets linear buckets, so that
+    the percentiles reported are within 1/SubBuckets of the recorded values.
+    Recording takes constant time, and the memory used is bounded by the
+    range of the values seen rather than by their number.
+
+    The count, sum, minimum and maximum are kept exactly.  Values smaller in
+    magnitude than 2^MinExponent count as zero, and those larger than
+    2^MaxExponent go to the outermost buckets; NaNs are ignored.
+
+    Histograms recorded by different threads or processes can be added
+    together, which gives the percentiles of all of their values.
+
+    Not thread-safe.
+*/
+
+struct HdrHistogram {
+    enum {
+        SubBucketBits = 5,
+        SubBuckets = 1 << SubBucketBits,
+        MinExponent = -24,
+        MaxExponent = 40,
+        NumExponents = MaxExponent - MinExponent,
+        ZeroIndex = NumExponents * SubBuckets,   ///< bucket of zero
+        NumBuckets = 2 * ZeroIndex + 1
+    };
+
+    HdrHistogram()
+    {
+        clear();
+    }
+
+    void record(float value)
+    {
+        if (JML_UNLIKELY(std::isnan(value)))
+            return;
+
+        int index = bucketIndex(value);
+        if (JML_UNLIKELY(index < offset
+                         || index >= offset + (int)counts.size()))
+            extend(index);
+        counts[index - offset] += 1;
+
+        if (count_ == 0 || value < min_)
+            min_ = value;
+        if (count_ == 0 || value > max_)
+            max_ = value;
+        count_ += 1;
+        sum_ += value;
+    }
+
+    void clear();
+
+    /** Number of values recorded. */
+    uint64_t count() const { return count_; }
+
+    /** Exact sum, mean, minimum and maximum of the values recorded; the
+        last three are 0 when the histogram is empty.
+    */
+    double sum() const { return sum_; }
+    double mean() const { return count_ ? sum_ / count_ : 0.0; }
+    float min() const { return min_; }
+    float max() const { return max_; }
+
+    /** Value below which "percentile" percents of the recorded values
+        fall; returns 0 when the histogram is empty.
+    */
+    float percentile(double percentile) const;
+
+    HdrHistogram & operator += (const HdrHistogram & other);
+
+    /** Only the non-empty buckets are written, so that a histogram is
+        typically a few hundred bytes.
+    */
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
+
+    std::string toBinary() const;
+    static HdrHistogram fromBinary(const std::string & binary);
+
+    /** Index of the bucket of the given value, from the most negative
+        values to the most positive ones.
+    */
+    JML_ALWAYS_INLINE static int bucketIndex(float value)
+    {
+        uint32_t bits;
+        ::memcpy(&bits, &value, sizeof(bits));
+
+        int exponent = int((bits >> 23) & 0xff) - 127;
+        if (exponent < MinExponent)
+            return ZeroIndex;
+
+        int index;
+        if (exponent >= MaxExponent)
+            index = NumExponents * SubBuckets - 1;
+        else index = (exponent - MinExponent) * SubBuckets
+                 + ((bits >> (23 - SubBucketBits)) & (SubBuckets - 1));
+
+        return (bits >> 31) ? ZeroIndex - 1 - index : ZeroIndex + 1 + index;
+    }
+
+    /** Upper bound of the values counted in the given bucket. */
+    static float bucketUpperBound(int index);
+
+private:
+    void extend(int index);
+
+    // Counts of the buckets from "offset" onwards; the range grows to cover
+    // the buckets that were recorded in
+    std::vector<uint64_t> counts;
+    int offset;
+
+    uint64_t count_;
+    double sum_;
+    float min_;
+    float max_;
+};
+
+} // namespace Datacratic
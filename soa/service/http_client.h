@@ -143,6 +143,17 @@ struct HttpClientImpl : public AsyncEventSource {
 
     /* Returns the number of requests in the queue */
     virtual size_t queuedRequests() const = 0;
+
+    /** Keep up to "minConnections" connections open and close the others
+     *  after they have been idle for "idleTimeout" seconds (0 = never).
+     *  Only honoured by implementations that pool their connections. */
+    virtual void setConnectionPool(int minConnections, double idleTimeout)
+    {}
+
+    /** Number of seconds during which the resolved address of the host is
+     *  reused before being looked up again. */
+    virtual void setDnsCacheTtl(double ttl)
+    {}
 };
 
 
@@ -229,6 +240,22 @@ struct HttpClient : public AsyncEventSource {
         impl->enablePipelining(value);
     }
 
+    /** Connections are opened as needed, up to "numParallel". Once the load
+     *  decreases, the connections above "minConnections" that remained idle
+     *  for "idleTimeout" seconds are closed (0 = never, the default). Must
+     *  be called before the client is added to a message loop. */
+    void setConnectionPool(int minConnections, double idleTimeout)
+    {
+        impl->setConnectionPool(minConnections, idleTimeout);
+    }
+
+    /** Number of seconds during which the resolved address of the host is
+     *  reused before being looked up again (60 by default). */
+    void setDnsCacheTtl(double ttl)
+    {
+        impl->setDnsCacheTtl(ttl);
+    }
+
     /** Performs a GET request, with "resource" as the location of the
      *  resource on the server indicated in "baseUrl". Query parameters
      *  should preferably be passed via "queryParams".
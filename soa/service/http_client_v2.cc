@@ -4,12 +4,17 @@
 */
 
 #include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <arpa/inet.h>
 #include <sys/timerfd.h>
 
+#include "googleurl/src/gurl.h"
 #include "jml/arch/exception.h"
 #include "jml/utils/exc_assert.h"
 
 #include "soa/types/url.h"
+#include "dns_cache.h"
 #include "message_loop.h"
 #include "http_header.h"
 #include "http_parsers.h"
@@ -99,8 +104,8 @@ makeRequestStr(const HttpRequest & request)
 
 HttpConnection::
 HttpConnection()
-    : responseState_(IDLE), requestEnded_(false), lastCode_(Success),
-      timeoutFd_(-1)
+    : responseState_(IDLE), deadline_(Date::notADate()),
+      requestEnded_(false), lastCode_(Success), timeoutFd_(-1)
 {
     // cerr << "HttpConnection(): " << this << "\n";
 
@@ -144,12 +149,13 @@ clear()
     responseState_ = IDLE;
     requestEnded_ = false;
     request_.clear();
+    deadline_ = Date::notADate();
     lastCode_ = Success;
 }
 
 void
 HttpConnection::
-perform(HttpRequest && request)
+perform(HttpRequest && request, Date deadline)
 {
     // cerr << "perform: " << this << endl;
 
@@ -159,6 +165,7 @@ perform(HttpRequest && request)
     }
 
     request_ = move(request);
+    deadline_ = deadline;
 
     if (queueEnabled()) {
         startSendingRequest();
@@ -333,7 +340,13 @@ void
 HttpConnection::
 armRequestTimer()
 {
-    if (request_.timeout_ > 0) {
+    double timeout(request_.timeout_);
+    if (deadline_.isADate()) {
+        /* an expired timer would never fire */
+        timeout = max(deadline_.secondsSince(Date::now()), 0.001);
+    }
+
+    if (timeout > 0) {
         if (timeoutFd_ == -1) {
             timeoutFd_ = timerfd_create(CLOCK_MONOTONIC,
                                         TFD_NONBLOCK | TFD_CLOEXEC);
@@ -356,8 +369,11 @@ armRequestTimer()
         itimerspec spec;
         ::memset(&spec, 0, sizeof(itimerspec));
 
+        double seconds;
+        double fraction = modf(timeout, &seconds);
         spec.it_interval.tv_sec = 0;
-        spec.it_value.tv_sec = request_.timeout_;
+        spec.it_value.tv_sec = seconds;
+        spec.it_value.tv_nsec = fraction * 1000000000;
         int res = timerfd_settime(timeoutFd_, 0, &spec, nullptr);
         if (res == -1) {
             throw ML::Exception(errno, "timerfd_settime");
@@ -416,23 +432,32 @@ HttpClientV2(const string & baseUrl, int numParallel, size_t queueSize)
     : HttpClientImpl(baseUrl, numParallel, queueSize),
       loop_(1, 0, -1),
       baseUrl_(baseUrl),
-      avlConnections_(numParallel),
-      nextAvail_(0),
+      resolving_(false),
+      dnsTtl_(60.0),
+      resolverTarget_(make_shared<ResolverTarget>()),
+      maxConnections_(numParallel),
+      minConnections_(0),
+      idleTimeout_(0.0),
+      reaping_(false),
       queue_([&]() { this->handleQueueEvent(); return false; }, queueSize)
 {
     ExcAssert(baseUrl.compare(0, 8, "https://") != 0);
 
-    /* available connections */
-    for (size_t i = 0; i < numParallel; i++) {
-        HttpConnection * connPtr = new HttpConnection();
-        shared_ptr<HttpConnection> connection(connPtr);
-        connection->init(baseUrl);
-        connection->onDone = [&, connPtr] (TcpConnectionCode result) {
-            handleHttpConnectionDone(connPtr, result);
-        };
-        loop_.addSource("connection" + to_string(i), connection);
-        avlConnections_[i] = connPtr;
+    Url url(baseUrl);
+    hostname_ = url.host();
+    port_ = url.gurl().EffectiveIntPort();
+
+    resolverTarget_->client = this;
+
+    in_addr addr;
+    if (::inet_aton(hostname_.c_str(), &addr) != 0) {
+        address_ = hostname_;
+        addressResolved_ = Date::positiveInfinity();
+    }
+    else {
+        resolveHost();
     }
+
     loop_.addSource("queue", queue_);
 }
 
@@ -440,6 +465,10 @@ HttpClientV2::
 ~HttpClientV2()
 {
     // cerr << "~HttpClient: " << this << "\n";
+
+    /* pending resolutions must not reach the client anymore */
+    std::unique_lock<std::mutex> guard(resolverTarget_->lock);
+    resolverTarget_->client = nullptr;
 }
 
 int
@@ -485,6 +514,40 @@ enablePipelining(bool value)
     }
 }
 
+void
+HttpClientV2::
+setConnectionPool(int minConnections, double idleTimeout)
+{
+    if (minConnections < 0 || minConnections > maxConnections_) {
+        throw ML::Exception("'minConnections' must be between 0 and"
+                            " 'numParallel'");
+    }
+    if (idleTimeout < 0) {
+        throw ML::Exception("'idleTimeout' cannot be negative");
+    }
+
+    minConnections_ = minConnections;
+    idleTimeout_ = idleTimeout;
+
+    if (idleTimeout_ > 0 && !reaping_) {
+        auto onTimer = [&] (uint64_t numWakeups) {
+            this->reapIdleConnections();
+        };
+        loop_.addPeriodic("reaper", min(idleTimeout_, 1.0), onTimer);
+        reaping_ = true;
+    }
+}
+
+void
+HttpClientV2::
+setDnsCacheTtl(double ttl)
+{
+    if (ttl < 0) {
+        throw ML::Exception("the ttl of the dns cache cannot be negative");
+    }
+    dnsTtl_ = ttl;
+}
+
 bool
 HttpClientV2::
 enqueueRequest(const string & verb, const string & resource,
@@ -494,30 +557,43 @@ enqueueRequest(const string & verb, const string & resource,
                int timeout)
 {
     string url = baseUrl_ + resource + queryParams.uriEscaped();
-    HttpRequest request(verb, url, callbacks, content, headers, timeout);
+    QueuedRequest queued;
+    queued.request = HttpRequest(verb, url, callbacks, content, headers,
+                                 timeout);
+    queued.deadline = (timeout > 0
+                       ? Date::now().plusSeconds(timeout)
+                       : Date::notADate());
 
-    return queue_.push_back(std::move(request));
+    return queue_.push_back(std::move(queued));
 }
 
 void
 HttpClientV2::
 handleQueueEvent()
 {
-    size_t numConnections = avlConnections_.size() - nextAvail_;
+    /* requests wait in the queue until the host address is known */
+    if (address_.empty()) {
+        resolveHost();
+        return;
+    }
+
+    size_t numConnections = (idleConnections_.size()
+                             + maxConnections_ - connections_.size());
     if (numConnections > 0) {
         /* "0" has a special meaning for pop_front and must be avoided here */
         auto requests = queue_.pop_front(numConnections);
-        for (auto request: requests) {
+        Date now = Date::now();
+        for (auto & queued: requests) {
+            if (queued.deadline.isADate() && queued.deadline <= now) {
+                failRequest(queued.request, HttpClientError::Timeout);
+                continue;
+            }
             HttpConnection * conn = getConnection();
             if (!conn) {
-                cerr << ("nextAvail_: "  + to_string(nextAvail_)
-                         + "; num conn: "  + to_string(numConnections)
-                         + "; num reqs: "  + to_string(requests.size())
-                         + "\n");
                 throw ML::Exception("inconsistency in count of available"
                                     " connections");
             }
-            conn->perform(move(request));
+            conn->perform(move(queued.request), queued.deadline);
         }
     }
 }
@@ -527,28 +603,108 @@ HttpClientV2::
 handleHttpConnectionDone(HttpConnection * connection,
                          TcpConnectionCode result)
 {
-    auto requests = queue_.pop_front(1);
-    if (requests.size() > 0) {
-        // cerr << "emptying queue...\n";
-        connection->perform(move(requests[0]));
+    auto it = connections_.find(connection);
+    if (it == connections_.end()) {
+        throw ML::Exception("unknown connection");
     }
-    else {
+
+    PooledConnection & pooled = it->second;
+    if (pooled.state == IDLE) {
+        /* an idle connection was closed by the peer */
+        return;
+    }
+    if (pooled.state == CLOSING) {
+        /* closed by the reaper: reopened only when everything else is in
+           use */
+        pooled.state = IDLE;
+        pooled.idleSince = Date::now();
+        idleConnections_.insert(idleConnections_.begin(), connection);
+        return;
+    }
+
+    if (!performNext(connection)) {
         releaseConnection(connection);
     }
 }
 
+bool
+HttpClientV2::
+performNext(HttpConnection * connection)
+{
+    for (;;) {
+        /* "0" has a special meaning for pop_front and must be avoided here */
+        auto requests = queue_.pop_front(1);
+        if (requests.empty()) {
+            return false;
+        }
+
+        QueuedRequest & queued = requests[0];
+        if (queued.deadline.isADate() && queued.deadline <= Date::now()) {
+            failRequest(queued.request, HttpClientError::Timeout);
+            continue;
+        }
+
+        connection->perform(move(queued.request), queued.deadline);
+        return true;
+    }
+}
+
+void
+HttpClientV2::
+failRequest(HttpRequest & request, HttpClientError error)
+{
+    if (request.callbacks_) {
+        request.callbacks_->onDone(request, error);
+    }
+}
+
+void
+HttpClientV2::
+failQueuedRequests(HttpClientError error)
+{
+    for (;;) {
+        auto requests = queue_.pop_front(1);
+        if (requests.empty()) {
+            break;
+        }
+        failRequest(requests[0].request, error);
+    }
+}
+
 HttpConnection *
 HttpClientV2::
 getConnection()
 {
-    HttpConnection * conn;
+    HttpConnection * conn(nullptr);
 
-    if (nextAvail_ < avlConnections_.size()) {
-        conn = avlConnections_[nextAvail_];
-        nextAvail_++;
+    if (!idleConnections_.empty()) {
+        conn = idleConnections_.back();
+        idleConnections_.pop_back();
+        PooledConnection & pooled = connections_[conn];
+        pooled.state = BUSY;
+
+        /* a closed connection reconnects to the current address */
+        if (!conn->queueEnabled()) {
+            conn->init(address_, port_);
+        }
     }
-    else {
-        conn = nullptr;
+    else if (connections_.size() < maxConnections_) {
+        shared_ptr<HttpConnection> connection = make_shared<HttpConnection>();
+        conn = connection.get();
+        connection->init(address_, port_);
+        connection->onDone = [&, conn] (TcpConnectionCode result) {
+            this->handleHttpConnectionDone(conn, result);
+        };
+        loop_.addSource("connection" + to_string(connections_.size()),
+                        connection);
+
+        PooledConnection & pooled = connections_[conn];
+        pooled.connection = connection;
+        pooled.state = BUSY;
+    }
+
+    if (conn && Date::now().secondsSince(addressResolved_) >= dnsTtl_) {
+        resolveHost();
     }
 
     // cerr << " returning conn: " << conn << "\n";
@@ -560,8 +716,84 @@ void
 HttpClientV2::
 releaseConnection(HttpConnection * oldConnection)
 {
-    if (nextAvail_ > 0) {
-        nextAvail_--;
-        avlConnections_[nextAvail_] = oldConnection;
+    PooledConnection & pooled = connections_[oldConnection];
+    pooled.state = IDLE;
+    pooled.idleSince = Date::now();
+    idleConnections_.push_back(oldConnection);
+}
+
+void
+HttpClientV2::
+reapIdleConnections()
+{
+    size_t numOpen(0);
+    for (const auto & it: connections_) {
+        if (it.second.connection->queueEnabled()) {
+            numOpen++;
+        }
+    }
+
+    /* the least recently used connections come first */
+    Date now = Date::now();
+    for (auto it = idleConnections_.begin();
+         it != idleConnections_.end() && numOpen > minConnections_;) {
+        HttpConnection * conn = *it;
+        PooledConnection & pooled = connections_[conn];
+        if (!conn->queueEnabled()) {
+            ++it;
+            continue;
+        }
+        if (now.secondsSince(pooled.idleSince) < idleTimeout_) {
+            break;
+        }
+        pooled.state = CLOSING;
+        it = idleConnections_.erase(it);
+        conn->requestClose();
+        numOpen--;
+    }
+}
+
+void
+HttpClientV2::
+resolveHost()
+{
+    if (resolving_) {
+        return;
+    }
+    resolving_ = true;
+
+    /* The result is handed back to the loop thread, unless the client was
+       destroyed in the meantime. */
+    shared_ptr<ResolverTarget> target = resolverTarget_;
+    auto onResolved = [target] (int error, const string & address) {
+        std::unique_lock<std::mutex> guard(target->lock);
+        HttpClientV2 * client = target->client;
+        if (client) {
+            client->loop_.runInMessageLoopThread([=] () {
+                client->handleHostResolved(error, address);
+            });
+        }
+    };
+    DnsCache::instance().resolve(hostname_, dnsTtl_, onResolved);
+}
+
+void
+HttpClientV2::
+handleHostResolved(int error, const string & address)
+{
+    resolving_ = false;
+
+    if (error == 0) {
+        address_ = address;
+        addressResolved_ = Date::now();
+        handleQueueEvent();
+    }
+    else {
+        cerr << ("error resolving '" + hostname_ + "': "
+                 + gai_strerror(error) + "\n");
+        /* keep using the previous address if there is one */
+        if (address_.empty()) {
+            failQueuedRequests(HttpClientError::HostNotFound);
+        }
     }
 }
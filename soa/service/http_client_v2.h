@@ -16,15 +16,18 @@
    - parser:
      - needs better validation (header key size, ...)
    - compression
-   - auto disconnect (keep-alive)
    - SSL support
    - pipelining
  */
 
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "soa/jsoncpp/value.h"
+#include "soa/types/date.h"
 #include "soa/service/http_client.h"
 #include "soa/service/http_header.h"
 #include "soa/service/http_parsers.h"
@@ -54,7 +57,11 @@ struct HttpConnection : TcpClient {
     ~HttpConnection();
 
     void clear();
-    void perform(HttpRequest && request);
+
+    /* Send "request", which fails with a timeout error when no response was
+       received by "deadline". Without a deadline, the timeout of the request
+       starts when it is sent. */
+    void perform(HttpRequest && request, Date deadline = Date::notADate());
 
     const HttpRequest & request() const
     {
@@ -84,6 +91,7 @@ private:
 
     HttpState responseState_;
     HttpRequest request_;
+    Date deadline_;
     bool requestEnded_;
 
     /* Connection: close */
@@ -102,6 +110,14 @@ private:
 /* HTTP CLIENT V2                                                           */
 /****************************************************************************/
 
+/* Connections are created as the load requires it, up to "numParallel",
+ * and the idle ones are reused in LIFO order so that the least recently used
+ * can be closed once idle for long enough. The host name is resolved outside
+ * of the loop thread through the DnsCache and requests wait in the queue
+ * until the address is known. The timeout of a request counts from the
+ * moment it is enqueued, so that requests that are still queued once it
+ * expired fail right away instead of being sent. */
+
 struct HttpClientV2 : public HttpClientImpl {
     HttpClientV2(const std::string & baseUrl,
                  int numParallel, size_t queueSize);
@@ -132,26 +148,83 @@ struct HttpClientV2 : public HttpClientImpl {
         return queue_.size();
     }
 
+    void setConnectionPool(int minConnections, double idleTimeout);
+    void setDnsCacheTtl(double ttl);
+
+    /* Number of connections created so far */
+    size_t numConnections()
+        const
+    {
+        return connections_.size();
+    }
+
     HttpClient & operator = (HttpClient && other) = delete;
     HttpClient & operator = (const HttpClient & other) = delete;
 
 private:
+    struct QueuedRequest {
+        HttpRequest request;
+        Date deadline;
+    };
+
+    enum ConnectionState {
+        BUSY,
+        IDLE,
+        CLOSING
+    };
+
+    struct PooledConnection {
+        std::shared_ptr<HttpConnection> connection;
+        ConnectionState state;
+        Date idleSince;
+    };
+
+    /* Shared with the resolver callbacks, which may outlive the client */
+    struct ResolverTarget {
+        std::mutex lock;
+        HttpClientV2 * client;
+    };
+
     void handleQueueEvent();
 
     void handleHttpConnectionDone(HttpConnection * connection,
                                   TcpConnectionCode result);
 
+    /* Performs the next queued request that has not expired yet on
+       "connection", or returns false when there is none */
+    bool performNext(HttpConnection * connection);
+    void failRequest(HttpRequest & request, HttpClientError error);
+    void failQueuedRequests(HttpClientError error);
+
     HttpConnection * getConnection();
     void releaseConnection(HttpConnection * connection);
+    void reapIdleConnections();
+
+    void resolveHost();
+    void handleHostResolved(int error, const std::string & address);
 
     MessageLoop loop_;
 
     std::string baseUrl_;
+    std::string hostname_;
+    int port_;
+
+    /* resolved address of hostname_, empty until known */
+    std::string address_;
+    Date addressResolved_;
+    bool resolving_;
+    double dnsTtl_;
+    std::shared_ptr<ResolverTarget> resolverTarget_;
+
+    size_t maxConnections_;
+    size_t minConnections_;
+    double idleTimeout_;
+    bool reaping_;
 
-    std::vector<HttpConnection *> avlConnections_;
-    size_t nextAvail_;
+    std::unordered_map<HttpConnection *, PooledConnection> connections_;
+    std::vector<HttpConnection *> idleConnections_; /* most recent last */
 
-    TypedMessageQueue<HttpRequest> queue_; /* queued requests */
+    TypedMessageQueue<QueuedRequest> queue_; /* queued requests */
 
     HttpConnection::OnDone onHttpConnectionDone_;
 };
@@ -21,6 +21,52 @@ using namespace ML;
 namespace Datacratic {
 
 
+/*****************************************************************************/
+/* HTTP RESPONSE                                                             */
+/*****************************************************************************/
+
+void
+HttpResponse::
+preRender()
+{
+    std::string head;
+    renderHead(head);
+    renderedHead = std::make_shared<const std::string>(std::move(head));
+    numRenderedHeaders = extraHeaders.size();
+}
+
+void
+HttpResponse::
+renderHead(std::string & output) const
+{
+    output.append("HTTP/1.1 ");
+    output.append(to_string(responseCode));
+    output.append(" ");
+    output.append(responseStatus);
+    output.append("\r\n");
+
+    if (contentType != "") {
+        output.append("Content-Type: ");
+        output.append(contentType);
+        output.append("\r\n");
+    }
+
+    if (sendBody) {
+        output.append("Content-Length: ");
+        output.append(to_string(body.length()));
+        output.append("\r\n");
+        output.append("Connection: Keep-Alive\r\n");
+    }
+
+    for (auto & h: extraHeaders) {
+        output.append(h.first);
+        output.append(": ");
+        output.append(h.second);
+        output.append("\r\n");
+    }
+}
+
+
 /*****************************************************************************/
 /* HTTP CONNECTION HANDLER                                                   */
 /*****************************************************************************/
@@ -39,6 +85,13 @@ onGotTransport()
     
     readState = HEADER;
     startReading();
+
+    // Requests that came in behind the previous one on this connection
+    if (!pipelinedData.empty()) {
+        std::string data;
+        data.swap(pipelinedData);
+        handleData(data);
+    }
 }
 
 std::shared_ptr<ConnectionHandler>
@@ -48,7 +101,16 @@ makeNewHandlerShared()
     if (!this->httpEndpoint)
         throw Exception("HttpConnectionHandler needs to be owned by an "
                         "HttpEndpoint for makeNewHandlerShared() to work");
-    return httpEndpoint->makeNewHandler();
+    auto result = httpEndpoint->makeNewHandler();
+    if (!pipelinedData.empty()) {
+        auto httpHandler
+            = std::dynamic_pointer_cast<HttpConnectionHandler>(result);
+        if (!httpHandler)
+            throw Exception("pipelined HTTP requests need an "
+                            "HttpConnectionHandler to be handled");
+        httpHandler->pipelinedData.swap(pipelinedData);
+    }
+    return result;
 }
 
 void
@@ -84,17 +146,43 @@ handleData(const std::string & data)
         handleHttpData(data);
         return;
     }
+
+    if (readState == DONE) {
+        // The client is pipelining requests; keep them until the response
+        // to this one is sent
+        if (pipelinedData.size() + data.size() > MaxPipelinedData) {
+            doError("too much pipelined data");
+            return;
+        }
+        pipelinedData.append(data);
+        return;
+    }
     
     if (readState != HEADER) {
         throw Exception("invalid read state %d handling data '%s' for %p",
                         readState, data.c_str(), this);
     }
     
-    headerText += data;
-    // The first time that we see that character sequence, it's the break
-    // between the header and the data.
-    string::size_type breakPos = headerText.find("\r\n\r\n");
-    
+    /* Usually the whole header arrives in one read, in which case it is
+       parsed straight out of the receive buffer.  Otherwise it accumulates
+       in headerText and only the new data (plus the three characters
+       before it) is scanned for the end of header.
+    */
+    const std::string * text = &data;
+    string::size_type breakPos;
+
+    if (headerText.empty()) {
+        breakPos = data.find("\r\n\r\n");
+        if (breakPos == string::npos)
+            headerText = data;
+    }
+    else {
+        string::size_type searchFrom
+            = headerText.size() < 3 ? 0 : headerText.size() - 3;
+        headerText += data;
+        breakPos = headerText.find("\r\n\r\n", searchFrom);
+        text = &headerText;
+    }
 
     if (breakPos == string::npos)
     {
@@ -106,7 +194,7 @@ handleData(const std::string & data)
     }
     // We got a header
     try {
-        header.parse(headerText);
+        header.parseBuffer(text->c_str(), text->length());
     } catch (...) {
         cerr << "problem parsing in state: " << status() << endl;
         throw;
@@ -172,24 +260,53 @@ handleHttpData(const std::string & data)
         if (readState != PAYLOAD)
             throw Exception("invalid state: expected payload");
 
-        payload += data;
+        /* The common case is the whole body arriving with the header, so
+           hand it over as is rather than accumulating a copy. */
+        if (payload.empty() && data.length() == header.contentLength) {
+            addActivityS("got HTTP payload");
+            readState = DONE;
+            handleHttpPayload(header, data);
+            return;
+        }
+
+        /* Anything beyond the body is the start of the next request.  It
+           is put aside before the payload is handled, as the response can
+           be sent, and the next handler created, from within the handler.
+        */
+        size_t needed = header.contentLength - payload.length();
+        if (data.length() > needed) {
+            if (data.length() - needed > MaxPipelinedData) {
+                doError("too much pipelined data");
+                return;
+            }
+            pipelinedData.assign(data, needed, string::npos);
+            if (payload.empty()) {
+                addActivityS("got HTTP payload");
+                readState = DONE;
+                handleHttpPayload(header, data.substr(0, needed));
+                return;
+            }
+            payload.append(data, 0, needed);
+        }
+        else {
+            if (payload.empty() && header.contentLength <= 1024 * 1024)
+                payload.reserve(header.contentLength);
+            payload += data;
+        }
 #if 0
         cerr << "payload = " << payload << endl;
         cerr << "payload.length() = " << payload.length() << endl;
         cerr << "header.contentLength = " << header.contentLength << endl;
 #endif
-        if (payload.length() > header.contentLength) {
-            doError("extra data");
-        }
-    
+
 
         if (payload.length() == header.contentLength) {
             addActivityS("got HTTP payload");
-            handleHttpPayload(header, payload);
 
             //cerr << this << " switching to DONE" << endl;
 
             readState = DONE;
+            handleHttpPayload(header, payload);
         }
     }
     if (readState == CHUNK_HEADER || readState == CHUNK_BODY) {
@@ -350,28 +467,20 @@ putResponseOnWire(HttpResponse response,
         };
 
     std::string responseStr;
-    responseStr.reserve(1024 + response.body.length());
-
-    responseStr.append("HTTP/1.1 ");
-    responseStr.append(to_string(response.responseCode));
-    responseStr.append(" ");
-    responseStr.append(response.responseStatus);
-    responseStr.append("\r\n");
+    responseStr.reserve(1024);
 
-    if (response.contentType != "") {
-        responseStr.append("Content-Type: ");
-        responseStr.append(response.contentType);
-        responseStr.append("\r\n");
+    size_t firstHeader = 0;
+    if (response.renderedHead) {
+        responseStr.append(*response.renderedHead);
+        firstHeader = response.numRenderedHeaders;
     }
-
-    if (response.sendBody) {
-        responseStr.append("Content-Length: ");
-        responseStr.append(to_string(response.body.length()));
-        responseStr.append("\r\n");
-        responseStr.append("Connection: Keep-Alive\r\n");
+    else {
+        response.renderHead(responseStr);
+        firstHeader = response.extraHeaders.size();
     }
 
-    for (auto & h: response.extraHeaders) {
+    for (size_t i = firstHeader;  i < response.extraHeaders.size();  ++i) {
+        auto & h = response.extraHeaders[i];
         responseStr.append(h.first);
         responseStr.append(": ");
         responseStr.append(h.second);
@@ -379,11 +488,13 @@ putResponseOnWire(HttpResponse response,
     }
 
     responseStr.append("\r\n");
-    responseStr.append(response.body);
 
     //cerr << "sending " << responseStr << endl;
-    
-    send(responseStr,
+
+    /* The body goes out in the same write as the header without being
+       copied after it. */
+    send(std::move(responseStr),
+         std::move(response.body),
          next,
          onSendFinished);
 }
@@ -393,6 +504,8 @@ putResponseOnWire(HttpResponse response,
 /* HTTP ENDPOINT                                                             */
 /*****************************************************************************/
 
+constexpr size_t HttpConnectionHandler::MaxPipelinedData;
+
 HttpEndpoint::
 HttpEndpoint(const std::string & name)
     : PassiveEndpointT<SocketTransport>(name)
@@ -35,10 +35,11 @@ struct HttpResponse {
                      = std::vector<std::pair<std::string, std::string> >())
         : responseCode(responseCode),
           responseStatus(getResponseReasonPhrase(responseCode)),
-          contentType(contentType),
-          body(body),
-          extraHeaders(extraHeaders),
-          sendBody(true)
+          contentType(std::move(contentType)),
+          body(std::move(body)),
+          extraHeaders(std::move(extraHeaders)),
+          sendBody(true),
+          numRenderedHeaders(0)
     {
     }
 
@@ -53,7 +54,8 @@ struct HttpResponse {
           responseStatus(getResponseReasonPhrase(responseCode)),
           contentType(contentType),
           extraHeaders(extraHeaders),
-          sendBody(false)
+          sendBody(false),
+          numRenderedHeaders(0)
     {
     }
 
@@ -66,16 +68,34 @@ struct HttpResponse {
           contentType("application/json"),
           body(boost::trim_copy(body.toString())),
           extraHeaders(extraHeaders),
-          sendBody(true)
+          sendBody(true),
+          numRenderedHeaders(0)
     {
     }
 
+    /** Render the status line and headers once and keep them, so that a
+        response that is sent over and over (a no-bid, for example) is not
+        formatted again each time.  The body must not be changed
+        afterwards; extra headers added afterwards are still sent.
+    */
+    void preRender();
+
+    /** Append the status line and headers, but not the blank line that
+        ends them, to the given string.
+    */
+    void renderHead(std::string & output) const;
+
     int responseCode;
     std::string responseStatus;
     std::string contentType;
     std::string body;
     std::vector<std::pair<std::string, std::string> > extraHeaders;
     bool sendBody;
+
+    /// Head rendered by preRender(), shared between copies
+    std::shared_ptr<const std::string> renderedHead;
+    /// Number of extraHeaders that are already in renderedHead
+    size_t numRenderedHeaders;
 };
 
 
@@ -120,13 +140,25 @@ struct HttpConnectionHandler : public PassiveConnectionHandler {
     /** When we first got data. */
     Date firstData;
 
+    /** Data received after the end of the request, which belongs to the
+        requests that the client pipelined behind it.  It is handed over
+        to the handler of the next request, so that the requests of a
+        connection are handled, and their responses sent, in order.
+    */
+    std::string pipelinedData;
+
+    /** Maximum size of pipelinedData, over which the connection is
+        closed.
+    */
+    static constexpr size_t MaxPipelinedData = 1024 * 1024;
+
     HttpEndpoint * httpEndpoint;
 
     virtual void onGotTransport();
 
     /** Create a new connection handler.  Delegates to the endpoint.  This
         is used after a response is sent to set the connection up for a
-        new request.
+        new request, and passes the pipelined data on to it.
     */
     std::shared_ptr<ConnectionHandler> makeNewHandlerShared();
 
@@ -180,14 +180,21 @@ void
 HttpHeader::
 parse(const std::string & headerAndData, bool checkBodyLength)
 {
+    parseBuffer(headerAndData.c_str(), headerAndData.length(),
+                checkBodyLength);
+}
+
+void
+HttpHeader::
+parseBuffer(const char * headerAndData, size_t length, bool checkBodyLength)
+{
+    const char * end = headerAndData + length;
+
     try {
         HttpHeader parsed;
 
         // Parse http
-        ML::Parse_Context context("request header",
-                                  headerAndData.c_str(),
-                                  headerAndData.c_str()
-                                      + headerAndData.length());
+        ML::Parse_Context context("request header", headerAndData, end);
 
         parsed.verb = context.expect_text(" \n");
         context.expect_literal(' ');
@@ -234,12 +241,9 @@ parse(const std::string & headerAndData, bool checkBodyLength)
         }
 
         // The rest of the data is the body
-        const char * content_start
-            = headerAndData.c_str() + context.get_offset();
+        const char * content_start = headerAndData + context.get_offset();
 
-        parsed.knownData
-            = string(content_start,
-                     headerAndData.c_str() + headerAndData.length());
+        parsed.knownData = string(content_start, end);
 
         if (checkBodyLength && (parsed.contentLength != -1)
             && ((int)parsed.knownData.length() > (int)parsed.contentLength)) {
@@ -250,7 +254,7 @@ parse(const std::string & headerAndData, bool checkBodyLength)
                                      "%d > %d for data \"%s\"",
                                      (int)parsed.knownData.length(),
                                      (int)parsed.contentLength,
-                                     headerAndData.c_str()));
+                                     string(headerAndData, end).c_str()));
 #endif
             parsed.knownData.resize(parsed.contentLength);
         }
@@ -259,7 +263,7 @@ parse(const std::string & headerAndData, bool checkBodyLength)
     }
     catch (const std::exception & exc) {
         cerr << "error parsing http header: " << exc.what() << endl;
-        cerr << headerAndData << endl;
+        cerr << string(headerAndData, end) << endl;
         throw;
     }
 }
@@ -61,6 +61,13 @@ struct HttpHeader {
 
     void parse(const std::string & headerAndData, bool checkBodyLength = true);
 
+    /** Parse the header directly out of the given buffer, which must start
+        with the request line.  Anything after the blank line ending the
+        header is copied into knownData.
+    */
+    void parseBuffer(const char * headerAndData, size_t length,
+                     bool checkBodyLength = true);
+
     std::string verb;       // GET, PUT, etc
     std::string resource;   // after the get
     std::string version;    // after the get
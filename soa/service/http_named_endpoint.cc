@@ -6,6 +6,7 @@
 */
 
 #include "http_named_endpoint.h"
+#include "service_discovery_cache.h"
 
 using namespace std;
 
@@ -250,7 +251,7 @@ sendResponse(int code,
     // handled.
     auto onSendFinished = [=] {
         this->transport().associateWhenHandlerFinished
-        (endpoint->makeNewHandler(), "sendResponse");
+        (this->makeNewHandlerShared(), "sendResponse");
     };
     
     for (auto & h: endpoint->extraHeaders)
@@ -328,13 +329,11 @@ connectToServiceClass(const std::string & serviceClass,
     this->serviceClass = serviceClass;
     this->endpointName = endpointName;
 
-    std::vector<std::string> children
-        = config->getChildren("serviceClass/" + serviceClass);
+    auto children = config->discovery()->getEntries("serviceClass/"
+                                                    + serviceClass);
 
-    for (auto c : children) {
-        std::string key = "serviceClass/" + serviceClass + "/" + c;
-
-        Json::Value value = config->getJson(key);
+    for (auto & c : *children) {
+        const Json::Value & value = c.second;
         std::string name = value["serviceName"].asString();
         std::string path = value["servicePath"].asString();
 
@@ -0,0 +1,421 @@
+/* io_uring_poller.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+*/
+
+#include "soa/service/io_uring_poller.h"
+
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include <linux/io_uring.h>
+
+#include <atomic>
+#include <algorithm>
+#include "jml/arch/exception.h"
+#include "jml/utils/guard.h"
+
+using namespace std;
+
+namespace Datacratic {
+
+namespace {
+
+/* User data of the removal requests, whose completions are ignored. */
+constexpr uint64_t RemoveTag = ~uint64_t(0);
+
+/* Poller whose completions this thread is currently handling.  Requests
+   queued from its handlers are submitted together once they all ran; those
+   coming from anywhere else are submitted right away since the loop may be
+   asleep.
+*/
+thread_local const IoUringPoller * handling = nullptr;
+
+int ioUringSetup(unsigned entries, io_uring_params * params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete,
+                 unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags,
+                   nullptr, 0);
+}
+
+unsigned loadAcquire(const unsigned * ptr)
+{
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+void storeRelease(unsigned * ptr, unsigned value)
+{
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+template<typename T>
+T * offset(void * base, size_t off)
+{
+    return reinterpret_cast<T *>(static_cast<char *>(base) + off);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* IO URING POLLER                                                           */
+/*****************************************************************************/
+
+bool
+IoUringPoller::
+supported()
+{
+    static const bool result = [] () {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int fd = ioUringSetup(2, &params);
+        if (fd == -1) return false;
+        ::close(fd);
+        return true;
+    } ();
+
+    return result;
+}
+
+IoUringPoller::
+IoUringPoller(unsigned maxFds)
+    : ringFd_(-1),
+      sqRing_(MAP_FAILED), sqRingSize_(0),
+      cqRing_(MAP_FAILED), cqRingSize_(0),
+      sqes_(nullptr), sqesSize_(0),
+      toSubmit_(0), nextGeneration_(0)
+{
+    // Each fd has at most one poll request in flight but the completions of
+    // all of them can come in before we get to reap them.
+    unsigned cqEntries = 1;
+    while (cqEntries < std::max(maxFds, 2U)) cqEntries <<= 1;
+    cqEntries = std::min(cqEntries, 1U << 16);
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = cqEntries;
+
+    ringFd_ = ioUringSetup(std::min(cqEntries, 4096U), &params);
+    if (ringFd_ == -1)
+        throw ML::Exception(errno, "io_uring_setup");
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+
+    auto map = [&] (size_t size, off_t off) {
+        void * result = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ringFd_, off);
+        if (result == MAP_FAILED) {
+            int err = errno;
+            this->cleanup();
+            throw ML::Exception(err, "io_uring mmap");
+        }
+        return result;
+    };
+
+    sqRing_ = map(sqRingSize_, IORING_OFF_SQ_RING);
+    cqRing_ = singleMmap ? sqRing_ : map(cqRingSize_, IORING_OFF_CQ_RING);
+
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(map(sqesSize_, IORING_OFF_SQES));
+
+    sqHead_ = offset<unsigned>(sqRing_, params.sq_off.head);
+    sqTail_ = offset<unsigned>(sqRing_, params.sq_off.tail);
+    sqMask_ = *offset<unsigned>(sqRing_, params.sq_off.ring_mask);
+    sqEntries_ = *offset<unsigned>(sqRing_, params.sq_off.ring_entries);
+    sqArray_ = offset<unsigned>(sqRing_, params.sq_off.array);
+
+    cqHead_ = offset<unsigned>(cqRing_, params.cq_off.head);
+    cqTail_ = offset<unsigned>(cqRing_, params.cq_off.tail);
+    cqMask_ = *offset<unsigned>(cqRing_, params.cq_off.ring_mask);
+    cqes_ = offset<io_uring_cqe>(cqRing_, params.cq_off.cqes);
+}
+
+IoUringPoller::
+~IoUringPoller()
+{
+    cleanup();
+}
+
+void
+IoUringPoller::
+cleanup()
+{
+    if (sqes_ && (void *) sqes_ != MAP_FAILED)
+        munmap(sqes_, sqesSize_);
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+        munmap(cqRing_, cqRingSize_);
+    if (sqRing_ != MAP_FAILED)
+        munmap(sqRing_, sqRingSize_);
+    sqes_ = nullptr;
+    sqRing_ = cqRing_ = MAP_FAILED;
+
+    if (ringFd_ >= 0)
+        ::close(ringFd_);
+    ringFd_ = -1;
+}
+
+io_uring_sqe *
+IoUringPoller::
+getSqe()
+{
+    unsigned tail = *sqTail_;
+    if (tail - loadAcquire(sqHead_) == sqEntries_) {
+        submitLocked();
+        if (tail - loadAcquire(sqHead_) == sqEntries_)
+            throw ML::Exception("io_uring submission ring is full");
+    }
+
+    unsigned index = tail & sqMask_;
+    io_uring_sqe * sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    return sqe;
+}
+
+void
+IoUringPoller::
+pushPoll(int fd, const Slot & slot)
+{
+    io_uring_sqe * sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = EPOLLIN;
+    sqe->user_data = userData(fd, slot);
+
+    storeRelease(sqTail_, *sqTail_ + 1);
+    ++toSubmit_;
+}
+
+void
+IoUringPoller::
+pushRemove(int fd, const Slot & slot)
+{
+    io_uring_sqe * sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = userData(fd, slot);
+    sqe->user_data = RemoveTag;
+
+    storeRelease(sqTail_, *sqTail_ + 1);
+    ++toSubmit_;
+}
+
+void
+IoUringPoller::
+addFd(int fd, void * data, bool oneShot, bool restart)
+{
+    std::unique_lock<std::mutex> guard(lock_);
+
+    auto it = slots_.find(fd);
+    if (restart) {
+        if (it == slots_.end())
+            throw ML::Exception("io_uring restart of unknown fd %d", fd);
+    }
+    else {
+        if (it != slots_.end())
+            throw ML::Exception("io_uring fd %d already added", fd);
+        Slot slot;
+        slot.generation = nextGeneration_++;
+        slot.armed = false;
+        slot.rearmed = false;
+        it = slots_.insert(make_pair(fd, slot)).first;
+    }
+
+    Slot & slot = it->second;
+    slot.data = data;
+    slot.oneShot = oneShot;
+
+    if (!slot.armed) {
+        slot.armed = true;
+        slot.rearmed = false;
+        pushPoll(fd, slot);
+        if (handling != this) submitLocked();
+    }
+}
+
+void
+IoUringPoller::
+removeFd(int fd)
+{
+    std::unique_lock<std::mutex> guard(lock_);
+
+    auto it = slots_.find(fd);
+    if (it == slots_.end()) return;
+
+    // The kernel holds a reference on the file until the poll is removed so
+    // this has to reach it before the fd can be closed.
+    if (it->second.armed) {
+        pushRemove(fd, it->second);
+        submitLocked();
+    }
+    slots_.erase(it);
+}
+
+void
+IoUringPoller::
+submit()
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    submitLocked();
+}
+
+void
+IoUringPoller::
+submitLocked()
+{
+    while (toSubmit_) {
+        int res = ioUringEnter(ringFd_, toSubmit_, 0, 0);
+        if (res == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EBUSY) return;
+            throw ML::Exception(errno, "io_uring_enter");
+        }
+        toSubmit_ -= std::min<unsigned>(res, toSubmit_);
+    }
+}
+
+bool
+IoUringPoller::
+hasCompletions() const
+{
+    return loadAcquire(cqTail_) != *cqHead_;
+}
+
+int
+IoUringPoller::
+handleCompletions(int maxEvents, const OnEvent & onEvent)
+{
+    std::unique_lock<std::mutex> reaping(completionLock_);
+
+    epoll_event events[std::max(maxEvents, 1)];
+    int fds[std::max(maxEvents, 1)];
+    rearm_.clear();
+    int numEvents = 0;
+    int numRechecks = 0;
+
+    {
+        std::unique_lock<std::mutex> guard(lock_);
+
+        unsigned head = *cqHead_;
+        unsigned tail = loadAcquire(cqTail_);
+
+        for (; head != tail && numEvents < maxEvents; ++head) {
+            const io_uring_cqe & cqe = cqes_[head & cqMask_];
+            if (cqe.user_data == RemoveTag) continue;
+
+            int fd = uint32_t(cqe.user_data);
+            uint32_t generation = cqe.user_data >> 32;
+
+            // Completions for fds that were removed since they were armed
+            auto it = slots_.find(fd);
+            if (it == slots_.end() || it->second.generation != generation)
+                continue;
+
+            Slot & slot = it->second;
+            slot.armed = false;
+
+            if (cqe.res < 0) {
+                // Cancelled because the fd was closed under us: leave it
+                // disarmed, as epoll would have forgotten about it.
+                if (cqe.res == -ECANCELED || cqe.res == -EBADF) continue;
+                events[numEvents].events = EPOLLERR;
+            }
+            else events[numEvents].events = cqe.res;
+
+            events[numEvents].data.ptr = slot.data;
+            fds[numEvents] = fd;
+            ++numEvents;
+
+            if (slot.rearmed)
+                ++numRechecks;
+        }
+
+        storeRelease(cqHead_, head);
+    }
+
+    // Drop the stale notifications of the fds that were rearmed while not
+    // drained; they get armed again below like the ones that we hand out.
+    if (numRechecks) {
+        pollfd pfds[numEvents];
+        for (int i = 0;  i < numEvents;  ++i) {
+            pfds[i].fd = fds[i];
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+
+        std::unique_lock<std::mutex> guard(lock_);
+        int res = ::poll(pfds, numEvents, 0);
+        if (res == -1 && errno != EINTR)
+            throw ML::Exception(errno, "io_uring recheck poll");
+
+        int kept = 0;
+        for (int i = 0;  i < numEvents;  ++i) {
+            auto it = slots_.find(fds[i]);
+            bool stale = it != slots_.end() && it->second.rearmed
+                && res != -1 && pfds[i].revents == 0;
+            if (stale) {
+                it->second.armed = true;
+                it->second.rearmed = false;
+                pushPoll(fds[i], it->second);
+                continue;
+            }
+            events[kept] = events[i];
+            fds[kept] = fds[i];
+            ++kept;
+        }
+        numEvents = kept;
+        submitLocked();
+    }
+
+    {
+        std::unique_lock<std::mutex> guard(lock_);
+        for (int i = 0;  i < numEvents;  ++i) {
+            auto it = slots_.find(fds[i]);
+            if (it != slots_.end() && !it->second.oneShot)
+                rearm_.push_back(fds[i]);
+        }
+    }
+
+    // Whatever happens in the handlers, the level-triggered fds have to be
+    // armed again or we'd never hear from them.  This and everything the
+    // handlers queued goes out in a single submission; it can't wait for the
+    // next call since nothing would wake up whoever polls on our fd.
+    auto rearm = [&] () {
+        handling = nullptr;
+
+        std::unique_lock<std::mutex> guard(lock_);
+        for (int fd: rearm_) {
+            auto it = slots_.find(fd);
+            if (it == slots_.end() || it->second.armed || it->second.oneShot)
+                continue;
+            it->second.armed = true;
+            it->second.rearmed = true;
+            pushPoll(fd, it->second);
+        }
+        submitLocked();
+    };
+    ML::Call_Guard guard(rearm);
+
+    handling = this;
+    for (int i = 0;  i < numEvents;  ++i) {
+        if (!onEvent(events[i]))
+            return -1;
+    }
+
+    return numEvents;
+}
+
+} // namespace Datacratic
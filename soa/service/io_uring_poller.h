@@ -0,0 +1,130 @@
+/* io_uring_poller.h                                               -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Readiness notification for file descriptors on top of io_uring.
+*/
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+struct epoll_event;
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace Datacratic {
+
+/*****************************************************************************/
+/* IO URING POLLER                                                           */
+/*****************************************************************************/
+
+/** Provides the same level-triggered or one-shot readiness notifications as
+    epoll, but through io_uring poll requests.
+
+    The requests made by the handlers to arm, rearm and remove fds are
+    queued in the submission ring and handed to the kernel in a single
+    io_uring_enter once all the handlers of a batch of notifications ran,
+    and the notifications are read straight out of the completion ring
+    without any system call.  A loop that keeps rearming its fds thus makes
+    one system call per batch instead of one per fd.
+
+    Level-triggered fds are rearmed once their handler returned, which is
+    when epoll would notice that the fd is still ready.  Since that poll
+    completes right away if the handler left data behind, whatever is read
+    from the fd after the rearm can make the notification stale; those fds
+    are checked again with a single poll per batch before being handed out,
+    so that handlers only see the fds that epoll would have returned.
+
+    The ring fd becomes readable when there are notifications to handle, so
+    the poller can be waited on with poll or nested into another epoll set.
+*/
+
+struct IoUringPoller {
+
+    /** Whether io_uring is available on the running kernel. */
+    static bool supported();
+
+    IoUringPoller(unsigned maxFds);
+    ~IoUringPoller();
+
+    IoUringPoller(const IoUringPoller &) = delete;
+    IoUringPoller & operator = (const IoUringPoller &) = delete;
+
+    int selectFd() const { return ringFd_; }
+
+    void addFd(int fd, void * data, bool oneShot, bool restart);
+    void removeFd(int fd);
+
+    /** Hand all of the queued requests to the kernel. */
+    void submit();
+
+    /** Whether there are notifications waiting to be handled. */
+    bool hasCompletions() const;
+
+    typedef std::function<bool (epoll_event & event)> OnEvent;
+
+    /** Call onEvent for up to maxEvents of the pending notifications, in
+        the form epoll_wait would have returned them.  Stops early if onEvent
+        returns false, in which case -1 is returned; otherwise returns the
+        number of events handled.
+    */
+    int handleCompletions(int maxEvents, const OnEvent & onEvent);
+
+private:
+    struct Slot {
+        void * data;
+        uint32_t generation;
+        bool oneShot;
+        bool armed;
+        bool rearmed;   ///< armed again after its handler ran
+    };
+
+    /** Queues a request; must be called with lock_ held. */
+    void pushPoll(int fd, const Slot & slot);
+    void pushRemove(int fd, const Slot & slot);
+    io_uring_sqe * getSqe();
+    void submitLocked();
+    void cleanup();
+
+    static uint64_t userData(int fd, const Slot & slot)
+    {
+        return (uint64_t(slot.generation) << 32) | uint32_t(fd);
+    }
+
+    int ringFd_;
+
+    void * sqRing_;
+    size_t sqRingSize_;
+    void * cqRing_;
+    size_t cqRingSize_;
+    io_uring_sqe * sqes_;
+    size_t sqesSize_;
+
+    unsigned * sqHead_;
+    unsigned * sqTail_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    unsigned * sqArray_;
+
+    unsigned * cqHead_;
+    unsigned * cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe * cqes_;
+
+    unsigned toSubmit_;
+    uint32_t nextGeneration_;
+    std::unordered_map<int, Slot> slots_;
+
+    /* Protects the submission ring and the slots. */
+    std::mutex lock_;
+
+    /* Only one thread reaps the completions at a time. */
+    std::mutex completionLock_;
+    std::vector<int> rearm_;
+};
+
+} // namespace Datacratic
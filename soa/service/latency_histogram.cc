@@ -0,0 +1,82 @@
+/* latency_histogram.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+#include "latency_histogram.h"
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+/*****************************************************************************/
+/* LATENCY HISTOGRAM                                                         */
+/*****************************************************************************/
+
+void
+LatencyHistogram::
+clear()
+{
+    ::memset(counts, 0, sizeof(counts));
+    count_ = 0;
+    max_ = 0;
+}
+
+uint64_t
+LatencyHistogram::
+bucketUpperBound(int index)
+{
+    if (index < SubBuckets)
+        return index;
+    int shift = (index >> SubBucketBits) - 1;
+    uint64_t lower = uint64_t(SubBuckets + (index & (SubBuckets - 1))) << shift;
+    return lower + (uint64_t(1) << shift) - 1;
+}
+
+uint64_t
+LatencyHistogram::
+percentile(double percentile) const
+{
+    if (count_ == 0)
+        return 0;
+
+    uint64_t target = std::ceil(count_ * std::min(percentile, 100.0) / 100.0);
+    if (target == 0)
+        target = 1;
+
+    uint64_t total(0);
+    for (int i = 0; i < NumBuckets; i++) {
+        total += counts[i];
+        if (total >= target)
+            return std::min(bucketUpperBound(i), max_);
+    }
+
+    return max_;
+}
+
+LatencyHistogram &
+LatencyHistogram::
+operator += (const LatencyHistogram & other)
+{
+    for (int i = 0; i < NumBuckets; i++)
+        counts[i] += other.counts[i];
+    count_ += other.count_;
+    max_ = std::max(max_, other.max_);
+
+    return *this;
+}
+
+LatencyHistogram &
+LatencyHistogram::
+operator -= (const LatencyHistogram & other)
+{
+    for (int i = 0; i < NumBuckets; i++)
+        counts[i] -= other.counts[i];
+    count_ -= other.count_;
+
+    return *this;
+}
@@ -0,0 +1,92 @@
+/* latency_histogram.h                                             -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Histogram of durations with a bounded relative error.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "jml/compiler/compiler.h"
+
+
+namespace Datacratic {
+
+/*****************************************************************************/
+/* LATENCY HISTOGRAM                                                         */
+/*****************************************************************************/
+
+/** Histogram in the manner of HdrHistogram: the values are grouped by powers
+    of two, each of which is split into SubBuckets linear buckets, so that
+    the values reported are within 1/SubBuckets of the recorded ones.
+    Recording a value takes a few instructions and never allocates, which
+    makes it usable from the hot path. The values are unitless; they are
+    typically tick counts.
+
+    Recording is not thread-safe. Reading while another thread records
+    gives approximate results, which is good enough for monitoring.
+*/
+
+struct LatencyHistogram {
+    enum {
+        SubBucketBits = 4,
+        SubBuckets = 1 << SubBucketBits,
+        MaxBits = 48,    ///< larger values are counted in the last bucket
+        NumBuckets = (MaxBits - SubBucketBits + 1) * SubBuckets
+    };
+
+    LatencyHistogram()
+    {
+        clear();
+    }
+
+    void record(uint64_t value)
+    {
+        counts[bucketIndex(value)] += 1;
+        count_ += 1;
+        if (value > max_)
+            max_ = value;
+    }
+
+    void clear();
+
+    /** Number of values recorded. */
+    uint64_t count() const { return count_; }
+
+    /** Largest value recorded. This is not affected by subtraction. */
+    uint64_t max() const { return max_; }
+
+    /** Value below which "percentile" percents of the recorded values
+        fall; returns 0 when the histogram is empty.
+    */
+    uint64_t percentile(double percentile) const;
+
+    LatencyHistogram & operator += (const LatencyHistogram & other);
+
+    /** Remove the values of an earlier copy of this histogram, which
+        leaves the ones that were recorded since then.
+    */
+    LatencyHistogram & operator -= (const LatencyHistogram & other);
+
+    JML_ALWAYS_INLINE static int bucketIndex(uint64_t value)
+    {
+        if (value < SubBuckets)
+            return value;
+        int msb = 63 - __builtin_clzll(value);
+        if (msb >= MaxBits)
+            return NumBuckets - 1;
+        int shift = msb - SubBucketBits;
+        return ((shift + 1) << SubBucketBits) + ((value >> shift) - SubBuckets);
+    }
+
+    /** Largest value that is counted in the given bucket. */
+    static uint64_t bucketUpperBound(int index);
+
+private:
+    uint64_t counts[NumBuckets];
+    uint64_t count_;
+    uint64_t max_;
+};
+
+} // namespace Datacratic
@@ -8,6 +8,7 @@
 
 #include "loop_monitor.h"
 #include "jml/arch/cmp_xchg.h"
+#include "jml/arch/tick_counter.h"
 
 #include <mutex>
 #include <functional>
@@ -65,6 +66,12 @@ doLoops(uint64_t numTimeouts)
         recordLevel(load, loop.first);
     }
 
+    for (auto& sources : loopSources) {
+        recordSourceStats(sources.first, sources.second,
+                updatePeriod * numTimeouts);
+        recordWakeupLatency(sources.first, sources.second);
+    }
+
     curLoad.packed = maxLoad.packed;
     if (onLoadChange) onLoadChange(maxLoad.load);
 }
@@ -107,6 +114,65 @@ addMessageLoop(const string& name, const MessageLoop* loop)
     };
 
     addCallback(name, sampleFn);
+
+    std::lock_guard<ML::Spinlock> guard(lock);
+    loopSources[name].loop = loop;
+}
+
+void
+LoopMonitor::
+recordSourceStats(const string& name, LoopSources& sources, double elapsedTime)
+{
+    if (!sources.loop->sourceStatsEnabled()) return;
+
+    // Sources that share a name are reported together.
+    map<string, SourceStats> current;
+    for (auto& entry : sources.loop->sourceStats())
+        current[entry.first] += entry.second;
+
+    for (auto& entry : current) {
+        SourceStats delta = entry.second;
+        auto it = sources.lastStats.find(entry.first);
+        if (it != sources.lastStats.end()
+                && it->second.calls <= delta.calls)
+            delta -= it->second;
+
+        string prefix = name + "." + entry.first;
+        recordCount(delta.calls, prefix + ".calls");
+        recordLevel(delta.busyTicks * seconds_per_tick / elapsedTime,
+                prefix + ".busy");
+
+        if (!delta.calls) continue;
+
+        auto toUs = [] (uint64_t ticks) {
+            return float(ticks * seconds_per_tick * 1000000.0);
+        };
+        recordLevel(toUs(delta.durations.percentile(50)), prefix + ".p50Us");
+        recordLevel(toUs(delta.durations.percentile(99)), prefix + ".p99Us");
+        recordLevel(toUs(delta.durations.percentile(100)), prefix + ".maxUs");
+    }
+
+    sources.lastStats = std::move(current);
+}
+
+void
+LoopMonitor::
+recordWakeupLatency(const string& name, LoopSources& sources)
+{
+    LatencyHistogram current = sources.loop->wakeupLatency();
+    LatencyHistogram delta = current;
+    if (sources.lastWakeupLatency.count() <= delta.count())
+        delta -= sources.lastWakeupLatency;
+    sources.lastWakeupLatency = current;
+
+    if (!delta.count()) return;
+
+    auto toUs = [] (uint64_t ticks) {
+        return float(ticks * seconds_per_tick * 1000000.0);
+    };
+    recordLevel(toUs(delta.percentile(50)), name + ".wakeupP50Us");
+    recordLevel(toUs(delta.percentile(99)), name + ".wakeupP99Us");
+    recordLevel(toUs(delta.percentile(100)), name + ".wakeupMaxUs");
 }
 
 void
@@ -127,6 +193,7 @@ remove(const string& name)
 
     size_t ret = loops.erase(name);
     ExcCheckEqual(ret, 1, "loop is not monitored: " + name);
+    loopSources.erase(name);
 }
 
 
@@ -45,7 +45,11 @@ struct LoopMonitor : public ServiceBase, public MessageLoop
     typedef std::function<double(double elapsedTime)> SampleLoadFn;
 
     /** Adds a sampling function for a MessageLoop which will be called every
-        updatePeriod. Thread-safe.
+        updatePeriod. If the per-source statistics of the loop are enabled
+        (see MessageLoop::enableSourceStats), the calls, the busy fraction
+        and the percentiles of the handler durations of each source are also
+        recorded every updatePeriod, as are the percentiles of the wake-up
+        latency of the loop (see MessageLoop::wakeupLatency). Thread-safe.
      */
     void addMessageLoop(const std::string& name, const MessageLoop* loop);
 
@@ -89,10 +93,24 @@ private:
 
     void doLoops(uint64_t numTimeouts);
 
+    /** Source statistics of a loop, as of the previous sample. */
+    struct LoopSources
+    {
+        const MessageLoop* loop;
+        std::map<std::string, SourceStats> lastStats;
+        LatencyHistogram lastWakeupLatency;
+    };
+
+    void recordSourceStats(const std::string& name, LoopSources& sources,
+                           double elapsedTime);
+
+    void recordWakeupLatency(const std::string& name, LoopSources& sources);
+
     double updatePeriod;
 
     mutable ML::Spinlock lock;
     std::map<std::string, SampleLoadFn> loops;
+    std::map<std::string, LoopSources> loopSources;
 
     LoadSample curLoad;
 };
@@ -14,6 +14,7 @@
 #include "jml/arch/demangle.h"
 #include "jml/arch/futex.h"
 #include "jml/arch/backtrace.h"
+#include "jml/arch/rt.h"
 #include "jml/utils/smart_ptr_utils.h"
 #include "jml/utils/exc_assert.h"
 #include "soa/types/date.h"
@@ -33,18 +34,53 @@ Logging::Category MessageLoopLogs::trace("Message Loop Trace", print);
 
 typedef MessageLoopLogs Logs;
 
+
+/*****************************************************************************/
+/* SOURCE STATS                                                              */
+/*****************************************************************************/
+
+SourceStats &
+SourceStats::
+operator += (const SourceStats & other)
+{
+    calls += other.calls;
+    busyTicks += other.busyTicks;
+    durations += other.durations;
+
+    return *this;
+}
+
+SourceStats &
+SourceStats::
+operator -= (const SourceStats & other)
+{
+    calls -= other.calls;
+    busyTicks -= other.busyTicks;
+    durations -= other.durations;
+
+    return *this;
+}
+
+
 /*****************************************************************************/
 /* MESSAGE LOOP                                                              */
 /*****************************************************************************/
 
 MessageLoop::
-MessageLoop(int numThreads, double maxAddedLatency, int epollTimeout)
+MessageLoop(int numThreads, double maxAddedLatency, int epollTimeout,
+            Epoller::Backend backend)
     : sourceActions_([&] () { handleSourceActions(); }),
       numThreadsCreated(0),
       shutdown_(true),
-      totalSleepTime_(0.0)
+      totalSleepTime_(0.0),
+      sourceStatsEnabled_(false),
+      nextTaskId(1),
+      pollingThread(0),
+      workGeneration_(0),
+      numSleeping_(0),
+      numStolen_(0)
 {
-    init(numThreads, maxAddedLatency, epollTimeout);
+    init(numThreads, maxAddedLatency, epollTimeout, backend);
 }
 
 MessageLoop::
@@ -55,7 +91,8 @@ MessageLoop::
 
 void
 MessageLoop::
-init(int numThreads, double maxAddedLatency, int epollTimeout)
+init(int numThreads, double maxAddedLatency, int epollTimeout,
+     Epoller::Backend backend)
 {
     // std::cerr << "msgloop init: " << this << "\n";
     if (maxAddedLatency == 0 && epollTimeout != -1)
@@ -63,21 +100,32 @@ init(int numThreads, double maxAddedLatency, int epollTimeout)
             << "MessageLoop with maxAddedLatency of zero and "
             << "epollTeimout != -1 will busy wait" << endl;
     
-    // See the comments on processOne below for more details on this assertion.
-    ExcAssertEqual(numThreads, 1);
+    ExcAssertGreaterEqual(numThreads, 1);
 
-    Epoller::init(16384, epollTimeout);
+    Epoller::init(16384, epollTimeout, backend);
     maxAddedLatency_ = maxAddedLatency;
     handleEvent = std::bind(&MessageLoop::handleEpollEvent,
                             this,
                             std::placeholders::_1);
 
+    workers.clear();
+    tasks.clear();
+    pollTasks.clear();
+
     /* Our source action queue is a source in itself, which enables us to
        handle source operations from the same epoll mechanism as the rest.
+       With several threads this also keeps them serialized, since a task is
+       only ever run by one thread at a time.
 
        Adding a special source named "_shutdown" triggers shutdown-related
        events, without requiring the use of an additional signal fd. */
-    addFd(sourceActions_.selectFd(), &sourceActions_);
+    if (numThreads > 1) {
+        for (int i = 0;  i < numThreads;  ++i)
+            workers.emplace_back(new Worker());
+        addTask(SourceEntry("_actions",
+                            ML::make_unowned_std_sp(sourceActions_), 0));
+    }
+    else addFd(sourceActions_.selectFd(), &sourceActions_);
 
     debug_ = false;
 }
@@ -94,12 +142,25 @@ start(const OnStop & onStop)
     //cerr << "starting thread from " << this << endl;
     //ML::backtrace();
 
-    auto runfn = [&, onStop] () {
-        this->runWorkerThread();
-        if (onStop) onStop();
-    };
-
-    threads.emplace_back(runfn);
+    if (!workers.empty()) {
+        for (int i = 0;  i < workers.size();  ++i) {
+            auto runfn = [&, onStop, i] () {
+                this->pinThread();
+                this->runStealingThread(i);
+                if (i == 0 && onStop) onStop();
+            };
+            threads.emplace_back(runfn);
+        }
+    }
+    else {
+        auto runfn = [&, onStop] () {
+            this->pinThread();
+            this->runWorkerThread();
+            if (onStop) onStop();
+        };
+
+        threads.emplace_back(runfn);
+    }
 
     ++numThreadsCreated;
 }
@@ -114,7 +175,18 @@ startSync()
     ++numThreadsCreated;
 
     shutdown_ = false;
-    runWorkerThread();
+
+    if (!workers.empty()) {
+        for (int i = 1;  i < workers.size();  ++i) {
+            auto runfn = [&, i] () {
+                this->pinThread();
+                this->runStealingThread(i);
+            };
+            threads.emplace_back(runfn);
+        }
+        runStealingThread(0);
+    }
+    else runWorkerThread();
 }
     
 void
@@ -130,6 +202,7 @@ shutdown()
     // will be woken by the futex_wake) or blocked in epoll (in which case
     // we will get the addSource event to wake us up).
     ML::futex_wake(shutdown_);
+    wakeupWorkers(INT_MAX);
     addSource("_shutdown", nullptr);
 
     for (auto & t: threads)
@@ -142,16 +215,17 @@ shutdown()
 bool
 MessageLoop::
 addSource(const std::string & name,
-          AsyncEventSource & source, int priority)
+          AsyncEventSource & source, int priority, int affinity)
 {
-    return addSource(name, ML::make_unowned_std_sp(source), priority);
+    return addSource(name, ML::make_unowned_std_sp(source), priority,
+                     affinity);
 }
 
 bool
 MessageLoop::
 addSource(const std::string & name,
           const std::shared_ptr<AsyncEventSource> & source,
-          int priority)
+          int priority, int affinity)
 {
     if (name != "_shutdown") {
         ExcCheck(!source->parent_, "source already has a parent: " + name);
@@ -165,7 +239,7 @@ addSource(const std::string & name,
     //      << " needsPoll: " << needsPoll
     //      << endl;
 
-    SourceEntry entry(name, source, priority);
+    SourceEntry entry(name, source, priority, affinity);
     SourceAction newAction(SourceAction::ADD, move(entry));
 
     return sourceActions_.push_back(move(newAction));
@@ -232,7 +306,21 @@ startSubordinateThread(const SubordinateThreadFn & thread)
 {
     Guard guard(threadsLock);
     int64_t id = 0;
-    threads.emplace_back(std::bind(thread, std::ref(shutdown_), id));
+    auto runfn = [=] () {
+        this->pinThread();
+        thread(shutdown_, id);
+    };
+    threads.emplace_back(runfn);
+}
+
+void
+MessageLoop::
+pinThread()
+{
+    if (!ML::setCurrentThreadAffinity(cpuAffinity))
+        LOG(Logs::warning)
+            << "couldn't set the CPU affinity of a message loop thread"
+            << endl;
 }
 
 void
@@ -322,12 +410,16 @@ runWorkerThread()
         double elapsed = end.secondsSince(start);
         double sleepTime = maxAddedLatency_ - elapsed;
 
+        // When busy polling we'd rather spin in handleEvents() than add
+        // latency to whatever comes in while we sleep.
+        uint64_t beforeSleepTicks = ML::ticks();
         duty.notifyBeforeSleep();
-        if (sleepTime > 0) {
+        if (sleepTime > 0 && busyPoll() == 0) {
             ML::futex_wait(shutdown_, 0, sleepTime);
             totalSleepTime_ += sleepTime;
         }
         duty.notifyAfterSleep();
+        wakeupLatency_.record(ML::ticks() - beforeSleepTicks);
         
         if (lastCheck.secondsUntil(end) > 10.0) {
             // auto stats = duty.stats();
@@ -339,12 +431,267 @@ runWorkerThread()
     }
 }
 
+void
+MessageLoop::
+runStealingThread(int index)
+{
+    int i = 0;
+
+    while (!shutdown_) {
+        // Read before looking for work so that a task queued from now on
+        // prevents us from going to sleep.
+        int generation = workGeneration_;
+
+        auto task = popTask(index);
+        if (task) {
+            runTask(task, index);
+
+            if (index == 0 && ++i >= 50) {
+                getrusage(RUSAGE_THREAD, &resourceUsage);
+                i = 0;
+            }
+            continue;
+        }
+
+        // Nothing to do here or anywhere else.  Wait for the fds unless
+        // another idle thread is already doing so.
+        if (pollerLock.try_lock()) {
+            waitForTasks(index);
+            pollerLock.unlock();
+            continue;
+        }
+
+        ++numSleeping_;
+        if (workGeneration_ == generation && !shutdown_) {
+            Date before = Date::now();
+            ML::futex_wait(workGeneration_, generation, 0.1);
+            workers[index]->sleepTime += Date::now().secondsSince(before);
+        }
+        --numSleeping_;
+    }
+}
+
+void
+MessageLoop::
+waitForTasks(int index)
+{
+    Worker & worker = *workers[index];
+    pollingThread = index;
+
+    vector<shared_ptr<Task> > toPoll;
+    {
+        std::unique_lock<std::mutex> guard(tasksLock);
+        toPoll = pollTasks;
+    }
+
+    // The sources without an fd have to be polled so we can't sleep for
+    // longer than the latency that we're allowed to add.
+    int usToWait = 999999;
+    if (!toPoll.empty())
+        usToWait = std::max(1, int(maxAddedLatency_ * 1000000));
+
+    Date beforeSleepTime;
+    auto beforeSleep = [&] () { beforeSleepTime = Date::now(); };
+    auto afterSleep = [&] ()
+        {
+            worker.sleepTime += Date::now().secondsSince(beforeSleepTime);
+        };
+
+    handleEvents(usToWait, 512, nullptr, beforeSleep, afterSleep);
+
+    for (auto & task: toPoll) {
+        {
+            std::unique_lock<std::mutex> guard(task->lock);
+            if (task->removed || task->state != Task::IDLE)
+                continue;
+            task->state = Task::QUEUED;
+        }
+        queueTask(task, index);
+    }
+}
+
+void
+MessageLoop::
+addTask(const SourceEntry & entry)
+{
+    auto task = std::make_shared<Task>(nextTaskId++, entry);
+    if (task->entry.affinity >= 0)
+        task->entry.affinity %= workers.size();
+
+    {
+        std::unique_lock<std::mutex> guard(tasksLock);
+        tasks[task->id] = task;
+        if (task->fd == -1)
+            pollTasks.push_back(task);
+    }
+
+    if (task->fd != -1) {
+        std::unique_lock<std::mutex> guard(task->lock);
+        addFdOneShot(task->fd, reinterpret_cast<void *>(task->id));
+    }
+}
+
+void
+MessageLoop::
+queueTask(const std::shared_ptr<Task> & task, int thread)
+{
+    int target = task->entry.affinity >= 0 ? task->entry.affinity : thread;
+
+    {
+        Worker & worker = *workers[target];
+        Guard guard(worker.lock);
+        worker.queue.push_back(task);
+    }
+
+    // The thread that a source prefers may not be the one that we wake up
+    // so in that case everyone has to have a look.
+    wakeupWorkers(target == thread ? 1 : INT_MAX);
+}
+
+std::shared_ptr<MessageLoop::Task>
+MessageLoop::
+popTask(int thread)
+{
+    std::shared_ptr<Task> result;
+
+    {
+        Worker & worker = *workers[thread];
+        Guard guard(worker.lock);
+        if (!worker.queue.empty()) {
+            result = std::move(worker.queue.front());
+            worker.queue.pop_front();
+            return result;
+        }
+    }
+
+    int numWorkers = workers.size();
+    for (int i = 1;  i < numWorkers;  ++i) {
+        int victim = (thread + i) % numWorkers;
+        Worker & worker = *workers[victim];
+        Guard guard(worker.lock);
+
+        auto & queue = worker.queue;
+        if (queue.empty())
+            continue;
+
+        // Take the most recently queued task that doesn't prefer the victim;
+        // the ones that do are only taken when the victim is falling behind.
+        auto it = queue.end();
+        while (it != queue.begin()) {
+            --it;
+            if ((*it)->entry.affinity != victim)
+                break;
+        }
+        if ((*it)->entry.affinity == victim) {
+            if (queue.size() < 2)
+                continue;
+            it = queue.end() - 1;
+        }
+
+        result = std::move(*it);
+        queue.erase(it);
+        ++numStolen_;
+        return result;
+    }
+
+    return result;
+}
+
+void
+MessageLoop::
+runTask(const std::shared_ptr<Task> & task, int thread)
+{
+    {
+        std::unique_lock<std::mutex> guard(task->lock);
+        if (task->removed)
+            return;
+        task->state = Task::RUNNING;
+    }
+
+    bool more;
+    try {
+        more = runSource(*task->entry.source, task->entry.stats.get());
+        if (debug_)
+            cerr << "source " << task->entry.name << " has " << more << endl;
+    } catch (...) {
+        cerr << "exception processing source " << task->entry.name << endl;
+        throw;
+    }
+
+    std::unique_lock<std::mutex> guard(task->lock);
+
+    if (task->removed) {
+        // The source was removed while we were running it, so it's up to us
+        // to tell that we're done with it.
+        guard.unlock();
+        auto & source = *task->entry.source;
+        source.connectionState_ = AsyncEventSource::DISCONNECTED;
+        ML::futex_wake(source.connectionState_);
+        return;
+    }
+
+    // Rather than going back through the epoller, queue it again behind the
+    // tasks that are waiting so that busy sources get their fair share.
+    if (more) {
+        task->state = Task::QUEUED;
+        guard.unlock();
+        queueTask(task, thread);
+        return;
+    }
+
+    task->state = Task::IDLE;
+    if (task->fd != -1)
+        restartFdOneShot(task->fd, reinterpret_cast<void *>(task->id));
+}
+
+void
+MessageLoop::
+wakeupWorkers(int nToWake)
+{
+    __sync_fetch_and_add(&workGeneration_, 1);
+    if (numSleeping_)
+        ML::futex_wake(workGeneration_, nToWake);
+}
+
+double
+MessageLoop::
+totalSleepSeconds() const
+{
+    double result = totalSleepTime_;
+    for (auto & worker: workers)
+        result += worker->sleepTime;
+    return result;
+}
+
 Epoller::HandleEventResult
 MessageLoop::
 handleEpollEvent(epoll_event & event)
 {
     bool debug = false;
 
+    if (!workers.empty()) {
+        uint64_t id = reinterpret_cast<uintptr_t>(event.data.ptr);
+
+        std::shared_ptr<Task> task;
+        {
+            std::unique_lock<std::mutex> guard(tasksLock);
+            auto it = tasks.find(id);
+            if (it == tasks.end())
+                return Epoller::DONE;
+            task = it->second;
+        }
+
+        {
+            std::unique_lock<std::mutex> guard(task->lock);
+            if (task->removed || task->state != Task::IDLE)
+                return Epoller::DONE;
+            task->state = Task::QUEUED;
+        }
+
+        queueTask(task, pollingThread);
+        return Epoller::DONE;
+    }
+
     if (debug) {
         cerr << "handleEvent" << endl;
         int mask = event.events;
@@ -369,7 +716,13 @@ handleEpollEvent(epoll_event & event)
              << Epoller::poll() << endl;
     }
 
-    int res = source->processOne();
+    SourceStats * stats = nullptr;
+    if (sourceStatsEnabled_) {
+        auto it = statsBySource_.find(source);
+        if (it != statsBySource_.end())
+            stats = it->second;
+    }
+    int res = runSource(*source, stats);
 
     if (debug) {
         cerr << "source " << ML::type_name(*source) << " had processOne() result " << res << endl;
@@ -399,20 +752,32 @@ handleSourceActions()
 
 void
 MessageLoop::
-processAddSource(const SourceEntry & entry)
+processAddSource(const SourceEntry & newEntry)
 {
-    if (entry.name == "_shutdown")
+    if (newEntry.name == "_shutdown")
         return;
 
+    SourceEntry entry(newEntry);
+    if (sourceStatsEnabled_) {
+        entry.stats = std::make_shared<SourceStats>();
+        statsBySource_[entry.source.get()] = entry.stats.get();
+        Guard guard(sourceStatsLock_);
+        sourceStats_.emplace_back(entry.name, entry.stats);
+    }
+
     // cerr << "processAddSource: " << entry.source.get()
     //      << " (" << ML::type_name(*entry.source) << ")"
     //      << " needsPoll: " << entry.source->needsPoll
     //      << " in msg loop: " << this
     //      << " needsPoll: " << needsPoll
     //      << endl;
-    int fd = entry.source->selectFd();
-    if (fd != -1)
-        addFd(fd, entry.source.get());
+    if (!workers.empty())
+        addTask(entry);
+    else {
+        int fd = entry.source->selectFd();
+        if (fd != -1)
+            addFd(fd, entry.source.get());
+    }
 
     if (!needsPoll && entry.source->needsPoll) {
         needsPoll = true;
@@ -459,7 +824,24 @@ processRemoveSource(const SourceEntry & rmEntry)
     SourceEntry entry = *it;
     sources.erase(it);
 
+    if (entry.stats) {
+        statsBySource_.erase(entry.source.get());
+        Guard guard(sourceStatsLock_);
+        for (auto jt = sourceStats_.begin(); jt != sourceStats_.end(); ++jt) {
+            if (jt->second == entry.stats) {
+                sourceStats_.erase(jt);
+                break;
+            }
+        }
+    }
+
     entry.source->parent_ = nullptr;
+
+    if (!workers.empty()) {
+        processRemoveTask(entry);
+        return;
+    }
+
     int fd = entry.source->selectFd();
     if (fd == -1) return;
     removeFd(fd);
@@ -477,6 +859,51 @@ processRemoveSource(const SourceEntry & rmEntry)
     ML::futex_wake(entry.source->connectionState_);
 }
 
+void
+MessageLoop::
+processRemoveTask(const SourceEntry & entry)
+{
+    std::shared_ptr<Task> task;
+    {
+        std::unique_lock<std::mutex> guard(tasksLock);
+        for (auto it = tasks.begin();  it != tasks.end();  ++it) {
+            if (it->second->entry.source.get() == entry.source.get()) {
+                task = it->second;
+                tasks.erase(it);
+                break;
+            }
+        }
+        ExcCheck(task, "couldn't remove task");
+
+        auto it = std::find(pollTasks.begin(), pollTasks.end(), task);
+        if (it != pollTasks.end())
+            pollTasks.erase(it);
+    }
+
+    bool running;
+    {
+        std::unique_lock<std::mutex> guard(task->lock);
+        task->removed = true;
+        if (task->fd != -1)
+            removeFd(task->fd);
+        running = task->state == Task::RUNNING;
+    }
+
+    if (needsPoll && entry.source->needsPoll) {
+        bool oldNeedsPoll = needsPoll;
+        checkNeedsPoll();
+        if (oldNeedsPoll != needsPoll && parent_)
+            parent_->checkNeedsPoll();
+    }
+
+    // Whoever is running it will finish the disconnection once it's done.
+    if (running)
+        return;
+
+    entry.source->connectionState_ = AsyncEventSource::DISCONNECTED;
+    ML::futex_wake(entry.source->connectionState_);
+}
+
 void
 MessageLoop::
 processRunAction(const SourceEntry & entry)
@@ -498,9 +925,8 @@ poll() const
 }
 
 /** This function assumes that it's called by only a single thread. This
-    contradicts the AsyncEventSource documentation for processOne. If
-    multi-threading is ever required then accesses to the sources array will
-    need to be synchronized in some way.
+    contradicts the AsyncEventSource documentation for processOne. Loops
+    with several threads don't go through here; see runStealingThread.
 
     Note, that this synchronization mechanism should not hold a lock while
     calling a child's processOne() function. This can easily lead to
@@ -511,6 +937,9 @@ bool
 MessageLoop::
 processOne()
 {
+    ExcCheck(workers.empty(),
+             "a message loop with several threads can't be nested");
+
     bool more = false;
 
     // NOTE: this is required for some buggy sources that don't have a reliable FD to
@@ -520,7 +949,8 @@ processOne()
 
         for (unsigned i = 0;  i < sources.size();  ++i) {
             try {
-                bool hasMore = sources[i].source->processOne();
+                bool hasMore = runSource(*sources[i].source,
+                                         sources[i].stats.get());
                 if (debug_)
                     cerr << "source " << sources[i].name << " has " << hasMore << endl;
                 more = more || hasMore;
@@ -536,6 +966,20 @@ processOne()
     return more;
 }
 
+MessageLoop::SourceStatsList
+MessageLoop::
+sourceStats() const
+{
+    SourceStatsList result;
+
+    Guard guard(sourceStatsLock_);
+    result.reserve(sourceStats_.size());
+    for (auto & entry: sourceStats_)
+        result.emplace_back(entry.first, *entry.second);
+
+    return result;
+}
+
 void
 MessageLoop::
 debug(bool debugOn)
@@ -9,13 +9,23 @@
 
 #include <thread>
 #include <functional>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "jml/arch/wakeup_fd.h"
 #include "jml/arch/spinlock.h"
+#include "jml/arch/tick_counter.h"
 
 #include "epoller.h"
 #include "async_event_source.h"
 #include "typed_message_channel.h"
+#include "latency_histogram.h"
 #include "logs.h"
 #include "rusage.h"
 
@@ -33,19 +43,68 @@ struct MessageLoopLogs
     static Logging::Category trace;
 };
 
+/*****************************************************************************/
+/* SOURCE STATS                                                              */
+/*****************************************************************************/
+
+/** Time spent by a MessageLoop in the processOne() calls of a source, in
+    ticks of the CPU tick counter (see ML::seconds_per_tick).
+*/
+
+struct SourceStats {
+    SourceStats()
+        : calls(0), busyTicks(0)
+    {
+    }
+
+    void record(uint64_t ticks)
+    {
+        calls++;
+        busyTicks += ticks;
+        durations.record(ticks);
+    }
+
+    SourceStats & operator += (const SourceStats & other);
+    SourceStats & operator -= (const SourceStats & other);
+
+    uint64_t calls;             ///< number of calls to processOne()
+    uint64_t busyTicks;         ///< total time spent in processOne()
+    LatencyHistogram durations; ///< duration of each call
+};
+
+
 /*****************************************************************************/
 /* MESSAGE LOOP                                                              */
 /*****************************************************************************/
 
+/** Runs a set of asynchronous event sources.
+
+    With a single thread, which is the default, every source is handled by
+    the one thread that runs the loop.
+
+    With numThreads > 1 the loop becomes a work-stealing executor.  Each
+    thread keeps a local queue of the sources that are ready; whichever
+    thread is idle waits on the fds, each source that becomes ready is
+    queued on that thread (or on the one given by the source's affinity
+    hint) and threads that run out of work steal from the others.  A source
+    is only ever handled by one thread at a time and isn't watched while it
+    is queued or running, so sources written for a single-threaded loop work
+    unchanged as long as they don't share state with the other sources.
+    Such a loop can't itself be added as a source to another loop.
+*/
+
 struct MessageLoop : public Epoller {
     typedef std::function<void ()> OnStop;
 
+    /** backend selects how the loop waits on its sources; see Epoller. */
     MessageLoop(int numThreads = 1, double maxAddedLatency = 0.0005,
-                int epollTimeout = 0);
+                int epollTimeout = 0,
+                Epoller::Backend backend = Epoller::DefaultBackend);
     ~MessageLoop();
 
     void init(int numThreads = 1, double maxAddedLatency = 0.0005,
-              int epollTimeout = 0);
+              int epollTimeout = 0,
+              Epoller::Backend backend = Epoller::DefaultBackend);
 
     void start(const OnStop & onStop = OnStop());
 
@@ -59,11 +118,15 @@ struct MessageLoop : public Epoller {
         Note that this function call will not take effect immediately. All work
         is deferred to the main message loop thread.
 
+        With more than one thread, affinity is the index of the thread
+        that should preferably handle the source; -1 lets any thread do it.
+
         Returns true if the request was successfully enqueued, false otherwise.
     */
     bool addSource(const std::string & name,
                    AsyncEventSource & source,
-                   int priority = 0);
+                   int priority = 0,
+                   int affinity = -1);
 
     /** Add the given source of asynchronous wakeups with the given
         callback to be run when they trigger.
@@ -75,7 +138,8 @@ struct MessageLoop : public Epoller {
     */
     bool addSource(const std::string & name,
                    const std::shared_ptr<AsyncEventSource> & source,
-                   int priority = 0);
+                   int priority = 0,
+                   int affinity = -1);
 
     /** Add a periodic job to be performed by the loop.  The number passed
         to the toRun function is the number of timeouts that have elapsed
@@ -101,6 +165,15 @@ struct MessageLoop : public Epoller {
     */
     void startSubordinateThread(const SubordinateThreadFn & mainFn);
 
+    /** Restrict the threads started from now on by start() and
+        startSubordinateThread() to the given CPUs (see ML::parseCpuList).
+        An empty list lets them run anywhere.
+    */
+    void setThreadAffinity(const std::vector<int> & cpus)
+    {
+        cpuAffinity = cpus;
+    }
+
     virtual bool processOne();
 
     virtual bool poll() const;
@@ -136,13 +209,58 @@ struct MessageLoop : public Epoller {
     /** Total number of seconds that this message loop has spent sleeping.
         Can be polled regularly to determine the duty cycle of the loop.
      */
-    double totalSleepSeconds() const { return totalSleepTime_; }
+    double totalSleepSeconds() const;
     rusage getResourceUsage() const { return resourceUsage; }
 
+    /** Time, in ticks of the CPU tick counter, that each pass of the loop
+        slept for once it had done its work in order to batch up what comes
+        in meanwhile (see maxAddedLatency), including the time taken by the
+        kernel to wake it back up.  This is how much later than it could
+        have been that a message arriving at the start of the sleep is
+        handled; it stays near zero with busy polling (see setBusyPoll()),
+        which does away with that sleep.  Only measured with a single
+        thread.  The figures are approximate while the loop runs.
+    */
+    LatencyHistogram wakeupLatency() const { return wakeupLatency_; }
+
+    /** Number of threads handling the sources. */
+    int numThreads() const { return std::max<int>(workers.size(), 1); }
+
+    /** Number of times that a thread ran a source taken from the queue of
+        another thread.
+    */
+    uint64_t numStolen() const { return numStolen_; }
+
+    /** Measure the calls to processOne() of each source added from now on.
+        This costs two reads of the tick counter per call; when disabled,
+        which is the default, the sources are run as is.
+    */
+    void enableSourceStats(bool enabled = true)
+    {
+        sourceStatsEnabled_ = enabled;
+    }
+
+    bool sourceStatsEnabled() const { return sourceStatsEnabled_; }
+
+    typedef std::vector<std::pair<std::string, SourceStats> > SourceStatsList;
+
+    /** Copy of the statistics of the instrumented sources, by source name.
+        Thread-safe; the figures are approximate while the loop runs.
+    */
+    SourceStatsList sourceStats() const;
+
     void debug(bool debugOn);
     
 private:
     void runWorkerThread();
+
+    /** Worker loop of the thread with the given index when handling the
+        sources from several threads.
+    */
+    void runStealingThread(int index);
+
+    /** Apply cpuAffinity to the calling thread. */
+    void pinThread();
     
     void wakeupMainThread();
 
@@ -154,24 +272,48 @@ private:
         SourceEntry() = default;
         SourceEntry(const std::string& name,
                     std::shared_ptr<AsyncEventSource> source,
-                    int priority)
-            : name(name), source(std::move(source)), priority(priority)
+                    int priority,
+                    int affinity = -1)
+            : name(name), source(std::move(source)), priority(priority),
+              affinity(affinity)
         {}
 
         SourceEntry(const std::string& name,
                     std::function<void ()> run,
                     int priority)
-            : name(name), priority(priority), run(std::move(run))
+            : name(name), priority(priority), affinity(-1),
+              run(std::move(run))
         {}
 
         std::string name;
         std::shared_ptr<AsyncEventSource> source;
         int priority;
+        int affinity;
         std::function<void ()> run;
+        std::shared_ptr<SourceStats> stats;
     };
 
     std::vector<SourceEntry> sources;
 
+    /* Per-source instrumentation. statsBySource_ is only used from the loop
+       thread, while sourceStats_ is shared with the readers. */
+    bool sourceStatsEnabled_;
+    std::unordered_map<const AsyncEventSource *, SourceStats *> statsBySource_;
+    mutable Lock sourceStatsLock_;
+    std::vector<std::pair<std::string, std::shared_ptr<SourceStats> > >
+        sourceStats_;
+
+    static bool runSource(AsyncEventSource & source, SourceStats * stats)
+    {
+        if (JML_LIKELY(!stats))
+            return source.processOne();
+
+        uint64_t before = ML::ticks();
+        bool more = source.processOne();
+        stats->record(ML::ticks() - before);
+        return more;
+    }
+
     /* Addition/removal action to perform on an event source */
     struct SourceAction {
         static constexpr int ADD = 0;
@@ -196,6 +338,7 @@ private:
     Lock threadsLock;
     int numThreadsCreated;
     std::vector<std::thread> threads;
+    std::vector<int> cpuAffinity;
     
     /** Global flag to shutdown. */
     volatile int shutdown_;
@@ -206,16 +349,76 @@ private:
     /** Number of secs that the message loop has spent sleeping. */
     double totalSleepTime_;
     rusage resourceUsage;
+    LatencyHistogram wakeupLatency_;
 
     /** Number of seconds of latency we're allowed to add in order to reduce
         the number of context switches.
     */
     double maxAddedLatency_;
 
+    /* A source as seen by the threads of a work-stealing loop.  Its fd is
+       armed one-shot while the source is idle so that only one thread can
+       pick it up; it is rearmed once the source has nothing left to do. */
+    struct Task {
+        enum State {
+            IDLE,      ///< waiting on its fd, or to be polled
+            QUEUED,    ///< in the queue of a worker
+            RUNNING    ///< being handled by a worker
+        };
+
+        Task(uint64_t id, const SourceEntry & entry)
+            : id(id), entry(entry), fd(entry.source->selectFd()),
+              state(IDLE), removed(false)
+        {
+        }
+
+        uint64_t id;
+        SourceEntry entry;
+        int fd;
+
+        std::mutex lock;
+        State state;
+        bool removed;
+    };
+
+    /* A thread of a work-stealing loop. */
+    struct Worker {
+        Worker() : sleepTime(0.0) {}
+
+        Lock lock;
+        std::deque<std::shared_ptr<Task> > queue;
+        double sleepTime;
+    };
+
+    std::vector<std::unique_ptr<Worker> > workers;
+
+    /* Tasks by id; the id is what is registered with the epoller, so that
+       a late notification for a removed source can't reach it. */
+    std::mutex tasksLock;
+    std::unordered_map<uint64_t, std::shared_ptr<Task> > tasks;
+    std::vector<std::shared_ptr<Task> > pollTasks;
+    uint64_t nextTaskId;
+
+    /* Only one idle thread at a time waits on the fds; the others sleep on
+       workGeneration_, which is bumped whenever a task is queued. */
+    Lock pollerLock;
+    int pollingThread;
+    volatile int workGeneration_;
+    std::atomic<int> numSleeping_;
+    std::atomic<uint64_t> numStolen_;
+
+    void addTask(const SourceEntry & entry);
+    void queueTask(const std::shared_ptr<Task> & task, int thread);
+    std::shared_ptr<Task> popTask(int thread);
+    void runTask(const std::shared_ptr<Task> & task, int thread);
+    void waitForTasks(int thread);
+    void wakeupWorkers(int nToWake);
+
     Epoller::HandleEventResult handleEpollEvent(epoll_event & event);
     void handleSourceActions();
     void processAddSource(const SourceEntry & entry);
     void processRemoveSource(const SourceEntry & entry);
+    void processRemoveTask(const SourceEntry & entry);
     void processRunAction(const SourceEntry & entry);
 };
 
@@ -4,7 +4,9 @@
 */
 
 #include <endian.h>
+#include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/timerfd.h>
 
 #include <iostream>
 #include <mutex>
@@ -313,3 +315,244 @@ rdy(int count)
 {
     forceWrite("RDY " + to_string(count) + "\n");
 }
+
+void
+NsqClient::
+mpub(const string & topic, const vector<string> & messages,
+     const OnFrame & onFrame)
+{
+    uint32_t bodySize(4);
+    for (const string & message: messages) {
+        bodySize += 4 + message.size();
+    }
+
+    string mpubMsg = "MPUB " + topic + "\n";
+    mpubMsg.reserve(mpubMsg.size() + 4 + bodySize);
+    uint32_t value = htonl(bodySize);
+    mpubMsg.append((char *) &value, sizeof(value));
+    value = htonl(messages.size());
+    mpubMsg.append((char *) &value, sizeof(value));
+    for (const string & message: messages) {
+        value = htonl(message.size());
+        mpubMsg.append((char *) &value, sizeof(value));
+        mpubMsg.append(message);
+    }
+
+    unique_lock<mutex> guard(callbacksLock_);
+    callbacks_.emplace(onFrame);
+    forceWrite(move(mpubMsg));
+}
+
+
+/* NSQ CLIENT: PRODUCER MODE */
+
+NsqClient::
+~NsqClient()
+{
+    if (timerFd_ != -1) {
+        removeFd(timerFd_);
+        unregisterFdCallback(timerFd_, false);
+        ::close(timerFd_);
+    }
+}
+
+void
+NsqClient::
+enableProducer(const NsqProducerConfig & config)
+{
+    ExcCheck(config.maxBatchMessages > 0, "invalid maxBatchMessages");
+    ExcCheck(config.maxBatchDelay > 0, "invalid maxBatchDelay");
+
+    unique_lock<mutex> guard(producerLock_);
+    ExcCheck(!producerEnabled_, "producer mode already enabled");
+    producerConfig_ = config;
+
+    timerFd_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd_ == -1) {
+        throw ML::Exception(errno, "timerfd_create");
+    }
+
+    /* checking twice per delay bounds the wait of a message to 1.5 times
+       "maxBatchDelay" */
+    double interval = config.maxBatchDelay / 2;
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = interval;
+    spec.it_interval.tv_nsec = (interval - spec.it_interval.tv_sec) * 1e9;
+    if (spec.it_interval.tv_sec == 0 && spec.it_interval.tv_nsec == 0) {
+        spec.it_interval.tv_nsec = 1;
+    }
+    spec.it_value = spec.it_interval;
+    if (::timerfd_settime(timerFd_, 0, &spec, nullptr) == -1) {
+        throw ML::Exception(errno, "timerfd_settime");
+    }
+
+    auto onTimerEvent = [this] (const ::epoll_event & event) {
+        this->handleTimerEvent();
+    };
+    addFd(timerFd_, true, false, onTimerEvent);
+
+    producerEnabled_ = true;
+}
+
+bool
+NsqClient::
+publish(const string & topic, string message)
+{
+    vector<pair<string, Batch> > toSend;
+    bool notifyBackpressure(false);
+    bool accepted(true);
+
+    {
+        unique_lock<mutex> guard(producerLock_);
+        ExcCheck(producerEnabled_, "producer mode is not enabled");
+
+        NsqTopicStats & stats = topicStats_[topic];
+        size_t size = message.size();
+        if (bufferedBytes_ + size > producerConfig_.maxBufferedBytes) {
+            stats.messagesRejected++;
+            if (!backpressure_) {
+                backpressure_ = true;
+                notifyBackpressure = true;
+            }
+            accepted = false;
+        }
+        else {
+            Batch & batch = batches_[topic];
+            if (!batch.messages.empty()
+                && batch.bytes + size > producerConfig_.maxBatchBytes) {
+                takeBatch(topic, batch, toSend);
+            }
+            if (batch.messages.empty()) {
+                batch.started = Date::now();
+            }
+            batch.messages.emplace_back(move(message));
+            batch.bytes += size;
+            bufferedBytes_ += size;
+            stats.messagesQueued++;
+            if (batch.messages.size() >= producerConfig_.maxBatchMessages
+                || batch.bytes >= producerConfig_.maxBatchBytes) {
+                takeBatch(topic, batch, toSend);
+            }
+        }
+    }
+
+    if (notifyBackpressure && producerConfig_.onBackpressure) {
+        producerConfig_.onBackpressure(true);
+    }
+    for (auto & entry: toSend) {
+        sendBatch(entry.first, move(entry.second));
+    }
+
+    return accepted;
+}
+
+void
+NsqClient::
+flushBatches()
+{
+    flushBatches(Date::positiveInfinity());
+}
+
+void
+NsqClient::
+flushBatches(Date olderThan)
+{
+    vector<pair<string, Batch> > toSend;
+
+    {
+        unique_lock<mutex> guard(producerLock_);
+        for (auto & entry: batches_) {
+            Batch & batch = entry.second;
+            if (!batch.messages.empty() && batch.started < olderThan) {
+                takeBatch(entry.first, batch, toSend);
+            }
+        }
+    }
+
+    for (auto & entry: toSend) {
+        sendBatch(entry.first, move(entry.second));
+    }
+}
+
+size_t
+NsqClient::
+bufferedBytes()
+    const
+{
+    unique_lock<mutex> guard(producerLock_);
+    return bufferedBytes_;
+}
+
+map<string, NsqTopicStats>
+NsqClient::
+topicStats()
+    const
+{
+    unique_lock<mutex> guard(producerLock_);
+    return topicStats_;
+}
+
+void
+NsqClient::
+takeBatch(const string & topic, Batch & batch,
+          vector<pair<string, Batch> > & toSend)
+{
+    toSend.emplace_back(topic, move(batch));
+    topicStats_[topic].batchesSent++;
+    batch = Batch();
+}
+
+void
+NsqClient::
+sendBatch(const string & topic, Batch && batch)
+{
+    size_t numMessages = batch.messages.size();
+    size_t bytes = batch.bytes;
+    auto onFrame = [=] (const NsqFrame & response) {
+        this->handleBatchResult(topic, numMessages, bytes, response);
+    };
+    mpub(topic, batch.messages, onFrame);
+}
+
+void
+NsqClient::
+handleBatchResult(const string & topic, size_t numMessages, size_t bytes,
+                  const NsqFrame & response)
+{
+    bool notifyBackpressure(false);
+
+    {
+        unique_lock<mutex> guard(producerLock_);
+        NsqTopicStats & stats = topicStats_[topic];
+        if (response.type == NsqFrameType::Response) {
+            stats.messagesSent += numMessages;
+            stats.bytesSent += bytes;
+        }
+        else {
+            stats.messagesFailed += numMessages;
+        }
+        bufferedBytes_ -= bytes;
+        if (backpressure_
+            && bufferedBytes_ < producerConfig_.maxBufferedBytes / 2) {
+            backpressure_ = false;
+            notifyBackpressure = true;
+        }
+    }
+
+    if (notifyBackpressure && producerConfig_.onBackpressure) {
+        producerConfig_.onBackpressure(false);
+    }
+    if (producerConfig_.onBatchResult) {
+        producerConfig_.onBatchResult(topic, numMessages, response);
+    }
+}
+
+void
+NsqClient::
+handleTimerEvent()
+{
+    uint64_t numWakeups;
+    while (::read(timerFd_, &numWakeups, sizeof(numWakeups)) > 0);
+
+    flushBatches(Date::now().plusSeconds(-producerConfig_.maxBatchDelay));
+}
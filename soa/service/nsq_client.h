@@ -9,7 +9,11 @@
 
 #pragma once
 
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "soa/types/date.h"
 #include "soa/types/value_description.h"
@@ -60,6 +64,66 @@ struct NsqFrame {
 };
 
 
+/****************************************************************************/
+/* NSQ PRODUCER CONFIG                                                      */
+/****************************************************************************/
+
+/* Parameters of the batched producer mode of NsqClient, where the messages
+ * published to a topic are buffered and sent with a single MPUB command once
+ * the batch has "maxBatchMessages" messages or "maxBatchBytes" bytes, or
+ * when its oldest message has waited about "maxBatchDelay" seconds. */
+
+struct NsqProducerConfig {
+    NsqProducerConfig()
+        : maxBatchMessages(500), maxBatchBytes(1024 * 1024),
+          maxBatchDelay(0.05), maxBufferedBytes(64 * 1024 * 1024)
+    {
+    }
+
+    size_t maxBatchMessages;
+
+    /* must stay below the --max-body-size of nsqd, 5MB by default */
+    size_t maxBatchBytes;
+
+    double maxBatchDelay;
+
+    /* bound on the bytes that are buffered or sent and not acknowledged yet,
+       above which "publish" refuses new messages */
+    size_t maxBufferedBytes;
+
+    /* invoked with "true" when "publish" starts refusing messages and with
+       "false" once the buffered bytes are back under half of
+       "maxBufferedBytes" */
+    std::function<void (bool)> onBackpressure;
+
+    /* invoked with the response of nsqd to each batch */
+    std::function<void (const std::string & topic, size_t numMessages,
+                        const NsqFrame & response)> onBatchResult;
+};
+
+
+/****************************************************************************/
+/* NSQ TOPIC STATS                                                          */
+/****************************************************************************/
+
+/* Counters of the batched producer mode for one topic. */
+
+struct NsqTopicStats {
+    NsqTopicStats()
+        : messagesQueued(0), messagesRejected(0), messagesSent(0),
+          messagesFailed(0), bytesSent(0), batchesSent(0)
+    {
+    }
+
+    uint64_t messagesQueued;    /* accepted by "publish" */
+    uint64_t messagesRejected;  /* refused due to backpressure */
+    uint64_t messagesSent;      /* acknowledged by nsqd */
+    uint64_t messagesFailed;    /* in batches refused by nsqd */
+    uint64_t bytesSent;         /* payload of the acknowledged messages */
+    uint64_t batchesSent;
+};
+
+
 /****************************************************************************/
 /* NSQ CLIENT                                                               */
 /****************************************************************************/
@@ -74,11 +138,15 @@ struct NsqClient : public TcpClient {
               const OnMessage & onMessage = nullptr)
         : TcpClient(onClosed, nullptr, nullptr, 0),
           parserStep_(0), parserRemaining_(0),
-          onMessage_(onMessage), remainingRdy_(0)
+          onMessage_(onMessage), remainingRdy_(0),
+          producerEnabled_(false), bufferedBytes_(0), backpressure_(false),
+          timerFd_(-1)
     {
         setUseNagle(true);
     }
 
+    ~NsqClient();
+
     TcpConnectionResult connectSync();
 
     void nop();
@@ -92,6 +160,25 @@ struct NsqClient : public TcpClient {
 
     void pub(const std::string & topic, const std::string & message,
              const OnFrame & onFrame = nullptr);
+    void mpub(const std::string & topic,
+              const std::vector<std::string> & messages,
+              const OnFrame & onFrame = nullptr);
+
+    /* batched producer mode; the client must be registered in a message
+       loop, which flushes the batches that are due */
+    void enableProducer(const NsqProducerConfig & config
+                        = NsqProducerConfig());
+
+    /* buffer "message" for publication to "topic", or return false when
+       "maxBufferedBytes" is reached */
+    bool publish(const std::string & topic, std::string message);
+
+    /* send all the buffered messages right away, typically before closing
+       the connection */
+    void flushBatches();
+
+    size_t bufferedBytes() const;
+    std::map<std::string, NsqTopicStats> topicStats() const;
 
     void fin(const std::string & messageId);
 
@@ -114,6 +201,29 @@ private:
         rdy(1000);
     }
 
+    /* producer mode */
+    struct Batch {
+        Batch()
+            : bytes(0)
+        {
+        }
+
+        std::vector<std::string> messages;
+        size_t bytes;
+        Date started;
+    };
+
+    /* move the messages of "batch" to "toSend", so that they can be sent
+       once producerLock_, which is held by the caller, is released */
+    void takeBatch(const std::string & topic, Batch & batch,
+                   std::vector<std::pair<std::string, Batch> > & toSend);
+    void sendBatch(const std::string & topic, Batch && batch);
+    void handleBatchResult(const std::string & topic,
+                           size_t numMessages, size_t bytes,
+                           const NsqFrame & response);
+    void flushBatches(Date olderThan);
+    void handleTimerEvent();
+
     /* response parsing */
     int parserStep_; /* 0 = size; 1 = type; 2 = message */
     uint32_t parserRemaining_; /* size missing from message */
@@ -125,6 +235,15 @@ private:
 
     OnMessage onMessage_;
     int remainingRdy_;
+
+    mutable std::mutex producerLock_;
+    bool producerEnabled_;
+    NsqProducerConfig producerConfig_;
+    std::map<std::string, Batch> batches_;
+    std::map<std::string, NsqTopicStats> topicStats_;
+    size_t bufferedBytes_;
+    bool backpressure_;
+    int timerFd_;
 };
 
 } // namespace Datacratic
@@ -12,6 +12,14 @@
 #include <poll.h>
 #include <boost/date_time/gregorian/gregorian.hpp>
 
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT 15
+#endif
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+
 using namespace std;
 using namespace ML;
 using namespace boost::posix_time;
@@ -39,13 +47,13 @@ PassiveEndpoint::
 int
 PassiveEndpoint::
 init(PortRange const & portRange, const std::string & hostname, int num_threads, bool synchronous,
-     bool nameLookup, int backlog)
+     bool nameLookup, int backlog, int numAcceptors)
 {
     //static const char *fName = "PassiveEndpoint::init:";
     //cerr << fName << this << ":was called for " << hostname << endl;
     spinup(num_threads, synchronous);
 
-    int port = listen(portRange, hostname, nameLookup, backlog);
+    int port = listen(portRange, hostname, nameLookup, backlog, numAcceptors);
     cerr << "listening on hostname " << hostname << " port " << port << endl;
     return port;
 }
@@ -57,7 +65,7 @@ init(PortRange const & portRange, const std::string & hostname, int num_threads,
 
 AcceptorT<SocketTransport>::
 AcceptorT()
-    : fd(-1), endpoint(0), listening_(false)
+    : endpoint(0), listening_(false)
 {
 }
 
@@ -67,72 +75,123 @@ AcceptorT<SocketTransport>::
     closePeer();
 }
 
+namespace {
+
+/** Create a listening socket with the options that every acceptor socket
+    needs.  SO_REUSEPORT has to be set before the bind on every socket that
+    is to share the port.  SO_BUSY_POLL is inherited by the accepted
+    sockets; raising it takes CAP_NET_ADMIN, so we only warn if it fails.
+*/
+int openAcceptSocket(bool reusePort, int busyPollUs)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1)
+        throw Exception("error creating socket: %s", strerror(errno));
+
+    // Avoid already bound messages for the minute after a server has exited
+    int tr = 1;
+    int res = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &tr, sizeof(int));
+
+    if (res == -1) {
+        close(fd);
+        throw Exception("error setsockopt SO_REUSEADDR: %s", strerror(errno));
+    }
+
+    if (reusePort) {
+        res = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &tr, sizeof(int));
+        if (res == -1) {
+            close(fd);
+            throw Exception("error setsockopt SO_REUSEPORT: %s",
+                            strerror(errno));
+        }
+    }
+
+    if (busyPollUs > 0) {
+        res = setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busyPollUs,
+                         sizeof(int));
+        if (res == -1) {
+            static bool warned = false;
+            if (!warned) {
+                cerr << "couldn't set SO_BUSY_POLL on accept socket: "
+                     << strerror(errno) << endl;
+                warned = true;
+            }
+        }
+    }
+
+    return fd;
+}
+
+} // file scope
+
 int
 AcceptorT<SocketTransport>::
 listen(PortRange const & portRange,
        const std::string & hostname,
        PassiveEndpoint * endpoint,
        bool nameLookup,
-       int backlog)
+       int backlog,
+       int numAcceptors)
 {
     closePeer();
+
+    if (numAcceptors < 1)
+        throw Exception("listen: need at least one acceptor, not %d",
+                        numAcceptors);
     
     this->endpoint = endpoint;
     this->nameLookup = nameLookup;
 
-    fd = socket(AF_INET, SOCK_STREAM, 0);
+    bool reusePort = numAcceptors > 1;
 
-    // Avoid already bound messages for the minute after a server has exited
-    int tr = 1;
-    int res = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &tr, sizeof(int));
+    auto closeAll = [&] ()
+        {
+            for (int fd: fds)
+                close(fd);
+            fds.clear();
+        };
 
-    if (res == -1) {
-        close(fd);
-        fd = -1;
-        throw Exception("error setsockopt SO_REUSEADDR: %s", strerror(errno));
-    }
+    int fd = openAcceptSocket(reusePort, endpoint->busyPoll());
+    fds.push_back(fd);
 
     const char * hostNameToUse
         = (hostname == "*" ? "0.0.0.0" : hostname.c_str());
 
-    int port = portRange.bindPort
-        ([&](int port)
-         {
-             addr = ACE_INET_Addr(port, hostNameToUse, AF_INET);
-
-             //cerr << "port = " << port
-             //     << " hostname = " << hostname
-             //     << " addr = " << addr.get_host_name() << " "
-             //     << addr.get_host_addr() << " "
-             //     << addr.get_ip_address() << endl;
-
-             int res = ::bind(fd,
-                              reinterpret_cast<sockaddr *>(addr.get_addr()),
-                              addr.get_addr_size());
-             if (res == -1 && errno != EADDRINUSE)
-                 throw Exception("listen: bind returned %s", strerror(errno));
-             return res == 0;
-         });
+    int port;
+    try {
+        port = portRange.bindPort
+            ([&](int port)
+             {
+                 addr = ACE_INET_Addr(port, hostNameToUse, AF_INET);
+
+                 //cerr << "port = " << port
+                 //     << " hostname = " << hostname
+                 //     << " addr = " << addr.get_host_name() << " "
+                 //     << addr.get_host_addr() << " "
+                 //     << addr.get_ip_address() << endl;
+
+                 int res = ::bind(fd,
+                                  reinterpret_cast<sockaddr *>(addr.get_addr()),
+                                  addr.get_addr_size());
+                 if (res == -1 && errno != EADDRINUSE)
+                     throw Exception("listen: bind returned %s", strerror(errno));
+                 return res == 0;
+             });
+    } catch (...) {
+        closeAll();
+        throw;
+    }
     
     if (port == -1) {
+        closeAll();
         throw Exception("couldn't bind to any port in range [%d,%d]", portRange.first,
                                                             portRange.last);
     }
 
-    // Avoid already bound messages for the minute after a server has exited
-    res = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &tr, sizeof(int));
-
-    if (res == -1) {
-        close(fd);
-        fd = -1;
-        throw Exception("error setsockopt SO_REUSEADDR: %s", strerror(errno));
-    }
-
-    res = ::listen(fd, backlog);
+    int res = ::listen(fd, backlog);
 
     if (res == -1) {
-        close(fd);
-        fd = -1;
+        closeAll();
         throw Exception("error on listen: %s", strerror(errno));
     }
 
@@ -144,12 +203,43 @@ listen(PortRange const & portRange,
         addr.set(&inAddr, inAddrLen);
     }
 
+    /* The other acceptors join the port that the first one has bound, so
+       that a scanned or ephemeral port is shared as well. */
+    for (int i = 1;  i < numAcceptors;  ++i) {
+        int extraFd;
+        try {
+            extraFd = openAcceptSocket(true, endpoint->busyPoll());
+        } catch (...) {
+            closeAll();
+            throw;
+        }
+        fds.push_back(extraFd);
+
+        res = ::bind(extraFd,
+                     reinterpret_cast<sockaddr *>(addr.get_addr()),
+                     addr.get_addr_size());
+        if (res == -1) {
+            closeAll();
+            throw Exception("listen: bind of acceptor %d returned %s",
+                            i, strerror(errno));
+        }
+
+        res = ::listen(extraFd, backlog);
+        if (res == -1) {
+            closeAll();
+            throw Exception("error on listen: %s", strerror(errno));
+        }
+    }
+
     listening_ = true;
     ML::futex_wake(listening_);
 
     shutdown = false;
 
-    acceptThread.reset(new boost::thread([=] () { this->runAcceptThread(); }));
+    for (int fd: fds) {
+        acceptThreads.emplace_back
+            (new boost::thread([=] () { this->runAcceptThread(fd); }));
+    }
     return port;
 }
 
@@ -157,18 +247,22 @@ void
 AcceptorT<SocketTransport>::
 closePeer()
 {
-    if (!acceptThread) return;
+    if (acceptThreads.empty()) return;
     shutdown = true;
 
     ML::memory_barrier();
 
+    /* The accept threads never read the wakeup once shutdown is set, so a
+       single signal stays pending until all of them have seen it. */
     wakeup.signal();
 
-    close(fd);
-    fd = -1;
+    for (auto & thread: acceptThreads)
+        thread->join();
+    acceptThreads.clear();
 
-    acceptThread->join();
-    acceptThread.reset();
+    for (int fd: fds)
+        close(fd);
+    fds.clear();
 }
 
 std::string
@@ -200,7 +294,7 @@ struct NameEntry {
 
 void
 AcceptorT<SocketTransport>::
-runAcceptThread()
+runAcceptThread(int fd)
 {
     //static const char *fName = "AcceptorT<SocketTransport>::runAcceptThread:";
     unordered_map<string,NameEntry> addr2Name;
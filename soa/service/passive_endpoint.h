@@ -28,7 +28,8 @@ struct Acceptor {
 
     virtual int
     listen(PortRange const & portRange, const std::string & hostname,
-           PassiveEndpoint * endpoint, bool nameLookup, int backlog) = 0;
+           PassiveEndpoint * endpoint, bool nameLookup, int backlog,
+           int numAcceptors = 1) = 0;
 
     virtual void closePeer() = 0;
 
@@ -72,21 +73,26 @@ struct PassiveEndpoint: public EndpointBase {
 
         If threads is zero, then nothing will actually be done until a
         thread calls useThisThread() to do work.
+
+        If numAcceptors is more than one, that many listening sockets are
+        bound to the same port with SO_REUSEPORT, each with its own accept
+        thread, and the kernel spreads incoming connections between them.
     */
     int init(PortRange const & portRange = PortRange(), const std::string & hostname = "localhost",
              int threads = 1, bool synchronous = true, bool nameLookup=true,
-             int backlog = DEF_BACKLOG);
+             int backlog = DEF_BACKLOG, int numAcceptors = 1);
 
     /** Listen on the given port.  If port is -1, then it should scan
         for a port and return that.  Returns the port number.
     */
     virtual int listen(PortRange const & portRange, const std::string & host,bool nameLookup=true,
-                       int backlog = DEF_BACKLOG)
+                       int backlog = DEF_BACKLOG, int numAcceptors = 1)
     {
         if (!acceptor)
             throw ML::Exception("can't listen without acceptor");
 
-        return acceptor->listen(portRange, host, this, nameLookup, backlog);
+        return acceptor->listen(portRange, host, this, nameLookup, backlog,
+                                numAcceptors);
     }
 
     /** Wait until we are ready to accept connections */
@@ -189,12 +195,16 @@ struct AcceptorT<SocketTransport> : public Acceptor {
     AcceptorT();
     virtual ~AcceptorT();
 
-    /** Listen on the given address for connections. */
+    /** Listen on the given address for connections.  When numAcceptors is
+        more than one, that many sockets share the port via SO_REUSEPORT
+        and each is served by its own accept thread.
+    */
     virtual int listen(PortRange const & portRange,
                        const std::string & hostname,
                        PassiveEndpoint * endpoint,
                        bool nameLookup,
-                       int backlog);
+                       int backlog,
+                       int numAcceptors = 1);
 
     /** Close down the acceptor. */
     virtual void closePeer();
@@ -208,16 +218,16 @@ struct AcceptorT<SocketTransport> : public Acceptor {
     /** Special thread to deal with accepting connections all by itself to
         avoid multiplexing them on the router.
     */
-    void runAcceptThread();
+    void runAcceptThread(int fd);
 
     /** Wait until we are ready to accept connections */
     void waitListening() const;
 
 protected:
-    std::shared_ptr<boost::thread> acceptThread;
+    std::vector<std::shared_ptr<boost::thread> > acceptThreads;
     ML::Wakeup_Fd wakeup;
     ACE_INET_Addr addr;
-    int fd;
+    std::vector<int> fds;
     PassiveEndpoint * endpoint;
     int listening_; // whether the socket is listening
     bool nameLookup;
@@ -8,8 +8,16 @@
 #ifndef __router__pending_list_h__
 #define __router__pending_list_h__
 
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include "timeout_map.h"
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
+#include "jml/utils/exc_assert.h"
 #include "jml/utils/guard.h"
 
 namespace Datacratic {
@@ -36,8 +44,26 @@ struct PendingPersistence {
 };
 
 struct LeveldbPendingPersistence : public PendingPersistence {
+    LeveldbPendingPersistence()
+        : sync(false)
+    {
+    }
+
+    ~LeveldbPendingPersistence()
+    {
+        try {
+            disableBatching();
+        } catch (const std::exception & exc) {
+            std::cerr << "error writing the last leveldb batch: "
+                      << exc.what() << std::endl;
+        }
+    }
+
     std::shared_ptr<leveldb::DB> db;
 
+    /** Whether each write waits for the data to be on disk. */
+    bool sync;
+
     void open(const std::string & filename)
     {
         leveldb::DB* db;
@@ -100,9 +126,49 @@ struct LeveldbPendingPersistence : public PendingPersistence {
         return size;
     }
 
+    /** Group commit: the puts and erases are accumulated into a batch
+        that a background thread writes once it holds maxBatchSize
+        operations or is maxDelay seconds old.  Reads see the operations
+        that are not written yet.  A failed write is thrown by the next
+        put, erase or flush.
+    */
+    void enableBatching(size_t maxBatchSize = 1000, double maxDelay = 0.01)
+    {
+        ExcAssert(!batcher);
+        ExcAssertGreater(maxBatchSize, 0);
+        batcher.reset(new Batcher(db, sync, maxBatchSize, maxDelay));
+    }
+
+    /** Write the pending operations and go back to writing each of them
+        directly.
+    */
+    void disableBatching()
+    {
+        if (!batcher)
+            return;
+        batcher->stop();
+        std::exception_ptr exc = batcher->exc;
+        batcher.reset();
+        if (exc)
+            std::rethrow_exception(exc);
+    }
+
+    /** Wait until all the operations done so far are written. */
+    void flush() const
+    {
+        if (batcher)
+            batcher->flush();
+    }
+
     virtual void put(const std::string & key, const std::string & value)
     {
+        if (batcher) {
+            batcher->add(key, &value);
+            return;
+        }
+
         leveldb::WriteOptions options;
+        options.sync = sync;
         leveldb::Status status = db->Put(options, key, value);
         if (!status.ok()) {
             throw ML::Exception("Writing to leveldb: " + status.ToString());
@@ -119,8 +185,17 @@ struct LeveldbPendingPersistence : public PendingPersistence {
     virtual std::string
     get(const std::string & key) const
     {
-        leveldb::ReadOptions options;
         std::string value;
+        if (batcher) {
+            int found = batcher->lookup(key, value);
+            if (found > 0)
+                return value;
+            if (found < 0)
+                throw ML::Exception("Writing to leveldb: "
+                                    + leveldb::Status::NotFound("").ToString());
+        }
+
+        leveldb::ReadOptions options;
         leveldb::Status status = db->Get(options, key, &value);
         if (!status.ok()) {
             throw ML::Exception("Writing to leveldb: " + status.ToString());
@@ -130,7 +205,13 @@ struct LeveldbPendingPersistence : public PendingPersistence {
 
     virtual void erase(const std::string & key)
     {
+        if (batcher) {
+            batcher->add(key, nullptr);
+            return;
+        }
+
         leveldb::WriteOptions options;
+        options.sync = sync;
         leveldb::Status status = db->Delete(options, key);
         if (!status.ok()) {
             throw ML::Exception("Writing to leveldb: " + status.ToString());
@@ -145,6 +226,8 @@ struct LeveldbPendingPersistence : public PendingPersistence {
         //db->CompactRange(0, 0);
         //cerr << "done compacting" << endl;
 
+        flush();
+
         leveldb::ReadOptions options;
         options.verify_checksums = true;
 
@@ -176,6 +259,166 @@ struct LeveldbPendingPersistence : public PendingPersistence {
         using namespace std;
         cerr << "scanned " << numScanned << " entries" << endl;
     }
+
+private:
+    struct Batcher {
+        Batcher(std::shared_ptr<leveldb::DB> db, bool sync,
+                size_t maxBatchSize, double maxDelay)
+            : db(db), sync(sync), maxBatchSize(maxBatchSize),
+              maxDelay(std::chrono::duration_cast
+                       <std::chrono::steady_clock::duration>
+                       (std::chrono::duration<double>(maxDelay))),
+              batch(new leveldb::WriteBatch()), batchSize(0),
+              opsQueued(0), opsWritten(0), flushTarget(0), shutdown(false)
+        {
+            thread = std::thread([=] () { this->run(); });
+        }
+
+        ~Batcher()
+        {
+            stop();
+        }
+
+        /* value is null for an erase */
+        void add(const std::string & key, const std::string * value)
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (exc)
+                std::rethrow_exception(exc);
+
+            // Bound the memory used when the disk can't keep up
+            while (batchSize >= 4 * maxBatchSize && !exc)
+                cond.wait(guard);
+
+            if (value) {
+                batch->Put(key, *value);
+                pending[key] = std::make_pair(true, *value);
+            }
+            else {
+                batch->Delete(key);
+                pending[key] = std::make_pair(false, std::string());
+            }
+            if (batchSize++ == 0)
+                batchStart = std::chrono::steady_clock::now();
+            ++opsQueued;
+            if (batchSize == maxBatchSize)
+                cond.notify_all();
+        }
+
+        /* 1 if the key has a value that is not written yet, -1 if it was
+           erased and 0 if leveldb has to say */
+        int lookup(const std::string & key, std::string & value) const
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            for (auto overlay: { &pending, &writing }) {
+                auto it = overlay->find(key);
+                if (it == overlay->end())
+                    continue;
+                if (!it->second.first)
+                    return -1;
+                value = it->second.second;
+                return 1;
+            }
+            return 0;
+        }
+
+        void flush()
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            uint64_t target = opsQueued;
+            flushTarget = std::max(flushTarget, target);
+            cond.notify_all();
+            while (opsWritten < target && !exc)
+                cond.wait(guard);
+            if (exc)
+                std::rethrow_exception(exc);
+        }
+
+        void stop()
+        {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                shutdown = true;
+            }
+            cond.notify_all();
+            if (thread.joinable())
+                thread.join();
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> guard(lock);
+
+            for (;;) {
+                if (batchSize == 0) {
+                    if (shutdown)
+                        return;
+                    cond.wait(guard);
+                    continue;
+                }
+
+                // A batch is written when full, on time, or when asked to
+                auto deadline = batchStart + maxDelay;
+                if (batchSize < maxBatchSize && flushTarget <= opsWritten
+                    && !shutdown
+                    && std::chrono::steady_clock::now() < deadline) {
+                    cond.wait_until(guard, deadline);
+                    continue;
+                }
+
+                std::unique_ptr<leveldb::WriteBatch> toWrite(batch.release());
+                batch.reset(new leveldb::WriteBatch());
+                writing.swap(pending);
+                pending.clear();
+                batchSize = 0;
+                uint64_t upTo = opsQueued;
+                cond.notify_all();
+
+                guard.unlock();
+                leveldb::WriteOptions options;
+                options.sync = sync;
+                leveldb::Status status = db->Write(options, toWrite.get());
+                guard.lock();
+
+                writing.clear();
+                if (!status.ok() && !exc) {
+                    exc = std::make_exception_ptr
+                        (ML::Exception("Writing to leveldb: "
+                                       + status.ToString()));
+                }
+                opsWritten = upTo;
+                cond.notify_all();
+            }
+        }
+
+        std::shared_ptr<leveldb::DB> db;
+        bool sync;
+        size_t maxBatchSize;
+        std::chrono::steady_clock::duration maxDelay;
+
+        mutable std::mutex lock;
+        std::condition_variable cond;
+
+        std::unique_ptr<leveldb::WriteBatch> batch;
+        size_t batchSize;
+        std::chrono::steady_clock::time_point batchStart;
+
+        /* latest operation on each key of the batch being accumulated and
+           of the one being written, where false means erased */
+        typedef std::map<std::string, std::pair<bool, std::string> > Overlay;
+        Overlay pending;
+        Overlay writing;
+
+        uint64_t opsQueued;
+        uint64_t opsWritten;
+        uint64_t flushTarget;
+        bool shutdown;
+        std::exception_ptr exc;
+
+        std::thread thread;
+    };
+
+    std::unique_ptr<Batcher> batcher;
 };
 
 template<typename Key, typename Value>
@@ -15,6 +15,8 @@
 #include "jml/arch/backtrace.h"
 #include "jml/arch/futex.h"
 #include "jml/utils/vector_utils.h"
+#include "jml/utils/xxhash.h"
+#include <algorithm>
 
 
 using namespace std;
@@ -474,7 +476,8 @@ struct AsyncConnection::EventLoop {
     void wakeup()
     {
         int res = write(wakeupfd[1], "x", 1);
-        if (res == -1)
+        // A full pipe means that a wakeup is already pending
+        if (res == -1 && errno != EAGAIN)
             throw ML::Exception("error waking up fd %d: %s", wakeupfd[1],
                                 strerror(errno));
     }
@@ -662,7 +665,12 @@ struct AsyncConnection::EventLoop {
     void startWriting()
     {
         //cerr << "start writing" << endl;
-        //if (fds[1].events & POLLOUT) return;  // already reading
+
+        // hiredis calls this for every command that it buffers.  Until the
+        // loop has written out the buffer, which it does with the lock
+        // held, the commands that follow are simply appended to it and sent
+        // in the same write.
+        if (fds[1].events & POLLOUT) return;  // already writing
         fds[1].events |= POLLOUT;
         wakeup();
     }
@@ -1108,4 +1116,267 @@ expireTimeouts(Date now)
     else earliestTimeout = timeouts.begin()->first;
 }
 
+/*****************************************************************************/
+/* SHARDED CONNECTION                                                        */
+/*****************************************************************************/
+
+ShardedConnection::
+ShardedConnection()
+{
+}
+
+ShardedConnection::
+ShardedConnection(const std::vector<Address> & addresses,
+                  int connectionsPerNode)
+{
+    connect(addresses, connectionsPerNode);
+}
+
+ShardedConnection::
+~ShardedConnection()
+{
+    close();
+}
+
+void
+ShardedConnection::
+connect(const std::vector<Address> & addresses, int connectionsPerNode)
+{
+    if (addresses.empty())
+        throw ML::Exception("sharded Redis connection needs at least one "
+                            "address");
+    if (connectionsPerNode < 1)
+        throw ML::Exception("invalid number of connections per Redis node: %d",
+                            connectionsPerNode);
+
+    close();
+
+    for (unsigned i = 0;  i < addresses.size();  ++i) {
+        std::unique_ptr<Node> node(new Node());
+        node->address = addresses[i];
+        node->next = 0;
+        for (int j = 0;  j < connectionsPerNode;  ++j)
+            node->connections.emplace_back(new AsyncConnection(addresses[i]));
+        nodes.emplace_back(std::move(node));
+
+        // The points only depend on the address, so that the other servers
+        // keep their keys when one is added
+        for (int j = 0;  j < VirtualNodes;  ++j) {
+            string point = addresses[i].uri() + "-" + to_string(j);
+            ring.emplace_back(XXH32(point.c_str(), point.size(), 0), i);
+        }
+    }
+
+    std::sort(ring.begin(), ring.end());
+}
+
+void
+ShardedConnection::
+test()
+{
+    for (auto & node: nodes)
+        for (auto & connection: node->connections)
+            connection->test();
+}
+
+void
+ShardedConnection::
+auth(std::string password)
+{
+    for (auto & node: nodes)
+        for (auto & connection: node->connections)
+            connection->auth(password);
+}
+
+void
+ShardedConnection::
+select(int database)
+{
+    for (auto & node: nodes)
+        for (auto & connection: node->connections)
+            connection->select(database);
+}
+
+void
+ShardedConnection::
+close()
+{
+    nodes.clear();
+    ring.clear();
+}
+
+std::string
+ShardedConnection::
+hashTag(const std::string & key)
+{
+    auto start = key.find('{');
+    if (start == string::npos)
+        return key;
+    auto end = key.find('}', start + 1);
+    if (end == string::npos || end == start + 1)
+        return key;
+    return key.substr(start + 1, end - start - 1);
+}
+
+int
+ShardedConnection::
+nodeFor(const std::string & key) const
+{
+    ExcAssert(!ring.empty());
+
+    string tag = hashTag(key);
+    uint32_t hash = XXH32(tag.c_str(), tag.size(), 0);
+
+    auto it = std::upper_bound(ring.begin(), ring.end(),
+                               make_pair(hash, int(nodes.size())));
+    if (it == ring.end())
+        it = ring.begin();
+    return it->second;
+}
+
+int
+ShardedConnection::
+nodeFor(const Command & command) const
+{
+    const string & name = command.formatStr;
+
+    if (command.args.empty() || name == "PING" || name == "KEYS"
+        || name == "RANDOMKEY" || name == "AUTH" || name == "SELECT"
+        || name == "MULTI" || name == "EXEC")
+        throw ML::Exception("Redis command %s has no key to be sharded by",
+                            name.c_str());
+
+    // Commands with several keys, which must all be on the same node
+    int stride = 0, numKeys = 1;
+    if (name == "MGET" || name == "DEL" || name == "WATCH")
+        stride = 1, numKeys = command.args.size();
+    else if (name == "MSET")
+        stride = 2, numKeys = (command.args.size() + 1) / 2;
+    else if (name == "SMOVE")
+        stride = 1, numKeys = 2;
+
+    int result = nodeFor(command.args[0]);
+    for (int i = 1;  i < numKeys;  ++i) {
+        if (nodeFor(command.args.at(i * stride)) != result)
+            throw ML::Exception("keys of Redis command %s are on different "
+                                "nodes; use a common {hash tag}",
+                                name.c_str());
+    }
+
+    return result;
+}
+
+AsyncConnection &
+ShardedConnection::
+connectionFor(const std::string & key)
+{
+    return nodes[nodeFor(key)]->connection();
+}
+
+size_t
+ShardedConnection::
+numRequestsPending() const
+{
+    size_t result = 0;
+    for (auto & node: nodes)
+        for (auto & connection: node->connections)
+            result += connection->numRequestsPending();
+    return result;
+}
+
+int64_t
+ShardedConnection::
+queue(const Command & command,
+      const OnResult & onResult,
+      Timeout timeout)
+{
+    return nodes[nodeFor(command)]->connection()
+        .queue(command, onResult, timeout);
+}
+
+Result
+ShardedConnection::
+exec(const Command & command, Timeout timeout)
+{
+    return nodes[nodeFor(command)]->connection().exec(command, timeout);
+}
+
+struct ShardedConnection::MultiAggregator
+    : public Results {
+
+    MultiAggregator(int size,
+                    const OnResults & onResults)
+        : numDone(0), onResults(onResults)
+    {
+        resize(size);
+    }
+
+    void result(int i, const Result & result)
+    {
+        at(i) = result.deepCopy();
+        if (__sync_add_and_fetch(&numDone, 1) != size())
+            return;
+        if (onResults)
+            onResults(*this);
+    }
+
+    int numDone;
+    OnResults onResults;
+};
+
+void
+ShardedConnection::
+queueMulti(const std::vector<Command> & commands,
+           const OnResults & onResults,
+           Timeout timeout)
+{
+    if (commands.empty())
+        throw ML::Exception("can't call queueMulti with an empty list "
+                            "of commands");
+
+    // Route everything first, so that nothing is sent if one of the
+    // commands can't be
+    vector<int> commandNodes;
+    for (const Command & command: commands)
+        commandNodes.push_back(nodeFor(command));
+
+    auto results
+        = std::make_shared<MultiAggregator>(commands.size(), onResults);
+
+    // One connection per node, so that its commands stay in order
+    vector<AsyncConnection *> connections(nodes.size(), nullptr);
+
+    for (unsigned i = 0;  i < commands.size();  ++i) {
+        AsyncConnection * & connection = connections[commandNodes[i]];
+        if (!connection)
+            connection = &nodes[commandNodes[i]]->connection();
+        connection->queue(commands[i],
+                          std::bind(&MultiAggregator::result, results, i,
+                                    std::placeholders::_1),
+                          timeout);
+    }
+}
+
+Results
+ShardedConnection::
+execMulti(const std::vector<Command> & commands, Timeout timeout)
+{
+    Results results;
+    int done = 0;
+
+    auto onResponse = [&] (const Redis::Results & redisResults)
+        {
+            results = redisResults;
+            done = 1;
+            futex_wake(done);
+        };
+
+    queueMulti(commands, onResponse, timeout);
+
+    while (!done)
+        futex_wait(done, 0);
+
+    return results;
+}
+
 } // namespace Redis
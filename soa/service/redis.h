@@ -22,7 +22,9 @@
 #include <boost/function.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include <atomic>
 #include <deque>
+#include <memory>
 
 
 namespace Redis {
@@ -361,7 +363,12 @@ struct Address {
 /* ASYNC CONNECTION                                                          */
 /*****************************************************************************/
 
-/** Asynchronous connection to Redis. */
+/** Asynchronous connection to Redis.
+
+    Commands are pipelined: the ones queued before the event loop gets to
+    write to the socket are sent together in a single write, and the
+    event loop is only woken up for the first of them.
+*/
 
 struct AsyncConnection {
     
@@ -482,6 +489,115 @@ private:
     struct MultiAggregator;
 };
 
+
+/*****************************************************************************/
+/* SHARDED CONNECTION                                                        */
+/*****************************************************************************/
+
+/** Connection to a set of independent Redis servers, between which the keys
+    are spread by consistent hashing, with a pool of AsyncConnections to
+    each server.
+
+    Each command is sent to the server that holds its first key; as in
+    Redis Cluster, only the part of a key between the first '{' and the
+    following '}' is hashed when there is one, so that keys that share a
+    hash tag are always held by the same server.  The commands of this
+    file that take several keys (MGET, MSET, DEL, SMOVE) must have all of
+    them on the same server, and commands without a key can only be sent
+    through the connections returned by connectionFor().
+
+    Adding a server only moves about 1/n of the keys to it.
+*/
+
+struct ShardedConnection {
+
+    typedef AsyncConnection::Timeout Timeout;
+    typedef AsyncConnection::OnResult OnResult;
+    typedef AsyncConnection::OnResults OnResults;
+
+    /** Number of points of each server on the hash ring. */
+    enum { VirtualNodes = 160 };
+
+    ShardedConnection();
+
+    ShardedConnection(const std::vector<Address> & addresses,
+                      int connectionsPerNode = 1);
+
+    ~ShardedConnection();
+
+    void connect(const std::vector<Address> & addresses,
+                 int connectionsPerNode = 1);
+
+    /** Test all of the connections; see AsyncConnection::test(). */
+    void test();
+    void auth(std::string password);
+    void select(int database);
+
+    void close();
+
+    /** Queue a command on the server of its key.  Returns a handle that is
+        only unique within the connection it was sent through.
+    */
+    int64_t queue(const Command & command,
+                  const OnResult & onResult = OnResult(),
+                  Timeout timeout = Timeout());
+
+    /** Execute synchronously. */
+    Result exec(const Command & command, Timeout timeout = Timeout());
+
+    /** Queue a list of commands, which can be on different servers.  The
+        commands for each server are sent in order through a single
+        connection, but there is no atomicity across servers.
+    */
+    void queueMulti(const std::vector<Command> & commands,
+                    const OnResults & onResults = OnResults(),
+                    Timeout timeout = Timeout());
+
+    /** Execute multiple commands synchronously. */
+    Results execMulti(const std::vector<Command> & commands,
+                      Timeout timeout = Timeout());
+
+    size_t numNodes() const
+    {
+        return nodes.size();
+    }
+
+    /** Index of the server that holds the given key. */
+    int nodeFor(const std::string & key) const;
+
+    /** Index of the server that the given command is to be sent to. */
+    int nodeFor(const Command & command) const;
+
+    /** Part of the key that is hashed. */
+    static std::string hashTag(const std::string & key);
+
+    /** One of the pooled connections to the server that holds the given
+        key, in round-robin order.
+    */
+    AsyncConnection & connectionFor(const std::string & key);
+
+    size_t numRequestsPending() const;
+
+private:
+    struct Node {
+        Address address;
+        std::vector<std::unique_ptr<AsyncConnection> > connections;
+        std::atomic<unsigned> next;
+
+        AsyncConnection & connection()
+        {
+            return *connections[next.fetch_add(1) % connections.size()];
+        }
+    };
+
+    std::vector<std::unique_ptr<Node> > nodes;
+
+    /** Points of the servers on the hash ring, sorted by hash. */
+    std::vector<std::pair<uint32_t, int> > ring;
+
+    struct MultiAggregator;
+};
+
 } // namespace Datacratic
 
 #endif /* __redis__redis_h__ */
@@ -6,6 +6,7 @@
 
 #include "rest_proxy.h"
 #include "jml/arch/exception_handler.h"
+#include "jml/utils/exc_check.h"
 
 using namespace std;
 using namespace ML;
@@ -19,26 +20,36 @@ namespace Datacratic {
 RestProxy::
 RestProxy()
     : operationQueue(1024),
+      localEndpoint(nullptr),
+      localResponses(1024),
       numMessagesOutstanding_(0),
       currentOpId(1)
 {
     // What to do when we get a new entry in the queue?
     operationQueue.onEvent = std::bind(&RestProxy::handleOperation,
                                        this, std::placeholders::_1);
-    
+    localResponses.onEvent = [=] (LocalResponse && response)
+        {
+            handleResponse(response.opId, response.responseCode, response.body);
+        };
 }
 
 RestProxy::
 RestProxy(const std::shared_ptr<zmq::context_t> & context)
     : operationQueue(1024),
       connection(context),
+      localEndpoint(nullptr),
+      localResponses(1024),
       numMessagesOutstanding_(0),
       currentOpId(1)
 {
     // What to do when we get a new entry in the queue?
     operationQueue.onEvent = std::bind(&RestProxy::handleOperation,
                                        this, std::placeholders::_1);
-    
+    localResponses.onEvent = [=] (LocalResponse && response)
+        {
+            handleResponse(response.opId, response.responseCode, response.body);
+        };
 }
 
 RestProxy::
@@ -67,7 +78,8 @@ shutdown()
     // Stop processing messages
     MessageLoop::shutdown();
 
-    connection.shutdown();
+    if (!localEndpoint)
+        connection.shutdown();
 }
 
 void
@@ -113,6 +125,19 @@ initServiceClass(std::shared_ptr<ConfigurationService> config,
                          std::placeholders::_1)));
 }
 
+void
+RestProxy::
+initLocal(RestServiceEndpoint * endpoint, const std::string & serviceName)
+{
+    ExcCheck(endpoint, "no local endpoint");
+
+    serviceName_ = serviceName;
+    localEndpoint = endpoint;
+
+    addSource("RestProxy::operationQueue", operationQueue);
+    addSource("RestProxy::localResponses", localResponses);
+}
+
 void
 RestProxy::
 push(const RestRequest & request, const OnDone & onDone)
@@ -145,6 +170,11 @@ handleOperation(const Operation & op)
     // Gets called when someone calls our API to make something happen;
     // this is run by the main worker thread to actually do the work.
     // It forwards the request off to the master banker.
+    if (localEndpoint) {
+        handleLocalOperation(op);
+        return;
+    }
+
     uint64_t opId = 0;
     if (op.onDone)
         opId = currentOpId++;
@@ -192,8 +222,43 @@ handleZmqResponse(const std::vector<std::string> & message)
 
     uint64_t opId = boost::lexical_cast<uint64_t>(message.at(0));
     int responseCode = boost::lexical_cast<int>(message.at(1));
-    std::string body = message.at(2);
+    handleResponse(opId, responseCode, message.at(2));
+}
+
+void
+RestProxy::
+handleLocalOperation(const Operation & op)
+{
+    if (!op.onDone) {
+        localEndpoint->handleLocalRequest(op.request,
+                                          [] (int, const std::string &) {});
+        int no = __sync_add_and_fetch(&numMessagesOutstanding_, -1);
+        if (no == 0)
+            futex_wake(numMessagesOutstanding_);
+        return;
+    }
 
+    uint64_t opId = currentOpId++;
+    outstanding[opId] = op.onDone;
+
+    // The endpoint may answer from one of its own threads, so the response
+    // goes through a queue to be handled on ours like the zeromq ones.
+    auto onResponse = [=] (int responseCode, const std::string & body)
+        {
+            LocalResponse response;
+            response.opId = opId;
+            response.responseCode = responseCode;
+            response.body = body;
+            localResponses.push(std::move(response));
+        };
+
+    localEndpoint->handleLocalRequest(op.request, onResponse);
+}
+
+void
+RestProxy::
+handleResponse(uint64_t opId, int responseCode, const std::string & body)
+{
     ExcAssert(opId);
 
     auto it = outstanding.find(opId);
@@ -293,6 +358,27 @@ push(   const OnResponse & onResponse,
 }
 
 
+void
+MultiRestProxy::
+connectLocal(const string& serviceName, RestServiceEndpoint * endpoint)
+{
+    {
+        lock_guard<ML::Spinlock> guard(connectionsLock);
+
+        auto& conn = connections[serviceName];
+        if (conn) return;
+
+        shared_ptr<RestProxy> newConn(new RestProxy());
+        newConn->initLocal(endpoint, serviceName);
+        conn = std::move(newConn);
+
+        addSource("MultiRestProxy::" + serviceName, conn);
+    }
+
+    connected = true;
+    onConnect(serviceName);
+}
+
 void
 MultiRestProxy::
 connectAllServiceProviders(
@@ -101,6 +101,13 @@ struct RestProxy: public MessageLoop {
                           const std::string & serviceClass,
                           const std::string & endpointName,
                           bool local = true);
+
+    /** Initialize to send the requests straight to the given endpoint, which
+        lives in the same process, instead of going through zeromq.  The
+        responses are still delivered on this message loop.
+    */
+    void initLocal(RestServiceEndpoint * endpoint,
+                   const std::string & serviceName = "local");
     
     typedef std::function<void (std::exception_ptr,
                                 int responseCode, const std::string &)> OnDone;
@@ -134,12 +141,27 @@ protected:
     TypedMessageSink<Operation> operationQueue;
     ZmqNamedProxy connection;
 
+    /** Endpoint that the requests are handed to when initLocal was used. */
+    RestServiceEndpoint * localEndpoint;
+
+    struct LocalResponse {
+        uint64_t opId;
+        int responseCode;
+        std::string body;
+    };
+
+    /** Responses of the local endpoint, which can come from any thread. */
+    TypedMessageSink<LocalResponse> localResponses;
+
     std::map<uint64_t, OnDone> outstanding;
     int numMessagesOutstanding_;  // atomic so can be read with no lock
     uint64_t currentOpId;
 
     void handleOperation(const Operation & op);
     void handleZmqResponse(const std::vector<std::string> & message);
+    void handleLocalOperation(const Operation & op);
+    void handleResponse(uint64_t opId, int responseCode,
+                        const std::string & body);
 };
 
 
@@ -194,6 +216,12 @@ struct MultiRestProxy : public MessageLoop
     }
 
 
+    /** Connects our class to the given endpoint which lives in the same
+        process, as if it was a service provider of the given name.
+    */
+    void connectLocal(const std::string& serviceName,
+                      RestServiceEndpoint * endpoint);
+
     /** Connects our class to every service under the given service class. */
     void connectAllServiceProviders(
             const std::string& serviceClass,
@@ -9,6 +9,8 @@
 #include "jml/arch/exception_handler.h"
 #include "jml/utils/set_utils.h"
 #include "jml/utils/file_functions.h"
+#include <algorithm>
+#include <string.h>
 
 
 using namespace std;
@@ -26,6 +28,53 @@ std::ostream & operator << (std::ostream & stream, const PathSpec & path)
     return stream << path.path;
 }
 
+std::string
+PathSpec::
+literalPrefix() const
+{
+    if (type == STRING)
+        return path;
+    if (type != REGEX
+        || (rex.flags() & boost::regex::icase)
+        || path.find('|') != string::npos)
+        return "";
+
+    static const char * metaChars = ".[]{}()*+?$|^\\";
+
+    string result;
+    for (size_t i = 0;  i < path.size();) {
+        char c = path[i];
+        if (c == '^' && i == 0) {
+            ++i;
+            continue;
+        }
+
+        if (c == '\\' && i + 1 < path.size() && ispunct(path[i + 1])) {
+            c = path[i + 1];
+            i += 2;
+        }
+        else if (strchr(metaChars, c)) {
+            break;
+        }
+        else ++i;
+
+        // A quantifier makes the character optional
+        if (i < path.size()) {
+            char next = path[i];
+            if (next == '*' || next == '?' || next == '{')
+                break;
+            if (next == '+') {
+                result += c;
+                break;
+            }
+        }
+
+        result += c;
+    }
+
+    return result;
+}
+
 
 /*****************************************************************************/
 /* REQUEST FILTER                                                            */
@@ -48,6 +97,95 @@ std::ostream & operator << (std::ostream & stream,
 }
 
 
+/*****************************************************************************/
+/* ROUTE TREE                                                                */
+/*****************************************************************************/
+
+void
+RouteTree::
+insert(const std::string & prefix, int route)
+{
+    Node * node = root.get();
+    size_t pos = 0;
+
+    for (;;) {
+        if (pos == prefix.size()) {
+            node->routes.push_back(route);
+            break;
+        }
+
+        std::shared_ptr<Node> * child = nullptr;
+        for (auto & c: node->children) {
+            if (c->label[0] == prefix[pos]) {
+                child = &c;
+                break;
+            }
+        }
+
+        if (!child) {
+            auto leaf = std::make_shared<Node>();
+            leaf->label = prefix.substr(pos);
+            leaf->routes.push_back(route);
+            node->children.push_back(leaf);
+            break;
+        }
+
+        Node & c = **child;
+        size_t common = 1;
+        while (common < c.label.size() && pos + common < prefix.size()
+               && c.label[common] == prefix[pos + common])
+            ++common;
+
+        if (common < c.label.size()) {
+            // Split the edge where the prefixes diverge
+            auto split = std::make_shared<Node>();
+            split->label = c.label.substr(0, common);
+            c.label = c.label.substr(common);
+            split->children.push_back(*child);
+            *child = split;
+            node = split.get();
+        }
+        else node = &c;
+
+        pos += common;
+    }
+
+    ++numRoutes;
+}
+
+void
+RouteTree::
+match(const std::string & path, Routes & routes) const
+{
+    const Node * node = root.get();
+    size_t pos = 0;
+
+    for (;;) {
+        for (int route: node->routes)
+            routes.push_back(route);
+
+        if (pos == path.size())
+            break;
+
+        const Node * next = nullptr;
+        for (auto & c: node->children) {
+            if (c->label[0] == path[pos]) {
+                next = c.get();
+                break;
+            }
+        }
+
+        if (!next || path.compare(pos, next->label.size(), next->label) != 0)
+            break;
+
+        pos += next->label.size();
+        node = next;
+    }
+
+    std::sort(routes.begin(), routes.end());
+}
+
+
 /*****************************************************************************/
 /* REST REQUEST ROUTER                                                       */
 /*****************************************************************************/
@@ -147,7 +285,18 @@ processRequest(const RestServiceEndpoint::ConnectionId & connection,
     if (rootHandler && (!terminal || context.remaining.empty()))
         return rootHandler(connection, request, context);
 
-    for (auto & sr: subRoutes) {
+    // Only the routes whose literal prefix matches can match; the others
+    // are skipped without looking at them.
+    RouteTree::Routes candidates;
+    if (routeTree.size() == subRoutes.size())
+        routeTree.match(context.remaining, candidates);
+    else {
+        for (unsigned i = 0;  i < subRoutes.size();  ++i)
+            candidates.push_back(i);
+    }
+
+    for (int i: candidates) {
+        auto & sr = subRoutes[i];
         if (debug)
             cerr << "  trying subroute " << sr.router->description << endl;
         try {
@@ -187,23 +336,21 @@ matchPath(const RestRequest & request,
 {
     switch (path.type) {
     case PathSpec::STRING: {
-        std::string::size_type pos = context.remaining.find(path.path);
-        if (pos == 0) {
-            using namespace std;
-            //cerr << "context string " << pos << endl;
+        if (context.remaining.compare(0, path.path.size(), path.path) == 0) {
             context.resources.push_back(path.path);
-            context.remaining = string(context.remaining, path.path.size());
+            context.remaining.erase(0, path.path.size());
             break;
         }
         else return false;
     }
     case PathSpec::REGEX: {
+        // Only matches from the start
         boost::smatch results;
         bool found
             = boost::regex_search(context.remaining,
                                   results,
-                                  path.rex)
-            && !results.prefix().matched;  // matches from the start
+                                  path.rex,
+                                  boost::match_continuous);
         
         //cerr << "matching regex " << path.path << " against "
         //     << context.remaining << " with found " << found << endl;
@@ -211,8 +358,7 @@ matchPath(const RestRequest & request,
             return false;
         for (unsigned i = 0;  i < results.size();  ++i)
             context.resources.push_back(results[i]);
-        context.remaining = std::string(context.remaining,
-                                        results[0].length());
+        context.remaining.erase(0, results[0].length());
         break;
     }
     case PathSpec::NONE:
@@ -295,7 +441,7 @@ addRoute(PathSpec path, RequestFilter filter,
     route.router = handler;
     route.extractObject = extractObject;
 
-    subRoutes.emplace_back(std::move(route));
+    addSubRoute(std::move(route));
 }
 
 void
@@ -368,8 +514,17 @@ addSubRouter(PathSpec path, const std::string & description, ExtractObject extra
     route.router->description = description;
     route.extractObject = extractObject;
 
-    subRoutes.push_back(route);
-    return *route.router;
+    RestRequestRouter & result = *route.router;
+    addSubRoute(std::move(route));
+    return result;
+}
+
+void
+RestRequestRouter::
+addSubRoute(Route && route)
+{
+    routeTree.insert(route.path.literalPrefix(), subRoutes.size());
+    subRoutes.emplace_back(std::move(route));
 }
 
 RestRequestRouter::OnProcessRequest
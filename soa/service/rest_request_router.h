@@ -10,6 +10,7 @@
 #include "soa/service/message_loop.h"
 #include "soa/service/rest_service_endpoint.h"
 #include "jml/utils/vector_utils.h"
+#include "jml/utils/compact_vector.h"
 #include "jml/utils/positioned_types.h"
 #include "jml/arch/rtti_utils.h"
 #include "jml/arch/demangle.h"
@@ -96,6 +97,12 @@ struct PathSpec {
     {
         return path < other.path;
     }
+
+    /** Returns the string that any path matched by this spec starts with:
+        the whole path for a string, or the literal characters the regex
+        starts with, which may be empty.
+    */
+    std::string literalPrefix() const;
 };
 
 struct Rx : public PathSpec {
@@ -353,6 +360,49 @@ std::ostream & operator << (std::ostream & stream,
                             const RestRequestParsingContext & context);
 
 
+/*****************************************************************************/
+/* ROUTE TREE                                                                */
+/*****************************************************************************/
+
+/** Radix tree indexing routes by the literal prefix of their path, so that
+    finding the routes that can match a request costs a walk along the
+    request path rather than one comparison (or regex search) per route.
+*/
+
+struct RouteTree {
+    typedef ML::compact_vector<int, 16> Routes;
+
+    RouteTree()
+        : root(new Node()), numRoutes(0)
+    {
+    }
+
+    /** Number of routes indexed. */
+    size_t size() const
+    {
+        return numRoutes;
+    }
+
+    /** Index route number "route" under "prefix". */
+    void insert(const std::string & prefix, int route);
+
+    /** Add to "routes" the numbers of all the routes whose prefix is a
+        prefix of "path", in increasing order.
+    */
+    void match(const std::string & path, Routes & routes) const;
+
+private:
+    struct Node {
+        std::string label;
+        std::vector<std::shared_ptr<Node> > children;
+        std::vector<int> routes;
+    };
+
+    std::shared_ptr<Node> root;
+    size_t numRoutes;
+};
+
+
 /*****************************************************************************/
 /* REST REQUEST ROUTER                                                       */
 /*****************************************************************************/
@@ -535,15 +585,22 @@ struct RestRequestRouter {
         route.router = res;
         route.router->description = description;
         route.extractObject = getExtractObject(res.get());
-        subRoutes.push_back(route);
+        addSubRoute(std::move(route));
         return *res;
     }
     
     OnProcessRequest rootHandler;
+
+    /// Routes tried in order by processRequest; use the add* methods to
+    /// modify them so that routeTree stays in sync
     std::vector<Route> subRoutes;
+    RouteTree routeTree;
     std::string description;
     bool terminal;
     Json::Value argHelp;
+
+private:
+    void addSubRoute(Route && route);
 };
 
 
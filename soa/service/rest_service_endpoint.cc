@@ -9,6 +9,7 @@
 #include "jml/utils/vector_utils.h"
 #include "jml/utils/pair_utils.h"
 #include "city.h"
+#include <atomic>
 
 using namespace std;
 
@@ -47,6 +48,8 @@ sendResponse(int responseCode,
 
     if (itl->http)
         itl->http->sendResponse(responseCode, response, contentType);
+    else if (itl->local)
+        itl->local(responseCode, response);
     else {
         std::vector<std::string> message;
         message.push_back(itl->zmqAddress);
@@ -81,6 +84,8 @@ sendResponse(int responseCode,
 
     if (itl->http)
         itl->http->sendResponse(responseCode, response, contentType);
+    else if (itl->local)
+        itl->local(responseCode, response.toString());
     else {
         std::vector<std::string> message;
         message.push_back(itl->zmqAddress);
@@ -113,6 +118,8 @@ sendErrorResponse(int responseCode,
             
     if (itl->http)
         itl->http->sendResponse(responseCode, error);
+    else if (itl->local)
+        itl->local(responseCode, error);
     else {
         std::vector<std::string> message;
         message.push_back(itl->zmqAddress);
@@ -142,6 +149,8 @@ sendErrorResponse(int responseCode, const Json::Value & error) const
 
     if (itl->http)
         itl->http->sendResponse(responseCode, error);
+    else if (itl->local)
+        itl->local(responseCode, error.toString());
     else {
         std::vector<std::string> message;
         message.push_back(itl->zmqAddress);
@@ -367,6 +376,27 @@ handleRequest(const ConnectionId & connection,
     }
 }
 
+void
+RestServiceEndpoint::
+handleLocalRequest(const RestRequest & request,
+                   const OnLocalResponse & onResponse)
+{
+    static std::atomic<uint64_t> localRequests(0);
+    std::string requestId = "local-" + std::to_string(++localRequests);
+
+    ConnectionId connection(onResponse, requestId, this);
+
+    try {
+        doHandleRequest(connection, request);
+    } catch (const std::exception & exc) {
+        // Over zeromq and http the caller would time out; here it would
+        // never hear back so it gets the error instead.
+        if (!connection.responseSent())
+            connection.sendErrorResponse(500, exc.what(), "text/plain");
+        else throw;
+    }
+}
+
 std::string
 RestServiceEndpoint::
 getHttpRequestId() const
@@ -78,9 +78,14 @@ struct RestServiceEndpoint: public MessageLoop {
 
     void shutdown();
 
+    /** Receives the response to a request made from within the process. */
+    typedef std::function<void (int responseCode,
+                                const std::string & body)> OnLocalResponse;
+
     /** Defines a connection: either a zeromq connection (identified by its
-        zeromq identifier) or an http connection (identified by its
-        connection handler object).
+        zeromq identifier), an http connection (identified by its
+        connection handler object) or an in-process connection (identified
+        by the function that gets the response).
     */
     struct ConnectionId {
         /// Don't initialize for now
@@ -104,6 +109,14 @@ struct RestServiceEndpoint: public MessageLoop {
         {
         }
 
+        /// Initialize for an in-process caller
+        ConnectionId(OnLocalResponse local,
+                     const std::string & requestId,
+                     RestServiceEndpoint * endpoint)
+            : itl(new Itl(std::move(local), requestId, endpoint))
+        {
+        }
+
         struct Itl {
             Itl(std::shared_ptr<HttpNamedEndpoint::RestConnectionHandler> http,
                 const std::string & requestId,
@@ -132,6 +145,20 @@ struct RestServiceEndpoint: public MessageLoop {
             {
             }
 
+            Itl(OnLocalResponse local,
+                const std::string & requestId,
+                RestServiceEndpoint * endpoint)
+                : requestId(requestId),
+                  http(0),
+                  local(std::move(local)),
+                  endpoint(endpoint),
+                  responseSent(false),
+                  startDate(Date::now()),
+                  chunkedEncoding(false),
+                  keepAlive(true)
+            {
+            }
+
             ~Itl()
             {
                 if (!responseSent)
@@ -141,6 +168,7 @@ struct RestServiceEndpoint: public MessageLoop {
             std::string zmqAddress;
             std::string requestId;
             std::shared_ptr<HttpNamedEndpoint::RestConnectionHandler> http;
+            OnLocalResponse local;
             RestServiceEndpoint * endpoint;
             bool responseSent;
             Date startDate;
@@ -293,6 +321,14 @@ struct RestServiceEndpoint: public MessageLoop {
 
         handleRequest(connection, request);
     }
+
+    /** Handle a request made from within the process, bypassing zeromq and
+        http.  The response is passed to onResponse from whichever thread
+        sends it, which may be this one if the request is handled
+        synchronously.
+    */
+    void handleLocalRequest(const RestRequest & request,
+                            const OnLocalResponse & onResponse);
     
     // Create a random request ID for an HTTP request
     std::string getHttpRequestId() const;
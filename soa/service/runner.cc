@@ -8,6 +8,7 @@
 
 #include <fcntl.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -102,7 +103,8 @@ std::string Runner::runnerHelper;
 Runner::
 Runner()
     : EpollLoop(nullptr),
-      closeStdin(false), runRequests_(0), activeRequest_(0), running_(false),
+      closeStdin(false), useSpawn(true),
+      runRequests_(0), activeRequest_(0), running_(false),
       startDate_(Date::negativeInfinity()), endDate_(startDate_),
       childPid_(-1), childStdinFd_(-1),
       statusRemaining_(sizeof(ProcessStatus))
@@ -529,54 +531,60 @@ doRunImpl(const vector<string> & command,
         tie(task_.stdErrFd, childFds.stdErr) = CreateStdPipe(false);
     }
 
-    ::flockfile(stdout);
-    ::flockfile(stderr);
-    ::fflush_unlocked(NULL);
-    task_.wrapperPid = fork();
-    int savedErrno = errno;
-    ::funlockfile(stderr);
-    ::funlockfile(stdout);
-    if (task_.wrapperPid == -1) {
-        throw ML::Exception(savedErrno, "Runner::run fork");
+    if (useSpawn) {
+        task_.wrapperPid = task_.spawnWrapper(command, childFds);
     }
-    else if (task_.wrapperPid == 0) {
-        try {
-            task_.runWrapper(command, childFds);
+    if (task_.wrapperPid == -1) {
+        /* Either spawning is disabled or it failed, in which case the fork
+           path reports the error through the status pipe. */
+        ::flockfile(stdout);
+        ::flockfile(stderr);
+        ::fflush_unlocked(NULL);
+        task_.wrapperPid = fork();
+        int savedErrno = errno;
+        ::funlockfile(stderr);
+        ::funlockfile(stdout);
+        if (task_.wrapperPid == -1) {
+            throw ML::Exception(savedErrno, "Runner::run fork");
         }
-        catch (...) {
-            ProcessStatus status;
-            status.state = ProcessState::STOPPED;
-            status.setErrorCodes(errno, LaunchError::SUBTASK_LAUNCH);
-            childFds.writeStatus(status);
+        else if (task_.wrapperPid == 0) {
+            try {
+                task_.runWrapper(command, childFds);
+            }
+            catch (...) {
+                ProcessStatus status;
+                status.state = ProcessState::STOPPED;
+                status.setErrorCodes(errno, LaunchError::SUBTASK_LAUNCH);
+                childFds.writeStatus(status);
 
-            exit(-1);
+                exit(-1);
+            }
         }
     }
-    else {
-        task_.statusState = ProcessState::LAUNCHING;
 
-        ML::set_file_flag(task_.statusFd, O_NONBLOCK);
-        auto statusCb = [&] (const epoll_event & event) {
-            handleChildStatus(event);
-        };
-        addFd(task_.statusFd, true, false, statusCb);
-        if (stdOutSink) {
-            ML::set_file_flag(task_.stdOutFd, O_NONBLOCK);
-            auto outputCb = [=] (const epoll_event & event) {
-                handleOutputStatus(event, task_.stdOutFd, stdOutSink_);
-            };
-            addFd(task_.stdOutFd, true, false, outputCb);
-        }
-        if (stdErrSink) {
-            ML::set_file_flag(task_.stdErrFd, O_NONBLOCK);
-            auto outputCb = [=] (const epoll_event & event) {
-                handleOutputStatus(event, task_.stdErrFd, stdErrSink_);
-            };
-            addFd(task_.stdErrFd, true, false, outputCb);
-        }
+    task_.statusState = ProcessState::LAUNCHING;
 
-        childFds.close();
+    ML::set_file_flag(task_.statusFd, O_NONBLOCK);
+    auto statusCb = [&] (const epoll_event & event) {
+        handleChildStatus(event);
+    };
+    addFd(task_.statusFd, true, false, statusCb);
+    if (stdOutSink) {
+        ML::set_file_flag(task_.stdOutFd, O_NONBLOCK);
+        auto outputCb = [=] (const epoll_event & event) {
+            handleOutputStatus(event, task_.stdOutFd, stdOutSink_);
+        };
+        addFd(task_.stdOutFd, true, false, outputCb);
+    }
+    if (stdErrSink) {
+        ML::set_file_flag(task_.stdErrFd, O_NONBLOCK);
+        auto outputCb = [=] (const epoll_event & event) {
+            handleOutputStatus(event, task_.stdErrFd, stdErrSink_);
+        };
+        addFd(task_.stdErrFd, true, false, outputCb);
     }
+
+    childFds.close();
 }
 
 bool
@@ -741,6 +749,49 @@ runWrapper(const vector<string> & command, ProcessFds & fds)
     throw ML::Exception("You are the King of Time!");
 }
 
+pid_t
+Runner::Task::
+spawnWrapper(const vector<string> & command, ProcessFds & fds)
+{
+    string runnerHelper;
+    try {
+        JML_TRACE_EXCEPTIONS(false);
+        runnerHelper = findRunnerHelper();
+    }
+    catch (const std::exception & exc) {
+        return -1;
+    }
+
+    size_t channelsSize = 4*2*4+3+1;
+    char channels[channelsSize];
+    fds.encodeToBuffer(channels, channelsSize);
+
+    vector<char *> argv;
+    argv.reserve(command.size() + 3);
+    argv.push_back((char *) runnerHelper.c_str());
+    argv.push_back(channels);
+    for (const string & arg: command) {
+        argv.push_back((char *) arg.c_str());
+    }
+    argv.push_back(nullptr);
+
+    /* The helper inherits the same descriptors, signal mask and environment
+       as with fork, but the address space of the parent is shared until the
+       exec instead of being copied. */
+    posix_spawnattr_t attrs;
+    ::posix_spawnattr_init(&attrs);
+#ifdef POSIX_SPAWN_USEVFORK
+    ::posix_spawnattr_setflags(&attrs, POSIX_SPAWN_USEVFORK);
+#endif
+
+    pid_t pid;
+    int res = ::posix_spawn(&pid, argv[0], nullptr, &attrs, &argv[0],
+                            environ);
+    ::posix_spawnattr_destroy(&attrs);
+
+    return (res == 0) ? pid : -1;
+}
+
 string
 Runner::Task::
 findRunnerHelper()
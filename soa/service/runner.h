@@ -118,6 +118,11 @@ struct Runner : public EpollLoop {
     /* Close stdin at launch time if stdin sink was not queried. */
     bool closeStdin;
 
+    /* Launch the subprocesses with posix_spawn rather than fork, which
+       avoids copying the page tables of the parent process and makes the
+       launch time independent of its size. Defaults to true. */
+    bool useSpawn;
+
     /** Run a program asynchronously, requiring to be attached to a
      * MessageLoop. */
     void run(const std::vector<std::string> & command,
@@ -211,6 +216,10 @@ private:
         void flushStdInBuffer();
         void runWrapper(const std::vector<std::string> & command,
                         ProcessFds & fds);
+        /* Returns the pid of the wrapper, or -1 when it could not be
+           spawned */
+        pid_t spawnWrapper(const std::vector<std::string> & command,
+                           ProcessFds & fds);
         std::string findRunnerHelper();
 
         void postTerminate(Runner & runner);
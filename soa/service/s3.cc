@@ -27,6 +27,8 @@
 #include "xml_helpers.h"
 
 #include <boost/iostreams/stream_buffer.hpp>
+#include <condition_variable>
+#include <deque>
 #include <exception>
 #include <thread>
 #include <unordered_map>
@@ -164,6 +166,24 @@ double
 S3Api::
 defaultBandwidthToServiceMbps = 20.0;
 
+int
+S3Api::
+defaultDownloadConcurrency = 8;
+
+int
+S3Api::
+defaultDownloadReadAhead = 2;
+
+int
+S3Api::
+defaultRangeAttempts = 3;
+
+size_t
+S3Api::
+defaultUploadBufferBytes = 256 * 1024 * 1024;
+
+constexpr size_t S3Api::MinPartSize;
+
 S3Api::Range S3Api::Range::Full(0);
 
 S3Api::
@@ -1270,6 +1290,307 @@ forEachObject(const std::string & uriPrefix,
     forEachObject(bucket, objectPrefix, onObject2, onSubdir, delimiter, depth, startAt);
 }
 
+namespace {
+
+/** One page of a listing. */
+struct ListingPage {
+    std::vector<S3Api::ObjectInfo> objects;
+    std::vector<std::string> prefixes;  ///< Common prefixes, with delimiter
+    std::string nextMarker;             ///< Empty for the last page
+};
+
+ListingPage
+listPage(const S3Api & api,
+         const std::string & bucket,
+         const std::string & prefix,
+         const std::string & delimiter,
+         const std::string & marker)
+{
+    using namespace tinyxml2;
+
+    RestParams queryParams;
+    if (prefix != "")
+        queryParams.push_back({"prefix", prefix});
+    if (delimiter != "")
+        queryParams.push_back({"delimiter", delimiter});
+    if (marker != "")
+        queryParams.push_back({"marker", marker});
+
+    auto listingResult = api.get(bucket, "/", S3Api::Range::Full, "",
+                                 {}, queryParams);
+    auto listingResultXml = listingResult.bodyXml();
+
+    ListingPage result;
+
+    auto foundObject
+        = XMLHandle(*listingResultXml)
+        .FirstChildElement("ListBucketResult")
+        .FirstChildElement("Contents")
+        .ToElement();
+    for (; foundObject;
+         foundObject = foundObject->NextSiblingElement("Contents"))
+        result.objects.emplace_back(foundObject);
+
+    auto foundDir
+        = XMLHandle(*listingResultXml)
+        .FirstChildElement("ListBucketResult")
+        .FirstChildElement("CommonPrefixes")
+        .ToElement();
+    for (; foundDir; foundDir = foundDir->NextSiblingElement("CommonPrefixes"))
+        result.prefixes.push_back(extract<string>(foundDir, "Prefix"));
+
+    string truncated
+        = extract<string>(listingResultXml, "ListBucketResult/IsTruncated");
+    if (truncated == "true") {
+        // NextMarker is only there when a delimiter was given; otherwise
+        // the listing carries on after the last key.
+        result.nextMarker
+            = extractDef<string>(listingResultXml,
+                                 "ListBucketResult/NextMarker", "");
+        if (result.nextMarker == "" && !result.objects.empty())
+            result.nextMarker = result.objects.back().key;
+        if (!result.prefixes.empty())
+            result.nextMarker = std::max(result.nextMarker,
+                                         result.prefixes.back());
+        ExcAssertNotEqual(result.nextMarker, marker);
+        if (result.nextMarker == "")
+            throw ML::Exception("truncated listing of " + bucket + "/"
+                                + prefix + " has no next marker");
+    }
+
+    return result;
+}
+
+} // file scope
+
+void
+S3Api::
+forEachObjectParallel(const std::string & bucket,
+                      const std::string & prefix,
+                      const OnObject & onObject,
+                      const ParallelListing & options) const
+{
+    /* A shard is a prefix whose keys are listed by one thread, page after
+       page.  The objects found while looking for the shards are put in
+       shards of their own that are already done, so that the shards
+       taken in order give the keys in order.
+    */
+    struct Shard {
+        Shard(const std::string & prefix = "", bool done = false)
+            : prefix(prefix), done(done)
+        {
+        }
+
+        std::string prefix;
+        std::deque<std::vector<ObjectInfo> > pages;
+        bool done;
+    };
+
+    vector<Shard> shards;
+
+    if (!options.shardPrefixes.empty()) {
+        vector<string> prefixes;
+        for (auto & p: options.shardPrefixes)
+            prefixes.push_back(prefix + p);
+        std::sort(prefixes.begin(), prefixes.end());
+        prefixes.erase(std::unique(prefixes.begin(), prefixes.end()),
+                       prefixes.end());
+        for (auto & p: prefixes)
+            shards.emplace_back(p);
+    }
+    else {
+        ExcCheck(options.delimiter != "",
+                 "parallel listing needs a delimiter or shard prefixes");
+
+        typedef std::pair<std::string, ObjectInfo> Found;
+        vector<Found> found;  // objects, or shards when the info is empty
+
+        std::function<void (const std::string &, int)> findShards
+            = [&] (const std::string & prefix, int depth)
+            {
+                string marker;
+                do {
+                    auto page = listPage(*this, bucket, prefix,
+                                         options.delimiter, marker);
+                    for (auto & info: page.objects)
+                        found.emplace_back(info.key, std::move(info));
+                    for (auto & p: page.prefixes) {
+                        if (depth > 1)
+                            findShards(p, depth - 1);
+                        else found.emplace_back(p, ObjectInfo());
+                    }
+                    marker = page.nextMarker;
+                } while (marker != "");
+            };
+
+        findShards(prefix, std::max(options.shardDepth, 1));
+
+        // A key outside of a prefix sorts either before or after all of its
+        // keys, so sorting them with the prefixes keeps the keys in order.
+        std::sort(found.begin(), found.end(),
+                  [] (const Found & f1, const Found & f2)
+                  {
+                      return f1.first < f2.first;
+                  });
+
+        for (auto & f: found) {
+            if (!f.second.exists) {
+                shards.emplace_back(f.first);
+                continue;
+            }
+            if (shards.empty() || !shards.back().done
+                || shards.back().pages.back().size() >= 1000) {
+                shards.emplace_back("", true);
+                shards.back().pages.emplace_back();
+            }
+            shards.back().pages.back().push_back(std::move(f.second));
+        }
+    }
+
+    std::mutex lock;
+    std::condition_variable cond;
+    size_t nextShard = 0;   // next shard to be listed by a thread
+    size_t current = 0;     // first shard not passed on yet
+    int buffered = 0;
+    bool stop = false;
+    std::exception_ptr error;
+
+    for (auto & s: shards)
+        buffered += s.pages.size();
+
+    auto runThread = [&] ()
+        {
+            for (;;) {
+                size_t i;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    while (nextShard < shards.size() && shards[nextShard].done)
+                        ++nextShard;
+                    if (stop || nextShard == shards.size())
+                        return;
+                    i = nextShard++;
+                }
+
+                try {
+                    string marker;
+                    do {
+                        {
+                            // The shard that is being waited on in ordered
+                            // mode always goes ahead.
+                            std::unique_lock<std::mutex> guard(lock);
+                            cond.wait(guard, [&] ()
+                                      {
+                                          return stop
+                                              || buffered < options.maxBufferedPages
+                                              || (options.ordered && i == current);
+                                      });
+                            if (stop)
+                                return;
+                        }
+
+                        auto page = listPage(*this, bucket, shards[i].prefix,
+                                             NO_SUBDIRS, marker);
+                        marker = page.nextMarker;
+
+                        std::unique_lock<std::mutex> guard(lock);
+                        if (!page.objects.empty()) {
+                            shards[i].pages.emplace_back(std::move(page.objects));
+                            ++buffered;
+                        }
+                        shards[i].done = marker == "";
+                        cond.notify_all();
+                    } while (marker != "");
+                } catch (...) {
+                    std::unique_lock<std::mutex> guard(lock);
+                    if (!error)
+                        error = std::current_exception();
+                    stop = true;
+                    cond.notify_all();
+                    return;
+                }
+            }
+        };
+
+    int numThreads = std::max(1, std::min<int>(options.numThreads,
+                                               shards.size()));
+    vector<std::thread> threads;
+
+    auto stopThreads = [&] ()
+        {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                stop = true;
+                cond.notify_all();
+            }
+            for (auto & t: threads)
+                t.join();
+            threads.clear();
+        };
+
+    /* Takes the next page to be passed on, or returns false once all of
+       the shards are done.  Called with the lock held.
+    */
+    auto nextPage = [&] (std::unique_lock<std::mutex> & guard,
+                         std::vector<ObjectInfo> & page) -> bool
+        {
+            for (;;) {
+                if (error)
+                    return false;
+
+                while (current < shards.size()
+                       && shards[current].done
+                       && shards[current].pages.empty()) {
+                    ++current;
+                    cond.notify_all();
+                }
+                if (current == shards.size())
+                    return false;
+
+                size_t end = options.ordered ? current + 1 : shards.size();
+                for (size_t i = current;  i < end;  ++i) {
+                    auto & pages = shards[i].pages;
+                    if (pages.empty())
+                        continue;
+                    page = std::move(pages.front());
+                    pages.pop_front();
+                    --buffered;
+                    cond.notify_all();
+                    return true;
+                }
+
+                cond.wait(guard);
+            }
+        };
+
+    try {
+        for (int i = 0;  i < numThreads;  ++i)
+            threads.emplace_back(runThread);
+
+        std::unique_lock<std::mutex> guard(lock);
+        std::vector<ObjectInfo> page;
+        while (nextPage(guard, page)) {
+            guard.unlock();
+            for (auto & info: page) {
+                ExcAssertEqual(info.key.find(prefix), 0);
+                string basename(info.key, prefix.length());
+                if (!onObject(prefix, basename, info, 1)) {
+                    stopThreads();
+                    return;
+                }
+            }
+            guard.lock();
+        }
+    } catch (...) {
+        stopThreads();
+        throw;
+    }
+
+    stopThreads();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
 S3Api::ObjectInfo
 S3Api::
 getObjectInfo(const std::string & bucket, const std::string & object,
@@ -1480,6 +1801,46 @@ getPublicUri(const std::string & bucket,
     return protocol + "://" + bucket + ".s3.amazonaws.com/" + object;
 }
 
+namespace {
+
+/* Get a range of an object, retrying the whole range when the response is
+   not a complete one, as happens when the retries made by performSync are
+   exhausted or when a server returns a short body. */
+S3Api::Response
+getRange(const S3Api & api,
+         const std::string & bucket, const std::string & object,
+         const S3Api::Range & range)
+{
+    for (int attempt = 1;; attempt++) {
+        try {
+            auto partResult = api.get(bucket, "/" + object, range);
+            if (!(partResult.code_ == 206 || partResult.code_ == 200)) {
+                throw ML::Exception("http error "
+                                    + to_string(partResult.code_)
+                                    + " while getting part "
+                                    + partResult.bodyXmlStr());
+            }
+            if (partResult.body().size() != range.size) {
+                throw ML::Exception("got %zd bytes instead of %zd",
+                                    partResult.body().size(),
+                                    (size_t) range.size);
+            }
+            return partResult;
+        }
+        catch (const std::exception & exc) {
+            if (attempt >= S3Api::defaultRangeAttempts)
+                throw;
+            ::fprintf(stderr,
+                      "S3 range %zd-%zd of %s failed (attempt %d): %s\n",
+                      (size_t) range.offset, (size_t) range.endPos(),
+                      object.c_str(), attempt, exc.what());
+            ML::sleep(attempt);
+        }
+    }
+}
+
+} // file scope
+
 void
 S3Api::
 download(const std::string & uri,
@@ -1504,11 +1865,6 @@ download(const std::string & bucket,
     ObjectInfo info = getObjectInfo(bucket, object);
     size_t chunkSize = 128 * 1024 * 1024;  // 128MB probably good
 
-    struct Part {
-        uint64_t offset;
-        uint64_t size;
-    };
-
     if (endOffset == -1)
         endOffset = info.size;
 
@@ -1516,15 +1872,15 @@ download(const std::string & bucket,
 
     vector<S3Api::Range> parts;
 
-    for (uint64_t offset = 0;  offset < endOffset;  offset += chunkSize) {
+    for (uint64_t offset = startOffset;  offset < endOffset;
+         offset += chunkSize) {
         parts.emplace_back(offset, std::min<ssize_t>(endOffset - offset, chunkSize));
     }
 
     //cerr << "getting in " << parts.size() << " parts" << endl;
 
-    // uint64_t bytesDone = 0;
-    Date start;
-    bool failed = false;
+    atomic<bool> failed(false);
+    exception_ptr lastExc;
 
     auto doPart = [&] (int i)
         {
@@ -1534,34 +1890,25 @@ download(const std::string & bucket,
             // cerr << "part " << i << " with " << part.size << " bytes"
             //      << " and offset : " << part.offset << endl;
 
-            auto partResult = get(bucket, "/" + object, part);
-            if (!(partResult.code_ == 206 || partResult.code_ == 200)) {
-                cerr << "error getting part " << i << ": "
-                     << partResult.bodyXmlStr() << endl;
-                failed = true;
-                return;
-            }
-
-            ExcAssertEqual(partResult.body_.size(), part.size);
-
-            onChunk(partResult.body_.c_str(),
-                    part.size,
-                    i,
-                    part.offset,
-                    info.size);
+            try {
+                auto partResult = getRange(*this, bucket, object, part);
 
-            // ML::atomic_add(bytesDone, part.size);
-            // double seconds = Date::now().secondsSince(start);
-            // cerr << "downloaded " << bytesDone / 1024 / 1024 << " MB in "
-            // << seconds << " s at "
-            // << bytesDone / 1024.0 / 1024 / seconds
-            // << " MB/second" << endl;
+                onChunk(partResult.body_.c_str(),
+                        part.size,
+                        i,
+                        part.offset,
+                        info.size);
+            }
+            catch (const std::exception & exc) {
+                cerr << "error getting part " << i << ": " << exc.what()
+                     << endl;
+                if (!failed.exchange(true))
+                    lastExc = current_exception();
+            }
         };
 
     int currentPart = 0;
 
-    start = Date::now();
-
     auto doPartThread = [&] ()
         {
             for (;;) {
@@ -1573,13 +1920,14 @@ download(const std::string & bucket,
         };
 
     boost::thread_group tg;
-    for (unsigned i = 0;  i < 16;  ++i)
+    int numThreads = std::min<int>(defaultDownloadConcurrency, parts.size());
+    for (int i = 0;  i < numThreads;  ++i)
         tg.create_thread(doPartThread);
 
     tg.join_all();
 
     if (failed)
-        throw ML::Exception("Failed to get part");
+        rethrow_exception(lastExc);
 }
 
 /**
@@ -1635,15 +1983,8 @@ struct StreamingDownloadSource {
         impl->info = impl->owner->getObjectInfo(urlStr);
         impl->baseChunkSize = 1024 * 1024;  // start with 1MB and ramp up
 
-        int numThreads = 1;
-        if (impl->info.size > 1024 * 1024)
-            numThreads = 2;
-        if (impl->info.size > 16 * 1024 * 1024)
-            numThreads = 3;
-        if (impl->info.size > 256 * 1024 * 1024)
-            numThreads = 5;
-        
-        impl->start(numThreads);
+        impl->start(S3Api::defaultDownloadConcurrency,
+                    S3Api::defaultDownloadReadAhead);
     }
 
     typedef char char_type;
@@ -1714,7 +2055,7 @@ struct StreamingDownloadSource {
             numThreads = 0;
         }
 
-        void start(int nThreads)
+        void start(int maxThreads, int readAhead)
         {
             // Maximum chunk size is what we can do in 3 seconds
             maxChunkSize = (owner->bandwidthToServiceMbps
@@ -1725,10 +2066,18 @@ struct StreamingDownloadSource {
             // Limit each chunk to 1% of system memory
             maxChunkSize = std::min(maxChunkSize, sysMemory / 100);
             //cerr << "maxChunkSize = " << maxChunkSize << endl;
-            numThreads = nThreads;
+
+            /* one thread per chunk for a small object, up to maxThreads */
+            numThreads = 0;
+            uint64_t offset = 0;
+            while (numThreads < maxThreads
+                   && (numThreads == 0 || offset < info.size)) {
+                offset += getChunkSize(numThreads);
+                numThreads++;
+            }
 
             for (int i = 0; i < numThreads; i++) {
-                threadQueues.emplace_back(2);
+                threadQueues.emplace_back(readAhead);
             }
             
             /* ensure that the queues are ready before the threads are
@@ -1837,21 +2186,14 @@ struct StreamingDownloadSource {
                     }
 
                     auto partResult
-                        = owner->get(bucket, "/" + object,
-                                     S3Api::Range(start, chunkSize));
-                    if (!(partResult.code_ == 206 || partResult.code_ == 200)) {
-                        throw ML::Exception("http error "
-                                            + to_string(partResult.code_)
-                                            + " while getting part "
-                                            + partResult.bodyXmlStr());
-                    }
+                        = getRange(*owner, bucket, object,
+                                   S3Api::Range(start, chunkSize));
                     // it can sometimes happen that a file changes during download
                     // i.e it is being overwritten. Make sure we check for this condition
                     // and throw an appropriate exception
                     string chunkEtag = partResult.getHeader("etag") ;
                     if(chunkEtag != info.etag)
                         throw ML::Exception("chunk etag %s not equal to file etag %s: file <%s> has changed during download!!", chunkEtag.c_str(), info.etag.c_str(), object.c_str());
-                    ExcAssert(partResult.body().size() == chunkSize);
 
                     while (true) {
                         if (shutdown || lastExc) {
@@ -1941,8 +2283,8 @@ struct StreamingUploadSource {
 
     struct Impl {
         Impl()
-            : offset(0), chunkIndex(0), shutdown(false),
-              chunks(16)
+            : offset(0), chunkSize(0), chunkIndex(0), shutdown(false),
+              maxBufferedBytes(0), bufferedBytes(0), uploadRate(0.0)
         {
         }
 
@@ -1985,6 +2327,8 @@ struct StreamingUploadSource {
             Chunk & operator = (Chunk && other)
                 noexcept
             {
+                if (this->data)
+                    delete[] this->data;
                 this->offset = other.offset;
                 this->size = other.size;
                 this->capacity = other.capacity;
@@ -2020,6 +2364,12 @@ struct StreamingUploadSource {
                 return todo;
             }
 
+            void release()
+            {
+                delete[] data;
+                data = nullptr;
+            }
+
             char * data;
             size_t size;
             size_t capacity;
@@ -2032,8 +2382,19 @@ struct StreamingUploadSource {
         };
 
         Chunk current;
-        
-        RingBufferSWMR<Chunk> chunks;
+
+        /* Chunks waiting for an upload thread.  bufferedBytes is the memory
+           held by the chunk being written, the queued ones and the ones
+           being uploaded; the writer waits in flush() for it to go under
+           maxBufferedBytes, so that a slow upload slows down the writer
+           instead of using up the memory.  uploadRate is the average rate of
+           the part uploads, in bytes per second per thread. */
+        std::mutex chunksLock;
+        std::condition_variable chunksCond;
+        std::deque<Chunk> chunks;
+        size_t maxBufferedBytes;
+        size_t bufferedBytes;
+        double uploadRate;
 
         std::mutex etagsLock;
         std::vector<std::string> etags;
@@ -2057,15 +2418,28 @@ struct StreamingUploadSource {
             //cerr << "uploadId = " << uploadId << " with " << metadata.numThreads 
             //<< "threads!!! " << endl;
 
+            if (metadata.numThreads < 1)
+                metadata.numThreads = 1;
+            maxBufferedBytes = metadata.maxBufferedBytes;
+            if (!maxBufferedBytes)
+                maxBufferedBytes = S3Api::defaultUploadBufferBytes;
+
             startDate = Date::now();
             for (unsigned i = 0;  i < metadata.numThreads;  ++i)
                 tg.create_thread(boost::bind<void>(&Impl::runThread, this));
+
+            chunkSize = std::min(chunkSize, maxChunkSize());
+            bufferedBytes = chunkSize;
             current.init(0, chunkSize, 0);
         }
 
         void stop()
         {
-            shutdown = true;
+            {
+                std::unique_lock<std::mutex> guard(chunksLock);
+                shutdown = true;
+            }
+            chunksCond.notify_all();
             tg.join_all();
         }
 
@@ -2078,7 +2452,9 @@ struct StreamingUploadSource {
             offset += done;
             if (done < n) {
                 flush();
-                done += current.append(s + done, n - done);
+                size_t more = current.append(s + done, n - done);
+                offset += more;
+                done += more;
             }
 
             //cerr << "writing " << n << " characters returned "
@@ -2090,17 +2466,60 @@ struct StreamingUploadSource {
             return done;
         }
 
-        void flush()
+        /* Largest chunk that leaves room in the buffer for one chunk per
+           upload thread plus the one being written. */
+        size_t maxChunkSize() const
         {
-            if (current.size == 0) return;
-            chunks.push(std::move(current));
-            ++chunkIndex;
+            return std::max(maxBufferedBytes / (metadata.numThreads + 1),
+                            S3Api::MinPartSize);
+        }
+
+        /* Size of the next chunk.  The schedule of chunkSize lets files of
+           up to a few hundred GB fit within the 10000 parts of a multipart
+           upload; on top of that, the chunks grow so that each takes about
+           TargetPartSeconds to upload, which amortizes the cost of a request
+           over more data on fast links. */
+        size_t nextChunkSize()
+        {
+            static constexpr double TargetPartSeconds = 4.0;
 
             // Get bigger for bigger files
             if (chunkIndex % 5 == 0 && chunkSize < 64 * 1024 * 1024)
                 chunkSize *= 2;
 
-            current.init(offset, chunkSize, chunkIndex);
+            size_t result = chunkSize;
+            if (uploadRate > 0.0)
+                result = std::max<size_t>(result,
+                                          uploadRate * TargetPartSeconds);
+
+            return std::min(result, maxChunkSize());
+        }
+
+        void flush()
+        {
+            if (current.size == 0) return;
+
+            std::unique_lock<std::mutex> guard(chunksLock);
+            // Give back the part of the chunk that was never written to
+            bufferedBytes -= current.capacity - current.size;
+            chunks.emplace_back(std::move(current));
+            ++chunkIndex;
+            chunksCond.notify_all();
+
+            size_t size = nextChunkSize();
+
+            // Back pressure: wait for the uploads to free enough memory.
+            // There is always room for a single chunk, however large.
+            while (bufferedBytes > 0 && bufferedBytes + size > maxBufferedBytes
+                   && !exc)
+                chunksCond.wait(guard);
+            bufferedBytes += size;
+            guard.unlock();
+
+            if (exc)
+                std::rethrow_exception(exc);
+
+            current.init(offset, size, chunkIndex);
         }
 
         void finish()
@@ -2110,14 +2529,20 @@ struct StreamingUploadSource {
             // cerr << "pushing last chunk " << chunkIndex << endl;
             flush();
 
-            if (!chunkIndex) {
-                chunks.push(std::move(current));
-                ++chunkIndex;
-            }
+            {
+                std::unique_lock<std::mutex> guard(chunksLock);
+                if (!chunkIndex) {
+                    bufferedBytes -= current.capacity;
+                    chunks.emplace_back(std::move(current));
+                    ++chunkIndex;
+                    chunksCond.notify_all();
+                }
 
-            //cerr << "waiting for everything to stop" << endl;
-            chunks.waitUntilEmpty();
-            //cerr << "empty" << endl;
+                //cerr << "waiting for everything to stop" << endl;
+                while (!chunks.empty())
+                    chunksCond.wait(guard);
+                //cerr << "empty" << endl;
+            }
             stop();
             //cerr << "stopped" << endl;
 
@@ -2151,45 +2576,82 @@ struct StreamingUploadSource {
 
         void runThread()
         {
-            while (!shutdown) {
+            for (;;) {
                 Chunk chunk;
-                if (chunks.tryPop(chunk, 0.01)) {
-                    if (exc)
+                {
+                    std::unique_lock<std::mutex> guard(chunksLock);
+                    while (chunks.empty() && !shutdown)
+                        chunksCond.wait(guard);
+                    if (shutdown)
                         return;
-                    try {
-                        //cerr << "got chunk " << chunk.index
-                        //     << " with " << chunk.size << " bytes at index "
-                        //     << chunk.index << endl;
-
-                        // Upload the data
-                        string md5 = md5HashToHex(chunk.data, chunk.size);
-
-                        auto putResult = owner->put(bucket, "/" + object,
-                                                    ML::format("partNumber=%d&uploadId=%s",
-                                                               chunk.index + 1, uploadId),
-                                                    {}, {},
-                                                    S3Api::Content(chunk.data,
-                                                                   chunk.size,
-                                                                   md5));
-                        if (putResult.code_ != 200) {
-                            cerr << putResult.bodyXmlStr() << endl;
-
-                            throw ML::Exception("put didn't work: %d", (int)putResult.code_);
-                        }
-                        string etag = putResult.getHeader("etag");
-                        // cerr << "successfully uploaded part " << chunk.index
-                        //     << " with etag " << etag << endl;
-
-                        std::unique_lock<std::mutex> guard(etagsLock);
-                        while (etags.size() <= chunk.index)
-                            etags.push_back("");
-                        etags[chunk.index] = etag;
-                    } catch (...) {
-                        // Capture exception to be thrown later
-                        exc = std::current_exception();
-                        onException();
-                    }
+                    chunk = std::move(chunks.front());
+                    chunks.pop_front();
                 }
+                chunksCond.notify_all();
+
+                // Once an upload has failed, the remaining chunks are
+                // only drained to unblock the writer
+                if (!exc)
+                    uploadChunk(chunk);
+
+                size_t size = chunk.size;
+                chunk.release();
+                {
+                    std::unique_lock<std::mutex> guard(chunksLock);
+                    bufferedBytes -= size;
+                }
+                chunksCond.notify_all();
+            }
+        }
+
+        void uploadChunk(const Chunk & chunk)
+        {
+            try {
+                //cerr << "got chunk " << chunk.index
+                //     << " with " << chunk.size << " bytes at index "
+                //     << chunk.index << endl;
+
+                Date before = Date::now();
+
+                // Upload the data
+                string md5 = md5HashToHex(chunk.data, chunk.size);
+
+                auto putResult = owner->put(bucket, "/" + object,
+                                            ML::format("partNumber=%d&uploadId=%s",
+                                                       chunk.index + 1, uploadId),
+                                            {}, {},
+                                            S3Api::Content(chunk.data,
+                                                           chunk.size,
+                                                           md5));
+                if (putResult.code_ != 200) {
+                    cerr << putResult.bodyXmlStr() << endl;
+
+                    throw ML::Exception("put didn't work: %d", (int)putResult.code_);
+                }
+                string etag = putResult.getHeader("etag");
+                // cerr << "successfully uploaded part " << chunk.index
+                //     << " with etag " << etag << endl;
+
+                double elapsed = Date::now().secondsSince(before);
+                if (elapsed > 0.0) {
+                    double rate = chunk.size / elapsed;
+                    std::unique_lock<std::mutex> guard(chunksLock);
+                    uploadRate = (uploadRate > 0.0
+                                  ? 0.75 * uploadRate + 0.25 * rate : rate);
+                }
+
+                std::unique_lock<std::mutex> guard(etagsLock);
+                while (etags.size() <= chunk.index)
+                    etags.push_back("");
+                etags[chunk.index] = etag;
+            } catch (...) {
+                // Capture exception to be thrown later
+                {
+                    std::unique_lock<std::mutex> guard(chunksLock);
+                    exc = std::current_exception();
+                }
+                chunksCond.notify_all();
+                onException();
             }
         }
     };
@@ -2385,6 +2847,16 @@ void S3Api::setDefaultBandwidthToServiceMbps(double mbps){
     S3Api::defaultBandwidthToServiceMbps = mbps;
 }
 
+void
+S3Api::
+setDefaultDownloadConcurrency(int concurrency, int readAhead)
+{
+    ExcCheckGreater(concurrency, 0, "invalid download concurrency");
+    ExcCheckGreater(readAhead, 0, "invalid download read-ahead");
+    defaultDownloadConcurrency = concurrency;
+    defaultDownloadReadAhead = readAhead;
+}
+
 HttpRestProxy S3Api::proxy;
 
 S3Api::Redundancy S3Api::defaultRedundancy = S3Api::REDUNDANCY_STANDARD;
@@ -2518,6 +2990,9 @@ struct RegisterS3Handler {
                 {
                     md.numThreads = std::stoi(value);
                 }
+                else if (name == "upload-buffer-mb") {
+                    md.maxBufferedBytes = std::stoull(value) * 1024 * 1024;
+                }
                 else {
                     cerr << "warning: skipping unknown S3 option "
                          << name << "=" << value << endl;
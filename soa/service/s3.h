@@ -67,6 +67,36 @@ struct S3Api : public AwsApi {
     */
     static double defaultBandwidthToServiceMbps;
 
+    /** Maximum number of ranges of an object that are downloaded in
+        parallel by the streaming downloads and by download().  Default is
+        8.
+    */
+    static int defaultDownloadConcurrency;
+
+    /** Number of downloaded ranges that each download thread of a streaming
+        download can keep ahead of the reader.  Default is 2.
+    */
+    static int defaultDownloadReadAhead;
+
+    /** Number of attempts made for each range of a download before giving
+        up on the whole download.  Errors that are retried at the HTTP level
+        are not counted.  Default is 3.
+    */
+    static int defaultRangeAttempts;
+
+    static void setDefaultDownloadConcurrency(int concurrency,
+                                              int readAhead = 2);
+
+    /** Maximum number of bytes that a streaming upload holds in memory,
+        for the part being written and those waiting for or being uploaded
+        by its threads.  Writes block while it is reached.  Used when the
+        metadata of the upload doesn't set one.  Default is 256MB.
+    */
+    static size_t defaultUploadBufferBytes;
+
+    /** Smallest size of all but the last part of a multipart upload. */
+    static constexpr size_t MinPartSize = 5 * 1024 * 1024;
+
     S3Api();
 
     /** Set up the API to called with the given credentials. */
@@ -244,14 +274,16 @@ struct S3Api : public AwsApi {
         ObjectMetadata()
             : redundancy(REDUNDANCY_DEFAULT),
               serverSideEncryption(SSE_NONE),
-              numThreads(8)
+              numThreads(8),
+              maxBufferedBytes(0)
         {
         }
 
         ObjectMetadata(const Redundancy & redundancy)
             : redundancy(redundancy),
               serverSideEncryption(SSE_NONE),
-              numThreads(8)
+              numThreads(8),
+              maxBufferedBytes(0)
         {
         }
 
@@ -264,7 +296,14 @@ struct S3Api : public AwsApi {
         std::string contentEncoding;
         std::map<std::string, std::string> metadata;
         std::string acl;
+
+        /** Number of parts uploaded in parallel by a streaming upload. */
         unsigned int numThreads;
+
+        /** Memory bound of a streaming upload; 0 means
+            defaultUploadBufferBytes.
+        */
+        size_t maxBufferedBytes;
     };
 
     /** Signed request that can be executed. */
@@ -465,6 +504,56 @@ struct S3Api : public AwsApi {
     */
     static const std::string NO_SUBDIRS;
 
+    /** Options for forEachObjectParallel. */
+    struct ParallelListing {
+        ParallelListing()
+            : numThreads(defaultDownloadConcurrency),
+              ordered(false), delimiter("/"), shardDepth(1),
+              maxBufferedPages(64)
+        {
+        }
+
+        int numThreads;         ///< Number of shards listed at once
+        bool ordered;           ///< Call onObject in key order
+
+        /** Shards are found by listing the prefixes under the delimiter,
+            down to shardDepth levels below the prefix.
+        */
+        std::string delimiter;
+        int shardDepth;
+
+        /** Explicit shards, appended to the prefix, instead of the ones
+            found with the delimiter.  They must cover all of the keys to
+            be listed (for example the 16 hex digits of hashed keys); the
+            keys that start with none of them are not listed.
+        */
+        std::vector<std::string> shardPrefixes;
+
+        /** Pages of up to 1000 objects that have been fetched but not yet
+            passed to onObject.  Bounds the memory when the callback is
+            slower than the listing.
+        */
+        int maxBufferedPages;
+    };
+
+    /** Call onObject for each object under the prefix, like forEachObject
+        with NO_SUBDIRS, but with the key space split into shards whose
+        pages are fetched and parsed by numThreads threads at once.
+
+        onObject is always called from the calling thread, one object at
+        a time, with the prefix of the listing and a depth of 1.  In
+        unordered mode the objects are passed on as their pages arrive;
+        in ordered mode they are passed in key order, the objects of a
+        shard being held until the shards before it are done.  Listing
+        stops as soon as onObject returns false.  An error in one of the
+        threads stops the listing and is rethrown.
+    */
+    void forEachObjectParallel(const std::string & bucket,
+                               const std::string & prefix,
+                               const OnObject & onObject,
+                               const ParallelListing & options
+                                   = ParallelListing()) const;
+
     /** Does the object exist? */
     ObjectInfo tryGetObjectInfo(const std::string & bucket,
                                 const std::string & object,
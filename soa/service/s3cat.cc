@@ -30,6 +30,8 @@ int main(int argc, char* argv[])
     vector<string> outputFiles;
     string s3KeyId;
     string s3Key;
+    int downloadConcurrency = S3Api::defaultDownloadConcurrency;
+    int readAhead = S3Api::defaultDownloadReadAhead;
     
     po::options_description desc("Main options");
     desc.add_options()
@@ -37,6 +39,8 @@ int main(int argc, char* argv[])
         ("output-uri,o", po::value(&outputFiles), "Output files/uris (can have multiple file/s3://bucket/object)")
         ("s3-key-id,I", po::value<string>(&s3KeyId), "S3 key id")
         ("s3-key,K", po::value<string>(&s3Key), "S3 key")
+        ("download-concurrency", po::value<int>(&downloadConcurrency), "Number of ranges of an S3 object downloaded in parallel (default: 8)")
+        ("read-ahead", po::value<int>(&readAhead), "Number of ranges buffered ahead by each download thread (default: 2)")
         ("help,h", "Produce help message");
     
     po::positional_options_description pos;
@@ -67,6 +71,8 @@ int main(int argc, char* argv[])
     if (outputFiles.empty())
         outputFiles.push_back("-");
 
+    S3Api::setDefaultDownloadConcurrency(downloadConcurrency, readAhead);
+
     if (!s3KeyId.empty()) {
         for (auto f: outputFiles){
             if(f.substr(0, 5) == "s3://"){
@@ -29,6 +29,8 @@ int main(int argc, char* argv[])
     string localFile;
     string s3KeyId;
     string s3Key;
+    int downloadConcurrency = S3Api::defaultDownloadConcurrency;
+    int readAhead = S3Api::defaultDownloadReadAhead;
     
     string compression = "none";
     
@@ -41,6 +43,8 @@ int main(int argc, char* argv[])
         ("s3-key-id,I", po::value<string>(&s3KeyId), "S3 access id")
         ("s3-key,K", po::value<string>(&s3Key), "S3 access id key")
         ("compression,c", po::value<string>(&compression), "Compression to apply (default: none, valid: auto,gz,bz2,xz")
+        ("download-concurrency", po::value<int>(&downloadConcurrency), "Number of ranges of an S3 object downloaded in parallel (default: 8)")
+        ("read-ahead", po::value<int>(&readAhead), "Number of ranges buffered ahead by each download thread (default: 2)")
         ("help,h", "Produce help message");
     
     po::positional_options_description pos;
@@ -76,6 +80,8 @@ int main(int argc, char* argv[])
     if (s3KeyId != "")
         registerS3Buckets(s3KeyId, s3Key);
 
+    S3Api::setDefaultDownloadConcurrency(downloadConcurrency, readAhead);
+
     ML::filter_istream in(inputUri, ios::in, compression);
 
     std::vector<filter_ostream> streams;
@@ -0,0 +1,219 @@
+/* scope_profiler.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Hierarchical profiler of nested scopes, cheap enough for the hot paths.
+*/
+
+#include "scope_profiler.h"
+#include "service_base.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* SCOPE PROFILER                                                            */
+/*****************************************************************************/
+
+/** Node of the tree of scopes of a thread.  Only the thread writes to it;
+    the counters are atomic so that others can read them, but they are only
+    updated with relaxed loads and stores.
+*/
+struct ScopeProfiler::Node {
+    Node(const char * name, Node * parent)
+        : name(name), parent(parent), calls(0), ticks(0),
+          allocs(0), allocBytes(0), firstChild(0), nextSibling(0)
+    {
+    }
+
+    const char * name;
+    Node * parent;
+
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> ticks;
+    std::atomic<uint64_t> allocs;
+    std::atomic<uint64_t> allocBytes;
+
+    /** Children are pushed at the front with a release store, so a reader
+        that sees a child also sees its fields.
+    */
+    std::atomic<Node *> firstChild;
+    Node * nextSibling;
+
+    Node * child(const char * childName)
+    {
+        for (Node * child = firstChild.load(std::memory_order_relaxed);
+             child;  child = child->nextSibling)
+            if (child->name == childName)
+                return child;
+
+        Node * child = new Node(childName, this);
+        child->nextSibling = firstChild.load(std::memory_order_relaxed);
+        firstChild.store(child, std::memory_order_release);
+        return child;
+    }
+
+    static void add(std::atomic<uint64_t> & counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value,
+                      std::memory_order_relaxed);
+    }
+};
+
+namespace {
+
+/** Tree of a thread.  The trees are never freed, as scopes may still be
+    left while the process exits and the counts of the threads that are gone
+    still count.
+*/
+struct ThreadTree {
+    ThreadTree()
+        : root("", nullptr), current(&root)
+    {
+    }
+
+    ScopeProfiler::Node root;
+    ScopeProfiler::Node * current;
+};
+
+struct Registry {
+    std::mutex lock;
+    std::vector<ThreadTree *> trees;
+
+    /** Totals at the last record(), to turn them into rates. */
+    std::map<std::string, ScopeProfiler::Totals> recorded;
+};
+
+Registry & registry()
+{
+    static Registry * result = new Registry();
+    return *result;
+}
+
+thread_local ThreadTree * threadTree = nullptr;
+
+ThreadTree * getThreadTree()
+{
+    if (JML_UNLIKELY(!threadTree)) {
+        threadTree = new ThreadTree();
+        Registry & reg = registry();
+        std::unique_lock<std::mutex> guard(reg.lock);
+        reg.trees.push_back(threadTree);
+    }
+    return threadTree;
+}
+
+void accumulate(const ScopeProfiler::Node & node, const std::string & path,
+                std::map<std::string, ScopeProfiler::Totals> & result)
+{
+    for (const ScopeProfiler::Node * child
+             = node.firstChild.load(std::memory_order_acquire);
+         child;  child = child->nextSibling) {
+        std::string childPath
+            = path.empty() ? child->name : path + "." + child->name;
+
+        ScopeProfiler::Totals & totals = result[childPath];
+        totals.calls += child->calls.load(std::memory_order_relaxed);
+        totals.ticks += child->ticks.load(std::memory_order_relaxed);
+        totals.allocs += child->allocs.load(std::memory_order_relaxed);
+        totals.allocBytes += child->allocBytes.load(std::memory_order_relaxed);
+
+        accumulate(*child, childPath, result);
+    }
+}
+
+} // file scope
+
+std::atomic<bool> ScopeProfiler::enabled_(true);
+
+void
+ScopeProfiler::
+setEnabled(bool enabled)
+{
+    enabled_ = enabled;
+}
+
+ScopeProfiler::Node *
+ScopeProfiler::
+enter(const char * name)
+{
+    ThreadTree * tree = getThreadTree();
+    Node * node = tree->current->child(name);
+    tree->current = node;
+    return node;
+}
+
+void
+ScopeProfiler::
+leave(Node * node, uint64_t startTicks,
+      const AllocationCounters & startAllocs)
+{
+    uint64_t ticks = ML::ticks();
+    AllocationCounters allocs = AllocationCounters::thisThread();
+    Node::add(node->calls, 1);
+    Node::add(node->ticks, ticks > startTicks ? ticks - startTicks : 0);
+    Node::add(node->allocs, allocs.allocs - startAllocs.allocs);
+    Node::add(node->allocBytes, allocs.bytes - startAllocs.bytes);
+    threadTree->current = node->parent;
+}
+
+std::map<std::string, ScopeProfiler::Totals>
+ScopeProfiler::
+totals()
+{
+    Registry & reg = registry();
+    std::unique_lock<std::mutex> guard(reg.lock);
+
+    std::map<std::string, Totals> result;
+    for (ThreadTree * tree: reg.trees)
+        accumulate(tree->root, "", result);
+    return result;
+}
+
+void
+ScopeProfiler::
+record(const EventRecorder & recorder, const std::string & prefix)
+{
+    auto current = totals();
+
+    std::map<std::string, Totals> previous;
+    {
+        Registry & reg = registry();
+        std::unique_lock<std::mutex> guard(reg.lock);
+        previous.swap(reg.recorded);
+        reg.recorded = current;
+    }
+
+    for (auto & entry: current) {
+        const Totals & before = previous[entry.first];
+        uint64_t calls = entry.second.calls - before.calls;
+        if (!calls) continue;
+
+        double us = (entry.second.ticks - before.ticks)
+            * ML::seconds_per_tick * 1000000.0;
+
+        recorder.recordCount(calls, prefix + "." + entry.first + ".calls");
+        recorder.recordCount(us, prefix + "." + entry.first + ".us");
+
+        uint64_t allocs = entry.second.allocs - before.allocs;
+        if (!allocs) continue;
+        uint64_t allocBytes = entry.second.allocBytes - before.allocBytes;
+
+        recorder.recordCount(allocs, prefix + "." + entry.first + ".allocs");
+        recorder.recordCount(allocBytes,
+                             prefix + "." + entry.first + ".allocBytes");
+        recorder.recordLevel(double(allocs) / calls,
+                             prefix + "." + entry.first + ".allocsPerCall");
+        recorder.recordLevel(double(allocBytes) / calls,
+                             prefix + "." + entry.first + ".bytesPerCall");
+    }
+}
+
+} // namespace Datacratic
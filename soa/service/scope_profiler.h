@@ -0,0 +1,140 @@
+/* scope_profiler.h                                                -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Hierarchical profiler of nested scopes, cheap enough for the hot paths.
+*/
+
+#pragma once
+
+#include "allocation_counters.h"
+#include "jml/arch/tick_counter.h"
+#include "jml/compiler/compiler.h"
+#include <atomic>
+#include <map>
+#include <string>
+#include <stdint.h>
+
+
+namespace Datacratic {
+
+struct EventRecorder;
+
+
+/*****************************************************************************/
+/* SCOPE PROFILER                                                            */
+/*****************************************************************************/
+
+/** Counts the calls and the ticks spent in named scopes, by the path of
+    scopes they are nested in, separately for each thread:
+
+        void doBid()
+        {
+            ProfileScope scope("doBid");
+            ...
+            {
+                ProfileScope scope("parse");   // doBid.parse
+                ...
+            }
+        }
+
+    The names must be string literals (or live as long as the process); they
+    are compared by address.  Each thread only ever writes to its own tree,
+    with plain loads and stores, so entering and leaving a scope costs two
+    reads of the tick counter and no atomic operations.  Nodes are never
+    freed, which lets other threads read the trees while they are updated.
+
+    Time spent in a scope includes the time in the scopes nested in it.
+
+    The allocations made by the thread while in a scope are counted along
+    with it, nested scopes included, once the AllocationCounters hooks are
+    installed; otherwise they stay at zero.
+*/
+
+struct ScopeProfiler {
+
+    /** Calls, ticks and allocations of a scope over all of the threads. */
+    struct Totals {
+        Totals()
+            : calls(0), ticks(0), allocs(0), allocBytes(0)
+        {
+        }
+
+        uint64_t calls;
+        uint64_t ticks;
+        uint64_t allocs;
+        uint64_t allocBytes;
+    };
+
+    /** Totals of every scope, by path (names joined with '.'). */
+    static std::map<std::string, Totals> totals();
+
+    /** Record the calls and the microseconds spent in each scope since the
+        last call as counts of "<prefix>.<path>.calls" and
+        "<prefix>.<path>.us".  When there were allocations, they are also
+        recorded as counts of "<prefix>.<path>.allocs" and
+        "<prefix>.<path>.allocBytes" and as the levels
+        "<prefix>.<path>.allocsPerCall" and "<prefix>.<path>.bytesPerCall",
+        which are the allocation budgets of the scope.  Meant to be called
+        periodically from a single thread.
+    */
+    static void record(const EventRecorder & recorder,
+                       const std::string & prefix = "profile");
+
+    /** Turn the profiling of new scopes on or off; it's on by default. */
+    static void setEnabled(bool enabled);
+
+    static bool enabled()
+    {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    struct Node;
+
+    /** Enter the scope below the current one of the thread and return its
+        node.
+    */
+    static Node * enter(const char * name);
+
+    /** Leave the node's scope, which has been entered at startTicks with
+        the thread's allocation counters at startAllocs.
+    */
+    static void leave(Node * node, uint64_t startTicks,
+                      const AllocationCounters & startAllocs);
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+
+/*****************************************************************************/
+/* PROFILE SCOPE                                                             */
+/*****************************************************************************/
+
+/** Profiles the scope that it's declared in; see ScopeProfiler.  A null
+    name profiles nothing.
+*/
+
+struct ProfileScope {
+    ProfileScope(const char * name)
+        : node(name && ScopeProfiler::enabled()
+               ? ScopeProfiler::enter(name) : 0),
+          startTicks(node ? ML::ticks() : 0)
+    {
+        if (node) startAllocs = AllocationCounters::thisThread();
+    }
+
+    ~ProfileScope()
+    {
+        if (node) ScopeProfiler::leave(node, startTicks, startAllocs);
+    }
+
+private:
+    ScopeProfiler::Node * node;
+    uint64_t startTicks;
+    AllocationCounters startAllocs;
+
+    ProfileScope(const ProfileScope &) = delete;
+    void operator = (const ProfileScope &) = delete;
+};
+
+} // namespace Datacratic
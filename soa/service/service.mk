@@ -3,10 +3,10 @@
 
 
 LIBOPSTATS_SOURCES := \
-	statsd_connector.cc carbon_connector.cc stat_aggregator.cc process_stats.cc
+	statsd_connector.cc carbon_connector.cc stat_aggregator.cc hdr_histogram.cc process_stats.cc
 
 LIBOPSTATS_LINK := \
-	ACE arch utils boost_thread types
+	ACE arch utils db boost_thread types
 
 $(eval $(call library,opstats,$(LIBOPSTATS_SOURCES),$(LIBOPSTATS_LINK)))
 
@@ -41,10 +41,14 @@ LIBSERVICES_SOURCES := \
 	passive_endpoint.cc \
 	chunked_http_endpoint.cc \
 	epoller.cc \
+	io_uring_poller.cc \
 	epoll_loop.cc \
 	http_header.cc \
 	port_range_service.cc \
 	service_base.cc \
+	service_discovery_cache.cc \
+	event_sampler.cc \
+	latency_histogram.cc \
 	message_loop.cc \
 	loop_monitor.cc \
 	named_endpoint.cc \
@@ -53,6 +57,7 @@ LIBSERVICES_SOURCES := \
 	async_event_source.cc \
 	async_writer_source.cc \
 	tcp_client.cc \
+	dns_cache.cc \
 	rest_service_endpoint.cc \
 	http_named_endpoint.cc \
 	rest_proxy.cc \
@@ -74,12 +79,23 @@ LIBSERVICES_SOURCES := \
 	nsq_event_handler.cc \
 	event_publisher.cc \
 	event_subscriber.cc \
-	nsq_client.cc 
+	nsq_client.cc \
+	shared_memory_ring.cc \
+	scope_profiler.cc \
+	allocation_counters.cc
 
-LIBSERVICES_LINK := opstats curl boost_regex runner_common zeromq zookeeper_mt ACE arch utils jsoncpp boost_thread zmq types tinyxml2 boost_system value_description crypto
+LIBSERVICES_LINK := opstats curl boost_regex runner_common zeromq zookeeper_mt ACE arch utils jsoncpp boost_thread zmq types tinyxml2 boost_system value_description crypto rt gc
+
+# The allocation counters use the hooks of tcmalloc when it's the allocator
+ifeq ($(TCMALLOC_ENABLED),1)
+LIBSERVICES_LINK += tcmalloc
+endif
 
 $(eval $(call library,services,$(LIBSERVICES_SOURCES),$(LIBSERVICES_LINK)))
 $(eval $(call set_compile_option,runner.cc,-DBIN=\"$(BIN)\"))
+ifeq ($(TCMALLOC_ENABLED),1)
+$(eval $(call set_compile_option,allocation_counters.cc,-DDATACRATIC_TCMALLOC_HOOKS=1))
+endif
 
 $(LIB)/libservices.so: $(BIN)/runner_helper
 
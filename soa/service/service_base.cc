@@ -6,10 +6,12 @@
 */
 
 #include "service_base.h"
+#include "service_discovery_cache.h"
 #include <iostream>
 #include "soa/service/carbon_connector.h"
 #include "zookeeper_configuration_service.h"
 #include "jml/arch/demangle.h"
+#include "jml/arch/huge_page_pool.h"
 #include "jml/utils/exc_assert.h"
 #include "jml/utils/environment.h"
 #include "jml/utils/file_functions.h"
@@ -190,6 +192,16 @@ splitPath(const std::string & path)
     return make_pair(root, leaf);
 }
 
+std::shared_ptr<ServiceDiscoveryCache>
+ConfigurationService::
+discovery()
+{
+    std::lock_guard<std::mutex> guard(discoveryLock);
+    if (!discoveryCache)
+        discoveryCache = std::make_shared<ServiceDiscoveryCache>(*this);
+    return discoveryCache;
+}
+
 /*****************************************************************************/
 /* INTERNAL CONFIGURATION SERVICE                                            */
 /*****************************************************************************/
@@ -474,6 +486,7 @@ checkSysLimits()
 ServiceProxies::
 ServiceProxies()
     : events(new NullEventService()),
+      eventSampler(new EventSampler()),
       config(new InternalConfigurationService()),
       ports(new DefaultPortRangeService()),
       zmqContext(new zmq::context_t(1 /* num worker threads */))
@@ -552,10 +565,9 @@ ServiceProxies::getServiceClassInstances(std::string const & name,
 {
     std::vector<std::string> result;
     if(config) {
-        std::string root = "serviceClass/" + name;
-        vector<string> children = config->getChildren(root);
-        for(auto & item : children) {
-            Json::Value json = config->getJson(root + "/" + item);
+        auto entries = discovery()->getEntries("serviceClass/" + name);
+        for(auto & item : *entries) {
+            const Json::Value & json = item.second;
             auto items = getEndpointInstances(json["servicePath"].asString(), protocol);
             result.insert(result.begin(), items.begin(), items.end());
         }
@@ -570,10 +582,9 @@ ServiceProxies::getEndpointInstances(std::string const & name,
 {
     std::vector<std::string> result;
     if(config) {
-        std::string path = name + "/" + protocol;
-        vector<string> children = config->getChildren(path);
-        for(auto & item : children) {
-            Json::Value json = config->getJson(path + "/" + item);
+        auto entries = discovery()->getEntries(name + "/" + protocol);
+        for(auto & item : *entries) {
+            const Json::Value & json = item.second;
             for(auto & entry: json) {
                 std::string key;
                 if(protocol == "http") key = "httpUri";
@@ -603,6 +614,15 @@ ServiceProxies::getEndpointInstances(std::string const & name,
     return result;
 }
 
+std::shared_ptr<ServiceDiscoveryCache>
+ServiceProxies::
+discovery()
+{
+    if (!config)
+        throw ML::Exception("no configuration service to discover services");
+    return config->discovery();
+}
+
 void
 ServiceProxies::
 bootstrap(const std::string& path)
@@ -659,6 +679,9 @@ bootstrap(const Json::Value& config)
 
     if (config.isMember("portRanges"))
         usePortRanges(config["portRanges"]);
+
+    if (config.isMember("event-sampling"))
+        eventSampler->setConfig(config["event-sampling"]);
 }
 
 /*****************************************************************************/
@@ -711,6 +734,20 @@ recordEventFmt(StatEventType type,
     }
 }
 
+void
+EventRecorder::
+recordHugePageStats() const
+{
+    ML::Huge_Page_Stats stats = ML::huge_page_stats();
+    auto toMb = [] (size_t bytes) { return bytes / 1048576.0; };
+
+    recordLevel(toMb(stats.bytes_1gb), "hugePages.mapped1GB");
+    recordLevel(toMb(stats.bytes_2mb), "hugePages.mapped2MB");
+    recordLevel(toMb(stats.bytes_transparent), "hugePages.mappedTransparent");
+    recordLevel(toMb(stats.bytes_normal), "hugePages.mappedNormal");
+    recordLevel(toMb(stats.bytes_in_use), "hugePages.inUse");
+}
+
 /*****************************************************************************/
 /* SERVICE BASE                                                              */
 /*****************************************************************************/
@@ -9,6 +9,7 @@
 
 #include "port_range_service.h"
 #include "soa/service/stats_events.h"
+#include "soa/service/event_sampler.h"
 #include "stdarg.h"
 #include "jml/compiler/compiler.h"
 #include <string>
@@ -36,6 +37,7 @@ namespace Datacratic {
 
 class MultiAggregator;
 class CarbonConnector;
+struct ServiceDiscoveryCache;
 
 /*****************************************************************************/
 /* EVENT SERVICE                                                             */
@@ -292,6 +294,15 @@ struct ConfigurationService {
 
     std::string currentInstallation;
     std::string currentLocation;
+
+    /** Snapshot of the service discovery entries of this service, shared
+        by all the connectors that use it.  Created on first use.
+    */
+    std::shared_ptr<ServiceDiscoveryCache> discovery();
+
+private:
+    std::mutex discoveryLock;
+    std::shared_ptr<ServiceDiscoveryCache> discoveryCache;
 };
 
 
@@ -398,6 +409,13 @@ struct ServiceProxies {
     ServiceProxies();
 
     std::shared_ptr<EventService> events;
+
+    /** Sampling applied to the events recorded through an EventRecorder
+        before they reach the events service.  Kept when the events service
+        is replaced.
+    */
+    std::shared_ptr<EventSampler> eventSampler;
+
     std::shared_ptr<ConfigurationService> config;
     std::shared_ptr<PortRangeService> ports;
     Json::Value params;
@@ -437,6 +455,11 @@ struct ServiceProxies {
     getEndpointInstances(std::string const & name,
                          std::string const & protocol = "http");
 
+    /** Shared snapshot of the service discovery entries of the
+        configuration service, used by the lookups above.
+    */
+    std::shared_ptr<ServiceDiscoveryCache> discovery();
+
     // Bootstrap the proxies services using a json configuration.
     void bootstrap(const std::string& path);
     void bootstrap(const Json::Value& config);
@@ -485,6 +508,10 @@ struct EventRecorder {
             std::cerr << "no services configured!!!!" << std::endl;
             return;
         }
+        if (services_ && services_->eventSampler
+            && !services_->eventSampler->sample(eventPrefix_, eventName,
+                                                type, value))
+            return;
         es->onEvent(eventPrefix_, eventName, type, value, extra);
     }
 
@@ -644,6 +671,12 @@ struct EventRecorder {
         recordEvent(event.c_str(), ET_STABLE_LEVEL, level);
     }
 
+    /** Record the memory that the process has mapped for the huge page
+        pools (see ML::huge_page_stats()) under hugePages, in megabytes.
+        Meant to be called every few seconds.
+    */
+    void recordHugePageStats() const;
+
 protected:
     std::string eventPrefix_;
     std::shared_ptr<EventService> events_;
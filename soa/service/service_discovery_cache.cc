@@ -0,0 +1,172 @@
+/* service_discovery_cache.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+*/
+
+#include "jml/arch/exception.h"
+#include "service_discovery_cache.h"
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+/*****************************************************************************/
+/* SERVICE DISCOVERY CACHE                                                   */
+/*****************************************************************************/
+
+ServiceDiscoveryCache::
+ServiceDiscoveryCache(ConfigurationService & config)
+    : config(config), current(gcLock), updating(false), nextToken(1)
+{
+}
+
+ServiceDiscoveryCache::
+~ServiceDiscoveryCache()
+{
+    for (auto & entry: watches)
+        entry.second.disable();
+}
+
+std::shared_ptr<const ServiceDiscoveryCache::Entries>
+ServiceDiscoveryCache::
+getEntries(const std::string & path)
+{
+    {
+        auto snap = snapshot();
+        auto it = snap->directories.find(path);
+        if (it != snap->directories.end())
+            return it->second;
+    }
+
+    refresh(path);
+
+    {
+        auto snap = snapshot();
+        auto it = snap->directories.find(path);
+        if (it != snap->directories.end())
+            return it->second;
+    }
+
+    // Another thread, or a caller further up our own stack, is updating the
+    // cache and will publish this directory once it is done.  Read it
+    // directly in the meantime.
+    return read(path, ConfigurationService::Watch());
+}
+
+uint64_t
+ServiceDiscoveryCache::
+subscribe(const OnChange & onChange)
+{
+    std::lock_guard<std::recursive_mutex> guard(subscribersLock);
+    uint64_t token = nextToken++;
+    subscribers[token] = onChange;
+    return token;
+}
+
+void
+ServiceDiscoveryCache::
+unsubscribe(uint64_t token)
+{
+    std::lock_guard<std::recursive_mutex> guard(subscribersLock);
+    subscribers.erase(token);
+}
+
+void
+ServiceDiscoveryCache::
+refresh(const std::string & path)
+{
+    {
+        std::lock_guard<ML::Spinlock> guard(pendingLock);
+        pending.insert(path);
+        if (updating)
+            return;
+        updating = true;
+    }
+
+    for (;;) {
+        string next;
+        {
+            std::lock_guard<ML::Spinlock> guard(pendingLock);
+            if (pending.empty()) {
+                updating = false;
+                return;
+            }
+            next = *pending.begin();
+            pending.erase(pending.begin());
+        }
+
+        std::shared_ptr<const Entries> entries;
+        try {
+            auto & watch = watches[next];
+            if (!watch) {
+                std::weak_ptr<ServiceDiscoveryCache> weak = shared_from_this();
+                watch.init([=] (const std::string &,
+                                ConfigurationService::ChangeType)
+                           {
+                               auto cache = weak.lock();
+                               if (cache)
+                                   cache->refresh(next);
+                           });
+            }
+            entries = read(next, watch);
+        } catch (...) {
+            std::lock_guard<ML::Spinlock> guard(pendingLock);
+            pending.insert(next);
+            updating = false;
+            throw;
+        }
+
+        publish(next, std::move(entries));
+        notify(next);
+    }
+}
+
+std::shared_ptr<const ServiceDiscoveryCache::Entries>
+ServiceDiscoveryCache::
+read(const std::string & path, ConfigurationService::Watch watch)
+{
+    std::shared_ptr<Entries> result(new Entries());
+
+    vector<string> children = config.getChildren(path, watch);
+    result->reserve(children.size());
+    for (auto & c: children)
+        result->emplace_back(c, config.getJson(path + "/" + c, watch));
+
+    return result;
+}
+
+void
+ServiceDiscoveryCache::
+publish(const std::string & path, std::shared_ptr<const Entries> entries)
+{
+    // Only the updating thread gets here, so nothing can be published
+    // between the copy and the swap
+    std::unique_ptr<Snapshot> next;
+    {
+        auto snap = snapshot();
+        next.reset(new Snapshot(*snap));
+    }
+    next->directories[path] = std::move(entries);
+    ++next->generation;
+
+    current.replace(next.release());
+}
+
+void
+ServiceDiscoveryCache::
+notify(const std::string & path)
+{
+    std::lock_guard<std::recursive_mutex> guard(subscribersLock);
+
+    // Callbacks may subscribe or unsubscribe, so never hold an iterator
+    // across a call
+    uint64_t token = 0;
+    for (;;) {
+        auto it = subscribers.upper_bound(token);
+        if (it == subscribers.end())
+            break;
+        token = it->first;
+        OnChange onChange = it->second;
+        onChange(path);
+    }
+}
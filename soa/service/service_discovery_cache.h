@@ -0,0 +1,127 @@
+/* service_discovery_cache.h                                       -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   In-process snapshot of the service discovery entries of a configuration
+   service.
+*/
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "jml/arch/spinlock.h"
+#include "soa/gc/rcu_protected.h"
+#include "soa/jsoncpp/json.h"
+#include "soa/service/service_base.h"
+
+
+namespace Datacratic {
+
+/*****************************************************************************/
+/* SERVICE DISCOVERY CACHE                                                   */
+/*****************************************************************************/
+
+/** Immutable snapshot of the directories of the configuration service that
+    are used to discover services ("serviceClass/<class>" and
+    "<service>/<endpoint>"), shared by all the connectors of a process.
+
+    A directory is read from the configuration service the first time it is
+    asked for, along with the values of its children, and a watch is kept on
+    it from then on.  Each change builds a new snapshot, which is swapped in
+    with RCU; readers never take a lock nor do a round-trip, and the entries
+    they get are never copied or modified.  A topology change thus causes a
+    single read of the directory per process, rather than one per
+    connector.
+
+    The cache must not outlive its configuration service; it is normally
+    obtained through ConfigurationService::discovery().
+*/
+
+struct ServiceDiscoveryCache
+    : public std::enable_shared_from_this<ServiceDiscoveryCache> {
+
+    /** Names and values of the children of a directory. */
+    typedef std::vector<std::pair<std::string, Json::Value> > Entries;
+
+    struct Snapshot {
+        Snapshot()
+            : generation(0)
+        {
+        }
+
+        /** Entries of the directories read so far, indexed by path. */
+        std::map<std::string, std::shared_ptr<const Entries> > directories;
+
+        /** Incremented each time a directory changes. */
+        uint64_t generation;
+    };
+
+    ServiceDiscoveryCache(ConfigurationService & config);
+    ~ServiceDiscoveryCache();
+
+    /** Entries below the given directory.  Only the first call for a
+        directory goes to the configuration service.
+    */
+    std::shared_ptr<const Entries> getEntries(const std::string & path);
+
+    /** Current snapshot, which stays valid while it is held. */
+    RcuLocked<const Snapshot> snapshot() const
+    {
+        return current.getImmutable();
+    }
+
+    /** Callback invoked with the path of a directory when its entries
+        change, after the new snapshot is published.
+    */
+    typedef std::function<void (const std::string & path)> OnChange;
+
+    /** Register a callback for the changes of all the directories that are
+        cached.  Returns a token for unsubscribe().
+    */
+    uint64_t subscribe(const OnChange & onChange);
+
+    /** Remove a callback.  It is guaranteed not to be running nor to be
+        called anymore once this returns, unless called from the callback
+        itself.
+    */
+    void unsubscribe(uint64_t token);
+
+    /** Read the given directory again and publish its entries. */
+    void refresh(const std::string & path);
+
+private:
+    ConfigurationService & config;
+
+    GcLock gcLock;
+    RcuProtected<Snapshot> current;
+
+    /** Directories waiting to be read.  A single thread reads them at a
+        time, which keeps a single writer for the snapshot and copes with
+        the watches that are triggered from within a read.
+    */
+    ML::Spinlock pendingLock;
+    std::set<std::string> pending;
+    bool updating;
+
+    /// Watches on the directories, only used by the updating thread
+    std::map<std::string, ConfigurationService::Watch> watches;
+
+    std::recursive_mutex subscribersLock;
+    std::map<uint64_t, OnChange> subscribers;
+    uint64_t nextToken;
+
+    std::shared_ptr<const Entries> read(const std::string & path,
+                                        ConfigurationService::Watch watch);
+    void publish(const std::string & path,
+                 std::shared_ptr<const Entries> entries);
+    void notify(const std::string & path);
+};
+
+} // namespace Datacratic
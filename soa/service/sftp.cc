@@ -21,6 +21,11 @@
 #include <fstream>
 #include "jml/utils/filter_streams.h"
 #include "jml/utils/exc_assert.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fcntl.h>
 #include <thread>
 #include <unordered_map>
 
@@ -228,6 +233,154 @@ close()
 }
 
 
+/*****************************************************************************/
+/* TRANSFERS                                                                 */
+/*****************************************************************************/
+
+namespace {
+
+struct CloseHandle {
+    void operator () (LIBSSH2_SFTP_HANDLE * handle) const
+    {
+        libssh2_sftp_close(handle);
+    }
+};
+
+typedef std::unique_ptr<LIBSSH2_SFTP_HANDLE, CloseHandle> HandlePtr;
+
+LIBSSH2_SFTP_HANDLE *
+openForRead(const SftpConnection & connection, const std::string & path)
+{
+    LIBSSH2_SFTP_HANDLE * handle
+        = libssh2_sftp_open_ex(connection.sftp_session, path.c_str(),
+                               path.length(), LIBSSH2_FXF_READ, 0,
+                               LIBSSH2_SFTP_OPENFILE);
+    if (!handle)
+        throw ML::Exception("couldn't open path: " + connection.lastError());
+    return handle;
+}
+
+/** Open the file for writing.  The file is created and truncated by the
+    first handle only, as those of the other sessions write into it.
+*/
+LIBSSH2_SFTP_HANDLE *
+openForWrite(const SftpConnection & connection, const std::string & path,
+             bool truncate)
+{
+    unsigned long flags = LIBSSH2_FXF_WRITE;
+    if (truncate)
+        flags |= LIBSSH2_FXF_CREAT | LIBSSH2_FXF_TRUNC;
+
+    LIBSSH2_SFTP_HANDLE * handle
+        = libssh2_sftp_open(connection.sftp_session, path.c_str(), flags,
+                            LIBSSH2_SFTP_S_IRUSR|LIBSSH2_SFTP_S_IWUSR|
+                            LIBSSH2_SFTP_S_IRGRP|LIBSSH2_SFTP_S_IROTH);
+    if (!handle)
+        throw ML::Exception("couldn't open path: " + connection.lastError());
+    return handle;
+}
+
+void
+readFully(LIBSSH2_SFTP_HANDLE * handle, const SftpConnection & connection,
+          char * buf, size_t length)
+{
+    for (size_t done = 0;  done < length;) {
+        ssize_t numRead = libssh2_sftp_read(handle, buf + done, length - done);
+        if (numRead < 0)
+            throw ML::Exception("read(): " + connection.lastError());
+        if (numRead == 0)
+            throw ML::Exception("sftp file was truncated while being read");
+        done += numRead;
+    }
+}
+
+void
+writeFully(LIBSSH2_SFTP_HANDLE * handle, const SftpConnection & connection,
+           const char * buf, size_t length)
+{
+    for (size_t done = 0;  done < length;) {
+        ssize_t rc = libssh2_sftp_write(handle, buf + done, length - done);
+        if (rc < 0)
+            throw ML::Exception("couldn't upload file: "
+                                + connection.lastError());
+        done += rc;
+    }
+}
+
+/** Hands out the chunks of a transfer to the sessions, until there are
+    none left or one of the sessions failed.
+*/
+struct Chunks {
+    Chunks(uint64_t size, size_t chunkSize)
+        : size(size), chunkSize(chunkSize), next(0), failed(false)
+    {
+    }
+
+    bool get(uint64_t & offset, size_t & length)
+    {
+        if (failed)
+            return false;
+        offset = next++ * chunkSize;
+        if (offset >= size)
+            return false;
+        length = std::min<uint64_t>(chunkSize, size - offset);
+        return true;
+    }
+
+    uint64_t size;
+    size_t chunkSize;
+    std::atomic<uint64_t> next;
+    std::atomic<bool> failed;
+};
+
+/** Call onSession from numSessions threads, each with its own connection
+    to the host, and rethrow the first error once they are all done.
+*/
+void
+runSessions(const SftpConnection & owner, int numSessions,
+            Chunks & chunks,
+            const std::function<void (SftpConnection & session)> & onSession)
+{
+    std::mutex lock;
+    std::exception_ptr error;
+
+    auto runThread = [&] ()
+        {
+            try {
+                auto session = owner.newSession();
+                onSession(*session);
+            } catch (...) {
+                chunks.failed = true;
+                std::unique_lock<std::mutex> guard(lock);
+                if (!error)
+                    error = std::current_exception();
+            }
+        };
+
+    vector<std::thread> threads;
+    for (int i = 0;  i < numSessions;  ++i)
+        threads.emplace_back(runThread);
+    for (auto & t: threads)
+        t.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void
+printTransfer(const char * what, uint64_t bytes, Date started,
+              int numSessions)
+{
+    double elapsed = Date::now().secondsSince(started);
+    double mb = bytes / 1024.0 / 1024.0;
+    cerr << ML::format("%s %.2fMB in %.2fs at %.2fMB/s over %d sessions",
+                       what, mb, elapsed, mb / elapsed, numSessions)
+         << endl;
+}
+
+} // file scope
+
+
 /*****************************************************************************/
 /* ATTRIBUTES                                                                */
 /*****************************************************************************/
@@ -368,14 +521,60 @@ size() const
 
 void
 SftpConnection::File::
-downloadTo(const std::string & filename) const
+downloadTo(const std::string & filename, int numSessions) const
 {
     uint64_t bytesToRead = size();
 
+    if (numSessions > 1 && bytesToRead > defaultChunkSize) {
+        int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd == -1)
+            throw ML::Exception(errno, "couldn't open " + filename,
+                                "downloadTo");
+
+        Date started = Date::now();
+        Chunks chunks(bytesToRead, defaultChunkSize);
+
+        auto onSession = [&] (SftpConnection & session)
+            {
+                HandlePtr handle(openForRead(session, path));
+                std::unique_ptr<char[]> buf(new char[defaultChunkSize]);
+
+                uint64_t offset;
+                size_t length;
+                while (chunks.get(offset, length)) {
+                    libssh2_sftp_seek64(handle.get(), offset);
+                    readFully(handle.get(), session, buf.get(), length);
+
+                    for (size_t done = 0;  done < length;) {
+                        ssize_t res = pwrite(fd, buf.get() + done,
+                                             length - done, offset + done);
+                        if (res == -1)
+                            throw ML::Exception(errno, "couldn't write "
+                                                + filename, "downloadTo");
+                        done += res;
+                    }
+                }
+            };
+
+        try {
+            runSessions(*owner, numSessions, chunks, onSession);
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+
+        if (::close(fd) == -1)
+            throw ML::Exception(errno, "couldn't close " + filename,
+                                "downloadTo");
+
+        printTransfer("downloaded", bytesToRead, started, numSessions);
+        return;
+    }
+
     uint64_t done = 0;
     std::ofstream stream(filename.c_str());
 
-    size_t bufSize = 1024 * 1024;
+    size_t bufSize = defaultChunkSize;
 
     char * buf = new char[bufSize];
             
@@ -413,6 +612,10 @@ downloadTo(const std::string & filename) const
 /* SFTP CONNECTION                                                           */
 /*****************************************************************************/
 
+size_t
+SftpConnection::
+defaultChunkSize = 4 * 1024 * 1024;
+
 SftpConnection::
 SftpConnection()
     : sftp_session(0)
@@ -442,6 +645,10 @@ connectPasswordAuth(const std::string & hostname,
                             + lastError());
     }
 
+    connectSession = [=] (SftpConnection & connection)
+        {
+            connection.connectPasswordAuth(hostname, username, password, port);
+        };
 }
 
 void
@@ -462,6 +669,12 @@ connectPublicKeyAuth(const std::string & hostname,
                             + lastError());
     }
 
+    connectSession = [=] (SftpConnection & connection)
+        {
+            connection.connectPublicKeyAuth(hostname, username,
+                                            publicKeyFile, privateKeyFile,
+                                            port);
+        };
 }
 
 SftpConnection::Directory
@@ -505,6 +718,18 @@ getAttributes(const std::string & path, Attributes & attrs)
     return (res != -1);
 }
     
+std::shared_ptr<SftpConnection>
+SftpConnection::
+newSession() const
+{
+    if (!connectSession)
+        throw ML::Exception("sftp connection isn't connected");
+
+    auto result = std::make_shared<SftpConnection>();
+    connectSession(*result);
+    return result;
+}
+
 void
 SftpConnection::
 close()
@@ -521,8 +746,33 @@ void
 SftpConnection::
 uploadFile(const char * start,
            size_t size,
-           const std::string & path)
+           const std::string & path,
+           int numSessions)
 {
+    if (numSessions > 1 && size > defaultChunkSize) {
+        Date started = Date::now();
+        libssh2_sftp_close(openForWrite(*this, path, true));
+
+        Chunks chunks(size, defaultChunkSize);
+
+        auto onSession = [&] (SftpConnection & session)
+            {
+                HandlePtr handle(openForWrite(session, path, false));
+
+                uint64_t offset;
+                size_t length;
+                while (chunks.get(offset, length)) {
+                    libssh2_sftp_seek64(handle.get(), offset);
+                    writeFully(handle.get(), session, start + offset, length);
+                }
+            };
+
+        runSessions(*this, numSessions, chunks, onSession);
+
+        printTransfer("uploaded", size, started, numSessions);
+        return;
+    }
+
     /* Request a file via SFTP */ 
     LIBSSH2_SFTP_HANDLE * handle =
         libssh2_sftp_open(sftp_session, path.c_str(),
@@ -543,7 +793,7 @@ uploadFile(const char * start,
     for (; offset < size; ) {
         /* write data in a loop until we block */ 
         size_t toSend = std::min<size_t>(size - offset,
-                                         1024 * 1024);
+                                         defaultChunkSize);
 
         ssize_t rc = libssh2_sftp_write(handle,
                                         start + offset,
@@ -682,12 +932,14 @@ struct SftpStreamingUploadSource {
 
     SftpStreamingUploadSource(SftpConnection * owner,
                               const std::string & path,
-                              const ML::OnUriHandlerException & excCallback)
+                              const ML::OnUriHandlerException & excCallback,
+                              int numSessions)
     {
         impl.reset(new Impl());
         impl->owner = owner;
         impl->path = path;
         impl->onException = excCallback;
+        impl->numSessions = numSessions;
         impl->start();
     }
 
@@ -701,12 +953,14 @@ struct SftpStreamingUploadSource {
 
     struct Impl {
         Impl()
-            : owner(0), handle(0), offset(0), lastPrint(0)
+            : owner(0), handle(0), offset(0), lastPrint(0),
+              numSessions(1), finished(false)
         {
         }
 
         ~Impl()
         {
+            stopSessions(true);
             stop();
         }
 
@@ -721,6 +975,19 @@ struct SftpStreamingUploadSource {
 
         Date startDate;
 
+        /* With more than one session, the data is cut into chunks that
+           the threads of the sessions write at their offset.
+        */
+        int numSessions;
+        size_t chunkSize;
+        std::string chunk;      ///< Data of the chunk being filled
+        std::deque<std::pair<uint64_t, std::string> > chunks;
+        std::mutex lock;
+        std::condition_variable cond;
+        bool finished;
+        std::exception_ptr error;
+        std::vector<std::thread> threads;
+
         void start()
         {
             /* Request a file via SFTP */ 
@@ -736,17 +1003,116 @@ struct SftpStreamingUploadSource {
             }
 
             startDate = Date::now();
+
+            if (numSessions > 1) {
+                chunkSize = SftpConnection::defaultChunkSize;
+                chunk.reserve(chunkSize);
+                for (int i = 0;  i < numSessions;  ++i)
+                    threads.emplace_back([=] () { this->runSession(); });
+            }
         }
         
         void stop()
         {
             if (handle) libssh2_sftp_close(handle);
+            handle = 0;
+        }
+
+        void runSession()
+        {
+            try {
+                auto session = owner->newSession();
+                HandlePtr sessionHandle(openForWrite(*session, path, false));
+
+                for (;;) {
+                    std::pair<uint64_t, std::string> next;
+                    {
+                        std::unique_lock<std::mutex> guard(lock);
+                        cond.wait(guard, [&] ()
+                                  {
+                                      return error || finished
+                                          || !chunks.empty();
+                                  });
+                        if (error || chunks.empty())
+                            return;
+                        next = std::move(chunks.front());
+                        chunks.pop_front();
+                        cond.notify_all();
+                    }
+
+                    libssh2_sftp_seek64(sessionHandle.get(), next.first);
+                    writeFully(sessionHandle.get(), *session,
+                               next.second.data(), next.second.size());
+                }
+            } catch (...) {
+                std::unique_lock<std::mutex> guard(lock);
+                if (!error)
+                    error = std::current_exception();
+                cond.notify_all();
+            }
+        }
+
+        /** Queue the chunk being filled, waiting while two per session
+            are already queued.
+        */
+        void pushChunk()
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [&] ()
+                      {
+                          return error || chunks.size() < 2 * threads.size();
+                      });
+            if (error) {
+                guard.unlock();
+                onException();
+                std::rethrow_exception(error);
+            }
+
+            chunks.emplace_back(offset - chunk.size(), std::move(chunk));
+            chunk.clear();
+            chunk.reserve(chunkSize);
+            cond.notify_all();
+        }
+
+        /** Wait for the sessions to write the queued chunks and finish, or
+            drop them when aborting.
+        */
+        void stopSessions(bool abort)
+        {
+            if (threads.empty())
+                return;
+
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                finished = true;
+                if (abort)
+                    chunks.clear();
+                cond.notify_all();
+            }
+
+            for (auto & t: threads)
+                t.join();
+            threads.clear();
         }
 
         std::streamsize write(const char_type* s, std::streamsize n)
         {
             ssize_t done = 0;
 
+            if (!threads.empty()) {
+                while (done < n) {
+                    size_t toCopy = std::min<size_t>(n - done,
+                                                     chunkSize - chunk.size());
+                    chunk.append(s + done, toCopy);
+                    done += toCopy;
+                    offset += toCopy;
+                    if (chunk.size() == chunkSize)
+                        pushChunk();
+                }
+
+                return done;
+            }
+
             while (done < n) {
 
                 ssize_t rc = libssh2_sftp_write(handle, s + done, n - done);
@@ -791,6 +1157,16 @@ struct SftpStreamingUploadSource {
 
         void finish()
         {
+            if (!threads.empty()) {
+                if (!chunk.empty())
+                    pushChunk();
+                stopSessions(false);
+                if (error) {
+                    onException();
+                    std::rethrow_exception(error);
+                }
+            }
+
             stop();
 
             double elapsed = Date::now().secondsSince(startDate);
@@ -823,11 +1199,11 @@ struct SftpStreamingUploadSource {
 
 ML::filter_ostream
 SftpConnection::
-streamingUpload(const std::string & path)
+streamingUpload(const std::string & path, int numSessions)
 {
     ML::filter_ostream result;
     auto onException = [&] { result.notifyException(); };
-    auto sb = streamingUploadStreambuf(path, onException);
+    auto sb = streamingUploadStreambuf(path, onException, numSessions);
     result.openFromStreambuf(sb.release(), true, path);
     
     return result;
@@ -836,12 +1212,17 @@ streamingUpload(const std::string & path)
 std::unique_ptr<std::streambuf>
 SftpConnection::
 streamingUploadStreambuf(const std::string & path,
-                         const ML::OnUriHandlerException & onException)
+                         const ML::OnUriHandlerException & onException,
+                         int numSessions)
 {
+    // Without sessions, each write is a whole window for libssh2.
+    size_t bufferSize = numSessions > 1 ? 131072 : defaultChunkSize;
+
     std::unique_ptr<std::streambuf> result;
     result.reset(new boost::iostreams::stream_buffer<SftpStreamingUploadSource>
-                 (SftpStreamingUploadSource(this, path, onException),
-                  131072));
+                 (SftpStreamingUploadSource(this, path, onException,
+                                            numSessions),
+                  bufferSize));
     return result;
 }
 
@@ -863,7 +1244,7 @@ streamingDownloadStreambuf(const std::string & path)
     std::unique_ptr<std::streambuf> result;
     result.reset(new boost::iostreams::stream_buffer<SftpStreamingDownloadSource>
                  (SftpStreamingDownloadSource(this, path),
-                  131072));
+                  defaultChunkSize));
     return result;
 }
 
@@ -960,9 +1341,15 @@ struct RegisterSftpHandler {
                              true);
         }
         else if (mode == ios::out) {
+            int numSessions = 1;
+            auto it = options.find("sftp-sessions");
+            if (it != options.end())
+                numSessions = std::stoi(it->second);
+
             return make_pair(connection->streamingUploadStreambuf("sftp://"
                                                                   + resource,
-                                                                  onException)
+                                                                  onException,
+                                                                  numSessions)
                              .release(),
                              true);
         }
@@ -82,6 +82,13 @@ struct SshConnection : public SocketConnection {
 struct SftpConnection : public SshConnection {
     LIBSSH2_SFTP *sftp_session;
 
+    /** Size of the reads and writes given to libssh2.  It splits each of
+        them into packets that are all in flight at once, so this is the
+        window that keeps a link with a long round trip busy.  Default is
+        4MB.
+    */
+    static size_t defaultChunkSize;
+
     SftpConnection();
 
     ~SftpConnection();
@@ -115,7 +122,11 @@ struct SftpConnection : public SshConnection {
 
         uint64_t size() const;
 
-        void downloadTo(const std::string & filename) const;
+        /** Download the file.  With more than one session, ranges of the
+            file are read at once over that many connections to the host.
+        */
+        void downloadTo(const std::string & filename,
+                        int numSessions = 1) const;
     };
 
     struct Directory {
@@ -140,25 +151,45 @@ struct SftpConnection : public SshConnection {
 
     File openFile(const std::string & path);
 
+    /** Upload the file.  With more than one session, ranges of the file
+        are written at once over that many connections to the host.
+    */
     void uploadFile(const char * start,
                     size_t size,
-                    const std::string & path);
+                    const std::string & path,
+                    int numSessions = 1);
 
     bool getAttributes(const std::string & path, Attributes & attrs) const;
     
+    /** Streaming upload.  With more than one session, the data is cut
+        into chunks of defaultChunkSize that are written at their offset
+        over that many connections to the host, with a bounded number of
+        chunks waiting for them.  The "sftp-sessions" option of a
+        filter_ostream open gives the number of sessions.
+    */
     std::unique_ptr<std::streambuf>
     streamingUploadStreambuf(const std::string & path,
-                             const ML::OnUriHandlerException & onException);
+                             const ML::OnUriHandlerException & onException,
+                             int numSessions = 1);
 
     std::unique_ptr<std::streambuf>
     streamingDownloadStreambuf(const std::string & path);
 
-    ML::filter_ostream streamingUpload(const std::string & path);
+    ML::filter_ostream streamingUpload(const std::string & path,
+                                       int numSessions = 1);
     ML::filter_istream streamingDownload(const std::string & path);
 
     int unlink(const std::string & path);
 
+    /** Open another connection to the same host with the same
+        credentials, for the transfers over several sessions.
+    */
+    std::shared_ptr<SftpConnection> newSession() const;
+
     void close();
+
+private:
+    std::function<void (SftpConnection &)> connectSession;
 };
 
 
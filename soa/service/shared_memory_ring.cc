@@ -0,0 +1,338 @@
+/* shared_memory_ring.cc
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+   Implementation of the shared memory ring.
+*/
+
+#include "shared_memory_ring.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/futex.h"
+#include "jml/utils/exc_assert.h"
+#include <string.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+using namespace std;
+using namespace ML;
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* SHARED MEMORY RING                                                        */
+/*****************************************************************************/
+
+namespace {
+
+const uint64_t RingMagic = 0x524e49524d485344ULL;  // "DSHMRINR"
+
+/** Messages are encoded as a 32 bit length of the rest of the message,
+    a 32 bit number of parts, and then each part as a 32 bit length followed
+    by its bytes.
+*/
+size_t encodedSize(const iovec * parts, int numParts)
+{
+    size_t result = 8;
+    for (int i = 0;  i < numParts;  ++i)
+        result += 4 + parts[i].iov_len;
+    return result;
+}
+
+std::string segmentName(const std::string & name)
+{
+    if (name.empty())
+        throw ML::Exception("shared memory ring needs a name");
+    return name[0] == '/' ? name : "/" + name;
+}
+
+} // file scope
+
+struct SharedMemoryRing::Header {
+    uint64_t magic;
+    uint64_t capacity;
+    std::atomic<int> closed;
+    std::atomic<int> writeLock;     ///< Held by a writer while copying in
+
+    /* The positions only ever increase; they are taken modulo the capacity
+       to find the offset.  Each is on its own cache line as the reader and
+       the writers are normally on different cores. */
+    alignas(64) std::atomic<uint64_t> writePos;
+    alignas(64) std::atomic<uint64_t> readPos;
+    std::atomic<int> readerWaiting;
+    std::atomic<int> wakeups;       ///< Futex that the reader sleeps on
+};
+
+static_assert(sizeof(std::atomic<int>) == 4,
+              "futex needs a 32 bit atomic");
+
+SharedMemoryRing::
+SharedMemoryRing(const std::string & name, int fd, size_t mappedSize,
+                 bool owner)
+    : name_(name), fd(fd), mappedSize(mappedSize), owner(owner),
+      header(0), data(0), mask(0)
+{
+    void * addr = mmap(0, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd, 0);
+    if (addr == MAP_FAILED) {
+        int err = errno;
+        ::close(fd);
+        throw ML::Exception(err, "mmap of shared memory ring " + name);
+    }
+
+    header = reinterpret_cast<Header *>(addr);
+    data = reinterpret_cast<char *>(addr) + 4096;
+}
+
+SharedMemoryRing::
+~SharedMemoryRing()
+{
+    if (owner) {
+        close();
+        shm_unlink(name_.c_str());
+    }
+
+    munmap(header, mappedSize);
+    ::close(fd);
+}
+
+std::shared_ptr<SharedMemoryRing>
+SharedMemoryRing::
+create(const std::string & name_, size_t capacity)
+{
+    static_assert(sizeof(Header) <= 4096, "header doesn't fit in a page");
+
+    std::string name = segmentName(name_);
+
+    size_t size = 4096;
+    while (size < capacity)
+        size *= 2;
+
+    shm_unlink(name.c_str());
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1)
+        throw ML::Exception(errno, "shm_open " + name);
+
+    if (ftruncate(fd, 4096 + size) == -1) {
+        int err = errno;
+        ::close(fd);
+        shm_unlink(name.c_str());
+        throw ML::Exception(err, "ftruncate " + name);
+    }
+
+    std::shared_ptr<SharedMemoryRing> result
+        (new SharedMemoryRing(name, fd, 4096 + size, true /* owner */));
+
+    Header * header = new (result->header) Header();
+    header->capacity = size;
+    header->closed = 0;
+    header->writeLock = 0;
+    header->writePos = 0;
+    header->readPos = 0;
+    header->readerWaiting = 0;
+    header->wakeups = 0;
+
+    // Written last so that a process that opens the ring in the meantime
+    // doesn't see a half initialized header
+    __atomic_store_n(&header->magic, RingMagic, __ATOMIC_RELEASE);
+
+    result->mask = size - 1;
+    return result;
+}
+
+std::shared_ptr<SharedMemoryRing>
+SharedMemoryRing::
+open(const std::string & name_)
+{
+    std::string name = segmentName(name_);
+
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd == -1) {
+        if (errno == ENOENT)
+            return nullptr;
+        throw ML::Exception(errno, "shm_open " + name);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        int err = errno;
+        ::close(fd);
+        throw ML::Exception(err, "fstat " + name);
+    }
+
+    if (st.st_size <= 4096) {
+        // Still being created
+        ::close(fd);
+        return nullptr;
+    }
+
+    std::shared_ptr<SharedMemoryRing> result
+        (new SharedMemoryRing(name, fd, st.st_size, false /* owner */));
+
+    Header * header = result->header;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != RingMagic
+        || header->capacity + 4096 != st.st_size
+        || header->closed)
+        return nullptr;
+
+    result->mask = header->capacity - 1;
+    return result;
+}
+
+void
+SharedMemoryRing::
+copyIn(uint64_t pos, const void * src, size_t len)
+{
+    size_t offset = pos & mask;
+    size_t first = std::min(len, mask + 1 - offset);
+    memcpy(data + offset, src, first);
+    memcpy(data, (const char *)src + first, len - first);
+}
+
+void
+SharedMemoryRing::
+copyOut(uint64_t pos, void * dest, size_t len) const
+{
+    size_t offset = pos & mask;
+    size_t first = std::min(len, mask + 1 - offset);
+    memcpy(dest, data + offset, first);
+    memcpy((char *)dest + first, data, len - first);
+}
+
+bool
+SharedMemoryRing::
+tryWrite(const iovec * parts, int numParts)
+{
+    size_t needed = encodedSize(parts, numParts);
+    if (needed > capacity() || closed())
+        return false;
+
+    for (int spins = 0;  header->writeLock.exchange(1, std::memory_order_acquire);) {
+        if (++spins == 100) {
+            sched_yield();
+            spins = 0;
+        }
+    }
+
+    uint64_t writePos = header->writePos.load(std::memory_order_relaxed);
+    uint64_t readPos = header->readPos.load(std::memory_order_acquire);
+
+    if (needed > capacity() - (writePos - readPos)) {
+        header->writeLock.store(0, std::memory_order_release);
+        return false;
+    }
+
+    uint32_t length = needed - 4;
+    uint32_t count = numParts;
+    uint64_t pos = writePos;
+    copyIn(pos, &length, 4);  pos += 4;
+    copyIn(pos, &count, 4);  pos += 4;
+    for (int i = 0;  i < numParts;  ++i) {
+        uint32_t partLength = parts[i].iov_len;
+        copyIn(pos, &partLength, 4);  pos += 4;
+        copyIn(pos, parts[i].iov_base, partLength);  pos += partLength;
+    }
+
+    header->writePos.store(pos);
+    header->writeLock.store(0, std::memory_order_release);
+
+    if (header->readerWaiting.load()) {
+        header->wakeups.fetch_add(1);
+        ML::futex_wake(header->wakeups);
+    }
+
+    return true;
+}
+
+bool
+SharedMemoryRing::
+tryWrite(const std::vector<std::string> & parts)
+{
+    std::vector<iovec> iov(parts.size());
+    for (unsigned i = 0;  i < parts.size();  ++i) {
+        iov[i].iov_base = (void *)parts[i].data();
+        iov[i].iov_len = parts[i].size();
+    }
+    return tryWrite(iov.data(), iov.size());
+}
+
+bool
+SharedMemoryRing::
+tryRead(std::vector<std::string> & parts)
+{
+    uint64_t readPos = header->readPos.load(std::memory_order_relaxed);
+    uint64_t writePos = header->writePos.load(std::memory_order_acquire);
+    if (readPos == writePos)
+        return false;
+
+    uint32_t length, count;
+    uint64_t pos = readPos;
+    copyOut(pos, &length, 4);  pos += 4;
+    copyOut(pos, &count, 4);  pos += 4;
+
+    ExcAssertLessEqual(4 + length, writePos - readPos);
+
+    parts.resize(count);
+    for (auto & part: parts) {
+        uint32_t partLength;
+        copyOut(pos, &partLength, 4);  pos += 4;
+        part.resize(partLength);
+        copyOut(pos, &part[0], partLength);  pos += partLength;
+    }
+
+    ExcAssertEqual(pos, readPos + 4 + length);
+
+    header->readPos.store(pos, std::memory_order_release);
+    return true;
+}
+
+bool
+SharedMemoryRing::
+wait(double timeout)
+{
+    auto hasData = [&] ()
+        {
+            return header->writePos.load() != header->readPos.load();
+        };
+
+    int wakeups = header->wakeups.load();
+    header->readerWaiting.store(1);
+
+    // A writer that published before it could see readerWaiting will be
+    // seen here instead
+    if (!hasData() && !closed())
+        ML::futex_wait(header->wakeups, wakeups, timeout);
+
+    header->readerWaiting.store(0);
+    return hasData();
+}
+
+bool
+SharedMemoryRing::
+closed() const
+{
+    return header->closed.load(std::memory_order_relaxed);
+}
+
+size_t
+SharedMemoryRing::
+capacity() const
+{
+    return mask + 1;
+}
+
+void
+SharedMemoryRing::
+close()
+{
+    header->closed.store(1);
+    header->wakeups.fetch_add(1);
+    ML::futex_wake(header->wakeups);
+}
+
+} // namespace Datacratic
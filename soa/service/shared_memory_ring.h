@@ -0,0 +1,107 @@
+/* shared_memory_ring.h                                            -*- C++ -*-
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+   Ring buffer of multi-part messages in POSIX shared memory, for passing
+   messages between processes on the same host without a socket.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* SHARED MEMORY RING                                                        */
+/*****************************************************************************/
+
+/** Ring of variable length, multi-part messages living in a POSIX shared
+    memory segment.
+
+    There is a single reader.  Writers may be in any number of processes and
+    threads; they serialize on a spinlock in the segment that is only held
+    while the message is copied in.
+
+    A reader that has run out of messages can sleep in wait(), on a futex in
+    the segment.  Writers only make the wake up system call when the reader
+    is actually asleep, so a busy reader costs no system calls at all.
+
+    The process that creates the ring owns the segment.  Its name is
+    unlinked when the owner's object is destroyed, and the ring is marked as
+    closed so that the other side knows to stop using it.
+*/
+
+struct SharedMemoryRing {
+
+    /** Create a new segment with room for the given number of bytes, which
+        is rounded up to a power of two.  Any stale segment with the same
+        name is replaced.
+    */
+    static std::shared_ptr<SharedMemoryRing>
+    create(const std::string & name, size_t capacity);
+
+    /** Attach to a segment created by another process.  Returns a null
+        pointer if there is no such segment or if it has been closed.
+    */
+    static std::shared_ptr<SharedMemoryRing>
+    open(const std::string & name);
+
+    ~SharedMemoryRing();
+
+    SharedMemoryRing(const SharedMemoryRing &) = delete;
+    SharedMemoryRing & operator = (const SharedMemoryRing &) = delete;
+
+    /** Append a message made of the given parts.  Returns false, having
+        written nothing, if there isn't enough room or the ring is closed.
+    */
+    bool tryWrite(const iovec * parts, int numParts);
+    bool tryWrite(const std::vector<std::string> & parts);
+
+    /** Pop the next message into parts.  Returns false if there is none.
+        Must only be called by the reader.
+    */
+    bool tryRead(std::vector<std::string> & parts);
+
+    /** Wait until there is something to read, for at most the given number
+        of seconds.  Returns true if there is something to read.
+    */
+    bool wait(double timeout);
+
+    /** Has the owner of the segment gone away? */
+    bool closed() const;
+
+    /** Largest message that could ever fit, in bytes of encoded parts. */
+    size_t capacity() const;
+
+    const std::string & name() const { return name_; }
+
+    /** Give up on the ring from this side.  The owner does this from its
+        destructor; the other side can use it to signal that it is exiting.
+    */
+    void close();
+
+    struct Header;
+
+private:
+    SharedMemoryRing(const std::string & name, int fd, size_t mappedSize,
+                     bool owner);
+
+    std::string name_;
+    int fd;
+    size_t mappedSize;
+    bool owner;
+    Header * header;
+    char * data;
+    size_t mask;
+
+    void copyIn(uint64_t pos, const void * src, size_t len);
+    void copyOut(uint64_t pos, void * dest, size_t len) const;
+};
+
+} // namespace Datacratic
@@ -49,6 +49,16 @@ record(float value)
     while (!ML::cmp_xchg(total, oldval, oldval + value));
 }
 
+void
+CounterAggregator::
+merge(StatAggregator & other)
+{
+    auto & counter = dynamic_cast<CounterAggregator &>(other);
+    double value = counter.reset().first;
+    if (value != 0.0)
+        record(value);
+}
+
 std::pair<double, Date>
 CounterAggregator::
 reset()
@@ -121,6 +131,26 @@ record(float value)
     values = current;
 }
 
+void
+GaugeAggregator::
+merge(StatAggregator & other)
+{
+    auto & gauge = dynamic_cast<GaugeAggregator &>(other);
+    std::unique_ptr<ML::distribution<float> > otherValues(gauge.reset().first);
+    if (otherValues->empty())
+        return;
+
+    ML::distribution<float> * current = values;
+    while ((current = values) == 0 || !cmp_xchg(values, current,
+                                     (ML::distribution<float>*)0));
+
+    current->insert(current->end(), otherValues->begin(), otherValues->end());
+
+    memory_barrier();
+
+    values = current;
+}
+
 std::pair<ML::distribution<float> *, Date>
 GaugeAggregator::
 reset()
@@ -191,4 +221,113 @@ read(const std::string & prefix)
     return result;
 }
 
+
+
+/*****************************************************************************/
+/* OUTCOME AGGREGATOR                                                        */
+/*****************************************************************************/
+
+OutcomeAggregator::
+OutcomeAggregator(const std::vector<int>& extra)
+    : start(Date::now()), histogram(new HdrHistogram()), extra(extra)
+{
+    ExcCheck(this->extra.size() > 0, "Can not construct with empty percentiles");
+}
+
+OutcomeAggregator::
+~OutcomeAggregator()
+{
+    delete histogram;
+}
+
+HdrHistogram *
+OutcomeAggregator::
+acquire()
+{
+    HdrHistogram * current;
+    while ((current = histogram) == 0
+           || !cmp_xchg(histogram, current, (HdrHistogram *)0));
+    return current;
+}
+
+void
+OutcomeAggregator::
+record(float value)
+{
+    HdrHistogram * current = acquire();
+
+    current->record(value);
+
+    memory_barrier();
+
+    histogram = current;
+}
+
+void
+OutcomeAggregator::
+merge(StatAggregator & other)
+{
+    auto & outcome = dynamic_cast<OutcomeAggregator &>(other);
+    std::unique_ptr<HdrHistogram> otherHistogram(outcome.reset().first);
+    if (otherHistogram->count() == 0)
+        return;
+
+    HdrHistogram * current = acquire();
+
+    *current += *otherHistogram;
+
+    memory_barrier();
+
+    histogram = current;
+}
+
+std::pair<HdrHistogram *, Date>
+OutcomeAggregator::
+reset()
+{
+    HdrHistogram * current;
+    HdrHistogram * newCurrent = new HdrHistogram();
+
+    while ((current = histogram) == 0
+           || !cmp_xchg(histogram, current, newCurrent));
+
+    start = Date::now();
+
+    return make_pair(current, start);
+}
+
+std::vector<StatReading>
+OutcomeAggregator::
+read(const std::string & prefix)
+{
+    HdrHistogram * values;
+    Date oldStart;
+
+    boost::tie(values, oldStart) = reset();
+
+    std::unique_ptr<HdrHistogram> vptr(values);
+
+    if (values->count() == 0)
+        return vector<StatReading>();
+
+    vector<StatReading> result;
+
+    auto addMetric = [&] (const char * name, double value)
+        {
+            result.push_back(StatReading(prefix + "." + name,
+                                         value, start));
+        };
+
+    addMetric("mean", values->mean());
+    addMetric("upper", values->max());
+    addMetric("lower", values->min());
+    addMetric("count", values->count());
+    for (int pct: extra) {
+        addMetric(ML::format("upper_%d", pct).c_str(),
+                  values->percentile(pct));
+    }
+
+    return result;
+}
+
 } // namespace Datacratic
@@ -12,6 +12,7 @@
 #include <boost/thread.hpp>
 #include "soa/types/date.h"
 #include "stats_events.h"
+#include "hdr_histogram.h"
 #include <unordered_map>
 #include <map>
 #include <deque>
@@ -49,6 +50,12 @@ struct StatAggregator {
     /** Record a value. */
     virtual void record(float value) = 0;
 
+    /** Move the values recorded by another aggregator of the same type into
+        this one, which resets the other one.  Used to gather the values
+        recorded by different threads.
+    */
+    virtual void merge(StatAggregator & other) = 0;
+
     /** Read and reset the counter, providing output in Graphite's preferred
         format. */
     virtual std::vector<StatReading> read(const std::string & prefix) = 0;
@@ -68,6 +75,8 @@ struct CounterAggregator : public StatAggregator {
 
     virtual void record(float value);
 
+    virtual void merge(StatAggregator & other);
+
     std::pair<double, Date> reset();
 
     /** Read and reset the counter, providing output in Graphite's preferred
@@ -106,6 +115,8 @@ struct GaugeAggregator : public StatAggregator {
     /** Record a new value of the stat.  Lock-free but may spin briefly. */
     virtual void record(float value);
 
+    virtual void merge(StatAggregator & other);
+
     /** Obtain a the current statistics and replace with a new version. */
     std::pair<ML::distribution<float> *, Date> reset();
 
@@ -122,4 +133,44 @@ private:
 };
 
 
+
+/*****************************************************************************/
+/* OUTCOME AGGREGATOR                                                        */
+/*****************************************************************************/
+
+/** Class that aggregates outcomes over a period of time in an HdrHistogram,
+    which uses a bounded amount of memory whatever the rate of the events.
+    Produces the same readings as a GaugeAggregator in Outcome mode, with
+    percentiles that are exact to within 1/HdrHistogram::SubBuckets.
+*/
+
+struct OutcomeAggregator : public StatAggregator {
+
+    OutcomeAggregator(const std::vector<int>& extra
+                          = DefaultOutcomePercentiles);
+
+    virtual ~OutcomeAggregator();
+
+    /** Record a new value of the stat.  Lock-free but may spin briefly. */
+    virtual void record(float value);
+
+    virtual void merge(StatAggregator & other);
+
+    /** Obtain the current histogram and replace it with an empty one. */
+    std::pair<HdrHistogram *, Date> reset();
+
+    /** Read and reset the histogram, providing output in Graphite's
+        preferred format.
+    */
+    virtual std::vector<StatReading> read(const std::string & prefix);
+
+private:
+    Date start;  //< Date at which we last cleared the histogram
+    HdrHistogram * volatile histogram;
+    std::vector<int> extra;
+
+    HdrHistogram * acquire();
+};
+
+
 } // namespace Datacratic
@@ -8,7 +8,12 @@
 #include "ace/INET_Addr.h"
 #include "jml/arch/exception.h"
 #include "jml/arch/format.h"
+#include "jml/compiler/compiler.h"
 #include <iostream>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
 
 using namespace std;
@@ -16,6 +21,25 @@ using namespace ML;
 
 namespace Datacratic {
 
+namespace {
+
+/* random() takes a process-wide lock, which all the threads recording stats
+   would contend for; each thread samples with its own generator instead. */
+thread_local unsigned int sampleSeed = 0;
+
+bool isSampled(float sampleRate)
+{
+    if (sampleRate >= 1.0)
+        return true;
+
+    if (JML_UNLIKELY(sampleSeed == 0))
+        sampleSeed = ::syscall(SYS_gettid) ^ ::time(nullptr) ^ 1;
+
+    return (rand_r(&sampleSeed) % 10000) / 10000.0 < sampleRate;
+}
+
+} // file scope
+
 
 /*****************************************************************************/
 /* STATSD CONNECTOR                                                          */
@@ -53,7 +77,7 @@ void
 StatsdConnector::
 incrementCounter(const char* counterName, float sampleRate, int value)
 {
-    if (sampleRate < 1.0 && ((random() % 10000) / 10000.0) >= sampleRate)
+    if (!isSampled(sampleRate))
         return;
 
     char msgBuf[1024];
@@ -75,7 +99,7 @@ void
 StatsdConnector::
 recordGauge(const char* counterName, float sampleRate, float value)
 {
-    if (sampleRate < 1.0 && ((random() % 10000) / 10000.0) >= sampleRate)
+    if (!isSampled(sampleRate))
         return;
 
     char msgBuf[1024];
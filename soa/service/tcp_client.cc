@@ -6,6 +6,7 @@
 */
 
 #include <netdb.h>
+#include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -32,7 +33,9 @@ TcpClient(const OnClosed & onClosed, const OnReceivedData & onReceivedData,
                         maxMessages, recvBufSize),
       port_(-1),
       state_(TcpClientState::Disconnected),
-      noNagle_(false)
+      noNagle_(false),
+      useCork_(false),
+      useMsgMore_(false)
 {
 }
 
@@ -52,7 +55,7 @@ void
 TcpClient::
 init(const Url & url)
 {
-    int port = url.url->EffectiveIntPort();
+    int port = url.gurl().EffectiveIntPort();
     init(url.host(), port);
 }
 
@@ -60,8 +63,10 @@ void
 TcpClient::
 init(const string & hostname, int port)
 {
+    /* A connection that was closed can be pointed to another address
+       before being reopened. */
     if (state_ == TcpClientState::Connecting
-        || state_ == TcpClientState::Connected) {
+        || (state_ == TcpClientState::Connected && getFd() != -1)) {
         throw ML::Exception("connection already pending or established");
     }
     if (hostname.empty()) {
@@ -85,6 +90,24 @@ setUseNagle(bool useNagle)
     noNagle_ = !useNagle;
 }
 
+void
+TcpClient::
+setUseCork(bool useCork)
+{
+    if (state() != Disconnected) {
+        throw ML::Exception("socket already created");
+    }
+
+    useCork_ = useCork;
+}
+
+void
+TcpClient::
+setUseMsgMore(bool useMsgMore)
+{
+    useMsgMore_ = useMsgMore;
+}
+
 void
 TcpClient::
 connect(const OnConnectionResult & onConnectionResult)
@@ -129,6 +152,10 @@ connect(const OnConnectionResult & onConnectionResult)
         }
     }
 
+    if (useCork_) {
+        setCork(socketFd, true);
+    }
+
     /* host resolution */
     struct sockaddr_in addr;
     addr.sin_port = htons(port_);
@@ -183,6 +210,45 @@ connect(const OnConnectionResult & onConnectionResult)
     success = true;
 }
 
+void
+TcpClient::
+setCork(int socketFd, bool cork)
+{
+    int flag = cork;
+    int res = setsockopt(socketFd, IPPROTO_TCP, TCP_CORK,
+                         (char *) &flag, sizeof(int));
+    if (res == -1) {
+        throw ML::Exception(errno, "setsockopt TCP_CORK");
+    }
+}
+
+ssize_t
+TcpClient::
+writeData(const ::iovec * iov, int iovcnt, bool more)
+{
+    ::msghdr msg;
+    ::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (::iovec *) iov;
+    msg.msg_iovlen = iovcnt;
+
+    int flags(MSG_NOSIGNAL);
+    if (more && useMsgMore_) {
+        flags |= MSG_MORE;
+    }
+
+    ssize_t res = ::sendmsg(getFd(), &msg, flags);
+
+    /* uncorking pushes the last partial frame out */
+    if (res > 0 && !more && useCork_) {
+        int error = errno;
+        setCork(getFd(), false);
+        setCork(getFd(), true);
+        errno = error;
+    }
+
+    return res;
+}
+
 void
 TcpClient::
 handleConnectionEvent(int socketFd, OnConnectionResult onConnectionResult)
@@ -104,6 +104,13 @@ struct TcpClient : public AsyncWriterSource
     /* disable the Nagle algorithm (TCP_NODELAY) */
     void setUseNagle(bool useNagle);
 
+    /* keep the socket corked (TCP_CORK) while writes are being flushed, so
+       that only full frames are sent until the write queue is drained */
+    void setUseCork(bool useCork);
+
+    /* flag the writes followed by more queued data with MSG_MORE */
+    void setUseMsgMore(bool useMsgMore);
+
     /* initiate or restore a connection to the target service */
     void connect(const OnConnectionResult & onConnectionResult);
 
@@ -111,7 +118,13 @@ struct TcpClient : public AsyncWriterSource
     TcpClientState state() const
     { return TcpClientState(state_); }
 
+protected:
+    /* AsyncWriterSource override, using sendmsg */
+    virtual ssize_t writeData(const ::iovec * iov, int iovcnt, bool more);
+
 private:
+    void setCork(int socketFd, bool cork);
+
     void handleConnectionEvent(int socketFd,
                                OnConnectionResult onConnectionResult);
     void handleConnectionResult();
@@ -120,6 +133,8 @@ private:
     int port_;
     int state_; /* TcpClientState */
     bool noNagle_;
+    bool useCork_;
+    bool useMsgMore_;
 
     EpollCallback handleConnectionEventCb_;
 };
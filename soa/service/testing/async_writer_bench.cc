@@ -184,14 +184,15 @@ void doBench(const string & label,
     }
 
     double totalTime = lastRead - start;
-    ::printf("%s,%d,%lu,%lu,%d,%f,%f,%f,%f,%f\n",
+    ::printf("%s,%d,%lu,%lu,%d,%f,%f,%f,%f,%f,%lu,%lu\n",
              label.c_str(),
              numMessages, msgSize, bytesRead, numMissed,
              (lastWrite - start),
              (lastWriteResult - start),
              totalTime,
              (double(numMessages) / totalTime),
-             (double(totalBytes) / totalTime));
+             (double(totalBytes) / totalTime),
+             writer->writeCalls(), writer->coalescedWrites());
 
     readerLoop.shutdown();
     writerLoop.shutdown();
@@ -213,7 +214,7 @@ int main()
 {
     ::printf("label,msgs_count,msg_size,bytes_xfer,miss_count,"
              "delta_last_write,delta_last_written,delta_last_read,"
-             "msg_rate,byte_rate\n");
+             "msg_rate,byte_rate,write_calls,coalesced_writes\n");
 
     benchFunction("pipe", makePipePair);
     benchFunction("unix", makeUnixSocketPair);
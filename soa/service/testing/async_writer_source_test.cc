@@ -0,0 +1,104 @@
+/* async_writer_source_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests the coalescing of the writes performed by AsyncWriterSource.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+#include "jml/arch/futex.h"
+#include "soa/service/message_loop.h"
+#include "soa/service/async_writer_source.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+struct WriterSource : public AsyncWriterSource {
+    WriterSource(int fd)
+        : AsyncWriterSource(nullptr, nullptr, nullptr, 0, 0)
+    {
+        setFd(fd);
+    }
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_coalesced_writes )
+{
+    enum { NumMessages = 1000 };
+
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0,
+                                   fds), 0);
+
+    /* the messages are all queued before the writer is part of a loop, and
+       thus end up being flushed together */
+    auto writer = make_shared<WriterSource>(fds[0]);
+    string expected;
+    int numResults(0);
+    int lastResult(-1);
+    bool ordered(true);
+    for (int i = 0; i < NumMessages; i++) {
+        string message = "message " + to_string(i) + "\n";
+        expected += message;
+        auto onWriteResult = [&, i] (AsyncWriteResult result) {
+            BOOST_CHECK_EQUAL(result.error, 0);
+            if (i != lastResult + 1) {
+                ordered = false;
+            }
+            lastResult = i;
+            numResults++;
+            if (numResults == NumMessages) {
+                ML::futex_wake(numResults);
+            }
+        };
+        BOOST_REQUIRE(writer->write(message, onWriteResult));
+    }
+
+    MessageLoop loop;
+    loop.addSource("writer", writer);
+    loop.start();
+
+    while (numResults < NumMessages) {
+        int old = numResults;
+        ML::futex_wait(numResults, old, 1.0);
+    }
+    BOOST_CHECK(ordered);
+
+    string received;
+    char buffer[65536];
+    while (received.size() < expected.size()) {
+        ssize_t len = ::read(fds[1], buffer, sizeof(buffer));
+        if (len > 0) {
+            received.append(buffer, len);
+        }
+        else {
+            BOOST_REQUIRE(len == -1 && errno == EAGAIN);
+            ::usleep(1000);
+        }
+    }
+    BOOST_CHECK(received == expected);
+
+    BOOST_CHECK_EQUAL(writer->msgsSent(), NumMessages);
+    BOOST_CHECK_EQUAL(writer->bytesSent(), expected.size());
+    BOOST_CHECK_LT(writer->writeCalls(), NumMessages / 10);
+    BOOST_CHECK_EQUAL(writer->coalescedWrites() + writer->writeCalls(),
+                      NumMessages);
+
+    loop.removeSourceSync(writer.get());
+    loop.shutdown();
+    ::close(fds[1]);
+}
@@ -14,6 +14,8 @@
 #include "jml/arch/timers.h"
 #include "soa/service/passive_endpoint.h"
 #include <boost/make_shared.hpp>
+#include <map>
+#include <sstream>
 
 
 using namespace std;
@@ -169,6 +171,61 @@ BOOST_AUTO_TEST_CASE( test_multi_aggregator )
     BOOST_CHECK_EQUAL(readings[0].value, 50.0);
 }
 
+BOOST_AUTO_TEST_CASE( test_multi_aggregator_threads )
+{
+    // Each thread records in its own aggregators; they must all be merged
+    // when dumping, including those of the threads that have exited.
+
+    MultiAggregator agg;
+    auto handle = agg.intern("interned", ET_COUNT);
+
+    uint64_t nthreads = 8, iter = 100000;
+    boost::barrier barrier(nthreads);
+    boost::thread_group tg;
+    for (unsigned i = 0;  i < nthreads;  ++i) {
+        auto doThread = [&, i] ()
+            {
+                barrier.wait();
+
+                for (unsigned j = 0;  j < iter;  ++j) {
+                    agg.record(handle);
+                    agg.recordHit("byName");
+                    agg.recordLevel("level", i);
+                }
+            };
+
+        tg.create_thread(doThread);
+    }
+
+    tg.join_all();
+
+    std::map<std::string, double> values;
+    auto readValues = [&] ()
+        {
+            std::stringstream stream;
+            agg.dumpSync(stream);
+
+            values.clear();
+            string line;
+            while (getline(stream, line)) {
+                size_t pos = line.rfind(':');
+                values[line.substr(0, pos)] = stod(line.substr(pos + 1));
+            }
+        };
+
+    readValues();
+    BOOST_CHECK_EQUAL(values["interned"], nthreads * iter);
+    BOOST_CHECK_EQUAL(values["byName"], nthreads * iter);
+    BOOST_CHECK_EQUAL(values["level.lower"], 0);
+    BOOST_CHECK_EQUAL(values["level.upper"], nthreads - 1);
+    BOOST_CHECK_EQUAL(values["level.mean"], (nthreads - 1) / 2.0);
+
+    // Nothing more was recorded, and the gauge has nothing to report
+    readValues();
+    BOOST_CHECK_EQUAL(values["interned"], nthreads * iter / 2);
+    BOOST_CHECK_EQUAL(values.count("level.mean"), 0);
+}
+
 struct FakeCarbon : public PassiveEndpointT<SocketTransport> {
 
     FakeCarbon()
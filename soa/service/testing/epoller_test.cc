@@ -0,0 +1,206 @@
+/* epoller_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests that the epoll and io_uring backends of the Epoller behave the same.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <map>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+#include "soa/service/epoller.h"
+#include "soa/service/io_uring_poller.h"
+
+using namespace std;
+using namespace Datacratic;
+
+namespace {
+
+vector<Epoller::Backend> backends()
+{
+    vector<Epoller::Backend> result = { Epoller::EpollBackend };
+    if (IoUringPoller::supported())
+        result.push_back(Epoller::IoUringBackend);
+    else cerr << "io_uring is not supported, only testing epoll" << endl;
+    return result;
+}
+
+struct Pipe {
+    Pipe()
+    {
+        BOOST_REQUIRE_EQUAL(::pipe2(fds, O_NONBLOCK), 0);
+    }
+
+    ~Pipe()
+    {
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+
+    void write()
+    {
+        char c = 'x';
+        BOOST_REQUIRE_EQUAL(::write(fds[1], &c, 1), 1);
+    }
+
+    void drain()
+    {
+        char buf[64];
+        while (::read(fds[0], buf, sizeof(buf)) > 0);
+    }
+
+    int fds[2];
+};
+
+/** Handles whatever is ready right now, counting the wakeups of each fd. */
+int handle(Epoller & epoller, map<void *, int> & wakeups)
+{
+    auto onEvent = [&] (epoll_event & event) {
+        wakeups[event.data.ptr]++;
+        return Epoller::DONE;
+    };
+
+    return epoller.handleEvents(1000, 16, onEvent);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_level_triggered )
+{
+    for (auto backend: backends()) {
+        BOOST_TEST_MESSAGE("backend " << backend);
+
+        Epoller epoller;
+        epoller.init(16, 0, backend);
+        BOOST_CHECK_EQUAL(epoller.backend(), backend);
+
+        Pipe a, b;
+        epoller.addFd(a.fds[0], &a);
+        epoller.addFd(b.fds[0], &b);
+
+        map<void *, int> wakeups;
+        BOOST_CHECK_EQUAL(handle(epoller, wakeups), 0);
+
+        a.write();
+        BOOST_CHECK(epoller.poll() || backend == Epoller::IoUringBackend);
+        BOOST_CHECK_EQUAL(handle(epoller, wakeups), 1);
+        BOOST_CHECK_EQUAL(wakeups[&a], 1);
+
+        // Still readable so we hear about it again
+        BOOST_CHECK_EQUAL(handle(epoller, wakeups), 1);
+        BOOST_CHECK_EQUAL(wakeups[&a], 2);
+
+        a.drain();
+        b.write();
+        BOOST_CHECK_EQUAL(handle(epoller, wakeups), 1);
+        BOOST_CHECK_EQUAL(wakeups[&b], 1);
+        BOOST_CHECK_EQUAL(wakeups[&a], 2);
+
+        b.drain();
+        epoller.removeFd(b.fds[0]);
+        b.write();
+        BOOST_CHECK_EQUAL(handle(epoller, wakeups), 0);
+        BOOST_CHECK_EQUAL(wakeups[&b], 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_one_shot )
+{
+    for (auto backend: backends()) {
+        BOOST_TEST_MESSAGE("backend " << backend);
+
+        Epoller epoller;
+        epoller.init(16, 0, backend);
+
+        Pipe a;
+        epoller.addFdOneShot(a.fds[0], &a);
+
+        map<void *, int> wakeups;
+        a.write();
+        BOOST_CHECK_EQUAL(handle(epoller, wakeups), 1);
+        BOOST_CHECK_EQUAL(handle(epoller, wakeups), 0);
+
+        epoller.restartFdOneShot(a.fds[0], &a);
+        BOOST_CHECK_EQUAL(handle(epoller, wakeups), 1);
+        BOOST_CHECK_EQUAL(wakeups[&a], 2);
+
+        // Rearming from within the handler, as the MessageLoop does
+        auto onEvent = [&] (epoll_event & event) {
+            wakeups[event.data.ptr]++;
+            epoller.restartFdOneShot(a.fds[0], &a);
+            return Epoller::DONE;
+        };
+        epoller.restartFdOneShot(a.fds[0], &a);
+        BOOST_CHECK_EQUAL(epoller.handleEvents(1000, 16, onEvent), 1);
+        BOOST_CHECK_EQUAL(handle(epoller, wakeups), 1);
+        BOOST_CHECK_EQUAL(wakeups[&a], 4);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_wakeup_from_other_thread )
+{
+    for (auto backend: backends()) {
+        BOOST_TEST_MESSAGE("backend " << backend);
+
+        Epoller epoller;
+        epoller.init(16, -1, backend);
+
+        Pipe a;
+        std::thread writer([&] () {
+                ::usleep(10000);
+                epoller.addFd(a.fds[0], &a);
+                a.write();
+            });
+
+        // Blocks until the writer added its fd and wrote to it
+        map<void *, int> wakeups;
+        int res = 0;
+        while (res == 0)
+            res = epoller.handleEvents(0, 16, [&] (epoll_event & event) {
+                    wakeups[event.data.ptr]++;
+                    return Epoller::DONE;
+                });
+        writer.join();
+
+        BOOST_CHECK_EQUAL(res, 1);
+        BOOST_CHECK_EQUAL(wakeups[&a], 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_nested )
+{
+    // The ring fd has to work as the select fd of a nested source
+    for (auto backend: backends()) {
+        BOOST_TEST_MESSAGE("backend " << backend);
+
+        Epoller outer, inner;
+        outer.init(16, 0, Epoller::EpollBackend);
+        inner.init(16, 0, backend);
+        outer.addFd(inner.selectFd(), &inner);
+
+        Pipe a;
+        inner.addFd(a.fds[0], &a);
+
+        map<void *, int> outerWakeups, innerWakeups;
+        BOOST_CHECK_EQUAL(handle(outer, outerWakeups), 0);
+
+        a.write();
+        BOOST_CHECK_EQUAL(handle(outer, outerWakeups), 1);
+        BOOST_CHECK_EQUAL(handle(inner, innerWakeups), 1);
+
+        a.drain();
+        BOOST_CHECK_EQUAL(handle(inner, innerWakeups), 0);
+        a.write();
+        BOOST_CHECK_EQUAL(handle(outer, outerWakeups), 1);
+        BOOST_CHECK_EQUAL(handle(inner, innerWakeups), 1);
+        BOOST_CHECK_EQUAL(innerWakeups[&a], 2);
+    }
+}
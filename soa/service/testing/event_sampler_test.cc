@@ -0,0 +1,88 @@
+/* event_sampler_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests of the sampling of the events recorded by services.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "jml/arch/exception.h"
+#include "soa/service/event_sampler.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_sample_rates )
+{
+    EventSampler sampler;
+
+    StatEventType type(ET_HIT);
+    float value(1.0);
+    BOOST_CHECK(sampler.sample("router", "hit", type, value));
+    BOOST_CHECK_EQUAL(type, ET_HIT);
+
+    sampler.setSampleRate("router.filter", 0.1);
+    sampler.setSampleRate("router.filter.important", 1.0);
+    BOOST_CHECK_EQUAL(sampler.getSampleRate("router.filter.reason"), 0.1);
+    BOOST_CHECK_EQUAL(sampler.getSampleRate("router.filter.important.x"),
+                      1.0);
+    BOOST_CHECK_EQUAL(sampler.getSampleRate("router.other"), 1.0);
+    BOOST_CHECK_THROW(sampler.setSampleRate("x", 0.0), ML::Exception);
+
+    /* sampled hits become counts, scaled so that their total is kept */
+    enum { NumEvents = 100000 };
+    double total(0.0);
+    int kept(0);
+    for (int i = 0; i < NumEvents; i++) {
+        type = ET_HIT;
+        value = 1.0;
+        if (sampler.sample("router", "filter.reason", type, value)) {
+            BOOST_REQUIRE_EQUAL(type, ET_COUNT);
+            total += value;
+            kept++;
+        }
+    }
+    BOOST_CHECK_CLOSE(total, double(NumEvents), 5.0);
+    BOOST_CHECK_EQUAL(kept + sampler.numSampledOut(), NumEvents);
+
+    /* levels are sampled but not scaled */
+    type = ET_LEVEL;
+    value = 3.0;
+    while (!sampler.sample("router", "filter.level", type, value));
+    BOOST_CHECK_EQUAL(value, 3.0);
+
+    type = ET_HIT;
+    value = 1.0;
+    BOOST_CHECK(sampler.sample("router", "filter.important.x", type, value));
+    BOOST_CHECK_EQUAL(value, 1.0);
+}
+
+BOOST_AUTO_TEST_CASE( test_metric_budget )
+{
+    EventSampler sampler;
+    sampler.setMetricBudget(2);
+
+    StatEventType type(ET_HIT);
+    float value(1.0);
+    BOOST_CHECK(sampler.sample("", "a", type, value));
+    BOOST_CHECK(sampler.sample("", "b", type, value));
+    BOOST_CHECK(!sampler.sample("", "c", type, value));
+    BOOST_CHECK(sampler.sample("", "a", type, value));
+    BOOST_CHECK_EQUAL(sampler.numOverBudget(), 1);
+
+    /* the configuration replaces everything and can be read back */
+    Json::Value config;
+    config["metricBudget"] = 0;
+    config["sampleRates"]["router.filter"] = 0.5;
+    sampler.setConfig(config);
+    BOOST_CHECK(sampler.sample("", "c", type, value));
+    BOOST_CHECK_EQUAL(sampler.getConfig().toString(), config.toString());
+
+    config["sampleRates"]["router.filter"] = 2.0;
+    BOOST_CHECK_THROW(sampler.setConfig(config), ML::Exception);
+    BOOST_CHECK_EQUAL(sampler.getSampleRate("router.filter"), 0.5);
+}
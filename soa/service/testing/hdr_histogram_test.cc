@@ -0,0 +1,125 @@
+/* hdr_histogram_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests of the HdrHistogram and of the OutcomeAggregator.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <math.h>
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+#include "soa/service/hdr_histogram.h"
+#include "soa/service/stat_aggregator.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+/* The buckets are ordered like the values, and the upper bound of a bucket
+ * is at most 1/SubBuckets away from its values. */
+BOOST_AUTO_TEST_CASE( test_buckets )
+{
+    int lastIndex(-1);
+    for (float value = -1000.0; value < 1000.0; value += 0.01) {
+        int index = HdrHistogram::bucketIndex(value);
+        BOOST_REQUIRE_GE(index, lastIndex);
+        float upper = HdrHistogram::bucketUpperBound(index);
+        BOOST_REQUIRE_GE(upper, value);
+        BOOST_REQUIRE_LE(upper - value,
+                         fabs(value) * 2 / HdrHistogram::SubBuckets + 1e-6);
+        lastIndex = index;
+    }
+
+    BOOST_CHECK_EQUAL(HdrHistogram::bucketIndex(0.0), HdrHistogram::ZeroIndex);
+    BOOST_CHECK_EQUAL(HdrHistogram::bucketIndex(-0.0), HdrHistogram::ZeroIndex);
+    BOOST_CHECK_EQUAL(HdrHistogram::bucketIndex(INFINITY),
+                      HdrHistogram::NumBuckets - 1);
+    BOOST_CHECK_EQUAL(HdrHistogram::bucketIndex(-INFINITY), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_percentiles )
+{
+    HdrHistogram histogram;
+    BOOST_CHECK_EQUAL(histogram.percentile(50), 0.0);
+
+    for (int i = 1; i <= 1000; i++)
+        histogram.record(i * 0.5);
+    histogram.record(NAN);
+
+    BOOST_CHECK_EQUAL(histogram.count(), 1000);
+    BOOST_CHECK_EQUAL(histogram.min(), 0.5);
+    BOOST_CHECK_EQUAL(histogram.max(), 500.0);
+    BOOST_CHECK_CLOSE(histogram.mean(), 250.25, 1e-6);
+
+    double tolerance = 100.0 / HdrHistogram::SubBuckets;
+    BOOST_CHECK_CLOSE(histogram.percentile(50), 250.0, tolerance);
+    BOOST_CHECK_CLOSE(histogram.percentile(90), 450.0, tolerance);
+    BOOST_CHECK_CLOSE(histogram.percentile(99), 495.0, tolerance);
+    BOOST_CHECK_EQUAL(histogram.percentile(100), 500.0);
+    BOOST_CHECK_EQUAL(histogram.percentile(0), 0.5);
+
+    HdrHistogram negative;
+    for (int i = 1; i <= 100; i++)
+        negative.record(-i);
+    BOOST_CHECK_EQUAL(negative.percentile(100), -1.0);
+    BOOST_CHECK_CLOSE(negative.percentile(50), -50.0, tolerance);
+}
+
+/* Merged histograms give the percentiles of all of their values, and survive
+ * serialization. */
+BOOST_AUTO_TEST_CASE( test_merge_serialize )
+{
+    HdrHistogram low, high, all;
+    for (int i = 0; i < 1000; i++) {
+        low.record(i * 0.001);
+        high.record(1000 + i);
+        all.record(i * 0.001);
+        all.record(1000 + i);
+    }
+
+    HdrHistogram merged = HdrHistogram::fromBinary(low.toBinary());
+    merged += HdrHistogram::fromBinary(high.toBinary());
+
+    BOOST_CHECK_EQUAL(merged.count(), all.count());
+    BOOST_CHECK_EQUAL(merged.min(), all.min());
+    BOOST_CHECK_EQUAL(merged.max(), all.max());
+    BOOST_CHECK_EQUAL(merged.sum(), all.sum());
+    for (double pct: { 1.0, 25.0, 50.0, 75.0, 99.0 })
+        BOOST_CHECK_EQUAL(merged.percentile(pct), all.percentile(pct));
+
+    BOOST_CHECK_LT(merged.toBinary().size(), 1500);
+
+    string bad = all.toBinary();
+    bad[0] = 1;
+    BOOST_CHECK_THROW(HdrHistogram::fromBinary(bad), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_outcome_aggregator )
+{
+    OutcomeAggregator aggregator({ 50, 90 });
+    OutcomeAggregator other({ 50, 90 });
+    for (int i = 1; i <= 100; i++) {
+        aggregator.record(i);
+        other.record(100 + i);
+    }
+    aggregator.merge(other);
+
+    map<string, float> values;
+    for (auto & reading: aggregator.read("latency"))
+        values[reading.name] = reading.value;
+
+    BOOST_CHECK_EQUAL(values.size(), 6);
+    BOOST_CHECK_EQUAL(values["latency.count"], 200);
+    BOOST_CHECK_EQUAL(values["latency.lower"], 1);
+    BOOST_CHECK_EQUAL(values["latency.upper"], 200);
+    BOOST_CHECK_CLOSE(values["latency.mean"], 100.5, 1e-4);
+    BOOST_CHECK_CLOSE(values["latency.upper_50"], 100, 100.0 / 32);
+    BOOST_CHECK_CLOSE(values["latency.upper_90"], 180, 100.0 / 32);
+
+    BOOST_CHECK(aggregator.read("latency").empty());
+    BOOST_CHECK(other.read("latency").empty());
+}
@@ -33,21 +33,42 @@ enum HttpMethod {
 
 /* bench methods */
 
+/* Pool settings, used with the async model. Requests are sent in "rounds"
+   bursts of "maxReqs" requests separated by "pause" seconds, so that with a
+   pause longer than "idleTimeout" the pool has to shrink and grow again. */
+struct PoolSettings {
+    PoolSettings()
+        : minConnections(0), idleTimeout(0), timeout(-1), rounds(1), pause(0)
+    {}
+
+    int minConnections;
+    double idleTimeout;
+    int timeout;
+    int rounds;
+    double pause;
+};
+
 double
 AsyncModelBench(HttpMethod method,
                 const string & baseUrl, const string & payload,
-                int maxReqs, int concurrency)
+                int maxReqs, int concurrency,
+                const PoolSettings & pool = PoolSettings())
 {
     int numReqs, numResponses(0), numMissed(0);
+    atomic<int> numErrors(0);
     MessageLoop loop(1, 0, -1);
     loop.start();
 
     auto client = make_shared<HttpClient>(baseUrl, concurrency);
+    client->setConnectionPool(pool.minConnections, pool.idleTimeout);
     loop.addSource("client", client);
     client->waitConnectionState(AsyncEventSource::CONNECTED);
 
     auto onResponse = [&] (const HttpRequest & rq, HttpClientError errorCode_,
                            int status, string && headers, string && body) {
+        if (errorCode_ != HttpClientError::None) {
+            numErrors++;
+        }
         numResponses++;
         // if (numResponses % 1000) {
             // cerr << "resps: "  + to_string(numResponses) + "\n";
@@ -62,38 +83,49 @@ AsyncModelBench(HttpMethod method,
 
     auto & clientRef = *client.get();
     string url("/");
+    double paused(0);
     Date start = Date::now();
-    for (numReqs = 0; numReqs < maxReqs;) {
-        bool result;
-        if (method == GET) {
-            result = clientRef.get(url, cbs);
+    for (int round = 0; round < pool.rounds; round++) {
+        if (round > 0) {
+            ::usleep(pool.pause * 1000000);
+            paused += pool.pause;
+            numResponses = 0;
         }
-        else if (method == POST) {
-            result = clientRef.post(url, cbs, content);
-        }
-        else if (method == PUT) {
-            result = clientRef.put(url, cbs, content);
-        }
-        else {
-            result = true;
-        }
-        if (result) {
-            numReqs++;
-            // if (numReqs % 1000) {
-            //     cerr << "reqs: "  + to_string(numReqs) + "\n";
-            // }
-        }
-        else {
-            numMissed++;
+        for (numReqs = 0; numReqs < maxReqs;) {
+            bool result;
+            if (method == GET) {
+                result = clientRef.get(url, cbs, RestParams(), RestParams(),
+                                       pool.timeout);
+            }
+            else if (method == POST) {
+                result = clientRef.post(url, cbs, content, RestParams(),
+                                        RestParams(), pool.timeout);
+            }
+            else if (method == PUT) {
+                result = clientRef.put(url, cbs, content, RestParams(),
+                                       RestParams(), pool.timeout);
+            }
+            else {
+                result = true;
+            }
+            if (result) {
+                numReqs++;
+                // if (numReqs % 1000) {
+                //     cerr << "reqs: "  + to_string(numReqs) + "\n";
+                // }
+            }
+            else {
+                numMissed++;
+            }
         }
-    }
 
-    while (numResponses < maxReqs) {
-        // cerr << (" num Responses: " + to_string(numResponses)
-        //          + "; max reqs: " + to_string(maxReqs)
-        //          + "\n");
-        int old(numResponses);
-        ML::futex_wait(numResponses, old);
+        while (numResponses < maxReqs) {
+            // cerr << (" num Responses: " + to_string(numResponses)
+            //          + "; max reqs: " + to_string(maxReqs)
+            //          + "\n");
+            int old(numResponses);
+            ML::futex_wait(numResponses, old);
+        }
     }
     Date end = Date::now();
 
@@ -101,8 +133,9 @@ AsyncModelBench(HttpMethod method,
     client->waitConnectionState(AsyncEventSource::DISCONNECTED);
 
     cerr << "num misses: "  + to_string(numMissed) + "\n";
+    cerr << "num errors: "  + to_string(numErrors) + "\n";
 
-    return end - start;
+    return end - start - paused;
 }
 
 double
@@ -153,6 +186,7 @@ int main(int argc, char *argv[])
     unsigned int maxReqs(0);
     string method("GET");
     unsigned int payloadSize(0);
+    PoolSettings pool;
 
     string serveriface("127.0.0.1");
     string clientiface(serveriface);
@@ -173,6 +207,16 @@ int main(int argc, char *argv[])
          "total of number of requests to perform")
         ("payload-size,s", value(&payloadSize),
          "size of the response body")
+        ("min-connections", value(&pool.minConnections),
+         "connections kept open by the async client when idle")
+        ("idle-timeout", value(&pool.idleTimeout),
+         "seconds after which idle connections are closed (0 = never)")
+        ("timeout", value(&pool.timeout),
+         "timeout of each request in seconds")
+        ("rounds", value(&pool.rounds),
+         "number of bursts of \"requests\" requests (async model)")
+        ("pause", value(&pool.pause),
+         "seconds between two bursts")
         ("server-iface,S", value(&serveriface),
          "server address (\"none\" for no server)")
         ("help,H", "show help");
@@ -261,7 +305,8 @@ int main(int argc, char *argv[])
 
         double delta;
         if (model == 1) {
-            delta = AsyncModelBench(httpMethod, baseUrl, payload, maxReqs, concurrency);
+            delta = AsyncModelBench(httpMethod, baseUrl, payload, maxReqs,
+                                    concurrency, pool);
         }
         else if (model == 2) {
             delta = ThreadedModelBench(httpMethod, baseUrl, payload, maxReqs, concurrency);
@@ -269,6 +314,9 @@ int main(int argc, char *argv[])
         else {
             throw ML::Exception("invalid 'model'");
         }
+        if (model == 1) {
+            maxReqs *= pool.rounds;
+        }
         double qps = maxReqs / delta;
         double bps = double(maxReqs * payload.size()) / delta;
         ::printf("%d\t%u\t%u\t%u\t%f\t%f\t%f\n",
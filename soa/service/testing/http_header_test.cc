@@ -122,3 +122,24 @@ BOOST_AUTO_TEST_CASE(test_http_header_space_as_plus)
 
     testQueryParam(header, "arg1", "1 2");
 }
+
+/* parsing directly out of a receive buffer only looks at the given range */
+BOOST_AUTO_TEST_CASE(test_http_header_parse_buffer)
+{
+    const std::string request = "POST /auctions HTTP/1.1\r\n"
+                                "Content-Type: application/json\r\n"
+                                "Content-Length: 7\r\n"
+                                "X-Openrtb-Version: 2.1\r\n"
+                                "\r\n"
+                                "{\"a\":1}GARBAGE";
+
+    Datacratic::HttpHeader header;
+    header.parseBuffer(request.c_str(), request.length() - 7);
+
+    BOOST_CHECK_EQUAL(header.verb, "POST");
+    BOOST_CHECK_EQUAL(header.resource, "/auctions");
+    BOOST_CHECK_EQUAL(header.contentType, "application/json");
+    BOOST_CHECK_EQUAL(header.contentLength, 7);
+    BOOST_CHECK_EQUAL(header.getHeader("x-openrtb-version"), "2.1");
+    BOOST_CHECK_EQUAL(header.knownData, "{\"a\":1}");
+}
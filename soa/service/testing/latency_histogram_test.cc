@@ -0,0 +1,76 @@
+/* latency_histogram_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests of the LatencyHistogram.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "soa/service/latency_histogram.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+/* The buckets must cover every value without gaps, with a width that is at
+ * most 1/SubBuckets of their values. */
+BOOST_AUTO_TEST_CASE( test_buckets )
+{
+    int lastIndex(-1);
+    for (uint64_t value = 0; value < 1000000; value++) {
+        int index = LatencyHistogram::bucketIndex(value);
+        BOOST_REQUIRE(index == lastIndex || index == lastIndex + 1);
+        BOOST_REQUIRE_GE(LatencyHistogram::bucketUpperBound(index), value);
+        if (index != lastIndex && index > 0) {
+            BOOST_REQUIRE_EQUAL(LatencyHistogram::bucketUpperBound(index - 1),
+                                value - 1);
+        }
+        lastIndex = index;
+    }
+
+    uint64_t value = 123456789;
+    uint64_t upper = LatencyHistogram::bucketUpperBound(
+        LatencyHistogram::bucketIndex(value));
+    BOOST_CHECK_LE(upper - value, value / LatencyHistogram::SubBuckets);
+
+    BOOST_CHECK_EQUAL(LatencyHistogram::bucketIndex(-1),
+                      LatencyHistogram::NumBuckets - 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_percentiles )
+{
+    LatencyHistogram histogram;
+    BOOST_CHECK_EQUAL(histogram.percentile(50), 0);
+
+    for (uint64_t value = 1; value <= 10000; value++) {
+        histogram.record(value);
+    }
+    BOOST_CHECK_EQUAL(histogram.count(), 10000);
+    BOOST_CHECK_EQUAL(histogram.max(), 10000);
+    BOOST_CHECK_EQUAL(histogram.percentile(100), 10000);
+
+    uint64_t median = histogram.percentile(50);
+    BOOST_CHECK_GE(median, 5000);
+    BOOST_CHECK_LE(median, 5000 + 5000 / LatencyHistogram::SubBuckets);
+
+    uint64_t p99 = histogram.percentile(99);
+    BOOST_CHECK_GE(p99, 9900);
+    BOOST_CHECK_LE(p99, 10000);
+
+    /* the difference with an earlier copy holds the values recorded since */
+    LatencyHistogram earlier(histogram);
+    for (int i = 0; i < 100; i++) {
+        histogram.record(1000000);
+    }
+    LatencyHistogram delta(histogram);
+    delta -= earlier;
+    BOOST_CHECK_EQUAL(delta.count(), 100);
+    BOOST_CHECK_GE(delta.percentile(1), 1000000);
+
+    histogram.clear();
+    BOOST_CHECK_EQUAL(histogram.count(), 0);
+    BOOST_CHECK_EQUAL(histogram.max(), 0);
+}
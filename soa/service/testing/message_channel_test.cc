@@ -89,6 +89,56 @@ BOOST_AUTO_TEST_CASE( test_message_channel )
     }
 }
 
+BOOST_AUTO_TEST_CASE( test_typed_message_ring_sink )
+{
+    const int numThreads = 8;
+    const int numMessages = 100000;
+
+    ML::Watchdog watchdog(60.0);
+
+    // Each message is (thread, sequence); the ring is small so that the
+    // producers keep running into a full ring
+    TypedMessageRingSink<std::pair<int, int> > sink(64, 16);
+
+    vector<int> lastSeen(numThreads, -1);
+    int numReceived = 0;
+    int outOfOrder = 0;
+
+    sink.onEvent = [&] (std::pair<int, int> && message)
+        {
+            if (message.second != lastSeen[message.first] + 1)
+                ++outOfOrder;
+            lastSeen[message.first] = message.second;
+            ML::atomic_inc(numReceived);
+        };
+
+    MessageLoop loop;
+    loop.addSource("sink", sink);
+    loop.start();
+
+    auto pushThread = [&] (int thread)
+        {
+            for (int i = 0;  i < numMessages / numThreads;  ++i)
+                sink.push(std::make_pair(thread, i));
+        };
+
+    vector<std::thread> threads;
+    for (int i = 0;  i < numThreads;  ++i)
+        threads.emplace_back(pushThread, i);
+    for (auto & thread: threads)
+        thread.join();
+
+    // Every push has to have woken the loop up eventually
+    while (numReceived < numMessages)
+        ML::sleep(0.01);
+
+    loop.shutdown();
+
+    BOOST_CHECK_EQUAL(numReceived, numMessages);
+    BOOST_CHECK_EQUAL(outOfOrder, 0);
+    BOOST_CHECK(!sink.poll());
+}
+
 namespace Datacratic {
 
 BOOST_AUTO_TEST_CASE( test_typed_message_queue )
@@ -209,4 +259,91 @@ BOOST_AUTO_TEST_CASE( test_typed_message_queue )
     }
 }
 
+BOOST_AUTO_TEST_CASE( test_typed_message_ring_queue )
+{
+    {
+        TypedMessageRingQueue<string> queue(nullptr, 5);
+        BOOST_CHECK_EQUAL(queue.capacity(), 8);
+        BOOST_CHECK(queue.empty());
+
+        for (int i = 0; i < 8; i++) {
+            BOOST_CHECK(queue.push_back("message " + to_string(i)));
+        }
+        BOOST_CHECK(!queue.push_back("one too many"));
+
+        /* pop front 1: a single element */
+        auto msgs = queue.pop_front(1);
+        BOOST_CHECK_EQUAL(msgs.size(), 1);
+        BOOST_CHECK_EQUAL(msgs[0], "message 0");
+
+        /* in place, in order */
+        vector<string> drained;
+        size_t done = queue.pop_front(3, [&] (string && message) {
+                drained.emplace_back(move(message));
+            });
+        BOOST_CHECK_EQUAL(done, 3);
+        BOOST_CHECK_EQUAL(drained.size(), 3);
+        BOOST_CHECK_EQUAL(drained.back(), "message 3");
+
+        /* all elements requested */
+        msgs = queue.pop_front(0);
+        BOOST_CHECK_EQUAL(msgs.size(), 4);
+        BOOST_CHECK_EQUAL(msgs.back(), "message 7");
+        BOOST_CHECK(queue.empty());
+    }
+
+    /* multiple producers and a MessageLoop */
+    {
+        const int numThreads(20);
+        const size_t numMessages(100000);
+
+        ML::Watchdog watchdog(120);
+
+        MessageLoop loop;
+        loop.start();
+
+        size_t numNotifications(0);
+        size_t numPopped(0);
+
+        shared_ptr<TypedMessageRingQueue<string> > queue;
+        auto onNotify = [&]() {
+            numNotifications++;
+            numPopped += queue->pop_front(0, [] (string && message) {});
+        };
+        queue.reset(new TypedMessageRingQueue<string>(onNotify, 1024));
+        loop.addSource("queue", queue);
+
+        size_t sliceSize = numMessages/numThreads;
+        auto threadFn = [&] (int threadNum) {
+            size_t base = threadNum * sliceSize;
+            for (size_t i = 0; i < sliceSize; i++) {
+                while (!queue->push_back("This is message "
+                                         + to_string(base + i))) {
+                    std::this_thread::yield();
+                }
+            }
+        };
+
+        vector<thread> workers;
+        for (int i = 0; i < numThreads; i++) {
+            workers.emplace_back(threadFn, i);
+        }
+        for (thread & worker: workers) {
+            worker.join();
+        }
+
+        while (numPopped < numMessages) {
+            ML::sleep(0.2);
+        };
+
+        cerr << ("numNotifications: " + to_string(numNotifications)
+                 + "; numPopped: "  + to_string(numPopped)
+                 + "\n");
+        BOOST_CHECK_EQUAL(numPopped, numMessages);
+        BOOST_CHECK_LT(numNotifications, numMessages);
+
+        loop.removeSourceSync(queue.get());
+    }
+}
+
 } // namespace Datacratic
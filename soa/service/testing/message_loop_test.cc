@@ -1,10 +1,15 @@
 #define BOOST_TEST_MAIN
 #define BOOST_TEST_DYN_LINK
 
+#include <atomic>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
 
 #include <boost/test/unit_test.hpp>
 
+#include "jml/arch/tick_counter.h"
 #include "jml/arch/timers.h"
 #include "jml/utils/testing/watchdog.h"
 
@@ -102,3 +107,187 @@ BOOST_AUTO_TEST_CASE( test_addSource_after_before_start )
         }
     }
 }
+
+/* This test ensures that a loop with several threads handles all the
+ * messages of its sources, spreading them over its threads without ever
+ * running the same source from two threads at once. */
+BOOST_AUTO_TEST_CASE( test_work_stealing )
+{
+    ML::Watchdog wd(30);
+    const int numSources(16);
+    const int numMessages(20000);
+
+    MessageLoop loop(4);
+    BOOST_CHECK_EQUAL(loop.numThreads(), 4);
+
+    typedef TypedMessageSink<int> TestSource;
+
+    vector<shared_ptr<TestSource> > sources;
+    vector<unique_ptr<std::atomic<int> > > running;
+    std::atomic<int> received(0);
+    std::atomic<int> overlaps(0);
+    std::mutex threadsLock;
+    set<std::thread::id> threadIds;
+
+    for (int i = 0; i < numSources; i++) {
+        sources.emplace_back(new TestSource(numMessages));
+        running.emplace_back(new std::atomic<int>(0));
+
+        auto & inside = *running.back();
+        sources.back()->onEvent = [&] (int && message) {
+            if (inside.fetch_add(1) != 0)
+                ++overlaps;
+            ML::sleep(0.00001);
+            {
+                std::lock_guard<std::mutex> guard(threadsLock);
+                threadIds.insert(std::this_thread::get_id());
+            }
+            --inside;
+            ++received;
+        };
+
+        // Half of them prefer the second thread
+        loop.addSource("source", sources.back(), 0, i % 2 ? 1 : -1);
+    }
+
+    loop.start();
+    for (auto & source: sources)
+        source->waitConnectionState(AsyncEventSource::CONNECTED);
+
+    for (int i = 0; i < numMessages; i++)
+        sources[i % numSources]->push(i);
+
+    while (received < numMessages)
+        ML::sleep(0.01);
+
+    BOOST_CHECK_EQUAL(overlaps, 0);
+    BOOST_CHECK_GT(threadIds.size(), 1);
+    cerr << "stolen " << loop.numStolen() << " times by "
+         << threadIds.size() << " threads" << endl;
+
+    // Sources can go away while the others keep on running
+    for (int i = 0; i < numSources; i += 2)
+        loop.removeSourceSync(sources[i].get());
+
+    for (int i = 0; i < numMessages; i++)
+        sources[1 + (i % (numSources / 2)) * 2]->push(i);
+
+    while (received < 2 * numMessages)
+        ML::sleep(0.01);
+
+    for (int i = 1; i < numSources; i += 2)
+        loop.removeSourceSync(sources[i].get());
+
+    loop.shutdown();
+    BOOST_CHECK_EQUAL(received, 2 * numMessages);
+}
+
+/* This test ensures that the time spent handling each source is measured
+ * separately when the source stats are enabled. */
+BOOST_AUTO_TEST_CASE( test_source_stats )
+{
+    ML::Watchdog wd(30);
+    const int numMessages(100);
+
+    MessageLoop loop;
+    loop.enableSourceStats();
+
+    typedef TypedMessageSink<int> TestSource;
+
+    std::atomic<int> received(0);
+    auto fast = make_shared<TestSource>(numMessages);
+    fast->onEvent = [&] (int && message) {
+        ++received;
+    };
+    auto slow = make_shared<TestSource>(numMessages);
+    slow->onEvent = [&] (int && message) {
+        ML::sleep(0.001);
+        ++received;
+    };
+
+    loop.addSource("fast", fast);
+    loop.addSource("slow", slow);
+    loop.start();
+    fast->waitConnectionState(AsyncEventSource::CONNECTED);
+    slow->waitConnectionState(AsyncEventSource::CONNECTED);
+
+    for (int i = 0; i < numMessages; i++) {
+        fast->push(i);
+        slow->push(i);
+        ML::sleep(0.0001);
+    }
+
+    while (received < 2 * numMessages)
+        ML::sleep(0.01);
+
+    map<string, SourceStats> stats;
+    for (auto & entry: loop.sourceStats())
+        stats[entry.first] = entry.second;
+    BOOST_REQUIRE_EQUAL(stats.size(), 2);
+
+    const SourceStats & fastStats = stats["fast"];
+    const SourceStats & slowStats = stats["slow"];
+    BOOST_CHECK_GT(fastStats.calls, 0);
+    BOOST_CHECK_EQUAL(fastStats.durations.count(), fastStats.calls);
+    BOOST_CHECK_EQUAL(slowStats.durations.count(), slowStats.calls);
+    BOOST_CHECK_GE(slowStats.busyTicks * ML::seconds_per_tick,
+                   numMessages * 0.001);
+    BOOST_CHECK_GT(slowStats.busyTicks, 10 * fastStats.busyTicks);
+    BOOST_CHECK_GE(slowStats.durations.percentile(100) * ML::seconds_per_tick,
+                   0.001);
+
+    loop.removeSourceSync(slow.get());
+    BOOST_CHECK_EQUAL(loop.sourceStats().size(), 1);
+
+    loop.removeSourceSync(fast.get());
+    loop.shutdown();
+}
+
+/* This test ensures that a busy polling loop handles its sources without
+ * sleeping between passes, whereas a normal loop sleeps for up to
+ * maxAddedLatency. */
+BOOST_AUTO_TEST_CASE( test_busy_poll )
+{
+    ML::Watchdog wd(30);
+    const int numMessages(100);
+
+    typedef TypedMessageSink<int> TestSource;
+
+    auto runLoop = [&] (int busyPollUs)
+        {
+            MessageLoop loop(1, 0.001);
+            loop.setBusyPoll(busyPollUs);
+
+            std::atomic<int> received(0);
+            auto source = make_shared<TestSource>(numMessages);
+            source->onEvent = [&] (int && message) {
+                ++received;
+            };
+
+            loop.addSource("source", source);
+            loop.start();
+            source->waitConnectionState(AsyncEventSource::CONNECTED);
+
+            for (int i = 0; i < numMessages; i++) {
+                source->push(i);
+                ML::sleep(0.0001);
+            }
+
+            while (received < numMessages)
+                ML::sleep(0.01);
+
+            LatencyHistogram latency = loop.wakeupLatency();
+            loop.removeSourceSync(source.get());
+            loop.shutdown();
+
+            BOOST_CHECK_GT(latency.count(), 0);
+            return latency.percentile(50) * ML::seconds_per_tick;
+        };
+
+    double sleeping = runLoop(0);
+    double spinning = runLoop(100);
+    cerr << "median wakeup latency: sleeping " << sleeping * 1000000.0
+         << "us, busy polling " << spinning * 1000000.0 << "us" << endl;
+    BOOST_CHECK_GE(sleeping, 0.0005);
+    BOOST_CHECK_LT(spinning, 0.0005);
+}
@@ -190,3 +190,47 @@ BOOST_AUTO_TEST_CASE( test_http_client_get )
     cerr << "threads joined\n";
 }
 #endif
+
+BOOST_AUTO_TEST_CASE( test_nsq_batched_publish )
+{
+    MessageLoop loop;
+    loop.start();
+
+    auto client = make_shared<NsqClient>();
+    loop.addSource("client", client);
+    client->init("http://127.0.0.1:4150");
+    auto result = client->connectSync();
+    BOOST_REQUIRE_EQUAL(result.code, TcpConnectionCode::Success);
+
+    int numBatches(0);
+    NsqProducerConfig config;
+    config.maxBatchMessages = 100;
+    config.onBatchResult = [&] (const string & topic, size_t numMessages,
+                                const NsqFrame & response) {
+        BOOST_CHECK_EQUAL(response.type, NsqFrameType::Response);
+        __sync_add_and_fetch(&numBatches, 1);
+    };
+    client->enableProducer(config);
+
+    Date start = Date::now();
+    for (int i = 0; i < numMessages; i++) {
+        BOOST_CHECK(client->publish("b-topic",
+                                    "batched message nr " + to_string(i)));
+    }
+
+    while (client->topicStats()["b-topic"].messagesSent < numMessages) {
+        ML::sleep(0.1);
+    }
+    double delay = Date::now() - start;
+
+    auto stats = client->topicStats()["b-topic"];
+    BOOST_CHECK_EQUAL(stats.messagesQueued, numMessages);
+    BOOST_CHECK_EQUAL(stats.messagesFailed, 0);
+    BOOST_CHECK_EQUAL(stats.batchesSent, numMessages / 100);
+    BOOST_CHECK_EQUAL(numBatches, numMessages / 100);
+    BOOST_CHECK_EQUAL(client->bufferedBytes(), 0);
+    cerr << ("batched publisher: " + to_string(numMessages / delay)
+             + " msgs/sec\n");
+
+    loop.shutdown();
+}
@@ -351,3 +351,82 @@ BOOST_AUTO_TEST_CASE( test_redis_timeout )
 
     redis.shutdown();
 }
+
+BOOST_AUTO_TEST_CASE( test_redis_pipelining )
+{
+    RedisTemporaryServer redis;
+    Redis::AsyncConnection connection(redis);
+
+    // Many more commands than the wakeup pipe could hold, all queued before
+    // any of them is replied to
+    enum { NumCommands = 100000 };
+
+    int numDone = 0, numErrors = 0;
+
+    auto onResult = [&] (const Redis::Result & result)
+        {
+            if (!result)
+                ML::atomic_inc(numErrors);
+            if (__sync_add_and_fetch(&numDone, 1) == NumCommands)
+                futex_wake(numDone);
+        };
+
+    for (unsigned i = 0;  i < NumCommands;  ++i)
+        connection.queue(SET(ML::format("key%d", i), i), onResult);
+
+    while (numDone < NumCommands) {
+        int current = numDone;
+        futex_wait(numDone, current, 0.1);
+    }
+
+    BOOST_CHECK_EQUAL(numErrors, 0);
+    BOOST_CHECK_EQUAL(connection.exec(GET("key12345")).reply().asString(),
+                      "12345");
+}
+
+BOOST_AUTO_TEST_CASE( test_redis_sharded )
+{
+    RedisTemporaryServer redis1, redis2;
+
+    vector<Address> addresses = { redis1.address(), redis2.address() };
+    ShardedConnection connection(addresses, 2);
+    connection.test();
+
+    BOOST_CHECK_EQUAL(ShardedConnection::hashTag("user:{42}:name"), "42");
+    BOOST_CHECK_EQUAL(ShardedConnection::hashTag("user:{}:name"),
+                      "user:{}:name");
+    BOOST_CHECK_EQUAL(connection.nodeFor("a{42}"), connection.nodeFor("b{42}"));
+
+    // The keys are spread over both servers, and each one is on the server
+    // that nodeFor() says
+    Redis::AsyncConnection direct1(redis1), direct2(redis2);
+    int counts[2] = { 0, 0 };
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        string key = ML::format("key%d", i);
+        BOOST_CHECK(connection.exec(SET(key, i)));
+
+        int node = connection.nodeFor(key);
+        counts[node] += 1;
+        auto result = (node == 0 ? direct1 : direct2).exec(GET(key));
+        BOOST_CHECK_EQUAL(result.reply().asString(), to_string(i));
+    }
+    BOOST_CHECK_GT(counts[0], 300);
+    BOOST_CHECK_GT(counts[1], 300);
+
+    // Commands on both servers
+    auto results = connection.execMulti({ GET("key1"), GET("key2"),
+                                          GET("key3"), GET("key4") });
+    BOOST_REQUIRE_EQUAL(results.size(), 4);
+    for (unsigned i = 0;  i < 4;  ++i)
+        BOOST_CHECK_EQUAL(results[i].reply().asString(), to_string(i + 1));
+
+    // Keys on different servers can't be in the same command
+    string key0, key1;
+    for (unsigned i = 0;  key0.empty() || key1.empty();  ++i) {
+        string key = ML::format("key%d", i);
+        (connection.nodeFor(key) == 0 ? key0 : key1) = key;
+    }
+    BOOST_CHECK_THROW(connection.exec(MGET(key0, key1)), ML::Exception);
+    BOOST_CHECK(connection.exec(MGET("a{tag}", "b{tag}")));
+    BOOST_CHECK_THROW(connection.exec(PING), ML::Exception);
+}
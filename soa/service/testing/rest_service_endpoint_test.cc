@@ -15,6 +15,9 @@
 #include "soa/service/rest_service_endpoint.h"
 #include "soa/service/rest_proxy.h"
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <boost/lexical_cast.hpp>
 #include "jml/utils/guard.h"
 #include "jml/arch/exception_handler.h"
 #include "jml/utils/testing/watchdog.h"
@@ -175,3 +178,104 @@ BOOST_AUTO_TEST_CASE( test_named_endpoint )
 
     service.shutdown();
 }
+
+BOOST_AUTO_TEST_CASE( test_http_pipelining )
+{
+    auto proxies = std::make_shared<ServiceProxies>();
+
+    EchoService service(proxies, "echo-pipelining");
+    auto addr = service.bindTcp();
+    service.start();
+
+    string uri = addr.second;
+    int port = boost::lexical_cast<int>(string(uri, uri.rfind(':') + 1));
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    BOOST_REQUIRE(fd != -1);
+    ML::Call_Guard closeFd([&] () { ::close(fd); });
+
+    sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    BOOST_REQUIRE_EQUAL(connect(fd, (sockaddr *) &sin, sizeof(sin)), 0);
+
+    // Several requests in a single write, the last one split in two
+    string requests;
+    for (unsigned i = 0;  i < 10;  ++i) {
+        string body = "request" + to_string(i);
+        requests += ("POST /echo HTTP/1.1\r\n"
+                     "Content-Length: " + to_string(body.size()) + "\r\n"
+                     "\r\n" + body);
+    }
+    size_t half = requests.size() - 10;
+    BOOST_REQUIRE_EQUAL(write(fd, requests.c_str(), half), half);
+    ML::sleep(0.1);
+    BOOST_REQUIRE_EQUAL(write(fd, requests.c_str() + half,
+                              requests.size() - half),
+                        requests.size() - half);
+
+    // The responses come back in order
+    string responses;
+    size_t pos = 0;
+    for (unsigned i = 0;  i < 10;  ++i) {
+        string expected = "request" + to_string(i);
+        while (responses.find(expected, pos) == string::npos) {
+            char buf[4096];
+            ssize_t res = read(fd, buf, sizeof(buf));
+            BOOST_REQUIRE(res > 0);
+            responses.append(buf, res);
+        }
+        size_t found = responses.find(expected, pos);
+        BOOST_CHECK_EQUAL(responses.find("request", pos),
+                          found);
+        pos = found + expected.size();
+    }
+
+    service.shutdown();
+}
+
+BOOST_AUTO_TEST_CASE( test_local_rest_proxy )
+{
+    auto proxies = std::make_shared<ServiceProxies>();
+
+    EchoService service(proxies, "echo-local");
+    service.start();
+
+    RestProxy proxy;
+    proxy.initLocal(&service, "echo-local");
+    proxy.start();
+
+    int totalPings = 1000;
+    int numOk = 0, numErrors = 0;
+
+    // The responses all come back on the proxy's thread
+    for (int i = 0;  i < totalPings;  ++i) {
+        auto onResponse = [=, &numOk] (std::exception_ptr ptr,
+                                       int responseCode,
+                                       std::string body)
+            {
+                if (!ptr && responseCode == 200 && body == to_string(i))
+                    ++numOk;
+            };
+        proxy.push(onResponse, "POST", "/echo", {}, to_string(i));
+    }
+
+    // Handler exceptions come back as errors instead of being lost
+    auto onError = [&] (std::exception_ptr ptr, int responseCode,
+                        std::string body)
+        {
+            if (ptr && responseCode == 500)
+                ++numErrors;
+        };
+    proxy.push(onError, "GET", "/echo");
+
+    proxy.sleepUntilIdle();
+    proxy.shutdown();
+
+    BOOST_CHECK_EQUAL(numOk, totalPings);
+    BOOST_CHECK_EQUAL(numErrors, 1);
+
+    service.shutdown();
+}
@@ -0,0 +1,117 @@
+/* runner_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Measures the time taken by Runner to launch a subprocess, with fork and
+   with posix_spawn, as the resident size of the parent process grows.
+
+   Usage: runner_bench [max resident size in GB]
+*/
+
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "jml/arch/exception.h"
+#include "jml/arch/futex.h"
+#include "soa/service/message_loop.h"
+#include "soa/service/runner.h"
+#include "soa/types/date.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+/* Maps and touches "size" bytes, so that they count in the resident size of
+   the process and in the page tables that fork must copy. */
+void growResidentSize(size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+
+    void * mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        throw ML::Exception(errno, "mmap");
+    }
+    char * bytes = (char *) mem;
+    for (size_t i = 0; i < size; i += 4096) {
+        bytes[i] = 1;
+    }
+}
+
+void doBench(const string & label, bool useSpawn, size_t residentGb,
+             int numLaunches)
+{
+    MessageLoop loop;
+    loop.start();
+
+    auto runner = make_shared<Runner>();
+    runner->useSpawn = useSpawn;
+    loop.addSource("runner", runner);
+    runner->waitConnectionState(AsyncEventSource::CONNECTED);
+
+    double totalLaunch(0.0), maxLaunch(0.0), totalRun(0.0);
+    int numFailures(0);
+
+    for (int i = 0; i < numLaunches; i++) {
+        int done(0);
+        RunResult result;
+        auto onTerminate = [&] (const RunResult & newResult) {
+            result = newResult;
+            done = 1;
+            ML::futex_wake(done);
+        };
+
+        Date start = Date::now();
+        runner->run({"/bin/true"}, onTerminate);
+        runner->waitStart();
+        double launch = Date::now() - start;
+        while (!done) {
+            ML::futex_wait(done, 0);
+        }
+        runner->waitTermination();
+        totalRun += Date::now() - start;
+
+        if (result.state != RunResult::RETURNED || result.returnCode != 0) {
+            numFailures++;
+        }
+        totalLaunch += launch;
+        if (launch > maxLaunch) {
+            maxLaunch = launch;
+        }
+    }
+
+    ::printf("%s,%lu,%d,%d,%f,%f,%f\n",
+             label.c_str(), residentGb, numLaunches, numFailures,
+             totalLaunch / numLaunches * 1000.0, maxLaunch * 1000.0,
+             totalRun / numLaunches * 1000.0);
+
+    loop.removeSourceSync(runner.get());
+    loop.shutdown();
+}
+
+int main(int argc, char * argv[])
+{
+    size_t maxGb(4);
+    if (argc > 1) {
+        maxGb = ::atoi(argv[1]);
+    }
+
+    ::printf("label,resident_gb,launches,failures,"
+             "avg_launch_ms,max_launch_ms,avg_run_ms\n");
+
+    size_t residentGb(0);
+    for (size_t gb = 0; gb <= maxGb; gb = (gb == 0 ? 1 : gb * 2)) {
+        growResidentSize((gb - residentGb) << 30);
+        residentGb = gb;
+
+        doBench("fork", false, residentGb, 20);
+        doBench("spawn", true, residentGb, 20);
+    }
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+/* scope_profiler_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test for the hierarchical scope profiler.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/service/scope_profiler.h"
+#include <thread>
+
+
+using namespace std;
+using namespace Datacratic;
+
+namespace {
+
+void inner()
+{
+    ProfileScope scope("inner");
+}
+
+void outer(int numInner)
+{
+    ProfileScope scope("outer");
+    for (int i = 0;  i < numInner;  ++i)
+        inner();
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_scope_profiler_tree )
+{
+    outer(3);
+    inner();
+
+    auto totals = ScopeProfiler::totals();
+    BOOST_CHECK_EQUAL(totals["outer"].calls, 1);
+    BOOST_CHECK_EQUAL(totals["outer.inner"].calls, 3);
+    BOOST_CHECK_EQUAL(totals["inner"].calls, 1);
+    BOOST_CHECK(totals["outer"].ticks >= totals["outer.inner"].ticks);
+
+    // Null names and disabled profiling don't count
+    {
+        ProfileScope scope(nullptr);
+        inner();
+    }
+    ScopeProfiler::setEnabled(false);
+    outer(1);
+    ScopeProfiler::setEnabled(true);
+
+    totals = ScopeProfiler::totals();
+    BOOST_CHECK_EQUAL(totals["outer"].calls, 1);
+    BOOST_CHECK_EQUAL(totals["inner"].calls, 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_scope_profiler_threads )
+{
+    auto before = ScopeProfiler::totals();
+
+    std::thread t1([] () { for (int i = 0;  i < 1000;  ++i) outer(2); });
+    std::thread t2([] () { for (int i = 0;  i < 1000;  ++i) outer(2); });
+    t1.join();
+    t2.join();
+
+    // The trees of the threads that are gone still count
+    auto totals = ScopeProfiler::totals();
+    BOOST_CHECK_EQUAL(totals["outer"].calls - before["outer"].calls, 2000);
+    BOOST_CHECK_EQUAL(totals["outer.inner"].calls
+                      - before["outer.inner"].calls, 4000);
+}
+
+BOOST_AUTO_TEST_CASE( test_scope_profiler_allocations )
+{
+    // Counted by hand, as the hooks need tcmalloc
+    AllocationCounters start = AllocationCounters::thisThread();
+    {
+        ProfileScope scope("allocs");
+        AllocationCounters::recordAllocation(100);
+        {
+            ProfileScope scope("nested");
+            AllocationCounters::recordAllocation(20);
+            AllocationCounters::recordAllocation(30);
+            AllocationCounters::recordFree();
+        }
+    }
+
+    AllocationCounters end = AllocationCounters::thisThread();
+    BOOST_CHECK_EQUAL(end.allocs - start.allocs, 3);
+    BOOST_CHECK_EQUAL(end.bytes - start.bytes, 150);
+    BOOST_CHECK_EQUAL(end.frees - start.frees, 1);
+
+    // Nested scopes count in their parents
+    auto totals = ScopeProfiler::totals();
+    BOOST_CHECK_EQUAL(totals["allocs"].allocs, 3);
+    BOOST_CHECK_EQUAL(totals["allocs"].allocBytes, 150);
+    BOOST_CHECK_EQUAL(totals["allocs.nested"].allocs, 2);
+    BOOST_CHECK_EQUAL(totals["allocs.nested"].allocBytes, 50);
+
+    // Each thread has its own counters
+    std::thread t([] ()
+                  {
+                      BOOST_CHECK_EQUAL(AllocationCounters::thisThread().allocs,
+                                        0);
+                  });
+    t.join();
+}
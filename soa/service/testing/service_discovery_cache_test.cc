@@ -0,0 +1,259 @@
+/* service_discovery_cache_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests of the shared snapshot of the service discovery entries.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <atomic>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+#include "soa/service/service_discovery_cache.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+/** Configuration service with a single level of directories, that keeps
+    the watches until they are triggered, as ZooKeeper does, and counts the
+    reads.
+*/
+
+struct MockConfigurationService : public ConfigurationService {
+
+    MockConfigurationService()
+        : reads(0)
+    {
+    }
+
+    virtual Json::Value getJson(const std::string & key, Watch watch)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        ++reads;
+        if (watch)
+            watches[key].push_back(watch);
+        auto it = values.find(key);
+        return it == values.end() ? Json::Value() : it->second;
+    }
+
+    virtual void set(const std::string & key, const Json::Value & value)
+    {
+        std::string parent = key.substr(0, key.rfind('/'));
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            values[key] = value;
+            children[parent].insert(key.substr(parent.size() + 1));
+        }
+        trigger(key, VALUE_CHANGED);
+        trigger(parent, NEW_CHILD);
+    }
+
+    virtual std::string setUnique(const std::string & key,
+                                  const Json::Value & value)
+    {
+        set(key, value);
+        return key;
+    }
+
+    virtual std::vector<std::string>
+    getChildren(const std::string & key, Watch watch)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        ++reads;
+        if (watch)
+            watches[key].push_back(watch);
+        auto & c = children[key];
+        return vector<string>(c.begin(), c.end());
+    }
+
+    virtual bool forEachEntry(const OnEntry & onEntry,
+                              const std::string & startPrefix) const
+    {
+        throw ML::Exception("not implemented");
+    }
+
+    virtual void removePath(const std::string & key)
+    {
+        std::string parent = key.substr(0, key.rfind('/'));
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            values.erase(key);
+            children[parent].erase(key.substr(parent.size() + 1));
+        }
+        trigger(key, DELETED);
+        trigger(parent, NEW_CHILD);
+    }
+
+    void trigger(const std::string & key, ChangeType change)
+    {
+        vector<Watch> toTrigger;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            toTrigger.swap(watches[key]);
+        }
+
+        // Calls the callback as ZooKeeper does, without the check of
+        // Watch::trigger()
+        for (auto & watch: toTrigger) {
+            std::unique_ptr<std::shared_ptr<Watch::Data> > data(watch.get());
+            if ((*data)->watchReferences > 0)
+                (*data)->onChange(key, change);
+        }
+    }
+
+    std::mutex lock;
+    std::map<std::string, Json::Value> values;
+    std::map<std::string, std::set<std::string> > children;
+    std::map<std::string, std::vector<Watch> > watches;
+    int reads;
+};
+
+Json::Value provider(const std::string & name)
+{
+    Json::Value result;
+    result["serviceName"] = name;
+    result["servicePath"] = name;
+    result["serviceLocation"] = "global";
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE( test_read_once_and_share )
+{
+    MockConfigurationService config;
+    config.set("serviceClass/router/router1", provider("router1"));
+    config.set("serviceClass/router/router2", provider("router2"));
+
+    auto cache = std::make_shared<ServiceDiscoveryCache>(config);
+
+    auto entries = cache->getEntries("serviceClass/router");
+    BOOST_REQUIRE_EQUAL(entries->size(), 2);
+    BOOST_CHECK_EQUAL((*entries)[0].first, "router1");
+    BOOST_CHECK_EQUAL((*entries)[1].second["serviceName"].asString(),
+                      "router2");
+
+    // A directory and each of its children are read once; then the readers
+    // all get the same entries
+    BOOST_CHECK_EQUAL(config.reads, 3);
+    for (unsigned i = 0;  i < 100;  ++i)
+        BOOST_CHECK_EQUAL(cache->getEntries("serviceClass/router"), entries);
+    BOOST_CHECK_EQUAL(config.reads, 3);
+
+    // Directories that don't exist are cached as empty
+    BOOST_CHECK(cache->getEntries("serviceClass/banker")->empty());
+    BOOST_CHECK(cache->getEntries("serviceClass/banker")->empty());
+    BOOST_CHECK_EQUAL(config.reads, 4);
+}
+
+BOOST_AUTO_TEST_CASE( test_watch_updates )
+{
+    MockConfigurationService config;
+    config.set("serviceClass/router/router1", provider("router1"));
+
+    auto cache = std::make_shared<ServiceDiscoveryCache>(config);
+
+    vector<string> changed;
+    uint64_t token = cache->subscribe([&] (const std::string & path)
+        {
+            changed.push_back(path);
+        });
+
+    auto before = cache->getEntries("serviceClass/router");
+    BOOST_CHECK_EQUAL(before->size(), 1);
+    uint64_t generation = cache->snapshot()->generation;
+
+    // A new provider publishes a new snapshot; the old entries stay valid
+    // for those who hold them
+    config.set("serviceClass/router/router2", provider("router2"));
+    auto after = cache->getEntries("serviceClass/router");
+    BOOST_CHECK_EQUAL(after->size(), 2);
+    BOOST_CHECK_EQUAL(before->size(), 1);
+    BOOST_CHECK_GT(cache->snapshot()->generation, generation);
+    BOOST_CHECK(!changed.empty());
+    BOOST_CHECK_EQUAL(changed.back(), "serviceClass/router");
+
+    // Changes of the values of the children are seen too
+    Json::Value moved = provider("router1");
+    moved["serviceLocation"] = "elsewhere";
+    config.set("serviceClass/router/router1", moved);
+    auto entries = cache->getEntries("serviceClass/router");
+    BOOST_CHECK_EQUAL((*entries)[0].second["serviceLocation"].asString(),
+                      "elsewhere");
+
+    config.removePath("serviceClass/router/router2");
+    BOOST_CHECK_EQUAL(cache->getEntries("serviceClass/router")->size(), 1);
+
+    // No more notifications after unsubscribing
+    cache->unsubscribe(token);
+    size_t numChanges = changed.size();
+    config.set("serviceClass/router/router3", provider("router3"));
+    BOOST_CHECK_EQUAL(changed.size(), numChanges);
+    BOOST_CHECK_EQUAL(cache->getEntries("serviceClass/router")->size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_reentrant_reads )
+{
+    MockConfigurationService config;
+    config.set("serviceClass/router/router1", provider("router1"));
+    config.set("router1/zeromq/tcp", Json::Value("uri"));
+
+    auto cache = std::make_shared<ServiceDiscoveryCache>(config);
+
+    // A subscriber that reads a directory that isn't cached yet from its
+    // callback, as the connectors do
+    size_t numEndpoints = 0;
+    cache->subscribe([&] (const std::string & path)
+        {
+            if (path == "serviceClass/router")
+                numEndpoints = cache->getEntries("router1/zeromq")->size();
+        });
+
+    cache->getEntries("serviceClass/router");
+    BOOST_CHECK_EQUAL(numEndpoints, 1);
+
+    // The endpoint was published once the first update was done
+    int reads = config.reads;
+    BOOST_CHECK_EQUAL(cache->getEntries("router1/zeromq")->size(), 1);
+    BOOST_CHECK_EQUAL(config.reads, reads);
+}
+
+BOOST_AUTO_TEST_CASE( test_concurrent_readers )
+{
+    MockConfigurationService config;
+    config.set("serviceClass/router/router0", provider("router0"));
+
+    auto cache = std::make_shared<ServiceDiscoveryCache>(config);
+    cache->getEntries("serviceClass/router");
+
+    std::atomic<bool> finished(false);
+    std::atomic<uint64_t> errors(0);
+
+    auto reader = [&] ()
+        {
+            while (!finished) {
+                auto entries = cache->getEntries("serviceClass/router");
+                for (auto & e: *entries)
+                    if (e.second["serviceName"].asString() != e.first)
+                        ++errors;
+            }
+        };
+
+    vector<std::thread> threads;
+    for (unsigned i = 0;  i < 4;  ++i)
+        threads.emplace_back(reader);
+
+    for (unsigned i = 1;  i <= 200;  ++i) {
+        string name = "router" + to_string(i);
+        config.set("serviceClass/router/" + name, provider(name));
+    }
+
+    finished = true;
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+    BOOST_CHECK_EQUAL(cache->getEntries("serviceClass/router")->size(), 201);
+}
@@ -12,6 +12,7 @@ service_utils_test: $(LIB)/libcustom_preload_1.so \
 					$(LIB)/libcustom_preload_4.so
 
 $(eval $(call test,epoll_test,services,boost))
+$(eval $(call test,epoller_test,services,boost))
 $(eval $(call test,epoll_wait_test,services,boost manual))
 
 $(eval $(call test,named_endpoint_test,services,boost manual))
@@ -31,6 +32,7 @@ $(eval $(call nodejs_test,opstats_js_test,opstats,,,manual))
 
 $(eval $(call test,statsd_connector_test,opstats,boost  manual))
 $(eval $(call test,carbon_connector_test,opstats endpoint,boost manual))
+$(eval $(call test,hdr_histogram_test,opstats,boost))
 
 $(eval $(call test,endpoint_unit_test,endpoint,boost))
 $(eval $(call test,test_active_endpoint_nothing_listening,endpoint,boost manual))
@@ -46,12 +48,19 @@ $(eval $(call test,http_rest_proxy_stress_test,services,boost manual))
 $(eval $(call test,service_proxies_test,endpoint,boost manual))
 
 $(eval $(call test,message_loop_test,services,boost))
+$(eval $(call test,latency_histogram_test,services,boost))
+$(eval $(call test,event_sampler_test,services,boost))
+$(eval $(call test,service_discovery_cache_test,services,boost))
+$(eval $(call test,timer_wheel_test,types,boost))
+$(eval $(call test,timeout_map_test,types,boost))
+$(eval $(call test,shared_memory_ring_test,services,boost))
 
 $(eval $(call program,runner_test_helper,utils))
 $(eval $(call test,runner_test,services,boost))
 $(eval $(call test,runner_stress_test,services,boost manual))
 $(TESTS)/runner_test $(TESTS)/runner_stress_test: $(BIN)/runner_test_helper
 $(eval $(call test,sink_test,services,boost))
+$(eval $(call test,async_writer_source_test,services,boost))
 
 #$(eval $(call test,zmq_tcp_bench,services,boost manual timed))
 $(eval $(call test,nprobe_test,services,boost manual))
@@ -59,6 +68,7 @@ $(eval $(call test,nprobe_test,services,boost manual))
 $(eval $(call library,test_services,test_http_services.cc,services))
 
 $(eval $(call program,async_writer_bench,services))
+$(eval $(call program,runner_bench,services))
 
 # nsq_client_test is "manual" because of dependency on nsqd */
 $(eval $(call test,nsq_client_test,cloud,boost manual))
@@ -70,6 +80,7 @@ $(eval $(call test,http_client_bench,boost_program_options services test_service
 $(eval $(call test,http_parsers_test,services test_services,boost valgrind))
 
 $(eval $(call test,logs_test,services,boost))
+$(eval $(call test,scope_profiler_test,services,boost))
 
 $(eval $(call test,sns_mock_test,cloud services,boost))
 $(eval $(call test,zmq_message_loop_test,services,boost))
@@ -0,0 +1,129 @@
+/* shared_memory_ring_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the shared memory ring.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/service/shared_memory_ring.h"
+#include "jml/utils/testing/watchdog.h"
+#include <deque>
+#include <thread>
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+string ringName(const string & test)
+{
+    return "shared_memory_ring_test." + test + "." + to_string(getpid());
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_ring_basics )
+{
+    BOOST_CHECK(!SharedMemoryRing::open(ringName("missing")));
+
+    auto writer = SharedMemoryRing::create(ringName("basics"), 100);
+    BOOST_CHECK_EQUAL(writer->capacity(), 4096);
+
+    auto reader = SharedMemoryRing::open(ringName("basics"));
+    BOOST_REQUIRE(reader);
+
+    vector<string> parts;
+    BOOST_CHECK(!reader->tryRead(parts));
+
+    BOOST_CHECK(writer->tryWrite({ "AUCTION", "", string(1000, 'x') }));
+    BOOST_CHECK(writer->tryWrite({ "BID" }));
+
+    BOOST_CHECK(reader->tryRead(parts));
+    BOOST_CHECK(parts == vector<string>({ "AUCTION", "", string(1000, 'x') }));
+    BOOST_CHECK(reader->tryRead(parts));
+    BOOST_CHECK(parts == vector<string>({ "BID" }));
+    BOOST_CHECK(!reader->tryRead(parts));
+
+    // Too big to ever fit
+    BOOST_CHECK(!writer->tryWrite({ string(5000, 'y') }));
+
+    // Closing the owner's side is seen through the other mapping
+    BOOST_CHECK(!reader->closed());
+    writer.reset();
+    BOOST_CHECK(reader->closed());
+    BOOST_CHECK(!SharedMemoryRing::open(ringName("basics")));
+}
+
+BOOST_AUTO_TEST_CASE( test_ring_full_and_wrap )
+{
+    auto ring = SharedMemoryRing::create(ringName("wrap"), 4096);
+
+    // Each message takes 8 + 4 + 1000 bytes, so four of them fit
+    std::deque<string> expected;
+    for (;;) {
+        string part(1000, 'a' + expected.size());
+        if (!ring->tryWrite({ part }))
+            break;
+        expected.push_back(part);
+    }
+    BOOST_CHECK_EQUAL(expected.size(), 4);
+
+    // Keep going around the ring many times over
+    vector<string> parts;
+    for (int i = 0;  i < 100;  ++i) {
+        BOOST_REQUIRE(ring->tryRead(parts));
+        BOOST_REQUIRE_EQUAL(parts.size(), 1);
+        BOOST_REQUIRE(parts[0] == expected.front());
+        expected.pop_front();
+
+        string part(1001, 'a' + i % 26);
+        BOOST_REQUIRE(ring->tryWrite({ part }));
+        expected.push_back(part);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_ring_between_processes )
+{
+    ML::Watchdog watchdog(30.0);
+
+    string name = ringName("processes");  // before forking; depends on pid
+    auto ring = SharedMemoryRing::create(name, 65536);
+    const int numMessages = 100000;
+
+    pid_t pid = fork();
+    BOOST_REQUIRE_NE(pid, -1);
+
+    if (pid == 0) {
+        auto child = SharedMemoryRing::open(name);
+        if (!child)
+            _exit(1);
+        for (int i = 0;  i < numMessages;) {
+            if (child->tryWrite({ to_string(i) }))
+                ++i;
+            else std::this_thread::yield();
+        }
+        _exit(0);
+    }
+
+    vector<string> parts;
+    for (int i = 0;  i < numMessages;) {
+        if (!ring->tryRead(parts)) {
+            ring->wait(0.1);
+            continue;
+        }
+        BOOST_REQUIRE_EQUAL(parts.size(), 1);
+        BOOST_REQUIRE_EQUAL(parts[0], to_string(i));
+        ++i;
+    }
+
+    int status;
+    BOOST_CHECK_EQUAL(waitpid(pid, &status, 0), pid);
+    BOOST_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
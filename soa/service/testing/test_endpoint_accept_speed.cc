@@ -27,7 +27,7 @@ using namespace std;
 using namespace ML;
 using namespace Datacratic;
 
-void runAcceptSpeedTest()
+void runAcceptSpeedTest(int numAcceptors = 1)
 {
     string connectionError;
 
@@ -38,7 +38,8 @@ void runAcceptSpeedTest()
             return ML::make_std_sp(new PongConnectionHandler(connectionError));
         };
     
-    int port = acceptor.init();
+    int port = acceptor.init(PortRange(), "localhost", 1, true, true,
+                             DEF_BACKLOG, numAcceptors);
 
     cerr << "port = " << port << endl;
 
@@ -128,3 +129,18 @@ BOOST_AUTO_TEST_CASE( test_accept_speed )
     BOOST_CHECK_EQUAL(ConnectionHandler::created,
                       ConnectionHandler::destroyed);
 }
+
+BOOST_AUTO_TEST_CASE( test_accept_speed_reuseport )
+{
+    BOOST_REQUIRE_EQUAL(TransportBase::created, TransportBase::destroyed);
+    BOOST_REQUIRE_EQUAL(ConnectionHandler::created,
+                        ConnectionHandler::destroyed);
+
+    Watchdog watchdog(50.0);
+
+    runAcceptSpeedTest(4);
+
+    BOOST_CHECK_EQUAL(TransportBase::created, TransportBase::destroyed);
+    BOOST_CHECK_EQUAL(ConnectionHandler::created,
+                      ConnectionHandler::destroyed);
+}
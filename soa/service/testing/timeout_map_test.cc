@@ -0,0 +1,88 @@
+/* timeout_map_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the timeout map.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/service/timeout_map.h"
+#include <vector>
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+Date at(double seconds)
+{
+    return Date::fromSecondsSinceEpoch(1000.0 + seconds);
+}
+
+struct Entry {
+    Entry(int value = 0) : value(value) {}
+    int value;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_timeout_map_bounded_expire )
+{
+    TimeoutMap<int, Entry> map;
+    for (int i = 0;  i < 10;  ++i)
+        map.insert(i, Entry(i * 10), at(i));
+
+    vector<int> expired;
+    auto onExpired = [&] (int key, const Entry & entry)
+        {
+            BOOST_CHECK_EQUAL(entry.value, key * 10);
+            expired.push_back(key);
+            return Date();
+        };
+
+    BOOST_CHECK(!map.hasExpired(at(-1)));
+    BOOST_CHECK(map.hasExpired(at(6)));
+
+    // Seven have expired; they're handled in timeout order, three at a time
+    BOOST_CHECK_EQUAL(map.expire(onExpired, at(6), 3), 3);
+    BOOST_CHECK_EQUAL(map.size(), 7);
+    BOOST_CHECK(map.hasExpired(at(6)));
+
+    BOOST_CHECK_EQUAL(map.expire(onExpired, at(6), 3), 3);
+    BOOST_CHECK_EQUAL(map.expire(onExpired, at(6), 3), 1);
+    BOOST_CHECK_EQUAL(map.expire(onExpired, at(6), 3), 0);
+    BOOST_CHECK(!map.hasExpired(at(6)));
+    BOOST_CHECK_EQUAL(map.size(), 3);
+
+    vector<int> expected = { 0, 1, 2, 3, 4, 5, 6 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(expired.begin(), expired.end(),
+                                  expected.begin(), expected.end());
+
+    // Without a limit, everything that has expired goes at once
+    BOOST_CHECK_EQUAL(map.expire(onExpired, at(100)), 3);
+    BOOST_CHECK_EQUAL(map.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_timeout_map_bounded_expire_rescheduled )
+{
+    TimeoutMap<int, Entry> map;
+    for (int i = 0;  i < 4;  ++i)
+        map.insert(i, Entry(i), at(i));
+
+    // Rescheduled entries count against the limit and stay in the map
+    auto onExpired = [&] (int key, const Entry &)
+        {
+            return key % 2 ? at(50) : Date();
+        };
+
+    BOOST_CHECK_EQUAL(map.expire(onExpired, at(10), 2), 2);
+    BOOST_CHECK_EQUAL(map.size(), 3);
+    BOOST_CHECK_EQUAL(map.expire(onExpired, at(10), 2), 2);
+    BOOST_CHECK_EQUAL(map.size(), 2);
+    BOOST_CHECK(!map.hasExpired(at(10)));
+    BOOST_CHECK(map.hasExpired(at(50)));
+}
@@ -0,0 +1,83 @@
+/* timer_wheel_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the timer wheel.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/service/timer_wheel.h"
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+Date at(double seconds)
+{
+    return Date::fromSecondsSinceEpoch(1000.0 + seconds);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_timer_wheel_expiry_order )
+{
+    TimerWheel<int> wheel(0.001, 16);
+    wheel.expire(at(0.0), [] (int) {});
+
+    wheel.insert(at(0.0105), 1);
+    wheel.insert(at(0.003), 2);
+    wheel.insert(at(0.050), 3);   // more than one turn of the wheel away
+    BOOST_CHECK_EQUAL(wheel.size(), 3);
+
+    vector<int> fired;
+    auto record = [&] (int i) { fired.push_back(i); };
+
+    BOOST_CHECK_EQUAL(wheel.expire(at(0.002), record), 0);
+    BOOST_CHECK_EQUAL(wheel.expire(at(0.004), record), 1);
+    BOOST_CHECK_EQUAL(wheel.expire(at(0.010), record), 0);
+    BOOST_CHECK_EQUAL(wheel.expire(at(0.011), record), 1);
+
+    // 0.050 shares its slot with ticks that have already gone past
+    BOOST_CHECK_EQUAL(wheel.expire(at(0.049), record), 0);
+    BOOST_CHECK_EQUAL(wheel.size(), 1);
+    BOOST_CHECK_EQUAL(wheel.expire(at(0.060), record), 1);
+
+    BOOST_CHECK(fired == vector<int>({ 2, 1, 3 }));
+    BOOST_CHECK_EQUAL(wheel.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_timer_wheel_past_deadline )
+{
+    TimerWheel<int> wheel(0.001, 16);
+    wheel.expire(at(1.0), [] (int) {});
+
+    // Already expired deadlines fire on the next tick, never on the same one
+    wheel.insert(at(0.5), 1);
+
+    int numFired = 0;
+    auto count = [&] (int) { ++numFired; };
+    wheel.expire(at(1.0), count);
+    BOOST_CHECK_EQUAL(numFired, 0);
+    wheel.expire(at(1.001), count);
+    BOOST_CHECK_EQUAL(numFired, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_timer_wheel_long_gap )
+{
+    TimerWheel<int> wheel(0.001, 16);
+    wheel.expire(at(0.0), [] (int) {});
+
+    for (int i = 1;  i <= 100;  ++i)
+        wheel.insert(at(i * 0.001), i);
+
+    // Going around the wheel several times in one call fires everything due
+    int numFired = 0;
+    wheel.expire(at(0.0805), [&] (int i) { BOOST_CHECK_LE(i, 80); ++numFired; });
+    BOOST_CHECK_EQUAL(numFired, 80);
+    BOOST_CHECK_EQUAL(wheel.size(), 20);
+}
@@ -218,18 +218,25 @@ BOOST_AUTO_TEST_CASE( test_named_publisher )
             pub.publish("dog", "eats", "dog");
             pub.publish("hello", "stranger");
 
+            // Shared payloads go out without being copied
+            auto payload = std::make_shared<const std::string>(
+                    "a payload that is too large to be copied around");
+            pub.publish("hello", payload, sharedStringMessage(payload));
+
             cerr << "published" << endl;
 
             // Wait until they are received
             for (;;) {
                 int nm = numMessages;
-                if (nm == 2) break;
+                if (nm == 3) break;
                 ML::futex_wait(numMessages, nm);
             }
 
-            BOOST_CHECK_EQUAL(subscriberMessages.size(), 2);
+            BOOST_CHECK_EQUAL(subscriberMessages.size(), 3);
             BOOST_CHECK_EQUAL(subscriberMessages.at(0), vector<string>({ "hello", "world"}) );
             BOOST_CHECK_EQUAL(subscriberMessages.at(1), vector<string>({ "hello", "stranger"}) );
+            BOOST_CHECK_EQUAL(subscriberMessages.at(2),
+                              vector<string>({ "hello", *payload, *payload }) );
 
             sub.shutdown();
         }
@@ -252,5 +259,5 @@ BOOST_AUTO_TEST_CASE( test_named_publisher )
     cerr << "got a total of " << numMessages << " subscriber messages" << endl;
 
     // Check that it got all of the messages
-    BOOST_CHECK_EQUAL(numMessages, numIter * 2);
+    BOOST_CHECK_EQUAL(numMessages, numIter * 3);
 }
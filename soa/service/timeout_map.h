@@ -11,6 +11,7 @@
 #define __router__timeout_map_h__
 
 #include <map>
+#include <memory>
 #include "soa/types/date.h"
 #include <boost/function.hpp>
 #include "jml/arch/exception.h"
@@ -18,7 +19,11 @@
 
 namespace Datacratic {
 
-template<typename Key, class Value>
+/** The nodes of both maps are allocated with Allocator, which can be
+    ML::Huge_Page_Allocator for the large maps that live for a long time.
+*/
+template<typename Key, class Value,
+         template<typename> class Allocator = std::allocator>
 struct TimeoutMap {
 
     TimeoutMap(double defaultTimeout = -INFINITY)
@@ -179,14 +184,20 @@ struct TimeoutMap {
 #endif
 
     /** Call the callback on any which have expired, removing them from
-        the map.
+        the map.  At most maxExpiries of them are handled; the others stay
+        in the map for the next call.  Returns the number handled.
     */
     template<typename Callback>
-    void expire(const Callback & callback, Date now = Date::now())
+    size_t expire(const Callback & callback, Date now = Date::now(),
+                  size_t maxExpiries = (size_t)-1)
     {
+        size_t numExpired = 0;
+
         // Look for loss timeout expiries
         for (auto it = timeouts.begin(), end = timeouts.end();
-             it != end && it->first <= now;  /* no inc */) {
+             it != end && it->first <= now && numExpired < maxExpiries;
+             /* no inc */) {
+            ++numExpired;
             auto it2 = it;
             auto expired = it->second;
             Date newExpiry = callback(expired->first, expired->second);
@@ -201,6 +212,14 @@ struct TimeoutMap {
                 erase(expired);
             }
         }
+
+        return numExpired;
+    }
+
+    /** Is there anything that has expired by now? */
+    bool hasExpired(Date now = Date::now()) const
+    {
+        return !timeouts.empty() && timeouts.begin()->first <= now;
     }
 
     /** Remove any which have expired. */
@@ -215,11 +234,15 @@ struct TimeoutMap {
         }
     }
     
-    typedef std::map<Key, Node> Nodes;
+    typedef std::map<Key, Node, std::less<Key>,
+                     Allocator<std::pair<const Key, Node> > > Nodes;
     Nodes nodes;
 
     /** Ordered set of timeouts in submitted for auction loss messages. */
-    typedef std::multimap<Date, typename Nodes::iterator> Timeouts;
+    typedef std::multimap<Date, typename Nodes::iterator, std::less<Date>,
+                          Allocator<std::pair<const Date,
+                                              typename Nodes::iterator> > >
+        Timeouts;
     Timeouts timeouts;
 
     // Date of the earliest timeout
@@ -0,0 +1,127 @@
+/* timer_wheel.h                                                   -*- C++ -*-
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+   Hashed timer wheel for large numbers of short deadlines.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <mutex>
+#include <vector>
+#include "jml/arch/spinlock.h"
+#include "jml/utils/exc_assert.h"
+#include "soa/types/date.h"
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* TIMER WHEEL                                                               */
+/*****************************************************************************/
+
+/** Keeps a large number of deadlines in a ring of slots, each slot covering
+    one tick of the given resolution.  Inserting a deadline is a push onto the
+    slot's vector, and expire() only looks at the slots for the ticks that
+    have elapsed since it was last called, so that a single periodic timer can
+    enforce all of the deadlines instead of one timer per deadline.
+
+    Deadlines further away than numSlots ticks stay in their slot until the
+    wheel has come around to them.  Deadlines are never fired early, and are
+    fired at most one tick late plus the period at which expire() is called.
+
+    Nothing is ever removed from the wheel before it expires; the payload
+    should allow the owner to tell a stale deadline from a live one (a weak
+    pointer and a generation number, for example).
+
+    Thread safe.
+*/
+
+template<typename Payload>
+struct TimerWheel {
+
+    TimerWheel(double resolution = 0.001, size_t numSlots = 1024)
+        : resolution(resolution), slots(numSlots), currentTick(0),
+          numEntries(0)
+    {
+        ExcAssertGreater(resolution, 0.0);
+        ExcAssertGreater(numSlots, 0);
+    }
+
+    /** Arrange for the payload to be passed to the callback of the first call
+        to expire() with a time at or after the deadline. */
+    void insert(Date deadline, Payload payload)
+    {
+        uint64_t tick = std::ceil(deadline.secondsSinceEpoch() / resolution);
+
+        std::lock_guard<ML::Spinlock> guard(lock);
+        if (tick <= currentTick)
+            tick = currentTick + 1;
+        slots[tick % slots.size()].emplace_back(tick, std::move(payload));
+        ++numEntries;
+    }
+
+    /** Call onExpired(payload) for every entry whose deadline is at or
+        before now, and forget about them.  The callback is called without
+        the wheel locked, so it may insert new deadlines.  Returns the number
+        of entries that expired.
+    */
+    template<typename OnExpired>
+    size_t expire(Date now, OnExpired && onExpired)
+    {
+        uint64_t nowTick = std::floor(now.secondsSinceEpoch() / resolution);
+        std::vector<Payload> expired;
+
+        {
+            std::lock_guard<ML::Spinlock> guard(lock);
+            if (nowTick <= currentTick)
+                return 0;
+
+            uint64_t numTicks = std::min<uint64_t>(nowTick - currentTick,
+                                                   slots.size());
+            for (uint64_t i = 1;  i <= numTicks;  ++i) {
+                auto & slot = slots[(currentTick + i) % slots.size()];
+
+                size_t kept = 0;
+                for (size_t j = 0;  j < slot.size();  ++j) {
+                    if (slot[j].first <= nowTick)
+                        expired.emplace_back(std::move(slot[j].second));
+                    else {
+                        if (kept != j)
+                            slot[kept] = std::move(slot[j]);
+                        ++kept;
+                    }
+                }
+                slot.erase(slot.begin() + kept, slot.end());
+            }
+
+            currentTick = nowTick;
+            numEntries -= expired.size();
+        }
+
+        for (auto & payload: expired)
+            onExpired(payload);
+
+        return expired.size();
+    }
+
+    /** Number of deadlines that have not yet expired, including any that
+        their owner no longer cares about. */
+    size_t size() const
+    {
+        std::lock_guard<ML::Spinlock> guard(lock);
+        return numEntries;
+    }
+
+private:
+    typedef std::vector<std::pair<uint64_t, Payload> > Slot;
+
+    double resolution;
+    std::vector<Slot> slots;
+    uint64_t currentTick;      ///< Last tick that expire() has processed
+    size_t numEntries;
+    mutable ML::Spinlock lock;
+};
+
+} // namespace Datacratic
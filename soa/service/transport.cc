@@ -19,6 +19,7 @@
 #include <sys/epoll.h>
 #include <sys/timerfd.h>
 #include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <poll.h>
 
 
@@ -782,6 +783,29 @@ stopReading()
     flags_ &= ~POLLIN;
 }
 
+ssize_t
+TransportBase::
+sendv(const iovec * iov, int iovcnt, int flags)
+{
+    ssize_t total = 0;
+
+    for (int i = 0;  i < iovcnt;  ++i) {
+        if (iov[i].iov_len == 0)
+            continue;
+
+        ssize_t written = send((const char *)iov[i].iov_base,
+                               iov[i].iov_len, flags);
+        if (written == -1)
+            return total ? total : -1;
+
+        total += written;
+        if ((size_t)written < iov[i].iov_len)
+            break;
+    }
+
+    return total;
+}
+
 void
 TransportBase::
 startWriting()
@@ -1016,6 +1040,18 @@ send(const char * buf, size_t len, int flags)
     return peer().send(buf, len, flags);
 }
    
+ssize_t
+SocketTransport::
+sendv(const iovec * iov, int iovcnt, int flags)
+{
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<iovec *>(iov);
+    msg.msg_iovlen = iovcnt;
+
+    return ::sendmsg(getHandle(), &msg, flags);
+}
+
 ssize_t
 SocketTransport::
 recv(char * buf, size_t buf_size, int flags)
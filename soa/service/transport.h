@@ -24,6 +24,7 @@
 #include "soa/jsoncpp/json.h"
 #include <boost/type_traits/is_convertible.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <sys/uio.h>
 
 namespace Datacratic {
 
@@ -61,6 +62,14 @@ struct TransportBase : public std::enable_shared_from_this<TransportBase> {
     virtual ssize_t send(const char * buf, size_t len, int flags) = 0;
     virtual ssize_t recv(char * buf, size_t buf_size, int flags) = 0;
 
+    /** Send the given buffers one after the other, as if they were one
+        contiguous buffer.  Returns the number of bytes written, which may
+        end part way through a buffer, or -1 with errno set if nothing could
+        be written.  The default implementation calls send() for each
+        buffer in turn.
+    */
+    virtual ssize_t sendv(const iovec * iov, int iovcnt, int flags);
+
     // closeWhenHandlerFinished() should be used in almost all cases instead
     // of this, except when writing test code, in which case asyncClose()
     // should be called instead.
@@ -603,6 +612,7 @@ struct SocketTransport
 
     virtual ssize_t send(const char * buf, size_t len, int flags);
     virtual ssize_t recv(char * buf, size_t buf_size, int flags);
+    virtual ssize_t sendv(const iovec * iov, int iovcnt, int flags);
     virtual int closePeer();
 
     ACE_SOCK_Stream & peer() { return peer_; }
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <queue>
 #include <thread>
 
@@ -86,6 +87,90 @@ private:
 };
 
 
+/*****************************************************************************/
+/* TYPED MESSAGE RING SINK                                                   */
+/*****************************************************************************/
+
+/** Same interface as TypedMessageSink, for queues with many producers that
+    see bursts.  The producers don't take a lock (see ML::RingBufferMPSC),
+    they only write to the wakeup fd when the consumer has gone idle, and
+    each wakeup of the consumer handles up to batchSize messages.
+*/
+template<typename Message>
+struct TypedMessageRingSink: public AsyncEventSource {
+
+    TypedMessageRingSink(size_t bufferSize, size_t batchSize = 64)
+        : wakeup(EFD_NONBLOCK), buf(bufferSize), batchSize(batchSize),
+          idle(true)
+    {
+    }
+
+    std::function<void (Message && message)> onEvent;
+
+    template<typename MessageT>
+    void push(MessageT&& message)
+    {
+        buf.push(std::forward<MessageT>(message));
+        notify();
+    }
+
+    template<typename MessageT>
+    bool tryPush(MessageT&& message)
+    {
+        bool pushed = buf.tryPush(std::forward<MessageT>(message));
+        if (pushed)
+            notify();
+
+        return pushed;
+    }
+
+    virtual int selectFd() const
+    {
+        return wakeup.fd();
+    }
+
+    virtual bool poll() const
+    {
+        return buf.couldPop();
+    }
+
+    virtual bool processOne()
+    {
+        wakeup.tryRead();
+        buf.popBatch(onEvent, batchSize);
+        if (buf.couldPop())
+            return true;
+
+        // A producer that pushes after the check below is guaranteed to see
+        // the flag and signal us; one that pushed before it is caught by the
+        // check itself.
+        idle.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!buf.couldPop())
+            return false;
+
+        idle.store(false, std::memory_order_relaxed);
+        return true;
+    }
+
+    uint64_t size() const { return buf.capacity(); }
+
+private:
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (idle.load(std::memory_order_relaxed)
+                && idle.exchange(false, std::memory_order_relaxed))
+            wakeup.signal();
+    }
+
+    ML::Wakeup_Fd wakeup;
+    ML::RingBufferMPSC<Message> buf;
+    size_t batchSize;
+    std::atomic<bool> idle;
+};
+
+
 /*****************************************************************************
  * TYPED MESSAGE QUEUE                                                       *
  *****************************************************************************/
@@ -210,4 +295,133 @@ private:
     OnNotify onNotify_;
 };
 
+
+/*****************************************************************************
+ * TYPED MESSAGE RING QUEUE                                                  *
+ *****************************************************************************/
+
+/* Same interface as TypedMessageQueue, for queues that are fed by many
+ * threads at a high rate.  The queue is always bounded: "maxMessages" is
+ * rounded up to a power of two and can't be changed afterwards.  Producers
+ * don't take a lock (see ML::RingBufferMPSC) and only signal the wakeup fd
+ * when the queue goes from empty to non-empty, and the consumer can drain
+ * the messages in place with "pop_front(number, onMessage)". */
+template<typename Message>
+struct TypedMessageRingQueue: public AsyncEventSource
+{
+    typedef std::function<void ()> OnNotify;
+
+    TypedMessageRingQueue(const OnNotify & onNotify, size_t maxMessages)
+        : buf_(maxMessages),
+          wakeup_(EFD_NONBLOCK | EFD_CLOEXEC), pending_(false),
+          onNotify_(onNotify)
+    {
+    }
+
+    /* AsyncEventSource interface */
+    virtual int selectFd() const
+    {
+        return wakeup_.fd();
+    }
+
+    virtual bool poll() const
+    {
+        return buf_.couldPop();
+    }
+
+    virtual bool processOne()
+    {
+        while (wakeup_.tryRead());
+        onNotify();
+
+        return false;
+    }
+
+    virtual void onNotify()
+    {
+        if (onNotify_) {
+            onNotify_();
+        }
+    }
+
+    /* push message into the queue; returns false when it is full */
+    template<typename MessageT>
+    bool push_back(MessageT && message)
+    {
+        if (!buf_.tryPush(std::forward<MessageT>(message))) {
+            return false;
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!pending_.load(std::memory_order_relaxed)
+                && !pending_.exchange(true, std::memory_order_relaxed)) {
+            wakeup_.signal();
+        }
+
+        return true;
+    }
+
+    /* call "onMessage" on up to "number" messages, or all of them if 0,
+     * without copying them out of the queue; returns the number of messages
+     * handled */
+    template<typename Fn>
+    size_t pop_front(size_t number, Fn && onMessage)
+    {
+        if (number == 0) {
+            number = buf_.capacity();
+        }
+
+        size_t done = buf_.popBatch(std::forward<Fn>(onMessage), number);
+        if (!buf_.couldPop()) {
+            /* A producer that pushed after the check below sees the flag
+             * cleared and signals; one that pushed before it is caught by the
+             * check, in which case we signal ourselves. */
+            pending_.store(false, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (buf_.couldPop()
+                    && !pending_.exchange(true, std::memory_order_relaxed)) {
+                wakeup_.signal();
+            }
+        }
+
+        return done;
+    }
+
+    /* returns up to "number" messages from the queue or all of them if 0 */
+    std::vector<Message> pop_front(size_t number)
+    {
+        std::vector<Message> messages;
+        pop_front(number, [&] (Message && message) {
+                messages.emplace_back(std::move(message));
+            });
+
+        return messages;
+    }
+
+    /* whether there are messages waiting in the queue */
+    bool empty()
+        const
+    {
+        return !buf_.couldPop();
+    }
+
+    /* maximum number of messages that the queue can hold */
+    size_t capacity()
+        const
+    {
+        return buf_.capacity();
+    }
+
+private:
+    ML::RingBufferMPSC<Message> buf_;
+
+    ML::Wakeup_Fd wakeup_;
+
+    /* notifications are pending */
+    std::atomic<bool> pending_;
+
+    /* callback */
+    OnNotify onNotify_;
+};
+
 } // namespace Datacratic
@@ -418,6 +418,7 @@ bindTcp(PortRange const & portRange, std::string host)
 ZmqNamedProxy::
 ZmqNamedProxy() :
     context_(new zmq::context_t(1)),
+    discoveryToken(0),
     local(true),
     shardIndex(-1)
 {
@@ -426,6 +427,7 @@ ZmqNamedProxy() :
 ZmqNamedProxy::
 ZmqNamedProxy(std::shared_ptr<zmq::context_t> context, int shardIndex) :
     context_(context),
+    discoveryToken(0),
     local(true),
     shardIndex(shardIndex)
 {
@@ -446,15 +448,13 @@ init(std::shared_ptr<ConfigurationService> config,
         setIdentity(*socket_, identity);
     setHwm(*socket_, 65536);
 
-    serviceWatch.init(std::bind(&ZmqNamedProxy::onServiceNodeChange,
-                                this,
-                                std::placeholders::_1,
-                                std::placeholders::_2));
-
-    endpointWatch.init(std::bind(&ZmqNamedProxy::onEndpointNodeChange,
-                                 this,
-                                 std::placeholders::_1,
-                                 std::placeholders::_2));
+    if (discovery)
+        discovery->unsubscribe(discoveryToken);
+    discovery = config->discovery();
+    discoveryToken
+        = discovery->subscribe(std::bind(&ZmqNamedProxy::onDiscoveryChange,
+                                         this,
+                                         std::placeholders::_1));
 }
 
 bool
@@ -477,8 +477,7 @@ connect(const std::string & endpointName,
 
     LOG(ZmqLogs::print) << "connecting to " << endpointName << endl;
 
-    vector<string> children
-        = config->getChildren(endpointName, endpointWatch);
+    auto children = discovery->getEntries(endpointName);
 
     auto setPending = [&]
         {
@@ -488,10 +487,9 @@ connect(const std::string & endpointName,
                 connectionState = CONNECTION_PENDING;
         };
 
-    for (auto c: children) {
+    for (auto & c: *children) {
         ExcAssertNotEqual(connectionState, CONNECTED);
-        string key = endpointName + "/" + c;
-        Json::Value epConfig = config->getJson(key);
+        const Json::Value & epConfig = c.second;
                 
         for (auto & entry: epConfig) {
 
@@ -570,12 +568,10 @@ connectToServiceClass(const std::string & serviceClass,
     if (connectionState == CONNECTED)
         THROW(ZmqLogs::error) << "attempt to double connect connection" << endl;
 
-    vector<string> children
-        = config->getChildren("serviceClass/" + serviceClass, serviceWatch);
+    auto children = discovery->getEntries("serviceClass/" + serviceClass);
 
-    for (auto c: children) {
-        string key = "serviceClass/" + serviceClass + "/" + c;
-        Json::Value value = config->getJson(key);
+    for (auto & c: *children) {
+        const Json::Value & value = c.second;
         std::string name = value["serviceName"].asString();
         std::string path = value["servicePath"].asString();
 
@@ -616,24 +612,23 @@ connectToServiceClass(const std::string & serviceClass,
 
 void
 ZmqNamedProxy::
-onServiceNodeChange(const std::string & path,
-                    ConfigurationService::ChangeType change)
+onDiscoveryChange(const std::string & path)
 {
     if (connectionState != CONNECTION_PENDING)
         return;  // no need to watch anymore
 
-    connectToServiceClass(serviceClass, endpointName, local, CS_ASYNCHRONOUS);
-}
-
-void
-ZmqNamedProxy::
-onEndpointNodeChange(const std::string & path,
-                     ConfigurationService::ChangeType change)
-{
-    if (connectionState != CONNECTION_PENDING)
-        return;  // no need to watch anymore
-
-    connect(connectedService, CS_ASYNCHRONOUS);
+    if (connectionType == CONNECT_TO_CLASS) {
+        // Either the providers of the class or the endpoint of one of them
+        bool endpointChanged
+            = path.size() > endpointName.size()
+            && path.compare(path.size() - endpointName.size() - 1,
+                            string::npos, "/" + endpointName) == 0;
+        if (path == "serviceClass/" + serviceClass || endpointChanged)
+            connectToServiceClass(serviceClass, endpointName, local,
+                                  CS_ASYNCHRONOUS);
+    }
+    else if (path == connectedService)
+        connect(connectedService, CS_ASYNCHRONOUS);
 }
 
 
@@ -11,6 +11,7 @@
 #include "named_endpoint.h"
 #include "message_loop.h"
 #include "logs.h"
+#include "service_discovery_cache.h"
 #include <set>
 #include <type_traits>
 #include "jml/utils/smart_ptr_utils.h"
@@ -746,6 +747,30 @@ struct ZmqNamedClientBus: public ZmqNamedEndpoint {
                                       std::forward<Args>(args)...);
     }
 
+    /** Send the same message to each of the given clients.  The message is
+        only encoded once and the copies sent to each client share its
+        payload, so with zmq::message_t or std::shared_ptr<const std::string>
+        arguments (see sharedStringMessage) nothing gets copied.
+    */
+    template<typename... Args>
+    void sendMessageToAll(const std::vector<std::string> & addresses,
+                          const std::string & topic,
+                          Args&&... args)
+    {
+        std::vector<zmq::message_t> parts;
+        parts.reserve(sizeof...(Args) + 1);
+        encodeAll(parts, topic, std::forward<Args>(args)...);
+
+        for (auto & address: addresses) {
+            std::vector<zmq::message_t> message;
+            message.reserve(parts.size() + 1);
+            message.emplace_back(encodeMessage(address));
+            for (auto & part: parts)
+                message.emplace_back(part);
+            ZmqNamedEndpoint::sendMessage(std::move(message));
+        }
+    }
+
     virtual void handleMessage(std::vector<std::string> && message)
     {
         using namespace std;
@@ -867,6 +892,8 @@ struct ZmqNamedProxy: public MessageLoop {
     ~ZmqNamedProxy()
     {
         shutdown();
+        if (discovery)
+            discovery->unsubscribe(discoveryToken);
     }
 
     void shutdown()
@@ -992,10 +1019,11 @@ struct ZmqNamedProxy: public MessageLoop {
     }
 
 protected:
-    ConfigurationService::Watch serviceWatch, endpointWatch;
     std::shared_ptr<ConfigurationService> config;
     std::shared_ptr<zmq::context_t> context_;
     std::shared_ptr<zmq::socket_t> socket_;
+    std::shared_ptr<ServiceDiscoveryCache> discovery;
+    uint64_t discoveryToken;
 
     mutable ZmqEventSource::SocketLock socketLock_;
 
@@ -1011,10 +1039,9 @@ protected:
         CONNECTED           // connect() was called and the socket was connected
     } connectionState;
 
-    void onServiceNodeChange(const std::string & path,
-                             ConfigurationService::ChangeType change);
-    void onEndpointNodeChange(const std::string & path,
-                              ConfigurationService::ChangeType change);
+    /** Called back when a directory of the service discovery changes, to
+        retry a pending connection. */
+    void onDiscoveryChange(const std::string & path);
 
     std::string serviceClass;      ///< Service class we're connecting to
     std::string endpointName;      ///< Name of endpoint to connect to
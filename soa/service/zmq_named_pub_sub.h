@@ -8,6 +8,7 @@
 #pragma once
 
 #include "zmq_endpoint.h"
+#include "service_discovery_cache.h"
 #include "typed_message_channel.h"
 #include <sys/utsname.h>
 #include "jml/arch/backtrace.h"
@@ -90,30 +91,11 @@ struct ZmqNamedPublisher: public MessageLoop {
     //{
     //}
 
-    template<typename Head, typename... Tail>
-    void encodeAll(std::vector<zmq::message_t> & messages,
-                   Head head,
-                   Tail&&... tail)
-    {
-        messages.emplace_back(std::move(encodeMessage(head)));
-        encodeAll(messages, std::forward<Tail>(tail)...);
-    }
-
-    // Vectors treated specially... they are copied
-    template<typename... Tail>
-    void encodeAll(std::vector<zmq::message_t> & messages,
-                   const std::vector<std::string> & head,
-                   Tail&&... tail)
-    {
-        for (auto & m: head)
-            messages.emplace_back(std::move(encodeMessage(m)));
-        encodeAll(messages, std::forward<Tail>(tail)...);
-    }
-
-    void encodeAll(std::vector<zmq::message_t> & messages)
-    {
-    }
-
+    /** Publish a message on the given channel.  Arguments that are a
+        zmq::message_t or a std::shared_ptr<const std::string> (see
+        sharedStringMessage) are published without copying their payload,
+        which is worth it for large messages.
+    */
     template<typename... Args>
     void publish(const std::string & channel, Args&&... args)
     {
@@ -122,7 +104,16 @@ struct ZmqNamedPublisher: public MessageLoop {
         
         encodeAll(messages, channel,
                   std::forward<Args>(args)...);
-        publishQueue.push(messages);
+        publishQueue.push(std::move(messages));
+    }
+
+    /** Send a message that is already encoded, channel included, without
+        going through the queue.  Must only be called from the thread of
+        the message loop, for example from a periodic added to it.
+    */
+    void sendFromLoop(std::vector<zmq::message_t> && message)
+    {
+        publishEndpoint.sendMessage(std::move(message));
     }
 
 private:
@@ -173,8 +164,15 @@ private:
 struct EndpointConnector : public MessageLoop {
 
     EndpointConnector()
-        : changes(32)
+        : changes(32), discoveryToken(0)
+    {
+    }
+
+    ~EndpointConnector()
     {
+        shutdown();
+        if (discovery)
+            discovery->unsubscribe(discoveryToken);
     }
 
     void init(std::shared_ptr<ConfigurationService> config)
@@ -187,6 +185,16 @@ struct EndpointConnector : public MessageLoop {
                         std::placeholders::_1);
 
         addSource("EndpointConnector::changes", changes);
+
+        // The endpoints are read from the snapshot shared by the process,
+        // which tells us when one of them changes
+        discovery = config->discovery();
+        discoveryToken = discovery->subscribe([=] (const std::string & path)
+            {
+                std::unique_lock<Lock> guard(lock);
+                if (endpoints.count(path))
+                    changes.push(path);
+            });
     }
 
     void watchEndpoint(const std::string & endpointPath)
@@ -196,30 +204,8 @@ struct EndpointConnector : public MessageLoop {
         using namespace std;
         //cerr << "watching endpoint " << endpointPath << endl;
 
-        auto & entry = endpoints[endpointPath];
-
-        if (!entry.watch) {
+        if (endpoints.insert(make_pair(endpointPath, Entry())).second) {
             // First time that we watch this service; set it up
-
-            //cerr << "=============== initializing watch for " << endpointPath << endl;
-
-            entry.watch.init([=] (const std::string & path,
-                                  ConfigurationService::ChangeType change)
-                             {
-                                 using namespace std;
-                                 //cerr << "endpoint changed path " << path << " " << this << endl;
-
-                                 {
-                                     std::unique_lock<Lock> guard(lock);
-                                     if (endpoints.count(endpointPath)) {
-                                         auto & entry = endpoints[endpointPath];
-                                         entry.watchIsSet = false;
-                                     }
-                                 }
-                                 
-                                 changes.push(endpointPath);
-                             });
-
             changes.push(endpointPath);
         }
     }
@@ -285,19 +271,14 @@ private:
     TypedMessageSink<std::string> changes;
 
     struct Entry {
-        Entry()
-            : watchIsSet(false)
-        {
-        }
-
-        ConfigurationService::Watch watch;
         std::string connectedTo;
-        bool watchIsSet;
     };
 
     std::map<std::string, Entry> endpoints;
 
     std::shared_ptr<ConfigurationService> config;
+    std::shared_ptr<ServiceDiscoveryCache> discovery;
+    uint64_t discoveryToken;
 
     void handleEndpointChange(const std::string & endpointPath)
     {
@@ -305,6 +286,16 @@ private:
 
         //cerr << "handleEndpointChange " << endpointPath << endl;
 
+        {
+            std::unique_lock<Lock> guard(lock);
+            if (!endpoints.count(endpointPath))
+                return;
+        }
+
+        // Not under our lock, as the first read of an endpoint calls back
+        // into us
+        auto children = discovery->getEntries(endpointPath);
+
         std::unique_lock<Lock> guard(lock);
 
         if (!endpoints.count(endpointPath))
@@ -314,20 +305,17 @@ private:
 
         //cerr << "handling service class change for " << endpointPath << endl;
 
-        vector<string> children;
-        if (entry.watchIsSet)
-            children = config->getChildren(endpointPath);
-        else children = config->getChildren(endpointPath, entry.watch);
-        entry.watchIsSet = true;
-
-        //cerr << "children = " << children << endl;
-
         // If we're connected, look for a change in the endpoints
         if (!entry.connectedTo.empty()) {
 
             // Does our connected node still exist?
-            if (std::find(children.begin(), children.end(), entry.connectedTo)
-                == children.end()) {
+            auto isConnectedTo
+                = [&] (const std::pair<std::string, Json::Value> & c)
+                {
+                    return c.first == entry.connectedTo;
+                };
+            if (std::find_if(children->begin(), children->end(),
+                             isConnectedTo) == children->end()) {
                 // Node disappeared; we need to disconnect
                 guard.unlock();
                 handleDisconnection(endpointPath, entry.connectedTo);
@@ -343,10 +331,9 @@ private:
         guard.unlock();
 
         // If we got here, we're not connected
-        for (auto & c: children) {
-            Json::Value cfg = config->getJson(endpointPath + "/" + c);
-            if (connect(endpointPath, c, cfg)) {
-                notifyConnectionStatus(endpointPath, c, true);
+        for (auto & c: *children) {
+            if (connect(endpointPath, c.first, c.second)) {
+                notifyConnectionStatus(endpointPath, c.first, true);
                 return;
             }
         }
@@ -720,7 +707,7 @@ struct ZmqNamedSubscriber: public ZmqNamedSocket {
 struct ServiceProviderWatcher: public MessageLoop {
 
     ServiceProviderWatcher()
-        : currentToken(1), changes(128)
+        : currentToken(1), discoveryToken(0), changes(128)
     {
     }
 
@@ -729,6 +716,8 @@ struct ServiceProviderWatcher: public MessageLoop {
         using namespace std;
         //cerr << "shutting down service provider watcher" << endl;
         shutdown();
+        if (discovery)
+            discovery->unsubscribe(discoveryToken);
         //cerr << "done" << endl;
     }
 
@@ -742,6 +731,19 @@ struct ServiceProviderWatcher: public MessageLoop {
                         std::placeholders::_1);
 
         addSource("ServiceProviderWatcher::changes", changes);
+
+        discovery = config->discovery();
+        discoveryToken = discovery->subscribe([=] (const std::string & path)
+            {
+                static const std::string prefix = "serviceClass/";
+                if (path.compare(0, prefix.size(), prefix) != 0)
+                    return;
+                std::string serviceClass = path.substr(prefix.size());
+
+                std::unique_lock<Lock> guard(lock);
+                if (serviceClasses.count(serviceClass))
+                    changes.push(serviceClass);
+            });
     }
 
     /** Type of a function that will be called when there is a change on
@@ -770,22 +772,13 @@ struct ServiceProviderWatcher: public MessageLoop {
 
         std::unique_lock<Lock> guard(lock);
 
-        auto & entry = serviceClasses[serviceClass];
-
-        //cerr << "entry.watch = " << entry.watch << endl;
-
-        if (!entry.watch) {
-            // First time that we watch this service; set it up
-
-            entry.watch.init([=] (const std::string & path,
-                                  ConfigurationService::ChangeType change)
-                             {
-                                 using namespace std;
-                                 //cerr << "changed path " << path << endl;
-
-                                 changes.push(serviceClass);
-                             });
+        auto inserted = serviceClasses.insert(make_pair(serviceClass,
+                                                        ServiceClassEntry()));
+        auto & entry = inserted.first->second;
 
+        if (inserted.second) {
+            // First time that we watch this service; changes will come
+            // through the discovery cache from now on
             changes.push(serviceClass);
         }
 
@@ -825,8 +818,6 @@ private:
     };
 
     struct ServiceClassEntry {
-        /// Watch on the service providers node
-        ConfigurationService::Watch watch;
         std::map<uint64_t, WatchEntry> entries; 
 
         /** Current set of known children of the service nodes.  Used to
@@ -839,6 +830,8 @@ private:
     std::map<std::string, ServiceClassEntry> serviceClasses;
 
     std::shared_ptr<ConfigurationService> config;
+    std::shared_ptr<ServiceDiscoveryCache> discovery;
+    uint64_t discoveryToken;
 
     /** Deal with a change in the service class node. */
     void handleServiceClassChange(const std::string & serviceClass)
@@ -846,6 +839,14 @@ private:
         using namespace std;
 
         //cerr << "handleServiceClassChange " << serviceClass << endl;
+
+        // Not under our lock, as the first read of a class calls back into
+        // us
+        auto entries = discovery->getEntries("serviceClass/" + serviceClass);
+
+        vector<string> children;
+        for (auto & e: *entries)
+            children.push_back(e.first);
         
         std::unique_lock<Lock> guard(lock);
 
@@ -853,10 +854,6 @@ private:
 
         //cerr << "handling service class change for " << serviceClass << endl;
 
-        vector<string> children
-            = config->getChildren("serviceClass/" + serviceClass,
-                                  entry.watch);
-
         //cerr << "children = " << children << endl;
 
         std::sort(children.begin(), children.end());
@@ -214,6 +214,77 @@ inline zmq::message_t encodeMessage(const Json::Value & j)
     return chomp(j.toString());
 }
 
+/** Copying a message only bumps the reference count of its data so the same
+    message can be sent to many peers without copying the payload again.
+*/
+inline zmq::message_t encodeMessage(const zmq::message_t & message)
+{
+    return message;
+}
+
+/** Return a message that points into the given string rather than copying
+    it.  The string is kept alive until zeromq is done with the message and
+    all of its copies.
+*/
+inline zmq::message_t
+sharedStringMessage(const std::shared_ptr<const std::string> & str)
+{
+    typedef std::shared_ptr<const std::string> Holder;
+
+    std::unique_ptr<Holder> holder(new Holder(str));
+    auto release = [] (void *, void * hint)
+        {
+            delete reinterpret_cast<Holder *>(hint);
+        };
+
+    zmq::message_t result((void *)str->data(), str->size(),
+                          release, holder.get());
+    holder.release();
+    return result;
+}
+
+/** Shared strings are sent without copying their contents (see
+    sharedStringMessage above).  Note that this only applies to pointers to
+    const strings: any other shared pointer is sent as a pointer for the
+    same process to pick up (see sharedPtrToMessage).
+*/
+inline zmq::message_t
+encodeMessage(const std::shared_ptr<const std::string> & str)
+{
+    return sharedStringMessage(str);
+}
+
+/** Encode each of the arguments into a part of the message.  A vector of
+    strings becomes one part per string.
+*/
+inline void encodeAll(std::vector<zmq::message_t> & messages)
+{
+}
+
+template<typename... Tail>
+void encodeAll(std::vector<zmq::message_t> & messages,
+               const std::vector<std::string> & head,
+               Tail&&... tail);
+
+template<typename Head, typename... Tail>
+void encodeAll(std::vector<zmq::message_t> & messages,
+               const Head & head,
+               Tail&&... tail)
+{
+    messages.emplace_back(encodeMessage(head));
+    encodeAll(messages, std::forward<Tail>(tail)...);
+}
+
+template<typename... Tail>
+void encodeAll(std::vector<zmq::message_t> & messages,
+               const std::vector<std::string> & head,
+               Tail&&... tail)
+{
+    for (auto & m: head)
+        messages.emplace_back(encodeMessage(m));
+    encodeAll(messages, std::forward<Tail>(tail)...);
+}
+
 inline bool sendMesg(zmq::socket_t & sock,
                      const std::string & msg,
                      int options = 0)
@@ -243,6 +314,13 @@ inline bool sendMesg(zmq::socket_t & sock,
     return sock.send(msg1, options);
 }
 
+inline bool sendMesg(zmq::socket_t & sock,
+                     const std::shared_ptr<const std::string> & str,
+                     int options = 0)
+{
+    return sock.send(sharedStringMessage(str), options);
+}
+
 template<typename T>
 inline bool sendMesg(zmq::socket_t & sock,
                      const T & obj,
@@ -314,7 +392,7 @@ inline void sendMessage(zmq::socket_t & socket,
 template<typename Arg1, typename... Args>
 void sendMessage(zmq::socket_t & socket,
                  const Arg1 & arg1,
-                 Args... args)
+                 const Args &... args)
 {
     if (!sendMesg(socket, arg1, ZMQ_SNDMORE | BLOCK_FLAG)) {
         throwSocketError(__FUNCTION__);
@@ -337,7 +415,8 @@ bool trySendMessage(zmq::socket_t & socket, const Arg1 & arg1)
 }
 
 template<typename Arg1, typename... Args>
-bool trySendMessage(zmq::socket_t & socket, const Arg1 & arg1, Args... args)
+bool trySendMessage(zmq::socket_t & socket, const Arg1 & arg1,
+                    const Args &... args)
 {
     if (!sendMesg(socket, arg1, ZMQ_SNDMORE | BLOCK_FLAG)) {
         if (errno == EAGAIN)
@@ -8,6 +8,7 @@
 #include "jml/arch/timers.h"
 #include "jml/arch/backtrace.h"
 #include <cstring>
+#include <memory>
 
 using namespace std;
 
@@ -36,6 +37,56 @@ void zk_callback(zhandle_t * ah, int type, int state, const char * path, void *
     }
 }
 
+struct NodeReadBatch {
+    NodeReadBatch(size_t pending,
+                  const ZookeeperConnection::OnNodeRead & onRead,
+                  ZookeeperCallbackManager & callbackMgr)
+        : pending(pending), onRead(onRead), callbackMgr(callbackMgr)
+    {
+    }
+
+    void finish(size_t index, uintptr_t cb, bool found,
+                const std::string & value)
+    {
+        if (cb) {
+            if (found)
+                callbackMgr.mark(cb, true);
+            else delete callbackMgr.popCallback(cb);
+        }
+
+        onRead(index, found, value);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (--pending == 0)
+            done.notify_all();
+    }
+
+    std::mutex lock;
+    std::condition_variable done;
+    size_t pending;
+    const ZookeeperConnection::OnNodeRead & onRead;
+    ZookeeperCallbackManager & callbackMgr;
+};
+
+struct NodeRead {
+    NodeReadBatch * batch;
+    size_t index;
+    uintptr_t cb;
+};
+
+void nodeReadCompletion(int rc, const char * value, int valueLen,
+                        const struct Stat * stat, const void * data)
+{
+    std::unique_ptr<NodeRead> read((NodeRead *) data);
+
+    bool found = (rc == ZOK);
+    std::string result;
+    if (found && value && valueLen > 0)
+        result.assign(value, valueLen);
+
+    read->batch->finish(read->index, read->cb, found, result);
+}
+
 } // file scope
 
 ZookeeperCallbackManager &ZookeeperCallbackManager::instance()
@@ -98,7 +149,7 @@ ZookeeperCallbackManager::sendEvent(int type, int state)
         localCallbacks = std::move(callbacks_);
     }
 
-    for( auto it = localCallbacks.begin(); it != callbacks_.end(); ++it)
+    for( auto it = localCallbacks.begin(); it != localCallbacks.end(); ++it)
     {
         //Only invoke if valid
         if(it->second.valid)
@@ -457,8 +508,11 @@ nodeExists(const std::string & path_, ZookeeperCallbackType watcher, void * watc
         uintptr_t cb = callbackMgr_.createCallback(watcher, path, watcherData);
                 int res = zoo_wexists(handle, path.c_str(), zk_callback,
                 reinterpret_cast<void *>(cb), 0 /* stat */);
-        if (res == ZNONODE)
+        if (res == ZNONODE) {
+            // the watch is also set on missing nodes
+            callbackMgr_.mark(cb, true);
             return false;
+        }
         if (checkRes(res, retries, "zoo_wexists", path.c_str()) == CR_DONE)
         {
             // mark this particular callback as valid
@@ -499,6 +553,40 @@ readNode(const std::string & path_, ZookeeperCallbackType watcher, void * watche
     return string(buf, buf + bufLen);
 }
 
+void
+ZookeeperConnection::
+readNodes(const std::vector<std::string> & paths,
+          const OnNodeRead & onRead,
+          ZookeeperCallbackType watcher,
+          const std::vector<void *> & watcherData)
+{
+    if (watcher && watcherData.size() != paths.size())
+        throw ML::Exception("readNodes: watcher data must be given for each"
+                            " path");
+
+    NodeReadBatch batch(paths.size(), onRead, callbackMgr_);
+
+    for (size_t i = 0;  i < paths.size();  ++i) {
+        string path = fixPath(paths[i]);
+        uintptr_t cb = callbackMgr_.createCallback(watcher, path,
+                                                   watcher
+                                                   ? watcherData[i]
+                                                   : nullptr);
+
+        NodeRead * read = new NodeRead{&batch, i, cb};
+        int res = zoo_awget(handle, path.c_str(),
+                            zk_callback, reinterpret_cast<void *>(cb),
+                            nodeReadCompletion, read);
+        if (res != ZOK) {
+            delete read;
+            batch.finish(i, cb, false, "");
+        }
+    }
+
+    std::unique_lock<std::mutex> guard(batch.lock);
+    batch.done.wait(guard, [&] () { return batch.pending == 0; });
+}
+
 void
 ZookeeperConnection::
 writeNode(const std::string & path, const std::string & value)
@@ -563,13 +651,12 @@ getChildren(const std::string & path_, bool failIfNodeMissing,
                 else if (res == ZNONODE)
                 {
                     std::cerr << "2. returning result " << std::endl;
+                    // the watch will trigger when the node is created
+                    callbackMgr_.mark(cb, true);
                     return result;
                 }
-                if (checkRes(res, retries, "zoo_wexists", path.c_str()) == CR_DONE)
-                {
-                    cerr << "3. Returning result "  << endl;
-                    return result;
-                }
+                if (checkRes(res, retries, "zoo_wexists", path.c_str()) == CR_RETRY)
+                    continue;
             }
             return result;
         }
@@ -12,6 +12,7 @@
 #include "jml/arch/format.h"
 #include "jml/utils/guard.h"
 
+#include <functional>
 #include <set>
 #include <iostream>
 #include <vector>
@@ -175,6 +176,27 @@ struct ZookeeperConnection {
                          ZookeeperCallbackType watcher = 0,
                          void * watcherData = 0);
 
+    /** Called by readNodes with the result for the node at position
+        "index" in the batch. "found" is false when the node could not be
+        read, in which case no watch was set on it and its watcher data was
+        not used.
+    */
+    typedef std::function<void (size_t index, bool found,
+                                const std::string & value)> OnNodeRead;
+
+    /** Read several nodes at once. All the requests are sent before the
+        replies are waited for, so that the batch costs a single round trip
+        instead of one per node. When a watcher is given, "watcherData"
+        holds the data passed to it for each node. "onRead" is invoked from
+        the ZooKeeper thread and the call returns once all the replies were
+        received. Failed reads are not retried.
+    */
+    void readNodes(const std::vector<std::string> & paths,
+                   const OnNodeRead & onRead,
+                   ZookeeperCallbackType watcher = 0,
+                   const std::vector<void *> & watcherData
+                   = std::vector<void *>());
+
     void writeNode(const std::string & path, const std::string & value);
 
     std::vector<std::string>
@@ -10,6 +10,8 @@
 #include "jml/utils/exc_assert.h"
 #include <boost/algorithm/string.hpp>
 #include <sys/utsname.h>
+#include <mutex>
+#include <unordered_map>
 
 using namespace std;
 using namespace ML;
@@ -69,6 +71,18 @@ std::string printChangeType(ConfigurationService::ChangeType change)
 }
     
 
+ConfigurationService::ChangeType
+changeTypeForEvent(int type)
+{
+    if (type == ZOO_CREATED_EVENT)
+        return ConfigurationService::CREATED;
+    if (type == ZOO_CHANGED_EVENT)
+        return ConfigurationService::VALUE_CHANGED;
+    if (type == ZOO_CHILD_EVENT)
+        return ConfigurationService::NEW_CHILD;
+    return ConfigurationService::DELETED;
+}
+
 void
 watcherFn(int type, int state, std::string const & path, void * watcherCtx)
 {
@@ -83,15 +97,7 @@ watcherFn(int type, int state, std::string const & path, void * watcherCtx)
 #endif
 
 
-    ConfigurationService::ChangeType change;
-    if (type == ZOO_CREATED_EVENT)
-        change = ConfigurationService::CREATED;
-    if (type == ZOO_DELETED_EVENT)
-        change = ConfigurationService::DELETED;
-    if (type == ZOO_CHANGED_EVENT)
-        change = ConfigurationService::VALUE_CHANGED;
-    if (type == ZOO_CHILD_EVENT)
-        change = ConfigurationService::NEW_CHILD;
+    ConfigurationService::ChangeType change = changeTypeForEvent(type);
 
     auto & item = *data;
     if (item->watchReferences > 0) {
@@ -112,6 +118,275 @@ getWatcherFn(const ConfigurationService::Watch & watch)
 }
 
 
+/*****************************************************************************/
+/* ZOOKEEPER CONFIGURATION SERVICE CACHE                                     */
+/*****************************************************************************/
+
+/** Values and children read from ZooKeeper, indexed by their full path.
+    Every cached item has a ZooKeeper watch set on it, which invalidates it
+    and triggers the watches of the readers of the item. The generation of
+    an item changes with each invalidation, so that the result of a read
+    that was in progress at that moment is not cached.
+*/
+
+struct ZookeeperConfigurationService::Cache
+    : public std::enable_shared_from_this<Cache> {
+    typedef std::shared_ptr<ConfigurationService::Watch::Data> WatchData;
+
+    struct Item {
+        Item()
+            : cached(false), generation(0)
+        {
+        }
+
+        bool cached;
+        uint64_t generation;
+        std::vector<WatchData> watches;
+    };
+
+    struct Entry {
+        Item valueItem;
+        std::string value;
+        Item childrenItem;
+        std::vector<std::string> children;
+    };
+
+    struct WatcherData {
+        std::weak_ptr<Cache> cache;
+        bool children;
+    };
+
+    Cache()
+        : enabled(true)
+    {
+    }
+
+    std::string getValue(ZookeeperConnection & zoo, const std::string & path,
+                         Watch & watch);
+    std::vector<std::string> getChildren(ZookeeperConnection & zoo,
+                                         const std::string & path,
+                                         Watch & watch);
+
+    /** Read the values of the given children in a single batch, so that
+        the readers that list a node and then read each child find them in
+        the cache. */
+    void prefetch(ZookeeperConnection & zoo, const std::string & path,
+                  const std::vector<std::string> & children);
+
+    /** Uncache the value of "path" and the children of its parents after a
+        local change, while waiting for the watches to trigger. */
+    void forget(const std::string & path, bool recursive);
+
+    void invalidate(const std::string & path, int type, bool children);
+
+    void * newWatcherData(bool children)
+    {
+        return new WatcherData{shared_from_this(), children};
+    }
+
+    static void watcherFn(int type, int state, std::string const & path,
+                          void * watcherCtx);
+
+    std::mutex lock;
+    std::unordered_map<std::string, Entry> entries;
+    bool enabled;
+};
+
+namespace {
+
+std::shared_ptr<ConfigurationService::Watch::Data>
+getWatchData(ConfigurationService::Watch & watch)
+{
+    std::unique_ptr<std::shared_ptr<ConfigurationService::Watch::Data> >
+        data(watch.get());
+    return *data;
+}
+
+} // file scope
+
+std::string
+ZookeeperConfigurationService::Cache::
+getValue(ZookeeperConnection & zoo, const std::string & path, Watch & watch)
+{
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        Entry & entry = entries[path];
+        if (watch)
+            entry.valueItem.watches.push_back(getWatchData(watch));
+        if (entry.valueItem.cached)
+            return entry.value;
+        generation = entry.valueItem.generation;
+    }
+
+    /* Missing nodes are read as empty values and readNode leaves no watch
+       on them, in which case an existence watch is set instead. A node that
+       was created in between is read again. */
+    string value = zoo.readNode(path, watcherFn, newWatcherData(false));
+    if (value.empty() && zoo.nodeExists(path, watcherFn, newWatcherData(false)))
+        value = zoo.readNode(path, watcherFn, newWatcherData(false));
+
+    std::lock_guard<std::mutex> guard(lock);
+    Entry & entry = entries[path];
+    if (entry.valueItem.generation == generation) {
+        entry.valueItem.cached = true;
+        entry.value = value;
+    }
+
+    return value;
+}
+
+std::vector<std::string>
+ZookeeperConfigurationService::Cache::
+getChildren(ZookeeperConnection & zoo, const std::string & path,
+            Watch & watch)
+{
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        Entry & entry = entries[path];
+        if (watch)
+            entry.childrenItem.watches.push_back(getWatchData(watch));
+        if (entry.childrenItem.cached)
+            return entry.children;
+        generation = entry.childrenItem.generation;
+    }
+
+    vector<string> children = zoo.getChildren(path,
+                                              false /* fail if not there */,
+                                              watcherFn,
+                                              newWatcherData(true));
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        Entry & entry = entries[path];
+        if (entry.childrenItem.generation == generation) {
+            entry.childrenItem.cached = true;
+            entry.children = children;
+        }
+    }
+
+    prefetch(zoo, path, children);
+
+    return children;
+}
+
+void
+ZookeeperConfigurationService::Cache::
+prefetch(ZookeeperConnection & zoo, const std::string & path,
+         const std::vector<std::string> & children)
+{
+    vector<string> paths;
+    vector<uint64_t> generations;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (const string & child: children) {
+            string childPath = (path == "/" ? path : path + "/") + child;
+            Entry & entry = entries[childPath];
+            if (!entry.valueItem.cached) {
+                paths.push_back(childPath);
+                generations.push_back(entry.valueItem.generation);
+            }
+        }
+    }
+
+    if (paths.empty())
+        return;
+
+    vector<void *> watcherData;
+    for (unsigned i = 0;  i < paths.size();  ++i)
+        watcherData.push_back(newWatcherData(false));
+
+    auto onRead = [&] (size_t index, bool found, const std::string & value) {
+        if (!found) {
+            delete (WatcherData *) watcherData[index];
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        Entry & entry = entries[paths[index]];
+        if (entry.valueItem.generation == generations[index]) {
+            entry.valueItem.cached = true;
+            entry.value = value;
+        }
+    };
+    zoo.readNodes(paths, onRead, watcherFn, watcherData);
+}
+
+void
+ZookeeperConfigurationService::Cache::
+forget(const std::string & path, bool recursive)
+{
+    auto uncache = [] (Item & item) {
+        item.cached = false;
+        ++item.generation;
+    };
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    string childPrefix = path + "/";
+    for (auto & entry: entries) {
+        const string & key = entry.first;
+        if (key == path
+            || (recursive && key.compare(0, childPrefix.size(),
+                                         childPrefix) == 0)) {
+            uncache(entry.second.valueItem);
+            if (recursive)
+                uncache(entry.second.childrenItem);
+        }
+    }
+
+    /* creating or removing a node changes the children of its parents */
+    for (string parent = path;;) {
+        string::size_type pos = parent.rfind('/');
+        if (pos == string::npos || pos == 0)
+            break;
+        parent.resize(pos);
+        auto it = entries.find(parent);
+        if (it != entries.end())
+            uncache(it->second.childrenItem);
+    }
+}
+
+void
+ZookeeperConfigurationService::Cache::
+invalidate(const std::string & path, int type, bool children)
+{
+    vector<WatchData> watches;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = entries.find(path);
+        if (it == entries.end())
+            return;
+
+        Entry & entry = it->second;
+        Item & item = children ? entry.childrenItem : entry.valueItem;
+        item.cached = false;
+        ++item.generation;
+        watches.swap(item.watches);
+        if (children)
+            entry.children.clear();
+        else entry.value.clear();
+    }
+
+    ConfigurationService::ChangeType change = changeTypeForEvent(type);
+    for (auto & data: watches) {
+        if (data->watchReferences > 0)
+            data->onChange(path, change);
+    }
+}
+
+void
+ZookeeperConfigurationService::Cache::
+watcherFn(int type, int state, std::string const & path, void * watcherCtx)
+{
+    std::unique_ptr<WatcherData> data(reinterpret_cast<WatcherData *>(watcherCtx));
+
+    auto cache = data->cache.lock();
+    if (cache)
+        cache->invalidate(path, type, data->children);
+}
+
+
 
 /*****************************************************************************/
 /* ZOOKEEPER CONFIGURATION SERVICE                                           */
@@ -119,6 +394,7 @@ getWatcherFn(const ConfigurationService::Watch & watch)
 
 ZookeeperConfigurationService::
 ZookeeperConfigurationService()
+    : cache(std::make_shared<Cache>())
 {
 }
 
@@ -127,6 +403,7 @@ ZookeeperConfigurationService(std::string host,
                               std::string prefix,
                               std::string location,
                               int timeout)
+    : cache(std::make_shared<Cache>())
 {
     init(std::move(host), std::move(prefix), std::move(location));
 }
@@ -166,8 +443,11 @@ ZookeeperConfigurationService::
 getJson(const std::string & key, Watch watch)
 {
     ExcAssert(zoo);
-    auto val = zoo->readNode(prefix + key, getWatcherFn(watch),
-                             watch.get());
+    string val;
+    if (cache->enabled)
+        val = cache->getValue(*zoo, ZookeeperConnection::fixPath(prefix + key),
+                              watch);
+    else val = zoo->readNode(prefix + key, getWatcherFn(watch), watch.get());
     try {
         if (val == "")
             return Json::Value();
@@ -191,6 +471,7 @@ set(const std::string & key,
                          true /* create path */).second)
         zoo->writeNode(prefix + key, boost::trim_copy(value.toString()));
     ExcAssert(zoo);
+    cache->forget(ZookeeperConnection::fixPath(prefix + key), false);
 }
 
 std::string
@@ -200,12 +481,15 @@ setUnique(const std::string & key,
 {
     //cerr << "setting unique " << key << " to " << value << endl;
     ExcAssert(zoo);
-    return zoo->createNode(prefix + key, boost::trim_copy(value.toString()),
-                           true /* ephemeral */,
-                           false /* sequential */,
-                           true /* mustSucceed */,
-                           true /* create path */)
+    string path = zoo->createNode(prefix + key,
+                                  boost::trim_copy(value.toString()),
+                                  true /* ephemeral */,
+                                  false /* sequential */,
+                                  true /* mustSucceed */,
+                                  true /* create path */)
         .first;
+    cache->forget(ZookeeperConnection::fixPath(path), false);
+    return path;
 }
 
 std::vector<std::string>
@@ -214,6 +498,10 @@ getChildren(const std::string & key,
             Watch watch)
 {
     //cerr << "getChildren " << key << " watch " << watch << endl;
+    if (cache->enabled)
+        return cache->getChildren(*zoo,
+                                  ZookeeperConnection::fixPath(prefix + key),
+                                  watch);
     return zoo->getChildren(prefix + key,
                             false /* fail if not there */,
                             getWatcherFn(watch),
@@ -274,6 +562,14 @@ removePath(const std::string & path)
 {
     ExcAssert(zoo);
     zoo->removePath(prefix + path);
+    cache->forget(ZookeeperConnection::fixPath(prefix + path), true);
+}
+
+void
+ZookeeperConfigurationService::
+enableCache(bool enabled)
+{
+    cache->enabled = enabled;
 }
 
 
@@ -62,9 +62,19 @@ struct ZookeeperConfigurationService
     /** Recursively remove everything below this path. */
     virtual void removePath(const std::string & path);
 
+    /** Enable or disable the caching of the values and children read from
+        ZooKeeper. Cached entries are kept until ZooKeeper notifies that
+        they changed, so that the watches of all the readers of a node are
+        served by a single ZooKeeper watch. Enabled by default.
+    */
+    void enableCache(bool enabled);
+
 private:
+    struct Cache;
+
     std::unique_ptr<ZookeeperConnection> zoo;
     std::string prefix;
+    std::shared_ptr<Cache> cache;
 };
 
 
@@ -0,0 +1,756 @@
+/* binary_json.cc
+   FreeBSD-style copyright and disclaimer apply
+
+   Binary encoding of the JSON data model.
+*/
+
+#include "binary_json.h"
+#include "jml/arch/format.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+
+
+namespace Datacratic {
+
+using namespace BinaryJson;
+
+
+/*****************************************************************************/
+/* BINARY JSON PRINTING CONTEXT                                              */
+/*****************************************************************************/
+
+void
+BinaryJsonPrintingContext::
+writeVarint(unsigned long long val)
+{
+    while (val >= 0x80) {
+        output.push_back(char(val | 0x80));
+        val >>= 7;
+    }
+    output.push_back(char(val));
+}
+
+void
+BinaryJsonPrintingContext::
+writeBytes(const char * data, size_t size)
+{
+    writeTag(STRING_TAG);
+    writeVarint(size);
+    output.append(data, size);
+}
+
+void
+BinaryJsonPrintingContext::
+startObject()
+{
+    writeTag(OBJECT_TAG);
+}
+
+void
+BinaryJsonPrintingContext::
+startMember(const std::string & memberName)
+{
+    writeTag(KEY_TAG);
+    output.append(memberName.c_str(), memberName.size() + 1);
+}
+
+void
+BinaryJsonPrintingContext::
+endObject()
+{
+    writeTag(END_TAG);
+}
+
+void
+BinaryJsonPrintingContext::
+startArray(int knownSize)
+{
+    writeTag(ARRAY_TAG);
+}
+
+void
+BinaryJsonPrintingContext::
+newArrayElement()
+{
+}
+
+void
+BinaryJsonPrintingContext::
+endArray()
+{
+    writeTag(END_TAG);
+}
+
+void
+BinaryJsonPrintingContext::
+skip()
+{
+    writeNull();
+}
+
+void
+BinaryJsonPrintingContext::
+writeNull()
+{
+    writeTag(NULL_TAG);
+}
+
+void
+BinaryJsonPrintingContext::
+writeInt(int i)
+{
+    writeLongLong(i);
+}
+
+void
+BinaryJsonPrintingContext::
+writeUnsignedInt(unsigned int i)
+{
+    writeUnsignedLongLong(i);
+}
+
+void
+BinaryJsonPrintingContext::
+writeLong(long int i)
+{
+    writeLongLong(i);
+}
+
+void
+BinaryJsonPrintingContext::
+writeUnsignedLong(unsigned long int i)
+{
+    writeUnsignedLongLong(i);
+}
+
+void
+BinaryJsonPrintingContext::
+writeLongLong(long long int i)
+{
+    // Zig-zag encoding keeps small negative numbers small.
+    unsigned long long u = i;
+    writeTag(INT_TAG);
+    writeVarint((u << 1) ^ (i < 0 ? ~0ULL : 0ULL));
+}
+
+void
+BinaryJsonPrintingContext::
+writeUnsignedLongLong(unsigned long long int i)
+{
+    writeTag(UINT_TAG);
+    writeVarint(i);
+}
+
+void
+BinaryJsonPrintingContext::
+writeFloat(float f)
+{
+    writeDouble(f);
+}
+
+void
+BinaryJsonPrintingContext::
+writeDouble(double d)
+{
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+
+    writeTag(DOUBLE_TAG);
+    for (unsigned i = 0;  i < 8;  ++i)
+        output.push_back(char(bits >> (i * 8)));
+}
+
+void
+BinaryJsonPrintingContext::
+writeString(const std::string & s)
+{
+    writeBytes(s.data(), s.size());
+}
+
+void
+BinaryJsonPrintingContext::
+writeStringUtf8(const Utf8String & s)
+{
+    writeBytes(s.rawData(), s.rawLength());
+}
+
+void
+BinaryJsonPrintingContext::
+writeJson(const Json::Value & val)
+{
+    switch (val.type()) {
+    case Json::nullValue:    writeNull();  return;
+    case Json::intValue:     writeLongLong(val.asInt());  return;
+    case Json::uintValue:    writeUnsignedLongLong(val.asUInt());  return;
+    case Json::realValue:    writeDouble(val.asDouble());  return;
+    case Json::stringValue:  writeString(val.asString());  return;
+    case Json::booleanValue: writeBool(val.asBool());  return;
+
+    case Json::arrayValue:
+        startArray(val.size());
+        for (unsigned i = 0;  i < val.size();  ++i) {
+            newArrayElement();
+            writeJson(val[i]);
+        }
+        endArray();
+        return;
+
+    case Json::objectValue:
+        startObject();
+        for (auto it = val.begin(), end = val.end();  it != end;  ++it) {
+            writeTag(KEY_TAG);
+            const char * name = it.memberNameC();
+            output.append(name, strlen(name) + 1);
+            writeJson(*it);
+        }
+        endObject();
+        return;
+
+    default:
+        throw ML::Exception("can't encode JSON value of unknown type");
+    }
+}
+
+void
+BinaryJsonPrintingContext::
+writeBool(bool b)
+{
+    writeTag(b ? TRUE_TAG : FALSE_TAG);
+}
+
+
+/*****************************************************************************/
+/* BINARY JSON PARSING CONTEXT                                               */
+/*****************************************************************************/
+
+void
+BinaryJsonParsingContext::
+exception(const std::string & message)
+{
+    throw ML::Exception("at " + printPath() + ": " + message
+                        + " (binary json offset "
+                        + to_string(pos - start) + ")");
+}
+
+std::string
+BinaryJsonParsingContext::
+getContext() const
+{
+    return "offset " + to_string(pos - start) + " at " + printPath();
+}
+
+unsigned char
+BinaryJsonParsingContext::
+peek() const
+{
+    if (pos == end)
+        const_cast<BinaryJsonParsingContext *>(this)
+            ->exception("unexpected end of binary json");
+    return *pos;
+}
+
+void
+BinaryJsonParsingContext::
+expectTag(Tag tag, const char * what)
+{
+    if (peek() != tag)
+        exception(ML::format("expected %s; got tag %d", what, (int)peek()));
+    ++pos;
+}
+
+unsigned long long
+BinaryJsonParsingContext::
+readVarint()
+{
+    unsigned long long result = 0;
+
+    for (unsigned shift = 0;  shift < 64;  shift += 7) {
+        unsigned char c = peek();
+        ++pos;
+        result |= (unsigned long long)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return result;
+    }
+
+    exception("varint is too long");
+    return 0;
+}
+
+double
+BinaryJsonParsingContext::
+readDouble()
+{
+    if (end - pos < 8)
+        exception("truncated double");
+
+    uint64_t bits = 0;
+    for (unsigned i = 0;  i < 8;  ++i)
+        bits |= uint64_t((unsigned char)pos[i]) << (i * 8);
+    pos += 8;
+
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+std::pair<const char *, size_t>
+BinaryJsonParsingContext::
+readString()
+{
+    expectTag(STRING_TAG, "string");
+    unsigned long long size = readVarint();
+    if (size > (unsigned long long)(end - pos))
+        exception("truncated string");
+
+    const char * data = pos;
+    pos += size;
+    return make_pair(data, size);
+}
+
+bool
+BinaryJsonParsingContext::
+matchInteger(long long & val)
+{
+    const char * old = pos;
+
+    switch (peek()) {
+    case INT_TAG: {
+        ++pos;
+        unsigned long long u = readVarint();
+        val = (long long)(u >> 1) ^ -(long long)(u & 1);
+        return true;
+    }
+    case UINT_TAG: {
+        ++pos;
+        unsigned long long u = readVarint();
+        if (u <= (unsigned long long)numeric_limits<long long>::max()) {
+            val = u;
+            return true;
+        }
+        break;
+    }
+    case DOUBLE_TAG: {
+        ++pos;
+        double d = readDouble();
+        long long v = d;
+        if (v == d) {
+            val = v;
+            return true;
+        }
+        break;
+    }
+    }
+
+    pos = old;
+    return false;
+}
+
+bool
+BinaryJsonParsingContext::
+matchUnsigned(unsigned long long & val)
+{
+    const char * old = pos;
+
+    switch (peek()) {
+    case UINT_TAG:
+        ++pos;
+        val = readVarint();
+        return true;
+
+    case INT_TAG: {
+        long long v;
+        if (matchInteger(v) && v >= 0) {
+            val = v;
+            return true;
+        }
+        break;
+    }
+    case DOUBLE_TAG: {
+        ++pos;
+        double d = readDouble();
+        unsigned long long v = d;
+        if (d >= 0 && v == d) {
+            val = v;
+            return true;
+        }
+        break;
+    }
+    }
+
+    pos = old;
+    return false;
+}
+
+int
+BinaryJsonParsingContext::
+expectInt()
+{
+    return expectLongLong();
+}
+
+unsigned int
+BinaryJsonParsingContext::
+expectUnsignedInt()
+{
+    return expectUnsignedLongLong();
+}
+
+long
+BinaryJsonParsingContext::
+expectLong()
+{
+    return expectLongLong();
+}
+
+unsigned long
+BinaryJsonParsingContext::
+expectUnsignedLong()
+{
+    return expectUnsignedLongLong();
+}
+
+long long
+BinaryJsonParsingContext::
+expectLongLong()
+{
+    long long val;
+    if (!matchInteger(val))
+        exception("expected integer");
+    return val;
+}
+
+unsigned long long
+BinaryJsonParsingContext::
+expectUnsignedLongLong()
+{
+    unsigned long long val;
+    if (!matchUnsigned(val))
+        exception("expected unsigned integer");
+    return val;
+}
+
+float
+BinaryJsonParsingContext::
+expectFloat()
+{
+    return expectDouble();
+}
+
+double
+BinaryJsonParsingContext::
+expectDouble()
+{
+    double val;
+    if (!matchDouble(val))
+        exception("expected number");
+    return val;
+}
+
+bool
+BinaryJsonParsingContext::
+expectBool()
+{
+    unsigned char tag = peek();
+    if (tag != TRUE_TAG && tag != FALSE_TAG)
+        exception("expected boolean");
+    ++pos;
+    return tag == TRUE_TAG;
+}
+
+bool
+BinaryJsonParsingContext::
+matchUnsignedLongLong(unsigned long long & val)
+{
+    return matchUnsigned(val);
+}
+
+bool
+BinaryJsonParsingContext::
+matchLongLong(long long & val)
+{
+    return matchInteger(val);
+}
+
+bool
+BinaryJsonParsingContext::
+matchDouble(double & val)
+{
+    switch (peek()) {
+    case DOUBLE_TAG:
+        ++pos;
+        val = readDouble();
+        return true;
+
+    case INT_TAG: {
+        long long v;
+        matchInteger(v);
+        val = v;
+        return true;
+    }
+    case UINT_TAG:
+        ++pos;
+        val = readVarint();
+        return true;
+    }
+
+    return false;
+}
+
+std::string
+BinaryJsonParsingContext::
+expectStringAscii()
+{
+    auto str = readString();
+    return string(str.first, str.second);
+}
+
+ssize_t
+BinaryJsonParsingContext::
+expectStringAscii(char * value, size_t maxLen)
+{
+    const char * old = pos;
+
+    auto str = readString();
+    if (str.second >= maxLen) {
+        pos = old;
+        return -1;
+    }
+
+    memcpy(value, str.first, str.second);
+    value[str.second] = '\0';
+    return str.second;
+}
+
+Utf8String
+BinaryJsonParsingContext::
+expectStringUtf8()
+{
+    auto str = readString();
+    return Utf8String::fromBuffer(str.first, str.second);
+}
+
+Json::Value
+BinaryJsonParsingContext::
+expectJson()
+{
+    switch (peek()) {
+    case NULL_TAG:
+        ++pos;
+        return Json::Value();
+
+    case FALSE_TAG:
+    case TRUE_TAG:
+        return expectBool();
+
+    case INT_TAG:
+        return expectLongLong();
+
+    case UINT_TAG:
+        return expectUnsignedLongLong();
+
+    case DOUBLE_TAG:
+        return expectDouble();
+
+    case STRING_TAG: {
+        auto str = readString();
+        return Json::Value(str.first, str.first + str.second);
+    }
+
+    case ARRAY_TAG: {
+        Json::Value result(Json::arrayValue);
+        forEachElement([&] () { result.append(expectJson()); });
+        return result;
+    }
+
+    case OBJECT_TAG: {
+        Json::Value result(Json::objectValue);
+        forEachMember([&] () { result[fieldNamePtr()] = expectJson(); });
+        return result;
+    }
+    }
+
+    exception(ML::format("unknown binary json tag %d", (int)peek()));
+    return Json::Value();
+}
+
+void
+BinaryJsonParsingContext::
+expectNull()
+{
+    expectTag(NULL_TAG, "null");
+}
+
+bool
+BinaryJsonParsingContext::
+isObject() const
+{
+    return peek() == OBJECT_TAG;
+}
+
+bool
+BinaryJsonParsingContext::
+isString() const
+{
+    return peek() == STRING_TAG;
+}
+
+bool
+BinaryJsonParsingContext::
+isArray() const
+{
+    return peek() == ARRAY_TAG;
+}
+
+bool
+BinaryJsonParsingContext::
+isBool() const
+{
+    return peek() == TRUE_TAG || peek() == FALSE_TAG;
+}
+
+bool
+BinaryJsonParsingContext::
+isNumber() const
+{
+    unsigned char tag = peek();
+    return tag == INT_TAG || tag == UINT_TAG || tag == DOUBLE_TAG;
+}
+
+bool
+BinaryJsonParsingContext::
+isNull() const
+{
+    return peek() == NULL_TAG;
+}
+
+void
+BinaryJsonParsingContext::
+skip()
+{
+    switch (peek()) {
+    case NULL_TAG:
+    case FALSE_TAG:
+    case TRUE_TAG:
+        ++pos;
+        return;
+
+    case INT_TAG:
+    case UINT_TAG:
+        ++pos;
+        readVarint();
+        return;
+
+    case DOUBLE_TAG:
+        ++pos;
+        readDouble();
+        return;
+
+    case STRING_TAG:
+        readString();
+        return;
+
+    case ARRAY_TAG:
+    case OBJECT_TAG:
+        ++pos;
+        while (peek() != END_TAG) {
+            if (*pos == KEY_TAG) {
+                const char * key = pos + 1;
+                const char * nul = (const char *)memchr(key, 0, end - key);
+                if (!nul)
+                    exception("unterminated member name");
+                pos = nul + 1;
+            }
+            skip();
+        }
+        ++pos;
+        return;
+    }
+
+    exception(ML::format("unknown binary json tag %d", (int)peek()));
+}
+
+std::string
+BinaryJsonParsingContext::
+printCurrent()
+{
+    const char * old = pos;
+    try {
+        string result = expectJson().toStringNoNewLine();
+        pos = old;
+        return result;
+    } catch (const std::exception & exc) {
+        pos = old;
+        return ML::format("<unparseable binary json at offset %zd>",
+                          old - start);
+    }
+}
+
+void
+BinaryJsonParsingContext::
+forEachMember(const std::function<void ()> & fn)
+{
+    expectTag(OBJECT_TAG, "object");
+
+    int memberNum = 0;
+
+    while (peek() != END_TAG) {
+        expectTag(KEY_TAG, "member name");
+
+        const char * key = pos;
+        const char * nul = (const char *)memchr(key, 0, end - key);
+        if (!nul)
+            exception("unterminated member name");
+        pos = nul + 1;
+
+        // The key points straight into the buffer; no copy needed.
+        struct PathPusher {
+            PathPusher(const char * memberName,
+                       int memberNum,
+                       BinaryJsonParsingContext * context)
+                : context(context)
+            {
+                context->pushPath(memberName, memberNum);
+            }
+
+            ~PathPusher()
+            {
+                context->popPath();
+            }
+
+            BinaryJsonParsingContext * const context;
+        } pusher(key, memberNum++, this);
+
+        fn();
+    }
+
+    ++pos;
+}
+
+void
+BinaryJsonParsingContext::
+forEachElement(const std::function<void ()> & fn)
+{
+    expectTag(ARRAY_TAG, "array");
+
+    int index = 0;
+
+    while (peek() != END_TAG) {
+        if (index == 0)
+            pushPath(index);
+        else replacePath(index);
+
+        fn();
+        ++index;
+    }
+
+    if (index != 0)
+        popPath();
+
+    ++pos;
+}
+
+} // namespace Datacratic
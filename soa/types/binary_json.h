@@ -0,0 +1,179 @@
+/* binary_json.h                                                   -*- C++ -*-
+   FreeBSD-style copyright and disclaimer apply
+
+   Compact binary encoding of the JSON data model that plugs into the value
+   description machinery through the JSON printing and parsing contexts.
+
+   Anything that has a ValueDescription can be encoded and decoded without
+   going through the text format which avoids formatting and parsing numbers,
+   escaping strings and allocating object keys.
+
+   Encoding, where each value starts with a one byte tag:
+
+   - null, false, true: the tag alone.
+   - signed integers: zig-zag encoded varint.
+   - unsigned integers: varint.
+   - floating points: IEEE 754 double, 8 bytes little endian.
+   - strings: varint length followed by the raw bytes.
+   - arrays: the tag, the elements and an end tag.
+   - objects: the tag, a key tag followed by a NUL terminated key and the
+     value for every member and an end tag.
+*/
+
+#pragma once
+
+#include "soa/types/json_parsing.h"
+#include "soa/types/json_printing.h"
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* BINARY JSON                                                               */
+/*****************************************************************************/
+
+namespace BinaryJson {
+
+enum Tag {
+    NULL_TAG   = 0x00,
+    FALSE_TAG  = 0x01,
+    TRUE_TAG   = 0x02,
+    INT_TAG    = 0x03,
+    UINT_TAG   = 0x04,
+    DOUBLE_TAG = 0x05,
+    STRING_TAG = 0x06,
+    ARRAY_TAG  = 0x07,
+    OBJECT_TAG = 0x08,
+    KEY_TAG    = 0x09,
+    END_TAG    = 0x0A
+};
+
+} // namespace BinaryJson
+
+
+/*****************************************************************************/
+/* BINARY JSON PRINTING CONTEXT                                              */
+/*****************************************************************************/
+
+/** Printing context that appends the binary encoding of the values to the
+    output string.
+*/
+
+struct BinaryJsonPrintingContext
+    : public JsonPrintingContext {
+
+    std::string output;
+
+    virtual void startObject();
+    virtual void startMember(const std::string & memberName);
+    virtual void endObject();
+
+    virtual void startArray(int knownSize = -1);
+    virtual void newArrayElement();
+    virtual void endArray();
+
+    virtual void skip();
+
+    virtual void writeNull();
+    virtual void writeInt(int i);
+    virtual void writeUnsignedInt(unsigned int i);
+    virtual void writeLong(long int i);
+    virtual void writeUnsignedLong(unsigned long int i);
+    virtual void writeLongLong(long long int i);
+    virtual void writeUnsignedLongLong(unsigned long long int i);
+    virtual void writeFloat(float f);
+    virtual void writeDouble(double d);
+    virtual void writeString(const std::string & s);
+    virtual void writeStringUtf8(const Utf8String & s);
+    virtual void writeJson(const Json::Value & val);
+    virtual void writeBool(bool b);
+
+private:
+    void writeTag(BinaryJson::Tag tag)
+    {
+        output.push_back(tag);
+    }
+
+    void writeVarint(unsigned long long val);
+    void writeBytes(const char * data, size_t size);
+};
+
+
+/*****************************************************************************/
+/* BINARY JSON PARSING CONTEXT                                               */
+/*****************************************************************************/
+
+/** Parsing context that reads back the output of BinaryJsonPrintingContext.
+
+    The object keys are used in place so the buffer must outlive the parsing.
+*/
+
+struct BinaryJsonParsingContext
+    : public JsonParsingContext {
+
+    BinaryJsonParsingContext(const char * start, const char * end)
+        : start(start), pos(start), end(end)
+    {
+    }
+
+    BinaryJsonParsingContext(const std::string & buffer)
+        : start(buffer.data()), pos(start), end(start + buffer.size())
+    {
+    }
+
+    /** Returns true if the whole buffer was consumed. */
+    bool eof() const { return pos == end; }
+
+    virtual void exception(const std::string & message);
+
+    virtual std::string getContext() const;
+
+    virtual int expectInt();
+    virtual unsigned int expectUnsignedInt();
+    virtual long expectLong();
+    virtual unsigned long expectUnsignedLong();
+    virtual long long expectLongLong();
+    virtual unsigned long long expectUnsignedLongLong();
+
+    virtual float expectFloat();
+    virtual double expectDouble();
+    virtual bool expectBool();
+    virtual bool matchUnsignedLongLong(unsigned long long & val);
+    virtual bool matchLongLong(long long & val);
+    virtual bool matchDouble(double & val);
+    virtual std::string expectStringAscii();
+    virtual ssize_t expectStringAscii(char * value, size_t maxLen);
+    virtual Utf8String expectStringUtf8();
+    virtual Json::Value expectJson();
+    virtual void expectNull();
+    virtual bool isObject() const;
+    virtual bool isString() const;
+    virtual bool isArray() const;
+    virtual bool isBool() const;
+    virtual bool isNumber() const;
+    virtual bool isNull() const;
+
+    virtual void skip();
+
+    virtual std::string printCurrent();
+
+    virtual void forEachMember(const std::function<void ()> & fn);
+    virtual void forEachElement(const std::function<void ()> & fn);
+
+private:
+    const char * start;
+    const char * pos;
+    const char * end;
+
+    unsigned char peek() const;
+    void expectTag(BinaryJson::Tag tag, const char * what);
+    unsigned long long readVarint();
+    double readDouble();
+    std::pair<const char *, size_t> readString();
+
+    bool matchInteger(long long & val);
+    bool matchUnsigned(unsigned long long & val);
+};
+
+} // namespace Datacratic
@@ -83,8 +83,159 @@ expectFixedWidthInt(ML::Parse_Context & context,
     return result;
 }
 
+
+/*****************************************************************************/
+/* FAST PATHS                                                                */
+/*****************************************************************************/
+
+/* The timestamps of the logs, win notices and replayed events almost always
+   come in one fixed layout.  These functions recognize that layout without
+   going through a Parse_Context and return false for anything else, which
+   is then handed to the general parser, which also produces the error
+   messages.  They must give bit for bit the same results as the general
+   parsers for what they accept.
+*/
+
+/** Powers of ten that are exactly representable as doubles. */
+const double exactPowersOfTen[23] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool
+fixedDigits(const char * p, int n, int & value)
+{
+    int result = 0;
+    for (int i = 0;  i < n;  ++i) {
+        unsigned d = (unsigned char)p[i] - '0';
+        if (d > 9)
+            return false;
+        result = result * 10 + d;
+    }
+    value = result;
+    return true;
+}
+
+inline bool isLeapYear(int year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+/** Days between 1970-01-01 and the given date of the proleptic gregorian
+    calendar. */
+int64_t daysSinceEpoch(int year, unsigned month, unsigned day)
+{
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned yearOfEra = year - era * 400;
+    unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5
+                       + day - 1;
+    unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100
+                      + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
 }
 
+/** Matches exactly YYYY-MM-DDTHH:MM:SS, optionally followed by a fraction
+    of up to 9 digits and by a 'Z'.  The separator may also be a space.
+    fractionDigits is set to the number of digits of the fraction.
+*/
+bool
+matchFixedIso8601(const char * p, const char * e,
+                  double & result, int & fractionDigits)
+{
+    if (e - p < 19)
+        return false;
+    if (p[4] != '-' || p[7] != '-' || (p[10] != 'T' && p[10] != ' ')
+        || p[13] != ':' || p[16] != ':')
+        return false;
+
+    int year, month, day, hour, minute, second;
+    if (!fixedDigits(p, 4, year) || !fixedDigits(p + 5, 2, month)
+        || !fixedDigits(p + 8, 2, day) || !fixedDigits(p + 11, 2, hour)
+        || !fixedDigits(p + 14, 2, minute) || !fixedDigits(p + 17, 2, second))
+        return false;
+
+    static const int monthDays[13]
+        = { 0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    if (year < 1400 || month < 1 || month > 12 || day < 1
+        || hour > 23 || minute > 59 || second > 60)
+        return false;
+    if (day > monthDays[month] + (month == 2 && isLeapYear(year)))
+        return false;
+
+    p += 19;
+
+    int fraction = 0;
+    fractionDigits = 0;
+    if (p != e && *p == '.') {
+        ++p;
+        const char * start = p;
+        while (p != e && p - start < 10 && *p >= '0' && *p <= '9')
+            fraction = fraction * 10 + (*p++ - '0');
+        fractionDigits = p - start;
+        if (fractionDigits == 0 || fractionDigits > 9)
+            return false;
+    }
+
+    if (p != e && *p == 'Z')
+        ++p;
+    if (p != e)
+        return false;
+
+    // Same operations in the same order as Iso8601Parser, so that the
+    // rounding is the same.
+    double time = 3600 * hour + 60 * minute + second;
+    if (fractionDigits)
+        time += double(fraction) / exactPowersOfTen[fractionDigits];
+
+    result = daysSinceEpoch(year, month, day) * 86400.0 + time;
+    return true;
+}
+
+/** Matches a decimal number of seconds with no exponent whose digits,
+    taken as an integer, fit exactly in a double, as does its power of ten;
+    the single division then rounds the same way as strtod.
+*/
+bool
+matchFixedEpoch(const char * p, const char * e, double & result)
+{
+    bool negative = false;
+    if (p != e && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+
+    uint64_t mantissa = 0;
+    int digits = 0, fractionDigits = 0;
+    bool inFraction = false;
+
+    if (p == e)
+        return false;
+
+    for (;  p != e;  ++p) {
+        unsigned d = (unsigned char)*p - '0';
+        if (d <= 9) {
+            if (++digits > 19)
+                return false;
+            mantissa = mantissa * 10 + d;
+            fractionDigits += inFraction;
+        }
+        else if (*p == '.' && !inFraction)
+            inFraction = true;
+        else return false;
+    }
+
+    if (digits == 0 || mantissa > (1ULL << 53) || fractionDigits > 22)
+        return false;
+
+    double value = mantissa;
+    if (fractionDigits)
+        value /= exactPowersOfTen[fractionDigits];
+    result = negative ? -value : value;
+    return true;
+}
+
+} // file scope
+
 namespace Datacratic {
 
 
@@ -162,6 +313,10 @@ Date
 Date::
 parseSecondsSinceEpoch(const std::string & date)
 {
+    double fast;
+    if (matchFixedEpoch(date.c_str(), date.c_str() + date.length(), fast))
+        return fromSecondsSinceEpoch(fast);
+
     errno = 0;
     char * end = 0;
     double seconds = strtod(date.c_str(), &end);
@@ -197,6 +352,16 @@ parseIso8601(const std::string & date)
     else if (date == "-Inf")
         return negativeInfinity();
     else {
+        // The general parser reads the seconds with match_double, so only
+        // whole seconds are taken by the fast path.
+        double fast;
+        int fractionDigits;
+        if (date.length() == 20 && date[10] == 'T' && date[19] == 'Z'
+            && date[17] != '6'
+            && matchFixedIso8601(date.c_str(), date.c_str() + 20,
+                                 fast, fractionDigits))
+            return fromSecondsSinceEpoch(fast);
+
         return parse_date_time(date, "%y-%m-%d", "T%H:%M:%SZ");
     }
 }
@@ -211,8 +376,16 @@ parseIso8601DateTime(const std::string & dateTimeStr)
         return positiveInfinity();
     else if (dateTimeStr == "-Inf")
         return negativeInfinity();
-    else
+    else {
+        double fast;
+        int fractionDigits;
+        if (matchFixedIso8601(dateTimeStr.c_str(),
+                              dateTimeStr.c_str() + dateTimeStr.length(),
+                              fast, fractionDigits))
+            return fromSecondsSinceEpoch(fast);
+
         return Iso8601Parser::parseDateTimeString(dateTimeStr);
+    }
 }
 
 Date
@@ -253,6 +426,21 @@ now()
     return fromSecondsSinceEpoch(time.tv_sec + time.tv_nsec * 0.000000001);
 }
 
+Date
+Date::
+nowCoarse()
+{
+#ifdef CLOCK_REALTIME_COARSE
+    timespec time;
+    int res = clock_gettime(CLOCK_REALTIME_COARSE, &time);
+    if (res == -1)
+        throw ML::Exception(errno, "clock_gettime");
+    return fromSecondsSinceEpoch(time.tv_sec + time.tv_nsec * 0.000000001);
+#else
+    return now();
+#endif
+}
+
 Date
 Date::
 nowOld()
@@ -91,6 +91,13 @@ struct Date {
     static Date now();
     static Date nowOld();
 
+    /** Current time as seen by the coarse system clock, which only advances
+        once per kernel tick (every few milliseconds) but is several times
+        cheaper to read than now().  Meant for computing and checking
+        timeouts and expiries that don't need millisecond precision.
+    */
+    static Date nowCoarse();
+
     bool isADate() const;
 
     double secondsSinceEpoch() const
@@ -13,6 +13,10 @@
 #include "jml/utils/exc_assert.h"
 #include "soa/jsoncpp/value.h"
 
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
 using namespace ML;
 using namespace std;
 
@@ -95,6 +99,72 @@ inline int hexToDec2(int c)
     return v;
 }
 
+enum {
+    HEX_LOWER = 1,  ///< Contains a lower case hex digit
+    HEX_UPPER = 2   ///< Contains an upper case hex digit
+};
+
+/** Decode the 16 hex digits at p into a 64 bit value, the first digit being
+    the most significant one.  Returns false if any of the characters is not
+    a hex digit.  The cases of the letters seen are or-ed into cases.
+*/
+static bool decodeHex16(const char * p, uint64_t & result, int & cases)
+{
+#if defined(__SSE2__)
+    __m128i c = _mm_loadu_si128((const __m128i *)p);
+
+    // Bytes above 0x7f are negative so they fail both range checks
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+
+    if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xffff)
+        return false;
+
+    int alphaMask = _mm_movemask_epi8(alpha);
+    int upperMask = _mm_movemask_epi8(_mm_andnot_si128(_mm_cmpeq_epi8(c, lower),
+                                                       alpha));
+    if (alphaMask & ~upperMask)
+        cases |= HEX_LOWER;
+    if (upperMask)
+        cases |= HEX_UPPER;
+
+    // The low nibble is the value of a digit and the value minus 9 of a
+    // letter in both cases
+    __m128i nibbles = _mm_add_epi8(_mm_and_si128(c, _mm_set1_epi8(0x0f)),
+                                   _mm_and_si128(alpha, _mm_set1_epi8(9)));
+
+    // Merge each pair of nibbles into a byte, the first one being the high
+    // one, and pack the eight bytes together
+    __m128i bytes = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(nibbles, 4),
+                                               _mm_set1_epi16(0xf0)),
+                                 _mm_srli_epi16(nibbles, 8));
+    bytes = _mm_packus_epi16(bytes, bytes);
+
+    uint64_t val;
+    _mm_storel_epi64((__m128i *)&val, bytes);
+    result = __builtin_bswap64(val);
+    return true;
+#else
+    uint64_t val = 0;
+    for (unsigned i = 0;  i < 16;  ++i) {
+        int c = p[i];
+        int v = hexToDec(c);
+        if (v == -1)
+            return false;
+        if (c >= 'a')
+            cases |= HEX_LOWER;
+        else if (c >= 'A')
+            cases |= HEX_UPPER;
+        val = (val << 4) + v;
+    }
+    result = val;
+    return true;
+#endif
+}
+
 void
 Id::
 parse(const char * value, size_t len, Type type)
@@ -146,60 +216,24 @@ parse(const char * value, size_t len, Type type)
         if (value[18] != '-') break;
         if (value[23] != '-') break;
 
-        unsigned f1;
-        short f2, f3, f4;
-        unsigned long long f5;
-
-        const char * p = value;
-        bool failed = false;
-        int capsType = -1; // -1 = unknown, 0 = no, 1 = yes
+        // Gather the 32 digits together and decode them 16 at a time
+        char digits[32];
+        memcpy(digits, value, 8);
+        memcpy(digits + 8, value + 9, 4);
+        memcpy(digits + 12, value + 14, 4);
+        memcpy(digits + 16, value + 19, 4);
+        memcpy(digits + 20, value + 24, 12);
 
-        auto scanRange = [&] (int start, int len) -> unsigned long long
-            {
-                unsigned long long val = 0;
-                for (unsigned i = start;  i != start + len;  ++i) {
-                    int c = p[i];
-                    {
-                        // case handling
-                        if (c >= 'a' && c <= 'f') {
-                            if (capsType == -1) {
-                                capsType = 0;
-                            }
-                            else if (capsType != 0) {
-                                failed = true;
-                                return val;
-                            }
-                        }
-                        else if (c >= 'A' && c <= 'F') {
-                            if (capsType == -1) {
-                                capsType = 1;
-                            }
-                            else if (capsType != 1) {
-                                failed = true;
-                                return val;
-                            }
-                        }
-                    }
-                    int v = hexToDec(c);
-                    if (v == -1) {
-                        failed = true;
-                        return val;
-                    }
-                    val = (val << 4) + v;
-                }
-                return val;
-            };
-
-        f1 = scanRange(0, 8);
-        f2 = scanRange(9, 4);
-        f3 = scanRange(14, 4);
-        if (failed) break;
-        f4 = scanRange(19, 4);
-        f5 = scanRange(24, 12);
-        if (failed) break;
+        uint64_t high, low;
+        int cases = 0;
+        if (!decodeHex16(digits, high, cases)
+            || !decodeHex16(digits + 16, low, cases)
+            || cases == (HEX_LOWER | HEX_UPPER))
+            break;
 
-        r.type = capsType == 1 ? UUID_CAPS : UUID;
-        r.f1 = f1;  r.f2 = f2;  r.f3 = f3;  r.f4 = f4;  r.f5 = f5;
+        r.type = cases == HEX_UPPER ? UUID_CAPS : UUID;
+        r.f1 = high >> 32;  r.f2 = high >> 16;  r.f3 = high;
+        r.f4 = low >> 48;  r.f5 = low;
         finish();
         return;
     }
@@ -316,36 +350,10 @@ parse(const char * value, size_t len, Type type)
 
     while ((type == UNKNOWN || type == HEX128LC) && len == 32) {
         uint64_t high, low;
+        int cases = 0;
 
-        const char * p = value;
-        bool failed = false;
-
-        auto scanRange = [&] (int start, int len) -> unsigned long long
-            {
-                uint64_t val = 0;
-                for (unsigned i = start;  i != start + len;  ++i) {
-                    int c = p[i];
-                    int v = hexToDec(c);
-
-                    //cerr << "c = " << c << " " << p[i] << " v = " << v << endl;
-
-                    if (v == -1) {
-                        failed = true;
-                        return val;
-                    }
-                    val = (val << 4) + v;
-                }
-
-                //cerr << "val = " << val << " failed = " << failed << endl;
-
-                return val;
-            };
-
-        high = scanRange(0, 16);
-        if (failed)
-            break;
-        low = scanRange(16, 16);
-        if (failed)
+        if (!decodeHex16(value, high, cases)
+            || !decodeHex16(value + 16, low, cases))
             break;
 
         r.type = HEX128LC;
@@ -113,6 +113,7 @@ struct Id {
           val1(other.val1), val2(other.val2)
     {
         other.type = NONE;
+        other.val = 0;
     }
 
     Id(const Id & other)
@@ -131,6 +132,7 @@ struct Id {
         val1 = other.val1;
         val2 = other.val2;
         other.type = NONE;
+        other.val = 0;
         return *this;
     }
 
@@ -176,12 +178,14 @@ struct Id {
 
     JML_IMPLEMENT_OPERATOR_BOOL(notNull());
 
+    /* NONE and NULLID Ids always have a zero value, so every type below STR
+       compares equal exactly when its 128 bits do.
+    */
     bool operator == (const Id & other) const
     {
         if (type != other.type) return false;
-        if (type == NONE || type == NULLID) return true;
-        if (JML_UNLIKELY(type >= STR)) return complexEqual(other);
-        return val == other.val;
+        if (JML_LIKELY(type < STR)) return val == other.val;
+        return complexEqual(other);
     }
 
     bool operator != (const Id & other) const
@@ -51,6 +51,14 @@ expectStringUtf8()
             bufferSize = newBufferSize;
         }
 
+        // Plain characters are copied in bulk
+        size_t run = context->match_string_run(buffer + pos,
+                                               bufferSize - 4 - pos);
+        if (run) {
+            pos += run;
+            continue;
+        }
+
         int c = *(*context);
         
         //cerr << "c = " << c << " " << (char)c << endl;
@@ -97,7 +105,7 @@ expectStringUtf8()
         else buffer[pos++] = c;
     }
 
-    Utf8String result(string(buffer, buffer + pos));
+    Utf8String result = Utf8String::fromBuffer(buffer, pos);
     if (buffer != internalBuffer)
         delete[] buffer;
     
@@ -5,6 +5,8 @@
    Functionality to print JSON values.
 */
 
+#include <boost/thread/tss.hpp>
+
 #include "jml/utils/exc_assert.h"
 
 #include "json_printing.h"
@@ -224,6 +226,276 @@ writeBool(bool b)
 }
 
 
+/*****************************************************************************/
+/* STRING JSON PRINTING CONTEXT                                              */
+/*****************************************************************************/
+
+StringJsonPrintingContext::
+StringJsonPrintingContext(std::string & output)
+    : output(output), writeUtf8(true)
+{
+}
+
+std::string &
+StringJsonPrintingContext::
+threadBuffer()
+{
+    static boost::thread_specific_ptr<std::string> buffers;
+
+    std::string * buffer = buffers.get();
+    if (!buffer) {
+        buffer = new std::string();
+        buffers.reset(buffer);
+    }
+    buffer->clear();
+    return *buffer;
+}
+
+void
+StringJsonPrintingContext::
+startObject()
+{
+    path.push_back(true /* isObject */);
+    output += '{';
+}
+
+void
+StringJsonPrintingContext::
+startMember(const std::string & memberName)
+{
+    ExcAssert(path.back().isObject);
+    ++path.back().memberNum;
+    if (path.back().memberNum != 0)
+        output += ',';
+    output += '\"';
+    writeEscaped(memberName.c_str(), memberName.size());
+    output += "\":";
+}
+
+void
+StringJsonPrintingContext::
+endObject()
+{
+    ExcAssert(path.back().isObject);
+    path.pop_back();
+    output += '}';
+}
+
+void
+StringJsonPrintingContext::
+startArray(int knownSize)
+{
+    path.push_back(false /* isObject */);
+    output += '[';
+}
+
+void
+StringJsonPrintingContext::
+newArrayElement()
+{
+    ExcAssert(!path.back().isObject);
+    ++path.back().memberNum;
+    if (path.back().memberNum != 0)
+        output += ',';
+}
+
+void
+StringJsonPrintingContext::
+endArray()
+{
+    ExcAssert(!path.back().isObject);
+    path.pop_back();
+    output += ']';
+}
+
+void
+StringJsonPrintingContext::
+skip()
+{
+    output += "null";
+}
+
+void
+StringJsonPrintingContext::
+writeNull()
+{
+    output += "null";
+}
+
+void
+StringJsonPrintingContext::
+writeUnsigned(unsigned long long i, bool negative)
+{
+    // Digits are generated from the end of the buffer backwards
+    char buf[24];
+    char * end = buf + sizeof(buf);
+    char * p = end;
+
+    do {
+        *--p = '0' + i % 10;
+        i /= 10;
+    } while (i);
+
+    if (negative)
+        *--p = '-';
+
+    output.append(p, end);
+}
+
+void
+StringJsonPrintingContext::
+writeInt(int i)
+{
+    writeLongLong(i);
+}
+
+void
+StringJsonPrintingContext::
+writeUnsignedInt(unsigned int i)
+{
+    writeUnsigned(i, false);
+}
+
+void
+StringJsonPrintingContext::
+writeLong(long int i)
+{
+    writeLongLong(i);
+}
+
+void
+StringJsonPrintingContext::
+writeUnsignedLong(unsigned long int i)
+{
+    writeUnsigned(i, false);
+}
+
+void
+StringJsonPrintingContext::
+writeLongLong(long long int i)
+{
+    // Negate as unsigned so that the minimum value doesn't overflow
+    if (i < 0)
+        writeUnsigned(-(unsigned long long)i, true);
+    else writeUnsigned(i, false);
+}
+
+void
+StringJsonPrintingContext::
+writeUnsignedLongLong(unsigned long long int i)
+{
+    writeUnsigned(i, false);
+}
+
+void
+StringJsonPrintingContext::
+writeFloat(float f)
+{
+    writeDouble(f);
+}
+
+void
+StringJsonPrintingContext::
+writeDouble(double d)
+{
+    if (std::isfinite(d))
+        output += Datacratic::dtoa(d);
+    else output += ML::format("\"%g\"", d);
+}
+
+void
+StringJsonPrintingContext::
+writeEscaped(const char * s, size_t size)
+{
+    const char * begin = s, * end = s + size;
+
+    while (s != end) {
+        // Copy the run of characters that need no escaping in one go
+        const char * start = s;
+        while (s != end && *s >= ' ' && *s < 127 && *s != '\"' && *s != '\\')
+            ++s;
+        output.append(start, s);
+
+        if (s == end)
+            break;
+
+        char c = *s++;
+        switch (c) {
+        case '\t': output += "\\t";  break;
+        case '\n': output += "\\n";  break;
+        case '\r': output += "\\r";  break;
+        case '\f': output += "\\f";  break;
+        case '\b': output += "\\b";  break;
+        case '\\':
+        case '\"': output += '\\';  output += c;  break;
+        default:
+            throw ML::Exception("Invalid character in JSON string: "
+                                + std::string(begin, end));
+        }
+    }
+}
+
+void
+StringJsonPrintingContext::
+writeString(const std::string & s)
+{
+    output += '\"';
+    writeEscaped(s.c_str(), s.size());
+    output += '\"';
+}
+
+void
+StringJsonPrintingContext::
+writeStringUtf8(const Utf8String & s)
+{
+    output += '\"';
+
+    for (auto it = s.begin(), end = s.end();  it != end;  ++it) {
+        int c = *it;
+        if (c >= ' ' && c < 127 && c != '\"' && c != '\\')
+            output += (char)c;
+        else {
+            switch (c) {
+            case '\t': output += "\\t";  break;
+            case '\n': output += "\\n";  break;
+            case '\r': output += "\\r";  break;
+            case '\b': output += "\\b";  break;
+            case '\f': output += "\\f";  break;
+            case '/':
+            case '\\':
+            case '\"': output += '\\';  output += (char)c;  break;
+            default:
+                if (writeUtf8) {
+                    char buf[4];
+                    char * p = utf8::unchecked::append(c, buf);
+                    output.append(buf, p);
+                }
+                else {
+                    ExcAssert(c >= 0 && c < 65536);
+                    output += ML::format("\\u%04x", (unsigned)c);
+                }
+            }
+        }
+    }
+
+    output += '\"';
+}
+
+void
+StringJsonPrintingContext::
+writeJson(const Json::Value & val)
+{
+    output += val.toStringNoNewLine();
+}
+
+void
+StringJsonPrintingContext::
+writeBool(bool b)
+{
+    output += (b ? "true": "false");
+}
+
+
 /*****************************************************************************/
 /* STRUCTURED JSON PRINTING CONTEXT                                          */
 /*****************************************************************************/
@@ -12,6 +12,7 @@
 
 #include "jml/utils/exc_assert.h"
 #include "jml/utils/json_parsing.h"
+#include "jml/utils/compact_vector.h"
 
 #include "soa/jsoncpp/value.h"
 #include "soa/types/string.h"
@@ -19,6 +20,8 @@
 
 namespace Datacratic {
 
+struct StringJsonPrintingContext;
+
 
 /*****************************************************************************/
 /* JSON PRINTING CONTEXT                                                     */
@@ -53,6 +56,15 @@ struct JsonPrintingContext {
 
     virtual void writeJson(const Json::Value & val) = 0;
     virtual void skip() = 0;
+
+    /** Returns this context if it's a StringJsonPrintingContext, which the
+        structure descriptions can write their basic fields to directly, or
+        null otherwise.
+    */
+    virtual StringJsonPrintingContext * stringContext()
+    {
+        return nullptr;
+    }
 };
 
 
@@ -123,6 +135,96 @@ struct StreamJsonPrintingContext
 };
 
 
+/*****************************************************************************/
+/* STRING JSON PRINTING CONTEXT                                              */
+/*****************************************************************************/
+
+/** JSON printing context that appends directly to a string instead of going
+    through an ostream.
+
+    The output string is never cleared, so a buffer that the caller clears
+    and reuses between messages keeps its capacity and printing does not
+    allocate once it has grown to the size of the largest message.
+*/
+
+struct StringJsonPrintingContext
+    : public JsonPrintingContext {
+
+    StringJsonPrintingContext(std::string & output);
+
+    std::string & output;
+    bool writeUtf8;          ///< If true, utf8 chars in binary.  False: escaped ASCII
+
+    /** Returns an empty buffer owned by the calling thread to be used as the
+        output of a StringJsonPrintingContext.  It is the same buffer on
+        every call from a given thread so its contents must be consumed
+        before the next call.
+    */
+    static std::string & threadBuffer();
+
+    virtual void startObject();
+
+    virtual void startMember(const std::string & memberName);
+
+    virtual void endObject();
+
+    virtual void startArray(int knownSize = -1);
+
+    virtual void newArrayElement();
+
+    virtual void endArray();
+
+    virtual void skip();
+
+    virtual void writeNull();
+
+    virtual void writeInt(int i);
+
+    virtual void writeUnsignedInt(unsigned int i);
+
+    virtual void writeLong(long int i);
+
+    virtual void writeUnsignedLong(unsigned long int i);
+
+    virtual void writeLongLong(long long int i);
+
+    virtual void writeUnsignedLongLong(unsigned long long int i);
+
+    virtual void writeFloat(float f);
+
+    virtual void writeDouble(double d);
+
+    virtual void writeString(const std::string & s);
+
+    virtual void writeStringUtf8(const Utf8String & s);
+
+    virtual void writeJson(const Json::Value & val);
+
+    virtual void writeBool(bool b);
+
+    virtual StringJsonPrintingContext * stringContext()
+    {
+        return this;
+    }
+
+private:
+    struct PathEntry {
+        PathEntry(bool isObject)
+            : isObject(isObject), memberNum(-1)
+        {
+        }
+
+        bool isObject;
+        int memberNum;
+    };
+
+    ML::compact_vector<PathEntry, 8> path;
+
+    void writeUnsigned(unsigned long long i, bool negative);
+    void writeEscaped(const char * s, size_t size);
+};
+
+
 /*****************************************************************************/
 /* STRUCTURED JSON PRINTING CONTEXT                                          */
 /*****************************************************************************/
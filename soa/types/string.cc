@@ -9,6 +9,10 @@
 #include <iostream>
 #include "jml/arch/exception.h"
 #include "jml/db/persistent.h"
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
@@ -38,10 +42,39 @@ Utf8String::fromLatin1(const std::string & lat1Str)
     return Utf8String(utf8Str);
 }
 
+bool
+Utf8String::isAscii(const char * data, size_t length)
+{
+    const char * end = data + length;
+
+#if defined(__SSE2__)
+    // 16 characters at a time; the mask has the high bits of each of them
+    for (;  data + 16 <= end;  data += 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i *)data);
+        if (_mm_movemask_epi8(chars))
+            return false;
+    }
+#else
+    for (;  data + 8 <= end;  data += 8) {
+        uint64_t chars;
+        memcpy(&chars, data, 8);
+        if (chars & 0x8080808080808080ULL)
+            return false;
+    }
+#endif
+
+    for (;  data < end;  ++data)
+        if (*data & 0x80)
+            return false;
+
+    return true;
+}
+
 Utf8String::Utf8String(const string & in, bool check)
-    : data_(in)
+    : data_(in), ascii_(isAscii(in.data(), in.length()))
 {
-    if (check)
+    // ASCII is always valid utf-8
+    if (check && !ascii_)
     {
         // Check if we find an invalid encoding
         string::const_iterator end_it = utf8::find_invalid(in.begin(), in.end());
@@ -53,9 +86,9 @@ Utf8String::Utf8String(const string & in, bool check)
 }
 
 Utf8String::Utf8String(string && in, bool check)
-    : data_(std::move(in))
+    : data_(std::move(in)), ascii_(isAscii(data_.data(), data_.length()))
 {
-    if (check)
+    if (check && !ascii_)
     {
         // Check if we find an invalid encoding
         string::const_iterator end_it = utf8::find_invalid(data_.begin(), data_.end());
@@ -66,6 +99,25 @@ Utf8String::Utf8String(string && in, bool check)
     }
 }
 
+Utf8String
+Utf8String::fromBuffer(const char * start, size_t length, bool check)
+{
+    Utf8String result;
+    result.data_.assign(start, length);
+    result.ascii_ = isAscii(start, length);
+
+    if (check && !result.ascii_)
+    {
+        // Check if we find an invalid encoding
+        const char * end = start + length;
+        if (utf8::find_invalid(start, end) != end)
+        {
+            throw ML::Exception("Invalid sequence within utf-8 string");
+        }
+    }
+    return result;
+}
+
 Utf8String::const_iterator
 Utf8String::begin() const
 {
@@ -81,6 +133,7 @@ Utf8String::end() const
 Utf8String &Utf8String::operator+=(const Utf8String &utf8str)
 {
     data_ += utf8str.data_;
+    ascii_ = ascii_ && utf8str.ascii_;
     return *this;
 }
 
@@ -102,10 +155,20 @@ Utf8String::
 reconstitute(ML::DB::Store_Reader & store)
 {
     store >> data_;
+    ascii_ = isAscii(data_.data(), data_.length());
 }
     
 string Utf8String::extractAscii() const
 {
+    if (ascii_) {
+        string s(data_);
+        for (char & c: s) {
+            if (c < ' ' || c == 127)
+                c = '?';
+        }
+        return s;
+    }
+
     string s;
     for(auto it = begin(); it != end(); it++) {
         char c = *it;
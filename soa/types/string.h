@@ -19,25 +19,43 @@ namespace Datacratic {
 /* Utf8String                                                               */
 /*****************************************************************************/
 
+/** A string of utf-8 encoded characters.
+
+    Most of the strings that go through here are plain ASCII, so that is
+    detected once, when the contents are set: validating an ASCII string
+    is then that scan only, and length(), operator [] and extractAscii()
+    don't need to decode anything.
+*/
+
 class Utf8String
 {
 public:
     static Utf8String fromLatin1(const std::string & lat1Str);
 
+    /** Copy the utf8-encoded characters of a buffer, such as the one of a
+        parser, without going through a temporary string. */
+    static Utf8String fromBuffer(const char * start, size_t length,
+                                 bool check = true);
+
+    /** Tell if the characters are all ASCII, ie have their high bit clear. */
+    static bool isAscii(const char * data, size_t length);
+
     /** Allow default construction of an empty string. */
     Utf8String()
+        : ascii_(true)
     {
     }
 
     /** Move constructor. */
     Utf8String(Utf8String && str) noexcept
-        : data_(std::move(str.data_))
+        : data_(std::move(str.data_)), ascii_(str.ascii_)
     {
+        str.ascii_ = true;
     }
 
     /** Copy constructor. */
     Utf8String(const Utf8String & str)
-        : data_(str.data_)
+        : data_(str.data_), ascii_(str.ascii_)
     {
     }
 
@@ -68,18 +86,21 @@ public:
     Utf8String & operator=(const std::string &str)
     {
     	data_ = str;
+        ascii_ = isAscii(data_.data(), data_.length());
     	return *this;
     }
 
     Utf8String & operator=(std::string &&str)
     {
     	data_ = std::move(str);
+        ascii_ = isAscii(data_.data(), data_.length());
     	return *this;
     }
 
     void swap(Utf8String & other)
     {
         data_.swap(other.data_);
+        std::swap(ascii_, other.ascii_);
     }
 
     bool empty() const
@@ -96,6 +117,7 @@ public:
     Utf8String&  operator+=(const std::string& str)
     {
     	data_+=str;
+        ascii_ = ascii_ && isAscii(str.data(), str.length());
     	return *this;
     }
     Utf8String &operator+=(const Utf8String &utf8str);
@@ -107,6 +129,27 @@ public:
     const char * rawData() const { return data_.c_str(); }
     size_t rawLength() const { return data_.length() ; }
 
+    /** Tell if all of the characters are ASCII. */
+    bool isAscii() const { return ascii_; }
+
+    /** Number of code points. */
+    size_t length() const
+    {
+        if (ascii_) return data_.length();
+        const char * start = data_.data();
+        return utf8::unchecked::distance(start, start + data_.length());
+    }
+
+    /** Code point at the given index, which must be less than length().
+        Constant time for an ASCII string, linear otherwise. */
+    char32_t operator [] (size_t index) const
+    {
+        if (ascii_) return (unsigned char)data_[index];
+        const char * it = data_.data();
+        utf8::unchecked::advance(it, index);
+        return utf8::unchecked::peek_next(it);
+    }
+
     void serialize(ML::DB::Store_Writer & store) const;
     void reconstitute(ML::DB::Store_Reader & store);
 
@@ -129,6 +172,7 @@ public:
 
 private:
     std::string data_; // original utf8-encoded string
+    bool ascii_;       // data_ has only ASCII characters
 };
 
 inline void swap(Utf8String & s1, Utf8String & s2)
@@ -0,0 +1,127 @@
+/* binary_json_test.cc
+   FreeBSD-style copyright and disclaimer apply
+
+   Test the binary json printing and parsing contexts.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+
+#include "soa/types/binary_json.h"
+#include "soa/types/basic_value_descriptions.h"
+#include "soa/types/value_description.h"
+
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+struct BinaryTestStructure {
+    BinaryTestStructure()
+        : count(0), delta(0), ratio(0), flag(false)
+    {
+    }
+
+    string name;
+    unsigned count;
+    int delta;
+    double ratio;
+    bool flag;
+    vector<string> tags;
+    Json::Value ext;
+};
+
+CREATE_STRUCTURE_DESCRIPTION(BinaryTestStructure)
+
+BinaryTestStructureDescription::
+BinaryTestStructureDescription()
+{
+    addField("name", &BinaryTestStructure::name, "");
+    addField("count", &BinaryTestStructure::count, "");
+    addField("delta", &BinaryTestStructure::delta, "");
+    addField("ratio", &BinaryTestStructure::ratio, "");
+    addField("flag", &BinaryTestStructure::flag, "");
+    addField("tags", &BinaryTestStructure::tags, "");
+    addField("ext", &BinaryTestStructure::ext, "");
+}
+
+BOOST_AUTO_TEST_CASE( test_binary_json_structure_round_trip )
+{
+    BinaryTestStructure data;
+    data.name = "hello \"world\"";
+    data.count = 300;
+    data.delta = -12345;
+    data.ratio = 0.1;
+    data.flag = true;
+    data.tags = { "a", "", "c" };
+    data.ext = Json::parse("{\"a\":[1,-2,3.5,null,true],\"b\":{\"c\":\"d\"}}");
+
+    BinaryTestStructureDescription desc;
+
+    BinaryJsonPrintingContext printer;
+    desc.printJsonTyped(&data, printer);
+
+    std::ostringstream stream;
+    StreamJsonPrintingContext textPrinter(stream);
+    desc.printJsonTyped(&data, textPrinter);
+    BOOST_CHECK_LT(printer.output.size(), stream.str().size());
+
+    BinaryTestStructure result;
+    BinaryJsonParsingContext parser(printer.output);
+    desc.parseJsonTyped(&result, parser);
+    BOOST_CHECK(parser.eof());
+
+    BOOST_CHECK_EQUAL(result.name, data.name);
+    BOOST_CHECK_EQUAL(result.count, data.count);
+    BOOST_CHECK_EQUAL(result.delta, data.delta);
+    BOOST_CHECK_EQUAL(result.ratio, data.ratio);
+    BOOST_CHECK_EQUAL(result.flag, data.flag);
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.tags.begin(), result.tags.end(),
+                                  data.tags.begin(), data.tags.end());
+    BOOST_CHECK_EQUAL(result.ext, data.ext);
+}
+
+BOOST_AUTO_TEST_CASE( test_binary_json_skip_unknown )
+{
+    Json::Value val = Json::parse(
+            "{\"unknown\":{\"x\":[1,{\"y\":2}],\"z\":\"w\"},\"count\":7}");
+
+    BinaryJsonPrintingContext printer;
+    printer.writeJson(val);
+
+    BinaryTestStructure result;
+    BinaryTestStructureDescription desc;
+    desc.onUnknownField = [] (BinaryTestStructure *, JsonParsingContext & context)
+        {
+            context.skip();
+        };
+
+    BinaryJsonParsingContext parser(printer.output);
+    desc.parseJsonTyped(&result, parser);
+    BOOST_CHECK(parser.eof());
+    BOOST_CHECK_EQUAL(result.count, 7);
+
+    BinaryJsonParsingContext jsonParser(printer.output);
+    BOOST_CHECK_EQUAL(jsonParser.expectJson(), val);
+}
+
+BOOST_AUTO_TEST_CASE( test_binary_json_truncated )
+{
+    BinaryTestStructure data;
+    data.name = "truncated";
+
+    BinaryTestStructureDescription desc;
+    BinaryJsonPrintingContext printer;
+    desc.printJsonTyped(&data, printer);
+
+    for (size_t i = 0;  i < printer.output.size();  ++i) {
+        BinaryTestStructure result;
+        BinaryJsonParsingContext parser(printer.output.data(),
+                                        printer.output.data() + i);
+        BOOST_CHECK_THROW(desc.parseJsonTyped(&result, parser),
+                          ML::Exception);
+    }
+}
@@ -0,0 +1,91 @@
+/* date_parse_profile.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Profile of the parsing of the usual timestamps by the fast paths of Date
+   and by the general parsers.
+*/
+
+#include <iostream>
+#include <stdlib.h>
+#include "soa/types/date.h"
+#include "jml/arch/format.h"
+
+using namespace ML;
+using namespace std;
+using namespace Datacratic;
+
+template<typename Fn>
+void profile(const std::string & what, int n, Fn fn)
+{
+    Date before = Date::now();
+
+    for (unsigned i = 0;  i < n;  ++i)
+        fn(i);
+
+    Date after = Date::now();
+    double elapsed = after.secondsSince(before);
+
+    cerr << what << ": processed " << n << " in " << elapsed << "s ("
+         << 1.0 * n / elapsed << " per second)" << endl;
+}
+
+int main(int argc, char ** argv)
+{
+    int n = 1000000;
+
+    enum { N = 64 };
+    string isoDates[N], isoFracDates[N], isoZDates[N];
+    string intEpochs[N], floatEpochs[N];
+
+    Date start(2014, 4, 2, 9, 8, 7);
+    for (unsigned i = 0;  i < N;  ++i) {
+        Date date = start.plusSeconds(i * 86399.123);
+        isoDates[i] = date.printIso8601(0);
+        isoFracDates[i] = date.printIso8601(3);
+        isoZDates[i] = isoDates[i];
+        if (isoZDates[i].back() != 'Z')
+            isoZDates[i] += 'Z';
+        intEpochs[i] = to_string((long long)date.secondsSinceEpoch());
+        floatEpochs[i] = ML::format("%.6f", date.secondsSinceEpoch());
+    }
+
+    double total = 0;
+
+    profile("iso8601 fast", n, [&] (int i) {
+            total += Date::parseIso8601DateTime(isoDates[i % N])
+                .secondsSinceEpoch();
+        });
+    profile("iso8601 general", n, [&] (int i) {
+            total += Iso8601Parser::parseDateTimeString(isoDates[i % N])
+                .secondsSinceEpoch();
+        });
+    profile("iso8601 fraction fast", n, [&] (int i) {
+            total += Date::parseIso8601DateTime(isoFracDates[i % N])
+                .secondsSinceEpoch();
+        });
+    profile("iso8601 fraction general", n, [&] (int i) {
+            total += Iso8601Parser::parseDateTimeString(isoFracDates[i % N])
+                .secondsSinceEpoch();
+        });
+    profile("deprecated iso8601 fast", n, [&] (int i) {
+            total += Date::parseIso8601(isoZDates[i % N]).secondsSinceEpoch();
+        });
+    profile("deprecated iso8601 general", n, [&] (int i) {
+            total += Date::parse_date_time(isoZDates[i % N],
+                                           "%y-%m-%d", "T%H:%M:%SZ")
+                .secondsSinceEpoch();
+        });
+    profile("integer epoch fast", n, [&] (int i) {
+            total += Date::parseSecondsSinceEpoch(intEpochs[i % N])
+                .secondsSinceEpoch();
+        });
+    profile("float epoch fast", n, [&] (int i) {
+            total += Date::parseSecondsSinceEpoch(floatEpochs[i % N])
+                .secondsSinceEpoch();
+        });
+    profile("float epoch strtod", n, [&] (int i) {
+            total += strtod(floatEpochs[i % N].c_str(), 0);
+        });
+
+    cerr << "(checksum " << total << ")" << endl;
+}
@@ -589,3 +589,83 @@ BOOST_AUTO_TEST_CASE( test_second )
     }
 
 }
+
+BOOST_AUTO_TEST_CASE( test_now_coarse )
+{
+    // The coarse clock lags the precise one by at most a few ticks
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        Date before = Date::now();
+        Date coarse = Date::nowCoarse();
+        Date after = Date::now();
+
+        BOOST_CHECK_LE(before.secondsSince(coarse), 0.1);
+        BOOST_CHECK_LE(coarse.secondsSince(after), 0.0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_fast_parse_same_as_general )
+{
+    vector<string> dateTimes = {
+        "2013-04-01T09:08:07",
+        "2013-04-01T09:08:07Z",
+        "2013-04-01 09:08:07",
+        "2012-12-20T14:57:57.187Z",
+        "2012-12-20T14:57:57.1",
+        "2012-12-20T14:57:57.123456789Z",
+        "1969-12-31T23:59:58.984375",
+        "1400-01-01T00:00:00Z",
+        "1900-03-01T00:00:00Z",
+        "2000-02-29T23:59:59.999Z",
+        "2016-12-31T23:59:60Z",
+        "9999-12-31T23:59:59Z"
+    };
+
+    for (auto & str: dateTimes) {
+        BOOST_TEST_CHECKPOINT(str);
+        BOOST_CHECK_EQUAL(Date::parseIso8601DateTime(str).secondsSinceEpoch(),
+                          Iso8601Parser::parseDateTimeString(str)
+                          .secondsSinceEpoch());
+    }
+
+    for (auto & str: { "2013-04-01T09:08:07Z", "1969-12-31T23:59:59Z",
+                       "2000-02-29T00:00:00Z" }) {
+        BOOST_TEST_CHECKPOINT(str);
+        BOOST_CHECK_EQUAL(Date::parseIso8601(str).secondsSinceEpoch(),
+                          Date::parse_date_time(str, "%y-%m-%d", "T%H:%M:%SZ")
+                          .secondsSinceEpoch());
+    }
+
+    // Not in the fixed layout; these go through the general parser.
+    BOOST_CHECK_EQUAL(Date::parseIso8601DateTime("2013-04-01T09:08:07-04:00")
+                      .print(), "2013-Apr-01 05:08:07");
+    BOOST_CHECK_EQUAL(Date::parseIso8601DateTime("2013-02-28T00:00:00.1234567891")
+                      .print(3), "2013-Feb-28 00:00:00.123");
+
+    {
+        JML_TRACE_EXCEPTIONS(false);
+        BOOST_CHECK_THROW(Date::parseIso8601DateTime("2013-02-29T00:00:00Z"),
+                          std::exception);
+        BOOST_CHECK_THROW(Date::parseIso8601DateTime("2013-04-01T24:00:00Z"),
+                          ML::Exception);
+    }
+
+    vector<string> epochs = {
+        "0", "1", "-1", "+1", "1396432087", "1396432087.5",
+        "1396432087.123456", "0.1", ".5", "5.", "-0.000001",
+        "999999999999999", "1396432087.123456", "9007199254740993", "0.30000000000000004", "1e9", " 1", "12345678901234567"
+    };
+
+    for (auto & str: epochs) {
+        BOOST_TEST_CHECKPOINT(str);
+        char * end = 0;
+        double expected = strtod(str.c_str(), &end);
+        if (end == str.c_str() + str.length()) {
+            BOOST_CHECK_EQUAL(Date::parseSecondsSinceEpoch(str)
+                              .secondsSinceEpoch(), expected);
+        }
+        else {
+            JML_TRACE_EXCEPTIONS(false);
+            BOOST_CHECK_THROW(Date::parseSecondsSinceEpoch(str), ML::Exception);
+        }
+    }
+}
@@ -5,6 +5,7 @@
 */
 
 #include <iostream>
+#include <algorithm>
 #include "soa/types/id.h"
 #include "soa/types/date.h"
 
@@ -105,12 +106,29 @@ void profile3()
          << 1.0 * n / elapsed << " per second)" << endl;
 }
 
+template<typename Fn>
+void profile(const std::string & what, int n, Fn fn)
+{
+    Date before = Date::now();
+
+    for (unsigned i = 0;  i < n;  ++i)
+        fn(i);
+
+    Date after = Date::now();
+    double elapsed = after.secondsSince(before);
+
+    cerr << what << ": processed " << n << " in " << elapsed << "s ("
+         << 1.0 * n / elapsed << " per second)" << endl;
+}
+
 int main(int argc, char ** argv)
 {
     //profile1();
     //profile2();
     //profile3();
 
+    int n = 10000000;
+
     string ids[5] = {
         "2fa07c3c-1ac1-4001-15e8-42e6000003a1",
         "a78e802f-1ac1-4001-15e8-c6b0000003a0",
@@ -121,21 +139,29 @@ int main(int argc, char ** argv)
 
     int nids = 5;
 
-    Date before = Date::now();
-    
-    int n = 10000000;
-    
-    for (unsigned i = 0;  i < n;  ++i) {
-        Id id(ids[i % nids]);
-        //if (id.type != Id::UUID)
-        //    cerr << "bad type" << endl;
-        //if (id.toString() != ids[i % nids])
-        //    cerr << "bad parse" << endl;
+    string hexIds[5], bigdecIds[5], strIds[5];
+    Id parsed[5];
+    for (unsigned i = 0;  i < nids;  ++i) {
+        hexIds[i] = ids[i];
+        hexIds[i].erase(std::remove(hexIds[i].begin(), hexIds[i].end(), '-'),
+                        hexIds[i].end());
+        bigdecIds[i] = to_string(7394206091425759590ULL + i);
+        strIds[i] = "user:" + ids[i];
+        parsed[i] = Id(ids[i]);
     }
 
-    Date after = Date::now();
-    double elapsed = after.secondsSince(before);
-    
-    cerr << "processed " << n << " in " << elapsed << "s ("
-         << 1.0 * n / elapsed << " per second)" << endl;
+    size_t total = 0;
+
+    profile("uuid parse", n, [&] (int i) { total += Id(ids[i % nids]).val1; });
+    profile("hex parse", n, [&] (int i) { total += Id(hexIds[i % nids]).val1; });
+    profile("bigdec parse", n, [&] (int i) { total += Id(bigdecIds[i % nids]).val1; });
+    profile("string parse", n, [&] (int i) { total += Id(strIds[i % nids]).len; });
+    profile("hash", n, [&] (int i) { total += parsed[i % nids].hash(); });
+    profile("equality", n,
+            [&] (int i)
+            {
+                total += parsed[i % nids] == parsed[(i / nids) % nids];
+            });
+
+    cerr << "(checksum " << total << ")" << endl;
 }
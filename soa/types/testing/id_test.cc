@@ -348,3 +348,56 @@ BOOST_AUTO_TEST_CASE( test_compound_id )
 {
     Id id(Id("hello"), Id("world"));
 }
+
+BOOST_AUTO_TEST_CASE( test_hex_id_digits )
+{
+    // Every hex digit in every position of both halves
+    const char * digits = "0123456789abcdef";
+    for (unsigned i = 0;  i < 32;  ++i) {
+        for (unsigned d = 0;  d < 16;  ++d) {
+            string s(32, 'a');
+            s[i] = digits[d];
+            Id id(s);
+            BOOST_CHECK_EQUAL(id.type, Id::HEX128LC);
+            BOOST_CHECK_EQUAL(id.toString(), s);
+
+            string uuid = s.substr(0, 8) + "-" + s.substr(8, 4) + "-"
+                + s.substr(12, 4) + "-" + s.substr(16, 4) + "-"
+                + s.substr(20, 12);
+            Id id2(uuid);
+            BOOST_CHECK_EQUAL(id2.type, Id::UUID);
+            BOOST_CHECK_EQUAL(id2.toString(), uuid);
+        }
+    }
+
+    // Characters just outside of the hex ranges and above 0x7f make it a
+    // string
+    const char * invalid = "/:@G`g\x80\xff";
+    for (unsigned i = 0;  i < 32;  ++i) {
+        for (const char * c = invalid;  *c;  ++c) {
+            string s(32, 'a');
+            s[i] = *c;
+            Id id(s);
+            BOOST_CHECK_EQUAL(id.type, Id::STR);
+            BOOST_CHECK_EQUAL(id.toString(), s);
+        }
+    }
+
+    // Upper case hex is accepted but printed in lower case
+    Id upper("0123456789ABCDEF0123456789abcdef");
+    BOOST_CHECK_EQUAL(upper.type, Id::HEX128LC);
+    BOOST_CHECK_EQUAL(upper.toString(), "0123456789abcdef0123456789abcdef");
+}
+
+BOOST_AUTO_TEST_CASE( test_moved_from_id )
+{
+    Id id("0828398c-5965-11e0-84c8-0026b937c8e1");
+    Id id2(std::move(id));
+    BOOST_CHECK_EQUAL(id, Id());
+    BOOST_CHECK_EQUAL(id.hash(), Id().hash());
+
+    Id id3;
+    id3 = std::move(id2);
+    BOOST_CHECK_EQUAL(id2, Id());
+    BOOST_CHECK_EQUAL(id3.toString(), "0828398c-5965-11e0-84c8-0026b937c8e1");
+}
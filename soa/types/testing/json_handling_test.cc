@@ -10,6 +10,7 @@
 
 #include <boost/test/unit_test.hpp>
 #include <iostream>
+#include <limits>
 #include "jml/db/persistent.h"
 #include "soa/types/string.h"
 #include "soa/types/json_parsing.h"
@@ -63,3 +64,56 @@ BOOST_AUTO_TEST_CASE(test_utf8_round_trip_streaming_ascii)
         BOOST_CHECK_EQUAL(str, str2);
     }
 }
+
+BOOST_AUTO_TEST_CASE(test_string_printing_context)
+{
+    auto print = [] (JsonPrintingContext & context)
+        {
+            context.startObject();
+            context.startMember("int");
+            context.writeInt(std::numeric_limits<int>::min());
+            context.startMember("long");
+            context.writeLongLong(std::numeric_limits<long long>::min());
+            context.startMember("unsigned");
+            context.writeUnsignedLongLong(std::numeric_limits<unsigned long long>::max());
+            context.startMember("zero");
+            context.writeUnsignedInt(0);
+            context.startMember("double");
+            context.writeDouble(0.1);
+            context.startMember("key \"quoted\"");
+            context.startArray();
+            context.newArrayElement();
+            context.writeString("tab\there\\");
+            context.newArrayElement();
+            context.writeStringUtf8(Utf8String("\xe2\x80\xa2skin"));
+            context.newArrayElement();
+            context.writeBool(false);
+            context.newArrayElement();
+            context.writeNull();
+            context.endArray();
+            context.startMember("json");
+            context.writeJson(Json::parse("{\"a\":[1,2]}"));
+            context.endObject();
+        };
+
+    std::ostringstream stream;
+    StreamJsonPrintingContext streamContext(stream);
+    print(streamContext);
+
+    std::string & buffer = StringJsonPrintingContext::threadBuffer();
+    StringJsonPrintingContext context(buffer);
+    print(context);
+
+    BOOST_CHECK_EQUAL(buffer, stream.str());
+
+    // The thread buffer comes back empty but keeps its storage
+    const char * data = buffer.data();
+    std::string & buffer2 = StringJsonPrintingContext::threadBuffer();
+    BOOST_CHECK_EQUAL(&buffer2, &buffer);
+    BOOST_CHECK(buffer2.empty());
+
+    StringJsonPrintingContext context2(buffer2);
+    print(context2);
+    BOOST_CHECK_EQUAL(buffer2, stream.str());
+    BOOST_CHECK_EQUAL((const void *)buffer2.data(), (const void *)data);
+}
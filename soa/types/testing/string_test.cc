@@ -11,6 +11,7 @@
 #include "soa/jsoncpp/json.h"
 #include "soa/types/dtoa.h"
 #include "jml/arch/format.h"
+#include "jml/arch/exception.h"
 
 using namespace std;
 using namespace ML;
@@ -119,6 +120,51 @@ BOOST_AUTO_TEST_CASE( test_u32_string )
 
 }
 
+BOOST_AUTO_TEST_CASE( test_utf8_ascii )
+{
+    // Long enough to go through the vectorized scan
+    string raw = "Mozilla/5.0 (Windows NT 6.1; WOW64) AppleWebKit/537.36";
+    Utf8String ascii(raw);
+    BOOST_CHECK(ascii.isAscii());
+    BOOST_CHECK_EQUAL(ascii.length(), raw.length());
+    BOOST_CHECK_EQUAL(ascii[8], U'5');
+    BOOST_CHECK_EQUAL(ascii.extractAscii(), raw);
+    BOOST_CHECK_EQUAL(Utf8String("tab\there").extractAscii(), "tab?here");
+
+    for (size_t i = 0;  i <= raw.length();  ++i) {
+        string s = raw;
+        if (i < s.length()) s[i] = '\xe9';
+        BOOST_CHECK_EQUAL(Utf8String::isAscii(s.data(), s.length()),
+                          i == raw.length());
+    }
+
+    Utf8String accented("saint-jérôme, Québec");
+    BOOST_CHECK(!accented.isAscii());
+    BOOST_CHECK_EQUAL(accented.length(), 20);
+    BOOST_CHECK_EQUAL(accented[7], U'é');
+    BOOST_CHECK_EQUAL(accented[8], U'r');
+    BOOST_CHECK_EQUAL(accented[9], U'ô');
+    BOOST_CHECK_EQUAL(accented[17], U'b');
+
+    Utf8String mixed = ascii;
+    BOOST_CHECK(mixed.isAscii());
+    mixed += accented;
+    BOOST_CHECK(!mixed.isAscii());
+    BOOST_CHECK_EQUAL(mixed.length(), raw.length() + 20);
+    mixed = raw;
+    BOOST_CHECK(mixed.isAscii());
+
+    Utf8String empty;
+    BOOST_CHECK(empty.isAscii());
+    BOOST_CHECK_EQUAL(empty.length(), 0);
+
+    const char buffer[] = "fr-CA\xc3\xa9";
+    BOOST_CHECK_EQUAL(Utf8String::fromBuffer(buffer, 5).rawString(), "fr-CA");
+    BOOST_CHECK(!Utf8String::fromBuffer(buffer, 7).isAscii());
+    BOOST_CHECK_THROW(Utf8String::fromBuffer(buffer, 6), ML::Exception);
+    BOOST_CHECK_THROW(Utf8String(string("\xff")), ML::Exception);
+}
+
 BOOST_AUTO_TEST_CASE( test_basic_dtoa )
 {
     double value = 365.0;
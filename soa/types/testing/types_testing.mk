@@ -5,5 +5,8 @@ $(eval $(call test,string_test,types arch utils boost_regex,boost))
 $(eval $(call test,json_handling_test,types arch utils value_description,boost))
 $(eval $(call test,value_description_test,types arch utils value_description,boost))
 $(eval $(call test,value_instance_test,types arch utils value_description,boost))
+$(eval $(call test,binary_json_test,types arch utils value_description,boost))
 $(eval $(call test,periodic_utils_test,types,boost))
+$(eval $(call test,url_test,types googleurl,boost))
 $(eval $(call program,id_profile,types))
+$(eval $(call program,date_parse_profile,types))
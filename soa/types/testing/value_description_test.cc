@@ -524,3 +524,169 @@ BOOST_AUTO_TEST_CASE( test_date_value_description_validation )
     BOOST_CHECK_EQUAL(numChildValidations, 1);
     BOOST_CHECK_EQUAL(numParentValidations, 1);
 }
+
+struct DispatchStructure {
+    DispatchStructure()
+        : i(0), id(0), ids(0), idx(0), d(0), di(0)
+    {
+    }
+
+    int i, id, ids, idx, d, di;
+};
+
+CREATE_STRUCTURE_DESCRIPTION(DispatchStructure)
+
+DispatchStructureDescription::
+DispatchStructureDescription()
+{
+    addField("i", &DispatchStructure::i, "");
+    addField("id", &DispatchStructure::id, "");
+    addField("ids", &DispatchStructure::ids, "");
+    addField("idx", &DispatchStructure::idx, "");
+    addField("d", &DispatchStructure::d, "");
+    addField("di", &DispatchStructure::di, "");
+}
+
+BOOST_AUTO_TEST_CASE( test_structure_field_dispatch )
+{
+    DispatchStructureDescription desc;
+
+    // Every field is found, whatever the prefixes it shares with the others
+    // and the order it comes in.
+    for (auto & f: desc.fields)
+        BOOST_CHECK_EQUAL(desc.findField(f.first), &f.second);
+
+    BOOST_CHECK(!desc.findField(""));
+    BOOST_CHECK(!desc.findField("idxx"));
+    BOOST_CHECK(!desc.findField("I"));
+
+    int unknown = 0;
+    desc.onUnknownField = [&] (DispatchStructure *, JsonParsingContext & context)
+        {
+            ++unknown;
+            context.skip();
+        };
+
+    string json = "{\"di\":6,\"x\":0,\"idx\":4,\"ids\":3,\"\":0,"
+                  "\"id\":2,\"i\":1,\"idxx\":0,\"d\":5}";
+
+    DispatchStructure result;
+    StreamingJsonParsingContext context(json, json.c_str(),
+                                        json.c_str() + json.size());
+    desc.parseJson(&result, context);
+
+    BOOST_CHECK_EQUAL(unknown, 3);
+    BOOST_CHECK_EQUAL(result.i, 1);
+    BOOST_CHECK_EQUAL(result.id, 2);
+    BOOST_CHECK_EQUAL(result.ids, 3);
+    BOOST_CHECK_EQUAL(result.idx, 4);
+    BOOST_CHECK_EQUAL(result.d, 5);
+    BOOST_CHECK_EQUAL(result.di, 6);
+}
+
+struct PrintedBase {
+    PrintedBase() : count(0) {}
+    unsigned count;
+};
+
+struct Printed : PrintedBase {
+    Printed()
+        : b(false), i(0), l(0), ul(0), ll(0), ull(0), f(0), d(0), withDefault(3)
+    {
+    }
+
+    bool b;
+    int i;
+    long l;
+    unsigned long ul;
+    long long ll;
+    unsigned long long ull;
+    float f;
+    double d;
+    std::string s;
+    Utf8String u;
+    int withDefault;
+    Id id;
+    std::vector<int> ints;
+    S2 nested;
+};
+
+CREATE_STRUCTURE_DESCRIPTION(PrintedBase);
+CREATE_STRUCTURE_DESCRIPTION(Printed);
+
+PrintedBaseDescription::PrintedBaseDescription()
+{
+    addField("count", &PrintedBase::count, "");
+}
+
+PrintedDescription::PrintedDescription()
+{
+    addParent<PrintedBase>();
+    addField("b", &Printed::b, "");
+    addField("i", &Printed::i, "");
+    addField("l", &Printed::l, "");
+    addField("ul", &Printed::ul, "");
+    addField("ll", &Printed::ll, "");
+    addField("ull", &Printed::ull, "");
+    addField("f", &Printed::f, "");
+    addField("d", &Printed::d, "");
+    addField("s", &Printed::s, "");
+    addField("u", &Printed::u, "");
+    addField("withDefault", &Printed::withDefault, "", 3);
+    addField("id", &Printed::id, "");
+    addField("ints", &Printed::ints, "");
+    addField("nested", &Printed::nested, "");
+}
+
+BOOST_AUTO_TEST_CASE( test_structure_print_string_context )
+{
+    PrintedDescription desc;
+
+    BOOST_CHECK(desc.getField("count").printString);
+    BOOST_CHECK(desc.getField("d").printString);
+    BOOST_CHECK(desc.getField("u").printString);
+    BOOST_CHECK(!desc.getField("withDefault").printString);
+    BOOST_CHECK(!desc.getField("id").printString);
+    BOOST_CHECK(!desc.getField("nested").printString);
+
+    auto check = [&] (const Printed & val)
+        {
+            std::ostringstream stream;
+            StreamJsonPrintingContext streamContext(stream);
+            desc.printJson(&val, streamContext);
+
+            std::string output;
+            StringJsonPrintingContext context(output);
+            desc.printJson(&val, context);
+
+            BOOST_CHECK_EQUAL(output, stream.str());
+            return output;
+        };
+
+    Printed val;
+    BOOST_CHECK_EQUAL(check(val),
+                      "{\"count\":0,\"b\":false,\"i\":0,\"l\":0,\"ul\":0,"
+                      "\"ll\":0,\"ull\":0,\"f\":0,\"d\":0,\"nested\":{}}");
+
+    val.count = std::numeric_limits<unsigned>::max();
+    val.b = true;
+    val.i = std::numeric_limits<int>::min();
+    val.l = std::numeric_limits<long>::min();
+    val.ul = std::numeric_limits<unsigned long>::max();
+    val.ll = -12345678901234LL;
+    val.ull = 12345678901234ULL;
+    val.f = 0.1;
+    val.d = std::numeric_limits<double>::infinity();
+    val.s = "tab\there \"quoted\" back\\slash";
+    val.u = Utf8String("\xe2\x80\xa2skin/\n");
+    val.withDefault = 4;
+    val.id = Id("some-id");
+    val.ints = { 1, -2, 3 };
+    val.nested.val1 = "one";
+    val.nested.val2 = "two";
+    check(val);
+
+    val.d = -0.5;
+    val.withDefault = 3;
+    check(val);
+}
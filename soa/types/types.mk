@@ -33,10 +33,11 @@ LIBVALUE_DESCRIPTION_SOURCES := \
 	value_description.cc \
 	json_parsing.cc \
 	json_printing.cc \
+	binary_json.cc \
 	periodic_utils_value_descriptions.cc
 
 LIBVALUE_DESCRIPTION_LINK := \
-	arch types
+	arch types boost_thread
 
 $(eval $(call library,value_description,$(LIBVALUE_DESCRIPTION_SOURCES),$(LIBVALUE_DESCRIPTION_LINK)))
 
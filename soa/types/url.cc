@@ -3,10 +3,12 @@
 
 #include "googleurl/src/gurl.h"
 #include "googleurl/src/url_util.h"
+#include "googleurl/src/url_parse.h"
 #include "jml/arch/exception.h"
 #include "jml/db/persistent.h"
 
 #include <iostream>
+#include <cstring>
 
 using namespace std;
 
@@ -22,61 +24,257 @@ struct Init {
     }
 } init;
 
+bool isComponent(const char * spec, const url_parse::Component & comp,
+                 const char * str, int len)
+{
+    return comp.len == len && strncmp(spec + comp.begin, str, len) == 0;
+}
+
+/** Lower case host name that the canonicalization leaves as it is.  The
+    last label must start with a letter, as otherwise the host could be an
+    IPv4 address written in one of the forms that get rewritten. */
+bool isSimpleHost(const char * host, int len)
+{
+    if (len == 0 || host[0] == '.') return false;
+
+    int label = 0;   // start of the current label
+    for (int i = 0;  i < len;  ++i) {
+        char c = host[i];
+        if (c == '.') {
+            if (host[i - 1] == '.') return false;
+            label = i + 1;
+        }
+        else if (!(c >= 'a' && c <= 'z') && !(c >= '0' && c <= '9') && c != '-')
+            return false;
+    }
+
+    return label < len && host[label] >= 'a' && host[label] <= 'z';
 }
 
+bool isSimplePort(const char * port, int len)
+{
+    if (len == 0 || len > 5) return false;
+
+    int value = 0;
+    for (int i = 0;  i < len;  ++i) {
+        if (port[i] < '0' || port[i] > '9') return false;
+        value = value * 10 + (port[i] - '0');
+    }
+    return value <= 65535;
+}
+
+/** Path that needs neither escaping, unescaping nor the resolution of dot
+    segments. */
+bool isSimplePath(const char * path, int len)
+{
+    for (int i = 0;  i < len;  ++i) {
+        char c = path[i];
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+            || (c >= '0' && c <= '9'))
+            continue;
+        if (c == '.') {
+            if (i == 0 || path[i - 1] == '/') return false;
+            continue;
+        }
+        if (!strchr("-_~!$&'()*+,;=:@/", c)) return false;
+    }
+    return true;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* URL                                                                       */
+/*****************************************************************************/
+
+struct Url::Canonical {
+    GURL url;
+    std::string host;
+    std::string path;
+};
+
 Url::
 Url()
-    : url(new GURL())
+    : simple(false), canonical_(nullptr)
 {
 }
 
 Url::
 Url(const std::string & s_)
-    : original(s_)
+    : simple(false), canonical_(nullptr)
 {
-    init(original);
+    init(s_);
 }
 
 Url::
 Url(const Utf8String & s_)
-    : original(s_.rawString())
+    : simple(false), canonical_(nullptr)
 {
-    init(original);
+    init(s_.rawString());
 }
 
 Url::
 Url(const Utf32String & s_)
-        : original(s_.utf8String())
+    : simple(false), canonical_(nullptr)
+{
+    init(s_.utf8String());
+}
+
+Url::
+Url(const Url & other)
+    : original(other.original),
+      simple(other.simple),
+      simpleHost(other.simpleHost),
+      simplePath(other.simplePath),
+      canonical_(nullptr)
+{
+}
+
+Url::
+Url(Url && other) noexcept
+    : original(std::move(other.original)),
+      simple(other.simple),
+      simpleHost(std::move(other.simpleHost)),
+      simplePath(std::move(other.simplePath)),
+      canonical_(other.canonical_.exchange(nullptr))
 {
-    init(original);
+    other.simple = false;
+}
+
+Url &
+Url::
+operator = (const Url & other)
+{
+    if (this == &other) return *this;
+    Url copy(other);
+    return *this = std::move(copy);
+}
+
+Url &
+Url::
+operator = (Url && other) noexcept
+{
+    if (this == &other) return *this;
+
+    original = std::move(other.original);
+    simple = other.simple;
+    simpleHost = std::move(other.simpleHost);
+    simplePath = std::move(other.simplePath);
+    delete canonical_.exchange(other.canonical_.exchange(nullptr));
+
+    other.simple = false;
+    return *this;
+}
+
+Url::
+~Url()
+{
+    delete canonical_.load();
 }
 
 void
 Url::init(std::string s)
 {
-    if (s == "") {
-        url.reset(new GURL(s));
+    original = std::move(s);
+    delete canonical_.exchange(nullptr);
+    split();
+}
+
+void
+Url::
+split()
+{
+    simple = false;
+    simpleHost.clear();
+    simplePath.clear();
+
+    if (original.empty()) return;
+
+    // Leading and trailing spaces are trimmed by the canonicalization.
+    if ((unsigned char)original[0] <= ' '
+        || (unsigned char)original[original.size() - 1] <= ' ')
         return;
-    }
 
-    if (s.find("://") == string::npos) {
-        s = "http://" + s;
+    std::string prefixed;
+    const std::string * s = &original;
+    if (original.find("://") == string::npos) {
+        prefixed = "http://" + original;
+        s = &prefixed;
     }
-    url.reset(new GURL(s));
-
-    if (url->possibly_invalid_spec().empty()) {
-        //cerr << "bad parse 1" << endl;
-        url.reset(new GURL("http://" + s));
-        if (url->possibly_invalid_spec().empty()) {
-            //cerr << "bad parse 2" << endl;
-            url.reset(new GURL("http://" + s + "/"));
+
+    const char * spec = s->c_str();
+    int len = s->length();
+
+    url_parse::Parsed parsed;
+    url_parse::ParseStandardURL(spec, len, &parsed);
+
+    if (!isComponent(spec, parsed.scheme, "http", 4)
+        && !isComponent(spec, parsed.scheme, "https", 5))
+        return;
+    if (parsed.username.is_valid() || parsed.password.is_valid())
+        return;
+    if (!isSimpleHost(spec + parsed.host.begin, parsed.host.len))
+        return;
+    if (parsed.port.is_valid()
+        && !isSimplePort(spec + parsed.port.begin, parsed.port.len))
+        return;
+    if (parsed.path.is_nonempty()
+        && !isSimplePath(spec + parsed.path.begin, parsed.path.len))
+        return;
+
+    simpleHost.assign(spec + parsed.host.begin, parsed.host.len);
+    if (parsed.path.is_nonempty())
+        simplePath.assign(spec + parsed.path.begin, parsed.path.len);
+    else simplePath = "/";
+    simple = true;
+}
+
+const Url::Canonical &
+Url::
+canonicalized() const
+{
+    Canonical * current = canonical_.load(std::memory_order_acquire);
+    if (current) return *current;
+
+    std::unique_ptr<Canonical> result(new Canonical());
+    GURL & url = result->url;
+
+    if (!original.empty()) {
+        string s = original;
+        if (s.find("://") == string::npos) {
+            s = "http://" + s;
+        }
+        url = GURL(s);
+
+        if (url.possibly_invalid_spec().empty()) {
+            //cerr << "bad parse 1" << endl;
+            url = GURL("http://" + s);
+            if (url.possibly_invalid_spec().empty()) {
+                //cerr << "bad parse 2" << endl;
+                url = GURL("http://" + s + "/");
+            }
         }
     }
+
+    result->host = url.host();
+    if (url.scheme() == "file")
+        result->path = url.host() + url.path();
+    else result->path = url.path();
+
+    // Another thread may have got there first, in which case its result is
+    // the one that is kept.
+    if (canonical_.compare_exchange_strong(current, result.get(),
+                                           std::memory_order_acq_rel))
+        return *result.release();
+    return *current;
 }
 
+const GURL &
 Url::
-~Url()
+gurl() const
 {
+    return canonicalized().url;
 }
 
 std::string
@@ -102,7 +300,7 @@ Url::
 c_str() const
 {
     if (valid())
-        return url->spec().c_str();
+        return gurl().spec().c_str();
     return original.c_str();
 }
 
@@ -110,14 +308,14 @@ bool
 Url::
 valid() const
 {
-    return url->is_valid();
+    return simple || gurl().is_valid();
 }
 
 bool
 Url::
 empty() const
 {
-    return url->is_empty();
+    return !simple && gurl().is_empty();
 }
 
 std::string
@@ -125,72 +323,85 @@ Url::
 canonical() const
 {
     if (!valid()) return "";
-    return url->spec();
+    return gurl().spec();
 }
 
 std::string
 Url::
 scheme() const
 {
-    return url->scheme();
+    return gurl().scheme();
 }
 
 std::string
 Url::
 username() const
 {
-    return url->username();
+    return gurl().username();
 }
 
 std::string
 Url::
 password() const
 {
-    return url->password();
+    return gurl().password();
 }
 
-std::string
+const std::string &
 Url::
 host() const
 {
-    return url->host();
+    if (simple) return simpleHost;
+    return canonicalized().host;
 }
 
 bool
 Url::
 hostIsIpAddress() const
 {
-    return url->HostIsIPAddress();
+    return !simple && gurl().HostIsIPAddress();
 }
 
 bool
 Url::
 domainMatches(const std::string & str) const
 {
-    return url->DomainIs(str.c_str(), str.length());
+    if (!simple)
+        return gurl().DomainIs(str.c_str(), str.length());
+
+    // Same as GURL::DomainIs() for a host that is already in lower case
+    // and doesn't end with a dot.
+    size_t len = str.length();
+    if (len == 0 || simpleHost.length() < len)
+        return false;
+
+    size_t start = simpleHost.length() - len;
+    if (simpleHost.compare(start, len, str) != 0)
+        return false;
+
+    return str[0] == '.' || start == 0 || simpleHost[start - 1] == '.';
 }
 
 int
 Url::
 port() const
 {
-    return url->IntPort();
+    return gurl().IntPort();
 }
 
-std::string
+const std::string &
 Url::
 path() const
 {
-    if (url->scheme() == "file")
-        return url->host() + url->path();
-    else return url->path();
+    if (simple) return simplePath;
+    return canonicalized().path;
 }
 
 std::string
 Url::
 query() const
 {
-    return url->query();
+    return gurl().query();
 }
 
 uint64_t
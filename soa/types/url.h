@@ -9,6 +9,7 @@
 
 #include <string>
 #include <memory>
+#include <atomic>
 #include "jml/db/persistent_fwd.h"
 #include "string.h"
 
@@ -16,6 +17,20 @@ class GURL;
 
 namespace Datacratic {
 
+/** A URL.
+
+    Construction only splits the URL into its components, without
+    canonicalizing anything.  When the URL is a plain http or https one
+    whose host and path are already in their canonical form, which is the
+    case for nearly all of the URLs of the bid requests, host() and path()
+    return them as they were found and domainMatches() works on the host.
+
+    For any other URL, and for the accessors that need it, the URL is
+    canonicalized through a GURL on first use and the result kept for the
+    lifetime of the object.  This is thread safe, so that a const Url can
+    be used by several filters at once.
+*/
+
 struct Url {
     Url();
     explicit Url(const std::string & s);
@@ -23,6 +38,11 @@ struct Url {
     explicit Url(const Utf32String & s);
     ~Url();
 
+    Url(const Url & other);
+    Url(Url && other) noexcept;
+    Url & operator = (const Url & other);
+    Url & operator = (Url && other) noexcept;
+
     void init(std::string s);
 
     Utf8String toUtf8String() const;
@@ -37,21 +57,39 @@ struct Url {
     std::string scheme() const;
     std::string username() const;
     std::string password() const;
-    std::string host() const;
+    const std::string & host() const;
     bool hostIsIpAddress() const;
     bool domainMatches(const std::string & str) const;
     int port() const;
-    std::string path() const;
+    const std::string & path() const;
     std::string query() const;
 
     uint64_t urlHash();
     uint64_t hostHash();
 
-    std::shared_ptr<GURL> url;
+    /** The canonicalized URL. */
+    const GURL & gurl() const;
+
     std::string original;
 
     void serialize(ML::DB::Store_Writer & store) const;
     void reconstitute(ML::DB::Store_Reader & store);
+
+private:
+    struct Canonical;
+
+    /** Records the components of original that are already canonical. */
+    void split();
+
+    const Canonical & canonicalized() const;
+
+    /** Set when original is a valid http or https URL whose canonical host
+        and path are simpleHost and simplePath. */
+    bool simple;
+    std::string simpleHost;
+    std::string simplePath;
+
+    mutable std::atomic<Canonical *> canonical_;
 };
 
 inline std::ostream & operator << (std::ostream & stream, const Url & url)
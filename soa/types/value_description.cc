@@ -95,6 +95,35 @@ registerValueDescription(const std::type_info & type,
 #endif
 }
 
+void
+StructureDescriptionBase::
+indexFields()
+{
+    // Keep the table at most half full so that the probe sequences stay
+    // short, including for the misses on unknown fields.
+    size_t size = 8;
+    while (size < fields.size() * 2)
+        size *= 2;
+
+    std::vector<FieldSlot> table(size);
+
+    for (auto & f: fields) {
+        // Use the name owned by the field description as it's stable.
+        const FieldDescription & fd = f.second;
+        uint64_t hash = hashFieldName(fd.fieldName.c_str());
+
+        size_t i = hash & (size - 1);
+        while (table[i].field)
+            i = (i + 1) & (size - 1);
+
+        table[i].hash = hash;
+        table[i].name = fd.fieldName.c_str();
+        table[i].field = &fd;
+    }
+
+    fieldTable.swap(table);
+}
+
 void
 ValueDescription::
 convertAndCopy(const void * from,
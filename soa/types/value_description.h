@@ -12,7 +12,9 @@
 #include <memory>
 #include <unordered_map>
 #include <set>
+#include <cstring>
 #include "jml/arch/exception.h"
+#include "jml/compiler/compiler.h"
 #include "jml/arch/demangle.h"
 #include "jml/arch/demangle.h"
 #include "jml/utils/exc_assert.h"
@@ -191,6 +193,14 @@ struct ValueDescription {
         int offset;
         int fieldNum;
 
+        /** Prints the field, if it's not the default, straight into a
+            StringJsonPrintingContext.  Only set when the description is
+            the default one of a type with a StringJsonWriter.
+        */
+        void (*printString)(const void * val,
+                            const FieldDescription & field,
+                            StringJsonPrintingContext & context) = nullptr;
+
         void* getFieldPtr(void* obj) const
         {
             return ((char*) obj) + offset;
@@ -734,6 +744,87 @@ struct ValueDescriptionWithDefault : public Base {
 };
 
 
+/*****************************************************************************/
+/* STRING JSON WRITER                                                        */
+/*****************************************************************************/
+
+/** Writes the values of a basic type into a StringJsonPrintingContext with
+    non-virtual calls, producing exactly what the type's DefaultDescription
+    would through the virtual interfaces.  The structure descriptions use
+    it for the fields that have the default description of such a type,
+    which are the bulk of what gets printed.
+*/
+
+template<typename T, typename Enable = void>
+struct StringJsonWriter {
+    static const bool enabled = false;
+};
+
+#define DATACRATIC_STRING_JSON_WRITER(Type, method, isDefaultExpr)      \
+    template<>                                                          \
+    struct StringJsonWriter<Type> {                                     \
+        static const bool enabled = true;                               \
+                                                                        \
+        static bool isDefault(const Type & val)                         \
+        {                                                               \
+            return isDefaultExpr;                                       \
+        }                                                               \
+                                                                        \
+        static void write(const Type & val,                             \
+                          StringJsonPrintingContext & context)          \
+        {                                                               \
+            context.StringJsonPrintingContext::method(val);             \
+        }                                                               \
+    }
+
+DATACRATIC_STRING_JSON_WRITER(bool, writeBool, false);
+DATACRATIC_STRING_JSON_WRITER(signed int, writeInt, false);
+DATACRATIC_STRING_JSON_WRITER(unsigned int, writeInt, false);
+DATACRATIC_STRING_JSON_WRITER(signed long, writeLong, false);
+DATACRATIC_STRING_JSON_WRITER(unsigned long, writeUnsignedLong, false);
+DATACRATIC_STRING_JSON_WRITER(signed long long, writeLongLong, false);
+DATACRATIC_STRING_JSON_WRITER(unsigned long long, writeUnsignedLongLong, false);
+DATACRATIC_STRING_JSON_WRITER(float, writeFloat, false);
+DATACRATIC_STRING_JSON_WRITER(double, writeDouble, false);
+DATACRATIC_STRING_JSON_WRITER(std::string, writeString, val.empty());
+DATACRATIC_STRING_JSON_WRITER(Utf8String, writeStringUtf8, val.empty());
+
+#undef DATACRATIC_STRING_JSON_WRITER
+
+template<typename T>
+void printStringJsonField(const void * val,
+                          const ValueDescription::FieldDescription & field,
+                          StringJsonPrintingContext & context)
+{
+    const T & v = *reinterpret_cast<const T *>(val);
+    if (StringJsonWriter<T>::isDefault(v))
+        return;
+    context.StringJsonPrintingContext::startMember(field.fieldName);
+    StringJsonWriter<T>::write(v, context);
+}
+
+/** Return the printString function of a field of type T with the given
+    description, or null if it has to go through the description.
+*/
+template<typename T>
+typename std::enable_if<StringJsonWriter<T>::enabled,
+                        decltype(ValueDescription::FieldDescription::printString)>::type
+getStringJsonFieldPrinter(const ValueDescription & description)
+{
+    // Any other description may print or skip the values its own way
+    if (typeid(description) != typeid(DefaultDescription<T>))
+        return nullptr;
+    return &printStringJsonField<T>;
+}
+
+template<typename T>
+typename std::enable_if<!StringJsonWriter<T>::enabled,
+                        decltype(ValueDescription::FieldDescription::printString)>::type
+getStringJsonFieldPrinter(const ValueDescription & description)
+{
+    return nullptr;
+}
+
 
 /*****************************************************************************/
 /* STRUCTURE DESCRIPTION BASE                                                */
@@ -791,6 +882,58 @@ struct StructureDescriptionBase {
 
     std::vector<Fields::const_iterator> orderedFields;
 
+    /** Open addressing hash table over the field names, used to dispatch the
+        members of the objects being parsed with a single hash of the name
+        and usually a single comparison instead of a walk down the map.
+
+        It's rebuilt by indexFields() whenever a field is added, so it's
+        never modified while parsing.  Empty slots have a null field.
+    */
+    struct FieldSlot {
+        FieldSlot()
+            : hash(0), name(nullptr), field(nullptr)
+        {
+        }
+
+        uint64_t hash;
+        const char * name;
+        const FieldDescription * field;
+    };
+
+    std::vector<FieldSlot> fieldTable;
+
+    static uint64_t hashFieldName(const char * name)
+    {
+        // FNV-1a
+        uint64_t result = 14695981039346656037ULL;
+        for (; *name;  ++name)
+            result = (result ^ (unsigned char)*name) * 1099511628211ULL;
+        return result;
+    }
+
+    /** Rebuild the field table from the fields. */
+    void indexFields();
+
+    /** Return the description of the field with the given name or null if
+        there is no such field.
+    */
+    const FieldDescription * findField(const char * name) const
+    {
+        if (JML_UNLIKELY(fieldTable.empty()))
+            return nullptr;
+
+        uint64_t hash = hashFieldName(name);
+        size_t mask = fieldTable.size() - 1;
+
+        for (size_t i = hash & mask;;  i = (i + 1) & mask) {
+            const FieldSlot & slot = fieldTable[i];
+            if (!slot.field)
+                return nullptr;
+            if (slot.hash == hash && strcmp(slot.name, name) == 0)
+                return slot.field;
+        }
+    }
+
     struct Exception: public ML::Exception {
         Exception(JsonParsingContext & context,
                   const std::string & message)
@@ -821,14 +964,13 @@ struct StructureDescriptionBase {
                 {
                     try {
                         auto n = context.fieldNamePtr();
-                        auto it = fields.find(n);
-                        if (it == fields.end()) {
+                        auto field = findField(n);
+                        if (!field) {
                             context.onUnknownField(owner);
                         }
                         else {
-                            it->second.description
-                                ->parseJson(addOffset(output,
-                                                      it->second.offset),
+                            field->description
+                                ->parseJson(addOffset(output, field->offset),
                                             context);
                         }
                     }
@@ -860,6 +1002,11 @@ struct StructureDescriptionBase {
 
     virtual void printJson(const void * input, JsonPrintingContext & context) const
     {
+        if (StringJsonPrintingContext * stringContext = context.stringContext()) {
+            printJsonString(input, *stringContext);
+            return;
+        }
+
         context.startObject();
 
         for (const auto & it: orderedFields) {
@@ -868,13 +1015,40 @@ struct StructureDescriptionBase {
             auto mbr = addOffset(input, fd.offset);
             if (fd.description->isDefault(mbr))
                 continue;
-            context.startMember(it->first);
+            context.startMember(fd.fieldName);
             fd.description->printJson(mbr, context);
         }
         
         context.endObject();
     }
 
+    /** Same output as printJson(), but the fields with a printString
+        function are written directly and the others with non-virtual calls
+        to the context.
+    */
+    void printJsonString(const void * input,
+                         StringJsonPrintingContext & context) const
+    {
+        context.StringJsonPrintingContext::startObject();
+
+        for (const auto & it: orderedFields) {
+            auto & fd = it->second;
+
+            auto mbr = addOffset(input, fd.offset);
+            if (fd.printString) {
+                fd.printString(mbr, fd, context);
+                continue;
+            }
+
+            if (fd.description->isDefault(mbr))
+                continue;
+            context.StringJsonPrintingContext::startMember(fd.fieldName);
+            fd.description->printJson(mbr, context);
+        }
+
+        context.StringJsonPrintingContext::endObject();
+    }
+
     virtual bool onEntry(void * output, JsonParsingContext & context) const = 0;
     virtual void onExit(void * output, JsonParsingContext & context) const = 0;
 };
@@ -976,7 +1150,9 @@ struct StructureDescription
         Struct * p = nullptr;
         fd.offset = (size_t)&(p->*field);
         fd.fieldNum = fields.size() - 1;
+        fd.printString = getStringJsonFieldPrinter<V>(*description);
         orderedFields.push_back(it);
+        indexFields();
         //using namespace std;
         //cerr << "offset = " << fd.offset << endl;
     }
@@ -1117,8 +1293,11 @@ addParent(ValueDescriptionT<V> * description_)
         
         fd.offset = ofd.offset + ofs;
         fd.fieldNum = fields.size() - 1;
+        fd.printString = ofd.printString;
         orderedFields.push_back(it);
     }
+
+    indexFields();
 }
 
 
@@ -1862,10 +2041,10 @@ std::string jsonEncodeStr(const T & obj,
                           typename std::enable_if<!hasToJson<T>::value>::type * = 0)
 {
     static auto desc = getDefaultDescriptionShared<T>();
-    std::ostringstream stream;
-    StreamJsonPrintingContext context(stream);
+    std::string result;
+    StringJsonPrintingContext context(result);
     desc->printJson(&obj, context);
-    return std::move(stream.str());
+    return result;
 }
 
 // jsonEncode implementation for any type which: